@@ -33,6 +33,9 @@
 #define VCPU_STAT(x) { #x, offsetof(struct kvm_vcpu, stat.x), KVM_STAT_VCPU }
 
 struct kvm_stats_debugfs_item debugfs_entries[] = {
+	VCPU_STAT(halt_successful_poll),
+	VCPU_STAT(halt_failed_poll),
+	VCPU_STAT(halt_poll_invalid),
 	{ NULL }
 };
 
@@ -159,6 +159,9 @@ struct kvm_vm_stat {
 };
 
 struct kvm_vcpu_stat {
+	u32 halt_successful_poll;
+	u32 halt_failed_poll;
+	u32 halt_poll_invalid;
 	u32 halt_wakeup;
 };
 
@@ -85,4 +85,11 @@
 #define SO_ATTACH_BPF		50
 #define SO_DETACH_BPF		SO_DETACH_FILTER
 
+#define SO_ZEROCOPY		51
+
+#define SO_ATTACH_REUSEPORT_CBPF	52
+#define SO_ATTACH_REUSEPORT_EBPF	53
+
+#define SO_BUSY_POLL_BUDGET	54
+
 #endif /* _UAPI__ASM_AVR32_SOCKET_H */
@@ -81,6 +81,13 @@
 #define SO_ATTACH_BPF		0x0034
 #define SO_DETACH_BPF		SO_DETACH_FILTER
 
+#define SO_ZEROCOPY		0x0035
+
+#define SO_ATTACH_REUSEPORT_CBPF	0x0036
+#define SO_ATTACH_REUSEPORT_EBPF	0x0037
+
+#define SO_BUSY_POLL_BUDGET	0x0038
+
 /* Security levels - as per NRL IPv6 - don't actually do anything */
 #define SO_SECURITY_AUTHENTICATION		0x5001
 #define SO_SECURITY_ENCRYPTION_TRANSPORT	0x5002
@@ -0,0 +1,172 @@
+/*
+ * Poly1305 authenticator algorithm, RFC7539, SIMD glue code
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/internal/hash.h>
+#include <crypto/poly1305.h>
+#include <linux/crypto.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <asm/i387.h>
+#include <asm/xcr.h>
+#include <asm/xsave.h>
+
+struct poly1305_simd_desc_ctx {
+	struct poly1305_desc_ctx base;
+	/* derived key table r^4, r^3, r^2, r has been computed */
+	bool rtab_set;
+	/* R0..R4, S1..S4 of r^4, r^3, r^2 and r in 64-bit lanes */
+	u32 rtab[9][8];
+};
+
+asmlinkage void poly1305_4block_avx2(u32 *h, const u8 *src, const u32 *rtab,
+				     unsigned int blocks);
+
+/* a = a * b mod 2^130 - 5, both in 26-bit limbs */
+static void poly1305_simd_mult(u32 *a, const u32 *b)
+{
+	u32 s1 = b[1] * 5, s2 = b[2] * 5, s3 = b[3] * 5, s4 = b[4] * 5;
+	u64 d0, d1, d2, d3, d4;
+
+	d0 = (u64)a[0] * b[0] + (u64)a[1] * s4 + (u64)a[2] * s3 +
+	     (u64)a[3] * s2 + (u64)a[4] * s1;
+	d1 = (u64)a[0] * b[1] + (u64)a[1] * b[0] + (u64)a[2] * s4 +
+	     (u64)a[3] * s3 + (u64)a[4] * s2;
+	d2 = (u64)a[0] * b[2] + (u64)a[1] * b[1] + (u64)a[2] * b[0] +
+	     (u64)a[3] * s4 + (u64)a[4] * s3;
+	d3 = (u64)a[0] * b[3] + (u64)a[1] * b[2] + (u64)a[2] * b[1] +
+	     (u64)a[3] * b[0] + (u64)a[4] * s4;
+	d4 = (u64)a[0] * b[4] + (u64)a[1] * b[3] + (u64)a[2] * b[2] +
+	     (u64)a[3] * b[1] + (u64)a[4] * b[0];
+
+	d1 += d0 >> 26;       a[0] = d0 & 0x3ffffff;
+	d2 += d1 >> 26;       a[1] = d1 & 0x3ffffff;
+	d3 += d2 >> 26;       a[2] = d2 & 0x3ffffff;
+	d4 += d3 >> 26;       a[3] = d3 & 0x3ffffff;
+	a[0] += (d4 >> 26) * 5; a[4] = d4 & 0x3ffffff;
+	a[1] += a[0] >> 26;   a[0] &= 0x3ffffff;
+}
+
+static void poly1305_simd_setrtab(struct poly1305_simd_desc_ctx *sctx)
+{
+	u32 rn[5];
+	int i, lane;
+
+	memcpy(rn, sctx->base.r, sizeof(rn));
+	/* lane 3 takes r, lane 0 takes r^4 */
+	for (lane = 3; lane >= 0; lane--) {
+		if (lane != 3)
+			poly1305_simd_mult(rn, sctx->base.r);
+		for (i = 0; i < 5; i++) {
+			sctx->rtab[i][lane * 2] = rn[i];
+			sctx->rtab[i][lane * 2 + 1] = 0;
+		}
+		for (i = 1; i < 5; i++) {
+			sctx->rtab[4 + i][lane * 2] = rn[i] * 5;
+			sctx->rtab[4 + i][lane * 2 + 1] = 0;
+		}
+	}
+	sctx->rtab_set = true;
+}
+
+static int poly1305_simd_init(struct shash_desc *desc)
+{
+	struct poly1305_simd_desc_ctx *sctx = shash_desc_ctx(desc);
+
+	sctx->rtab_set = false;
+
+	return crypto_poly1305_init(desc);
+}
+
+static int poly1305_simd_update(struct shash_desc *desc,
+				const u8 *src, unsigned int srclen)
+{
+	struct poly1305_simd_desc_ctx *sctx = shash_desc_ctx(desc);
+	struct poly1305_desc_ctx *dctx = &sctx->base;
+	unsigned int bytes;
+
+	if (srclen < 4 * POLY1305_BLOCK_SIZE || !irq_fpu_usable())
+		return crypto_poly1305_update(desc, src, srclen);
+
+	/* complete a pending partial block the generic way */
+	if (unlikely(dctx->buflen)) {
+		bytes = min(srclen, POLY1305_BLOCK_SIZE - dctx->buflen);
+		crypto_poly1305_update(desc, src, bytes);
+		src += bytes;
+		srclen -= bytes;
+	}
+
+	if (unlikely(!dctx->sset)) {
+		bytes = crypto_poly1305_setdesckey(dctx, src, srclen);
+		src += srclen - bytes;
+		srclen = bytes;
+	}
+
+	if (dctx->sset && srclen >= 4 * POLY1305_BLOCK_SIZE) {
+		if (unlikely(!sctx->rtab_set))
+			poly1305_simd_setrtab(sctx);
+
+		bytes = rounddown(srclen, 4 * POLY1305_BLOCK_SIZE);
+		kernel_fpu_begin();
+		poly1305_4block_avx2(dctx->h, src, &sctx->rtab[0][0],
+				     bytes / POLY1305_BLOCK_SIZE);
+		kernel_fpu_end();
+		src += bytes;
+		srclen -= bytes;
+	}
+
+	if (srclen)
+		return crypto_poly1305_update(desc, src, srclen);
+
+	return 0;
+}
+
+static struct shash_alg alg = {
+	.digestsize	= POLY1305_DIGEST_SIZE,
+	.init		= poly1305_simd_init,
+	.update		= poly1305_simd_update,
+	.final		= crypto_poly1305_final,
+	.setkey		= crypto_poly1305_setkey,
+	.descsize	= sizeof(struct poly1305_simd_desc_ctx),
+	.base		= {
+		.cra_name		= "poly1305",
+		.cra_driver_name	= "poly1305-simd",
+		.cra_priority		= 300,
+		.cra_flags		= CRYPTO_ALG_TYPE_SHASH,
+		.cra_alignmask		= sizeof(u32) - 1,
+		.cra_blocksize		= POLY1305_BLOCK_SIZE,
+		.cra_module		= THIS_MODULE,
+	},
+};
+
+static int __init poly1305_simd_mod_init(void)
+{
+	u64 xcr0;
+
+	if (!cpu_has_avx || !cpu_has_avx2 || !cpu_has_osxsave)
+		return -ENODEV;
+
+	xcr0 = xgetbv(XCR_XFEATURE_ENABLED_MASK);
+	if ((xcr0 & (XSTATE_SSE | XSTATE_YMM)) != (XSTATE_SSE | XSTATE_YMM))
+		return -ENODEV;
+
+	return crypto_register_shash(&alg);
+}
+
+static void __exit poly1305_simd_mod_exit(void)
+{
+	crypto_unregister_shash(&alg);
+}
+
+module_init(poly1305_simd_mod_init);
+module_exit(poly1305_simd_mod_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Poly1305 authenticator, AVX2 accelerated");
+MODULE_ALIAS_CRYPTO("poly1305");
+MODULE_ALIAS_CRYPTO("poly1305-simd");
@@ -15,7 +15,9 @@
  * Simple spin lock operations.  There are two variants, one clears IRQ's
  * on the local processor, one does not.
  *
- * These are fair FIFO ticket locks, which support up to 2^16 CPUs.
+ * These are fair FIFO ticket locks, which support up to 2^16 CPUs, or,
+ * with CONFIG_QUEUE_SPINLOCK, queue spinlocks whose waiters each spin on
+ * their own per-cpu node (see kernel/locking/qspinlock.c).
  *
  * (the type definitions are in asm/spinlock_types.h)
  */
@@ -42,6 +44,10 @@
 extern struct static_key paravirt_ticketlocks_enabled;
 static __always_inline bool static_key_false(struct static_key *key);
 
+#ifdef CONFIG_QUEUE_SPINLOCK
+#include <asm/qspinlock.h>
+#else
+
 #ifdef CONFIG_PARAVIRT_SPINLOCKS
 
 static inline void __ticket_enter_slowpath(arch_spinlock_t *lock)
@@ -196,6 +202,7 @@ static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 		cpu_relax();
 	}
 }
+#endif /* CONFIG_QUEUE_SPINLOCK */
 
 /*
  * Read-write spinlocks, allowing multiple readers
@@ -1396,6 +1396,11 @@ again:
 	if (__test_and_clear_bit(62, (unsigned long *)&status)) {
 		handled++;
 		x86_pmu.drain_pebs(regs);
+		/*
+		 * The PEBS counters were handled by the drain, with
+		 * auto-reload they may show overflows of their own.
+		 */
+		status &= ~(cpuc->pebs_enabled & PEBS_COUNTER_MASK);
 	}
 
 	/*
@@ -1747,6 +1752,24 @@ static int intel_pmu_hw_config(struct perf_event *event)
 	if (event->attr.precise_ip && x86_pmu.pebs_aliases)
 		x86_pmu.pebs_aliases(event);
 
+	/*
+	 * A fixed period lets the hardware reload the counter by itself
+	 * after each PEBS record.  If in addition everything the sample
+	 * asks for comes out of the record, there is no need to take an
+	 * interrupt per record and the records can be left to pile up.
+	 */
+	if (event->attr.precise_ip && x86_pmu.intel_cap.pebs_format >= 1 &&
+	    !event->attr.freq && event->hw.sample_period &&
+	    event->hw.sample_period <= x86_pmu.max_period) {
+		event->hw.flags |= PERF_X86_EVENT_AUTO_RELOAD;
+		if (!(event->attr.sample_type & ~PEBS_FREERUNNING_FLAGS)) {
+			event->hw.flags |= PERF_X86_EVENT_FREERUNNING;
+			/* cpu-wide events need the buffer drained at ctxsw */
+			if (!(event->attach_state & PERF_ATTACH_TASK))
+				event->attach_state |= PERF_ATTACH_SCHED_CB;
+		}
+	}
+
 	if (intel_pmu_needs_lbr_smpl(event)) {
 		ret = intel_pmu_setup_lbr_filter(event);
 		if (ret)
@@ -2056,6 +2079,21 @@ static void intel_pmu_flush_branch_stack(void)
 		intel_pmu_lbr_reset();
 }
 
+static void intel_pmu_read_event(struct perf_event *event)
+{
+	if (event->hw.flags & PERF_X86_EVENT_AUTO_RELOAD)
+		intel_pmu_auto_reload_read(event);
+	else
+		x86_perf_event_update(event);
+}
+
+static void intel_pmu_sched_task(struct perf_event_context *ctx,
+				 bool sched_in)
+{
+	if (x86_pmu.pebs_active)
+		intel_pmu_pebs_sched_task(ctx, sched_in);
+}
+
 PMU_FORMAT_ATTR(offcore_rsp, "config1:0-63");
 
 PMU_FORMAT_ATTR(ldlat, "config1:0-15");
@@ -2108,6 +2146,8 @@ static __initconst const struct x86_pmu intel_pmu = {
 	.cpu_dying		= intel_pmu_cpu_dying,
 	.guest_get_msrs		= intel_guest_get_msrs,
 	.flush_branch_stack	= intel_pmu_flush_branch_stack,
+	.read			= intel_pmu_read_event,
+	.sched_task		= intel_pmu_sched_task,
 };
 
 static __init void intel_clovertown_quirk(void)
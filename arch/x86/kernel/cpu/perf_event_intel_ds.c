@@ -11,7 +11,7 @@
 #define BTS_RECORD_SIZE		24
 
 #define BTS_BUFFER_SIZE		(PAGE_SIZE << 4)
-#define PEBS_BUFFER_SIZE	PAGE_SIZE
+#define PEBS_BUFFER_SIZE	(PAGE_SIZE << 4)
 #define PEBS_FIXUP_SIZE		PAGE_SIZE
 
 /*
@@ -250,7 +250,7 @@ static int alloc_pebs_buffer(int cpu)
 {
 	struct debug_store *ds = per_cpu(cpu_hw_events, cpu).ds;
 	int node = cpu_to_node(cpu);
-	int max, thresh = 1; /* always use a single PEBS record */
+	int max;
 	void *buffer, *ibuffer;
 
 	if (!x86_pmu.pebs)
@@ -280,8 +280,9 @@ static int alloc_pebs_buffer(int cpu)
 	ds->pebs_absolute_maximum = ds->pebs_buffer_base +
 		max * x86_pmu.pebs_record_size;
 
+	/* a single record until free-running events ask for more */
 	ds->pebs_interrupt_threshold = ds->pebs_buffer_base +
-		thresh * x86_pmu.pebs_record_size;
+		x86_pmu.pebs_record_size;
 
 	return 0;
 }
@@ -667,10 +668,36 @@ struct event_constraint *intel_pebs_constraints(struct perf_event *event)
 	return &emptyconstraint;
 }
 
+static void intel_pmu_drain_pebs_buffer(void)
+{
+	struct pt_regs regs;
+
+	memset(&regs, 0, sizeof(regs));
+	x86_pmu.drain_pebs(&regs);
+}
+
+/*
+ * Only take a PMI when the buffer is nearly full if every PEBS counter
+ * can do without one per record; otherwise interrupt on each record.
+ */
+static void pebs_update_threshold(struct cpu_hw_events *cpuc)
+{
+	struct debug_store *ds = cpuc->ds;
+	u64 pebs_counters = cpuc->pebs_enabled & PEBS_COUNTER_MASK;
+
+	if (pebs_counters && cpuc->pebs_freerunning == pebs_counters)
+		ds->pebs_interrupt_threshold = ds->pebs_absolute_maximum -
+			x86_pmu.max_pebs_events * x86_pmu.pebs_record_size;
+	else
+		ds->pebs_interrupt_threshold = ds->pebs_buffer_base +
+			x86_pmu.pebs_record_size;
+}
+
 void intel_pmu_pebs_enable(struct perf_event *event)
 {
 	struct cpu_hw_events *cpuc = this_cpu_ptr(&cpu_hw_events);
 	struct hw_perf_event *hwc = &event->hw;
+	struct debug_store *ds = cpuc->ds;
 
 	hwc->config &= ~ARCH_PERFMON_EVENTSEL_INT;
 
@@ -680,20 +707,42 @@ void intel_pmu_pebs_enable(struct perf_event *event)
 		cpuc->pebs_enabled |= 1ULL << (hwc->idx + 32);
 	else if (event->hw.flags & PERF_X86_EVENT_PEBS_ST)
 		cpuc->pebs_enabled |= 1ULL << 63;
+
+	if (hwc->flags & PERF_X86_EVENT_FREERUNNING)
+		cpuc->pebs_freerunning |= 1ULL << hwc->idx;
+
+	/* let the hardware reload the counter after each record */
+	if (hwc->flags & PERF_X86_EVENT_AUTO_RELOAD)
+		ds->pebs_event_reset[hwc->idx] =
+			(u64)(-hwc->sample_period) & x86_pmu.cntval_mask;
+
+	pebs_update_threshold(cpuc);
 }
 
 void intel_pmu_pebs_disable(struct perf_event *event)
 {
 	struct cpu_hw_events *cpuc = this_cpu_ptr(&cpu_hw_events);
 	struct hw_perf_event *hwc = &event->hw;
+	struct debug_store *ds = cpuc->ds;
+
+	/* flush the records and the count before the counter goes away */
+	if ((hwc->flags & PERF_X86_EVENT_AUTO_RELOAD) &&
+	    (cpuc->pebs_enabled & (1ULL << hwc->idx)))
+		intel_pmu_drain_pebs_buffer();
 
 	cpuc->pebs_enabled &= ~(1ULL << hwc->idx);
+	cpuc->pebs_freerunning &= ~(1ULL << hwc->idx);
 
 	if (event->hw.constraint->flags & PERF_X86_EVENT_PEBS_LDLAT)
 		cpuc->pebs_enabled &= ~(1ULL << (hwc->idx + 32));
 	else if (event->hw.constraint->flags & PERF_X86_EVENT_PEBS_ST)
 		cpuc->pebs_enabled &= ~(1ULL << 63);
 
+	if (hwc->flags & PERF_X86_EVENT_AUTO_RELOAD)
+		ds->pebs_event_reset[hwc->idx] = 0;
+
+	pebs_update_threshold(cpuc);
+
 	if (cpuc->enabled)
 		wrmsrl(MSR_IA32_PEBS_ENABLE, cpuc->pebs_enabled);
 
@@ -716,6 +765,54 @@ void intel_pmu_pebs_disable_all(void)
 		wrmsrl(MSR_IA32_PEBS_ENABLE, 0);
 }
 
+void intel_pmu_pebs_sched_task(struct perf_event_context *ctx, bool sched_in)
+{
+	struct cpu_hw_events *cpuc = this_cpu_ptr(&cpu_hw_events);
+
+	/* the records belong to the outgoing task */
+	if (!sched_in && cpuc->pebs_freerunning)
+		intel_pmu_drain_pebs_buffer();
+}
+
+/*
+ * With auto-reload the counter restarts from -period on every record
+ * without software noticing, so the count has to be rebuilt from the
+ * number of records drained.
+ *
+ * The counter counts up from -period and every overflow starts it over,
+ * so after @count overflows the distance travelled is:
+ *
+ *   (0 - old) + (count - 1) * period + (new - (-period))
+ *
+ * which reduces to new - old + count * period.
+ */
+static void intel_pmu_save_and_restart_reload(struct perf_event *event,
+					      int count)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	int shift = 64 - x86_pmu.cntval_bits;
+	u64 prev_raw_count, new_raw_count;
+	s64 new, old;
+
+	prev_raw_count = local64_read(&hwc->prev_count);
+	rdpmcl(hwc->event_base_rdpmc, new_raw_count);
+	local64_set(&hwc->prev_count, new_raw_count);
+
+	new = ((s64)(new_raw_count << shift) >> shift);
+	old = ((s64)(prev_raw_count << shift) >> shift);
+	local64_add(new - old + count * hwc->sample_period, &event->count);
+
+	local64_set(&hwc->period_left, -new);
+	perf_event_update_userpage(event);
+}
+
+void intel_pmu_auto_reload_read(struct perf_event *event)
+{
+	perf_pmu_disable(event->pmu);
+	intel_pmu_drain_pebs_buffer();
+	perf_pmu_enable(event->pmu);
+}
+
 static int intel_pmu_pebs_fixup_ip(struct pt_regs *regs)
 {
 	struct cpu_hw_events *cpuc = this_cpu_ptr(&cpu_hw_events);
@@ -829,8 +926,10 @@ static inline u64 intel_hsw_transaction(struct pebs_record_hsw *pebs)
 	return txn;
 }
 
-static void __intel_pmu_pebs_event(struct perf_event *event,
-				   struct pt_regs *iregs, void *__pebs)
+static void setup_pebs_sample_data(struct perf_event *event,
+				   struct pt_regs *iregs, void *__pebs,
+				   struct perf_sample_data *data,
+				   struct pt_regs *regs)
 {
 #define PERF_X86_EVENT_PEBS_HSW_PREC \
 		(PERF_X86_EVENT_PEBS_ST_HSW | \
@@ -842,30 +941,25 @@ static void __intel_pmu_pebs_event(struct perf_event *event,
 	 */
 	struct cpu_hw_events *cpuc = this_cpu_ptr(&cpu_hw_events);
 	struct pebs_record_hsw *pebs = __pebs;
-	struct perf_sample_data data;
-	struct pt_regs regs;
 	u64 sample_type;
 	int fll, fst, dsrc;
 	int fl = event->hw.flags;
 
-	if (!intel_pmu_save_and_restart(event))
-		return;
-
 	sample_type = event->attr.sample_type;
 	dsrc = sample_type & PERF_SAMPLE_DATA_SRC;
 
 	fll = fl & PERF_X86_EVENT_PEBS_LDLAT;
 	fst = fl & (PERF_X86_EVENT_PEBS_ST | PERF_X86_EVENT_PEBS_HSW_PREC);
 
-	perf_sample_data_init(&data, 0, event->hw.last_period);
+	perf_sample_data_init(data, 0, event->hw.last_period);
 
-	data.period = event->hw.last_period;
+	data->period = event->hw.last_period;
 
 	/*
 	 * Use latency for weight (only avail with PEBS-LL)
 	 */
 	if (fll && (sample_type & PERF_SAMPLE_WEIGHT))
-		data.weight = pebs->lat;
+		data->weight = pebs->lat;
 
 	/*
 	 * data.data_src encodes the data source
@@ -878,7 +972,7 @@ static void __intel_pmu_pebs_event(struct perf_event *event,
 			val = precise_datala_hsw(event, pebs->dse);
 		else if (fst)
 			val = precise_store_data(pebs->dse);
-		data.data_src.val = val;
+		data->data_src.val = val;
 	}
 
 	/*
@@ -889,62 +983,78 @@ static void __intel_pmu_pebs_event(struct perf_event *event,
 	 *
 	 * In the simple case fix up only the IP and BP,SP regs, for
 	 * PERF_SAMPLE_IP and PERF_SAMPLE_CALLCHAIN to function properly.
-	 * A possible PERF_SAMPLE_REGS will have to transfer all regs.
+	 * A possible PERF_SAMPLE_REGS will have to transfer all regs->
 	 */
-	regs = *iregs;
-	regs.flags = pebs->flags;
-	set_linear_ip(&regs, pebs->ip);
-	regs.bp = pebs->bp;
-	regs.sp = pebs->sp;
+	*regs = *iregs;
+	regs->flags = pebs->flags;
+	set_linear_ip(regs, pebs->ip);
+	regs->bp = pebs->bp;
+	regs->sp = pebs->sp;
 
 	if (sample_type & PERF_SAMPLE_REGS_INTR) {
-		regs.ax = pebs->ax;
-		regs.bx = pebs->bx;
-		regs.cx = pebs->cx;
-		regs.dx = pebs->dx;
-		regs.si = pebs->si;
-		regs.di = pebs->di;
-		regs.bp = pebs->bp;
-		regs.sp = pebs->sp;
-
-		regs.flags = pebs->flags;
+		regs->ax = pebs->ax;
+		regs->bx = pebs->bx;
+		regs->cx = pebs->cx;
+		regs->dx = pebs->dx;
+		regs->si = pebs->si;
+		regs->di = pebs->di;
+		regs->bp = pebs->bp;
+		regs->sp = pebs->sp;
+
+		regs->flags = pebs->flags;
 #ifndef CONFIG_X86_32
-		regs.r8 = pebs->r8;
-		regs.r9 = pebs->r9;
-		regs.r10 = pebs->r10;
-		regs.r11 = pebs->r11;
-		regs.r12 = pebs->r12;
-		regs.r13 = pebs->r13;
-		regs.r14 = pebs->r14;
-		regs.r15 = pebs->r15;
+		regs->r8 = pebs->r8;
+		regs->r9 = pebs->r9;
+		regs->r10 = pebs->r10;
+		regs->r11 = pebs->r11;
+		regs->r12 = pebs->r12;
+		regs->r13 = pebs->r13;
+		regs->r14 = pebs->r14;
+		regs->r15 = pebs->r15;
 #endif
 	}
 
 	if (event->attr.precise_ip > 1 && x86_pmu.intel_cap.pebs_format >= 2) {
-		regs.ip = pebs->real_ip;
-		regs.flags |= PERF_EFLAGS_EXACT;
-	} else if (event->attr.precise_ip > 1 && intel_pmu_pebs_fixup_ip(&regs))
-		regs.flags |= PERF_EFLAGS_EXACT;
+		regs->ip = pebs->real_ip;
+		regs->flags |= PERF_EFLAGS_EXACT;
+	} else if (event->attr.precise_ip > 1 && intel_pmu_pebs_fixup_ip(regs))
+		regs->flags |= PERF_EFLAGS_EXACT;
 	else
-		regs.flags &= ~PERF_EFLAGS_EXACT;
+		regs->flags &= ~PERF_EFLAGS_EXACT;
 
 	if ((sample_type & PERF_SAMPLE_ADDR) &&
 	    x86_pmu.intel_cap.pebs_format >= 1)
-		data.addr = pebs->dla;
+		data->addr = pebs->dla;
 
 	if (x86_pmu.intel_cap.pebs_format >= 2) {
 		/* Only set the TSX weight when no memory weight. */
 		if ((sample_type & PERF_SAMPLE_WEIGHT) && !fll)
-			data.weight = intel_hsw_weight(pebs);
+			data->weight = intel_hsw_weight(pebs);
 
 		if (sample_type & PERF_SAMPLE_TRANSACTION)
-			data.txn = intel_hsw_transaction(pebs);
+			data->txn = intel_hsw_transaction(pebs);
 	}
 
 	if (has_branch_stack(event))
-		data.br_stack = &cpuc->lbr_stack;
+		data->br_stack = &cpuc->lbr_stack;
+}
+
+/*
+ * All but the last record of a drain go straight to the buffer; the last
+ * one goes through the overflow handler so that throttling and the
+ * wakeup logic see the drain.
+ */
+static void __intel_pmu_pebs_event(struct perf_event *event,
+				   struct pt_regs *iregs, void *at, bool last)
+{
+	struct perf_sample_data data;
+	struct pt_regs regs;
 
-	if (perf_event_overflow(event, &data, &regs))
+	setup_pebs_sample_data(event, iregs, at, &data, &regs);
+
+	if (!last)
+		perf_event_output(event, &data, &regs);
+	else if (perf_event_overflow(event, &data, &regs))
 		x86_pmu_stop(event, 0);
 }
 
@@ -986,61 +1096,90 @@ static void intel_pmu_drain_pebs_core(struct pt_regs *iregs)
 	WARN_ONCE(n > 1, "bad leftover pebs %d\n", n);
 	at += n - 1;
 
-	__intel_pmu_pebs_event(event, iregs, at);
+	if (!intel_pmu_save_and_restart(event))
+		return;
+
+	__intel_pmu_pebs_event(event, iregs, at, true);
+}
+
+/* The PEBS counter a record belongs to, or -1 */
+static int pebs_record_bit(void *at, u64 mask)
+{
+	struct pebs_record_nhm *p = at;
+	u64 status = p->status & mask;
+
+	if (!status)
+		return -1;
+
+	return __ffs64(status);
 }
 
 static void intel_pmu_drain_pebs_nhm(struct pt_regs *iregs)
 {
 	struct cpu_hw_events *cpuc = this_cpu_ptr(&cpu_hw_events);
 	struct debug_store *ds = cpuc->ds;
-	struct perf_event *event = NULL;
-	void *at, *top;
-	u64 status = 0;
+	struct perf_event *event;
+	int counts[MAX_PEBS_EVENTS] = { 0, };
+	void *base, *at, *top;
+	u64 mask = 0;
 	int bit;
 
 	if (!x86_pmu.pebs_active)
 		return;
 
-	at  = (struct pebs_record_nhm *)(unsigned long)ds->pebs_buffer_base;
-	top = (struct pebs_record_nhm *)(unsigned long)ds->pebs_index;
+	base = (void *)(unsigned long)ds->pebs_buffer_base;
+	top  = (void *)(unsigned long)ds->pebs_index;
 
 	ds->pebs_index = ds->pebs_buffer_base;
 
-	if (unlikely(at > top))
+	if (unlikely(base > top))
 		return;
 
-	/*
-	 * Should not happen, we program the threshold at 1 and do not
-	 * set a reset value.
-	 */
-	WARN_ONCE(top - at > x86_pmu.max_pebs_events * x86_pmu.pebs_record_size,
-		  "Unexpected number of pebs records %ld\n",
-		  (long)(top - at) / x86_pmu.pebs_record_size);
+	for (bit = 0; bit < x86_pmu.max_pebs_events; bit++) {
+		if (!(cpuc->pebs_enabled & (1ULL << bit)) ||
+		    !test_bit(bit, cpuc->active_mask))
+			continue;
 
-	for (; at < top; at += x86_pmu.pebs_record_size) {
-		struct pebs_record_nhm *p = at;
+		event = cpuc->events[bit];
+		WARN_ON_ONCE(!event);
 
-		for_each_set_bit(bit, (unsigned long *)&p->status,
-				 x86_pmu.max_pebs_events) {
-			event = cpuc->events[bit];
-			if (!test_bit(bit, cpuc->active_mask))
-				continue;
+		if (event && event->attr.precise_ip)
+			mask |= 1ULL << bit;
+	}
 
-			WARN_ON_ONCE(!event);
+	/*
+	 * Without auto-reload only the first record of a counter counts,
+	 * the counter was not rearmed for the others.
+	 */
+	for (at = base; at < top; at += x86_pmu.pebs_record_size) {
+		bit = pebs_record_bit(at, mask);
+		if (bit < 0)
+			continue;
 
-			if (!event->attr.precise_ip)
-				continue;
+		event = cpuc->events[bit];
+		if (counts[bit] &&
+		    !(event->hw.flags & PERF_X86_EVENT_AUTO_RELOAD))
+			continue;
 
-			if (__test_and_set_bit(bit, (unsigned long *)&status))
-				continue;
+		counts[bit]++;
+	}
 
-			break;
-		}
+	for_each_set_bit(bit, (unsigned long *)&mask, MAX_PEBS_EVENTS) {
+		event = cpuc->events[bit];
+
+		if (event->hw.flags & PERF_X86_EVENT_AUTO_RELOAD)
+			intel_pmu_save_and_restart_reload(event, counts[bit]);
+		else if (counts[bit] && !intel_pmu_save_and_restart(event))
+			counts[bit] = 0;
+	}
 
-		if (!event || bit >= x86_pmu.max_pebs_events)
+	for (at = base; at < top; at += x86_pmu.pebs_record_size) {
+		bit = pebs_record_bit(at, mask);
+		if (bit < 0 || !counts[bit])
 			continue;
 
-		__intel_pmu_pebs_event(event, iregs, at);
+		__intel_pmu_pebs_event(cpuc->events[bit], iregs, at,
+				       --counts[bit] == 0);
 	}
 }
 
@@ -388,6 +388,36 @@ int kvm_ioapic_set_irq(struct kvm_ioapic *ioapic, int irq, int irq_source_id,
 	return ret;
 }
 
+/*
+ * irqfd fast path: raise the pin, and lower it again unless the irqfd
+ * resamples, without ever spinning on ioapic->lock.  Returns
+ * -EWOULDBLOCK if the IOAPIC is busy and the caller has to retry from
+ * process context.
+ */
+int kvm_ioapic_irqfd_inject(struct kvm_ioapic *ioapic, int irq,
+			    int irq_source_id, bool resample)
+{
+	int ret, irq_level;
+
+	BUG_ON(irq < 0 || irq >= IOAPIC_NUM_PINS);
+
+	if (!spin_trylock(&ioapic->lock))
+		return -EWOULDBLOCK;
+
+	irq_level = __kvm_irq_line_state(&ioapic->irq_states[irq],
+					 irq_source_id, 1);
+	ret = ioapic_set_irq(ioapic, irq, irq_level, false);
+	if (!resample) {
+		irq_level = __kvm_irq_line_state(&ioapic->irq_states[irq],
+						 irq_source_id, 0);
+		ioapic_set_irq(ioapic, irq, irq_level, false);
+	}
+
+	spin_unlock(&ioapic->lock);
+
+	return ret;
+}
+
 void kvm_ioapic_clear_all(struct kvm_ioapic *ioapic, int irq_source_id)
 {
 	int i;
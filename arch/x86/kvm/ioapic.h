@@ -106,6 +106,8 @@ void kvm_ioapic_update_eoi(struct kvm_vcpu *vcpu, int vector,
 bool kvm_ioapic_handles_vector(struct kvm *kvm, int vector);
 int kvm_ioapic_init(struct kvm *kvm);
 void kvm_ioapic_destroy(struct kvm *kvm);
+int kvm_ioapic_irqfd_inject(struct kvm_ioapic *ioapic, int irq,
+			    int irq_source_id, bool resample);
 int kvm_ioapic_set_irq(struct kvm_ioapic *ioapic, int irq, int irq_source_id,
 		       int level, bool line_status);
 void kvm_ioapic_clear_all(struct kvm_ioapic *ioapic, int irq_source_id);
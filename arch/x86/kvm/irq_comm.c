@@ -175,6 +175,31 @@ int kvm_set_irq_inatomic(struct kvm *kvm, int irq_source_id, u32 irq, int level)
 	return ret;
 }
 
+/*
+ * irqfd fast path, called from the eventfd wakeup with interrupts
+ * disabled.  Besides MSIs this handles gsis routed to a single IOAPIC
+ * pin, the usual case for the INTx of vhost and assigned devices.
+ * ioapic->lock is not irq-safe, so the IOAPIC is only touched from
+ * task context.
+ */
+int kvm_arch_irqfd_inject_inatomic(struct kvm_kernel_irq_routing_entry *e,
+				   struct kvm *kvm, int irq_source_id,
+				   bool resample)
+{
+	switch (e->type) {
+	case KVM_IRQ_ROUTING_MSI:
+		return kvm_set_msi(e, kvm, irq_source_id, 1, false);
+	case KVM_IRQ_ROUTING_IRQCHIP:
+		if (e->irqchip.irqchip != KVM_IRQCHIP_IOAPIC || in_interrupt())
+			break;
+		return kvm_ioapic_irqfd_inject(kvm->arch.vioapic,
+					       e->irqchip.pin, irq_source_id,
+					       resample);
+	}
+
+	return -EWOULDBLOCK;
+}
+
 int kvm_request_irq_source_id(struct kvm *kvm)
 {
 	unsigned long *bitmap = &kvm->arch.irq_sources_bitmap;
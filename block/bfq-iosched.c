@@ -69,6 +69,7 @@
 #include <linux/ioprio.h>
 #include "bfq.h"
 #include "blk.h"
+#include "blk-mq-sched.h"
 
 /* Max number of dispatches in one round of service. */
 static const int bfq_quantum = 4;
@@ -203,6 +204,18 @@ static inline void bfq_schedule_dispatch(struct bfq_data *bfqd)
 	}
 }
 
+/*
+ * Let dispatching restart right away.  A blk-mq queue has no request_fn,
+ * there we can only kick its hardware contexts.
+ */
+static void bfq_run_queue(struct request_queue *q)
+{
+	if (q->mq_ops)
+		blk_mq_sched_kick(q);
+	else
+		__blk_run_queue(q);
+}
+
 /*
  * Lifted from AS - choose which of rq1 and rq2 that is best served now.
  * We choose the request that is closesr to the head right now.  Distance
@@ -3322,7 +3335,7 @@ static void bfq_rq_enqueued(struct bfq_data *bfqd, struct bfq_queue *bfqq,
 		 * Let the request rip immediately, or let a new queue be
 		 * selected if bfqq has just been expired.
 		 */
-		__blk_run_queue(bfqd->queue);
+		bfq_run_queue(bfqd->queue);
 	}
 }
 
@@ -3661,7 +3674,7 @@ static void bfq_kick_queue(struct work_struct *work)
 	struct request_queue *q = bfqd->queue;
 
 	spin_lock_irq(q->queue_lock);
-	__blk_run_queue(q);
+	bfq_run_queue(q);
 	spin_unlock_irq(q->queue_lock);
 }
 
@@ -4171,6 +4184,7 @@ static struct elevator_type iosched_bfq = {
 	.elevator_attrs =	bfq_attrs,
 	.elevator_name =	"bfq",
 	.elevator_owner =	THIS_MODULE,
+	.uses_mq =		true,
 };
 
 static int __init bfq_init(void)
@@ -28,9 +28,11 @@
 #include <linux/mempool.h>
 #include <linux/workqueue.h>
 #include <linux/cgroup.h>
+#include <linux/kthread.h>
 #include <scsi/sg.h>		/* for struct sg_iovec */
 
 #include <trace/events/block.h>
+#include "blk.h"
 
 /*
  * Test patch to inline a certain number of bi_io_vec's inside the bio
@@ -1825,6 +1827,7 @@ void bio_endio(struct bio *bio, int error)
 			bio_put(bio);
 			bio = parent;
 		} else {
+			blk_iolatency_done_bio(bio);
 			if (bio->bi_end_io)
 				bio->bi_end_io(bio, error);
 			bio = NULL;
@@ -2046,7 +2049,9 @@ int bio_associate_current(struct bio *bio)
 
 	/* associate blkcg if exists */
 	rcu_read_lock();
-	css = task_css(current, blkio_cgrp_id);
+	css = kthread_blkcg();
+	if (!css)
+		css = task_css(current, blkio_cgrp_id);
 	if (css && css_tryget_online(css))
 		bio->bi_css = css;
 	rcu_read_unlock();
@@ -855,9 +855,18 @@ done:
  */
 int blkcg_init_queue(struct request_queue *q)
 {
+	int ret;
+
 	might_sleep();
 
-	return blk_throtl_init(q);
+	ret = blk_throtl_init(q);
+	if (ret)
+		return ret;
+
+	ret = blk_iolatency_init(q);
+	if (ret)
+		blk_throtl_exit(q);
+	return ret;
 }
 
 /**
@@ -892,6 +901,7 @@ void blkcg_exit_queue(struct request_queue *q)
 	blkg_destroy_all(q);
 	spin_unlock_irq(q->queue_lock);
 
+	blk_iolatency_exit(q);
 	blk_throtl_exit(q);
 }
 
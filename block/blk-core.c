@@ -32,6 +32,7 @@
 #include <linux/delay.h>
 #include <linux/ratelimit.h>
 #include <linux/pm_runtime.h>
+#include <linux/hrtimer.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
@@ -39,6 +40,7 @@
 #include "blk.h"
 #include "blk-cgroup.h"
 #include "blk-mq.h"
+#include "blk-wbt.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -547,8 +549,10 @@ void blk_cleanup_queue(struct request_queue *q)
 	del_timer_sync(&q->backing_dev_info.laptop_mode_wb_timer);
 	blk_sync_queue(q);
 
-	if (q->mq_ops)
+	if (q->mq_ops) {
+		elevator_mq_exit(q);
 		blk_mq_free_queue(q);
+	}
 
 	spin_lock_irq(lock);
 	if (q->queue_lock != &q->__queue_lock)
@@ -1377,6 +1381,8 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 
 	elv_completed_request(q, req);
 
+	wbt_done(q->rq_wb, req);
+
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
 
@@ -1573,6 +1579,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool wb_acct;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1620,6 +1627,8 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	}
 
 get_rq:
+	wb_acct = wbt_wait(q->rq_wb, bio, q->queue_lock);
+
 	/*
 	 * This sync check and mask will be re-done in init_request_from_bio(),
 	 * but we need to set it earlier to expose the sync flag to the
@@ -1635,10 +1644,14 @@ get_rq:
 	 */
 	req = get_request(q, rw_flags, bio, GFP_NOIO);
 	if (IS_ERR(req)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		bio_endio(bio, PTR_ERR(req));	/* @q is dead */
 		goto out_unlock;
 	}
 
+	wbt_track(req, wb_acct);
+
 	/*
 	 * After dropping the lock and possibly sleeping here, our request
 	 * may now be mergeable after it had proven unmergeable (above).
@@ -1857,6 +1870,8 @@ generic_make_request_checks(struct bio *bio)
 	if (blk_throtl_bio(q, bio))
 		return false;	/* throttled, will be resubmitted later */
 
+	blk_iolatency_throttle(q, bio);
+
 	trace_block_bio_queue(q, bio);
 	return true;
 
@@ -2363,6 +2378,8 @@ void blk_start_request(struct request *req)
 {
 	blk_dequeue_request(req);
 
+	wbt_issue(req->q->rq_wb, req);
+
 	/*
 	 * We are now handing the request to the hardware, initialize
 	 * resid_len to full count and add the timeout handler.
@@ -3187,6 +3204,91 @@ void blk_finish_plug(struct blk_plug *plug)
 }
 EXPORT_SYMBOL(blk_finish_plug);
 
+/*
+ * Hybrid polling: sleep for a fixed time, or for half the mean completion
+ * time of the hardware queue, before we start spinning.  The caller has
+ * to recheck its wait condition afterwards, as the wakeup may have come
+ * from either the timer or the completion.
+ */
+static bool blk_poll_hybrid_sleep(struct request_queue *q,
+				  struct blk_mq_hw_ctx *hctx)
+{
+	struct hrtimer_sleeper hs;
+	u64 nsecs;
+
+	if (q->poll_nsec < 0)
+		return false;
+
+	nsecs = q->poll_nsec ? q->poll_nsec : hctx->poll_mean_ns / 2;
+	if (!nsecs)
+		return false;
+
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	hrtimer_init_sleeper(&hs, current);
+	hrtimer_start(&hs.timer, ns_to_ktime(nsecs), HRTIMER_MODE_REL);
+	if (hs.task)
+		io_schedule();
+	hrtimer_cancel(&hs.timer);
+	destroy_hrtimer_on_stack(&hs.timer);
+
+	__set_current_state(TASK_RUNNING);
+	return true;
+}
+
+/**
+ * blk_poll - spin on a queue's completions instead of sleeping for them
+ * @q: the queue the caller has I/O outstanding on
+ * @hybrid: allow sleeping for part of the expected completion time first
+ *
+ * Description:
+ *    Called by a task that has set itself TASK_UNINTERRUPTIBLE and would
+ *    otherwise io_schedule() until its I/O completes.  The hardware queue
+ *    of the calling CPU is polled through ->poll until the task has been
+ *    woken up.  Returns %true if the task is running again and should
+ *    recheck what it was waiting for, %false if it has to sleep as usual.
+ *    Only blk-mq queues with QUEUE_FLAG_POLL set are polled.
+ */
+bool blk_poll(struct request_queue *q, bool hybrid)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct blk_plug *plug;
+	long state;
+
+	if (!q->mq_ops || !q->mq_ops->poll || !blk_queue_poll(q))
+		return false;
+
+	plug = current->plug;
+	if (plug)
+		blk_flush_plug_list(plug, false);
+
+	hctx = q->mq_ops->map_queue(q, raw_smp_processor_id());
+	hctx->poll_considered++;
+
+	if (hybrid && blk_poll_hybrid_sleep(q, hctx))
+		return true;
+
+	state = current->state;
+	while (!need_resched()) {
+		int ret;
+
+		hctx->poll_invoked++;
+		ret = q->mq_ops->poll(hctx);
+		if (ret > 0)
+			hctx->poll_completed += ret;
+
+		if (signal_pending_state(state, current))
+			__set_current_state(TASK_RUNNING);
+		if (current->state == TASK_RUNNING)
+			return true;
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
 #ifdef CONFIG_PM
 /**
  * blk_pm_runtime_init - Block layer runtime PM initialization routine
@@ -0,0 +1,427 @@
+/*
+ * Latency target based cgroup I/O protection
+ *
+ * Instead of fixed bandwidth or iops caps, a group is given a completion
+ * latency target per device through blkio.latency.target_device:
+ *
+ *	echo "8:16 2000" > blkio.latency.target_device
+ *
+ * asks for I/O of this group on 8:16 to complete within 2ms.  Every
+ * window we check each protected group on the queue.  If more than a
+ * tenth of its I/O took longer than its target, every group with a
+ * looser target (or none at all) gets its allowed queue depth halved.
+ * Once all protected groups are meeting their targets again, the depth
+ * of the throttled groups is doubled back up each window until they are
+ * unrestricted.
+ *
+ * The root group is never throttled.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/slab.h>
+#include <linux/timer.h>
+#include "blk-cgroup.h"
+#include "blk.h"
+
+/* how often protected groups are checked */
+#define IOLAT_WINDOW		(HZ / 10)
+/* ignore windows with fewer completions than this */
+#define IOLAT_MIN_SAMPLES	5
+
+static struct blkcg_policy blkcg_policy_iolat;
+
+/* per blkg, per policy data */
+struct iolat_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	/* completion latency target, 0 if the group isn't protected */
+	u64 min_lat_nsec;
+
+	/* how far we have scaled this group down, 0 is unthrottled */
+	int scale_step;
+	unsigned int max_depth;
+
+	/* bios between blk_iolatency_throttle() and completion */
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	/* completions in the current window */
+	spinlock_t stat_lock;
+	unsigned int nr_samples;
+	unsigned int nr_missed;
+};
+
+/* per request_queue data */
+struct iolat_data {
+	struct request_queue *queue;
+	struct timer_list timer;
+
+	/* groups with a target on this queue, protected by queue_lock */
+	unsigned int nr_protected;
+};
+
+static inline struct iolat_grp *pd_to_iolat(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_iolat(struct blkcg_gq *blkg)
+{
+	return pd_to_iolat(blkg_to_pd(blkg, &blkcg_policy_iolat));
+}
+
+static bool atomic_inc_below(atomic_t *v, unsigned int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static void iolat_set_depth(struct iolat_grp *iolat, unsigned int qd)
+{
+	if (!iolat->scale_step) {
+		iolat->max_depth = UINT_MAX;
+		return;
+	}
+
+	iolat->max_depth = max(1U, qd >> iolat->scale_step);
+}
+
+static void iolat_scale_down(struct iolat_grp *iolat, unsigned int qd)
+{
+	if (iolat->max_depth == 1)
+		return;
+
+	iolat->scale_step++;
+	iolat_set_depth(iolat, qd);
+}
+
+static void iolat_scale_up(struct iolat_grp *iolat, unsigned int qd)
+{
+	if (!iolat->scale_step)
+		return;
+
+	iolat->scale_step--;
+	iolat_set_depth(iolat, qd);
+	wake_up_all(&iolat->wait);
+}
+
+static void iolat_timer_fn(unsigned long data)
+{
+	struct iolat_data *id = (struct iolat_data *)data;
+	struct request_queue *q = id->queue;
+	unsigned int qd = max(1UL, q->nr_requests);
+	struct blkcg_gq *blkg;
+	u64 missed_target = 0;
+	bool scaled = false;
+
+	spin_lock_irq(q->queue_lock);
+
+	/*
+	 * Find the tightest target that was missed in this window.
+	 */
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolat_grp *iolat = blkg_to_iolat(blkg);
+		unsigned int nr, missed;
+
+		if (!iolat)
+			continue;
+
+		spin_lock(&iolat->stat_lock);
+		nr = iolat->nr_samples;
+		missed = iolat->nr_missed;
+		iolat->nr_samples = iolat->nr_missed = 0;
+		spin_unlock(&iolat->stat_lock);
+
+		if (!iolat->min_lat_nsec || nr < IOLAT_MIN_SAMPLES)
+			continue;
+
+		if (missed * 10 > nr &&
+		    (!missed_target || iolat->min_lat_nsec < missed_target))
+			missed_target = iolat->min_lat_nsec;
+	}
+
+	/*
+	 * Push back everyone with a looser target than that, or let them
+	 * all open up again if nobody is suffering.
+	 */
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolat_grp *iolat = blkg_to_iolat(blkg);
+
+		if (!iolat)
+			continue;
+
+		if (!missed_target)
+			iolat_scale_up(iolat, qd);
+		else if (blkg->parent && (!iolat->min_lat_nsec ||
+					  iolat->min_lat_nsec > missed_target))
+			iolat_scale_down(iolat, qd);
+
+		if (iolat->scale_step)
+			scaled = true;
+	}
+
+	if (id->nr_protected || scaled)
+		mod_timer(&id->timer, jiffies + IOLAT_WINDOW);
+
+	spin_unlock_irq(q->queue_lock);
+}
+
+/**
+ * blk_iolatency_throttle - account @bio to its group and wait for room
+ * @q: the request_queue @bio is issued to
+ * @bio: bio being submitted
+ *
+ * Only does anything while a group on @q has a latency target.  May
+ * sleep until the group of @bio is below its allowed depth.
+ */
+void blk_iolatency_throttle(struct request_queue *q, struct bio *bio)
+{
+	struct iolat_data *id = q->iolat_data;
+	struct iolat_grp *iolat;
+	struct blkcg_gq *blkg;
+	DEFINE_WAIT(wait);
+
+	if (!id || !ACCESS_ONCE(id->nr_protected))
+		return;
+
+	/* already accounted on a stacked device above us */
+	if (bio->bi_iolat_blkg)
+		return;
+
+	rcu_read_lock();
+	blkg = blkg_lookup(bio_blkcg(bio), q);
+	if (unlikely(!blkg)) {
+		spin_lock_irq(q->queue_lock);
+		blkg = blkg_lookup_create(bio_blkcg(bio), q);
+		if (IS_ERR(blkg))
+			blkg = NULL;
+		spin_unlock_irq(q->queue_lock);
+	}
+	iolat = blkg ? blkg_to_iolat(blkg) : NULL;
+	if (!iolat) {
+		rcu_read_unlock();
+		return;
+	}
+	blkg_get(blkg);
+	rcu_read_unlock();
+
+	bio->bi_iolat_blkg = blkg;
+
+	/*
+	 * Metadata and priority I/O is only accounted, it may be holding
+	 * up others in the filesystem.
+	 */
+	if (!blkg->parent || (bio->bi_rw & (REQ_META | REQ_PRIO))) {
+		atomic_inc(&iolat->inflight);
+		goto out;
+	}
+
+	if (atomic_inc_below(&iolat->inflight, iolat->max_depth))
+		goto out;
+
+	do {
+		prepare_to_wait_exclusive(&iolat->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		if (atomic_inc_below(&iolat->inflight, iolat->max_depth))
+			break;
+		io_schedule();
+	} while (1);
+
+	finish_wait(&iolat->wait, &wait);
+out:
+	bio->bi_iolat_start = ktime_get_ns();
+}
+
+void __blk_iolatency_done_bio(struct bio *bio)
+{
+	struct blkcg_gq *blkg = bio->bi_iolat_blkg;
+	struct iolat_grp *iolat = blkg_to_iolat(blkg);
+	u64 lat = ktime_get_ns() - bio->bi_iolat_start;
+	unsigned long flags;
+	int inflight;
+
+	bio->bi_iolat_blkg = NULL;
+
+	if (iolat) {
+		spin_lock_irqsave(&iolat->stat_lock, flags);
+		iolat->nr_samples++;
+		if (iolat->min_lat_nsec && lat > iolat->min_lat_nsec)
+			iolat->nr_missed++;
+		spin_unlock_irqrestore(&iolat->stat_lock, flags);
+
+		inflight = atomic_dec_return(&iolat->inflight);
+		if (waitqueue_active(&iolat->wait) &&
+		    inflight < iolat->max_depth)
+			wake_up(&iolat->wait);
+	}
+
+	blkg_put(blkg);
+}
+
+static void iolat_pd_init(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *iolat = blkg_to_iolat(blkg);
+
+	iolat->min_lat_nsec = 0;
+	iolat->scale_step = 0;
+	iolat->max_depth = UINT_MAX;
+	atomic_set(&iolat->inflight, 0);
+	init_waitqueue_head(&iolat->wait);
+	spin_lock_init(&iolat->stat_lock);
+}
+
+static void iolat_pd_offline(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *iolat = blkg_to_iolat(blkg);
+	struct iolat_data *id = blkg->q->iolat_data;
+
+	if (iolat->min_lat_nsec)
+		id->nr_protected--;
+	iolat->min_lat_nsec = 0;
+	iolat->scale_step = 0;
+	iolat_set_depth(iolat, 0);
+	wake_up_all(&iolat->wait);
+}
+
+static u64 iolat_prfill_target(struct seq_file *sf,
+			       struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+
+	if (!iolat->min_lat_nsec)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, div_u64(iolat->min_lat_nsec,
+						 NSEC_PER_USEC));
+}
+
+static int iolat_print_target(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_target,
+			  &blkcg_policy_iolat, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static u64 iolat_prfill_depth(struct seq_file *sf,
+			      struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *iolat = pd_to_iolat(pd);
+
+	if (!iolat->scale_step)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, iolat->max_depth);
+}
+
+static int iolat_print_depth(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_depth,
+			  &blkcg_policy_iolat, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t iolat_set_target(struct kernfs_open_file *of,
+				char *buf, size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct blkg_conf_ctx ctx;
+	struct iolat_grp *iolat;
+	struct iolat_data *id;
+	u64 target;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolat, buf, &ctx);
+	if (ret)
+		return ret;
+
+	iolat = blkg_to_iolat(ctx.blkg);
+	id = ctx.blkg->q->iolat_data;
+	target = ctx.v * NSEC_PER_USEC;
+
+	if (!iolat->min_lat_nsec && target)
+		id->nr_protected++;
+	else if (iolat->min_lat_nsec && !target)
+		id->nr_protected--;
+	iolat->min_lat_nsec = target;
+
+	if (id->nr_protected && !timer_pending(&id->timer))
+		mod_timer(&id->timer, jiffies + IOLAT_WINDOW);
+
+	blkg_conf_finish(&ctx);
+	return nbytes;
+}
+
+static struct cftype iolat_files[] = {
+	{
+		.name = "latency.target_device",
+		.seq_show = iolat_print_target,
+		.write = iolat_set_target,
+	},
+	{
+		.name = "latency.throttled_depth",
+		.seq_show = iolat_print_depth,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolat = {
+	.pd_size		= sizeof(struct iolat_grp),
+	.cftypes		= iolat_files,
+
+	.pd_init_fn		= iolat_pd_init,
+	.pd_offline_fn		= iolat_pd_offline,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct iolat_data *id;
+	int ret;
+
+	id = kzalloc_node(sizeof(*id), GFP_KERNEL, q->node);
+	if (!id)
+		return -ENOMEM;
+
+	id->queue = q;
+	setup_timer(&id->timer, iolat_timer_fn, (unsigned long)id);
+	q->iolat_data = id;
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolat);
+	if (ret) {
+		q->iolat_data = NULL;
+		kfree(id);
+	}
+	return ret;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	struct iolat_data *id = q->iolat_data;
+
+	if (!id)
+		return;
+
+	del_timer_sync(&id->timer);
+	blkcg_deactivate_policy(q, &blkcg_policy_iolat);
+	q->iolat_data = NULL;
+	kfree(id);
+}
+
+static int __init iolat_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolat);
+}
+
+module_init(iolat_init);
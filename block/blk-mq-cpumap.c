@@ -85,6 +85,19 @@ int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues)
 	return 0;
 }
 
+/*
+ * Drivers whose queues are served by spread interrupt vectors provide
+ * ->map_queues to reuse the interrupt affinity, so submission and
+ * completion of a request stay on the same cpus.
+ */
+int blk_mq_build_queue_map(struct blk_mq_tag_set *set, unsigned int *map)
+{
+	if (set->ops->map_queues)
+		return set->ops->map_queues(set, map);
+
+	return blk_mq_update_queue_map(map, set->nr_hw_queues);
+}
+
 unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 {
 	unsigned int *map;
@@ -95,7 +108,7 @@ unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set)
 	if (!map)
 		return NULL;
 
-	if (!blk_mq_update_queue_map(map, set->nr_hw_queues))
+	if (!blk_mq_build_queue_map(set, map))
 		return map;
 
 	kfree(map);
@@ -0,0 +1,55 @@
+/*
+ * CPU -> hardware queue mapping from PCI interrupt affinity
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blk-mq.h>
+#include <linux/blk-mq-pci.h>
+#include <linux/pci.h>
+
+#include "blk-mq.h"
+
+/**
+ * blk_mq_pci_map_queues - provide a default queue mapping for PCI device
+ * @set:	tagset to provide the mapping for
+ * @map:	cpu -> hardware queue index table to fill in
+ * @pdev:	PCI device associated with @set.
+ *
+ * This function assumes the PCI device @pdev has at least as many available
+ * interrupt vectors as @set has queues, that hardware queue N is served by
+ * vector N, and that the vectors were spread with
+ * pci_enable_msix_range_affinity(). It then maps every hardware queue to
+ * the cpus its vector is pinned to. Without spread vectors (e.g. after a
+ * fallback to plain MSI) the generic topology based mapping is used.
+ */
+int blk_mq_pci_map_queues(struct blk_mq_tag_set *set, unsigned int *map,
+			  struct pci_dev *pdev)
+{
+	const struct cpumask *mask;
+	unsigned int queue, cpu;
+
+	/* cpus not covered by any vector go to the first queue */
+	for_each_possible_cpu(cpu)
+		map[cpu] = 0;
+
+	for (queue = 0; queue < set->nr_hw_queues; queue++) {
+		mask = pci_irq_get_affinity(pdev, queue);
+		if (!mask)
+			return blk_mq_update_queue_map(map, set->nr_hw_queues);
+
+		for_each_cpu(cpu, mask)
+			map[cpu] = queue;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(blk_mq_pci_map_queues);
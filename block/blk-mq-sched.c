@@ -0,0 +1,249 @@
+/*
+ * Elevator support for blk-mq
+ *
+ * blk-mq has no I/O scheduler framework of its own.  This lets an
+ * elevator_type that sets ->uses_mq run on a multiqueue device instead:
+ * requests from ->make_request get elevator private data when they are
+ * allocated, are merged and sorted by the elevator under q->queue_lock,
+ * and are pulled back out by each hardware context when it runs.
+ * Requests are always issued on the hardware context of the software
+ * queue they were allocated from.
+ *
+ * Elevators that provide ->mq_ops skip q->queue_lock entirely: they keep
+ * a scheduler instance in each hardware context, and requests are merged,
+ * inserted and dispatched through that context's instance only.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/iocontext.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+#include "blk-mq-sched.h"
+
+/*
+ * Attach elevator private data to a freshly allocated @rq.  Called with
+ * the software queue held, so nothing here may sleep.  If we can't set
+ * it up, @rq simply bypasses the elevator like it would in the legacy
+ * request path.
+ */
+void blk_mq_sched_get_request(struct request_queue *q, struct request *rq,
+			      struct bio *bio)
+{
+	struct elevator_type *et = q->elevator->type;
+	struct io_context *ioc = current->io_context;
+	struct io_cq *icq = NULL;
+
+	if (et->mq_ops) {
+		rq->elv.icq = NULL;
+		rq->cmd_flags |= REQ_ELVPRIV;
+		return;
+	}
+
+#ifdef CONFIG_BLK_CGROUP
+	if (bio->bi_ioc)
+		ioc = bio->bi_ioc;
+#endif
+
+	if (et->icq_cache) {
+		if (!ioc)
+			return;
+
+		spin_lock_irq(q->queue_lock);
+		icq = ioc_lookup_icq(ioc, q);
+		spin_unlock_irq(q->queue_lock);
+
+		if (!icq)
+			icq = ioc_create_icq(ioc, q, GFP_ATOMIC);
+		if (!icq)
+			return;
+	}
+
+	rq->elv.icq = icq;
+	if (unlikely(elv_set_request(q, rq, bio, GFP_ATOMIC)))
+		return;
+
+	/* @rq->elv.icq holds io_context until @rq is freed */
+	if (icq)
+		get_io_context(icq->ioc);
+
+	rq->cmd_flags |= REQ_ELVPRIV;
+}
+
+/*
+ * Called when @rq is freed.  Completion is reported to the elevator here
+ * too, as blk-mq frees a request as soon as it has been ended.
+ */
+void blk_mq_sched_put_request(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	unsigned long flags;
+
+	/* nothing was set up at allocation time */
+	if (q->elevator->type->mq_ops)
+		return;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	if (rq->cmd_flags & REQ_SORTED)
+		elv_completed_request(q, rq);
+	if (rq->cmd_flags & REQ_ELVPRIV) {
+		elv_put_request(q, rq);
+		if (rq->elv.icq)
+			put_io_context(rq->elv.icq->ioc);
+	}
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+/*
+ * Try to merge @bio into a request the elevator is still holding.  Only
+ * bio merges are attempted; the request that was allocated for @bio is
+ * freed by the caller if this succeeds.
+ */
+bool blk_mq_sched_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
+{
+	struct request_queue *q = hctx->queue;
+	struct elevator_mq_ops *ops = q->elevator->type->mq_ops;
+	struct request *rq;
+	bool merged = false;
+	int el_ret;
+
+	if (blk_queue_nomerges(q))
+		return false;
+
+	if (ops)
+		return ops->bio_merge(hctx, bio);
+
+	spin_lock_irq(q->queue_lock);
+	el_ret = elv_merge(q, &rq, bio);
+	if (el_ret == ELEVATOR_BACK_MERGE)
+		merged = bio_attempt_back_merge(q, rq, bio);
+	else if (el_ret == ELEVATOR_FRONT_MERGE)
+		merged = bio_attempt_front_merge(q, rq, bio);
+	if (merged)
+		elv_merged_request(q, rq, el_ret);
+	spin_unlock_irq(q->queue_lock);
+
+	return merged;
+}
+
+/**
+ * blk_mq_sched_attempt_merge - merge @bio into a request held by ->mq_ops
+ * @rq: request to merge into
+ * @bio: bio to merge
+ * @el_ret: %ELEVATOR_BACK_MERGE or %ELEVATOR_FRONT_MERGE
+ *
+ * For elevators providing ->mq_ops, called with their hctx lock held.
+ * Returns true if @bio is now part of @rq.
+ */
+bool blk_mq_sched_attempt_merge(struct request *rq, struct bio *bio,
+				int el_ret)
+{
+	if (el_ret == ELEVATOR_BACK_MERGE)
+		return bio_attempt_back_merge(rq->q, rq, bio);
+	if (el_ret == ELEVATOR_FRONT_MERGE)
+		return bio_attempt_front_merge(rq->q, rq, bio);
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_mq_sched_attempt_merge);
+
+void blk_mq_sched_insert_request(struct blk_mq_hw_ctx *hctx,
+				 struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct elevator_mq_ops *ops = q->elevator->type->mq_ops;
+
+	if (ops) {
+		ops->insert_request(hctx, rq);
+		return;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	__elv_add_request(q, rq, ELEVATOR_INSERT_SORT);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Pull up to a queue depth worth of requests out of the elevator onto
+ * @list.  Requests that belong to another hardware context are handed
+ * to that context's dispatch list and it is kicked asynchronously.
+ */
+void blk_mq_sched_dispatch_requests(struct blk_mq_hw_ctx *hctx,
+				    struct list_head *list)
+{
+	struct request_queue *q = hctx->queue;
+	struct elevator_queue *e;
+	unsigned int nr = 0;
+	unsigned long flags;
+
+	/*
+	 * Elevators are only switched with the queue frozen, when nothing
+	 * can be dispatched, so ->mq_ops can be looked at without the lock.
+	 */
+	e = ACCESS_ONCE(q->elevator);
+	if (e && e->type->mq_ops) {
+		struct elevator_mq_ops *ops = e->type->mq_ops;
+
+		while (nr < hctx->queue_depth) {
+			struct request *rq = ops->dispatch_request(hctx);
+
+			if (!rq)
+				break;
+			list_add_tail(&rq->queuelist, list);
+			nr++;
+		}
+		return;
+	}
+
+	spin_lock_irqsave(q->queue_lock, flags);
+	e = q->elevator;
+	while (e && nr < hctx->queue_depth) {
+		struct blk_mq_hw_ctx *this_hctx;
+		struct request *rq;
+
+		if (list_empty(&q->queue_head) &&
+		    !e->type->ops.elevator_dispatch_fn(q, 0))
+			break;
+
+		rq = list_entry_rq(q->queue_head.next);
+		list_del_init(&rq->queuelist);
+
+		rq->cmd_flags |= REQ_STARTED;
+		if (blk_account_rq(rq))
+			q->in_flight[rq_is_sync(rq)]++;
+		elv_activate_rq(q, rq);
+		nr++;
+
+		this_hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+		if (this_hctx == hctx) {
+			list_add_tail(&rq->queuelist, list);
+			continue;
+		}
+
+		spin_lock(&this_hctx->lock);
+		list_add_tail(&rq->queuelist, &this_hctx->dispatch);
+		spin_unlock(&this_hctx->lock);
+		blk_mq_run_hw_queue(this_hctx, true);
+	}
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+/**
+ * blk_mq_sched_kick - run all hardware queues of @q
+ * @q: request queue with an elevator attached
+ *
+ * Async replacement for __blk_run_queue() that elevators use to restart
+ * dispatch, e.g. when an idle timer expires.  Safe to call with
+ * q->queue_lock held.
+ */
+void blk_mq_sched_kick(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, true);
+}
+EXPORT_SYMBOL_GPL(blk_mq_sched_kick);
@@ -0,0 +1,34 @@
+#ifndef INT_BLK_MQ_SCHED_H
+#define INT_BLK_MQ_SCHED_H
+
+#include "blk-mq.h"
+
+/*
+ * Glue for running an elevator (with ->uses_mq set) on top of blk-mq.
+ * Requests that come in through ->make_request get elevator private data
+ * at allocation time, are sorted by the elevator under q->queue_lock and
+ * pulled back out per hardware context when that context is run.
+ */
+void blk_mq_sched_get_request(struct request_queue *q, struct request *rq,
+			      struct bio *bio);
+void blk_mq_sched_put_request(struct request *rq);
+bool blk_mq_sched_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio);
+bool blk_mq_sched_attempt_merge(struct request *rq, struct bio *bio,
+				int el_ret);
+void blk_mq_sched_insert_request(struct blk_mq_hw_ctx *hctx,
+				 struct request *rq);
+void blk_mq_sched_dispatch_requests(struct blk_mq_hw_ctx *hctx,
+				    struct list_head *list);
+void blk_mq_sched_kick(struct request_queue *q);
+
+static inline bool blk_mq_sched_enabled(struct request_queue *q)
+{
+	return q->elevator && !blk_queue_bypass(q);
+}
+
+static inline bool blk_mq_sched_bio_wants_elv(struct bio *bio)
+{
+	return !(bio->bi_rw & (REQ_FLUSH | REQ_FUA));
+}
+
+#endif
@@ -213,6 +213,82 @@ static ssize_t blk_mq_hw_sysfs_active_show(struct blk_mq_hw_ctx *hctx, char *pag
 	return sprintf(page, "%u\n", atomic_read(&hctx->nr_active));
 }
 
+/*
+ * Completions that a poller didn't reap were delivered by interrupt (or
+ * by timeout handling, which is rare enough not to matter here).
+ */
+static ssize_t blk_mq_hw_sysfs_poll_show(struct blk_mq_hw_ctx *hctx, char *page)
+{
+	struct blk_mq_ctx *ctx;
+	unsigned long completed = 0;
+	unsigned int i;
+
+	hctx_for_each_ctx(hctx, ctx, i)
+		completed += ctx->rq_completed[0] + ctx->rq_completed[1];
+
+	return sprintf(page, "considered=%lu\ninvoked=%lu\npolled=%lu\n"
+			"interrupt=%lu\nmean_ns=%llu\n",
+			hctx->poll_considered, hctx->poll_invoked,
+			hctx->poll_completed,
+			completed - min(completed, hctx->poll_completed),
+			(unsigned long long)hctx->poll_mean_ns);
+}
+
+/*
+ * One row per latency bucket: the lower bound in usec, then the number of
+ * completions for each size class, summed over the per-cpu stats.
+ */
+static ssize_t blk_mq_hw_sysfs_lat_show(struct blk_mq_hw_ctx *hctx,
+					char *page, int rw)
+{
+	char *start_page = page;
+	unsigned int i, j;
+	int cpu;
+
+	for (i = 0; i < BLK_MQ_LAT_BUCKETS; i++) {
+		unsigned long sum[BLK_MQ_SIZE_CLASSES] = { 0, };
+
+		for_each_possible_cpu(cpu) {
+			struct blk_mq_hctx_stat *stat;
+
+			stat = per_cpu_ptr(hctx->stats, cpu);
+			for (j = 0; j < BLK_MQ_SIZE_CLASSES; j++)
+				sum[j] += stat->lat[rw][j][i];
+		}
+
+		page += sprintf(page, "%8lu", i ? 1UL << (i - 1) : 0UL);
+		for (j = 0; j < BLK_MQ_SIZE_CLASSES; j++)
+			page += sprintf(page, "\t%lu", sum[j]);
+		page += sprintf(page, "\n");
+	}
+
+	return page - start_page;
+}
+
+static ssize_t blk_mq_hw_sysfs_read_lat_show(struct blk_mq_hw_ctx *hctx,
+					     char *page)
+{
+	return blk_mq_hw_sysfs_lat_show(hctx, page, READ);
+}
+
+static ssize_t blk_mq_hw_sysfs_write_lat_show(struct blk_mq_hw_ctx *hctx,
+					      char *page)
+{
+	return blk_mq_hw_sysfs_lat_show(hctx, page, WRITE);
+}
+
+static ssize_t blk_mq_hw_sysfs_inflight_show(struct blk_mq_hw_ctx *hctx,
+					     char *page)
+{
+	long inflight = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		inflight += per_cpu_ptr(hctx->stats, cpu)->inflight;
+
+	return sprintf(page, "%ld\n", max(inflight, 0L));
+}
+
 static ssize_t blk_mq_hw_sysfs_cpus_show(struct blk_mq_hw_ctx *hctx, char *page)
 {
 	unsigned int i, first = 1;
@@ -288,6 +364,22 @@ static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_cpus = {
 	.attr = {.name = "cpu_list", .mode = S_IRUGO },
 	.show = blk_mq_hw_sysfs_cpus_show,
 };
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_poll = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_poll_show,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_read_lat = {
+	.attr = {.name = "read_latency", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_read_lat_show,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_write_lat = {
+	.attr = {.name = "write_latency", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_write_lat_show,
+};
+static struct blk_mq_hw_ctx_sysfs_entry blk_mq_hw_sysfs_inflight = {
+	.attr = {.name = "inflight", .mode = S_IRUGO },
+	.show = blk_mq_hw_sysfs_inflight_show,
+};
 
 static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_queued.attr,
@@ -297,6 +389,10 @@ static struct attribute *default_hw_ctx_attrs[] = {
 	&blk_mq_hw_sysfs_tags.attr,
 	&blk_mq_hw_sysfs_cpus.attr,
 	&blk_mq_hw_sysfs_active.attr,
+	&blk_mq_hw_sysfs_poll.attr,
+	&blk_mq_hw_sysfs_read_lat.attr,
+	&blk_mq_hw_sysfs_write_lat.attr,
+	&blk_mq_hw_sysfs_inflight.attr,
 	NULL,
 };
 
@@ -28,6 +28,8 @@
 #include "blk.h"
 #include "blk-mq.h"
 #include "blk-mq-tag.h"
+#include "blk-mq-sched.h"
+#include "blk-wbt.h"
 
 static DEFINE_MUTEX(all_q_mutex);
 static LIST_HEAD(all_q_list);
@@ -122,10 +124,11 @@ void blk_mq_freeze_queue_start(struct request_queue *q)
 }
 EXPORT_SYMBOL_GPL(blk_mq_freeze_queue_start);
 
-static void blk_mq_freeze_queue_wait(struct request_queue *q)
+void blk_mq_freeze_queue_wait(struct request_queue *q)
 {
 	wait_event(q->mq_freeze_wq, percpu_ref_is_zero(&q->mq_usage_counter));
 }
+EXPORT_SYMBOL_GPL(blk_mq_freeze_queue_wait);
 
 /*
  * Guarantee no request is in use, so we can change any data structure of
@@ -136,6 +139,7 @@ void blk_mq_freeze_queue(struct request_queue *q)
 	blk_mq_freeze_queue_start(q);
 	blk_mq_freeze_queue_wait(q);
 }
+EXPORT_SYMBOL_GPL(blk_mq_freeze_queue);
 
 void blk_mq_unfreeze_queue(struct request_queue *q)
 {
@@ -193,6 +197,7 @@ static void blk_mq_rq_ctx_init(struct request_queue *q, struct blk_mq_ctx *ctx,
 	rq->rq_disk = NULL;
 	rq->part = NULL;
 	rq->start_time = jiffies;
+	rq->issue_time_ns = 0;
 #ifdef CONFIG_BLK_CGROUP
 	rq->rl = NULL;
 	set_start_time_ns(rq);
@@ -293,10 +298,13 @@ static void __blk_mq_free_request(struct blk_mq_hw_ctx *hctx,
 
 	if (rq->cmd_flags & REQ_MQ_INFLIGHT)
 		atomic_dec(&hctx->nr_active);
+	if (rq->cmd_flags & (REQ_ELVPRIV | REQ_SORTED))
+		blk_mq_sched_put_request(rq);
+	wbt_done(q->rq_wb, rq);
 	rq->cmd_flags = 0;
 
 	clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
-	blk_mq_put_tag(hctx, tag, &ctx->last_tag);
+	blk_mq_put_tag(hctx, ctx, tag);
 	blk_mq_queue_exit(q);
 }
 
@@ -320,10 +328,52 @@ void blk_mq_free_request(struct request *rq)
 }
 EXPORT_SYMBOL_GPL(blk_mq_free_request);
 
+static inline unsigned int blk_mq_size_class(unsigned int bytes)
+{
+	if (bytes <= 4096)
+		return 0;
+	if (bytes <= 16384)
+		return 1;
+	if (bytes <= 65536)
+		return 2;
+	return 3;
+}
+
+static inline unsigned int blk_mq_lat_bucket(u64 lat_ns)
+{
+	u64 usec = div_u64(lat_ns, NSEC_PER_USEC);
+
+	if (!usec)
+		return 0;
+	return min_t(u64, ilog2(usec) + 1, BLK_MQ_LAT_BUCKETS - 1);
+}
+
+/*
+ * Account the completion of @rq in the stats of its hardware queue, and
+ * feed the mean completion time that hybrid polling sleeps on.  That
+ * one is updated locklessly, it is only a hint.
+ */
+static void blk_mq_stat_complete(struct request *rq)
+{
+	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+	unsigned int size = blk_mq_size_class(rq->issue_bytes);
+	u64 lat = ktime_get_ns() - rq->issue_time_ns;
+
+	this_cpu_inc(hctx->stats->lat[rq_data_dir(rq)][size][blk_mq_lat_bucket(lat)]);
+	this_cpu_dec(hctx->stats->inflight);
+
+	if (blk_queue_poll(q))
+		hctx->poll_mean_ns = (hctx->poll_mean_ns * 7 + lat) >> 3;
+}
+
 inline void __blk_mq_end_request(struct request *rq, int error)
 {
 	blk_account_io_done(rq);
 
+	if (rq->issue_time_ns)
+		blk_mq_stat_complete(rq);
+
 	if (rq->end_io) {
 		rq->end_io(rq, error);
 	} else {
@@ -413,6 +463,7 @@ EXPORT_SYMBOL_GPL(blk_mq_request_started);
 void blk_mq_start_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
+	struct blk_mq_hw_ctx *hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
 
 	trace_block_rq_issue(q, rq);
 
@@ -434,8 +485,12 @@ void blk_mq_start_request(struct request *rq)
 	 * complete. So be sure to clear complete again when we start
 	 * the request, otherwise we'll ignore the completion event.
 	 */
-	if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags))
+	if (!test_bit(REQ_ATOM_STARTED, &rq->atomic_flags)) {
+		rq->issue_time_ns = ktime_get_ns();
+		rq->issue_bytes = blk_rq_bytes(rq);
+		this_cpu_inc(hctx->stats->inflight);
 		set_bit(REQ_ATOM_STARTED, &rq->atomic_flags);
+	}
 	if (test_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags))
 		clear_bit(REQ_ATOM_COMPLETE, &rq->atomic_flags);
 
@@ -459,6 +514,13 @@ static void __blk_mq_requeue_request(struct request *rq)
 	if (test_and_clear_bit(REQ_ATOM_STARTED, &rq->atomic_flags)) {
 		if (q->dma_drain_size && blk_rq_bytes(rq))
 			rq->nr_phys_segments--;
+		if (rq->issue_time_ns) {
+			struct blk_mq_hw_ctx *hctx;
+
+			hctx = q->mq_ops->map_queue(q, rq->mq_ctx->cpu);
+			this_cpu_dec(hctx->stats->inflight);
+			rq->issue_time_ns = 0;
+		}
 	}
 }
 
@@ -764,6 +826,7 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 	LIST_HEAD(rq_list);
 	LIST_HEAD(driver_list);
 	struct list_head *dptr;
+	bool need_commit = false;
 	int queued;
 
 	WARN_ON(!cpumask_test_cpu(raw_smp_processor_id(), hctx->cpumask));
@@ -789,6 +852,12 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 		spin_unlock(&hctx->lock);
 	}
 
+	/*
+	 * With an elevator attached, top up with whatever it lets go of.
+	 */
+	if (q->elevator)
+		blk_mq_sched_dispatch_requests(hctx, &rq_list);
+
 	/*
 	 * Start off with dptr being NULL, so we start the first request
 	 * immediately, even if we have more pending.
@@ -814,6 +883,7 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 		switch (ret) {
 		case BLK_MQ_RQ_QUEUE_OK:
 			queued++;
+			need_commit = !bd.last;
 			continue;
 		case BLK_MQ_RQ_QUEUE_BUSY:
 			list_add(&rq->queuelist, &rq_list);
@@ -838,6 +908,13 @@ static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
 			dptr = &driver_list;
 	}
 
+	/*
+	 * The driver may be holding back what it was given, waiting for a
+	 * request flagged as last that never came.
+	 */
+	if (need_commit && q->mq_ops->commit_rqs)
+		q->mq_ops->commit_rqs(hctx);
+
 	if (!queued)
 		hctx->dispatched[0]++;
 	else if (queued < (1 << (BLK_MQ_MAX_DISPATCH_ORDER - 1)))
@@ -1215,12 +1292,35 @@ static struct request *blk_mq_map_request(struct request_queue *q,
 		hctx = alloc_data.hctx;
 	}
 
+	if (blk_mq_sched_enabled(q) && blk_mq_sched_bio_wants_elv(bio))
+		blk_mq_sched_get_request(q, rq, bio);
+
 	hctx->queued++;
 	data->hctx = hctx;
 	data->ctx = ctx;
 	return rq;
 }
 
+/*
+ * Hand @rq to the elevator, or merge @bio into a request the elevator
+ * already holds.  Returns false if @rq isn't managed by an elevator.
+ */
+static bool blk_mq_sched_queue_io(struct blk_map_ctx *data,
+				  struct request *rq, struct bio *bio)
+{
+	if (!(rq->cmd_flags & REQ_ELVPRIV))
+		return false;
+
+	if (blk_mq_sched_bio_merge(data->hctx, bio)) {
+		__blk_mq_free_request(data->hctx, data->ctx, rq);
+		return true;
+	}
+
+	blk_mq_bio_to_request(rq, bio);
+	blk_mq_sched_insert_request(data->hctx, rq);
+	return true;
+}
+
 /*
  * Multiple hardware queue variant. This will not use per-process plugs,
  * but will attempt to bypass the hctx queueing if we can go straight to
@@ -1232,6 +1332,7 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	const int is_flush_fua = bio->bi_rw & (REQ_FLUSH | REQ_FUA);
 	struct blk_map_ctx data;
 	struct request *rq;
+	bool wb_acct;
 
 	blk_queue_bounce(q, &bio);
 
@@ -1240,9 +1341,16 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		return;
 	}
 
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return;
+	}
+
+	wbt_track(rq, wb_acct);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1250,6 +1358,9 @@ static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		goto run_queue;
 	}
 
+	if (blk_mq_sched_queue_io(&data, rq, bio))
+		goto run_queue;
+
 	/*
 	 * If the driver supports defer issued based on 'last', then
 	 * queue it up like normal since we can potentially save some
@@ -1309,6 +1420,7 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	unsigned int use_plug, request_count = 0;
 	struct blk_map_ctx data;
 	struct request *rq;
+	bool wb_acct;
 
 	/*
 	 * If we have multiple hardware queues, just go directly to
@@ -1327,9 +1439,16 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 	    blk_attempt_plug_merge(q, bio, &request_count))
 		return;
 
+	wb_acct = wbt_wait(q->rq_wb, bio, NULL);
+
 	rq = blk_mq_map_request(q, bio, &data);
-	if (unlikely(!rq))
+	if (unlikely(!rq)) {
+		if (wb_acct)
+			__wbt_done(q->rq_wb);
 		return;
+	}
+
+	wbt_track(rq, wb_acct);
 
 	if (unlikely(is_flush_fua)) {
 		blk_mq_bio_to_request(rq, bio);
@@ -1337,6 +1456,9 @@ static void blk_sq_make_request(struct request_queue *q, struct bio *bio)
 		goto run_queue;
 	}
 
+	if (blk_mq_sched_queue_io(&data, rq, bio))
+		goto run_queue;
+
 	/*
 	 * A task plug currently exists. Since this is completely lockless,
 	 * utilize that to temporarily store requests until the task is
@@ -1619,6 +1741,7 @@ static void blk_mq_exit_hctx(struct request_queue *q,
 	blk_mq_unregister_cpu_notifier(&hctx->cpu_notifier);
 	blk_free_flush_queue(hctx->fq);
 	kfree(hctx->ctxs);
+	free_percpu(hctx->stats);
 	blk_mq_free_bitmap(&hctx->ctx_map);
 }
 
@@ -1682,11 +1805,15 @@ static int blk_mq_init_hctx(struct request_queue *q,
 	if (blk_mq_alloc_bitmap(&hctx->ctx_map, node))
 		goto free_ctxs;
 
+	hctx->stats = alloc_percpu(struct blk_mq_hctx_stat);
+	if (!hctx->stats)
+		goto free_bitmap;
+
 	hctx->nr_ctx = 0;
 
 	if (set->ops->init_hctx &&
 	    set->ops->init_hctx(hctx, set->driver_data, hctx_idx))
-		goto free_bitmap;
+		goto free_stats;
 
 	hctx->fq = blk_alloc_flush_queue(q, hctx->numa_node, set->cmd_size);
 	if (!hctx->fq)
@@ -1705,6 +1832,8 @@ static int blk_mq_init_hctx(struct request_queue *q,
  exit_hctx:
 	if (set->ops->exit_hctx)
 		set->ops->exit_hctx(hctx, hctx_idx);
+ free_stats:
+	free_percpu(hctx->stats);
  free_bitmap:
 	blk_mq_free_bitmap(&hctx->ctx_map);
  free_ctxs:
@@ -1957,6 +2086,9 @@ struct request_queue *blk_mq_init_queue(struct blk_mq_tag_set *set)
 
 	q->sg_reserved_size = INT_MAX;
 
+	/* classic polling until io_poll_delay says otherwise */
+	q->poll_nsec = -1;
+
 	INIT_WORK(&q->requeue_work, blk_mq_requeue_work);
 	INIT_LIST_HEAD(&q->requeue_list);
 	spin_lock_init(&q->requeue_lock);
@@ -2037,7 +2169,7 @@ static void blk_mq_queue_reinit(struct request_queue *q)
 
 	blk_mq_sysfs_unregister(q);
 
-	blk_mq_update_queue_map(q->mq_map, q->nr_hw_queues);
+	blk_mq_build_queue_map(q->tag_set, q->mq_map);
 
 	/*
 	 * redo blk_mq_init_cpu_queues and blk_mq_init_hw_queues. FIXME: maybe
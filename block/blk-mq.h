@@ -12,10 +12,8 @@ struct blk_mq_ctx {
 	unsigned int		cpu;
 	unsigned int		index_hw;
 
-	unsigned int		last_tag ____cacheline_aligned_in_smp;
-
 	/* incremented at dispatch time */
-	unsigned long		rq_dispatched[2];
+	unsigned long		rq_dispatched[2] ____cacheline_aligned_in_smp;
 	unsigned long		rq_merged;
 
 	/* incremented at completion time */
@@ -27,7 +25,6 @@ struct blk_mq_ctx {
 
 void __blk_mq_complete_request(struct request *rq);
 void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async);
-void blk_mq_freeze_queue(struct request_queue *q);
 void blk_mq_free_queue(struct request_queue *q);
 void blk_mq_clone_flush_request(struct request *flush_rq,
 		struct request *orig_rq);
@@ -52,6 +49,7 @@ void blk_mq_disable_hotplug(void);
  */
 extern unsigned int *blk_mq_make_queue_map(struct blk_mq_tag_set *set);
 extern int blk_mq_update_queue_map(unsigned int *map, unsigned int nr_queues);
+extern int blk_mq_build_queue_map(struct blk_mq_tag_set *set, unsigned int *map);
 extern int blk_mq_hw_queue_to_node(unsigned int *map, unsigned int);
 
 /*
@@ -0,0 +1,464 @@
+/*
+ * Buffered writeback throttling, loosely based on CoDel.  We can't drop
+ * writes, but we can limit how many of them are in flight.  Every window
+ * we look at the lowest read completion latency we saw.  If even the
+ * fastest read took longer than the target, the device is being flooded
+ * with writes and we halve the allowed write depth.  Once reads are fast
+ * again, the depth is doubled back up to the queue depth.
+ *
+ * Only async writes are throttled.  Reads, sync writes (fsync, O_DIRECT)
+ * and flushes go straight through and are what the latency is measured
+ * on, so a big writer can no longer push them out by seconds.
+ *
+ * The target is set through /sys/block/<dev>/queue/wbt_lat_usec, 0 turns
+ * throttling off.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+
+#include "blk.h"
+#include "blk-wbt.h"
+
+enum {
+	/*
+	 * Default depth for queues that don't advertise their own,
+	 * ie everything not on blk-mq.
+	 */
+	RWB_DEF_DEPTH	= 16,
+
+	/*
+	 * 100msec window
+	 */
+	RWB_WINDOW_NSEC		= 100 * 1000 * 1000ULL,
+
+	/*
+	 * Disregard latency stats after this many windows without reads,
+	 * and start drifting back towards the full depth.
+	 */
+	RWB_UNKNOWN_BUMP	= 5,
+};
+
+enum {
+	LAT_OK = 1,
+	LAT_UNKNOWN,
+	LAT_EXCEEDED,
+};
+
+static inline bool rwb_enabled(struct rq_wb *rwb)
+{
+	return rwb && rwb->wb_normal != 0;
+}
+
+/*
+ * Increment 'v', if 'v' is below 'below'. Returns true if we succeeded,
+ * false if 'v' + 1 would be bigger than 'below'.
+ */
+static bool atomic_inc_below(atomic_t *v, int below)
+{
+	int cur = atomic_read(v);
+
+	for (;;) {
+		int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+static void wb_timestamp(struct rq_wb *rwb, unsigned long *var)
+{
+	if (rwb_enabled(rwb)) {
+		const unsigned long cur = jiffies;
+
+		if (cur != *var)
+			*var = cur;
+	}
+}
+
+/*
+ * Was there a read or sync write issued or completed in the last 100ms?
+ */
+static bool close_io(struct rq_wb *rwb)
+{
+	const unsigned long now = jiffies;
+
+	return time_before(now, rwb->last_issue + HZ / 10) ||
+		time_before(now, rwb->last_comp + HZ / 10);
+}
+
+static unsigned int get_limit(struct rq_wb *rwb)
+{
+	/*
+	 * At this point we know it's an async write.  If kswapd is the one
+	 * writing, we're short on memory and want it cleaned out as fast
+	 * as possible.  If there was other I/O recently, back off harder
+	 * so it keeps getting in.
+	 */
+	if (current_is_kswapd())
+		return rwb->wb_max;
+	if (close_io(rwb))
+		return rwb->wb_background;
+
+	return rwb->wb_normal;
+}
+
+void __wbt_done(struct rq_wb *rwb)
+{
+	int inflight, limit;
+
+	inflight = atomic_dec_return(&rwb->inflight);
+
+	/*
+	 * wbt got disabled with IO in flight. Wake up any potential
+	 * waiters, we don't have to do more than that.
+	 */
+	if (unlikely(!rwb_enabled(rwb))) {
+		wake_up_all(&rwb->wait);
+		return;
+	}
+
+	limit = close_io(rwb) ? rwb->wb_background : rwb->wb_normal;
+
+	/*
+	 * Don't wake anyone up if we are above the normal limit.
+	 */
+	if (inflight && inflight >= limit)
+		return;
+
+	if (waitqueue_active(&rwb->wait)) {
+		int diff = limit - inflight;
+
+		if (!inflight || diff >= rwb->wb_background / 2)
+			wake_up_all(&rwb->wait);
+	}
+}
+
+static void wbt_sample(struct rq_wb *rwb, struct request *rq)
+{
+	unsigned long flags;
+	u64 lat;
+
+	if (!rq->issue_time_ns)
+		return;
+
+	lat = ktime_get_ns() - rq->issue_time_ns;
+
+	spin_lock_irqsave(&rwb->stat_lock, flags);
+	if (rq_data_dir(rq) == READ) {
+		if (!rwb->read_nr || lat < rwb->read_min_nsec)
+			rwb->read_min_nsec = lat;
+		rwb->read_nr++;
+	} else
+		rwb->write_nr++;
+	spin_unlock_irqrestore(&rwb->stat_lock, flags);
+}
+
+/*
+ * Called when @rq is freed, on both the legacy and blk-mq paths.
+ */
+void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+	if (!rwb)
+		return;
+
+	if (rq->cmd_flags & REQ_WB_TRACKED) {
+		rq->cmd_flags &= ~REQ_WB_TRACKED;
+		__wbt_done(rwb);
+	} else
+		wb_timestamp(rwb, &rwb->last_comp);
+
+	wbt_sample(rwb, rq);
+}
+
+void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+	if (rwb_enabled(rwb))
+		rq->issue_time_ns = ktime_get_ns();
+}
+
+static int latency_exceeded(struct rq_wb *rwb)
+{
+	unsigned int read_nr, write_nr;
+	unsigned long flags;
+	u64 read_min;
+
+	spin_lock_irqsave(&rwb->stat_lock, flags);
+	read_min = rwb->read_min_nsec;
+	read_nr = rwb->read_nr;
+	write_nr = rwb->write_nr;
+	rwb->read_nr = rwb->write_nr = 0;
+	spin_unlock_irqrestore(&rwb->stat_lock, flags);
+
+	/*
+	 * No reads in this window.  If writes are all that is happening,
+	 * we have nothing to measure against.
+	 */
+	if (!read_nr)
+		return LAT_UNKNOWN;
+
+	/*
+	 * If the fastest read in the window was over the target, we're
+	 * queueing too much write back in front of reads.
+	 */
+	if (read_min > rwb->min_lat_nsec)
+		return LAT_EXCEEDED;
+
+	/*
+	 * Reads are fine.  Don't take that as a hint to open up unless
+	 * writes were actually completing too.
+	 */
+	if (!write_nr && !atomic_read(&rwb->inflight))
+		return LAT_UNKNOWN;
+
+	return LAT_OK;
+}
+
+static void calc_wb_limits(struct rq_wb *rwb)
+{
+	unsigned int depth;
+
+	if (!rwb->min_lat_nsec) {
+		rwb->wb_max = rwb->wb_normal = rwb->wb_background = 0;
+		return;
+	}
+
+	depth = 1 + ((rwb->queue_depth - 1) >> min(31, rwb->scale_step));
+
+	/*
+	 * Set our max/normal/bg queue depths based on how far we have
+	 * scaled down (->scale_step).
+	 */
+	rwb->wb_max = depth;
+	rwb->wb_normal = (rwb->wb_max + 1) / 2;
+	rwb->wb_background = (rwb->wb_max + 3) / 4;
+}
+
+/*
+ * Shrink the monitoring window along with the depth, so we react faster
+ * when latencies are bad.
+ */
+static void rwb_arm_timer(struct rq_wb *rwb)
+{
+	unsigned long expires;
+
+	rwb->cur_win_nsec = div_u64(rwb->win_nsec << 4,
+				    int_sqrt((rwb->scale_step + 1) << 8));
+	expires = jiffies + max(1UL, nsecs_to_jiffies(rwb->cur_win_nsec));
+	mod_timer(&rwb->window_timer, expires);
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	if (!rwb->scale_step)
+		return;
+
+	rwb->scale_step--;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+	wake_up_all(&rwb->wait);
+}
+
+static void scale_down(struct rq_wb *rwb)
+{
+	/*
+	 * Stop scaling down when we've hit the limit. This also prevents
+	 * ->scale_step from going to crazy values, if the device can't
+	 * keep up.
+	 */
+	if (rwb->wb_max == 1)
+		return;
+
+	rwb->scale_step++;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+}
+
+static void wb_timer_fn(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *) data;
+	int status;
+
+	if (!rwb_enabled(rwb))
+		return;
+
+	status = latency_exceeded(rwb);
+	switch (status) {
+	case LAT_EXCEEDED:
+		scale_down(rwb);
+		break;
+	case LAT_OK:
+		scale_up(rwb);
+		break;
+	case LAT_UNKNOWN:
+		/*
+		 * We had no read samples, start bumping up the write depth
+		 * slowly.
+		 */
+		if (++rwb->unknown_cnt < RWB_UNKNOWN_BUMP)
+			break;
+		scale_up(rwb);
+		break;
+	}
+
+	/*
+	 * Re-arm the timer if we're still throttling or have writes in
+	 * flight, otherwise the next tracked write will do it.
+	 */
+	if (rwb->scale_step || atomic_read(&rwb->inflight))
+		rwb_arm_timer(rwb);
+}
+
+/*
+ * Only throttle async writes.  Reads and sync writes are what we are
+ * trying to protect, and flushes need to get out as soon as possible.
+ */
+static inline bool wbt_should_throttle(struct bio *bio)
+{
+	if (!(bio->bi_rw & REQ_WRITE))
+		return false;
+
+	return !(bio->bi_rw & (REQ_SYNC | REQ_FLUSH | REQ_FUA | REQ_DISCARD));
+}
+
+/*
+ * Block if we will exceed our limit, or if we are currently waiting for
+ * the timer to kick off queuing again.
+ */
+static void __wbt_wait(struct rq_wb *rwb, spinlock_t *lock)
+	__releases(lock)
+	__acquires(lock)
+{
+	DEFINE_WAIT(wait);
+
+	if (atomic_inc_below(&rwb->inflight, get_limit(rwb)))
+		return;
+
+	do {
+		prepare_to_wait_exclusive(&rwb->wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+
+		if (atomic_inc_below(&rwb->inflight, get_limit(rwb)))
+			break;
+
+		if (lock)
+			spin_unlock_irq(lock);
+
+		io_schedule();
+
+		if (lock)
+			spin_lock_irq(lock);
+	} while (1);
+
+	finish_wait(&rwb->wait, &wait);
+}
+
+/**
+ * wbt_wait - throttle @bio if it is writeback
+ * @rwb: writeback throttling state of the queue, may be NULL
+ * @bio: bio about to get a request
+ * @lock: queue lock held by the caller, if any
+ *
+ * Returns true if the request allocated for @bio must be tracked with
+ * wbt_track(). May sleep, and drops and retakes @lock to do so.
+ */
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock)
+{
+	if (!rwb_enabled(rwb))
+		return false;
+
+	if (!wbt_should_throttle(bio)) {
+		wb_timestamp(rwb, &rwb->last_issue);
+		return false;
+	}
+
+	__wbt_wait(rwb, lock);
+
+	if (!timer_pending(&rwb->window_timer))
+		rwb_arm_timer(rwb);
+
+	return true;
+}
+
+/*
+ * The write depth is reset to full whenever the queue depth or the
+ * latency target changes.
+ */
+static void wbt_update_limits(struct rq_wb *rwb)
+{
+	rwb->scale_step = 0;
+	rwb->unknown_cnt = 0;
+	calc_wb_limits(rwb);
+
+	wake_up_all(&rwb->wait);
+}
+
+void wbt_set_queue_depth(struct rq_wb *rwb, unsigned int depth)
+{
+	if (!rwb)
+		return;
+
+	rwb->queue_depth = max(1U, depth);
+	wbt_update_limits(rwb);
+}
+
+void wbt_set_min_lat(struct rq_wb *rwb, u64 min_lat_nsec)
+{
+	rwb->min_lat_nsec = min_lat_nsec;
+	wbt_update_limits(rwb);
+}
+
+u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	/*
+	 * We default to 2msec for non-rotational storage, and 75msec
+	 * for rotational storage.
+	 */
+	if (blk_queue_nonrot(q))
+		return 2000000ULL;
+	else
+		return 75000000ULL;
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	rwb = kzalloc(sizeof(*rwb), GFP_KERNEL);
+	if (!rwb)
+		return -ENOMEM;
+
+	atomic_set(&rwb->inflight, 0);
+	init_waitqueue_head(&rwb->wait);
+	spin_lock_init(&rwb->stat_lock);
+	setup_timer(&rwb->window_timer, wb_timer_fn, (unsigned long) rwb);
+	rwb->last_comp = rwb->last_issue = jiffies;
+	rwb->queue = q;
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->min_lat_nsec = wbt_default_latency_nsec(q);
+	rwb->queue_depth = q->mq_ops ? max(1UL, q->nr_requests) :
+			RWB_DEF_DEPTH;
+	wbt_update_limits(rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (rwb) {
+		del_timer_sync(&rwb->window_timer);
+		q->rq_wb = NULL;
+		kfree(rwb);
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef INT_BLK_WBT_H
+#define INT_BLK_WBT_H
+
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/timer.h>
+#include <linux/spinlock.h>
+
+/*
+ * Writeback throttling state, one per request_queue.  Async writes are
+ * counted against a depth that shrinks while read completion latency is
+ * over @min_lat_nsec and grows back once it is under again.
+ */
+struct rq_wb {
+	/*
+	 * Settings that govern how many writes we allow in flight.
+	 */
+	unsigned int wb_background;		/* other I/O close by */
+	unsigned int wb_normal;			/* normal writeback */
+	unsigned int wb_max;			/* kswapd, full depth */
+	int scale_step;
+	unsigned int queue_depth;
+
+	u64 win_nsec;				/* default window size */
+	u64 cur_win_nsec;			/* current window size */
+	u64 min_lat_nsec;			/* read latency target */
+
+	unsigned int unknown_cnt;
+	struct timer_list window_timer;
+
+	unsigned long last_issue;		/* last non-throttled issue */
+	unsigned long last_comp;		/* last non-throttled comp */
+
+	/*
+	 * Read latency seen in the current window.
+	 */
+	spinlock_t stat_lock;
+	u64 read_min_nsec;
+	unsigned int read_nr;
+	unsigned int write_nr;
+
+	struct request_queue *queue;
+	atomic_t inflight;
+	wait_queue_head_t wait;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+int wbt_init(struct request_queue *q);
+void wbt_exit(struct request_queue *q);
+bool wbt_wait(struct rq_wb *rwb, struct bio *bio, spinlock_t *lock);
+void __wbt_done(struct rq_wb *rwb);
+void wbt_done(struct rq_wb *rwb, struct request *rq);
+void wbt_issue(struct rq_wb *rwb, struct request *rq);
+void wbt_set_queue_depth(struct rq_wb *rwb, unsigned int depth);
+void wbt_set_min_lat(struct rq_wb *rwb, u64 min_lat_nsec);
+u64 wbt_default_latency_nsec(struct request_queue *q);
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline bool wbt_wait(struct rq_wb *rwb, struct bio *bio,
+			    spinlock_t *lock)
+{
+	return false;
+}
+static inline void __wbt_done(struct rq_wb *rwb)
+{
+}
+static inline void wbt_done(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_issue(struct rq_wb *rwb, struct request *rq)
+{
+}
+static inline void wbt_set_queue_depth(struct rq_wb *rwb, unsigned int depth)
+{
+}
+static inline void wbt_set_min_lat(struct rq_wb *rwb, u64 min_lat_nsec)
+{
+}
+static inline u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	return 0;
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+/*
+ * Mark @rq as counted against the throttle if wbt_wait() said so.
+ */
+static inline void wbt_track(struct request *rq, bool tracked)
+{
+	if (tracked)
+		rq->cmd_flags |= REQ_WB_TRACKED;
+}
+
+#endif
@@ -112,6 +112,7 @@ static inline void blk_clear_rq_complete(struct request *rq)
 #define ELV_ON_HASH(rq) ((rq)->cmd_flags & REQ_HASHED)
 
 void blk_insert_flush(struct request *rq);
+void elevator_mq_exit(struct request_queue *q);
 
 static inline struct request *__elv_next_request(struct request_queue *q)
 {
@@ -281,4 +282,23 @@ static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline void blk_throtl_exit(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern void blk_iolatency_throttle(struct request_queue *q, struct bio *bio);
+extern void __blk_iolatency_done_bio(struct bio *bio);
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+
+static inline void blk_iolatency_done_bio(struct bio *bio)
+{
+	if (bio->bi_iolat_blkg)
+		__blk_iolatency_done_bio(bio);
+}
+#else /* CONFIG_BLK_CGROUP_IOLATENCY */
+static inline void blk_iolatency_throttle(struct request_queue *q,
+					  struct bio *bio) { }
+static inline void blk_iolatency_done_bio(struct bio *bio) { }
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+#endif /* CONFIG_BLK_CGROUP_IOLATENCY */
+
 #endif /* BLK_INTERNAL_H */
@@ -35,11 +35,13 @@
 #include <linux/hash.h>
 #include <linux/uaccess.h>
 #include <linux/pm_runtime.h>
+#include <linux/blk-mq.h>
 
 #include <trace/events/block.h>
 
 #include "blk.h"
 #include "blk-cgroup.h"
+#include "blk-mq.h"
 
 static DEFINE_SPINLOCK(elv_list_lock);
 static LIST_HEAD(elv_list);
@@ -204,6 +206,10 @@ int elevator_init(struct request_queue *q, char *name)
 		e = elevator_get(name, true);
 		if (!e)
 			return -EINVAL;
+		if (e->mq_ops) {
+			elevator_put(e);
+			return -EINVAL;
+		}
 	}
 
 	/*
@@ -216,6 +222,12 @@ int elevator_init(struct request_queue *q, char *name)
 		if (!e)
 			printk(KERN_ERR "I/O scheduler %s not found\n",
 							chosen_elevator);
+		else if (e->mq_ops) {
+			printk(KERN_ERR "I/O scheduler %s only runs on blk-mq\n",
+							chosen_elevator);
+			elevator_put(e);
+			e = NULL;
+		}
 	}
 
 	if (!e) {
@@ -946,6 +958,91 @@ fail_init:
 	return err;
 }
 
+/*
+ * Switch @q to @new_e, or detach the elevator if @new_e is %NULL.  The
+ * queue is frozen, so no request with elevator private data can exist
+ * while this runs.  On failure the old elevator is kept.
+ */
+static int elevator_switch_mq(struct request_queue *q,
+			      struct elevator_type *new_e)
+{
+	struct elevator_queue *old = q->elevator;
+	int err = 0;
+
+	blk_mq_freeze_queue(q);
+
+	if (old && old->registered)
+		elv_unregister_queue(q);
+
+	spin_lock_irq(q->queue_lock);
+	ioc_clear_queue(q);
+	spin_unlock_irq(q->queue_lock);
+
+	if (new_e) {
+		if (!old) {
+			INIT_LIST_HEAD(&q->queue_head);
+			q->last_merge = NULL;
+			q->end_sector = 0;
+			q->boundary_rq = NULL;
+		}
+
+		err = new_e->ops.elevator_init_fn(q, new_e);
+		if (err) {
+			elevator_put(new_e);
+			goto fail;
+		}
+
+		err = elv_register_queue(q);
+		if (err) {
+			elevator_exit(q->elevator);
+			goto fail;
+		}
+	} else {
+		spin_lock_irq(q->queue_lock);
+		q->elevator = NULL;
+		spin_unlock_irq(q->queue_lock);
+	}
+
+	if (old)
+		elevator_exit(old);
+	blk_mq_unfreeze_queue(q);
+
+	blk_add_trace_msg(q, "elv switch: %s",
+			  new_e ? new_e->elevator_name : "none");
+	return 0;
+
+fail:
+	spin_lock_irq(q->queue_lock);
+	q->elevator = old;
+	spin_unlock_irq(q->queue_lock);
+	if (old)
+		elv_register_queue(q);
+	blk_mq_unfreeze_queue(q);
+	return err;
+}
+
+/*
+ * Tear down the elevator of a dying queue before its hardware contexts
+ * go away, so that elevator timers can no longer kick them.
+ */
+void elevator_mq_exit(struct request_queue *q)
+{
+	struct elevator_queue *e = q->elevator;
+
+	if (!e)
+		return;
+
+	if (e->registered)
+		elv_unregister_queue(q);
+
+	spin_lock_irq(q->queue_lock);
+	ioc_clear_queue(q);
+	q->elevator = NULL;
+	spin_unlock_irq(q->queue_lock);
+
+	elevator_exit(e);
+}
+
 /*
  * Switch this queue to the given IO scheduler.
  */
@@ -954,21 +1051,45 @@ static int __elevator_change(struct request_queue *q, const char *name)
 	char elevator_name[ELV_NAME_MAX];
 	struct elevator_type *e;
 
-	if (!q->elevator)
+	if (!q->elevator && !q->mq_ops)
 		return -ENXIO;
 
 	strlcpy(elevator_name, name, sizeof(elevator_name));
+	if (q->mq_ops && !strcmp(strstrip(elevator_name), "none")) {
+		if (!q->elevator)
+			return 0;
+		return elevator_switch_mq(q, NULL);
+	}
+
 	e = elevator_get(strstrip(elevator_name), true);
 	if (!e) {
 		printk(KERN_ERR "elevator: type %s not found\n", elevator_name);
 		return -EINVAL;
 	}
 
-	if (!strcmp(elevator_name, q->elevator->type->elevator_name)) {
+	if (q->elevator &&
+	    !strcmp(elevator_name, q->elevator->type->elevator_name)) {
 		elevator_put(e);
 		return 0;
 	}
 
+	if (q->mq_ops) {
+		if (!e->uses_mq) {
+			printk(KERN_ERR "elevator: %s does not support blk-mq\n",
+			       elevator_name);
+			elevator_put(e);
+			return -EINVAL;
+		}
+		return elevator_switch_mq(q, e);
+	}
+
+	if (e->mq_ops) {
+		printk(KERN_ERR "elevator: %s only runs on blk-mq\n",
+		       elevator_name);
+		elevator_put(e);
+		return -EINVAL;
+	}
+
 	return elevator_switch(q, e);
 }
 
@@ -990,7 +1111,7 @@ ssize_t elv_iosched_store(struct request_queue *q, const char *name,
 {
 	int ret;
 
-	if (!q->elevator)
+	if (!q->elevator && !q->mq_ops)
 		return count;
 
 	ret = __elevator_change(q, name);
@@ -1008,20 +1129,27 @@ ssize_t elv_iosched_show(struct request_queue *q, char *name)
 	struct elevator_type *__e;
 	int len = 0;
 
-	if (!q->elevator || !blk_queue_stackable(q))
+	if (!q->mq_ops && (!q->elevator || !blk_queue_stackable(q)))
 		return sprintf(name, "none\n");
 
-	elv = e->type;
+	elv = e ? e->type : NULL;
 
 	spin_lock(&elv_list_lock);
 	list_for_each_entry(__e, &elv_list, list) {
-		if (!strcmp(elv->elevator_name, __e->elevator_name))
+		if (q->mq_ops && !__e->uses_mq)
+			continue;
+		if (!q->mq_ops && __e->mq_ops)
+			continue;
+		if (elv && !strcmp(elv->elevator_name, __e->elevator_name))
 			len += sprintf(name+len, "[%s] ", elv->elevator_name);
 		else
 			len += sprintf(name+len, "%s ", __e->elevator_name);
 	}
 	spin_unlock(&elv_list_lock);
 
+	if (q->mq_ops)
+		len += sprintf(name+len, elv ? "none" : "[none]");
+
 	len += sprintf(len+name, "\n");
 	return len;
 }
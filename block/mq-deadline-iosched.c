@@ -0,0 +1,488 @@
+/*
+ *  Deadline i/o scheduler for blk-mq.
+ *
+ *  The same CSCAN batches with FIFO expiry as deadline-iosched.c, but
+ *  with a sort and fifo list set in every hardware context, each under a
+ *  lock of its own.  Only the tunables are shared by the whole queue.
+ *
+ *  Copyright (C) 2002 Jens Axboe <axboe@kernel.dk>
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+
+#include "blk-mq-sched.h"
+
+/*
+ * See Documentation/block/deadline-iosched.txt
+ */
+static const int read_expire = HZ / 2;  /* max time before a read is submitted. */
+static const int write_expire = 5 * HZ; /* ditto for writes, these limits are SOFT! */
+static const int writes_starved = 2;    /* max times reads can starve a write */
+static const int fifo_batch = 16;       /* # of sequential requests treated as one
+				     by the above parameters. For throughput. */
+
+/*
+ * settings that change how the i/o scheduler behaves, one set per queue
+ */
+struct deadline_mq_data {
+	struct request_queue *queue;
+
+	int fifo_expire[2];
+	int fifo_batch;
+	int writes_starved;
+	int front_merges;
+};
+
+/*
+ * run time data, one per hardware context
+ */
+struct deadline_hctx_data {
+	spinlock_t lock;
+	struct deadline_mq_data *dd;
+
+	/*
+	 * requests are present on both sort_list and fifo_list
+	 */
+	struct rb_root sort_list[2];
+	struct list_head fifo_list[2];
+
+	/*
+	 * next in sort order. read, write or both are NULL
+	 */
+	struct request *next_rq[2];
+	unsigned int batching;		/* number of sequential requests made */
+	unsigned int starved;		/* times reads have starved writes */
+};
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+dd_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void dd_del_rq_rb(struct deadline_hctx_data *hd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	if (hd->next_rq[data_dir] == rq)
+		hd->next_rq[data_dir] = dd_latter_request(rq);
+
+	elv_rb_del(&hd->sort_list[data_dir], rq);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void dd_remove_request(struct deadline_hctx_data *hd,
+			      struct request *rq)
+{
+	list_del_init(&rq->queuelist);
+	dd_del_rq_rb(hd, rq);
+}
+
+/*
+ * Find the request that ends where @sector starts.  Requests rarely
+ * overlap, so it is the last one that starts before @sector if any.
+ */
+static struct request *dd_find_back_merge(struct rb_root *root,
+					  sector_t sector)
+{
+	struct rb_node *node = root->rb_node;
+	struct request *rq = NULL;
+
+	while (node) {
+		struct request *__rq = rb_entry_rq(node);
+
+		if (blk_rq_pos(__rq) < sector) {
+			rq = __rq;
+			node = node->rb_right;
+		} else
+			node = node->rb_left;
+	}
+
+	if (rq && rq_end_sector(rq) == sector)
+		return rq;
+	return NULL;
+}
+
+static bool dd_bio_merge(struct blk_mq_hw_ctx *hctx, struct bio *bio)
+{
+	struct deadline_hctx_data *hd = hctx->sched_data;
+	struct rb_root *root = &hd->sort_list[bio_data_dir(bio)];
+	struct request *rq;
+	bool merged = false;
+
+	spin_lock(&hd->lock);
+
+	rq = dd_find_back_merge(root, bio->bi_iter.bi_sector);
+	if (rq && elv_rq_merge_ok(rq, bio) &&
+	    blk_mq_sched_attempt_merge(rq, bio, ELEVATOR_BACK_MERGE)) {
+		merged = true;
+		goto out;
+	}
+
+	if (hd->dd->front_merges) {
+		rq = elv_rb_find(root, bio_end_sector(bio));
+		if (rq && elv_rq_merge_ok(rq, bio) &&
+		    blk_mq_sched_attempt_merge(rq, bio, ELEVATOR_FRONT_MERGE)) {
+			/*
+			 * the request starts earlier now, reposition it
+			 */
+			elv_rb_del(root, rq);
+			elv_rb_add(root, rq);
+			merged = true;
+		}
+	}
+out:
+	spin_unlock(&hd->lock);
+	return merged;
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq)
+{
+	struct deadline_hctx_data *hd = hctx->sched_data;
+	const int data_dir = rq_data_dir(rq);
+
+	spin_lock(&hd->lock);
+	elv_rb_add(&hd->sort_list[data_dir], rq);
+
+	/*
+	 * set expire time and add to fifo list
+	 */
+	rq->fifo_time = jiffies + hd->dd->fifo_expire[data_dir];
+	list_add_tail(&rq->queuelist, &hd->fifo_list[data_dir]);
+	spin_unlock(&hd->lock);
+}
+
+/*
+ * take rq off the sort and fifo list, it goes to the driver next
+ */
+static void dd_move_request(struct deadline_hctx_data *hd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	hd->next_rq[READ] = NULL;
+	hd->next_rq[WRITE] = NULL;
+	hd->next_rq[data_dir] = dd_latter_request(rq);
+
+	dd_remove_request(hd, rq);
+}
+
+/*
+ * dd_check_fifo returns 0 if there are no expired requests on the fifo,
+ * 1 otherwise. Requires !list_empty(&hd->fifo_list[data_dir])
+ */
+static inline int dd_check_fifo(struct deadline_hctx_data *hd, int ddir)
+{
+	struct request *rq = rq_entry_fifo(hd->fifo_list[ddir].next);
+
+	/*
+	 * rq is expired!
+	 */
+	if (time_after_eq(jiffies, rq->fifo_time))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * select the best request according to read/write expire, fifo_batch, etc
+ */
+static struct request *__dd_dispatch_request(struct deadline_hctx_data *hd)
+{
+	struct deadline_mq_data *dd = hd->dd;
+	const int reads = !list_empty(&hd->fifo_list[READ]);
+	const int writes = !list_empty(&hd->fifo_list[WRITE]);
+	struct request *rq;
+	int data_dir;
+
+	/*
+	 * batches are currently reads XOR writes
+	 */
+	if (hd->next_rq[WRITE])
+		rq = hd->next_rq[WRITE];
+	else
+		rq = hd->next_rq[READ];
+
+	if (rq && hd->batching < dd->fifo_batch)
+		/* we have a next request are still entitled to batch */
+		goto dispatch_request;
+
+	/*
+	 * at this point we are not running a batch. select the appropriate
+	 * data direction (read / write)
+	 */
+
+	if (reads) {
+		BUG_ON(RB_EMPTY_ROOT(&hd->sort_list[READ]));
+
+		if (writes && (hd->starved++ >= dd->writes_starved))
+			goto dispatch_writes;
+
+		data_dir = READ;
+
+		goto dispatch_find_request;
+	}
+
+	/*
+	 * there are either no reads or writes have been starved
+	 */
+
+	if (writes) {
+dispatch_writes:
+		BUG_ON(RB_EMPTY_ROOT(&hd->sort_list[WRITE]));
+
+		hd->starved = 0;
+
+		data_dir = WRITE;
+
+		goto dispatch_find_request;
+	}
+
+	return NULL;
+
+dispatch_find_request:
+	/*
+	 * we are not running a batch, find best request for selected data_dir
+	 */
+	if (dd_check_fifo(hd, data_dir) || !hd->next_rq[data_dir]) {
+		/*
+		 * A deadline has expired, the last request was in the other
+		 * direction, or we have run out of higher-sectored requests.
+		 * Start again from the request with the earliest expiry time.
+		 */
+		rq = rq_entry_fifo(hd->fifo_list[data_dir].next);
+	} else {
+		/*
+		 * The last req was the same dir and we have a next request in
+		 * sort order. No expired requests so continue on from here.
+		 */
+		rq = hd->next_rq[data_dir];
+	}
+
+	hd->batching = 0;
+
+dispatch_request:
+	/*
+	 * rq is the selected appropriate request.
+	 */
+	hd->batching++;
+	dd_move_request(hd, rq);
+
+	return rq;
+}
+
+static struct request *dd_dispatch_request(struct blk_mq_hw_ctx *hctx)
+{
+	struct deadline_hctx_data *hd = hctx->sched_data;
+	struct request *rq;
+
+	spin_lock(&hd->lock);
+	rq = __dd_dispatch_request(hd);
+	spin_unlock(&hd->lock);
+
+	return rq;
+}
+
+static void dd_exit_queue(struct elevator_queue *e)
+{
+	struct deadline_mq_data *dd = e->elevator_data;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	queue_for_each_hw_ctx(dd->queue, hctx, i) {
+		struct deadline_hctx_data *hd = hctx->sched_data;
+
+		if (!hd)
+			continue;
+
+		BUG_ON(!list_empty(&hd->fifo_list[READ]));
+		BUG_ON(!list_empty(&hd->fifo_list[WRITE]));
+
+		hctx->sched_data = NULL;
+		kfree(hd);
+	}
+
+	kfree(dd);
+}
+
+/*
+ * initialize elevator private data, and that of every hardware context.
+ * The queue is frozen while this runs.
+ */
+static int dd_init_queue(struct request_queue *q, struct elevator_type *e)
+{
+	struct deadline_mq_data *dd;
+	struct elevator_queue *eq;
+	struct blk_mq_hw_ctx *hctx;
+	unsigned int i;
+
+	eq = elevator_alloc(q, e);
+	if (!eq)
+		return -ENOMEM;
+
+	dd = kzalloc_node(sizeof(*dd), GFP_KERNEL, q->node);
+	if (!dd) {
+		kobject_put(&eq->kobj);
+		return -ENOMEM;
+	}
+	eq->elevator_data = dd;
+
+	dd->queue = q;
+	dd->fifo_expire[READ] = read_expire;
+	dd->fifo_expire[WRITE] = write_expire;
+	dd->writes_starved = writes_starved;
+	dd->front_merges = 1;
+	dd->fifo_batch = fifo_batch;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		struct deadline_hctx_data *hd;
+
+		hd = kzalloc_node(sizeof(*hd), GFP_KERNEL, hctx->numa_node);
+		if (!hd) {
+			dd_exit_queue(eq);
+			eq->elevator_data = NULL;
+			kobject_put(&eq->kobj);
+			return -ENOMEM;
+		}
+
+		spin_lock_init(&hd->lock);
+		hd->dd = dd;
+		INIT_LIST_HEAD(&hd->fifo_list[READ]);
+		INIT_LIST_HEAD(&hd->fifo_list[WRITE]);
+		hd->sort_list[READ] = RB_ROOT;
+		hd->sort_list[WRITE] = RB_ROOT;
+		hctx->sched_data = hd;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	q->elevator = eq;
+	spin_unlock_irq(q->queue_lock);
+	return 0;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+dd_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+dd_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct deadline_mq_data *dd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return dd_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(dd_read_expire_show, dd->fifo_expire[READ], 1);
+SHOW_FUNCTION(dd_write_expire_show, dd->fifo_expire[WRITE], 1);
+SHOW_FUNCTION(dd_writes_starved_show, dd->writes_starved, 0);
+SHOW_FUNCTION(dd_front_merges_show, dd->front_merges, 0);
+SHOW_FUNCTION(dd_fifo_batch_show, dd->fifo_batch, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct deadline_mq_data *dd = e->elevator_data;			\
+	int __data;							\
+	int ret = dd_var_store(&__data, (page), count);			\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(dd_read_expire_store, &dd->fifo_expire[READ], 0, INT_MAX, 1);
+STORE_FUNCTION(dd_write_expire_store, &dd->fifo_expire[WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(dd_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX, 0);
+STORE_FUNCTION(dd_front_merges_store, &dd->front_merges, 0, 1, 0);
+STORE_FUNCTION(dd_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+#define DD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, dd_##name##_show, dd_##name##_store)
+
+static struct elv_fs_entry mq_deadline_attrs[] = {
+	DD_ATTR(read_expire),
+	DD_ATTR(write_expire),
+	DD_ATTR(writes_starved),
+	DD_ATTR(front_merges),
+	DD_ATTR(fifo_batch),
+	__ATTR_NULL
+};
+
+static struct elevator_mq_ops mq_deadline_mq_ops = {
+	.bio_merge =		dd_bio_merge,
+	.insert_request =	dd_insert_request,
+	.dispatch_request =	dd_dispatch_request,
+};
+
+static struct elevator_type iosched_mq_deadline = {
+	.ops = {
+		.elevator_init_fn =		dd_init_queue,
+		.elevator_exit_fn =		dd_exit_queue,
+	},
+	.mq_ops = &mq_deadline_mq_ops,
+	.uses_mq = true,
+
+	.elevator_attrs = mq_deadline_attrs,
+	.elevator_name = "mq-deadline",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init mq_deadline_init(void)
+{
+	return elv_register(&iosched_mq_deadline);
+}
+
+static void __exit mq_deadline_exit(void)
+{
+	elv_unregister(&iosched_mq_deadline);
+}
+
+module_init(mq_deadline_init);
+module_exit(mq_deadline_exit);
+
+MODULE_AUTHOR("Jens Axboe");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("MQ deadline IO scheduler");
@@ -0,0 +1,421 @@
+/*
+ * ChaCha20-Poly1305 AEAD, RFC7539
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <crypto/internal/aead.h>
+#include <crypto/internal/hash.h>
+#include <crypto/internal/skcipher.h>
+#include <crypto/scatterwalk.h>
+#include <crypto/chacha20.h>
+#include <crypto/poly1305.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#define CHACHAPOLY_IV_SIZE	12
+
+/*
+ * The template only instantiates synchronous chacha20 and poly1305
+ * implementations, so every step below completes before returning and
+ * the request can be processed straight through without callbacks.
+ */
+struct chachapoly_instance_ctx {
+	struct crypto_skcipher_spawn chacha;
+	struct crypto_ahash_spawn poly;
+};
+
+struct chachapoly_ctx {
+	struct crypto_ablkcipher *chacha;
+	struct crypto_ahash *poly;
+};
+
+struct chachapoly_req_ctx {
+	/* one time Poly1305 key, derived from the first keystream block */
+	u8 key[POLY1305_KEY_SIZE];
+	/* calculated Poly1305 tag */
+	u8 tag[POLY1305_DIGEST_SIZE];
+	/* tag received with the ciphertext */
+	u8 itag[POLY1305_DIGEST_SIZE];
+	/* counter and nonce for the ChaCha20 child */
+	u8 iv[CHACHA20_IV_SIZE];
+	/* little endian lengths of associated data and ciphertext */
+	__le64 lens[2];
+	struct scatterlist sg[1];
+	union {
+		struct ahash_request ahreq;
+		struct ablkcipher_request abreq;
+	} u;
+};
+
+static const u8 chachapoly_zeroes[POLY1305_BLOCK_SIZE];
+
+static inline struct chachapoly_req_ctx *chachapoly_reqctx(
+	struct aead_request *req)
+{
+	unsigned long align = crypto_aead_alignmask(crypto_aead_reqtfm(req));
+
+	return (void *)PTR_ALIGN((u8 *)aead_request_ctx(req), align + 1);
+}
+
+static int chachapoly_crypt(struct aead_request *req,
+			    struct scatterlist *dst, struct scatterlist *src,
+			    unsigned int len, u32 counter, bool enc)
+{
+	struct chachapoly_ctx *ctx = crypto_aead_ctx(crypto_aead_reqtfm(req));
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+	struct ablkcipher_request *abreq = &rctx->u.abreq;
+
+	*(__le32 *)rctx->iv = cpu_to_le32(counter);
+	memcpy(rctx->iv + sizeof(__le32), req->iv, CHACHAPOLY_IV_SIZE);
+
+	ablkcipher_request_set_tfm(abreq, ctx->chacha);
+	ablkcipher_request_set_callback(abreq, aead_request_flags(req),
+					NULL, NULL);
+	ablkcipher_request_set_crypt(abreq, src, dst, len, rctx->iv);
+
+	return enc ? crypto_ablkcipher_encrypt(abreq) :
+		     crypto_ablkcipher_decrypt(abreq);
+}
+
+static int chachapoly_setpolykey(struct aead_request *req)
+{
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+
+	memset(rctx->key, 0, sizeof(rctx->key));
+	sg_init_one(rctx->sg, rctx->key, sizeof(rctx->key));
+
+	return chachapoly_crypt(req, rctx->sg, rctx->sg, sizeof(rctx->key),
+				0, true);
+}
+
+static int chachapoly_polyupdate(struct aead_request *req,
+				 struct scatterlist *sg, unsigned int len)
+{
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+	struct ahash_request *ahreq = &rctx->u.ahreq;
+
+	ahash_request_set_crypt(ahreq, sg, NULL, len);
+	return crypto_ahash_update(ahreq);
+}
+
+static int chachapoly_polypad(struct aead_request *req, unsigned int len)
+{
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+	unsigned int padlen = -len % POLY1305_BLOCK_SIZE;
+
+	if (!padlen)
+		return 0;
+
+	sg_init_one(rctx->sg, chachapoly_zeroes, padlen);
+	return chachapoly_polyupdate(req, rctx->sg, padlen);
+}
+
+/*
+ * tag = Poly1305(key, aad | pad16 | ct | pad16 | le64(aadlen) | le64(ctlen))
+ */
+static int chachapoly_mac(struct aead_request *req, struct scatterlist *ct,
+			  unsigned int ctlen)
+{
+	struct chachapoly_ctx *ctx = crypto_aead_ctx(crypto_aead_reqtfm(req));
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+	struct ahash_request *ahreq = &rctx->u.ahreq;
+	int err;
+
+	ahash_request_set_tfm(ahreq, ctx->poly);
+	ahash_request_set_callback(ahreq, aead_request_flags(req), NULL, NULL);
+
+	err = crypto_ahash_init(ahreq);
+	if (err)
+		return err;
+
+	sg_init_one(rctx->sg, rctx->key, sizeof(rctx->key));
+	err = chachapoly_polyupdate(req, rctx->sg, sizeof(rctx->key));
+	if (err)
+		return err;
+
+	err = chachapoly_polyupdate(req, req->assoc, req->assoclen);
+	if (err)
+		return err;
+	err = chachapoly_polypad(req, req->assoclen);
+	if (err)
+		return err;
+
+	err = chachapoly_polyupdate(req, ct, ctlen);
+	if (err)
+		return err;
+	err = chachapoly_polypad(req, ctlen);
+	if (err)
+		return err;
+
+	rctx->lens[0] = cpu_to_le64(req->assoclen);
+	rctx->lens[1] = cpu_to_le64(ctlen);
+	sg_init_one(rctx->sg, rctx->lens, sizeof(rctx->lens));
+	err = chachapoly_polyupdate(req, rctx->sg, sizeof(rctx->lens));
+	if (err)
+		return err;
+
+	ahash_request_set_crypt(ahreq, NULL, rctx->tag, 0);
+	return crypto_ahash_final(ahreq);
+}
+
+static int chachapoly_encrypt(struct aead_request *req)
+{
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+	int err;
+
+	err = chachapoly_setpolykey(req);
+	if (err)
+		return err;
+
+	err = chachapoly_crypt(req, req->dst, req->src, req->cryptlen, 1,
+			       true);
+	if (err)
+		return err;
+
+	err = chachapoly_mac(req, req->dst, req->cryptlen);
+	if (err)
+		return err;
+
+	scatterwalk_map_and_copy(rctx->tag, req->dst, req->cryptlen,
+				 POLY1305_DIGEST_SIZE, 1);
+	return 0;
+}
+
+static int chachapoly_decrypt(struct aead_request *req)
+{
+	struct chachapoly_req_ctx *rctx = chachapoly_reqctx(req);
+	unsigned int ctlen;
+	int err;
+
+	if (req->cryptlen < POLY1305_DIGEST_SIZE)
+		return -EINVAL;
+	ctlen = req->cryptlen - POLY1305_DIGEST_SIZE;
+
+	err = chachapoly_setpolykey(req);
+	if (err)
+		return err;
+
+	err = chachapoly_mac(req, req->src, ctlen);
+	if (err)
+		return err;
+
+	scatterwalk_map_and_copy(rctx->itag, req->src, ctlen,
+				 POLY1305_DIGEST_SIZE, 0);
+	if (crypto_memneq(rctx->itag, rctx->tag, POLY1305_DIGEST_SIZE))
+		return -EBADMSG;
+
+	return chachapoly_crypt(req, req->dst, req->src, ctlen, 1, false);
+}
+
+static int chachapoly_setkey(struct crypto_aead *aead, const u8 *key,
+			     unsigned int keylen)
+{
+	struct chachapoly_ctx *ctx = crypto_aead_ctx(aead);
+	int err;
+
+	if (keylen != CHACHA20_KEY_SIZE)
+		return -EINVAL;
+
+	crypto_ablkcipher_clear_flags(ctx->chacha, CRYPTO_TFM_REQ_MASK);
+	crypto_ablkcipher_set_flags(ctx->chacha, crypto_aead_get_flags(aead) &
+				    CRYPTO_TFM_REQ_MASK);
+
+	err = crypto_ablkcipher_setkey(ctx->chacha, key, keylen);
+	crypto_aead_set_flags(aead, crypto_ablkcipher_get_flags(ctx->chacha) &
+			      CRYPTO_TFM_RES_MASK);
+	return err;
+}
+
+static int chachapoly_setauthsize(struct crypto_aead *tfm,
+				  unsigned int authsize)
+{
+	if (authsize != POLY1305_DIGEST_SIZE)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int chachapoly_init(struct crypto_tfm *tfm)
+{
+	struct crypto_instance *inst = (void *)tfm->__crt_alg;
+	struct chachapoly_instance_ctx *ictx = crypto_instance_ctx(inst);
+	struct chachapoly_ctx *ctx = crypto_tfm_ctx(tfm);
+	struct crypto_ablkcipher *chacha;
+	struct crypto_ahash *poly;
+	unsigned long align;
+
+	poly = crypto_spawn_ahash(&ictx->poly);
+	if (IS_ERR(poly))
+		return PTR_ERR(poly);
+
+	chacha = crypto_spawn_skcipher(&ictx->chacha);
+	if (IS_ERR(chacha)) {
+		crypto_free_ahash(poly);
+		return PTR_ERR(chacha);
+	}
+
+	ctx->chacha = chacha;
+	ctx->poly = poly;
+
+	align = crypto_tfm_alg_alignmask(tfm);
+	align &= ~(crypto_tfm_ctx_alignment() - 1);
+	tfm->crt_aead.reqsize = align +
+				offsetof(struct chachapoly_req_ctx, u) +
+				max(offsetof(struct ablkcipher_request, __ctx) +
+				    crypto_ablkcipher_reqsize(chacha),
+				    offsetof(struct ahash_request, __ctx) +
+				    crypto_ahash_reqsize(poly));
+
+	return 0;
+}
+
+static void chachapoly_exit(struct crypto_tfm *tfm)
+{
+	struct chachapoly_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_ahash(ctx->poly);
+	crypto_free_ablkcipher(ctx->chacha);
+}
+
+static struct crypto_instance *chachapoly_alloc(struct rtattr **tb)
+{
+	struct crypto_attr_type *algt;
+	struct crypto_instance *inst;
+	struct crypto_alg *chacha;
+	struct crypto_alg *poly;
+	struct hash_alg_common *poly_hash;
+	struct chachapoly_instance_ctx *ctx;
+	const char *chacha_name;
+	int err;
+
+	algt = crypto_get_attr_type(tb);
+	if (IS_ERR(algt))
+		return ERR_CAST(algt);
+
+	if ((algt->type ^ CRYPTO_ALG_TYPE_AEAD) & algt->mask)
+		return ERR_PTR(-EINVAL);
+
+	chacha_name = crypto_attr_alg_name(tb[1]);
+	if (IS_ERR(chacha_name))
+		return ERR_CAST(chacha_name);
+
+	poly_hash = ahash_attr_alg(tb[2], CRYPTO_ALG_TYPE_HASH,
+				   CRYPTO_ALG_TYPE_AHASH_MASK |
+				   CRYPTO_ALG_ASYNC);
+	if (IS_ERR(poly_hash))
+		return ERR_CAST(poly_hash);
+
+	poly = &poly_hash->base;
+
+	err = -EINVAL;
+	if (poly_hash->digestsize != POLY1305_DIGEST_SIZE)
+		goto out_put_poly;
+
+	inst = kzalloc(sizeof(*inst) + sizeof(*ctx), GFP_KERNEL);
+	err = -ENOMEM;
+	if (!inst)
+		goto out_put_poly;
+
+	ctx = crypto_instance_ctx(inst);
+
+	err = crypto_init_ahash_spawn(&ctx->poly, poly_hash, inst);
+	if (err)
+		goto err_free_inst;
+
+	crypto_set_skcipher_spawn(&ctx->chacha, inst);
+	err = crypto_grab_skcipher(&ctx->chacha, chacha_name, 0,
+				   CRYPTO_ALG_ASYNC);
+	if (err)
+		goto err_drop_poly;
+
+	chacha = crypto_skcipher_spawn_alg(&ctx->chacha);
+
+	err = -EINVAL;
+	/* Need 16-byte IV size, including Initial Block Counter value */
+	if (chacha->cra_ablkcipher.ivsize != CHACHA20_IV_SIZE)
+		goto err_drop_chacha;
+	/* Not a stream cipher? */
+	if (chacha->cra_blocksize != 1)
+		goto err_drop_chacha;
+
+	err = -ENAMETOOLONG;
+	if (snprintf(inst->alg.cra_name, CRYPTO_MAX_ALG_NAME,
+		     "rfc7539(%s,%s)", chacha->cra_name,
+		     poly->cra_name) >= CRYPTO_MAX_ALG_NAME)
+		goto err_drop_chacha;
+	if (snprintf(inst->alg.cra_driver_name, CRYPTO_MAX_ALG_NAME,
+		     "rfc7539(%s,%s)", chacha->cra_driver_name,
+		     poly->cra_driver_name) >= CRYPTO_MAX_ALG_NAME)
+		goto err_drop_chacha;
+
+	inst->alg.cra_flags = CRYPTO_ALG_TYPE_AEAD;
+	inst->alg.cra_priority = (chacha->cra_priority +
+				  poly->cra_priority) / 2;
+	inst->alg.cra_blocksize = 1;
+	inst->alg.cra_alignmask = chacha->cra_alignmask | poly->cra_alignmask;
+	inst->alg.cra_type = &crypto_aead_type;
+	inst->alg.cra_aead.ivsize = CHACHAPOLY_IV_SIZE;
+	inst->alg.cra_aead.maxauthsize = POLY1305_DIGEST_SIZE;
+	inst->alg.cra_aead.geniv = "seqiv";
+	inst->alg.cra_ctxsize = sizeof(struct chachapoly_ctx);
+	inst->alg.cra_init = chachapoly_init;
+	inst->alg.cra_exit = chachapoly_exit;
+	inst->alg.cra_aead.setkey = chachapoly_setkey;
+	inst->alg.cra_aead.setauthsize = chachapoly_setauthsize;
+	inst->alg.cra_aead.encrypt = chachapoly_encrypt;
+	inst->alg.cra_aead.decrypt = chachapoly_decrypt;
+
+out:
+	crypto_mod_put(poly);
+	return inst;
+
+err_drop_chacha:
+	crypto_drop_skcipher(&ctx->chacha);
+err_drop_poly:
+	crypto_drop_ahash(&ctx->poly);
+err_free_inst:
+	kfree(inst);
+out_put_poly:
+	inst = ERR_PTR(err);
+	goto out;
+}
+
+static void chachapoly_free(struct crypto_instance *inst)
+{
+	struct chachapoly_instance_ctx *ctx = crypto_instance_ctx(inst);
+
+	crypto_drop_skcipher(&ctx->chacha);
+	crypto_drop_ahash(&ctx->poly);
+	kfree(inst);
+}
+
+static struct crypto_template rfc7539_tmpl = {
+	.name = "rfc7539",
+	.alloc = chachapoly_alloc,
+	.free = chachapoly_free,
+	.module = THIS_MODULE,
+};
+
+static int __init chacha20poly1305_module_init(void)
+{
+	return crypto_register_template(&rfc7539_tmpl);
+}
+
+static void __exit chacha20poly1305_module_exit(void)
+{
+	crypto_unregister_template(&rfc7539_tmpl);
+}
+
+module_init(chacha20poly1305_module_init);
+module_exit(chacha20poly1305_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("ChaCha20-Poly1305 AEAD");
+MODULE_ALIAS_CRYPTO("rfc7539");
@@ -0,0 +1,389 @@
+/*
+ * Handle async block request by crypto hardware engine.
+ *
+ * Hardware drivers hand their requests to an engine instead of running a
+ * queue and a thread of their own. The engine pumps queued requests to
+ * the driver from a kthread, up to max_batch of them at a time, and the
+ * driver reports each one back with crypto_finalize_request(), which
+ * completes it right away in the caller's context.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <linux/err.h>
+#include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <crypto/engine.h>
+
+#define CRYPTO_ENGINE_MAX_QLEN 10
+
+/*
+ * Complete a request the engine handed out and decide whether the pump
+ * has to run again. When nothing else is queued and no hardware teardown
+ * is needed, the engine goes idle right here without waking the pump.
+ */
+static void crypto_engine_complete(struct crypto_engine *engine,
+				   struct crypto_async_request *req, int err)
+{
+	unsigned long flags;
+	bool kick = false;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	engine->inflight--;
+	if (engine->queue.qlen && engine->running) {
+		kick = true;
+	} else if (!engine->inflight && engine->busy) {
+		if (engine->unprepare_crypt_hardware)
+			kick = true;
+		else
+			engine->busy = false;
+	}
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	req->complete(req, err);
+
+	if (kick)
+		queue_kthread_work(&engine->kworker, &engine->pump_requests);
+}
+
+/**
+ * crypto_pump_requests - dequeue requests and hand them to the hardware
+ * @engine: the hardware engine
+ * @in_kthread: true if we are in the context of the request pump thread
+ *
+ * This function checks if there is any request in the engine queue that
+ * needs processing and if so calls out to the driver to initialize the
+ * hardware and handle each request, up to max_batch of them at once.
+ */
+static void crypto_pump_requests(struct crypto_engine *engine,
+				 bool in_kthread)
+{
+	struct crypto_async_request *async_req, *backlog;
+	unsigned int batched = 0;
+	unsigned long flags;
+	bool was_busy;
+	int err = 0;
+	int ret;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+
+	/* The hardware has no room for another request */
+	if (engine->inflight >= engine->max_batch)
+		goto out;
+
+	/* If another context is idling then defer */
+	if (engine->idling) {
+		queue_kthread_work(&engine->kworker, &engine->pump_requests);
+		goto out;
+	}
+
+	/* Check if the engine queue is idle */
+	if (!engine->queue.qlen || !engine->running) {
+		if (!engine->busy || engine->inflight)
+			goto out;
+
+		/* Only do teardown in the thread */
+		if (!in_kthread) {
+			queue_kthread_work(&engine->kworker,
+					   &engine->pump_requests);
+			goto out;
+		}
+
+		engine->busy = false;
+		engine->idling = true;
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+		if (engine->unprepare_crypt_hardware &&
+		    engine->unprepare_crypt_hardware(engine))
+			pr_err("failed to unprepare crypt hardware\n");
+
+		spin_lock_irqsave(&engine->queue_lock, flags);
+		engine->idling = false;
+		goto out;
+	}
+
+	was_busy = engine->busy;
+	engine->busy = true;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (!was_busy && engine->prepare_crypt_hardware) {
+		err = engine->prepare_crypt_hardware(engine);
+		if (err) {
+			pr_err("failed to prepare crypt hardware\n");
+			spin_lock_irqsave(&engine->queue_lock, flags);
+			engine->busy = false;
+			spin_unlock_irqrestore(&engine->queue_lock, flags);
+		}
+	}
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+	while (engine->inflight < engine->max_batch) {
+		backlog = crypto_get_backlog(&engine->queue);
+		async_req = crypto_dequeue_request(&engine->queue);
+		if (!async_req)
+			break;
+		engine->inflight++;
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+		if (backlog)
+			backlog->complete(backlog, -EINPROGRESS);
+
+		/* The hardware could not be brought up, fail this batch */
+		if (err) {
+			crypto_engine_complete(engine, async_req, err);
+			goto next;
+		}
+
+		if (engine->prepare_request) {
+			ret = engine->prepare_request(engine, async_req);
+			if (ret) {
+				pr_err("failed to prepare request: %d\n", ret);
+				crypto_engine_complete(engine, async_req, ret);
+				goto next;
+			}
+		}
+
+		ret = engine->do_one_request(engine, async_req);
+		if (ret) {
+			pr_err("failed to do request: %d\n", ret);
+			crypto_finalize_request(engine, async_req, ret);
+			goto next;
+		}
+		batched++;
+next:
+		spin_lock_irqsave(&engine->queue_lock, flags);
+	}
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (batched && engine->do_batch) {
+		ret = engine->do_batch(engine);
+		if (ret)
+			pr_err("failed to do batch: %d\n", ret);
+	}
+	return;
+
+out:
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+}
+
+static void crypto_pump_work(struct kthread_work *work)
+{
+	struct crypto_engine *engine =
+		container_of(work, struct crypto_engine, pump_requests);
+
+	crypto_pump_requests(engine, true);
+}
+
+/**
+ * crypto_transfer_request - transfer the new request into the engine queue
+ * @engine: the hardware engine
+ * @req: the request need to be listed into the engine queue
+ * @need_pump: wake the pump if the hardware has room for the request
+ */
+int crypto_transfer_request(struct crypto_engine *engine,
+			    struct crypto_async_request *req, bool need_pump)
+{
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+
+	if (!engine->running) {
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+		return -ESHUTDOWN;
+	}
+
+	ret = crypto_enqueue_request(&engine->queue, req);
+
+	if (need_pump && engine->inflight < engine->max_batch)
+		queue_kthread_work(&engine->kworker, &engine->pump_requests);
+
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(crypto_transfer_request);
+
+/**
+ * crypto_transfer_request_to_engine - transfer one request to list into the
+ * engine queue
+ * @engine: the hardware engine
+ * @req: the request need to be listed into the engine queue
+ */
+int crypto_transfer_request_to_engine(struct crypto_engine *engine,
+				      struct crypto_async_request *req)
+{
+	return crypto_transfer_request(engine, req, true);
+}
+EXPORT_SYMBOL_GPL(crypto_transfer_request_to_engine);
+
+/**
+ * crypto_finalize_request - finalize one request if the request is done
+ * @engine: the hardware engine
+ * @req: the request need to be finalized
+ * @err: error number
+ *
+ * May be called from the driver's interrupt handler. The request is
+ * completed directly; the pump thread only runs again if more requests
+ * are waiting or the hardware has to be torn down.
+ */
+void crypto_finalize_request(struct crypto_engine *engine,
+			     struct crypto_async_request *req, int err)
+{
+	int ret;
+
+	if (engine->unprepare_request) {
+		ret = engine->unprepare_request(engine, req);
+		if (ret)
+			pr_err("failed to unprepare request\n");
+	}
+
+	crypto_engine_complete(engine, req, err);
+}
+EXPORT_SYMBOL_GPL(crypto_finalize_request);
+
+/**
+ * crypto_engine_start - start the hardware engine
+ * @engine: the hardware engine need to be started
+ *
+ * Return 0 on success, else on fail.
+ */
+int crypto_engine_start(struct crypto_engine *engine)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+
+	if (engine->running || engine->busy) {
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+		return -EBUSY;
+	}
+
+	engine->running = true;
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	queue_kthread_work(&engine->kworker, &engine->pump_requests);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_start);
+
+/**
+ * crypto_engine_stop - stop the hardware engine
+ * @engine: the hardware engine need to be stopped
+ *
+ * Return 0 on success, else on fail.
+ */
+int crypto_engine_stop(struct crypto_engine *engine)
+{
+	unsigned long flags;
+	unsigned limit = 500;
+	int ret = 0;
+
+	spin_lock_irqsave(&engine->queue_lock, flags);
+
+	/*
+	 * If the engine queue is not empty or the engine is on busy state,
+	 * we need to wait for a while to pump the requests of engine queue.
+	 */
+	while ((engine->queue.qlen || engine->busy) && limit--) {
+		spin_unlock_irqrestore(&engine->queue_lock, flags);
+		msleep(20);
+		spin_lock_irqsave(&engine->queue_lock, flags);
+	}
+
+	if (engine->queue.qlen || engine->busy)
+		ret = -EBUSY;
+	else
+		engine->running = false;
+
+	spin_unlock_irqrestore(&engine->queue_lock, flags);
+
+	if (ret)
+		pr_warn("could not stop engine\n");
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_stop);
+
+/**
+ * crypto_engine_alloc_init - allocate crypto hardware engine structure and
+ * initialize it.
+ * @dev: the device attached with one hardware engine
+ * @rt: whether this queue is set to run as a realtime task
+ *
+ * This must be called from context that can sleep. The engine hands out
+ * one request at a time until the driver raises max_batch.
+ * Return: the crypto engine structure on success, else NULL.
+ */
+struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO - 1 };
+	struct crypto_engine *engine;
+
+	if (!dev)
+		return NULL;
+
+	engine = devm_kzalloc(dev, sizeof(*engine), GFP_KERNEL);
+	if (!engine)
+		return NULL;
+
+	engine->rt = rt;
+	engine->running = false;
+	engine->busy = false;
+	engine->idling = false;
+	engine->max_batch = 1;
+	engine->priv_data = dev;
+	snprintf(engine->name, sizeof(engine->name),
+		 "%s-engine", dev_name(dev));
+
+	crypto_init_queue(&engine->queue, CRYPTO_ENGINE_MAX_QLEN);
+	spin_lock_init(&engine->queue_lock);
+
+	init_kthread_worker(&engine->kworker);
+	engine->kworker_task = kthread_run(kthread_worker_fn,
+					   &engine->kworker, "%s",
+					   engine->name);
+	if (IS_ERR(engine->kworker_task)) {
+		dev_err(dev, "failed to create crypto request pump task\n");
+		return NULL;
+	}
+	init_kthread_work(&engine->pump_requests, crypto_pump_work);
+
+	if (engine->rt) {
+		dev_info(dev, "will run requests pump with realtime priority\n");
+		sched_setscheduler(engine->kworker_task, SCHED_FIFO, &param);
+	}
+
+	return engine;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_alloc_init);
+
+/**
+ * crypto_engine_exit - free the resources of hardware engine when exit
+ * @engine: the hardware engine need to be freed
+ *
+ * Return 0 for success.
+ */
+int crypto_engine_exit(struct crypto_engine *engine)
+{
+	int ret;
+
+	ret = crypto_engine_stop(engine);
+	if (ret)
+		return ret;
+
+	flush_kthread_worker(&engine->kworker);
+	kthread_stop(engine->kworker_task);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Crypto hardware engine framework");
@@ -20703,6 +20703,305 @@ static struct aead_testvec aes_ccm_rfc4309_dec_tv_template[] = {
 	},
 };
 
+/*
+ * ChaCha20-Poly1305 AEAD test vectors from RFC7539 2.8.2.
+ */
+#define RFC7539_ENC_TEST_VECTORS 2
+static struct aead_testvec rfc7539_enc_tv_template[] = {
+	{ /* RFC7539 2.8.2. Test Vector */
+		.key	= "\x80\x81\x82\x83\x84\x85\x86\x87"
+			  "\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+			  "\x90\x91\x92\x93\x94\x95\x96\x97"
+			  "\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f",
+		.klen	= 32,
+		.iv	= "\x07\x00\x00\x00\x40\x41\x42\x43"
+			  "\x44\x45\x46\x47",
+		.assoc	= "\x50\x51\x52\x53\xc0\xc1\xc2\xc3"
+			  "\xc4\xc5\xc6\xc7",
+		.alen	= 12,
+		.input	= "\x4c\x61\x64\x69\x65\x73\x20\x61"
+			  "\x6e\x64\x20\x47\x65\x6e\x74\x6c"
+			  "\x65\x6d\x65\x6e\x20\x6f\x66\x20"
+			  "\x74\x68\x65\x20\x63\x6c\x61\x73"
+			  "\x73\x20\x6f\x66\x20\x27\x39\x39"
+			  "\x3a\x20\x49\x66\x20\x49\x20\x63"
+			  "\x6f\x75\x6c\x64\x20\x6f\x66\x66"
+			  "\x65\x72\x20\x79\x6f\x75\x20\x6f"
+			  "\x6e\x6c\x79\x20\x6f\x6e\x65\x20"
+			  "\x74\x69\x70\x20\x66\x6f\x72\x20"
+			  "\x74\x68\x65\x20\x66\x75\x74\x75"
+			  "\x72\x65\x2c\x20\x73\x75\x6e\x73"
+			  "\x63\x72\x65\x65\x6e\x20\x77\x6f"
+			  "\x75\x6c\x64\x20\x62\x65\x20\x69"
+			  "\x74\x2e",
+		.ilen	= 114,
+		.result	= "\xd3\x1a\x8d\x34\x64\x8e\x60\xdb"
+			  "\x7b\x86\xaf\xbc\x53\xef\x7e\xc2"
+			  "\xa4\xad\xed\x51\x29\x6e\x08\xfe"
+			  "\xa9\xe2\xb5\xa7\x36\xee\x62\xd6"
+			  "\x3d\xbe\xa4\x5e\x8c\xa9\x67\x12"
+			  "\x82\xfa\xfb\x69\xda\x92\x72\x8b"
+			  "\x1a\x71\xde\x0a\x9e\x06\x0b\x29"
+			  "\x05\xd6\xa5\xb6\x7e\xcd\x3b\x36"
+			  "\x92\xdd\xbd\x7f\x2d\x77\x8b\x8c"
+			  "\x98\x03\xae\xe3\x28\x09\x1b\x58"
+			  "\xfa\xb3\x24\xe4\xfa\xd6\x75\x94"
+			  "\x55\x85\x80\x8b\x48\x31\xd7\xbc"
+			  "\x3f\xf4\xde\xf0\x8e\x4b\x7a\x9d"
+			  "\xe5\x76\xd2\x65\x86\xce\xc6\x4b"
+			  "\x61\x16\x1a\xe1\x0b\x59\x4f\x09"
+			  "\xe2\x6a\x7e\x90\x2e\xcb\xd0\x60"
+			  "\x06\x91",
+		.rlen	= 130,
+	}, { /* Long input without associated data */
+		.key	= "\x05\x22\x3f\x5c\x79\x96\xb3\xd0"
+			  "\xed\x0a\x27\x44\x61\x7e\x9b\xb8"
+			  "\xd5\xf2\x0f\x2c\x49\x66\x83\xa0"
+			  "\xbd\xda\xf7\x14\x31\x4e\x6b\x88",
+		.klen	= 32,
+		.iv	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b",
+		.assoc	= "",
+		.alen	= 0,
+		.input	= "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f\x20\x31\x42"
+			  "\x53\x64\x75\x86\x97\xa8\xb9\xca"
+			  "\xdb\xec\xfd\x0e\x1f\x30\x41\x52"
+			  "\x63\x74\x85\x96\xa7\xb8\xc9\xda"
+			  "\xeb\xfc\x0d\x1e\x2f\x40\x51\x62"
+			  "\x73\x84\x95\xa6\xb7\xc8\xd9\xea"
+			  "\xfb\x0c\x1d\x2e\x3f\x50\x61\x72"
+			  "\x83\x94\xa5\xb6\xc7\xd8\xe9\xfa"
+			  "\x0b\x1c\x2d\x3e\x4f\x60\x71\x82"
+			  "\x93\xa4\xb5\xc6\xd7\xe8\xf9\x0a"
+			  "\x1b\x2c\x3d\x4e\x5f\x70\x81\x92"
+			  "\xa3\xb4\xc5\xd6\xe7\xf8\x09\x1a"
+			  "\x2b\x3c\x4d\x5e\x6f\x80\x91\xa2"
+			  "\xb3\xc4\xd5\xe6\xf7\x08\x19\x2a"
+			  "\x3b\x4c\x5d\x6e\x7f\x90\xa1\xb2"
+			  "\xc3\xd4\xe5\xf6\x07\x18\x29\x3a"
+			  "\x4b\x5c\x6d\x7e\x8f\xa0\xb1\xc2"
+			  "\xd3\xe4\xf5\x06\x17\x28\x39\x4a"
+			  "\x5b\x6c\x7d\x8e\x9f\xb0\xc1\xd2"
+			  "\xe3\xf4\x05\x16\x27\x38\x49\x5a"
+			  "\x6b\x7c\x8d\x9e\xaf\xc0\xd1\xe2"
+			  "\xf3\x04\x15\x26\x37\x48\x59\x6a"
+			  "\x7b\x8c\x9d\xae\xbf\xd0\xe1\xf2"
+			  "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f",
+		.ilen	= 333,
+		.result	= "\x9c\x54\xaa\x1e\x20\x32\x3c\xa7"
+			  "\xa1\x89\xe5\xe0\xa9\x16\xb2\x44"
+			  "\x78\xfd\x56\xe9\x86\x35\xc6\x50"
+			  "\x35\x2b\x46\x65\x68\xa2\xb3\x92"
+			  "\x31\xb1\xa3\x3a\x01\x08\xa4\xa0"
+			  "\xf3\xe9\x59\x4a\x1d\x14\xc9\x02"
+			  "\x7b\x70\xc8\x65\x9e\x28\xe5\xe7"
+			  "\x76\xc9\x0d\xc9\xfc\x60\x7d\xf3"
+			  "\x45\xb6\x64\x95\xa9\x4f\xe3\x49"
+			  "\xe9\xe4\x41\x3b\x1d\xe7\xad\x3b"
+			  "\xdc\x6d\xe3\x17\x8a\xf5\x1b\xeb"
+			  "\xdb\x40\x66\x29\x39\xf7\x18\x89"
+			  "\x33\xd7\xdc\x4f\xd9\xef\x0d\xcc"
+			  "\x3a\x71\x17\xff\x05\x24\xf1\x68"
+			  "\x1f\xa4\xaf\x0a\x70\x66\xe4\x44"
+			  "\xa8\x40\x7b\x45\xb8\x5f\xdc\x44"
+			  "\x95\xa6\xfa\xca\xe3\x40\x96\x81"
+			  "\x30\x2a\x0d\x32\x23\xaa\xa9\xbd"
+			  "\xa9\x8b\x9f\xa4\x98\x20\x4c\xc0"
+			  "\x45\xf7\xf7\x21\xc7\xe0\x3e\xea"
+			  "\x1f\x6a\x1f\xc2\xe1\x93\x8b\x8c"
+			  "\xb2\x93\xfc\x6b\xc6\x7b\x30\x19"
+			  "\x79\x87\x70\x03\xa5\xa4\x4e\x1b"
+			  "\x7a\x21\x44\x31\x4b\xd8\xc2\x71"
+			  "\x4a\xf4\xe7\xf5\xdb\x32\x72\x19"
+			  "\x51\xd5\x34\xbf\x3a\x0e\xb7\xa9"
+			  "\x5a\x9b\x26\xd3\x2d\x5e\x89\xd9"
+			  "\xdf\xdd\x16\x88\xe3\x4f\x71\xd1"
+			  "\x93\x07\x0b\x27\x78\x98\x17\x15"
+			  "\x16\x9d\xfc\xe3\x2a\xc0\x48\xbd"
+			  "\xd6\x44\x85\xdb\x51\x60\x3f\x7d"
+			  "\x9f\xf2\x3d\x37\x8c\xa4\x38\x1d"
+			  "\x82\xbe\xc8\x6f\x91\xaf\x37\x9f"
+			  "\xdc\xce\xba\x8e\x07\x95\xea\x3b"
+			  "\x35\xe3\xb7\x19\xdc\x28\x77\x76"
+			  "\x32\x6d\x05\x7f\xfa\xc2\x2a\x8d"
+			  "\xf1\xba\xdf\xdf\x40\x66\x92\xcc"
+			  "\x8b\xf2\xfa\x5e\x44\x32\x87\xd3"
+			  "\x73\xca\x9f\x72\x21\x05\x5e\xbc"
+			  "\x72\x24\xba\xb4\x7f\xa1\x95\x0b"
+			  "\xf9\xc0\x2b\x13\x20\x3e\x47\xb0"
+			  "\x5d\x8c\xfa\x27\x8f\x09\x54\x1c"
+			  "\xa5\xcf\x4d\x98\x6c\x27\xff\xdc"
+			  "\xc1\xa0\xbc\xed\xd4",
+		.rlen	= 349,
+	}
+};
+
+#define RFC7539_DEC_TEST_VECTORS 2
+static struct aead_testvec rfc7539_dec_tv_template[] = {
+	{ /* RFC7539 2.8.2. Test Vector */
+		.key	= "\x80\x81\x82\x83\x84\x85\x86\x87"
+			  "\x88\x89\x8a\x8b\x8c\x8d\x8e\x8f"
+			  "\x90\x91\x92\x93\x94\x95\x96\x97"
+			  "\x98\x99\x9a\x9b\x9c\x9d\x9e\x9f",
+		.klen	= 32,
+		.iv	= "\x07\x00\x00\x00\x40\x41\x42\x43"
+			  "\x44\x45\x46\x47",
+		.assoc	= "\x50\x51\x52\x53\xc0\xc1\xc2\xc3"
+			  "\xc4\xc5\xc6\xc7",
+		.alen	= 12,
+		.input	= "\xd3\x1a\x8d\x34\x64\x8e\x60\xdb"
+			  "\x7b\x86\xaf\xbc\x53\xef\x7e\xc2"
+			  "\xa4\xad\xed\x51\x29\x6e\x08\xfe"
+			  "\xa9\xe2\xb5\xa7\x36\xee\x62\xd6"
+			  "\x3d\xbe\xa4\x5e\x8c\xa9\x67\x12"
+			  "\x82\xfa\xfb\x69\xda\x92\x72\x8b"
+			  "\x1a\x71\xde\x0a\x9e\x06\x0b\x29"
+			  "\x05\xd6\xa5\xb6\x7e\xcd\x3b\x36"
+			  "\x92\xdd\xbd\x7f\x2d\x77\x8b\x8c"
+			  "\x98\x03\xae\xe3\x28\x09\x1b\x58"
+			  "\xfa\xb3\x24\xe4\xfa\xd6\x75\x94"
+			  "\x55\x85\x80\x8b\x48\x31\xd7\xbc"
+			  "\x3f\xf4\xde\xf0\x8e\x4b\x7a\x9d"
+			  "\xe5\x76\xd2\x65\x86\xce\xc6\x4b"
+			  "\x61\x16\x1a\xe1\x0b\x59\x4f\x09"
+			  "\xe2\x6a\x7e\x90\x2e\xcb\xd0\x60"
+			  "\x06\x91",
+		.ilen	= 130,
+		.result	= "\x4c\x61\x64\x69\x65\x73\x20\x61"
+			  "\x6e\x64\x20\x47\x65\x6e\x74\x6c"
+			  "\x65\x6d\x65\x6e\x20\x6f\x66\x20"
+			  "\x74\x68\x65\x20\x63\x6c\x61\x73"
+			  "\x73\x20\x6f\x66\x20\x27\x39\x39"
+			  "\x3a\x20\x49\x66\x20\x49\x20\x63"
+			  "\x6f\x75\x6c\x64\x20\x6f\x66\x66"
+			  "\x65\x72\x20\x79\x6f\x75\x20\x6f"
+			  "\x6e\x6c\x79\x20\x6f\x6e\x65\x20"
+			  "\x74\x69\x70\x20\x66\x6f\x72\x20"
+			  "\x74\x68\x65\x20\x66\x75\x74\x75"
+			  "\x72\x65\x2c\x20\x73\x75\x6e\x73"
+			  "\x63\x72\x65\x65\x6e\x20\x77\x6f"
+			  "\x75\x6c\x64\x20\x62\x65\x20\x69"
+			  "\x74\x2e",
+		.rlen	= 114,
+	}, { /* Long input without associated data */
+		.key	= "\x05\x22\x3f\x5c\x79\x96\xb3\xd0"
+			  "\xed\x0a\x27\x44\x61\x7e\x9b\xb8"
+			  "\xd5\xf2\x0f\x2c\x49\x66\x83\xa0"
+			  "\xbd\xda\xf7\x14\x31\x4e\x6b\x88",
+		.klen	= 32,
+		.iv	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b",
+		.assoc	= "",
+		.alen	= 0,
+		.input	= "\x9c\x54\xaa\x1e\x20\x32\x3c\xa7"
+			  "\xa1\x89\xe5\xe0\xa9\x16\xb2\x44"
+			  "\x78\xfd\x56\xe9\x86\x35\xc6\x50"
+			  "\x35\x2b\x46\x65\x68\xa2\xb3\x92"
+			  "\x31\xb1\xa3\x3a\x01\x08\xa4\xa0"
+			  "\xf3\xe9\x59\x4a\x1d\x14\xc9\x02"
+			  "\x7b\x70\xc8\x65\x9e\x28\xe5\xe7"
+			  "\x76\xc9\x0d\xc9\xfc\x60\x7d\xf3"
+			  "\x45\xb6\x64\x95\xa9\x4f\xe3\x49"
+			  "\xe9\xe4\x41\x3b\x1d\xe7\xad\x3b"
+			  "\xdc\x6d\xe3\x17\x8a\xf5\x1b\xeb"
+			  "\xdb\x40\x66\x29\x39\xf7\x18\x89"
+			  "\x33\xd7\xdc\x4f\xd9\xef\x0d\xcc"
+			  "\x3a\x71\x17\xff\x05\x24\xf1\x68"
+			  "\x1f\xa4\xaf\x0a\x70\x66\xe4\x44"
+			  "\xa8\x40\x7b\x45\xb8\x5f\xdc\x44"
+			  "\x95\xa6\xfa\xca\xe3\x40\x96\x81"
+			  "\x30\x2a\x0d\x32\x23\xaa\xa9\xbd"
+			  "\xa9\x8b\x9f\xa4\x98\x20\x4c\xc0"
+			  "\x45\xf7\xf7\x21\xc7\xe0\x3e\xea"
+			  "\x1f\x6a\x1f\xc2\xe1\x93\x8b\x8c"
+			  "\xb2\x93\xfc\x6b\xc6\x7b\x30\x19"
+			  "\x79\x87\x70\x03\xa5\xa4\x4e\x1b"
+			  "\x7a\x21\x44\x31\x4b\xd8\xc2\x71"
+			  "\x4a\xf4\xe7\xf5\xdb\x32\x72\x19"
+			  "\x51\xd5\x34\xbf\x3a\x0e\xb7\xa9"
+			  "\x5a\x9b\x26\xd3\x2d\x5e\x89\xd9"
+			  "\xdf\xdd\x16\x88\xe3\x4f\x71\xd1"
+			  "\x93\x07\x0b\x27\x78\x98\x17\x15"
+			  "\x16\x9d\xfc\xe3\x2a\xc0\x48\xbd"
+			  "\xd6\x44\x85\xdb\x51\x60\x3f\x7d"
+			  "\x9f\xf2\x3d\x37\x8c\xa4\x38\x1d"
+			  "\x82\xbe\xc8\x6f\x91\xaf\x37\x9f"
+			  "\xdc\xce\xba\x8e\x07\x95\xea\x3b"
+			  "\x35\xe3\xb7\x19\xdc\x28\x77\x76"
+			  "\x32\x6d\x05\x7f\xfa\xc2\x2a\x8d"
+			  "\xf1\xba\xdf\xdf\x40\x66\x92\xcc"
+			  "\x8b\xf2\xfa\x5e\x44\x32\x87\xd3"
+			  "\x73\xca\x9f\x72\x21\x05\x5e\xbc"
+			  "\x72\x24\xba\xb4\x7f\xa1\x95\x0b"
+			  "\xf9\xc0\x2b\x13\x20\x3e\x47\xb0"
+			  "\x5d\x8c\xfa\x27\x8f\x09\x54\x1c"
+			  "\xa5\xcf\x4d\x98\x6c\x27\xff\xdc"
+			  "\xc1\xa0\xbc\xed\xd4",
+		.ilen	= 349,
+		.result	= "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f\x20\x31\x42"
+			  "\x53\x64\x75\x86\x97\xa8\xb9\xca"
+			  "\xdb\xec\xfd\x0e\x1f\x30\x41\x52"
+			  "\x63\x74\x85\x96\xa7\xb8\xc9\xda"
+			  "\xeb\xfc\x0d\x1e\x2f\x40\x51\x62"
+			  "\x73\x84\x95\xa6\xb7\xc8\xd9\xea"
+			  "\xfb\x0c\x1d\x2e\x3f\x50\x61\x72"
+			  "\x83\x94\xa5\xb6\xc7\xd8\xe9\xfa"
+			  "\x0b\x1c\x2d\x3e\x4f\x60\x71\x82"
+			  "\x93\xa4\xb5\xc6\xd7\xe8\xf9\x0a"
+			  "\x1b\x2c\x3d\x4e\x5f\x70\x81\x92"
+			  "\xa3\xb4\xc5\xd6\xe7\xf8\x09\x1a"
+			  "\x2b\x3c\x4d\x5e\x6f\x80\x91\xa2"
+			  "\xb3\xc4\xd5\xe6\xf7\x08\x19\x2a"
+			  "\x3b\x4c\x5d\x6e\x7f\x90\xa1\xb2"
+			  "\xc3\xd4\xe5\xf6\x07\x18\x29\x3a"
+			  "\x4b\x5c\x6d\x7e\x8f\xa0\xb1\xc2"
+			  "\xd3\xe4\xf5\x06\x17\x28\x39\x4a"
+			  "\x5b\x6c\x7d\x8e\x9f\xb0\xc1\xd2"
+			  "\xe3\xf4\x05\x16\x27\x38\x49\x5a"
+			  "\x6b\x7c\x8d\x9e\xaf\xc0\xd1\xe2"
+			  "\xf3\x04\x15\x26\x37\x48\x59\x6a"
+			  "\x7b\x8c\x9d\xae\xbf\xd0\xe1\xf2"
+			  "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f",
+		.rlen	= 333,
+	}
+};
+
 /*
  * ANSI X9.31 Continuous Pseudo-Random Number Generator (AES mode)
  * test vectors, taken from Appendix B.2.9 and B.2.10:
@@ -28370,6 +28669,240 @@ static struct cipher_testvec salsa20_stream_enc_tv_template[] = {
 	},
 };
 
+/*
+ * ChaCha20 test vectors from RFC7539 A.2. and 2.4.2.
+ */
+#define CHACHA20_ENC_TEST_VECTORS 3
+static struct cipher_testvec chacha20_enc_tv_template[] = {
+	{ /* RFC7539 A.2. Test Vector #1 */
+		.key	= "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+		.klen	= 32,
+		.iv	= "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+		.input	= "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+		.ilen	= 64,
+		.result	= "\x76\xb8\xe0\xad\xa0\xf1\x3d\x90"
+			  "\x40\x5d\x6a\xe5\x53\x86\xbd\x28"
+			  "\xbd\xd2\x19\xb8\xa0\x8d\xed\x1a"
+			  "\xa8\x36\xef\xcc\x8b\x77\x0d\xc7"
+			  "\xda\x41\x59\x7c\x51\x57\x48\x8d"
+			  "\x77\x24\xe0\x3f\xb8\xd8\x4a\x37"
+			  "\x6a\x43\xb8\xf4\x15\x18\xa1\x1c"
+			  "\xc3\x87\xb6\x69\xb2\xee\x65\x86",
+		.rlen	= 64,
+	}, { /* RFC7539 2.4.2. Test Vector */
+		.key	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+		.klen	= 32,
+		.iv	= "\x01\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x4a\x00\x00\x00\x00",
+		.input	= "\x4c\x61\x64\x69\x65\x73\x20\x61"
+			  "\x6e\x64\x20\x47\x65\x6e\x74\x6c"
+			  "\x65\x6d\x65\x6e\x20\x6f\x66\x20"
+			  "\x74\x68\x65\x20\x63\x6c\x61\x73"
+			  "\x73\x20\x6f\x66\x20\x27\x39\x39"
+			  "\x3a\x20\x49\x66\x20\x49\x20\x63"
+			  "\x6f\x75\x6c\x64\x20\x6f\x66\x66"
+			  "\x65\x72\x20\x79\x6f\x75\x20\x6f"
+			  "\x6e\x6c\x79\x20\x6f\x6e\x65\x20"
+			  "\x74\x69\x70\x20\x66\x6f\x72\x20"
+			  "\x74\x68\x65\x20\x66\x75\x74\x75"
+			  "\x72\x65\x2c\x20\x73\x75\x6e\x73"
+			  "\x63\x72\x65\x65\x6e\x20\x77\x6f"
+			  "\x75\x6c\x64\x20\x62\x65\x20\x69"
+			  "\x74\x2e",
+		.ilen	= 114,
+		.result	= "\x6e\x2e\x35\x9a\x25\x68\xf9\x80"
+			  "\x41\xba\x07\x28\xdd\x0d\x69\x81"
+			  "\xe9\x7e\x7a\xec\x1d\x43\x60\xc2"
+			  "\x0a\x27\xaf\xcc\xfd\x9f\xae\x0b"
+			  "\xf9\x1b\x65\xc5\x52\x47\x33\xab"
+			  "\x8f\x59\x3d\xab\xcd\x62\xb3\x57"
+			  "\x16\x39\xd6\x24\xe6\x51\x52\xab"
+			  "\x8f\x53\x0c\x35\x9f\x08\x61\xd8"
+			  "\x07\xca\x0d\xbf\x50\x0d\x6a\x61"
+			  "\x56\xa3\x8e\x08\x8a\x22\xb6\x5e"
+			  "\x52\xbc\x51\x4d\x16\xcc\xf8\x06"
+			  "\x81\x8c\xe9\x1a\xb7\x79\x37\x36"
+			  "\x5a\xf9\x0b\xbf\x74\xa3\x5b\xe6"
+			  "\xb4\x0b\x8e\xed\xf2\x78\x5e\x42"
+			  "\x87\x4d",
+		.rlen	= 114,
+	}, { /* Long input, exercising all SIMD block paths */
+		.key	= "\x05\x22\x3f\x5c\x79\x96\xb3\xd0"
+			  "\xed\x0a\x27\x44\x61\x7e\x9b\xb8"
+			  "\xd5\xf2\x0f\x2c\x49\x66\x83\xa0"
+			  "\xbd\xda\xf7\x14\x31\x4e\x6b\x88",
+		.klen	= 32,
+		.iv	= "\x07\x00\x00\x00\x00\x01\x02\x03"
+			  "\x04\x05\x06\x07\x08\x09\x0a\x0b",
+		.input	= "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f\x20\x31\x42"
+			  "\x53\x64\x75\x86\x97\xa8\xb9\xca"
+			  "\xdb\xec\xfd\x0e\x1f\x30\x41\x52"
+			  "\x63\x74\x85\x96\xa7\xb8\xc9\xda"
+			  "\xeb\xfc\x0d\x1e\x2f\x40\x51\x62"
+			  "\x73\x84\x95\xa6\xb7\xc8\xd9\xea"
+			  "\xfb\x0c\x1d\x2e\x3f\x50\x61\x72"
+			  "\x83\x94\xa5\xb6\xc7\xd8\xe9\xfa"
+			  "\x0b\x1c\x2d\x3e\x4f\x60\x71\x82"
+			  "\x93\xa4\xb5\xc6\xd7\xe8\xf9\x0a"
+			  "\x1b\x2c\x3d\x4e\x5f\x70\x81\x92"
+			  "\xa3\xb4\xc5\xd6\xe7\xf8\x09\x1a"
+			  "\x2b\x3c\x4d\x5e\x6f\x80\x91\xa2"
+			  "\xb3\xc4\xd5\xe6\xf7\x08\x19\x2a"
+			  "\x3b\x4c\x5d\x6e\x7f\x90\xa1\xb2"
+			  "\xc3\xd4\xe5\xf6\x07\x18\x29\x3a"
+			  "\x4b\x5c\x6d\x7e\x8f\xa0\xb1\xc2"
+			  "\xd3\xe4\xf5\x06\x17\x28\x39\x4a"
+			  "\x5b\x6c\x7d\x8e\x9f\xb0\xc1\xd2"
+			  "\xe3\xf4\x05\x16\x27\x38\x49\x5a"
+			  "\x6b\x7c\x8d\x9e\xaf\xc0\xd1\xe2"
+			  "\xf3\x04\x15\x26\x37\x48\x59\x6a"
+			  "\x7b\x8c\x9d\xae\xbf\xd0\xe1\xf2"
+			  "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f\x20\x31\x42"
+			  "\x53\x64\x75\x86\x97\xa8\xb9\xca"
+			  "\xdb\xec\xfd\x0e\x1f\x30\x41\x52"
+			  "\x63\x74\x85\x96\xa7\xb8\xc9\xda"
+			  "\xeb\xfc\x0d\x1e\x2f\x40\x51\x62"
+			  "\x73\x84\x95\xa6\xb7\xc8\xd9\xea"
+			  "\xfb\x0c\x1d\x2e\x3f\x50\x61\x72"
+			  "\x83\x94\xa5\xb6\xc7\xd8\xe9\xfa"
+			  "\x0b\x1c\x2d\x3e\x4f\x60\x71\x82"
+			  "\x93\xa4\xb5\xc6\xd7\xe8\xf9\x0a"
+			  "\x1b\x2c\x3d\x4e\x5f\x70\x81\x92"
+			  "\xa3\xb4\xc5\xd6\xe7\xf8\x09\x1a"
+			  "\x2b\x3c\x4d\x5e\x6f\x80\x91\xa2"
+			  "\xb3\xc4\xd5\xe6\xf7\x08\x19\x2a"
+			  "\x3b\x4c\x5d\x6e\x7f\x90\xa1\xb2"
+			  "\xc3\xd4\xe5\xf6\x07\x18\x29\x3a"
+			  "\x4b\x5c\x6d\x7e\x8f\xa0\xb1\xc2"
+			  "\xd3\xe4\xf5\x06\x17\x28\x39\x4a"
+			  "\x5b\x6c\x7d\x8e\x9f\xb0\xc1\xd2"
+			  "\xe3\xf4\x05\x16\x27\x38\x49\x5a"
+			  "\x6b\x7c\x8d\x9e\xaf\xc0\xd1\xe2"
+			  "\xf3\x04\x15\x26\x37\x48\x59\x6a"
+			  "\x7b\x8c\x9d\xae\xbf\xd0\xe1\xf2"
+			  "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f\x20\x31\x42"
+			  "\x53\x64\x75\x86\x97\xa8\xb9\xca",
+		.ilen	= 600,
+		.result	= "\x73\x0f\x7e\x06\x1e\x4a\x5f\x0a"
+			  "\x0a\xc5\xfe\x06\x46\xca\x36\x3d"
+			  "\xa1\x58\xfc\x99\xb5\x0d\x00\xaa"
+			  "\x9e\x0e\x1e\xf1\x5c\xf3\x87\xf2"
+			  "\x2f\x15\xbf\xeb\x3d\xdc\xe2\xec"
+			  "\xf2\x93\x11\xe8\x08\x0e\xaf\xc1"
+			  "\x89\x97\x31\xe9\x53\x82\x4f\x59"
+			  "\x13\x4a\x86\x9d\xb6\x1c\x85\xd4"
+			  "\x05\x41\x3e\x04\x12\xf4\x48\x39"
+			  "\xdb\x72\xa7\xe4\xb3\x5f\x2e\xe5"
+			  "\xc5\xbb\x7c\x25\x09\xec\x66\x99"
+			  "\x4b\x06\x05\xd3\x56\x36\xe2\xb9"
+			  "\x67\x06\x87\x60\xbe\x6d\x96\xa5"
+			  "\x98\x5b\x68\x66\xa6\x9d\xd8\x11"
+			  "\x0c\x4c\x98\xe1\x2e\xd3\x8a\x82"
+			  "\xea\x19\x81\xe6\xb6\x99\x39\x57"
+			  "\x4c\x5d\x89\xdc\xc1\x3c\x78\x56"
+			  "\x76\xe2\x11\x59\xb8\x71\x77\x2b"
+			  "\x32\x4c\x19\x0b\x0c\x9d\xd8\x10"
+			  "\x08\xd8\x56\x3f\x32\x73\x18\xdb"
+			  "\xd4\xee\x13\x88\x41\x1a\x9f\xd5"
+			  "\x66\x3f\xc1\xab\x4b\x5d\x6f\xa5"
+			  "\xda\x12\xd7\xda\x2d\x40\xd4\x2b"
+			  "\x42\x68\x5d\x5c\x43\xfc\x7b\xaa"
+			  "\xc2\xcc\x2a\xdb\x3c\x33\x0e\x0e"
+			  "\x75\xcc\xd0\x2f\xc3\x48\x25\x77"
+			  "\xca\xf7\x99\x13\x01\xa8\x24\x29"
+			  "\x6f\x99\xa6\x2a\x34\xfe\x4d\xf8"
+			  "\x87\x1f\x51\x1b\x6f\xdb\x08\xbe"
+			  "\xac\x6a\x3a\x19\x47\x93\x7f\xb5"
+			  "\xd8\x88\xd2\xb5\x00\xd5\xb0\xc8"
+			  "\xe1\xc6\x7a\x8f\x98\x38\x7d\x8d"
+			  "\xf1\x39\x89\xc9\x91\x6f\xca\xbf"
+			  "\x14\xd6\xf1\xd2\x84\x26\x35\x44"
+			  "\x73\x7c\xb2\x73\xe0\xa8\x73\xf4"
+			  "\xc4\xa2\x6d\x54\x53\x69\x80\x26"
+			  "\xb7\x57\xee\x26\xba\xbd\x8d\x24"
+			  "\xbd\x89\x1b\x87\x0d\xa9\xd6\xa6"
+			  "\x18\xe4\x08\xda\xac\x4f\x0e\xef"
+			  "\x87\xdd\x71\x78\x63\x3d\x45\x92"
+			  "\x81\x13\x3f\x28\x63\x25\x67\xbf"
+			  "\x2c\x3c\xa2\x39\x04\x0b\x77\xaa"
+			  "\xc0\x64\xf7\xa7\xdb\xb8\x26\xdf"
+			  "\xb7\xa3\x87\x15\x73\xbd\x65\xed"
+			  "\xfe\xb2\xa3\xb2\x72\xbb\x38\xe9"
+			  "\x02\xd3\x2c\xae\x02\x4b\x21\xd8"
+			  "\xc5\x0c\x0c\xeb\xa8\x6a\x2f\xb9"
+			  "\xd3\x45\x27\xc8\x05\x76\x89\x70"
+			  "\xf8\x00\xa0\xd6\x96\x46\x48\xc9"
+			  "\x63\x17\xbc\xc1\x87\xaa\x9a\x9a"
+			  "\x99\xc9\xd1\x44\x5b\xc7\xf3\x6a"
+			  "\x4b\x06\xf9\xf5\x71\x41\xc8\xb9"
+			  "\x03\xf0\xd6\xca\xf0\xb1\x3e\xed"
+			  "\xaa\x6d\x14\xd0\x2c\x68\x58\xe0"
+			  "\x2a\x2f\x2c\x3b\x6b\xd6\xdd\x7a"
+			  "\xa9\x4e\x6d\x6b\xb5\x93\x66\x0d"
+			  "\xe8\xdb\x4a\x90\xbc\xa7\xbd\xb1"
+			  "\xf7\xc9\xb9\x88\xdd\xae\xfa\x26"
+			  "\xab\xbf\x37\xc3\xdf\xc8\xa0\xa1"
+			  "\xa6\xdf\xba\x10\x9b\x94\x36\xcf"
+			  "\xf8\x14\x3e\x15\xcc\xb6\x0f\x80"
+			  "\x8b\x55\x67\x33\xbf\x56\xb0\x65"
+			  "\x2a\xe5\x9d\x75\xe0\x6e\x46\x29"
+			  "\x8e\x52\x74\xed\x9e\xce\x5a\xe0"
+			  "\xf7\x5d\x59\x4c\x4d\x1a\xf1\xc1"
+			  "\xbe\x35\x4f\xb3\x41\x41\x42\x88"
+			  "\x8e\xa1\x5e\x0f\x1f\x35\x3e\xd1"
+			  "\x7c\x37\xf2\xfc\x26\x8a\xd4\xc6"
+			  "\xdd\x57\xe7\x3b\x33\x3b\x2e\x3d"
+			  "\xc0\x87\xce\xf6\x16\xe2\xc9\x17"
+			  "\x6b\xb6\x8b\xf2\xc3\xb5\x8f\xee"
+			  "\x8f\x7e\x4b\xb0\xe9\x5c\x72\xef"
+			  "\xc2\xde\xaa\xb1\x2d\x00\x37\x2a"
+			  "\x19\xca\xd6\x8f\xca\x85\xf5\x94"
+			  "\x10\xc2\x51\xd3\x88\x50\x58\xbe",
+		.rlen	= 600,
+	}
+};
+
 /*
  * CTS (Cipher Text Stealing) mode tests
  */
@@ -28945,6 +29478,90 @@ static struct hash_testvec michael_mic_tv_template[] = {
 	}
 };
 
+/*
+ * Poly1305 test vectors from RFC7539 A.3. and 2.5.2. The key is passed as
+ * the first 32 bytes of the input.
+ */
+#define POLY1305_TEST_VECTORS 3
+static struct hash_testvec poly1305_tv_template[] = {
+	{ /* RFC7539 A.3. Test Vector #1 */
+		.plaintext	= "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+		.psize	= 96,
+		.digest	= "\x00\x00\x00\x00\x00\x00\x00\x00"
+			  "\x00\x00\x00\x00\x00\x00\x00\x00",
+	}, { /* RFC7539 2.5.2. Test Vector */
+		.plaintext	= "\x85\xd6\xbe\x78\x57\x55\x6d\x33"
+			  "\x7f\x44\x52\xfe\x42\xd5\x06\xa8"
+			  "\x01\x03\x80\x8a\xfb\x0d\xb2\xfd"
+			  "\x4a\xbf\xf6\xaf\x41\x49\xf5\x1b"
+			  "\x43\x72\x79\x70\x74\x6f\x67\x72"
+			  "\x61\x70\x68\x69\x63\x20\x46\x6f"
+			  "\x72\x75\x6d\x20\x52\x65\x73\x65"
+			  "\x61\x72\x63\x68\x20\x47\x72\x6f"
+			  "\x75\x70",
+		.psize	= 66,
+		.digest	= "\xa8\x06\x1d\xc1\x30\x51\x36\xc6"
+			  "\xc2\x2b\x8b\xaf\x0c\x01\x27\xa9",
+	}, { /* Long input, exercising the SIMD block path */
+		.plaintext	= "\x05\x22\x3f\x5c\x79\x96\xb3\xd0"
+			  "\xed\x0a\x27\x44\x61\x7e\x9b\xb8"
+			  "\xd5\xf2\x0f\x2c\x49\x66\x83\xa0"
+			  "\xbd\xda\xf7\x14\x31\x4e\x6b\x88"
+			  "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde\xef\x00\x11\x22"
+			  "\x33\x44\x55\x66\x77\x88\x99\xaa"
+			  "\xbb\xcc\xdd\xee\xff\x10\x21\x32"
+			  "\x43\x54\x65\x76\x87\x98\xa9\xba"
+			  "\xcb\xdc\xed\xfe\x0f\x20\x31\x42"
+			  "\x53\x64\x75\x86\x97\xa8\xb9\xca"
+			  "\xdb\xec\xfd\x0e\x1f\x30\x41\x52"
+			  "\x63\x74\x85\x96\xa7\xb8\xc9\xda"
+			  "\xeb\xfc\x0d\x1e\x2f\x40\x51\x62"
+			  "\x73\x84\x95\xa6\xb7\xc8\xd9\xea"
+			  "\xfb\x0c\x1d\x2e\x3f\x50\x61\x72"
+			  "\x83\x94\xa5\xb6\xc7\xd8\xe9\xfa"
+			  "\x0b\x1c\x2d\x3e\x4f\x60\x71\x82"
+			  "\x93\xa4\xb5\xc6\xd7\xe8\xf9\x0a"
+			  "\x1b\x2c\x3d\x4e\x5f\x70\x81\x92"
+			  "\xa3\xb4\xc5\xd6\xe7\xf8\x09\x1a"
+			  "\x2b\x3c\x4d\x5e\x6f\x80\x91\xa2"
+			  "\xb3\xc4\xd5\xe6\xf7\x08\x19\x2a"
+			  "\x3b\x4c\x5d\x6e\x7f\x90\xa1\xb2"
+			  "\xc3\xd4\xe5\xf6\x07\x18\x29\x3a"
+			  "\x4b\x5c\x6d\x7e\x8f\xa0\xb1\xc2"
+			  "\xd3\xe4\xf5\x06\x17\x28\x39\x4a"
+			  "\x5b\x6c\x7d\x8e\x9f\xb0\xc1\xd2"
+			  "\xe3\xf4\x05\x16\x27\x38\x49\x5a"
+			  "\x6b\x7c\x8d\x9e\xaf\xc0\xd1\xe2"
+			  "\xf3\x04\x15\x26\x37\x48\x59\x6a"
+			  "\x7b\x8c\x9d\xae\xbf\xd0\xe1\xf2"
+			  "\x03\x14\x25\x36\x47\x58\x69\x7a"
+			  "\x8b\x9c\xad\xbe\xcf\xe0\xf1\x02"
+			  "\x13\x24\x35\x46\x57\x68\x79\x8a"
+			  "\x9b\xac\xbd\xce\xdf\xf0\x01\x12"
+			  "\x23\x34\x45\x56\x67\x78\x89\x9a"
+			  "\xab\xbc\xcd\xde",
+		.psize	= 332,
+		.digest	= "\x30\x2e\xb7\x19\x0f\x6a\xd3\x43"
+			  "\xfd\x97\xc9\xbf\xf9\xba\xe2\x4c",
+	}
+};
+
 /*
  * CRC32C test vectors
  */
@@ -29539,4 +30156,102 @@ static struct comp_testvec lz4hc_decomp_tv_template[] = {
 	},
 };
 
+#define ZSTD_COMP_TEST_VECTORS 2
+#define ZSTD_DECOMP_TEST_VECTORS 2
+
+static struct comp_testvec zstd_comp_tv_template[] = {
+	{
+		.inlen	= 70,
+		.outlen	= 49,
+		.input	= "Join us now and share the software "
+			  "Join us now and share the software ",
+		.output	= "\x28\xb5\x2f\xfd\x20\x46\x45\x01"
+			  "\x00\xf8\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x02\x00\x8c\x22\x30\xac\xd3"
+			  "\x09",
+	},
+	{
+		.inlen	= 275,
+		.outlen	= 174,
+		.input	= "This document describes a mechanism for using zstd "
+			  "compression within the kernel crypto API. zstd "
+			  "compresses data in frames, frames are made of "
+			  "blocks, blocks hold literals and sequences. Literals "
+			  "and sequences are entropy coded, literals with "
+			  "Huffman and sequences with FSE.",
+		.output	= "\x28\xb5\x2f\xfd\x60\x13\x00\x25"
+			  "\x05\x00\xb2\xcb\x21\x1c\xa0\x27"
+			  "\x29\x84\xa0\x2d\x53\x22\x3b\x25"
+			  "\x89\x80\x24\x89\xfc\x52\x92\x51"
+			  "\x9f\x50\xb4\x4c\x6a\xdc\x0b\x57"
+			  "\xb5\x4e\x47\xc0\x81\x00\x9a\x3a"
+			  "\x27\x19\xb0\x61\x6e\xb2\x58\x81"
+			  "\xa4\x2e\x7c\x81\x8f\x7d\xc1\x27"
+			  "\x88\xaf\x0d\x9a\x37\x99\x7e\x5d"
+			  "\xb2\x49\x89\x6c\xec\xa1\x64\x2a"
+			  "\xf8\xa4\x6f\x4c\xf9\x6a\x36\xf6"
+			  "\xca\xf4\x18\xcf\xb6\xcc\x78\x7f"
+			  "\x10\x18\x00\x38\x17\xa2\xd0\xe2"
+			  "\x74\xd4\x1f\x7c\xb4\x8c\x87\xd6"
+			  "\x25\x8c\x79\xbb\x57\x44\x65\xb1"
+			  "\x59\xbb\xb0\x01\x6f\x13\x6b\x1e"
+			  "\xab\x3d\x34\x54\xae\x6c\xde\x17"
+			  "\x4e\xcb\xde\x78\xe1\x55\x52\xd2"
+			  "\x78\x0f\x11\x02\x09\x00\x3e\x05"
+			  "\xa0\xb5\x79\x66\x36\x28\x62\x55"
+			  "\x0a\x2d\x78\xe7\x77\x40\x66\x56"
+			  "\xb2\xc0\x49\x59\x45\x01",
+	},
+};
+
+static struct comp_testvec zstd_decomp_tv_template[] = {
+	{
+		.inlen	= 48,
+		.outlen	= 70,
+		.input	= "\x28\xb5\x2f\xfd\x20\x46\x3d\x01"
+			  "\x00\x32\x82\x07\x0c\xd0\x3d\xa0"
+			  "\xa4\x82\x45\x9c\x01\x01\x91\x28"
+			  "\x2d\x9f\x8c\x5e\x42\xfd\xd4\x7e"
+			  "\x32\x4a\x2f\x17\x6f\xbc\x2b\xff"
+			  "\x0c\x21\x01\x00\x63\x48\xf5\x04",
+		.output	= "Join us now and share the software "
+			  "Join us now and share the software ",
+	},
+	{
+		.inlen	= 171,
+		.outlen	= 275,
+		.input	= "\x28\xb5\x2f\xfd\x60\x13\x00\x0d"
+			  "\x05\x00\x82\xcb\x20\x1a\x80\x4b"
+			  "\x73\x88\xdc\x48\xc4\x36\x91\xfd"
+			  "\x1b\x7d\x92\x22\xa8\x75\x20\x37"
+			  "\x01\x61\xba\x41\xed\x60\x5e\x1a"
+			  "\x49\xe0\x20\xc8\x5b\xe7\x2c\x03"
+			  "\x23\x78\x54\x63\x87\xa2\xac\xe5"
+			  "\x0b\x4e\xf6\x26\xbf\x30\xbe\xc6"
+			  "\x3c\xaf\x3a\xf6\x96\x94\x51\x29"
+			  "\x32\xb2\x0b\xa3\x2a\xe1\xa3\x3e"
+			  "\xde\xf2\xd9\x19\xd9\xaf\x63\xc7"
+			  "\xd7\x0e\xbd\x4f\x08\x06\x80\xb5"
+			  "\x29\x0e\x66\xac\x9e\xec\x0b\x1f"
+			  "\x35\x67\x42\x2d\x35\x9c\x9a\x76"
+			  "\xcf\x94\xa5\xc6\xd8\xf6\x61\x45"
+			  "\xa6\x5d\xcc\xf4\x78\x6d\xca\x43"
+			  "\xe6\xcb\xe7\x7d\x22\x31\xb3\x47"
+			  "\xb7\xfc\x5a\x8c\xa2\x37\x21\x44"
+			  "\x0a\x00\x3e\x33\xf0\x8e\x67\x7f"
+			  "\x83\x22\x8a\x4a\x21\x03\xef\x4c"
+			  "\x0e\xc8\x6c\x25\x33\x00\x60\x4e"
+			  "\xca\xea\x0c",
+		.output	= "This document describes a mechanism for using zstd "
+			  "compression within the kernel crypto API. zstd "
+			  "compresses data in frames, frames are made of "
+			  "blocks, blocks hold literals and sequences. Literals "
+			  "and sequences are entropy coded, literals with "
+			  "Huffman and sequences with FSE.",
+	},
+};
+
 #endif	/* _CRYPTO_TESTMGR_H */
@@ -0,0 +1,128 @@
+/*
+ * Cryptographic API.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/crypto.h>
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+
+/*
+ * Users of the compression API mostly work on pages. Larger inputs are
+ * compressed as a series of frames of this size, which keeps the working
+ * memory of each transform small; the decompressor reads any number of
+ * frames in one go.
+ */
+#define ZSTD_CRYPTO_FRAME_SIZE	PAGE_SIZE
+
+struct zstd_ctx {
+	void *zstd_comp_mem;
+	void *zstd_decomp_mem;
+};
+
+static int zstd_init(struct crypto_tfm *tfm)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->zstd_comp_mem = vmalloc(zstd_compress_workmem_size(
+			ZSTD_DEFAULT_CLEVEL, ZSTD_CRYPTO_FRAME_SIZE));
+	if (!ctx->zstd_comp_mem)
+		return -ENOMEM;
+
+	ctx->zstd_decomp_mem = vmalloc(ZSTD_DECOMPRESS_WORKMEM);
+	if (!ctx->zstd_decomp_mem) {
+		vfree(ctx->zstd_comp_mem);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void zstd_exit(struct crypto_tfm *tfm)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	vfree(ctx->zstd_comp_mem);
+	vfree(ctx->zstd_decomp_mem);
+}
+
+static int zstd_compress_crypto(struct crypto_tfm *tfm, const u8 *src,
+			    unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	unsigned int done = 0, out = 0;
+	int err;
+
+	do {
+		unsigned int len = min_t(unsigned int, slen - done,
+					 ZSTD_CRYPTO_FRAME_SIZE);
+		size_t tmp_len = *dlen - out;
+
+		err = zstd_compress(src + done, len, dst + out, &tmp_len,
+				    ZSTD_DEFAULT_CLEVEL, ctx->zstd_comp_mem);
+		if (err < 0)
+			return -EINVAL;
+
+		done += len;
+		out += tmp_len;
+	} while (done < slen);
+
+	*dlen = out;
+	return 0;
+}
+
+static int zstd_decompress_crypto(struct crypto_tfm *tfm, const u8 *src,
+			      unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct zstd_ctx *ctx = crypto_tfm_ctx(tfm);
+	size_t tmp_len = *dlen;
+	int err;
+
+	err = zstd_decompress(src, slen, dst, &tmp_len, ctx->zstd_decomp_mem);
+	if (err < 0)
+		return -EINVAL;
+
+	*dlen = tmp_len;
+	return 0;
+}
+
+static struct crypto_alg alg_zstd = {
+	.cra_name		= "zstd",
+	.cra_flags		= CRYPTO_ALG_TYPE_COMPRESS,
+	.cra_ctxsize		= sizeof(struct zstd_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(alg_zstd.cra_list),
+	.cra_init		= zstd_init,
+	.cra_exit		= zstd_exit,
+	.cra_u			= { .compress = {
+	.coa_compress		= zstd_compress_crypto,
+	.coa_decompress		= zstd_decompress_crypto } }
+};
+
+static int __init zstd_mod_init(void)
+{
+	return crypto_register_alg(&alg_zstd);
+}
+
+static void __exit zstd_mod_fini(void)
+{
+	crypto_unregister_alg(&alg_zstd);
+}
+
+module_init(zstd_mod_init);
+module_exit(zstd_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstd Compression Algorithm");
+MODULE_ALIAS_CRYPTO("zstd");
@@ -29,6 +29,7 @@
 #include <linux/syscore_ops.h>
 #include <linux/reboot.h>
 #include <linux/security.h>
+#include <linux/initrd.h>
 
 #include <generated/utsrelease.h>
 
@@ -322,8 +323,12 @@ static int fw_get_filesystem_firmware(struct device *device,
 {
 	int i;
 	int rc = -ENOENT;
-	char *path = __getname();
+	char *path;
 
+	/* Firmware is commonly shipped in the initramfs */
+	wait_for_initramfs();
+
+	path = __getname();
 	for (i = 0; i < ARRAY_SIZE(fw_path); i++) {
 		struct file *file;
 
@@ -11,8 +11,11 @@
 
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/aio.h>
+#include <linux/kthread.h>
 #include <uapi/linux/loop.h>
 
 /* Possible states of device */
@@ -45,6 +48,7 @@ struct loop_device {
 				 unsigned long arg); 
 
 	struct file *	lo_backing_file;
+	struct file *	lo_dio_file;	/* O_DIRECT reopen of the above */
 	struct block_device *lo_device;
 	unsigned	lo_blocksize;
 	void		*key_data; 
@@ -52,19 +56,26 @@ struct loop_device {
 	gfp_t		old_gfp_mask;
 
 	spinlock_t		lo_lock;
-	struct bio_list		lo_bio_list;
-	unsigned int		lo_bio_count;
 	int			lo_state;
 	struct mutex		lo_ctl_mutex;
-	struct task_struct	*lo_thread;
-	wait_queue_head_t	lo_event;
-	/* wait queue for incoming requests */
-	wait_queue_head_t	lo_req_wait;
+	struct kthread_worker	worker;
+	struct task_struct	*worker_task;
+	bool			use_dio;
 
 	struct request_queue	*lo_queue;
+	struct blk_mq_tag_set	tag_set;
 	struct gendisk		*lo_disk;
 };
 
+struct loop_cmd {
+	struct kthread_work work;
+	struct request *rq;
+	bool use_aio;		/* use AIO interface to handle I/O */
+	long ret;
+	struct bio_vec *bvec;	/* flattened bvecs of a merged request */
+	struct kiocb iocb;
+};
+
 /* Support for loadable transfer modules */
 struct loop_func_table {
 	int number;	/* filter type */ 
@@ -32,6 +32,8 @@
 #include <net/sock.h>
 #include <linux/net.h>
 #include <linux/kthread.h>
+#include <linux/blk-mq.h>
+#include <linux/workqueue.h>
 
 #include <asm/uaccess.h>
 #include <asm/types.h>
@@ -59,17 +61,21 @@ static unsigned int nbds_max = 16;
 static struct nbd_device *nbd_dev;
 static int max_part;
 
-/*
- * Use just one lock (or at most 1 per NIC). Two arguments for this:
- * 1. Each NIC is essentially a synchronization point for all servers
- *    accessed through that NIC so there's no need to have more locks
- *    than NICs anyway.
- * 2. More locks lead to more "Dirty cache line bouncing" which will slow
- *    down each lock to the point where they're actually slower than just
- *    a single lock.
- * Thanks go to Jens Axboe and Al Viro for their LKML emails explaining this!
- */
-static DEFINE_SPINLOCK(nbd_lock);
+/* Sends block on the socket, so they are done from here */
+static struct workqueue_struct *nbd_wq;
+
+struct nbd_cmd {
+	struct nbd_device *nbd;
+	struct work_struct work;
+	unsigned long flags;
+};
+
+/* nbd_device runtime_flags */
+#define NBD_RUNNING		0
+#define NBD_SOCKS_SHUTDOWN	1
+
+/* nbd_cmd flags: sent, owned by whoever clears it first */
+#define NBD_REQ_INFLIGHT	0
 
 #ifndef NDEBUG
 static const char *ioctl_cmd_to_ascii(int cmd)
@@ -107,71 +113,78 @@ static const char *nbdcmd_to_ascii(int cmd)
 
 static void nbd_end_request(struct request *req)
 {
-	int error = req->errors ? -EIO : 0;
-	struct request_queue *q = req->q;
-	unsigned long flags;
-
 	dprintk(DBG_BLKDEV, "%s: request %p: %s\n", req->rq_disk->disk_name,
-			req, error ? "failed" : "done");
+			req, req->errors ? "failed" : "done");
 
-	spin_lock_irqsave(q->queue_lock, flags);
-	__blk_end_request_all(req, error);
-	spin_unlock_irqrestore(q->queue_lock, flags);
+	blk_mq_complete_request(req);
+}
+
+static void nbd_complete_rq(struct request *req)
+{
+	blk_mq_end_request(req, req->errors ? -EIO : 0);
 }
 
-static void sock_shutdown(struct nbd_device *nbd, int lock)
+static void sock_shutdown(struct nbd_device *nbd)
 {
-	/* Forcibly shutdown the socket causing all listeners
+	int i;
+
+	/* Forcibly shutdown the sockets causing all listeners
 	 * to error
 	 *
 	 * FIXME: This code is duplicated from sys_shutdown, but
 	 * there should be a more generic interface rather than
 	 * calling socket ops directly here */
-	if (lock)
-		mutex_lock(&nbd->tx_lock);
-	if (nbd->sock) {
-		dev_warn(disk_to_dev(nbd->disk), "shutting down socket\n");
-		kernel_sock_shutdown(nbd->sock, SHUT_RDWR);
-		nbd->sock = NULL;
-	}
-	if (lock)
-		mutex_unlock(&nbd->tx_lock);
+	if (!nbd->num_connections)
+		return;
+	if (test_and_set_bit(NBD_SOCKS_SHUTDOWN, &nbd->runtime_flags))
+		return;
+
+	dev_warn(disk_to_dev(nbd->disk), "shutting down sockets\n");
+	for (i = 0; i < nbd->num_connections; i++)
+		kernel_sock_shutdown(nbd->socks[i]->sock, SHUT_RDWR);
 }
 
-static void nbd_xmit_timeout(unsigned long arg)
+static void nbd_timeout_work(struct work_struct *work)
 {
-	struct task_struct *task = (struct task_struct *)arg;
+	struct nbd_device *nbd = container_of(work, struct nbd_device,
+					      timeout_work);
 
-	printk(KERN_WARNING "nbd: killing hung xmit (%s, pid: %d)\n",
-		task->comm, task->pid);
-	force_sig(SIGKILL, task);
+	sock_shutdown(nbd);
+}
+
+static enum blk_eh_timer_return nbd_xmit_timeout(struct request *req,
+						 bool reserved)
+{
+	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(req);
+	struct nbd_device *nbd = cmd->nbd;
+
+	if (!nbd->xmit_timeout)
+		return BLK_EH_RESET_TIMER;
+
+	dev_err(disk_to_dev(nbd->disk),
+		"Connection timed out, shutting down connection\n");
+
+	/*
+	 * We are called from the timer, where the sockets can't be shut
+	 * down.  Once they are, the request is failed by nbd_clear_que(),
+	 * which knows nobody is still sending it.
+	 */
+	schedule_work(&nbd->timeout_work);
+	return BLK_EH_RESET_TIMER;
 }
 
 /*
  *  Send or receive packet.
  */
-static int sock_xmit(struct nbd_device *nbd, int send, void *buf, int size,
-		int msg_flags)
+static int sock_xmit(struct nbd_device *nbd, struct nbd_sock *nsock,
+		int send, void *buf, int size, int msg_flags)
 {
-	struct socket *sock = nbd->sock;
+	struct socket *sock = nsock->sock;
 	int result;
 	struct msghdr msg;
 	struct kvec iov;
-	sigset_t blocked, oldset;
 	unsigned long pflags = current->flags;
 
-	if (unlikely(!sock)) {
-		dev_err(disk_to_dev(nbd->disk),
-			"Attempted %s on closed socket in sock_xmit\n",
-			(send ? "send" : "recv"));
-		return -EINVAL;
-	}
-
-	/* Allow interception of SIGKILL only
-	 * Don't allow other signals to interrupt the transmission */
-	siginitsetinv(&blocked, sigmask(SIGKILL));
-	sigprocmask(SIG_SETMASK, &blocked, &oldset);
-
 	current->flags |= PF_MEMALLOC;
 	do {
 		sock->sk->sk_allocation = GFP_NOIO | __GFP_MEMALLOC;
@@ -183,33 +196,12 @@ static int sock_xmit(struct nbd_device *nbd, int send, void *buf, int size,
 		msg.msg_controllen = 0;
 		msg.msg_flags = msg_flags | MSG_NOSIGNAL;
 
-		if (send) {
-			struct timer_list ti;
-
-			if (nbd->xmit_timeout) {
-				init_timer(&ti);
-				ti.function = nbd_xmit_timeout;
-				ti.data = (unsigned long)current;
-				ti.expires = jiffies + nbd->xmit_timeout;
-				add_timer(&ti);
-			}
+		if (send)
 			result = kernel_sendmsg(sock, &msg, &iov, 1, size);
-			if (nbd->xmit_timeout)
-				del_timer_sync(&ti);
-		} else
+		else
 			result = kernel_recvmsg(sock, &msg, &iov, 1, size,
 						msg.msg_flags);
 
-		if (signal_pending(current)) {
-			siginfo_t info;
-			printk(KERN_WARNING "nbd (pid %d: %s) got signal %d\n",
-				task_pid_nr(current), current->comm,
-				dequeue_signal_lock(current, &current->blocked, &info));
-			result = -EINTR;
-			sock_shutdown(nbd, !send);
-			break;
-		}
-
 		if (result <= 0) {
 			if (result == 0)
 				result = -EPIPE; /* short read */
@@ -219,46 +211,48 @@ static int sock_xmit(struct nbd_device *nbd, int send, void *buf, int size,
 		buf += result;
 	} while (size > 0);
 
-	sigprocmask(SIG_SETMASK, &oldset, NULL);
 	tsk_restore_flags(current, pflags, PF_MEMALLOC);
 
 	return result;
 }
 
-static inline int sock_send_bvec(struct nbd_device *nbd, struct bio_vec *bvec,
-		int flags)
+static inline int sock_send_bvec(struct nbd_device *nbd, struct nbd_sock *nsock,
+		struct bio_vec *bvec, int flags)
 {
 	int result;
 	void *kaddr = kmap(bvec->bv_page);
-	result = sock_xmit(nbd, 1, kaddr + bvec->bv_offset,
+	result = sock_xmit(nbd, nsock, 1, kaddr + bvec->bv_offset,
 			   bvec->bv_len, flags);
 	kunmap(bvec->bv_page);
 	return result;
 }
 
-/* always call with the tx_lock held */
-static int nbd_send_req(struct nbd_device *nbd, struct request *req)
+/* always call with the tx_lock of nsock held */
+static int nbd_send_req(struct nbd_device *nbd, struct nbd_sock *nsock,
+		struct request *req)
 {
 	int result, flags;
 	struct nbd_request request;
 	unsigned long size = blk_rq_bytes(req);
+	u32 tag = blk_mq_unique_tag(req);
 
 	memset(&request, 0, sizeof(request));
 	request.magic = htonl(NBD_REQUEST_MAGIC);
 	request.type = htonl(nbd_cmd(req));
 
-	if (nbd_cmd(req) != NBD_CMD_FLUSH && nbd_cmd(req) != NBD_CMD_DISC) {
+	if (nbd_cmd(req) != NBD_CMD_FLUSH) {
 		request.from = cpu_to_be64((u64)blk_rq_pos(req) << 9);
 		request.len = htonl(size);
 	}
-	memcpy(request.handle, &req, sizeof(req));
+	/* the reply is matched back to req through its tag */
+	memcpy(request.handle, &tag, sizeof(tag));
 
 	dprintk(DBG_TX, "%s: request %p: sending control (%s@%llu,%uB)\n",
 			nbd->disk->disk_name, req,
 			nbdcmd_to_ascii(nbd_cmd(req)),
 			(unsigned long long)blk_rq_pos(req) << 9,
 			blk_rq_bytes(req));
-	result = sock_xmit(nbd, 1, &request, sizeof(request),
+	result = sock_xmit(nbd, nsock, 1, &request, sizeof(request),
 			(nbd_cmd(req) == NBD_CMD_WRITE) ? MSG_MORE : 0);
 	if (result <= 0) {
 		dev_err(disk_to_dev(nbd->disk),
@@ -279,7 +273,7 @@ static int nbd_send_req(struct nbd_device *nbd, struct request *req)
 				flags = MSG_MORE;
 			dprintk(DBG_TX, "%s: request %p: sending %d bytes data\n",
 					nbd->disk->disk_name, req, bvec.bv_len);
-			result = sock_send_bvec(nbd, &bvec, flags);
+			result = sock_send_bvec(nbd, nsock, &bvec, flags);
 			if (result <= 0) {
 				dev_err(disk_to_dev(nbd->disk),
 					"Send data failed (result %d)\n",
@@ -294,51 +288,75 @@ error_out:
 	return -EIO;
 }
 
-static struct request *nbd_find_request(struct nbd_device *nbd,
-					struct request *xreq)
+static void send_disconnects(struct nbd_device *nbd)
 {
-	struct request *req, *tmp;
-	int err;
+	struct nbd_request request = {
+		.magic = htonl(NBD_REQUEST_MAGIC),
+		.type = htonl(NBD_CMD_DISC),
+	};
+	int i, result;
+
+	for (i = 0; i < nbd->num_connections; i++) {
+		struct nbd_sock *nsock = nbd->socks[i];
+
+		mutex_lock(&nsock->tx_lock);
+		if (!nsock->dead) {
+			result = sock_xmit(nbd, nsock, 1, &request,
+					   sizeof(request), 0);
+			if (result <= 0)
+				dev_err(disk_to_dev(nbd->disk),
+					"Send disconnect failed (result %d)\n",
+					result);
+		}
+		mutex_unlock(&nsock->tx_lock);
+	}
+}
 
-	err = wait_event_interruptible(nbd->active_wq, nbd->active_req != xreq);
-	if (unlikely(err))
-		goto out;
+static struct request *nbd_find_request(struct nbd_device *nbd, u32 tag)
+{
+	u16 hwq = blk_mq_unique_tag_to_hwq(tag);
+	u16 idx = blk_mq_unique_tag_to_tag(tag);
+	struct request *req;
+	struct nbd_cmd *cmd;
 
-	spin_lock(&nbd->queue_lock);
-	list_for_each_entry_safe(req, tmp, &nbd->queue_head, queuelist) {
-		if (req != xreq)
-			continue;
-		list_del_init(&req->queuelist);
-		spin_unlock(&nbd->queue_lock);
-		return req;
-	}
-	spin_unlock(&nbd->queue_lock);
+	if (hwq >= nbd->tag_set.nr_hw_queues ||
+	    idx >= nbd->tag_set.queue_depth)
+		return ERR_PTR(-ENOENT);
 
-	err = -ENOENT;
+	req = blk_mq_tag_to_rq(nbd->tag_set.tags[hwq], idx);
+	if (!req || !blk_mq_request_started(req))
+		return ERR_PTR(-ENOENT);
 
-out:
-	return ERR_PTR(err);
+	/* claim it, so that nbd_clear_que() leaves it to us */
+	cmd = blk_mq_rq_to_pdu(req);
+	if (!test_and_clear_bit(NBD_REQ_INFLIGHT, &cmd->flags))
+		return ERR_PTR(-ENOENT);
+
+	return req;
 }
 
-static inline int sock_recv_bvec(struct nbd_device *nbd, struct bio_vec *bvec)
+static inline int sock_recv_bvec(struct nbd_device *nbd, struct nbd_sock *nsock,
+		struct bio_vec *bvec)
 {
 	int result;
 	void *kaddr = kmap(bvec->bv_page);
-	result = sock_xmit(nbd, 0, kaddr + bvec->bv_offset, bvec->bv_len,
-			MSG_WAITALL);
+	result = sock_xmit(nbd, nsock, 0, kaddr + bvec->bv_offset,
+			   bvec->bv_len, MSG_WAITALL);
 	kunmap(bvec->bv_page);
 	return result;
 }
 
 /* NULL returned = something went wrong, inform userspace */
-static struct request *nbd_read_stat(struct nbd_device *nbd)
+static struct request *nbd_read_stat(struct nbd_device *nbd,
+		struct nbd_sock *nsock)
 {
 	int result;
 	struct nbd_reply reply;
 	struct request *req;
+	u32 tag;
 
 	reply.magic = 0;
-	result = sock_xmit(nbd, 0, &reply, sizeof(reply), MSG_WAITALL);
+	result = sock_xmit(nbd, nsock, 0, &reply, sizeof(reply), MSG_WAITALL);
 	if (result <= 0) {
 		dev_err(disk_to_dev(nbd->disk),
 			"Receive control failed (result %d)\n", result);
@@ -352,14 +370,11 @@ static struct request *nbd_read_stat(struct nbd_device *nbd)
 		goto harderror;
 	}
 
-	req = nbd_find_request(nbd, *(struct request **)reply.handle);
+	memcpy(&tag, reply.handle, sizeof(tag));
+	req = nbd_find_request(nbd, tag);
 	if (IS_ERR(req)) {
-		result = PTR_ERR(req);
-		if (result != -ENOENT)
-			goto harderror;
-
-		dev_err(disk_to_dev(nbd->disk), "Unexpected reply (%p)\n",
-			reply.handle);
+		dev_err(disk_to_dev(nbd->disk), "Unexpected reply (%08x)\n",
+			tag);
 		result = -EBADR;
 		goto harderror;
 	}
@@ -378,7 +393,7 @@ static struct request *nbd_read_stat(struct nbd_device *nbd)
 		struct bio_vec bvec;
 
 		rq_for_each_segment(bvec, req, iter) {
-			result = sock_recv_bvec(nbd, &bvec);
+			result = sock_recv_bvec(nbd, nsock, &bvec);
 			if (result <= 0) {
 				dev_err(disk_to_dev(nbd->disk), "Receive data failed (result %d)\n",
 					result);
@@ -395,6 +410,24 @@ harderror:
 	return NULL;
 }
 
+static int nbd_recv_thread(void *data)
+{
+	struct nbd_sock *nsock = data;
+	struct nbd_device *nbd = nsock->nbd;
+	struct request *req;
+
+	set_user_nice(current, MIN_NICE);
+	while ((req = nbd_read_stat(nbd, nsock)) != NULL)
+		nbd_end_request(req);
+
+	/* one connection going away takes the whole device down */
+	sock_shutdown(nbd);
+
+	if (atomic_dec_and_test(&nbd->recv_threads))
+		wake_up(&nbd->recv_wq);
+	return 0;
+}
+
 static ssize_t pid_show(struct device *dev,
 			struct device_attribute *attr, char *buf)
 {
@@ -409,67 +442,113 @@ static struct device_attribute pid_attr = {
 	.show = pid_show,
 };
 
-static int nbd_do_it(struct nbd_device *nbd)
+static void nbd_clear_req(struct blk_mq_hw_ctx *hctx, struct request *req,
+			  void *data, bool reserved)
 {
-	struct request *req;
-	int ret;
+	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(req);
+
+	if (!test_and_clear_bit(NBD_REQ_INFLIGHT, &cmd->flags))
+		return;
+	req->errors++;
+	nbd_end_request(req);
+}
+
+static void nbd_clear_que(struct nbd_device *nbd)
+{
+	struct request_queue *q = nbd->disk->queue;
+	struct blk_mq_hw_ctx *hctx;
+	int i;
 
 	BUG_ON(nbd->magic != NBD_MAGIC);
 
-	sk_set_memalloc(nbd->sock->sk);
-	nbd->pid = task_pid_nr(current);
-	ret = device_create_file(disk_to_dev(nbd->disk), &pid_attr);
-	if (ret) {
-		dev_err(disk_to_dev(nbd->disk), "device_create_file failed!\n");
-		nbd->pid = 0;
-		return ret;
+	/* Requests not sent yet fail from now on */
+	clear_bit(NBD_RUNNING, &nbd->runtime_flags);
+	blk_mq_freeze_queue_start(q);
+
+	/*
+	 * Kick out any sender stuck on a socket and wait for it: once
+	 * every socket is dead under its tx_lock, nobody is touching the
+	 * pages of a request marked in flight any more.
+	 */
+	sock_shutdown(nbd);
+	for (i = 0; i < nbd->num_connections; i++) {
+		mutex_lock(&nbd->socks[i]->tx_lock);
+		nbd->socks[i]->dead = true;
+		mutex_unlock(&nbd->socks[i]->tx_lock);
 	}
 
-	while ((req = nbd_read_stat(nbd)) != NULL)
-		nbd_end_request(req);
+	/* The receivers are gone, so no reply is coming for these */
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_tag_busy_iter(hctx, nbd_clear_req, NULL);
 
-	device_remove_file(disk_to_dev(nbd->disk), &pid_attr);
-	nbd->pid = 0;
-	return 0;
+	blk_mq_freeze_queue_wait(q);
+	blk_mq_unfreeze_queue(q);
 }
 
-static void nbd_clear_que(struct nbd_device *nbd)
+static void nbd_free_socks(struct nbd_device *nbd)
 {
-	struct request *req;
+	int i;
+
+	cancel_work_sync(&nbd->timeout_work);
+	for (i = 0; i < nbd->num_connections; i++) {
+		sockfd_put(nbd->socks[i]->sock);
+		kfree(nbd->socks[i]);
+	}
+	kfree(nbd->socks);
+	nbd->socks = NULL;
+	nbd->num_connections = 0;
+	clear_bit(NBD_SOCKS_SHUTDOWN, &nbd->runtime_flags);
+}
+
+static int nbd_do_it(struct nbd_device *nbd)
+{
+	struct task_struct *thread;
+	int i, ret;
 
 	BUG_ON(nbd->magic != NBD_MAGIC);
 
-	/*
-	 * Because we have set nbd->sock to NULL under the tx_lock, all
-	 * modifications to the list must have completed by now.  For
-	 * the same reason, the active_req must be NULL.
-	 *
-	 * As a consequence, we don't need to take the spin lock while
-	 * purging the list here.
-	 */
-	BUG_ON(nbd->sock);
-	BUG_ON(nbd->active_req);
+	nbd->pid = task_pid_nr(current);
+	ret = device_create_file(disk_to_dev(nbd->disk), &pid_attr);
+	if (ret) {
+		dev_err(disk_to_dev(nbd->disk), "device_create_file failed!\n");
+		nbd->pid = 0;
+		return ret;
+	}
 
-	while (!list_empty(&nbd->queue_head)) {
-		req = list_entry(nbd->queue_head.next, struct request,
-				 queuelist);
-		list_del_init(&req->queuelist);
-		req->errors++;
-		nbd_end_request(req);
+	set_bit(NBD_RUNNING, &nbd->runtime_flags);
+	for (i = 0; i < nbd->num_connections; i++) {
+		struct nbd_sock *nsock = nbd->socks[i];
+
+		sk_set_memalloc(nsock->sock->sk);
+		atomic_inc(&nbd->recv_threads);
+		thread = kthread_run(nbd_recv_thread, nsock, "%s-recv%d",
+				     nbd->disk->disk_name, i);
+		if (IS_ERR(thread)) {
+			atomic_dec(&nbd->recv_threads);
+			sock_shutdown(nbd);
+			break;
+		}
 	}
 
-	while (!list_empty(&nbd->waiting_queue)) {
-		req = list_entry(nbd->waiting_queue.next, struct request,
-				 queuelist);
-		list_del_init(&req->queuelist);
-		req->errors++;
-		nbd_end_request(req);
+	if (wait_event_interruptible(nbd->recv_wq,
+				     !atomic_read(&nbd->recv_threads))) {
+		dev_warn(disk_to_dev(nbd->disk), "nbd-client got a signal\n");
+		sock_shutdown(nbd);
+		wait_event(nbd->recv_wq, !atomic_read(&nbd->recv_threads));
 	}
-}
 
+	nbd_clear_que(nbd);
+
+	device_remove_file(disk_to_dev(nbd->disk), &pid_attr);
+	nbd->pid = 0;
+	return 0;
+}
 
 static void nbd_handle_req(struct nbd_device *nbd, struct request *req)
 {
+	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(req);
+	struct nbd_sock *nsock;
+
 	if (req->cmd_type != REQ_TYPE_FS)
 		goto error_out;
 
@@ -494,29 +573,37 @@ static void nbd_handle_req(struct nbd_device *nbd, struct request *req)
 
 	req->errors = 0;
 
-	mutex_lock(&nbd->tx_lock);
-	if (unlikely(!nbd->sock)) {
-		mutex_unlock(&nbd->tx_lock);
+	/*
+	 * The connections can't change while we're running, and
+	 * nbd_clear_que() waits for this request before they go away.
+	 */
+	if (unlikely(!test_bit(NBD_RUNNING, &nbd->runtime_flags))) {
 		dev_err(disk_to_dev(nbd->disk),
 			"Attempted send on closed socket\n");
 		goto error_out;
 	}
 
-	nbd->active_req = req;
+	/* the tags spread the requests over the connections */
+	nsock = nbd->socks[req->tag % nbd->num_connections];
 
-	if (nbd_send_req(nbd, req) != 0) {
-		dev_err(disk_to_dev(nbd->disk), "Request send failed\n");
-		req->errors++;
-		nbd_end_request(req);
-	} else {
-		spin_lock(&nbd->queue_lock);
-		list_add_tail(&req->queuelist, &nbd->queue_head);
-		spin_unlock(&nbd->queue_lock);
+	mutex_lock(&nsock->tx_lock);
+	if (unlikely(nsock->dead)) {
+		mutex_unlock(&nsock->tx_lock);
+		dev_err(disk_to_dev(nbd->disk),
+			"Attempted send on closed socket\n");
+		goto error_out;
 	}
 
-	nbd->active_req = NULL;
-	mutex_unlock(&nbd->tx_lock);
-	wake_up_all(&nbd->active_wq);
+	/* set before sending, the reply may beat us back */
+	set_bit(NBD_REQ_INFLIGHT, &cmd->flags);
+	if (nbd_send_req(nbd, nsock, req) != 0) {
+		dev_err(disk_to_dev(nbd->disk), "Request send failed\n");
+		if (test_and_clear_bit(NBD_REQ_INFLIGHT, &cmd->flags)) {
+			req->errors++;
+			nbd_end_request(req);
+		}
+	}
+	mutex_unlock(&nsock->tx_lock);
 
 	return;
 
@@ -525,32 +612,12 @@ error_out:
 	nbd_end_request(req);
 }
 
-static int nbd_thread(void *data)
+static void nbd_cmd_work(struct work_struct *work)
 {
-	struct nbd_device *nbd = data;
-	struct request *req;
-
-	set_user_nice(current, MIN_NICE);
-	while (!kthread_should_stop() || !list_empty(&nbd->waiting_queue)) {
-		/* wait for something to do */
-		wait_event_interruptible(nbd->waiting_wq,
-					 kthread_should_stop() ||
-					 !list_empty(&nbd->waiting_queue));
-
-		/* extract request */
-		if (list_empty(&nbd->waiting_queue))
-			continue;
-
-		spin_lock_irq(&nbd->queue_lock);
-		req = list_entry(nbd->waiting_queue.next, struct request,
-				 queuelist);
-		list_del_init(&req->queuelist);
-		spin_unlock_irq(&nbd->queue_lock);
+	struct nbd_cmd *cmd = container_of(work, struct nbd_cmd, work);
+	struct request *req = blk_mq_rq_from_pdu(cmd);
 
-		/* handle request */
-		nbd_handle_req(nbd, req);
-	}
-	return 0;
+	nbd_handle_req(cmd->nbd, req);
 }
 
 /*
@@ -560,98 +627,110 @@ static int nbd_thread(void *data)
  *   { printk( "Warning: Ignoring result!\n"); nbd_end_request( req ); }
  */
 
-static void do_nbd_request(struct request_queue *q)
-		__releases(q->queue_lock) __acquires(q->queue_lock)
+static int nbd_queue_rq(struct blk_mq_hw_ctx *hctx,
+			const struct blk_mq_queue_data *bd)
 {
-	struct request *req;
-	
-	while ((req = blk_fetch_request(q)) != NULL) {
-		struct nbd_device *nbd;
-
-		spin_unlock_irq(q->queue_lock);
-
-		dprintk(DBG_BLKDEV, "%s: request %p: dequeued (flags=%x)\n",
-				req->rq_disk->disk_name, req, req->cmd_type);
+	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(bd->rq);
 
-		nbd = req->rq_disk->private_data;
+	BUG_ON(cmd->nbd->magic != NBD_MAGIC);
 
-		BUG_ON(nbd->magic != NBD_MAGIC);
+	dprintk(DBG_BLKDEV, "%s: request %p: dequeued (flags=%x)\n",
+			bd->rq->rq_disk->disk_name, bd->rq, bd->rq->cmd_type);
 
-		if (unlikely(!nbd->sock)) {
-			dev_err(disk_to_dev(nbd->disk),
-				"Attempted send on closed socket\n");
-			req->errors++;
-			nbd_end_request(req);
-			spin_lock_irq(q->queue_lock);
-			continue;
-		}
-
-		spin_lock_irq(&nbd->queue_lock);
-		list_add_tail(&req->queuelist, &nbd->waiting_queue);
-		spin_unlock_irq(&nbd->queue_lock);
+	/* sending may sleep, which we can't do here */
+	blk_mq_start_request(bd->rq);
+	queue_work(nbd_wq, &cmd->work);
+	return BLK_MQ_RQ_QUEUE_OK;
+}
 
-		wake_up(&nbd->waiting_wq);
+static int nbd_init_request(void *data, struct request *rq,
+			    unsigned int hctx_idx, unsigned int request_idx,
+			    unsigned int numa_node)
+{
+	struct nbd_cmd *cmd = blk_mq_rq_to_pdu(rq);
 
-		spin_lock_irq(q->queue_lock);
-	}
+	cmd->nbd = data;
+	INIT_WORK(&cmd->work, nbd_cmd_work);
+	return 0;
 }
 
-/* Must be called with tx_lock held */
+static struct blk_mq_ops nbd_mq_ops = {
+	.queue_rq	= nbd_queue_rq,
+	.map_queue	= blk_mq_map_queue,
+	.init_request	= nbd_init_request,
+	.complete	= nbd_complete_rq,
+	.timeout	= nbd_xmit_timeout,
+};
+
+/* Must be called with config_lock held */
 
 static int __nbd_ioctl(struct block_device *bdev, struct nbd_device *nbd,
 		       unsigned int cmd, unsigned long arg)
 {
 	switch (cmd) {
 	case NBD_DISCONNECT: {
-		struct request sreq;
-
 		dev_info(disk_to_dev(nbd->disk), "NBD_DISCONNECT\n");
-		if (!nbd->sock)
+		if (!nbd->num_connections)
 			return -EINVAL;
 
-		mutex_unlock(&nbd->tx_lock);
+		mutex_unlock(&nbd->config_lock);
 		fsync_bdev(bdev);
-		mutex_lock(&nbd->tx_lock);
-		blk_rq_init(NULL, &sreq);
-		sreq.cmd_type = REQ_TYPE_SPECIAL;
-		nbd_cmd(&sreq) = NBD_CMD_DISC;
+		mutex_lock(&nbd->config_lock);
 
 		/* Check again after getting mutex back.  */
-		if (!nbd->sock)
+		if (!nbd->num_connections)
 			return -EINVAL;
 
 		nbd->disconnect = 1;
 
-		nbd_send_req(nbd, &sreq);
+		send_disconnects(nbd);
 		return 0;
 	}
- 
-	case NBD_CLEAR_SOCK: {
-		struct socket *sock = nbd->sock;
-		nbd->sock = NULL;
-		nbd_clear_que(nbd);
-		BUG_ON(!list_empty(&nbd->queue_head));
-		BUG_ON(!list_empty(&nbd->waiting_queue));
+
+	case NBD_CLEAR_SOCK:
+		/* NBD_DO_IT clears up after the connections itself */
+		if (nbd->pid) {
+			sock_shutdown(nbd);
+			return 0;
+		}
+		nbd_free_socks(nbd);
 		kill_bdev(bdev);
-		if (sock)
-			sockfd_put(sock);
 		return 0;
-	}
 
 	case NBD_SET_SOCK: {
+		struct nbd_sock **socks, *nsock;
 		struct socket *sock;
 		int err;
-		if (nbd->sock)
+
+		/* more connections may be added until NBD_DO_IT */
+		if (nbd->pid)
 			return -EBUSY;
 		sock = sockfd_lookup(arg, &err);
-		if (sock) {
-			nbd->sock = sock;
-			if (max_part > 0)
-				bdev->bd_invalidated = 1;
-			nbd->disconnect = 0; /* we're connected now */
-			return 0;
+		if (!sock)
+			return -EINVAL;
+
+		socks = krealloc(nbd->socks, (nbd->num_connections + 1) *
+				 sizeof(*socks), GFP_KERNEL);
+		if (!socks) {
+			sockfd_put(sock);
+			return -ENOMEM;
 		}
-		return -EINVAL;
+		nbd->socks = socks;
+
+		nsock = kzalloc(sizeof(*nsock), GFP_KERNEL);
+		if (!nsock) {
+			sockfd_put(sock);
+			return -ENOMEM;
+		}
+		mutex_init(&nsock->tx_lock);
+		nsock->sock = sock;
+		nsock->nbd = nbd;
+		socks[nbd->num_connections++] = nsock;
+
+		if (max_part > 0)
+			bdev->bd_invalidated = 1;
+		nbd->disconnect = 0; /* we're connected now */
+		return 0;
 	}
 
 	case NBD_SET_BLKSIZE:
@@ -671,6 +750,8 @@ static int __nbd_ioctl(struct block_device *bdev, struct nbd_device *nbd,
 
 	case NBD_SET_TIMEOUT:
 		nbd->xmit_timeout = arg * HZ;
+		if (arg)
+			blk_queue_rq_timeout(nbd->disk->queue, arg * HZ);
 		return 0;
 
 	case NBD_SET_FLAGS:
@@ -685,16 +766,20 @@ static int __nbd_ioctl(struct block_device *bdev, struct nbd_device *nbd,
 		return 0;
 
 	case NBD_DO_IT: {
-		struct task_struct *thread;
-		struct socket *sock;
 		int error;
 
 		if (nbd->pid)
 			return -EBUSY;
-		if (!nbd->sock)
+		if (!nbd->num_connections)
+			return -EINVAL;
+		if (nbd->num_connections > 1 &&
+		    !(nbd->flags & NBD_FLAG_CAN_MULTI_CONN)) {
+			dev_err(disk_to_dev(nbd->disk),
+				"server does not support multiple connections per device\n");
 			return -EINVAL;
+		}
 
-		mutex_unlock(&nbd->tx_lock);
+		mutex_unlock(&nbd->config_lock);
 
 		if (nbd->flags & NBD_FLAG_READ_ONLY)
 			set_device_ro(bdev, true);
@@ -706,29 +791,16 @@ static int __nbd_ioctl(struct block_device *bdev, struct nbd_device *nbd,
 		else
 			blk_queue_flush(nbd->disk->queue, 0);
 
-		thread = kthread_create(nbd_thread, nbd, "%s",
-					nbd->disk->disk_name);
-		if (IS_ERR(thread)) {
-			mutex_lock(&nbd->tx_lock);
-			return PTR_ERR(thread);
-		}
-		wake_up_process(thread);
 		error = nbd_do_it(nbd);
-		kthread_stop(thread);
 
-		mutex_lock(&nbd->tx_lock);
+		mutex_lock(&nbd->config_lock);
 		if (error)
 			return error;
-		sock_shutdown(nbd, 0);
-		sock = nbd->sock;
-		nbd->sock = NULL;
-		nbd_clear_que(nbd);
+		nbd_free_socks(nbd);
 		dev_warn(disk_to_dev(nbd->disk), "queue cleared\n");
 		kill_bdev(bdev);
 		queue_flag_clear_unlocked(QUEUE_FLAG_DISCARD, nbd->disk->queue);
 		set_device_ro(bdev, false);
-		if (sock)
-			sockfd_put(sock);
 		nbd->flags = 0;
 		nbd->bytesize = 0;
 		bdev->bd_inode->i_size = 0;
@@ -749,9 +821,8 @@ static int __nbd_ioctl(struct block_device *bdev, struct nbd_device *nbd,
 
 	case NBD_PRINT_DEBUG:
 		dev_info(disk_to_dev(nbd->disk),
-			"next = %p, prev = %p, head = %p\n",
-			nbd->queue_head.next, nbd->queue_head.prev,
-			&nbd->queue_head);
+			"connections = %d, receivers = %d\n",
+			nbd->num_connections, atomic_read(&nbd->recv_threads));
 		return 0;
 	}
 	return -ENOTTY;
@@ -772,9 +843,9 @@ static int nbd_ioctl(struct block_device *bdev, fmode_t mode,
 	dprintk(DBG_IOCTL, "%s: nbd_ioctl cmd=%s(0x%x) arg=%lu\n",
 		nbd->disk->disk_name, ioctl_cmd_to_ascii(cmd), cmd, arg);
 
-	mutex_lock(&nbd->tx_lock);
+	mutex_lock(&nbd->config_lock);
 	error = __nbd_ioctl(bdev, nbd, cmd, arg);
-	mutex_unlock(&nbd->tx_lock);
+	mutex_unlock(&nbd->config_lock);
 
 	return error;
 }
@@ -828,18 +899,40 @@ static int __init nbd_init(void)
 	if (nbds_max > 1UL << (MINORBITS - part_shift))
 		return -EINVAL;
 
+	nbd_wq = alloc_workqueue("nbd", WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!nbd_wq) {
+		kfree(nbd_dev);
+		return -ENOMEM;
+	}
+
 	for (i = 0; i < nbds_max; i++) {
 		struct gendisk *disk = alloc_disk(1 << part_shift);
 		if (!disk)
 			goto out;
 		nbd_dev[i].disk = disk;
+
+		nbd_dev[i].tag_set.ops = &nbd_mq_ops;
+		nbd_dev[i].tag_set.nr_hw_queues = 1;
+		nbd_dev[i].tag_set.queue_depth = 128;
+		nbd_dev[i].tag_set.numa_node = NUMA_NO_NODE;
+		nbd_dev[i].tag_set.cmd_size = sizeof(struct nbd_cmd);
+		nbd_dev[i].tag_set.flags = BLK_MQ_F_SHOULD_MERGE |
+					   BLK_MQ_F_SG_MERGE;
+		nbd_dev[i].tag_set.driver_data = &nbd_dev[i];
+
+		if (blk_mq_alloc_tag_set(&nbd_dev[i].tag_set)) {
+			put_disk(disk);
+			goto out;
+		}
+
 		/*
 		 * The new linux 2.5 block layer implementation requires
 		 * every gendisk to have its very own request_queue struct.
 		 * These structs are big so we dynamically allocate them.
 		 */
-		disk->queue = blk_init_queue(do_nbd_request, &nbd_lock);
-		if (!disk->queue) {
+		disk->queue = blk_mq_init_queue(&nbd_dev[i].tag_set);
+		if (IS_ERR(disk->queue)) {
+			blk_mq_free_tag_set(&nbd_dev[i].tag_set);
 			put_disk(disk);
 			goto out;
 		}
@@ -866,12 +959,10 @@ static int __init nbd_init(void)
 	for (i = 0; i < nbds_max; i++) {
 		struct gendisk *disk = nbd_dev[i].disk;
 		nbd_dev[i].magic = NBD_MAGIC;
-		INIT_LIST_HEAD(&nbd_dev[i].waiting_queue);
-		spin_lock_init(&nbd_dev[i].queue_lock);
-		INIT_LIST_HEAD(&nbd_dev[i].queue_head);
-		mutex_init(&nbd_dev[i].tx_lock);
-		init_waitqueue_head(&nbd_dev[i].active_wq);
-		init_waitqueue_head(&nbd_dev[i].waiting_wq);
+		mutex_init(&nbd_dev[i].config_lock);
+		atomic_set(&nbd_dev[i].recv_threads, 0);
+		init_waitqueue_head(&nbd_dev[i].recv_wq);
+		INIT_WORK(&nbd_dev[i].timeout_work, nbd_timeout_work);
 		nbd_dev[i].blksize = 1024;
 		nbd_dev[i].bytesize = 0;
 		disk->major = NBD_MAJOR;
@@ -887,8 +978,10 @@ static int __init nbd_init(void)
 out:
 	while (i--) {
 		blk_cleanup_queue(nbd_dev[i].disk->queue);
+		blk_mq_free_tag_set(&nbd_dev[i].tag_set);
 		put_disk(nbd_dev[i].disk);
 	}
+	destroy_workqueue(nbd_wq);
 	kfree(nbd_dev);
 	return err;
 }
@@ -902,10 +995,12 @@ static void __exit nbd_cleanup(void)
 		if (disk) {
 			del_gendisk(disk);
 			blk_cleanup_queue(disk->queue);
+			blk_mq_free_tag_set(&nbd_dev[i].tag_set);
 			put_disk(disk);
 		}
 	}
 	unregister_blkdev(NBD_MAJOR, "nbd");
+	destroy_workqueue(nbd_wq);
 	kfree(nbd_dev);
 	printk(KERN_INFO "nbd: unregistered device at major %d\n", NBD_MAJOR);
 }
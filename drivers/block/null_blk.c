@@ -8,15 +8,20 @@
 #include <linux/slab.h>
 #include <linux/blk-mq.h>
 #include <linux/hrtimer.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
 
 struct nullb_cmd {
 	struct list_head list;
-	struct llist_node ll_list;
 	struct call_single_data csd;
 	struct request *rq;
 	struct bio *bio;
 	unsigned int tag;
+	int error;
 	struct nullb_queue *nq;
+	struct hrtimer timer;
 };
 
 struct nullb_queue {
@@ -33,12 +38,31 @@ struct nullb {
 	struct request_queue *q;
 	struct gendisk *disk;
 	struct blk_mq_tag_set tag_set;
-	struct hrtimer timer;
 	unsigned int queue_depth;
 	spinlock_t lock;
 
 	struct nullb_queue *queues;
 	unsigned int nr_queues;
+
+	/*
+	 * Device emulation, taken from the module parameters when the
+	 * device is added.  The timing ones only matter with irqmode=2 and
+	 * can be changed through /sys/block/nullbX/nullb/.
+	 */
+	unsigned int completion_nsec;
+	unsigned int lat_dist;
+	unsigned int lat_spread_nsec;
+	unsigned int lat_sigma;
+	unsigned int mbps;
+	unsigned int cache_mb;
+	unsigned int zone_size;
+
+	spinlock_t emu_lock;		/* protects the fields below */
+	u64 busy_until;			/* media busy up to here, in ns */
+	u64 cache_dirty;		/* bytes in the write cache */
+	unsigned int zone_shift;	/* zone size, in sectors */
+	unsigned int nr_zones;
+	sector_t *zone_wp;		/* write pointer of each zone */
 };
 
 static LIST_HEAD(nullb_list);
@@ -46,23 +70,18 @@ static struct mutex lock;
 static int null_major;
 static int nullb_indexes;
 
-struct completion_queue {
-	struct llist_head list;
-	struct hrtimer timer;
-};
-
-/*
- * These are per-cpu for now, they will need to be configured by the
- * complete_queues parameter and appropriately mapped.
- */
-static DEFINE_PER_CPU(struct completion_queue, completion_queues);
-
 enum {
 	NULL_IRQ_NONE		= 0,
 	NULL_IRQ_SOFTIRQ	= 1,
 	NULL_IRQ_TIMER		= 2,
 };
 
+enum {
+	NULL_LAT_FIXED		= 0,
+	NULL_LAT_UNIFORM	= 1,
+	NULL_LAT_LOGNORMAL	= 2,
+};
+
 enum {
 	NULL_Q_BIO		= 0,
 	NULL_Q_RQ		= 1,
@@ -139,6 +158,42 @@ static int completion_nsec = 10000;
 module_param(completion_nsec, int, S_IRUGO);
 MODULE_PARM_DESC(completion_nsec, "Time in ns to complete a request in hardware. Default: 10,000ns");
 
+static int lat_dist = NULL_LAT_FIXED;
+
+static int null_set_lat_dist(const char *str, const struct kernel_param *kp)
+{
+	return null_param_store_val(str, &lat_dist, NULL_LAT_FIXED,
+					NULL_LAT_LOGNORMAL);
+}
+
+static struct kernel_param_ops null_lat_dist_param_ops = {
+	.set	= null_set_lat_dist,
+	.get	= param_get_int,
+};
+
+device_param_cb(lat_dist, &null_lat_dist_param_ops, &lat_dist, S_IRUGO);
+MODULE_PARM_DESC(lat_dist, "Completion time distribution with irqmode=2. 0-fixed, 1-uniform, 2-lognormal");
+
+static unsigned int lat_spread_nsec;
+module_param(lat_spread_nsec, uint, S_IRUGO);
+MODULE_PARM_DESC(lat_spread_nsec, "Uniform distribution: completion_nsec +/- this many ns. Default: 0");
+
+static unsigned int lat_sigma = 500;
+module_param(lat_sigma, uint, S_IRUGO);
+MODULE_PARM_DESC(lat_sigma, "Lognormal distribution: sigma in 1/1000, around a median of completion_nsec. Default: 500");
+
+static unsigned int mbps;
+module_param(mbps, uint, S_IRUGO);
+MODULE_PARM_DESC(mbps, "Bandwidth ceiling in MB/s with irqmode=2. Default: 0 (unlimited)");
+
+static unsigned int cache_mb;
+module_param(cache_mb, uint, S_IRUGO);
+MODULE_PARM_DESC(cache_mb, "Size of a volatile write cache in MB, written back at mbps and on flush. Default: 0 (none)");
+
+static unsigned int zone_size;
+module_param(zone_size, uint, S_IRUGO);
+MODULE_PARM_DESC(zone_size, "Zone size in MB, writes must be sequential within a zone and discard resets it. Default: 0 (not zoned)");
+
 static int hw_queue_depth = 64;
 module_param(hw_queue_depth, int, S_IRUGO);
 MODULE_PARM_DESC(hw_queue_depth, "Queue depth for each hardware queue. Default: 64");
@@ -215,52 +270,212 @@ static void end_cmd(struct nullb_cmd *cmd)
 {
 	switch (queue_mode)  {
 	case NULL_Q_MQ:
-		blk_mq_end_request(cmd->rq, 0);
+		blk_mq_end_request(cmd->rq, cmd->error);
 		return;
 	case NULL_Q_RQ:
 		INIT_LIST_HEAD(&cmd->rq->queuelist);
-		blk_end_request_all(cmd->rq, 0);
+		blk_end_request_all(cmd->rq, cmd->error);
 		break;
 	case NULL_Q_BIO:
-		bio_endio(cmd->bio, 0);
+		bio_endio(cmd->bio, cmd->error);
 		break;
 	}
 
 	free_cmd(cmd);
 }
 
-static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+static void null_cmd_geometry(struct nullb_cmd *cmd, sector_t *sector,
+			      unsigned int *bytes, u64 *flags)
 {
-	struct completion_queue *cq;
-	struct llist_node *entry;
-	struct nullb_cmd *cmd;
+	if (queue_mode == NULL_Q_BIO) {
+		*sector = cmd->bio->bi_iter.bi_sector;
+		*bytes = cmd->bio->bi_iter.bi_size;
+		*flags = cmd->bio->bi_rw;
+	} else {
+		*sector = blk_rq_pos(cmd->rq);
+		*bytes = blk_rq_bytes(cmd->rq);
+		*flags = cmd->rq->cmd_flags;
+	}
+}
 
-	cq = &per_cpu(completion_queues, smp_processor_id());
+/*
+ * Writes have to start at the write pointer of their zone and may not
+ * cross into the next one.  A discard resets every zone it covers
+ * completely, like a zone reset would.
+ */
+static int null_handle_zoned(struct nullb *nullb, struct nullb_cmd *cmd)
+{
+	sector_t sector, nr, zsects = 1ULL << nullb->zone_shift;
+	unsigned int bytes, zno;
+	unsigned long flags;
+	u64 rw;
+	int ret = 0;
+
+	null_cmd_geometry(cmd, &sector, &bytes, &rw);
+	nr = bytes >> 9;
+	if (!(rw & REQ_WRITE) || !nr)
+		return 0;
+
+	spin_lock_irqsave(&nullb->emu_lock, flags);
+	if (rw & REQ_DISCARD) {
+		sector_t s;
+
+		for (s = round_up(sector, zsects); s + zsects <= sector + nr;
+		     s += zsects)
+			nullb->zone_wp[s >> nullb->zone_shift] = s;
+	} else {
+		zno = sector >> nullb->zone_shift;
+		if (zno >= nullb->nr_zones || sector != nullb->zone_wp[zno] ||
+		    ((sector + nr - 1) >> nullb->zone_shift) != zno)
+			ret = -EIO;
+		else
+			nullb->zone_wp[zno] += nr;
+	}
+	spin_unlock_irqrestore(&nullb->emu_lock, flags);
 
-	while ((entry = llist_del_all(&cq->list)) != NULL) {
-		entry = llist_reverse_order(entry);
-		do {
-			cmd = container_of(entry, struct nullb_cmd, ll_list);
-			entry = entry->next;
-			end_cmd(cmd);
-		} while (entry);
+	return ret;
+}
+
+/*
+ * Standard normal deviate as the sum of 12 uniform ones, in 16.16 fixed
+ * point.
+ */
+static s64 null_normal_q16(void)
+{
+	s64 sum = 0;
+	int i;
+
+	for (i = 0; i < 12; i++)
+		sum += prandom_u32() >> 16;
+
+	return sum - 6 * 65536;
+}
+
+/*
+ * @median * e^(sigma * N(0, 1)), with sigma in 1/1000.  The power of two
+ * is split into its integer part and a third order series for the rest,
+ * which is close enough for a completion time.
+ */
+static u64 null_lognormal_nsec(unsigned int median, unsigned int sigma)
+{
+	/* 94548 is log2(e) in 16.16 */
+	s64 x = div_s64(null_normal_q16() * sigma * 94548, 1000) >> 16;
+	int k = clamp_t(s64, x >> 16, -16, 15);
+	u64 f = x & 0xffff;
+	u64 r;
+
+	r = 65536 + ((f * (45426 + ((f * (15743 +
+			((f * 3638) >> 16))) >> 16))) >> 16);
+	if (k >= 0)
+		r <<= k;
+	else
+		r >>= -k;
+
+	return ((u64)median * (r >> 8)) >> 8;
+}
+
+static u64 null_sample_latency(struct nullb *nullb)
+{
+	unsigned int nsec = nullb->completion_nsec;
+	unsigned int spread = min(nullb->lat_spread_nsec, nsec);
+
+	switch (nullb->lat_dist) {
+	case NULL_LAT_UNIFORM:
+		return nsec - spread + prandom_u32_max(2 * spread + 1);
+	case NULL_LAT_LOGNORMAL:
+		return null_lognormal_nsec(nsec, nullb->lat_sigma);
+	default:
+		return nsec;
 	}
+}
 
-	return HRTIMER_NORESTART;
+static u64 null_xfer_nsec(struct nullb *nullb, u64 bytes)
+{
+	/* bytes per ns is mbps / 1000 */
+	return nullb->mbps ? div_u64(bytes * 1000, nullb->mbps) : 0;
 }
 
-static void null_cmd_end_timer(struct nullb_cmd *cmd)
+/*
+ * Write back as much of the cache as the media had idle time for since
+ * it was last busy.
+ */
+static void null_drain_cache(struct nullb *nullb, u64 now)
 {
-	struct completion_queue *cq = &per_cpu(completion_queues, get_cpu());
+	u64 idle, drained;
+
+	if (!nullb->cache_dirty || now <= nullb->busy_until)
+		return;
 
-	cmd->ll_list.next = NULL;
-	if (llist_add(&cmd->ll_list, &cq->list)) {
-		ktime_t kt = ktime_set(0, completion_nsec);
+	if (!nullb->mbps) {
+		nullb->cache_dirty = 0;
+		return;
+	}
+
+	idle = min_t(u64, now - nullb->busy_until, 60 * NSEC_PER_SEC);
+	drained = div_u64(idle * nullb->mbps, 1000);
+	if (drained >= nullb->cache_dirty) {
+		nullb->busy_until += null_xfer_nsec(nullb, nullb->cache_dirty);
+		nullb->cache_dirty = 0;
+	} else {
+		nullb->cache_dirty -= drained;
+		nullb->busy_until = now;
+	}
+}
 
-		hrtimer_start(&cq->timer, kt, HRTIMER_MODE_REL);
+/*
+ * Time until @cmd completes.  Transfers are serialised on the media at
+ * the bandwidth ceiling, while the sampled latency overlaps with other
+ * commands.  Writes that fit in the cache don't touch the media until the
+ * cache is written back, which a flush waits for.
+ */
+static u64 null_cmd_delay(struct nullb *nullb, struct nullb_cmd *cmd)
+{
+	u64 lat = null_sample_latency(nullb);
+	u64 now = ktime_get_ns();
+	u64 rw, xfer, done;
+	unsigned long flags;
+	unsigned int bytes;
+	sector_t sector;
+
+	if (!nullb->mbps && !nullb->cache_mb)
+		return lat;
+
+	null_cmd_geometry(cmd, &sector, &bytes, &rw);
+	if (rw & REQ_DISCARD)
+		bytes = 0;
+
+	spin_lock_irqsave(&nullb->emu_lock, flags);
+	null_drain_cache(nullb, now);
+
+	xfer = null_xfer_nsec(nullb, bytes);
+	if (rw & REQ_FLUSH) {
+		xfer += null_xfer_nsec(nullb, nullb->cache_dirty);
+		nullb->cache_dirty = 0;
+	} else if ((rw & REQ_WRITE) && bytes && nullb->mbps &&
+		   nullb->cache_dirty + bytes <= (u64)nullb->cache_mb << 20) {
+		nullb->cache_dirty += bytes;
+		xfer = 0;
 	}
 
-	put_cpu();
+	nullb->busy_until = max(nullb->busy_until, now) + xfer;
+	done = max(now + lat, nullb->busy_until);
+	spin_unlock_irqrestore(&nullb->emu_lock, flags);
+
+	return done - now;
+}
+
+static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
+{
+	end_cmd(container_of(timer, struct nullb_cmd, timer));
+
+	return HRTIMER_NORESTART;
+}
+
+static void null_cmd_end_timer(struct nullb *nullb, struct nullb_cmd *cmd)
+{
+	ktime_t kt = ns_to_ktime(null_cmd_delay(nullb, cmd));
+
+	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
 
 static void null_softirq_done_fn(struct request *rq)
@@ -271,8 +486,12 @@ static void null_softirq_done_fn(struct request *rq)
 		end_cmd(rq->special);
 }
 
-static inline void null_handle_cmd(struct nullb_cmd *cmd)
+static inline void null_handle_cmd(struct nullb *nullb, struct nullb_cmd *cmd)
 {
+	cmd->error = 0;
+	if (nullb->zone_wp)
+		cmd->error = null_handle_zoned(nullb, cmd);
+
 	/* Complete IO by inline, softirq or timer */
 	switch (irqmode) {
 	case NULL_IRQ_SOFTIRQ:
@@ -295,7 +514,7 @@ static inline void null_handle_cmd(struct nullb_cmd *cmd)
 		end_cmd(cmd);
 		break;
 	case NULL_IRQ_TIMER:
-		null_cmd_end_timer(cmd);
+		null_cmd_end_timer(nullb, cmd);
 		break;
 	}
 }
@@ -319,7 +538,7 @@ static void null_queue_bio(struct request_queue *q, struct bio *bio)
 	cmd = alloc_cmd(nq, 1);
 	cmd->bio = bio;
 
-	null_handle_cmd(cmd);
+	null_handle_cmd(nullb, cmd);
 }
 
 static int null_rq_prep_fn(struct request_queue *q, struct request *req)
@@ -340,13 +559,14 @@ static int null_rq_prep_fn(struct request_queue *q, struct request *req)
 
 static void null_request_fn(struct request_queue *q)
 {
+	struct nullb *nullb = q->queuedata;
 	struct request *rq;
 
 	while ((rq = blk_fetch_request(q)) != NULL) {
 		struct nullb_cmd *cmd = rq->special;
 
 		spin_unlock_irq(q->queue_lock);
-		null_handle_cmd(cmd);
+		null_handle_cmd(nullb, cmd);
 		spin_lock_irq(q->queue_lock);
 	}
 }
@@ -361,10 +581,24 @@ static int null_queue_rq(struct blk_mq_hw_ctx *hctx,
 
 	blk_mq_start_request(bd->rq);
 
-	null_handle_cmd(cmd);
+	null_handle_cmd(hctx->queue->queuedata, cmd);
 	return BLK_MQ_RQ_QUEUE_OK;
 }
 
+static void null_init_cmd_timer(struct nullb_cmd *cmd)
+{
+	hrtimer_init(&cmd->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cmd->timer.function = null_cmd_timer_expired;
+}
+
+static int null_init_request(void *data, struct request *rq,
+			     unsigned int hctx_idx, unsigned int rq_idx,
+			     unsigned int numa_node)
+{
+	null_init_cmd_timer(blk_mq_rq_to_pdu(rq));
+	return 0;
+}
+
 static void null_init_queue(struct nullb *nullb, struct nullb_queue *nq)
 {
 	BUG_ON(!nullb);
@@ -391,6 +625,7 @@ static struct blk_mq_ops null_mq_ops = {
 	.queue_rq       = null_queue_rq,
 	.map_queue      = blk_mq_map_queue,
 	.init_hctx	= null_init_hctx,
+	.init_request	= null_init_request,
 	.complete	= null_softirq_done_fn,
 };
 
@@ -398,14 +633,86 @@ static void null_del_dev(struct nullb *nullb)
 {
 	list_del_init(&nullb->list);
 
+	sysfs_remove_group(&disk_to_dev(nullb->disk)->kobj, &nullb_attr_group);
 	del_gendisk(nullb->disk);
 	blk_cleanup_queue(nullb->q);
 	if (queue_mode == NULL_Q_MQ)
 		blk_mq_free_tag_set(&nullb->tag_set);
 	put_disk(nullb->disk);
+	vfree(nullb->zone_wp);
 	kfree(nullb);
 }
 
+/*
+ * Per device emulation settings, in /sys/block/nullbX/nullb/
+ */
+#define NULLB_ATTR_SHOW(_name)						\
+static ssize_t nullb_##_name##_show(struct device *dev,		\
+				    struct device_attribute *attr,	\
+				    char *page)				\
+{									\
+	struct nullb *nullb = dev_to_disk(dev)->private_data;		\
+									\
+	return sprintf(page, "%u\n", nullb->_name);			\
+}
+
+#define NULLB_ATTR_RW(_name, _min, _max)				\
+NULLB_ATTR_SHOW(_name)							\
+static ssize_t nullb_##_name##_store(struct device *dev,		\
+				     struct device_attribute *attr,	\
+				     const char *page, size_t count)	\
+{									\
+	struct nullb *nullb = dev_to_disk(dev)->private_data;		\
+	unsigned int val;						\
+									\
+	if (kstrtouint(page, 10, &val) || val < (_min) || val > (_max))	\
+		return -EINVAL;						\
+	nullb->_name = val;						\
+	return count;							\
+}									\
+static DEVICE_ATTR(_name, S_IRUGO | S_IWUSR, nullb_##_name##_show,	\
+		   nullb_##_name##_store)
+
+#define NULLB_ATTR_RO(_name)						\
+NULLB_ATTR_SHOW(_name)							\
+static DEVICE_ATTR(_name, S_IRUGO, nullb_##_name##_show, NULL)
+
+NULLB_ATTR_RW(completion_nsec, 0, INT_MAX);
+NULLB_ATTR_RW(lat_dist, NULL_LAT_FIXED, NULL_LAT_LOGNORMAL);
+NULLB_ATTR_RW(lat_spread_nsec, 0, INT_MAX);
+NULLB_ATTR_RW(lat_sigma, 0, 4000);
+NULLB_ATTR_RW(mbps, 0, INT_MAX);
+NULLB_ATTR_RO(queue_depth);
+NULLB_ATTR_RO(cache_mb);
+NULLB_ATTR_RO(zone_size);
+
+static ssize_t nullb_cache_dirty_show(struct device *dev,
+				      struct device_attribute *attr, char *page)
+{
+	struct nullb *nullb = dev_to_disk(dev)->private_data;
+
+	return sprintf(page, "%llu\n", (unsigned long long)nullb->cache_dirty);
+}
+static DEVICE_ATTR(cache_dirty, S_IRUGO, nullb_cache_dirty_show, NULL);
+
+static struct attribute *nullb_attrs[] = {
+	&dev_attr_completion_nsec.attr,
+	&dev_attr_lat_dist.attr,
+	&dev_attr_lat_spread_nsec.attr,
+	&dev_attr_lat_sigma.attr,
+	&dev_attr_mbps.attr,
+	&dev_attr_queue_depth.attr,
+	&dev_attr_cache_mb.attr,
+	&dev_attr_cache_dirty.attr,
+	&dev_attr_zone_size.attr,
+	NULL,
+};
+
+static struct attribute_group nullb_attr_group = {
+	.name = "nullb",
+	.attrs = nullb_attrs,
+};
+
 static int null_open(struct block_device *bdev, fmode_t mode)
 {
 	return 0;
@@ -440,8 +747,8 @@ static int setup_commands(struct nullb_queue *nq)
 	for (i = 0; i < nq->queue_depth; i++) {
 		cmd = &nq->cmds[i];
 		INIT_LIST_HEAD(&cmd->list);
-		cmd->ll_list.next = NULL;
 		cmd->tag = -1U;
+		null_init_cmd_timer(cmd);
 	}
 
 	return 0;
@@ -494,6 +801,35 @@ static int init_driver_queues(struct nullb *nullb)
 	return 0;
 }
 
+static int null_setup_zones(struct nullb *nullb, sector_t *capacity)
+{
+	struct request_queue *q = nullb->q;
+	sector_t zsects;
+	unsigned int i;
+
+	nullb->zone_size = rounddown_pow_of_two(min(nullb->zone_size, 2048U));
+	nullb->zone_shift = ilog2(nullb->zone_size) + 20 - 9;
+	zsects = 1ULL << nullb->zone_shift;
+
+	nullb->nr_zones = *capacity >> nullb->zone_shift;
+	if (!nullb->nr_zones)
+		return -EINVAL;
+	*capacity = (sector_t)nullb->nr_zones << nullb->zone_shift;
+
+	nullb->zone_wp = vmalloc(nullb->nr_zones * sizeof(sector_t));
+	if (!nullb->zone_wp)
+		return -ENOMEM;
+	for (i = 0; i < nullb->nr_zones; i++)
+		nullb->zone_wp[i] = (sector_t)i << nullb->zone_shift;
+
+	blk_queue_chunk_sectors(q, zsects);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
+	q->limits.discard_granularity = zsects << 9;
+	blk_queue_max_discard_sectors(q, UINT_MAX >> 9);
+
+	return 0;
+}
+
 static int null_add_dev(void)
 {
 	struct gendisk *disk;
@@ -508,6 +844,15 @@ static int null_add_dev(void)
 	}
 
 	spin_lock_init(&nullb->lock);
+	spin_lock_init(&nullb->emu_lock);
+
+	nullb->completion_nsec = max(completion_nsec, 0);
+	nullb->lat_dist = lat_dist;
+	nullb->lat_spread_nsec = lat_spread_nsec;
+	nullb->lat_sigma = min(lat_sigma, 4000U);
+	nullb->mbps = mbps;
+	nullb->cache_mb = cache_mb;
+	nullb->zone_size = zone_size;
 
 	if (queue_mode == NULL_Q_MQ && use_per_node_hctx)
 		submit_queues = nr_online_nodes;
@@ -561,6 +906,18 @@ static int null_add_dev(void)
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, nullb->q);
 	queue_flag_clear_unlocked(QUEUE_FLAG_ADD_RANDOM, nullb->q);
 
+	size = gb * 1024 * 1024 * 1024ULL;
+	sector_div(size, bs);
+
+	if (nullb->zone_size) {
+		rv = null_setup_zones(nullb, &size);
+		if (rv)
+			goto out_cleanup_blk_queue;
+	}
+
+	if (nullb->cache_mb)
+		blk_queue_flush(nullb->q, REQ_FLUSH);
+
 	disk = nullb->disk = alloc_disk_node(1, home_node);
 	if (!disk) {
 		rv = -ENOMEM;
@@ -575,8 +932,6 @@ static int null_add_dev(void)
 	blk_queue_logical_block_size(nullb->q, bs);
 	blk_queue_physical_block_size(nullb->q, bs);
 
-	size = gb * 1024 * 1024 * 1024ULL;
-	sector_div(size, bs);
 	set_capacity(disk, size);
 
 	disk->flags |= GENHD_FL_EXT_DEVT;
@@ -587,6 +942,10 @@ static int null_add_dev(void)
 	disk->queue		= nullb->q;
 	sprintf(disk->disk_name, "nullb%d", nullb->index);
 	add_disk(disk);
+
+	if (sysfs_create_group(&disk_to_dev(disk)->kobj, &nullb_attr_group))
+		pr_warn("null_blk: failed to create sysfs attributes for %s\n",
+			disk->disk_name);
 	return 0;
 
 out_cleanup_blk_queue:
@@ -597,6 +956,7 @@ out_cleanup_tags:
 out_cleanup_queues:
 	cleanup_queues(nullb);
 out_free_nullb:
+	vfree(nullb->zone_wp);
 	kfree(nullb);
 out:
 	return rv;
@@ -625,19 +985,6 @@ static int __init null_init(void)
 
 	mutex_init(&lock);
 
-	/* Initialize a separate list for each CPU for issuing softirqs */
-	for_each_possible_cpu(i) {
-		struct completion_queue *cq = &per_cpu(completion_queues, i);
-
-		init_llist_head(&cq->list);
-
-		if (irqmode != NULL_IRQ_TIMER)
-			continue;
-
-		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
-		cq->timer.function = null_cmd_timer_expired;
-	}
-
 	null_major = register_blkdev(0, "nullb");
 	if (null_major < 0)
 		return null_major;
@@ -16,6 +16,7 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/blk-mq.h>
+#include <linux/blk-mq-pci.h>
 #include <linux/cpu.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
@@ -109,6 +110,7 @@ struct nvme_queue {
 	s16 cq_vector;
 	u16 sq_head;
 	u16 sq_tail;
+	u16 last_sq_tail;	/* tail the doorbell was last rung with */
 	u16 cq_head;
 	u16 qid;
 	u8 cq_phase;
@@ -196,6 +198,17 @@ static int nvme_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
 	return 0;
 }
 
+/*
+ * I/O queue N completes on vector N - 1, which is also the index of its
+ * hctx, so let blk-mq submit from the cpus the vector was spread to.
+ */
+static int nvme_map_queues(struct blk_mq_tag_set *set, unsigned int *map)
+{
+	struct nvme_dev *dev = set->driver_data;
+
+	return blk_mq_pci_map_queues(set, map, dev->pci_dev);
+}
+
 static int nvme_init_request(void *data, struct request *req,
 				unsigned int hctx_idx, unsigned int rq_idx,
 				unsigned int numa_node)
@@ -326,6 +339,27 @@ static void *nvme_finish_cmd(struct nvme_queue *nvmeq, int tag,
 	return ctx;
 }
 
+/*
+ * Ring the SQ doorbell for everything up to sq_tail.  Unless @write_sq is
+ * set the write is held back, so that a batch of commands from blk-mq only
+ * costs one MMIO write; we still ring if the next command would otherwise
+ * wrap onto the slots the controller hasn't been told about.
+ */
+static inline void nvme_write_sq_db(struct nvme_queue *nvmeq, bool write_sq)
+{
+	if (!write_sq) {
+		u16 next_tail = nvmeq->sq_tail + 1;
+
+		if (next_tail == nvmeq->q_depth)
+			next_tail = 0;
+		if (next_tail != nvmeq->last_sq_tail)
+			return;
+	}
+
+	writel(nvmeq->sq_tail, nvmeq->q_db);
+	nvmeq->last_sq_tail = nvmeq->sq_tail;
+}
+
 /**
  * nvme_submit_cmd() - Copy a command into a queue and ring the doorbell
  * @nvmeq: The queue to use
@@ -340,8 +374,8 @@ static int __nvme_submit_cmd(struct nvme_queue *nvmeq, struct nvme_command *cmd)
 	memcpy(&nvmeq->sq_cmds[tail], cmd, sizeof(*cmd));
 	if (++tail == nvmeq->q_depth)
 		tail = 0;
-	writel(tail, nvmeq->q_db);
 	nvmeq->sq_tail = tail;
+	nvme_write_sq_db(nvmeq, true);
 
 	return 0;
 }
@@ -564,7 +598,6 @@ static void nvme_submit_discard(struct nvme_queue *nvmeq, struct nvme_ns *ns,
 
 	if (++nvmeq->sq_tail == nvmeq->q_depth)
 		nvmeq->sq_tail = 0;
-	writel(nvmeq->sq_tail, nvmeq->q_db);
 }
 
 static void nvme_submit_flush(struct nvme_queue *nvmeq, struct nvme_ns *ns,
@@ -579,7 +612,6 @@ static void nvme_submit_flush(struct nvme_queue *nvmeq, struct nvme_ns *ns,
 
 	if (++nvmeq->sq_tail == nvmeq->q_depth)
 		nvmeq->sq_tail = 0;
-	writel(nvmeq->sq_tail, nvmeq->q_db);
 }
 
 static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod,
@@ -613,7 +645,6 @@ static int nvme_submit_iod(struct nvme_queue *nvmeq, struct nvme_iod *iod,
 
 	if (++nvmeq->sq_tail == nvmeq->q_depth)
 		nvmeq->sq_tail = 0;
-	writel(nvmeq->sq_tail, nvmeq->q_db);
 
 	return 0;
 }
@@ -678,6 +709,7 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 		nvme_submit_flush(nvmeq, ns, req->tag);
 	else
 		nvme_submit_iod(nvmeq, iod, ns);
+	nvme_write_sq_db(nvmeq, bd->last);
 
 	nvme_process_cq(nvmeq);
 	spin_unlock_irq(&nvmeq->q_lock);
@@ -694,6 +726,7 @@ static int nvme_queue_rq(struct blk_mq_hw_ctx *hctx,
 static int nvme_process_cq(struct nvme_queue *nvmeq)
 {
 	u16 head, phase;
+	int found = 0;
 
 	head = nvmeq->cq_head;
 	phase = nvmeq->cq_phase;
@@ -711,6 +744,7 @@ static int nvme_process_cq(struct nvme_queue *nvmeq)
 		}
 		ctx = nvme_finish_cmd(nvmeq, cqe.command_id, &fn);
 		fn(nvmeq, ctx, &cqe);
+		found++;
 	}
 
 	/* If the controller ignores the cq head doorbell and continuously
@@ -727,7 +761,7 @@ static int nvme_process_cq(struct nvme_queue *nvmeq)
 	nvmeq->cq_phase = phase;
 
 	nvmeq->cqe_seen = 1;
-	return 1;
+	return found;
 }
 
 /* Admin queue isn't initialized as a request queue. If at some point this
@@ -760,6 +794,27 @@ static irqreturn_t nvme_irq_check(int irq, void *data)
 	return IRQ_WAKE_THREAD;
 }
 
+/*
+ * Reap completions for a task spinning in blk_poll().  cqe_seen is left
+ * set, so an interrupt that finds the queue already drained still counts
+ * as handled.
+ */
+static int nvme_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct nvme_queue *nvmeq = hctx->driver_data;
+	struct nvme_completion cqe = nvmeq->cqes[nvmeq->cq_head];
+	int found;
+
+	if ((le16_to_cpu(cqe.status) & 1) != nvmeq->cq_phase)
+		return 0;
+
+	spin_lock_irq(&nvmeq->q_lock);
+	found = nvme_process_cq(nvmeq);
+	spin_unlock_irq(&nvmeq->q_lock);
+
+	return found;
+}
+
 static void nvme_abort_cmd_info(struct nvme_queue *nvmeq, struct nvme_cmd_info *
 								cmd_info)
 {
@@ -1267,6 +1322,7 @@ static void nvme_init_queue(struct nvme_queue *nvmeq, u16 qid)
 
 	spin_lock_irq(&nvmeq->q_lock);
 	nvmeq->sq_tail = 0;
+	nvmeq->last_sq_tail = 0;
 	nvmeq->cq_head = 0;
 	nvmeq->cq_phase = 1;
 	nvmeq->q_db = &dev->dbs[qid * 2 * dev->db_stride];
@@ -1374,6 +1430,20 @@ static int nvme_shutdown_ctrl(struct nvme_dev *dev)
 	return 0;
 }
 
+/*
+ * blk-mq stopped short of the request it marked as last; make sure the
+ * controller sees whatever we queued without ringing the doorbell.
+ */
+static void nvme_commit_rqs(struct blk_mq_hw_ctx *hctx)
+{
+	struct nvme_queue *nvmeq = hctx->driver_data;
+
+	spin_lock_irq(&nvmeq->q_lock);
+	if (nvmeq->sq_tail != nvmeq->last_sq_tail)
+		nvme_write_sq_db(nvmeq, true);
+	spin_unlock_irq(&nvmeq->q_lock);
+}
+
 static struct blk_mq_ops nvme_mq_admin_ops = {
 	.queue_rq	= nvme_admin_queue_rq,
 	.map_queue	= blk_mq_map_queue,
@@ -1386,10 +1456,13 @@ static struct blk_mq_ops nvme_mq_admin_ops = {
 static struct blk_mq_ops nvme_mq_ops = {
 	.queue_rq	= nvme_queue_rq,
 	.map_queue	= blk_mq_map_queue,
+	.map_queues	= nvme_map_queues,
 	.init_hctx	= nvme_init_hctx,
 	.exit_hctx	= nvme_exit_hctx,
 	.init_request	= nvme_init_request,
 	.timeout	= nvme_timeout,
+	.poll		= nvme_poll,
+	.commit_rqs	= nvme_commit_rqs,
 };
 
 static void nvme_dev_remove_admin(struct nvme_dev *dev)
@@ -2018,6 +2091,7 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 {
 	struct nvme_queue *adminq = dev->queues[0];
 	struct pci_dev *pdev = dev->pci_dev;
+	struct irq_affinity affd = { };
 	int result, i, vecs, nr_io_queues, size;
 
 	nr_io_queues = num_possible_cpus();
@@ -2054,7 +2128,12 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 
 	for (i = 0; i < nr_io_queues; i++)
 		dev->entry[i].entry = i;
-	vecs = pci_enable_msix_range(pdev, dev->entry, 1, nr_io_queues);
+	/*
+	 * Spread the vectors over the cpus and let the irq core pin them;
+	 * the admin queue shares the first vector with the first I/O queue.
+	 */
+	vecs = pci_enable_msix_range_affinity(pdev, dev->entry, 1,
+					      nr_io_queues, &affd);
 	if (vecs < 0) {
 		vecs = pci_enable_msi_range(pdev, 1, min(nr_io_queues, 32));
 		if (vecs < 0) {
@@ -2617,6 +2696,10 @@ static void nvme_set_irq_hints(struct nvme_dev *dev)
 	struct nvme_queue *nvmeq;
 	int i;
 
+	/* Spread MSI-X vectors already have a kernel managed affinity */
+	if (pci_irq_get_affinity(dev->pci_dev, 0))
+		return;
+
 	for (i = 0; i < dev->online_queues; i++) {
 		nvmeq = dev->queues[i];
 
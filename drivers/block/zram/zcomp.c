@@ -19,6 +19,9 @@
 #ifdef CONFIG_ZRAM_LZ4_COMPRESS
 #include "zcomp_lz4.h"
 #endif
+#ifdef CONFIG_ZRAM_ZSTD_COMPRESS
+#include "zcomp_zstd.h"
+#endif
 
 /*
  * single zcomp_strm backend
@@ -47,6 +50,10 @@ static struct zcomp_backend *backends[] = {
 	&zcomp_lzo,
 #ifdef CONFIG_ZRAM_LZ4_COMPRESS
 	&zcomp_lz4,
+	&zcomp_lz4hc,
+#endif
+#ifdef CONFIG_ZRAM_ZSTD_COMPRESS
+	&zcomp_zstd,
 #endif
 	NULL
 };
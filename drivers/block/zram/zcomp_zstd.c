@@ -0,0 +1,92 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/zstd.h>
+
+#include "zcomp_zstd.h"
+
+/*
+ * Decompression runs with the slot locked and gets no stream, so it
+ * works in a per-cpu area shared by all zstd streams.
+ */
+static void __percpu *zcomp_zstd_dwrkmem;
+static int zcomp_zstd_users;
+static DEFINE_MUTEX(zcomp_zstd_lock);
+
+static void *zcomp_zstd_create(void)
+{
+	void *private;
+
+	private = vzalloc(zstd_compress_workmem_size(ZSTD_DEFAULT_CLEVEL,
+						     PAGE_SIZE));
+	if (!private)
+		return NULL;
+
+	mutex_lock(&zcomp_zstd_lock);
+	if (!zcomp_zstd_users) {
+		zcomp_zstd_dwrkmem = __alloc_percpu(ZSTD_DECOMPRESS_WORKMEM,
+						    sizeof(long));
+		if (!zcomp_zstd_dwrkmem) {
+			mutex_unlock(&zcomp_zstd_lock);
+			vfree(private);
+			return NULL;
+		}
+	}
+	zcomp_zstd_users++;
+	mutex_unlock(&zcomp_zstd_lock);
+
+	return private;
+}
+
+static void zcomp_zstd_destroy(void *private)
+{
+	vfree(private);
+
+	mutex_lock(&zcomp_zstd_lock);
+	if (!--zcomp_zstd_users) {
+		free_percpu(zcomp_zstd_dwrkmem);
+		zcomp_zstd_dwrkmem = NULL;
+	}
+	mutex_unlock(&zcomp_zstd_lock);
+}
+
+static int zcomp_zstd_compress(const unsigned char *src, unsigned char *dst,
+		size_t *dst_len, void *private)
+{
+	/* dst is two pages, always enough for zstd_compressbound(PAGE_SIZE) */
+	*dst_len = zstd_compressbound(PAGE_SIZE);
+	/* return  : Success if return 0 */
+	return zstd_compress(src, PAGE_SIZE, dst, dst_len, ZSTD_DEFAULT_CLEVEL,
+			     private);
+}
+
+static int zcomp_zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dst)
+{
+	size_t dst_len = PAGE_SIZE;
+	void *wrkmem;
+	int ret;
+
+	wrkmem = get_cpu_ptr(zcomp_zstd_dwrkmem);
+	ret = zstd_decompress(src, src_len, dst, &dst_len, wrkmem);
+	put_cpu_ptr(zcomp_zstd_dwrkmem);
+
+	/* return  : Success if return 0 */
+	return ret;
+}
+
+struct zcomp_backend zcomp_zstd = {
+	.compress = zcomp_zstd_compress,
+	.decompress = zcomp_zstd_decompress,
+	.create = zcomp_zstd_create,
+	.destroy = zcomp_zstd_destroy,
+	.name = "zstd",
+};
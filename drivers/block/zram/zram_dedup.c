@@ -0,0 +1,206 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/rbtree.h>
+
+#include "zram_drv.h"
+#include "zram_dedup.h"
+
+/*
+ * Identical compressed objects are stored once.  Objects are looked up
+ * by a checksum of their compressed data in a hash of rbtrees, and each
+ * table entry that uses one holds a reference to it.
+ */
+
+/* one hash bucket for this many pages of disk */
+#define ZRAM_HASH_PAGES_SHIFT	7
+
+static struct zram_hash *zram_hash_bucket(struct zram_meta *meta,
+					u32 checksum)
+{
+	return &meta->hash[checksum & (meta->hash_size - 1)];
+}
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	size_t i;
+
+	meta->hash_size = roundup_pow_of_two(max_t(size_t,
+				num_pages >> ZRAM_HASH_PAGES_SHIFT, 1));
+	meta->hash = vzalloc(meta->hash_size * sizeof(*meta->hash));
+	if (!meta->hash) {
+		pr_err("Error allocating zram dedup hash\n");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < meta->hash_size; i++) {
+		spin_lock_init(&meta->hash[i].lock);
+		meta->hash[i].rb_root = RB_ROOT;
+	}
+
+	return 0;
+}
+
+/*
+ * Free every object that is still referenced.  The caller destroys the
+ * pool right after, the table must not be used anymore.
+ */
+void zram_dedup_fini(struct zram_meta *meta)
+{
+	struct zram_entry *entry, *tmp;
+	size_t i;
+
+	if (!meta->hash)
+		return;
+
+	for (i = 0; i < meta->hash_size; i++) {
+		rbtree_postorder_for_each_entry_safe(entry, tmp,
+				&meta->hash[i].rb_root, rb_node) {
+			zs_free(meta->mem_pool, entry->handle);
+			kfree(entry);
+		}
+	}
+
+	vfree(meta->hash);
+	meta->hash = NULL;
+}
+
+static bool zram_entry_match(struct zram_meta *meta, struct zram_entry *entry,
+			unsigned char *mem, size_t len)
+{
+	unsigned char *cmem;
+	bool match;
+
+	if (entry->len != len)
+		return false;
+
+	cmem = zs_map_object(meta->mem_pool, entry->handle, ZS_MM_RO);
+	match = !memcmp(cmem, mem, len);
+	zs_unmap_object(meta->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Look up an object with the same @len bytes of compressed data as @mem,
+ * and take a reference on it if there is one.  The checksum of @mem is
+ * returned in @checksum for zram_dedup_insert().
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, unsigned char *mem,
+				size_t len, u32 *checksum)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_hash *hash;
+	struct zram_entry *entry;
+	struct rb_node *node, *prev;
+
+	*checksum = jhash(mem, len, 0);
+	hash = zram_hash_bucket(meta, *checksum);
+
+	spin_lock(&hash->lock);
+	node = hash->rb_root.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (*checksum < entry->checksum)
+			node = node->rb_left;
+		else if (*checksum > entry->checksum)
+			node = node->rb_right;
+		else
+			break;
+	}
+
+	/* rewind to the first of the entries with this checksum */
+	while (node && (prev = rb_prev(node)) &&
+	       rb_entry(prev, struct zram_entry, rb_node)->checksum == *checksum)
+		node = prev;
+
+	for (; node; node = rb_next(node)) {
+		entry = rb_entry(node, struct zram_entry, rb_node);
+		if (entry->checksum != *checksum)
+			break;
+		if (zram_entry_match(meta, entry, mem, len)) {
+			entry->refcount++;
+			spin_unlock(&hash->lock);
+
+			atomic64_inc(&zram->stats.dup_pages);
+			atomic64_add(len, &zram->stats.dup_data_size);
+			return entry;
+		}
+	}
+	spin_unlock(&hash->lock);
+
+	return NULL;
+}
+
+/*
+ * Make the freshly stored object @handle available for deduplication.
+ * The caller holds the only reference to the returned entry.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				size_t len, u32 checksum)
+{
+	struct zram_hash *hash = zram_hash_bucket(zram->meta, checksum);
+	struct rb_node **p, *parent = NULL;
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->handle = handle;
+	entry->len = len;
+	entry->refcount = 1;
+
+	spin_lock(&hash->lock);
+	p = &hash->rb_root.rb_node;
+	while (*p) {
+		parent = *p;
+		if (checksum < rb_entry(parent, struct zram_entry,
+					rb_node)->checksum)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, p);
+	rb_insert_color(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	return entry;
+}
+
+/*
+ * Drop a reference to @entry, freeing the object with the last one.
+ */
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zram_hash *hash = zram_hash_bucket(meta, entry->checksum);
+	int refcount;
+
+	spin_lock(&hash->lock);
+	refcount = --entry->refcount;
+	if (!refcount)
+		rb_erase(&entry->rb_node, &hash->rb_root);
+	spin_unlock(&hash->lock);
+
+	if (refcount) {
+		atomic64_dec(&zram->stats.dup_pages);
+		atomic64_sub(entry->len, &zram->stats.dup_data_size);
+		return;
+	}
+
+	zs_free(meta->mem_pool, entry->handle);
+	atomic64_sub(entry->len, &zram->stats.compr_data_size);
+	kfree(entry);
+}
@@ -0,0 +1,24 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+struct zram;
+struct zram_meta;
+struct zram_entry;
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages);
+void zram_dedup_fini(struct zram_meta *meta);
+
+struct zram_entry *zram_dedup_find(struct zram *zram, unsigned char *mem,
+				size_t len, u32 *checksum);
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+				size_t len, u32 checksum);
+void zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+#endif /* _ZRAM_DEDUP_H_ */
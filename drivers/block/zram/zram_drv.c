@@ -26,6 +26,7 @@
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
@@ -34,6 +35,7 @@
 #include <linux/err.h>
 
 #include "zram_drv.h"
+#include "zram_dedup.h"
 
 /* Globals */
 static int zram_major;
@@ -246,6 +248,107 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (int)val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	bool val;
+	struct zram *zram = dev_to_zram(dev);
+
+	if (strtobool(buf, &val))
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+	if (sysfs_streq(buf, "none"))
+		zram->recomp_algorithm[0] = 0;
+	else
+		strlcpy(zram->recomp_algorithm, buf,
+			sizeof(zram->recomp_algorithm));
+	up_write(&zram->init_lock);
+	return len;
+}
+
+static ssize_t recomp_idle_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	unsigned int val;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	val = zram->recomp_idle;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", val);
+}
+
+static ssize_t recomp_idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	unsigned int val;
+	struct zram *zram = dev_to_zram(dev);
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	down_write(&zram->init_lock);
+	zram->recomp_idle = val;
+	if (init_done(zram) && zram->recomp && val)
+		mod_delayed_work(system_unbound_wq, &zram->recomp_work,
+				 val * HZ);
+	up_write(&zram->init_lock);
+
+	return len;
+}
+#endif
+
 /* flag operations needs meta->tb_lock */
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
@@ -309,15 +412,16 @@ static inline int valid_io_request(struct zram *zram,
 
 static void zram_meta_free(struct zram_meta *meta)
 {
+	zram_dedup_fini(meta);
 	zs_destroy_pool(meta->mem_pool);
 	vfree(meta->table);
 	kfree(meta);
 }
 
-static struct zram_meta *zram_meta_alloc(u64 disksize)
+static struct zram_meta *zram_meta_alloc(u64 disksize, bool use_dedup)
 {
 	size_t num_pages;
-	struct zram_meta *meta = kmalloc(sizeof(*meta), GFP_KERNEL);
+	struct zram_meta *meta = kzalloc(sizeof(*meta), GFP_KERNEL);
 	if (!meta)
 		goto out;
 
@@ -334,8 +438,13 @@ static struct zram_meta *zram_meta_alloc(u64 disksize)
 		goto free_table;
 	}
 
+	if (use_dedup && zram_dedup_init(meta, num_pages))
+		goto free_pool;
+
 	return meta;
 
+free_pool:
+	zs_destroy_pool(meta->mem_pool);
 free_table:
 	vfree(meta->table);
 free_meta:
@@ -352,36 +461,296 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
-static int page_zero_filled(void *ptr)
+static bool page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
-			return 0;
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page) - 1; pos++) {
+		if (page[pos] != page[pos + 1])
+			return false;
 	}
 
-	return 1;
+	*element = page[pos];
+	return true;
+}
+
+static void zram_fill_page(void *ptr, unsigned long element)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	if (!element) {
+		clear_page(ptr);
+		return;
+	}
+
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = element;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+/*
+ * @offset is where @bvec starts within the zram page, the pattern is
+ * laid out relative to that page.
+ */
+static void handle_same_page(struct bio_vec *bvec, int offset,
+			     unsigned long element)
 {
 	struct page *page = bvec->bv_page;
-	void *user_mem;
+	unsigned char *pattern = (unsigned char *)&element;
+	unsigned char *user_mem;
+	unsigned int i;
 
 	user_mem = kmap_atomic(page);
-	if (is_partial_io(bvec))
+	if (!is_partial_io(bvec))
+		zram_fill_page(user_mem, element);
+	else if (!element)
 		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	else
-		clear_page(user_mem);
+	else {
+		for (i = 0; i < bvec->bv_len; i++)
+			user_mem[bvec->bv_offset + i] =
+				pattern[(offset + i) % sizeof(element)];
+	}
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
 }
 
+static unsigned long zram_get_handle(struct zram_meta *meta, u32 index)
+{
+	if (zram_test_flag(meta, index, ZRAM_DEDUP))
+		return meta->table[index].entry->handle;
+
+	return meta->table[index].handle;
+}
+
+/* needs the table index entry's bit_spinlock */
+static void zram_accessed(struct zram_meta *meta, u32 index)
+{
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	meta->table[index].ac_time = jiffies;
+#endif
+}
+
+/* the compressor the object of slot @index was made with */
+static struct zcomp *zram_slot_comp(struct zram *zram, u32 index)
+{
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram_test_flag(zram->meta, index, ZRAM_RECOMP))
+		return zram->recomp;
+#endif
+	return zram->comp;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void reset_bdev(struct zram *zram)
+{
+	struct block_device *bdev;
+
+	if (!zram->backing_dev)
+		return;
+
+	bdev = zram->bdev;
+	set_blocksize(bdev, zram->old_block_size);
+	blkdev_put(bdev, FMODE_READ|FMODE_WRITE|FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	zram->backing_dev = NULL;
+	zram->old_block_size = 0;
+	zram->bdev = NULL;
+
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	char *p;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	if (!zram->backing_dev) {
+		up_read(&zram->init_lock);
+		return scnprintf(buf, PAGE_SIZE, "none\n");
+	}
+
+	p = d_path(&zram->backing_dev->f_path, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	char *file_name;
+	size_t sz;
+	struct file *backing_dev = NULL;
+	struct inode *inode;
+	struct block_device *bdev = NULL;
+	unsigned long nr_pages, *bitmap = NULL;
+	unsigned int old_block_size;
+	struct zram *zram = dev_to_zram(dev);
+	int err;
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	sz = strlen(file_name);
+	if (sz > 0 && file_name[sz - 1] == '\n')
+		file_name[sz - 1] = 0x00;
+
+	backing_dev = filp_open(file_name, O_RDWR|O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		err = PTR_ERR(backing_dev);
+		backing_dev = NULL;
+		goto out;
+	}
+
+	inode = backing_dev->f_mapping->host;
+
+	/* Only block devices are supported for now */
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (err < 0) {
+		bdev = NULL;
+		goto out;
+	}
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	old_block_size = block_size(bdev);
+	err = set_blocksize(bdev, PAGE_SIZE);
+	if (err)
+		goto out;
+
+	reset_bdev(zram);
+
+	zram->old_block_size = old_block_size;
+	zram->bdev = bdev;
+	zram->backing_dev = backing_dev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+
+	return len;
+out:
+	vfree(bitmap);
+	if (bdev)
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	if (backing_dev)
+		filp_close(backing_dev, NULL);
+	up_write(&zram->init_lock);
+	kfree(file_name);
+
+	return err;
+}
+
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk;
+
+	do {
+		/* block 0 stands for no block */
+		blk = find_next_zero_bit(zram->bitmap, zram->nr_pages, 1);
+		if (blk >= zram->nr_pages)
+			return 0;
+	} while (test_and_set_bit(blk, zram->bitmap));
+
+	return blk;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bitmap));
+}
+
+static int zram_bdev_rw(struct zram *zram, struct page *page,
+			unsigned long blk, int rw)
+{
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_iter.bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	ret = submit_bio_wait(rw, bio);
+	bio_put(bio);
+
+	return ret;
+}
+
+static int read_from_bdev(struct zram *zram, char *mem, unsigned long blk)
+{
+	struct page *page;
+	int ret;
+
+	page = alloc_page(GFP_NOIO);
+	if (!page)
+		return -ENOMEM;
+
+	ret = zram_bdev_rw(zram, page, blk, READ);
+	if (!ret) {
+		copy_page(mem, page_address(page));
+		atomic64_inc(&zram->stats.bd_reads);
+	}
+	__free_page(page);
+
+	return ret;
+}
+#else
+static inline void reset_bdev(struct zram *zram) {};
+static inline void free_block_bdev(struct zram *zram, unsigned long blk) {};
+static inline int read_from_bdev(struct zram *zram, char *mem,
+				 unsigned long blk)
+{
+	return -EIO;
+}
+#endif
+
 
 /*
  * To protect concurrent access to the same index entry,
@@ -393,22 +762,43 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		if (!meta->table[index].element)
 			atomic64_dec(&zram->stats.zero_pages);
-		}
+		atomic64_dec(&zram->stats.same_pages);
+		meta->table[index].element = 0;
 		return;
 	}
 
-	zs_free(meta->mem_pool, handle);
+	/* a writeback or recompression in progress has to drop its copy */
+	zram_clear_flag(meta, index, ZRAM_PP_SLOT);
+	zram_clear_flag(meta, index, ZRAM_HUGE);
+	zram_clear_flag(meta, index, ZRAM_INCOMPRESSIBLE);
+	if (zram_test_flag(meta, index, ZRAM_RECOMP)) {
+		zram_clear_flag(meta, index, ZRAM_RECOMP);
+		atomic64_dec(&zram->stats.recomp_pages);
+	}
+
+	if (unlikely(!handle))
+		return;
 
-	atomic64_sub(zram_get_obj_size(meta, index),
-			&zram->stats.compr_data_size);
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		free_block_bdev(zram, handle);
+		zram_clear_flag(meta, index, ZRAM_WB);
+		atomic64_dec(&zram->stats.bd_count);
+	} else if (zram_test_flag(meta, index, ZRAM_DEDUP)) {
+		zram_dedup_put(zram, meta->table[index].entry);
+		zram_clear_flag(meta, index, ZRAM_DEDUP);
+	} else {
+		zs_free(meta->mem_pool, handle);
+		atomic64_sub(zram_get_obj_size(meta, index),
+				&zram->stats.compr_data_size);
+	}
 	atomic64_dec(&zram->stats.pages_stored);
 
 	meta->table[index].handle = 0;
@@ -424,10 +814,25 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	size_t size;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-	handle = meta->table[index].handle;
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].element;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_fill_page(mem, element);
+		return 0;
+	}
+
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		unsigned long blk = meta->table[index].handle;
+
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return read_from_bdev(zram, mem, blk);
+	}
+
+	handle = zram_get_handle(meta, index);
 	size = zram_get_obj_size(meta, index);
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
+	if (!handle) {
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 		clear_page(mem);
 		return 0;
@@ -437,7 +842,8 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	if (size == PAGE_SIZE)
 		copy_page(mem, cmem);
 	else
-		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+		ret = zcomp_decompress(zram_slot_comp(zram, index), cmem,
+				size, mem);
 	zs_unmap_object(meta->mem_pool, handle);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
@@ -460,10 +866,13 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	page = bvec->bv_page;
 
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
+	zram_accessed(meta, index);
+	if (zram_test_flag(meta, index, ZRAM_SAME) ||
+			unlikely(!meta->table[index].handle)) {
+		unsigned long element = meta->table[index].element;
+
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		handle_zero_page(bvec);
+		handle_same_page(bvec, offset, element);
 		return 0;
 	}
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
@@ -521,6 +930,9 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	int ret = 0;
 	size_t clen;
 	unsigned long handle;
+	unsigned long element;
+	struct zram_entry *entry = NULL;
+	u32 checksum = 0;
 	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
@@ -557,16 +969,20 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		if (user_mem)
 			kunmap_atomic(user_mem);
 		/* Free memory associated with this sector now. */
 		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
 		zram_free_page(zram, index);
-		zram_set_flag(meta, index, ZRAM_ZERO);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].element = element;
+		zram_accessed(meta, index);
 		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
-		atomic64_inc(&zram->stats.zero_pages);
+		if (!element)
+			atomic64_inc(&zram->stats.zero_pages);
+		atomic64_inc(&zram->stats.same_pages);
 		ret = 0;
 		goto out;
 	}
@@ -587,6 +1003,15 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		clen = PAGE_SIZE;
 		if (is_partial_io(bvec))
 			src = uncmem;
+	} else if (meta->hash) {
+		/* pages stored uncompressed are rare, don't share them */
+		entry = zram_dedup_find(zram, src, clen, &checksum);
+		if (entry) {
+			zcomp_strm_release(zram->comp, zstrm);
+			locked = false;
+			handle = entry->handle;
+			goto found_dup;
+		}
 	}
 
 	handle = zs_malloc(meta->mem_pool, clen);
@@ -620,6 +1045,17 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	locked = false;
 	zs_unmap_object(meta->mem_pool, handle);
 
+	if (meta->hash && clen != PAGE_SIZE) {
+		entry = zram_dedup_insert(zram, handle, clen, checksum);
+		if (!entry) {
+			zs_free(meta->mem_pool, handle);
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+	atomic64_add(clen, &zram->stats.compr_data_size);
+
+found_dup:
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
@@ -627,12 +1063,18 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
 	zram_free_page(zram, index);
 
-	meta->table[index].handle = handle;
+	if (entry) {
+		meta->table[index].entry = entry;
+		zram_set_flag(meta, index, ZRAM_DEDUP);
+	} else
+		meta->table[index].handle = handle;
+	if (clen == PAGE_SIZE)
+		zram_set_flag(meta, index, ZRAM_HUGE);
 	zram_set_obj_size(meta, index, clen);
+	zram_accessed(meta, index);
 	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
 
 	/* Update stats */
-	atomic64_add(clen, &zram->stats.compr_data_size);
 	atomic64_inc(&zram->stats.pages_stored);
 out:
 	if (locked)
@@ -665,6 +1107,255 @@ static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
 	return ret;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Move pages out to the backing device: with "huge", those stored
+ * uncompressed, with "idle <secs>", those not accessed for that long.
+ * Shared and same filled pages stay where they are.  The slot lock is
+ * dropped over the write, a slot freed or rewritten meanwhile loses
+ * ZRAM_PP_SLOT and the block is given back.
+ */
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, index, blk, handle;
+	unsigned int age = 0;
+	struct page *page;
+	bool huge;
+	ssize_t ret = len;
+	int err;
+
+	if (sysfs_streq(buf, "huge"))
+		huge = true;
+	else if (sscanf(buf, "idle %u", &age) == 1)
+		huge = false;
+	else
+		return -EINVAL;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (!zram->backing_dev) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!meta->table[index].handle ||
+		    zram_test_flag(meta, index, ZRAM_SAME) ||
+		    zram_test_flag(meta, index, ZRAM_DEDUP) ||
+		    zram_test_flag(meta, index, ZRAM_WB) ||
+		    zram_test_flag(meta, index, ZRAM_PP_SLOT))
+			goto next;
+		if (huge && !zram_test_flag(meta, index, ZRAM_HUGE))
+			goto next;
+		if (!huge && time_before(jiffies, meta->table[index].ac_time +
+					 (unsigned long)age * HZ))
+			goto next;
+
+		zram_set_flag(meta, index, ZRAM_PP_SLOT);
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+		err = zram_decompress_page(zram, page_address(page), index);
+		blk = err ? 0 : alloc_block_bdev(zram);
+		if (blk) {
+			err = zram_bdev_rw(zram, page, blk, WRITE);
+			if (err) {
+				free_block_bdev(zram, blk);
+				blk = 0;
+			}
+		} else if (!err)
+			err = -ENOSPC;
+
+		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		if (!zram_test_flag(meta, index, ZRAM_PP_SLOT)) {
+			/* freed or rewritten while we were at it */
+			if (blk)
+				free_block_bdev(zram, blk);
+			goto next;
+		}
+		zram_clear_flag(meta, index, ZRAM_PP_SLOT);
+
+		if (!blk) {
+			bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+			ret = err;
+			break;
+		}
+
+		handle = meta->table[index].handle;
+		zs_free(meta->mem_pool, handle);
+		atomic64_sub(zram_get_obj_size(meta, index),
+				&zram->stats.compr_data_size);
+
+		zram_clear_flag(meta, index, ZRAM_HUGE);
+		if (zram_test_flag(meta, index, ZRAM_RECOMP)) {
+			zram_clear_flag(meta, index, ZRAM_RECOMP);
+			atomic64_dec(&zram->stats.recomp_pages);
+		}
+		zram_set_flag(meta, index, ZRAM_WB);
+		zram_set_obj_size(meta, index, 0);
+		meta->table[index].handle = blk;
+
+		atomic64_inc(&zram->stats.bd_count);
+		atomic64_inc(&zram->stats.bd_writes);
+next:
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		cond_resched();
+	}
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_ZRAM_MULTI_COMP
+/*
+ * Recompress one idle slot with the secondary algorithm.  As for
+ * writeback, the slot lock is dropped while we work, and a slot freed or
+ * rewritten meanwhile loses ZRAM_PP_SLOT.  Returns -ENOMEM when the pool
+ * is full so that the pass stops.
+ */
+static int zram_recompress(struct zram *zram, u32 index, struct page *page)
+{
+	struct zram_meta *meta = zram->meta;
+	unsigned long handle, new_handle, alloced_pages;
+	struct zcomp_strm *zstrm;
+	unsigned char *cmem;
+	size_t size, clen = 0;
+	int ret;
+
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	if (!meta->table[index].handle ||
+	    zram_test_flag(meta, index, ZRAM_SAME) ||
+	    zram_test_flag(meta, index, ZRAM_DEDUP) ||
+	    zram_test_flag(meta, index, ZRAM_WB) ||
+	    zram_test_flag(meta, index, ZRAM_PP_SLOT) ||
+	    zram_test_flag(meta, index, ZRAM_RECOMP) ||
+	    zram_test_flag(meta, index, ZRAM_INCOMPRESSIBLE) ||
+	    time_before(jiffies, meta->table[index].ac_time +
+			(unsigned long)zram->recomp_idle * HZ)) {
+		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		return 0;
+	}
+	size = zram_get_obj_size(meta, index);
+	zram_set_flag(meta, index, ZRAM_PP_SLOT);
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+
+	new_handle = 0;
+	ret = zram_decompress_page(zram, page_address(page), index);
+	if (ret)
+		goto out;
+
+	zstrm = zcomp_strm_find(zram->recomp);
+	ret = zcomp_compress(zram->recomp, zstrm, page_address(page), &clen);
+	if (ret || clen >= size || clen > max_zpage_size) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		goto out;
+	}
+
+	new_handle = zs_malloc(meta->mem_pool, clen);
+	if (!new_handle) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	alloced_pages = zs_get_total_pages(meta->mem_pool);
+	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		zs_free(meta->mem_pool, new_handle);
+		new_handle = 0;
+		ret = -ENOMEM;
+		goto out;
+	}
+	update_used_max(zram, alloced_pages);
+
+	cmem = zs_map_object(meta->mem_pool, new_handle, ZS_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zs_unmap_object(meta->mem_pool, new_handle);
+	zcomp_strm_release(zram->recomp, zstrm);
+out:
+	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	if (!zram_test_flag(meta, index, ZRAM_PP_SLOT)) {
+		/* freed or rewritten while we were at it */
+		if (new_handle)
+			zs_free(meta->mem_pool, new_handle);
+		goto unlock;
+	}
+	zram_clear_flag(meta, index, ZRAM_PP_SLOT);
+
+	if (!new_handle) {
+		/* don't try this one again until it is rewritten */
+		if (!ret)
+			zram_set_flag(meta, index, ZRAM_INCOMPRESSIBLE);
+		goto unlock;
+	}
+
+	handle = meta->table[index].handle;
+	zs_free(meta->mem_pool, handle);
+	atomic64_sub(size, &zram->stats.compr_data_size);
+	atomic64_add(clen, &zram->stats.compr_data_size);
+
+	zram_clear_flag(meta, index, ZRAM_HUGE);
+	zram_set_flag(meta, index, ZRAM_RECOMP);
+	zram_set_obj_size(meta, index, clen);
+	meta->table[index].handle = new_handle;
+	atomic64_inc(&zram->stats.recomp_pages);
+unlock:
+	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	return ret == -ENOMEM ? ret : 0;
+}
+
+/*
+ * Background pass over the device, rerun every recomp_idle seconds.
+ * Writes keep going through the primary algorithm, so the fault path
+ * never pays for the slower one.
+ */
+static void zram_recomp_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(to_delayed_work(work),
+					 struct zram, recomp_work);
+	unsigned long nr_pages, index;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp || !zram->recomp_idle)
+		goto out;
+
+	if (page) {
+		nr_pages = zram->disksize >> PAGE_SHIFT;
+		for (index = 0; index < nr_pages; index++) {
+			if (zram_recompress(zram, index, page))
+				break;
+			cond_resched();
+		}
+	}
+
+	queue_delayed_work(system_unbound_wq, &zram->recomp_work,
+			   zram->recomp_idle * HZ);
+out:
+	up_read(&zram->init_lock);
+	if (page)
+		__free_page(page);
+}
+#endif
+
 /*
  * zram_bio_discard - handler on discard request
  * @index: physical block index in PAGE_SIZE units
@@ -709,6 +1400,10 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	size_t index;
 	struct zram_meta *meta;
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	/* the pass takes init_lock, stop it before we do */
+	cancel_delayed_work_sync(&zram->recomp_work);
+#endif
 	down_write(&zram->init_lock);
 
 	zram->limit_pages = 0;
@@ -722,7 +1417,10 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		unsigned long handle = meta->table[index].handle;
-		if (!handle)
+		/* shared objects are freed by zram_meta_free() */
+		if (!handle || zram_test_flag(meta, index, ZRAM_SAME) ||
+		    zram_test_flag(meta, index, ZRAM_DEDUP) ||
+		    zram_test_flag(meta, index, ZRAM_WB))
 			continue;
 
 		zs_free(meta->mem_pool, handle);
@@ -730,9 +1428,15 @@ static void zram_reset_device(struct zram *zram, bool reset_capacity)
 
 	zcomp_destroy(zram->comp);
 	zram->max_comp_streams = 1;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram->recomp)
+		zcomp_destroy(zram->recomp);
+	zram->recomp = NULL;
+#endif
 
 	zram_meta_free(zram->meta);
 	zram->meta = NULL;
+	reset_bdev(zram);
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -755,7 +1459,7 @@ static ssize_t disksize_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	u64 disksize;
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp = NULL;
 	struct zram_meta *meta;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
@@ -765,7 +1469,7 @@ static ssize_t disksize_store(struct device *dev,
 		return -EINVAL;
 
 	disksize = PAGE_ALIGN(disksize);
-	meta = zram_meta_alloc(disksize);
+	meta = zram_meta_alloc(disksize, zram->use_dedup);
 	if (!meta)
 		return -ENOMEM;
 
@@ -777,6 +1481,19 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	if (zram->recomp_algorithm[0]) {
+		recomp = zcomp_create(zram->recomp_algorithm, 1);
+		if (IS_ERR(recomp)) {
+			pr_info("Cannot initialise %s compressing backend\n",
+					zram->recomp_algorithm);
+			err = PTR_ERR(recomp);
+			recomp = NULL;
+			goto out_destroy_comp_unlocked;
+		}
+	}
+#endif
+
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		pr_info("Cannot change disksize for initialized device\n");
@@ -788,6 +1505,12 @@ static ssize_t disksize_store(struct device *dev,
 	zram->comp = comp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	zram->recomp = recomp;
+	if (recomp && zram->recomp_idle)
+		queue_delayed_work(system_unbound_wq, &zram->recomp_work,
+				   zram->recomp_idle * HZ);
+#endif
 	up_write(&zram->init_lock);
 
 	/*
@@ -801,6 +1524,9 @@ static ssize_t disksize_store(struct device *dev,
 
 out_destroy_comp:
 	up_write(&zram->init_lock);
+out_destroy_comp_unlocked:
+	if (recomp)
+		zcomp_destroy(recomp);
 	zcomp_destroy(comp);
 out_free_meta:
 	zram_meta_free(meta);
@@ -1002,6 +1728,15 @@ static DEVICE_ATTR_RW(mem_limit);
 static DEVICE_ATTR_RW(mem_used_max);
 static DEVICE_ATTR_RW(max_comp_streams);
 static DEVICE_ATTR_RW(comp_algorithm);
+static DEVICE_ATTR_RW(use_dedup);
+#ifdef CONFIG_ZRAM_WRITEBACK
+static DEVICE_ATTR_RW(backing_dev);
+static DEVICE_ATTR_WO(writeback);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+static DEVICE_ATTR_RW(recomp_algorithm);
+static DEVICE_ATTR_RW(recomp_idle);
+#endif
 
 ZRAM_ATTR_RO(num_reads);
 ZRAM_ATTR_RO(num_writes);
@@ -1010,6 +1745,17 @@ ZRAM_ATTR_RO(failed_writes);
 ZRAM_ATTR_RO(invalid_io);
 ZRAM_ATTR_RO(notify_free);
 ZRAM_ATTR_RO(zero_pages);
+ZRAM_ATTR_RO(same_pages);
+ZRAM_ATTR_RO(dup_pages);
+ZRAM_ATTR_RO(dup_data_size);
+#ifdef CONFIG_ZRAM_WRITEBACK
+ZRAM_ATTR_RO(bd_count);
+ZRAM_ATTR_RO(bd_reads);
+ZRAM_ATTR_RO(bd_writes);
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+ZRAM_ATTR_RO(recomp_pages);
+#endif
 ZRAM_ATTR_RO(compr_data_size);
 
 static struct attribute *zram_disk_attrs[] = {
@@ -1023,6 +1769,9 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_invalid_io.attr,
 	&dev_attr_notify_free.attr,
 	&dev_attr_zero_pages.attr,
+	&dev_attr_same_pages.attr,
+	&dev_attr_dup_pages.attr,
+	&dev_attr_dup_data_size.attr,
 	&dev_attr_orig_data_size.attr,
 	&dev_attr_compr_data_size.attr,
 	&dev_attr_mem_used_total.attr,
@@ -1030,6 +1779,19 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_use_dedup.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_count.attr,
+	&dev_attr_bd_reads.attr,
+	&dev_attr_bd_writes.attr,
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recomp_idle.attr,
+	&dev_attr_recomp_pages.attr,
+#endif
 	NULL,
 };
 
@@ -1109,6 +1871,9 @@ static int create_device(struct zram *zram, int device_id)
 	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 	zram->meta = NULL;
 	zram->max_comp_streams = 1;
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	INIT_DELAYED_WORK(&zram->recomp_work, zram_recomp_work);
+#endif
 	return 0;
 
 out_free_disk:
@@ -16,7 +16,9 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/spinlock.h>
+#include <linux/rbtree.h>
 #include <linux/zsmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zcomp.h"
 
@@ -65,19 +67,46 @@ static const size_t max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO = ZRAM_FLAG_SHIFT,
+	/* Page is filled with one value, kept in table.element */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_DEDUP,	/* object is shared, see table.entry */
+	ZRAM_HUGE,	/* page is stored uncompressed */
+	ZRAM_WB,	/* page is on the backing device, handle is the block */
+	ZRAM_PP_SLOT,	/* page is being written back or recompressed */
+	ZRAM_RECOMP,	/* page is compressed with the secondary algorithm */
+	ZRAM_INCOMPRESSIBLE,	/* recompression did not make it smaller */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* A compressed object shared by identical pages */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 checksum;
+	int refcount;		/* protected by the zram_hash lock */
+	unsigned long handle;
+	size_t len;
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct rb_root rb_root;
+};
+
 /* Allocated for each disk page */
 struct zram_table_entry {
-	unsigned long handle;
+	union {
+		unsigned long handle;
+		unsigned long element;		/* ZRAM_SAME */
+		struct zram_entry *entry;	/* ZRAM_DEDUP */
+	};
 	unsigned long value;
+#ifdef CONFIG_ZRAM_TRACK_ENTRY_ACTIME
+	unsigned long ac_time;		/* jiffies of the last access */
+#endif
 };
 
 struct zram_stats {
@@ -89,6 +118,13 @@ struct zram_stats {
 	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
 	atomic64_t notify_free;	/* no. of swap slot free notifications */
 	atomic64_t zero_pages;		/* no. of zero filled pages */
+	atomic64_t same_pages;		/* no. of same element filled pages */
+	atomic64_t dup_pages;		/* no. of pages sharing an object */
+	atomic64_t dup_data_size;	/* compressed size saved by sharing */
+	atomic64_t bd_count;		/* no. of pages on the backing device */
+	atomic64_t bd_reads;		/* no. of reads from the backing device */
+	atomic64_t bd_writes;		/* no. of writes to the backing device */
+	atomic64_t recomp_pages;	/* no. of pages recompressed */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 };
@@ -96,6 +132,8 @@ struct zram_stats {
 struct zram_meta {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
+	struct zram_hash *hash;		/* NULL without dedup */
+	size_t hash_size;
 };
 
 struct zram {
@@ -118,6 +156,20 @@ struct zram {
 	 */
 	unsigned long limit_pages;
 
+	bool use_dedup;
 	char compressor[10];
+#ifdef CONFIG_ZRAM_WRITEBACK
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned int old_block_size;
+	unsigned long *bitmap;		/* blocks in use, block 0 is never used */
+	unsigned long nr_pages;
+#endif
+#ifdef CONFIG_ZRAM_MULTI_COMP
+	struct zcomp *recomp;
+	char recomp_algorithm[10];	/* empty for none */
+	unsigned int recomp_idle;	/* seconds, 0 disables recompression */
+	struct delayed_work recomp_work;
+#endif
 };
 #endif
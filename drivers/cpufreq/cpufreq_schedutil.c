@@ -0,0 +1,426 @@
+/*
+ *  drivers/cpufreq/cpufreq_schedutil.c
+ *
+ *  CPUFreq governor driven by scheduler utilization data.
+ *
+ *  Instead of sampling load from a timer, the scheduler reports the
+ *  utilization of each CPU when tasks are enqueued and on ticks, and the
+ *  frequency is chosen from it straight away.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/cpufreq.h>
+#include <linux/init.h>
+#include <linux/irq_work.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+/* Minimum time between two frequency changes of a policy */
+#define SUGOV_DEFAULT_RATE_LIMIT_US	(10 * USEC_PER_MSEC)
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+
+	raw_spinlock_t update_lock;	/* For shared policies */
+	u64 last_freq_update_time;
+	s64 freq_update_delay_ns;
+	unsigned int next_freq;
+
+	/* The frequency change itself may sleep, so it is done from a work */
+	struct irq_work irq_work;
+	struct work_struct work;
+	struct mutex work_lock;
+	bool work_in_progress;
+
+	bool need_freq_update;
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+
+	/* The most recent utilization reported for this CPU */
+	unsigned long util;
+	unsigned long max;
+	u64 last_update;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+static unsigned int sugov_rate_limit_us = SUGOV_DEFAULT_RATE_LIMIT_US;
+static DEFINE_MUTEX(global_tunables_lock);
+static int global_tunables_users;
+
+/************************ Governor internals ***********************/
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	s64 delta_ns;
+
+	if (sg_policy->work_in_progress)
+		return false;
+
+	if (unlikely(sg_policy->need_freq_update)) {
+		sg_policy->need_freq_update = false;
+		return true;
+	}
+
+	delta_ns = time - sg_policy->last_freq_update_time;
+	return delta_ns >= sg_policy->freq_update_delay_ns;
+}
+
+static void sugov_update_commit(struct sugov_policy *sg_policy, u64 time,
+				unsigned int next_freq)
+{
+	sg_policy->last_freq_update_time = time;
+
+	if (sg_policy->next_freq == next_freq)
+		return;
+
+	sg_policy->next_freq = next_freq;
+	sg_policy->work_in_progress = true;
+	irq_work_queue(&sg_policy->irq_work);
+}
+
+/**
+ * get_next_freq - Compute a new frequency for a given cpufreq policy.
+ * @policy: cpufreq policy object to compute the new frequency for.
+ * @util: Current CPU utilization.
+ * @max: CPU capacity.
+ *
+ * The frequency is proportional to the utilization with a 25% margin, so
+ * that a CPU running at 80% of the current frequency is sped up:
+ *
+ * next_freq = 1.25 * max_freq * util / max
+ *
+ * ULONG_MAX utilization, reported for realtime tasks, selects the highest
+ * frequency allowed by the policy.
+ */
+static unsigned int get_next_freq(struct cpufreq_policy *policy,
+				  unsigned long util, unsigned long max)
+{
+	unsigned int freq = policy->cpuinfo.max_freq;
+
+	if (util != ULONG_MAX)
+		freq = div64_u64((u64)(freq + (freq >> 2)) * util, max);
+
+	return clamp_val(freq, policy->min, policy->max);
+}
+
+static void sugov_update_single(struct update_util_data *hook, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+
+	if (!sugov_should_update_freq(sg_policy, time))
+		return;
+
+	sugov_update_commit(sg_policy, time,
+			    get_next_freq(sg_policy->policy, util, max));
+}
+
+/*
+ * The CPUs of a shared policy run at the frequency needed by the busiest of
+ * them. Utilization reported more than two ticks ago is stale, as the CPU
+ * has been idle since.
+ */
+static unsigned int sugov_next_freq_shared(struct sugov_policy *sg_policy,
+					   u64 time, unsigned long util,
+					   unsigned long max)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int j;
+
+	if (util == ULONG_MAX)
+		return get_next_freq(policy, util, max);
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+		unsigned long j_util, j_max;
+		s64 delta_ns;
+
+		if (j == smp_processor_id())
+			continue;
+
+		delta_ns = time - j_sg_cpu->last_update;
+		if (delta_ns > 2 * TICK_NSEC)
+			continue;
+
+		j_util = j_sg_cpu->util;
+		if (j_util == ULONG_MAX)
+			return policy->max;
+
+		j_max = j_sg_cpu->max;
+		if (j_util * max > j_max * util) {
+			util = j_util;
+			max = j_max;
+		}
+	}
+
+	return get_next_freq(policy, util, max);
+}
+
+static void sugov_update_shared(struct update_util_data *hook, u64 time,
+				unsigned long util, unsigned long max)
+{
+	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	unsigned int next_f;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sg_cpu->util = util;
+	sg_cpu->max = max;
+	sg_cpu->last_update = time;
+
+	if (sugov_should_update_freq(sg_policy, time)) {
+		next_f = sugov_next_freq_shared(sg_policy, time, util, max);
+		sugov_update_commit(sg_policy, time, next_f);
+	}
+
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_work(struct work_struct *work)
+{
+	struct sugov_policy *sg_policy = container_of(work, struct sugov_policy,
+						      work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy;
+
+	sg_policy = container_of(irq_work, struct sugov_policy, irq_work);
+	schedule_work_on(smp_processor_id(), &sg_policy->work);
+}
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sugov_rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *kobj, struct attribute *attr,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+
+	if (kstrtouint(buf, 10, &input))
+		return -EINVAL;
+
+	/* Policies pick up the new value when they are next started */
+	sugov_rate_limit_us = input;
+	return count;
+}
+
+define_one_global_rw(rate_limit_us);
+
+static struct attribute *sugov_attributes[] = {
+	&rate_limit_us.attr,
+	NULL
+};
+
+static struct attribute_group sugov_attr_group = {
+	.attrs = sugov_attributes,
+	.name = "schedutil",
+};
+
+static int sugov_tunables_get(void)
+{
+	int ret = 0;
+
+	mutex_lock(&global_tunables_lock);
+	if (!global_tunables_users) {
+		ret = cpufreq_get_global_kobject();
+		if (ret)
+			goto out;
+		ret = sysfs_create_group(cpufreq_global_kobject,
+					 &sugov_attr_group);
+		if (ret) {
+			cpufreq_put_global_kobject();
+			goto out;
+		}
+	}
+	global_tunables_users++;
+out:
+	mutex_unlock(&global_tunables_lock);
+	return ret;
+}
+
+static void sugov_tunables_put(void)
+{
+	mutex_lock(&global_tunables_lock);
+	if (!--global_tunables_users) {
+		sysfs_remove_group(cpufreq_global_kobject, &sugov_attr_group);
+		cpufreq_put_global_kobject();
+	}
+	mutex_unlock(&global_tunables_lock);
+}
+
+/********************** cpufreq governor interface *********************/
+
+static int sugov_init(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy;
+	int ret;
+
+	if (policy->governor_data)
+		return -EBUSY;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	ret = sugov_tunables_get();
+	if (ret) {
+		kfree(sg_policy);
+		return ret;
+	}
+
+	sg_policy->policy = policy;
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	INIT_WORK(&sg_policy->work, sugov_work);
+	mutex_init(&sg_policy->work_lock);
+	raw_spin_lock_init(&sg_policy->update_lock);
+
+	policy->governor_data = sg_policy;
+	return 0;
+}
+
+static int sugov_exit(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	policy->governor_data = NULL;
+	mutex_destroy(&sg_policy->work_lock);
+	kfree(sg_policy);
+	sugov_tunables_put();
+	return 0;
+}
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	unsigned int cpu;
+
+	sg_policy->freq_update_delay_ns = (s64)sugov_rate_limit_us * NSEC_PER_USEC;
+	sg_policy->last_freq_update_time = 0;
+	sg_policy->next_freq = UINT_MAX;
+	sg_policy->work_in_progress = false;
+	sg_policy->need_freq_update = false;
+
+	for_each_cpu(cpu, policy->cpus) {
+		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, cpu);
+
+		sg_cpu->sg_policy = sg_policy;
+		if (cpumask_weight(policy->cpus) > 1) {
+			sg_cpu->util = 0;
+			sg_cpu->max = 0;
+			sg_cpu->last_update = 0;
+			sg_cpu->update_util.func = sugov_update_shared;
+		} else {
+			sg_cpu->update_util.func = sugov_update_single;
+		}
+		cpufreq_set_update_util_data(cpu, &sg_cpu->update_util);
+	}
+	return 0;
+}
+
+static int sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+	unsigned int cpu;
+
+	for_each_cpu(cpu, policy->cpus)
+		cpufreq_set_update_util_data(cpu, NULL);
+
+	synchronize_sched();
+
+	irq_work_sync(&sg_policy->irq_work);
+	cancel_work_sync(&sg_policy->work);
+	return 0;
+}
+
+static int sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = policy->governor_data;
+
+	mutex_lock(&sg_policy->work_lock);
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max,
+					CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min,
+					CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->need_freq_update = true;
+	return 0;
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	switch (event) {
+	case CPUFREQ_GOV_POLICY_INIT:
+		return sugov_init(policy);
+	case CPUFREQ_GOV_POLICY_EXIT:
+		return sugov_exit(policy);
+	case CPUFREQ_GOV_START:
+		return sugov_start(policy);
+	case CPUFREQ_GOV_STOP:
+		return sugov_stop(policy);
+	case CPUFREQ_GOV_LIMITS:
+		return sugov_limits(policy);
+	default:
+		return 0;
+	}
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name		= "schedutil",
+	.governor	= cpufreq_governor_schedutil,
+	.owner		= THIS_MODULE,
+};
+
+static int __init cpufreq_gov_schedutil_init(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+
+MODULE_DESCRIPTION("CPUfreq policy governor 'schedutil'");
+MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+fs_initcall(cpufreq_gov_schedutil_init);
+#else
+module_init(cpufreq_gov_schedutil_init);
+#endif
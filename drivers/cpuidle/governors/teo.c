@@ -0,0 +1,340 @@
+/*
+ * teo.c - the timer events oriented idle governor
+ *
+ * This code is licenced under the GPL version 2 as described
+ * in the COPYING file that acompanies the Linux Kernel.
+ */
+
+#include <linux/kernel.h>
+#include <linux/cpuidle.h>
+#include <linux/pm_qos.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/sched.h>
+#include <linux/module.h>
+
+/*
+ * Concepts and ideas behind the TEO governor
+ *
+ * On a tickless system the next timer event is known at idle entry, and
+ * on a mostly idle machine it is what ends most idle periods.  So rather
+ * than scaling the timer distance by a correction factor the way menu
+ * does, TEO takes the idle state whose target residency matches the time
+ * till the next timer ("the sleep length") as its first candidate and
+ * only looks at history to decide whether something else is likely to
+ * wake the CPU up earlier.
+ *
+ * For every idle state it keeps three decaying metrics, updated after
+ * each wakeup for the state matching the sleep length at selection
+ * time:
+ *
+ * hits:	the CPU stayed idle long enough to match that state as well,
+ *		i.e. the sleep length was a good predictor;
+ * misses:	something woke the CPU up earlier than that;
+ * early_hits:	charged to the shallower state whose residency window the
+ *		early wakeup actually fell into.
+ *
+ * At selection time, if the candidate state has collected more hits than
+ * misses, it is used.  Otherwise the shallower state with the most early
+ * hits is used instead, as that is where early wakeups most often land.
+ *
+ * On top of that the last INTERVALS idle durations ending in non-timer
+ * wakeups are remembered; if most of them are shorter than the selected
+ * state's target residency, their average is used to pick a shallower
+ * state, which catches periodic device interrupts.
+ *
+ * Like menu, the exit latency is capped by the PM QoS latency request.
+ */
+
+/*
+ * The PULSE value is added to metrics when they grow and the DECAY_SHIFT
+ * value is used for decreasing metrics on a regular basis.
+ */
+#define PULSE		1024
+#define DECAY_SHIFT	3
+
+/*
+ * Number of the most recent idle duration values to take into
+ * consideration for the detection of wakeup patterns.
+ */
+#define INTERVALS	8
+
+struct teo_idle_state {
+	unsigned int	early_hits;
+	unsigned int	hits;
+	unsigned int	misses;
+};
+
+struct teo_device {
+	int		last_state_idx;
+	int		needs_update;
+
+	u64		time_span_ns;
+	unsigned int	sleep_length_us;
+	struct teo_idle_state states[CPUIDLE_STATE_MAX];
+	unsigned int	intervals[INTERVALS];
+	int		interval_idx;
+};
+
+static DEFINE_PER_CPU(struct teo_device, teo_devices);
+
+/**
+ * teo_update - update the metrics after a wakeup
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static void teo_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_device *data = this_cpu_ptr(&teo_devices);
+	unsigned int sleep_length_us = data->sleep_length_us;
+	unsigned int measured_us, lat;
+	int i, idx_hit = -1, idx_timer = -1;
+
+	if (data->time_span_ns >= (u64)sleep_length_us * NSEC_PER_USEC) {
+		/*
+		 * The CPU slept all the way to the timer, or was woken up
+		 * close enough to it for the difference not to matter.
+		 */
+		measured_us = UINT_MAX;
+	} else {
+		lat = drv->states[data->last_state_idx].exit_latency;
+		measured_us = cpuidle_get_last_residency(dev);
+
+		/*
+		 * The exit latency is a worst case and it is not always hit,
+		 * so take half of it as a rough approximation of what was
+		 * spent waking up.
+		 */
+		if (measured_us >= lat)
+			measured_us -= lat / 2;
+		else
+			measured_us /= 2;
+	}
+
+	/*
+	 * Decay the "early hits" metric for all of the states and find the
+	 * states matching the sleep length and the measured idle duration.
+	 */
+	for (i = 0; i < drv->state_count; i++) {
+		unsigned int early_hits = data->states[i].early_hits;
+
+		data->states[i].early_hits -= early_hits >> DECAY_SHIFT;
+
+		if (drv->states[i].target_residency <= sleep_length_us) {
+			idx_timer = i;
+			if (drv->states[i].target_residency <= measured_us)
+				idx_hit = i;
+		}
+	}
+
+	/*
+	 * A wakeup in the window of the state matching the sleep length is a
+	 * hit for it; an earlier one is a miss, and an early hit for the
+	 * state it did match.
+	 */
+	if (idx_timer >= 0) {
+		unsigned int hits = data->states[idx_timer].hits;
+		unsigned int misses = data->states[idx_timer].misses;
+
+		hits -= hits >> DECAY_SHIFT;
+		misses -= misses >> DECAY_SHIFT;
+
+		if (idx_timer > idx_hit) {
+			misses += PULSE;
+			if (idx_hit >= 0)
+				data->states[idx_hit].early_hits += PULSE;
+		} else {
+			hits += PULSE;
+		}
+
+		data->states[idx_timer].misses = misses;
+		data->states[idx_timer].hits = hits;
+	}
+
+	/* timer wakeups are recorded as UINT_MAX and never match a pattern */
+	data->intervals[data->interval_idx++] = measured_us;
+	if (data->interval_idx >= INTERVALS)
+		data->interval_idx = 0;
+}
+
+/**
+ * teo_find_shallower_state - find an enabled state shallower than @idx
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ * @idx: the state to start from
+ * @duration_us: the idle duration the state has to fit into
+ */
+static int teo_find_shallower_state(struct cpuidle_driver *drv,
+				    struct cpuidle_device *dev, int idx,
+				    unsigned int duration_us)
+{
+	int i;
+
+	for (i = idx - 1; i >= CPUIDLE_DRIVER_STATE_START; i--) {
+		if (drv->states[i].disabled || dev->states_usage[i].disable)
+			continue;
+
+		idx = i;
+		if (drv->states[i].target_residency <= duration_us)
+			break;
+	}
+
+	return idx;
+}
+
+/**
+ * teo_select - selects the next idle state to enter
+ * @drv: cpuidle driver containing state data
+ * @dev: the CPU
+ */
+static int teo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct teo_device *data = this_cpu_ptr(&teo_devices);
+	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	unsigned int duration_us, hits = 0, misses = 0, early_hits = 0;
+	unsigned int count = 0, sum = 0;
+	int max_early_idx = -1, idx = -1;
+	int i;
+
+	if (data->needs_update) {
+		teo_update(drv, dev);
+		data->needs_update = 0;
+	}
+
+	data->last_state_idx = CPUIDLE_DRIVER_STATE_START - 1;
+	data->time_span_ns = local_clock();
+	data->sleep_length_us = ktime_to_us(tick_nohz_get_sleep_length());
+	duration_us = data->sleep_length_us;
+
+	/* Special case when user has set very strict latency requirement */
+	if (unlikely(latency_req == 0))
+		return 0;
+
+	/*
+	 * Find the deepest state fitting the sleep length and the latency
+	 * constraint, and on the way the shallower one early wakeups have
+	 * been landing in most often.
+	 */
+	for (i = CPUIDLE_DRIVER_STATE_START; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct teo_idle_state *st = &data->states[i];
+
+		if (s->disabled || dev->states_usage[i].disable)
+			continue;
+		if (s->target_residency > duration_us)
+			break;
+		if (s->exit_latency > latency_req)
+			break;
+
+		idx = i;
+		hits = st->hits;
+		misses = st->misses;
+
+		if (early_hits < st->early_hits) {
+			early_hits = st->early_hits;
+			max_early_idx = i;
+		}
+	}
+
+	/*
+	 * The sleep length was not a good predictor for this state in the
+	 * past, so expect the CPU to be woken up where it most often was.
+	 */
+	if (hits <= misses && max_early_idx >= 0) {
+		idx = max_early_idx;
+		duration_us = drv->states[idx].target_residency;
+	}
+
+	/*
+	 * Like menu, default to C1 (hlt) rather than polling unless the
+	 * timer is really close.
+	 */
+	if (idx < 0) {
+		if (data->sleep_length_us > 5 &&
+		    !drv->states[CPUIDLE_DRIVER_STATE_START].disabled &&
+		    !dev->states_usage[CPUIDLE_DRIVER_STATE_START].disable)
+			idx = CPUIDLE_DRIVER_STATE_START;
+		else
+			idx = CPUIDLE_DRIVER_STATE_START - 1;
+		data->last_state_idx = idx;
+		return idx;
+	}
+
+	/*
+	 * If most of the recent non-timer wakeups came sooner than the
+	 * expected idle duration, go by their average instead.
+	 */
+	for (i = 0; i < INTERVALS; i++) {
+		if (data->intervals[i] < duration_us) {
+			count++;
+			sum += data->intervals[i];
+		}
+	}
+
+	if (count > INTERVALS / 2) {
+		unsigned int avg_us = sum / count;
+
+		if (drv->states[idx].target_residency > avg_us)
+			idx = teo_find_shallower_state(drv, dev, idx, avg_us);
+	}
+
+	data->last_state_idx = idx;
+	return idx;
+}
+
+/**
+ * teo_reflect - records that data structures need update
+ * @dev: the CPU
+ * @index: the index of actual entered state
+ *
+ * NOTE: it's important to be fast here because this operation will add to
+ *       the overall exit latency.
+ */
+static void teo_reflect(struct cpuidle_device *dev, int index)
+{
+	struct teo_device *data = this_cpu_ptr(&teo_devices);
+
+	data->last_state_idx = index;
+	if (index >= 0) {
+		data->time_span_ns = local_clock() - data->time_span_ns;
+		data->needs_update = 1;
+	}
+}
+
+/**
+ * teo_enable_device - scans a CPU's states and does setup
+ * @drv: cpuidle driver
+ * @dev: the CPU
+ */
+static int teo_enable_device(struct cpuidle_driver *drv,
+			     struct cpuidle_device *dev)
+{
+	struct teo_device *data = &per_cpu(teo_devices, dev->cpu);
+	int i;
+
+	memset(data, 0, sizeof(struct teo_device));
+
+	for (i = 0; i < INTERVALS; i++)
+		data->intervals[i] = UINT_MAX;
+
+	return 0;
+}
+
+static struct cpuidle_governor teo_governor = {
+	.name =		"teo",
+	.rating =	19,
+	.enable =	teo_enable_device,
+	.select =	teo_select,
+	.reflect =	teo_reflect,
+	.owner =	THIS_MODULE,
+};
+
+/**
+ * init_teo - initializes the governor
+ */
+static int __init init_teo(void)
+{
+	return cpuidle_register_governor(&teo_governor);
+}
+
+postcore_initcall(init_teo);
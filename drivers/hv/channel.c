@@ -569,6 +569,38 @@ void vmbus_close(struct vmbus_channel *channel)
 }
 EXPORT_SYMBOL_GPL(vmbus_close);
 
+/*
+ * Signal the host after writing to the outbound ring.  The host only
+ * needs a signal when the ring goes from empty to non-empty ("signal"),
+ * but a sender with more packets to queue (!kick_q) can hold it back
+ * and have the last packet of the batch deliver it.  If the write
+ * failed, make sure the host drains what is there.
+ */
+static void vmbus_signal_outbound(struct vmbus_channel *channel, int ret,
+				  bool signal, bool kick_q)
+{
+	if (ret == 0 && !kick_q) {
+		if (signal)
+			set_bit(0, &channel->signal_deferred);
+		return;
+	}
+
+	if (test_and_clear_bit(0, &channel->signal_deferred) ||
+	    (ret == 0 && signal) || ret)
+		vmbus_setevent(channel);
+}
+
+/**
+ * vmbus_flush_signal() - Deliver a signal held back by a previous send
+ * @channel: Pointer to vmbus_channel structure.
+ */
+void vmbus_flush_signal(struct vmbus_channel *channel)
+{
+	if (test_and_clear_bit(0, &channel->signal_deferred))
+		vmbus_setevent(channel);
+}
+EXPORT_SYMBOL_GPL(vmbus_flush_signal);
+
 /**
  * vmbus_sendpacket() - Send the specified buffer on the given channel
  * @channel: Pointer to vmbus_channel structure.
@@ -586,6 +618,20 @@ EXPORT_SYMBOL_GPL(vmbus_close);
 int vmbus_sendpacket(struct vmbus_channel *channel, void *buffer,
 			   u32 bufferlen, u64 requestid,
 			   enum vmbus_packet_type type, u32 flags)
+{
+	return vmbus_sendpacket_ctl(channel, buffer, bufferlen, requestid,
+				    type, flags, true);
+}
+EXPORT_SYMBOL(vmbus_sendpacket);
+
+/**
+ * vmbus_sendpacket_ctl() - vmbus_sendpacket() with control over signalling
+ * @kick_q: false if more packets follow on this channel and the host
+ * need not be signalled yet
+ */
+int vmbus_sendpacket_ctl(struct vmbus_channel *channel, void *buffer,
+			   u32 bufferlen, u64 requestid,
+			   enum vmbus_packet_type type, u32 flags, bool kick_q)
 {
 	struct vmpacket_descriptor desc;
 	u32 packetlen = sizeof(struct vmpacket_descriptor) + bufferlen;
@@ -613,12 +659,11 @@ int vmbus_sendpacket(struct vmbus_channel *channel, void *buffer,
 
 	ret = hv_ringbuffer_write(&channel->outbound, bufferlist, 3, &signal);
 
-	if (ret == 0 && signal)
-		vmbus_setevent(channel);
+	vmbus_signal_outbound(channel, ret, signal, kick_q);
 
 	return ret;
 }
-EXPORT_SYMBOL(vmbus_sendpacket);
+EXPORT_SYMBOL(vmbus_sendpacket_ctl);
 
 /*
  * vmbus_sendpacket_pagebuffer - Send a range of single-page buffer
@@ -628,6 +673,21 @@ int vmbus_sendpacket_pagebuffer(struct vmbus_channel *channel,
 				     struct hv_page_buffer pagebuffers[],
 				     u32 pagecount, void *buffer, u32 bufferlen,
 				     u64 requestid)
+{
+	return vmbus_sendpacket_pagebuffer_ctl(channel, pagebuffers, pagecount,
+					       buffer, bufferlen, requestid,
+					       true);
+}
+EXPORT_SYMBOL_GPL(vmbus_sendpacket_pagebuffer);
+
+/*
+ * vmbus_sendpacket_pagebuffer_ctl - vmbus_sendpacket_pagebuffer() with
+ * control over signalling the host, see vmbus_sendpacket_ctl().
+ */
+int vmbus_sendpacket_pagebuffer_ctl(struct vmbus_channel *channel,
+				     struct hv_page_buffer pagebuffers[],
+				     u32 pagecount, void *buffer, u32 bufferlen,
+				     u64 requestid, bool kick_q)
 {
 	int ret;
 	int i;
@@ -676,12 +736,11 @@ int vmbus_sendpacket_pagebuffer(struct vmbus_channel *channel,
 
 	ret = hv_ringbuffer_write(&channel->outbound, bufferlist, 3, &signal);
 
-	if (ret == 0 && signal)
-		vmbus_setevent(channel);
+	vmbus_signal_outbound(channel, ret, signal, kick_q);
 
 	return ret;
 }
-EXPORT_SYMBOL_GPL(vmbus_sendpacket_pagebuffer);
+EXPORT_SYMBOL_GPL(vmbus_sendpacket_pagebuffer_ctl);
 
 /*
  * vmbus_sendpacket_multipagebuffer - Send a multi-page buffer packet
@@ -460,6 +460,7 @@ struct cache {
 
 struct gc_stat {
 	size_t			nodes;
+	size_t			nodes_pre;	/* at the start of this pass */
 	size_t			key_bytes;
 
 	size_t			nkeys;
@@ -555,6 +556,14 @@ struct cache_set {
 	/* Number of elements in btree_cache + btree_cache_freeable lists */
 	unsigned		btree_cache_used;
 
+	/*
+	 * Protects the lists above and insertion into/removal from
+	 * bucket_hash, which is otherwise read under RCU.  Nests inside
+	 * bucket_lock, so that btree node cache misses and reclaim don't
+	 * contend with bucket allocation.
+	 */
+	struct mutex		btree_cache_lock;
+
 	/*
 	 * If we need to allocate memory for a new btree node and that
 	 * allocation fails, we can cannibalize another node in the btree cache
@@ -598,6 +607,9 @@ struct cache_set {
 	struct gc_stat		gc_stats;
 	size_t			nbuckets;
 
+	/* foreground requests in flight, gc yields to them */
+	atomic_t		search_inflight;
+
 	struct task_struct	*gc_thread;
 	/* Where in the btree gc currently is */
 	struct bkey		gc_done;
@@ -655,6 +667,7 @@ struct cache_set {
 	unsigned		congested_write_threshold_us;
 
 	struct time_stats	btree_gc_time;
+	struct time_stats	btree_gc_pass_time;
 	struct time_stats	btree_split_time;
 	struct time_stats	btree_read_time;
 
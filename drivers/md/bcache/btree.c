@@ -88,6 +88,15 @@
 #define MAX_NEED_GC		64
 #define MAX_SAVE_PRIO		72
 
+/*
+ * While there is foreground IO, gc gives up the btree after every
+ * 1/MAX_GC_PASSES of the nodes (but no fewer than MIN_GC_NODES) and
+ * sleeps for GC_SLEEP_MS before resuming from gc_done.
+ */
+#define MAX_GC_PASSES		100
+#define MIN_GC_NODES		100
+#define GC_SLEEP_MS		100
+
 #define PTR_DIRTY_BIT		(((uint64_t) 1 << 36))
 
 #define PTR_HASH(c, k)							\
@@ -622,7 +631,7 @@ static int mca_reap(struct btree *b, unsigned min_order, bool flush)
 	struct closure cl;
 
 	closure_init_stack(&cl);
-	lockdep_assert_held(&b->c->bucket_lock);
+	lockdep_assert_held(&b->c->btree_cache_lock);
 
 	if (!down_write_trylock(&b->lock))
 		return -ENOMEM;
@@ -674,8 +683,8 @@ static unsigned long bch_mca_scan(struct shrinker *shrink,
 
 	/* Return -1 if we can't do anything right now */
 	if (sc->gfp_mask & __GFP_IO)
-		mutex_lock(&c->bucket_lock);
-	else if (!mutex_trylock(&c->bucket_lock))
+		mutex_lock(&c->btree_cache_lock);
+	else if (!mutex_trylock(&c->btree_cache_lock))
 		return -1;
 
 	/*
@@ -718,7 +727,7 @@ static unsigned long bch_mca_scan(struct shrinker *shrink,
 			b->accessed = 0;
 	}
 out:
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return freed;
 }
 
@@ -745,7 +754,7 @@ void bch_btree_cache_free(struct cache_set *c)
 	if (c->shrink.list.next)
 		unregister_shrinker(&c->shrink);
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 
 #ifdef CONFIG_BCACHE_DEBUG
 	if (c->verify_data)
@@ -775,7 +784,7 @@ void bch_btree_cache_free(struct cache_set *c)
 		kfree(b);
 	}
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 }
 
 int bch_btree_cache_alloc(struct cache_set *c)
@@ -892,7 +901,7 @@ static struct btree *mca_alloc(struct cache_set *c, struct btree_op *op,
 
 	BUG_ON(current->bio_list);
 
-	lockdep_assert_held(&c->bucket_lock);
+	lockdep_assert_held(&c->btree_cache_lock);
 
 	if (mca_find(c, k))
 		return NULL;
@@ -980,9 +989,9 @@ retry:
 		if (current->bio_list)
 			return ERR_PTR(-EAGAIN);
 
-		mutex_lock(&c->bucket_lock);
+		mutex_lock(&c->btree_cache_lock);
 		b = mca_alloc(c, op, k, level);
-		mutex_unlock(&c->bucket_lock);
+		mutex_unlock(&c->btree_cache_lock);
 
 		if (!b)
 			goto retry;
@@ -1027,9 +1036,9 @@ static void btree_node_prefetch(struct btree *parent, struct bkey *k)
 {
 	struct btree *b;
 
-	mutex_lock(&parent->c->bucket_lock);
+	mutex_lock(&parent->c->btree_cache_lock);
 	b = mca_alloc(parent->c, NULL, k, parent->level - 1);
-	mutex_unlock(&parent->c->bucket_lock);
+	mutex_unlock(&parent->c->btree_cache_lock);
 
 	if (!IS_ERR_OR_NULL(b)) {
 		b->parent = parent;
@@ -1057,8 +1066,10 @@ static void btree_node_free(struct btree *b)
 	cancel_delayed_work(&b->work);
 
 	mutex_lock(&b->c->bucket_lock);
+	mutex_lock(&b->c->btree_cache_lock);
 	bch_bucket_free(b->c, &b->key);
 	mca_bucket_free(b);
+	mutex_unlock(&b->c->btree_cache_lock);
 	mutex_unlock(&b->c->bucket_lock);
 }
 
@@ -1077,7 +1088,9 @@ retry:
 	bkey_put(c, &k.key);
 	SET_KEY_SIZE(&k.key, c->btree_pages * PAGE_SECTORS);
 
+	mutex_lock(&c->btree_cache_lock);
 	b = mca_alloc(c, op, &k.key, level);
+	mutex_unlock(&c->btree_cache_lock);
 	if (IS_ERR(b))
 		goto err_free;
 
@@ -1509,6 +1522,11 @@ static unsigned btree_gc_count_keys(struct btree *b)
 	return ret;
 }
 
+static size_t btree_gc_min_nodes(struct cache_set *c)
+{
+	return max_t(size_t, c->gc_stats.nodes / MAX_GC_PASSES, MIN_GC_NODES);
+}
+
 static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 			    struct closure *writes, struct gc_stat *gc)
 {
@@ -1574,6 +1592,13 @@ static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 		memmove(r + 1, r, sizeof(r[0]) * (GC_MERGE_NODES - 1));
 		r->b = NULL;
 
+		if (atomic_read(&b->c->search_inflight) &&
+		    gc->nodes >= gc->nodes_pre + btree_gc_min_nodes(b->c)) {
+			gc->nodes_pre = gc->nodes;
+			ret = -EAGAIN;
+			break;
+		}
+
 		if (need_resched()) {
 			ret = -EAGAIN;
 			break;
@@ -1739,10 +1764,16 @@ static void bch_btree_gc(struct cache_set *c)
 	btree_gc_start(c);
 
 	do {
+		uint64_t pass_time = local_clock();
+
 		ret = btree_root(gc_root, c, &op, &writes, &stats);
 		closure_sync(&writes);
+		bch_time_stats_update(&c->btree_gc_pass_time, pass_time);
+		cond_resched();
 
-		if (ret && ret != -EAGAIN)
+		if (ret == -EAGAIN && atomic_read(&c->search_inflight))
+			schedule_timeout_uninterruptible(msecs_to_jiffies(GC_SLEEP_MS));
+		else if (ret && ret != -EAGAIN)
 			pr_warn("gc failed!");
 	} while (ret);
 
@@ -2250,9 +2281,9 @@ void bch_btree_set_root(struct btree *b)
 	for (i = 0; i < KEY_PTRS(&b->key); i++)
 		BUG_ON(PTR_BUCKET(b->c, &b->key, i)->prio != BTREE_PRIO);
 
-	mutex_lock(&b->c->bucket_lock);
+	mutex_lock(&b->c->btree_cache_lock);
 	list_del_init(&b->list);
-	mutex_unlock(&b->c->bucket_lock);
+	mutex_unlock(&b->c->btree_cache_lock);
 
 	b->c->root = b;
 
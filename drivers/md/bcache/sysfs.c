@@ -51,6 +51,7 @@ read_attribute(metadata_written);
 read_attribute(active_journal_entries);
 
 sysfs_time_stats_attribute(btree_gc,	sec, ms);
+sysfs_time_stats_attribute(btree_gc_pass, ms, us);
 sysfs_time_stats_attribute(btree_split, sec, us);
 sysfs_time_stats_attribute(btree_sort,	ms,  us);
 sysfs_time_stats_attribute(btree_read,	ms,  us);
@@ -470,11 +471,11 @@ static size_t bch_cache_size(struct cache_set *c)
 	size_t ret = 0;
 	struct btree *b;
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 	list_for_each_entry(b, &c->btree_cache, list)
 		ret += 1 << (b->keys.page_order + PAGE_SHIFT);
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return ret;
 }
 
@@ -483,7 +484,7 @@ static unsigned bch_cache_max_chain(struct cache_set *c)
 	unsigned ret = 0;
 	struct hlist_head *h;
 
-	mutex_lock(&c->bucket_lock);
+	mutex_lock(&c->btree_cache_lock);
 
 	for (h = c->bucket_hash;
 	     h < c->bucket_hash + (1 << BUCKET_HASH_BITS);
@@ -497,7 +498,7 @@ static unsigned bch_cache_max_chain(struct cache_set *c)
 		ret = max(ret, i);
 	}
 
-	mutex_unlock(&c->bucket_lock);
+	mutex_unlock(&c->btree_cache_lock);
 	return ret;
 }
 
@@ -530,6 +531,7 @@ SHOW(__bch_cache_set)
 	sysfs_print(cache_available_percent,	100 - c->gc_stats.in_use);
 
 	sysfs_print_time_stats(&c->btree_gc_time,	btree_gc, sec, ms);
+	sysfs_print_time_stats(&c->btree_gc_pass_time,	btree_gc_pass, ms, us);
 	sysfs_print_time_stats(&c->btree_split_time,	btree_split, sec, us);
 	sysfs_print_time_stats(&c->sort.time,		btree_sort, ms, us);
 	sysfs_print_time_stats(&c->btree_read_time,	btree_read, ms, us);
@@ -704,6 +706,7 @@ static struct attribute *bch_cache_set_internal_files[] = {
 	&sysfs_active_journal_entries,
 
 	sysfs_time_stats_attribute_list(btree_gc, sec, ms)
+	sysfs_time_stats_attribute_list(btree_gc_pass, ms, us)
 	sysfs_time_stats_attribute_list(btree_split, sec, us)
 	sysfs_time_stats_attribute_list(btree_sort, ms, us)
 	sysfs_time_stats_attribute_list(btree_read, ms, us)
@@ -67,9 +67,19 @@
 #define LIST_DIRTY	1
 #define LIST_SIZE	2
 
+/*
+ * The buffer index is split into this many shards by block number.
+ */
+#define DM_BUFIO_SHARDS		16
+
 /*
  * Linking of buffers:
- *	All buffers are linked to cache_hash with their hash_list field.
+ *	All buffers are linked to the buffer_tree of their shard with
+ *	their node field.  The tree is protected by the shard's spinlock,
+ *	so that looking up and holding a cached buffer doesn't take the
+ *	client lock.  A buffer is only freed after it was removed from
+ *	the tree with a zero hold_count.  Everything else is protected by
+ *	c->lock, which nests outside the shard locks.
  *
  *	Clean buffers that are not being written (B_WRITING not set)
  *	are linked to lru[LIST_CLEAN] with their lru_list field.
@@ -81,7 +91,16 @@
  *	context), so some clean-not-writing buffers can be held on
  *	dirty_lru too.  They are later added to lru in the process
  *	context.
+ *
+ *	Buffers found without c->lock are not moved in the lru, they
+ *	are marked accessed instead and get a second chance when they
+ *	reach the end of the list.
  */
+struct dm_bufio_shard {
+	spinlock_t lock;
+	struct rb_root buffer_tree;
+} ____cacheline_aligned_in_smp;
+
 struct dm_bufio_client {
 	struct mutex lock;
 
@@ -104,13 +123,14 @@ struct dm_bufio_client {
 
 	unsigned minimum_buffers;
 
-	struct rb_root buffer_tree;
 	wait_queue_head_t free_buffer_wait;
 
 	int async_write_error;
 
 	struct list_head client_list;
 	struct shrinker shrinker;
+
+	struct dm_bufio_shard shards[DM_BUFIO_SHARDS];
 };
 
 /*
@@ -139,11 +159,12 @@ struct dm_buffer {
 	void *data;
 	enum data_mode data_mode;
 	unsigned char list_mode;		/* LIST_* */
-	unsigned hold_count;
+	atomic_t hold_count;
 	int read_error;
 	int write_error;
 	unsigned long state;
 	unsigned long last_accessed;
+	unsigned accessed;
 	struct dm_bufio_client *c;
 	struct list_head write_list;
 	struct bio bio;
@@ -253,11 +274,18 @@ static LIST_HEAD(dm_bufio_all_clients);
 static DEFINE_MUTEX(dm_bufio_clients_lock);
 
 /*----------------------------------------------------------------
- * A red/black tree acts as an index for all the buffers.
+ * A red/black tree per shard acts as an index for all the buffers.
+ * The shard lock must be held.
  *--------------------------------------------------------------*/
-static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
+static struct dm_bufio_shard *dm_bufio_shard(struct dm_bufio_client *c,
+					     sector_t block)
 {
-	struct rb_node *n = c->buffer_tree.rb_node;
+	return &c->shards[block & (DM_BUFIO_SHARDS - 1)];
+}
+
+static struct dm_buffer *__find(struct dm_bufio_shard *s, sector_t block)
+{
+	struct rb_node *n = s->buffer_tree.rb_node;
 	struct dm_buffer *b;
 
 	while (n) {
@@ -272,9 +300,9 @@ static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
 	return NULL;
 }
 
-static void __insert(struct dm_bufio_client *c, struct dm_buffer *b)
+static void __insert(struct dm_bufio_shard *s, struct dm_buffer *b)
 {
-	struct rb_node **new = &c->buffer_tree.rb_node, *parent = NULL;
+	struct rb_node **new = &s->buffer_tree.rb_node, *parent = NULL;
 	struct dm_buffer *found;
 
 	while (*new) {
@@ -291,12 +319,33 @@ static void __insert(struct dm_bufio_client *c, struct dm_buffer *b)
 	}
 
 	rb_link_node(&b->node, parent, new);
-	rb_insert_color(&b->node, &c->buffer_tree);
+	rb_insert_color(&b->node, &s->buffer_tree);
 }
 
-static void __remove(struct dm_bufio_client *c, struct dm_buffer *b)
+static void __remove(struct dm_bufio_shard *s, struct dm_buffer *b)
 {
-	rb_erase(&b->node, &c->buffer_tree);
+	rb_erase(&b->node, &s->buffer_tree);
+}
+
+/*
+ * Remove a buffer that nobody but the caller's @hold_count holds from the
+ * index, so that no new holds can be taken on it.  Called with c->lock
+ * held, which the caller keeps until the buffer is unlinked from the lru
+ * too.  Returns false if the buffer is held by others.
+ */
+static bool __try_claim_buffer(struct dm_buffer *b, int hold_count)
+{
+	struct dm_bufio_shard *s = dm_bufio_shard(b->c, b->block);
+	bool claimed = false;
+
+	spin_lock(&s->lock);
+	if (atomic_read(&b->hold_count) == hold_count) {
+		__remove(s, b);
+		claimed = true;
+	}
+	spin_unlock(&s->lock);
+
+	return claimed;
 }
 
 /*----------------------------------------------------------------*/
@@ -475,29 +524,47 @@ static void free_buffer(struct dm_buffer *b)
 static void __link_buffer(struct dm_buffer *b, sector_t block, int dirty)
 {
 	struct dm_bufio_client *c = b->c;
+	struct dm_bufio_shard *s = dm_bufio_shard(c, block);
 
 	c->n_buffers[dirty]++;
 	b->block = block;
 	b->list_mode = dirty;
-	list_add(&b->lru_list, &c->lru[dirty]);
-	__insert(b->c, b);
+	b->accessed = 0;
 	b->last_accessed = jiffies;
+	list_add(&b->lru_list, &c->lru[dirty]);
+
+	spin_lock(&s->lock);
+	__insert(s, b);
+	spin_unlock(&s->lock);
 }
 
 /*
- * Unlink buffer from the hash list and dirty or clean queue.
+ * Unlink buffer from the dirty or clean queue only, after it was claimed.
  */
-static void __unlink_buffer(struct dm_buffer *b)
+static void __unlink_claimed_buffer(struct dm_buffer *b)
 {
 	struct dm_bufio_client *c = b->c;
 
 	BUG_ON(!c->n_buffers[b->list_mode]);
 
 	c->n_buffers[b->list_mode]--;
-	__remove(b->c, b);
 	list_del(&b->lru_list);
 }
 
+/*
+ * Unlink buffer from the hash list and dirty or clean queue.
+ */
+static void __unlink_buffer(struct dm_buffer *b)
+{
+	struct dm_bufio_shard *s = dm_bufio_shard(b->c, b->block);
+
+	spin_lock(&s->lock);
+	__remove(s, b);
+	spin_unlock(&s->lock);
+
+	__unlink_claimed_buffer(b);
+}
+
 /*
  * Place the buffer to the head of dirty or clean LRU queue.
  */
@@ -510,6 +577,7 @@ static void __relink_lru(struct dm_buffer *b, int dirty)
 	c->n_buffers[b->list_mode]--;
 	c->n_buffers[dirty]++;
 	b->list_mode = dirty;
+	b->accessed = 0;
 	list_move(&b->lru_list, &c->lru[dirty]);
 	b->last_accessed = jiffies;
 }
@@ -724,7 +792,7 @@ static void __flush_write_list(struct list_head *write_list)
  */
 static void __make_buffer_clean(struct dm_buffer *b)
 {
-	BUG_ON(b->hold_count);
+	BUG_ON(atomic_read(&b->hold_count));
 
 	if (!b->state)	/* fast case */
 		return;
@@ -740,15 +808,21 @@ static void __make_buffer_clean(struct dm_buffer *b)
  */
 static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 {
-	struct dm_buffer *b;
+	struct dm_buffer *b, *tmp;
 
-	list_for_each_entry_reverse(b, &c->lru[LIST_CLEAN], lru_list) {
+	list_for_each_entry_safe_reverse(b, tmp, &c->lru[LIST_CLEAN], lru_list) {
 		BUG_ON(test_bit(B_WRITING, &b->state));
 		BUG_ON(test_bit(B_DIRTY, &b->state));
 
-		if (!b->hold_count) {
+		if (b->accessed) {
+			b->accessed = 0;
+			list_move(&b->lru_list, &c->lru[LIST_CLEAN]);
+			continue;
+		}
+
+		if (__try_claim_buffer(b, 0)) {
 			__make_buffer_clean(b);
-			__unlink_buffer(b);
+			__unlink_claimed_buffer(b);
 			return b;
 		}
 		dm_bufio_cond_resched();
@@ -757,9 +831,9 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 	list_for_each_entry_reverse(b, &c->lru[LIST_DIRTY], lru_list) {
 		BUG_ON(test_bit(B_READING, &b->state));
 
-		if (!b->hold_count) {
+		if (__try_claim_buffer(b, 0)) {
 			__make_buffer_clean(b);
-			__unlink_buffer(b);
+			__unlink_claimed_buffer(b);
 			return b;
 		}
 		dm_bufio_cond_resched();
@@ -772,20 +846,33 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
  * Wait until some other threads free some buffer or release hold count on
  * some buffer.
  *
- * This function is entered with c->lock held, drops it and regains it
- * before exiting.
+ * Holds are released without c->lock, so the caller has to be on the wait
+ * queue (__prepare_wait_for_free_buffer) before it looks for a buffer,
+ * or it could miss the wakeup.  __wait_for_free_buffer is entered with
+ * c->lock held, drops it and regains it before exiting.
  */
-static void __wait_for_free_buffer(struct dm_bufio_client *c)
+static void __prepare_wait_for_free_buffer(struct dm_bufio_client *c,
+					   wait_queue_t *wait)
 {
-	DECLARE_WAITQUEUE(wait, current);
-
-	add_wait_queue(&c->free_buffer_wait, &wait);
+	add_wait_queue(&c->free_buffer_wait, wait);
 	set_task_state(current, TASK_UNINTERRUPTIBLE);
+}
+
+static void __finish_wait_for_free_buffer(struct dm_bufio_client *c,
+					  wait_queue_t *wait)
+{
+	__set_task_state(current, TASK_RUNNING);
+	remove_wait_queue(&c->free_buffer_wait, wait);
+}
+
+static void __wait_for_free_buffer(struct dm_bufio_client *c,
+				   wait_queue_t *wait)
+{
 	dm_bufio_unlock(c);
 
 	io_schedule();
 
-	remove_wait_queue(&c->free_buffer_wait, &wait);
+	remove_wait_queue(&c->free_buffer_wait, wait);
 
 	dm_bufio_lock(c);
 }
@@ -806,6 +893,7 @@ enum new_flag {
 static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client *c, enum new_flag nf)
 {
 	struct dm_buffer *b;
+	DECLARE_WAITQUEUE(wait, current);
 
 	/*
 	 * dm-bufio is resistant to allocation failures (it just keeps
@@ -838,11 +926,14 @@ static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client
 			return b;
 		}
 
+		__prepare_wait_for_free_buffer(c, &wait);
 		b = __get_unclaimed_buffer(c);
-		if (b)
+		if (b) {
+			__finish_wait_for_free_buffer(c, &wait);
 			return b;
+		}
 
-		__wait_for_free_buffer(c);
+		__wait_for_free_buffer(c, &wait);
 	}
 }
 
@@ -955,6 +1046,45 @@ static void __check_watermark(struct dm_bufio_client *c,
  * Getting a buffer
  *--------------------------------------------------------------*/
 
+/*
+ * Look up a buffer and take a hold on it with only the shard lock held.
+ * Returns false if the block is not cached.  If it is, *bp is set to the
+ * held buffer, or to NULL if @nf says it must not be held.
+ */
+static bool __find_buffer(struct dm_bufio_client *c, sector_t block,
+			  enum new_flag nf, struct dm_buffer **bp)
+{
+	struct dm_bufio_shard *s = dm_bufio_shard(c, block);
+	struct dm_buffer *b;
+
+	spin_lock(&s->lock);
+	b = __find(s, block);
+	if (!b) {
+		spin_unlock(&s->lock);
+		return false;
+	}
+
+	/*
+	 * Note: it is essential that we don't wait for the buffer to be
+	 * read if dm_bufio_get function is used. Both dm_bufio_get and
+	 * dm_bufio_prefetch can be used in the driver request routine.
+	 * If the user called both dm_bufio_prefetch and dm_bufio_get on
+	 * the same buffer, it would deadlock if we waited.
+	 */
+	if (nf == NF_PREFETCH ||
+	    (nf == NF_GET && unlikely(test_bit(B_READING, &b->state))))
+		b = NULL;
+	else {
+		atomic_inc(&b->hold_count);
+		b->accessed = 1;
+		b->last_accessed = jiffies;
+	}
+	spin_unlock(&s->lock);
+
+	*bp = b;
+	return true;
+}
+
 static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 				     enum new_flag nf, int *need_submit,
 				     struct list_head *write_list)
@@ -963,8 +1093,7 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 
 	*need_submit = 0;
 
-	b = __find(c, block);
-	if (b)
+	if (__find_buffer(c, block, nf, &b))
 		goto found_buffer;
 
 	if (nf == NF_GET)
@@ -978,46 +1107,35 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 	 * We've had a period where the mutex was unlocked, so need to
 	 * recheck the hash table.
 	 */
-	b = __find(c, block);
-	if (b) {
+	if (__find_buffer(c, block, nf, &b)) {
 		__free_buffer_wake(new_b);
 		goto found_buffer;
 	}
 
 	__check_watermark(c, write_list);
 
+	/*
+	 * The buffer can be found as soon as it is linked, so it must be
+	 * fully set up before.
+	 */
 	b = new_b;
-	b->hold_count = 1;
+	atomic_set(&b->hold_count, 1);
 	b->read_error = 0;
 	b->write_error = 0;
-	__link_buffer(b, block, LIST_CLEAN);
-
-	if (nf == NF_FRESH) {
+	if (nf == NF_FRESH)
 		b->state = 0;
-		return b;
+	else {
+		b->state = 1 << B_READING;
+		*need_submit = 1;
 	}
-
-	b->state = 1 << B_READING;
-	*need_submit = 1;
+	__link_buffer(b, block, LIST_CLEAN);
 
 	return b;
 
 found_buffer:
-	if (nf == NF_PREFETCH)
-		return NULL;
-	/*
-	 * Note: it is essential that we don't wait for the buffer to be
-	 * read if dm_bufio_get function is used. Both dm_bufio_get and
-	 * dm_bufio_prefetch can be used in the driver request routine.
-	 * If the user called both dm_bufio_prefetch and dm_bufio_get on
-	 * the same buffer, it would deadlock if we waited.
-	 */
-	if (nf == NF_GET && unlikely(test_bit(B_READING, &b->state)))
-		return NULL;
-
-	b->hold_count++;
-	__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
-		     test_bit(B_WRITING, &b->state));
+	if (b)
+		__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
+			     test_bit(B_WRITING, &b->state));
 	return b;
 }
 
@@ -1054,17 +1172,27 @@ static void *new_read(struct dm_bufio_client *c, sector_t block,
 
 	LIST_HEAD(write_list);
 
-	dm_bufio_lock(c);
-	b = __bufio_new(c, block, nf, &need_submit, &write_list);
-	dm_bufio_unlock(c);
+	/*
+	 * Cached buffers are found without taking the client lock.
+	 */
+	if (__find_buffer(c, block, nf, &b)) {
+		if (!b)
+			return NULL;
+	} else if (nf == NF_GET)
+		return NULL;
+	else {
+		dm_bufio_lock(c);
+		b = __bufio_new(c, block, nf, &need_submit, &write_list);
+		dm_bufio_unlock(c);
 
-	__flush_write_list(&write_list);
+		__flush_write_list(&write_list);
 
-	if (!b)
-		return b;
+		if (!b)
+			return b;
 
-	if (need_submit)
-		submit_io(b, READ, b->block, read_endio);
+		if (need_submit)
+			submit_io(b, READ, b->block, read_endio);
+	}
 
 	wait_on_bit_io(&b->state, B_READING, TASK_UNINTERRUPTIBLE);
 
@@ -1106,22 +1234,38 @@ void *dm_bufio_new(struct dm_bufio_client *c, sector_t block,
 }
 EXPORT_SYMBOL_GPL(dm_bufio_new);
 
-void dm_bufio_prefetch(struct dm_bufio_client *c,
+/*
+ * Blocks are taken from @blocks if it is set, or counted up from @block.
+ */
+static void __prefetch(struct dm_bufio_client *c, const sector_t *blocks,
 		       sector_t block, unsigned n_blocks)
 {
 	struct blk_plug plug;
+	bool locked = false;
 
 	LIST_HEAD(write_list);
 
 	BUG_ON(dm_bufio_in_request());
 
 	blk_start_plug(&plug);
-	dm_bufio_lock(c);
 
 	for (; n_blocks--; block++) {
+		sector_t where = blocks ? *blocks++ : block;
 		int need_submit;
 		struct dm_buffer *b;
-		b = __bufio_new(c, block, NF_PREFETCH, &need_submit,
+
+		if (!locked) {
+			/*
+			 * Blocks that are cached already don't need the
+			 * client lock.
+			 */
+			if (__find_buffer(c, where, NF_PREFETCH, &b))
+				continue;
+			dm_bufio_lock(c);
+			locked = true;
+		}
+
+		b = __bufio_new(c, where, NF_PREFETCH, &need_submit,
 				&write_list);
 		if (unlikely(!list_empty(&write_list))) {
 			dm_bufio_unlock(c);
@@ -1132,53 +1276,69 @@ void dm_bufio_prefetch(struct dm_bufio_client *c,
 		}
 		if (unlikely(b != NULL)) {
 			dm_bufio_unlock(c);
+			locked = false;
 
 			if (need_submit)
 				submit_io(b, READ, b->block, read_endio);
 			dm_bufio_release(b);
 
 			dm_bufio_cond_resched();
-
-			if (!n_blocks)
-				goto flush_plug;
-			dm_bufio_lock(c);
 		}
 	}
 
-	dm_bufio_unlock(c);
+	if (locked)
+		dm_bufio_unlock(c);
 
-flush_plug:
 	blk_finish_plug(&plug);
 }
+
+void dm_bufio_prefetch(struct dm_bufio_client *c,
+		       sector_t block, unsigned n_blocks)
+{
+	__prefetch(c, NULL, block, n_blocks);
+}
 EXPORT_SYMBOL_GPL(dm_bufio_prefetch);
 
+void dm_bufio_prefetch_blocks(struct dm_bufio_client *c,
+			      const sector_t *blocks, unsigned n_blocks)
+{
+	__prefetch(c, blocks, 0, n_blocks);
+}
+EXPORT_SYMBOL_GPL(dm_bufio_prefetch_blocks);
+
 void dm_bufio_release(struct dm_buffer *b)
 {
 	struct dm_bufio_client *c = b->c;
 
-	dm_bufio_lock(c);
-
-	BUG_ON(!b->hold_count);
+	BUG_ON(!atomic_read(&b->hold_count));
 
-	b->hold_count--;
-	if (!b->hold_count) {
-		wake_up(&c->free_buffer_wait);
-
-		/*
-		 * If there were errors on the buffer, and the buffer is not
-		 * to be written, free the buffer. There is no point in caching
-		 * invalid buffer.
-		 */
-		if ((b->read_error || b->write_error) &&
-		    !test_bit(B_READING, &b->state) &&
+	/*
+	 * If there were errors on the buffer, and the buffer is not
+	 * to be written, free the buffer. There is no point in caching
+	 * invalid buffer.
+	 */
+	if (unlikely(b->read_error || b->write_error)) {
+		dm_bufio_lock(c);
+		if (!test_bit(B_READING, &b->state) &&
 		    !test_bit(B_WRITING, &b->state) &&
-		    !test_bit(B_DIRTY, &b->state)) {
-			__unlink_buffer(b);
+		    !test_bit(B_DIRTY, &b->state) &&
+		    __try_claim_buffer(b, 1)) {
+			atomic_set(&b->hold_count, 0);
+			__unlink_claimed_buffer(b);
 			__free_buffer_wake(b);
-		}
+		} else if (atomic_dec_and_test(&b->hold_count))
+			wake_up(&c->free_buffer_wait);
+		dm_bufio_unlock(c);
+		return;
 	}
 
-	dm_bufio_unlock(c);
+	/*
+	 * The barrier implied by atomic_dec_and_test pairs with the one in
+	 * __prepare_wait_for_free_buffer.
+	 */
+	if (atomic_dec_and_test(&b->hold_count) &&
+	    waitqueue_active(&c->free_buffer_wait))
+		wake_up(&c->free_buffer_wait);
 }
 EXPORT_SYMBOL_GPL(dm_bufio_release);
 
@@ -1243,12 +1403,12 @@ again:
 		if (test_bit(B_WRITING, &b->state)) {
 			if (buffers_processed < c->n_buffers[LIST_DIRTY]) {
 				dropped_lock = 1;
-				b->hold_count++;
+				atomic_inc(&b->hold_count);
 				dm_bufio_unlock(c);
 				wait_on_bit_io(&b->state, B_WRITING,
 					       TASK_UNINTERRUPTIBLE);
 				dm_bufio_lock(c);
-				b->hold_count--;
+				atomic_dec(&b->hold_count);
 			} else
 				wait_on_bit_io(&b->state, B_WRITING,
 					       TASK_UNINTERRUPTIBLE);
@@ -1327,38 +1487,43 @@ EXPORT_SYMBOL_GPL(dm_bufio_issue_flush);
 void dm_bufio_release_move(struct dm_buffer *b, sector_t new_block)
 {
 	struct dm_bufio_client *c = b->c;
+	struct dm_bufio_shard *s = dm_bufio_shard(c, new_block);
 	struct dm_buffer *new;
+	DECLARE_WAITQUEUE(wait, current);
 
 	BUG_ON(dm_bufio_in_request());
 
 	dm_bufio_lock(c);
 
 retry:
-	new = __find(c, new_block);
+	spin_lock(&s->lock);
+	new = __find(s, new_block);
+	spin_unlock(&s->lock);
 	if (new) {
-		if (new->hold_count) {
-			__wait_for_free_buffer(c);
+		__prepare_wait_for_free_buffer(c, &wait);
+		if (!__try_claim_buffer(new, 0)) {
+			__wait_for_free_buffer(c, &wait);
 			goto retry;
 		}
+		__finish_wait_for_free_buffer(c, &wait);
 
 		/*
 		 * FIXME: Is there any point waiting for a write that's going
 		 * to be overwritten in a bit?
 		 */
 		__make_buffer_clean(new);
-		__unlink_buffer(new);
+		__unlink_claimed_buffer(new);
 		__free_buffer_wake(new);
 	}
 
-	BUG_ON(!b->hold_count);
+	BUG_ON(!atomic_read(&b->hold_count));
 	BUG_ON(test_bit(B_READING, &b->state));
 
 	__write_dirty_buffer(b, NULL);
-	if (b->hold_count == 1) {
-		wait_on_bit_io(&b->state, B_WRITING,
-			       TASK_UNINTERRUPTIBLE);
+	wait_on_bit_io(&b->state, B_WRITING, TASK_UNINTERRUPTIBLE);
+	if (__try_claim_buffer(b, 1)) {
 		set_bit(B_DIRTY, &b->state);
-		__unlink_buffer(b);
+		__unlink_claimed_buffer(b);
 		__link_buffer(b, new_block, LIST_DIRTY);
 	} else {
 		sector_t old_block;
@@ -1394,13 +1559,21 @@ EXPORT_SYMBOL_GPL(dm_bufio_release_move);
  */
 void dm_bufio_forget(struct dm_bufio_client *c, sector_t block)
 {
+	struct dm_bufio_shard *s = dm_bufio_shard(c, block);
 	struct dm_buffer *b;
 
 	dm_bufio_lock(c);
 
-	b = __find(c, block);
-	if (b && likely(!b->hold_count) && likely(!b->state)) {
-		__unlink_buffer(b);
+	spin_lock(&s->lock);
+	b = __find(s, block);
+	if (b && likely(!atomic_read(&b->hold_count)) && likely(!b->state))
+		__remove(s, b);
+	else
+		b = NULL;
+	spin_unlock(&s->lock);
+
+	if (b) {
+		__unlink_claimed_buffer(b);
 		__free_buffer_wake(b);
 	}
 
@@ -1471,7 +1644,8 @@ static void drop_buffers(struct dm_bufio_client *c)
 	for (i = 0; i < LIST_SIZE; i++)
 		list_for_each_entry(b, &c->lru[i], lru_list)
 			DMERR("leaked buffer %llx, hold count %u, list %d",
-			      (unsigned long long)b->block, b->hold_count, i);
+			      (unsigned long long)b->block,
+			      atomic_read(&b->hold_count), i);
 
 	for (i = 0; i < LIST_SIZE; i++)
 		BUG_ON(!list_empty(&c->lru[i]));
@@ -1496,11 +1670,11 @@ static bool __try_evict_buffer(struct dm_buffer *b, gfp_t gfp)
 			return false;
 	}
 
-	if (b->hold_count)
+	if (!__try_claim_buffer(b, 0))
 		return false;
 
 	__make_buffer_clean(b);
-	__unlink_buffer(b);
+	__unlink_claimed_buffer(b);
 	__free_buffer_wake(b);
 
 	return true;
@@ -1587,7 +1761,10 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 		r = -ENOMEM;
 		goto bad_client;
 	}
-	c->buffer_tree = RB_ROOT;
+	for (i = 0; i < DM_BUFIO_SHARDS; i++) {
+		spin_lock_init(&c->shards[i].lock);
+		c->shards[i].buffer_tree = RB_ROOT;
+	}
 
 	c->bdev = bdev;
 	c->block_size = block_size;
@@ -1705,7 +1882,8 @@ void dm_bufio_client_destroy(struct dm_bufio_client *c)
 
 	mutex_unlock(&dm_bufio_clients_lock);
 
-	BUG_ON(!RB_EMPTY_ROOT(&c->buffer_tree));
+	for (i = 0; i < DM_BUFIO_SHARDS; i++)
+		BUG_ON(!RB_EMPTY_ROOT(&c->shards[i].buffer_tree));
 	BUG_ON(c->need_reserved_buffers);
 
 	while (!list_empty(&c->reserved_buffers)) {
@@ -1755,8 +1933,17 @@ static void __evict_old_buffers(struct dm_bufio_client *c, unsigned long age_hz)
 		if (count <= retain_target)
 			break;
 
-		if (!older_than(b, age_hz))
-			break;
+		if (!older_than(b, age_hz)) {
+			if (!b->accessed)
+				break;
+			/*
+			 * Found without the client lock since it was last
+			 * moved, the rest of the list may still be old.
+			 */
+			b->accessed = 0;
+			list_move(&b->lru_list, &c->lru[LIST_CLEAN]);
+			continue;
+		}
 
 		if (__try_evict_buffer(b, 0))
 			count--;
@@ -70,6 +70,14 @@ void *dm_bufio_new(struct dm_bufio_client *c, sector_t block,
 void dm_bufio_prefetch(struct dm_bufio_client *c,
 		       sector_t block, unsigned n_blocks);
 
+/*
+ * Like dm_bufio_prefetch, but for a list of blocks that need not be
+ * contiguous.  The reads are issued under a single plug, later
+ * dm_bufio_read calls wait for them.
+ */
+void dm_bufio_prefetch_blocks(struct dm_bufio_client *c,
+			      const sector_t *blocks, unsigned n_blocks);
+
 /*
  * Release a reference obtained with dm_bufio_{read,get,new}. The data
  * pointer and dm_buffer pointer is no longer valid after this call.
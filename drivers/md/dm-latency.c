@@ -0,0 +1,378 @@
+/*
+ * dm-latency.c
+ *
+ * This file is released under the GPL.
+ *
+ * latency path selector - choose the path expected to complete the
+ * incoming I/O soonest, judging by the completion latency each path
+ * has shown recently.
+ *
+ * Every path keeps an exponentially weighted histogram of completion
+ * latencies in log2 microsecond buckets.  The selector's percentile of
+ * that histogram, times the number of I/Os already queued on the path
+ * plus one, is the predicted service time of the incoming I/O.
+ *
+ * A path that is never chosen never gets new samples, so a path that
+ * was slow once would be shunned for good.  Paths left unused for a
+ * probe interval are therefore sent one I/O, and their old samples are
+ * aged by the idle time so that a recovered path is picked up quickly.
+ */
+
+#include "dm.h"
+#include "dm-path-selector.h"
+
+#include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/atomic.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+
+#define DM_MSG_PREFIX	"multipath latency"
+#define LAT_MIN_IO	1
+#define LAT_VERSION	"0.1.0"
+
+#define LAT_BUCKETS		24	/* up to 2^23 us */
+#define LAT_ONE			(1U << 16)	/* weight of one sample */
+#define LAT_DECAY_SHIFT		5	/* ~ the last 32 completions */
+#define LAT_DEF_PERCENTILE	90
+#define LAT_DEF_PROBE_MS	1000
+
+struct selector {
+	struct list_head valid_paths;
+	struct list_head failed_paths;
+	spinlock_t lock;		/* protects the histograms */
+	unsigned percentile;
+	unsigned probe_ms;
+	unsigned long probe_jiffies;
+};
+
+struct path_info {
+	struct list_head list;
+	struct dm_path *path;
+	unsigned repeat_count;
+	atomic_t in_flight;
+	unsigned predicted_us;
+	unsigned long last_used;
+	unsigned long last_complete;
+	unsigned hist[LAT_BUCKETS];
+};
+
+static struct selector *alloc_selector(void)
+{
+	struct selector *s = kmalloc(sizeof(*s), GFP_KERNEL);
+
+	if (s) {
+		INIT_LIST_HEAD(&s->valid_paths);
+		INIT_LIST_HEAD(&s->failed_paths);
+		spin_lock_init(&s->lock);
+	}
+
+	return s;
+}
+
+static int lat_create(struct path_selector *ps, unsigned argc, char **argv)
+{
+	struct selector *s;
+	unsigned percentile = LAT_DEF_PERCENTILE;
+	unsigned probe_ms = LAT_DEF_PROBE_MS;
+	char dummy;
+
+	/*
+	 * Arguments: [<percentile> [<probe_ms>]]
+	 *	<percentile>: Latency percentile (1-100) used to predict the
+	 *		service time of a path.  Default 90.
+	 *	<probe_ms>: Paths not used for this long get one I/O to
+	 *		refresh their latency.  Default 1000.
+	 */
+	if (argc > 2)
+		return -EINVAL;
+
+	if (argc && (sscanf(argv[0], "%u%c", &percentile, &dummy) != 1 ||
+		     !percentile || percentile > 100))
+		return -EINVAL;
+
+	if (argc == 2 && (sscanf(argv[1], "%u%c", &probe_ms, &dummy) != 1 ||
+			  !probe_ms))
+		return -EINVAL;
+
+	s = alloc_selector();
+	if (!s)
+		return -ENOMEM;
+
+	s->percentile = percentile;
+	s->probe_ms = probe_ms;
+	s->probe_jiffies = max(msecs_to_jiffies(probe_ms), 1UL);
+
+	ps->context = s;
+	return 0;
+}
+
+static void lat_free_paths(struct list_head *paths)
+{
+	struct path_info *pi, *next;
+
+	list_for_each_entry_safe(pi, next, paths, list) {
+		list_del(&pi->list);
+		kfree(pi);
+	}
+}
+
+static void lat_destroy(struct path_selector *ps)
+{
+	struct selector *s = ps->context;
+
+	lat_free_paths(&s->valid_paths);
+	lat_free_paths(&s->failed_paths);
+	kfree(s);
+	ps->context = NULL;
+}
+
+static int lat_status(struct path_selector *ps, struct dm_path *path,
+		      status_type_t type, char *result, unsigned maxlen)
+{
+	struct selector *s = ps->context;
+	unsigned sz = 0;
+	struct path_info *pi;
+
+	if (!path) {
+		if (type == STATUSTYPE_TABLE)
+			DMEMIT("2 %u %u ", s->percentile, s->probe_ms);
+		else
+			DMEMIT("0 ");
+	} else {
+		pi = path->pscontext;
+
+		switch (type) {
+		case STATUSTYPE_INFO:
+			DMEMIT("%d %u ", atomic_read(&pi->in_flight),
+			       pi->predicted_us);
+			break;
+		case STATUSTYPE_TABLE:
+			DMEMIT("%u ", pi->repeat_count);
+			break;
+		}
+	}
+
+	return sz;
+}
+
+static int lat_add_path(struct path_selector *ps, struct dm_path *path,
+			int argc, char **argv, char **error)
+{
+	struct selector *s = ps->context;
+	struct path_info *pi;
+	unsigned repeat_count = LAT_MIN_IO;
+	char dummy;
+
+	/*
+	 * Arguments: [<repeat_count>]
+	 *	<repeat_count>: The number of I/Os before switching path.
+	 *			If not given, default (LAT_MIN_IO) is used.
+	 */
+	if (argc > 1) {
+		*error = "latency ps: incorrect number of arguments";
+		return -EINVAL;
+	}
+
+	if (argc && (sscanf(argv[0], "%u%c", &repeat_count, &dummy) != 1)) {
+		*error = "latency ps: invalid repeat count";
+		return -EINVAL;
+	}
+
+	/* allocate the path */
+	pi = kzalloc(sizeof(*pi), GFP_KERNEL);
+	if (!pi) {
+		*error = "latency ps: Error allocating path context";
+		return -ENOMEM;
+	}
+
+	pi->path = path;
+	pi->repeat_count = repeat_count;
+	atomic_set(&pi->in_flight, 0);
+	/* unknown latency: cheap, so that the first I/Os measure it */
+	pi->predicted_us = 1;
+	pi->last_used = jiffies;
+	pi->last_complete = jiffies;
+
+	path->pscontext = pi;
+
+	list_add_tail(&pi->list, &s->valid_paths);
+
+	return 0;
+}
+
+static void lat_fail_path(struct path_selector *ps, struct dm_path *path)
+{
+	struct selector *s = ps->context;
+	struct path_info *pi = path->pscontext;
+
+	list_move(&pi->list, &s->failed_paths);
+}
+
+static int lat_reinstate_path(struct path_selector *ps, struct dm_path *path)
+{
+	struct selector *s = ps->context;
+	struct path_info *pi = path->pscontext;
+
+	list_move_tail(&pi->list, &s->valid_paths);
+
+	return 0;
+}
+
+/* Predicted service time of the incoming I/O on @pi, in us */
+static u64 lat_cost(struct path_info *pi)
+{
+	return (u64)ACCESS_ONCE(pi->predicted_us) *
+		(atomic_read(&pi->in_flight) + 1);
+}
+
+static struct dm_path *lat_select_path(struct path_selector *ps,
+				       unsigned *repeat_count, size_t nr_bytes)
+{
+	struct selector *s = ps->context;
+	struct path_info *pi, *best = NULL;
+	u64 cost, best_cost = 0;
+
+	if (list_empty(&s->valid_paths))
+		return NULL;
+
+	/* Change preferred (first in list) path to evenly balance. */
+	list_move_tail(s->valid_paths.next, &s->valid_paths);
+
+	list_for_each_entry(pi, &s->valid_paths, list) {
+		/* probe a path that has been left alone for too long */
+		if (time_after(jiffies, pi->last_used + s->probe_jiffies)) {
+			best = pi;
+			break;
+		}
+
+		cost = lat_cost(pi);
+		if (!best || cost < best_cost) {
+			best = pi;
+			best_cost = cost;
+		}
+	}
+
+	if (!best)
+		return NULL;
+
+	best->last_used = jiffies;
+	*repeat_count = best->repeat_count;
+
+	return best->path;
+}
+
+static int lat_start_io(struct path_selector *ps, struct dm_path *path,
+			size_t nr_bytes)
+{
+	struct path_info *pi = path->pscontext;
+
+	atomic_inc(&pi->in_flight);
+
+	return 0;
+}
+
+static unsigned lat_bucket(u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	if (!us)
+		return 0;
+
+	return min_t(unsigned, ilog2(us) + 1, LAT_BUCKETS - 1);
+}
+
+/* Bucket i holds [2^(i-1), 2^i) us; take the middle */
+static unsigned lat_bucket_us(unsigned i)
+{
+	return i ? (3U << i) >> 2 : 1;
+}
+
+/* Fold one completion into the histogram.  Called with s->lock held. */
+static void lat_account(struct selector *s, struct path_info *pi, u64 ns)
+{
+	unsigned long idle = jiffies - pi->last_complete;
+	unsigned i, shift, sum = 0, want, seen = 0;
+
+	/* age the samples by one halving per probe interval spent idle */
+	shift = min_t(unsigned long, idle / s->probe_jiffies, 31);
+	pi->last_complete = jiffies;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		pi->hist[i] >>= shift;
+		pi->hist[i] -= pi->hist[i] >> LAT_DECAY_SHIFT;
+	}
+	pi->hist[lat_bucket(ns)] += LAT_ONE >> LAT_DECAY_SHIFT;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		sum += pi->hist[i];
+
+	want = div_u64((u64)sum * s->percentile, 100);
+	for (i = 0; i < LAT_BUCKETS - 1; i++) {
+		seen += pi->hist[i];
+		if (seen >= want)
+			break;
+	}
+
+	pi->predicted_us = lat_bucket_us(i);
+}
+
+static int lat_end_io(struct path_selector *ps, struct dm_path *path,
+		      size_t nr_bytes, u64 start_time)
+{
+	struct selector *s = ps->context;
+	struct path_info *pi = path->pscontext;
+	u64 now = ktime_get_ns();
+	unsigned long flags;
+
+	spin_lock_irqsave(&s->lock, flags);
+	lat_account(s, pi, now > start_time ? now - start_time : 0);
+	spin_unlock_irqrestore(&s->lock, flags);
+
+	atomic_dec(&pi->in_flight);
+
+	return 0;
+}
+
+static struct path_selector_type lat_ps = {
+	.name		= "latency",
+	.module		= THIS_MODULE,
+	.table_args	= 1,
+	.info_args	= 2,
+	.create		= lat_create,
+	.destroy	= lat_destroy,
+	.status		= lat_status,
+	.add_path	= lat_add_path,
+	.fail_path	= lat_fail_path,
+	.reinstate_path	= lat_reinstate_path,
+	.select_path	= lat_select_path,
+	.start_io	= lat_start_io,
+	.end_io		= lat_end_io,
+};
+
+static int __init dm_lat_init(void)
+{
+	int r = dm_register_path_selector(&lat_ps);
+
+	if (r < 0)
+		DMERR("register failed %d", r);
+
+	DMINFO("version " LAT_VERSION " loaded");
+
+	return r;
+}
+
+static void __exit dm_lat_exit(void)
+{
+	int r = dm_unregister_path_selector(&lat_ps);
+
+	if (r < 0)
+		DMERR("unregister failed %d", r);
+}
+
+module_init(dm_lat_init);
+module_exit(dm_lat_exit);
+
+MODULE_DESCRIPTION(DM_NAME " latency oriented path selector");
+MODULE_LICENSE("GPL");
@@ -78,8 +78,12 @@ struct path_selector_type {
 
 	int (*start_io) (struct path_selector *ps, struct dm_path *path,
 			 size_t nr_bytes);
+	/*
+	 * start_time is the ktime_get_ns() value taken when the I/O was
+	 * mapped to the path.
+	 */
 	int (*end_io) (struct path_selector *ps, struct dm_path *path,
-		       size_t nr_bytes);
+		       size_t nr_bytes, u64 start_time);
 };
 
 /* Register a path selector */
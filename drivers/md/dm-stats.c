@@ -29,6 +29,8 @@ struct dm_stat_percpu {
 	unsigned long long io_ticks[2];
 	unsigned long long io_ticks_total;
 	unsigned long long time_in_queue;
+	/* n_histogram_entries + 1 counters for reads, then as many for writes */
+	unsigned long long *histogram;
 };
 
 struct dm_stat_shared {
@@ -44,11 +46,14 @@ struct dm_stat {
 	sector_t start;
 	sector_t end;
 	sector_t step;
+	unsigned n_histogram_entries;
+	unsigned long long *histogram_boundaries;
 	const char *program_id;
 	const char *aux_data;
 	struct rcu_head rcu_head;
 	size_t shared_alloc_size;
 	size_t percpu_alloc_size;
+	size_t histogram_alloc_size;
 	struct dm_stat_percpu *stat_percpu[NR_CPUS];
 	struct dm_stat_shared stat_shared[0];
 };
@@ -171,13 +176,28 @@ static void dm_stat_free(struct rcu_head *head)
 	int cpu;
 	struct dm_stat *s = container_of(head, struct dm_stat, rcu_head);
 
+	kfree(s->histogram_boundaries);
 	kfree(s->program_id);
 	kfree(s->aux_data);
-	for_each_possible_cpu(cpu)
+	for_each_possible_cpu(cpu) {
+		if (s->stat_percpu[cpu])
+			dm_kvfree(s->stat_percpu[cpu][0].histogram,
+				  s->histogram_alloc_size);
 		dm_kvfree(s->stat_percpu[cpu], s->percpu_alloc_size);
+	}
+	dm_kvfree(s->stat_shared[0].tmp.histogram, s->histogram_alloc_size);
 	dm_kvfree(s, s->shared_alloc_size);
 }
 
+/*
+ * Number of histogram counters of one area: a counter for each interval
+ * between the boundaries, reads and writes separately.
+ */
+static size_t dm_stat_histogram_len(struct dm_stat *s)
+{
+	return 2 * ((size_t)s->n_histogram_entries + 1);
+}
+
 static int dm_stat_in_flight(struct dm_stat_shared *shared)
 {
 	return atomic_read(&shared->in_flight[READ]) +
@@ -227,7 +247,9 @@ void dm_stats_cleanup(struct dm_stats *stats)
 }
 
 static int dm_stats_create(struct dm_stats *stats, sector_t start, sector_t end,
-			   sector_t step, const char *program_id, const char *aux_data,
+			   sector_t step, unsigned n_histogram_entries,
+			   unsigned long long *histogram_boundaries,
+			   const char *program_id, const char *aux_data,
 			   void (*suspend_callback)(struct mapped_device *),
 			   void (*resume_callback)(struct mapped_device *),
 			   struct mapped_device *md)
@@ -238,7 +260,9 @@ static int dm_stats_create(struct dm_stats *stats, sector_t start, sector_t end,
 	size_t ni;
 	size_t shared_alloc_size;
 	size_t percpu_alloc_size;
+	size_t histogram_alloc_size;
 	struct dm_stat_percpu *p;
+	unsigned long long *hi;
 	int cpu;
 	int ret_id;
 	int r;
@@ -261,7 +285,15 @@ static int dm_stats_create(struct dm_stats *stats, sector_t start, sector_t end,
 	if (percpu_alloc_size / sizeof(struct dm_stat_percpu) != n_entries)
 		return -EOVERFLOW;
 
-	if (!check_shared_memory(shared_alloc_size + num_possible_cpus() * percpu_alloc_size))
+	histogram_alloc_size = (n_histogram_entries + 1) * 2 *
+		(size_t)n_entries * sizeof(unsigned long long);
+	if (histogram_alloc_size / (n_histogram_entries + 1) / 2 !=
+	    (size_t)n_entries * sizeof(unsigned long long))
+		return -EOVERFLOW;
+
+	if (!check_shared_memory(shared_alloc_size + num_possible_cpus() * percpu_alloc_size +
+				 (n_histogram_entries ?
+				  (num_possible_cpus() + 1) * histogram_alloc_size : 0)))
 		return -ENOMEM;
 
 	s = dm_kvzalloc(shared_alloc_size, NUMA_NO_NODE);
@@ -274,6 +306,18 @@ static int dm_stats_create(struct dm_stats *stats, sector_t start, sector_t end,
 	s->step = step;
 	s->shared_alloc_size = shared_alloc_size;
 	s->percpu_alloc_size = percpu_alloc_size;
+	s->histogram_alloc_size = histogram_alloc_size;
+
+	s->n_histogram_entries = n_histogram_entries;
+	if (n_histogram_entries) {
+		s->histogram_boundaries = kmemdup(histogram_boundaries,
+						  n_histogram_entries * sizeof(unsigned long long),
+						  GFP_KERNEL);
+		if (!s->histogram_boundaries) {
+			r = -ENOMEM;
+			goto out;
+		}
+	}
 
 	s->program_id = kstrdup(program_id, GFP_KERNEL);
 	if (!s->program_id) {
@@ -291,6 +335,18 @@ static int dm_stats_create(struct dm_stats *stats, sector_t start, sector_t end,
 		atomic_set(&s->stat_shared[ni].in_flight[WRITE], 0);
 	}
 
+	if (s->n_histogram_entries) {
+		hi = dm_kvzalloc(s->histogram_alloc_size, NUMA_NO_NODE);
+		if (!hi) {
+			r = -ENOMEM;
+			goto out;
+		}
+		for (ni = 0; ni < n_entries; ni++) {
+			s->stat_shared[ni].tmp.histogram = hi;
+			hi += dm_stat_histogram_len(s);
+		}
+	}
+
 	for_each_possible_cpu(cpu) {
 		p = dm_kvzalloc(percpu_alloc_size, cpu_to_node(cpu));
 		if (!p) {
@@ -298,6 +354,17 @@ static int dm_stats_create(struct dm_stats *stats, sector_t start, sector_t end,
 			goto out;
 		}
 		s->stat_percpu[cpu] = p;
+		if (s->n_histogram_entries) {
+			hi = dm_kvzalloc(s->histogram_alloc_size, cpu_to_node(cpu));
+			if (!hi) {
+				r = -ENOMEM;
+				goto out;
+			}
+			for (ni = 0; ni < n_entries; ni++) {
+				p[ni].histogram = hi;
+				hi += dm_stat_histogram_len(s);
+			}
+		}
 	}
 
 	/*
@@ -375,9 +442,11 @@ static int dm_stats_delete(struct dm_stats *stats, int id)
 	 * vfree can't be called from RCU callback
 	 */
 	for_each_possible_cpu(cpu)
-		if (is_vmalloc_addr(s->stat_percpu))
+		if (is_vmalloc_addr(s->stat_percpu[cpu]) ||
+		    is_vmalloc_addr(s->stat_percpu[cpu][0].histogram))
 			goto do_sync_free;
-	if (is_vmalloc_addr(s)) {
+	if (is_vmalloc_addr(s) ||
+	    is_vmalloc_addr(s->stat_shared[0].tmp.histogram)) {
 do_sync_free:
 		synchronize_rcu_expedited();
 		dm_stat_free(&s->rcu_head);
@@ -398,18 +467,29 @@ static int dm_stats_list(struct dm_stats *stats, const char *program,
 	/*
 	 * Output format:
 	 *   <region_id>: <start_sector>+<length> <step> <program_id> <aux_data>
+	 *	[histogram:<boundary>,<boundary>...]
 	 */
 
 	mutex_lock(&stats->mutex);
 	list_for_each_entry(s, &stats->list, list_entry) {
 		if (!program || !strcmp(program, s->program_id)) {
 			len = s->end - s->start;
-			DMEMIT("%d: %llu+%llu %llu %s %s\n", s->id,
+			DMEMIT("%d: %llu+%llu %llu %s %s", s->id,
 				(unsigned long long)s->start,
 				(unsigned long long)len,
 				(unsigned long long)s->step,
 				s->program_id,
 				s->aux_data);
+			if (s->n_histogram_entries) {
+				unsigned i;
+				DMEMIT(" histogram:");
+				for (i = 0; i < s->n_histogram_entries; i++) {
+					if (i)
+						DMEMIT(",");
+					DMEMIT("%llu", s->histogram_boundaries[i]);
+				}
+			}
+			DMEMIT("\n");
 		}
 	}
 	mutex_unlock(&stats->mutex);
@@ -483,6 +563,19 @@ static void dm_stat_for_entry(struct dm_stat *s, size_t entry,
 		p->ios[idx] += 1;
 		p->merges[idx] += merged;
 		p->ticks[idx] += duration;
+		if (s->n_histogram_entries) {
+			unsigned lo = 0, hi = s->n_histogram_entries + 1;
+			unsigned msec = jiffies_to_msecs(duration);
+
+			while (lo + 1 < hi) {
+				unsigned mid = (lo + hi) / 2;
+				if (s->histogram_boundaries[mid - 1] > msec)
+					hi = mid;
+				else
+					lo = mid;
+			}
+			p->histogram[idx * (s->n_histogram_entries + 1) + lo]++;
+		}
 	}
 
 #if BITS_PER_LONG == 32
@@ -570,6 +663,7 @@ static void __dm_stat_init_temporary_percpu_totals(struct dm_stat_shared *shared
 						   struct dm_stat *s, size_t x)
 {
 	int cpu;
+	size_t i;
 	struct dm_stat_percpu *p;
 
 	local_irq_disable();
@@ -577,7 +671,23 @@ static void __dm_stat_init_temporary_percpu_totals(struct dm_stat_shared *shared
 	dm_stat_round(shared, p);
 	local_irq_enable();
 
-	memset(&shared->tmp, 0, sizeof(shared->tmp));
+	/* tmp.histogram points at the area's slot of the shared histogram */
+	shared->tmp.sectors[READ] = 0;
+	shared->tmp.sectors[WRITE] = 0;
+	shared->tmp.ios[READ] = 0;
+	shared->tmp.ios[WRITE] = 0;
+	shared->tmp.merges[READ] = 0;
+	shared->tmp.merges[WRITE] = 0;
+	shared->tmp.ticks[READ] = 0;
+	shared->tmp.ticks[WRITE] = 0;
+	shared->tmp.io_ticks[READ] = 0;
+	shared->tmp.io_ticks[WRITE] = 0;
+	shared->tmp.io_ticks_total = 0;
+	shared->tmp.time_in_queue = 0;
+	if (s->n_histogram_entries)
+		memset(shared->tmp.histogram, 0,
+		       dm_stat_histogram_len(s) * sizeof(unsigned long long));
+
 	for_each_possible_cpu(cpu) {
 		p = &s->stat_percpu[cpu][x];
 		shared->tmp.sectors[READ] += ACCESS_ONCE(p->sectors[READ]);
@@ -592,13 +702,16 @@ static void __dm_stat_init_temporary_percpu_totals(struct dm_stat_shared *shared
 		shared->tmp.io_ticks[WRITE] += ACCESS_ONCE(p->io_ticks[WRITE]);
 		shared->tmp.io_ticks_total += ACCESS_ONCE(p->io_ticks_total);
 		shared->tmp.time_in_queue += ACCESS_ONCE(p->time_in_queue);
+		if (s->n_histogram_entries)
+			for (i = 0; i < dm_stat_histogram_len(s); i++)
+				shared->tmp.histogram[i] += ACCESS_ONCE(p->histogram[i]);
 	}
 }
 
 static void __dm_stat_clear(struct dm_stat *s, size_t idx_start, size_t idx_end,
 			    bool init_tmp_percpu_totals)
 {
-	size_t x;
+	size_t x, i;
 	struct dm_stat_shared *shared;
 	struct dm_stat_percpu *p;
 
@@ -620,6 +733,9 @@ static void __dm_stat_clear(struct dm_stat *s, size_t idx_start, size_t idx_end,
 		p->io_ticks[WRITE] -= shared->tmp.io_ticks[WRITE];
 		p->io_ticks_total -= shared->tmp.io_ticks_total;
 		p->time_in_queue -= shared->tmp.time_in_queue;
+		if (s->n_histogram_entries)
+			for (i = 0; i < dm_stat_histogram_len(s); i++)
+				p->histogram[i] -= shared->tmp.histogram[i];
 		local_irq_enable();
 	}
 }
@@ -677,6 +793,10 @@ static int dm_stats_print(struct dm_stats *stats, int id,
 	/*
 	 * Output format:
 	 *   <start_sector>+<length> counters
+	 *	[<read histogram> <write histogram>]
+	 *
+	 * A histogram is the colon separated io counts of each interval
+	 * between the region's boundaries.
 	 */
 
 	mutex_lock(&stats->mutex);
@@ -706,7 +826,7 @@ static int dm_stats_print(struct dm_stats *stats, int id,
 
 		__dm_stat_init_temporary_percpu_totals(shared, s, x);
 
-		DMEMIT("%llu+%llu %llu %llu %llu %llu %llu %llu %llu %llu %d %llu %llu %llu %llu\n",
+		DMEMIT("%llu+%llu %llu %llu %llu %llu %llu %llu %llu %llu %d %llu %llu %llu %llu",
 		       (unsigned long long)start,
 		       (unsigned long long)step,
 		       shared->tmp.ios[READ],
@@ -722,6 +842,17 @@ static int dm_stats_print(struct dm_stats *stats, int id,
 		       dm_jiffies_to_msec64(shared->tmp.time_in_queue),
 		       dm_jiffies_to_msec64(shared->tmp.io_ticks[READ]),
 		       dm_jiffies_to_msec64(shared->tmp.io_ticks[WRITE]));
+		if (s->n_histogram_entries) {
+			unsigned i;
+			for (i = 0; i < dm_stat_histogram_len(s); i++) {
+				if (i == 0 || i == s->n_histogram_entries + 1)
+					DMEMIT(" ");
+				else
+					DMEMIT(":");
+				DMEMIT("%llu", shared->tmp.histogram[i]);
+			}
+		}
+		DMEMIT("\n");
 
 		if (unlikely(sz + 1 >= maxlen))
 			goto buffer_overflow;
@@ -763,22 +894,73 @@ static int dm_stats_set_aux(struct dm_stats *stats, int id, const char *aux_data
 	return 0;
 }
 
+/*
+ * Parse "histogram:" boundaries, a comma separated list of strictly
+ * increasing latencies in milliseconds.
+ */
+static int parse_histogram(const char *h, unsigned *n_histogram_entries,
+			   unsigned long long **histogram_boundaries)
+{
+	const char *q;
+	unsigned n;
+	unsigned long long last;
+
+	*n_histogram_entries = 1;
+	for (q = h; *q; q++)
+		if (*q == ',')
+			(*n_histogram_entries)++;
+
+	*histogram_boundaries = kmalloc(*n_histogram_entries * sizeof(unsigned long long),
+					GFP_KERNEL);
+	if (!*histogram_boundaries)
+		return -ENOMEM;
+
+	n = 0;
+	last = 0;
+	while (1) {
+		unsigned long long hi;
+		int s;
+		char ch;
+
+		s = sscanf(h, "%llu%c", &hi, &ch);
+		if (s <= 0 || (s == 2 && ch != ','))
+			return -EINVAL;
+		if (hi <= last || hi > UINT_MAX)
+			return -EINVAL;
+		last = hi;
+		(*histogram_boundaries)[n] = hi;
+		if (s == 1)
+			return 0;
+		h = strchr(h, ',') + 1;
+		n++;
+	}
+}
+
 static int message_stats_create(struct mapped_device *md,
 				unsigned argc, char **argv,
 				char *result, unsigned maxlen)
 {
+	int r;
 	int id;
 	char dummy;
 	unsigned long long start, end, len, step;
 	unsigned divisor;
 	const char *program_id, *aux_data;
+	unsigned n_histogram_entries = 0;
+	unsigned long long *histogram_boundaries = NULL;
+	unsigned feature_args;
+	unsigned i;
+	const char *a;
 
 	/*
 	 * Input format:
-	 *   <range> <step> [<program_id> [<aux_data>]]
+	 *   <range> <step> [<number_of_optional_arguments> <optional_arguments>...]
+	 *	[<program_id> [<aux_data>]]
+	 *
+	 * The only optional argument is histogram:<boundary>,<boundary>...
 	 */
 
-	if (argc < 3 || argc > 5)
+	if (argc < 3)
 		return -EINVAL;
 
 	if (!strcmp(argv[1], "-")) {
@@ -804,14 +986,41 @@ static int message_stats_create(struct mapped_device *md,
 		   step != (sector_t)step || !step)
 		return -EINVAL;
 
+	i = 3;
+	if (i < argc && sscanf(argv[i], "%u%c", &feature_args, &dummy) == 1) {
+		i++;
+		while (feature_args--) {
+			if (i >= argc) {
+				r = -EINVAL;
+				goto out;
+			}
+			a = argv[i++];
+			if (!strncasecmp(a, "histogram:", 10) &&
+			    !histogram_boundaries) {
+				r = parse_histogram(a + 10, &n_histogram_entries,
+						    &histogram_boundaries);
+				if (r)
+					goto out;
+			} else {
+				r = -EINVAL;
+				goto out;
+			}
+		}
+	}
+
 	program_id = "-";
 	aux_data = "-";
 
-	if (argc > 3)
-		program_id = argv[3];
+	if (i < argc)
+		program_id = argv[i++];
 
-	if (argc > 4)
-		aux_data = argv[4];
+	if (i < argc)
+		aux_data = argv[i++];
+
+	if (i < argc) {
+		r = -EINVAL;
+		goto out;
+	}
 
 	/*
 	 * If a buffer overflow happens after we created the region,
@@ -820,17 +1029,26 @@ static int message_stats_create(struct mapped_device *md,
 	 * leaked).  So we must detect buffer overflow in advance.
 	 */
 	snprintf(result, maxlen, "%d", INT_MAX);
-	if (dm_message_test_buffer_overflow(result, maxlen))
-		return 1;
+	if (dm_message_test_buffer_overflow(result, maxlen)) {
+		r = 1;
+		goto out;
+	}
 
-	id = dm_stats_create(dm_get_stats(md), start, end, step, program_id, aux_data,
+	id = dm_stats_create(dm_get_stats(md), start, end, step,
+			     n_histogram_entries, histogram_boundaries,
+			     program_id, aux_data,
 			     dm_internal_suspend_fast, dm_internal_resume_fast, md);
-	if (id < 0)
-		return id;
+	if (id < 0) {
+		r = id;
+		goto out;
+	}
 
 	snprintf(result, maxlen, "%d", id);
+	r = 1;
 
-	return 1;
+out:
+	kfree(histogram_boundaries);
+	return r;
 }
 
 static int message_stats_delete(struct mapped_device *md,
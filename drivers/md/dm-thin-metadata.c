@@ -1419,6 +1419,75 @@ int dm_thin_find_block(struct dm_thin_device *td, dm_block_t block,
 	return r;
 }
 
+int dm_thin_find_mapped_range(struct dm_thin_device *td,
+			      dm_block_t begin, dm_block_t end,
+			      dm_block_t *thin_begin, dm_block_t *thin_end,
+			      dm_block_t *pool_begin, bool *maybe_shared)
+{
+	int r;
+	uint64_t key;
+	__le64 value;
+	dm_block_t pool_end = 0;
+	bool found = false;
+	struct dm_btree_cursor cursor;
+	struct dm_pool_metadata *pmd = td->pmd;
+
+	if (end <= begin)
+		return -ENODATA;
+
+	if (pmd->fail_io)
+		return -EINVAL;
+
+	down_read(&pmd->root_lock);
+
+	r = dm_btree_lookup(&pmd->tl_info, pmd->root, &td->id, &value);
+	if (r)
+		goto out;
+
+	r = dm_btree_cursor_begin(&pmd->bl_info, le64_to_cpu(value), begin,
+				  true, &cursor);
+	if (r)
+		goto out;
+
+	for (;;) {
+		dm_block_t exception_block;
+		uint32_t exception_time;
+		bool shared;
+
+		r = dm_btree_cursor_get_value(&cursor, &key, &value);
+		if (r || key >= end)
+			break;
+
+		unpack_block_time(le64_to_cpu(value), &exception_block,
+				  &exception_time);
+		shared = __snapshotted_since(td, exception_time);
+
+		if (!found) {
+			found = true;
+			*thin_begin = key;
+			*pool_begin = exception_block;
+			*maybe_shared = shared;
+
+		} else if (key != *thin_end || exception_block != pool_end ||
+			   shared != *maybe_shared)
+			break;
+
+		*thin_end = key + 1;
+		pool_end = exception_block + 1;
+
+		r = dm_btree_cursor_next(&cursor);
+		if (r)
+			break;
+	}
+	dm_btree_cursor_end(&cursor);
+
+	if (!r || r == -ENODATA)
+		r = found ? 0 : -ENODATA;
+out:
+	up_read(&pmd->root_lock);
+	return r;
+}
+
 static int __insert(struct dm_thin_device *td, dm_block_t block,
 		    dm_block_t data_block)
 {
@@ -146,6 +146,20 @@ struct dm_thin_lookup_result {
 int dm_thin_find_block(struct dm_thin_device *td, dm_block_t block,
 		       int can_issue_io, struct dm_thin_lookup_result *result);
 
+/*
+ * Finds the first run of mapped blocks in [@begin, @end) that map to
+ * consecutive data blocks with the same sharing, walking each leaf of the
+ * mapping tree once.
+ *
+ * Returns:
+ *   -ENODATA iff no block of the range is mapped.
+ *   0 success
+ */
+int dm_thin_find_mapped_range(struct dm_thin_device *td,
+			      dm_block_t begin, dm_block_t end,
+			      dm_block_t *thin_begin, dm_block_t *thin_end,
+			      dm_block_t *pool_begin, bool *maybe_shared);
+
 /*
  * Obtain an unused block.
  */
@@ -29,6 +29,7 @@
 #define MAPPING_POOL_SIZE 1024
 #define COMMIT_PERIOD HZ
 #define NO_SPACE_TIMEOUT_SECS 60
+#define MAX_COMMIT_WINDOW_MS 1000
 
 static unsigned no_space_timeout_secs = NO_SPACE_TIMEOUT_SECS;
 
@@ -201,6 +202,12 @@ struct pool_features {
 	bool discard_enabled:1;
 	bool discard_passdown:1;
 	bool error_if_no_space:1;
+
+	/*
+	 * How long a flush may wait for others before the metadata is
+	 * committed, in milliseconds.  Zero commits straight away.
+	 */
+	unsigned commit_window_ms;
 };
 
 struct thin_c;
@@ -234,8 +241,10 @@ struct pool {
 	struct work_struct worker;
 	struct delayed_work waker;
 	struct delayed_work no_space_timeout;
+	struct delayed_work commit_window;
 
 	unsigned long last_commit_jiffies;
+	unsigned long first_flush_jiffies;
 	unsigned ref_count;
 
 	spinlock_t lock;
@@ -599,6 +608,7 @@ static void issue(struct thin_c *tc, struct bio *bio)
 {
 	struct pool *pool = tc->pool;
 	unsigned long flags;
+	bool first;
 
 	if (!bio_triggers_commit(tc, bio)) {
 		generic_make_request(bio);
@@ -617,11 +627,20 @@ static void issue(struct thin_c *tc, struct bio *bio)
 
 	/*
 	 * Batch together any bios that trigger commits and then issue a
-	 * single commit for them in process_deferred_bios().
+	 * single commit for them in process_deferred_bios().  With a
+	 * commit window the first flush also arms a timer, so the flushes
+	 * from every thin that arrive within the window share one commit.
 	 */
 	spin_lock_irqsave(&pool->lock, flags);
+	first = bio_list_empty(&pool->deferred_flush_bios);
+	if (first)
+		pool->first_flush_jiffies = jiffies;
 	bio_list_add(&pool->deferred_flush_bios, bio);
 	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (first && pool->pf.commit_window_ms)
+		queue_delayed_work(pool->wq, &pool->commit_window,
+				   msecs_to_jiffies(pool->pf.commit_window_ms));
 }
 
 static void remap_to_origin_and_issue(struct thin_c *tc, struct bio *bio)
@@ -1704,6 +1723,20 @@ static int need_commit_due_to_time(struct pool *pool)
 	       jiffies > pool->last_commit_jiffies + COMMIT_PERIOD;
 }
 
+/*
+ * Deferred flushes are held back until the oldest has waited for the
+ * commit window.  Must be called with pool->lock held.
+ */
+static bool commit_window_open(struct pool *pool)
+{
+	if (!pool->pf.commit_window_ms || pool->suspended ||
+	    bio_list_empty(&pool->deferred_flush_bios))
+		return false;
+
+	return time_before(jiffies, pool->first_flush_jiffies +
+			   msecs_to_jiffies(pool->pf.commit_window_ms));
+}
+
 #define thin_pbd(node) rb_entry((node), struct dm_thin_endio_hook, rb_node)
 #define thin_bio(pbd) dm_bio_from_per_bio_data((pbd), sizeof(struct dm_thin_endio_hook))
 
@@ -1967,8 +2000,10 @@ static void process_deferred_bios(struct pool *pool)
 	 */
 	bio_list_init(&bios);
 	spin_lock_irqsave(&pool->lock, flags);
-	bio_list_merge(&bios, &pool->deferred_flush_bios);
-	bio_list_init(&pool->deferred_flush_bios);
+	if (!commit_window_open(pool) || need_commit_due_to_time(pool)) {
+		bio_list_merge(&bios, &pool->deferred_flush_bios);
+		bio_list_init(&pool->deferred_flush_bios);
+	}
 	spin_unlock_irqrestore(&pool->lock, flags);
 
 	if (bio_list_empty(&bios) &&
@@ -2012,6 +2047,16 @@ static void do_waker(struct work_struct *ws)
 	queue_delayed_work(pool->wq, &pool->waker, COMMIT_PERIOD);
 }
 
+/*
+ * The commit window of the oldest deferred flush has closed.
+ */
+static void do_commit_window(struct work_struct *ws)
+{
+	struct pool *pool = container_of(to_delayed_work(ws), struct pool,
+					 commit_window);
+	wake_worker(pool);
+}
+
 /*
  * We're holding onto IO to allow userland time to react.  After the
  * timeout either the pool will have been resized (and thus back in
@@ -2492,6 +2537,7 @@ static void pool_features_init(struct pool_features *pf)
 	pf->discard_enabled = true;
 	pf->discard_passdown = true;
 	pf->error_if_no_space = false;
+	pf->commit_window_ms = 0;
 }
 
 static void __pool_destroy(struct pool *pool)
@@ -2579,6 +2625,7 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 	INIT_WORK(&pool->worker, do_worker);
 	INIT_DELAYED_WORK(&pool->waker, do_waker);
 	INIT_DELAYED_WORK(&pool->no_space_timeout, do_no_space_timeout);
+	INIT_DELAYED_WORK(&pool->commit_window, do_commit_window);
 	spin_lock_init(&pool->lock);
 	bio_list_init(&pool->deferred_flush_bios);
 	INIT_LIST_HEAD(&pool->prepared_mappings);
@@ -2612,6 +2659,7 @@ static struct pool *pool_create(struct mapped_device *pool_md,
 
 	pool->ref_count = 1;
 	pool->last_commit_jiffies = jiffies;
+	pool->first_flush_jiffies = jiffies;
 	pool->pool_md = pool_md;
 	pool->md_dev = metadata_dev;
 	__pool_table_insert(pool);
@@ -2705,11 +2753,12 @@ static int parse_pool_features(struct dm_arg_set *as, struct pool_features *pf,
 			       struct dm_target *ti)
 {
 	int r;
-	unsigned argc;
+	unsigned argc, val;
 	const char *arg_name;
+	char dummy;
 
 	static struct dm_arg _args[] = {
-		{0, 4, "Invalid number of pool feature arguments"},
+		{0, 6, "Invalid number of pool feature arguments"},
 	};
 
 	/*
@@ -2741,7 +2790,15 @@ static int parse_pool_features(struct dm_arg_set *as, struct pool_features *pf,
 		else if (!strcasecmp(arg_name, "error_if_no_space"))
 			pf->error_if_no_space = true;
 
-		else {
+		else if (sscanf(arg_name, "commit_window_ms:%u%c", &val, &dummy) == 1) {
+			if (val > MAX_COMMIT_WINDOW_MS) {
+				ti->error = "Invalid commit window";
+				r = -EINVAL;
+				break;
+			}
+			pf->commit_window_ms = val;
+
+		} else {
 			ti->error = "Unrecognised pool feature requested";
 			r = -EINVAL;
 			break;
@@ -2824,6 +2881,8 @@ static dm_block_t calc_metadata_threshold(struct pool_c *pt)
  *	     no_discard_passdown: don't pass discards down to the data device
  *	     read_only: Don't allow any changes to be made to the pool metadata.
  *	     error_if_no_space: error IOs, instead of queueing, if no space.
+ *	     commit_window_ms:<ms>: hold flushes for up to <ms> so flushes
+ *				    from all thins share a metadata commit.
  */
 static int pool_ctr(struct dm_target *ti, unsigned argc, char **argv)
 {
@@ -3177,6 +3236,9 @@ static void pool_presuspend(struct dm_target *ti)
 	pool->suspended = true;
 	spin_unlock_irqrestore(&pool->lock, flags);
 
+	/* don't keep flushes waiting for the commit window */
+	wake_worker(pool);
+
 	pool_suspend_active_thins(pool);
 }
 
@@ -3200,6 +3262,7 @@ static void pool_postsuspend(struct dm_target *ti)
 
 	cancel_delayed_work(&pool->waker);
 	cancel_delayed_work(&pool->no_space_timeout);
+	cancel_delayed_work(&pool->commit_window);
 	flush_workqueue(pool->wq);
 	(void) commit(pool);
 }
@@ -3412,7 +3475,7 @@ static void emit_flags(struct pool_features *pf, char *result,
 {
 	unsigned count = !pf->zero_new_blocks + !pf->discard_enabled +
 		!pf->discard_passdown + (pf->mode == PM_READ_ONLY) +
-		pf->error_if_no_space;
+		pf->error_if_no_space + !!pf->commit_window_ms;
 	DMEMIT("%u ", count);
 
 	if (!pf->zero_new_blocks)
@@ -3429,6 +3492,9 @@ static void emit_flags(struct pool_features *pf, char *result,
 
 	if (pf->error_if_no_space)
 		DMEMIT("error_if_no_space ");
+
+	if (pf->commit_window_ms)
+		DMEMIT("commit_window_ms:%u ", pf->commit_window_ms);
 }
 
 /*
@@ -3654,7 +3720,7 @@ static struct target_type pool_target = {
 	.name = "thin-pool",
 	.features = DM_TARGET_SINGLETON | DM_TARGET_ALWAYS_WRITEABLE |
 		    DM_TARGET_IMMUTABLE,
-	.version = {1, 14, 0},
+	.version = {1, 15, 0},
 	.module = THIS_MODULE,
 	.ctr = pool_ctr,
 	.dtr = pool_dtr,
@@ -28,6 +28,12 @@
 
 #define DM_VERITY_MAX_LEVELS		63
 
+/*
+ * Bios of at least twice this many blocks are split into parts of at
+ * least this many blocks, verified in parallel.
+ */
+#define DM_VERITY_MIN_PART_BLOCKS	8
+
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
 module_param_named(prefetch_cluster, dm_verity_prefetch_cluster, uint, S_IRUGO | S_IWUSR);
@@ -77,6 +83,11 @@ struct dm_verity_io {
 
 	struct work_struct work;
 
+	/* the parts still being verified, and the first error of them */
+	atomic_t parts_pending;
+	int parts_error;
+	void *parts;
+
 	/*
 	 * Three variably-size fields follow this struct:
 	 *
@@ -84,10 +95,23 @@ struct dm_verity_io {
 	 * u8 real_digest[v->digest_size];
 	 * u8 want_digest[v->digest_size];
 	 *
-	 * To access them use: io_hash_desc(), io_real_digest() and io_want_digest().
+	 * To access them use: verity_hash_desc(), verity_real_digest() and
+	 * verity_want_digest() on io + 1.
 	 */
 };
 
+/*
+ * A range of the blocks of a bio that is verified by its own work item.
+ * It is followed by the same variably-size fields as dm_verity_io.
+ */
+struct dm_verity_part {
+	struct work_struct work;
+	struct dm_verity_io *io;
+	sector_t block;
+	unsigned n_blocks;
+	struct bvec_iter iter;
+};
+
 struct dm_verity_prefetch_work {
 	struct work_struct work;
 	struct dm_verity *v;
@@ -95,19 +119,25 @@ struct dm_verity_prefetch_work {
 	unsigned n_blocks;
 };
 
-static struct shash_desc *io_hash_desc(struct dm_verity *v, struct dm_verity_io *io)
+static struct shash_desc *verity_hash_desc(struct dm_verity *v, void *tail)
 {
-	return (struct shash_desc *)(io + 1);
+	return (struct shash_desc *)tail;
 }
 
-static u8 *io_real_digest(struct dm_verity *v, struct dm_verity_io *io)
+static u8 *verity_real_digest(struct dm_verity *v, void *tail)
 {
-	return (u8 *)(io + 1) + v->shash_descsize;
+	return (u8 *)tail + v->shash_descsize;
 }
 
-static u8 *io_want_digest(struct dm_verity *v, struct dm_verity_io *io)
+static u8 *verity_want_digest(struct dm_verity *v, void *tail)
 {
-	return (u8 *)(io + 1) + v->shash_descsize + v->digest_size;
+	return (u8 *)tail + v->shash_descsize + v->digest_size;
+}
+
+static size_t verity_part_size(struct dm_verity *v)
+{
+	return roundup(sizeof(struct dm_verity_part) + v->shash_descsize + v->digest_size * 2,
+		       __alignof__(struct dm_verity_part));
 }
 
 /*
@@ -178,17 +208,16 @@ static void verity_hash_at_level(struct dm_verity *v, sector_t block, int level,
  * Verify hash of a metadata block pertaining to the specified data block
  * ("block" argument) at a specified level ("level" argument).
  *
- * On successful return, io_want_digest(v, io) contains the hash value for
- * a lower tree level or for the data block (if we're at the lowest leve).
+ * On successful return, verity_want_digest(v, tail) contains the hash value
+ * for a lower tree level or for the data block (if we're at the lowest leve).
  *
  * If "skip_unverified" is true, unverified buffer is skipped and 1 is returned.
  * If "skip_unverified" is false, unverified buffer is hashed and verified
- * against current value of io_want_digest(v, io).
+ * against current value of verity_want_digest(v, tail).
  */
-static int verity_verify_level(struct dm_verity_io *io, sector_t block,
+static int verity_verify_level(struct dm_verity *v, void *tail, sector_t block,
 			       int level, bool skip_unverified)
 {
-	struct dm_verity *v = io->v;
 	struct dm_buffer *buf;
 	struct buffer_aux *aux;
 	u8 *data;
@@ -213,7 +242,7 @@ static int verity_verify_level(struct dm_verity_io *io, sector_t block,
 			goto release_ret_r;
 		}
 
-		desc = io_hash_desc(v, io);
+		desc = verity_hash_desc(v, tail);
 		desc->tfm = v->tfm;
 		desc->flags = CRYPTO_TFM_REQ_MAY_SLEEP;
 		r = crypto_shash_init(desc);
@@ -244,13 +273,13 @@ static int verity_verify_level(struct dm_verity_io *io, sector_t block,
 			}
 		}
 
-		result = io_real_digest(v, io);
+		result = verity_real_digest(v, tail);
 		r = crypto_shash_final(desc, result);
 		if (r < 0) {
 			DMERR("crypto_shash_final failed: %d", r);
 			goto release_ret_r;
 		}
-		if (unlikely(memcmp(result, io_want_digest(v, io), v->digest_size))) {
+		if (unlikely(memcmp(result, verity_want_digest(v, tail), v->digest_size))) {
 			DMERR_LIMIT("metadata block %llu is corrupted",
 				(unsigned long long)hash_block);
 			v->hash_failed = 1;
@@ -262,7 +291,7 @@ static int verity_verify_level(struct dm_verity_io *io, sector_t block,
 
 	data += offset;
 
-	memcpy(io_want_digest(v, io), data, v->digest_size);
+	memcpy(verity_want_digest(v, tail), data, v->digest_size);
 
 	dm_bufio_release(buf);
 	return 0;
@@ -274,17 +303,17 @@ release_ret_r:
 }
 
 /*
- * Verify one "dm_verity_io" structure.
+ * Verify "n_blocks" blocks of a bio starting at "block", whose data
+ * starts at "iter".  "tail" is the hash scratch space of the caller.
  */
-static int verity_verify_io(struct dm_verity_io *io)
+static int verity_verify_blocks(struct dm_verity *v, void *tail, struct bio *bio,
+				sector_t block, unsigned n_blocks,
+				struct bvec_iter *iter)
 {
-	struct dm_verity *v = io->v;
-	struct bio *bio = dm_bio_from_per_bio_data(io,
-						   v->ti->per_bio_data_size);
 	unsigned b;
 	int i;
 
-	for (b = 0; b < io->n_blocks; b++) {
+	for (b = 0; b < n_blocks; b++) {
 		struct shash_desc *desc;
 		u8 *result;
 		int r;
@@ -298,23 +327,23 @@ static int verity_verify_io(struct dm_verity_io *io)
 			 * function returns 0 and we fall back to whole
 			 * chain verification.
 			 */
-			int r = verity_verify_level(io, io->block + b, 0, true);
+			int r = verity_verify_level(v, tail, block + b, 0, true);
 			if (likely(!r))
 				goto test_block_hash;
 			if (r < 0)
 				return r;
 		}
 
-		memcpy(io_want_digest(v, io), v->root_digest, v->digest_size);
+		memcpy(verity_want_digest(v, tail), v->root_digest, v->digest_size);
 
 		for (i = v->levels - 1; i >= 0; i--) {
-			int r = verity_verify_level(io, io->block + b, i, false);
+			int r = verity_verify_level(v, tail, block + b, i, false);
 			if (unlikely(r))
 				return r;
 		}
 
 test_block_hash:
-		desc = io_hash_desc(v, io);
+		desc = verity_hash_desc(v, tail);
 		desc->tfm = v->tfm;
 		desc->flags = CRYPTO_TFM_REQ_MAY_SLEEP;
 		r = crypto_shash_init(desc);
@@ -334,7 +363,7 @@ test_block_hash:
 		do {
 			u8 *page;
 			unsigned len;
-			struct bio_vec bv = bio_iter_iovec(bio, io->iter);
+			struct bio_vec bv = bio_iter_iovec(bio, *iter);
 
 			page = kmap_atomic(bv.bv_page);
 			len = bv.bv_len;
@@ -348,7 +377,7 @@ test_block_hash:
 				return r;
 			}
 
-			bio_advance_iter(bio, &io->iter, len);
+			bio_advance_iter(bio, iter, len);
 			todo -= len;
 		} while (todo);
 
@@ -360,15 +389,15 @@ test_block_hash:
 			}
 		}
 
-		result = io_real_digest(v, io);
+		result = verity_real_digest(v, tail);
 		r = crypto_shash_final(desc, result);
 		if (r < 0) {
 			DMERR("crypto_shash_final failed: %d", r);
 			return r;
 		}
-		if (unlikely(memcmp(result, io_want_digest(v, io), v->digest_size))) {
+		if (unlikely(memcmp(result, verity_want_digest(v, tail), v->digest_size))) {
 			DMERR_LIMIT("data block %llu is corrupted",
-				(unsigned long long)(io->block + b));
+				(unsigned long long)(block + b));
 			v->hash_failed = 1;
 			return -EIO;
 		}
@@ -391,10 +420,108 @@ static void verity_finish_io(struct dm_verity_io *io, int error)
 	bio_endio_nodec(bio, error);
 }
 
+/*
+ * Verify one "dm_verity_io" structure.
+ */
+static int verity_verify_io(struct dm_verity_io *io)
+{
+	struct dm_verity *v = io->v;
+	struct bio *bio = dm_bio_from_per_bio_data(io,
+						   v->ti->per_bio_data_size);
+
+	return verity_verify_blocks(v, io + 1, bio, io->block, io->n_blocks,
+				    &io->iter);
+}
+
+/*
+ * One of the parts of an io is done.  The last one finishes the io.
+ */
+static void verity_part_done(struct dm_verity_io *io, int error)
+{
+	if (unlikely(error))
+		cmpxchg(&io->parts_error, 0, error);
+
+	if (!atomic_dec_and_test(&io->parts_pending))
+		return;
+
+	kfree(io->parts);
+	verity_finish_io(io, io->parts_error);
+}
+
+static void verity_part_work(struct work_struct *w)
+{
+	struct dm_verity_part *part = container_of(w, struct dm_verity_part, work);
+	struct dm_verity_io *io = part->io;
+	struct dm_verity *v = io->v;
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_bio_data_size);
+
+	verity_part_done(io, verity_verify_blocks(v, part + 1, bio, part->block,
+						  part->n_blocks, &part->iter));
+}
+
+/*
+ * Split a large io into parts that are hashed on other CPUs.  The first
+ * part is verified by the caller, in "io" itself.
+ *
+ * Returns false if the io should be verified in one go.
+ */
+static bool verity_split_io(struct dm_verity_io *io)
+{
+	struct dm_verity *v = io->v;
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_bio_data_size);
+	size_t part_size = verity_part_size(v);
+	unsigned nr_parts, per_part, i;
+	sector_t block;
+	struct bvec_iter iter;
+
+	nr_parts = min(io->n_blocks / DM_VERITY_MIN_PART_BLOCKS, num_online_cpus());
+	if (nr_parts < 2)
+		return false;
+
+	per_part = DIV_ROUND_UP(io->n_blocks, nr_parts);
+	nr_parts = DIV_ROUND_UP(io->n_blocks, per_part);
+
+	io->parts = kmalloc((nr_parts - 1) * part_size,
+			    GFP_NOIO | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
+	if (!io->parts)
+		return false;
+
+	atomic_set(&io->parts_pending, nr_parts);
+	io->parts_error = 0;
+
+	block = io->block + per_part;
+	iter = io->iter;
+	bio_advance_iter(bio, &iter, per_part << v->data_dev_block_bits);
+
+	for (i = 0; i < nr_parts - 1; i++) {
+		struct dm_verity_part *part = io->parts + i * part_size;
+
+		part->io = io;
+		part->block = block;
+		part->n_blocks = min_t(sector_t, per_part,
+				       io->block + io->n_blocks - block);
+		part->iter = iter;
+		bio_advance_iter(bio, &iter, part->n_blocks << v->data_dev_block_bits);
+		block += part->n_blocks;
+
+		INIT_WORK(&part->work, verity_part_work);
+		queue_work(v->verify_wq, &part->work);
+	}
+
+	io->n_blocks = per_part;
+
+	return true;
+}
+
 static void verity_work(struct work_struct *w)
 {
 	struct dm_verity_io *io = container_of(w, struct dm_verity_io, work);
 
+	if (verity_split_io(io)) {
+		verity_part_done(io, verity_verify_io(io));
+		return;
+	}
+
 	verity_finish_io(io, verity_verify_io(io));
 }
 
@@ -501,6 +628,7 @@ static int verity_map(struct dm_target *ti, struct bio *bio)
 	io->orig_bi_private = bio->bi_private;
 	io->block = bio->bi_iter.bi_sector >> (v->data_dev_block_bits - SECTOR_SHIFT);
 	io->n_blocks = bio->bi_iter.bi_size >> v->data_dev_block_bits;
+	io->parts = NULL;
 
 	bio->bi_end_io = verity_end_io;
 	bio->bi_private = io;
@@ -865,7 +993,7 @@ bad:
 
 static struct target_type verity_target = {
 	.name		= "verity",
-	.version	= {1, 2, 0},
+	.version	= {1, 3, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
@@ -3271,7 +3271,8 @@ level_store(struct mddev *mddev, const char *buf, size_t len)
 	if (mddev->sync_thread ||
 	    test_bit(MD_RECOVERY_RUNNING, &mddev->recovery) ||
 	    mddev->reshape_position != MaxSector ||
-	    mddev->sysfs_active)
+	    mddev->sysfs_active ||
+	    test_bit(MD_HAS_LOG, &mddev->flags))
 		return -EBUSY;
 
 	if (!mddev->pers->quiesce) {
@@ -5118,6 +5119,7 @@ static int md_set_readonly(struct mddev *mddev, struct block_device *bdev)
 
 	mutex_lock(&mddev->open_mutex);
 	if ((mddev->pers && atomic_read(&mddev->openers) > !!bdev) ||
+	    test_bit(MD_HAS_LOG, &mddev->flags) ||
 	    mddev->sync_thread ||
 	    test_bit(MD_RECOVERY_RUNNING, &mddev->recovery) ||
 	    (bdev && !test_bit(MD_STILL_CLOSED, &mddev->flags))) {
@@ -5180,6 +5182,7 @@ static int do_md_stop(struct mddev *mddev, int mode,
 
 	mutex_lock(&mddev->open_mutex);
 	if ((mddev->pers && atomic_read(&mddev->openers) > !!bdev) ||
+	    test_bit(MD_HAS_LOG, &mddev->flags) ||
 	    mddev->sysfs_active ||
 	    mddev->sync_thread ||
 	    test_bit(MD_RECOVERY_RUNNING, &mddev->recovery) ||
@@ -97,6 +97,9 @@ struct md_rdev {
 	atomic_t	read_errors;	/* number of consecutive read errors that
 					 * we have tried to ignore.
 					 */
+	unsigned long	read_latency;	/* moving average of read completion
+					 * time in ns, for read balancing.
+					 */
 	struct timespec last_read_error;	/* monotonic time since our
 						 * last read error
 						 */
@@ -217,6 +220,9 @@ struct mddev {
 #define MD_STILL_CLOSED	4	/* If set, then array has not been opened since
 				 * md_ioctl checked on it.
 				 */
+#define MD_HAS_LOG	5	/* A write-back log is (being) attached, the
+				 * array can't be stopped or change level.
+				 */
 
 	int				suspended;
 	atomic_t			active_io;
@@ -446,6 +452,32 @@ static inline void rdev_dec_pending(struct md_rdev *rdev, struct mddev *mddev)
 		set_bit(MD_RECOVERY_NEEDED, &mddev->recovery);
 }
 
+/*
+ * Fold a completed read issued at @start (local_clock()) into the read
+ * latency average of @rdev.  Updates from different CPUs may race, the
+ * average only needs to be roughly right.
+ */
+static inline void md_rdev_read_done(struct md_rdev *rdev, u64 start)
+{
+	unsigned long lat = ACCESS_ONCE(rdev->read_latency);
+	s64 delta = local_clock() - start;
+
+	if (delta < 0)
+		delta = 0;
+	ACCESS_ONCE(rdev->read_latency) = lat - (lat >> 3) + (delta >> 3);
+}
+
+/*
+ * The expected cost of queueing one more read on @rdev: its queue depth
+ * weighted by how long its reads take.  Used instead of head position for
+ * non-rotational devices, which have no seek to avoid.
+ */
+static inline u64 md_rdev_read_load(struct md_rdev *rdev)
+{
+	return (u64)(atomic_read(&rdev->nr_pending) + 1) *
+		(ACCESS_ONCE(rdev->read_latency) + 1);
+}
+
 static inline void md_sync_acct(struct block_device *bdev, unsigned long nr_sectors)
 {
 	atomic_add(nr_sectors, &bdev->bd_contains->bd_disk->sync_io);
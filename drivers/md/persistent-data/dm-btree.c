@@ -890,3 +890,192 @@ int dm_btree_walk(struct dm_btree_info *info, dm_block_t root,
 	return walk_node(info, root, fn, context);
 }
 EXPORT_SYMBOL_GPL(dm_btree_walk);
+
+/*----------------------------------------------------------------
+ * Cursor API
+ *--------------------------------------------------------------*/
+
+/*
+ * Prefetch the children of the top internal node that the cursor has
+ * still to visit.
+ */
+static void prefetch_cursor_children(struct dm_btree_cursor *c)
+{
+	unsigned i, nr;
+	struct cursor_node *n = c->nodes + c->depth - 1;
+	struct btree_node *bn = dm_block_data(n->b);
+	struct dm_block_manager *bm = dm_tm_get_bm(c->info->tm);
+
+	nr = le32_to_cpu(bn->header.nr_entries);
+	for (i = n->index; i < nr; i++)
+		dm_bm_prefetch(bm, value64(bn, i));
+}
+
+static int push_node(struct dm_btree_cursor *c, dm_block_t b)
+{
+	int r;
+	struct cursor_node *n = c->nodes + c->depth;
+
+	if (c->depth >= DM_BTREE_CURSOR_MAX_DEPTH) {
+		DMERR("couldn't push cursor node, stack depth too high");
+		return -EINVAL;
+	}
+
+	r = bn_read_lock(c->info, b, &n->b);
+	if (r)
+		return r;
+
+	n->index = 0;
+	c->depth++;
+
+	return 0;
+}
+
+static void pop_node(struct dm_btree_cursor *c)
+{
+	c->depth--;
+	unlock_block(c->info, c->nodes[c->depth].b);
+}
+
+/*
+ * Moves the cursor forward in the deepest node that has entries left,
+ * dropping the nodes that are finished with.
+ */
+static int inc_or_backtrack(struct dm_btree_cursor *c)
+{
+	struct cursor_node *n;
+	struct btree_node *bn;
+
+	for (;;) {
+		if (!c->depth)
+			return -ENODATA;
+
+		n = c->nodes + c->depth - 1;
+		bn = dm_block_data(n->b);
+
+		n->index++;
+		if (n->index < le32_to_cpu(bn->header.nr_entries))
+			break;
+
+		pop_node(c);
+	}
+
+	return 0;
+}
+
+/*
+ * Descends from the current entry of the top node down to a leaf.  If
+ * @seek is set, the first entry not below @key is picked in each node,
+ * otherwise the first entry.
+ */
+static int find_leaf(struct dm_btree_cursor *c, bool seek, uint64_t key)
+{
+	int r, i;
+	struct cursor_node *n;
+	struct btree_node *bn;
+	uint32_t flags;
+
+	for (;;) {
+		n = c->nodes + c->depth - 1;
+		bn = dm_block_data(n->b);
+		flags = le32_to_cpu(bn->header.flags);
+
+		if (seek) {
+			i = lower_bound(bn, key);
+			if (i < 0)
+				i = 0;
+			else if ((flags & LEAF_NODE) &&
+				 le64_to_cpu(*key_ptr(bn, i)) < key)
+				i++;
+			n->index = i;
+		}
+
+		if (n->index >= le32_to_cpu(bn->header.nr_entries))
+			return -ENODATA;
+
+		if (flags & LEAF_NODE)
+			return 0;
+
+		/*
+		 * Only on the first visit of the node, not every time the
+		 * cursor comes back up to it.
+		 */
+		if (c->prefetch_leaves && (seek || !n->index))
+			prefetch_cursor_children(c);
+
+		r = push_node(c, value64(bn, n->index));
+		if (r)
+			return r;
+	}
+}
+
+int dm_btree_cursor_begin(struct dm_btree_info *info, dm_block_t root,
+			  uint64_t key, bool prefetch_leaves,
+			  struct dm_btree_cursor *c)
+{
+	int r;
+
+	BUG_ON(info->levels > 1);
+
+	c->info = info;
+	c->root = root;
+	c->depth = 0;
+	c->prefetch_leaves = prefetch_leaves;
+
+	r = push_node(c, root);
+	if (r)
+		return r;
+
+	/*
+	 * All the keys of a leaf may be below @key, the entry we want is
+	 * then the first of the next leaf.
+	 */
+	r = find_leaf(c, true, key);
+	if (r == -ENODATA)
+		r = dm_btree_cursor_next(c);
+	if (r)
+		dm_btree_cursor_end(c);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_cursor_begin);
+
+void dm_btree_cursor_end(struct dm_btree_cursor *c)
+{
+	while (c->depth)
+		pop_node(c);
+}
+EXPORT_SYMBOL_GPL(dm_btree_cursor_end);
+
+int dm_btree_cursor_next(struct dm_btree_cursor *c)
+{
+	int r;
+
+	do {
+		r = inc_or_backtrack(c);
+		if (!r)
+			r = find_leaf(c, false, 0);
+	} while (r == -ENODATA && c->depth);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_cursor_next);
+
+int dm_btree_cursor_get_value(struct dm_btree_cursor *c, uint64_t *key,
+			      void *value_le)
+{
+	struct cursor_node *n;
+	struct btree_node *bn;
+
+	if (!c->depth)
+		return -ENODATA;
+
+	n = c->nodes + c->depth - 1;
+	bn = dm_block_data(n->b);
+
+	*key = le64_to_cpu(*key_ptr(bn, n->index));
+	memcpy(value_le, value_ptr(bn, n->index), c->info->value_type.size);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dm_btree_cursor_get_value);
@@ -325,9 +325,10 @@ static void raid1_end_read_request(struct bio *bio, int error)
 	 */
 	update_head_pos(mirror, r1_bio);
 
-	if (uptodate)
+	if (uptodate) {
+		md_rdev_read_done(conf->mirrors[mirror].rdev, r1_bio->read_start);
 		set_bit(R1BIO_Uptodate, &r1_bio->state);
-	else {
+	} else {
 		/* If all other devices have failed, we want to return
 		 * the error upwards rather than fail the last device.
 		 * Here we redefine "uptodate" to mean "Don't want to retry"
@@ -513,11 +514,11 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	const sector_t this_sector = r1_bio->sector;
 	int sectors;
 	int best_good_sectors;
-	int best_disk, best_dist_disk, best_pending_disk;
+	int best_disk, best_dist_disk, best_load_disk;
 	int has_nonrot_disk;
 	int disk;
 	sector_t best_dist;
-	unsigned int min_pending;
+	u64 min_load;
 	struct md_rdev *rdev;
 	int choose_first;
 	int choose_next_idle;
@@ -533,8 +534,8 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	best_disk = -1;
 	best_dist_disk = -1;
 	best_dist = MaxSector;
-	best_pending_disk = -1;
-	min_pending = UINT_MAX;
+	best_load_disk = -1;
+	min_load = U64_MAX;
 	best_good_sectors = 0;
 	has_nonrot_disk = 0;
 	choose_next_idle = 0;
@@ -546,6 +547,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		sector_t first_bad;
 		int bad_sectors;
 		unsigned int pending;
+		u64 load;
 		bool nonrot;
 
 		rdev = rcu_dereference(conf->mirrors[disk].rdev);
@@ -570,7 +572,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 				} else
 					best_good_sectors = sectors;
 				best_dist_disk = disk;
-				best_pending_disk = disk;
+				best_load_disk = disk;
 			}
 			continue;
 		}
@@ -644,8 +646,11 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			}
 			break;
 		}
-		/* If device is idle, use it */
-		if (pending == 0) {
+		/*
+		 * If a rotational device is idle, use it.  Idle
+		 * non-rotational devices are still compared on latency.
+		 */
+		if (pending == 0 && (!nonrot || choose_next_idle)) {
 			best_disk = disk;
 			break;
 		}
@@ -653,9 +658,10 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 		if (choose_next_idle)
 			continue;
 
-		if (min_pending > pending) {
-			min_pending = pending;
-			best_pending_disk = disk;
+		load = md_rdev_read_load(rdev);
+		if (min_load > load) {
+			min_load = load;
+			best_load_disk = disk;
 		}
 
 		if (dist < best_dist) {
@@ -666,13 +672,14 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 
 	/*
 	 * If all disks are rotational, choose the closest disk. If any disk is
-	 * non-rotational, choose the disk with less pending request even the
-	 * disk is rotational, which might/might not be optimal for raids with
-	 * mixed ratation/non-rotational disks depending on workload.
+	 * non-rotational, choose the disk with the fewest pending requests
+	 * weighted by its read latency, even if the disk is rotational, which
+	 * might/might not be optimal for raids with mixed
+	 * rotation/non-rotational disks depending on workload.
 	 */
 	if (best_disk == -1) {
 		if (has_nonrot_disk)
-			best_disk = best_pending_disk;
+			best_disk = best_load_disk;
 		else
 			best_disk = best_dist_disk;
 	}
@@ -695,6 +702,7 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			conf->mirrors[best_disk].seq_start = this_sector;
 
 		conf->mirrors[best_disk].next_seq_sect = this_sector + sectors;
+		r1_bio->read_start = local_clock();
 	}
 	rcu_read_unlock();
 	*max_sectors = sectors;
@@ -135,6 +135,7 @@ struct r1bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_disk;
+	u64			read_start;	/* local_clock() at read_balance() */
 
 	struct list_head	retry_list;
 	/* Next two are only valid when R1BIO_BehindIO is set */
@@ -375,6 +375,7 @@ static void raid10_end_read_request(struct bio *bio, int error)
 	update_head_pos(slot, r10_bio);
 
 	if (uptodate) {
+		md_rdev_read_done(rdev, r10_bio->read_start);
 		/*
 		 * Set R10BIO_Uptodate in our master bio, so that
 		 * we will return a good error code to the higher
@@ -789,8 +790,11 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	int best_good_sectors;
 	sector_t new_distance, best_dist;
 	struct md_rdev *best_rdev, *rdev = NULL;
+	struct md_rdev *best_load_rdev;
 	int do_balance;
-	int best_slot;
+	int best_slot, best_load_slot;
+	int has_nonrot_disk;
+	u64 load, min_load;
 	struct geom *geo = &conf->geo;
 
 	raid10_find_phys(conf, r10_bio);
@@ -800,6 +804,10 @@ retry:
 	best_slot = -1;
 	best_rdev = NULL;
 	best_dist = MaxSector;
+	best_load_slot = -1;
+	best_load_rdev = NULL;
+	min_load = U64_MAX;
+	has_nonrot_disk = 0;
 	best_good_sectors = 0;
 	do_balance = 1;
 	/*
@@ -868,6 +876,22 @@ retry:
 		if (!do_balance)
 			break;
 
+		load = md_rdev_read_load(rdev);
+		if (load < min_load) {
+			min_load = load;
+			best_load_slot = slot;
+			best_load_rdev = rdev;
+		}
+
+		/* Non-rotational devices have no head position to care
+		 * about.  If there is any, pick the device with the least
+		 * latency-weighted queue instead, like raid1 does.
+		 */
+		if (blk_queue_nonrot(bdev_get_queue(rdev->bdev))) {
+			has_nonrot_disk = 1;
+			continue;
+		}
+
 		/* This optimisation is debatable, and completely destroys
 		 * sequential read speed for 'far copies' arrays.  So only
 		 * keep it for 'near' arrays, and review those later.
@@ -888,8 +912,13 @@ retry:
 		}
 	}
 	if (slot >= conf->copies) {
-		slot = best_slot;
-		rdev = best_rdev;
+		if (has_nonrot_disk) {
+			slot = best_load_slot;
+			rdev = best_load_rdev;
+		} else {
+			slot = best_slot;
+			rdev = best_rdev;
+		}
 	}
 
 	if (slot >= 0) {
@@ -902,6 +931,7 @@ retry:
 			goto retry;
 		}
 		r10_bio->read_slot = slot;
+		r10_bio->read_start = local_clock();
 	} else
 		rdev = NULL;
 	rcu_read_unlock();
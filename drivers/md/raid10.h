@@ -105,6 +105,7 @@ struct r10bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_slot;
+	u64			read_start;	/* local_clock() at read_balance() */
 
 	struct list_head	retry_list;
 	/*
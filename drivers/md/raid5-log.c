@@ -0,0 +1,955 @@
+/*
+ * raid5-log.c : write-back log for md raid4/5/6
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * Small writes are appended to a log on a fast device (typically an SSD)
+ * and completed as soon as they are on stable storage there.  They are
+ * then written to the array in batches, under one plug, so that writes
+ * to the same stripe meet in the stripe cache and a read-modify-write
+ * turns into a single reconstruct-write.
+ *
+ * The log device starts with a superblock block, the rest of it is a
+ * ring of records.  A record is a header block followed by the data,
+ * padded to whole blocks.  Records carry a sequence number and a
+ * checksum, so that when the log is attached again after a crash the
+ * records from the superblock's tail on are found and written to the
+ * array again.
+ *
+ * The log only holds data, parity is not logged.  A record is freed, and
+ * the superblock tail moved past it, only once its write reached the
+ * array, so no write that was completed is ever lost.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/slab.h>
+#include <linux/crc32c.h>
+#include <linux/random.h>
+#include <linux/interval_tree_generic.h>
+#include "md.h"
+#include "raid5.h"
+
+#define R5L_MAGIC		0x6c356472	/* "rd5l" */
+#define R5L_VERSION		1
+
+#define R5L_BLOCK_SECTORS	(PAGE_SIZE >> 9)
+#define R5L_MIN_BLOCKS		1024
+
+/* writes up to this size, and smaller than a full stripe, are logged */
+#define R5L_MAX_WRITE		(64 * 1024)
+#define R5L_MAX_PAGES		(R5L_MAX_WRITE / PAGE_SIZE + 1)
+
+/* pages held by writes that haven't reached the array */
+#define R5L_MAX_INFLIGHT_PAGES	16384
+
+/*
+ * Logged writes are held for up to R5L_ISSUE_DELAY to give the rest of
+ * their stripe a chance to arrive, or until R5L_ISSUE_BATCH pages are
+ * waiting.
+ */
+#define R5L_ISSUE_DELAY		(HZ / 50)
+#define R5L_ISSUE_BATCH		256
+
+struct r5l_super {
+	__le32 magic;
+	__le32 version;
+	__le32 block_size;
+	__le32 crc;
+	__u8 uuid[16];
+	__le64 nr_blocks;
+	__le64 tail;		/* block of the oldest record still needed */
+	__le64 tail_seq;	/* and its sequence number */
+};
+
+struct r5l_record {
+	__le32 magic;
+	__le32 crc;		/* of the data, then this header */
+	__le64 seq;
+	__le64 sector;		/* on the array */
+	__le32 nr_sectors;
+	__le32 pad;
+};
+
+enum r5l_state {
+	R5L_LOGGING,		/* being written to the log */
+	R5L_LOGGED,		/* on the log, waiting to be issued */
+	R5L_ISSUED,		/* being written to the array */
+	R5L_DONE,		/* on the array, waiting for reclaim */
+};
+
+struct r5l_entry {
+	struct list_head list;		/* all entries, in log order */
+	struct list_head pending_list;	/* logging or logged */
+	struct rb_node rb;
+	sector_t start, last;		/* array sectors, inclusive */
+	sector_t subtree_last;
+
+	struct r5l_log *log;
+	struct bio *bio;		/* the user's bio, until completed */
+	u64 seq;
+	sector_t pos;			/* log block of the header */
+	unsigned nr_sectors;
+	enum r5l_state state;
+	int error;
+
+	unsigned nr_pages;		/* header and data */
+	struct page *pages[0];
+};
+
+struct r5l_log {
+	struct r5conf *conf;
+	struct block_device *bdev;
+	struct block_device *md_bdev;
+	sector_t nr_blocks;
+	u32 seed;
+
+	spinlock_t lock;
+	struct list_head entries;
+	struct list_head pending;
+	struct rb_root tree;
+	sector_t head;			/* block of the next record */
+	u64 seq;			/* of the next record */
+	unsigned nr_pages;		/* held by entries not done */
+	unsigned nr_logged;		/* pages logged, not issued */
+	unsigned nr_undone;		/* entries not done */
+	bool failed;
+
+	wait_queue_head_t wait;
+	struct workqueue_struct *wq;
+	struct bio_list log_bios;	/* waiting for submit_work */
+	struct work_struct submit_work;
+	struct delayed_work issue_work;
+	struct work_struct reclaim_work;
+
+	struct page *sb_page;
+};
+
+#define R5L_START(e) ((e)->start)
+#define R5L_LAST(e) ((e)->last)
+INTERVAL_TREE_DEFINE(struct r5l_entry, rb, sector_t, subtree_last,
+		     R5L_START, R5L_LAST, static, r5l_tree);
+
+static void r5l_array_endio(struct bio *bio, int error);
+
+/*
+ * Allocate a bio for @bytes of @pages.  The array bypasses
+ * bio_add_page(), raid5 takes bios of any size.
+ */
+static struct bio *r5l_alloc_bio(struct block_device *bdev, sector_t sector,
+				 struct page **pages, unsigned bytes,
+				 bool to_array)
+{
+	unsigned nr = DIV_ROUND_UP(bytes, PAGE_SIZE);
+	struct bio *bio;
+	unsigned i, len;
+
+	bio = bio_alloc(GFP_NOIO, nr);
+	if (!bio)
+		return NULL;
+
+	bio->bi_bdev = bdev;
+	bio->bi_iter.bi_sector = sector;
+	for (i = 0; i < nr; i++, bytes -= len) {
+		len = min_t(unsigned, bytes, PAGE_SIZE);
+		if (to_array) {
+			bio->bi_io_vec[i].bv_page = pages[i];
+			bio->bi_io_vec[i].bv_len = len;
+			bio->bi_io_vec[i].bv_offset = 0;
+			bio->bi_vcnt++;
+			bio->bi_iter.bi_size += len;
+		} else if (bio_add_page(bio, pages[i], len, 0) != len) {
+			bio_put(bio);
+			return NULL;
+		}
+	}
+
+	return bio;
+}
+
+static int r5l_rw_pages(struct block_device *bdev, sector_t sector,
+			struct page **pages, unsigned bytes, int rw,
+			bool to_array)
+{
+	struct bio *bio;
+	int ret;
+
+	bio = r5l_alloc_bio(bdev, sector, pages, bytes, to_array);
+	if (!bio)
+		return -ENOMEM;
+
+	ret = submit_bio_wait(rw, bio);
+	bio_put(bio);
+
+	return ret;
+}
+
+static u32 r5l_data_crc(struct r5l_log *log, struct page **pages,
+			unsigned bytes)
+{
+	u32 crc = log->seed;
+	unsigned i, len;
+
+	for (i = 0; bytes; i++, bytes -= len) {
+		len = min_t(unsigned, bytes, PAGE_SIZE);
+		crc = crc32c(crc, page_address(pages[i]), len);
+	}
+
+	return crc;
+}
+
+static u32 r5l_record_crc(struct r5l_record *rec, u32 crc)
+{
+	__le32 saved = rec->crc;
+
+	rec->crc = 0;
+	crc = crc32c(crc, rec, sizeof(*rec));
+	rec->crc = saved;
+
+	return crc;
+}
+
+static int r5l_write_super(struct r5l_log *log, sector_t tail, u64 tail_seq)
+{
+	struct r5l_super *sb = page_address(log->sb_page);
+	int ret;
+
+	sb->tail = cpu_to_le64(tail);
+	sb->tail_seq = cpu_to_le64(tail_seq);
+	sb->crc = 0;
+	sb->crc = cpu_to_le32(crc32c(~0, sb, sizeof(*sb)));
+
+	ret = r5l_rw_pages(log->bdev, 0, &log->sb_page, PAGE_SIZE,
+			   WRITE_FUA, false);
+	if (ret)
+		printk(KERN_ERR "md/raid:%s: failed to write log superblock: %d\n",
+		       mdname(log->conf->mddev), ret);
+	return ret;
+}
+
+/*----------------------------------------------------------------*/
+
+static void r5l_free_entry(struct r5l_entry *e)
+{
+	unsigned i;
+
+	for (i = 0; i < e->nr_pages; i++)
+		if (e->pages[i])
+			__free_page(e->pages[i]);
+	kfree(e);
+}
+
+static struct r5l_entry *r5l_alloc_entry(struct r5l_log *log, struct bio *bio)
+{
+	unsigned nr_sectors = bio_sectors(bio);
+	unsigned nr_pages = 1 + DIV_ROUND_UP(nr_sectors, R5L_BLOCK_SECTORS);
+	struct r5l_entry *e;
+	unsigned i;
+
+	e = kzalloc(sizeof(*e) + nr_pages * sizeof(struct page *), GFP_NOIO);
+	if (!e)
+		return NULL;
+
+	e->log = log;
+	e->bio = bio;
+	e->start = bio->bi_iter.bi_sector;
+	e->last = e->start + nr_sectors - 1;
+	e->nr_sectors = nr_sectors;
+	e->nr_pages = nr_pages;
+
+	for (i = 0; i < nr_pages; i++) {
+		/* the header and the tail of the data are zero padded */
+		gfp_t gfp = (i == 0 || i == nr_pages - 1) ?
+			GFP_NOIO | __GFP_ZERO : GFP_NOIO;
+
+		e->pages[i] = alloc_page(gfp);
+		if (!e->pages[i]) {
+			r5l_free_entry(e);
+			return NULL;
+		}
+	}
+
+	return e;
+}
+
+static void r5l_copy_bio(struct r5l_entry *e, struct bio *bio)
+{
+	struct bio_vec bv;
+	struct bvec_iter iter;
+	unsigned off = 0;
+
+	bio_for_each_segment(bv, bio, iter) {
+		char *src = kmap_atomic(bv.bv_page);
+		unsigned done = 0;
+
+		while (done < bv.bv_len) {
+			unsigned poff = off & (PAGE_SIZE - 1);
+			unsigned len = min_t(unsigned, bv.bv_len - done,
+					     PAGE_SIZE - poff);
+			char *dst = page_address(e->pages[1 + (off >> PAGE_SHIFT)]);
+
+			memcpy(dst + poff, src + bv.bv_offset + done, len);
+			done += len;
+			off += len;
+		}
+		kunmap_atomic(src);
+	}
+}
+
+/*
+ * Find @nr contiguous free blocks at the head of the ring, wrapping
+ * to the first block after the superblock if they don't fit at the end.
+ * The head never catches up with the tail, so a full ring can't be
+ * mistaken for an empty one.  Must be called with log->lock held.
+ */
+static bool r5l_find_space(struct r5l_log *log, unsigned nr, sector_t *pos)
+{
+	sector_t head = log->head;
+	sector_t tail;
+
+	if (list_empty(&log->entries)) {
+		*pos = head + nr <= log->nr_blocks ? head : 1;
+		return true;
+	}
+
+	tail = list_first_entry(&log->entries, struct r5l_entry, list)->pos;
+	if (head > tail) {
+		if (head + nr <= log->nr_blocks) {
+			*pos = head;
+			return true;
+		}
+		if (1 + nr < tail) {
+			*pos = 1;
+			return true;
+		}
+		return false;
+	}
+
+	if (head + nr < tail) {
+		*pos = head;
+		return true;
+	}
+	return false;
+}
+
+static bool r5l_try_reserve(struct r5l_log *log, struct r5l_entry *e, int *ret)
+{
+	sector_t pos;
+
+	spin_lock_irq(&log->lock);
+	if (log->failed) {
+		*ret = -EIO;
+		goto done;
+	}
+
+	if (log->nr_pages + e->nr_pages > R5L_MAX_INFLIGHT_PAGES ||
+	    !r5l_find_space(log, e->nr_pages, &pos)) {
+		spin_unlock_irq(&log->lock);
+		return false;
+	}
+
+	e->pos = pos;
+	e->seq = log->seq++;
+	e->state = R5L_LOGGING;
+	log->head = pos + e->nr_pages;
+	log->nr_pages += e->nr_pages;
+	log->nr_undone++;
+	list_add_tail(&e->list, &log->entries);
+	list_add_tail(&e->pending_list, &log->pending);
+	r5l_tree_insert(e, &log->tree);
+	*ret = 0;
+done:
+	spin_unlock_irq(&log->lock);
+	return true;
+}
+
+static void r5l_log_endio(struct bio *bio, int error)
+{
+	struct r5l_entry *e = bio->bi_private;
+	struct r5l_log *log = e->log;
+	struct bio *orig = NULL;
+	unsigned long flags;
+	bool kick;
+
+	bio_put(bio);
+
+	spin_lock_irqsave(&log->lock, flags);
+	if (error) {
+		/* the user's bio completes when the array write does */
+		if (!log->failed)
+			printk(KERN_ERR "md/raid:%s: log write failed: %d, bypassing log\n",
+			       mdname(log->conf->mddev), error);
+		log->failed = true;
+	} else {
+		orig = e->bio;
+		e->bio = NULL;
+	}
+	e->state = R5L_LOGGED;
+	log->nr_logged += e->nr_pages;
+	kick = log->nr_logged >= R5L_ISSUE_BATCH;
+	spin_unlock_irqrestore(&log->lock, flags);
+
+	if (orig)
+		bio_endio(orig, 0);
+
+	if (kick)
+		mod_delayed_work(log->wq, &log->issue_work, 0);
+	else
+		queue_delayed_work(log->wq, &log->issue_work, R5L_ISSUE_DELAY);
+}
+
+/*
+ * Returns 0 once the write is on its way to the log.
+ */
+static int r5l_log_write(struct r5l_log *log, struct bio *bio)
+{
+	struct r5l_entry *e;
+	struct r5l_record *rec;
+	struct bio *lbio;
+	u32 crc;
+	int ret;
+
+	e = r5l_alloc_entry(log, bio);
+	if (!e)
+		return -ENOMEM;
+
+	r5l_copy_bio(e, bio);
+
+	lbio = r5l_alloc_bio(log->bdev, 0, e->pages, e->nr_pages * PAGE_SIZE, false);
+	if (!lbio) {
+		r5l_free_entry(e);
+		return -ENOMEM;
+	}
+
+	if (!r5l_try_reserve(log, e, &ret)) {
+		mod_delayed_work(log->wq, &log->issue_work, 0);
+		wait_event(log->wait, r5l_try_reserve(log, e, &ret));
+	}
+	if (ret) {
+		bio_put(lbio);
+		r5l_free_entry(e);
+		return ret;
+	}
+
+	rec = page_address(e->pages[0]);
+	rec->magic = cpu_to_le32(R5L_MAGIC);
+	rec->seq = cpu_to_le64(e->seq);
+	rec->sector = cpu_to_le64(e->start);
+	rec->nr_sectors = cpu_to_le32(e->nr_sectors);
+	crc = r5l_data_crc(log, e->pages + 1, e->nr_sectors << 9);
+	rec->crc = cpu_to_le32(r5l_record_crc(rec, crc));
+
+	lbio->bi_iter.bi_sector = e->pos * R5L_BLOCK_SECTORS;
+	lbio->bi_rw = WRITE_FUA;
+	lbio->bi_end_io = r5l_log_endio;
+	lbio->bi_private = e;
+
+	spin_lock_irq(&log->lock);
+	bio_list_add(&log->log_bios, lbio);
+	spin_unlock_irq(&log->lock);
+	queue_work(log->wq, &log->submit_work);
+
+	return 0;
+}
+
+/*
+ * Log writes are submitted from a work item: from make_request() they
+ * would only be dispatched once it returns, and a later bio on the same
+ * current->bio_list waiting for log space would wait for them forever.
+ */
+static void r5l_submit_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(work, struct r5l_log, submit_work);
+	struct blk_plug plug;
+	struct bio_list bios;
+	struct bio *bio;
+
+	spin_lock_irq(&log->lock);
+	bios = log->log_bios;
+	bio_list_init(&log->log_bios);
+	spin_unlock_irq(&log->lock);
+
+	blk_start_plug(&plug);
+	while ((bio = bio_list_pop(&bios)))
+		submit_bio(bio->bi_rw, bio);
+	blk_finish_plug(&plug);
+}
+
+/*----------------------------------------------------------------*/
+
+static void r5l_array_endio(struct bio *bio, int error)
+{
+	struct r5l_entry *e = bio->bi_private;
+	struct r5l_log *log = e->log;
+	struct bio *orig;
+	unsigned long flags;
+	unsigned i;
+
+	bio_put(bio);
+
+	spin_lock_irqsave(&log->lock, flags);
+	orig = e->bio;
+	e->bio = NULL;
+	e->error = error;
+	e->state = R5L_DONE;
+	log->nr_pages -= e->nr_pages;
+	log->nr_undone--;
+	if (error && !log->failed) {
+		printk(KERN_ERR "md/raid:%s: write of logged data failed: %d\n",
+		       mdname(log->conf->mddev), error);
+		log->failed = true;
+	}
+	spin_unlock_irqrestore(&log->lock, flags);
+
+	if (orig)
+		bio_endio(orig, error);
+
+	/* only the entry itself is needed until reclaim */
+	for (i = 0; i < e->nr_pages; i++) {
+		__free_page(e->pages[i]);
+		e->pages[i] = NULL;
+	}
+
+	wake_up(&log->wait);
+	queue_work(log->wq, &log->reclaim_work);
+}
+
+/*
+ * Write logged entries to the array in log order, stopping at the first
+ * one still on its way to the log.  They are issued straight to the
+ * personality, like md_make_request() would, so that they make progress
+ * while the array is being suspended.
+ */
+static void r5l_issue_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(to_delayed_work(work),
+					   struct r5l_log, issue_work);
+	struct mddev *mddev = log->conf->mddev;
+	struct r5l_entry *e;
+	struct blk_plug plug;
+	struct bio *bio;
+
+	blk_start_plug(&plug);
+	for (;;) {
+		spin_lock_irq(&log->lock);
+		e = list_first_entry_or_null(&log->pending, struct r5l_entry,
+					     pending_list);
+		if (!e || e->state != R5L_LOGGED) {
+			spin_unlock_irq(&log->lock);
+			break;
+		}
+		list_del(&e->pending_list);
+		e->state = R5L_ISSUED;
+		log->nr_logged -= e->nr_pages;
+		spin_unlock_irq(&log->lock);
+
+		/* can't fail, bio_alloc() waits on the mempool for GFP_NOIO */
+		bio = r5l_alloc_bio(log->md_bdev, e->start, e->pages + 1,
+				    e->nr_sectors << 9, true);
+		bio->bi_rw = WRITE;
+		bio->bi_end_io = r5l_array_endio;
+		bio->bi_private = e;
+		mddev->pers->make_request(mddev, bio);
+	}
+	blk_finish_plug(&plug);
+}
+
+/*
+ * Move the superblock tail past the entries at the start of the log that
+ * reached the array, then free them.
+ */
+static void r5l_reclaim_work(struct work_struct *work)
+{
+	struct r5l_log *log = container_of(work, struct r5l_log, reclaim_work);
+	struct r5l_entry *e, *last = NULL, *tmp;
+	sector_t tail;
+	u64 tail_seq;
+	LIST_HEAD(done);
+
+	spin_lock_irq(&log->lock);
+	list_for_each_entry(e, &log->entries, list) {
+		if (e->state != R5L_DONE || e->error)
+			break;
+		last = e;
+	}
+	if (!last) {
+		spin_unlock_irq(&log->lock);
+		return;
+	}
+	if (list_is_last(&last->list, &log->entries)) {
+		tail = log->head;
+		tail_seq = log->seq;
+	} else {
+		e = list_next_entry(last, list);
+		tail = e->pos;
+		tail_seq = e->seq;
+	}
+	spin_unlock_irq(&log->lock);
+
+	/*
+	 * The entries stay in the log, and keep their space, until the
+	 * superblock no longer points at them.
+	 */
+	if (r5l_write_super(log, tail, tail_seq)) {
+		spin_lock_irq(&log->lock);
+		log->failed = true;
+		spin_unlock_irq(&log->lock);
+		wake_up(&log->wait);
+		return;
+	}
+
+	spin_lock_irq(&log->lock);
+	list_cut_position(&done, &log->entries, &last->list);
+	list_for_each_entry(e, &done, list)
+		r5l_tree_remove(e, &log->tree);
+	spin_unlock_irq(&log->lock);
+
+	list_for_each_entry_safe(e, tmp, &done, list)
+		kfree(e);
+
+	wake_up(&log->wait);
+}
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Reads have to wait for logged writes they overlap to reach the array.
+ * Writes that bypass the log have to wait until the log no longer holds
+ * any overlapping record, or a replay could overwrite them.
+ */
+static bool r5l_overlaps(struct r5l_log *log, sector_t start, sector_t last,
+			 bool write)
+{
+	struct r5l_entry *e;
+	bool ret = false;
+
+	spin_lock_irq(&log->lock);
+	for (e = r5l_tree_iter_first(&log->tree, start, last); e;
+	     e = r5l_tree_iter_next(e, start, last))
+		if (!e->error && (write || e->state != R5L_DONE)) {
+			ret = true;
+			break;
+		}
+	spin_unlock_irq(&log->lock);
+
+	return ret;
+}
+
+static bool r5l_want_log(struct r5l_log *log, struct bio *bio)
+{
+	struct r5conf *conf = log->conf;
+	unsigned data_disks = conf->raid_disks - conf->max_degraded;
+
+	return bio_data_dir(bio) == WRITE &&
+		!(bio->bi_rw & REQ_DISCARD) &&
+		bio->bi_iter.bi_size &&
+		bio->bi_iter.bi_size <= R5L_MAX_WRITE &&
+		bio_sectors(bio) < conf->chunk_sectors * data_disks &&
+		!ACCESS_ONCE(log->failed);
+}
+
+/*
+ * Called by make_request() for every bio.  Returns true if the bio was
+ * taken by the log.
+ */
+bool r5l_handle_bio(struct r5l_log *log, struct bio *bio)
+{
+	sector_t start = bio->bi_iter.bi_sector;
+
+	/* one of our own writes */
+	if (bio->bi_end_io == r5l_array_endio)
+		return false;
+
+	if (r5l_want_log(log, bio) && !r5l_log_write(log, bio))
+		return true;
+
+	if (!bio_sectors(bio) || RB_EMPTY_ROOT(&log->tree))
+		return false;
+
+	if (r5l_overlaps(log, start, bio_end_sector(bio) - 1,
+			 bio_data_dir(bio) == WRITE)) {
+		mod_delayed_work(log->wq, &log->issue_work, 0);
+		wait_event(log->wait,
+			   !r5l_overlaps(log, start, bio_end_sector(bio) - 1,
+					 bio_data_dir(bio) == WRITE));
+	}
+
+	return false;
+}
+
+dev_t r5l_device(struct r5l_log *log)
+{
+	return log->bdev->bd_dev;
+}
+
+/*----------------------------------------------------------------*/
+
+static bool r5l_record_valid(struct r5l_log *log, struct r5l_record *rec,
+			     sector_t pos, u64 seq)
+{
+	unsigned nr_sectors = le32_to_cpu(rec->nr_sectors);
+
+	return le32_to_cpu(rec->magic) == R5L_MAGIC &&
+		le64_to_cpu(rec->seq) == seq &&
+		nr_sectors && nr_sectors <= (R5L_MAX_WRITE >> 9) &&
+		le64_to_cpu(rec->sector) + nr_sectors <= log->conf->mddev->array_sectors &&
+		pos + 1 + DIV_ROUND_UP(nr_sectors, R5L_BLOCK_SECTORS) <= log->nr_blocks;
+}
+
+/*
+ * Write every record from the tail on to the array again.  Records that
+ * had already reached it are written twice, which is harmless as they
+ * are replayed in order.
+ */
+static int r5l_recover(struct r5l_log *log, sector_t pos, u64 seq)
+{
+	struct page *pages[R5L_MAX_PAGES];
+	struct r5l_record *rec;
+	unsigned nr_sectors, nr_data, i, count = 0;
+	bool wrapped = false;
+	int ret = 0;
+
+	memset(pages, 0, sizeof(pages));
+	for (i = 0; i < R5L_MAX_PAGES; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+	rec = page_address(pages[0]);
+
+	for (;;) {
+		if (pos >= log->nr_blocks)
+			pos = 1;
+
+		ret = r5l_rw_pages(log->bdev, pos * R5L_BLOCK_SECTORS, pages,
+				   PAGE_SIZE, READ, false);
+		if (ret)
+			goto out;
+
+		if (!r5l_record_valid(log, rec, pos, seq)) {
+			/* the writer wraps when a record doesn't fit */
+			if (pos == 1 || wrapped)
+				break;
+			pos = 1;
+			wrapped = true;
+			continue;
+		}
+
+		nr_sectors = le32_to_cpu(rec->nr_sectors);
+		nr_data = DIV_ROUND_UP(nr_sectors, R5L_BLOCK_SECTORS);
+		ret = r5l_rw_pages(log->bdev, (pos + 1) * R5L_BLOCK_SECTORS,
+				   pages + 1, nr_sectors << 9, READ, false);
+		if (ret)
+			goto out;
+
+		if (le32_to_cpu(rec->crc) !=
+		    r5l_record_crc(rec, r5l_data_crc(log, pages + 1, nr_sectors << 9)))
+			break;
+
+		ret = r5l_rw_pages(log->md_bdev, le64_to_cpu(rec->sector),
+				   pages + 1, nr_sectors << 9, WRITE, true);
+		if (ret) {
+			printk(KERN_ERR "md/raid:%s: failed to replay log: %d\n",
+			       mdname(log->conf->mddev), ret);
+			goto out;
+		}
+
+		count++;
+		wrapped = false;
+		pos += 1 + nr_data;
+		seq++;
+	}
+
+	if (count)
+		printk(KERN_INFO "md/raid:%s: replayed %u writes from log\n",
+		       mdname(log->conf->mddev), count);
+
+	log->head = pos;
+	log->seq = seq;
+	ret = r5l_write_super(log, pos, seq);
+out:
+	for (i = 0; i < R5L_MAX_PAGES; i++)
+		if (pages[i])
+			__free_page(pages[i]);
+	return ret;
+}
+
+/*
+ * Read the log superblock, formatting the log if it has none, and replay
+ * what has been left in it.
+ */
+static int r5l_load_super(struct r5l_log *log)
+{
+	struct mddev *mddev = log->conf->mddev;
+	struct r5l_super *sb = page_address(log->sb_page);
+	sector_t nr_blocks = i_size_read(log->bdev->bd_inode) >> PAGE_SHIFT;
+	u32 crc;
+	u64 seq;
+	int ret;
+
+	ret = r5l_rw_pages(log->bdev, 0, &log->sb_page, PAGE_SIZE, READ, false);
+	if (ret)
+		return ret;
+
+	crc = le32_to_cpu(sb->crc);
+	sb->crc = 0;
+	if (le32_to_cpu(sb->magic) != R5L_MAGIC ||
+	    crc != crc32c(~0, sb, sizeof(*sb))) {
+		printk(KERN_INFO "md/raid:%s: formatting log device\n",
+		       mdname(mddev));
+		memset(sb, 0, PAGE_SIZE);
+		sb->magic = cpu_to_le32(R5L_MAGIC);
+		sb->version = cpu_to_le32(R5L_VERSION);
+		sb->block_size = cpu_to_le32(PAGE_SIZE);
+		memcpy(sb->uuid, mddev->uuid, sizeof(sb->uuid));
+		sb->nr_blocks = cpu_to_le64(nr_blocks);
+		log->nr_blocks = nr_blocks;
+
+		get_random_bytes(&seq, sizeof(seq));
+		log->head = 1;
+		log->seq = seq;
+		return r5l_write_super(log, log->head, log->seq);
+	}
+
+	if (le32_to_cpu(sb->version) != R5L_VERSION ||
+	    le32_to_cpu(sb->block_size) != PAGE_SIZE) {
+		printk(KERN_ERR "md/raid:%s: unsupported log format\n",
+		       mdname(mddev));
+		return -EINVAL;
+	}
+
+	if (memcmp(sb->uuid, mddev->uuid, sizeof(sb->uuid))) {
+		printk(KERN_ERR "md/raid:%s: log device belongs to another array\n",
+		       mdname(mddev));
+		return -EINVAL;
+	}
+
+	log->nr_blocks = le64_to_cpu(sb->nr_blocks);
+	if (log->nr_blocks > nr_blocks || log->nr_blocks < R5L_MIN_BLOCKS ||
+	    le64_to_cpu(sb->tail) >= log->nr_blocks) {
+		printk(KERN_ERR "md/raid:%s: log superblock is inconsistent\n",
+		       mdname(mddev));
+		return -EINVAL;
+	}
+
+	return r5l_recover(log, le64_to_cpu(sb->tail), le64_to_cpu(sb->tail_seq));
+}
+
+/*
+ * Attach the log device @dev to the array.  The caller makes sure that
+ * the array is neither stopped nor reshaped to another level meanwhile.
+ */
+struct r5l_log *r5l_init(struct r5conf *conf, dev_t dev)
+{
+	struct mddev *mddev = conf->mddev;
+	struct r5l_log *log;
+	int ret;
+
+	if (!mddev->gendisk)
+		return ERR_PTR(-EINVAL);
+
+	log = kzalloc(sizeof(*log), GFP_KERNEL);
+	if (!log)
+		return ERR_PTR(-ENOMEM);
+
+	log->conf = conf;
+	log->seed = crc32c(~0, mddev->uuid, sizeof(mddev->uuid));
+	spin_lock_init(&log->lock);
+	INIT_LIST_HEAD(&log->entries);
+	INIT_LIST_HEAD(&log->pending);
+	log->tree = RB_ROOT;
+	init_waitqueue_head(&log->wait);
+	bio_list_init(&log->log_bios);
+	INIT_WORK(&log->submit_work, r5l_submit_work);
+	INIT_DELAYED_WORK(&log->issue_work, r5l_issue_work);
+	INIT_WORK(&log->reclaim_work, r5l_reclaim_work);
+
+	ret = -ENOMEM;
+	log->sb_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+	if (!log->sb_page)
+		goto out_free;
+
+	log->wq = alloc_workqueue("md_r5l", WQ_MEM_RECLAIM | WQ_HIGHPRI, 0);
+	if (!log->wq)
+		goto out_free_page;
+
+	log->bdev = blkdev_get_by_dev(dev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, log);
+	if (IS_ERR(log->bdev)) {
+		ret = PTR_ERR(log->bdev);
+		goto out_destroy_wq;
+	}
+
+	if ((i_size_read(log->bdev->bd_inode) >> PAGE_SHIFT) < R5L_MIN_BLOCKS) {
+		ret = -ENOSPC;
+		goto out_put_bdev;
+	}
+
+	/* replayed and logged writes are submitted to the array itself */
+	ret = -ENODEV;
+	log->md_bdev = bdget_disk(mddev->gendisk, 0);
+	if (!log->md_bdev)
+		goto out_put_bdev;
+	ret = blkdev_get(log->md_bdev, FMODE_READ | FMODE_WRITE, NULL);
+	if (ret)
+		goto out_put_bdev;
+
+	ret = r5l_load_super(log);
+	if (ret)
+		goto out_put_md_bdev;
+
+	return log;
+
+out_put_md_bdev:
+	blkdev_put(log->md_bdev, FMODE_READ | FMODE_WRITE);
+out_put_bdev:
+	blkdev_put(log->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+out_destroy_wq:
+	destroy_workqueue(log->wq);
+out_free_page:
+	__free_page(log->sb_page);
+out_free:
+	kfree(log);
+	return ERR_PTR(ret);
+}
+
+static bool r5l_drained(struct r5l_log *log)
+{
+	bool ret;
+
+	spin_lock_irq(&log->lock);
+	ret = !log->nr_undone;
+	spin_unlock_irq(&log->lock);
+
+	return ret;
+}
+
+/*
+ * Detach the log.  No new bios may reach r5l_handle_bio().  All logged
+ * writes are written to the array first, which leaves the log clean.
+ */
+void r5l_exit(struct r5l_log *log)
+{
+	struct r5l_entry *e, *tmp;
+
+	mod_delayed_work(log->wq, &log->issue_work, 0);
+	wait_event(log->wait, r5l_drained(log));
+	queue_work(log->wq, &log->reclaim_work);
+	flush_workqueue(log->wq);
+
+	if (!list_empty(&log->entries))
+		printk(KERN_WARNING "md/raid:%s: log detached with failed writes, "
+		       "they will be replayed when it is attached again\n",
+		       mdname(log->conf->mddev));
+	list_for_each_entry_safe(e, tmp, &log->entries, list)
+		kfree(e);
+
+	destroy_workqueue(log->wq);
+	blkdev_put(log->md_bdev, FMODE_READ | FMODE_WRITE);
+	blkdev_put(log->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	__free_page(log->sb_page);
+	kfree(log);
+}
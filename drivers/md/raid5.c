@@ -4596,6 +4596,9 @@ static void make_request(struct mddev *mddev, struct bio * bi)
 		return;
 	}
 
+	if (conf->log && r5l_handle_bio(conf->log, bi))
+		return;
+
 	md_write_start(mddev, bi);
 
 	if (rw == READ &&
@@ -5519,12 +5522,98 @@ raid5_group_thread_cnt = __ATTR(group_thread_cnt, S_IRUGO | S_IWUSR,
 				raid5_show_group_thread_cnt,
 				raid5_store_group_thread_cnt);
 
+static ssize_t
+raid5_show_log_device(struct mddev *mddev, char *page)
+{
+	struct r5conf *conf = mddev->private;
+	dev_t dev;
+
+	if (!conf)
+		return 0;
+	if (!conf->log)
+		return sprintf(page, "none\n");
+	dev = r5l_device(conf->log);
+	return sprintf(page, "%d:%d\n", MAJOR(dev), MINOR(dev));
+}
+
+/*
+ * Attaching a log replays it, and detaching one waits for the logged
+ * writes to reach the array, both of which need the md thread to be
+ * able to update the superblock.  So the reconfig_mutex is dropped
+ * around them; MD_HAS_LOG keeps the array from being stopped or taken
+ * over meanwhile.
+ */
+static ssize_t
+raid5_store_log_device(struct mddev *mddev, const char *page, size_t len)
+{
+	struct r5conf *conf = mddev->private;
+	struct r5l_log *log;
+	unsigned int major, minor;
+	dev_t dev = 0;
+	char c = 0;
+
+	if (len >= PAGE_SIZE)
+		return -EINVAL;
+	if (!conf)
+		return -ENODEV;
+
+	if (!sysfs_streq(page, "none")) {
+		if (sscanf(page, "%u:%u%c", &major, &minor, &c) < 2 ||
+		    (c && c != '\n'))
+			return -EINVAL;
+		dev = MKDEV(major, minor);
+		if (MAJOR(dev) != major || MINOR(dev) != minor)
+			return -EOVERFLOW;
+	}
+
+	if (!dev) {
+		log = conf->log;
+		if (!log)
+			return len;
+
+		mddev_suspend(mddev);
+		conf->log = NULL;
+		mddev_resume(mddev);
+
+		mddev_unlock(mddev);
+		r5l_exit(log);
+		mutex_lock(&mddev->reconfig_mutex);
+		clear_bit(MD_HAS_LOG, &mddev->flags);
+		return len;
+	}
+
+	if (mddev->ro == 1)
+		return -EROFS;
+	if (test_and_set_bit(MD_HAS_LOG, &mddev->flags))
+		return -EBUSY;
+
+	mddev_unlock(mddev);
+	log = r5l_init(conf, dev);
+	mutex_lock(&mddev->reconfig_mutex);
+	if (IS_ERR(log)) {
+		clear_bit(MD_HAS_LOG, &mddev->flags);
+		return PTR_ERR(log);
+	}
+
+	mddev_suspend(mddev);
+	conf->log = log;
+	mddev_resume(mddev);
+
+	return len;
+}
+
+static struct md_sysfs_entry
+raid5_log_device = __ATTR(log_device, S_IRUGO | S_IWUSR,
+			  raid5_show_log_device,
+			  raid5_store_log_device);
+
 static struct attribute *raid5_attrs[] =  {
 	&raid5_stripecache_size.attr,
 	&raid5_stripecache_active.attr,
 	&raid5_preread_bypass_threshold.attr,
 	&raid5_group_thread_cnt.attr,
 	&raid5_skip_copy.attr,
+	&raid5_log_device.attr,
 	NULL,
 };
 static struct attribute_group raid5_attrs_group = {
@@ -390,6 +390,8 @@ struct r5worker_group {
 	int stripes_cnt;
 };
 
+struct r5l_log;
+
 struct r5conf {
 	struct hlist_head	*stripe_hashtbl;
 	/* only protect corresponding hash list and inactive_list */
@@ -493,6 +495,7 @@ struct r5conf {
 	struct md_thread	*thread;
 	struct list_head	temp_inactive_list[NR_STRIPE_HASH_LOCKS];
 	struct r5worker_group	*worker_groups;
+	struct r5l_log		*log;	/* write-back log, if attached */
 	int			group_cnt;
 	int			worker_cnt_per_group;
 };
@@ -561,4 +564,9 @@ static inline int algorithm_is_DDF(int layout)
 extern int md_raid5_congested(struct mddev *mddev, int bits);
 extern void md_raid5_kick_device(struct r5conf *conf);
 extern int raid5_set_cache_size(struct mddev *mddev, int size);
+
+extern struct r5l_log *r5l_init(struct r5conf *conf, dev_t dev);
+extern void r5l_exit(struct r5l_log *log);
+extern bool r5l_handle_bio(struct r5l_log *log, struct bio *bio);
+extern dev_t r5l_device(struct r5l_log *log);
 #endif
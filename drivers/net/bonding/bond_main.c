@@ -3126,6 +3126,8 @@ static struct rtnl_link_stats64 *bond_get_stats(struct net_device *bond_dev,
 	struct rtnl_link_stats64 temp;
 	struct list_head *iter;
 	struct slave *slave;
+	u64 tx_dropped = 0;
+	int cpu;
 
 	memcpy(stats, &bond->bond_stats, sizeof(*stats));
 
@@ -3165,6 +3167,21 @@ static struct rtnl_link_stats64 *bond_get_stats(struct net_device *bond_dev,
 	}
 	memcpy(&bond->bond_stats, stats, sizeof(*stats));
 
+	/* the bond's own counters are totals, keep them out of bond_stats */
+	for_each_possible_cpu(cpu) {
+		const struct bond_pcpu_stats *pstats =
+			per_cpu_ptr(bond->pcpu_stats, cpu);
+		unsigned int start;
+		u64 dropped;
+
+		do {
+			start = u64_stats_fetch_begin_irq(&pstats->syncp);
+			dropped = pstats->tx_dropped;
+		} while (u64_stats_fetch_retry_irq(&pstats->syncp, start));
+		tx_dropped += dropped;
+	}
+	stats->tx_dropped += tx_dropped;
+
 	return stats;
 }
 
@@ -3538,22 +3555,23 @@ static u32 bond_rr_gen_slave_id(struct bonding *bond)
 	u32 slave_id;
 	struct reciprocal_value reciprocal_packets_per_slave;
 	int packets_per_slave = bond->params.packets_per_slave;
+	u32 rr_tx_counter = __this_cpu_read(*bond->rr_tx_counter);
 
 	switch (packets_per_slave) {
 	case 0:
 		slave_id = prandom_u32();
 		break;
 	case 1:
-		slave_id = bond->rr_tx_counter;
+		slave_id = rr_tx_counter;
 		break;
 	default:
 		reciprocal_packets_per_slave =
 			bond->params.reciprocal_packets_per_slave;
-		slave_id = reciprocal_divide(bond->rr_tx_counter,
+		slave_id = reciprocal_divide(rr_tx_counter,
 					     reciprocal_packets_per_slave);
 		break;
 	}
-	bond->rr_tx_counter++;
+	__this_cpu_inc(*bond->rr_tx_counter);
 
 	return slave_id;
 }
@@ -3963,6 +3981,8 @@ static void bond_destructor(struct net_device *bond_dev)
 	struct bonding *bond = netdev_priv(bond_dev);
 	if (bond->wq)
 		destroy_workqueue(bond->wq);
+	free_percpu(bond->rr_tx_counter);
+	free_percpu(bond->pcpu_stats);
 	free_netdev(bond_dev);
 }
 
@@ -4425,6 +4445,12 @@ static int bond_init(struct net_device *bond_dev)
 	if (!bond->wq)
 		return -ENOMEM;
 
+	/* both freed by bond_destructor() */
+	bond->rr_tx_counter = alloc_percpu(u32);
+	bond->pcpu_stats = netdev_alloc_pcpu_stats(struct bond_pcpu_stats);
+	if (!bond->rr_tx_counter || !bond->pcpu_stats)
+		return -ENOMEM;
+
 	bond_set_lockdep_class(bond_dev);
 
 	list_add_tail(&bond->bond_list, &bn->dev_list);
@@ -186,6 +186,7 @@ struct ixgbe_rx_buffer {
 	dma_addr_t dma;
 	struct page *page;
 	unsigned int page_offset;
+	u64 zc_addr;			/* umem offset on zero copy rings */
 };
 
 struct ixgbe_queue_stats {
@@ -250,6 +251,7 @@ struct ixgbe_ring {
 	struct net_device *netdev;	/* netdev ring belongs to */
 	struct device *dev;		/* device for DMA mapping */
 	struct ixgbe_fwd_adapter *l2_accel_priv;
+	struct packet_zc *zc;		/* rx into a packet socket's umem */
 	void *desc;			/* descriptor ring memory */
 	union {
 		struct ixgbe_tx_buffer *tx_buffer_info;
@@ -670,6 +672,8 @@ struct ixgbe_adapter {
 	u64 non_eop_descs;
 	u32 alloc_rx_page_failed;
 	u32 alloc_rx_buff_failed;
+	struct bpf_prog __rcu *xdp_prog;	/* run before skb allocation */
+	struct packet_zc *zc[MAX_RX_QUEUES];	/* zero copy rx queues */
 
 	struct ixgbe_q_vector *q_vector[MAX_Q_VECTORS];
 
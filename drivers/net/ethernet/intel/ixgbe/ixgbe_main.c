@@ -49,6 +49,9 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <net/packet_zc.h>
 #include <scsi/fc/fc_fcoe.h>
 
 #ifdef CONFIG_OF
@@ -1470,6 +1473,43 @@ static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
 	return true;
 }
 
+/**
+ * ixgbe_alloc_zc_frame - post an empty umem frame on a zero copy ring
+ * @rx_ring: ring to place the frame on
+ * @bi: buffer info to fill in
+ *
+ * Returns false if userspace has no empty frames queued.
+ **/
+static bool ixgbe_alloc_zc_frame(struct ixgbe_ring *rx_ring,
+				 struct ixgbe_rx_buffer *bi)
+{
+	struct packet_zc *zc = rx_ring->zc;
+	dma_addr_t dma;
+	u64 addr;
+
+	/* a dropped frame is reposted as-is */
+	if (likely(bi->page))
+		return true;
+
+	if (!packet_zc_fill_get(zc, &addr))
+		return false;
+
+	dma = dma_map_page(rx_ring->dev, packet_zc_page(zc, addr),
+			   packet_zc_offset(zc, addr), ixgbe_rx_bufsz(rx_ring),
+			   DMA_FROM_DEVICE);
+	if (dma_mapping_error(rx_ring->dev, dma)) {
+		rx_ring->rx_stats.alloc_rx_page_failed++;
+		return false;
+	}
+
+	bi->dma = dma;
+	bi->page = packet_zc_page(zc, addr);
+	bi->page_offset = 0;
+	bi->zc_addr = addr;
+
+	return true;
+}
+
 /**
  * ixgbe_alloc_rx_buffers - Replace used receive buffers
  * @rx_ring: ring to place buffers on
@@ -1490,8 +1530,12 @@ void ixgbe_alloc_rx_buffers(struct ixgbe_ring *rx_ring, u16 cleaned_count)
 	i -= rx_ring->count;
 
 	do {
-		if (!ixgbe_alloc_mapped_page(rx_ring, bi))
+		if (rx_ring->zc) {
+			if (!ixgbe_alloc_zc_frame(rx_ring, bi))
+				break;
+		} else if (!ixgbe_alloc_mapped_page(rx_ring, bi)) {
 			break;
+		}
 
 		/*
 		 * Refresh the desc even if buffer_addrs didn't change
@@ -1972,6 +2016,180 @@ dma_sync:
 	return skb;
 }
 
+/**
+ * ixgbe_run_xdp - run the XDP program on a received frame
+ * @adapter: board private structure
+ * @rx_ring: rx descriptor ring the frame was received on
+ * @rx_desc: descriptor of the frame
+ *
+ * The program sees the frame in place in the rx buffer.  Frames that span
+ * more than one buffer are not handed to it.
+ *
+ * Returns the program's verdict, XDP_PASS if it did not run
+ **/
+static u32 ixgbe_run_xdp(struct ixgbe_adapter *adapter,
+			 struct ixgbe_ring *rx_ring,
+			 union ixgbe_adv_rx_desc *rx_desc)
+{
+	struct ixgbe_rx_buffer *rx_buffer;
+	struct bpf_prog *xdp_prog;
+	struct xdp_buff xdp;
+	u32 act = XDP_PASS;
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(adapter->xdp_prog);
+	if (!xdp_prog)
+		goto out;
+
+	rx_buffer = &rx_ring->rx_buffer_info[rx_ring->next_to_clean];
+	if (rx_buffer->skb ||
+	    !ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP))
+		goto out;
+
+	dma_sync_single_range_for_cpu(rx_ring->dev,
+				      rx_buffer->dma,
+				      rx_buffer->page_offset,
+				      ixgbe_rx_bufsz(rx_ring),
+				      DMA_FROM_DEVICE);
+
+	xdp.data = page_address(rx_buffer->page) + rx_buffer->page_offset;
+	xdp.len = le16_to_cpu(rx_desc->wb.upper.length);
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+out:
+	rcu_read_unlock();
+	return act;
+}
+
+/**
+ * ixgbe_xdp_drop - drop the frame at next_to_clean without an skb
+ * @rx_ring: rx descriptor ring the frame was received on
+ *
+ * The page never left the ring, so the buffer is handed straight back.
+ **/
+static void ixgbe_xdp_drop(struct ixgbe_ring *rx_ring)
+{
+	struct ixgbe_rx_buffer *rx_buffer;
+	u32 ntc = rx_ring->next_to_clean;
+
+	rx_buffer = &rx_ring->rx_buffer_info[ntc];
+	ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+	rx_buffer->page = NULL;
+
+	/* fetch, update, and store next to clean */
+	ntc++;
+	ntc = (ntc < rx_ring->count) ? ntc : 0;
+	rx_ring->next_to_clean = ntc;
+
+	prefetch(IXGBE_RX_DESC(rx_ring, ntc));
+}
+
+/**
+ * ixgbe_xdp_tx - send a frame back out as the XDP program asked
+ * @adapter: board private structure
+ * @rx_ring: rx descriptor ring the frame was received on
+ * @skb: the frame
+ **/
+static void ixgbe_xdp_tx(struct ixgbe_adapter *adapter,
+			 struct ixgbe_ring *rx_ring,
+			 struct sk_buff *skb)
+{
+	struct ixgbe_ring *tx_ring;
+	struct netdev_queue *txq;
+
+	tx_ring = adapter->tx_ring[rx_ring->queue_index %
+				   adapter->num_tx_queues];
+	txq = netdev_get_tx_queue(adapter->netdev, tx_ring->queue_index);
+
+	skb->dev = adapter->netdev;
+	skb->protocol = ((struct ethhdr *)skb->data)->h_proto;
+	skb->queue_mapping = tx_ring->queue_index;
+
+	__netif_tx_lock(txq, smp_processor_id());
+	if (netif_xmit_frozen_or_stopped(txq) ||
+	    ixgbe_xmit_frame_ring(skb, adapter, tx_ring) == NETDEV_TX_BUSY)
+		dev_kfree_skb_any(skb);
+	__netif_tx_unlock(txq);
+}
+
+/**
+ * ixgbe_clean_rx_irq_zc - Clean completed descriptors from a zero copy ring
+ * @q_vector: structure containing interrupt and ring information
+ * @rx_ring: rx descriptor ring to transact packets on
+ * @budget: Total limit on number of packets to process
+ *
+ * Frames were received straight into the socket's umem and are only
+ * reported in its rx ring.  Frames that span several buffers, have errors
+ * or find the rx ring full are dropped and their buffer reposted.
+ *
+ * Returns amount of work completed
+ **/
+static int ixgbe_clean_rx_irq_zc(struct ixgbe_q_vector *q_vector,
+				 struct ixgbe_ring *rx_ring,
+				 const int budget)
+{
+	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
+	struct packet_zc *zc = rx_ring->zc;
+	u16 ntc = rx_ring->next_to_clean;
+
+	while (likely(total_rx_packets < budget)) {
+		union ixgbe_adv_rx_desc *rx_desc;
+		struct ixgbe_rx_buffer *rx_buffer;
+		unsigned int size;
+
+		rx_desc = IXGBE_RX_DESC(rx_ring, ntc);
+
+		if (!rx_desc->wb.upper.status_error)
+			break;
+
+		/* This memory barrier is needed to keep us from reading
+		 * any other fields out of the rx_desc until we know the
+		 * descriptor has been written back
+		 */
+		dma_rmb();
+
+		rx_buffer = &rx_ring->rx_buffer_info[ntc];
+		size = le16_to_cpu(rx_desc->wb.upper.length);
+
+		if (unlikely(!ixgbe_test_staterr(rx_desc, IXGBE_RXD_STAT_EOP) ||
+			     (ixgbe_test_staterr(rx_desc,
+						 IXGBE_RXDADV_ERR_FRAME_ERR_MASK) &&
+			      !(rx_ring->netdev->features & NETIF_F_RXALL)) ||
+			     packet_zc_rx(zc, rx_buffer->zc_addr, size))) {
+			/* the frame never left the ring, post it again */
+			ixgbe_reuse_rx_page(rx_ring, rx_buffer);
+		} else {
+			dma_unmap_page(rx_ring->dev, rx_buffer->dma,
+				       ixgbe_rx_bufsz(rx_ring), DMA_FROM_DEVICE);
+			total_rx_bytes += size;
+		}
+		rx_buffer->page = NULL;
+		total_rx_packets++;
+
+		ntc++;
+		ntc = (ntc < rx_ring->count) ? ntc : 0;
+		rx_ring->next_to_clean = ntc;
+		prefetch(IXGBE_RX_DESC(rx_ring, ntc));
+	}
+
+	packet_zc_rx_flush(zc);
+	ixgbe_alloc_rx_buffers(rx_ring, ixgbe_desc_unused(rx_ring));
+
+	u64_stats_update_begin(&rx_ring->syncp);
+	rx_ring->stats.packets += total_rx_packets;
+	rx_ring->stats.bytes += total_rx_bytes;
+	u64_stats_update_end(&rx_ring->syncp);
+	q_vector->rx.total_packets += total_rx_packets;
+	q_vector->rx.total_bytes += total_rx_bytes;
+
+	/* with no buffer posted the hardware cannot interrupt us again,
+	 * keep polling until userspace queues empty frames
+	 */
+	if (ixgbe_desc_unused(rx_ring) == rx_ring->count - 1)
+		return budget;
+
+	return total_rx_packets;
+}
+
 /**
  * ixgbe_clean_rx_irq - Clean completed descriptors from Rx ring - bounce buf
  * @q_vector: structure containing interrupt and ring information
@@ -1990,16 +2208,20 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 			       const int budget)
 {
 	unsigned int total_rx_bytes = 0, total_rx_packets = 0;
-#ifdef IXGBE_FCOE
 	struct ixgbe_adapter *adapter = q_vector->adapter;
+#ifdef IXGBE_FCOE
 	int ddp_bytes;
 	unsigned int mss = 0;
 #endif /* IXGBE_FCOE */
 	u16 cleaned_count = ixgbe_desc_unused(rx_ring);
 
+	if (rx_ring->zc)
+		return ixgbe_clean_rx_irq_zc(q_vector, rx_ring, budget);
+
 	while (likely(total_rx_packets < budget)) {
 		union ixgbe_adv_rx_desc *rx_desc;
 		struct sk_buff *skb;
+		u32 act;
 
 		/* return some buffers to hardware, one at a time is too slow */
 		if (cleaned_count >= IXGBE_RX_BUFFER_WRITE) {
@@ -2018,6 +2240,16 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		 */
 		dma_rmb();
 
+		/* let the XDP program have the frame before an skb exists */
+		act = ixgbe_run_xdp(adapter, rx_ring, rx_desc);
+		if (act != XDP_PASS && act != XDP_TX) {
+			total_rx_bytes += le16_to_cpu(rx_desc->wb.upper.length);
+			total_rx_packets++;
+			cleaned_count++;
+			ixgbe_xdp_drop(rx_ring);
+			continue;
+		}
+
 		/* retrieve a buffer from the ring */
 		skb = ixgbe_fetch_rx_buffer(rx_ring, rx_desc);
 
@@ -2038,6 +2270,12 @@ static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		/* probably a little skewed due to removing CRC */
 		total_rx_bytes += skb->len;
 
+		if (act == XDP_TX) {
+			ixgbe_xdp_tx(adapter, rx_ring, skb);
+			total_rx_packets++;
+			continue;
+		}
+
 		/* populate checksum, timestamp, VLAN, and protocol */
 		ixgbe_process_skb_fields(rx_ring, rx_desc, skb);
 
@@ -3463,6 +3701,13 @@ void ixgbe_configure_rx_ring(struct ixgbe_adapter *adapter,
 	IXGBE_WRITE_REG(hw, IXGBE_RDT(reg_idx), 0);
 	ring->tail = adapter->io_addr + IXGBE_RDT(reg_idx);
 
+	/* a zero copy ring gets single buffer frames only */
+	if (!ring->l2_accel_priv && adapter->zc[ring->queue_index] &&
+	    ixgbe_rx_bufsz(ring) <= adapter->zc[ring->queue_index]->frame_size) {
+		ring->zc = adapter->zc[ring->queue_index];
+		clear_ring_rsc_enabled(ring);
+	}
+
 	ixgbe_configure_srrctl(adapter, ring);
 	ixgbe_configure_rscctl(adapter, ring);
 
@@ -4424,12 +4669,21 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 		if (!rx_buffer->page)
 			continue;
 
+		/* umem frames go back to their owner with the socket */
+		if (rx_ring->zc) {
+			dma_unmap_page(dev, rx_buffer->dma,
+				       ixgbe_rx_bufsz(rx_ring), DMA_FROM_DEVICE);
+			rx_buffer->page = NULL;
+			continue;
+		}
+
 		dma_unmap_page(dev, rx_buffer->dma,
 			       ixgbe_rx_pg_size(rx_ring), DMA_FROM_DEVICE);
 		__free_pages(rx_buffer->page, ixgbe_rx_pg_order(rx_ring));
 
 		rx_buffer->page = NULL;
 	}
+	rx_ring->zc = NULL;
 
 	size = sizeof(struct ixgbe_rx_buffer) * rx_ring->count;
 	memset(rx_ring->rx_buffer_info, 0, size);
@@ -7938,6 +8192,59 @@ static void ixgbe_fwd_del(struct net_device *pdev, void *priv)
 	kfree(fwd_adapter);
 }
 
+/**
+ * ixgbe_packet_zc - hand an rx queue to a zero copy packet socket
+ * @netdev: network interface device structure
+ * @queue_id: rx queue
+ * @zc: socket's zero copy context, NULL to give the queue back
+ **/
+static int ixgbe_packet_zc(struct net_device *netdev, u32 queue_id,
+			   struct packet_zc *zc)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(netdev);
+
+	if (queue_id >= adapter->num_rx_queues)
+		return -EINVAL;
+	if (zc && adapter->zc[queue_id])
+		return -EBUSY;
+	if (zc && zc->frame_size < IXGBE_RXBUFFER_2K)
+		return -EINVAL;
+
+	adapter->zc[queue_id] = zc;
+	if (netif_running(netdev))
+		ixgbe_reinit_locked(adapter);
+
+	return 0;
+}
+
+/**
+ * ixgbe_xdp - install, remove or query the XDP program
+ * @netdev: network interface device structure
+ * @xdp: command
+ **/
+static int ixgbe_xdp(struct net_device *netdev, struct netdev_xdp *xdp)
+{
+	struct ixgbe_adapter *adapter = netdev_priv(netdev);
+	struct bpf_prog *old_prog;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		old_prog = rtnl_dereference(adapter->xdp_prog);
+		rcu_assign_pointer(adapter->xdp_prog, xdp->prog);
+		if (old_prog) {
+			/* wait for NAPI polls still running the old one */
+			synchronize_net();
+			bpf_prog_put(old_prog);
+		}
+		return 0;
+	case XDP_QUERY_PROG:
+		xdp->prog_attached = !!rtnl_dereference(adapter->xdp_prog);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
 static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_open		= ixgbe_open,
 	.ndo_stop		= ixgbe_close,
@@ -7982,6 +8289,8 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 	.ndo_bridge_getlink	= ixgbe_ndo_bridge_getlink,
 	.ndo_dfwd_add_station	= ixgbe_fwd_add,
 	.ndo_dfwd_del_station	= ixgbe_fwd_del,
+	.ndo_xdp		= ixgbe_xdp,
+	.ndo_packet_zc		= ixgbe_packet_zc,
 };
 
 /**
@@ -8588,6 +8897,9 @@ static void ixgbe_remove(struct pci_dev *pdev)
 	if (netdev->reg_state == NETREG_REGISTERED)
 		unregister_netdev(netdev);
 
+	if (rcu_access_pointer(adapter->xdp_prog))
+		bpf_prog_put(rcu_dereference_protected(adapter->xdp_prog, 1));
+
 #ifdef CONFIG_PCI_IOV
 	/*
 	 * Only disable SR-IOV on unload if the user specified the now
@@ -135,6 +135,7 @@ struct hv_netvsc_packet {
 
 	u16 q_idx;
 	struct vmbus_channel *channel;
+	bool xmit_more;		/* more packets follow, hold the host signal */
 
 	u64 send_completion_tid;
 	void *send_completion_ctx;
@@ -185,6 +186,7 @@ int netvsc_device_add(struct hv_device *device, void *additional_info);
 int netvsc_device_remove(struct hv_device *device);
 int netvsc_send(struct hv_device *device,
 		struct hv_netvsc_packet *packet);
+void netvsc_flush_send(struct hv_device *device, u16 q_idx);
 void netvsc_linkstatus_callback(struct hv_device *device_obj,
 				struct rndis_message *resp);
 int netvsc_recv_callback(struct hv_device *device_obj,
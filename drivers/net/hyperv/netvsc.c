@@ -766,19 +766,24 @@ int netvsc_send(struct hv_device *device,
 	if (out_channel->rescind)
 		return -ENODEV;
 
+	/*
+	 * While the stack has more packets lined up for this queue, let
+	 * the last one of the batch signal the host.
+	 */
 	if (packet->page_buf_cnt) {
-		ret = vmbus_sendpacket_pagebuffer(out_channel,
+		ret = vmbus_sendpacket_pagebuffer_ctl(out_channel,
 						  packet->page_buf,
 						  packet->page_buf_cnt,
 						  &sendMessage,
 						  sizeof(struct nvsp_message),
-						  req_id);
+						  req_id, !packet->xmit_more);
 	} else {
-		ret = vmbus_sendpacket(out_channel, &sendMessage,
+		ret = vmbus_sendpacket_ctl(out_channel, &sendMessage,
 				sizeof(struct nvsp_message),
 				req_id,
 				VM_PKT_DATA_INBAND,
-				VMBUS_DATA_PACKET_FLAG_COMPLETION_REQUESTED);
+				VMBUS_DATA_PACKET_FLAG_COMPLETION_REQUESTED,
+				!packet->xmit_more);
 	}
 
 	if (ret == 0) {
@@ -787,6 +792,8 @@ int netvsc_send(struct hv_device *device,
 
 		if (hv_ringbuf_avail_percent(&out_channel->outbound) <
 			RING_AVAIL_PERCENT_LOWATER) {
+			/* the rest of the batch is not coming */
+			vmbus_flush_signal(out_channel);
 			netif_tx_stop_queue(netdev_get_tx_queue(
 					    ndev, q_idx));
 
@@ -818,6 +825,26 @@ int netvsc_send(struct hv_device *device,
 	return ret;
 }
 
+/*
+ * Signal the host for packets queued on @q_idx with xmit_more set, when
+ * the packet that was to end the batch was dropped before netvsc_send().
+ */
+void netvsc_flush_send(struct hv_device *device, u16 q_idx)
+{
+	struct netvsc_device *net_device;
+	struct vmbus_channel *out_channel;
+
+	net_device = get_outbound_net_device(device);
+	if (!net_device)
+		return;
+
+	out_channel = net_device->chn_table[q_idx];
+	if (out_channel == NULL)
+		out_channel = device->channel;
+
+	vmbus_flush_signal(out_channel);
+}
+
 static void netvsc_send_recv_completion(struct hv_device *device,
 					struct vmbus_channel *channel,
 					struct netvsc_device *net_device,
@@ -836,10 +863,13 @@ static void netvsc_send_recv_completion(struct hv_device *device,
 	recvcompMessage.msg.v1_msg.send_rndis_pkt_complete.status = status;
 
 retry_send_cmplt:
-	/* Send the completion */
-	ret = vmbus_sendpacket(channel, &recvcompMessage,
-			       sizeof(struct nvsp_message), transaction_id,
-			       VM_PKT_COMP, 0);
+	/*
+	 * Send the completion.  The host is signalled once for the whole
+	 * receive pass, by netvsc_channel_cb().
+	 */
+	ret = vmbus_sendpacket_ctl(channel, &recvcompMessage,
+				   sizeof(struct nvsp_message), transaction_id,
+				   VM_PKT_COMP, 0, false);
 	if (ret == 0) {
 		/* success */
 		/* no-op */
@@ -1045,6 +1075,9 @@ void netvsc_channel_cb(void *context)
 		}
 	} while (1);
 
+	/* one signal for all the receive completions of this pass */
+	vmbus_flush_signal(channel);
+
 	if (bufferlen > NETVSC_PACKET_SIZE)
 		kfree(buffer);
 	return;
@@ -393,6 +393,9 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 	num_data_pgs = netvsc_get_slots(skb) + 2;
 	if (num_data_pgs > MAX_PAGE_BUFFER_COUNT) {
 		netdev_err(net, "Packet too big: %u\n", skb->len);
+		if (!skb->xmit_more)
+			netvsc_flush_send(net_device_ctx->device_ctx,
+					  skb_get_queue_mapping(skb));
 		dev_kfree_skb(skb);
 		net->stats.tx_dropped++;
 		return NETDEV_TX_OK;
@@ -408,6 +411,9 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 		/* out of memory, drop packet */
 		netdev_err(net, "unable to allocate hv_netvsc_packet\n");
 
+		if (!skb->xmit_more)
+			netvsc_flush_send(net_device_ctx->device_ctx,
+					  skb_get_queue_mapping(skb));
 		dev_kfree_skb(skb);
 		net->stats.tx_dropped++;
 		return NETDEV_TX_OK;
@@ -416,6 +422,7 @@ static int netvsc_start_xmit(struct sk_buff *skb, struct net_device *net)
 	packet->vlan_tci = skb->vlan_tci;
 
 	packet->q_idx = skb_get_queue_mapping(skb);
+	packet->xmit_more = skb->xmit_more;
 
 	packet->is_data_pkt = true;
 	packet->total_data_buflen = skb->len;
@@ -565,6 +572,9 @@ drop:
 	} else {
 		kfree(packet);
 		if (ret != -EAGAIN) {
+			if (!skb->xmit_more)
+				netvsc_flush_send(net_device_ctx->device_ctx,
+						  skb_get_queue_mapping(skb));
 			dev_kfree_skb_any(skb);
 			net->stats.tx_dropped++;
 		}
@@ -116,6 +116,10 @@ do {								\
 		      IFF_MULTI_QUEUE)
 #define GOODCOPY_LEN 128
 
+/* Max number of packets held back for a sender that told us more are
+ * coming (MSG_MORE, TUNSENDBATCH), before they are handed to the stack. */
+#define TUN_RX_BATCH	NAPI_POLL_WEIGHT
+
 #define FLT_EXACT_COUNT 8
 struct tap_filter {
 	unsigned int    count;    /* Number of addrs. Zero means disabled */
@@ -452,6 +456,7 @@ static struct tun_struct *tun_enable_queue(struct tun_file *tfile)
 
 static void tun_queue_purge(struct tun_file *tfile)
 {
+	skb_queue_purge(&tfile->sk.sk_write_queue);
 	skb_queue_purge(&tfile->sk.sk_receive_queue);
 	skb_queue_purge(&tfile->sk.sk_error_queue);
 }
@@ -808,7 +813,7 @@ static netdev_tx_t tun_net_xmit(struct sk_buff *skb, struct net_device *dev)
 			  >= dev->tx_queue_len)
 		goto drop;
 
-	if (unlikely(skb_orphan_frags(skb, GFP_ATOMIC)))
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_ATOMIC)))
 		goto drop;
 
 	if (skb->sk) {
@@ -1030,10 +1035,64 @@ static struct sk_buff *tun_alloc_skb(struct tun_file *tfile,
 	return skb;
 }
 
+/* Hand packets written to the device to the stack.  A writer that has
+ * more packets to come (@more) gets them batched on sk_write_queue, and
+ * the whole batch then goes up in one softirq-disabled section instead
+ * of one netif_rx_ni() per packet. */
+static void tun_rx_batched(struct tun_file *tfile, struct sk_buff *skb,
+			   bool more)
+{
+	struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+	struct sk_buff_head process_queue;
+	struct sk_buff *nskb;
+
+	if (!more && skb_queue_empty(queue)) {
+		netif_rx_ni(skb);
+		return;
+	}
+
+	spin_lock(&queue->lock);
+	if (more && skb_queue_len(queue) < TUN_RX_BATCH) {
+		__skb_queue_tail(queue, skb);
+		spin_unlock(&queue->lock);
+		return;
+	}
+	__skb_queue_head_init(&process_queue);
+	skb_queue_splice_tail_init(queue, &process_queue);
+	spin_unlock(&queue->lock);
+
+	local_bh_disable();
+	while ((nskb = __skb_dequeue(&process_queue)))
+		netif_receive_skb(nskb);
+	netif_receive_skb(skb);
+	local_bh_enable();
+}
+
+/* Deliver whatever a batching writer left behind, e.g. on error. */
+static void tun_rx_flush(struct tun_file *tfile)
+{
+	struct sk_buff_head *queue = &tfile->sk.sk_write_queue;
+	struct sk_buff_head process_queue;
+	struct sk_buff *skb;
+
+	if (skb_queue_empty(queue))
+		return;
+
+	__skb_queue_head_init(&process_queue);
+	spin_lock(&queue->lock);
+	skb_queue_splice_tail_init(queue, &process_queue);
+	spin_unlock(&queue->lock);
+
+	local_bh_disable();
+	while ((skb = __skb_dequeue(&process_queue)))
+		netif_receive_skb(skb);
+	local_bh_enable();
+}
+
 /* Get packet from user space buffer */
 static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 			    void *msg_control, struct iov_iter *from,
-			    int noblock)
+			    int noblock, bool more)
 {
 	struct tun_pi pi = { 0, cpu_to_be16(ETH_P_IP) };
 	struct sk_buff *skb;
@@ -1210,7 +1269,7 @@ static ssize_t tun_get_user(struct tun_struct *tun, struct tun_file *tfile,
 	skb_probe_transport_header(skb, 0);
 
 	rxhash = skb_get_hash(skb);
-	netif_rx_ni(skb);
+	tun_rx_batched(tfile, skb, more);
 
 	tun->dev->stats.rx_packets++;
 	tun->dev->stats.rx_bytes += len;
@@ -1229,7 +1288,8 @@ static ssize_t tun_chr_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	if (!tun)
 		return -EBADFD;
 
-	result = tun_get_user(tun, tfile, NULL, from, file->f_flags & O_NONBLOCK);
+	result = tun_get_user(tun, tfile, NULL, from,
+			      file->f_flags & O_NONBLOCK, false);
 
 	tun_put(tun);
 	return result;
@@ -1463,7 +1523,10 @@ static int tun_sendmsg(struct kiocb *iocb, struct socket *sock,
 		return -EBADFD;
 
 	ret = tun_get_user(tun, tfile, m->msg_control, &m->msg_iter,
-			   m->msg_flags & MSG_DONTWAIT);
+			   m->msg_flags & MSG_DONTWAIT,
+			   m->msg_flags & MSG_MORE);
+	if (unlikely(ret < 0))
+		tun_rx_flush(tfile);
 	tun_put(tun);
 	return ret;
 }
@@ -1826,6 +1889,103 @@ unlock:
 	return ret;
 }
 
+static long tun_send_batch(struct tun_struct *tun, struct tun_file *tfile,
+			   struct tun_batch_pkt __user *upkts, u32 count,
+			   int noblock)
+{
+	struct tun_batch_pkt pkt;
+	struct iov_iter from;
+	struct iovec iov;
+	ssize_t ret = 0;
+	u32 i;
+
+	for (i = 0; i < count; i++) {
+		if (copy_from_user(&pkt, &upkts[i], sizeof(pkt))) {
+			ret = -EFAULT;
+			break;
+		}
+		iov.iov_base = (void __user *)(unsigned long)pkt.buf;
+		iov.iov_len = pkt.len;
+		if (!access_ok(VERIFY_READ, iov.iov_base, iov.iov_len)) {
+			ret = -EFAULT;
+			break;
+		}
+		iov_iter_init(&from, WRITE, &iov, 1, iov.iov_len);
+		ret = tun_get_user(tun, tfile, NULL, &from, noblock,
+				   i + 1 < count);
+		if (ret < 0)
+			break;
+	}
+	tun_rx_flush(tfile);
+
+	return i ? i : ret;
+}
+
+static long tun_recv_batch(struct tun_struct *tun, struct tun_file *tfile,
+			   struct tun_batch_pkt __user *upkts, u32 count,
+			   int noblock)
+{
+	struct tun_batch_pkt pkt;
+	struct iov_iter to;
+	struct iovec iov;
+	ssize_t ret = 0;
+	u32 i;
+
+	for (i = 0; i < count; i++) {
+		if (copy_from_user(&pkt, &upkts[i], sizeof(pkt))) {
+			ret = -EFAULT;
+			break;
+		}
+		iov.iov_base = (void __user *)(unsigned long)pkt.buf;
+		iov.iov_len = pkt.len;
+		if (!access_ok(VERIFY_WRITE, iov.iov_base, iov.iov_len)) {
+			ret = -EFAULT;
+			break;
+		}
+		iov_iter_init(&to, READ, &iov, 1, iov.iov_len);
+		/* only wait for the first packet, then drain what's queued */
+		ret = tun_do_read(tun, tfile, &to, noblock || i);
+		if (ret <= 0)
+			break;
+		if (put_user(ret, &upkts[i].len)) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	return i ? i : ret;
+}
+
+static long tun_batch_ioctl(struct file *file, unsigned int cmd,
+			    void __user *argp)
+{
+	struct tun_file *tfile = file->private_data;
+	struct tun_batch_pkt __user *upkts;
+	struct tun_struct *tun;
+	struct tun_batch batch;
+	int noblock;
+	long ret;
+
+	if (copy_from_user(&batch, argp, sizeof(batch)))
+		return -EFAULT;
+	if (batch.flags || batch.count > TUN_BATCH_MAX)
+		return -EINVAL;
+
+	tun = tun_get(file);
+	if (!tun)
+		return -EBADFD;
+
+	upkts = (struct tun_batch_pkt __user *)(unsigned long)batch.pkts;
+	noblock = file->f_flags & O_NONBLOCK;
+	if (cmd == TUNSENDBATCH)
+		ret = tun_send_batch(tun, tfile, upkts, batch.count, noblock);
+	else
+		ret = tun_recv_batch(tun, tfile, upkts, batch.count, noblock);
+
+	tun_put(tun);
+	return ret;
+}
+
 static long __tun_chr_ioctl(struct file *file, unsigned int cmd,
 			    unsigned long arg, int ifreq_len)
 {
@@ -1856,6 +2016,8 @@ static long __tun_chr_ioctl(struct file *file, unsigned int cmd,
 				(unsigned int __user*)argp);
 	} else if (cmd == TUNSETQUEUE)
 		return tun_set_queue(file, &ifr);
+	else if (cmd == TUNSENDBATCH || cmd == TUNRECVBATCH)
+		return tun_batch_ioctl(file, cmd, argp);
 
 	ret = 0;
 	rtnl_lock();
@@ -2114,6 +2276,8 @@ static long tun_chr_compat_ioctl(struct file *file,
 	case TUNSETTXFILTER:
 	case TUNGETSNDBUF:
 	case TUNSETSNDBUF:
+	case TUNSENDBATCH:
+	case TUNRECVBATCH:
 	case SIOCGIFHWADDR:
 	case SIOCSIFHWADDR:
 		arg = (unsigned long)compat_ptr(arg);
@@ -52,6 +52,17 @@ module_param(gso, bool, 0444);
 
 #define VIRTNET_DRIVER_VERSION "1.0.0"
 
+/* Largest RSS key and indirection table we program, whatever the device
+ * offers beyond that.
+ */
+#define VIRTNET_RSS_MAX_KEY_SIZE	40
+#define VIRTNET_RSS_MAX_TABLE_LEN	128
+
+#define VIRTNET_RSS_HASH_TYPES_DEFAULT					\
+	(VIRTIO_NET_RSS_HASH_TYPE_IPv4 | VIRTIO_NET_RSS_HASH_TYPE_TCPv4 |	\
+	 VIRTIO_NET_RSS_HASH_TYPE_UDPv4 | VIRTIO_NET_RSS_HASH_TYPE_IPv6 |	\
+	 VIRTIO_NET_RSS_HASH_TYPE_TCPv6 | VIRTIO_NET_RSS_HASH_TYPE_UDPv6)
+
 struct virtnet_stats {
 	struct u64_stats_sync tx_syncp;
 	struct u64_stats_sync rx_syncp;
@@ -97,6 +108,15 @@ struct receive_queue {
 	char name[40];
 };
 
+/* Receive side scaling state, as last sent to the device */
+struct virtnet_rss {
+	u32 hash_types;
+	u16 indir_table_size;
+	u16 *indir_table;
+	u8 key_size;
+	u8 key[VIRTNET_RSS_MAX_KEY_SIZE];
+};
+
 struct virtnet_info {
 	struct virtio_device *vdev;
 	struct virtqueue *cvq;
@@ -123,6 +143,10 @@ struct virtnet_info {
 	/* Host can handle any s/g split between our header and packet data */
 	bool any_header_sg;
 
+	/* Guest programs receive side scaling */
+	bool has_rss;
+	struct virtnet_rss rss;
+
 	/* Packet virtio header size */
 	u8 hdr_len;
 
@@ -429,11 +453,14 @@ err_buf:
 	return NULL;
 }
 
-static void receive_buf(struct virtnet_info *vi, struct receive_queue *rq,
-			void *buf, unsigned int len)
+/* Returns the number of bytes to account as received, 0 if the buffer was
+ * dropped before it made it into an skb.
+ */
+static unsigned int receive_buf(struct virtnet_info *vi,
+				struct receive_queue *rq,
+				void *buf, unsigned int len)
 {
 	struct net_device *dev = vi->dev;
-	struct virtnet_stats *stats = this_cpu_ptr(vi->stats);
 	struct sk_buff *skb;
 	struct virtio_net_hdr_mrg_rxbuf *hdr;
 
@@ -449,7 +476,7 @@ static void receive_buf(struct virtnet_info *vi, struct receive_queue *rq,
 		} else {
 			dev_kfree_skb(buf);
 		}
-		return;
+		return 0;
 	}
 
 	if (vi->mergeable_rx_bufs)
@@ -460,14 +487,10 @@ static void receive_buf(struct virtnet_info *vi, struct receive_queue *rq,
 		skb = receive_small(vi, buf, len);
 
 	if (unlikely(!skb))
-		return;
+		return 0;
 
 	hdr = skb_vnet_hdr(skb);
-
-	u64_stats_update_begin(&stats->rx_syncp);
-	stats->rx_bytes += skb->len;
-	stats->rx_packets++;
-	u64_stats_update_end(&stats->rx_syncp);
+	len = skb->len;
 
 	if (hdr->hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
 		pr_debug("Needs csum!\n");
@@ -518,12 +541,13 @@ static void receive_buf(struct virtnet_info *vi, struct receive_queue *rq,
 
 	skb_mark_napi_id(skb, &rq->napi);
 
-	netif_receive_skb(skb);
-	return;
+	napi_gro_receive(&rq->napi, skb);
+	return len;
 
 frame_err:
 	dev->stats.rx_frame_errors++;
 	dev_kfree_skb(skb);
+	return len;
 }
 
 static int add_recvbuf_small(struct virtnet_info *vi, struct receive_queue *rq,
@@ -728,15 +752,28 @@ static void refill_work(struct work_struct *work)
 static int virtnet_receive(struct receive_queue *rq, int budget)
 {
 	struct virtnet_info *vi = rq->vq->vdev->priv;
-	unsigned int len, received = 0;
+	struct virtnet_stats *stats = this_cpu_ptr(vi->stats);
+	unsigned int len, received = 0, packets = 0, bytes = 0, ret;
 	void *buf;
 
 	while (received < budget &&
 	       (buf = virtqueue_get_buf(rq->vq, &len)) != NULL) {
-		receive_buf(vi, rq, buf, len);
+		ret = receive_buf(vi, rq, buf, len);
+		if (ret) {
+			bytes += ret;
+			packets++;
+		}
 		received++;
 	}
 
+	/* One stats update per poll rather than one per packet */
+	if (packets) {
+		u64_stats_update_begin(&stats->rx_syncp);
+		stats->rx_bytes += bytes;
+		stats->rx_packets += packets;
+		u64_stats_update_end(&stats->rx_syncp);
+	}
+
 	if (rq->vq->num_free > virtqueue_get_vring_size(rq->vq) / 2) {
 		if (!try_fill_recv(vi, rq, GFP_ATOMIC))
 			schedule_delayed_work(&vi->refill, 0);
@@ -786,6 +823,8 @@ static int virtnet_busy_poll(struct napi_struct *napi)
 
 again:
 	received += virtnet_receive(rq, budget);
+	/* Nothing completes NAPI behind us: don't sit on GRO packets */
+	napi_gro_flush(napi, false);
 
 	r = virtqueue_enable_cb_prepare(rq->vq);
 	clear_bit(NAPI_STATE_SCHED, &napi->state);
@@ -1095,20 +1134,74 @@ static void virtnet_ack_link_announce(struct virtnet_info *vi)
 	rtnl_unlock();
 }
 
+/* Send vi->rss to the device, with transmit limited to the first
+ * @queue_pairs queues.  Must be called with rtnl held.
+ */
+static bool virtnet_commit_rss(struct virtnet_info *vi, u16 queue_pairs)
+{
+	struct virtnet_rss *rss = &vi->rss;
+	struct virtio_net_rss_config *cfg;
+	struct scatterlist sg;
+	size_t len;
+	bool ok;
+	u8 *p;
+	int i;
+
+	len = offsetof(struct virtio_net_rss_config, indirection_table) +
+	      rss->indir_table_size * sizeof(__le16) +
+	      sizeof(__le16) + 1 + rss->key_size;
+	cfg = kzalloc(len, GFP_KERNEL);
+	if (!cfg)
+		return false;
+
+	cfg->hash_types = cpu_to_le32(rss->hash_types);
+	cfg->indirection_table_mask = cpu_to_le16(rss->indir_table_size - 1);
+	cfg->unclassified_queue = 0;
+	for (i = 0; i < rss->indir_table_size; i++)
+		cfg->indirection_table[i] = cpu_to_le16(rss->indir_table[i]);
+
+	p = (u8 *)&cfg->indirection_table[rss->indir_table_size];
+	*(__le16 *)p = cpu_to_le16(queue_pairs);
+	p += sizeof(__le16);
+	*p++ = rss->key_size;
+	memcpy(p, rss->key, rss->key_size);
+
+	sg_init_one(&sg, cfg, len);
+	ok = virtnet_send_command(vi, VIRTIO_NET_CTRL_MQ,
+				  VIRTIO_NET_CTRL_MQ_RSS_CONFIG, &sg);
+	kfree(cfg);
+
+	return ok;
+}
+
 static int virtnet_set_queues(struct virtnet_info *vi, u16 queue_pairs)
 {
 	struct scatterlist sg;
 	struct virtio_net_ctrl_mq s;
 	struct net_device *dev = vi->dev;
+	bool ok;
+	int i;
 
-	if (!vi->has_cvq || !virtio_has_feature(vi->vdev, VIRTIO_NET_F_MQ))
+	if (!vi->has_cvq ||
+	    (!virtio_has_feature(vi->vdev, VIRTIO_NET_F_MQ) && !vi->has_rss))
 		return 0;
 
-	s.virtqueue_pairs = cpu_to_virtio16(vi->vdev, queue_pairs);
-	sg_init_one(&sg, &s, sizeof(s));
+	if (vi->has_rss) {
+		/* Spread the table over the new set of queues; this drops
+		 * whatever ethtool -X put there before.
+		 */
+		for (i = 0; i < vi->rss.indir_table_size; i++)
+			vi->rss.indir_table[i] =
+				ethtool_rxfh_indir_default(i, queue_pairs);
+		ok = virtnet_commit_rss(vi, queue_pairs);
+	} else {
+		s.virtqueue_pairs = cpu_to_virtio16(vi->vdev, queue_pairs);
+		sg_init_one(&sg, &s, sizeof(s));
+		ok = virtnet_send_command(vi, VIRTIO_NET_CTRL_MQ,
+					  VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, &sg);
+	}
 
-	if (!virtnet_send_command(vi, VIRTIO_NET_CTRL_MQ,
-				  VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, &sg)) {
+	if (!ok) {
 		dev_warn(&dev->dev, "Fail to set num of queue pairs to %d\n",
 			 queue_pairs);
 		return -EINVAL;
@@ -1363,12 +1456,90 @@ static void virtnet_get_channels(struct net_device *dev,
 	channels->other_count = 0;
 }
 
+static int virtnet_get_rxnfc(struct net_device *dev,
+			     struct ethtool_rxnfc *info, u32 *rule_locs)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+
+	switch (info->cmd) {
+	case ETHTOOL_GRXRINGS:
+		info->data = vi->curr_queue_pairs;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static u32 virtnet_get_rxfh_key_size(struct net_device *dev)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+
+	return vi->has_rss ? vi->rss.key_size : 0;
+}
+
+static u32 virtnet_get_rxfh_indir_size(struct net_device *dev)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+
+	return vi->has_rss ? vi->rss.indir_table_size : 0;
+}
+
+static int virtnet_get_rxfh(struct net_device *dev, u32 *indir, u8 *key,
+			    u8 *hfunc)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	int i;
+
+	if (!vi->has_rss)
+		return -EOPNOTSUPP;
+
+	if (hfunc)
+		*hfunc = ETH_RSS_HASH_TOP;
+	if (indir)
+		for (i = 0; i < vi->rss.indir_table_size; i++)
+			indir[i] = vi->rss.indir_table[i];
+	if (key)
+		memcpy(key, vi->rss.key, vi->rss.key_size);
+
+	return 0;
+}
+
+static int virtnet_set_rxfh(struct net_device *dev, const u32 *indir,
+			    const u8 *key, const u8 hfunc)
+{
+	struct virtnet_info *vi = netdev_priv(dev);
+	int i;
+
+	if (!vi->has_rss)
+		return -EOPNOTSUPP;
+
+	/* The device only does Toeplitz */
+	if (hfunc != ETH_RSS_HASH_NO_CHANGE && hfunc != ETH_RSS_HASH_TOP)
+		return -EOPNOTSUPP;
+
+	if (indir)
+		for (i = 0; i < vi->rss.indir_table_size; i++)
+			vi->rss.indir_table[i] = indir[i];
+	if (key)
+		memcpy(vi->rss.key, key, vi->rss.key_size);
+
+	if (!virtnet_commit_rss(vi, vi->curr_queue_pairs))
+		return -EINVAL;
+
+	return 0;
+}
+
 static const struct ethtool_ops virtnet_ethtool_ops = {
 	.get_drvinfo = virtnet_get_drvinfo,
 	.get_link = ethtool_op_get_link,
 	.get_ringparam = virtnet_get_ringparam,
 	.set_channels = virtnet_set_channels,
 	.get_channels = virtnet_get_channels,
+	.get_rxnfc = virtnet_get_rxnfc,
+	.get_rxfh_key_size = virtnet_get_rxfh_key_size,
+	.get_rxfh_indir_size = virtnet_get_rxfh_indir_size,
+	.get_rxfh = virtnet_get_rxfh,
+	.set_rxfh = virtnet_set_rxfh,
 };
 
 #define MIN_MTU 68
@@ -1693,6 +1864,7 @@ static bool virtnet_validate_features(struct virtio_device *vdev)
 	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_GUEST_ANNOUNCE,
 			     "VIRTIO_NET_F_CTRL_VQ") ||
 	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_MQ, "VIRTIO_NET_F_CTRL_VQ") ||
+	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_RSS, "VIRTIO_NET_F_CTRL_VQ") ||
 	     VIRTNET_FAIL_ON(vdev, VIRTIO_NET_F_CTRL_MAC_ADDR,
 			     "VIRTIO_NET_F_CTRL_VQ"))) {
 		return false;
@@ -1701,6 +1873,51 @@ static bool virtnet_validate_features(struct virtio_device *vdev)
 	return true;
 }
 
+/* Read the device's RSS limits and set up a default configuration: all
+ * the hash types we know of, a random key and a table that will be spread
+ * over the queues in use when it is first sent.
+ */
+static int virtnet_init_rss(struct virtnet_info *vi, u16 max_queue_pairs)
+{
+	struct virtio_device *vdev = vi->vdev;
+	struct virtnet_rss *rss = &vi->rss;
+	u16 table_len;
+	u8 key_size;
+
+	/* Without a transport that reads past the legacy config we'd get
+	 * garbage here; and with one queue pair there's nothing to steer.
+	 */
+	if (!virtio_has_feature(vdev, VIRTIO_F_VERSION_1) ||
+	    max_queue_pairs < 2)
+		return 0;
+
+	key_size = virtio_cread8(vdev, offsetof(struct virtio_net_config,
+						rss_max_key_size));
+	table_len = virtio_cread16(vdev,
+			offsetof(struct virtio_net_config,
+				 rss_max_indirection_table_length));
+	rss->hash_types = virtio_cread32(vdev,
+			offsetof(struct virtio_net_config,
+				 supported_hash_types)) &
+			  VIRTNET_RSS_HASH_TYPES_DEFAULT;
+	if (!key_size || !table_len || !rss->hash_types)
+		return 0;
+
+	rss->key_size = min_t(u8, key_size, VIRTNET_RSS_MAX_KEY_SIZE);
+	rss->indir_table_size =
+		rounddown_pow_of_two(min_t(u16, table_len,
+					   VIRTNET_RSS_MAX_TABLE_LEN));
+	rss->indir_table = kcalloc(rss->indir_table_size,
+				   sizeof(*rss->indir_table), GFP_KERNEL);
+	if (!rss->indir_table)
+		return -ENOMEM;
+
+	netdev_rss_key_fill(rss->key, rss->key_size);
+	vi->has_rss = true;
+
+	return 0;
+}
+
 static int virtnet_probe(struct virtio_device *vdev)
 {
 	int i, err;
@@ -1814,6 +2031,12 @@ static int virtnet_probe(struct virtio_device *vdev)
 	if (virtio_has_feature(vdev, VIRTIO_NET_F_CTRL_VQ))
 		vi->has_cvq = true;
 
+	if (vi->has_cvq && virtio_has_feature(vdev, VIRTIO_NET_F_RSS)) {
+		err = virtnet_init_rss(vi, max_queue_pairs);
+		if (err)
+			goto free_stats;
+	}
+
 	if (vi->any_header_sg)
 		dev->needed_headroom = vi->hdr_len;
 
@@ -1841,6 +2064,13 @@ static int virtnet_probe(struct virtio_device *vdev)
 
 	virtio_device_ready(vdev);
 
+	/* Nothing hashes until we've sent the device a table */
+	if (vi->has_rss) {
+		rtnl_lock();
+		virtnet_set_queues(vi, vi->curr_queue_pairs);
+		rtnl_unlock();
+	}
+
 	/* Last of all, set up some receive buffers. */
 	for (i = 0; i < vi->curr_queue_pairs; i++) {
 		try_fill_recv(vi, &vi->rq[i], GFP_KERNEL);
@@ -1886,6 +2116,7 @@ free_vqs:
 	free_receive_page_frags(vi);
 	virtnet_del_vqs(vi);
 free_stats:
+	kfree(vi->rss.indir_table);
 	free_percpu(vi->stats);
 free:
 	free_netdev(dev);
@@ -1919,6 +2150,7 @@ static void virtnet_remove(struct virtio_device *vdev)
 
 	remove_vq_common(vi);
 
+	kfree(vi->rss.indir_table);
 	free_percpu(vi->stats);
 	free_netdev(vi->dev);
 }
@@ -1995,7 +2227,7 @@ static unsigned int features[] = {
 	VIRTIO_NET_F_MRG_RXBUF, VIRTIO_NET_F_STATUS, VIRTIO_NET_F_CTRL_VQ,
 	VIRTIO_NET_F_CTRL_RX, VIRTIO_NET_F_CTRL_VLAN,
 	VIRTIO_NET_F_GUEST_ANNOUNCE, VIRTIO_NET_F_MQ,
-	VIRTIO_NET_F_CTRL_MAC_ADDR,
+	VIRTIO_NET_F_CTRL_MAC_ADDR, VIRTIO_NET_F_RSS,
 	VIRTIO_F_ANY_LAYOUT,
 };
 
@@ -34,6 +34,7 @@
 #include <net/icmp.h>
 #include <net/udp.h>
 #include <net/udp_tunnel.h>
+#include <net/gro_cells.h>
 #include <net/rtnetlink.h>
 #include <net/route.h>
 #include <net/dsfield.h>
@@ -103,6 +104,8 @@ struct vxlan_rdst {
 	u32			 remote_ifindex;
 	struct list_head	 list;
 	struct rcu_head		 rcu;
+	/* per-CPU route to an IPv4 remote, may be NULL */
+	struct ip_tunnel_dst __percpu *dst_cache;
 };
 
 /* Forwarding table entry */
@@ -143,6 +146,8 @@ struct vxlan_dev {
 	unsigned int	  addrcnt;
 	unsigned int	  addrmax;
 
+	struct gro_cells  gro_cells;
+
 	struct hlist_head fdb_head[FDB_HASH_SIZE];
 };
 
@@ -501,6 +506,70 @@ static struct vxlan_rdst *vxlan_fdb_find_rdst(struct vxlan_fdb *f,
 }
 
 /* Replace destination of unicast mac */
+/* Per-CPU route cache of a remote, as ip_tunnel keeps for its peer.
+ * A cached route is dropped once its check fails, i.e. after the route
+ * genid of the netns has moved on.
+ */
+static void __vxlan_rdst_dst_set(struct ip_tunnel_dst *idst,
+				 struct dst_entry *dst, __be32 saddr)
+{
+	struct dst_entry *old_dst;
+
+	dst_clone(dst);
+	old_dst = xchg((__force struct dst_entry **)&idst->dst, dst);
+	dst_release(old_dst);
+	idst->saddr = saddr;
+}
+
+static void vxlan_rdst_dst_reset_all(struct vxlan_rdst *rd)
+{
+	int i;
+
+	if (!rd->dst_cache)
+		return;
+
+	for_each_possible_cpu(i)
+		__vxlan_rdst_dst_set(per_cpu_ptr(rd->dst_cache, i), NULL, 0);
+}
+
+static struct rtable *vxlan_rdst_rtable_get(struct vxlan_rdst *rd,
+					    __be32 *saddr)
+{
+	struct ip_tunnel_dst *idst;
+	struct dst_entry *dst;
+
+	rcu_read_lock();
+	idst = raw_cpu_ptr(rd->dst_cache);
+	dst = rcu_dereference(idst->dst);
+	if (dst && !atomic_inc_not_zero(&dst->__refcnt))
+		dst = NULL;
+	if (dst) {
+		if (!dst->obsolete || dst->ops->check(dst, 0)) {
+			*saddr = idst->saddr;
+		} else {
+			__vxlan_rdst_dst_set(idst, NULL, 0);
+			dst_release(dst);
+			dst = NULL;
+		}
+	}
+	rcu_read_unlock();
+	return (struct rtable *)dst;
+}
+
+static void vxlan_rdst_free(struct vxlan_rdst *rd)
+{
+	if (rd->dst_cache) {
+		vxlan_rdst_dst_reset_all(rd);
+		free_percpu(rd->dst_cache);
+	}
+	kfree(rd);
+}
+
+static void vxlan_rdst_free_rcu(struct rcu_head *head)
+{
+	vxlan_rdst_free(container_of(head, struct vxlan_rdst, rcu));
+}
+
 static int vxlan_fdb_replace(struct vxlan_fdb *f,
 			     union vxlan_addr *ip, __be16 port, __u32 vni, __u32 ifindex)
 {
@@ -517,6 +586,7 @@ static int vxlan_fdb_replace(struct vxlan_fdb *f,
 	rd->remote_port = port;
 	rd->remote_vni = vni;
 	rd->remote_ifindex = ifindex;
+	vxlan_rdst_dst_reset_all(rd);
 	return 1;
 }
 
@@ -534,6 +604,9 @@ static int vxlan_fdb_append(struct vxlan_fdb *f,
 	rd = kmalloc(sizeof(*rd), GFP_ATOMIC);
 	if (rd == NULL)
 		return -ENOBUFS;
+	/* Without a cache every packet does its own route lookup */
+	rd->dst_cache = alloc_percpu_gfp(struct ip_tunnel_dst,
+					 GFP_ATOMIC | __GFP_ZERO);
 	rd->remote_ip = *ip;
 	rd->remote_port = port;
 	rd->remote_vni = vni;
@@ -775,7 +848,7 @@ static void vxlan_fdb_free(struct rcu_head *head)
 	struct vxlan_rdst *rd, *nd;
 
 	list_for_each_entry_safe(rd, nd, &f->remotes, list)
-		kfree(rd);
+		vxlan_rdst_free(rd);
 	kfree(f);
 }
 
@@ -920,7 +993,7 @@ static int vxlan_fdb_delete(struct ndmsg *ndm, struct nlattr *tb[],
 	if (rd && !list_is_singular(&f->remotes)) {
 		list_del_rcu(&rd->list);
 		vxlan_fdb_notify(vxlan, f, rd, RTM_DELNEIGH);
-		kfree_rcu(rd, rcu);
+		call_rcu(&rd->rcu, vxlan_rdst_free_rcu);
 		goto out;
 	}
 
@@ -1244,7 +1317,7 @@ static void vxlan_rcv(struct vxlan_sock *vs,
 	stats->rx_bytes += skb->len;
 	u64_stats_update_end(&stats->syncp);
 
-	netif_rx(skb);
+	gro_cells_receive(&vxlan->gro_cells, skb);
 
 	return;
 drop:
@@ -1744,18 +1817,27 @@ static void vxlan_xmit_one(struct sk_buff *skb, struct net_device *dev,
 				     vxlan->port_max, true);
 
 	if (dst->sa.sa_family == AF_INET) {
+		/* The route only depends on the remote unless TOS is inherited */
+		bool use_cache = rdst->dst_cache && vxlan->tos != 1;
+
 		memset(&fl4, 0, sizeof(fl4));
 		fl4.flowi4_oif = rdst->remote_ifindex;
 		fl4.flowi4_tos = RT_TOS(tos);
 		fl4.daddr = dst->sin.sin_addr.s_addr;
 		fl4.saddr = vxlan->saddr.sin.sin_addr.s_addr;
 
-		rt = ip_route_output_key(vxlan->net, &fl4);
-		if (IS_ERR(rt)) {
-			netdev_dbg(dev, "no route to %pI4\n",
-				   &dst->sin.sin_addr.s_addr);
-			dev->stats.tx_carrier_errors++;
-			goto tx_error;
+		rt = use_cache ? vxlan_rdst_rtable_get(rdst, &fl4.saddr) : NULL;
+		if (!rt) {
+			rt = ip_route_output_key(vxlan->net, &fl4);
+			if (IS_ERR(rt)) {
+				netdev_dbg(dev, "no route to %pI4\n",
+					   &dst->sin.sin_addr.s_addr);
+				dev->stats.tx_carrier_errors++;
+				goto tx_error;
+			}
+			if (use_cache)
+				__vxlan_rdst_dst_set(raw_cpu_ptr(rdst->dst_cache),
+						     &rt->dst, fl4.saddr);
 		}
 
 		if (rt->dst.dev == dev) {
@@ -1991,11 +2073,18 @@ static int vxlan_init(struct net_device *dev)
 	struct vxlan_net *vn = net_generic(vxlan->net, vxlan_net_id);
 	struct vxlan_sock *vs;
 	bool ipv6 = vxlan->flags & VXLAN_F_IPV6;
+	int err;
 
 	dev->tstats = netdev_alloc_pcpu_stats(struct pcpu_sw_netstats);
 	if (!dev->tstats)
 		return -ENOMEM;
 
+	err = gro_cells_init(&vxlan->gro_cells, dev);
+	if (err) {
+		free_percpu(dev->tstats);
+		return err;
+	}
+
 	spin_lock(&vn->sock_lock);
 	vs = vxlan_find_sock(vxlan->net, ipv6 ? AF_INET6 : AF_INET,
 			     vxlan->dst_port);
@@ -2028,6 +2117,8 @@ static void vxlan_uninit(struct net_device *dev)
 	struct vxlan_dev *vxlan = netdev_priv(dev);
 	struct vxlan_sock *vs = vxlan->vn_sock;
 
+	gro_cells_destroy(&vxlan->gro_cells);
+
 	vxlan_fdb_delete_default(vxlan);
 
 	if (vs)
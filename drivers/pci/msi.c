@@ -403,6 +403,7 @@ static void free_msi_irqs(struct pci_dev *dev)
 		}
 
 		list_del(&entry->list);
+		kfree(entry->affinity);
 		kfree(entry);
 	}
 
@@ -706,18 +707,33 @@ static void __iomem *msix_map_region(struct pci_dev *dev, unsigned nr_entries)
 }
 
 static int msix_setup_entries(struct pci_dev *dev, void __iomem *base,
-			      struct msix_entry *entries, int nvec)
+			      struct msix_entry *entries, int nvec,
+			      const struct irq_affinity *affd)
 {
+	struct cpumask *masks = NULL;
 	struct msi_desc *entry;
 	int i;
 
+	/* Without masks the vectors are simply left unmanaged */
+	if (affd)
+		masks = irq_create_affinity_masks(nvec, affd);
+
 	for (i = 0; i < nvec; i++) {
 		entry = alloc_msi_entry(dev);
+		if (entry && masks) {
+			entry->affinity = kmemdup(masks + i, cpumask_size(),
+						  GFP_KERNEL);
+			if (!entry->affinity) {
+				kfree(entry);
+				entry = NULL;
+			}
+		}
 		if (!entry) {
 			if (!i)
 				iounmap(base);
 			else
 				free_msi_irqs(dev);
+			kfree(masks);
 			/* No enough memory. Don't try again */
 			return -ENOMEM;
 		}
@@ -732,6 +748,7 @@ static int msix_setup_entries(struct pci_dev *dev, void __iomem *base,
 		list_add_tail(&entry->list, &dev->msi_list);
 	}
 
+	kfree(masks);
 	return 0;
 }
 
@@ -748,6 +765,8 @@ static void msix_program_entries(struct pci_dev *dev,
 		entries[i].vector = entry->irq;
 		entry->masked = readl(entry->mask_base + offset);
 		msix_mask_irq(entry, 1);
+		if (entry->affinity)
+			irq_set_managed_affinity(entry->irq, entry->affinity);
 		i++;
 	}
 }
@@ -757,13 +776,15 @@ static void msix_program_entries(struct pci_dev *dev,
  * @dev: pointer to the pci_dev data structure of MSI-X device function
  * @entries: pointer to an array of struct msix_entry entries
  * @nvec: number of @entries
+ * @affd: optional description of how to spread the vectors over the cpus
  *
  * Setup the MSI-X capability structure of device function with a
  * single MSI-X irq. A return of zero indicates the successful setup of
  * requested MSI-X entries with allocated irqs or non-zero for otherwise.
  **/
 static int msix_capability_init(struct pci_dev *dev,
-				struct msix_entry *entries, int nvec)
+				struct msix_entry *entries, int nvec,
+				const struct irq_affinity *affd)
 {
 	int ret;
 	u16 control;
@@ -778,7 +799,7 @@ static int msix_capability_init(struct pci_dev *dev,
 	if (!base)
 		return -ENOMEM;
 
-	ret = msix_setup_entries(dev, base, entries, nvec);
+	ret = msix_setup_entries(dev, base, entries, nvec, affd);
 	if (ret)
 		return ret;
 
@@ -972,7 +993,8 @@ EXPORT_SYMBOL(pci_msix_vec_count);
  * of irqs or MSI-X vectors available. Driver should use the returned value to
  * re-send its request.
  **/
-int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
+static int __pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries,
+			     int nvec, const struct irq_affinity *affd)
 {
 	int nr_entries;
 	int i, j;
@@ -1005,7 +1027,12 @@ int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
 		dev_info(&dev->dev, "can't enable MSI-X (MSI IRQ already assigned)\n");
 		return -EINVAL;
 	}
-	return msix_capability_init(dev, entries, nvec);
+	return msix_capability_init(dev, entries, nvec, affd);
+}
+
+int pci_enable_msix(struct pci_dev *dev, struct msix_entry *entries, int nvec)
+{
+	return __pci_enable_msix(dev, entries, nvec, NULL);
 }
 EXPORT_SYMBOL(pci_enable_msix);
 
@@ -1141,8 +1168,9 @@ EXPORT_SYMBOL(pci_enable_msi_range);
  * indicates the successful configuration of MSI-X capability structure
  * with new allocated MSI-X interrupts.
  **/
-int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
-			       int minvec, int maxvec)
+static int __pci_enable_msix_range(struct pci_dev *dev,
+				   struct msix_entry *entries, int minvec,
+				   int maxvec, const struct irq_affinity *affd)
 {
 	int nvec = maxvec;
 	int rc;
@@ -1151,7 +1179,7 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 		return -ERANGE;
 
 	do {
-		rc = pci_enable_msix(dev, entries, nvec);
+		rc = __pci_enable_msix(dev, entries, nvec, affd);
 		if (rc < 0) {
 			return rc;
 		} else if (rc > 0) {
@@ -1163,8 +1191,64 @@ int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
 
 	return nvec;
 }
+
+int pci_enable_msix_range(struct pci_dev *dev, struct msix_entry *entries,
+			       int minvec, int maxvec)
+{
+	return __pci_enable_msix_range(dev, entries, minvec, maxvec, NULL);
+}
 EXPORT_SYMBOL(pci_enable_msix_range);
 
+/**
+ * pci_enable_msix_range_affinity - enable MSI-X spread over the cpus
+ * @dev: pointer to the pci_dev data structure of MSI-X device function
+ * @entries: pointer to an array of MSI-X entries
+ * @minvec: minimum number of MSI-X irqs requested
+ * @maxvec: maximum number of MSI-X irqs requested
+ * @affd: description of the vectors which must not be spread
+ *
+ * Same as pci_enable_msix_range(), but the vectors between the
+ * @affd->pre_vectors and @affd->post_vectors are spread over all possible
+ * cpus, honouring NUMA nodes and thread siblings, and pinned there with a
+ * kernel managed affinity.  @maxvec is capped to the number of possible
+ * cpus first, as there is no point in vectors which no cpu would use.
+ * The resulting masks can be queried with pci_irq_get_affinity().
+ **/
+int pci_enable_msix_range_affinity(struct pci_dev *dev,
+				   struct msix_entry *entries, int minvec,
+				   int maxvec, const struct irq_affinity *affd)
+{
+	maxvec = max(minvec, irq_calc_affinity_vectors(maxvec, affd));
+
+	return __pci_enable_msix_range(dev, entries, minvec, maxvec, affd);
+}
+EXPORT_SYMBOL(pci_enable_msix_range_affinity);
+
+/**
+ * pci_irq_get_affinity - return the affinity of a particular MSI-X vector
+ * @dev: PCI device to operate on
+ * @nr: index of the vector in the array passed at enable time
+ *
+ * Returns the kernel managed affinity of the vector, or NULL if MSI-X
+ * is not enabled or the vector was not spread.
+ **/
+const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev, int nr)
+{
+	struct msi_desc *entry;
+	int i = 0;
+
+	if (!dev->msix_enabled)
+		return NULL;
+
+	list_for_each_entry(entry, &dev->msi_list, list) {
+		if (i++ == nr)
+			return entry->affinity;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL(pci_irq_get_affinity);
+
 #ifdef CONFIG_PCI_MSI_IRQ_DOMAIN
 /**
  * pci_msi_domain_write_msg - Helper to write MSI message to PCI config space
@@ -17,6 +17,7 @@
 #include <linux/workqueue.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
 #include <linux/vmalloc.h>
 
 #include <linux/net.h>
@@ -39,6 +40,10 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
 
+/* Max number of used ring entries written and signalled at once by the
+ * copy paths. */
+#define VHOST_NET_BATCH 64
+
 /* MAX number of TX used buffers for outstanding zerocopy */
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
@@ -90,6 +95,9 @@ struct vhost_net_virtqueue {
 	struct iovec hdr[sizeof(struct virtio_net_hdr_mrg_rxbuf)];
 	size_t vhost_hlen;
 	size_t sock_hlen;
+	/* Number of heads at the start of vq->heads not yet added to the
+	 * used ring; only used when not doing zerocopy. */
+	int used_pending;
 	/* vhost zerocopy support fields below: */
 	/* last used idx for outstanding DMA zerocopy buffers */
 	int upend_idx;
@@ -197,6 +205,7 @@ static void vhost_net_vq_reset(struct vhost_net *n)
 	vhost_net_clear_ubuf_info(n);
 
 	for (i = 0; i < VHOST_NET_VQ_MAX; i++) {
+		n->vqs[i].used_pending = 0;
 		n->vqs[i].done_idx = 0;
 		n->vqs[i].upend_idx = 0;
 		n->vqs[i].ubufs = NULL;
@@ -330,6 +339,59 @@ static void vhost_zerocopy_callback(struct ubuf_info *ubuf, bool success)
 	rcu_read_unlock_bh();
 }
 
+static void vhost_net_signal_used(struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+
+	if (!nvq->used_pending)
+		return;
+
+	vhost_add_used_and_signal_n(vq->dev, vq, vq->heads, nvq->used_pending);
+	nvq->used_pending = 0;
+}
+
+static inline unsigned long busy_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static bool vhost_can_busy_poll(struct vhost_dev *dev,
+				unsigned long endtime)
+{
+	return likely(!need_resched()) &&
+	       likely(!time_after(busy_clock(), endtime)) &&
+	       likely(!signal_pending(current)) &&
+	       !vhost_has_work(dev);
+}
+
+/* Like vhost_get_vq_desc(), but if the ring is empty spin on the avail
+ * index for up to busyloop_timeout us before giving up, so that a guest
+ * that is about to post a buffer doesn't have to kick us. */
+static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
+				    struct vhost_virtqueue *vq,
+				    struct iovec iov[], unsigned int iov_size,
+				    unsigned int *out_num, unsigned int *in_num)
+{
+	unsigned long uninitialized_var(endtime);
+	int r = vhost_get_vq_desc(vq, iov, iov_size,
+				  out_num, in_num, NULL, NULL);
+
+	if (r == vq->num && vq->busyloop_timeout) {
+		/* Don't keep the guest waiting for completions while we spin */
+		vhost_net_signal_used(&net->vqs[VHOST_NET_VQ_TX]);
+		preempt_disable();
+		endtime = busy_clock() + vq->busyloop_timeout;
+		while (vhost_can_busy_poll(vq->dev, endtime) &&
+		       vhost_vq_avail_empty(vq->dev, vq))
+			cpu_relax_lowlatency();
+		preempt_enable();
+		r = vhost_get_vq_desc(vq, iov, iov_size,
+				      out_num, in_num, NULL, NULL);
+	}
+
+	return r;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -374,10 +436,9 @@ static void handle_tx(struct vhost_net *net)
 			      % UIO_MAXIOV == nvq->done_idx))
 			break;
 
-		head = vhost_get_vq_desc(vq, vq->iov,
-					 ARRAY_SIZE(vq->iov),
-					 &out, &in,
-					 NULL, NULL);
+		head = vhost_net_tx_get_vq_desc(net, vq, vq->iov,
+						ARRAY_SIZE(vq->iov),
+						&out, &in);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(head < 0))
 			break;
@@ -430,6 +491,14 @@ static void handle_tx(struct vhost_net *net)
 			msg.msg_control = NULL;
 			ubufs = NULL;
 		}
+		/* Let the backend batch packets up while the guest has
+		 * more for us; only done on the copy path. */
+		if (!zcopy && total_len + len < VHOST_NET_WEIGHT &&
+		    !vhost_vq_avail_empty(&net->dev, vq))
+			msg.msg_flags |= MSG_MORE;
+		else
+			msg.msg_flags &= ~MSG_MORE;
+
 		/* TODO: Check specific error and bomb out unless ENOBUFS? */
 		err = sock->ops->sendmsg(NULL, sock, &msg, len);
 		if (unlikely(err < 0)) {
@@ -444,10 +513,17 @@ static void handle_tx(struct vhost_net *net)
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy_used)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
-		else
+		if (zcopy_used) {
 			vhost_zerocopy_signal_used(net, vq);
+		} else if (zcopy) {
+			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		} else {
+			/* vq->heads is free for batching without zerocopy */
+			vq->heads[nvq->used_pending].id = cpu_to_vhost32(vq, head);
+			vq->heads[nvq->used_pending].len = 0;
+			if (++nvq->used_pending >= VHOST_NET_BATCH)
+				vhost_net_signal_used(nvq);
+		}
 		total_len += len;
 		vhost_net_tx_packet(net);
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
@@ -455,6 +531,7 @@ static void handle_tx(struct vhost_net *net)
 			break;
 		}
 	}
+	vhost_net_signal_used(nvq);
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -477,6 +554,51 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+/* With busy polling enabled, wait up to busyloop_timeout us for a packet
+ * on the socket.  When tx shares our worker thread, the tx virtqueue is
+ * polled too: stop as soon as the guest posts tx buffers, and requeue tx
+ * handling if it did. */
+static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
+{
+	struct vhost_net_virtqueue *nvq = &net->vqs[VHOST_NET_VQ_TX];
+	struct vhost_virtqueue *vq = &nvq->vq;
+	unsigned long uninitialized_var(endtime);
+	int len = peek_head_len(sk);
+	bool poll_tx;
+
+	if (!len && vq->busyloop_timeout) {
+		/* Flush batched rx completions before spinning */
+		vhost_net_signal_used(&net->vqs[VHOST_NET_VQ_RX]);
+
+		poll_tx = net->dev.nworkers == 1;
+		if (poll_tx) {
+			/* rx vq mutex is held by our caller */
+			mutex_lock_nested(&vq->mutex, 1);
+			vhost_disable_notify(&net->dev, vq);
+		}
+
+		preempt_disable();
+		endtime = busy_clock() + vq->busyloop_timeout;
+
+		while (vhost_can_busy_poll(&net->dev, endtime) &&
+		       skb_queue_empty(&sk->sk_receive_queue) &&
+		       (!poll_tx || vhost_vq_avail_empty(&net->dev, vq)))
+			cpu_relax_lowlatency();
+
+		preempt_enable();
+
+		if (poll_tx) {
+			if (vhost_enable_notify(&net->dev, vq))
+				vhost_poll_queue(&vq->poll);
+			mutex_unlock(&vq->mutex);
+		}
+
+		len = peek_head_len(sk);
+	}
+
+	return len;
+}
+
 /* This is a multi-buffer version of vhost_get_desc, that works if
  *	vq has read descriptors only.
  * @vq		- the relevant virtqueue
@@ -593,15 +715,22 @@ static void handle_rx(struct vhost_net *net)
 		vq->log : NULL;
 	mergeable = vhost_has_feature(vq, VIRTIO_NET_F_MRG_RXBUF);
 
-	while ((sock_len = peek_head_len(sock->sk))) {
+	while ((sock_len = vhost_net_rx_peek_head_len(net, sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
-		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
-					&in, vq_log, &log,
-					likely(mergeable) ? UIO_MAXIOV : 1);
+		/* Heads are batched up in vq->heads after the pending ones */
+		headcount = get_rx_bufs(vq, vq->heads + nvq->used_pending,
+					vhost_len, &in, vq_log, &log,
+					likely(mergeable) ?
+					UIO_MAXIOV - nvq->used_pending : 1);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(headcount < 0))
 			break;
+		/* Out of room for the batch: flush it and retry */
+		if (unlikely(headcount > UIO_MAXIOV) && nvq->used_pending) {
+			vhost_net_signal_used(nvq);
+			continue;
+		}
 		/* On overrun, truncate and discard */
 		if (unlikely(headcount > UIO_MAXIOV)) {
 			iov_iter_init(&msg.msg_iter, READ, vq->iov, 1, 1);
@@ -660,8 +789,9 @@ static void handle_rx(struct vhost_net *net)
 			vhost_discard_vq_desc(vq, headcount);
 			break;
 		}
-		vhost_add_used_and_signal_n(&net->dev, vq, vq->heads,
-					    headcount);
+		nvq->used_pending += headcount;
+		if (nvq->used_pending >= VHOST_NET_BATCH)
+			vhost_net_signal_used(nvq);
 		if (unlikely(vq_log))
 			vhost_log_write(vq, vq_log, log, vhost_len);
 		total_len += vhost_len;
@@ -670,6 +800,7 @@ static void handle_rx(struct vhost_net *net)
 			break;
 		}
 	}
+	vhost_net_signal_used(nvq);
 out:
 	mutex_unlock(&vq->mutex);
 }
@@ -731,6 +862,7 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 	n->vqs[VHOST_NET_VQ_TX].vq.handle_kick = handle_tx_kick;
 	n->vqs[VHOST_NET_VQ_RX].vq.handle_kick = handle_rx_kick;
 	for (i = 0; i < VHOST_NET_VQ_MAX; i++) {
+		n->vqs[i].used_pending = 0;
 		n->vqs[i].ubufs = NULL;
 		n->vqs[i].ubuf_info = NULL;
 		n->vqs[i].upend_idx = 0;
@@ -742,6 +874,9 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 
 	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, POLLOUT, dev);
 	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, POLLIN, dev);
+	/* run socket wakeups on the same worker as the matching vq */
+	n->poll[VHOST_NET_VQ_TX].work.vq_index = VHOST_NET_VQ_TX;
+	n->poll[VHOST_NET_VQ_RX].work.vq_index = VHOST_NET_VQ_RX;
 
 	f->private_data = n;
 
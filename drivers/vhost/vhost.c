@@ -28,6 +28,11 @@
 
 #include "vhost.h"
 
+static int max_workers = 1;
+module_param(max_workers, int, 0444);
+MODULE_PARM_DESC(max_workers,
+		 "Maximum number of worker threads per device (default 1)");
+
 enum {
 	VHOST_MEMORY_MAX_NREGIONS = 64,
 	VHOST_MEMORY_F_LOG = 0x1,
@@ -65,6 +70,7 @@ void vhost_work_init(struct vhost_work *work, vhost_work_fn_t fn)
 	init_waitqueue_head(&work->done);
 	work->flushing = 0;
 	work->queue_seq = work->done_seq = 0;
+	work->vq_index = 0;
 }
 EXPORT_SYMBOL_GPL(vhost_work_init);
 
@@ -116,30 +122,43 @@ void vhost_poll_stop(struct vhost_poll *poll)
 }
 EXPORT_SYMBOL_GPL(vhost_poll_stop);
 
-static bool vhost_work_seq_done(struct vhost_dev *dev, struct vhost_work *work,
-				unsigned seq)
+/* Virtqueues are spread round-robin over the device's workers. */
+static struct vhost_worker *vhost_work_worker(struct vhost_dev *dev,
+					      struct vhost_work *work)
+{
+	return &dev->workers[work->vq_index % dev->nworkers];
+}
+
+static bool vhost_work_seq_done(struct vhost_worker *worker,
+				struct vhost_work *work, unsigned seq)
 {
 	int left;
 
-	spin_lock_irq(&dev->work_lock);
+	spin_lock_irq(&worker->work_lock);
 	left = seq - work->done_seq;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	return left <= 0;
 }
 
 void vhost_work_flush(struct vhost_dev *dev, struct vhost_work *work)
 {
+	struct vhost_worker *worker;
 	unsigned seq;
 	int flushing;
 
-	spin_lock_irq(&dev->work_lock);
+	/* No workers, so nothing can have been queued. */
+	if (!dev->nworkers)
+		return;
+
+	worker = vhost_work_worker(dev, work);
+	spin_lock_irq(&worker->work_lock);
 	seq = work->queue_seq;
 	work->flushing++;
-	spin_unlock_irq(&dev->work_lock);
-	wait_event(work->done, vhost_work_seq_done(dev, work, seq));
-	spin_lock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
+	wait_event(work->done, vhost_work_seq_done(worker, work, seq));
+	spin_lock_irq(&worker->work_lock);
 	flushing = --work->flushing;
-	spin_unlock_irq(&dev->work_lock);
+	spin_unlock_irq(&worker->work_lock);
 	BUG_ON(flushing < 0);
 }
 EXPORT_SYMBOL_GPL(vhost_work_flush);
@@ -154,20 +173,34 @@ EXPORT_SYMBOL_GPL(vhost_poll_flush);
 
 void vhost_work_queue(struct vhost_dev *dev, struct vhost_work *work)
 {
+	struct vhost_worker *worker = vhost_work_worker(dev, work);
 	unsigned long flags;
 
-	spin_lock_irqsave(&dev->work_lock, flags);
+	spin_lock_irqsave(&worker->work_lock, flags);
 	if (list_empty(&work->node)) {
-		list_add_tail(&work->node, &dev->work_list);
+		list_add_tail(&work->node, &worker->work_list);
 		work->queue_seq++;
-		spin_unlock_irqrestore(&dev->work_lock, flags);
-		wake_up_process(dev->worker);
+		spin_unlock_irqrestore(&worker->work_lock, flags);
+		wake_up_process(worker->task);
 	} else {
-		spin_unlock_irqrestore(&dev->work_lock, flags);
+		spin_unlock_irqrestore(&worker->work_lock, flags);
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_work_queue);
 
+/* A lockless hint for busy polling code to exit the loop: is other work
+ * waiting for the worker we are running on? */
+bool vhost_has_work(struct vhost_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->nworkers; ++i)
+		if (dev->workers[i].task == current)
+			return !list_empty(&dev->workers[i].work_list);
+	return false;
+}
+EXPORT_SYMBOL_GPL(vhost_has_work);
+
 void vhost_poll_queue(struct vhost_poll *poll)
 {
 	vhost_work_queue(poll->dev, &poll->work);
@@ -199,11 +232,13 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->call = NULL;
 	vq->log_ctx = NULL;
 	vq->memory = NULL;
+	vq->busyloop_timeout = 0;
 }
 
 static int vhost_worker(void *data)
 {
-	struct vhost_dev *dev = data;
+	struct vhost_worker *worker = data;
+	struct vhost_dev *dev = worker->dev;
 	struct vhost_work *work = NULL;
 	unsigned uninitialized_var(seq);
 	mm_segment_t oldfs = get_fs();
@@ -215,7 +250,7 @@ static int vhost_worker(void *data)
 		/* mb paired w/ kthread_stop */
 		set_current_state(TASK_INTERRUPTIBLE);
 
-		spin_lock_irq(&dev->work_lock);
+		spin_lock_irq(&worker->work_lock);
 		if (work) {
 			work->done_seq = seq;
 			if (work->flushing)
@@ -223,18 +258,18 @@ static int vhost_worker(void *data)
 		}
 
 		if (kthread_should_stop()) {
-			spin_unlock_irq(&dev->work_lock);
+			spin_unlock_irq(&worker->work_lock);
 			__set_current_state(TASK_RUNNING);
 			break;
 		}
-		if (!list_empty(&dev->work_list)) {
-			work = list_first_entry(&dev->work_list,
+		if (!list_empty(&worker->work_list)) {
+			work = list_first_entry(&worker->work_list,
 						struct vhost_work, node);
 			list_del_init(&work->node);
 			seq = work->queue_seq;
 		} else
 			work = NULL;
-		spin_unlock_irq(&dev->work_lock);
+		spin_unlock_irq(&worker->work_lock);
 
 		if (work) {
 			__set_current_state(TASK_RUNNING);
@@ -304,9 +339,8 @@ void vhost_dev_init(struct vhost_dev *dev,
 	dev->log_file = NULL;
 	dev->memory = NULL;
 	dev->mm = NULL;
-	spin_lock_init(&dev->work_lock);
-	INIT_LIST_HEAD(&dev->work_list);
-	dev->worker = NULL;
+	dev->workers = NULL;
+	dev->nworkers = 0;
 
 	for (i = 0; i < dev->nvqs; ++i) {
 		vq = dev->vqs[i];
@@ -319,6 +353,7 @@ void vhost_dev_init(struct vhost_dev *dev,
 		if (vq->handle_kick)
 			vhost_poll_init(&vq->poll, vq->handle_kick,
 					POLLIN, dev);
+		vq->poll.work.vq_index = i;
 	}
 }
 EXPORT_SYMBOL_GPL(vhost_dev_init);
@@ -348,12 +383,18 @@ static void vhost_attach_cgroups_work(struct vhost_work *work)
 static int vhost_attach_cgroups(struct vhost_dev *dev)
 {
 	struct vhost_attach_cgroups_struct attach;
+	int i;
 
-	attach.owner = current;
-	vhost_work_init(&attach.work, vhost_attach_cgroups_work);
-	vhost_work_queue(dev, &attach.work);
-	vhost_work_flush(dev, &attach.work);
-	return attach.ret;
+	for (i = 0; i < dev->nworkers; ++i) {
+		attach.owner = current;
+		vhost_work_init(&attach.work, vhost_attach_cgroups_work);
+		attach.work.vq_index = i;
+		vhost_work_queue(dev, &attach.work);
+		vhost_work_flush(dev, &attach.work);
+		if (attach.ret)
+			return attach.ret;
+	}
+	return 0;
 }
 
 /* Caller should have device mutex */
@@ -366,8 +407,9 @@ EXPORT_SYMBOL_GPL(vhost_dev_has_owner);
 /* Caller should have device mutex */
 long vhost_dev_set_owner(struct vhost_dev *dev)
 {
-	struct task_struct *worker;
-	int err;
+	struct vhost_worker *workers;
+	struct task_struct *task;
+	int i, nworkers, err;
 
 	/* Is there an owner already? */
 	if (vhost_dev_has_owner(dev)) {
@@ -377,14 +419,36 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
-	if (IS_ERR(worker)) {
-		err = PTR_ERR(worker);
+
+	/* One worker per virtqueue at most; with a single worker, the
+	 * default, every virtqueue of the device is served by one thread. */
+	nworkers = clamp(max_workers, 1, dev->nvqs);
+	workers = kcalloc(nworkers, sizeof(*workers), GFP_KERNEL);
+	if (!workers) {
+		err = -ENOMEM;
 		goto err_worker;
 	}
 
-	dev->worker = worker;
-	wake_up_process(worker);	/* avoid contributing to loadavg */
+	for (i = 0; i < nworkers; ++i) {
+		spin_lock_init(&workers[i].work_lock);
+		INIT_LIST_HEAD(&workers[i].work_list);
+		workers[i].dev = dev;
+		if (nworkers == 1)
+			task = kthread_create(vhost_worker, &workers[i],
+					      "vhost-%d", current->pid);
+		else
+			task = kthread_create(vhost_worker, &workers[i],
+					      "vhost-%d-%d", current->pid, i);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			goto err_task;
+		}
+		workers[i].task = task;
+		wake_up_process(task);	/* avoid contributing to loadavg */
+	}
+
+	dev->workers = workers;
+	dev->nworkers = nworkers;
 
 	err = vhost_attach_cgroups(dev);
 	if (err)
@@ -396,8 +460,12 @@ long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	return 0;
 err_cgroup:
-	kthread_stop(worker);
-	dev->worker = NULL;
+	dev->workers = NULL;
+	dev->nworkers = 0;
+err_task:
+	while (i--)
+		kthread_stop(workers[i].task);
+	kfree(workers);
 err_worker:
 	if (dev->mm)
 		mmput(dev->mm);
@@ -472,11 +540,13 @@ void vhost_dev_cleanup(struct vhost_dev *dev, bool locked)
 	/* No one will access memory at this point */
 	kfree(dev->memory);
 	dev->memory = NULL;
-	WARN_ON(!list_empty(&dev->work_list));
-	if (dev->worker) {
-		kthread_stop(dev->worker);
-		dev->worker = NULL;
+	for (i = 0; i < dev->nworkers; ++i) {
+		WARN_ON(!list_empty(&dev->workers[i].work_list));
+		kthread_stop(dev->workers[i].task);
 	}
+	kfree(dev->workers);
+	dev->workers = NULL;
+	dev->nworkers = 0;
 	if (dev->mm)
 		mmput(dev->mm);
 	dev->mm = NULL;
@@ -806,6 +876,19 @@ long vhost_vring_ioctl(struct vhost_dev *d, int ioctl, void __user *argp)
 		} else
 			filep = eventfp;
 		break;
+	case VHOST_SET_VRING_BUSYLOOP_TIMEOUT:
+		if (copy_from_user(&s, argp, sizeof s)) {
+			r = -EFAULT;
+			break;
+		}
+		vq->busyloop_timeout = s.num;
+		break;
+	case VHOST_GET_VRING_BUSYLOOP_TIMEOUT:
+		s.index = idx;
+		s.num = vq->busyloop_timeout;
+		if (copy_to_user(argp, &s, sizeof s))
+			r = -EFAULT;
+		break;
 	default:
 		r = -ENOIOCTLCMD;
 	}
@@ -1546,6 +1629,24 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 }
 EXPORT_SYMBOL_GPL(vhost_enable_notify);
 
+/* Return true if we're sure the available ring is empty: used to decide
+ * whether busy polling should keep going. */
+bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	__virtio16 avail_idx;
+	int r;
+
+	if (vq->avail_idx != vq->last_avail_idx)
+		return false;
+
+	r = __get_user(avail_idx, &vq->avail->idx);
+	if (r)
+		return false;
+
+	return vhost16_to_cpu(vq, avail_idx) == vq->avail_idx;
+}
+EXPORT_SYMBOL_GPL(vhost_vq_avail_empty);
+
 /* We don't need to be notified again. */
 void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
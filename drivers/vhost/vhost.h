@@ -22,6 +22,16 @@ struct vhost_work {
 	int			  flushing;
 	unsigned		  queue_seq;
 	unsigned		  done_seq;
+	/* Virtqueue this work serves; selects the worker that runs it. */
+	unsigned		  vq_index;
+};
+
+/* A thread running the vhost_work queued for some of a device's virtqueues. */
+struct vhost_worker {
+	struct task_struct	*task;
+	spinlock_t		work_lock;
+	struct list_head	work_list;
+	struct vhost_dev	*dev;
 };
 
 /* Poll a file (eventfd or socket) */
@@ -106,6 +116,8 @@ struct vhost_virtqueue {
 	/* Log write descriptors */
 	void __user *log_base;
 	struct vhost_log *log;
+	/* How long (in us) to poll for new buffers before sleeping. */
+	u32 busyloop_timeout;
 };
 
 struct vhost_dev {
@@ -116,12 +128,12 @@ struct vhost_dev {
 	int nvqs;
 	struct file *log_file;
 	struct eventfd_ctx *log_ctx;
-	spinlock_t work_lock;
-	struct list_head work_list;
-	struct task_struct *worker;
+	struct vhost_worker *workers;
+	int nworkers;
 };
 
 void vhost_dev_init(struct vhost_dev *, struct vhost_virtqueue **vqs, int nvqs);
+bool vhost_has_work(struct vhost_dev *dev);
 long vhost_dev_set_owner(struct vhost_dev *dev);
 bool vhost_dev_has_owner(struct vhost_dev *dev);
 long vhost_dev_check_owner(struct vhost_dev *);
@@ -151,6 +163,7 @@ void vhost_add_used_and_signal_n(struct vhost_dev *, struct vhost_virtqueue *,
 void vhost_signal(struct vhost_dev *, struct vhost_virtqueue *);
 void vhost_disable_notify(struct vhost_dev *, struct vhost_virtqueue *);
 bool vhost_enable_notify(struct vhost_dev *, struct vhost_virtqueue *);
+bool vhost_vq_avail_empty(struct vhost_dev *, struct vhost_virtqueue *);
 
 int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 		    unsigned int log_num, u64 len);
@@ -498,6 +498,10 @@ void kiocb_set_cancel_fn(struct kiocb *req, kiocb_cancel_fn *cancel)
 	struct kioctx *ctx = req->ki_ctx;
 	unsigned long flags;
 
+	/* only kiocbs of an aio context can be cancelled */
+	if (!ctx)
+		return;
+
 	spin_lock_irqsave(&ctx->ctx_lock, flags);
 
 	if (!req->ki_list.next)
@@ -1031,6 +1035,11 @@ void aio_complete(struct kiocb *iocb, long res, long res2)
 	unsigned tail, pos, head;
 	unsigned long	flags;
 
+	if (iocb->ki_complete) {
+		iocb->ki_complete(iocb, res, res2);
+		return;
+	}
+
 	/*
 	 * Special case handling for sync iocbs:
 	 *  - events go directly into the iocb for fast handling
@@ -2281,7 +2281,12 @@ static int elf_core_dump(struct coredump_params *cprm)
 			page = get_dump_page(addr);
 			if (page) {
 				void *kaddr = kmap(page);
-				stop = !dump_emit(cprm, kaddr, PAGE_SIZE);
+				/* zero-filled pages become holes too */
+				if (memchr_inv(kaddr, 0, PAGE_SIZE))
+					stop = !dump_emit(cprm, kaddr,
+							  PAGE_SIZE);
+				else
+					stop = !dump_skip(cprm, PAGE_SIZE);
 				kunmap(page);
 				page_cache_release(page);
 			} else
@@ -154,12 +154,122 @@ blkdev_get_block(struct inode *inode, sector_t iblock,
 	return 0;
 }
 
+/*
+ * Largest synchronous direct I/O, in pages, that is issued as a single
+ * bio with its vector on the stack.
+ */
+#define DIO_INLINE_BIO_VECS 4
+
+static void blkdev_bio_end_io_simple(struct bio *bio, int error)
+{
+	struct task_struct *waiter = bio->bi_private;
+
+	WRITE_ONCE(bio->bi_private, NULL);
+	wake_up_process(waiter);
+}
+
+/*
+ * Direct I/O on the block device itself doesn't need any of the block
+ * mapping done by __blockdev_direct_IO().  Small synchronous requests
+ * are mapped into one bio on the stack and waited for right here.
+ * Returns -ENOTBLK if the request has to take the generic path; @iter
+ * is left untouched in that case.
+ */
+static ssize_t
+__blkdev_direct_IO_simple(int rw, struct kiocb *iocb, struct iov_iter *iter,
+			  loff_t offset, int nr_pages)
+{
+	struct block_device *bdev = I_BDEV(iocb->ki_filp->f_mapping->host);
+	unsigned blkbits = blksize_bits(bdev_logical_block_size(bdev));
+	struct bio_vec inline_vecs[DIO_INLINE_BIO_VECS];
+	struct page *pages[DIO_INLINE_BIO_VECS];
+	size_t start, len;
+	bool hybrid = true;
+	struct bio bio;
+	ssize_t ret;
+	int i;
+
+	if ((offset | iov_iter_alignment(iter)) & ((1 << blkbits) - 1))
+		return -ENOTBLK;
+	/* the stack bio is never freed, so nothing may be attached to it */
+	if (bdev_get_integrity(bdev))
+		return -ENOTBLK;
+
+	ret = iov_iter_get_pages(iter, pages, iov_iter_count(iter), nr_pages,
+				 &start);
+	if (ret <= 0)
+		return ret ? ret : -EFAULT;
+
+	/* only the first segment of an iovec is mapped at a time */
+	nr_pages = DIV_ROUND_UP(start + ret, PAGE_SIZE);
+	if (ret != iov_iter_count(iter)) {
+		ret = -ENOTBLK;
+		goto out;
+	}
+
+	bio_init(&bio);
+	bio.bi_max_vecs = nr_pages;
+	bio.bi_io_vec = inline_vecs;
+	bio.bi_bdev = bdev;
+	bio.bi_iter.bi_sector = offset >> 9;
+	bio.bi_private = current;
+	bio.bi_end_io = blkdev_bio_end_io_simple;
+
+	for (len = ret, i = 0; i < nr_pages; i++) {
+		size_t plen = min_t(size_t, len, PAGE_SIZE - start);
+
+		/* the queue limits don't allow it as a single bio */
+		if (bio_add_page(&bio, pages[i], plen, start) != plen) {
+			ret = -ENOTBLK;
+			goto out;
+		}
+		len -= plen;
+		start = 0;
+	}
+
+	submit_bio(rw == WRITE ? WRITE_ODIRECT : READ, &bio);
+	for (;;) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (!READ_ONCE(bio.bi_private))
+			break;
+		if (!blk_poll(bdev_get_queue(bdev), hybrid))
+			io_schedule();
+		hybrid = false;
+	}
+	__set_current_state(TASK_RUNNING);
+
+	bio_disassociate_task(&bio);
+	if (test_bit(BIO_UPTODATE, &bio.bi_flags))
+		iov_iter_advance(iter, ret);
+	else
+		ret = -EIO;
+out:
+	for (i = 0; i < nr_pages; i++) {
+		if (rw == READ && ret > 0 && !PageCompound(pages[i]))
+			set_page_dirty_lock(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	return ret;
+}
+
 static ssize_t
 blkdev_direct_IO(int rw, struct kiocb *iocb, struct iov_iter *iter,
 			loff_t offset)
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file->f_mapping->host;
+	int nr_pages;
+
+	nr_pages = iov_iter_npages(iter, DIO_INLINE_BIO_VECS + 1);
+	if (is_sync_kiocb(iocb) && nr_pages &&
+	    nr_pages <= DIO_INLINE_BIO_VECS) {
+		ssize_t ret;
+
+		ret = __blkdev_direct_IO_simple(rw, iocb, iter, offset,
+						nr_pages);
+		if (ret != -ENOTBLK)
+			return ret;
+	}
 
 	return __blockdev_direct_IO(rw, iocb, inode, I_BDEV(inode), iter,
 				    offset, blkdev_get_block,
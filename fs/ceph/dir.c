@@ -883,6 +883,84 @@ static int drop_caps_for_unlink(struct inode *inode)
 	return drop;
 }
 
+static int ceph_async_unlinks_wait(atomic_t *p)
+{
+	schedule();
+	return 0;
+}
+
+/*
+ * Wait until the mds has answered every unlink sent asynchronously
+ * from @dir.
+ */
+void ceph_wait_async_unlinks(struct inode *dir)
+{
+	wait_on_atomic_t(&ceph_inode(dir)->i_async_unlinks,
+			 ceph_async_unlinks_wait, TASK_UNINTERRUPTIBLE);
+}
+
+/*
+ * Return (and forget) the first error an async unlink from @dir ran into.
+ */
+static int ceph_async_unlink_err(struct inode *dir)
+{
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	int err;
+
+	spin_lock(&ci->i_ceph_lock);
+	err = ci->i_async_err;
+	ci->i_async_err = 0;
+	spin_unlock(&ci->i_ceph_lock);
+	return err;
+}
+
+static void ceph_async_unlink_cb(struct ceph_mds_client *mdsc,
+				 struct ceph_mds_request *req)
+{
+	struct inode *dir = req->r_async_dir;
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	int err = req->r_err;
+
+	if (!err)
+		err = le32_to_cpu(req->r_reply_info.head->result);
+	dout("async unlink %p '%pd' result %d\n", dir, req->r_dentry, err);
+
+	if (err) {
+		pr_warn("ceph: async unlink of %pd failed: %d\n",
+			req->r_dentry, err);
+		/* our view of the dir is wrong, go back to the mds */
+		spin_lock(&ci->i_ceph_lock);
+		if (!ci->i_async_err)
+			ci->i_async_err = err;
+		__ceph_dir_clear_complete(ci);
+		spin_unlock(&ci->i_ceph_lock);
+		d_drop(req->r_dentry);
+	}
+
+	if (atomic_dec_and_test(&ci->i_async_unlinks))
+		wake_up_atomic_t(&ci->i_async_unlinks);
+}
+
+/*
+ * With Fx on the dir nobody else can be changing it, so a plain unlink
+ * can be reflected locally right away and confirmed by the mds later.
+ */
+static bool ceph_can_async_unlink(struct inode *dir, int op)
+{
+	struct ceph_fs_client *fsc = ceph_sb_to_client(dir->i_sb);
+	struct ceph_inode_info *ci = ceph_inode(dir);
+	bool ret;
+
+	if (op != CEPH_MDS_OP_UNLINK ||
+	    !ceph_test_mount_opt(fsc, ASYNC_DIROPS))
+		return false;
+
+	spin_lock(&ci->i_ceph_lock);
+	ret = __ceph_caps_issued(ci, NULL) & CEPH_CAP_FILE_EXCL;
+	spin_unlock(&ci->i_ceph_lock);
+	return ret;
+}
+
 /*
  * rmdir and unlink are differ only by the metadata op code
  */
@@ -913,10 +991,25 @@ static int ceph_unlink(struct inode *dir, struct dentry *dentry)
 	}
 	req->r_dentry = dget(dentry);
 	req->r_num_caps = 2;
-	req->r_locked_dir = dir;
 	req->r_dentry_drop = CEPH_CAP_FILE_SHARED;
 	req->r_dentry_unless = CEPH_CAP_FILE_EXCL;
 	req->r_inode_drop = drop_caps_for_unlink(inode);
+
+	if (ceph_can_async_unlink(dir, op)) {
+		dout("unlink %p '%pd' async\n", dir, dentry);
+		ihold(dir);
+		ceph_get_cap_refs(ceph_inode(dir), CEPH_CAP_PIN);
+		req->r_async_dir = dir;
+		req->r_callback = ceph_async_unlink_cb;
+		atomic_inc(&ceph_inode(dir)->i_async_unlinks);
+		drop_nlink(inode);
+		/* a failure has already been handled by the callback */
+		ceph_mdsc_submit_request(mdsc, dir, req);
+		ceph_mdsc_put_request(req);
+		return 0;
+	}
+
+	req->r_locked_dir = dir;
 	err = ceph_mdsc_do_request(mdsc, dir, req);
 	if (!err && !req->r_reply_info.head->is_dentry)
 		d_delete(dentry);
@@ -1222,6 +1315,7 @@ static int ceph_dir_fsync(struct file *file, loff_t start, loff_t end,
 	if (ret)
 		return ret;
 	mutex_lock(&inode->i_mutex);
+	ceph_wait_async_unlinks(inode);
 
 	spin_lock(&ci->i_unsafe_lock);
 	if (list_empty(head))
@@ -1259,9 +1353,19 @@ out:
 	spin_unlock(&ci->i_unsafe_lock);
 	mutex_unlock(&inode->i_mutex);
 
+	if (!ret)
+		ret = ceph_async_unlink_err(inode);
 	return ret;
 }
 
+/*
+ * close() of a dir reports an async unlink that has failed meanwhile.
+ */
+static int ceph_dir_flush(struct file *file, fl_owner_t id)
+{
+	return ceph_async_unlink_err(file_inode(file));
+}
+
 /*
  * We maintain a private dentry LRU.
  *
@@ -1333,6 +1437,7 @@ const struct file_operations ceph_dir_fops = {
 	.release = ceph_release,
 	.unlocked_ioctl = ceph_ioctl,
 	.fsync = ceph_dir_fsync,
+	.flush = ceph_dir_flush,
 };
 
 const struct inode_operations ceph_dir_iops = {
@@ -454,6 +454,8 @@ struct inode *ceph_alloc_inode(struct super_block *sb)
 	INIT_LIST_HEAD(&ci->i_unsafe_writes);
 	INIT_LIST_HEAD(&ci->i_unsafe_dirops);
 	spin_lock_init(&ci->i_unsafe_lock);
+	atomic_set(&ci->i_async_unlinks, 0);
+	ci->i_async_err = 0;
 
 	ci->i_snap_realm = NULL;
 	INIT_LIST_HEAD(&ci->i_snap_realm_item);
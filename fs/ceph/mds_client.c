@@ -534,6 +534,10 @@ void ceph_mdsc_release_request(struct kref *kref)
 	}
 	if (req->r_locked_dir)
 		ceph_put_cap_refs(ceph_inode(req->r_locked_dir), CEPH_CAP_PIN);
+	if (req->r_async_dir) {
+		ceph_put_cap_refs(ceph_inode(req->r_async_dir), CEPH_CAP_PIN);
+		iput(req->r_async_dir);
+	}
 	iput(req->r_target_inode);
 	if (req->r_dentry)
 		dput(req->r_dentry);
@@ -2168,14 +2172,26 @@ static void kick_requests(struct ceph_mds_client *mdsc, int mds)
 	}
 }
 
-void ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
-			      struct ceph_mds_request *req)
+/*
+ * Send an mds request without waiting for the reply.  The caller is
+ * told about the outcome through req->r_callback; if @dir is given the
+ * request is tracked as an unsafe dirop there until the mds commits it.
+ */
+int ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
+			     struct inode *dir,
+			     struct ceph_mds_request *req)
 {
+	int err;
+
 	dout("submit_request on %p\n", req);
 	mutex_lock(&mdsc->mutex);
-	__register_request(mdsc, req, NULL);
+	__register_request(mdsc, req, dir);
 	__do_request(mdsc, req);
+	err = req->r_err;
+	if (err)
+		__unregister_request(mdsc, req);
 	mutex_unlock(&mdsc->mutex);
+	return err;
 }
 
 /*
@@ -2190,6 +2206,14 @@ int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
 
 	dout("do_request on %p\n", req);
 
+	/* unlinks still in flight in the dirs involved go first */
+	if (req->r_locked_dir)
+		ceph_wait_async_unlinks(req->r_locked_dir);
+	if (req->r_old_dentry_dir)
+		ceph_wait_async_unlinks(req->r_old_dentry_dir);
+	if (req->r_op == CEPH_MDS_OP_RMDIR && req->r_dentry->d_inode)
+		ceph_wait_async_unlinks(req->r_dentry->d_inode);
+
 	/* take CAP_PIN refs for r_inode, r_locked_dir, r_old_dentry */
 	if (req->r_inode)
 		ceph_get_cap_refs(ceph_inode(req->r_inode), CEPH_CAP_PIN);
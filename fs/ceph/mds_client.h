@@ -194,6 +194,7 @@ struct ceph_mds_request {
 	struct ceph_vino r_ino1, r_ino2;
 
 	struct inode *r_locked_dir; /* dir (if any) i_mutex locked by vfs */
+	struct inode *r_async_dir;  /* dir of an unlink completed locally */
 	struct inode *r_target_inode;       /* resulting inode */
 
 	struct mutex r_fill_mutex;
@@ -362,8 +363,9 @@ extern int ceph_alloc_readdir_reply_buffer(struct ceph_mds_request *req,
 					   struct inode *dir);
 extern struct ceph_mds_request *
 ceph_mdsc_create_request(struct ceph_mds_client *mdsc, int op, int mode);
-extern void ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
-				     struct ceph_mds_request *req);
+extern int ceph_mdsc_submit_request(struct ceph_mds_client *mdsc,
+				    struct inode *dir,
+				    struct ceph_mds_request *req);
 extern int ceph_mdsc_do_request(struct ceph_mds_client *mdsc,
 				struct inode *dir,
 				struct ceph_mds_request *req);
@@ -35,6 +35,7 @@
 #define CEPH_MOUNT_OPT_INO32           (1<<8) /* 32 bit inos */
 #define CEPH_MOUNT_OPT_DCACHE          (1<<9) /* use dcache for readdir etc */
 #define CEPH_MOUNT_OPT_FSCACHE         (1<<10) /* use fscache */
+#define CEPH_MOUNT_OPT_ASYNC_DIROPS    (1<<11) /* async unlink (nowsync) */
 
 #define CEPH_MOUNT_OPT_DEFAULT    (CEPH_MOUNT_OPT_RBYTES)
 
@@ -320,6 +321,9 @@ struct ceph_inode_info {
 	struct list_head i_unsafe_writes; /* uncommitted sync writes */
 	struct list_head i_unsafe_dirops; /* uncommitted mds dir ops */
 	spinlock_t i_unsafe_lock;
+	atomic_t i_async_unlinks; /* unlinks not yet answered by the mds */
+	int i_async_err;          /* first async unlink error, protected
+				     by i_ceph_lock */
 
 	struct ceph_snap_realm *i_snap_realm; /* snap realm (if caps) */
 	int i_snap_realm_counter; /* snap realm (if caps) */
@@ -907,6 +911,7 @@ extern void ceph_dentry_lru_touch(struct dentry *dn);
 extern void ceph_dentry_lru_del(struct dentry *dn);
 extern void ceph_invalidate_dentry_lease(struct dentry *dentry);
 extern unsigned ceph_dentry_hash(struct inode *dir, struct dentry *dn);
+extern void ceph_wait_async_unlinks(struct inode *dir);
 extern struct inode *ceph_get_dentry_parent_inode(struct dentry *dentry);
 
 /*
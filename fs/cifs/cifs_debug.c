@@ -180,6 +180,13 @@ static int cifs_debug_data_proc_show(struct seq_file *m, void *v)
 				atomic_read(&server->in_send),
 				atomic_read(&server->num_waiters));
 #endif
+#ifdef CONFIG_CIFS_SMB2
+			if (ses->binding)
+				seq_puts(m, " Channel");
+			else if (ses->chan_count)
+				seq_printf(m, " Channels: %u",
+					   ses->chan_count + 1);
+#endif
 
 			seq_puts(m, "\n\tShares:");
 			j = 0;
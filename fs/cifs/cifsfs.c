@@ -500,6 +500,10 @@ cifs_show_options(struct seq_file *s, struct dentry *root)
 	seq_printf(s, ",wsize=%u", cifs_sb->wsize);
 	/* convert actimeo and display it in seconds */
 	seq_printf(s, ",actimeo=%lu", cifs_sb->actimeo / HZ);
+#ifdef CONFIG_CIFS_SMB2
+	if (tcon->ses->chan_max > 1)
+		seq_printf(s, ",max_channels=%u", tcon->ses->chan_max);
+#endif
 
 	return 0;
 }
@@ -63,6 +63,12 @@
  */
 #define CIFS_MAX_REQ 32767
 
+/*
+ * Maximum number of connections (the primary one included) that an SMB3
+ * session may be bound to with the multichannel mount option
+ */
+#define CIFS_MAX_CHANNELS 16
+
 #define RFC1001_NAME_LEN 15
 #define RFC1001_NAME_LEN_WITH_NULL (RFC1001_NAME_LEN + 1)
 
@@ -374,6 +380,9 @@ struct smb_version_operations {
 	int (*create_mf_symlink)(unsigned int, struct cifs_tcon *,
 				 struct cifs_sb_info *, const unsigned char *,
 				 char *, unsigned int *);
+	/* get the addresses of the server's network interfaces */
+	int (*query_interfaces)(const unsigned int, struct cifs_tcon *,
+				struct sockaddr_storage *, unsigned int *);
 	/* if we can do cache read operations */
 	bool (*is_read_op)(__u32);
 	/* set oplock level for the inode */
@@ -485,6 +494,8 @@ struct smb_vol {
 	bool multiuser:1;
 	bool rwpidforward:1; /* pid forward for read/write operations */
 	bool nosharesock;
+	bool channel:1; /* private connection for an extra session channel */
+	unsigned int max_channels; /* connections per session, 1 = no binding */
 	unsigned int rsize;
 	unsigned int wsize;
 	bool sockopt_tcp_nodelay:1;
@@ -561,6 +572,7 @@ struct TCP_Server_Info {
 	__u16 sec_mode;
 	bool sign; /* is signing enabled on this connection? */
 	bool session_estab; /* mark when very first sess is established */
+	bool is_channel; /* extra channel of one session, never shared */
 #ifdef CONFIG_CIFS_SMB2
 	int echo_credits;  /* echo reserved slots */
 	int oplock_credits;  /* oplock break reserved slots */
@@ -798,6 +810,16 @@ struct cifs_ses {
 #ifdef CONFIG_CIFS_SMB2
 	__u16 session_flags;
 	char smb3signingkey[SMB3_SIGN_KEY_SIZE]; /* for signing smb3 packets */
+	/*
+	 * Extra connections bound to this session (multichannel). Each
+	 * channel has its own cifs_ses on the channel's smb_ses_list, with
+	 * the same Suid and the signing key of that channel.
+	 */
+	struct cifs_ses *chans[CIFS_MAX_CHANNELS - 1];
+	unsigned int chan_count;	/* valid entries in chans[] */
+	unsigned int chan_max;		/* channels requested at mount */
+	atomic_t chan_seq;		/* round robin cursor for async i/o */
+	bool binding:1;			/* this is a channel, not a session */
 #endif /* CONFIG_CIFS_SMB2 */
 };
 
@@ -1065,6 +1087,7 @@ struct cifs_readdata {
 	pid_t				pid;
 	int				result;
 	struct work_struct		work;
+	struct TCP_Server_Info		*server; /* channel, NULL = primary */
 	int (*read_into_pages)(struct TCP_Server_Info *server,
 				struct cifs_readdata *rdata,
 				unsigned int len);
@@ -1086,6 +1109,7 @@ struct cifs_writedata {
 	enum writeback_sync_modes	sync_mode;
 	struct work_struct		work;
 	struct cifsFileInfo		*cfile;
+	struct TCP_Server_Info		*server; /* channel, NULL = primary */
 	__u64				offset;
 	pid_t				pid;
 	unsigned int			bytes;
@@ -86,13 +86,13 @@ enum {
 	Opt_acl, Opt_noacl, Opt_locallease,
 	Opt_sign, Opt_seal, Opt_noac,
 	Opt_fsc, Opt_mfsymlinks,
-	Opt_multiuser, Opt_sloppy, Opt_nosharesock,
+	Opt_multiuser, Opt_sloppy, Opt_nosharesock, Opt_multichannel,
 
 	/* Mount options which take numeric value */
 	Opt_backupuid, Opt_backupgid, Opt_uid,
 	Opt_cruid, Opt_gid, Opt_file_mode,
 	Opt_dirmode, Opt_port,
-	Opt_rsize, Opt_wsize, Opt_actimeo,
+	Opt_rsize, Opt_wsize, Opt_actimeo, Opt_max_channels,
 
 	/* Mount options which take string value */
 	Opt_user, Opt_pass, Opt_ip,
@@ -169,6 +169,7 @@ static const match_table_t cifs_mount_option_tokens = {
 	{ Opt_multiuser, "multiuser" },
 	{ Opt_sloppy, "sloppy" },
 	{ Opt_nosharesock, "nosharesock" },
+	{ Opt_multichannel, "multichannel" },
 
 	{ Opt_backupuid, "backupuid=%s" },
 	{ Opt_backupgid, "backupgid=%s" },
@@ -182,6 +183,7 @@ static const match_table_t cifs_mount_option_tokens = {
 	{ Opt_rsize, "rsize=%s" },
 	{ Opt_wsize, "wsize=%s" },
 	{ Opt_actimeo, "actimeo=%s" },
+	{ Opt_max_channels, "max_channels=%s" },
 
 	{ Opt_blank_user, "user=" },
 	{ Opt_blank_user, "username=" },
@@ -1256,6 +1258,9 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 
 	vol->actimeo = CIFS_DEF_ACTIMEO;
 
+	/* no extra channels unless asked for */
+	vol->max_channels = 1;
+
 	/* FIXME: add autonegotiation -- for now, SMB1 is default */
 	vol->ops = &smb1_operations;
 	vol->vals = &smb1_values;
@@ -1487,6 +1492,10 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 		case Opt_nosharesock:
 			vol->nosharesock = true;
 			break;
+		case Opt_multichannel:
+			if (vol->max_channels < 2)
+				vol->max_channels = 2;
+			break;
 
 		/* Numeric Values */
 		case Opt_backupuid:
@@ -1581,6 +1590,15 @@ cifs_parse_mount_options(const char *mountdata, const char *devname,
 				goto cifs_parse_mount_err;
 			}
 			break;
+		case Opt_max_channels:
+			if (get_option_ul(args, &option) || option < 1 ||
+			    option > CIFS_MAX_CHANNELS) {
+				cifs_dbg(VFS, "%s: Invalid max_channels value, needs to be 1-%d\n",
+					 __func__, CIFS_MAX_CHANNELS);
+				goto cifs_parse_mount_err;
+			}
+			vol->max_channels = option;
+			break;
 
 		/* String Arguments */
 
@@ -2023,7 +2041,11 @@ static int match_server(struct TCP_Server_Info *server, struct smb_vol *vol)
 {
 	struct sockaddr *addr = (struct sockaddr *)&vol->dstaddr;
 
-	if (vol->nosharesock)
+	if (vol->nosharesock || vol->channel)
+		return 0;
+
+	/* channels belong to the session that bound them */
+	if (server->is_channel)
 		return 0;
 
 	if ((server->vals != vol->vals) || (server->ops != vol->ops))
@@ -2140,6 +2162,7 @@ cifs_get_tcp_session(struct smb_vol *volume_info)
 	memcpy(tcp_ses->server_RFC1001_name,
 		volume_info->target_rfc1001_name, RFC1001_NAME_LEN_WITH_NULL);
 	tcp_ses->session_estab = false;
+	tcp_ses->is_channel = volume_info->channel;
 	tcp_ses->sequence_number = 0;
 	tcp_ses->lstrp = jiffies;
 	spin_lock_init(&tcp_ses->req_lock);
@@ -2263,6 +2286,21 @@ cifs_find_smb_ses(struct TCP_Server_Info *server, struct smb_vol *vol)
 	return NULL;
 }
 
+#ifdef CONFIG_CIFS_SMB2
+static void
+cifs_free_channel(struct cifs_ses *chan)
+{
+	struct TCP_Server_Info *server = chan->server;
+
+	spin_lock(&cifs_tcp_ses_lock);
+	list_del_init(&chan->smb_ses_list);
+	spin_unlock(&cifs_tcp_ses_lock);
+
+	sesInfoFree(chan);
+	cifs_put_tcp_session(server);
+}
+#endif
+
 static void
 cifs_put_smb_ses(struct cifs_ses *ses)
 {
@@ -2293,6 +2331,12 @@ cifs_put_smb_ses(struct cifs_ses *ses)
 		_free_xid(xid);
 	}
 
+#ifdef CONFIG_CIFS_SMB2
+	/* the logoff above ended the session on every channel */
+	while (ses->chan_count)
+		cifs_free_channel(ses->chans[--ses->chan_count]);
+#endif
+
 	spin_lock(&cifs_tcp_ses_lock);
 	list_del_init(&ses->smb_ses_list);
 	spin_unlock(&cifs_tcp_ses_lock);
@@ -2510,6 +2554,9 @@ cifs_get_smb_ses(struct TCP_Server_Info *server, struct smb_vol *volume_info)
 
 	ses->sectype = volume_info->sectype;
 	ses->sign = volume_info->sign;
+#ifdef CONFIG_CIFS_SMB2
+	ses->chan_max = volume_info->max_channels;
+#endif
 
 	mutex_lock(&ses->session_mutex);
 	rc = cifs_negotiate_protocol(xid, ses);
@@ -2533,6 +2580,178 @@ get_ses_fail:
 	return ERR_PTR(rc);
 }
 
+/*
+ * Pick the connection for the next async read or write on @ses. The
+ * primary connection and the bound channels take turns; a channel that
+ * is down, or was bound to an earlier incarnation of the session, is
+ * skipped.
+ */
+struct TCP_Server_Info *
+cifs_pick_channel(struct cifs_ses *ses)
+{
+#ifdef CONFIG_CIFS_SMB2
+	unsigned int count = ACCESS_ONCE(ses->chan_count);
+	unsigned int i, start;
+
+	if (!count)
+		return ses->server;
+	/* pairs with smp_wmb() in cifs_bind_channel() */
+	smp_rmb();
+
+	start = atomic_inc_return(&ses->chan_seq);
+	for (i = 0; i <= count; i++) {
+		unsigned int idx = (start + i) % (count + 1);
+		struct cifs_ses *chan;
+
+		if (!idx)
+			break;
+		chan = ses->chans[idx - 1];
+		if (chan->server->tcpStatus == CifsGood &&
+		    !chan->need_reconnect && !ses->need_reconnect &&
+		    chan->Suid == ses->Suid)
+			return chan->server;
+	}
+#endif
+	return ses->server;
+}
+
+#ifdef CONFIG_CIFS_SMB2
+/*
+ * Open another connection to the server at @addr and bind it to @ses as
+ * a new channel. Called with ses->session_mutex held.
+ */
+static int
+cifs_bind_channel(const unsigned int xid, struct cifs_ses *ses,
+		  struct smb_vol *vol, struct sockaddr_storage *addr)
+{
+	struct TCP_Server_Info *server = ses->server;
+	struct TCP_Server_Info *chan_server;
+	struct cifs_ses *chan;
+	struct smb_vol chan_vol;
+	__be16 port;
+	int rc = -ENOMEM;
+
+	if (server->dstaddr.ss_family == AF_INET6)
+		port = ((struct sockaddr_in6 *)&server->dstaddr)->sin6_port;
+	else
+		port = ((struct sockaddr_in *)&server->dstaddr)->sin_port;
+
+	/* a private connection, to the same port as the primary one */
+	chan_vol = *vol;
+	chan_vol.channel = true;
+	memcpy(&chan_vol.dstaddr, addr, sizeof(chan_vol.dstaddr));
+	cifs_set_port((struct sockaddr *)&chan_vol.dstaddr, ntohs(port));
+
+	chan_server = cifs_get_tcp_session(&chan_vol);
+	if (IS_ERR(chan_server))
+		return PTR_ERR(chan_server);
+
+	chan = sesInfoAlloc();
+	if (chan == NULL)
+		goto out_put_server;
+
+	chan->server = chan_server;
+	memcpy(chan->serverName, ses->serverName, sizeof(chan->serverName));
+	if (ses->user_name) {
+		chan->user_name = kstrdup(ses->user_name, GFP_KERNEL);
+		if (!chan->user_name)
+			goto out_free;
+	}
+	if (ses->password) {
+		chan->password = kstrdup(ses->password, GFP_KERNEL);
+		if (!chan->password)
+			goto out_free;
+	}
+	if (ses->domainName) {
+		chan->domainName = kstrdup(ses->domainName, GFP_KERNEL);
+		if (!chan->domainName)
+			goto out_free;
+	}
+	chan->cred_uid = ses->cred_uid;
+	chan->linux_uid = ses->linux_uid;
+	chan->sectype = ses->sectype;
+	chan->sign = ses->sign;
+	chan->Suid = ses->Suid;
+	chan->binding = true;
+	/* the binding request is signed with the session's key */
+	memcpy(chan->smb3signingkey, ses->smb3signingkey,
+	       SMB3_SIGN_KEY_SIZE);
+
+	/* signing looks the session up by Suid on the connection */
+	spin_lock(&cifs_tcp_ses_lock);
+	list_add(&chan->smb_ses_list, &chan_server->smb_ses_list);
+	spin_unlock(&cifs_tcp_ses_lock);
+
+	rc = cifs_negotiate_protocol(xid, chan);
+	if (!rc && chan_server->dialect != server->dialect)
+		rc = -EOPNOTSUPP;
+	if (!rc)
+		rc = cifs_setup_session(xid, chan, vol->local_nls);
+	if (rc) {
+		cifs_free_channel(chan);
+		return rc;
+	}
+
+	ses->chans[ses->chan_count] = chan;
+	/* the entry must be visible before cifs_pick_channel() can see it */
+	smp_wmb();
+	ses->chan_count++;
+	return 0;
+
+out_free:
+	sesInfoFree(chan);
+out_put_server:
+	cifs_put_tcp_session(chan_server);
+	return rc;
+}
+
+/*
+ * Bind extra connections to @ses up to the number of channels asked for
+ * when it was set up, one per network interface the server reports (or
+ * all to the primary address if it reports none). Failing to bind is not
+ * fatal: the session keeps working over the channels it has.
+ */
+static void
+cifs_add_channels(const unsigned int xid, struct cifs_ses *ses,
+		  struct cifs_tcon *tcon, struct smb_vol *vol)
+{
+	struct TCP_Server_Info *server = ses->server;
+	struct sockaddr_storage *addrs;
+	unsigned int count = CIFS_MAX_CHANNELS;
+	unsigned int i;
+	int rc;
+
+	if (ses->chan_max < 2 || ses->chan_count >= ses->chan_max - 1 ||
+	    !server->ops->query_interfaces ||
+	    !(server->capabilities & SMB2_GLOBAL_CAP_MULTI_CHANNEL))
+		return;
+
+	addrs = kcalloc(count, sizeof(*addrs), GFP_KERNEL);
+	if (!addrs)
+		return;
+
+	rc = server->ops->query_interfaces(xid, tcon, addrs, &count);
+	if (rc || !count) {
+		memcpy(&addrs[0], &server->dstaddr, sizeof(addrs[0]));
+		count = 1;
+	}
+
+	mutex_lock(&ses->session_mutex);
+	for (i = 0; ses->chan_count < ses->chan_max - 1; i++) {
+		rc = cifs_bind_channel(xid, ses, vol, &addrs[i % count]);
+		if (rc) {
+			cifs_dbg(VFS, "Failed to bind channel %u, rc=%d\n",
+				 ses->chan_count + 1, rc);
+			break;
+		}
+	}
+	mutex_unlock(&ses->session_mutex);
+
+	cifs_dbg(FYI, "Session has %u channels\n", ses->chan_count + 1);
+	kfree(addrs);
+}
+#endif /* CONFIG_CIFS_SMB2 */
+
 static int match_tcon(struct cifs_tcon *tcon, const char *unc)
 {
 	if (tcon->tidStatus == CifsExiting)
@@ -3513,6 +3732,11 @@ try_mount_again:
 	if (!tcon->ipc && server->ops->qfs_tcon)
 		server->ops->qfs_tcon(xid, tcon);
 
+#ifdef CONFIG_CIFS_SMB2
+	if (!tcon->ipc)
+		cifs_add_channels(xid, ses, tcon, volume_info);
+#endif
+
 	cifs_sb->wsize = server->ops->negotiate_wsize(tcon, volume_info);
 	cifs_sb->rsize = server->ops->negotiate_rsize(tcon, volume_info);
 
@@ -2043,8 +2043,11 @@ static int cifs_writepages(struct address_space *mapping,
 			   struct writeback_control *wbc)
 {
 	struct cifs_sb_info *cifs_sb = CIFS_SB(mapping->host->i_sb);
-	struct TCP_Server_Info *server;
+	struct cifs_ses *ses = cifs_sb_master_tcon(cifs_sb)->ses;
+	struct TCP_Server_Info *server = ses->server;
 	bool done = false, scanned = false, range_whole = false;
+	/* with multiuser the pages may go out over another user's session */
+	bool spread = !(cifs_sb->mnt_cifs_flags & CIFS_MOUNT_MULTIUSER);
 	pgoff_t end, index;
 	struct cifs_writedata *wdata;
 	int rc = 0;
@@ -2066,12 +2069,13 @@ static int cifs_writepages(struct address_space *mapping,
 			range_whole = true;
 		scanned = true;
 	}
-	server = cifs_sb_master_tcon(cifs_sb)->ses->server;
 retry:
 	while (!done && index <= end) {
 		unsigned int i, nr_pages, found_pages, wsize, credits;
 		pgoff_t next = 0, tofind, saved_index = index;
 
+		if (spread)
+			server = cifs_pick_channel(ses);
 		rc = server->ops->wait_mtu_credits(server, cifs_sb->wsize,
 						   &wsize, &credits);
 		if (rc)
@@ -2104,6 +2108,8 @@ retry:
 		}
 
 		wdata->credits = credits;
+		if (spread)
+			wdata->server = server;
 
 		rc = wdata_send_pages(wdata, nr_pages, mapping, wbc);
 
@@ -2479,6 +2485,7 @@ cifs_write_from_iter(loff_t offset, size_t len, struct iov_iter *from,
 	struct iov_iter saved_from;
 	loff_t saved_offset = offset;
 	pid_t pid;
+	struct cifs_ses *ses;
 	struct TCP_Server_Info *server;
 
 	if (cifs_sb->mnt_cifs_flags & CIFS_MOUNT_RWPIDFORWARD)
@@ -2486,12 +2493,13 @@ cifs_write_from_iter(loff_t offset, size_t len, struct iov_iter *from,
 	else
 		pid = current->tgid;
 
-	server = tlink_tcon(open_file->tlink)->ses->server;
+	ses = tlink_tcon(open_file->tlink)->ses;
 	memcpy(&saved_from, from, sizeof(struct iov_iter));
 
 	do {
 		unsigned int wsize, credits;
 
+		server = cifs_pick_channel(ses);
 		rc = server->ops->wait_mtu_credits(server, cifs_sb->wsize,
 						   &wsize, &credits);
 		if (rc)
@@ -2539,6 +2547,7 @@ cifs_write_from_iter(loff_t offset, size_t len, struct iov_iter *from,
 		wdata->pagesz = PAGE_SIZE;
 		wdata->tailsz = cur_len - ((nr_pages - 1) * PAGE_SIZE);
 		wdata->credits = credits;
+		wdata->server = server;
 
 		if (!wdata->cfile->invalidHandle ||
 		    !cifs_reopen_file(wdata->cfile, false))
@@ -2935,9 +2944,10 @@ cifs_send_async_read(loff_t offset, size_t len, struct cifsFileInfo *open_file,
 	size_t cur_len;
 	int rc;
 	pid_t pid;
+	struct cifs_ses *ses;
 	struct TCP_Server_Info *server;
 
-	server = tlink_tcon(open_file->tlink)->ses->server;
+	ses = tlink_tcon(open_file->tlink)->ses;
 
 	if (cifs_sb->mnt_cifs_flags & CIFS_MOUNT_RWPIDFORWARD)
 		pid = open_file->pid;
@@ -2945,6 +2955,7 @@ cifs_send_async_read(loff_t offset, size_t len, struct cifsFileInfo *open_file,
 		pid = current->tgid;
 
 	do {
+		server = cifs_pick_channel(ses);
 		rc = server->ops->wait_mtu_credits(server, cifs_sb->rsize,
 						   &rsize, &credits);
 		if (rc)
@@ -2974,6 +2985,7 @@ cifs_send_async_read(loff_t offset, size_t len, struct cifsFileInfo *open_file,
 		rdata->pagesz = PAGE_SIZE;
 		rdata->read_into_pages = cifs_uncached_read_into_pages;
 		rdata->credits = credits;
+		rdata->server = server;
 
 		if (!rdata->cfile->invalidHandle ||
 		    !cifs_reopen_file(rdata->cfile, true))
@@ -3467,6 +3479,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 	struct list_head tmplist;
 	struct cifsFileInfo *open_file = file->private_data;
 	struct cifs_sb_info *cifs_sb = CIFS_FILE_SB(file);
+	struct cifs_ses *ses;
 	struct TCP_Server_Info *server;
 	pid_t pid;
 
@@ -3488,7 +3501,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		pid = current->tgid;
 
 	rc = 0;
-	server = tlink_tcon(open_file->tlink)->ses->server;
+	ses = tlink_tcon(open_file->tlink)->ses;
 
 	cifs_dbg(FYI, "%s: file=%p mapping=%p num_pages=%u\n",
 		 __func__, file, mapping, num_pages);
@@ -3511,6 +3524,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		struct cifs_readdata *rdata;
 		unsigned credits;
 
+		server = cifs_pick_channel(ses);
 		rc = server->ops->wait_mtu_credits(server, cifs_sb->rsize,
 						   &rsize, &credits);
 		if (rc)
@@ -3556,6 +3570,7 @@ static int cifs_readpages(struct file *file, struct address_space *mapping,
 		rdata->pagesz = PAGE_CACHE_SIZE;
 		rdata->read_into_pages = cifs_readpages_read_into_pages;
 		rdata->credits = credits;
+		rdata->server = server;
 
 		list_for_each_entry_safe(page, tpage, &tmplist, lru) {
 			list_del(&page->lru);
@@ -254,34 +254,82 @@ smb2_negotiate_rsize(struct cifs_tcon *tcon, struct smb_vol *volume_info)
 	return rsize;
 }
 
-#ifdef CONFIG_CIFS_STATS2
+/*
+ * Query the server's network interfaces. If @addrs is given, up to *@count
+ * of their addresses are returned there (the port is left zero) and
+ * *@count is set to the number found.
+ */
 static int
-SMB3_request_interfaces(const unsigned int xid, struct cifs_tcon *tcon)
+SMB3_request_interfaces(const unsigned int xid, struct cifs_tcon *tcon,
+			struct sockaddr_storage *addrs, unsigned int *count)
 {
 	int rc;
 	unsigned int ret_data_len = 0;
-	struct network_interface_info_ioctl_rsp *out_buf;
+	unsigned int off = 0, found = 0;
+	char *buf;
 
 	rc = SMB2_ioctl(xid, tcon, NO_FILE_ID, NO_FILE_ID,
 			FSCTL_QUERY_NETWORK_INTERFACE_INFO, true /* is_fsctl */,
 			NULL /* no data input */, 0 /* no data input */,
-			(char **)&out_buf, &ret_data_len);
-	if (rc != 0)
+			&buf, &ret_data_len);
+	if (rc != 0) {
 		cifs_dbg(VFS, "error %d on ioctl to get interface list\n", rc);
-	else if (ret_data_len < sizeof(struct network_interface_info_ioctl_rsp)) {
+		goto out;
+	}
+	if (ret_data_len < sizeof(struct network_interface_info_ioctl_rsp)) {
 		cifs_dbg(VFS, "server returned bad net interface info buf\n");
 		rc = -EINVAL;
-	} else {
-		/* Dump info on first interface */
-		cifs_dbg(FYI, "Adapter Capability 0x%x\t",
-			le32_to_cpu(out_buf->Capability));
-		cifs_dbg(FYI, "Link Speed %lld\n",
-			le64_to_cpu(out_buf->LinkSpeed));
+		goto out;
 	}
 
+	while (ret_data_len - off >=
+			sizeof(struct network_interface_info_ioctl_rsp)) {
+		struct network_interface_info_ioctl_rsp *iface =
+			(struct network_interface_info_ioctl_rsp *)(buf + off);
+		struct iface_info_ipv4 *p4 =
+			(struct iface_info_ipv4 *)iface->SockAddr_Storage;
+		struct iface_info_ipv6 *p6 =
+			(struct iface_info_ipv6 *)iface->SockAddr_Storage;
+		unsigned int next = le32_to_cpu(iface->Next);
+
+		cifs_dbg(FYI, "Adapter %u Capability 0x%x Link Speed %lld\n",
+			 le32_to_cpu(iface->IfIndex),
+			 le32_to_cpu(iface->Capability),
+			 le64_to_cpu(iface->LinkSpeed));
+
+		if (addrs && found < *count) {
+			struct sockaddr_storage *ss = &addrs[found];
+
+			memset(ss, 0, sizeof(*ss));
+			if (p4->Family == INTERNETWORK) {
+				struct sockaddr_in *sin =
+					(struct sockaddr_in *)ss;
+
+				sin->sin_family = AF_INET;
+				sin->sin_addr.s_addr = p4->IPv4Address;
+				found++;
+			} else if (p6->Family == INTERNETWORKV6) {
+				struct sockaddr_in6 *sin6 =
+					(struct sockaddr_in6 *)ss;
+
+				sin6->sin6_family = AF_INET6;
+				memcpy(&sin6->sin6_addr, p6->IPv6Address, 16);
+				sin6->sin6_flowinfo = p6->FlowInfo;
+				sin6->sin6_scope_id = le32_to_cpu(p6->ScopeId);
+				found++;
+			}
+		}
+
+		if (!next || next > ret_data_len - off)
+			break;
+		off += next;
+	}
+out:
+	if (count)
+		*count = found;
+	kfree(buf);
 	return rc;
 }
-#endif /* STATS2 */
 
 static void
 smb3_qfs_tcon(const unsigned int xid, struct cifs_tcon *tcon)
@@ -304,7 +352,7 @@ smb3_qfs_tcon(const unsigned int xid, struct cifs_tcon *tcon)
 		return;
 
 #ifdef CONFIG_CIFS_STATS2
-	SMB3_request_interfaces(xid, tcon);
+	SMB3_request_interfaces(xid, tcon, NULL, NULL);
 #endif /* STATS2 */
 
 	SMB2_QFS_attr(xid, tcon, fid.persistent_fid, fid.volatile_fid,
@@ -1600,6 +1648,7 @@ struct smb_version_operations smb30_operations = {
 	.query_symlink = smb2_query_symlink,
 	.query_mf_symlink = smb3_query_mf_symlink,
 	.create_mf_symlink = smb3_create_mf_symlink,
+	.query_interfaces = SMB3_request_interfaces,
 	.open = smb2_open_file,
 	.set_fid = smb2_set_fid,
 	.close = smb2_close_file,
@@ -536,6 +536,7 @@ SMB2_sess_setup(const unsigned int xid, struct cifs_ses *ses,
 	char *security_blob;
 	char *ntlmssp_blob = NULL;
 	bool use_spnego = false; /* else use raw ntlmssp */
+	bool want_key;
 
 	cifs_dbg(FYI, "Session Setup\n");
 
@@ -544,6 +545,22 @@ SMB2_sess_setup(const unsigned int xid, struct cifs_ses *ses,
 		return -EIO;
 	}
 
+	/*
+	 * Binding a channel needs the session's signing key on this
+	 * connection too, and a key of its own afterwards.
+	 */
+	want_key = server->sign || ses->binding || ses->chan_max > 1;
+
+	if (ses->binding) {
+		/* binding requests are signed with the session's key */
+		rc = smb3_crypto_shash_allocate(server);
+		if (rc)
+			return rc;
+		mutex_lock(&server->srv_mutex);
+		server->session_estab = true;
+		mutex_unlock(&server->srv_mutex);
+	}
+
 	/*
 	 * If we are here due to reconnect, free per-smb session key
 	 * in case signing was required.
@@ -571,8 +588,16 @@ ssetup_ntlmssp_authenticate:
 	if (rc)
 		return rc;
 
-	req->hdr.SessionId = 0; /* First session, not a reauthenticate */
-	req->VcNumber = 0; /* MBZ */
+	if (ses->binding) {
+		/* new channel of an existing session */
+		req->hdr.SessionId = ses->Suid;
+		req->hdr.Flags |= SMB2_FLAGS_SIGNED;
+		req->VcNumber = SMB2_SESSION_REQ_FLAG_BINDING;
+	} else {
+		/* First session, not a reauthenticate */
+		req->hdr.SessionId = 0;
+		req->VcNumber = 0;
+	}
 	/* to enable echos and oplocks */
 	req->hdr.CreditRequest = cpu_to_le16(3);
 
@@ -708,7 +733,7 @@ ssetup_exit:
 
 	if (!rc) {
 		mutex_lock(&server->srv_mutex);
-		if (server->sign && server->ops->generate_signingkey) {
+		if (want_key && server->ops->generate_signingkey) {
 			rc = server->ops->generate_signingkey(ses);
 			kfree(ses->auth_key.response);
 			ses->auth_key.response = NULL;
@@ -733,7 +758,7 @@ ssetup_exit:
 	}
 
 keygen_exit:
-	if (!server->sign) {
+	if (!want_key) {
 		kfree(ses->auth_key.response);
 		ses->auth_key.response = NULL;
 	}
@@ -1699,7 +1724,7 @@ smb2_readv_callback(struct mid_q_entry *mid)
 {
 	struct cifs_readdata *rdata = mid->callback_data;
 	struct cifs_tcon *tcon = tlink_tcon(rdata->cfile->tlink);
-	struct TCP_Server_Info *server = tcon->ses->server;
+	struct TCP_Server_Info *server = mid->server; /* may be a channel */
 	struct smb2_hdr *buf = (struct smb2_hdr *)rdata->iov.iov_base;
 	unsigned int credits_received = 1;
 	struct smb_rqst rqst = { .rq_iov = &rdata->iov,
@@ -1773,7 +1798,7 @@ smb2_async_readv(struct cifs_readdata *rdata)
 	io_parms.volatile_fid = rdata->cfile->fid.volatile_fid;
 	io_parms.pid = rdata->pid;
 
-	server = io_parms.tcon->ses->server;
+	server = rdata->server ?: io_parms.tcon->ses->server;
 
 	rc = smb2_new_read_req(&rdata->iov, &io_parms, 0, 0);
 	if (rc) {
@@ -1804,7 +1829,7 @@ smb2_async_readv(struct cifs_readdata *rdata)
 	}
 
 	kref_get(&rdata->refcount);
-	rc = cifs_call_async(io_parms.tcon->ses->server, &rqst,
+	rc = cifs_call_async(server, &rqst,
 			     cifs_readv_receive, smb2_readv_callback,
 			     rdata, flags);
 	if (rc) {
@@ -1876,6 +1901,7 @@ smb2_writev_callback(struct mid_q_entry *mid)
 {
 	struct cifs_writedata *wdata = mid->callback_data;
 	struct cifs_tcon *tcon = tlink_tcon(wdata->cfile->tlink);
+	struct TCP_Server_Info *server = mid->server; /* may be a channel */
 	unsigned int written;
 	struct smb2_write_rsp *rsp = (struct smb2_write_rsp *)mid->resp_buf;
 	unsigned int credits_received = 1;
@@ -1883,7 +1909,7 @@ smb2_writev_callback(struct mid_q_entry *mid)
 	switch (mid->mid_state) {
 	case MID_RESPONSE_RECEIVED:
 		credits_received = le16_to_cpu(rsp->hdr.CreditRequest);
-		wdata->result = smb2_check_receive(mid, tcon->ses->server, 0);
+		wdata->result = smb2_check_receive(mid, server, 0);
 		if (wdata->result != 0)
 			break;
 
@@ -1916,7 +1942,7 @@ smb2_writev_callback(struct mid_q_entry *mid)
 
 	queue_work(cifsiod_wq, &wdata->work);
 	DeleteMidQEntry(mid);
-	add_credits(tcon->ses->server, credits_received, 0);
+	add_credits(server, credits_received, 0);
 }
 
 /* smb2_async_writev - send an async write, and set up mid to handle result */
@@ -1927,7 +1953,7 @@ smb2_async_writev(struct cifs_writedata *wdata,
 	int rc = -EACCES, flags = 0;
 	struct smb2_write_req *req = NULL;
 	struct cifs_tcon *tcon = tlink_tcon(wdata->cfile->tlink);
-	struct TCP_Server_Info *server = tcon->ses->server;
+	struct TCP_Server_Info *server = wdata->server ?: tcon->ses->server;
 	struct kvec iov;
 	struct smb_rqst rqst;
 
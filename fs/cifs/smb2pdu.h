@@ -249,6 +249,9 @@ struct smb2_sess_setup_req {
 	__u8   Buffer[1];	/* variable length GSS security buffer */
 } __packed;
 
+/* Flags field (VcNumber in SMB2.0/2.1) of the session setup request */
+#define SMB2_SESSION_REQ_FLAG_BINDING	0x01
+
 /* Currently defined SessionFlags */
 #define SMB2_SESSION_FLAG_IS_GUEST	0x0001
 #define SMB2_SESSION_FLAG_IS_NULL	0x0002
@@ -614,6 +617,25 @@ struct network_interface_info_ioctl_rsp {
 	char	SockAddr_Storage[128];
 } __packed;
 
+/* SockAddr_Storage starts with the address family */
+#define INTERNETWORK	cpu_to_le16(0x0002)
+#define INTERNETWORKV6	cpu_to_le16(0x0017)
+
+struct iface_info_ipv4 {
+	__le16 Family;
+	__be16 Port;
+	__be32 IPv4Address;
+	__be64 Reserved;
+} __packed;
+
+struct iface_info_ipv6 {
+	__le16 Family;
+	__be16 Port;
+	__be32 FlowInfo;
+	u8     IPv6Address[16];
+	__be32 ScopeId;
+} __packed;
+
 #define NO_FILE_ID 0xFFFFFFFFFFFFFFFFULL /* general ioctls to srv not to file */
 
 struct compress_ioctl {
@@ -70,7 +70,7 @@ smb2_crypto_shash_allocate(struct TCP_Server_Info *server)
 	return 0;
 }
 
-static int
+int
 smb3_crypto_shash_allocate(struct TCP_Server_Info *server)
 {
 	unsigned int size;
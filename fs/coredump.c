@@ -434,7 +434,7 @@ static void coredump_finish(struct mm_struct *mm, bool core_dumped)
 	mm->core_state = NULL;
 }
 
-static bool dump_interrupted(void)
+bool dump_interrupted(void)
 {
 	/*
 	 * SIGKILL or freezing() interrupt the coredumping. Perhaps we
@@ -497,6 +497,18 @@ static int umh_pipe_setup(struct subprocess_info *info, struct cred *new)
 	return err;
 }
 
+/*
+ * A dump that ends in a hole has only seeked past its last pages; extend
+ * the file to cover them.
+ */
+static void dump_truncate(struct coredump_params *cprm)
+{
+	struct file *file = cprm->file;
+
+	if (i_size_read(file_inode(file)) < file->f_pos)
+		do_truncate(file->f_path.dentry, file->f_pos, 0, file);
+}
+
 void do_coredump(const siginfo_t *siginfo)
 {
 	struct core_state core_state;
@@ -671,7 +683,12 @@ void do_coredump(const siginfo_t *siginfo)
 		put_files_struct(displaced);
 	if (!dump_interrupted()) {
 		file_start_write(cprm.file);
+		cprm.compress = core_compress_start();
 		core_dumped = binfmt->core_dump(&cprm);
+		if (cprm.compress)
+			core_dumped = core_compress_finish(&cprm, core_dumped);
+		else if (core_dumped && !ispipe)
+			dump_truncate(&cprm);
 		file_end_write(cprm.file);
 	}
 	if (ispipe && core_pipe_limit)
@@ -697,13 +714,11 @@ fail:
  * do on a core-file: use only these functions to write out all the
  * necessary info.
  */
-int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
+int __dump_write(struct coredump_params *cprm, const void *addr, size_t nr)
 {
 	struct file *file = cprm->file;
 	loff_t pos = file->f_pos;
 	ssize_t n;
-	if (cprm->written + nr > cprm->limit)
-		return 0;
 	while (nr) {
 		if (dump_interrupted())
 			return 0;
@@ -711,18 +726,38 @@ int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
 		if (n <= 0)
 			return 0;
 		file->f_pos = pos;
-		cprm->written += n;
+		addr += n;
 		nr -= n;
 	}
 	return 1;
 }
+
+int dump_emit(struct coredump_params *cprm, const void *addr, int nr)
+{
+	if (cprm->written + nr > cprm->limit)
+		return 0;
+	if (cprm->compress) {
+		if (!core_compress_emit(cprm, addr, nr))
+			return 0;
+	} else if (!__dump_write(cprm, addr, nr))
+		return 0;
+	cprm->written += nr;
+	return 1;
+}
 EXPORT_SYMBOL(dump_emit);
 
 int dump_skip(struct coredump_params *cprm, size_t nr)
 {
 	static char zeroes[PAGE_SIZE];
 	struct file *file = cprm->file;
-	if (file->f_op->llseek && file->f_op->llseek != no_llseek) {
+	if (cprm->compress) {
+		if (cprm->written + nr > cprm->limit)
+			return 0;
+		if (!core_compress_skip(cprm, nr))
+			return 0;
+		cprm->written += nr;
+		return 1;
+	} else if (file->f_op->llseek && file->f_op->llseek != no_llseek) {
 		if (cprm->written + nr > cprm->limit)
 			return 0;
 		if (dump_interrupted() ||
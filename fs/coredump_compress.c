@@ -0,0 +1,310 @@
+/*
+ *  linux/fs/coredump_compress.c
+ *
+ *  gzip compression of the core dump stream.
+ *
+ *  The uncompressed stream is cut into CORE_CHUNK_SIZE chunks, each of
+ *  which is deflated on its own by a worker on system_unbound_wq and
+ *  wrapped into a complete gzip member.  The dumping task keeps filling
+ *  the next chunk while up to nr_chunks - 1 others are being compressed
+ *  and writes the members out strictly in order.  A sequence of gzip
+ *  members is itself a valid gzip file, so the result is read back with
+ *  plain zcat/gunzip.
+ *
+ *  Holes (dump_skip) that cover a whole chunk are not compressed again:
+ *  the member for an all-zero chunk is computed once and then written
+ *  out as-is, so large unpopulated mappings cost next to nothing.
+ */
+
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/fs.h>
+#include <linux/binfmts.h>
+#include <linux/coredump.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/zlib.h>
+#include <linux/crc32.h>
+#include <asm/unaligned.h>
+
+#include "internal.h"
+
+#define CORE_CHUNK_SIZE		(1 << 20)
+#define CORE_MAX_CHUNKS		16
+
+#define GZIP_HDR_SIZE		10
+#define GZIP_TRAILER_SIZE	8
+#define CORE_OUT_SIZE		(GZIP_HDR_SIZE + deflateBound(CORE_CHUNK_SIZE) + \
+				 GZIP_TRAILER_SIZE)
+
+/* 0 disables compression, 1-9 is the deflate level */
+int core_compress;
+
+static const u8 gzip_hdr[GZIP_HDR_SIZE] = {
+	0x1f, 0x8b,		/* magic */
+	0x08,			/* deflate */
+	0x00,			/* flags */
+	0x00, 0x00, 0x00, 0x00,	/* mtime */
+	0x00,			/* extra flags */
+	0x03,			/* OS: Unix */
+};
+
+struct core_chunk {
+	struct work_struct	work;
+	struct completion	done;
+	struct z_stream_s	strm;
+	void			*in;
+	size_t			in_len;
+	void			*out;
+	size_t			out_len;
+	bool			zero;	/* write core_compress->zero_out */
+	int			err;
+};
+
+struct core_compress {
+	void			*zero_out;
+	size_t			zero_len;
+	unsigned long		head;	/* chunk being filled */
+	unsigned long		tail;	/* oldest chunk not yet written */
+	unsigned int		nr_chunks;
+	struct core_chunk	chunks[];
+};
+
+static struct core_chunk *core_chunk(struct core_compress *cc,
+				     unsigned long idx)
+{
+	return &cc->chunks[idx % cc->nr_chunks];
+}
+
+static void core_chunk_deflate(struct core_chunk *chunk)
+{
+	struct z_stream_s *strm = &chunk->strm;
+	u8 *out = chunk->out;
+	size_t len;
+
+	chunk->err = -EIO;
+	if (zlib_deflateReset(strm) != Z_OK)
+		return;
+
+	memcpy(out, gzip_hdr, GZIP_HDR_SIZE);
+	strm->next_in = chunk->in;
+	strm->avail_in = chunk->in_len;
+	strm->next_out = out + GZIP_HDR_SIZE;
+	strm->avail_out = CORE_OUT_SIZE - GZIP_HDR_SIZE - GZIP_TRAILER_SIZE;
+	if (zlib_deflate(strm, Z_FINISH) != Z_STREAM_END)
+		return;
+
+	len = GZIP_HDR_SIZE + strm->total_out;
+	put_unaligned_le32(crc32_le(~0, chunk->in, chunk->in_len) ^ ~0,
+			   out + len);
+	put_unaligned_le32(chunk->in_len, out + len + 4);
+	chunk->out_len = len + GZIP_TRAILER_SIZE;
+	chunk->err = 0;
+}
+
+static void core_chunk_work(struct work_struct *work)
+{
+	struct core_chunk *chunk = container_of(work, struct core_chunk, work);
+
+	core_chunk_deflate(chunk);
+	complete(&chunk->done);
+}
+
+/*
+ * Retire the oldest chunk in flight, writing its member out if @write.
+ * Each submitted chunk is waited for exactly once.
+ */
+static int core_chunk_retire(struct coredump_params *cprm, bool write)
+{
+	struct core_compress *cc = cprm->compress;
+	struct core_chunk *chunk = core_chunk(cc, cc->tail++);
+
+	wait_for_completion(&chunk->done);
+	if (!write || chunk->err)
+		return 0;
+	if (chunk->zero)
+		return __dump_write(cprm, cc->zero_out, cc->zero_len);
+	return __dump_write(cprm, chunk->out, chunk->out_len);
+}
+
+/*
+ * Hand the current chunk over (to a worker unless @queue is false, in
+ * which case it is already complete) and move on to the next slot,
+ * writing out the oldest chunk first if every slot is in use.
+ */
+static int core_chunk_submit(struct coredump_params *cprm, bool queue)
+{
+	struct core_compress *cc = cprm->compress;
+	struct core_chunk *chunk = core_chunk(cc, cc->head);
+
+	if (queue)
+		queue_work(system_unbound_wq, &chunk->work);
+	else
+		complete(&chunk->done);
+
+	cc->head++;
+	if (cc->head - cc->tail == cc->nr_chunks &&
+	    !core_chunk_retire(cprm, true))
+		return 0;
+
+	chunk = core_chunk(cc, cc->head);
+	reinit_completion(&chunk->done);
+	chunk->in_len = 0;
+	chunk->zero = false;
+	return !dump_interrupted();
+}
+
+/*
+ * A whole chunk of zeroes: deflate it once, synchronously, and reuse the
+ * resulting member for every later one.
+ */
+static int core_chunk_zero(struct coredump_params *cprm)
+{
+	struct core_compress *cc = cprm->compress;
+	struct core_chunk *chunk = core_chunk(cc, cc->head);
+
+	if (cc->zero_out) {
+		chunk->zero = true;
+		return core_chunk_submit(cprm, false);
+	}
+
+	memset(chunk->in, 0, CORE_CHUNK_SIZE);
+	chunk->in_len = CORE_CHUNK_SIZE;
+	core_chunk_deflate(chunk);
+	if (!chunk->err) {
+		cc->zero_out = kmemdup(chunk->out, chunk->out_len, GFP_KERNEL);
+		cc->zero_len = chunk->out_len;
+	}
+	return core_chunk_submit(cprm, false);
+}
+
+int core_compress_emit(struct coredump_params *cprm, const void *addr,
+		       size_t nr)
+{
+	struct core_compress *cc = cprm->compress;
+
+	while (nr) {
+		struct core_chunk *chunk = core_chunk(cc, cc->head);
+		size_t n = min_t(size_t, nr, CORE_CHUNK_SIZE - chunk->in_len);
+
+		memcpy(chunk->in + chunk->in_len, addr, n);
+		chunk->in_len += n;
+		addr += n;
+		nr -= n;
+		if (chunk->in_len == CORE_CHUNK_SIZE &&
+		    !core_chunk_submit(cprm, true))
+			return 0;
+	}
+	return 1;
+}
+
+int core_compress_skip(struct coredump_params *cprm, size_t nr)
+{
+	struct core_compress *cc = cprm->compress;
+
+	while (nr) {
+		struct core_chunk *chunk = core_chunk(cc, cc->head);
+		size_t n;
+
+		if (!chunk->in_len && nr >= CORE_CHUNK_SIZE) {
+			if (!core_chunk_zero(cprm))
+				return 0;
+			nr -= CORE_CHUNK_SIZE;
+			continue;
+		}
+
+		n = min_t(size_t, nr, CORE_CHUNK_SIZE - chunk->in_len);
+		memset(chunk->in + chunk->in_len, 0, n);
+		chunk->in_len += n;
+		nr -= n;
+		if (chunk->in_len == CORE_CHUNK_SIZE &&
+		    !core_chunk_submit(cprm, true))
+			return 0;
+	}
+	return 1;
+}
+
+static void core_compress_free(struct core_compress *cc)
+{
+	unsigned int i;
+
+	for (i = 0; i < cc->nr_chunks; i++) {
+		struct core_chunk *chunk = &cc->chunks[i];
+
+		vfree(chunk->strm.workspace);
+		vfree(chunk->out);
+		vfree(chunk->in);
+	}
+	kfree(cc->zero_out);
+	kfree(cc);
+}
+
+/*
+ * Set up compression of the dump if kernel.core_compress asks for it.
+ * If the buffers cannot be had the core is written uncompressed.
+ */
+struct core_compress *core_compress_start(void)
+{
+	int level = ACCESS_ONCE(core_compress);
+	struct core_compress *cc;
+	unsigned int i, nr;
+
+	if (!level)
+		return NULL;
+
+	/* one chunk being filled, the rest being compressed */
+	nr = min_t(unsigned int, num_online_cpus(), CORE_MAX_CHUNKS - 1) + 1;
+	cc = kzalloc(sizeof(*cc) + nr * sizeof(cc->chunks[0]), GFP_KERNEL);
+	if (!cc)
+		goto fail;
+	cc->nr_chunks = nr;
+
+	for (i = 0; i < nr; i++) {
+		struct core_chunk *chunk = &cc->chunks[i];
+
+		INIT_WORK(&chunk->work, core_chunk_work);
+		init_completion(&chunk->done);
+		chunk->in = vmalloc(CORE_CHUNK_SIZE);
+		chunk->out = vmalloc(CORE_OUT_SIZE);
+		chunk->strm.workspace = vmalloc(
+			zlib_deflate_workspacesize(MAX_WBITS, DEF_MEM_LEVEL));
+		if (!chunk->in || !chunk->out || !chunk->strm.workspace)
+			goto fail_free;
+		/* raw deflate, the gzip framing is added by hand */
+		if (zlib_deflateInit2(&chunk->strm, level, Z_DEFLATED,
+				      -MAX_WBITS, DEF_MEM_LEVEL,
+				      Z_DEFAULT_STRATEGY) != Z_OK)
+			goto fail_free;
+	}
+	return cc;
+
+fail_free:
+	core_compress_free(cc);
+fail:
+	printk(KERN_WARNING "Pid %d(%s) core dump not compressed\n",
+	       task_tgid_vnr(current), current->comm);
+	return NULL;
+}
+
+/*
+ * Flush the last partial chunk and write out everything still in flight
+ * if the dump succeeded (@ok), otherwise just wait for the workers.
+ * Returns whether the compressed stream was completely written.
+ */
+int core_compress_finish(struct coredump_params *cprm, int ok)
+{
+	struct core_compress *cc = cprm->compress;
+
+	if (ok && core_chunk(cc, cc->head)->in_len)
+		ok = core_chunk_submit(cprm, true);
+
+	while (cc->tail != cc->head)
+		if (!core_chunk_retire(cprm, ok))
+			ok = 0;
+
+	cprm->compress = NULL;
+	core_compress_free(cc);
+	return ok;
+}
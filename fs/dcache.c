@@ -82,6 +82,14 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/*
+ * Maximum share, in percent of all dentries, of unused negative ones.
+ * Beyond it negative dentries are not kept around once their last
+ * reference goes, and the shrinker reclaims them without giving them
+ * a second pass through the LRU.  0 means no limit.
+ */
+int sysctl_negative_dentry_limit __read_mostly;
+
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -116,8 +124,7 @@ struct dentry_stat_t dentry_stat = {
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
-
-#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
+static DEFINE_PER_CPU(long, nr_dentry_negative);
 
 /*
  * Here we resort to our own counters instead of using generic per-cpu counters
@@ -149,15 +156,48 @@ static long get_nr_dentry_unused(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative(void)
+{
+	int i;
+	long sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative, i);
+	return sum < 0 ? 0 : sum;
+}
+
+#if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 int proc_nr_dentry(struct ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
+	dentry_stat.nr_negative = get_nr_dentry_negative();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 #endif
 
+/*
+ * Summing the per-cpu counters is too costly for every dput(), so the
+ * verdict is cached and refreshed at most every HZ/10.
+ */
+static bool negative_dentries_over_limit(void)
+{
+	static unsigned long next_check;
+	static bool over_limit;
+	int limit = ACCESS_ONCE(sysctl_negative_dentry_limit);
+
+	if (!limit)
+		return false;
+
+	if (time_after_eq(jiffies, ACCESS_ONCE(next_check))) {
+		next_check = jiffies + HZ / 10;
+		over_limit = get_nr_dentry_negative() * 100 >
+			     get_nr_dentry() * limit;
+	}
+
+	return over_limit;
+}
+
 /*
  * Compare 2 name strings, return 0 if they match, otherwise non-zero.
  * The strings are both count bytes long, and count is non-zero.
@@ -273,7 +313,7 @@ static void dentry_free(struct dentry *dentry)
 	if (unlikely(dname_external(dentry))) {
 		struct external_name *p = external_name(dentry);
 		if (likely(atomic_dec_and_test(&p->u.count))) {
-			call_rcu(&dentry->d_u.d_rcu, __d_free_external);
+			call_rcu_lazy(&dentry->d_u.d_rcu, __d_free_external);
 			return;
 		}
 	}
@@ -281,7 +321,7 @@ static void dentry_free(struct dentry *dentry)
 	if (!(dentry->d_flags & DCACHE_RCUACCESS))
 		__d_free(&dentry->d_u.d_rcu);
 	else
-		call_rcu(&dentry->d_u.d_rcu, __d_free);
+		call_rcu_lazy(&dentry->d_u.d_rcu, __d_free);
 }
 
 /**
@@ -337,6 +377,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
 	dentry->d_inode = NULL;
 	hlist_del_init(&dentry->d_u.d_alias);
 	dentry_rcuwalk_barrier(dentry);
+	if (dentry->d_flags & DCACHE_LRU_LIST)
+		this_cpu_inc(nr_dentry_negative);
 	spin_unlock(&dentry->d_lock);
 	spin_unlock(&inode->i_lock);
 	if (!inode->i_nlink)
@@ -356,7 +398,8 @@ static void dentry_unlink_inode(struct dentry * dentry)
  * on the shrink list (ie not on the superblock LRU list).
  *
  * The per-cpu "nr_dentry_unused" counters are updated with
- * the DCACHE_LRU_LIST bit.
+ * the DCACHE_LRU_LIST bit, and so are the "nr_dentry_negative"
+ * ones for negative dentries.
  *
  * These helper functions make sure we always follow the
  * rules. d_lock must be held by the caller.
@@ -367,6 +410,8 @@ static void d_lru_add(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, 0);
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_inc(nr_dentry_negative);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -375,6 +420,8 @@ static void d_lru_del(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_dec(nr_dentry_negative);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -384,6 +431,8 @@ static void d_shrink_del(struct dentry *dentry)
 	list_del_init(&dentry->d_lru);
 	dentry->d_flags &= ~(DCACHE_SHRINK_LIST | DCACHE_LRU_LIST);
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_dec(nr_dentry_negative);
 }
 
 static void d_shrink_add(struct dentry *dentry, struct list_head *list)
@@ -392,6 +441,8 @@ static void d_shrink_add(struct dentry *dentry, struct list_head *list)
 	list_add(&dentry->d_lru, list);
 	dentry->d_flags |= DCACHE_SHRINK_LIST | DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_inc(nr_dentry_negative);
 }
 
 /*
@@ -405,6 +456,8 @@ static void d_lru_isolate(struct dentry *dentry)
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
+	if (d_is_negative(dentry))
+		this_cpu_dec(nr_dentry_negative);
 	list_del_init(&dentry->d_lru);
 }
 
@@ -634,6 +687,10 @@ repeat:
 			goto kill_it;
 	}
 
+	/* Too many negative dentries cached already? */
+	if (d_is_negative(dentry) && negative_dentries_over_limit())
+		goto kill_it;
+
 	if (!(dentry->d_flags & DCACHE_REFERENCED))
 		dentry->d_flags |= DCACHE_REFERENCED;
 	dentry_lru_add(dentry);
@@ -895,7 +952,9 @@ dentry_lru_isolate(struct list_head *item, spinlock_t *lru_lock, void *arg)
 		return LRU_REMOVED;
 	}
 
-	if (dentry->d_flags & DCACHE_REFERENCED) {
+	/* Past the limit, negative dentries go ahead of positive ones */
+	if ((dentry->d_flags & DCACHE_REFERENCED) &&
+	    !(d_is_negative(dentry) && negative_dentries_over_limit())) {
 		dentry->d_flags &= ~DCACHE_REFERENCED;
 		spin_unlock(&dentry->d_lock);
 
@@ -1577,6 +1636,9 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	unsigned add_flags = d_flags_for_inode(inode);
 
 	spin_lock(&dentry->d_lock);
+	if (inode && d_is_negative(dentry) &&
+	    (dentry->d_flags & DCACHE_LRU_LIST))
+		this_cpu_dec(nr_dentry_negative);
 	__d_set_type(dentry, add_flags);
 	if (inode)
 		hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
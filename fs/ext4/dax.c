@@ -0,0 +1,86 @@
+/*
+ *  linux/fs/ext4/dax.c
+ *
+ * Direct access to file data on memory-backed block devices, for the
+ * generic xip file operations.  Requires blocksize == PAGE_SIZE, so a
+ * file page is a filesystem block.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/genhd.h>
+#include <linux/blkdev.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+static int ext4_dax_direct_access(struct inode *inode, ext4_fsblk_t pblk,
+				  void **kaddr, unsigned long *pfn)
+{
+	struct block_device *bdev = inode->i_sb->s_bdev;
+	const struct block_device_operations *ops = bdev->bd_disk->fops;
+	sector_t sector;
+
+	sector = pblk << (inode->i_blkbits - 9);
+
+	BUG_ON(!ops->direct_access);
+	return ops->direct_access(bdev, sector, kaddr, pfn);
+}
+
+/*
+ * Uninitialized extents read as zeroes; allocating writes and faults zero
+ * the new blocks in ext4_map_blocks(), under i_data_sem, so that nobody
+ * maps them before they are cleared.
+ */
+int ext4_get_xip_mem(struct address_space *mapping, pgoff_t pgoff, int create,
+		     void **kmem, unsigned long *pfn)
+{
+	struct inode *inode = mapping->host;
+	struct ext4_map_blocks map;
+	handle_t *handle;
+	int ret;
+
+	map.m_lblk = pgoff;
+	map.m_len = 1;
+
+	if (!create) {
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+		if (!ret || !(map.m_flags & EXT4_MAP_MAPPED))
+			return -ENODATA;
+		return ext4_dax_direct_access(inode, map.m_pblk, kmem, pfn);
+	}
+
+	handle = ext4_journal_start(inode, EXT4_HT_WRITE_PAGE,
+				    ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	ret = ext4_map_blocks(handle, inode, &map,
+			      EXT4_GET_BLOCKS_CREATE | EXT4_GET_BLOCKS_ZERO);
+	if (ret > 0)
+		ret = ext4_dax_direct_access(inode, map.m_pblk, kmem, pfn);
+	else if (!ret)
+		ret = -EIO;
+	ext4_journal_stop(handle);
+	return ret;
+}
+
+/*
+ * Zero @length bytes from @from, within one block, for truncate and
+ * hole punching.  Holes already read as zeroes.
+ */
+int ext4_dax_zero_range(struct inode *inode, loff_t from, unsigned length)
+{
+	unsigned long pfn;
+	void *kaddr;
+	int err;
+
+	err = ext4_get_xip_mem(inode->i_mapping, from >> PAGE_SHIFT, 0,
+			       &kaddr, &pfn);
+	if (err == -ENODATA)
+		return 0;
+	if (err)
+		return err;
+	memset(kaddr + (from & (PAGE_SIZE - 1)), 0, length);
+	return 0;
+}
@@ -381,6 +381,26 @@ static inline void ext4_update_inode_fsync_trans(handle_t *handle,
 	}
 }
 
+/*
+ * Record that @handle makes changes a fast commit can't describe, so
+ * fsync has to wait for its transaction to commit: anywhere in the
+ * filesystem, or only to @inode.
+ */
+static inline void ext4_fc_mark_ineligible(struct super_block *sb,
+					   handle_t *handle)
+{
+	if (ext4_handle_valid(handle))
+		EXT4_SB(sb)->s_fc_ineligible_tid = handle->h_transaction->t_tid;
+}
+
+static inline void ext4_fc_mark_inode_ineligible(struct inode *inode,
+						 handle_t *handle)
+{
+	if (ext4_handle_valid(handle))
+		EXT4_I(inode)->i_fc_ineligible_tid =
+			handle->h_transaction->t_tid;
+}
+
 /* super.c */
 int ext4_force_commit(struct super_block *sb);
 
@@ -162,6 +162,7 @@ int __ext4_ext_dirty(const char *where, unsigned int line, handle_t *handle,
 
 	WARN_ON(!rwsem_is_locked(&EXT4_I(inode)->i_data_sem));
 	if (path->p_bh) {
+		ext4_fc_mark_inode_ineligible(inode, handle);
 		ext4_extent_block_csum_set(inode, ext_block_hdr(path->p_bh));
 		/* path points to block */
 		err = __ext4_handle_dirty_metadata(where, line, handle,
@@ -1352,6 +1353,8 @@ static int ext4_ext_create_new_leaf(handle_t *handle, struct inode *inode,
 	struct ext4_ext_path *curp;
 	int depth, i, err = 0;
 
+	/* new tree blocks are only in the journal */
+	ext4_fc_mark_inode_ineligible(inode, handle);
 repeat:
 	i = depth = ext_depth(inode);
 
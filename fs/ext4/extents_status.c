@@ -305,12 +305,7 @@ static void ext4_es_list_add(struct inode *inode)
 	if (!list_empty(&ei->i_es_list))
 		return;
 
-	spin_lock(&sbi->s_es_lock);
-	if (list_empty(&ei->i_es_list)) {
-		list_add_tail(&ei->i_es_list, &sbi->s_es_list);
-		sbi->s_es_nr_inode++;
-	}
-	spin_unlock(&sbi->s_es_lock);
+	list_lru_add(&sbi->s_es_lru, &ei->i_es_list);
 }
 
 static void ext4_es_list_del(struct inode *inode)
@@ -318,13 +313,7 @@ static void ext4_es_list_del(struct inode *inode)
 	struct ext4_inode_info *ei = EXT4_I(inode);
 	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
 
-	spin_lock(&sbi->s_es_lock);
-	if (!list_empty(&ei->i_es_list)) {
-		list_del_init(&ei->i_es_list);
-		sbi->s_es_nr_inode--;
-		WARN_ON_ONCE(sbi->s_es_nr_inode < 0);
-	}
-	spin_unlock(&sbi->s_es_lock);
+	list_lru_del(&sbi->s_es_lru, &ei->i_es_list);
 }
 
 static struct extent_status *
@@ -819,6 +808,8 @@ out:
 		es->es_pblk = es1->es_pblk;
 		if (!ext4_es_is_referenced(es))
 			ext4_es_set_referenced(es);
+		if (!ext4_test_inode_state(inode, EXT4_STATE_ES_REFERENCED))
+			ext4_set_inode_state(inode, EXT4_STATE_ES_REFERENCED);
 		stats->es_stats_cache_hits++;
 	} else {
 		stats->es_stats_cache_misses++;
@@ -963,76 +954,106 @@ int ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 	return err;
 }
 
+/* Number of inodes looked at between checks for enough reclaimed extents */
+#define ES_SHRINK_BATCH		32
+
+struct es_shrink_arg {
+	struct ext4_inode_info *locked_ei;
+	int nr_to_scan;
+	int nr_shrunk;
+	int nr_skipped;
+	int retried;
+};
+
+/*
+ * Inodes are reclaimed in list order, with a second chance for the ones
+ * whose extents were looked up since the last pass and for precached
+ * ones.  Inodes that can't be reclaimed right now go to the tail too so
+ * that a walk never looks at the same inode twice.
+ */
+static enum lru_status es_shrink_isolate(struct list_head *item,
+					 spinlock_t *lock, void *cb_arg)
+{
+	struct ext4_inode_info *ei = list_entry(item, struct ext4_inode_info,
+						i_es_list);
+	struct inode *inode = &ei->vfs_inode;
+	struct es_shrink_arg *arg = cb_arg;
+
+	if (arg->nr_to_scan <= 0)
+		return LRU_SKIP;
+
+	/*
+	 * Normally we try hard to avoid shrinking precached inodes,
+	 * but we will as a last resort.
+	 */
+	if (!arg->retried &&
+	    (ext4_test_inode_state(inode, EXT4_STATE_EXT_PRECACHED) ||
+	     ext4_test_inode_state(inode, EXT4_STATE_ES_REFERENCED))) {
+		ext4_clear_inode_state(inode, EXT4_STATE_ES_REFERENCED);
+		arg->nr_skipped++;
+		return LRU_ROTATE;
+	}
+
+	if (ei == arg->locked_ei || !write_trylock(&ei->i_es_lock)) {
+		arg->nr_skipped++;
+		return LRU_ROTATE;
+	}
+
+	/*
+	 * Now we hold i_es_lock which protects us from inode reclaim
+	 * freeing inode under us.  Take the inode off the list so the list
+	 * lock can be dropped while reclaiming, and put it back at the tail
+	 * if it still has reclaimable extents.
+	 */
+	list_del_init(item);
+	spin_unlock(lock);
+
+	arg->nr_shrunk += es_reclaim_extents(ei, &arg->nr_to_scan);
+	if (ei->i_es_shk_nr)
+		ext4_es_list_add(inode);
+	write_unlock(&ei->i_es_lock);
+
+	spin_lock(lock);
+	return LRU_REMOVED_RETRY;
+}
+
 static int __es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
 		       struct ext4_inode_info *locked_ei)
 {
-	struct ext4_inode_info *ei;
+	struct es_shrink_arg arg = {
+		.locked_ei = locked_ei,
+		.nr_to_scan = nr_to_scan,
+	};
 	struct ext4_es_stats *es_stats;
 	ktime_t start_time;
 	u64 scan_time;
-	int nr_to_walk;
-	int nr_shrunk = 0;
-	int retried = 0, nr_skipped = 0;
+	unsigned long nr_to_walk, nr;
 
 	es_stats = &sbi->s_es_stats;
 	start_time = ktime_get();
 
 retry:
-	spin_lock(&sbi->s_es_lock);
-	nr_to_walk = sbi->s_es_nr_inode;
-	while (nr_to_walk-- > 0) {
-		if (list_empty(&sbi->s_es_list)) {
-			spin_unlock(&sbi->s_es_lock);
-			goto out;
-		}
-		ei = list_first_entry(&sbi->s_es_list, struct ext4_inode_info,
-				      i_es_list);
-		/* Move the inode to the tail */
-		list_move_tail(&ei->i_es_list, &sbi->s_es_list);
-
-		/*
-		 * Normally we try hard to avoid shrinking precached inodes,
-		 * but we will as a last resort.
-		 */
-		if (!retried && ext4_test_inode_state(&ei->vfs_inode,
-						EXT4_STATE_EXT_PRECACHED)) {
-			nr_skipped++;
-			continue;
-		}
-
-		if (ei == locked_ei || !write_trylock(&ei->i_es_lock)) {
-			nr_skipped++;
-			continue;
-		}
-		/*
-		 * Now we hold i_es_lock which protects us from inode reclaim
-		 * freeing inode under us
-		 */
-		spin_unlock(&sbi->s_es_lock);
-
-		nr_shrunk += es_reclaim_extents(ei, &nr_to_scan);
-		write_unlock(&ei->i_es_lock);
-
-		if (nr_to_scan <= 0)
-			goto out;
-		spin_lock(&sbi->s_es_lock);
+	nr_to_walk = list_lru_count(&sbi->s_es_lru);
+	while (nr_to_walk && arg.nr_to_scan > 0) {
+		nr = min_t(unsigned long, nr_to_walk, ES_SHRINK_BATCH);
+		nr_to_walk -= nr;
+		list_lru_walk(&sbi->s_es_lru, es_shrink_isolate, &arg, nr);
 	}
-	spin_unlock(&sbi->s_es_lock);
 
 	/*
 	 * If we skipped any inodes, and we weren't able to make any
 	 * forward progress, try again to scan precached inodes.
 	 */
-	if ((nr_shrunk == 0) && nr_skipped && !retried) {
-		retried++;
+	if ((arg.nr_shrunk == 0) && arg.nr_skipped && !arg.retried) {
+		arg.retried++;
 		goto retry;
 	}
 
-	if (locked_ei && nr_shrunk == 0)
-		nr_shrunk = es_reclaim_extents(locked_ei, &nr_to_scan);
+	if (locked_ei && arg.nr_shrunk == 0)
+		arg.nr_shrunk = es_reclaim_extents(locked_ei, &arg.nr_to_scan);
 
-out:
 	scan_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
+	es_stats->es_stats_nr_shrinks++;
 	if (likely(es_stats->es_stats_scan_time))
 		es_stats->es_stats_scan_time = (scan_time +
 				es_stats->es_stats_scan_time*3) / 4;
@@ -1041,14 +1062,21 @@ out:
 	if (scan_time > es_stats->es_stats_max_scan_time)
 		es_stats->es_stats_max_scan_time = scan_time;
 	if (likely(es_stats->es_stats_shrunk))
-		es_stats->es_stats_shrunk = (nr_shrunk +
+		es_stats->es_stats_shrunk = (arg.nr_shrunk +
 				es_stats->es_stats_shrunk*3) / 4;
 	else
-		es_stats->es_stats_shrunk = nr_shrunk;
+		es_stats->es_stats_shrunk = arg.nr_shrunk;
+	if (likely(es_stats->es_stats_skipped))
+		es_stats->es_stats_skipped = (arg.nr_skipped +
+				es_stats->es_stats_skipped*3) / 4;
+	else
+		es_stats->es_stats_skipped = arg.nr_skipped;
+	if (arg.nr_skipped > es_stats->es_stats_max_skipped)
+		es_stats->es_stats_max_skipped = arg.nr_skipped;
 
-	trace_ext4_es_shrink(sbi->s_sb, nr_shrunk, scan_time,
-			     nr_skipped, retried);
-	return nr_shrunk;
+	trace_ext4_es_shrink(sbi->s_sb, arg.nr_shrunk, scan_time,
+			     arg.nr_skipped, arg.retried);
+	return arg.nr_shrunk;
 }
 
 static unsigned long ext4_es_count(struct shrinker *shrink,
@@ -1094,26 +1122,45 @@ ext4_es_seq_shrinker_info_next(struct seq_file *seq, void *v, loff_t *pos)
 	return NULL;
 }
 
+struct es_max_arg {
+	unsigned int inode_cnt;
+	unsigned long ino;
+	unsigned int all_nr;
+	unsigned int shk_nr;
+};
+
+static enum lru_status es_find_max(struct list_head *item, spinlock_t *lock,
+				   void *cb_arg)
+{
+	struct ext4_inode_info *ei = list_entry(item, struct ext4_inode_info,
+						i_es_list);
+	struct es_max_arg *arg = cb_arg;
+
+	if (!arg->inode_cnt++ || arg->all_nr < ei->i_es_all_nr) {
+		arg->ino = ei->vfs_inode.i_ino;
+		arg->all_nr = ei->i_es_all_nr;
+		arg->shk_nr = ei->i_es_shk_nr;
+	}
+	return LRU_SKIP;
+}
+
 static int ext4_es_seq_shrinker_info_show(struct seq_file *seq, void *v)
 {
 	struct ext4_sb_info *sbi = seq->private;
 	struct ext4_es_stats *es_stats = &sbi->s_es_stats;
-	struct ext4_inode_info *ei, *max = NULL;
-	unsigned int inode_cnt = 0;
+	struct es_max_arg max = { 0 };
+	unsigned int inode_cnt;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
 
-	/* here we just find an inode that has the max nr. of objects */
-	spin_lock(&sbi->s_es_lock);
-	list_for_each_entry(ei, &sbi->s_es_list, i_es_list) {
-		inode_cnt++;
-		if (max && max->i_es_all_nr < ei->i_es_all_nr)
-			max = ei;
-		else if (!max)
-			max = ei;
-	}
-	spin_unlock(&sbi->s_es_lock);
+	/*
+	 * here we just find an inode that has the max nr. of objects, the
+	 * list lock keeps the inodes on the list from being freed
+	 */
+	list_lru_walk(&sbi->s_es_lru, es_find_max, &max,
+		      list_lru_count(&sbi->s_es_lru));
+	inode_cnt = max.inode_cnt;
 
 	seq_printf(seq, "stats:\n  %lld objects\n  %lld reclaimable objects\n",
 		   percpu_counter_sum_positive(&es_stats->es_stats_all_cnt),
@@ -1127,12 +1174,16 @@ static int ext4_es_seq_shrinker_info_show(struct seq_file *seq, void *v)
 	seq_printf(seq, "average:\n  %llu us scan time\n",
 	    div_u64(es_stats->es_stats_scan_time, 1000));
 	seq_printf(seq, "  %lu shrunk objects\n", es_stats->es_stats_shrunk);
+	seq_printf(seq, "  %lu skipped inodes\n", es_stats->es_stats_skipped);
+	seq_printf(seq, "  %lu shrinks\n", es_stats->es_stats_nr_shrinks);
+	seq_printf(seq, "maximum:\n");
 	if (inode_cnt)
-		seq_printf(seq,
-		    "maximum:\n  %lu inode (%u objects, %u reclaimable)\n"
-		    "  %llu us max scan time\n",
-		    max->vfs_inode.i_ino, max->i_es_all_nr, max->i_es_shk_nr,
-		    div_u64(es_stats->es_stats_max_scan_time, 1000));
+		seq_printf(seq, "  %lu inode (%u objects, %u reclaimable)\n",
+			   max.ino, max.all_nr, max.shk_nr);
+	seq_printf(seq, "  %llu us max scan time\n"
+		   "  %lu max skipped inodes\n",
+		   div_u64(es_stats->es_stats_max_scan_time, 1000),
+		   es_stats->es_stats_max_skipped);
 
 	return 0;
 }
@@ -1182,17 +1233,20 @@ int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 
 	/* Make sure we have enough bits for physical block number */
 	BUILD_BUG_ON(ES_SHIFT < 48);
-	INIT_LIST_HEAD(&sbi->s_es_list);
-	sbi->s_es_nr_inode = 0;
-	spin_lock_init(&sbi->s_es_lock);
 	sbi->s_es_stats.es_stats_shrunk = 0;
+	sbi->s_es_stats.es_stats_skipped = 0;
+	sbi->s_es_stats.es_stats_max_skipped = 0;
+	sbi->s_es_stats.es_stats_nr_shrinks = 0;
 	sbi->s_es_stats.es_stats_cache_hits = 0;
 	sbi->s_es_stats.es_stats_cache_misses = 0;
 	sbi->s_es_stats.es_stats_scan_time = 0;
 	sbi->s_es_stats.es_stats_max_scan_time = 0;
-	err = percpu_counter_init(&sbi->s_es_stats.es_stats_all_cnt, 0, GFP_KERNEL);
+	err = list_lru_init(&sbi->s_es_lru);
 	if (err)
 		return err;
+	err = percpu_counter_init(&sbi->s_es_stats.es_stats_all_cnt, 0, GFP_KERNEL);
+	if (err)
+		goto err0;
 	err = percpu_counter_init(&sbi->s_es_stats.es_stats_shk_cnt, 0, GFP_KERNEL);
 	if (err)
 		goto err1;
@@ -1214,6 +1268,8 @@ err2:
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_shk_cnt);
 err1:
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_all_cnt);
+err0:
+	list_lru_destroy(&sbi->s_es_lru);
 	return err;
 }
 
@@ -1224,6 +1280,7 @@ void ext4_es_unregister_shrinker(struct ext4_sb_info *sbi)
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_all_cnt);
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_shk_cnt);
 	unregister_shrinker(&sbi->s_es_shrinker);
+	list_lru_destroy(&sbi->s_es_lru);
 }
 
 /*
@@ -69,6 +69,9 @@ struct ext4_es_tree {
 
 struct ext4_es_stats {
 	unsigned long es_stats_shrunk;
+	unsigned long es_stats_skipped;
+	unsigned long es_stats_max_skipped;
+	unsigned long es_stats_nr_shrinks;
 	unsigned long es_stats_cache_hits;
 	unsigned long es_stats_cache_misses;
 	u64 es_stats_scan_time;
@@ -0,0 +1,378 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits: fsync of a file whose changes in the running transaction
+ * are all in its on-disk inode writes an image of that inode to the
+ * journal's fast commit area instead of committing the transaction.
+ * Recovery writes the image back into the inode table and accounts for
+ * the blocks it maps.  Everything else (directory entries, extent tree
+ * blocks, xattr blocks, freed blocks, the orphan list...) marks the
+ * transaction or the inode ineligible, and fsync waits for a full
+ * commit as before.
+ */
+
+#include <linux/fs.h>
+#include <linux/crc32.h>
+#include <linux/buffer_head.h>
+#include <linux/pagemap.h>
+#include <linux/quotaops.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+/* A fast commit is a single block: one inode and the tail */
+#define EXT4_FC_INODE_BYTES(sb)	(2 * sizeof(struct ext4_fc_tl) +	\
+				 sizeof(struct ext4_fc_inode) +		\
+				 EXT4_INODE_SIZE(sb) +			\
+				 sizeof(struct ext4_fc_tail))
+
+static u32 ext4_fc_csum(struct super_block *sb, void *buf, int len)
+{
+	struct ext4_super_block *es = EXT4_SB(sb)->s_es;
+
+	return crc32_le(crc32_le(~0, es->s_uuid, sizeof(es->s_uuid)),
+			buf, len);
+}
+
+/*
+ * Can @inode's changes in transaction @tid be described by its on-disk
+ * inode alone?
+ */
+static bool ext4_fc_eligible(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+
+	if (EXT4_SB(sb)->s_fc_ineligible_tid == tid ||
+	    EXT4_I(inode)->i_fc_ineligible_tid == tid)
+		return false;
+	if (!S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ext4_has_inline_data(inode) || ext4_should_journal_data(inode))
+		return false;
+	/* quota updates go to the quota files */
+	return !sb_any_quota_loaded(sb);
+}
+
+/*
+ * Fill @bh with the image of @inode.  The inode is checked again once the
+ * image is taken: whatever makes it ineligible marks it before changing
+ * anything, so a change the check misses isn't in the image either.
+ */
+static int ext4_fc_write_inode(struct inode *inode, tid_t tid,
+			       struct buffer_head *bh)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int inode_len = EXT4_INODE_SIZE(sb);
+	struct ext4_fc_inode *fc_inode;
+	struct ext4_fc_tail *tail;
+	struct ext4_fc_tl *tl;
+	struct ext4_iloc iloc;
+	int err;
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		return err;
+
+	tl = (struct ext4_fc_tl *)bh->b_data;
+	tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_INODE);
+	tl->fc_len = cpu_to_le16(sizeof(*fc_inode) + inode_len);
+	fc_inode = (struct ext4_fc_inode *)(tl + 1);
+	fc_inode->fc_ino = cpu_to_le32(inode->i_ino);
+
+	down_read(&ei->i_data_sem);
+	spin_lock(&ei->i_raw_lock);
+	memcpy(fc_inode->fc_raw_inode, ext4_raw_inode(&iloc), inode_len);
+	spin_unlock(&ei->i_raw_lock);
+	/*
+	 * The image must not map blocks whose data isn't on disk yet.  Pages
+	 * are mapped while still dirty and stay under writeback until their
+	 * IO is done, unwritten extents are converted after it.
+	 */
+	if (!ext4_fc_eligible(inode, tid) ||
+	    mapping_tagged(inode->i_mapping, PAGECACHE_TAG_DIRTY) ||
+	    mapping_tagged(inode->i_mapping, PAGECACHE_TAG_WRITEBACK) ||
+	    atomic_read(&ei->i_unwritten))
+		err = -EAGAIN;
+	up_read(&ei->i_data_sem);
+	brelse(iloc.bh);
+	if (err)
+		return err;
+
+	tl = (struct ext4_fc_tl *)(fc_inode->fc_raw_inode + inode_len);
+	tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_TAIL);
+	tl->fc_len = cpu_to_le16(sizeof(*tail));
+	tail = (struct ext4_fc_tail *)(tl + 1);
+	tail->fc_tid = cpu_to_le32(tid);
+	tail->fc_crc = cpu_to_le32(ext4_fc_csum(sb, bh->b_data,
+				(char *)&tail->fc_crc - bh->b_data));
+	return 0;
+}
+
+/*
+ * ext4_fc_commit
+ *
+ * Make the changes to @inode in transaction @commit_tid durable with a
+ * fast commit.  Returns 0 on success; otherwise the caller has to wait
+ * for the transaction to commit.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct buffer_head *bh;
+	bool running;
+	int err;
+
+	if (EXT4_FC_INODE_BYTES(sb) > sb->s_blocksize ||
+	    !ext4_fc_eligible(inode, commit_tid))
+		return -EOPNOTSUPP;
+
+	read_lock(&journal->j_state_lock);
+	running = journal->j_running_transaction &&
+		  journal->j_running_transaction->t_tid == commit_tid;
+	read_unlock(&journal->j_state_lock);
+	if (!running)
+		return -EAGAIN;
+
+	/*
+	 * A full commit waits for the data of ordered extents, here all of
+	 * the file's data has to be on disk before the inode is.
+	 */
+	err = filemap_write_and_wait(inode->i_mapping);
+	if (err)
+		return err;
+	wait_event(*ext4_ioend_wq(inode),
+		   atomic_read(&EXT4_I(inode)->i_unwritten) == 0);
+
+	err = jbd2_fc_begin_commit(journal, commit_tid);
+	if (err)
+		return err;
+
+	err = jbd2_fc_get_buf(journal, &bh);
+	if (!err)
+		err = ext4_fc_write_inode(inode, commit_tid, bh);
+	if (!err)
+		err = jbd2_fc_write_bufs(journal);
+	jbd2_fc_end_commit(journal, err);
+	return err;
+}
+
+/*
+ * Return the tail of a fast commit block if it is one of @tid.
+ */
+static struct ext4_fc_tail *ext4_fc_block_tail(struct super_block *sb,
+					       struct buffer_head *bh,
+					       tid_t tid)
+{
+	char *cur = bh->b_data, *end = bh->b_data + bh->b_size;
+	struct ext4_fc_tail *tail;
+	struct ext4_fc_tl *tl;
+
+	while (cur + sizeof(*tl) <= end) {
+		tl = (struct ext4_fc_tl *)cur;
+		cur += sizeof(*tl) + le16_to_cpu(tl->fc_len);
+		if (cur > end)
+			break;
+
+		switch (le16_to_cpu(tl->fc_tag)) {
+		case EXT4_FC_TAG_INODE:
+			continue;
+		case EXT4_FC_TAG_TAIL:
+			tail = (struct ext4_fc_tail *)(tl + 1);
+			if (le16_to_cpu(tl->fc_len) != sizeof(*tail) ||
+			    le32_to_cpu(tail->fc_tid) != tid ||
+			    le32_to_cpu(tail->fc_crc) !=
+			    ext4_fc_csum(sb, bh->b_data,
+					 (char *)&tail->fc_crc - bh->b_data))
+				return NULL;
+			return tail;
+		}
+		break;
+	}
+	return NULL;
+}
+
+static void ext4_fc_put_bitmap(struct super_block *sb, ext4_group_t group,
+			       struct ext4_group_desc *gdp,
+			       struct buffer_head *gd_bh,
+			       struct buffer_head *bitmap_bh,
+			       unsigned int count)
+{
+	if (count) {
+		ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_group_clusters(sb, gdp) - count);
+		ext4_block_bitmap_csum_set(sb, group, gdp, bitmap_bh);
+		ext4_group_desc_csum_set(sb, group, gdp);
+		mark_buffer_dirty(bitmap_bh);
+		mark_buffer_dirty(gd_bh);
+	}
+	brelse(bitmap_bh);
+}
+
+/*
+ * Mark @len blocks from @block in use.  The descriptors and bitmaps are
+ * read from the buffer cache directly, the allocator isn't set up yet.
+ */
+static int ext4_fc_mark_used(struct super_block *sb, ext4_fsblk_t block,
+			     unsigned int len)
+{
+	struct ext4_super_block *es = EXT4_SB(sb)->s_es;
+	struct buffer_head *bitmap_bh = NULL, *gd_bh = NULL;
+	struct ext4_group_desc *gdp = NULL;
+	ext4_group_t group, cur_group = 0;
+	ext4_grpblk_t bit;
+	unsigned int count = 0;
+
+	if (block < le32_to_cpu(es->s_first_data_block) ||
+	    len > ext4_blocks_count(es) - block)
+		return -EIO;
+
+	for (; len; block++, len--) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		if (!bitmap_bh || group != cur_group) {
+			if (bitmap_bh)
+				ext4_fc_put_bitmap(sb, cur_group, gdp, gd_bh,
+						   bitmap_bh, count);
+			bitmap_bh = NULL;
+			count = 0;
+			cur_group = group;
+
+			/* allocating from an uninit group is ineligible */
+			gdp = ext4_get_group_desc(sb, group, &gd_bh);
+			if (!gdp || (gdp->bg_flags &
+				     cpu_to_le16(EXT4_BG_BLOCK_UNINIT)))
+				return -EIO;
+			bitmap_bh = sb_bread(sb, ext4_block_bitmap(sb, gdp));
+			if (!bitmap_bh)
+				return -EIO;
+		}
+		if (!ext4_test_and_set_bit(bit, bitmap_bh->b_data))
+			count++;
+	}
+	if (bitmap_bh)
+		ext4_fc_put_bitmap(sb, cur_group, gdp, gd_bh, bitmap_bh, count);
+	return 0;
+}
+
+/*
+ * Blocks the inode got in the fast committed transaction are only
+ * accounted for in bitmaps that didn't make it to disk.  Only extents in
+ * the inode itself can be new: changing tree blocks makes the inode
+ * ineligible.
+ */
+static int ext4_fc_replay_extents(struct super_block *sb,
+				  struct ext4_inode *raw_inode)
+{
+	struct ext4_extent_header *eh;
+	struct ext4_extent *ex;
+	int i, err;
+
+	if (!(le32_to_cpu(raw_inode->i_flags) & EXT4_EXTENTS_FL))
+		return 0;
+
+	eh = (struct ext4_extent_header *)raw_inode->i_block;
+	if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth)
+		return 0;
+	if (le16_to_cpu(eh->eh_entries) >
+	    (sizeof(raw_inode->i_block) - sizeof(*eh)) / sizeof(*ex))
+		return -EIO;
+
+	ex = EXT_FIRST_EXTENT(eh);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++, ex++) {
+		err = ext4_fc_mark_used(sb, ext4_ext_pblock(ex),
+					ext4_ext_get_actual_len(ex));
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fc_inode, int len)
+{
+	struct ext4_inode *raw_inode = (struct ext4_inode *)fc_inode->fc_raw_inode;
+	unsigned long ino = le32_to_cpu(fc_inode->fc_ino);
+	int inode_size = EXT4_INODE_SIZE(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	unsigned long offset;
+
+	if (len != sizeof(*fc_inode) + inode_size ||
+	    ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count))
+		return -EIO;
+
+	jbd_debug(1, "EXT4-fs: replaying fast commit of inode %lu\n", ino);
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EIO;
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * inode_size;
+	bh = sb_bread(sb, ext4_inode_table(sb, gdp) +
+		      (offset >> EXT4_BLOCK_SIZE_BITS(sb)));
+	if (!bh)
+		return -EIO;
+	lock_buffer(bh);
+	memcpy(bh->b_data + (offset & (sb->s_blocksize - 1)), raw_inode,
+	       inode_size);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+
+	return ext4_fc_replay_extents(sb, raw_inode);
+}
+
+static int ext4_fc_replay_block(struct super_block *sb,
+				struct buffer_head *bh)
+{
+	char *cur = bh->b_data, *end = bh->b_data + bh->b_size;
+	struct ext4_fc_tl *tl;
+	int err;
+
+	/* the scan pass checked the layout */
+	while (cur + sizeof(*tl) <= end) {
+		tl = (struct ext4_fc_tl *)cur;
+		if (le16_to_cpu(tl->fc_tag) != EXT4_FC_TAG_INODE)
+			break;
+		err = ext4_fc_replay_inode(sb, (struct ext4_fc_inode *)(tl + 1),
+					   le16_to_cpu(tl->fc_len));
+		if (err)
+			return err;
+		cur += sizeof(*tl) + le16_to_cpu(tl->fc_len);
+	}
+	return 0;
+}
+
+/*
+ * Recovery callback.  The scan pass counts the fast commits of
+ * @expected_tid at the start of the area, the replay pass applies them.
+ */
+static int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  enum passtype pass, int off, tid_t expected_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int err;
+
+	if (pass == PASS_SCAN) {
+		if (!ext4_fc_block_tail(sb, bh, expected_tid))
+			return JBD2_FC_REPLAY_STOP;
+		sbi->s_fc_replay_blocks = off + 1;
+		return 0;
+	}
+
+	if (off >= sbi->s_fc_replay_blocks)
+		return JBD2_FC_REPLAY_STOP;
+	err = ext4_fc_replay_block(sb, bh);
+	if (err)
+		ext4_msg(sb, KERN_ERR, "fast commit replay failed (%d)", err);
+	return err;
+}
+
+void ext4_fc_init(struct super_block *sb, journal_t *journal)
+{
+	journal->j_fc_replay_callback = ext4_fc_replay;
+	EXT4_SB(sb)->s_fc_replay_blocks = 0;
+}
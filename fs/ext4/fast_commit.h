@@ -0,0 +1,35 @@
+/*
+ *  fs/ext4/fast_commit.h
+ *
+ * On-disk format of ext4 fast commits.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+/*
+ * Each fast commit is one block of the journal's fast commit area,
+ * holding a sequence of tag-length-value records.  It ends with a tail
+ * record naming the transaction it was written for and a crc32 of the
+ * block up to the crc.  Blocks are replayed in order, so a later image
+ * of an inode replaces an earlier one.
+ */
+#define EXT4_FC_TAG_INODE	0x0001	/* raw on-disk inode */
+#define EXT4_FC_TAG_TAIL	0x0002	/* end of the fast commit */
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;		/* length of the value that follows */
+};
+
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];	/* EXT4_INODE_SIZE bytes */
+};
+
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;
+};
+
+#endif	/* _EXT4_FAST_COMMIT_H */
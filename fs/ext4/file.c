@@ -88,6 +88,57 @@ ext4_unaligned_aio(struct inode *inode, struct iov_iter *from, loff_t pos)
 	return 0;
 }
 
+#ifdef CONFIG_EXT4_FS_DAX
+/*
+ * xip_file_write() only updates i_size, ext4 also has to get the new size
+ * into the on-disk inode.
+ */
+static ssize_t ext4_dax_file_write(struct file *file, const char __user *buf,
+				   size_t len, loff_t *ppos)
+{
+	struct inode *inode = file_inode(file);
+	loff_t pos = *ppos;
+	handle_t *handle;
+	ssize_t ret;
+	int err;
+
+	/* see the bitmap-format check in ext4_file_write_iter() */
+	if (!(ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) &&
+	    !(file->f_flags & O_APPEND)) {
+		struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+		if (pos >= sbi->s_bitmap_maxbytes)
+			return len ? -EFBIG : 0;
+		if (len > sbi->s_bitmap_maxbytes - pos)
+			len = sbi->s_bitmap_maxbytes - pos;
+	}
+
+	ret = xip_file_write(file, buf, len, ppos);
+	if (ret <= 0)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (inode->i_size > EXT4_I(inode)->i_disksize) {
+		handle = ext4_journal_start(inode, EXT4_HT_INODE, 1);
+		if (IS_ERR(handle)) {
+			mutex_unlock(&inode->i_mutex);
+			return PTR_ERR(handle);
+		}
+		ext4_update_i_disksize(inode, inode->i_size);
+		err = ext4_mark_inode_dirty(handle, inode);
+		ext4_journal_stop(handle);
+		if (err) {
+			mutex_unlock(&inode->i_mutex);
+			return err;
+		}
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	err = generic_write_sync(file, *ppos - ret, ret);
+	return err < 0 ? err : ret;
+}
+#endif
+
 static ssize_t
 ext4_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
@@ -600,6 +651,23 @@ const struct file_operations ext4_file_operations = {
 	.fallocate	= ext4_fallocate,
 };
 
+#ifdef CONFIG_EXT4_FS_DAX
+const struct file_operations ext4_dax_file_operations = {
+	.llseek		= ext4_llseek,
+	.read		= xip_file_read,
+	.write		= ext4_dax_file_write,
+	.unlocked_ioctl = ext4_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl	= ext4_compat_ioctl,
+#endif
+	.mmap		= xip_file_mmap,
+	.open		= ext4_file_open,
+	.release	= ext4_release_file,
+	.fsync		= ext4_sync_file,
+	.fallocate	= ext4_fallocate,
+};
+#endif
+
 const struct inode_operations ext4_file_inode_operations = {
 	.setattr	= ext4_setattr,
 	.getattr	= ext4_getattr,
@@ -412,6 +412,7 @@ static int ext4_destroy_inline_data_nolock(handle_t *handle,
 	if (!ei->i_inline_off)
 		return 0;
 
+	ext4_fc_mark_inode_ineligible(inode, handle);
 	error = ext4_get_inode_loc(inode, &is.iloc);
 	if (error)
 		return error;
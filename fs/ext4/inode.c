@@ -615,6 +615,20 @@ found:
 			ext4_da_update_reserve_space(inode, retval, 1);
 	}
 
+	/*
+	 * Direct access maps the blocks without going through the page
+	 * cache, zero them while still holding i_data_sem so a racing
+	 * lookup can't map them first.
+	 */
+	if (retval > 0 && (flags & EXT4_GET_BLOCKS_ZERO) &&
+	    (map->m_flags & EXT4_MAP_NEW) &&
+	    !(map->m_flags & EXT4_MAP_UNWRITTEN)) {
+		ret = sb_issue_zeroout(inode->i_sb, map->m_pblk, map->m_len,
+				       GFP_NOFS);
+		if (ret)
+			retval = ret;
+	}
+
 	if (retval > 0) {
 		unsigned int status;
 
@@ -3159,8 +3173,30 @@ static const struct address_space_operations ext4_da_aops = {
 	.error_remove_page	= generic_error_remove_page,
 };
 
+#ifdef CONFIG_EXT4_FS_DAX
+static const struct address_space_operations ext4_dax_aops = {
+	.bmap			= ext4_bmap,
+	.get_xip_mem		= ext4_get_xip_mem,
+};
+
+/* Regular files bypass the page cache unless their data is journalled */
+static bool ext4_use_dax(struct inode *inode)
+{
+	return test_opt(inode->i_sb, DAX) && S_ISREG(inode->i_mode) &&
+		!ext4_should_journal_data(inode) &&
+		!ext4_has_inline_data(inode);
+}
+#endif
+
 void ext4_set_aops(struct inode *inode)
 {
+#ifdef CONFIG_EXT4_FS_DAX
+	if (ext4_use_dax(inode)) {
+		inode->i_mapping->a_ops = &ext4_dax_aops;
+		inode->i_fop = &ext4_dax_file_operations;
+		return;
+	}
+#endif
 	switch (ext4_inode_journal_mode(inode)) {
 	case EXT4_INODE_ORDERED_DATA_MODE:
 		ext4_set_inode_state(inode, EXT4_STATE_ORDERED_MODE);
@@ -3199,11 +3235,6 @@ static int ext4_block_zero_page_range(handle_t *handle,
 	struct page *page;
 	int err = 0;
 
-	page = find_or_create_page(mapping, from >> PAGE_CACHE_SHIFT,
-				   mapping_gfp_mask(mapping) & ~__GFP_FS);
-	if (!page)
-		return -ENOMEM;
-
 	blocksize = inode->i_sb->s_blocksize;
 	max = blocksize - (offset & (blocksize - 1));
 
@@ -3214,6 +3245,14 @@ static int ext4_block_zero_page_range(handle_t *handle,
 	if (length > max || length < 0)
 		length = max;
 
+	if (ext4_mapping_is_dax(mapping))
+		return ext4_dax_zero_range(inode, from, length);
+
+	page = find_or_create_page(mapping, from >> PAGE_CACHE_SHIFT,
+				   mapping_gfp_mask(mapping) & ~__GFP_FS);
+	if (!page)
+		return -ENOMEM;
+
 	iblock = index << (PAGE_CACHE_SHIFT - inode->i_sb->s_blocksize_bits);
 
 	if (!page_has_buffers(page))
@@ -3997,6 +4036,7 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 			tid = transaction->t_tid;
 		else
 			tid = journal->j_commit_sequence;
+		ei->i_fc_ineligible_tid = journal->j_commit_sequence;
 		read_unlock(&journal->j_state_lock);
 		ei->i_sync_tid = tid;
 		ei->i_datasync_tid = tid;
@@ -4907,6 +4947,9 @@ int ext4_change_inode_journal_flag(struct inode *inode, int val)
 		return 0;
 	if (is_journal_aborted(journal))
 		return -EROFS;
+	/* Data written through direct access never goes to the journal */
+	if (test_opt(inode->i_sb, DAX))
+		return -EINVAL;
 	/* We have to allocate physical blocks for delalloc blocks
 	 * before flushing journal. otherwise delalloc blocks can not
 	 * be allocated any more. even more truncate on delalloc blocks
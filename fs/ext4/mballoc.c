@@ -166,6 +166,13 @@ MODULE_PARM_DESC(mballoc_debug, "Debugging level for ext4's mballoc");
  * can be used for allocation. ext4_mb_good_group explains how the groups are
  * checked.
  *
+ * With the mb_optimize_scan mount option, the first two criteria don't scan
+ * the groups in order.  Groups are kept on lists by the order of their
+ * largest free extent (sbi->s_mb_largest_free_orders) and of their average
+ * fragment size (sbi->s_mb_avg_fragment_size), and are picked from the
+ * lists of the orders that can satisfy the request.  This avoids looking at
+ * every group of a large, fragmented file system.
+ *
  * Both the prealloc space are getting populated as above. So for the first
  * request we will hit the buddy cache which will result in this prealloc
  * space getting filled. The prealloc space is then later used for the
@@ -703,18 +710,100 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
+	int new_order = -1;
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			new_order = i;
 			break;
 		}
 	}
+
+	if (new_order == grp->bb_largest_free_order)
+		return;
+
+	if (grp->bb_largest_free_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+	}
+	grp->bb_largest_free_order = new_order;
+	if (new_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[new_order]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[new_order]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[new_order]);
+	}
+}
+
+static int mb_avg_fragment_size_order(struct super_block *sb,
+				      ext4_grpblk_t len)
+{
+	return min_t(int, fls(len) - 1, MB_NUM_ORDERS(sb) - 1);
+}
+
+/*
+ * Keep the group on the list of its average free fragment size, groups
+ * without free blocks are on none.
+ */
+static void
+mb_update_avg_fragment_size(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int new_order = -1;
+
+	if (grp->bb_free && grp->bb_fragments)
+		new_order = mb_avg_fragment_size_order(sb,
+					grp->bb_free / grp->bb_fragments);
+
+	if (new_order == grp->bb_avg_fragment_size_order)
+		return;
+
+	if (grp->bb_avg_fragment_size_order >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[
+					grp->bb_avg_fragment_size_order]);
+		list_del_init(&grp->bb_avg_fragment_size_node);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[
+					grp->bb_avg_fragment_size_order]);
+	}
+	grp->bb_avg_fragment_size_order = new_order;
+	if (new_order >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[new_order]);
+		list_add_tail(&grp->bb_avg_fragment_size_node,
+			      &sbi->s_mb_avg_fragment_size[new_order]);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[new_order]);
+	}
+}
+
+/*
+ * Move a group that didn't satisfy an allocation to the tail of its lists,
+ * so that the next search tries the others first.  Called with the group
+ * lock held, which keeps the orders of the group stable.
+ */
+static void mb_rotate_group(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int order;
+
+	order = grp->bb_largest_free_order;
+	if (order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_move_tail(&grp->bb_largest_free_order_node,
+			       &sbi->s_mb_largest_free_orders[order]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
+
+	order = grp->bb_avg_fragment_size_order;
+	if (order >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[order]);
+		list_move_tail(&grp->bb_avg_fragment_size_node,
+			       &sbi->s_mb_avg_fragment_size[order]);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[order]);
+	}
 }
 
 static noinline_for_stack
@@ -766,6 +855,7 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 		set_bit(EXT4_GROUP_INFO_BBITMAP_CORRUPT_BIT, &grp->bb_state);
 	}
 	mb_set_largest_free_order(sb, grp);
+	mb_update_avg_fragment_size(sb, grp);
 
 	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
 
@@ -1484,6 +1574,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 
 done:
 	mb_set_largest_free_order(sb, e4b->bd_info);
+	mb_update_avg_fragment_size(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1608,6 +1699,7 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+	mb_update_avg_fragment_size(e4b->bd_sb, e4b->bd_info);
 
 	ext4_set_bits(e4b->bd_bitmap, ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -2073,6 +2165,141 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Look for blocks in @group with criteria @cr, if the group is good enough.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_buddy e4b;
+	int err;
+
+	/* This now checks without needing the buddy page */
+	if (!ext4_mb_good_group(ac, group, cr))
+		return 0;
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	if (!ext4_mb_good_group(ac, group, cr))
+		goto out;
+
+	ac->ac_groups_scanned++;
+	if (cr == 0 && ac->ac_2order < sb->s_blocksize_bits+2)
+		ext4_mb_simple_scan_group(ac, &e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, &e4b);
+	else
+		ext4_mb_complex_scan_group(ac, &e4b);
+
+	/* let the next search try another group first */
+	if (ac->ac_status == AC_STATUS_CONTINUE &&
+	    test_opt(sb, MB_OPTIMIZE_SCAN))
+		mb_rotate_group(sb, e4b.bd_info);
+out:
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+	return 0;
+}
+
+/*
+ * Find the first group of the lists from @order up that looks good enough
+ * for criteria @cr.  Largest free extent lists are used for cr 0, average
+ * fragment size lists for cr 1.
+ */
+static bool ext4_mb_find_group_by_order(struct ext4_allocation_context *ac,
+					int cr, int order, ext4_group_t ngroups,
+					ext4_group_t *group)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	struct list_head *lists, *pos;
+	rwlock_t *locks;
+	bool found = false;
+
+	if (cr == 0) {
+		lists = sbi->s_mb_largest_free_orders;
+		locks = sbi->s_mb_largest_free_orders_locks;
+	} else {
+		lists = sbi->s_mb_avg_fragment_size;
+		locks = sbi->s_mb_avg_fragment_size_locks;
+	}
+
+	for (; order < MB_NUM_ORDERS(sb) && !found; order++) {
+		if (list_empty(&lists[order]))
+			continue;
+
+		read_lock(&locks[order]);
+		list_for_each(pos, &lists[order]) {
+			if (cr == 0)
+				grp = list_entry(pos, struct ext4_group_info,
+						 bb_largest_free_order_node);
+			else
+				grp = list_entry(pos, struct ext4_group_info,
+						 bb_avg_fragment_size_node);
+
+			/*
+			 * Groups that are still being initialized must be
+			 * left alone, ext4_mb_good_group would sleep on them.
+			 */
+			if (grp->bb_group >= ngroups ||
+			    EXT4_MB_GRP_NEED_INIT(grp))
+				continue;
+
+			if (ext4_mb_good_group(ac, grp->bb_group, cr)) {
+				*group = grp->bb_group;
+				found = true;
+				break;
+			}
+		}
+		read_unlock(&locks[order]);
+	}
+
+	return found;
+}
+
+static int ext4_mb_scan_by_order(struct ext4_allocation_context *ac, int cr,
+				 ext4_group_t ngroups)
+{
+	struct super_block *sb = ac->ac_sb;
+	ext4_group_t group, i;
+	int order, err;
+
+	if (cr == 0)
+		order = ac->ac_2order;
+	else
+		order = mb_avg_fragment_size_order(sb, ac->ac_g_ex.fe_len);
+
+	for (i = 0; i < ngroups; i++) {
+		cond_resched();
+
+		if (!ext4_mb_find_group_by_order(ac, cr, order, ngroups,
+						 &group))
+			break;
+
+		err = ext4_mb_scan_group(ac, group, cr);
+		if (err)
+			return err;
+
+		if (ac->ac_status != AC_STATUS_CONTINUE)
+			break;
+	}
+
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2138,6 +2365,18 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
+		/*
+		 * Pick the groups that can satisfy the request straight
+		 * from the order lists, rather than checking all of them.
+		 */
+		if (cr < 2 && test_opt(sb, MB_OPTIMIZE_SCAN)) {
+			err = ext4_mb_scan_by_order(ac, cr, ngroups);
+			if (err)
+				goto out;
+			continue;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -2153,38 +2392,10 @@ repeat:
 			if (group >= ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			if (!ext4_mb_good_group(ac, group, cr))
-				continue;
-
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			if (!ext4_mb_good_group(ac, group, cr)) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0 && ac->ac_2order < sb->s_blocksize_bits+2)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2423,6 +2634,10 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_avg_fragment_size_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_avg_fragment_size_node);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2572,6 +2787,28 @@ int ext4_mb_init(struct super_block *sb)
 		goto out;
 	}
 
+	sbi->s_mb_largest_free_orders = kmalloc(MB_NUM_ORDERS(sb) *
+				sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks = kmalloc(MB_NUM_ORDERS(sb) *
+				sizeof(rwlock_t), GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size = kmalloc(MB_NUM_ORDERS(sb) *
+				sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size_locks = kmalloc(MB_NUM_ORDERS(sb) *
+				sizeof(rwlock_t), GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks ||
+	    !sbi->s_mb_avg_fragment_size ||
+	    !sbi->s_mb_avg_fragment_size_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+		INIT_LIST_HEAD(&sbi->s_mb_avg_fragment_size[i]);
+		rwlock_init(&sbi->s_mb_avg_fragment_size_locks[i]);
+	}
+
 	ret = ext4_groupinfo_create_slab(sb->s_blocksize);
 	if (ret < 0)
 		goto out;
@@ -2655,6 +2892,14 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
+	kfree(sbi->s_mb_avg_fragment_size);
+	sbi->s_mb_avg_fragment_size = NULL;
+	kfree(sbi->s_mb_avg_fragment_size_locks);
+	sbi->s_mb_avg_fragment_size_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2710,6 +2955,10 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_avg_fragment_size);
+	kfree(sbi->s_mb_avg_fragment_size_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -2936,6 +3185,8 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 	ext4_set_bits(bitmap_bh->b_data, ac->ac_b_ex.fe_start,
 		      ac->ac_b_ex.fe_len);
 	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+		/* fast commit replay can't initialize bitmaps */
+		ext4_fc_mark_ineligible(sb, handle);
 		gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
 		ext4_free_group_clusters_set(sb, gdp,
 					     ext4_free_clusters_after_init(sb,
@@ -4666,6 +4917,9 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 	ext4_debug("freeing block %llu\n", block);
 	trace_ext4_free_blocks(inode, block, count, flags);
 
+	/* fast commit replay only accounts for allocated blocks */
+	ext4_fc_mark_inode_ineligible(inode, handle);
+
 	if (flags & EXT4_FREE_BLOCKS_FORGET) {
 		struct buffer_head *tbh = bh;
 		int i;
@@ -286,6 +286,8 @@ again:
 		*err = PTR_ERR(handle);
 		return 0;
 	}
+	/* blocks change owner between the two inodes */
+	ext4_fc_mark_ineligible(orig_inode->i_sb, handle);
 
 	orig_blk_offset = orig_page_offset * blocks_per_page +
 		data_offset_in_page;
@@ -1883,6 +1883,8 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	if (!dentry->d_name.len)
 		return -EINVAL;
 
+	ext4_fc_mark_ineligible(sb, handle);
+
 	if (ext4_has_inline_data(dir)) {
 		retval = ext4_try_add_inline_entry(handle, dentry, inode);
 		if (retval < 0)
@@ -2131,6 +2133,8 @@ static int ext4_delete_entry(handle_t *handle,
 {
 	int err, csum_size = 0;
 
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
+
 	if (ext4_has_inline_data(dir)) {
 		int has_inline_data = 1;
 		err = ext4_delete_inline_entry(handle, dir, de_del, bh,
@@ -2551,6 +2555,9 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		return 0;
 
+	/* The orphan list lives in the superblock and other inodes */
+	ext4_fc_mark_ineligible(sb, handle);
+
 	/*
 	 * Orphan handling is only valid for files with data blocks
 	 * being truncated, or files being unlinked. Note that we either
@@ -2630,6 +2637,8 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	if (list_empty(&ei->i_orphan))
 		return 0;
 
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
+
 	if (handle) {
 		/* Grab inode buffer early before taking global s_orphan_lock */
 		err = ext4_reserve_inode_write(handle, inode, &iloc);
@@ -3266,6 +3275,7 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 			return PTR_ERR(whiteout);
 	}
 
+	ext4_fc_mark_ineligible(old.dir->i_sb, handle);
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
@@ -3430,6 +3440,7 @@ static int ext4_cross_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
 
+	ext4_fc_mark_ineligible(old.dir->i_sb, handle);
 	if (IS_DIRSYNC(old.dir) || IS_DIRSYNC(new.dir))
 		ext4_handle_sync(handle);
 
@@ -0,0 +1,691 @@
+/*
+ * fs/f2fs/compress.c
+ *
+ * Transparent compression of regular files by fixed-size clusters.
+ *
+ * A file marked with FS_COMPR_FL is split into clusters of
+ * F2FS_CLUSTER_PAGES pages. When a cluster is written back, its pages are
+ * compressed together and, if that saves at least one block, the address
+ * slot of its first page is set to COMPRESS_ADDR and the compressed data is
+ * written to the following slots. Otherwise the cluster is written as plain
+ * data blocks. Clusters crossing a direct node boundary are always plain.
+ * Reads decompress a whole cluster into the page cache at once.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+
+#include "f2fs.h"
+#include "node.h"
+#include "segment.h"
+
+#define F2FS_CLUSTER_SIZE	(F2FS_CLUSTER_PAGES << PAGE_CACHE_SHIFT)
+#define F2FS_COMPRESS_BOUND	(sizeof(struct f2fs_compress_header) +	\
+		max_t(size_t, lzo1x_worst_compress(F2FS_CLUSTER_SIZE),	\
+			lz4_compressbound(F2FS_CLUSTER_SIZE)))
+#define F2FS_COMPRESS_WRKMEM	max_t(size_t, LZO1X_1_MEM_COMPRESS,	\
+						LZ4_MEM_COMPRESS)
+
+/*
+ * Compressed blocks are written from private pages. The cluster pages stay
+ * under writeback until the last of them completes.
+ */
+struct cluster_io {
+	struct page *pages[F2FS_CLUSTER_PAGES];	/* cluster pages */
+	int nr_pages;				/* # of cluster pages */
+	atomic_t pending;			/* # of blocks in flight */
+};
+
+static inline pgoff_t cluster_start(pgoff_t index)
+{
+	return index & ~((pgoff_t)F2FS_CLUSTER_PAGES - 1);
+}
+
+/* # of pages of the cluster at @start below i_size */
+static int cluster_nr_pages(struct inode *inode, pgoff_t start)
+{
+	pgoff_t end = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+
+	if (end <= start)
+		return 0;
+	return min_t(pgoff_t, end - start, F2FS_CLUSTER_PAGES);
+}
+
+/* a cluster can only be compressed if one direct node holds all its slots */
+static bool cluster_in_dnode(struct inode *inode, pgoff_t start)
+{
+	unsigned int addrs = ADDRS_PER_INODE(F2FS_I(inode));
+	unsigned int ofs;
+
+	if (start < addrs) {
+		ofs = start;
+	} else {
+		ofs = (start - addrs) % ADDRS_PER_BLOCK;
+		addrs = ADDRS_PER_BLOCK;
+	}
+	return ofs + F2FS_CLUSTER_PAGES <= addrs;
+}
+
+static int lookup_cluster(struct inode *inode, pgoff_t start,
+						block_t *blkaddr)
+{
+	struct dnode_of_data dn;
+	unsigned int end;
+	int i = 0, err;
+
+	while (i < F2FS_CLUSTER_PAGES) {
+		set_new_dnode(&dn, inode, NULL, NULL, 0);
+		err = get_dnode_of_data(&dn, start + i, LOOKUP_NODE);
+		if (err == -ENOENT) {
+			blkaddr[i++] = NULL_ADDR;
+			continue;
+		}
+		if (err)
+			return err;
+
+		end = ADDRS_PER_PAGE(dn.node_page, F2FS_I(inode));
+		for (; i < F2FS_CLUSTER_PAGES && dn.ofs_in_node < end;
+						i++, dn.ofs_in_node++)
+			blkaddr[i] = datablock_addr(dn.node_page,
+							dn.ofs_in_node);
+		f2fs_put_dnode(&dn);
+	}
+	return 0;
+}
+
+static int decompress_cluster(unsigned char *cbuf, size_t csize,
+						unsigned char *rbuf)
+{
+	struct f2fs_compress_header *hdr = (void *)cbuf;
+	size_t clen = le32_to_cpu(hdr->clen);
+	size_t rlen = F2FS_CLUSTER_SIZE;
+	int ret;
+
+	if (clen > csize - sizeof(*hdr))
+		return -EIO;
+
+	cbuf += sizeof(*hdr);
+
+	switch (le32_to_cpu(hdr->algorithm)) {
+	case F2FS_COMPRESS_LZO:
+		ret = lzo1x_decompress_safe(cbuf, clen, rbuf, &rlen);
+		if (ret != LZO_E_OK)
+			return -EIO;
+		break;
+	case F2FS_COMPRESS_LZ4:
+		ret = lz4_decompress_unknownoutputsize(cbuf, clen, rbuf, &rlen);
+		if (ret < 0)
+			return -EIO;
+		break;
+	default:
+		return -EIO;
+	}
+
+	memset(rbuf + rlen, 0, F2FS_CLUSTER_SIZE - rlen);
+	return 0;
+}
+
+/* Read the data of the cluster mapped by @blkaddr into @rbuf. */
+static int read_cluster(struct f2fs_sb_info *sbi, block_t *blkaddr,
+						unsigned char *rbuf)
+{
+	struct page *pages[F2FS_CLUSTER_PAGES] = { NULL, };
+	bool compressed = blkaddr[0] == COMPRESS_ADDR;
+	unsigned char *cbuf;
+	int i, nr_cblocks = 0, err = 0;
+
+	for (i = compressed ? 1 : 0; i < F2FS_CLUSTER_PAGES; i++) {
+		if (blkaddr[i] == NULL_ADDR || blkaddr[i] == NEW_ADDR)
+			continue;
+
+		pages[i] = alloc_page(GFP_NOFS);
+		if (!pages[i]) {
+			err = -ENOMEM;
+			break;
+		}
+		lock_page(pages[i]);
+		err = f2fs_submit_page_bio(sbi, pages[i], blkaddr[i],
+								READ_SYNC);
+		if (err) {
+			pages[i] = NULL;
+			break;
+		}
+	}
+
+	/* wait for all the reads we issued, even on failure */
+	for (i = 0; i < F2FS_CLUSTER_PAGES; i++) {
+		if (!pages[i])
+			continue;
+		lock_page(pages[i]);
+		if (unlikely(!PageUptodate(pages[i])))
+			err = -EIO;
+	}
+	if (err)
+		goto out;
+
+	if (!compressed) {
+		for (i = 0; i < F2FS_CLUSTER_PAGES; i++) {
+			unsigned char *dst = rbuf + (i << PAGE_CACHE_SHIFT);
+
+			if (pages[i])
+				memcpy(dst, page_address(pages[i]),
+							PAGE_CACHE_SIZE);
+			else
+				memset(dst, 0, PAGE_CACHE_SIZE);
+		}
+		goto out;
+	}
+
+	/* the compressed blocks follow the COMPRESS_ADDR slot */
+	while (nr_cblocks + 1 < F2FS_CLUSTER_PAGES && pages[nr_cblocks + 1])
+		nr_cblocks++;
+	if (!nr_cblocks) {
+		err = -EIO;
+		goto out;
+	}
+
+	cbuf = kmalloc(nr_cblocks << PAGE_CACHE_SHIFT, GFP_NOFS);
+	if (!cbuf) {
+		err = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < nr_cblocks; i++)
+		memcpy(cbuf + (i << PAGE_CACHE_SHIFT),
+				page_address(pages[i + 1]), PAGE_CACHE_SIZE);
+
+	err = decompress_cluster(cbuf, nr_cblocks << PAGE_CACHE_SHIFT, rbuf);
+	kfree(cbuf);
+out:
+	for (i = 0; i < F2FS_CLUSTER_PAGES; i++)
+		if (pages[i])
+			f2fs_put_page(pages[i], 1);
+	return err;
+}
+
+static void fill_cluster_page(struct page *page, unsigned char *rbuf)
+{
+	unsigned int ofs = (page->index & (F2FS_CLUSTER_PAGES - 1)) <<
+							PAGE_CACHE_SHIFT;
+	void *kaddr;
+
+	kaddr = kmap_atomic(page);
+	memcpy(kaddr, rbuf + ofs, PAGE_CACHE_SIZE);
+	kunmap_atomic(kaddr);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+}
+
+/*
+ * Fill the locked page from its cluster, and any other page of the cluster
+ * that can be locked without waiting and is not up to date yet.
+ * Return the page unlocked, like ->readpage.
+ */
+int f2fs_read_cluster(struct inode *inode, struct page *page)
+{
+	struct address_space *mapping = inode->i_mapping;
+	pgoff_t start = cluster_start(page->index);
+	block_t blkaddr[F2FS_CLUSTER_PAGES];
+	unsigned char *rbuf;
+	int i, nr_pages, err;
+
+	rbuf = kmalloc(F2FS_CLUSTER_SIZE, GFP_NOFS);
+	if (!rbuf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	err = lookup_cluster(inode, start, blkaddr);
+	if (!err)
+		err = read_cluster(F2FS_I_SB(inode), blkaddr, rbuf);
+	if (err)
+		goto out;
+
+	fill_cluster_page(page, rbuf);
+
+	nr_pages = cluster_nr_pages(inode, start);
+	for (i = 0; i < nr_pages; i++) {
+		struct page *cpage;
+
+		if (start + i == page->index)
+			continue;
+
+		cpage = grab_cache_page_nowait(mapping, start + i);
+		if (!cpage)
+			continue;
+		if (!PageUptodate(cpage))
+			fill_cluster_page(cpage, rbuf);
+		f2fs_put_page(cpage, 1);
+	}
+out:
+	kfree(rbuf);
+	if (err)
+		SetPageError(page);
+	unlock_page(page);
+	return err;
+}
+
+int f2fs_read_cluster_pages(struct address_space *mapping,
+			struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	unsigned page_idx;
+
+	for (page_idx = 0; page_idx < nr_pages; page_idx++) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+
+		list_del(&page->lru);
+		/* an earlier cluster may have read this page in already */
+		if (!add_to_page_cache_lru(page, mapping, page->index,
+							GFP_KERNEL))
+			f2fs_read_cluster(inode, page);
+		page_cache_release(page);
+	}
+	return 0;
+}
+
+/* Return the locked and up-to-date page at @index of a compressed file. */
+struct page *f2fs_get_cluster_page(struct inode *inode, pgoff_t index)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct page *page;
+	int err;
+
+repeat:
+	page = grab_cache_page(mapping, index);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+
+	if (PageUptodate(page))
+		return page;
+
+	err = f2fs_read_cluster(inode, page);
+	if (err) {
+		page_cache_release(page);
+		return ERR_PTR(err);
+	}
+
+	lock_page(page);
+	if (unlikely(page->mapping != mapping)) {
+		f2fs_put_page(page, 1);
+		goto repeat;
+	}
+	return page;
+}
+
+/*
+ * Compress the first @len bytes of the raw cluster into compress_cbuf.
+ * Return the # of blocks the result takes, or 0 on failure.
+ */
+static int compress_cluster(struct f2fs_sb_info *sbi, size_t len)
+{
+	struct f2fs_compress_header *hdr = (void *)sbi->compress_cbuf;
+	unsigned char *dst = sbi->compress_cbuf + sizeof(*hdr);
+	size_t clen, csize;
+	int ret;
+
+	switch (sbi->compress_algorithm) {
+	case F2FS_COMPRESS_LZ4:
+		ret = lz4_compress(sbi->compress_rbuf, len, dst, &clen,
+							sbi->compress_wrkmem);
+		break;
+	default:
+		ret = lzo1x_1_compress(sbi->compress_rbuf, len, dst, &clen,
+							sbi->compress_wrkmem);
+		if (ret != LZO_E_OK)
+			ret = -EIO;
+		break;
+	}
+	if (ret)
+		return 0;
+
+	hdr->clen = cpu_to_le32(clen);
+	hdr->algorithm = cpu_to_le32(sbi->compress_algorithm);
+
+	csize = sizeof(*hdr) + clen;
+	memset(sbi->compress_cbuf + csize, 0,
+			round_up(csize, PAGE_CACHE_SIZE) - csize);
+	return DIV_ROUND_UP(csize, PAGE_CACHE_SIZE);
+}
+
+/* Point the current slot of @dn at @blkaddr, releasing what it had. */
+static void release_cluster_slot(struct dnode_of_data *dn, block_t blkaddr)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dn->inode);
+	block_t old_blkaddr = dn->data_blkaddr;
+
+	if (old_blkaddr == blkaddr)
+		return;
+
+	if (old_blkaddr != NULL_ADDR && old_blkaddr != COMPRESS_ADDR) {
+		invalidate_blocks(sbi, old_blkaddr);
+		dec_valid_block_count(sbi, dn->inode, 1);
+	}
+	update_extent_cache(blkaddr, dn);
+	dn->data_blkaddr = blkaddr;
+}
+
+static void set_cluster_slot(struct dnode_of_data *dn, unsigned int ofs,
+								int i)
+{
+	dn->ofs_in_node = ofs + i;
+	dn->data_blkaddr = datablock_addr(dn->node_page, dn->ofs_in_node);
+}
+
+/* Make sure the slots [from, to) have a block accounted to them. */
+static int reserve_cluster_slots(struct dnode_of_data *dn, unsigned int ofs,
+							int from, int to)
+{
+	int i, err;
+
+	for (i = from; i < to; i++) {
+		set_cluster_slot(dn, ofs, i);
+		if (dn->data_blkaddr != NULL_ADDR &&
+				dn->data_blkaddr != COMPRESS_ADDR)
+			continue;
+		err = reserve_new_block(dn);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static void start_cluster_writeback(struct inode *inode, struct page **pages,
+								int nr_pages)
+{
+	int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		if (clear_page_dirty_for_io(pages[i]))
+			inode_dec_dirty_pages(inode);
+		set_page_writeback(pages[i]);
+	}
+}
+
+static struct cluster_io *alloc_cluster_io(struct page **pages, int nr_pages,
+				struct page **cpages, int nr_cblocks)
+{
+	struct cluster_io *cio;
+	int i;
+
+	cio = kmalloc(sizeof(*cio), GFP_NOFS);
+	if (!cio)
+		return NULL;
+
+	for (i = 0; i < nr_cblocks; i++) {
+		cpages[i] = alloc_page(GFP_NOFS);
+		if (!cpages[i])
+			goto fail;
+		SetPagePrivate(cpages[i]);
+		set_page_private(cpages[i], (unsigned long)cio);
+	}
+
+	memcpy(cio->pages, pages, nr_pages * sizeof(struct page *));
+	cio->nr_pages = nr_pages;
+	atomic_set(&cio->pending, nr_cblocks);
+	return cio;
+fail:
+	while (--i >= 0) {
+		ClearPagePrivate(cpages[i]);
+		__free_page(cpages[i]);
+	}
+	kfree(cio);
+	return NULL;
+}
+
+/* Called from the write end_io for the pages allocated above. */
+void f2fs_end_cluster_page(struct page *cpage, int err)
+{
+	struct cluster_io *cio = (struct cluster_io *)page_private(cpage);
+	int i;
+
+	if (unlikely(err)) {
+		for (i = 0; i < cio->nr_pages; i++) {
+			set_page_dirty(cio->pages[i]);
+			set_bit(AS_EIO, &cio->pages[i]->mapping->flags);
+		}
+	}
+
+	if (atomic_dec_and_test(&cio->pending)) {
+		for (i = 0; i < cio->nr_pages; i++)
+			end_page_writeback(cio->pages[i]);
+		kfree(cio);
+	}
+
+	set_page_private(cpage, 0);
+	ClearPagePrivate(cpage);
+	__free_page(cpage);
+}
+
+/*
+ * Write the cluster starting at @start. The caller holds f2fs_lock_op and
+ * the locks of all the cluster pages below i_size, passed in @pages.
+ */
+static int write_cluster(struct inode *inode, struct page *page,
+			pgoff_t start, struct page **pages, int nr_pages,
+			struct f2fs_io_info *fio)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct page *cpages[F2FS_CLUSTER_PAGES];
+	struct cluster_io *cio = NULL;
+	struct dnode_of_data dn;
+	block_t blkaddr[F2FS_CLUSTER_PAGES];
+	block_t new_blkaddr;
+	unsigned int ofs;
+	bool read = false;
+	size_t len;
+	int i, nr_cblocks, err;
+
+	for (i = 0; i < nr_pages; i++)
+		f2fs_wait_on_page_writeback(pages[i], DATA);
+
+	mutex_lock(&sbi->compress_mutex);
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		goto out;
+	ofs = dn.ofs_in_node;
+
+	/* pages never read in take their data from the old cluster */
+	for (i = 0; i < nr_pages; i++) {
+		if (PageUptodate(pages[i]))
+			continue;
+		if (!read) {
+			int j;
+
+			for (j = 0; j < F2FS_CLUSTER_PAGES; j++)
+				blkaddr[j] = datablock_addr(dn.node_page,
+								ofs + j);
+			err = read_cluster(sbi, blkaddr, sbi->compress_rbuf);
+			if (err)
+				goto put_out;
+			read = true;
+		}
+		fill_cluster_page(pages[i], sbi->compress_rbuf);
+	}
+
+	for (i = 0; i < nr_pages; i++) {
+		void *kaddr = kmap_atomic(pages[i]);
+
+		memcpy(sbi->compress_rbuf + (i << PAGE_CACHE_SHIFT), kaddr,
+							PAGE_CACHE_SIZE);
+		kunmap_atomic(kaddr);
+	}
+	len = min_t(loff_t, i_size_read(inode) -
+			((loff_t)start << PAGE_CACHE_SHIFT), F2FS_CLUSTER_SIZE);
+	memset(sbi->compress_rbuf + len, 0, F2FS_CLUSTER_SIZE - len);
+
+	nr_cblocks = compress_cluster(sbi, len);
+	if (nr_cblocks && nr_cblocks < nr_pages) {
+		err = reserve_cluster_slots(&dn, ofs, 1, nr_cblocks + 1);
+		if (err)
+			goto put_out;
+		cio = alloc_cluster_io(pages, nr_pages, cpages, nr_cblocks);
+	}
+
+	if (!cio) {
+		/* no gain, or no memory: write the pages as they are */
+		err = reserve_cluster_slots(&dn, ofs, 0, nr_pages);
+		if (err)
+			goto put_out;
+
+		start_cluster_writeback(inode, pages, nr_pages);
+		for (i = 0; i < nr_pages; i++) {
+			set_cluster_slot(&dn, ofs, i);
+			write_data_page(pages[i], &dn, &new_blkaddr, fio);
+			update_extent_cache(new_blkaddr, &dn);
+		}
+		for (; i < F2FS_CLUSTER_PAGES; i++) {
+			set_cluster_slot(&dn, ofs, i);
+			release_cluster_slot(&dn, NULL_ADDR);
+		}
+		goto done;
+	}
+
+	for (i = 0; i < nr_cblocks; i++) {
+		void *kaddr = page_address(cpages[i]);
+
+		memcpy(kaddr, sbi->compress_cbuf + (i << PAGE_CACHE_SHIFT),
+							PAGE_CACHE_SIZE);
+	}
+
+	start_cluster_writeback(inode, pages, nr_pages);
+
+	set_cluster_slot(&dn, ofs, 0);
+	release_cluster_slot(&dn, COMPRESS_ADDR);
+	for (i = 1; i <= nr_cblocks; i++) {
+		set_cluster_slot(&dn, ofs, i);
+		write_cluster_page(page, cpages[i - 1], &dn, &new_blkaddr, fio);
+		update_extent_cache(new_blkaddr, &dn);
+	}
+	for (; i < F2FS_CLUSTER_PAGES; i++) {
+		set_cluster_slot(&dn, ofs, i);
+		release_cluster_slot(&dn, NULL_ADDR);
+	}
+done:
+	sync_inode_page(&dn);
+	set_inode_flag(F2FS_I(inode), FI_APPEND_WRITE);
+put_out:
+	f2fs_put_dnode(&dn);
+out:
+	mutex_unlock(&sbi->compress_mutex);
+	return err;
+}
+
+/*
+ * ->writepage for compressed files, called under f2fs_lock_op with @page
+ * locked. The other pages of the cluster are only try-locked, so -EAGAIN
+ * asks the caller to redirty @page and come back later.
+ */
+int f2fs_write_cluster(struct page *page, struct f2fs_io_info *fio)
+{
+	struct inode *inode = page->mapping->host;
+	struct address_space *mapping = inode->i_mapping;
+	struct page *pages[F2FS_CLUSTER_PAGES] = { NULL, };
+	pgoff_t start = cluster_start(page->index);
+	int i, nr_pages, err = 0;
+
+	if (!cluster_in_dnode(inode, start))
+		return do_write_data_page(page, fio);
+
+	/* raced with truncate */
+	nr_pages = cluster_nr_pages(inode, start);
+	if (!nr_pages)
+		return 0;
+	for (i = 0; i < nr_pages; i++) {
+		if (start + i == page->index) {
+			pages[i] = page;
+			continue;
+		}
+		pages[i] = grab_cache_page_nowait(mapping, start + i);
+		if (!pages[i]) {
+			err = -EAGAIN;
+			goto out;
+		}
+	}
+
+	err = write_cluster(inode, page, start, pages, nr_pages, fio);
+out:
+	for (i = 0; i < nr_pages; i++)
+		if (pages[i] && pages[i] != page)
+			f2fs_put_page(pages[i], 1);
+	return err;
+}
+
+/*
+ * Truncating to @from inside a compressed cluster would leave its tail in
+ * the compressed blocks, so write the cluster again before blocks are freed.
+ */
+int f2fs_truncate_cluster(struct inode *inode, u64 from)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct page *pages[F2FS_CLUSTER_PAGES] = { NULL, };
+	struct f2fs_io_info fio = {
+		.type = DATA,
+		.rw = WRITE,
+	};
+	pgoff_t start = cluster_start(from >> PAGE_CACHE_SHIFT);
+	block_t blkaddr[F2FS_CLUSTER_PAGES];
+	int i, nr_pages, err;
+
+	if (!(from & (F2FS_CLUSTER_SIZE - 1)) ||
+				!cluster_in_dnode(inode, start))
+		return 0;
+
+	err = lookup_cluster(inode, start, blkaddr);
+	if (err || blkaddr[0] != COMPRESS_ADDR)
+		return err;
+
+	nr_pages = cluster_nr_pages(inode, start);
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = grab_cache_page(inode->i_mapping, start + i);
+		if (!pages[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	f2fs_lock_op(sbi);
+	err = write_cluster(inode, pages[0], start, pages, nr_pages, &fio);
+	f2fs_unlock_op(sbi);
+out:
+	for (i = 0; i < nr_pages; i++)
+		if (pages[i])
+			f2fs_put_page(pages[i], 1);
+	return err;
+}
+
+int build_compress_manager(struct f2fs_sb_info *sbi)
+{
+	mutex_init(&sbi->compress_mutex);
+
+	sbi->compress_wrkmem = vmalloc(F2FS_COMPRESS_WRKMEM);
+	sbi->compress_rbuf = vmalloc(F2FS_CLUSTER_SIZE);
+	sbi->compress_cbuf = vmalloc(round_up(F2FS_COMPRESS_BOUND,
+							PAGE_CACHE_SIZE));
+	if (!sbi->compress_wrkmem || !sbi->compress_rbuf ||
+					!sbi->compress_cbuf) {
+		destroy_compress_manager(sbi);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void destroy_compress_manager(struct f2fs_sb_info *sbi)
+{
+	vfree(sbi->compress_wrkmem);
+	vfree(sbi->compress_rbuf);
+	vfree(sbi->compress_cbuf);
+	sbi->compress_wrkmem = NULL;
+	sbi->compress_rbuf = NULL;
+	sbi->compress_cbuf = NULL;
+}
@@ -52,6 +52,15 @@ static void f2fs_write_end_io(struct bio *bio, int err)
 	bio_for_each_segment_all(bvec, bio, i) {
 		struct page *page = bvec->bv_page;
 
+		/* a private page holding part of a compressed cluster */
+		if (!page->mapping) {
+			f2fs_end_cluster_page(page, err);
+			if (unlikely(err))
+				f2fs_stop_checkpoint(sbi);
+			dec_page_count(sbi, F2FS_WRITEBACK);
+			continue;
+		}
+
 		if (unlikely(err)) {
 			set_page_dirty(page);
 			set_bit(AS_EIO, &page->mapping->flags);
@@ -382,6 +391,13 @@ struct page *find_data_page(struct inode *inode, pgoff_t index, bool sync)
 		return page;
 	f2fs_put_page(page, 0);
 
+	if (f2fs_compressed_file(inode)) {
+		page = f2fs_get_cluster_page(inode, index);
+		if (!IS_ERR(page))
+			unlock_page(page);
+		return page;
+	}
+
 	set_new_dnode(&dn, inode, NULL, NULL, 0);
 	err = get_dnode_of_data(&dn, index, LOOKUP_NODE);
 	if (err)
@@ -431,6 +447,8 @@ struct page *get_lock_data_page(struct inode *inode, pgoff_t index)
 	struct page *page;
 	int err;
 
+	if (f2fs_compressed_file(inode))
+		return f2fs_get_cluster_page(inode, index);
 repeat:
 	page = grab_cache_page(mapping, index);
 	if (!page)
@@ -709,6 +727,10 @@ static int get_data_block_fiemap(struct inode *inode, sector_t iblock,
 int f2fs_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 		u64 start, u64 len)
 {
+	/* compressed clusters have no block mapping to report */
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	return generic_block_fiemap(inode, fieinfo,
 				start, len, get_data_block_fiemap);
 }
@@ -723,8 +745,12 @@ static int f2fs_read_data_page(struct file *file, struct page *page)
 	/* If the file has inline data, try to read it directly */
 	if (f2fs_has_inline_data(inode))
 		ret = f2fs_read_inline_data(inode, page);
-	if (ret == -EAGAIN)
-		ret = mpage_readpage(page, get_data_block);
+	if (ret == -EAGAIN) {
+		if (f2fs_compressed_file(inode))
+			ret = f2fs_read_cluster(inode, page);
+		else
+			ret = mpage_readpage(page, get_data_block);
+	}
 
 	return ret;
 }
@@ -739,6 +765,9 @@ static int f2fs_read_data_pages(struct file *file,
 	if (f2fs_has_inline_data(inode))
 		return 0;
 
+	if (f2fs_compressed_file(inode))
+		return f2fs_read_cluster_pages(mapping, pages, nr_pages);
+
 	return mpage_readpages(mapping, pages, nr_pages, get_data_block);
 }
 
@@ -839,8 +868,12 @@ write:
 	f2fs_lock_op(sbi);
 	if (f2fs_has_inline_data(inode))
 		err = f2fs_write_inline_data(inode, page);
-	if (err == -EAGAIN)
-		err = do_write_data_page(page, &fio);
+	if (err == -EAGAIN) {
+		if (f2fs_compressed_file(inode))
+			err = f2fs_write_cluster(page, &fio);
+		else
+			err = do_write_data_page(page, &fio);
+	}
 	f2fs_unlock_op(sbi);
 done:
 	if (err && err != -ENOENT)
@@ -999,7 +1032,19 @@ put_next:
 		goto out;
 	}
 
-	if (dn.data_blkaddr == NEW_ADDR) {
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_read_cluster(inode, page);
+		if (err) {
+			page_cache_release(page);
+			goto fail;
+		}
+
+		lock_page(page);
+		if (unlikely(page->mapping != mapping)) {
+			f2fs_put_page(page, 1);
+			goto repeat;
+		}
+	} else if (dn.data_blkaddr == NEW_ADDR) {
 		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
 	} else {
 		err = f2fs_submit_page_bio(sbi, page, dn.data_blkaddr,
@@ -1080,6 +1125,10 @@ static ssize_t f2fs_direct_IO(int rw, struct kiocb *iocb,
 	size_t count = iov_iter_count(iter);
 	int err;
 
+	/* fall back to buffered IO, which goes through the clusters */
+	if (f2fs_compressed_file(inode))
+		return 0;
+
 	/* we don't need to use inline_data strictly */
 	if (f2fs_has_inline_data(inode)) {
 		err = f2fs_convert_inline_inode(inode);
@@ -1151,6 +1200,9 @@ static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 {
 	struct inode *inode = mapping->host;
 
+	if (f2fs_compressed_file(inode))
+		return 0;
+
 	/* we don't need to use inline_data strictly */
 	if (f2fs_has_inline_data(inode)) {
 		int err = f2fs_convert_inline_inode(inode);
@@ -50,6 +50,7 @@
 #define F2FS_MOUNT_FLUSH_MERGE		0x00000400
 #define F2FS_MOUNT_NOBARRIER		0x00000800
 #define F2FS_MOUNT_FASTBOOT		0x00001000
+#define F2FS_MOUNT_PCPU_LOGS		0x00002000
 
 #define clear_opt(sbi, option)	(sbi->mount_opt.opt &= ~F2FS_MOUNT_##option)
 #define set_opt(sbi, option)	(sbi->mount_opt.opt |= F2FS_MOUNT_##option)
@@ -419,6 +420,7 @@ struct f2fs_sm_info {
 	struct free_segmap_info *free_info;	/* free segment information */
 	struct dirty_seglist_info *dirty_info;	/* dirty segment information */
 	struct curseg_info *curseg_array;	/* active segment information */
+	unsigned int nr_pcpu_logs;		/* extra hot/warm data logs each */
 
 	block_t seg0_blkaddr;		/* block address of 0'th segment */
 	block_t main_blkaddr;		/* start block address of main area */
@@ -574,13 +576,27 @@ struct f2fs_sb_info {
 	struct f2fs_mount_info mount_opt;	/* mount options */
 
 	/* for cleaning operations */
-	struct mutex gc_mutex;			/* mutex for GC */
+	struct rw_semaphore gc_lock;		/*
+						 * exclusive for FG_GC and
+						 * checkpoints, shared for
+						 * parallel BG_GC workers
+						 */
 	struct f2fs_gc_kthread	*gc_thread;	/* GC thread */
+	unsigned int gc_threads;		/* # of background GC threads */
 	unsigned int cur_victim_sec;		/* current victim section num */
 
 	/* maximum # of trials to find a victim segment for SSR and GC */
 	unsigned int max_victim_search;
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	/* for compressed clusters */
+	struct mutex compress_mutex;		/* protects the buffers below */
+	void *compress_wrkmem;			/* compressor working memory */
+	unsigned char *compress_rbuf;		/* raw cluster data */
+	unsigned char *compress_cbuf;		/* compressed cluster data */
+	unsigned int compress_algorithm;	/* used for new clusters */
+#endif
+
 	/*
 	 * for stat information.
 	 * one is for the LFS mode, and the other is for the SSR mode.
@@ -1220,6 +1236,16 @@ static inline bool f2fs_is_volatile_file(struct inode *inode)
 	return is_inode_flag_set(F2FS_I(inode), FI_VOLATILE_FILE);
 }
 
+static inline bool f2fs_compressed_file(struct inode *inode)
+{
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	return S_ISREG(inode->i_mode) &&
+		(F2FS_I(inode)->i_flags & FS_COMPR_FL);
+#else
+	return false;
+#endif
+}
+
 static inline void *inline_data_addr(struct page *page)
 {
 	struct f2fs_inode *ri = F2FS_INODE(page);
@@ -1403,6 +1429,7 @@ void release_discard_addrs(struct f2fs_sb_info *);
 void discard_next_dnode(struct f2fs_sb_info *, block_t);
 int npages_for_summary_flush(struct f2fs_sb_info *);
 void allocate_new_segments(struct f2fs_sb_info *);
+void close_pcpu_logs(struct f2fs_sb_info *);
 int f2fs_trim_fs(struct f2fs_sb_info *, struct fstrim_range *);
 struct page *get_sum_page(struct f2fs_sb_info *, unsigned int);
 void write_meta_page(struct f2fs_sb_info *, struct page *);
@@ -1410,6 +1437,8 @@ void write_node_page(struct f2fs_sb_info *, struct page *,
 		struct f2fs_io_info *, unsigned int, block_t, block_t *);
 void write_data_page(struct page *, struct dnode_of_data *, block_t *,
 					struct f2fs_io_info *);
+void write_cluster_page(struct page *, struct page *, struct dnode_of_data *,
+					block_t *, struct f2fs_io_info *);
 void rewrite_data_page(struct page *, block_t, struct f2fs_io_info *);
 void recover_data_page(struct f2fs_sb_info *, struct page *,
 				struct f2fs_summary *, block_t, block_t);
@@ -1476,6 +1505,7 @@ int start_gc_thread(struct f2fs_sb_info *);
 void stop_gc_thread(struct f2fs_sb_info *);
 block_t start_bidx_of_node(unsigned int, struct f2fs_inode_info *);
 int f2fs_gc(struct f2fs_sb_info *);
+int f2fs_gc_background(struct f2fs_sb_info *);
 void build_gc_manager(struct f2fs_sb_info *);
 int __init create_gc_caches(void);
 void destroy_gc_caches(void);
@@ -1620,6 +1650,52 @@ extern const struct inode_operations f2fs_dir_inode_operations;
 extern const struct inode_operations f2fs_symlink_inode_operations;
 extern const struct inode_operations f2fs_special_inode_operations;
 
+/*
+ * compress.c
+ */
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+int f2fs_read_cluster(struct inode *, struct page *);
+int f2fs_read_cluster_pages(struct address_space *, struct list_head *,
+							unsigned);
+struct page *f2fs_get_cluster_page(struct inode *, pgoff_t);
+int f2fs_write_cluster(struct page *, struct f2fs_io_info *);
+int f2fs_truncate_cluster(struct inode *, u64);
+void f2fs_end_cluster_page(struct page *, int);
+int build_compress_manager(struct f2fs_sb_info *);
+void destroy_compress_manager(struct f2fs_sb_info *);
+#else
+static inline int f2fs_read_cluster(struct inode *inode, struct page *page)
+{
+	unlock_page(page);
+	return -EOPNOTSUPP;
+}
+static inline int f2fs_read_cluster_pages(struct address_space *mapping,
+				struct list_head *pages, unsigned nr_pages)
+{
+	return -EOPNOTSUPP;
+}
+static inline struct page *f2fs_get_cluster_page(struct inode *inode,
+							pgoff_t index)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
+static inline int f2fs_write_cluster(struct page *page,
+					struct f2fs_io_info *fio)
+{
+	return -EOPNOTSUPP;
+}
+static inline int f2fs_truncate_cluster(struct inode *inode, u64 from)
+{
+	return 0;
+}
+static inline void f2fs_end_cluster_page(struct page *page, int err) { }
+static inline int build_compress_manager(struct f2fs_sb_info *sbi)
+{
+	return 0;
+}
+static inline void destroy_compress_manager(struct f2fs_sb_info *sbi) { }
+#endif
+
 /*
  * inline.c
  */
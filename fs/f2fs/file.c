@@ -319,8 +319,9 @@ static loff_t f2fs_seek_block(struct file *file, loff_t offset, int whence)
 	if (offset >= isize)
 		goto fail;
 
-	/* handle inline data case */
-	if (f2fs_has_inline_data(inode) || f2fs_has_inline_dentry(inode)) {
+	/* handle inline data and compressed cluster cases */
+	if (f2fs_has_inline_data(inode) || f2fs_has_inline_dentry(inode) ||
+					f2fs_compressed_file(inode)) {
 		if (whence == SEEK_HOLE)
 			data_ofs = isize;
 		goto found;
@@ -428,6 +429,11 @@ int truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 			continue;
 
 		update_extent_cache(NULL_ADDR, dn);
+
+		/* the marker of a compressed cluster owns no block */
+		if (blkaddr == COMPRESS_ADDR)
+			continue;
+
 		invalidate_blocks(sbi, blkaddr);
 		nr_free++;
 	}
@@ -484,6 +490,12 @@ int truncate_blocks(struct inode *inode, u64 from, bool lock)
 
 	trace_f2fs_truncate_blocks_enter(inode, from);
 
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_truncate_cluster(inode, from);
+		if (err)
+			goto out_trace;
+	}
+
 	free_from = (pgoff_t)
 		((from + blocksize - 1) >> (sbi->log_blocksize));
 
@@ -529,7 +541,7 @@ out:
 	/* lastly zero out the first data page */
 	if (!err)
 		err = truncate_partial_data_page(inode, from);
-
+out_trace:
 	trace_f2fs_truncate_blocks_exit(inode, err);
 	return err;
 }
@@ -818,6 +830,10 @@ static long f2fs_fallocate(struct file *file, int mode,
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
 		return -EOPNOTSUPP;
 
+	/* blocks of a compressed cluster can't be reserved or freed alone */
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	mutex_lock(&inode->i_mutex);
 
 	if (mode & FALLOC_FL_PUNCH_HOLE)
@@ -849,6 +865,32 @@ static inline __u32 f2fs_mask_flags(umode_t mode, __u32 flags)
 		return flags & F2FS_OTHER_FLMASK;
 }
 
+/*
+ * The layout of a file's clusters depends on the flag, so it can only be
+ * changed while the file has no data.
+ */
+static int f2fs_set_compress_flag(struct inode *inode, bool compress)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	if (!IS_ENABLED(CONFIG_F2FS_FS_COMPRESSION))
+		return -EOPNOTSUPP;
+	if (i_size_read(inode) || f2fs_is_atomic_file(inode) ||
+					f2fs_is_volatile_file(inode))
+		return -EINVAL;
+
+	/* the extent cache can't describe compressed clusters */
+	if (compress) {
+		set_inode_flag(fi, FI_NO_EXTENT);
+		write_lock(&fi->ext.ext_lock);
+		fi->ext.len = 0;
+		write_unlock(&fi->ext.ext_lock);
+	} else {
+		clear_inode_flag(fi, FI_NO_EXTENT);
+	}
+	return 0;
+}
+
 static int f2fs_ioc_getflags(struct file *filp, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -893,6 +935,14 @@ static int f2fs_ioc_setflags(struct file *filp, unsigned long arg)
 		}
 	}
 
+	if (S_ISREG(inode->i_mode) && ((flags ^ oldflags) & FS_COMPR_FL)) {
+		ret = f2fs_set_compress_flag(inode, flags & FS_COMPR_FL);
+		if (ret) {
+			mutex_unlock(&inode->i_mutex);
+			goto out;
+		}
+	}
+
 	flags = flags & FS_FL_USER_MODIFIABLE;
 	flags |= oldflags & ~FS_FL_USER_MODIFIABLE;
 	fi->i_flags = flags;
@@ -914,6 +964,9 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
+	if (f2fs_compressed_file(inode))
+		return -EINVAL;
+
 	f2fs_balance_fs(sbi);
 
 	set_inode_flag(F2FS_I(inode), FI_ATOMIC_FILE);
@@ -959,6 +1012,9 @@ static int f2fs_ioc_start_volatile_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
+	if (f2fs_compressed_file(inode))
+		return -EINVAL;
+
 	set_inode_flag(F2FS_I(inode), FI_VOLATILE_FILE);
 
 	return f2fs_convert_inline_inode(inode);
@@ -63,12 +63,12 @@ static int gc_thread_func(void *data)
 		 * invalidated soon after by user update or deletion.
 		 * So, I'd like to wait some time to collect dirty segments.
 		 */
-		if (!mutex_trylock(&sbi->gc_mutex))
+		if (!down_write_trylock(&sbi->gc_lock))
 			continue;
 
 		if (!is_idle(sbi)) {
 			wait_ms = increase_sleep_time(gc_th, wait_ms);
-			mutex_unlock(&sbi->gc_mutex);
+			up_write(&sbi->gc_lock);
 			continue;
 		}
 
@@ -90,9 +90,66 @@ static int gc_thread_func(void *data)
 	return 0;
 }
 
+/*
+ * Additional background GC workers. They only ever clean a single section
+ * at a time in BG_GC mode and share gc_lock with each other, so on a large
+ * device several dirty sections are migrated at once. Whenever free sections
+ * run short, cleaning is left to FG_GC in the main GC thread or in
+ * f2fs_balance_fs(), which excludes these workers.
+ */
+static int gc_worker_func(void *data)
+{
+	struct f2fs_sb_info *sbi = data;
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	wait_queue_head_t *wq = &sbi->gc_thread->gc_wait_queue_head;
+	long wait_ms;
+
+	wait_ms = gc_th->min_sleep_time;
+
+	do {
+		if (try_to_freeze())
+			continue;
+		else
+			wait_event_interruptible_timeout(*wq,
+						kthread_should_stop(),
+						msecs_to_jiffies(wait_ms));
+		if (kthread_should_stop())
+			break;
+
+		if (sbi->sb->s_writers.frozen >= SB_FREEZE_WRITE) {
+			wait_ms = increase_sleep_time(gc_th, wait_ms);
+			continue;
+		}
+
+		if (!is_idle(sbi) || !has_enough_invalid_blocks(sbi)) {
+			wait_ms = increase_sleep_time(gc_th, wait_ms);
+			continue;
+		}
+
+		if (!down_read_trylock(&sbi->gc_lock))
+			continue;
+
+		wait_ms = decrease_sleep_time(gc_th, wait_ms);
+		stat_inc_bggc_count(sbi);
+
+		/* if return value is not zero, no victim was selected */
+		if (f2fs_gc_background(sbi))
+			wait_ms = gc_th->no_gc_sleep_time;
+
+	} while (!kthread_should_stop());
+	return 0;
+}
+
+static void stop_gc_workers(struct f2fs_gc_kthread *gc_th)
+{
+	while (gc_th->nr_gc_workers)
+		kthread_stop(gc_th->gc_workers[--gc_th->nr_gc_workers]);
+}
+
 int start_gc_thread(struct f2fs_sb_info *sbi)
 {
 	struct f2fs_gc_kthread *gc_th;
+	struct task_struct *task;
 	dev_t dev = sbi->sb->s_bdev->bd_dev;
 	int err = 0;
 
@@ -107,6 +164,7 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->no_gc_sleep_time = DEF_GC_THREAD_NOGC_SLEEP_TIME;
 
 	gc_th->gc_idle = 0;
+	gc_th->nr_gc_workers = 0;
 
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
@@ -116,6 +174,18 @@ int start_gc_thread(struct f2fs_sb_info *sbi)
 		err = PTR_ERR(gc_th->f2fs_gc_task);
 		kfree(gc_th);
 		sbi->gc_thread = NULL;
+		goto out;
+	}
+
+	while (gc_th->nr_gc_workers < sbi->gc_threads - 1) {
+		task = kthread_run(gc_worker_func, sbi, "f2fs_gc-%u:%u-%u",
+				MAJOR(dev), MINOR(dev), gc_th->nr_gc_workers + 1);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			stop_gc_thread(sbi);
+			goto out;
+		}
+		gc_th->gc_workers[gc_th->nr_gc_workers++] = task;
 	}
 out:
 	return err;
@@ -126,6 +196,7 @@ void stop_gc_thread(struct f2fs_sb_info *sbi)
 	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
 	if (!gc_th)
 		return;
+	stop_gc_workers(gc_th);
 	kthread_stop(gc_th->f2fs_gc_task);
 	kfree(gc_th);
 	sbi->gc_thread = NULL;
@@ -541,7 +612,10 @@ static void move_data_page(struct inode *inode, struct page *page, int gc_type)
 		if (clear_page_dirty_for_io(page))
 			inode_dec_dirty_pages(inode);
 		set_cold_data(page);
-		do_write_data_page(page, &fio);
+		if (!f2fs_compressed_file(inode))
+			do_write_data_page(page, &fio);
+		else if (f2fs_write_cluster(page, &fio) == -EAGAIN)
+			set_page_dirty(page);
 		clear_cold_data(page);
 	}
 out:
@@ -740,7 +814,47 @@ gc_more:
 	if (gc_type == FG_GC)
 		write_checkpoint(sbi, &cpc);
 stop:
-	mutex_unlock(&sbi->gc_mutex);
+	up_write(&sbi->gc_lock);
+
+	put_gc_inode(&gc_list);
+	return ret;
+}
+
+/*
+ * Clean one victim section in BG_GC mode. This is called with gc_lock held
+ * for read and releases it, so several callers can run concurrently: each
+ * of them ends up with a different victim, as background victim selection
+ * skips the sections already marked in victim_secmap. No checkpoint is
+ * written here; if free sections run short we leave the work to f2fs_gc().
+ */
+int f2fs_gc_background(struct f2fs_sb_info *sbi)
+{
+	unsigned int segno, i;
+	int ret = -1;
+	struct gc_inode_list gc_list = {
+		.ilist = LIST_HEAD_INIT(gc_list.ilist),
+		.iroot = RADIX_TREE_INIT(GFP_NOFS),
+	};
+
+	if (unlikely(!(sbi->sb->s_flags & MS_ACTIVE)))
+		goto stop;
+	if (unlikely(f2fs_cp_error(sbi)))
+		goto stop;
+	if (has_not_enough_free_secs(sbi, 0))
+		goto stop;
+
+	if (!__get_victim(sbi, &segno, BG_GC))
+		goto stop;
+	ret = 0;
+
+	if (sbi->segs_per_sec > 1)
+		ra_meta_pages(sbi, GET_SUM_BLOCK(sbi, segno), sbi->segs_per_sec,
+								META_SSA);
+
+	for (i = 0; i < sbi->segs_per_sec; i++)
+		do_garbage_collect(sbi, segno + i, &gc_list, BG_GC);
+stop:
+	up_read(&sbi->gc_lock);
 
 	put_gc_inode(&gc_list);
 	return ret;
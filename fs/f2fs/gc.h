@@ -19,6 +19,10 @@
 #define LIMIT_INVALID_BLOCK	40 /* percentage over total user space */
 #define LIMIT_FREE_BLOCK	40 /* percentage over invalid + free space */
 
+/* parallel background GC workers, including the main GC thread */
+#define DEF_GC_THREADS		1
+#define MAX_GC_THREADS		8
+
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
@@ -26,6 +30,10 @@ struct f2fs_gc_kthread {
 	struct task_struct *f2fs_gc_task;
 	wait_queue_head_t gc_wait_queue_head;
 
+	/* additional workers cleaning other sections in parallel */
+	struct task_struct *gc_workers[MAX_GC_THREADS - 1];
+	unsigned int nr_gc_workers;
+
 	/* for gc sleep time */
 	unsigned int min_sleep_time;
 	unsigned int max_sleep_time;
@@ -140,6 +140,10 @@ static int do_read_inode(struct inode *inode)
 	get_extent_info(&fi->ext, ri->i_ext);
 	get_inline_info(fi, ri);
 
+	/* compressed files don't map page indices to blocks directly */
+	if (f2fs_compressed_file(inode))
+		set_inode_flag(fi, FI_NO_EXTENT);
+
 	/* check data exist */
 	if (f2fs_has_inline_data(inode) && !f2fs_exist_data(inode))
 		err = __recover_inline_status(inode, node_page);
@@ -154,6 +154,12 @@ static void recover_inode(struct inode *inode, struct page *page)
 	inode->i_ctime.tv_nsec = le32_to_cpu(raw->i_ctime_nsec);
 	inode->i_mtime.tv_nsec = le32_to_cpu(raw->i_mtime_nsec);
 
+	/* the recovered data indices may point at compressed clusters */
+	if (le32_to_cpu(raw->i_flags) & FS_COMPR_FL) {
+		F2FS_I(inode)->i_flags |= FS_COMPR_FL;
+		set_inode_flag(F2FS_I(inode), FI_NO_EXTENT);
+	}
+
 	f2fs_msg(inode->i_sb, KERN_NOTICE, "recover_inode: ino = %x, name = %s",
 			ino_of_node(page), F2FS_INODE(page)->i_name);
 }
@@ -380,8 +386,19 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 		src = datablock_addr(dn.node_page, dn.ofs_in_node);
 		dest = datablock_addr(page, dn.ofs_in_node);
 
+		/* a cluster compressed after the checkpoint */
+		if (dest == COMPRESS_ADDR) {
+			if (src != COMPRESS_ADDR) {
+				if (src != NULL_ADDR)
+					truncate_data_blocks_range(&dn, 1);
+				update_extent_cache(COMPRESS_ADDR, &dn);
+			}
+			dn.ofs_in_node++;
+			continue;
+		}
+
 		if (src != dest && dest != NEW_ADDR && dest != NULL_ADDR) {
-			if (src == NULL_ADDR) {
+			if (src == NULL_ADDR || src == COMPRESS_ADDR) {
 				err = reserve_new_block(&dn);
 				/* We should not get -ENOSPC */
 				f2fs_bug_on(sbi, err);
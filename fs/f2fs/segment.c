@@ -280,7 +280,7 @@ void f2fs_balance_fs(struct f2fs_sb_info *sbi)
 	 * dir/node pages without enough free segments.
 	 */
 	if (has_not_enough_free_secs(sbi, 0)) {
-		mutex_lock(&sbi->gc_mutex);
+		down_write(&sbi->gc_lock);
 		f2fs_gc(sbi);
 	}
 }
@@ -856,11 +856,11 @@ skip_left:
 		if (go_left && zoneno == 0)
 			goto got_it;
 	}
-	for (i = 0; i < NR_CURSEG_TYPE; i++)
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
 		if (CURSEG_I(sbi, i)->zone == zoneno)
 			break;
 
-	if (i < NR_CURSEG_TYPE) {
+	if (i < NR_CURSEGS(sbi)) {
 		/* zone is in user, try another */
 		if (go_left)
 			hint = zoneno * sbi->secs_per_zone - 1;
@@ -891,11 +891,11 @@ static void reset_curseg(struct f2fs_sb_info *sbi, int type, int modified)
 
 	sum_footer = &(curseg->sum_blk->footer);
 	memset(sum_footer, 0, sizeof(struct summary_footer));
-	if (IS_DATASEG(type))
+	if (IS_DATASEG(curseg->seg_type))
 		SET_SUM_TYPE(sum_footer, SUM_TYPE_DATA);
-	if (IS_NODESEG(type))
+	if (IS_NODESEG(curseg->seg_type))
 		SET_SUM_TYPE(sum_footer, SUM_TYPE_NODE);
-	__set_sit_entry_type(sbi, type, curseg->segno, modified);
+	__set_sit_entry_type(sbi, curseg->seg_type, curseg->segno, modified);
 }
 
 /*
@@ -908,9 +908,16 @@ static void new_curseg(struct f2fs_sb_info *sbi, int type, bool new_sec)
 	unsigned int segno = curseg->segno;
 	int dir = ALLOC_LEFT;
 
-	write_sum_page(sbi, curseg->sum_blk,
+	/* a closed per-cpu log starts next to the default log of its type */
+	if (segno == NULL_SEGNO) {
+		segno = CURSEG_I(sbi, curseg->seg_type)->segno;
+		new_sec = true;
+	} else {
+		write_sum_page(sbi, curseg->sum_blk,
 				GET_SUM_BLOCK(sbi, segno));
-	if (type == CURSEG_WARM_DATA || type == CURSEG_COLD_DATA)
+	}
+	if (curseg->seg_type == CURSEG_WARM_DATA ||
+			curseg->seg_type == CURSEG_COLD_DATA)
 		dir = ALLOC_RIGHT;
 
 	if (test_opt(sbi, NOHEAP))
@@ -1015,7 +1022,7 @@ static void allocate_segment_by_default(struct f2fs_sb_info *sbi,
 
 	if (force)
 		new_curseg(sbi, type, true);
-	else if (type == CURSEG_WARM_NODE)
+	else if (type == CURSEG_WARM_NODE || type >= NR_CURSEG_TYPE)
 		new_curseg(sbi, type, false);
 	else if (curseg->alloc_type == LFS && is_next_segment_free(sbi, type))
 		new_curseg(sbi, type, false);
@@ -1039,6 +1046,41 @@ void allocate_new_segments(struct f2fs_sb_info *sbi)
 		SIT_I(sbi)->s_ops->allocate_segment(sbi, i, true);
 		locate_dirty_segment(sbi, old_curseg);
 	}
+	close_pcpu_logs(sbi);
+}
+
+/*
+ * Close all per-cpu data logs. Their summary blocks go to the SSA area as
+ * for any full segment and the partially written segments become ordinary
+ * dirty segments, so nothing about them needs to be recorded in the
+ * checkpoint. They are reopened by the next allocation on their CPU.
+ */
+void close_pcpu_logs(struct f2fs_sb_info *sbi)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	struct curseg_info *curseg;
+	unsigned int old_segno;
+	int i;
+
+	for (i = NR_CURSEG_TYPE; i < NR_CURSEGS(sbi); i++) {
+		curseg = CURSEG_I(sbi, i);
+
+		mutex_lock(&curseg->curseg_mutex);
+		old_segno = curseg->segno;
+		if (old_segno == NULL_SEGNO) {
+			mutex_unlock(&curseg->curseg_mutex);
+			continue;
+		}
+		mutex_lock(&sit_i->sentry_lock);
+		write_sum_page(sbi, curseg->sum_blk,
+					GET_SUM_BLOCK(sbi, old_segno));
+		curseg->segno = NULL_SEGNO;
+		curseg->zone = NULL_SEGNO;
+		curseg->next_blkoff = 0;
+		locate_dirty_segment(sbi, old_segno);
+		mutex_unlock(&sit_i->sentry_lock);
+		mutex_unlock(&curseg->curseg_mutex);
+	}
 }
 
 static const struct segment_allocation default_salloc_ops = {
@@ -1070,9 +1112,9 @@ int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range)
 	cpc.trim_minlen = range->minlen >> sbi->log_blocksize;
 
 	/* do checkpoint to issue discard commands safely */
-	mutex_lock(&sbi->gc_mutex);
+	down_write(&sbi->gc_lock);
 	write_checkpoint(sbi, &cpc);
-	mutex_unlock(&sbi->gc_mutex);
+	up_write(&sbi->gc_lock);
 out:
 	range->len = cpc.trimmed << sbi->log_blocksize;
 	return 0;
@@ -1145,17 +1187,48 @@ static int __get_segment_type(struct page *page, enum page_type p_type)
 	return __get_segment_type_6(page, p_type);
 }
 
+/*
+ * Pick the log to allocate from. Hot and warm data go to the per-cpu log of
+ * the writing CPU if there is one, so writers on different CPUs don't
+ * serialise on the same curseg_mutex. Once we are short of free sections
+ * everything goes through the default logs, which can fall back to SSR.
+ */
+static int __get_curseg_index(struct f2fs_sb_info *sbi, int type)
+{
+	unsigned int nr_logs = SM_I(sbi)->nr_pcpu_logs;
+	unsigned int slot;
+
+	if (!nr_logs || !test_opt(sbi, PCPU_LOGS))
+		return type;
+	if (type != CURSEG_HOT_DATA && type != CURSEG_WARM_DATA)
+		return type;
+	if (need_SSR(sbi))
+		return type;
+
+	slot = raw_smp_processor_id() % (nr_logs + 1);
+	if (!slot)
+		return type;
+	return NR_CURSEG_TYPE + (type - CURSEG_HOT_DATA) * nr_logs + slot - 1;
+}
+
 void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 		block_t old_blkaddr, block_t *new_blkaddr,
 		struct f2fs_summary *sum, int type)
 {
 	struct sit_info *sit_i = SIT_I(sbi);
 	struct curseg_info *curseg;
+	int idx = __get_curseg_index(sbi, type);
 
-	curseg = CURSEG_I(sbi, type);
+	curseg = CURSEG_I(sbi, idx);
 
 	mutex_lock(&curseg->curseg_mutex);
 
+	if (unlikely(curseg->segno == NULL_SEGNO)) {
+		mutex_lock(&sit_i->sentry_lock);
+		new_curseg(sbi, idx, true);
+		mutex_unlock(&sit_i->sentry_lock);
+	}
+
 	*new_blkaddr = NEXT_FREE_BLKADDR(sbi, curseg);
 
 	/*
@@ -1163,15 +1236,15 @@ void allocate_data_block(struct f2fs_sb_info *sbi, struct page *page,
 	 * because, this function updates a summary entry in the
 	 * current summary block.
 	 */
-	__add_sum_entry(sbi, type, sum);
+	__add_sum_entry(sbi, idx, sum);
 
 	mutex_lock(&sit_i->sentry_lock);
 	__refresh_next_blkoff(sbi, curseg);
 
 	stat_inc_block_count(sbi, curseg);
 
-	if (!__has_curseg_space(sbi, type))
-		sit_i->s_ops->allocate_segment(sbi, type, false);
+	if (!__has_curseg_space(sbi, idx))
+		sit_i->s_ops->allocate_segment(sbi, idx, false);
 	/*
 	 * SIT information should be updated before segment allocation,
 	 * since SSR needs latest valid block information.
@@ -1232,6 +1305,28 @@ void write_data_page(struct page *page, struct dnode_of_data *dn,
 	do_write_page(sbi, page, dn->data_blkaddr, new_blkaddr, &sum, fio);
 }
 
+/*
+ * Write @cpage, which holds part of the compressed cluster of @page, into a
+ * new block taken from the log @page would be written to.
+ */
+void write_cluster_page(struct page *page, struct page *cpage,
+		struct dnode_of_data *dn, block_t *new_blkaddr,
+		struct f2fs_io_info *fio)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dn->inode);
+	struct f2fs_summary sum;
+	struct node_info ni;
+	int type = __get_segment_type(page, fio->type);
+
+	f2fs_bug_on(sbi, dn->data_blkaddr == NULL_ADDR);
+	get_node_info(sbi, dn->nid, &ni);
+	set_summary(&sum, dn->nid, dn->ofs_in_node, ni.version);
+
+	allocate_data_block(sbi, cpage, dn->data_blkaddr, new_blkaddr,
+								&sum, type);
+	f2fs_submit_page_mbio(sbi, cpage, *new_blkaddr, fio);
+}
+
 void rewrite_data_page(struct page *page, block_t old_blkaddr,
 					struct f2fs_io_info *fio)
 {
@@ -1906,19 +2001,29 @@ static int build_curseg(struct f2fs_sb_info *sbi)
 	struct curseg_info *array;
 	int i;
 
-	array = kcalloc(NR_CURSEG_TYPE, sizeof(*array), GFP_KERNEL);
+	if (test_opt(sbi, PCPU_LOGS))
+		SM_I(sbi)->nr_pcpu_logs = min_t(unsigned int,
+				num_possible_cpus(), MAX_PCPU_LOGS) - 1;
+
+	array = kcalloc(NR_CURSEGS(sbi), sizeof(*array), GFP_KERNEL);
 	if (!array)
 		return -ENOMEM;
 
 	SM_I(sbi)->curseg_array = array;
 
-	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+	for (i = 0; i < NR_CURSEGS(sbi); i++) {
 		mutex_init(&array[i].curseg_mutex);
 		array[i].sum_blk = kzalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
 		if (!array[i].sum_blk)
 			return -ENOMEM;
 		array[i].segno = NULL_SEGNO;
+		array[i].zone = NULL_SEGNO;
 		array[i].next_blkoff = 0;
+		if (i < NR_CURSEG_TYPE)
+			array[i].seg_type = i;
+		else
+			array[i].seg_type = CURSEG_HOT_DATA +
+				(i - NR_CURSEG_TYPE) / SM_I(sbi)->nr_pcpu_logs;
 	}
 	return restore_curseg_summaries(sbi);
 }
@@ -2181,9 +2286,9 @@ static void destroy_curseg(struct f2fs_sb_info *sbi)
 
 	if (!array)
 		return;
-	SM_I(sbi)->curseg_array = NULL;
-	for (i = 0; i < NR_CURSEG_TYPE; i++)
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
 		kfree(array[i].sum_blk);
+	SM_I(sbi)->curseg_array = NULL;
 	kfree(array);
 }
 
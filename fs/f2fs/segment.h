@@ -23,27 +23,18 @@
 #define IS_DATASEG(t)	(t <= CURSEG_COLD_DATA)
 #define IS_NODESEG(t)	(t >= CURSEG_HOT_NODE)
 
-#define IS_CURSEG(sbi, seg)						\
-	((seg == CURSEG_I(sbi, CURSEG_HOT_DATA)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_WARM_DATA)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_COLD_DATA)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_HOT_NODE)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_WARM_NODE)->segno) ||	\
-	 (seg == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno))
-
-#define IS_CURSEC(sbi, secno)						\
-	((secno == CURSEG_I(sbi, CURSEG_HOT_DATA)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_WARM_DATA)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_COLD_DATA)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_HOT_NODE)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_WARM_NODE)->segno /		\
-	  sbi->segs_per_sec) ||	\
-	 (secno == CURSEG_I(sbi, CURSEG_COLD_NODE)->segno /		\
-	  sbi->segs_per_sec))	\
+#define IS_CURSEG(sbi, seg)	__is_curseg(sbi, seg)
+#define IS_CURSEC(sbi, secno)	__is_cursec(sbi, secno)
+
+/*
+ * With the pcpu_logs mount option, hot and warm data get up to
+ * MAX_PCPU_LOGS logging heads each, picked by the writing CPU. The
+ * additional heads live behind the NR_CURSEG_TYPE default logs in
+ * curseg_array and are never recorded in a checkpoint: they are closed
+ * before each checkpoint and reopened on the next allocation.
+ */
+#define MAX_PCPU_LOGS		8
+#define NR_CURSEGS(sbi)		(NR_CURSEG_TYPE + 2 * SM_I(sbi)->nr_pcpu_logs)
 
 #define MAIN_BLKADDR(sbi)	(SM_I(sbi)->main_blkaddr)
 #define SEG0_BLKADDR(sbi)	(SM_I(sbi)->seg0_blkaddr)
@@ -243,6 +234,7 @@ struct victim_selection {
 struct curseg_info {
 	struct mutex curseg_mutex;		/* lock for consistency */
 	struct f2fs_summary_block *sum_blk;	/* cached summary block */
+	unsigned char seg_type;			/* segment type like CURSEG_XXX_TYPE */
 	unsigned char alloc_type;		/* current allocation type */
 	unsigned int segno;			/* current segment number */
 	unsigned short next_blkoff;		/* next block offset to write */
@@ -264,6 +256,29 @@ static inline struct curseg_info *CURSEG_I(struct f2fs_sb_info *sbi, int type)
 	return (struct curseg_info *)(SM_I(sbi)->curseg_array + type);
 }
 
+static inline bool __is_curseg(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEGS(sbi); i++)
+		if (segno == CURSEG_I(sbi, i)->segno)
+			return true;
+	return false;
+}
+
+static inline bool __is_cursec(struct f2fs_sb_info *sbi, unsigned int secno)
+{
+	unsigned int segno;
+	int i;
+
+	for (i = 0; i < NR_CURSEGS(sbi); i++) {
+		segno = CURSEG_I(sbi, i)->segno;
+		if (segno != NULL_SEGNO && secno == segno / sbi->segs_per_sec)
+			return true;
+	}
+	return false;
+}
+
 static inline struct seg_entry *get_seg_entry(struct f2fs_sb_info *sbi,
 						unsigned int segno)
 {
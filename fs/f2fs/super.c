@@ -55,6 +55,9 @@ enum {
 	Opt_flush_merge,
 	Opt_nobarrier,
 	Opt_fastboot,
+	Opt_gc_threads,
+	Opt_pcpu_logs,
+	Opt_compress_algorithm,
 	Opt_err,
 };
 
@@ -75,6 +78,9 @@ static match_table_t f2fs_tokens = {
 	{Opt_flush_merge, "flush_merge"},
 	{Opt_nobarrier, "nobarrier"},
 	{Opt_fastboot, "fastboot"},
+	{Opt_gc_threads, "gc_threads=%u"},
+	{Opt_pcpu_logs, "pcpu_logs"},
+	{Opt_compress_algorithm, "compress_algorithm=%s"},
 	{Opt_err, NULL},
 };
 
@@ -356,6 +362,38 @@ static int parse_options(struct super_block *sb, char *options)
 		case Opt_fastboot:
 			set_opt(sbi, FASTBOOT);
 			break;
+		case Opt_gc_threads:
+			if (args->from && match_int(args, &arg))
+				return -EINVAL;
+			if (arg < 1 || arg > MAX_GC_THREADS)
+				return -EINVAL;
+			sbi->gc_threads = arg;
+			break;
+		case Opt_pcpu_logs:
+			set_opt(sbi, PCPU_LOGS);
+			break;
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+		case Opt_compress_algorithm:
+			name = match_strdup(&args[0]);
+
+			if (!name)
+				return -ENOMEM;
+			if (strlen(name) == 3 && !strncmp(name, "lzo", 3))
+				sbi->compress_algorithm = F2FS_COMPRESS_LZO;
+			else if (strlen(name) == 3 && !strncmp(name, "lz4", 3))
+				sbi->compress_algorithm = F2FS_COMPRESS_LZ4;
+			else {
+				kfree(name);
+				return -EINVAL;
+			}
+			kfree(name);
+			break;
+#else
+		case Opt_compress_algorithm:
+			f2fs_msg(sb, KERN_INFO,
+				"compress_algorithm options not supported");
+			break;
+#endif
 		default:
 			f2fs_msg(sb, KERN_ERR,
 				"Unrecognized mount option \"%s\" or missing value",
@@ -465,6 +503,7 @@ static void f2fs_put_super(struct super_block *sb)
 	iput(sbi->meta_inode);
 
 	/* destroy f2fs internal modules */
+	destroy_compress_manager(sbi);
 	destroy_node_manager(sbi);
 	destroy_segment_manager(sbi);
 
@@ -487,9 +526,9 @@ int f2fs_sync_fs(struct super_block *sb, int sync)
 		struct cp_control cpc;
 
 		cpc.reason = test_opt(sbi, FASTBOOT) ? CP_UMOUNT : CP_SYNC;
-		mutex_lock(&sbi->gc_mutex);
+		down_write(&sbi->gc_lock);
 		write_checkpoint(sbi, &cpc);
-		mutex_unlock(&sbi->gc_mutex);
+		up_write(&sbi->gc_lock);
 	} else {
 		f2fs_balance_fs(sbi);
 	}
@@ -582,6 +621,14 @@ static int f2fs_show_options(struct seq_file *seq, struct dentry *root)
 	if (test_opt(sbi, FASTBOOT))
 		seq_puts(seq, ",fastboot");
 	seq_printf(seq, ",active_logs=%u", sbi->active_logs);
+	if (sbi->gc_threads != DEF_GC_THREADS)
+		seq_printf(seq, ",gc_threads=%u", sbi->gc_threads);
+	if (test_opt(sbi, PCPU_LOGS))
+		seq_puts(seq, ",pcpu_logs");
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	if (sbi->compress_algorithm == F2FS_COMPRESS_LZ4)
+		seq_puts(seq, ",compress_algorithm=lz4");
+#endif
 
 	return 0;
 }
@@ -631,6 +678,7 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	struct f2fs_sb_info *sbi = F2FS_SB(sb);
 	struct f2fs_mount_info org_mount_opt;
 	int err, active_logs;
+	unsigned int gc_threads;
 	bool need_restart_gc = false;
 	bool need_stop_gc = false;
 
@@ -642,9 +690,11 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 	 */
 	org_mount_opt = sbi->mount_opt;
 	active_logs = sbi->active_logs;
+	gc_threads = sbi->gc_threads;
 
 	sbi->mount_opt.opt = 0;
 	sbi->active_logs = NR_CURSEG_TYPE;
+	sbi->gc_threads = DEF_GC_THREADS;
 
 	/* parse mount options */
 	err = parse_options(sb, data);
@@ -674,6 +724,14 @@ static int f2fs_remount(struct super_block *sb, int *flags, char *data)
 		if (err)
 			goto restore_opts;
 		need_stop_gc = true;
+	} else if (sbi->gc_threads != gc_threads) {
+		/* restart the GC threads with the new number of workers */
+		stop_gc_thread(sbi);
+		need_restart_gc = true;
+		err = start_gc_thread(sbi);
+		if (err)
+			goto restore_gc;
+		need_stop_gc = true;
 	}
 
 	/*
@@ -693,16 +751,18 @@ skip:
 		(test_opt(sbi, POSIX_ACL) ? MS_POSIXACL : 0);
 	return 0;
 restore_gc:
+	if (need_stop_gc)
+		stop_gc_thread(sbi);
 	if (need_restart_gc) {
+		sbi->gc_threads = gc_threads;
 		if (start_gc_thread(sbi))
 			f2fs_msg(sbi->sb, KERN_WARNING,
 				"background gc thread has stopped");
-	} else if (need_stop_gc) {
-		stop_gc_thread(sbi);
 	}
 restore_opts:
 	sbi->mount_opt = org_mount_opt;
 	sbi->active_logs = active_logs;
+	sbi->gc_threads = gc_threads;
 	return err;
 }
 
@@ -963,6 +1023,7 @@ try_onemore:
 	sb->s_fs_info = sbi;
 	/* init some FS parameters */
 	sbi->active_logs = NR_CURSEG_TYPE;
+	sbi->gc_threads = DEF_GC_THREADS;
 
 	set_opt(sbi, BG_GC);
 
@@ -994,7 +1055,7 @@ try_onemore:
 	sbi->sb = sb;
 	sbi->raw_super = raw_super;
 	sbi->raw_super_buf = raw_super_buf;
-	mutex_init(&sbi->gc_mutex);
+	init_rwsem(&sbi->gc_lock);
 	mutex_init(&sbi->writepages);
 	mutex_init(&sbi->cp_mutex);
 	init_rwsem(&sbi->node_write);
@@ -1065,6 +1126,13 @@ try_onemore:
 
 	build_gc_manager(sbi);
 
+	err = build_compress_manager(sbi);
+	if (err) {
+		f2fs_msg(sb, KERN_ERR,
+			"Failed to initialize F2FS compression manager");
+		goto free_nm;
+	}
+
 	/* get an inode for node space */
 	sbi->node_inode = f2fs_iget(sb, F2FS_NODE_INO(sbi));
 	if (IS_ERR(sbi->node_inode)) {
@@ -1160,6 +1228,7 @@ free_root_inode:
 free_node_inode:
 	iput(sbi->node_inode);
 free_nm:
+	destroy_compress_manager(sbi);
 	destroy_node_manager(sbi);
 free_sm:
 	destroy_segment_manager(sbi);
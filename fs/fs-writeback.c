@@ -27,6 +27,7 @@
 #include <linux/backing-dev.h>
 #include <linux/tracepoint.h>
 #include <linux/device.h>
+#include <linux/cgroup.h>
 #include "internal.h"
 
 /*
@@ -605,6 +606,50 @@ static long writeback_chunk_size(struct backing_dev_info *bdi,
 	return pages;
 }
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+/*
+ * Remember the blkcg of the task dirtying @inode.  The flusher issues the
+ * inode's writeback on behalf of that blkcg, so that CFQ and blk-throttle
+ * charge it to the group that produced the dirty data rather than to the
+ * root group.  Called with i_lock held when the inode becomes dirty.
+ */
+static void inode_attach_wb_blkcg(struct inode *inode)
+{
+	struct cgroup_subsys_state *css;
+
+	rcu_read_lock();
+	css = kthread_blkcg();
+	if (!css)
+		css = task_css(current, blkio_cgrp_id);
+	if (css != inode->i_wb_blkcg && css_tryget_online(css)) {
+		if (inode->i_wb_blkcg)
+			css_put(inode->i_wb_blkcg);
+		inode->i_wb_blkcg = css;
+	}
+	rcu_read_unlock();
+}
+
+void inode_detach_wb_blkcg(struct inode *inode)
+{
+	if (inode->i_wb_blkcg) {
+		css_put(inode->i_wb_blkcg);
+		inode->i_wb_blkcg = NULL;
+	}
+}
+
+/*
+ * Charge the flusher's I/O for @inode to the blkcg that dirtied it.
+ * i_wb_blkcg doesn't change while I_SYNC is set.
+ */
+static void inode_wb_associate_blkcg(struct inode *inode)
+{
+	kthread_associate_blkcg(inode->i_wb_blkcg);
+}
+#else
+static inline void inode_attach_wb_blkcg(struct inode *inode) { }
+static inline void inode_wb_associate_blkcg(struct inode *inode) { }
+#endif
+
 /*
  * Write a portion of b_io inodes which belong to @sb.
  *
@@ -691,6 +736,7 @@ static long writeback_sb_inodes(struct super_block *sb,
 			continue;
 		}
 		inode->i_state |= I_SYNC;
+		inode_wb_associate_blkcg(inode);
 		spin_unlock(&inode->i_lock);
 
 		write_chunk = writeback_chunk_size(wb->bdi, work);
@@ -724,6 +770,7 @@ static long writeback_sb_inodes(struct super_block *sb,
 				break;
 		}
 	}
+	kthread_associate_blkcg(NULL);
 	return wrote;
 }
 
@@ -1208,6 +1255,7 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 			bool wakeup_bdi = false;
 			bdi = inode_to_bdi(inode);
 
+			inode_attach_wb_blkcg(inode);
 			spin_unlock(&inode->i_lock);
 			spin_lock(&bdi->wb.list_lock);
 			if (bdi_cap_writeback_dirty(bdi)) {
@@ -26,15 +26,77 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
 	return file->private_data;
 }
 
+void fuse_init_dev(struct fuse_dev *fud, struct fuse_conn *fc)
+{
+	memset(fud, 0, sizeof(*fud));
+	fud->fc = fc;
+	spin_lock_init(&fud->lock);
+	fud->connected = 1;
+	init_waitqueue_head(&fud->waitq);
+	INIT_LIST_HEAD(&fud->pending);
+	INIT_LIST_HEAD(&fud->processing);
+	INIT_LIST_HEAD(&fud->io);
+	INIT_LIST_HEAD(&fud->interrupts);
+	fud->forget_list_tail = &fud->forget_list_head;
+	list_add_tail(&fud->entry, &fc->devices);
+}
+
+void fuse_free_devs(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud, *next;
+
+	list_for_each_entry_safe(fud, next, &fc->devices, entry) {
+		if (fud != &fc->main_dev)
+			kfree(fud);
+	}
+	free_percpu(fc->cpu_dev);
+}
+
+/*
+ * The channel requests from this CPU should be queued on.  The result
+ * may be stale, which the caller notices by the channel having been
+ * disconnected.
+ */
+static struct fuse_dev *fuse_pick_dev(struct fuse_conn *fc)
+{
+	struct fuse_dev * __percpu *cpu_dev = ACCESS_ONCE(fc->cpu_dev);
+
+	if (!cpu_dev)
+		return &fc->main_dev;
+
+	/* Matches smp_wmb() in fuse_dev_clone() */
+	smp_read_barrier_depends();
+	return this_cpu_read(*cpu_dev);
+}
+
+/*
+ * Lock the channel of a request.  Pending requests may be moved to
+ * another channel, but only with the lock of the old one held.
+ */
+static struct fuse_dev *lock_req_dev(struct fuse_req *req)
+__acquires(req->fud->lock)
+{
+	struct fuse_dev *fud;
+
+	for (;;) {
+		fud = ACCESS_ONCE(req->fud);
+		spin_lock(&fud->lock);
+		if (likely(fud == req->fud))
+			return fud;
+		spin_unlock(&fud->lock);
+	}
+}
+
 static void fuse_request_init(struct fuse_req *req, struct page **pages,
 			      struct fuse_page_desc *page_descs,
 			      unsigned npages)
@@ -312,79 +374,99 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 
 static u64 fuse_get_unique(struct fuse_conn *fc)
 {
-	fc->reqctr++;
-	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	/* zero is special, and the counter starts from there */
+	return atomic64_inc_return(&fc->reqctr);
+}
 
-	return fc->reqctr;
+/*
+ * Lock a connected channel for queuing a request from this CPU.
+ * Returns NULL if the connection has no channels left.
+ *
+ * Channels are disconnected and the CPUs remapped within the same
+ * fc->lock section, so under fc->lock the first pick is always right.
+ */
+static struct fuse_dev *lock_queue_dev(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	for (;;) {
+		fud = fuse_pick_dev(fc);
+		spin_lock(&fud->lock);
+		if (fud->connected)
+			return fud;
+		spin_unlock(&fud->lock);
+		if (!ACCESS_ONCE(fc->connected))
+			return NULL;
+		cpu_relax();
+	}
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_request(struct fuse_dev *fud, struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	req->fud = fud;
+	list_add_tail(&req->list, &fud->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
-		atomic_inc(&fc->num_waiting);
+		atomic_inc(&fud->fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up(&fud->waitq);
+	kill_fasync(&fud->fasync, SIGIO, POLL_IN);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
+	struct fuse_dev *fud;
+
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->forget_list_tail->next = forget;
-		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fud = lock_queue_dev(fc);
+	if (fud) {
+		fud->forget_list_tail->next = forget;
+		fud->forget_list_tail = forget;
+		wake_up(&fud->waitq);
+		kill_fasync(&fud->fasync, SIGIO, POLL_IN);
+		spin_unlock(&fud->lock);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
 }
 
+/*
+ * Called with fc->lock held.  Once the connection is gone there is no
+ * channel to queue on, and the requests are left on bg_queue.
+ */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
-	while (fc->active_background < fc->max_background &&
+	while (fc->connected &&
+	       fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
+		struct fuse_dev *fud;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
 		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		fud = lock_queue_dev(fc);
+		queue_request(fud, req);
+		spin_unlock(&fud->lock);
 	}
 }
 
 /*
- * This function is called when a request is finished.  Either a reply
- * has arrived or it was aborted (and not yet sent) or some error
- * occurred during communication with userspace, or the device file
- * was closed.  The requester thread is woken up (if still waiting),
- * the 'end' callback is called if given, else the reference to the
- * request is released
- *
- * Called with fc->lock, unlocks it
+ * Finish a request that is no longer on any channel
  */
-static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+static void __request_end(struct fuse_conn *fc, struct fuse_req *req)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
-	list_del(&req->list);
-	list_del(&req->intr_entry);
-	req->state = FUSE_REQ_FINISHED;
 	if (req->background) {
+		spin_lock(&fc->lock);
 		req->background = 0;
 
 		if (fc->num_background == fc->max_background)
@@ -402,37 +484,63 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
+/*
+ * This function is called when a request is finished.  Either a reply
+ * has arrived or it was aborted (and not yet sent) or some error
+ * occurred during communication with userspace, or the device file
+ * was closed.  The requester thread is woken up (if still waiting),
+ * the 'end' callback is called if given, else the reference to the
+ * request is released
+ *
+ * Called with the lock of the request's channel, unlocks it
+ */
+static void request_end(struct fuse_conn *fc, struct fuse_req *req)
+__releases(req->fud->lock)
+{
+	list_del(&req->list);
+	list_del(&req->intr_entry);
+	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&req->fud->lock);
+	__request_end(fc, req);
+}
+
 static void wait_answer_interruptible(struct fuse_conn *fc,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->fud->lock)
+__acquires(req->fud->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->fud->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	lock_req_dev(req);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_interrupt(struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	struct fuse_dev *fud = req->fud;
+
+	list_add_tail(&req->intr_entry, &fud->interrupts);
+	wake_up(&fud->waitq);
+	kill_fasync(&fud->fasync, SIGIO, POLL_IN);
 }
 
+/*
+ * Called with the lock of the request's channel held, returns with the
+ * lock of its last channel held
+ */
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->fud->lock)
+__acquires(req->fud->lock)
 {
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
@@ -445,7 +553,7 @@ __acquires(fc->lock)
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(req);
 	}
 
 	if (!req->force) {
@@ -474,9 +582,9 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->fud->lock);
 	wait_event(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	lock_req_dev(req);
 
 	if (!req->aborted)
 		return;
@@ -489,30 +597,33 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fud->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		lock_req_dev(req);
 	}
 }
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_dev *fud;
+
 	BUG_ON(req->background);
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	fud = lock_queue_dev(fc);
+	if (!fud)
 		req->out.h.error = -ENOTCONN;
-	else if (fc->conn_error)
+	else if (fc->conn_error) {
+		spin_unlock(&fud->lock);
 		req->out.h.error = -ECONNREFUSED;
-	else {
+	} else {
 		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		queue_request(fud, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
+		spin_unlock(&req->fud->lock);
 	}
-	spin_unlock(&fc->lock);
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
@@ -582,6 +693,12 @@ ssize_t fuse_simple_request(struct fuse_conn *fc, struct fuse_args *args)
 		BUG_ON(args->out.numargs != 1);
 		ret = req->out.args[0].size;
 	}
+	if (req->passthrough_filp) {
+		if (ret)
+			fput(req->passthrough_filp);
+		else
+			args->out.passthrough_filp = req->passthrough_filp;
+	}
 	fuse_put_request(fc, req);
 
 	return ret;
@@ -610,8 +727,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
-		request_end(fc, req);
+		req->state = FUSE_REQ_FINISHED;
+		__request_end(fc, req);
 	}
 }
 
@@ -625,16 +744,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_dev *fud;
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
-	if (fc->connected) {
-		queue_request(fc, req);
+	fud = lock_queue_dev(fc);
+	if (fud) {
+		queue_request(fud, req);
+		spin_unlock(&fud->lock);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
 
 	return err;
 }
@@ -681,12 +801,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fud->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fud->lock);
 	}
 	return err;
 }
@@ -699,11 +819,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fud->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fud->lock);
 	}
 }
 
@@ -716,6 +836,7 @@ struct fuse_copy_state {
 	struct pipe_buffer *currbuf;
 	struct pipe_inode_info *pipe;
 	unsigned long nr_segs;
+	unsigned long max_segs;
 	unsigned long seglen;
 	unsigned long addr;
 	struct page *pg;
@@ -781,7 +902,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 			cs->pipebufs++;
 			cs->nr_segs--;
 		} else {
-			if (cs->nr_segs == cs->pipe->buffers)
+			if (cs->nr_segs == cs->max_segs)
 				return -EIO;
 
 			page = alloc_page(GFP_HIGHUSER);
@@ -922,13 +1043,20 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	if (!(buf->flags & PIPE_BUF_FLAG_LRU))
 		lru_cache_add_file(newpage);
 
+	/*
+	 * Release while we have extra ref on stolen page.  Otherwise
+	 * anon_pipe_buf_release() might think the page can be reused.
+	 */
+	buf->ops->release(cs->pipe, buf);
+	buf->ops = NULL;
+
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->fud->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->fud->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -960,7 +1088,7 @@ static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 {
 	struct pipe_buffer *buf;
 
-	if (cs->nr_segs == cs->pipe->buffers)
+	if (cs->nr_segs == cs->max_segs)
 		return -EIO;
 
 	unlock_request(cs->fc, cs->req);
@@ -1074,36 +1202,54 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int forget_pending(struct fuse_conn *fc)
+static int forget_pending(struct fuse_dev *fud)
+{
+	return fud->forget_list_head.next != NULL;
+}
+
+static int request_pending(struct fuse_dev *fud)
 {
-	return fc->forget_list_head.next != NULL;
+	return !list_empty(&fud->pending) || !list_empty(&fud->interrupts) ||
+		forget_pending(fud);
 }
 
-static int request_pending(struct fuse_conn *fc)
+/*
+ * Number of pipe buffers needed to splice a request to userspace.  The
+ * header and the ordinary arguments are packed into freshly allocated
+ * pages, while each page of the data gets a buffer of its own.
+ */
+static unsigned long fuse_req_pipe_segs(struct fuse_req *req)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	struct fuse_in *in = &req->in;
+	unsigned len = in->h.len;
+	unsigned long segs = 0;
+
+	if (in->argpages) {
+		len -= in->args[in->numargs - 1].size;
+		segs = req->num_pages;
+	}
+	return segs + DIV_ROUND_UP(len, PAGE_SIZE);
 }
 
 /* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void request_wait(struct fuse_dev *fud)
+__releases(fud->lock)
+__acquires(fud->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
+	add_wait_queue_exclusive(&fud->waitq, &wait);
+	while (fud->connected && !request_pending(fud)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&fud->lock);
 		schedule();
-		spin_lock(&fc->lock);
+		spin_lock(&fud->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&fud->waitq, &wait);
 }
 
 /*
@@ -1112,11 +1258,12 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with fud->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_dev *fud,
+			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(fud->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -1124,7 +1271,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(fud->fc);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -1132,7 +1279,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1144,21 +1291,21 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
-static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
+static struct fuse_forget_link *dequeue_forget(struct fuse_dev *fud,
 					       unsigned max,
 					       unsigned *countp)
 {
-	struct fuse_forget_link *head = fc->forget_list_head.next;
+	struct fuse_forget_link *head = fud->forget_list_head.next;
 	struct fuse_forget_link **newhead = &head;
 	unsigned count;
 
 	for (count = 0; *newhead != NULL && count < max; count++)
 		newhead = &(*newhead)->next;
 
-	fc->forget_list_head.next = *newhead;
+	fud->forget_list_head.next = *newhead;
 	*newhead = NULL;
-	if (fc->forget_list_head.next == NULL)
-		fc->forget_list_tail = &fc->forget_list_head;
+	if (fud->forget_list_head.next == NULL)
+		fud->forget_list_tail = &fud->forget_list_head;
 
 	if (countp != NULL)
 		*countp = count;
@@ -1166,24 +1313,24 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_conn *fc,
+static int fuse_read_single_forget(struct fuse_dev *fud,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(fud->lock)
 {
 	int err;
-	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
+	struct fuse_forget_link *forget = dequeue_forget(fud, 1, NULL);
 	struct fuse_forget_in arg = {
 		.nlookup = forget->forget_one.nlookup,
 	};
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fud->fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1199,9 +1346,9 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_conn *fc,
+static int fuse_read_batch_forget(struct fuse_dev *fud,
 				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+__releases(fud->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1210,18 +1357,18 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fud->fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&fud->lock);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
-	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	head = dequeue_forget(fud, max_forgets, &count);
+	spin_unlock(&fud->lock);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1248,14 +1395,14 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_forget(struct fuse_dev *fud, struct fuse_copy_state *cs,
 			    size_t nbytes)
-__releases(fc->lock)
+__releases(fud->lock)
 {
-	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+	if (fud->fc->minor < 16 || fud->forget_list_head.next->next == NULL)
+		return fuse_read_single_forget(fud, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(fud, cs, nbytes);
 }
 
 /*
@@ -1267,51 +1414,57 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
+	if ((file->f_flags & O_NONBLOCK) && fud->connected &&
+	    !request_pending(fud))
 		goto err_unlock;
 
-	request_wait(fc);
+	request_wait(fud);
 	err = -ENODEV;
-	if (!fc->connected)
+	if (!fud->connected)
 		goto err_unlock;
 	err = -ERESTARTSYS;
-	if (!request_pending(fc))
+	if (!request_pending(fud))
 		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&fud->interrupts)) {
+		req = list_entry(fud->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(fud, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+	if (forget_pending(fud)) {
+		if (list_empty(&fud->pending) || fud->forget_batch-- > 0)
+			return fuse_read_forget(fud, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (fud->forget_batch <= -8)
+			fud->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(fud->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fud->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
-	/* If request is too large, reply with an error and restart the read */
-	if (nbytes < reqsize) {
+	/*
+	 * If request is too large, reply with an error and restart the read.
+	 * When splicing, the request must fit into the free pipe buffers as
+	 * well, otherwise it would be lost after being taken off the queue.
+	 */
+	if (nbytes < reqsize ||
+	    (cs->pipebufs && fuse_req_pipe_segs(req) > cs->max_segs)) {
 		req->out.h.error = -EIO;
 		/* SETXATTR is special, since it may contain too large data */
 		if (in->h.opcode == FUSE_SETXATTR)
@@ -1319,14 +1472,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1341,15 +1494,15 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list, &fud->processing);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(req);
+		spin_unlock(&fud->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 	return err;
 }
 
@@ -1358,13 +1511,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -1376,18 +1529,21 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(in);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fud->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	pipe_lock(pipe);
+	cs.max_segs = pipe->buffers - pipe->nrbufs;
+	pipe_unlock(pipe);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1711,7 +1867,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 		num = file_size - outarg->offset;
 
 	num_pages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
-	num_pages = min(num_pages, FUSE_MAX_PAGES_PER_REQ);
+	num_pages = min(num_pages, fc->max_pages);
 
 	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
@@ -1826,11 +1982,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_dev *fud, u64 unique)
 {
 	struct fuse_req *req;
 
-	list_for_each_entry(req, &fc->processing, list) {
+	list_for_each_entry(req, &fud->processing, list) {
 		if (req->in.h.unique == unique || req->intr_unique == unique)
 			return req;
 	}
@@ -1867,10 +2023,11 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
-static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
+static ssize_t fuse_dev_do_write(struct fuse_dev *fud,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1898,19 +2055,19 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	err = -ENOENT;
-	if (!fc->connected)
+	if (!fud->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(fud, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&fud->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&fud->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1923,26 +2080,28 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&fud->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fud->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 
-	spin_lock(&fc->lock);
+	spin_lock(&fud->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1954,7 +2113,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1964,13 +2123,13 @@ static ssize_t fuse_dev_write(struct kiocb *iocb, const struct iovec *iov,
 			      unsigned long nr_segs, loff_t pos)
 {
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(iocb->ki_filp);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(iocb->ki_filp);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 0, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 0, iov, nr_segs);
 
-	return fuse_dev_do_write(fc, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_write(fud, &cs, iov_length(iov, nr_segs));
 }
 
 static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
@@ -1981,12 +2140,12 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	unsigned idx;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc;
+	struct fuse_dev *fud;
 	size_t rem;
 	ssize_t ret;
 
-	fc = fuse_get_conn(out);
-	if (!fc)
+	fud = fuse_get_dev(out);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
@@ -2033,18 +2192,21 @@ static ssize_t fuse_dev_splice_write(struct pipe_inode_info *pipe,
 	}
 	pipe_unlock(pipe);
 
-	fuse_copy_init(&cs, fc, 0, NULL, nbuf);
+	fuse_copy_init(&cs, fud->fc, 0, NULL, nbuf);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
 
 	if (flags & SPLICE_F_MOVE)
 		cs.move_pages = 1;
 
-	ret = fuse_dev_do_write(fc, &cs, len);
+	ret = fuse_dev_do_write(fud, &cs, len);
 
 	for (idx = 0; idx < nbuf; idx++) {
 		struct pipe_buffer *buf = &bufs[idx];
-		buf->ops->release(pipe, buf);
+
+		/* Pages moved into the page cache are already released */
+		if (buf->ops)
+			buf->ops->release(pipe, buf);
 	}
 out:
 	kfree(bufs);
@@ -2054,18 +2216,18 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	poll_wait(file, &fud->waitq, wait);
 
-	spin_lock(&fc->lock);
-	if (!fc->connected)
+	spin_lock(&fud->lock);
+	if (!fud->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (request_pending(fud))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
+	spin_unlock(&fud->lock);
 
 	return mask;
 }
@@ -2073,18 +2235,18 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires fud->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_dev *fud, struct list_head *head)
+__releases(fud->lock)
+__acquires(fud->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
-		request_end(fc, req);
-		spin_lock(&fc->lock);
+		request_end(fud->fc, req);
+		spin_lock(&fud->lock);
 	}
 }
 
@@ -2099,13 +2261,15 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_dev *fud)
+__releases(fud->lock)
+__acquires(fud->lock)
 {
-	while (!list_empty(&fc->io)) {
+	struct fuse_conn *fc = fud->fc;
+
+	while (!list_empty(&fud->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(fud->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -2116,25 +2280,23 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&fud->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&fud->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_queued_requests(struct fuse_dev *fud)
+__releases(fud->lock)
+__acquires(fud->lock)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	end_requests(fud, &fud->pending);
+	end_requests(fud, &fud->processing);
+	while (forget_pending(fud))
+		kfree(dequeue_forget(fud, 1, NULL));
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -2163,9 +2325,13 @@ static void end_polls(struct fuse_conn *fc)
  * is the combination of an asynchronous request and the tricky
  * deadlock (see Documentation/filesystems/fuse.txt).
  *
- * During the aborting, progression of requests from the pending and
+ * Background requests still waiting for a slot are queued on a
+ * channel first, then all channels are disconnected under fc->lock.
+ * From then on progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
- * onto the pending list is prevented by req->connected being false.
+ * onto the pending list is prevented by fud->connected being false.
+ * No channel is added to a disconnected connection, so the list of
+ * channels can be walked without fc->lock to end the requests.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -2173,34 +2339,190 @@ static void end_polls(struct fuse_conn *fc)
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
+	struct fuse_dev *fud;
+
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		fuse_set_initialized(fc);
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		return;
 	}
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	fc->connected = 0;
+	fc->blocked = 0;
+	fuse_set_initialized(fc);
+	list_for_each_entry(fud, &fc->devices, entry) {
+		spin_lock(&fud->lock);
+		fud->connected = 0;
+		spin_unlock(&fud->lock);
+	}
+	end_polls(fc);
+	wake_up_all(&fc->blocked_waitq);
 	spin_unlock(&fc->lock);
+
+	list_for_each_entry(fud, &fc->devices, entry) {
+		spin_lock(&fud->lock);
+		end_io_requests(fud);
+		end_queued_requests(fud);
+		spin_unlock(&fud->lock);
+		wake_up_all(&fud->waitq);
+		kill_fasync(&fud->fasync, SIGIO, POLL_IN);
+	}
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
-int fuse_dev_release(struct inode *inode, struct file *file)
+/* Next connected channel after @fud, wrapping around */
+static struct fuse_dev *fuse_next_dev(struct fuse_conn *fc,
+				      struct fuse_dev *fud)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
-		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		fuse_set_initialized(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+	struct list_head *pos = fud ? &fud->entry : &fc->devices;
+
+	do {
+		pos = pos->next;
+		if (pos == &fc->devices)
+			continue;
+		fud = list_entry(pos, struct fuse_dev, entry);
+	} while (pos == &fc->devices || !fud->connected);
+
+	return fud;
+}
+
+/*
+ * Spread the CPUs over the connected channels.  Called with fc->lock
+ * held, and with at least one channel connected.
+ */
+static void fuse_map_devs(struct fuse_conn *fc,
+			  struct fuse_dev * __percpu *cpu_dev)
+{
+	struct fuse_dev *fud = NULL;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		fud = fuse_next_dev(fc, fud);
+		*per_cpu_ptr(cpu_dev, cpu) = fud;
+	}
+}
+
+static int fuse_dev_clone(struct fuse_conn *fc, struct file *new)
+{
+	struct fuse_dev * __percpu *cpu_dev = NULL;
+	struct fuse_dev *fud;
+	int err;
+
+	if (new->private_data)
+		return -EINVAL;
+
+	fud = kmalloc(sizeof(*fud), GFP_KERNEL);
+	if (!fud)
+		return -ENOMEM;
+
+	if (!fc->cpu_dev) {
+		cpu_dev = alloc_percpu(struct fuse_dev *);
+		if (!cpu_dev) {
+			kfree(fud);
+			return -ENOMEM;
+		}
+	}
+
+	err = -ENODEV;
+	spin_lock(&fc->lock);
+	if (fc->connected) {
+		fuse_init_dev(fud, fc);
+		if (cpu_dev) {
+			fuse_map_devs(fc, cpu_dev);
+			/* Matches smp_read_barrier_depends() in fuse_pick_dev() */
+			smp_wmb();
+			fc->cpu_dev = cpu_dev;
+			cpu_dev = NULL;
+		} else {
+			fuse_map_devs(fc, fc->cpu_dev);
+		}
+		new->private_data = fud;
+		fuse_conn_get(fc);
+		fud = NULL;
+		err = 0;
+	}
+	spin_unlock(&fc->lock);
+
+	free_percpu(cpu_dev);
+	kfree(fud);
+
+	return err;
+}
+
+/*
+ * Take a released channel out of service.  Pending requests and
+ * forgets go to the other channels, requests userspace has read from
+ * this one can no longer be answered and are aborted.
+ *
+ * Returns false if this was the last connected channel.  Pending
+ * requests are moved with fc->lock held, so that there is only one
+ * mover and nesting the channel locks can't deadlock.
+ */
+static bool fuse_dev_detach(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_dev *other;
+
+	spin_lock(&fc->lock);
+	if (!fc->connected || !fc->cpu_dev) {
 		spin_unlock(&fc->lock);
+		return false;
+	}
+	list_for_each_entry(other, &fc->devices, entry) {
+		if (other != fud && other->connected)
+			break;
+	}
+	if (&other->entry == &fc->devices) {
+		spin_unlock(&fc->lock);
+		return false;
+	}
+
+	spin_lock(&fud->lock);
+	fud->connected = 0;
+	fuse_map_devs(fc, fc->cpu_dev);
+	while (!list_empty(&fud->pending)) {
+		struct fuse_req *req;
+
+		req = list_entry(fud->pending.next, struct fuse_req, list);
+		other = fuse_pick_dev(fc);
+		spin_lock_nested(&other->lock, SINGLE_DEPTH_NESTING);
+		list_move_tail(&req->list, &other->pending);
+		req->fud = other;
+		wake_up(&other->waitq);
+		kill_fasync(&other->fasync, SIGIO, POLL_IN);
+		spin_unlock(&other->lock);
+	}
+	if (forget_pending(fud)) {
+		other = fuse_pick_dev(fc);
+		spin_lock_nested(&other->lock, SINGLE_DEPTH_NESTING);
+		other->forget_list_tail->next = fud->forget_list_head.next;
+		other->forget_list_tail = fud->forget_list_tail;
+		fud->forget_list_head.next = NULL;
+		fud->forget_list_tail = &fud->forget_list_head;
+		wake_up(&other->waitq);
+		kill_fasync(&other->fasync, SIGIO, POLL_IN);
+		spin_unlock(&other->lock);
+	}
+	spin_unlock(&fud->lock);
+	spin_unlock(&fc->lock);
+
+	spin_lock(&fud->lock);
+	end_io_requests(fud);
+	end_requests(fud, &fud->processing);
+	spin_unlock(&fud->lock);
+
+	return true;
+}
+
+int fuse_dev_release(struct inode *inode, struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud) {
+		struct fuse_conn *fc = fud->fc;
+
+		if (!fuse_dev_detach(fud))
+			fuse_abort_conn(fc);
 		fuse_conn_put(fc);
 	}
 
@@ -2210,12 +2532,49 @@ EXPORT_SYMBOL_GPL(fuse_dev_release);
 
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
 	/* No locking - fasync_helper does its own locking */
-	return fasync_helper(fd, file, on, &fc->fasync);
+	return fasync_helper(fd, file, on, &fud->fasync);
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev *fud;
+	struct file *old;
+	int oldfd;
+	int err;
+
+	if (cmd != FUSE_DEV_IOC_CLONE)
+		return -ENOTTY;
+
+	if (get_user(oldfd, (__u32 __user *) arg))
+		return -EFAULT;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EINVAL;
+
+	/*
+	 * Check against file->f_op because CUSE uses its own copy of
+	 * fuse_dev_operations.
+	 */
+	err = -EINVAL;
+	if (old->f_op == file->f_op &&
+	    old->f_cred->user_ns == file->f_cred->user_ns) {
+		fud = fuse_get_dev(old);
+		if (fud) {
+			mutex_lock(&fuse_mutex);
+			err = fuse_dev_clone(fud->fc, file);
+			mutex_unlock(&fuse_mutex);
+		}
+	}
+	fput(old);
+
+	return err;
 }
 
 const struct file_operations fuse_dev_operations = {
@@ -2230,6 +2589,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
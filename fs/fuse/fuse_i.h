@@ -23,8 +23,11 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+/** Default max number of pages that can be used in a single read request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Maximum of max_pages received in init_out (1MB with 4k pages) */
+#define FUSE_MAX_MAX_PAGES 256
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -32,6 +35,9 @@
 /** It could be as large as PATH_MAX, but would that have any uses? */
 #define FUSE_NAME_MAX 1024
 
+/** Magic number of fuse superblocks */
+#define FUSE_SUPER_MAGIC 0x65735546
+
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
@@ -155,6 +161,9 @@ struct fuse_file {
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
 
+	/** Backing file that read, write and mmap go to, if any */
+	struct file *passthrough_filp;
+
 	/** Has flock been performed on this file? */
 	bool flock:1;
 };
@@ -236,6 +245,7 @@ struct fuse_args {
 		unsigned argvar:1;
 		unsigned numargs;
 		struct fuse_arg args[2];
+		struct file *passthrough_filp;
 	} out;
 };
 
@@ -377,6 +387,61 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Backing file taken from an OPEN or CREATE reply */
+	struct file *passthrough_filp;
+
+	/** Channel the request is queued on */
+	struct fuse_dev *fud;
+};
+
+/**
+ * A channel to the userspace filesystem.
+ *
+ * This is the /dev/fuse file the filesystem was mounted with, or one
+ * cloned from it with FUSE_DEV_IOC_CLONE.  Each channel has its own
+ * queues, so daemon threads reading from different channels don't
+ * contend with each other.  Requests are queued on the channel of the
+ * submitting CPU, and the reply has to be written to the channel the
+ * request was read from.
+ */
+struct fuse_dev {
+	/** The connection of the channel */
+	struct fuse_conn *fc;
+
+	/** Lock protecting the queues and the requests on them */
+	spinlock_t lock;
+
+	/** Cleared on release of the channel and on connection abort */
+	unsigned connected;
+
+	/** Readers of the channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+
+	/** O_ASYNC requests */
+	struct fasync_struct *fasync;
+
+	/** Entry on fuse_conn->devices */
+	struct list_head entry;
 };
 
 /**
@@ -410,17 +475,17 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
-	wait_queue_head_t waitq;
+	/** Maximum number of pages that can be used in a single request */
+	unsigned int max_pages;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Channel of the /dev/fuse file the connection was set up with */
+	struct fuse_dev main_dev;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** All channels of the connection, cloned ones included */
+	struct list_head devices;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Channel each CPU queues its requests on, once cloned */
+	struct fuse_dev * __percpu *cpu_dev;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -443,16 +508,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating that INIT reply has been received. Allocating
 	 * any fuse request will be suspended until the flag is set */
 	int initialized;
@@ -469,7 +524,7 @@ struct fuse_conn {
 	wait_queue_head_t reserved_req_waitq;
 
 	/** The next unique request id */
-	u64 reqctr;
+	atomic64_t reqctr;
 
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
@@ -572,6 +627,9 @@ struct fuse_conn {
 	/** Does the filesystem support asynchronous direct-IO submission? */
 	unsigned async_dio:1;
 
+	/** May open replies hand over a backing file? */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -593,9 +651,6 @@ struct fuse_conn {
 	/** number of dentries used in the above array */
 	int ctl_ndents;
 
-	/** O_ASYNC requests */
-	struct fasync_struct *fasync;
-
 	/** Key for lock owner ID scrambling */
 	u32 scramble_key[4];
 
@@ -730,6 +785,16 @@ void fuse_change_attributes(struct inode *inode, struct fuse_attr *attr,
 void fuse_change_attributes_common(struct inode *inode, struct fuse_attr *attr,
 				   u64 attr_valid);
 
+/**
+ * Initialize a channel and add it to the connection
+ */
+void fuse_init_dev(struct fuse_dev *fud, struct fuse_conn *fc);
+
+/**
+ * Free the channels of a connection on its final put
+ */
+void fuse_free_devs(struct fuse_conn *fc);
+
 /**
  * Initialize the client device
  */
@@ -908,4 +973,11 @@ int fuse_do_setattr(struct inode *inode, struct iattr *attr,
 
 void fuse_set_initialized(struct fuse_conn *fc);
 
+/* passthrough.c */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,172 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs_stack.h>
+#include <linux/fsnotify.h>
+#include <linux/cred.h>
+#include <linux/aio.h>
+
+/*
+ * A stacking filesystem usually just forwards the data of a file to a
+ * file on a lower filesystem.  Such a daemon may reply to OPEN or
+ * CREATE with FOPEN_PASSTHROUGH and a file descriptor of its own in
+ * passthrough_fh.  The descriptor is looked up while the daemon writes
+ * the reply, and from then on read, write and mmap of the fuse file go
+ * straight to that backing file, without a trip to userspace.
+ *
+ * The backing file is accessed with the credentials it was opened
+ * with, so it should be opened by the daemon with the flags it got in
+ * the open request.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *filp;
+	struct inode *inode;
+
+	if (req->in.h.opcode != FUSE_OPEN && req->in.h.opcode != FUSE_CREATE)
+		return;
+	if (req->out.h.error)
+		return;
+
+	outarg = req->out.args[req->out.numargs - 1].value;
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	/* Anything we can't pass through is served the usual way */
+	outarg->open_flags &= ~FOPEN_PASSTHROUGH;
+	if (!fc->passthrough)
+		return;
+
+	filp = fget(outarg->passthrough_fh);
+	if (!filp)
+		return;
+
+	inode = file_inode(filp);
+	if (!S_ISREG(inode->i_mode) || !filp->f_op->read_iter ||
+	    !filp->f_op->write_iter ||
+	    inode->i_sb->s_magic == FUSE_SUPER_MAGIC) {
+		fput(filp);
+		return;
+	}
+
+	outarg->open_flags |= FOPEN_PASSTHROUGH;
+	req->passthrough_filp = filp;
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *fuse_filp = iocb->ki_filp;
+	struct fuse_file *ff = fuse_filp->private_data;
+	struct file *filp = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(filp->f_mode & FMODE_READ))
+		return -EBADF;
+	if (!iov_iter_count(to))
+		return 0;
+
+	init_sync_kiocb(&kiocb, filp);
+	kiocb.ki_pos = iocb->ki_pos;
+	kiocb.ki_nbytes = iov_iter_count(to);
+
+	old_cred = override_creds(filp->f_cred);
+	ret = filp->f_op->read_iter(&kiocb, to);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	revert_creds(old_cred);
+
+	iocb->ki_pos = kiocb.ki_pos;
+	if (ret > 0)
+		fsnotify_access(filp);
+	fsstack_copy_attr_atime(file_inode(fuse_filp), file_inode(filp));
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *fuse_filp = iocb->ki_filp;
+	struct fuse_file *ff = fuse_filp->private_data;
+	struct inode *fuse_inode = file_inode(fuse_filp);
+	struct file *filp = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(filp->f_mode & FMODE_WRITE))
+		return -EBADF;
+	if (!iov_iter_count(from))
+		return 0;
+
+	init_sync_kiocb(&kiocb, filp);
+	kiocb.ki_pos = iocb->ki_pos;
+	kiocb.ki_nbytes = iov_iter_count(from);
+
+	mutex_lock(&fuse_inode->i_mutex);
+	old_cred = override_creds(filp->f_cred);
+	file_start_write(filp);
+	ret = filp->f_op->write_iter(&kiocb, from);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	file_end_write(filp);
+	revert_creds(old_cred);
+
+	iocb->ki_pos = kiocb.ki_pos;
+	if (ret > 0) {
+		fsnotify_modify(filp);
+		fuse_write_update_size(fuse_inode, kiocb.ki_pos);
+	}
+	fsstack_copy_attr_times(fuse_inode, file_inode(filp));
+	fuse_invalidate_attr(fuse_inode);
+	mutex_unlock(&fuse_inode->i_mutex);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *filp = ff->passthrough_filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!filp->f_op->mmap)
+		return -ENODEV;
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	/* The mapping belongs to the backing file from now on */
+	vma->vm_file = get_file(filp);
+	old_cred = override_creds(filp->f_cred);
+	ret = filp->f_op->mmap(filp, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* mmap_region() drops the reference on the original file */
+		vma->vm_file = file;
+		fput(filp);
+	} else {
+		fput(file);
+	}
+	file_accessed(file);
+
+	return ret;
+}
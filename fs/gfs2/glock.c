@@ -50,7 +50,7 @@
 #include "trace_gfs2.h"
 
 struct gfs2_glock_iter {
-	int hash;			/* hash bucket index           */
+	unsigned int hash;		/* hash bucket index           */
 	unsigned nhash;			/* Index within current bucket */
 	struct gfs2_sbd *sdp;		/* incore superblock           */
 	struct gfs2_glock *gl;		/* current glock struct        */
@@ -68,41 +68,69 @@ static LIST_HEAD(lru_list);
 static atomic_t lru_count = ATOMIC_INIT(0);
 static DEFINE_SPINLOCK(lru_lock);
 
-#define GFS2_GL_HASH_SHIFT      15
-#define GFS2_GL_HASH_SIZE       (1 << GFS2_GL_HASH_SHIFT)
-#define GFS2_GL_HASH_MASK       (GFS2_GL_HASH_SIZE - 1)
+/*
+ * Each filesystem keeps its glocks in a resizable hash table keyed by the
+ * lock name.  Lookups walk the table under rcu_read_lock() and only succeed
+ * if they can take a reference to a glock that is not already dead, so the
+ * common case of finding a cached glock takes no shared lock at all.
+ * Insertion and removal are serialised by sd_glock_lock so that a lock
+ * name is never hashed twice.  The table grows from the rhashtable's own
+ * deferred worker, never from the insertion path (which may be called
+ * under the glock shrinker).  The table never shrinks.
+ */
+#define GL_NAME_KEY_LEN	(offsetof(struct lm_lockname, ln_type) + \
+			 sizeof(unsigned int))
 
-static struct hlist_bl_head gl_hash_table[GFS2_GL_HASH_SIZE];
-static struct dentry *gfs2_root;
+static bool glock_name_cmp(void *obj, void *arg)
+{
+	struct gfs2_glock *gl = obj;
+
+	return lm_name_equal(&gl->gl_name, (struct lm_lockname *)arg) &&
+	       !__lockref_is_dead(&gl->gl_lockref);
+}
 
 /**
- * gl_hash() - Turn glock number into hash bucket number
- * @lock: The glock number
+ * glock_lookup() - Find struct gfs2_glock by lock name
+ * @sdp: The filesystem
+ * @name: The lock name
+ *
+ * Must be called under rcu_read_lock() or sd_glock_lock.  A lookup that
+ * races with the final put of a glock may miss, callers recheck under the
+ * lock before creating a new glock.
  *
- * Returns: The number of the corresponding hash bucket
+ * Returns: NULL, or the struct gfs2_glock with a reference held
  */
 
-static unsigned int gl_hash(const struct gfs2_sbd *sdp,
-			    const struct lm_lockname *name)
+static struct gfs2_glock *glock_lookup(struct gfs2_sbd *sdp,
+				       struct lm_lockname *name)
 {
-	unsigned int h;
-
-	h = jhash(&name->ln_number, sizeof(u64), 0);
-	h = jhash(&name->ln_type, sizeof(unsigned int), h);
-	h = jhash(&sdp, sizeof(struct gfs2_sbd *), h);
-	h &= GFS2_GL_HASH_MASK;
+	struct gfs2_glock *gl;
 
-	return h;
+	gl = rhashtable_lookup_compare(&sdp->sd_glock_hash, name,
+				       glock_name_cmp, name);
+	if (gl && lockref_get_not_dead(&gl->gl_lockref))
+		return gl;
+	return NULL;
 }
 
-static inline void spin_lock_bucket(unsigned int hash)
+int gfs2_glock_hash_init(struct gfs2_sbd *sdp)
 {
-	hlist_bl_lock(&gl_hash_table[hash]);
+	struct rhashtable_params params = {
+		.nelem_hint	= 1024,
+		.key_len	= GL_NAME_KEY_LEN,
+		.key_offset	= offsetof(struct gfs2_glock, gl_name),
+		.head_offset	= offsetof(struct gfs2_glock, gl_node),
+		.hashfn		= jhash,
+		.grow_decision	= rht_grow_above_75,
+	};
+
+	mutex_init(&sdp->sd_glock_lock);
+	return rhashtable_init(&sdp->sd_glock_hash, &params);
 }
 
-static inline void spin_unlock_bucket(unsigned int hash)
+void gfs2_glock_hash_destroy(struct gfs2_sbd *sdp)
 {
-	hlist_bl_unlock(&gl_hash_table[hash]);
+	rhashtable_destroy(&sdp->sd_glock_hash);
 }
 
 static void gfs2_glock_dealloc(struct rcu_head *rcu)
@@ -209,42 +237,15 @@ void gfs2_glock_put(struct gfs2_glock *gl)
 	__gfs2_glock_remove_from_lru(gl);
 	spin_unlock(&lru_lock);
 	spin_unlock(&gl->gl_lockref.lock);
-	spin_lock_bucket(gl->gl_hash);
-	hlist_bl_del_rcu(&gl->gl_list);
-	spin_unlock_bucket(gl->gl_hash);
+	mutex_lock(&sdp->sd_glock_lock);
+	rhashtable_remove(&sdp->sd_glock_hash, &gl->gl_node);
+	mutex_unlock(&sdp->sd_glock_lock);
 	GLOCK_BUG_ON(gl, !list_empty(&gl->gl_holders));
 	GLOCK_BUG_ON(gl, mapping && mapping->nrpages);
 	trace_gfs2_glock_put(gl);
 	sdp->sd_lockstruct.ls_ops->lm_put_lock(gl);
 }
 
-/**
- * search_bucket() - Find struct gfs2_glock by lock number
- * @bucket: the bucket to search
- * @name: The lock name
- *
- * Returns: NULL, or the struct gfs2_glock with the requested number
- */
-
-static struct gfs2_glock *search_bucket(unsigned int hash,
-					const struct gfs2_sbd *sdp,
-					const struct lm_lockname *name)
-{
-	struct gfs2_glock *gl;
-	struct hlist_bl_node *h;
-
-	hlist_bl_for_each_entry_rcu(gl, h, &gl_hash_table[hash], gl_list) {
-		if (!lm_name_equal(&gl->gl_name, name))
-			continue;
-		if (gl->gl_sbd != sdp)
-			continue;
-		if (lockref_get_not_dead(&gl->gl_lockref))
-			return gl;
-	}
-
-	return NULL;
-}
-
 /**
  * may_grant - check if its ok to grant a new lock
  * @gl: The glock
@@ -713,12 +714,11 @@ int gfs2_glock_get(struct gfs2_sbd *sdp, u64 number,
 	struct super_block *s = sdp->sd_vfs;
 	struct lm_lockname name = { .ln_number = number, .ln_type = glops->go_type };
 	struct gfs2_glock *gl, *tmp;
-	unsigned int hash = gl_hash(sdp, &name);
 	struct address_space *mapping;
 	struct kmem_cache *cachep;
 
 	rcu_read_lock();
-	gl = search_bucket(hash, sdp, &name);
+	gl = glock_lookup(sdp, &name);
 	rcu_read_unlock();
 
 	*glp = gl;
@@ -753,7 +753,6 @@ int gfs2_glock_get(struct gfs2_sbd *sdp, u64 number,
 	gl->gl_state = LM_ST_UNLOCKED;
 	gl->gl_target = LM_ST_UNLOCKED;
 	gl->gl_demote_state = LM_ST_EXCLUSIVE;
-	gl->gl_hash = hash;
 	gl->gl_ops = glops;
 	gl->gl_dstamp = ktime_set(0, 0);
 	preempt_disable();
@@ -779,17 +778,17 @@ int gfs2_glock_get(struct gfs2_sbd *sdp, u64 number,
 		mapping->writeback_index = 0;
 	}
 
-	spin_lock_bucket(hash);
-	tmp = search_bucket(hash, sdp, &name);
+	mutex_lock(&sdp->sd_glock_lock);
+	tmp = glock_lookup(sdp, &name);
 	if (tmp) {
-		spin_unlock_bucket(hash);
+		mutex_unlock(&sdp->sd_glock_lock);
 		kfree(gl->gl_lksb.sb_lvbptr);
 		kmem_cache_free(cachep, gl);
 		atomic_dec(&sdp->sd_glock_disposal);
 		gl = tmp;
 	} else {
-		hlist_bl_add_head_rcu(&gl->gl_list, &gl_hash_table[hash]);
-		spin_unlock_bucket(hash);
+		rhashtable_insert(&sdp->sd_glock_hash, &gl->gl_node);
+		mutex_unlock(&sdp->sd_glock_lock);
 	}
 
 	*glp = gl;
@@ -1467,30 +1466,42 @@ static struct shrinker glock_shrinker = {
  * @sdp: the filesystem
  * @bucket: the bucket
  *
+ * Returns: false once @bucket is past the end of the table
  */
 
-static void examine_bucket(glock_examiner examiner, const struct gfs2_sbd *sdp,
-			  unsigned int hash)
+static bool examine_bucket(glock_examiner examiner, struct gfs2_sbd *sdp,
+			   unsigned int hash)
 {
+	struct rhashtable *ht = &sdp->sd_glock_hash;
+	struct bucket_table *tbl;
 	struct gfs2_glock *gl;
-	struct hlist_bl_head *head = &gl_hash_table[hash];
-	struct hlist_bl_node *pos;
+	bool more = false;
 
 	rcu_read_lock();
-	hlist_bl_for_each_entry_rcu(gl, pos, head, gl_list) {
-		if ((gl->gl_sbd == sdp) && lockref_get_not_dead(&gl->gl_lockref))
-			examiner(gl);
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	if (hash < tbl->size) {
+		rht_for_each_entry_rcu(gl, tbl->buckets[hash], gl_node) {
+			if (lockref_get_not_dead(&gl->gl_lockref))
+				examiner(gl);
+		}
+		more = true;
 	}
 	rcu_read_unlock();
 	cond_resched();
+	return more;
 }
 
-static void glock_hash_walk(glock_examiner examiner, const struct gfs2_sbd *sdp)
+/*
+ * A walk that races with a table expansion may visit a glock twice or miss
+ * one; the examiners are all safe to repeat and gfs2_gl_hash_clear() waits
+ * for every glock to be freed regardless.
+ */
+static void glock_hash_walk(glock_examiner examiner, struct gfs2_sbd *sdp)
 {
 	unsigned x;
 
-	for (x = 0; x < GFS2_GL_HASH_SIZE; x++)
-		examine_bucket(examiner, sdp, x);
+	for (x = 0; examine_bucket(examiner, sdp, x); x++)
+		;
 }
 
 
@@ -1811,11 +1822,6 @@ static int gfs2_sbstats_seq_show(struct seq_file *seq, void *iter_ptr)
 
 int __init gfs2_glock_init(void)
 {
-	unsigned i;
-	for(i = 0; i < GFS2_GL_HASH_SIZE; i++) {
-		INIT_HLIST_BL_HEAD(&gl_hash_table[i]);
-	}
-
 	glock_workqueue = alloc_workqueue("glock_workqueue", WQ_MEM_RECLAIM |
 					  WQ_HIGHPRI | WQ_FREEZABLE, 0);
 	if (!glock_workqueue)
@@ -1840,16 +1846,26 @@ void gfs2_glock_exit(void)
 	destroy_workqueue(gfs2_delete_workqueue);
 }
 
-static inline struct gfs2_glock *glock_hash_chain(unsigned hash)
+static inline unsigned int glock_hash_size(struct gfs2_glock_iter *gi)
 {
-	return hlist_bl_entry(hlist_bl_first_rcu(&gl_hash_table[hash]),
-			      struct gfs2_glock, gl_list);
+	struct rhashtable *ht = &gi->sdp->sd_glock_hash;
+
+	return rht_dereference_rcu(ht->tbl, ht)->size;
+}
+
+static inline struct gfs2_glock *glock_hash_chain(struct gfs2_glock_iter *gi)
+{
+	struct rhashtable *ht = &gi->sdp->sd_glock_hash;
+	struct bucket_table *tbl = rht_dereference_rcu(ht->tbl, ht);
+
+	return rht_entry_safe(rht_dereference_rcu(tbl->buckets[gi->hash], ht),
+			      struct gfs2_glock, gl_node);
 }
 
 static inline struct gfs2_glock *glock_hash_next(struct gfs2_glock *gl)
 {
-	return hlist_bl_entry(rcu_dereference(gl->gl_list.next),
-			      struct gfs2_glock, gl_list);
+	return rht_entry_safe(rcu_dereference(gl->gl_node.next),
+			      struct gfs2_glock, gl_node);
 }
 
 static int gfs2_glock_iter_next(struct gfs2_glock_iter *gi)
@@ -1862,25 +1878,24 @@ static int gfs2_glock_iter_next(struct gfs2_glock_iter *gi)
 			gi->gl = glock_hash_next(gl);
 			gi->nhash++;
 		} else {
-			if (gi->hash >= GFS2_GL_HASH_SIZE) {
+			if (gi->hash >= glock_hash_size(gi)) {
 				rcu_read_unlock();
 				return 1;
 			}
-			gi->gl = glock_hash_chain(gi->hash);
+			gi->gl = glock_hash_chain(gi);
 			gi->nhash = 0;
 		}
 		while (gi->gl == NULL) {
 			gi->hash++;
-			if (gi->hash >= GFS2_GL_HASH_SIZE) {
+			if (gi->hash >= glock_hash_size(gi)) {
 				rcu_read_unlock();
 				return 1;
 			}
-			gi->gl = glock_hash_chain(gi->hash);
+			gi->gl = glock_hash_chain(gi);
 			gi->nhash = 0;
 		}
-	/* Skip entries for other sb and dead entries */
-	} while (gi->sdp != gi->gl->gl_sbd ||
-		 __lockref_is_dead(&gi->gl->gl_lockref));
+	/* Skip dead entries */
+	} while (__lockref_is_dead(&gi->gl->gl_lockref));
 
 	return 0;
 }
@@ -17,6 +17,7 @@
 #include <linux/buffer_head.h>
 #include <linux/rcupdate.h>
 #include <linux/rculist_bl.h>
+#include <linux/rhashtable.h>
 #include <linux/completion.h>
 #include <linux/rbtree.h>
 #include <linux/ktime.h>
@@ -323,7 +324,7 @@ enum {
 };
 
 struct gfs2_glock {
-	struct hlist_bl_node gl_list;
+	struct rhash_head gl_node;
 	struct gfs2_sbd *gl_sbd;
 	unsigned long gl_flags;		/* GLF_... */
 	struct lm_lockname gl_name;
@@ -338,7 +339,6 @@ struct gfs2_glock {
 		     gl_req:2,		/* State in last dlm request */
 		     gl_reply:8;	/* Last reply from the dlm */
 
-	unsigned int gl_hash;
 	unsigned long gl_demote_time; /* time of first demote request */
 	long gl_hold_time;
 	struct list_head gl_holders;
@@ -692,6 +692,8 @@ struct gfs2_sbd {
 	struct gfs2_glock *sd_rename_gl;
 	struct gfs2_glock *sd_freeze_gl;
 	struct work_struct sd_freeze_work;
+	struct rhashtable sd_glock_hash;
+	struct mutex sd_glock_lock;	/* table insert/remove */
 	wait_queue_head_t sd_glock_wait;
 	atomic_t sd_glock_disposal;
 	struct completion sd_locking_init;
@@ -78,6 +78,11 @@ static struct gfs2_sbd *init_sbd(struct super_block *sb)
 		kfree(sdp);
 		return NULL;
 	}
+	if (gfs2_glock_hash_init(sdp)) {
+		free_percpu(sdp->sd_lkstats);
+		kfree(sdp);
+		return NULL;
+	}
 
 	set_bit(SDF_NOJOURNALID, &sdp->sd_flags);
 	gfs2_tune_init(&sdp->sd_tune);
@@ -1101,6 +1106,7 @@ static int fill_super(struct super_block *sb, struct gfs2_args *args, int silent
 	if (error) {
 		/* In this case, we haven't initialized sysfs, so we have to
 		   manually free the sdp. */
+		gfs2_glock_hash_destroy(sdp);
 		free_percpu(sdp->sd_lkstats);
 		kfree(sdp);
 		sb->s_fs_info = NULL;
@@ -1205,6 +1211,7 @@ fail_lm:
 	gfs2_lm_unmount(sdp);
 fail_debug:
 	gfs2_delete_debugfs_file(sdp);
+	gfs2_glock_hash_destroy(sdp);
 	free_percpu(sdp->sd_lkstats);
 	/* gfs2_sys_fs_del must be the last thing we do, since it causes
 	 * sysfs to call function gfs2_sbd_release, which frees sdp. */
@@ -1388,6 +1395,7 @@ static void gfs2_kill_sb(struct super_block *sb)
 	sdp->sd_master_dir = NULL;
 	shrink_dcache_sb(sb);
 	gfs2_delete_debugfs_file(sdp);
+	gfs2_glock_hash_destroy(sdp);
 	free_percpu(sdp->sd_lkstats);
 	kill_block_super(sb);
 }
@@ -658,6 +658,7 @@ fail_lock_module:
 fail_tune:
 	sysfs_remove_group(&sdp->sd_kobj, &tune_group);
 fail_reg:
+	gfs2_glock_hash_destroy(sdp);
 	free_percpu(sdp->sd_lkstats);
 	fs_err(sdp, "error %d adding sysfs files", error);
 	if (sysfs_frees_sdp)
@@ -148,6 +148,43 @@ extern const struct file_operations pipefifo_fops;
 extern void sb_pin_kill(struct super_block *sb);
 extern void mnt_pin_kill(struct mount *m);
 
+/*
+ * coredump.c
+ */
+struct coredump_params;
+extern bool dump_interrupted(void);
+extern int __dump_write(struct coredump_params *cprm, const void *addr,
+			size_t nr);
+
+/*
+ * coredump_compress.c
+ */
+#ifdef CONFIG_COREDUMP_COMPRESS
+extern struct core_compress *core_compress_start(void);
+extern int core_compress_finish(struct coredump_params *cprm, int ok);
+extern int core_compress_emit(struct coredump_params *cprm, const void *addr,
+			      size_t nr);
+extern int core_compress_skip(struct coredump_params *cprm, size_t nr);
+#else
+static inline struct core_compress *core_compress_start(void)
+{
+	return NULL;
+}
+static inline int core_compress_finish(struct coredump_params *cprm, int ok)
+{
+	return ok;
+}
+static inline int core_compress_emit(struct coredump_params *cprm,
+				     const void *addr, size_t nr)
+{
+	return 0;
+}
+static inline int core_compress_skip(struct coredump_params *cprm, size_t nr)
+{
+	return 0;
+}
+#endif
+
 /*
  * fs/nsfs.c
  */
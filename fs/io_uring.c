@@ -0,0 +1,1081 @@
+/*
+ *  fs/io_uring.c
+ *
+ *  Asynchronous I/O through submission and completion rings that are
+ *  shared between the kernel and the application.
+ *
+ *  The application places requests in the submission queue (SQ) ring and
+ *  reaps results from the completion queue (CQ) ring.  Both rings, as
+ *  well as the array of submission queue entries (SQEs), are allocated
+ *  by the kernel and mmap()ed by the application, so neither side has
+ *  to copy request descriptors around.  The SQ ring is only read by the
+ *  kernel and only written by the application; the CQ ring is the other
+ *  way around.  Each side publishes its index with release semantics
+ *  and reads the other one's with acquire semantics.
+ *
+ *  Requests are issued from io_uring_enter(), or from a kernel thread
+ *  polling the SQ ring if the ring was set up with IORING_SETUP_SQPOLL.
+ *  In the latter case io_uring_enter() is only needed to wake the thread
+ *  once it has gone idle, or to wait for completions.
+ *
+ *  O_DIRECT reads and writes are issued inline with an asynchronous
+ *  kiocb and complete through ->ki_complete.  Everything that may block
+ *  for the duration of the request (buffered I/O, fsync) is handed to a
+ *  per-ring workqueue, which borrows the submitter's mm and credentials.
+ *
+ *  Rings set up with IORING_SETUP_IOPOLL only accept O_DIRECT I/O.  A task
+ *  waiting for their completions spins on the blk-mq hardware queue the
+ *  I/O was submitted to, through blk_poll(), instead of sleeping for the
+ *  interrupt.  The queue has to have polling enabled in sysfs.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/errno.h>
+#include <linux/syscalls.h>
+#include <linux/compat.h>
+#include <linux/uio.h>
+
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/mmu_context.h>
+#include <linux/percpu-refcount.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/kthread.h>
+#include <linux/blkdev.h>
+#include <linux/anon_inodes.h>
+#include <linux/aio.h>
+#include <linux/poll.h>
+#include <linux/cred.h>
+#include <linux/log2.h>
+
+#include <asm/uaccess.h>
+
+#include <uapi/linux/io_uring.h>
+
+#include "internal.h"
+
+#define IORING_MAX_ENTRIES	4096
+
+/* default time the SQ thread spins before it goes to sleep, in msecs */
+#define IORING_SQ_THREAD_IDLE	1000
+
+struct io_uring {
+	u32 head ____cacheline_aligned_in_smp;
+	u32 tail ____cacheline_aligned_in_smp;
+};
+
+struct io_sq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			dropped;
+	u32			flags;
+	u32			array[];
+};
+
+struct io_cq_ring {
+	struct io_uring		r;
+	u32			ring_mask;
+	u32			ring_entries;
+	u32			overflow;
+	struct io_uring_cqe	cqes[];
+};
+
+struct io_ring_ctx {
+	struct percpu_ref	refs;
+	struct completion	ctx_done;
+
+	unsigned int		flags;
+	bool			compat;
+
+	/* SQ ring, only touched by the submitter */
+	struct io_sq_ring	*sq_ring;
+	size_t			sq_ring_size;
+	unsigned		cached_sq_head;
+	unsigned		sq_entries;
+	unsigned		sq_mask;
+	struct io_uring_sqe	*sq_sqes;
+	size_t			sq_sqes_size;
+
+	/* submission context */
+	struct mm_struct	*sqo_mm;
+	const struct cred	*creds;
+	struct workqueue_struct	*sqo_wq;
+	struct task_struct	*sqo_thread;
+	wait_queue_head_t	sqo_wait;
+	unsigned long		sq_thread_idle;
+	struct mutex		uring_lock;
+
+	/* CQ ring, filled from completion context */
+	struct io_cq_ring	*cq_ring;
+	size_t			cq_ring_size;
+	unsigned		cached_cq_tail;
+	unsigned		cq_entries;
+	unsigned		cq_mask;
+	spinlock_t		completion_lock ____cacheline_aligned_in_smp;
+	wait_queue_head_t	wait;
+
+	/* queue the last IOPOLL request went to, under completion_lock */
+	struct request_queue	*poll_q;
+};
+
+struct io_kiocb {
+	struct kiocb		rw;
+	struct io_ring_ctx	*ctx;
+	struct io_uring_sqe	sqe;
+	struct work_struct	work;
+};
+
+static struct kmem_cache *req_cachep;
+
+static const struct file_operations io_uring_fops;
+
+static void io_ring_ctx_ref_free(struct percpu_ref *ref)
+{
+	struct io_ring_ctx *ctx = container_of(ref, struct io_ring_ctx, refs);
+
+	complete(&ctx->ctx_done);
+}
+
+static unsigned io_cqring_events(struct io_cq_ring *ring)
+{
+	/* See the comment in io_cqring_fill_event() */
+	smp_rmb();
+	return READ_ONCE(ring->r.tail) - READ_ONCE(ring->r.head);
+}
+
+static void io_cqring_fill_event(struct io_ring_ctx *ctx, u64 user_data,
+				 long res)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	struct io_uring_cqe *cqe;
+	unsigned tail;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+
+	/*
+	 * If the application hasn't made room yet, the event is dropped
+	 * and accounted in the overflow counter.  The head is read with
+	 * acquire semantics, so we don't overwrite an entry the
+	 * application is still looking at.
+	 */
+	tail = ctx->cached_cq_tail;
+	if (tail - smp_load_acquire(&ring->r.head) == ring->ring_entries) {
+		WRITE_ONCE(ring->overflow, ring->overflow + 1);
+	} else {
+		cqe = &ring->cqes[tail & ctx->cq_mask];
+		WRITE_ONCE(cqe->user_data, user_data);
+		WRITE_ONCE(cqe->res, res);
+		WRITE_ONCE(cqe->flags, 0);
+		ctx->cached_cq_tail++;
+		/* order the cqe stores against the tail update */
+		smp_store_release(&ring->r.tail, ctx->cached_cq_tail);
+	}
+
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	/* pairs with set_current_state() in io_cqring_wait() */
+	smp_mb();
+	if (waitqueue_active(&ctx->wait))
+		wake_up(&ctx->wait);
+}
+
+static struct io_kiocb *io_get_req(struct io_ring_ctx *ctx)
+{
+	struct io_kiocb *req;
+
+	req = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (!req)
+		return NULL;
+
+	percpu_ref_get(&ctx->refs);
+	req->ctx = ctx;
+	req->rw.ki_filp = NULL;
+	return req;
+}
+
+static void io_free_req(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (req->rw.ki_filp)
+		fput(req->rw.ki_filp);
+	kmem_cache_free(req_cachep, req);
+	percpu_ref_put(&ctx->refs);
+}
+
+static void io_complete_req(struct io_kiocb *req, long res)
+{
+	/*
+	 * There's no way to restart the request, the application only
+	 * sees its completion.
+	 */
+	if (unlikely(res == -ERESTARTSYS || res == -ERESTARTNOINTR ||
+		     res == -ERESTARTNOHAND || res == -ERESTART_RESTARTBLOCK))
+		res = -EINTR;
+
+	io_cqring_fill_event(req->ctx, req->sqe.user_data, res);
+	io_free_req(req);
+}
+
+/*
+ * ->ki_complete for reads and writes, called by aio_complete() from the
+ * completion path of the file, possibly in interrupt context.
+ */
+static void io_complete_rw(struct kiocb *kiocb, long res, long res2)
+{
+	struct io_kiocb *req = container_of(kiocb, struct io_kiocb, rw);
+
+	io_complete_req(req, res);
+}
+
+static struct request_queue *io_file_queue(struct file *file)
+{
+	struct inode *inode = file_inode(file);
+	struct block_device *bdev;
+
+	if (S_ISBLK(inode->i_mode))
+		bdev = I_BDEV(inode);
+	else
+		bdev = inode->i_sb->s_bdev;
+
+	return bdev ? bdev_get_queue(bdev) : NULL;
+}
+
+/*
+ * Remember which queue polled I/O went to last, so that a waiter knows
+ * where to look for completions.  The queue is pinned while it is
+ * remembered.
+ */
+static void io_set_poll_queue(struct io_ring_ctx *ctx, struct file *file)
+{
+	struct request_queue *q = io_file_queue(file);
+	struct request_queue *old;
+
+	if (!q || q == READ_ONCE(ctx->poll_q) || !blk_get_queue(q))
+		return;
+
+	spin_lock_irq(&ctx->completion_lock);
+	old = ctx->poll_q;
+	ctx->poll_q = q;
+	spin_unlock_irq(&ctx->completion_lock);
+
+	if (old)
+		blk_put_queue(old);
+}
+
+typedef ssize_t (io_rw_op)(struct kiocb *, const struct iovec *,
+			   unsigned long, loff_t);
+typedef ssize_t (io_iter_op)(struct kiocb *, struct iov_iter *);
+
+/*
+ * Issue a read or write.  Returns -EIOCBQUEUED if the file will call
+ * ->ki_complete later, the result of the request otherwise.
+ */
+static ssize_t io_issue_rw(struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	struct kiocb *kiocb = &req->rw;
+	struct file *file = kiocb->ki_filp;
+	struct iovec inline_vecs[UIO_FASTIOV], *iovec = inline_vecs;
+	void __user *buf = (void __user *) (unsigned long) sqe->addr;
+	struct iov_iter iter;
+	io_rw_op *rw_op;
+	io_iter_op *iter_op;
+	fmode_t mode;
+	ssize_t ret;
+	int rw;
+
+	if (sqe->opcode == IORING_OP_READV) {
+		mode	= FMODE_READ;
+		rw	= READ;
+		rw_op	= file->f_op->aio_read;
+		iter_op	= file->f_op->read_iter;
+	} else {
+		mode	= FMODE_WRITE;
+		rw	= WRITE;
+		rw_op	= file->f_op->aio_write;
+		iter_op	= file->f_op->write_iter;
+	}
+
+	if (unlikely(!(file->f_mode & mode)))
+		return -EBADF;
+	if (!rw_op && !iter_op)
+		return -EINVAL;
+	if (kiocb->ki_pos < 0)
+		return -EINVAL;
+
+#ifdef CONFIG_COMPAT
+	if (req->ctx->compat)
+		ret = compat_rw_copy_check_uvector(rw,
+				(struct compat_iovec __user *) buf,
+				sqe->len, UIO_FASTIOV, iovec, &iovec);
+	else
+#endif
+		ret = rw_copy_check_uvector(rw, (struct iovec __user *) buf,
+				sqe->len, UIO_FASTIOV, iovec, &iovec);
+	if (ret >= 0)
+		ret = rw_verify_area(rw, file, &kiocb->ki_pos, ret);
+	if (ret < 0)
+		goto out;
+
+	kiocb->ki_nbytes = ret;
+
+	if (rw == WRITE)
+		file_start_write(file);
+
+	if (iter_op) {
+		iov_iter_init(&iter, rw, iovec, sqe->len, kiocb->ki_nbytes);
+		ret = iter_op(kiocb, &iter);
+	} else {
+		ret = rw_op(kiocb, iovec, sqe->len, kiocb->ki_pos);
+	}
+
+	if (rw == WRITE)
+		file_end_write(file);
+out:
+	if (iovec != inline_vecs)
+		kfree(iovec);
+	return ret;
+}
+
+static int io_issue_fsync(struct io_kiocb *req)
+{
+	const struct io_uring_sqe *sqe = &req->sqe;
+	loff_t end = sqe->off + sqe->len;
+
+	if (!sqe->len || end < sqe->off)
+		end = LLONG_MAX;
+	else
+		end--;
+
+	return vfs_fsync_range(req->rw.ki_filp, sqe->off, end,
+			       sqe->fsync_flags & IORING_FSYNC_DATASYNC);
+}
+
+/*
+ * Runs requests that were punted by io_submit_sqe() because they would
+ * block the submitter.  The worker takes on the submitter's mm, so that
+ * user addresses in the request resolve, and its credentials.
+ */
+static void io_sq_wq_submit_work(struct work_struct *work)
+{
+	struct io_kiocb *req = container_of(work, struct io_kiocb, work);
+	struct io_ring_ctx *ctx = req->ctx;
+	struct mm_struct *mm = ctx->sqo_mm;
+	const struct cred *old_cred;
+	mm_segment_t old_fs;
+	ssize_t ret;
+
+	/* the owner is exiting, its address space is going away */
+	if (!atomic_inc_not_zero(&mm->mm_users)) {
+		io_complete_req(req, -EFAULT);
+		return;
+	}
+
+	old_cred = override_creds(ctx->creds);
+	use_mm(mm);
+	old_fs = get_fs();
+	set_fs(USER_DS);
+
+	if (req->sqe.opcode == IORING_OP_FSYNC)
+		ret = io_issue_fsync(req);
+	else
+		ret = io_issue_rw(req);
+
+	set_fs(old_fs);
+	unuse_mm(mm);
+	mmput(mm);
+	revert_creds(old_cred);
+
+	if (ret != -EIOCBQUEUED)
+		io_complete_req(req, ret);
+}
+
+static int io_submit_sqe(struct io_ring_ctx *ctx,
+			 const struct io_uring_sqe *sqe)
+{
+	struct io_kiocb *req;
+	struct file *file;
+	ssize_t ret;
+
+	req = io_get_req(ctx);
+	if (!req)
+		return -EAGAIN;
+
+	/*
+	 * The application may rewrite the SQE at any time, everything
+	 * below only looks at our copy.
+	 */
+	memcpy(&req->sqe, sqe, sizeof(*sqe));
+	sqe = &req->sqe;
+
+	ret = -EINVAL;
+	if (unlikely(sqe->flags))
+		goto err;
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+		io_complete_req(req, 0);
+		return 0;
+	case IORING_OP_READV:
+	case IORING_OP_WRITEV:
+		break;
+	case IORING_OP_FSYNC:
+		if (unlikely(ctx->flags & IORING_SETUP_IOPOLL))
+			goto err;
+		if (unlikely(sqe->fsync_flags & ~IORING_FSYNC_DATASYNC))
+			goto err;
+		break;
+	default:
+		goto err;
+	}
+
+	ret = -EBADF;
+	file = fget(sqe->fd);
+	if (!file)
+		goto err;
+
+	req->rw = (struct kiocb) {
+		.ki_filp	= file,
+		.ki_pos		= sqe->off,
+		.ki_complete	= io_complete_rw,
+		.ki_user_data	= sqe->user_data,
+	};
+
+	if (ctx->flags & IORING_SETUP_IOPOLL) {
+		ret = -EINVAL;
+		if (!(file->f_flags & O_DIRECT))
+			goto err;
+		io_set_poll_queue(ctx, file);
+	}
+
+	/*
+	 * Direct I/O only blocks the submitter for as long as it takes to
+	 * get the bios out, so it is issued right here.
+	 */
+	if (sqe->opcode != IORING_OP_FSYNC && (file->f_flags & O_DIRECT)) {
+		ret = io_issue_rw(req);
+		if (ret != -EIOCBQUEUED)
+			io_complete_req(req, ret);
+		return 0;
+	}
+
+	INIT_WORK(&req->work, io_sq_wq_submit_work);
+	queue_work(ctx->sqo_wq, &req->work);
+	return 0;
+err:
+	io_free_req(req);
+	return ret;
+}
+
+static unsigned io_sqring_entries(struct io_ring_ctx *ctx)
+{
+	return smp_load_acquire(&ctx->sq_ring->r.tail) - ctx->cached_sq_head;
+}
+
+/*
+ * Fetch the next SQE the application has queued.  The SQ ring array
+ * holds indices into the SQE array; invalid ones are skipped and
+ * accounted in the dropped counter.
+ */
+static const struct io_uring_sqe *io_get_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+	unsigned head;
+
+	while (io_sqring_entries(ctx)) {
+		head = READ_ONCE(ring->array[ctx->cached_sq_head & ctx->sq_mask]);
+		ctx->cached_sq_head++;
+		if (head < ctx->sq_entries)
+			return &ctx->sq_sqes[head];
+		WRITE_ONCE(ring->dropped, ring->dropped + 1);
+	}
+
+	return NULL;
+}
+
+static void io_commit_sqring(struct io_ring_ctx *ctx)
+{
+	struct io_sq_ring *ring = ctx->sq_ring;
+
+	/*
+	 * The SQEs up to the new head have been consumed, the application
+	 * may reuse their slots.
+	 */
+	if (ring->r.head != ctx->cached_sq_head)
+		smp_store_release(&ring->r.head, ctx->cached_sq_head);
+}
+
+/*
+ * Submit up to @to_submit entries.  A request that fails before it could
+ * be issued gets an error completion, it still counts as submitted.
+ */
+static int io_submit_sqes(struct io_ring_ctx *ctx, unsigned to_submit)
+{
+	const struct io_uring_sqe *sqe;
+	int submitted = 0;
+	int ret;
+
+	while (submitted < to_submit) {
+		sqe = io_get_sqring(ctx);
+		if (!sqe)
+			break;
+
+		ret = io_submit_sqe(ctx, sqe);
+		if (ret)
+			io_cqring_fill_event(ctx, READ_ONCE(sqe->user_data), ret);
+		submitted++;
+	}
+
+	io_commit_sqring(ctx);
+	return submitted;
+}
+
+static int io_sq_thread(void *data)
+{
+	struct io_ring_ctx *ctx = data;
+	struct mm_struct *mm = ctx->sqo_mm;
+	const struct cred *old_cred;
+	unsigned long timeout;
+	mm_segment_t old_fs;
+	bool mm_used = false;
+	DEFINE_WAIT(wait);
+
+	old_fs = get_fs();
+	set_fs(USER_DS);
+	old_cred = override_creds(ctx->creds);
+
+	timeout = jiffies + ctx->sq_thread_idle;
+	while (!kthread_should_stop()) {
+		if (io_sqring_entries(ctx)) {
+			/*
+			 * The mm is only borrowed while there is work, an
+			 * idle ring must not keep its owner's address space
+			 * alive.
+			 */
+			if (!mm_used) {
+				if (!atomic_inc_not_zero(&mm->mm_users))
+					break;
+				use_mm(mm);
+				mm_used = true;
+			}
+			io_submit_sqes(ctx, ctx->sq_entries);
+			timeout = jiffies + ctx->sq_thread_idle;
+			cond_resched();
+			continue;
+		}
+
+		if (time_before(jiffies, timeout) && !need_resched()) {
+			cpu_relax();
+			continue;
+		}
+
+		if (mm_used) {
+			unuse_mm(mm);
+			mmput(mm);
+			mm_used = false;
+		}
+
+		if (time_before(jiffies, timeout)) {
+			cond_resched();
+			continue;
+		}
+
+		prepare_to_wait(&ctx->sqo_wait, &wait, TASK_INTERRUPTIBLE);
+
+		/* tell the application to wake us up with io_uring_enter() */
+		ctx->sq_ring->flags |= IORING_SQ_NEED_WAKEUP;
+		/* pairs with the barrier the application needs before it
+		 * checks the flag after updating the tail */
+		smp_mb();
+
+		if (!io_sqring_entries(ctx) && !kthread_should_stop())
+			schedule();
+
+		finish_wait(&ctx->sqo_wait, &wait);
+		ctx->sq_ring->flags &= ~IORING_SQ_NEED_WAKEUP;
+		timeout = jiffies + ctx->sq_thread_idle;
+	}
+
+	if (mm_used) {
+		unuse_mm(mm);
+		mmput(mm);
+	}
+	revert_creds(old_cred);
+	set_fs(old_fs);
+
+	/* wait for kthread_stop() if the owner's mm went away under us */
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+/*
+ * For IORING_SETUP_IOPOLL rings, spin on the queue the last request went
+ * to instead of sleeping.  As with dio_await_one(), the caller has set
+ * its task state and rechecks its wait condition afterwards.
+ */
+static bool io_iopoll_wait(struct io_ring_ctx *ctx, bool hybrid)
+{
+	struct request_queue *q;
+	bool ret;
+
+	if (!(ctx->flags & IORING_SETUP_IOPOLL))
+		return false;
+
+	spin_lock_irq(&ctx->completion_lock);
+	q = ctx->poll_q;
+	if (q && !blk_get_queue(q))
+		q = NULL;
+	spin_unlock_irq(&ctx->completion_lock);
+	if (!q)
+		return false;
+
+	ret = blk_poll(q, hybrid);
+	blk_put_queue(q);
+	return ret;
+}
+
+/*
+ * Wait until at least @min_events completions are available in the CQ
+ * ring, or a signal arrives.
+ */
+static int io_cqring_wait(struct io_ring_ctx *ctx, unsigned min_events,
+			  const sigset_t __user *sig, size_t sigsz)
+{
+	struct io_cq_ring *ring = ctx->cq_ring;
+	sigset_t ksigmask, sigsaved;
+	bool hybrid = true;
+	DEFINE_WAIT(wait);
+	int ret = 0;
+
+	if (io_cqring_events(ring) >= min_events)
+		return 0;
+
+	if (sig) {
+		if (sigsz != sizeof(sigset_t))
+			return -EINVAL;
+		if (copy_from_user(&ksigmask, sig, sizeof(ksigmask)))
+			return -EFAULT;
+		sigsaved = current->blocked;
+		set_current_blocked(&ksigmask);
+	}
+
+	for (;;) {
+		prepare_to_wait(&ctx->wait, &wait, TASK_INTERRUPTIBLE);
+		if (io_cqring_events(ring) >= min_events)
+			break;
+		if (signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+		if (!io_iopoll_wait(ctx, hybrid))
+			schedule();
+		hybrid = false;
+	}
+	finish_wait(&ctx->wait, &wait);
+
+	/*
+	 * As in epoll_pwait(), the original signal mask is only restored
+	 * after the signal has been delivered.
+	 */
+	if (sig) {
+		if (ret == -EINTR) {
+			memcpy(&current->saved_sigmask, &sigsaved,
+			       sizeof(sigsaved));
+			set_restore_sigmask();
+		} else
+			set_current_blocked(&sigsaved);
+	}
+
+	return ret;
+}
+
+static void *io_mem_alloc(size_t size)
+{
+	gfp_t gfp = GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN;
+
+	return (void *) __get_free_pages(gfp, get_order(size));
+}
+
+static void io_mem_free(void *ptr, size_t size)
+{
+	if (ptr)
+		free_pages((unsigned long) ptr, get_order(size));
+}
+
+static void io_ring_ctx_free(struct io_ring_ctx *ctx)
+{
+	if (ctx->sqo_wq)
+		destroy_workqueue(ctx->sqo_wq);
+	if (ctx->sqo_mm)
+		mmdrop(ctx->sqo_mm);
+	if (ctx->creds)
+		put_cred(ctx->creds);
+	if (ctx->poll_q)
+		blk_put_queue(ctx->poll_q);
+
+	io_mem_free(ctx->sq_ring, ctx->sq_ring_size);
+	io_mem_free(ctx->sq_sqes, ctx->sq_sqes_size);
+	io_mem_free(ctx->cq_ring, ctx->cq_ring_size);
+
+	percpu_ref_exit(&ctx->refs);
+	kfree(ctx);
+}
+
+static void io_ring_ctx_wait_and_kill(struct io_ring_ctx *ctx)
+{
+	if (ctx->sqo_thread)
+		kthread_stop(ctx->sqo_thread);
+
+	mutex_lock(&ctx->uring_lock);
+	percpu_ref_kill(&ctx->refs);
+	mutex_unlock(&ctx->uring_lock);
+
+	/* in-flight requests still point into the rings and the mm */
+	wait_for_completion(&ctx->ctx_done);
+	io_ring_ctx_free(ctx);
+}
+
+static int io_uring_release(struct inode *inode, struct file *file)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+
+	file->private_data = NULL;
+	io_ring_ctx_wait_and_kill(ctx);
+	return 0;
+}
+
+static unsigned int io_uring_poll(struct file *file, poll_table *wait)
+{
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &ctx->wait, wait);
+	/* See comment at the top of this file */
+	smp_rmb();
+	if (READ_ONCE(ctx->sq_ring->r.tail) - ctx->cached_sq_head !=
+	    ctx->sq_entries)
+		mask |= POLLOUT | POLLWRNORM;
+	if (READ_ONCE(ctx->cq_ring->r.head) != ctx->cached_cq_tail)
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
+static int io_uring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	loff_t offset = (loff_t) vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long sz = vma->vm_end - vma->vm_start;
+	struct io_ring_ctx *ctx = file->private_data;
+	unsigned long pfn;
+	size_t size;
+	void *ptr;
+
+	switch (offset) {
+	case IORING_OFF_SQ_RING:
+		ptr = ctx->sq_ring;
+		size = ctx->sq_ring_size;
+		break;
+	case IORING_OFF_SQES:
+		ptr = ctx->sq_sqes;
+		size = ctx->sq_sqes_size;
+		break;
+	case IORING_OFF_CQ_RING:
+		ptr = ctx->cq_ring;
+		size = ctx->cq_ring_size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (sz > PAGE_ALIGN(size))
+		return -EINVAL;
+
+	pfn = virt_to_phys(ptr) >> PAGE_SHIFT;
+	return remap_pfn_range(vma, vma->vm_start, pfn, sz, vma->vm_page_prot);
+}
+
+SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
+		u32, min_complete, u32, flags, const sigset_t __user *, sig,
+		size_t, sigsz)
+{
+	struct io_ring_ctx *ctx;
+	long ret = -EBADF;
+	int submitted = 0;
+	struct fd f;
+
+	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP))
+		return -EINVAL;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	ret = -EOPNOTSUPP;
+	if (f.file->f_op != &io_uring_fops)
+		goto out_fput;
+
+	ret = -ENXIO;
+	ctx = f.file->private_data;
+	if (!percpu_ref_tryget_live(&ctx->refs))
+		goto out_fput;
+
+	/*
+	 * With an SQ thread the application only calls in to wake it up,
+	 * it consumes the SQ ring on its own.
+	 */
+	ret = 0;
+	if (ctx->flags & IORING_SETUP_SQPOLL) {
+		if (flags & IORING_ENTER_SQ_WAKEUP)
+			wake_up(&ctx->sqo_wait);
+		submitted = to_submit;
+	} else if (to_submit) {
+		to_submit = min(to_submit, ctx->sq_entries);
+
+		mutex_lock(&ctx->uring_lock);
+		submitted = io_submit_sqes(ctx, to_submit);
+		mutex_unlock(&ctx->uring_lock);
+	}
+
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = min(min_complete, ctx->cq_entries);
+		ret = io_cqring_wait(ctx, min_complete, sig, sigsz);
+	}
+
+	percpu_ref_put(&ctx->refs);
+out_fput:
+	fdput(f);
+	return submitted ? submitted : ret;
+}
+
+static const struct file_operations io_uring_fops = {
+	.release	= io_uring_release,
+	.mmap		= io_uring_mmap,
+	.poll		= io_uring_poll,
+	.llseek		= noop_llseek,
+};
+
+static int io_allocate_rings(struct io_ring_ctx *ctx, struct io_uring_params *p)
+{
+	ctx->sq_ring_size = sizeof(struct io_sq_ring) +
+			    p->sq_entries * sizeof(u32);
+	ctx->sq_ring = io_mem_alloc(ctx->sq_ring_size);
+	if (!ctx->sq_ring)
+		return -ENOMEM;
+
+	ctx->sq_sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sq_sqes = io_mem_alloc(ctx->sq_sqes_size);
+	if (!ctx->sq_sqes)
+		return -ENOMEM;
+
+	ctx->cq_ring_size = sizeof(struct io_cq_ring) +
+			    p->cq_entries * sizeof(struct io_uring_cqe);
+	ctx->cq_ring = io_mem_alloc(ctx->cq_ring_size);
+	if (!ctx->cq_ring)
+		return -ENOMEM;
+
+	ctx->sq_entries = p->sq_entries;
+	ctx->sq_mask = p->sq_entries - 1;
+	ctx->sq_ring->ring_mask = ctx->sq_mask;
+	ctx->sq_ring->ring_entries = ctx->sq_entries;
+
+	ctx->cq_entries = p->cq_entries;
+	ctx->cq_mask = p->cq_entries - 1;
+	ctx->cq_ring->ring_mask = ctx->cq_mask;
+	ctx->cq_ring->ring_entries = ctx->cq_entries;
+	return 0;
+}
+
+static int io_sq_offload_start(struct io_ring_ctx *ctx,
+			       struct io_uring_params *p)
+{
+	int cpu;
+
+	ctx->sqo_wq = alloc_workqueue("io_ring-wq", WQ_UNBOUND | WQ_FREEZABLE,
+			min(ctx->sq_entries - 1, 2 * num_online_cpus()));
+	if (!ctx->sqo_wq)
+		return -ENOMEM;
+
+	if (!(ctx->flags & IORING_SETUP_SQPOLL))
+		return 0;
+
+	/* a spinning kernel thread per ring is not for everybody */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle ?:
+					       IORING_SQ_THREAD_IDLE);
+
+	if (ctx->flags & IORING_SETUP_SQ_AFF) {
+		cpu = p->sq_thread_cpu;
+		if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+			return -EINVAL;
+		ctx->sqo_thread = kthread_create_on_cpu(io_sq_thread, ctx, cpu,
+							"io_uring-sq/%u");
+	} else {
+		ctx->sqo_thread = kthread_create(io_sq_thread, ctx,
+						 "io_uring-sq");
+	}
+	if (IS_ERR(ctx->sqo_thread)) {
+		int ret = PTR_ERR(ctx->sqo_thread);
+
+		ctx->sqo_thread = NULL;
+		return ret;
+	}
+
+	wake_up_process(ctx->sqo_thread);
+	return 0;
+}
+
+static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
+{
+	struct io_ring_ctx *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return NULL;
+
+	if (percpu_ref_init(&ctx->refs, io_ring_ctx_ref_free, 0, GFP_KERNEL)) {
+		kfree(ctx);
+		return NULL;
+	}
+
+	ctx->flags = p->flags;
+	ctx->compat = is_compat_task();
+	init_completion(&ctx->ctx_done);
+	init_waitqueue_head(&ctx->wait);
+	init_waitqueue_head(&ctx->sqo_wait);
+	spin_lock_init(&ctx->completion_lock);
+	mutex_init(&ctx->uring_lock);
+
+	/* pinned, the mm may be gone by the time a request runs */
+	atomic_inc(&current->mm->mm_count);
+	ctx->sqo_mm = current->mm;
+	ctx->creds = get_current_cred();
+	return ctx;
+}
+
+static int io_uring_create(unsigned entries, struct io_uring_params *p,
+			   struct io_uring_params __user *params)
+{
+	struct io_ring_ctx *ctx;
+	struct file *file;
+	int ret, fd;
+
+	if (!entries || entries > IORING_MAX_ENTRIES)
+		return -EINVAL;
+
+	/*
+	 * Use twice as many entries for the CQ ring.  Completions are only
+	 * dropped if the application lets it fill up, which is unlikely to
+	 * happen while it isn't submitting more than the SQ ring holds.
+	 */
+	p->sq_entries = roundup_pow_of_two(entries);
+	p->cq_entries = 2 * p->sq_entries;
+
+	ctx = io_ring_ctx_alloc(p);
+	if (!ctx)
+		return -ENOMEM;
+
+	ret = io_allocate_rings(ctx, p);
+	if (!ret)
+		ret = io_sq_offload_start(ctx, p);
+	if (ret)
+		goto err;
+
+	memset(&p->sq_off, 0, sizeof(p->sq_off));
+	p->sq_off.head = offsetof(struct io_sq_ring, r.head);
+	p->sq_off.tail = offsetof(struct io_sq_ring, r.tail);
+	p->sq_off.ring_mask = offsetof(struct io_sq_ring, ring_mask);
+	p->sq_off.ring_entries = offsetof(struct io_sq_ring, ring_entries);
+	p->sq_off.flags = offsetof(struct io_sq_ring, flags);
+	p->sq_off.dropped = offsetof(struct io_sq_ring, dropped);
+	p->sq_off.array = offsetof(struct io_sq_ring, array);
+
+	memset(&p->cq_off, 0, sizeof(p->cq_off));
+	p->cq_off.head = offsetof(struct io_cq_ring, r.head);
+	p->cq_off.tail = offsetof(struct io_cq_ring, r.tail);
+	p->cq_off.ring_mask = offsetof(struct io_cq_ring, ring_mask);
+	p->cq_off.ring_entries = offsetof(struct io_cq_ring, ring_entries);
+	p->cq_off.overflow = offsetof(struct io_cq_ring, overflow);
+	p->cq_off.cqes = offsetof(struct io_cq_ring, cqes);
+
+	fd = get_unused_fd_flags(O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		ret = fd;
+		goto err;
+	}
+
+	file = anon_inode_getfile("[io_uring]", &io_uring_fops, ctx,
+				  O_RDWR | O_CLOEXEC);
+	if (IS_ERR(file)) {
+		put_unused_fd(fd);
+		ret = PTR_ERR(file);
+		goto err;
+	}
+
+	/* the ring is torn down by ->release from here on */
+	if (copy_to_user(params, p, sizeof(*p))) {
+		put_unused_fd(fd);
+		fput(file);
+		return -EFAULT;
+	}
+
+	fd_install(fd, file);
+	return fd;
+err:
+	io_ring_ctx_wait_and_kill(ctx);
+	return ret;
+}
+
+/*
+ * Sets up an io_uring context, and returns the fd.  Applications ask for
+ * a ring size, we return the actual sq/cq ring sizes (among other
+ * things) in the params structure passed in.
+ */
+SYSCALL_DEFINE2(io_uring_setup, u32, entries,
+		struct io_uring_params __user *, params)
+{
+	struct io_uring_params p;
+	int i;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(p.resv); i++) {
+		if (p.resv[i])
+			return -EINVAL;
+	}
+
+	if (p.flags & ~(IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL |
+			IORING_SETUP_SQ_AFF))
+		return -EINVAL;
+	if ((p.flags & IORING_SETUP_SQ_AFF) && !(p.flags & IORING_SETUP_SQPOLL))
+		return -EINVAL;
+
+	return io_uring_create(entries, &p, params);
+}
+
+static int __init io_uring_init(void)
+{
+	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
+	return 0;
+}
+__initcall(io_uring_init);
@@ -41,6 +41,7 @@
 #include <linux/log2.h>
 #include <linux/vmalloc.h>
 #include <linux/backing-dev.h>
+#include <linux/blkdev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
 
@@ -754,6 +755,207 @@ wait_commit:
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commits:
+ *
+ * Instead of committing the running transaction, a client can write a
+ * few blocks of its own format to the fast commit area, describing the
+ * changes it needs on disk.  They are only meaningful until the
+ * transaction they were written for commits in full, which resets the
+ * area.  Recovery passes them to j_fc_replay_callback after replaying
+ * the log, when they belong to the first transaction that did not
+ * commit.  So a fast commit cannot be written while a full commit is
+ * running, nor for a transaction that is not the running one.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit is written for.
+ *
+ * Returns 0 when the caller may write a fast commit, which it must finish
+ * with jbd2_fc_end_commit().  -EALREADY means @tid has committed in the
+ * meantime.  Any other error means a fast commit isn't possible now and
+ * the caller has to wait for a full commit of @tid instead.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	int err = 0;
+
+	if (!journal->j_fc_wbuf)
+		return -EOPNOTSUPP;
+
+	write_lock(&journal->j_state_lock);
+	while (journal->j_flags &
+	       (JBD2_FAST_COMMIT_ONGOING | JBD2_FULL_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+
+	if (tid_geq(journal->j_commit_sequence, tid)) {
+		err = -EALREADY;
+		goto out;
+	}
+	if (is_journal_aborted(journal)) {
+		err = -EIO;
+		goto out;
+	}
+	/*
+	 * Recovery doesn't look at the fast commit area while the on-disk
+	 * superblock says the log is empty, which it does until the first
+	 * commit after a mount or a flush.
+	 */
+	if ((journal->j_flags & JBD2_FLUSHED) ||
+	    !journal->j_running_transaction ||
+	    journal->j_running_transaction->t_tid != tid) {
+		err = -EAGAIN;
+		goto out;
+	}
+
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	journal->j_fc_start = journal->j_fc_off;
+out:
+	write_unlock(&journal->j_state_lock);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * int jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal to act on.
+ * @bh_out: Returns a zeroed, uptodate buffer for the block.
+ *
+ * The buffer is owned by the journal until jbd2_fc_end_commit().
+ * Returns -ENOSPC when the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	struct buffer_head *bh;
+	unsigned long long blocknr;
+	unsigned long off;
+	int err;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	write_lock(&journal->j_state_lock);
+	off = journal->j_fc_off;
+	if (journal->j_fc_first + off >= journal->j_fc_last) {
+		write_unlock(&journal->j_state_lock);
+		return -ENOSPC;
+	}
+	journal->j_fc_wbuf[off] = NULL;
+	journal->j_fc_off++;
+	write_unlock(&journal->j_state_lock);
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + off, &blocknr);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_wbuf[off] = bh;
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+static void jbd2_fc_submit_buf(struct buffer_head *bh, int write_op)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	get_bh(bh);
+	submit_bh(write_op, bh);
+}
+
+static int jbd2_fc_wait_buf(struct buffer_head *bh)
+{
+	wait_on_buffer(bh);
+	return buffer_uptodate(bh) ? 0 : -EIO;
+}
+
+/**
+ * int jbd2_fc_write_bufs() - write out the fast commit in progress
+ * @journal: Journal to act on.
+ *
+ * The last block obtained from jbd2_fc_get_buf() is expected to hold the
+ * client's commit record, so it is only written once the others are on
+ * disk.  With barriers it is written with a cache flush and FUA, which
+ * also makes the data the client wrote before the fast commit durable.
+ */
+int jbd2_fc_write_bufs(journal_t *journal)
+{
+	unsigned long i, last = journal->j_fc_off - 1;
+	int err = 0, err2;
+
+	J_ASSERT(journal->j_fc_off > journal->j_fc_start);
+
+	for (i = journal->j_fc_start; i < last; i++)
+		jbd2_fc_submit_buf(journal->j_fc_wbuf[i], WRITE_SYNC);
+	for (i = journal->j_fc_start; i < last; i++) {
+		err2 = jbd2_fc_wait_buf(journal->j_fc_wbuf[i]);
+		if (!err)
+			err = err2;
+	}
+	if (err)
+		return err;
+
+	if (!(journal->j_flags & JBD2_BARRIER)) {
+		jbd2_fc_submit_buf(journal->j_fc_wbuf[last], WRITE_SYNC);
+		return jbd2_fc_wait_buf(journal->j_fc_wbuf[last]);
+	}
+
+	/* The flush below only covers the journal device */
+	if (journal->j_fs_dev != journal->j_dev) {
+		err = blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		if (err)
+			return err;
+	}
+	jbd2_fc_submit_buf(journal->j_fc_wbuf[last], WRITE_FLUSH_FUA);
+	return jbd2_fc_wait_buf(journal->j_fc_wbuf[last]);
+}
+EXPORT_SYMBOL(jbd2_fc_write_bufs);
+
+/**
+ * void jbd2_fc_end_commit() - finish a fast commit
+ * @journal: Journal to act on.
+ * @err: Zero if the fast commit is on disk.
+ *
+ * A failed fast commit gives its blocks back so that the next one
+ * overwrites them: recovery stops at the first block it can't make sense
+ * of, which must not come before a good fast commit.
+ */
+void jbd2_fc_end_commit(journal_t *journal, int err)
+{
+	unsigned long i;
+
+	for (i = journal->j_fc_start; i < journal->j_fc_off; i++) {
+		brelse(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+
+	write_lock(&journal->j_state_lock);
+	if (err)
+		journal->j_fc_off = journal->j_fc_start;
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
 /*
  * Log buffer allocation routines:
  */
@@ -1082,6 +1284,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1278,9 +1481,14 @@ static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
 	unsigned long long first, last;
+	unsigned long num_fc_blks = 0;
+
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		num_fc_blks = journal->j_fc_last - journal->j_fc_first;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - num_fc_blks;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1299,7 +1507,9 @@ static int journal_reset(journal_t *journal)
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
 
-	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+	journal->j_max_transaction_buffers =
+		(journal->j_maxlen - num_fc_blks) / 4;
+	journal->j_fc_off = 0;
 
 	/*
 	 * As a special case, if the on-disk copy is already marked as needing
@@ -1574,6 +1784,37 @@ out:
 	return err;
 }
 
+static unsigned long jbd2_journal_num_fc_blks(journal_superblock_t *sb)
+{
+	unsigned long num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+
+	return num_fc_blks ? num_fc_blks : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
+
+/*
+ * Set aside the fast commit area at the end of the journal.  The log
+ * must not extend into it, so this is done before recovery or, when the
+ * feature is turned on, while the log is empty.
+ */
+static int jbd2_journal_init_fc_area(journal_t *journal)
+{
+	unsigned long num_fc_blks;
+
+	num_fc_blks = jbd2_journal_num_fc_blks(journal->j_superblock);
+	if (journal->j_first + num_fc_blks + JBD2_MIN_JOURNAL_BLOCKS >
+	    journal->j_last + 1) {
+		printk(KERN_ERR "JBD2: Journal too short for %lu fast commit "
+		       "blocks.\n", num_fc_blks);
+		return -EINVAL;
+	}
+
+	journal->j_fc_last = journal->j_last;
+	journal->j_last -= num_fc_blks;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_off = 0;
+	return 0;
+}
+
 /*
  * Load the on-disk journal superblock and read the key fields into the
  * journal_t.
@@ -1596,6 +1837,10 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return jbd2_journal_init_fc_area(journal);
+
 	return 0;
 }
 
@@ -1651,6 +1896,16 @@ int jbd2_journal_load(journal_t *journal)
 		return -EIO;
 	}
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		journal->j_fc_wbuf = kcalloc(journal->j_fc_last -
+					     journal->j_fc_first,
+					     sizeof(struct buffer_head *),
+					     GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+	}
+
 	/* OK, we've finished with the dynamic journal bits:
 	 * reinitialise the dynamic contents of the superblock in memory
 	 * and reset them on disk. */
@@ -1720,6 +1975,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
@@ -1793,6 +2049,50 @@ int jbd2_journal_check_available_features (journal_t *journal, unsigned long com
 	return 0;
 }
 
+/*
+ * Turn on fast commits for a journal.  Once it is loaded, the end of the
+ * log can only move while nothing has been written to it since it was
+ * reset.
+ */
+static int jbd2_journal_enable_fast_commit(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	struct buffer_head **wbuf;
+	unsigned long num_fc_blks;
+	int err = 0;
+
+	if (!sb->s_num_fc_blks)
+		sb->s_num_fc_blks =
+			cpu_to_be32(JBD2_DEFAULT_FAST_COMMIT_BLOCKS);
+	if (!(journal->j_flags & JBD2_LOADED))
+		return 0;
+
+	num_fc_blks = jbd2_journal_num_fc_blks(sb);
+	wbuf = kcalloc(num_fc_blks, sizeof(struct buffer_head *), GFP_KERNEL);
+	if (!wbuf)
+		return -ENOMEM;
+
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_first ||
+	    journal->j_tail != journal->j_first)
+		err = -EBUSY;
+	else
+		err = jbd2_journal_init_fc_area(journal);
+	if (!err) {
+		journal->j_free = journal->j_last - journal->j_first;
+		journal->j_max_transaction_buffers =
+			(journal->j_maxlen - num_fc_blks) / 4;
+		journal->j_fc_wbuf = wbuf;
+	}
+	write_unlock(&journal->j_state_lock);
+
+	if (err)
+		kfree(wbuf);
+	return err;
+}
+
 /**
  * int jbd2_journal_set_features () - Mark a given journal feature in the superblock
  * @journal: Journal to act on.
@@ -1866,6 +2166,12 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 			~cpu_to_be32(JBD2_FEATURE_INCOMPAT_CSUM_V2 |
 				     JBD2_FEATURE_INCOMPAT_CSUM_V3);
 
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+	    jbd2_journal_enable_fast_commit(journal)) {
+		printk(KERN_ERR "JBD2: Cannot enable fast commits.\n");
+		return 0;
+	}
+
 	sb->s_feature_compat    |= cpu_to_be32(compat);
 	sb->s_feature_ro_compat |= cpu_to_be32(ro);
 	sb->s_feature_incompat  |= cpu_to_be32(incompat);
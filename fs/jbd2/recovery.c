@@ -38,7 +38,6 @@ struct recovery_info
 	int		nr_revoke_hits;
 };
 
-enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
@@ -233,6 +232,46 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Hand the fast commit area to the client, one block at a time, until it
+ * has seen all fast commits for the first transaction that didn't make
+ * it to the log.
+ */
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass)
+{
+	unsigned long next_fc_block = journal->j_fc_first;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT) ||
+	    !journal->j_fc_replay_callback)
+		return 0;
+
+	while (next_fc_block < journal->j_fc_last) {
+		jbd_debug(3, "Fast commit replay: pass %d, block %lu\n",
+			  pass, next_fc_block);
+		err = jread(&bh, journal, next_fc_block);
+		if (err)
+			break;
+
+		err = journal->j_fc_replay_callback(journal, bh, pass,
+					next_fc_block - journal->j_fc_first,
+					info->end_transaction);
+		brelse(bh);
+		if (err)
+			break;
+		next_fc_block++;
+	}
+
+	if (err == JBD2_FC_REPLAY_STOP)
+		err = 0;
+	if (err)
+		jbd_debug(1, "JBD2: fast commit replay failed, err %d\n", err);
+	return err;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -243,7 +282,8 @@ do {									\
  * Recovery is done in three passes.  In the first pass, we look for the
  * end of the log.  In the second, we assemble the list of revoke
  * blocks.  In the third and final pass, we replay any un-revoked blocks
- * in the log.
+ * in the log.  Fast commits written after the last complete transaction
+ * are then scanned and replayed on top of it.
  */
 int jbd2_journal_recover(journal_t *journal)
 {
@@ -273,6 +313,10 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = fc_do_one_pass(journal, &info, PASS_SCAN);
+	if (!err)
+		err = fc_do_one_pass(journal, &info, PASS_REPLAY);
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
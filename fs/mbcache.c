@@ -32,19 +32,21 @@
  * Each hash chain of both the block and index hash tables now contains
  * a built-in lock used to serialize accesses to the hash chain.
  *
- * Accesses to global data structures mb_cache_list and mb_cache_lru_list
- * are serialized via the global spinlock mb_cache_spinlock.
+ * Each cache has its own lru list, serialized via the cache's c_lru_lock,
+ * and its own shrinker. The global list of caches, mb_cache_list, is only
+ * walked by mb_cache_shrink() and is serialized via mb_cache_list_mutex.
  *
  * Each mb_cache_entry contains a spinlock, e_entry_lock, to serialize
  * accesses to its local data, such as e_used and e_queued.
  *
  * Lock ordering:
  *
- * Each block hash chain's lock has the highest lock order, followed by an
- * index hash chain's lock, mb_cache_bg_lock (used to implement mb_cache_entry's
- * lock), and mb_cach_spinlock, with the lowest order.  While holding
- * either a block or index hash chain lock, a thread can acquire an
- * mc_cache_bg_lock, which in turn can also acquire mb_cache_spinlock.
+ * mb_cache_list_mutex is taken outside of all the other locks. Each block
+ * hash chain's lock comes next, followed by an index hash chain's lock,
+ * mb_cache_bg_lock (used to implement mb_cache_entry's lock), and the
+ * cache's c_lru_lock, with the lowest order.  While holding either a block
+ * or index hash chain lock, a thread can acquire an mc_cache_bg_lock, which
+ * in turn can also acquire c_lru_lock.
  *
  * Synchronization:
  *
@@ -120,14 +122,12 @@ EXPORT_SYMBOL(mb_cache_entry_find_next);
 #endif
 
 /*
- * Global data: list of all mbcache's, lru list, and a spinlock for
- * accessing cache data structures on SMP machines. The lru list is
- * global across all mbcaches.
+ * Global data: list of all mbcache's, for mb_cache_shrink() to find
+ * the entries of a device in all of them.
  */
 
 static LIST_HEAD(mb_cache_list);
-static LIST_HEAD(mb_cache_lru_list);
-static DEFINE_SPINLOCK(mb_cache_spinlock);
+static DEFINE_MUTEX(mb_cache_list_mutex);
 
 static inline void
 __spin_lock_mb_cache_entry(struct mb_cache_entry *ce)
@@ -217,14 +217,11 @@ __mb_cache_entry_release(struct mb_cache_entry *ce)
 			__spin_unlock_mb_cache_entry(ce);
 			goto forget;
 		}
-		/*
-		 * Need access to lru list, first drop entry lock,
-		 * then reacquire the lock in the proper order.
-		 */
-		spin_lock(&mb_cache_spinlock);
+		spin_lock(&ce->e_cache->c_lru_lock);
 		if (list_empty(&ce->e_lru_list))
-			list_add_tail(&ce->e_lru_list, &mb_cache_lru_list);
-		spin_unlock(&mb_cache_spinlock);
+			list_add_tail(&ce->e_lru_list,
+				      &ce->e_cache->c_lru_list);
+		spin_unlock(&ce->e_cache->c_lru_lock);
 	}
 	__spin_unlock_mb_cache_entry(ce);
 	return;
@@ -239,7 +236,7 @@ forget:
  * This function is called by the kernel memory management when memory
  * gets low.
  *
- * @shrink: (ignored)
+ * @shrink: the shrinker of the cache to shrink
  * @sc: shrink_control passed from reclaim
  *
  * Returns the number of objects freed.
@@ -247,6 +244,8 @@ forget:
 static unsigned long
 mb_cache_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 {
+	struct mb_cache *cache = container_of(shrink, struct mb_cache,
+					      c_shrink);
 	LIST_HEAD(free_list);
 	struct mb_cache_entry *entry, *tmp;
 	int nr_to_scan = sc->nr_to_scan;
@@ -254,15 +253,15 @@ mb_cache_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 	unsigned long freed = 0;
 
 	mb_debug("trying to free %d entries", nr_to_scan);
-	spin_lock(&mb_cache_spinlock);
-	while ((nr_to_scan-- > 0) && !list_empty(&mb_cache_lru_list)) {
+	spin_lock(&cache->c_lru_lock);
+	while ((nr_to_scan-- > 0) && !list_empty(&cache->c_lru_list)) {
 		struct mb_cache_entry *ce =
-			list_entry(mb_cache_lru_list.next,
+			list_entry(cache->c_lru_list.next,
 				struct mb_cache_entry, e_lru_list);
 		list_del_init(&ce->e_lru_list);
 		if (ce->e_used || ce->e_queued || atomic_read(&ce->e_refcnt))
 			continue;
-		spin_unlock(&mb_cache_spinlock);
+		spin_unlock(&cache->c_lru_lock);
 		/* Prevent any find or get operation on the entry */
 		hlist_bl_lock(ce->e_block_hash_p);
 		hlist_bl_lock(ce->e_index_hash_p);
@@ -271,14 +270,14 @@ mb_cache_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 			!list_empty(&ce->e_lru_list)) {
 			hlist_bl_unlock(ce->e_index_hash_p);
 			hlist_bl_unlock(ce->e_block_hash_p);
-			spin_lock(&mb_cache_spinlock);
+			spin_lock(&cache->c_lru_lock);
 			continue;
 		}
 		__mb_cache_entry_unhash_unlock(ce);
 		list_add_tail(&ce->e_lru_list, &free_list);
-		spin_lock(&mb_cache_spinlock);
+		spin_lock(&cache->c_lru_lock);
 	}
-	spin_unlock(&mb_cache_spinlock);
+	spin_unlock(&cache->c_lru_lock);
 
 	list_for_each_entry_safe(entry, tmp, &free_list, e_lru_list) {
 		__mb_cache_entry_forget(entry, gfp_mask);
@@ -290,33 +289,20 @@ mb_cache_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 static unsigned long
 mb_cache_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 {
-	struct mb_cache *cache;
-	unsigned long count = 0;
+	struct mb_cache *cache = container_of(shrink, struct mb_cache,
+					      c_shrink);
 
-	spin_lock(&mb_cache_spinlock);
-	list_for_each_entry(cache, &mb_cache_list, c_cache_list) {
-		mb_debug("cache %s (%d)", cache->c_name,
-			  atomic_read(&cache->c_entry_count));
-		count += atomic_read(&cache->c_entry_count);
-	}
-	spin_unlock(&mb_cache_spinlock);
-
-	return vfs_pressure_ratio(count);
+	mb_debug("cache %s (%d)", cache->c_name,
+		  atomic_read(&cache->c_entry_count));
+	return vfs_pressure_ratio(atomic_read(&cache->c_entry_count));
 }
 
-static struct shrinker mb_cache_shrinker = {
-	.count_objects = mb_cache_shrink_count,
-	.scan_objects = mb_cache_shrink_scan,
-	.seeks = DEFAULT_SEEKS,
-};
-
 /*
  * mb_cache_create()  create a new cache
  *
  * All entries in one cache are equal size. Cache entries may be from
- * multiple devices. If this is the first mbcache created, registers
- * the cache with kernel memory management. Returns NULL if no more
- * memory was available.
+ * multiple devices. Each cache registers its own shrinker with kernel
+ * memory management. Returns NULL if no more memory was available.
  *
  * @name: name of the cache (informal)
  * @bucket_bits: log2(number of hash buckets)
@@ -340,6 +326,8 @@ mb_cache_create(const char *name, int bucket_bits)
 		return NULL;
 	cache->c_name = name;
 	atomic_set(&cache->c_entry_count, 0);
+	INIT_LIST_HEAD(&cache->c_lru_list);
+	spin_lock_init(&cache->c_lru_lock);
 	cache->c_bucket_bits = bucket_bits;
 	cache->c_block_hash = kmalloc(bucket_count *
 		sizeof(struct hlist_bl_head), GFP_KERNEL);
@@ -368,9 +356,15 @@ mb_cache_create(const char *name, int bucket_bits)
 	 */
 	cache->c_max_entries = bucket_count << 4;
 
-	spin_lock(&mb_cache_spinlock);
+	cache->c_shrink.count_objects = mb_cache_shrink_count;
+	cache->c_shrink.scan_objects = mb_cache_shrink_scan;
+	cache->c_shrink.seeks = DEFAULT_SEEKS;
+	if (register_shrinker(&cache->c_shrink))
+		goto fail2;
+
+	mutex_lock(&mb_cache_list_mutex);
 	list_add(&cache->c_cache_list, &mb_cache_list);
-	spin_unlock(&mb_cache_spinlock);
+	mutex_unlock(&mb_cache_list_mutex);
 	return cache;
 
 fail2:
@@ -392,16 +386,16 @@ fail:
  *
  * @bdev: which device's cache entries to shrink
  */
-void
-mb_cache_shrink(struct block_device *bdev)
+static void
+__mb_cache_shrink(struct mb_cache *cache, struct block_device *bdev)
 {
 	LIST_HEAD(free_list);
 	struct list_head *l;
 	struct mb_cache_entry *ce, *tmp;
 
-	l = &mb_cache_lru_list;
-	spin_lock(&mb_cache_spinlock);
-	while (!list_is_last(l, &mb_cache_lru_list)) {
+	l = &cache->c_lru_list;
+	spin_lock(&cache->c_lru_lock);
+	while (!list_is_last(l, &cache->c_lru_list)) {
 		l = l->next;
 		ce = list_entry(l, struct mb_cache_entry, e_lru_list);
 		if (ce->e_bdev == bdev) {
@@ -409,7 +403,7 @@ mb_cache_shrink(struct block_device *bdev)
 			if (ce->e_used || ce->e_queued ||
 				atomic_read(&ce->e_refcnt))
 				continue;
-			spin_unlock(&mb_cache_spinlock);
+			spin_unlock(&cache->c_lru_lock);
 			/*
 			 * Prevent any find or get operation on the entry.
 			 */
@@ -421,25 +415,36 @@ mb_cache_shrink(struct block_device *bdev)
 				!list_empty(&ce->e_lru_list)) {
 				hlist_bl_unlock(ce->e_index_hash_p);
 				hlist_bl_unlock(ce->e_block_hash_p);
-				l = &mb_cache_lru_list;
-				spin_lock(&mb_cache_spinlock);
+				l = &cache->c_lru_list;
+				spin_lock(&cache->c_lru_lock);
 				continue;
 			}
 			__mb_cache_entry_unhash_unlock(ce);
 			mb_assert(!(ce->e_used || ce->e_queued ||
 				atomic_read(&ce->e_refcnt)));
 			list_add_tail(&ce->e_lru_list, &free_list);
-			l = &mb_cache_lru_list;
-			spin_lock(&mb_cache_spinlock);
+			l = &cache->c_lru_list;
+			spin_lock(&cache->c_lru_lock);
 		}
 	}
-	spin_unlock(&mb_cache_spinlock);
+	spin_unlock(&cache->c_lru_lock);
 
 	list_for_each_entry_safe(ce, tmp, &free_list, e_lru_list) {
 		__mb_cache_entry_forget(ce, GFP_KERNEL);
 	}
 }
 
+void
+mb_cache_shrink(struct block_device *bdev)
+{
+	struct mb_cache *cache;
+
+	mutex_lock(&mb_cache_list_mutex);
+	list_for_each_entry(cache, &mb_cache_list, c_cache_list)
+		__mb_cache_shrink(cache, bdev);
+	mutex_unlock(&mb_cache_list_mutex);
+}
+
 
 /*
  * mb_cache_destroy()
@@ -454,13 +459,15 @@ mb_cache_destroy(struct mb_cache *cache)
 	LIST_HEAD(free_list);
 	struct mb_cache_entry *ce, *tmp;
 
-	spin_lock(&mb_cache_spinlock);
-	list_for_each_entry_safe(ce, tmp, &mb_cache_lru_list, e_lru_list) {
-		if (ce->e_cache == cache)
-			list_move_tail(&ce->e_lru_list, &free_list);
-	}
+	unregister_shrinker(&cache->c_shrink);
+
+	mutex_lock(&mb_cache_list_mutex);
 	list_del(&cache->c_cache_list);
-	spin_unlock(&mb_cache_spinlock);
+	mutex_unlock(&mb_cache_list_mutex);
+
+	spin_lock(&cache->c_lru_lock);
+	list_splice_init(&cache->c_lru_list, &free_list);
+	spin_unlock(&cache->c_lru_lock);
 
 	list_for_each_entry_safe(ce, tmp, &free_list, e_lru_list) {
 		list_del_init(&ce->e_lru_list);
@@ -481,10 +488,12 @@ mb_cache_destroy(struct mb_cache *cache)
 			  atomic_read(&cache->c_entry_count));
 	}
 
+	mutex_lock(&mb_cache_list_mutex);
 	if (list_empty(&mb_cache_list)) {
 		kmem_cache_destroy(mb_cache_kmem_cache);
 		mb_cache_kmem_cache = NULL;
 	}
+	mutex_unlock(&mb_cache_list_mutex);
 	kfree(cache->c_index_hash);
 	kfree(cache->c_block_hash);
 	kfree(cache);
@@ -504,43 +513,37 @@ mb_cache_entry_alloc(struct mb_cache *cache, gfp_t gfp_flags)
 	struct mb_cache_entry *ce;
 
 	if (atomic_read(&cache->c_entry_count) >= cache->c_max_entries) {
-		struct list_head *l;
-
-		l = &mb_cache_lru_list;
-		spin_lock(&mb_cache_spinlock);
-		while (!list_is_last(l, &mb_cache_lru_list)) {
-			l = l->next;
-			ce = list_entry(l, struct mb_cache_entry, e_lru_list);
-			if (ce->e_cache == cache) {
-				list_del_init(&ce->e_lru_list);
-				if (ce->e_used || ce->e_queued ||
-					atomic_read(&ce->e_refcnt))
-					continue;
-				spin_unlock(&mb_cache_spinlock);
-				/*
-				 * Prevent any find or get operation on the
-				 * entry.
-				 */
-				hlist_bl_lock(ce->e_block_hash_p);
-				hlist_bl_lock(ce->e_index_hash_p);
-				/* Ignore if it is touched by a find/get */
-				if (ce->e_used || ce->e_queued ||
-					atomic_read(&ce->e_refcnt) ||
-					!list_empty(&ce->e_lru_list)) {
-					hlist_bl_unlock(ce->e_index_hash_p);
-					hlist_bl_unlock(ce->e_block_hash_p);
-					l = &mb_cache_lru_list;
-					spin_lock(&mb_cache_spinlock);
-					continue;
-				}
-				mb_assert(list_empty(&ce->e_lru_list));
-				mb_assert(!(ce->e_used || ce->e_queued ||
-					atomic_read(&ce->e_refcnt)));
-				__mb_cache_entry_unhash_unlock(ce);
-				goto found;
+		/* Every entry on the lru list is ours, recycle the oldest */
+		spin_lock(&cache->c_lru_lock);
+		while (!list_empty(&cache->c_lru_list)) {
+			ce = list_entry(cache->c_lru_list.next,
+					struct mb_cache_entry, e_lru_list);
+			list_del_init(&ce->e_lru_list);
+			if (ce->e_used || ce->e_queued ||
+				atomic_read(&ce->e_refcnt))
+				continue;
+			spin_unlock(&cache->c_lru_lock);
+			/*
+			 * Prevent any find or get operation on the entry.
+			 */
+			hlist_bl_lock(ce->e_block_hash_p);
+			hlist_bl_lock(ce->e_index_hash_p);
+			/* Ignore if it is touched by a find/get */
+			if (ce->e_used || ce->e_queued ||
+				atomic_read(&ce->e_refcnt) ||
+				!list_empty(&ce->e_lru_list)) {
+				hlist_bl_unlock(ce->e_index_hash_p);
+				hlist_bl_unlock(ce->e_block_hash_p);
+				spin_lock(&cache->c_lru_lock);
+				continue;
 			}
+			mb_assert(list_empty(&ce->e_lru_list));
+			mb_assert(!(ce->e_used || ce->e_queued ||
+				atomic_read(&ce->e_refcnt)));
+			__mb_cache_entry_unhash_unlock(ce);
+			goto found;
 		}
-		spin_unlock(&mb_cache_spinlock);
+		spin_unlock(&cache->c_lru_lock);
 	}
 
 	ce = kmem_cache_alloc(cache->c_entry_cache, gfp_flags);
@@ -698,9 +701,9 @@ mb_cache_entry_get(struct mb_cache *cache, struct block_device *bdev,
 			__spin_unlock_mb_cache_entry(ce);
 
 			if (!list_empty(&ce->e_lru_list)) {
-				spin_lock(&mb_cache_spinlock);
+				spin_lock(&ce->e_cache->c_lru_lock);
 				list_del_init(&ce->e_lru_list);
-				spin_unlock(&mb_cache_spinlock);
+				spin_unlock(&ce->e_cache->c_lru_lock);
 			}
 			if (!__mb_cache_entry_is_block_hashed(ce)) {
 				__mb_cache_entry_release(ce);
@@ -753,9 +756,9 @@ __mb_cache_entry_find(struct hlist_bl_node *l, struct hlist_bl_head *head,
 			}
 			__spin_unlock_mb_cache_entry(ce);
 			if (!list_empty(&ce->e_lru_list)) {
-				spin_lock(&mb_cache_spinlock);
+				spin_lock(&ce->e_cache->c_lru_lock);
 				list_del_init(&ce->e_lru_list);
-				spin_unlock(&mb_cache_spinlock);
+				spin_unlock(&ce->e_cache->c_lru_lock);
 			}
 			if (!__mb_cache_entry_is_block_hashed(ce)) {
 				__mb_cache_entry_release(ce);
@@ -841,18 +844,3 @@ mb_cache_entry_find_next(struct mb_cache_entry *prev,
 }
 
 #endif  /* !defined(MB_CACHE_INDEXES_COUNT) || (MB_CACHE_INDEXES_COUNT > 0) */
-
-static int __init init_mbcache(void)
-{
-	register_shrinker(&mb_cache_shrinker);
-	return 0;
-}
-
-static void __exit exit_mbcache(void)
-{
-	unregister_shrinker(&mb_cache_shrinker);
-}
-
-module_init(init_mbcache)
-module_exit(exit_mbcache)
-
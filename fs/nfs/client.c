@@ -180,6 +180,7 @@ struct nfs_client *nfs_alloc_client(const struct nfs_client_initdata *cl_init)
 	clp->cl_rpcclient = ERR_PTR(-EINVAL);
 
 	clp->cl_proto = cl_init->proto;
+	clp->cl_nconnect = cl_init->nconnect;
 	clp->cl_net = get_net(cl_init->net);
 
 	cred = rpc_lookup_machine_cred("*");
@@ -605,6 +606,9 @@ int nfs_create_rpc_client(struct nfs_client *clp,
 	if (test_bit(NFS_CS_INFINITE_SLOTS, &clp->cl_flags))
 		args.flags |= RPC_CLNT_CREATE_INFINITE_SLOTS;
 
+	if (clp->cl_proto == XPRT_TRANSPORT_TCP)
+		args.nconnect = clp->cl_nconnect;
+
 	if (!IS_ERR(clp->cl_rpcclient))
 		return 0;
 
@@ -749,6 +753,7 @@ static int nfs_init_server(struct nfs_server *server,
 		.addrlen = data->nfs_server.addrlen,
 		.nfs_mod = nfs_mod,
 		.proto = data->nfs_server.protocol,
+		.nconnect = data->nfs_server.nconnect,
 		.net = data->net,
 	};
 	struct rpc_timeout timeparms;
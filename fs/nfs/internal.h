@@ -52,6 +52,9 @@ struct nfs_clone_mount {
  */
 #define NFS_MAX_SECFLAVORS	(12)
 
+/* Maximum number of TCP connections per server with nconnect= */
+#define NFS_MAX_CONNECTIONS	16
+
 /*
  * Value used if the user did not specify a port value.
  */
@@ -70,6 +73,7 @@ struct nfs_client_initdata {
 	size_t addrlen;
 	struct nfs_subversion *nfs_mod;
 	int proto;
+	unsigned int nconnect;
 	u32 minorversion;
 	struct net *net;
 };
@@ -110,6 +114,7 @@ struct nfs_parsed_mount_data {
 		char			*export_path;
 		int			port;
 		unsigned short		protocol;
+		unsigned short		nconnect;
 	} nfs_server;
 
 	struct security_mnt_opts lsm_opts;
@@ -791,7 +791,8 @@ static int nfs4_set_client(struct nfs_server *server,
 		const size_t addrlen,
 		const char *ip_addr,
 		rpc_authflavor_t authflavour,
-		int proto, const struct rpc_timeout *timeparms,
+		int proto, unsigned int nconnect,
+		const struct rpc_timeout *timeparms,
 		u32 minorversion, struct net *net)
 {
 	struct nfs_client_initdata cl_init = {
@@ -800,6 +801,7 @@ static int nfs4_set_client(struct nfs_server *server,
 		.addrlen = addrlen,
 		.nfs_mod = &nfs_v4,
 		.proto = proto,
+		.nconnect = nconnect,
 		.minorversion = minorversion,
 		.net = net,
 	};
@@ -1000,6 +1002,7 @@ static int nfs4_init_server(struct nfs_server *server,
 			data->client_address,
 			data->selected_flavor,
 			data->nfs_server.protocol,
+			data->nfs_server.nconnect,
 			&timeparms,
 			data->minorversion,
 			data->net);
@@ -1097,6 +1100,7 @@ struct nfs_server *nfs4_create_referral_server(struct nfs_clone_mount *data,
 				parent_client->cl_ipaddr,
 				data->authflavor,
 				rpc_protocol(parent_server->client),
+				parent_client->cl_nconnect,
 				parent_server->client->cl_timeout,
 				parent_client->cl_mvops->minor_version,
 				parent_client->cl_net);
@@ -1207,7 +1211,8 @@ int nfs4_update_server(struct nfs_server *server, const char *hostname,
 	nfs_server_remove_lists(server);
 	error = nfs4_set_client(server, hostname, sap, salen, buf,
 				clp->cl_rpcclient->cl_auth->au_flavor,
-				clp->cl_proto, clnt->cl_timeout,
+				clp->cl_proto, clp->cl_nconnect,
+				clnt->cl_timeout,
 				clp->cl_minorversion, net);
 	nfs_put_client(clp);
 	if (error != 0) {
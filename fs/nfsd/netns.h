@@ -109,6 +109,12 @@ struct nfsd_net {
 	 */
 	unsigned int max_connections;
 
+	/*
+	 * Upper limit for starting threads on demand.  Defaults to '0',
+	 * which keeps the number of threads fixed.
+	 */
+	unsigned int max_threads;
+
 	u32 clientid_counter;
 
 	struct svc_serv *nfsd_serv;
@@ -13,6 +13,7 @@
 #include <linux/highmem.h>
 #include <linux/log2.h>
 #include <linux/hash.h>
+#include <linux/percpu_counter.h>
 #include <net/checksum.h>
 
 #include "nfsd.h"
@@ -27,10 +28,20 @@
  */
 #define TARGET_BUCKET_SIZE	64
 
+/*
+ * Each bucket has its own lock, LRU and statistics, and sits on a
+ * cacheline of its own so that nfsd threads working on different
+ * buckets don't contend with each other.
+ */
 struct nfsd_drc_bucket {
 	struct list_head lru_head;
 	spinlock_t cache_lock;
-};
+
+	/* statistics, protected by cache_lock */
+	unsigned int payload_misses;	/* misses only due to checksum */
+	unsigned int longest_chain;	/* longest chain seen */
+	unsigned int longest_chain_cachesize; /* cache size at that time */
+} ____cacheline_aligned_in_smp;
 
 static struct nfsd_drc_bucket	*drc_hashtbl;
 static struct kmem_cache	*drc_slab;
@@ -43,24 +54,16 @@ static unsigned int		maskbits;
 static unsigned int		drc_hashsize;
 
 /*
- * Stats and other tracking of on the duplicate reply cache. All of these and
- * the "rc" fields in nfsdstats are protected by the cache_lock
+ * Stats and other tracking of on the duplicate reply cache.  These are
+ * updated from all buckets, so they are per-cpu counters.  The "rc"
+ * fields in nfsdstats are approximate.
  */
 
 /* total number of entries */
-static atomic_t			num_drc_entries;
-
-/* cache misses due only to checksum comparison failures */
-static unsigned int		payload_misses;
+static struct percpu_counter	num_drc_entries;
 
 /* amount of memory (in bytes) currently consumed by the DRC */
-static unsigned int		drc_mem_usage;
-
-/* longest hash chain seen */
-static unsigned int		longest_chain;
-
-/* size of cache when we saw the longest hash chain */
-static unsigned int		longest_chain_cachesize;
+static struct percpu_counter	drc_mem_usage;
 
 static int	nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *vec);
 static void	cache_cleaner_func(struct work_struct *unused);
@@ -144,12 +147,12 @@ static void
 nfsd_reply_cache_free_locked(struct svc_cacherep *rp)
 {
 	if (rp->c_type == RC_REPLBUFF && rp->c_replvec.iov_base) {
-		drc_mem_usage -= rp->c_replvec.iov_len;
+		percpu_counter_sub(&drc_mem_usage, rp->c_replvec.iov_len);
 		kfree(rp->c_replvec.iov_base);
 	}
 	list_del(&rp->c_lru);
-	atomic_dec(&num_drc_entries);
-	drc_mem_usage -= sizeof(*rp);
+	percpu_counter_dec(&num_drc_entries);
+	percpu_counter_sub(&drc_mem_usage, sizeof(*rp));
 	kmem_cache_free(drc_slab, rp);
 }
 
@@ -167,11 +170,13 @@ int nfsd_reply_cache_init(void)
 	unsigned int i;
 
 	max_drc_entries = nfsd_cache_size_limit();
-	atomic_set(&num_drc_entries, 0);
 	hashsize = nfsd_hashsize(max_drc_entries);
 	maskbits = ilog2(hashsize);
 
 	register_shrinker(&nfsd_reply_cache_shrinker);
+	if (percpu_counter_init(&num_drc_entries, 0, GFP_KERNEL) ||
+	    percpu_counter_init(&drc_mem_usage, 0, GFP_KERNEL))
+		goto out_nomem;
 	drc_slab = kmem_cache_create("nfsd_drc", sizeof(struct svc_cacherep),
 					0, 0, NULL);
 	if (!drc_slab)
@@ -217,6 +222,9 @@ void nfsd_reply_cache_shutdown(void)
 		kmem_cache_destroy(drc_slab);
 		drc_slab = NULL;
 	}
+
+	percpu_counter_destroy(&drc_mem_usage);
+	percpu_counter_destroy(&num_drc_entries);
 }
 
 /*
@@ -244,7 +252,8 @@ prune_bucket(struct nfsd_drc_bucket *b)
 		 */
 		if (rp->c_state == RC_INPROG)
 			continue;
-		if (atomic_read(&num_drc_entries) <= max_drc_entries &&
+		if (percpu_counter_read_positive(&num_drc_entries) <=
+						max_drc_entries &&
 		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
 			break;
 		nfsd_reply_cache_free_locked(rp);
@@ -294,7 +303,7 @@ cache_cleaner_func(struct work_struct *unused)
 static unsigned long
 nfsd_reply_cache_count(struct shrinker *shrink, struct shrink_control *sc)
 {
-	return atomic_read(&num_drc_entries);
+	return percpu_counter_read_positive(&num_drc_entries);
 }
 
 static unsigned long
@@ -336,14 +345,15 @@ nfsd_cache_csum(struct svc_rqst *rqstp)
 }
 
 static bool
-nfsd_cache_match(struct svc_rqst *rqstp, __wsum csum, struct svc_cacherep *rp)
+nfsd_cache_match(struct nfsd_drc_bucket *b, struct svc_rqst *rqstp,
+		 __wsum csum, struct svc_cacherep *rp)
 {
 	/* Check RPC XID first */
 	if (rqstp->rq_xid != rp->c_xid)
 		return false;
 	/* compare checksum of NFS data */
 	if (csum != rp->c_csum) {
-		++payload_misses;
+		++b->payload_misses;
 		return false;
 	}
 
@@ -374,21 +384,22 @@ nfsd_cache_search(struct nfsd_drc_bucket *b, struct svc_rqst *rqstp,
 
 	list_for_each_entry(rp, rh, c_lru) {
 		++entries;
-		if (nfsd_cache_match(rqstp, csum, rp)) {
+		if (nfsd_cache_match(b, rqstp, csum, rp)) {
 			ret = rp;
 			break;
 		}
 	}
 
 	/* tally hash chain length stats */
-	if (entries > longest_chain) {
-		longest_chain = entries;
-		longest_chain_cachesize = atomic_read(&num_drc_entries);
-	} else if (entries == longest_chain) {
+	if (entries > b->longest_chain) {
+		b->longest_chain = entries;
+		b->longest_chain_cachesize =
+			percpu_counter_read_positive(&num_drc_entries);
+	} else if (entries == b->longest_chain) {
 		/* prefer to keep the smallest cachesize possible here */
-		longest_chain_cachesize = min_t(unsigned int,
-				longest_chain_cachesize,
-				atomic_read(&num_drc_entries));
+		b->longest_chain_cachesize = min_t(unsigned int,
+				b->longest_chain_cachesize,
+				percpu_counter_read_positive(&num_drc_entries));
 	}
 
 	return ret;
@@ -429,11 +440,11 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 	 * preallocate an entry.
 	 */
 	rp = nfsd_reply_cache_alloc();
-	spin_lock(&b->cache_lock);
 	if (likely(rp)) {
-		atomic_inc(&num_drc_entries);
-		drc_mem_usage += sizeof(*rp);
+		percpu_counter_inc(&num_drc_entries);
+		percpu_counter_add(&drc_mem_usage, sizeof(*rp));
 	}
+	spin_lock(&b->cache_lock);
 
 	/* go ahead and prune the cache */
 	prune_bucket(b);
@@ -467,7 +478,7 @@ nfsd_cache_lookup(struct svc_rqst *rqstp)
 
 	/* release any buffer */
 	if (rp->c_type == RC_REPLBUFF) {
-		drc_mem_usage -= rp->c_replvec.iov_len;
+		percpu_counter_sub(&drc_mem_usage, rp->c_replvec.iov_len);
 		kfree(rp->c_replvec.iov_base);
 		rp->c_replvec.iov_base = NULL;
 	}
@@ -576,8 +587,8 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		nfsd_reply_cache_free(b, rp);
 		return;
 	}
+	percpu_counter_add(&drc_mem_usage, bufsize);
 	spin_lock(&b->cache_lock);
-	drc_mem_usage += bufsize;
 	lru_put_end(b, rp);
 	rp->c_secure = test_bit(RQ_SECURE, &rqstp->rq_flags);
 	rp->c_type = cachetype;
@@ -613,11 +624,31 @@ nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *data)
  */
 static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
 {
+	unsigned int payload_misses = 0;
+	unsigned int longest_chain = 0;
+	unsigned int longest_chain_cachesize = 0;
+	unsigned int i;
+
+	for (i = 0; i < drc_hashsize; i++) {
+		struct nfsd_drc_bucket *b = &drc_hashtbl[i];
+
+		spin_lock(&b->cache_lock);
+		payload_misses += b->payload_misses;
+		if (b->longest_chain > longest_chain ||
+		    (b->longest_chain == longest_chain &&
+		     b->longest_chain_cachesize < longest_chain_cachesize)) {
+			longest_chain = b->longest_chain;
+			longest_chain_cachesize = b->longest_chain_cachesize;
+		}
+		spin_unlock(&b->cache_lock);
+	}
+
 	seq_printf(m, "max entries:           %u\n", max_drc_entries);
-	seq_printf(m, "num entries:           %u\n",
-			atomic_read(&num_drc_entries));
+	seq_printf(m, "num entries:           %lld\n",
+			percpu_counter_sum_positive(&num_drc_entries));
 	seq_printf(m, "hash buckets:          %u\n", 1 << maskbits);
-	seq_printf(m, "mem usage:             %u\n", drc_mem_usage);
+	seq_printf(m, "mem usage:             %lld\n",
+			percpu_counter_sum_positive(&drc_mem_usage));
 	seq_printf(m, "cache hits:            %u\n", nfsdstats.rchits);
 	seq_printf(m, "cache misses:          %u\n", nfsdstats.rcmisses);
 	seq_printf(m, "not cached:            %u\n", nfsdstats.rcnocache);
@@ -390,6 +390,19 @@ static int nfsd_get_default_max_blksize(void)
 	return ret;
 }
 
+/*
+ * Start threads in the pools whose transports had to wait.  This runs
+ * from a workqueue, and svc_destroy() waits for that with nfsd_mutex
+ * held, so don't wait for the mutex.  The next wait will ask again.
+ */
+static void nfsd_autoscale(struct svc_serv *serv)
+{
+	if (!mutex_trylock(&nfsd_mutex))
+		return;
+	svc_pools_grow(serv);
+	mutex_unlock(&nfsd_mutex);
+}
+
 int nfsd_create_serv(struct net *net)
 {
 	int error;
@@ -409,6 +422,8 @@ int nfsd_create_serv(struct net *net)
 		return -ENOMEM;
 
 	nn->nfsd_serv->sv_maxconn = nn->max_connections;
+	nn->nfsd_serv->sv_maxthreads = nn->max_threads;
+	nn->nfsd_serv->sv_autoscale = nfsd_autoscale;
 	error = svc_bind(nn->nfsd_serv, net);
 	if (error < 0) {
 		svc_destroy(nn->nfsd_serv);
@@ -610,7 +625,8 @@ nfsd(void *vrqstp)
 		 */
 		while ((err = svc_recv(rqstp, 60*60*HZ)) == -EAGAIN)
 			;
-		if (err == -EINTR)
+		/* -ETIMEDOUT: an extra thread of an autoscaled pool idled */
+		if (err == -EINTR || err == -ETIMEDOUT)
 			break;
 		validate_process_creds();
 		svc_process(rqstp);
@@ -11,6 +11,13 @@
 
 #include "fanotify.h"
 
+/*
+ * How far back in the queue to look for an event to merge with.  Scanning
+ * the whole queue made every event O(queue length) under the notification
+ * mutex; repeats of the same event almost always arrive close together.
+ */
+#define FANOTIFY_MAX_MERGE_EVENTS	128
+
 static bool should_merge(struct fsnotify_event *old_fsn,
 			 struct fsnotify_event *new_fsn)
 {
@@ -20,8 +27,22 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	old = FANOTIFY_E(old_fsn);
 	new = FANOTIFY_E(new_fsn);
 
-	if (old_fsn->inode == new_fsn->inode && old->tgid == new->tgid &&
-	    old->path.mnt == new->path.mnt &&
+	if (old_fsn->inode != new_fsn->inode || old->tgid != new->tgid)
+		return false;
+
+	if (fanotify_is_name_event(old_fsn) || fanotify_is_name_event(new_fsn)) {
+		struct fanotify_name_event *old_ne, *new_ne;
+
+		if (!fanotify_is_name_event(old_fsn) ||
+		    !fanotify_is_name_event(new_fsn))
+			return false;
+		old_ne = FANOTIFY_NE(old_fsn);
+		new_ne = FANOTIFY_NE(new_fsn);
+		return old_ne->name_len == new_ne->name_len &&
+		       !memcmp(old_ne->name, new_ne->name, old_ne->name_len);
+	}
+
+	if (old->path.mnt == new->path.mnt &&
 	    old->path.dentry == new->path.dentry)
 		return true;
 	return false;
@@ -32,6 +53,7 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 {
 	struct fsnotify_event *test_event;
 	bool do_merge = false;
+	int i = 0;
 
 	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
 
@@ -50,6 +72,8 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 			do_merge = true;
 			break;
 		}
+		if (++i >= FANOTIFY_MAX_MERGE_EVENTS)
+			break;
 	}
 
 	if (!do_merge)
@@ -98,31 +122,39 @@ static int fanotify_get_response(struct fsnotify_group *group,
 }
 #endif
 
-static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
+static bool fanotify_should_send_event(struct fsnotify_group *group,
+				       struct fsnotify_mark *inode_mark,
 				       struct fsnotify_mark *vfsmnt_mark,
+				       struct fsnotify_mark *sb_mark,
 				       u32 event_mask,
 				       void *data, int data_type)
 {
-	__u32 marks_mask, marks_ignored_mask;
+	__u32 marks_mask = 0, marks_ignored_mask = 0;
 	struct path *path = data;
+	bool isdir;
 
-	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p mask=%x data=%p"
-		 " data_type=%d\n", __func__, inode_mark, vfsmnt_mark,
-		 event_mask, data, data_type);
+	pr_debug("%s: inode_mark=%p vfsmnt_mark=%p sb_mark=%p mask=%x"
+		 " data=%p data_type=%d\n", __func__, inode_mark, vfsmnt_mark,
+		 sb_mark, event_mask, data, data_type);
 
-	/* if we don't have enough info to send an event to userspace say no */
-	if (data_type != FSNOTIFY_EVENT_PATH)
-		return false;
+	if (event_mask & FAN_ALL_DIRENT_EVENTS) {
+		/* reported by name, the entry itself may be of any type */
+		if (!(group->fanotify_data.flags & FAN_REPORT_NAME))
+			return false;
+		isdir = event_mask & FS_ISDIR;
+	} else {
+		/* if we don't have enough info to send an event to userspace say no */
+		if (data_type != FSNOTIFY_EVENT_PATH)
+			return false;
 
-	/* sorry, fanotify only gives a damn about files and dirs */
-	if (!S_ISREG(path->dentry->d_inode->i_mode) &&
-	    !S_ISDIR(path->dentry->d_inode->i_mode))
-		return false;
+		/* sorry, fanotify only gives a damn about files and dirs */
+		if (!S_ISREG(path->dentry->d_inode->i_mode) &&
+		    !S_ISDIR(path->dentry->d_inode->i_mode))
+			return false;
+		isdir = S_ISDIR(path->dentry->d_inode->i_mode);
+	}
 
-	if (inode_mark && vfsmnt_mark) {
-		marks_mask = (vfsmnt_mark->mask | inode_mark->mask);
-		marks_ignored_mask = (vfsmnt_mark->ignored_mask | inode_mark->ignored_mask);
-	} else if (inode_mark) {
+	if (inode_mark && !vfsmnt_mark && !sb_mark) {
 		/*
 		 * if the event is for a child and this inode doesn't care about
 		 * events on the child, don't send it!
@@ -130,17 +162,22 @@ static bool fanotify_should_send_event(struct fsnotify_mark *inode_mark,
 		if ((event_mask & FS_EVENT_ON_CHILD) &&
 		    !(inode_mark->mask & FS_EVENT_ON_CHILD))
 			return false;
-		marks_mask = inode_mark->mask;
-		marks_ignored_mask = inode_mark->ignored_mask;
-	} else if (vfsmnt_mark) {
-		marks_mask = vfsmnt_mark->mask;
-		marks_ignored_mask = vfsmnt_mark->ignored_mask;
-	} else {
-		BUG();
 	}
 
-	if (S_ISDIR(path->dentry->d_inode->i_mode) &&
-	    (marks_ignored_mask & FS_ISDIR))
+	if (inode_mark) {
+		marks_mask |= inode_mark->mask;
+		marks_ignored_mask |= inode_mark->ignored_mask;
+	}
+	if (vfsmnt_mark) {
+		marks_mask |= vfsmnt_mark->mask;
+		marks_ignored_mask |= vfsmnt_mark->ignored_mask;
+	}
+	if (sb_mark) {
+		marks_mask |= sb_mark->mask;
+		marks_ignored_mask |= sb_mark->ignored_mask;
+	}
+
+	if (isdir && (marks_ignored_mask & FS_ISDIR))
 		return false;
 
 	if (event_mask & marks_mask & ~marks_ignored_mask)
@@ -183,10 +220,46 @@ init: __maybe_unused
 	return event;
 }
 
+static struct fanotify_event_info *
+fanotify_alloc_name_event(struct inode *dir, u32 mask, __kernel_fsid_t *fsid,
+			  const unsigned char *file_name)
+{
+	struct fanotify_name_event *ne;
+	int name_len = file_name ? strlen(file_name) : 0;
+	int dwords = MAX_HANDLE_SZ >> 2;
+	int type;
+
+	ne = kmalloc(sizeof(*ne) + name_len + 1, GFP_KERNEL);
+	if (!ne)
+		return NULL;
+
+	fsnotify_init_event(&ne->fae.fse, dir, mask);
+	ne->fae.tgid = get_pid(task_tgid(current));
+	ne->fae.path.mnt = NULL;
+	ne->fae.path.dentry = NULL;
+	ne->fsid = *fsid;
+
+	type = exportfs_encode_inode_fh(dir, (struct fid *)ne->handle,
+					&dwords, NULL);
+	if (type < 0 || type == FILEID_INVALID) {
+		/* still report the name, userspace gets an empty handle */
+		type = FILEID_INVALID;
+		dwords = 0;
+	}
+	ne->handle_type = type;
+	ne->handle_bytes = dwords << 2;
+
+	ne->name_len = name_len;
+	memcpy(ne->name, file_name, name_len);
+	ne->name[name_len] = '\0';
+	return &ne->fae;
+}
+
 static int fanotify_handle_event(struct fsnotify_group *group,
 				 struct inode *inode,
 				 struct fsnotify_mark *inode_mark,
 				 struct fsnotify_mark *fanotify_mark,
+				 struct fsnotify_mark *sb_mark,
 				 u32 mask, void *data, int data_type,
 				 const unsigned char *file_name, u32 cookie)
 {
@@ -204,15 +277,28 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	BUILD_BUG_ON(FAN_OPEN_PERM != FS_OPEN_PERM);
 	BUILD_BUG_ON(FAN_ACCESS_PERM != FS_ACCESS_PERM);
 	BUILD_BUG_ON(FAN_ONDIR != FS_ISDIR);
+	BUILD_BUG_ON(FAN_MOVED_FROM != FS_MOVED_FROM);
+	BUILD_BUG_ON(FAN_MOVED_TO != FS_MOVED_TO);
+	BUILD_BUG_ON(FAN_CREATE != FS_CREATE);
+	BUILD_BUG_ON(FAN_DELETE != FS_DELETE);
 
-	if (!fanotify_should_send_event(inode_mark, fanotify_mark, mask, data,
-					data_type))
+	if (!fanotify_should_send_event(group, inode_mark, fanotify_mark,
+					sb_mark, mask, data, data_type))
 		return 0;
 
 	pr_debug("%s: group=%p inode=%p mask=%x\n", __func__, group, inode,
 		 mask);
 
-	event = fanotify_alloc_event(inode, mask, data);
+	if (mask & FAN_ALL_DIRENT_EVENTS) {
+		struct fsnotify_mark *mark = inode_mark ?: fanotify_mark ?: sb_mark;
+
+		/* only the entry events, don't mix in others for the same inode */
+		mask &= FAN_ALL_DIRENT_EVENTS | FS_ISDIR;
+		event = fanotify_alloc_name_event(inode, mask,
+						  &FANOTIFY_M(mark)->fsid,
+						  file_name);
+	} else
+		event = fanotify_alloc_event(inode, mask, data);
 	if (unlikely(!event))
 		return -ENOMEM;
 
@@ -252,6 +338,10 @@ static void fanotify_free_event(struct fsnotify_event *fsn_event)
 	event = FANOTIFY_E(fsn_event);
 	path_put(&event->path);
 	put_pid(event->tgid);
+	if (fanotify_is_name_event(fsn_event)) {
+		kfree(FANOTIFY_NE(fsn_event));
+		return;
+	}
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	if (fsn_event->mask & FAN_ALL_PERM_EVENTS) {
 		kmem_cache_free(fanotify_perm_event_cachep,
@@ -1,10 +1,27 @@
+#include <linux/fanotify.h>
 #include <linux/fsnotify_backend.h>
+#include <linux/exportfs.h>
 #include <linux/path.h>
 #include <linux/slab.h>
 
 extern struct kmem_cache *fanotify_event_cachep;
 extern struct kmem_cache *fanotify_perm_event_cachep;
 
+/*
+ * fanotify marks remember the fsid of the filesystem they were placed on,
+ * so that directory entry events can report it without a statfs() per
+ * event.
+ */
+struct fanotify_mark {
+	struct fsnotify_mark fsn_mark;
+	__kernel_fsid_t fsid;
+};
+
+static inline struct fanotify_mark *FANOTIFY_M(struct fsnotify_mark *mark)
+{
+	return container_of(mark, struct fanotify_mark, fsn_mark);
+}
+
 /*
  * Structure for normal fanotify events. It gets allocated in
  * fanotify_handle_event() and freed when the information is retrieved by
@@ -46,5 +63,32 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
+/*
+ * Structure for directory entry events (FAN_ALL_DIRENT_EVENTS).  There is
+ * no path to open; the directory is identified by a file handle encoded
+ * when the event happens, the entry by its name.  Allocated with kmalloc()
+ * to fit the name.
+ */
+struct fanotify_name_event {
+	struct fanotify_event_info fae;
+	__kernel_fsid_t fsid;
+	int handle_type;
+	u32 handle_bytes;
+	unsigned char handle[MAX_HANDLE_SZ];
+	u32 name_len;
+	char name[];
+};
+
+static inline struct fanotify_name_event *
+FANOTIFY_NE(struct fsnotify_event *fse)
+{
+	return container_of(fse, struct fanotify_name_event, fae.fse);
+}
+
+static inline bool fanotify_is_name_event(struct fsnotify_event *fse)
+{
+	return fse->mask & FAN_ALL_DIRENT_EVENTS;
+}
+
 struct fanotify_event_info *fanotify_alloc_event(struct inode *inode, u32 mask,
 						 struct path *path);
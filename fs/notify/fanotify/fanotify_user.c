@@ -11,6 +11,7 @@
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/slab.h>
+#include <linux/statfs.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
 #include <linux/compat.h>
@@ -25,6 +26,9 @@
 #define FANOTIFY_DEFAULT_MAX_MARKS	8192
 #define FANOTIFY_DEFAULT_MAX_LISTENERS	128
 
+/* info records keep the next event's metadata (and its mask) aligned */
+#define FANOTIFY_EVENT_ALIGN		8
+
 /*
  * All flags that may be specified in parameter event_f_flags of fanotify_init.
  *
@@ -44,6 +48,24 @@ static struct kmem_cache *fanotify_mark_cache __read_mostly;
 struct kmem_cache *fanotify_event_cachep __read_mostly;
 struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 
+static size_t fanotify_name_info_len(struct fsnotify_event *fsn_event)
+{
+	struct fanotify_name_event *ne = FANOTIFY_NE(fsn_event);
+
+	return sizeof(struct fanotify_event_info_fid) +
+	       sizeof(struct file_handle) + ne->handle_bytes +
+	       ne->name_len + 1;
+}
+
+static size_t fanotify_event_len(struct fsnotify_event *fsn_event)
+{
+	if (!fanotify_is_name_event(fsn_event))
+		return FAN_EVENT_METADATA_LEN;
+	return FAN_EVENT_METADATA_LEN +
+	       round_up(fanotify_name_info_len(fsn_event),
+			FANOTIFY_EVENT_ALIGN);
+}
+
 /*
  * Get an fsnotify notification event if one exists and is small
  * enough to fit in "count". Return an error pointer if the count
@@ -61,7 +83,7 @@ static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
 	if (fsnotify_notify_queue_is_empty(group))
 		return NULL;
 
-	if (FAN_EVENT_METADATA_LEN > count)
+	if (fanotify_event_len(fsnotify_peek_first_event(group)) > count)
 		return ERR_PTR(-EINVAL);
 
 	/* held the notification_mutex the whole time, so this is the
@@ -124,13 +146,16 @@ static int fill_event_metadata(struct fsnotify_group *group,
 
 	*file = NULL;
 	event = container_of(fsn_event, struct fanotify_event_info, fse);
-	metadata->event_len = FAN_EVENT_METADATA_LEN;
+	metadata->event_len = fanotify_event_len(fsn_event);
 	metadata->metadata_len = FAN_EVENT_METADATA_LEN;
 	metadata->vers = FANOTIFY_METADATA_VERSION;
 	metadata->reserved = 0;
 	metadata->mask = fsn_event->mask & FAN_ALL_OUTGOING_EVENTS;
 	metadata->pid = pid_vnr(event->tgid);
-	if (unlikely(fsn_event->mask & FAN_Q_OVERFLOW))
+	if (fanotify_is_name_event(fsn_event)) {
+		metadata->mask |= fsn_event->mask & FAN_ONDIR;
+		metadata->fd = FAN_NOFD;
+	} else if (unlikely(fsn_event->mask & FAN_Q_OVERFLOW))
 		metadata->fd = FAN_NOFD;
 	else {
 		metadata->fd = create_fd(group, event, file);
@@ -200,6 +225,44 @@ static int process_access_response(struct fsnotify_group *group,
 }
 #endif
 
+/*
+ * Copy out the FAN_EVENT_INFO_TYPE_DFID_NAME record that follows the
+ * metadata of a directory entry event, padded up to the event length.
+ */
+static int copy_name_info_to_user(struct fsnotify_event *fsn_event,
+				  char __user *buf)
+{
+	struct fanotify_name_event *ne = FANOTIFY_NE(fsn_event);
+	size_t len = fanotify_name_info_len(fsn_event);
+	size_t pad = round_up(len, FANOTIFY_EVENT_ALIGN) - len;
+	struct fanotify_event_info_fid info = {
+		.hdr.info_type = FAN_EVENT_INFO_TYPE_DFID_NAME,
+		.hdr.len = len + pad,
+		.fsid = ne->fsid,
+	};
+	struct file_handle handle = {
+		.handle_bytes = ne->handle_bytes,
+		.handle_type = ne->handle_type,
+	};
+
+	if (copy_to_user(buf, &info, sizeof(info)))
+		return -EFAULT;
+	buf += sizeof(info);
+	if (copy_to_user(buf, &handle, sizeof(handle)))
+		return -EFAULT;
+	buf += sizeof(handle);
+	if (copy_to_user(buf, ne->handle, ne->handle_bytes))
+		return -EFAULT;
+	buf += ne->handle_bytes;
+	/* the name is stored with its terminating null */
+	if (copy_to_user(buf, ne->name, ne->name_len + 1))
+		return -EFAULT;
+	buf += ne->name_len + 1;
+	if (pad && clear_user(buf, pad))
+		return -EFAULT;
+	return 0;
+}
+
 static ssize_t copy_event_to_user(struct fsnotify_group *group,
 				  struct fsnotify_event *event,
 				  char __user *buf)
@@ -217,7 +280,11 @@ static ssize_t copy_event_to_user(struct fsnotify_group *group,
 	fd = fanotify_event_metadata.fd;
 	ret = -EFAULT;
 	if (copy_to_user(buf, &fanotify_event_metadata,
-			 fanotify_event_metadata.event_len))
+			 fanotify_event_metadata.metadata_len))
+		goto out_close_fd;
+
+	if (fanotify_is_name_event(event) &&
+	    copy_name_info_to_user(event, buf + FAN_EVENT_METADATA_LEN))
 		goto out_close_fd;
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
@@ -410,7 +477,7 @@ static long fanotify_ioctl(struct file *file, unsigned int cmd, unsigned long ar
 	case FIONREAD:
 		mutex_lock(&group->notification_mutex);
 		list_for_each_entry(fsn_event, &group->notification_list, list)
-			send_len += FAN_EVENT_METADATA_LEN;
+			send_len += fanotify_event_len(fsn_event);
 		mutex_unlock(&group->notification_mutex);
 		ret = put_user(send_len, (int __user *) p);
 		break;
@@ -433,7 +500,7 @@ static const struct file_operations fanotify_fops = {
 
 static void fanotify_free_mark(struct fsnotify_mark *fsn_mark)
 {
-	kmem_cache_free(fanotify_mark_cache, fsn_mark);
+	kmem_cache_free(fanotify_mark_cache, FANOTIFY_M(fsn_mark));
 }
 
 static int fanotify_find_path(int dfd, const char __user *filename,
@@ -532,6 +599,34 @@ static int fanotify_remove_vfsmount_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static int fanotify_remove_sb_mark(struct fsnotify_group *group,
+				   struct super_block *sb, __u32 mask,
+				   unsigned int flags)
+{
+	struct fsnotify_mark *fsn_mark = NULL;
+	__u32 removed;
+	int destroy_mark;
+
+	mutex_lock(&group->mark_mutex);
+	fsn_mark = fsnotify_find_sb_mark(group, sb);
+	if (!fsn_mark) {
+		mutex_unlock(&group->mark_mutex);
+		return -ENOENT;
+	}
+
+	removed = fanotify_mark_remove_from_mask(fsn_mark, mask, flags,
+						 &destroy_mark);
+	if (destroy_mark)
+		fsnotify_destroy_mark_locked(fsn_mark, group);
+	mutex_unlock(&group->mark_mutex);
+
+	fsnotify_put_mark(fsn_mark);
+	if (removed & sb->s_fsnotify_mask)
+		fsnotify_recalc_sb_mask(sb);
+
+	return 0;
+}
+
 static int fanotify_remove_inode_mark(struct fsnotify_group *group,
 				      struct inode *inode, __u32 mask,
 				      unsigned int flags)
@@ -590,9 +685,11 @@ static __u32 fanotify_mark_add_to_mask(struct fsnotify_mark *fsn_mark,
 
 static struct fsnotify_mark *fanotify_add_new_mark(struct fsnotify_group *group,
 						   struct inode *inode,
-						   struct vfsmount *mnt)
+						   struct vfsmount *mnt,
+						   struct super_block *sb,
+						   __kernel_fsid_t *fsid)
 {
-	struct fsnotify_mark *mark;
+	struct fanotify_mark *mark;
 	int ret;
 
 	if (atomic_read(&group->num_marks) > group->fanotify_data.max_marks)
@@ -602,20 +699,25 @@ static struct fsnotify_mark *fanotify_add_new_mark(struct fsnotify_group *group,
 	if (!mark)
 		return ERR_PTR(-ENOMEM);
 
-	fsnotify_init_mark(mark, fanotify_free_mark);
-	ret = fsnotify_add_mark_locked(mark, group, inode, mnt, 0);
+	fsnotify_init_mark(&mark->fsn_mark, fanotify_free_mark);
+	mark->fsid = *fsid;
+	if (sb)
+		ret = fsnotify_add_sb_mark_locked(&mark->fsn_mark, group, sb, 0);
+	else
+		ret = fsnotify_add_mark_locked(&mark->fsn_mark, group, inode,
+					       mnt, 0);
 	if (ret) {
-		fsnotify_put_mark(mark);
+		fsnotify_put_mark(&mark->fsn_mark);
 		return ERR_PTR(ret);
 	}
 
-	return mark;
+	return &mark->fsn_mark;
 }
 
 
 static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 				      struct vfsmount *mnt, __u32 mask,
-				      unsigned int flags)
+				      unsigned int flags, __kernel_fsid_t *fsid)
 {
 	struct fsnotify_mark *fsn_mark;
 	__u32 added;
@@ -623,7 +725,7 @@ static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 	mutex_lock(&group->mark_mutex);
 	fsn_mark = fsnotify_find_vfsmount_mark(group, mnt);
 	if (!fsn_mark) {
-		fsn_mark = fanotify_add_new_mark(group, NULL, mnt);
+		fsn_mark = fanotify_add_new_mark(group, NULL, mnt, NULL, fsid);
 		if (IS_ERR(fsn_mark)) {
 			mutex_unlock(&group->mark_mutex);
 			return PTR_ERR(fsn_mark);
@@ -639,9 +741,35 @@ static int fanotify_add_vfsmount_mark(struct fsnotify_group *group,
 	return 0;
 }
 
+static int fanotify_add_sb_mark(struct fsnotify_group *group,
+				struct super_block *sb, __u32 mask,
+				unsigned int flags, __kernel_fsid_t *fsid)
+{
+	struct fsnotify_mark *fsn_mark;
+	__u32 added;
+
+	mutex_lock(&group->mark_mutex);
+	fsn_mark = fsnotify_find_sb_mark(group, sb);
+	if (!fsn_mark) {
+		fsn_mark = fanotify_add_new_mark(group, NULL, NULL, sb, fsid);
+		if (IS_ERR(fsn_mark)) {
+			mutex_unlock(&group->mark_mutex);
+			return PTR_ERR(fsn_mark);
+		}
+	}
+	added = fanotify_mark_add_to_mask(fsn_mark, mask, flags);
+	mutex_unlock(&group->mark_mutex);
+
+	if (added & ~sb->s_fsnotify_mask)
+		fsnotify_recalc_sb_mask(sb);
+
+	fsnotify_put_mark(fsn_mark);
+	return 0;
+}
+
 static int fanotify_add_inode_mark(struct fsnotify_group *group,
 				   struct inode *inode, __u32 mask,
-				   unsigned int flags)
+				   unsigned int flags, __kernel_fsid_t *fsid)
 {
 	struct fsnotify_mark *fsn_mark;
 	__u32 added;
@@ -661,7 +789,7 @@ static int fanotify_add_inode_mark(struct fsnotify_group *group,
 	mutex_lock(&group->mark_mutex);
 	fsn_mark = fsnotify_find_inode_mark(group, inode);
 	if (!fsn_mark) {
-		fsn_mark = fanotify_add_new_mark(group, inode, NULL);
+		fsn_mark = fanotify_add_new_mark(group, inode, NULL, NULL, fsid);
 		if (IS_ERR(fsn_mark)) {
 			mutex_unlock(&group->mark_mutex);
 			return PTR_ERR(fsn_mark);
@@ -697,6 +825,11 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	if (event_f_flags & ~FANOTIFY_INIT_ALL_EVENT_F_BITS)
 		return -EINVAL;
 
+	/* entry events carry no fd and cannot be answered */
+	if ((flags & FAN_REPORT_NAME) &&
+	    (flags & FAN_ALL_CLASS_BITS) != FAN_CLASS_NOTIF)
+		return -EINVAL;
+
 	switch (event_f_flags & O_ACCMODE) {
 	case O_RDONLY:
 	case O_RDWR:
@@ -738,6 +871,7 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	if (force_o_largefile())
 		event_f_flags |= O_LARGEFILE;
 	group->fanotify_data.f_flags = event_f_flags;
+	group->fanotify_data.flags = flags & FAN_REPORT_NAME;
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	spin_lock_init(&group->fanotify_data.access_lock);
 	init_waitqueue_head(&group->fanotify_data.access_waitq);
@@ -795,6 +929,7 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 	struct inode *inode = NULL;
 	struct vfsmount *mnt = NULL;
 	struct fsnotify_group *group;
+	__kernel_fsid_t fsid = {};
 	struct fd f;
 	struct path path;
 	int ret;
@@ -815,25 +950,35 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 			return -EINVAL;
 		break;
 	case FAN_MARK_FLUSH:
-		if (flags & ~(FAN_MARK_MOUNT | FAN_MARK_FLUSH))
+		if (flags & ~(FAN_MARK_MOUNT | FAN_MARK_FILESYSTEM |
+			      FAN_MARK_FLUSH))
 			return -EINVAL;
 		break;
 	default:
 		return -EINVAL;
 	}
 
+	if ((flags & FAN_MARK_MOUNT) && (flags & FAN_MARK_FILESYSTEM))
+		return -EINVAL;
+
 	if (mask & FAN_ONDIR) {
 		flags |= FAN_MARK_ONDIR;
 		mask &= ~FAN_ONDIR;
 	}
 
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
-	if (mask & ~(FAN_ALL_EVENTS | FAN_ALL_PERM_EVENTS | FAN_EVENT_ON_CHILD))
+	if (mask & ~(FAN_ALL_EVENTS | FAN_ALL_DIRENT_EVENTS |
+		     FAN_ALL_PERM_EVENTS | FAN_EVENT_ON_CHILD))
 #else
-	if (mask & ~(FAN_ALL_EVENTS | FAN_EVENT_ON_CHILD))
+	if (mask & ~(FAN_ALL_EVENTS | FAN_ALL_DIRENT_EVENTS |
+		     FAN_EVENT_ON_CHILD))
 #endif
 		return -EINVAL;
 
+	/* entry events come without a path, a mount mark never sees them */
+	if ((mask & FAN_ALL_DIRENT_EVENTS) && (flags & FAN_MARK_MOUNT))
+		return -EINVAL;
+
 	f = fdget(fanotify_fd);
 	if (unlikely(!f.file))
 		return -EBADF;
@@ -853,10 +998,16 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 	    group->priority == FS_PRIO_0)
 		goto fput_and_out;
 
+	if ((mask & FAN_ALL_DIRENT_EVENTS) &&
+	    !(group->fanotify_data.flags & FAN_REPORT_NAME))
+		goto fput_and_out;
+
 	if (flags & FAN_MARK_FLUSH) {
 		ret = 0;
 		if (flags & FAN_MARK_MOUNT)
 			fsnotify_clear_vfsmount_marks_by_group(group);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			fsnotify_clear_sb_marks_by_group(group);
 		else
 			fsnotify_clear_inode_marks_by_group(group);
 		goto fput_and_out;
@@ -866,6 +1017,16 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 	if (ret)
 		goto fput_and_out;
 
+	if ((flags & FAN_MARK_ADD) &&
+	    (group->fanotify_data.flags & FAN_REPORT_NAME)) {
+		struct kstatfs st;
+
+		ret = vfs_statfs(&path, &st);
+		if (ret)
+			goto path_put_and_out;
+		fsid = st.f_fsid;
+	}
+
 	/* inode held in place by reference to path; group by fget on fd */
 	if (!(flags & FAN_MARK_MOUNT))
 		inode = path.dentry->d_inode;
@@ -876,13 +1037,21 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 	switch (flags & (FAN_MARK_ADD | FAN_MARK_REMOVE)) {
 	case FAN_MARK_ADD:
 		if (flags & FAN_MARK_MOUNT)
-			ret = fanotify_add_vfsmount_mark(group, mnt, mask, flags);
+			ret = fanotify_add_vfsmount_mark(group, mnt, mask, flags,
+							 &fsid);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			ret = fanotify_add_sb_mark(group, inode->i_sb, mask,
+						   flags, &fsid);
 		else
-			ret = fanotify_add_inode_mark(group, inode, mask, flags);
+			ret = fanotify_add_inode_mark(group, inode, mask, flags,
+						      &fsid);
 		break;
 	case FAN_MARK_REMOVE:
 		if (flags & FAN_MARK_MOUNT)
 			ret = fanotify_remove_vfsmount_mark(group, mnt, mask, flags);
+		else if (flags & FAN_MARK_FILESYSTEM)
+			ret = fanotify_remove_sb_mark(group, inode->i_sb, mask,
+						      flags);
 		else
 			ret = fanotify_remove_inode_mark(group, inode, mask, flags);
 		break;
@@ -890,6 +1059,7 @@ SYSCALL_DEFINE5(fanotify_mark, int, fanotify_fd, unsigned int, flags,
 		ret = -EINVAL;
 	}
 
+path_put_and_out:
 	path_put(&path);
 fput_and_out:
 	fdput(f);
@@ -919,7 +1089,7 @@ COMPAT_SYSCALL_DEFINE6(fanotify_mark,
  */
 static int __init fanotify_user_setup(void)
 {
-	fanotify_mark_cache = KMEM_CACHE(fsnotify_mark, SLAB_PANIC);
+	fanotify_mark_cache = KMEM_CACHE(fanotify_mark, SLAB_PANIC);
 	fanotify_event_cachep = KMEM_CACHE(fanotify_event_info, SLAB_PANIC);
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	fanotify_perm_event_cachep = KMEM_CACHE(fanotify_perm_event_info,
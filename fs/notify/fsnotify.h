@@ -9,7 +9,7 @@
 /* destroy all events sitting in this groups notification queue */
 extern void fsnotify_flush_notify(struct fsnotify_group *group);
 
-/* protects reads of inode and vfsmount marks list */
+/* protects reads of inode, vfsmount and sb marks list */
 extern struct srcu_struct fsnotify_mark_srcu;
 
 /* Calculate mask of events for a list of marks */
@@ -33,9 +33,15 @@ extern int fsnotify_add_inode_mark(struct fsnotify_mark *mark,
 extern int fsnotify_add_vfsmount_mark(struct fsnotify_mark *mark,
 				      struct fsnotify_group *group, struct vfsmount *mnt,
 				      int allow_dups);
+/* add a mark to a superblock */
+extern int fsnotify_add_sb_mark(struct fsnotify_mark *mark,
+				struct fsnotify_group *group, struct super_block *sb,
+				int allow_dups);
 
 /* vfsmount specific destruction of a mark */
 extern void fsnotify_destroy_vfsmount_mark(struct fsnotify_mark *mark);
+/* superblock specific destruction of a mark */
+extern void fsnotify_destroy_sb_mark(struct fsnotify_mark *mark);
 /* inode specific destruction of a mark */
 extern void fsnotify_destroy_inode_mark(struct fsnotify_mark *mark);
 /* Destroy all marks in the given list */
@@ -47,6 +53,8 @@ extern struct fsnotify_mark *fsnotify_find_mark(struct hlist_head *head,
 extern void fsnotify_clear_marks_by_inode(struct inode *inode);
 /* run the list of all marks associated with vfsmount and flag them to be freed */
 extern void fsnotify_clear_marks_by_mount(struct vfsmount *mnt);
+/* run the list of all marks associated with a superblock and flag them to be freed */
+extern void fsnotify_clear_marks_by_sb(struct super_block *sb);
 /*
  * update the dentry->d_flags of all of inode's children to indicate if inode cares
  * about events that happen to its children.
@@ -48,6 +48,9 @@
  * given inode and each mark is hooked via the i_list. (and sorta the
  * free_i_list)
  *
+ * sb->s_fsnotify_lock and mnt->mnt_root->d_lock play the same role for
+ * superblock and vfsmount marks.
+ *
  *
  * LIFETIME:
  * Inode marks survive between when they are added to an inode and when their
@@ -148,6 +151,8 @@ void fsnotify_destroy_mark_locked(struct fsnotify_mark *mark,
 		fsnotify_destroy_inode_mark(mark);
 	} else if (mark->flags & FSNOTIFY_MARK_FLAG_VFSMOUNT)
 		fsnotify_destroy_vfsmount_mark(mark);
+	else if (mark->flags & FSNOTIFY_MARK_FLAG_SUPERBLOCK)
+		fsnotify_destroy_sb_mark(mark);
 	else
 		BUG();
 
@@ -315,14 +320,14 @@ int fsnotify_add_mark_list(struct hlist_head *head, struct fsnotify_mark *mark,
  * These marks may be used for the fsnotify backend to determine which
  * event types should be delivered to which group.
  */
-int fsnotify_add_mark_locked(struct fsnotify_mark *mark,
-			     struct fsnotify_group *group, struct inode *inode,
-			     struct vfsmount *mnt, int allow_dups)
+static int __fsnotify_add_mark_locked(struct fsnotify_mark *mark,
+				      struct fsnotify_group *group,
+				      struct inode *inode, struct vfsmount *mnt,
+				      struct super_block *sb, int allow_dups)
 {
 	int ret = 0;
 
-	BUG_ON(inode && mnt);
-	BUG_ON(!inode && !mnt);
+	BUG_ON(!!inode + !!mnt + !!sb != 1);
 	BUG_ON(!mutex_is_locked(&group->mark_mutex));
 
 	/*
@@ -349,7 +354,9 @@ int fsnotify_add_mark_locked(struct fsnotify_mark *mark,
 		if (ret)
 			goto err;
 	} else {
-		BUG();
+		ret = fsnotify_add_sb_mark(mark, group, sb, allow_dups);
+		if (ret)
+			goto err;
 	}
 
 	/* this will pin the object if appropriate */
@@ -377,6 +384,22 @@ err:
 	return ret;
 }
 
+int fsnotify_add_mark_locked(struct fsnotify_mark *mark,
+			     struct fsnotify_group *group, struct inode *inode,
+			     struct vfsmount *mnt, int allow_dups)
+{
+	return __fsnotify_add_mark_locked(mark, group, inode, mnt, NULL,
+					  allow_dups);
+}
+
+int fsnotify_add_sb_mark_locked(struct fsnotify_mark *mark,
+				struct fsnotify_group *group,
+				struct super_block *sb, int allow_dups)
+{
+	return __fsnotify_add_mark_locked(mark, group, NULL, NULL, sb,
+					  allow_dups);
+}
+
 int fsnotify_add_mark(struct fsnotify_mark *mark, struct fsnotify_group *group,
 		      struct inode *inode, struct vfsmount *mnt, int allow_dups)
 {
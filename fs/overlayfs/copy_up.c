@@ -168,6 +168,16 @@ static int ovl_set_timestamps(struct dentry *upperdentry, struct kstat *stat)
 	return notify_change(upperdentry, &attr, NULL);
 }
 
+static int ovl_set_size(struct dentry *upperdentry, struct kstat *stat)
+{
+	struct iattr attr = {
+		.ia_valid = ATTR_SIZE,
+		.ia_size = stat->size,
+	};
+
+	return notify_change(upperdentry, &attr, NULL);
+}
+
 int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 {
 	int err = 0;
@@ -197,7 +207,7 @@ int ovl_set_attr(struct dentry *upperdentry, struct kstat *stat)
 static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 			      struct dentry *dentry, struct path *lowerpath,
 			      struct kstat *stat, struct iattr *attr,
-			      const char *link)
+			      const char *link, const char *metacopy)
 {
 	struct inode *wdir = workdir->d_inode;
 	struct inode *udir = upperdir->d_inode;
@@ -224,7 +234,7 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out2;
 
-	if (S_ISREG(stat->mode)) {
+	if (S_ISREG(stat->mode) && !metacopy) {
 		struct path upperpath;
 		ovl_path_upper(dentry, &upperpath);
 		BUG_ON(upperpath.dentry != NULL);
@@ -239,8 +249,19 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	if (metacopy) {
+		err = ovl_do_setxattr(newdentry, ovl_metacopy_xattr, metacopy,
+				      strlen(metacopy), 0);
+		if (err)
+			goto out_cleanup;
+	}
+
 	mutex_lock(&newdentry->d_inode->i_mutex);
-	err = ovl_set_attr(newdentry, stat);
+	err = 0;
+	if (metacopy)
+		err = ovl_set_size(newdentry, stat);
+	if (!err)
+		err = ovl_set_attr(newdentry, stat);
 	if (!err && attr)
 		err = notify_change(newdentry, attr, NULL);
 	mutex_unlock(&newdentry->d_inode->i_mutex);
@@ -251,6 +272,8 @@ static int ovl_copy_up_locked(struct dentry *workdir, struct dentry *upperdir,
 	if (err)
 		goto out_cleanup;
 
+	if (metacopy)
+		ovl_dentry_set_metacopy(dentry, true);
 	ovl_dentry_update(dentry, newdentry);
 	newdentry = NULL;
 
@@ -285,6 +308,12 @@ out_cleanup:
  * up uses upper parent i_mutex for exclusion.  Since rename can change
  * d_parent it is possible that the copy up will lock the old parent.  At
  * that point the file will have already been copied up anyway.
+ *
+ * With the metacopy option a regular file gets only its attributes
+ * copied up, unless the size is being changed.  The metacopy xattr on
+ * the upper file then records the path of the lower file relative to
+ * the lower root, and data is copied up by ovl_copy_up_meta_data() on
+ * the first open for write.
  */
 int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		    struct path *lowerpath, struct kstat *stat,
@@ -299,6 +328,8 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	const struct cred *old_cred;
 	struct cred *override_cred;
 	char *link = NULL;
+	char *metabuf = NULL;
+	char *metacopy = NULL;
 
 	ovl_path_upper(parent, &parentpath);
 	upperdir = parentpath.dentry;
@@ -313,6 +344,21 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 			return PTR_ERR(link);
 	}
 
+	if (S_ISREG(stat->mode) && stat->size && ovl_metacopy_enabled(dentry) &&
+	    !(attr && (attr->ia_valid & ATTR_SIZE))) {
+		err = -ENOMEM;
+		metabuf = kmalloc(PATH_MAX, GFP_KERNEL);
+		if (!metabuf)
+			goto out_free_link;
+
+		/* Fall back to copying the data if the path is too long */
+		metacopy = dentry_path_raw(dentry, metabuf, PATH_MAX);
+		if (IS_ERR(metacopy))
+			metacopy = NULL;
+		else
+			metacopy++;
+	}
+
 	err = -ENOMEM;
 	override_cred = prepare_creds();
 	if (!override_cred)
@@ -355,7 +401,7 @@ int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	}
 
 	err = ovl_copy_up_locked(workdir, upperdir, dentry, lowerpath,
-				 stat, attr, link);
+				 stat, attr, link, metacopy);
 	if (!err) {
 		/* Restore timestamps on parent (best effort) */
 		ovl_set_timestamps(upperdir, &pstat);
@@ -369,6 +415,92 @@ out_put_cred:
 out_free_link:
 	if (link)
 		free_page((unsigned long) link);
+	kfree(metabuf);
+
+	return err;
+}
+
+/*
+ * Copy the data of a metacopy file into its upper file, which already
+ * has the right size and attributes.  The data is read from the lower
+ * file until the metacopy xattr is removed, so a copy cut short leaves
+ * nothing to clean up.  With @no_data set the data is about to be
+ * truncated away and only the xattr is removed.
+ */
+int ovl_copy_up_meta_data(struct dentry *dentry, bool no_data)
+{
+	struct dentry *workdir = ovl_workdir(dentry);
+	int err;
+	struct kstat stat;
+	struct path lowerpath;
+	struct path upperpath;
+	struct dentry *parent;
+	struct dentry *upperdir;
+	struct dentry *upperdentry;
+	const struct cred *old_cred;
+	struct cred *override_cred;
+
+	if (!ovl_dentry_is_metacopy(dentry))
+		return 0;
+
+	err = -ENOMEM;
+	override_cred = prepare_creds();
+	if (!override_cred)
+		return err;
+
+	/*
+	 * CAP_SYS_ADMIN for removing the metacopy xattr
+	 * CAP_DAC_OVERRIDE for opening the lower and upper files
+	 * CAP_FOWNER for timestamp update
+	 * CAP_FSETID for keeping the suid and sgid bits while writing
+	 */
+	cap_raise(override_cred->cap_effective, CAP_SYS_ADMIN);
+	cap_raise(override_cred->cap_effective, CAP_DAC_OVERRIDE);
+	cap_raise(override_cred->cap_effective, CAP_FOWNER);
+	cap_raise(override_cred->cap_effective, CAP_FSETID);
+	old_cred = override_creds(override_cred);
+
+	parent = dget_parent(dentry);
+	upperdir = ovl_dentry_upper(parent);
+
+	err = -EIO;
+	if (lock_rename(workdir, upperdir) != NULL) {
+		pr_err("overlayfs: failed to lock workdir+upperdir\n");
+		goto out_unlock;
+	}
+	/* Raced with another data copy-up? */
+	err = 0;
+	if (!ovl_dentry_is_metacopy(dentry))
+		goto out_unlock;
+
+	ovl_path_upper(dentry, &upperpath);
+	upperdentry = upperpath.dentry;
+	err = vfs_getattr(&upperpath, &stat);
+	if (err)
+		goto out_unlock;
+
+	if (!no_data) {
+		ovl_path_lower(dentry, &lowerpath);
+		err = ovl_copy_up_data(&lowerpath, &upperpath, stat.size);
+		if (err)
+			goto out_unlock;
+	}
+
+	err = ovl_do_removexattr(upperdentry, ovl_metacopy_xattr);
+	if (err)
+		goto out_unlock;
+
+	ovl_dentry_set_metacopy(dentry, false);
+
+	/* Writing the data has updated the timestamps */
+	mutex_lock(&upperdentry->d_inode->i_mutex);
+	ovl_set_timestamps(upperdentry, &stat);
+	mutex_unlock(&upperdentry->d_inode->i_mutex);
+out_unlock:
+	unlock_rename(workdir, upperdir);
+	dput(parent);
+	revert_creds(old_cred);
+	put_cred(override_cred);
 
 	return err;
 }
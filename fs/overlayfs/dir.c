@@ -486,6 +486,11 @@ static int ovl_link(struct dentry *old, struct inode *newdir,
 	if (err)
 		goto out_drop_write;
 
+	/* Each link would otherwise need to find the lower data */
+	err = ovl_copy_up_meta_data(old, false);
+	if (err)
+		goto out_drop_write;
+
 	upper = ovl_dentry_upper(old);
 	err = ovl_create_or_link(new, upper->d_inode->i_mode, 0, NULL, upper);
 
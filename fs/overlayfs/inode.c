@@ -51,12 +51,18 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 
 	upperdentry = ovl_dentry_upper(dentry);
 	if (upperdentry) {
+		if (attr->ia_valid & ATTR_SIZE) {
+			err = ovl_copy_up_meta_data(dentry, !attr->ia_size);
+			if (err)
+				goto out_drop_write;
+		}
 		mutex_lock(&upperdentry->d_inode->i_mutex);
 		err = notify_change(upperdentry, attr, NULL);
 		mutex_unlock(&upperdentry->d_inode->i_mutex);
 	} else {
 		err = ovl_copy_up_last(dentry, attr, false);
 	}
+out_drop_write:
 	ovl_drop_write(dentry);
 out:
 	return err;
@@ -66,9 +72,20 @@ static int ovl_getattr(struct vfsmount *mnt, struct dentry *dentry,
 			 struct kstat *stat)
 {
 	struct path realpath;
+	struct kstat lowerstat;
+	int err;
 
 	ovl_path_real(dentry, &realpath);
-	return vfs_getattr(&realpath, stat);
+	err = vfs_getattr(&realpath, stat);
+	if (err || !ovl_dentry_is_metacopy(dentry))
+		return err;
+
+	/* The data, and so the allocated blocks, are still on lower */
+	ovl_path_lower(dentry, &realpath);
+	err = vfs_getattr(&realpath, &lowerstat);
+	if (!err)
+		stat->blocks = lowerstat.blocks;
+	return err;
 }
 
 int ovl_permission(struct inode *inode, int mask)
@@ -238,7 +255,9 @@ out:
 static bool ovl_need_xattr_filter(struct dentry *dentry,
 				  enum ovl_path_type type)
 {
-	return type == OVL_PATH_UPPER && S_ISDIR(dentry->d_inode->i_mode);
+	umode_t mode = dentry->d_inode->i_mode;
+
+	return type == OVL_PATH_UPPER && (S_ISDIR(mode) || S_ISREG(mode));
 }
 
 ssize_t ovl_getxattr(struct dentry *dentry, const char *name,
@@ -319,9 +338,9 @@ out:
 }
 
 static bool ovl_open_need_copy_up(int flags, enum ovl_path_type type,
-				  struct dentry *realdentry)
+				  struct dentry *realdentry, bool metacopy)
 {
-	if (type != OVL_PATH_LOWER)
+	if (type != OVL_PATH_LOWER && !metacopy)
 		return false;
 
 	if (special_file(realdentry->d_inode->i_mode))
@@ -340,22 +359,32 @@ static int ovl_dentry_open(struct dentry *dentry, struct file *file,
 	struct path realpath;
 	enum ovl_path_type type;
 	bool want_write = false;
+	bool metacopy;
 
 	type = ovl_path_real(dentry, &realpath);
-	if (ovl_open_need_copy_up(file->f_flags, type, realpath.dentry)) {
+	metacopy = ovl_dentry_is_metacopy(dentry);
+	if (ovl_open_need_copy_up(file->f_flags, type, realpath.dentry,
+				  metacopy)) {
+		bool no_data = file->f_flags & O_TRUNC;
+
 		want_write = true;
 		err = ovl_want_write(dentry);
 		if (err)
 			goto out;
 
-		if (file->f_flags & O_TRUNC)
+		if (no_data)
 			err = ovl_copy_up_last(dentry, NULL, true);
 		else
 			err = ovl_copy_up(dentry);
+		if (!err)
+			err = ovl_copy_up_meta_data(dentry, no_data);
 		if (err)
 			goto out_drop_write;
 
 		ovl_path_upper(dentry, &realpath);
+	} else if (metacopy) {
+		/* Read-only open of a file whose data is still on lower */
+		ovl_path_lower(dentry, &realpath);
 	}
 
 	err = vfs_open(&realpath, file, cred);
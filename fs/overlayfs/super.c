@@ -30,6 +30,7 @@ struct ovl_config {
 	char *lowerdir;
 	char *upperdir;
 	char *workdir;
+	bool metacopy;
 };
 
 /* private information held for overlayfs's superblock */
@@ -53,12 +54,14 @@ struct ovl_entry {
 		struct {
 			u64 version;
 			bool opaque;
+			bool metacopy;
 		};
 		struct rcu_head rcu;
 	};
 };
 
 const char *ovl_opaque_xattr = "trusted.overlay.opaque";
+const char *ovl_metacopy_xattr = "trusted.overlay.metacopy";
 
 
 enum ovl_path_type ovl_path_type(struct dentry *dentry)
@@ -202,6 +205,34 @@ void ovl_dentry_set_opaque(struct dentry *dentry, bool opaque)
 	oe->opaque = opaque;
 }
 
+bool ovl_metacopy_enabled(struct dentry *dentry)
+{
+	struct ovl_fs *ofs = dentry->d_sb->s_fs_info;
+	return ofs->config.metacopy;
+}
+
+/*
+ * A metacopy upper file carries the attributes of the file, while its
+ * data is still read from the lower file.
+ */
+bool ovl_dentry_is_metacopy(struct dentry *dentry)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+
+	if (!ovl_upperdentry_dereference(oe))
+		return false;
+
+	/* Pairs with smp_wmb() in ovl_dentry_update() */
+	smp_rmb();
+	return oe->metacopy;
+}
+
+void ovl_dentry_set_metacopy(struct dentry *dentry, bool metacopy)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+	oe->metacopy = metacopy;
+}
+
 void ovl_dentry_update(struct dentry *dentry, struct dentry *upperdentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
@@ -256,6 +287,54 @@ static bool ovl_is_opaquedir(struct dentry *dentry)
 	return false;
 }
 
+/*
+ * Find the lower file holding the data of a metacopy upper file.  The
+ * xattr records its path relative to the lower root, since the upper
+ * file may have been renamed since it was copied up.
+ */
+static struct dentry *ovl_lookup_metacopy(struct ovl_fs *ofs,
+					  struct dentry *upperdentry)
+{
+	struct inode *inode = upperdentry->d_inode;
+	struct dentry *lowerdentry;
+	struct path lowerpath;
+	char *name;
+	int res;
+
+	if (!inode->i_op->getxattr)
+		return NULL;
+
+	name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!name)
+		return ERR_PTR(-ENOMEM);
+
+	lowerdentry = NULL;
+	res = inode->i_op->getxattr(upperdentry, ovl_metacopy_xattr,
+				    name, PATH_MAX - 1);
+	if (res == -ENODATA || res == -EOPNOTSUPP)
+		goto out;
+
+	lowerdentry = ERR_PTR(res < 0 ? res : -EIO);
+	if (res <= 0)
+		goto out;
+	name[res] = '\0';
+
+	res = vfs_path_lookup(ofs->lower_mnt->mnt_root, ofs->lower_mnt, name,
+			      0, &lowerpath);
+	if (res) {
+		pr_warn_ratelimited("overlayfs: lower data of '%pd2' not found (%i)\n",
+				    upperdentry, res);
+		goto out;
+	}
+
+	if (S_ISREG(lowerpath.dentry->d_inode->i_mode))
+		lowerdentry = dget(lowerpath.dentry);
+	path_put(&lowerpath);
+out:
+	kfree(name);
+	return lowerdentry;
+}
+
 static void ovl_dentry_release(struct dentry *dentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
@@ -345,6 +424,17 @@ struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
 		oe->opaque = true;
 	}
 
+	if (upperdentry && !lowerdentry &&
+	    S_ISREG(upperdentry->d_inode->i_mode)) {
+		lowerdentry = ovl_lookup_metacopy(dentry->d_sb->s_fs_info,
+						  upperdentry);
+		err = PTR_ERR(lowerdentry);
+		if (IS_ERR(lowerdentry))
+			goto out_dput_upper;
+		if (lowerdentry)
+			oe->metacopy = true;
+	}
+
 	if (lowerdentry || upperdentry) {
 		struct dentry *realdentry;
 
@@ -434,6 +524,8 @@ static int ovl_show_options(struct seq_file *m, struct dentry *dentry)
 	seq_printf(m, ",lowerdir=%s", ufs->config.lowerdir);
 	seq_printf(m, ",upperdir=%s", ufs->config.upperdir);
 	seq_printf(m, ",workdir=%s", ufs->config.workdir);
+	if (ufs->config.metacopy)
+		seq_puts(m, ",metacopy=on");
 	return 0;
 }
 
@@ -447,6 +539,8 @@ enum {
 	OPT_LOWERDIR,
 	OPT_UPPERDIR,
 	OPT_WORKDIR,
+	OPT_METACOPY_ON,
+	OPT_METACOPY_OFF,
 	OPT_ERR,
 };
 
@@ -454,6 +548,8 @@ static const match_table_t ovl_tokens = {
 	{OPT_LOWERDIR,			"lowerdir=%s"},
 	{OPT_UPPERDIR,			"upperdir=%s"},
 	{OPT_WORKDIR,			"workdir=%s"},
+	{OPT_METACOPY_ON,		"metacopy=on"},
+	{OPT_METACOPY_OFF,		"metacopy=off"},
 	{OPT_ERR,			NULL}
 };
 
@@ -514,6 +610,14 @@ static int ovl_parse_opt(char *opt, struct ovl_config *config)
 				return -ENOMEM;
 			break;
 
+		case OPT_METACOPY_ON:
+			config->metacopy = true;
+			break;
+
+		case OPT_METACOPY_OFF:
+			config->metacopy = false;
+			break;
+
 		default:
 			return -EINVAL;
 		}
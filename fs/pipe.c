@@ -39,6 +39,13 @@ unsigned int pipe_max_size = 1048576;
  */
 unsigned int pipe_min_size = PAGE_SIZE;
 
+/*
+ * Adaptive mode, /proc/sys/fs/pipe-adaptive: pipes that fill up grow
+ * towards pipe_max_size, small writes are packed into the last page and
+ * the reader is only woken when it may be waiting for data.
+ */
+int pipe_adaptive;
+
 /*
  * We use a start+len construction, which provides full use of the 
  * allocated memory.
@@ -335,6 +342,21 @@ static inline int is_packetized(struct file *file)
 	return (file->f_flags & O_DIRECT) != 0;
 }
 
+static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages);
+
+/*
+ * In adaptive mode a writer that finds the pipe full doubles it, up to
+ * pipe_max_size, rather than waiting for the reader to catch up.
+ */
+static bool pipe_grow(struct pipe_inode_info *pipe)
+{
+	unsigned int max = pipe_max_size >> PAGE_SHIFT;
+
+	if (pipe->buffers >= max)
+		return false;
+	return pipe_set_size(pipe, min(pipe->buffers * 2, max)) > 0;
+}
+
 static ssize_t
 pipe_write(struct kiocb *iocb, struct iov_iter *from)
 {
@@ -342,6 +364,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 	struct pipe_inode_info *pipe = filp->private_data;
 	ssize_t ret = 0;
 	int do_wakeup = 0;
+	bool was_empty = true;
 	size_t total_len = iov_iter_count(from);
 	ssize_t chars;
 
@@ -357,6 +380,12 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		goto out;
 	}
 
+	/*
+	 * Readers only sleep on an empty pipe. If there is data already,
+	 * whoever wrote it has woken them, and they will find ours as well.
+	 */
+	was_empty = !pipe->nrbufs;
+
 	/* We try to merge small writes */
 	chars = total_len & (PAGE_SIZE-1); /* size of the last buffer */
 	if (pipe->nrbufs && chars != 0) {
@@ -366,6 +395,16 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		const struct pipe_buf_operations *ops = buf->ops;
 		int offset = buf->offset + buf->len;
 
+		/*
+		 * In adaptive mode a small write that does not fit also tops
+		 * up the last page, the rest going to a new one. Only with a
+		 * free slot, so a PIPE_BUF write is never split by a wait.
+		 */
+		if (pipe_adaptive && offset + chars > PAGE_SIZE &&
+		    offset < PAGE_SIZE && total_len < PAGE_SIZE &&
+		    pipe->nrbufs < pipe->buffers && !is_packetized(filp))
+			chars = PAGE_SIZE - offset;
+
 		if (ops->can_merge && offset + chars <= PAGE_SIZE) {
 			int error = ops->confirm(pipe, buf);
 			if (error)
@@ -440,6 +479,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		}
 		if (bufs < pipe->buffers)
 			continue;
+		if (pipe_adaptive && pipe_grow(pipe))
+			continue;
 		if (filp->f_flags & O_NONBLOCK) {
 			if (!ret)
 				ret = -EAGAIN;
@@ -458,8 +499,17 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		pipe->waiting_writers++;
 		pipe_wait(pipe);
 		pipe->waiting_writers--;
+		if (!pipe->nrbufs)
+			was_empty = true;
 	}
 out:
+	/*
+	 * Edge-triggered epoll and SIGIO users expect an event for every
+	 * write, so the wakeups are only batched if neither is in use.
+	 */
+	if (pipe_adaptive && !was_empty && !pipe->poll_usage &&
+	    !pipe->fasync_readers)
+		do_wakeup = 0;
 	__pipe_unlock(pipe);
 	if (do_wakeup) {
 		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
@@ -505,6 +555,8 @@ pipe_poll(struct file *filp, poll_table *wait)
 	struct pipe_inode_info *pipe = filp->private_data;
 	int nrbufs;
 
+	if (!pipe->poll_usage)
+		pipe->poll_usage = true;
 	poll_wait(filp, &pipe->wait, wait);
 
 	/* Reading only -- no need for acquiring the semaphore.  */
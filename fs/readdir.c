@@ -11,10 +11,14 @@
 #include <linux/mm.h>
 #include <linux/errno.h>
 #include <linux/stat.h>
+#include <linux/cred.h>
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/fsnotify.h>
 #include <linux/dirent.h>
+#include <linux/dirstat.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
 #include <linux/security.h>
 #include <linux/syscalls.h>
 #include <linux/unistd.h>
@@ -307,3 +311,236 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	fdput(f);
 	return error;
 }
+
+/*
+ * getdents_stat() saves a crawler the fstatat() and the path walk it
+ * would otherwise do for every entry.  The names are first collected
+ * into a page, as nfsd_buffered_readdir() does, since not every
+ * filesystem can take a lookup from within its ->iterate.  The batch
+ * is then looked up with the directory locked once, which mostly finds
+ * the dentries in the dcache, and stat'ed after the lock is dropped.
+ */
+struct dirstat_entry {
+	u64		ino;
+	loff_t		offset;
+	struct dentry	*dentry;
+	unsigned int	d_type;
+	int		namlen;
+	char		name[0];
+};
+
+struct getdents_stat_callback {
+	struct dir_context ctx;
+	char		*page;
+	unsigned int	used;		/* bytes of the page in use */
+	unsigned int	nr;		/* entries in the page */
+	unsigned int	count;		/* user buffer left */
+	int		error;
+};
+
+static inline unsigned int dirstat_entry_size(int namlen)
+{
+	return ALIGN(offsetof(struct dirstat_entry, name) + namlen, sizeof(u64));
+}
+
+static inline unsigned int dirstat_reclen(int namlen)
+{
+	return ALIGN(offsetof(struct linux_dirent_stat, d_name) + namlen + 1,
+		sizeof(u64));
+}
+
+static int filldir_stat(struct dir_context *ctx, const char *name, int namlen,
+			loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct getdents_stat_callback *buf =
+		container_of(ctx, struct getdents_stat_callback, ctx);
+	unsigned int size = dirstat_entry_size(namlen);
+	struct dirstat_entry *de;
+
+	/* page full: pick up from here in the next batch */
+	if (buf->used + size > PAGE_SIZE)
+		return -ENOSPC;
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (dirstat_reclen(namlen) > buf->count)
+		return -EINVAL;
+	buf->error = 0;
+
+	de = (struct dirstat_entry *)(buf->page + buf->used);
+	de->ino = ino;
+	de->offset = offset;
+	de->dentry = NULL;
+	de->d_type = d_type;
+	de->namlen = namlen;
+	memcpy(de->name, name, namlen);
+
+	buf->used += size;
+	buf->nr++;
+	buf->count -= dirstat_reclen(namlen);
+	return 0;
+}
+
+/*
+ * Called with the directory locked.  ".." is left alone, it may live
+ * on another mount.
+ */
+static struct dentry *dirstat_lookup(struct dentry *parent,
+				     struct dirstat_entry *de)
+{
+	struct dentry *dentry;
+
+	if (de->name[0] == '.') {
+		if (de->namlen == 1)
+			return dget(parent);
+		if (de->namlen == 2 && de->name[1] == '.')
+			return NULL;
+	}
+
+	dentry = lookup_one_len(de->name, parent, de->namlen);
+	if (IS_ERR(dentry))
+		return NULL;
+	if (!dentry->d_inode) {
+		/* raced with unlink */
+		dput(dentry);
+		return NULL;
+	}
+	return dentry;
+}
+
+static void dirstat_fill(struct linux_dirent_stat *ds, struct vfsmount *mnt,
+			 struct dentry *dentry, unsigned int mask)
+{
+	struct path path = { .mnt = mnt, .dentry = dentry };
+	struct kstat stat;
+
+	path_get(&path);
+	while (d_mountpoint(path.dentry) && follow_down_one(&path))
+		;
+	if (vfs_getattr(&path, &stat))
+		goto out;
+
+	ds->ds_mask = mask;
+	ds->ds_mode = stat.mode;
+	ds->ds_nlink = stat.nlink;
+	ds->ds_uid = from_kuid_munged(current_user_ns(), stat.uid);
+	ds->ds_gid = from_kgid_munged(current_user_ns(), stat.gid);
+	ds->ds_dev = huge_encode_dev(stat.dev);
+	ds->ds_rdev = huge_encode_dev(stat.rdev);
+	ds->ds_size = stat.size;
+	ds->ds_blocks = stat.blocks;
+	ds->ds_blksize = stat.blksize;
+	ds->ds_atime.tv_sec = stat.atime.tv_sec;
+	ds->ds_atime.tv_nsec = stat.atime.tv_nsec;
+	ds->ds_mtime.tv_sec = stat.mtime.tv_sec;
+	ds->ds_mtime.tv_nsec = stat.mtime.tv_nsec;
+	ds->ds_ctime.tv_sec = stat.ctime.tv_sec;
+	ds->ds_ctime.tv_nsec = stat.ctime.tv_nsec;
+out:
+	path_put(&path);
+}
+
+/*
+ * Look up and stat the entries collected in buf->page and copy them to
+ * userspace.  Returns the number of bytes copied.
+ */
+static int dirstat_copy_batch(struct file *file,
+			      struct getdents_stat_callback *buf,
+			      struct linux_dirent_stat __user *dirent,
+			      unsigned int mask)
+{
+	struct dentry *parent = file->f_path.dentry;
+	struct linux_dirent_stat ds;
+	struct dirstat_entry *de, *next;
+	unsigned int i;
+	int written = 0;
+	int error = 0;
+
+	/* With an empty mask there is nothing readdir didn't tell us */
+	if (mask) {
+		mutex_lock(&parent->d_inode->i_mutex);
+		de = (struct dirstat_entry *)buf->page;
+		for (i = 0; i < buf->nr; i++) {
+			de->dentry = dirstat_lookup(parent, de);
+			de = (void *)de + dirstat_entry_size(de->namlen);
+		}
+		mutex_unlock(&parent->d_inode->i_mutex);
+	}
+
+	de = (struct dirstat_entry *)buf->page;
+	for (i = 0; i < buf->nr; i++, de = next) {
+		unsigned int reclen = dirstat_reclen(de->namlen);
+
+		next = (void *)de + dirstat_entry_size(de->namlen);
+		if (!error) {
+			memset(&ds, 0, sizeof(ds));
+			ds.d_ino = de->ino;
+			ds.d_off = i + 1 < buf->nr ? next->offset : buf->ctx.pos;
+			ds.d_reclen = reclen;
+			ds.d_type = de->d_type;
+			if (de->dentry)
+				dirstat_fill(&ds, file->f_path.mnt, de->dentry,
+					     mask);
+
+			if (copy_to_user(dirent, &ds, sizeof(ds)) ||
+			    copy_to_user(dirent->d_name, de->name,
+					 de->namlen) ||
+			    __put_user(0, dirent->d_name + de->namlen))
+				error = -EFAULT;
+			dirent = (void __user *)dirent + reclen;
+			written += reclen;
+		}
+		dput(de->dentry);
+	}
+	return error ? error : written;
+}
+
+SYSCALL_DEFINE4(getdents_stat, unsigned int, fd,
+		struct linux_dirent_stat __user *, dirent, unsigned int, count,
+		unsigned int, mask)
+{
+	struct fd f;
+	struct getdents_stat_callback buf = {
+		.ctx.actor = filldir_stat,
+	};
+	unsigned int left = count;
+	int error;
+
+	if (mask & ~DIRSTAT_ALL)
+		return -EINVAL;
+	if (!access_ok(VERIFY_WRITE, dirent, count))
+		return -EFAULT;
+
+	f = fdget(fd);
+	if (!f.file)
+		return -EBADF;
+
+	error = -ENOMEM;
+	buf.page = (char *)__get_free_page(GFP_KERNEL);
+	if (!buf.page)
+		goto out;
+
+	for (;;) {
+		buf.used = 0;
+		buf.nr = 0;
+		buf.count = left;
+		buf.error = 0;
+
+		error = iterate_dir(f.file, &buf.ctx);
+		if (error >= 0)
+			error = buf.error;
+		if (!buf.nr)
+			break;
+
+		error = dirstat_copy_batch(f.file, &buf, dirent, mask);
+		if (error < 0)
+			break;
+		dirent = (void __user *)dirent + error;
+		left -= error;
+	}
+	if (left != count && error != -EFAULT)
+		error = count - left;
+
+	free_page((unsigned long)buf.page);
+out:
+	fdput(f);
+	return error;
+}
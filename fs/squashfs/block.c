@@ -78,6 +78,26 @@ static struct buffer_head *get_block_length(struct super_block *sb,
 }
 
 
+/*
+ * Start reading the device blocks holding a datablock without waiting
+ * for them.  A later squashfs_read_data() of the datablock finds the
+ * buffers in the buffer cache, and only waits for the I/O to complete.
+ */
+void squashfs_readahead_data(struct super_block *sb, u64 index, int length)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int bytes = -(index & ((1 << msblk->devblksize_log2) - 1));
+	u64 cur_index = index >> msblk->devblksize_log2;
+
+	length = SQUASHFS_COMPRESSED_SIZE_BLOCK(length);
+	if (length < 0 || length > msblk->block_size ||
+			(index + length) > msblk->bytes_used)
+		return;
+
+	for (; bytes < length; cur_index++, bytes += msblk->devblksize)
+		sb_breadahead(sb, cur_index);
+}
+
 /*
  * Read and decompress a metadata block or datablock.  Length is non-zero
  * if a datablock is being read (the size is stored elsewhere in the
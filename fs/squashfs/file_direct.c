@@ -13,6 +13,8 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/blkdev.h>
+#include <linux/workqueue.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -174,3 +176,238 @@ out:
 	squashfs_cache_put(buffer);
 	return res;
 }
+
+
+/*
+ * Readahead.  Squashfs_readpage() reads and decompresses one datablock
+ * at a time.  Here the I/O for every datablock in the readahead window
+ * is started up-front, and if there is more than one decompressor the
+ * datablocks are decompressed by workqueue threads in parallel, each
+ * directly into its own page cache pages.
+ */
+struct squashfs_ra_control {
+	atomic_t		pending;
+	struct completion	done;
+};
+
+struct squashfs_ra_block {
+	struct work_struct		work;
+	struct list_head		list;
+	struct super_block		*sb;
+	struct squashfs_ra_control	*ctl;
+	struct squashfs_page_actor	*actor;
+	u64				block;
+	int				bsize;
+	int				pages;
+	struct page			*page[0];
+};
+
+static void squashfs_ra_free(struct squashfs_ra_block *ra)
+{
+	kfree(ra->actor);
+	kfree(ra);
+}
+
+/*
+ * Add all the pages of the datablock holding target_page to the page
+ * cache, taking them off the readahead list where they are on it.  If
+ * some page can't be had, or is uptodate already, give up and leave the
+ * datablock to squashfs_readpage(), with target_page still locked.
+ */
+static struct squashfs_ra_block *squashfs_ra_block_get(struct page *target_page,
+	struct list_head *pages, u64 block, int bsize)
+{
+	struct address_space *mapping = target_page->mapping;
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+
+	int file_end = (i_size_read(inode) - 1) >> PAGE_CACHE_SHIFT;
+	int mask = (1 << (msblk->block_log - PAGE_CACHE_SHIFT)) - 1;
+	int start_index = target_page->index & ~mask;
+	int end_index = start_index | mask;
+	int i, n, nr, missing_pages = 0;
+	struct squashfs_ra_block *ra;
+
+	if (end_index > file_end)
+		end_index = file_end;
+
+	nr = end_index - start_index + 1;
+
+	ra = kzalloc(sizeof(*ra) + nr * sizeof(struct page *), GFP_KERNEL);
+	if (ra == NULL)
+		return NULL;
+
+	ra->actor = squashfs_page_actor_init_special(ra->page, nr, 0);
+	if (ra->actor == NULL) {
+		kfree(ra);
+		return NULL;
+	}
+
+	for (i = 0, n = start_index; i < nr; i++, n++) {
+		struct page *page = NULL;
+
+		if (n == target_page->index) {
+			ra->page[i] = target_page;
+			continue;
+		}
+
+		/* The readahead list is in ascending index order from the tail */
+		if (!list_empty(pages)) {
+			page = list_entry(pages->prev, struct page, lru);
+			if (page->index == n) {
+				list_del(&page->lru);
+				if (add_to_page_cache_lru(page, mapping, n,
+							GFP_KERNEL)) {
+					page_cache_release(page);
+					page = NULL;
+				}
+			} else
+				page = NULL;
+		}
+
+		if (page == NULL)
+			page = grab_cache_page_nowait(mapping, n);
+
+		ra->page[i] = page;
+		if (page == NULL || PageUptodate(page))
+			missing_pages++;
+	}
+
+	if (missing_pages) {
+		for (i = 0; i < nr; i++) {
+			if (ra->page[i] == NULL || ra->page[i] == target_page)
+				continue;
+			unlock_page(ra->page[i]);
+			page_cache_release(ra->page[i]);
+		}
+		squashfs_ra_free(ra);
+		return NULL;
+	}
+
+	ra->sb = inode->i_sb;
+	ra->block = block;
+	ra->bsize = bsize;
+	ra->pages = nr;
+	return ra;
+}
+
+static void squashfs_ra_decompress(struct squashfs_ra_block *ra)
+{
+	int i, bytes, res;
+	void *pageaddr;
+
+	res = squashfs_read_data(ra->sb, ra->block, ra->bsize, NULL,
+				ra->actor);
+
+	/* Last page may have trailing bytes not filled */
+	bytes = res % PAGE_CACHE_SIZE;
+	if (res > 0 && bytes) {
+		pageaddr = kmap_atomic(ra->page[ra->pages - 1]);
+		memset(pageaddr + bytes, 0, PAGE_CACHE_SIZE - bytes);
+		kunmap_atomic(pageaddr);
+	}
+
+	/* Failed pages are read again by squashfs_readpage() when wanted */
+	for (i = 0; i < ra->pages; i++) {
+		flush_dcache_page(ra->page[i]);
+		if (res < 0)
+			SetPageError(ra->page[i]);
+		else
+			SetPageUptodate(ra->page[i]);
+		unlock_page(ra->page[i]);
+		page_cache_release(ra->page[i]);
+	}
+}
+
+static void squashfs_ra_work(struct work_struct *work)
+{
+	struct squashfs_ra_block *ra = container_of(work,
+					struct squashfs_ra_block, work);
+	struct squashfs_ra_control *ctl = ra->ctl;
+
+	squashfs_ra_decompress(ra);
+	squashfs_ra_free(ra);
+
+	if (atomic_dec_and_test(&ctl->pending))
+		complete(&ctl->done);
+}
+
+int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	bool parallel = squashfs_max_decompressors() > 1;
+	struct squashfs_ra_block *ra, *first = NULL, *next;
+	struct squashfs_ra_control ctl;
+	struct blk_plug plug;
+	LIST_HEAD(ra_list);
+
+	atomic_set(&ctl.pending, 1);
+	init_completion(&ctl.done);
+
+	/* Find the datablocks and start reading all of them */
+	blk_start_plug(&plug);
+	while (!list_empty(pages)) {
+		struct page *page = list_entry(pages->prev, struct page, lru);
+		int index = page->index >> shift;
+		u64 block = 0;
+		int bsize = 0;
+
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					GFP_KERNEL)) {
+			page_cache_release(page);
+			continue;
+		}
+
+		if (index < file_end || squashfs_i(inode)->fragment_block ==
+					SQUASHFS_INVALID_BLK)
+			bsize = squashfs_read_blocklist(inode, index, &block);
+
+		ra = bsize > 0 ? squashfs_ra_block_get(page, pages, block,
+					bsize) : NULL;
+		if (ra == NULL) {
+			/* Fragments, sparse and partially cached datablocks */
+			mapping->a_ops->readpage(file, page);
+			page_cache_release(page);
+			continue;
+		}
+
+		squashfs_readahead_data(inode->i_sb, block, bsize);
+		list_add_tail(&ra->list, &ra_list);
+	}
+	blk_finish_plug(&plug);
+
+	/*
+	 * Hand all but the first datablock to the workqueue, and decompress
+	 * the first one here, as the reader is most likely waiting on it.
+	 */
+	list_for_each_entry_safe(ra, next, &ra_list, list) {
+		if (first == NULL) {
+			first = ra;
+			continue;
+		}
+		if (!parallel)
+			break;
+
+		list_del(&ra->list);
+		ra->ctl = &ctl;
+		atomic_inc(&ctl.pending);
+		INIT_WORK(&ra->work, squashfs_ra_work);
+		queue_work(system_unbound_wq, &ra->work);
+	}
+
+	list_for_each_entry_safe(ra, next, &ra_list, list) {
+		list_del(&ra->list);
+		squashfs_ra_decompress(ra);
+		squashfs_ra_free(ra);
+	}
+
+	if (!atomic_dec_and_test(&ctl.pending))
+		wait_for_completion(&ctl.done);
+
+	return 0;
+}
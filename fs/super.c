@@ -191,6 +191,10 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags)
 	s->s_bdi = &default_backing_dev_info;
 	INIT_HLIST_NODE(&s->s_instances);
 	INIT_HLIST_BL_HEAD(&s->s_anon);
+#ifdef CONFIG_FSNOTIFY
+	INIT_HLIST_HEAD(&s->s_fsnotify_marks);
+	spin_lock_init(&s->s_fsnotify_lock);
+#endif
 	INIT_LIST_HEAD(&s->s_inodes);
 
 	if (list_lru_init(&s->s_dentry_lru))
@@ -397,6 +401,7 @@ void generic_shutdown_super(struct super_block *sb)
 		sb->s_flags &= ~MS_ACTIVE;
 
 		fsnotify_unmount_inodes(&sb->s_inodes);
+		fsnotify_sb_delete(sb);
 
 		evict_inodes(sb);
 
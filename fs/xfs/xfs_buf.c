@@ -33,6 +33,7 @@
 #include <linux/migrate.h>
 #include <linux/backing-dev.h>
 #include <linux/freezer.h>
+#include <linux/jhash.h>
 
 #include "xfs_format.h"
 #include "xfs_log_format.h"
@@ -171,7 +172,7 @@ _xfs_buf_alloc(
 	init_completion(&bp->b_iowait);
 	INIT_LIST_HEAD(&bp->b_lru);
 	INIT_LIST_HEAD(&bp->b_list);
-	RB_CLEAR_NODE(&bp->b_rbnode);
+	INIT_HASH_HEAD(&bp->b_rhash_head);
 	sema_init(&bp->b_sema, 0); /* held, no waiters */
 	spin_lock_init(&bp->b_lock);
 	XB_SET_OWNER(bp);
@@ -245,12 +246,24 @@ _xfs_buf_free_pages(
 	}
 }
 
+STATIC void
+__xfs_buf_free(
+	struct rcu_head		*head)
+{
+	struct xfs_buf		*bp = container_of(head, struct xfs_buf, b_rcu);
+
+	kmem_zone_free(xfs_buf_zone, bp);
+}
+
 /*
  *	Releases the specified buffer.
  *
  * 	The modification state of any associated pages is left unchanged.
  * 	The buffer must not be on any hash - use xfs_buf_rele instead for
  * 	hashed and refcounted buffers
+ *
+ *	Lockless lookups may still be looking at the buffer, so the buffer
+ *	itself is only returned to the zone after an RCU grace period.
  */
 void
 xfs_buf_free(
@@ -276,7 +289,7 @@ xfs_buf_free(
 		kmem_free(bp->b_addr);
 	_xfs_buf_free_pages(bp);
 	xfs_buf_free_maps(bp);
-	kmem_zone_free(xfs_buf_zone, bp);
+	call_rcu(&bp->b_rcu, __xfs_buf_free);
 }
 
 /*
@@ -425,6 +438,77 @@ _xfs_buf_map_pages(
  *	Finding and Reading Buffers
  */
 
+/*
+ * Each AG indexes its cached buffers in an RCU-safe hash table keyed by the
+ * buffer's starting block number. Lookups walk the table under
+ * rcu_read_lock() without taking pag_buf_lock and only succeed if they can
+ * take a reference to a buffer whose hold count has not already dropped to
+ * zero. Insertion and removal of buffers are serialised by pag_buf_lock so
+ * that a buffer is never hashed twice. The table grows past 75% occupancy
+ * from the rhashtable's own deferred worker, which does not take
+ * pag_buf_lock and so cannot deadlock against the buffer cache shrinker.
+ */
+struct xfs_buf_cmp_arg {
+	xfs_daddr_t		blkno;
+	int			numblks;
+};
+
+/*
+ * A block number match with a different length is only allowed if the buffer
+ * in the cache is stale and the transaction that made it stale has not yet
+ * committed, i.e. we are reallocating a busy extent. Such buffers are skipped,
+ * the exact match may be further down the hash chain.
+ */
+STATIC bool
+xfs_buf_hash_cmp(
+	void			*obj,
+	void			*arg)
+{
+	struct xfs_buf		*bp = obj;
+	struct xfs_buf_cmp_arg	*cmp = arg;
+
+	if (bp->b_bn != cmp->blkno)
+		return false;
+	if (bp->b_length != cmp->numblks) {
+		ASSERT(bp->b_flags & XBF_STALE);
+		return false;
+	}
+	return true;
+}
+
+STATIC struct xfs_buf *
+xfs_buf_hash_lookup(
+	struct xfs_perag	*pag,
+	struct xfs_buf_cmp_arg	*cmp)
+{
+	return rhashtable_lookup_compare(&pag->pag_buf_hash, &cmp->blkno,
+					 xfs_buf_hash_cmp, cmp);
+}
+
+int
+xfs_buf_hash_init(
+	struct xfs_perag	*pag)
+{
+	struct rhashtable_params params = {
+		.nelem_hint	= 48,
+		.key_len	= sizeof(xfs_daddr_t),
+		.key_offset	= offsetof(struct xfs_buf, b_bn),
+		.head_offset	= offsetof(struct xfs_buf, b_rhash_head),
+		.hashfn		= jhash,
+		.grow_decision	= rht_grow_above_75,
+	};
+
+	mutex_init(&pag->pag_buf_lock);
+	return rhashtable_init(&pag->pag_buf_hash, &params);
+}
+
+void
+xfs_buf_hash_destroy(
+	struct xfs_perag	*pag)
+{
+	rhashtable_destroy(&pag->pag_buf_hash);
+}
+
 /*
  *	Look up, and creates if absent, a lockable buffer for
  *	a given range of an inode.  The buffer is returned
@@ -440,8 +524,7 @@ _xfs_buf_find(
 {
 	size_t			numbytes;
 	struct xfs_perag	*pag;
-	struct rb_node		**rbp;
-	struct rb_node		*parent;
+	struct xfs_buf_cmp_arg	cmp;
 	xfs_buf_t		*bp;
 	xfs_daddr_t		blkno = map[0].bm_bn;
 	xfs_daddr_t		eofs;
@@ -474,58 +557,54 @@ _xfs_buf_find(
 		return NULL;
 	}
 
-	/* get tree root */
+	/* get hash table */
 	pag = xfs_perag_get(btp->bt_mount,
 				xfs_daddr_to_agno(btp->bt_mount, blkno));
+	cmp.blkno = blkno;
+	cmp.numblks = numblks;
 
-	/* walk tree */
-	spin_lock(&pag->pag_buf_lock);
-	rbp = &pag->pag_buf_tree.rb_node;
-	parent = NULL;
-	bp = NULL;
-	while (*rbp) {
-		parent = *rbp;
-		bp = rb_entry(parent, struct xfs_buf, b_rbnode);
-
-		if (blkno < bp->b_bn)
-			rbp = &(*rbp)->rb_left;
-		else if (blkno > bp->b_bn)
-			rbp = &(*rbp)->rb_right;
-		else {
-			/*
-			 * found a block number match. If the range doesn't
-			 * match, the only way this is allowed is if the buffer
-			 * in the cache is stale and the transaction that made
-			 * it stale has not yet committed. i.e. we are
-			 * reallocating a busy extent. Skip this buffer and
-			 * continue searching to the right for an exact match.
-			 */
-			if (bp->b_length != numblks) {
-				ASSERT(bp->b_flags & XBF_STALE);
-				rbp = &(*rbp)->rb_right;
-				continue;
-			}
-			atomic_inc(&bp->b_hold);
-			goto found;
-		}
+	/*
+	 * Try a lockless lookup first. This can fail to take a reference to
+	 * a buffer that is being freed, so a miss here is rechecked under the
+	 * lock before we insert a new buffer.
+	 */
+	rcu_read_lock();
+	bp = xfs_buf_hash_lookup(pag, &cmp);
+	if (bp && atomic_inc_not_zero(&bp->b_hold)) {
+		rcu_read_unlock();
+		XFS_STATS_INC(xb_get_rcu);
+		goto found;
+	}
+	rcu_read_unlock();
+	XFS_STATS_INC(xb_miss_rcu);
+
+	/*
+	 * Hashed buffers always have a non-zero hold count while pag_buf_lock
+	 * is held, as xfs_buf_rele() only drops the last reference under the
+	 * lock and either takes a new one for the LRU or unhashes the buffer.
+	 */
+	mutex_lock(&pag->pag_buf_lock);
+	bp = xfs_buf_hash_lookup(pag, &cmp);
+	if (bp) {
+		atomic_inc(&bp->b_hold);
+		mutex_unlock(&pag->pag_buf_lock);
+		goto found;
 	}
 
 	/* No match found */
 	if (new_bp) {
-		rb_link_node(&new_bp->b_rbnode, parent, rbp);
-		rb_insert_color(&new_bp->b_rbnode, &pag->pag_buf_tree);
 		/* the buffer keeps the perag reference until it is freed */
 		new_bp->b_pag = pag;
-		spin_unlock(&pag->pag_buf_lock);
+		rhashtable_insert(&pag->pag_buf_hash, &new_bp->b_rhash_head);
+		mutex_unlock(&pag->pag_buf_lock);
 	} else {
 		XFS_STATS_INC(xb_miss_locked);
-		spin_unlock(&pag->pag_buf_lock);
+		mutex_unlock(&pag->pag_buf_lock);
 		xfs_perag_put(pag);
 	}
 	return new_bp;
 
 found:
-	spin_unlock(&pag->pag_buf_lock);
 	xfs_perag_put(pag);
 
 	if (!xfs_buf_trylock(bp)) {
@@ -873,16 +952,13 @@ xfs_buf_rele(
 
 	if (!pag) {
 		ASSERT(list_empty(&bp->b_lru));
-		ASSERT(RB_EMPTY_NODE(&bp->b_rbnode));
 		if (atomic_dec_and_test(&bp->b_hold))
 			xfs_buf_free(bp);
 		return;
 	}
 
-	ASSERT(!RB_EMPTY_NODE(&bp->b_rbnode));
-
 	ASSERT(atomic_read(&bp->b_hold) > 0);
-	if (atomic_dec_and_lock(&bp->b_hold, &pag->pag_buf_lock)) {
+	if (atomic_dec_and_mutex_lock(&bp->b_hold, &pag->pag_buf_lock)) {
 		spin_lock(&bp->b_lock);
 		if (!(bp->b_flags & XBF_STALE) && atomic_read(&bp->b_lru_ref)) {
 			/*
@@ -895,7 +971,7 @@ xfs_buf_rele(
 				atomic_inc(&bp->b_hold);
 			}
 			spin_unlock(&bp->b_lock);
-			spin_unlock(&pag->pag_buf_lock);
+			mutex_unlock(&pag->pag_buf_lock);
 		} else {
 			/*
 			 * most of the time buffers will already be removed from
@@ -911,8 +987,9 @@ xfs_buf_rele(
 			spin_unlock(&bp->b_lock);
 
 			ASSERT(!(bp->b_flags & _XBF_DELWRI_Q));
-			rb_erase(&bp->b_rbnode, &pag->pag_buf_tree);
-			spin_unlock(&pag->pag_buf_lock);
+			rhashtable_remove(&pag->pag_buf_hash,
+					  &bp->b_rhash_head);
+			mutex_unlock(&pag->pag_buf_lock);
 			xfs_perag_put(pag);
 			xfs_buf_free(bp);
 		}
@@ -1896,5 +1973,7 @@ xfs_buf_init(void)
 void
 xfs_buf_terminate(void)
 {
+	/* wait for rcu-deferred buffer frees before destroying the zone */
+	rcu_barrier();
 	kmem_zone_destroy(xfs_buf_zone);
 }
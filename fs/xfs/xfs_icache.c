@@ -175,7 +175,7 @@ xfs_iget_cache_hit(
 	 *	     wait_on_inode to wait for these flags to be cleared
 	 *	     instead of polling for it.
 	 */
-	if (ip->i_flags & (XFS_INEW|XFS_IRECLAIM)) {
+	if (ip->i_flags & (XFS_INEW|XFS_IRECLAIM|XFS_NEED_INACTIVE)) {
 		trace_xfs_iget_skip(ip);
 		XFS_STATS_INC(xs_ig_frecycle);
 		error = -EAGAIN;
@@ -775,6 +775,99 @@ xfs_inode_set_reclaim_tag(
 	xfs_perag_put(pag);
 }
 
+/*
+ * Background inactivation of unlinked inodes.
+ *
+ * Freeing the extents, attributes and on-disk inode of an unlinked file can
+ * take a long time, so rather than doing this in the context of the process
+ * dropping the last reference, unlinked inodes are queued on their AG once
+ * the VFS has finished with them and processed in batches by a worker. The
+ * worker is queued on a per-cpu workqueue, so each CPU inactivates the
+ * inodes it released. Once inactivated, the inode is handed over to
+ * background reclaim just like any other inode.
+ *
+ * If the queue for an AG backs up, the process queueing more inodes waits
+ * for the worker to catch up so that unlinks cannot run arbitrarily far
+ * ahead of the freeing of their space. We cannot do that from memory
+ * reclaim or from within a transaction, as the worker needs to allocate
+ * memory and reserve log space itself.
+ */
+#define XFS_INACTIVE_THROTTLE	256
+
+bool
+xfs_inode_needs_inactive(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+
+	if (ip->i_d.di_mode == 0 || ip->i_d.di_nlink != 0)
+		return false;
+	if (mp->m_flags & XFS_MOUNT_RDONLY)
+		return false;
+	return true;
+}
+
+void
+xfs_inode_queue_inactive(
+	struct xfs_inode	*ip)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_perag	*pag;
+	int			queued;
+
+	ASSERT(xfs_iflags_test(ip, XFS_NEED_INACTIVE));
+
+	pag = xfs_perag_get(mp, XFS_INO_TO_AGNO(mp, ip->i_ino));
+	queued = atomic_inc_return(&pag->pag_inactive_count);
+	llist_add(&ip->i_inactive_node, &pag->pag_inactive_list);
+	queue_work(mp->m_inactive_workqueue, &pag->pag_inactive_work);
+
+	if (queued > XFS_INACTIVE_THROTTLE &&
+	    !(current->flags & (PF_MEMALLOC | PF_FSTRANS)))
+		flush_work(&pag->pag_inactive_work);
+	xfs_perag_put(pag);
+}
+
+void
+xfs_inactive_worker(
+	struct work_struct	*work)
+{
+	struct xfs_perag	*pag = container_of(work, struct xfs_perag,
+						pag_inactive_work);
+	struct llist_node	*node;
+	struct xfs_inode	*ip, *n;
+
+	node = llist_del_all(&pag->pag_inactive_list);
+	if (!node)
+		return;
+
+	/* process the batch in the order the inodes were queued */
+	node = llist_reverse_order(node);
+	llist_for_each_entry_safe(ip, n, node, i_inactive_node) {
+		xfs_inactive(ip);
+		xfs_iflags_clear(ip, XFS_NEED_INACTIVE);
+		xfs_inode_set_reclaim_tag(ip);
+		atomic_dec(&pag->pag_inactive_count);
+	}
+}
+
+/*
+ * Wait for all inodes queued for inactivation to be processed.
+ */
+void
+xfs_inactive_flush(
+	struct xfs_mount	*mp)
+{
+	struct xfs_perag	*pag;
+	xfs_agnumber_t		agno;
+
+	for (agno = 0; agno < mp->m_sb.sb_agcount; agno++) {
+		pag = xfs_perag_get(mp, agno);
+		flush_work(&pag->pag_inactive_work);
+		xfs_perag_put(pag);
+	}
+}
+
 STATIC void
 __xfs_inode_clear_reclaim(
 	xfs_perag_t	*pag,
@@ -63,6 +63,11 @@ long xfs_reclaim_inodes_nr(struct xfs_mount *mp, int nr_to_scan);
 
 void xfs_inode_set_reclaim_tag(struct xfs_inode *ip);
 
+bool xfs_inode_needs_inactive(struct xfs_inode *ip);
+void xfs_inode_queue_inactive(struct xfs_inode *ip);
+void xfs_inactive_worker(struct work_struct *work);
+void xfs_inactive_flush(struct xfs_mount *mp);
+
 void xfs_inode_set_eofblocks_tag(struct xfs_inode *ip);
 void xfs_inode_clear_eofblocks_tag(struct xfs_inode *ip);
 int xfs_icache_free_eofblocks(struct xfs_mount *, struct xfs_eofblocks *);
@@ -61,6 +61,7 @@ typedef struct xfs_inode {
 	/* Miscellaneous state. */
 	unsigned long		i_flags;	/* see defined flags below */
 	unsigned int		i_delayed_blks;	/* count of delay alloc blks */
+	struct llist_node	i_inactive_node; /* pag inactivation queue */
 
 	xfs_icdinode_t		i_d;		/* most of ondisk inode */
 
@@ -215,6 +216,7 @@ xfs_get_initial_prid(struct xfs_inode *dp)
 #define __XFS_IPINNED_BIT	8	 /* wakeup key for zero pin count */
 #define XFS_IPINNED		(1 << __XFS_IPINNED_BIT)
 #define XFS_IDONTCACHE		(1 << 9) /* don't cache the inode long term */
+#define XFS_NEED_INACTIVE	(1 << 10) /* queued for background inactivation */
 
 /*
  * Per-lifetime flags need to be reset when re-using a reclaimable inode during
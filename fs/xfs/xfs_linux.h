@@ -91,6 +91,7 @@ typedef __uint64_t __psunsigned_t;
 #include <linux/kthread.h>
 #include <linux/freezer.h>
 #include <linux/list_sort.h>
+#include <linux/llist.h>
 #include <linux/ratelimit.h>
 
 #include <asm/page.h>
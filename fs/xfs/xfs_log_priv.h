@@ -252,13 +252,28 @@ struct xfs_cil_ctx {
 	xfs_lsn_t		commit_lsn;	/* chkpt commit record lsn */
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
 	int			nvecs;		/* number of regions */
-	int			space_used;	/* aggregate size of regions */
+	atomic_t		space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* item commit order */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct xfs_log_callback	log_cb;		/* completion callback hook. */
 	struct list_head	committing;	/* ctx committing list */
 };
 
+/*
+ * Per-cpu CIL state.  Transaction commits add their items, busy extents and
+ * space accounting to the local structure with the context lock held shared,
+ * so they don't contend on anything shared.  The push aggregates everything
+ * into the context with the context lock held exclusively.
+ */
+struct xlog_cil_pcp {
+	int			space_used;	/* not yet added to the ctx */
+	int			space_reserved;	/* header space for the ctx */
+	int			nvecs;
+	struct list_head	log_items;
+	struct list_head	busy_extents;
+};
+
 /*
  * Committed Item List structure
  *
@@ -278,7 +293,8 @@ struct xfs_cil_ctx {
 struct xfs_cil {
 	struct xlog		*xc_log;
 	struct list_head	xc_cil;
-	spinlock_t		xc_cil_lock;
+	unsigned long		xc_flags;
+	struct xlog_cil_pcp __percpu *xc_pcp;
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
 	struct xfs_cil_ctx	*xc_ctx;
@@ -291,6 +307,9 @@ struct xfs_cil {
 	struct work_struct	xc_push_work;
 } ____cacheline_aligned_in_smp;
 
+/* xc_flags */
+#define XLOG_CIL_EMPTY		0	/* nothing committed to the context */
+
 /*
  * The amount of log space we allow the CIL to aggregate is difficult to size.
  * Whatever we choose, we have to make sure we can get a reservation for the
@@ -340,6 +359,13 @@ struct xfs_cil {
  */
 #define XLOG_CIL_SPACE_LIMIT(log)	(log->l_logsize >> 3)
 
+/*
+ * Per-cpu space is added to the context once it reaches this much, so the
+ * context lags the real CIL size by at most a quarter of the space limit.
+ */
+#define XLOG_CIL_PCP_SPACE(log)	\
+	(XLOG_CIL_SPACE_LIMIT(log) / (4 * num_online_cpus()))
+
 /*
  * ticket grant locks, queues and accounting have their own cachlines
  * as these are quite hot and can be operated on concurrently.
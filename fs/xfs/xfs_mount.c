@@ -156,6 +156,7 @@ xfs_free_perag(
 		spin_unlock(&mp->m_perag_lock);
 		ASSERT(pag);
 		ASSERT(atomic_read(&pag->pag_ref) == 0);
+		xfs_buf_hash_destroy(pag);
 		call_rcu(&pag->rcu_head, __xfs_free_perag);
 	}
 }
@@ -214,11 +215,13 @@ xfs_initialize_perag(
 		spin_lock_init(&pag->pag_ici_lock);
 		mutex_init(&pag->pag_ici_reclaim_lock);
 		INIT_RADIX_TREE(&pag->pag_ici_root, GFP_ATOMIC);
-		spin_lock_init(&pag->pag_buf_lock);
-		pag->pag_buf_tree = RB_ROOT;
+		init_llist_head(&pag->pag_inactive_list);
+		INIT_WORK(&pag->pag_inactive_work, xfs_inactive_worker);
+		if (xfs_buf_hash_init(pag))
+			goto out_free_pag;
 
 		if (radix_tree_preload(GFP_NOFS))
-			goto out_unwind;
+			goto out_hash_destroy;
 
 		spin_lock(&mp->m_perag_lock);
 		if (radix_tree_insert(&mp->m_perag_tree, index, pag)) {
@@ -226,7 +229,7 @@ xfs_initialize_perag(
 			spin_unlock(&mp->m_perag_lock);
 			radix_tree_preload_end();
 			error = -EEXIST;
-			goto out_unwind;
+			goto out_hash_destroy;
 		}
 		spin_unlock(&mp->m_perag_lock);
 		radix_tree_preload_end();
@@ -253,10 +256,16 @@ xfs_initialize_perag(
 		*maxagi = index;
 	return 0;
 
-out_unwind:
+out_hash_destroy:
+	xfs_buf_hash_destroy(pag);
+out_free_pag:
 	kmem_free(pag);
+out_unwind:
 	for (; index > first_initialised; index--) {
 		pag = radix_tree_delete(&mp->m_perag_tree, index);
+		if (!pag)
+			continue;
+		xfs_buf_hash_destroy(pag);
 		kmem_free(pag);
 	}
 	return error;
@@ -973,6 +982,7 @@ xfs_mountfs(
  out_rele_rip:
 	IRELE(rip);
  out_log_dealloc:
+	xfs_inactive_flush(mp);
 	xfs_log_unmount(mp);
  out_fail_wait:
 	if (mp->m_logdev_targp && mp->m_logdev_targp != mp->m_ddev_targp)
@@ -1007,6 +1017,13 @@ xfs_unmountfs(
 	xfs_rtunmount_inodes(mp);
 	IRELE(mp->m_rootip);
 
+	/*
+	 * Unlinked inodes released above or by the final evict_inodes() pass
+	 * may still be queued for inactivation. Process them while we can
+	 * still run transactions.
+	 */
+	xfs_inactive_flush(mp);
+
 	/*
 	 * We can potentially deadlock here if we have an inode cluster
 	 * that has been freed has its buffer still pinned in memory because
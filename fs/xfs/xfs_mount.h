@@ -175,6 +175,7 @@ typedef struct xfs_mount {
 	struct workqueue_struct	*m_reclaim_workqueue;
 	struct workqueue_struct	*m_log_workqueue;
 	struct workqueue_struct *m_eofblocks_workqueue;
+	struct workqueue_struct	*m_inactive_workqueue;
 } xfs_mount_t;
 
 /*
@@ -360,8 +361,13 @@ typedef struct xfs_perag {
 	unsigned long	pag_ici_reclaim_cursor;	/* reclaim restart point */
 
 	/* buffer cache index */
-	spinlock_t	pag_buf_lock;	/* lock for pag_buf_tree */
-	struct rb_root	pag_buf_tree;	/* ordered tree of active buffers */
+	struct mutex	pag_buf_lock;	/* serialises pag_buf_hash updates */
+	struct rhashtable pag_buf_hash;	/* active buffers, rcu lookups */
+
+	/* background inactivation of unlinked inodes */
+	struct llist_head pag_inactive_list;	/* inodes to inactivate */
+	atomic_t	pag_inactive_count;	/* queued inodes */
+	struct work_struct pag_inactive_work;
 
 	/* for rcu-safe freeing */
 	struct rcu_head	rcu_head;
@@ -873,8 +873,15 @@ xfs_init_mount_workqueues(
 	if (!mp->m_eofblocks_workqueue)
 		goto out_destroy_log;
 
+	mp->m_inactive_workqueue = alloc_workqueue("xfs-inactive/%s",
+			WQ_MEM_RECLAIM|WQ_FREEZABLE, 0, mp->m_fsname);
+	if (!mp->m_inactive_workqueue)
+		goto out_destroy_eofb;
+
 	return 0;
 
+out_destroy_eofb:
+	destroy_workqueue(mp->m_eofblocks_workqueue);
 out_destroy_log:
 	destroy_workqueue(mp->m_log_workqueue);
 out_destroy_reclaim:
@@ -895,6 +902,7 @@ STATIC void
 xfs_destroy_mount_workqueues(
 	struct xfs_mount	*mp)
 {
+	destroy_workqueue(mp->m_inactive_workqueue);
 	destroy_workqueue(mp->m_eofblocks_workqueue);
 	destroy_workqueue(mp->m_log_workqueue);
 	destroy_workqueue(mp->m_reclaim_workqueue);
@@ -920,6 +928,9 @@ xfs_flush_inodes(
 		sync_inodes_sb(sb);
 		up_read(&sb->s_umount);
 	}
+
+	/* space held by unlinked inodes is released by inactivation */
+	xfs_inactive_flush(mp);
 }
 
 /* Catch misguided souls that try to use this interface on XFS */
@@ -959,8 +970,15 @@ xfs_fs_destroy_inode(
 	 * to take the flush lock. The background reclaim path handles
 	 * this more efficiently than we can here, so simply let background
 	 * reclaim tear down all inodes.
+	 *
+	 * Unlinked inodes still have to be freed on disk first, which is done
+	 * by the background inactivation workers before they hand the inode
+	 * over to reclaim.
 	 */
-	xfs_inode_set_reclaim_tag(ip);
+	if (xfs_iflags_test(ip, XFS_NEED_INACTIVE))
+		xfs_inode_queue_inactive(ip);
+	else
+		xfs_inode_set_reclaim_tag(ip);
 }
 
 /*
@@ -1005,6 +1023,17 @@ xfs_fs_evict_inode(
 	XFS_STATS_INC(vn_rele);
 	XFS_STATS_INC(vn_remove);
 
+	/*
+	 * Freeing the blocks and the inode of an unlinked file can take a
+	 * long time, so leave that to the background inactivation workers
+	 * rather than making the process dropping the last reference wait.
+	 * The inode is queued once the VFS is done with it in
+	 * xfs_fs_destroy_inode.
+	 */
+	if (xfs_inode_needs_inactive(ip)) {
+		xfs_iflags_set(ip, XFS_NEED_INACTIVE);
+		return;
+	}
 	xfs_inactive(ip);
 }
 
@@ -1063,6 +1092,7 @@ xfs_fs_sync_fs(
 	if (!wait)
 		return 0;
 
+	xfs_inactive_flush(mp);
 	xfs_log_force(mp, XFS_LOG_SYNC);
 	if (laptop_mode) {
 		/*
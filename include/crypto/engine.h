@@ -0,0 +1,93 @@
+/*
+ * Crypto engine API
+ *
+ * Request queue and pump thread shared by hardware crypto drivers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+#ifndef _CRYPTO_ENGINE_H
+#define _CRYPTO_ENGINE_H
+
+#include <linux/crypto.h>
+#include <linux/list.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <crypto/algapi.h>
+
+#define ENGINE_NAME_LEN	30
+
+/*
+ * struct crypto_engine - crypto hardware engine
+ * @name: the engine name
+ * @idling: the engine is tearing down the hardware after going idle
+ * @busy: the hardware has been prepared and requests are being pumped
+ * @running: the engine is accepting requests
+ * @rt: the pump thread runs at realtime priority
+ * @max_batch: number of requests the hardware accepts at once, defaults
+ *	to one; the pump hands out up to this many before calling @do_batch
+ * @inflight: requests handed to the driver and not yet finalized
+ * @queue_lock: protects the queue and the state above
+ * @queue: requests waiting for the hardware
+ * @prepare_crypt_hardware: called before the first request after the
+ *	engine was idle, from the pump thread
+ * @unprepare_crypt_hardware: called once the engine runs out of work,
+ *	from the pump thread
+ * @prepare_request: optional per request setup before @do_one_request
+ * @unprepare_request: optional per request teardown, called from
+ *	crypto_finalize_request()
+ * @do_one_request: hand one request to the hardware; a non-zero return
+ *	finalizes the request with that error
+ * @do_batch: optional, called after the pump handed out a batch of
+ *	requests so the driver can kick the hardware once for all of them
+ * @kworker: worker running the pump
+ * @kworker_task: task running @kworker
+ * @pump_requests: work queued to pump requests to the hardware
+ * @priv_data: driver private data
+ */
+struct crypto_engine {
+	char			name[ENGINE_NAME_LEN];
+	bool			idling;
+	bool			busy;
+	bool			running;
+	bool			rt;
+
+	unsigned int		max_batch;
+	unsigned int		inflight;
+
+	spinlock_t		queue_lock;
+	struct crypto_queue	queue;
+
+	int (*prepare_crypt_hardware)(struct crypto_engine *engine);
+	int (*unprepare_crypt_hardware)(struct crypto_engine *engine);
+
+	int (*prepare_request)(struct crypto_engine *engine,
+			       struct crypto_async_request *req);
+	int (*unprepare_request)(struct crypto_engine *engine,
+				 struct crypto_async_request *req);
+	int (*do_one_request)(struct crypto_engine *engine,
+			      struct crypto_async_request *req);
+	int (*do_batch)(struct crypto_engine *engine);
+
+	struct kthread_worker		kworker;
+	struct task_struct		*kworker_task;
+	struct kthread_work		pump_requests;
+
+	void				*priv_data;
+};
+
+int crypto_transfer_request(struct crypto_engine *engine,
+			    struct crypto_async_request *req, bool need_pump);
+int crypto_transfer_request_to_engine(struct crypto_engine *engine,
+				      struct crypto_async_request *req);
+void crypto_finalize_request(struct crypto_engine *engine,
+			     struct crypto_async_request *req, int err);
+int crypto_engine_start(struct crypto_engine *engine);
+int crypto_engine_stop(struct crypto_engine *engine);
+struct crypto_engine *crypto_engine_alloc_init(struct device *dev, bool rt);
+int crypto_engine_exit(struct crypto_engine *engine);
+
+#endif /* _CRYPTO_ENGINE_H */
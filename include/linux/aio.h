@@ -52,11 +52,17 @@ struct kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/*
+	 * Completion callback for asynchronous kiocbs that don't belong to
+	 * an aio context, aio_complete() hands the result to it.
+	 */
+	void (*ki_complete)(struct kiocb *iocb, long res, long res2);
 };
 
 static inline bool is_sync_kiocb(struct kiocb *kiocb)
 {
-	return kiocb->ki_ctx == NULL;
+	return kiocb->ki_ctx == NULL && kiocb->ki_complete == NULL;
 }
 
 static inline void init_sync_kiocb(struct kiocb *kiocb, struct file *filp)
@@ -65,6 +65,7 @@ struct coredump_params {
 	unsigned long limit;
 	unsigned long mm_flags;
 	loff_t written;
+	struct core_compress *compress;	/* gzip stream, see coredump_compress.c */
 };
 
 /*
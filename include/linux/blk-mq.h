@@ -18,6 +18,19 @@ struct blk_mq_ctxmap {
 	struct blk_align_bitmap *map;
 };
 
+/*
+ * Completion latency, in log2 usec buckets, split by direction and by
+ * size class (<= 4k, <= 16k, <= 64k, larger).  Kept per cpu for each
+ * hardware queue and summed up when read through sysfs.
+ */
+#define BLK_MQ_LAT_BUCKETS	24
+#define BLK_MQ_SIZE_CLASSES	4
+
+struct blk_mq_hctx_stat {
+	unsigned long		lat[2][BLK_MQ_SIZE_CLASSES][BLK_MQ_LAT_BUCKETS];
+	long			inflight;
+};
+
 struct blk_mq_hw_ctx {
 	struct {
 		spinlock_t		lock;
@@ -37,6 +50,7 @@ struct blk_mq_hw_ctx {
 	struct blk_flush_queue	*fq;
 
 	void			*driver_data;
+	void			*sched_data;	/* see elevator_mq_ops */
 
 	struct blk_mq_ctxmap	ctx_map;
 
@@ -57,6 +71,13 @@ struct blk_mq_hw_ctx {
 
 	atomic_t		nr_active;
 
+	unsigned long		poll_considered;
+	unsigned long		poll_invoked;
+	unsigned long		poll_completed;
+	u64			poll_mean_ns;	/* completion time, see blk_poll() */
+
+	struct blk_mq_hctx_stat __percpu *stats;
+
 	struct blk_mq_cpu_notifier	cpu_notifier;
 	struct kobject		kobj;
 };
@@ -86,6 +107,7 @@ struct blk_mq_queue_data {
 
 typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, const struct blk_mq_queue_data *);
 typedef struct blk_mq_hw_ctx *(map_queue_fn)(struct request_queue *, const int);
+typedef int (map_queues_fn)(struct blk_mq_tag_set *, unsigned int *);
 typedef enum blk_eh_timer_return (timeout_fn)(struct request *, bool);
 typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
 typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
@@ -94,6 +116,9 @@ typedef int (init_request_fn)(void *, struct request *, unsigned int,
 typedef void (exit_request_fn)(void *, struct request *, unsigned int,
 		unsigned int);
 
+typedef int (poll_fn)(struct blk_mq_hw_ctx *);
+typedef void (commit_rqs_fn)(struct blk_mq_hw_ctx *);
+
 typedef void (busy_iter_fn)(struct blk_mq_hw_ctx *, struct request *, void *,
 		bool);
 
@@ -103,11 +128,24 @@ struct blk_mq_ops {
 	 */
 	queue_rq_fn		*queue_rq;
 
+	/*
+	 * Called when a dispatch run ends without the request that was
+	 * flagged ->last having been queued, so that a driver batching its
+	 * doorbell writes on ->last can kick the hardware.
+	 */
+	commit_rqs_fn		*commit_rqs;
+
 	/*
 	 * Map to specific hardware queue
 	 */
 	map_queue_fn		*map_queue;
 
+	/*
+	 * Optionally build the cpu -> hardware queue index table used by
+	 * ->map_queue, e.g. from the interrupt affinity of the device.
+	 */
+	map_queues_fn		*map_queues;
+
 	/*
 	 * Called on request timeout
 	 */
@@ -115,6 +153,12 @@ struct blk_mq_ops {
 
 	softirq_done_fn		*complete;
 
+	/*
+	 * Reap completions from the hardware queue without waiting for an
+	 * interrupt.  Returns the number of requests completed.
+	 */
+	poll_fn			*poll;
+
 	/*
 	 * Called when the block layer side of a hardware queue has been
 	 * set up, allowing the driver to allocate/init matching structures.
@@ -214,8 +258,10 @@ void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async);
 void blk_mq_delay_queue(struct blk_mq_hw_ctx *hctx, unsigned long msecs);
 void blk_mq_tag_busy_iter(struct blk_mq_hw_ctx *hctx, busy_iter_fn *fn,
 		void *priv);
+void blk_mq_freeze_queue(struct request_queue *q);
 void blk_mq_unfreeze_queue(struct request_queue *q);
 void blk_mq_freeze_queue_start(struct request_queue *q);
+void blk_mq_freeze_queue_wait(struct request_queue *q);
 
 /*
  * Driver command data is immediately after the request. So subtract request
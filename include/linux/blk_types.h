@@ -77,6 +77,11 @@ struct bio {
 	 */
 	struct io_context	*bi_ioc;
 	struct cgroup_subsys_state *bi_css;
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+	/* group the latency controller charged us to, and when */
+	struct blkcg_gq		*bi_iolat_blkg;
+	u64			bi_iolat_start;
+#endif
 #endif
 	union {
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -194,6 +199,7 @@ enum rq_flag_bits {
 	__REQ_HASHED,		/* on IO scheduler merge hash */
 	__REQ_MQ_INFLIGHT,	/* track inflight for MQ */
 	__REQ_NO_TIMEOUT,	/* requests may never expire */
+	__REQ_WB_TRACKED,	/* counted by writeback throttling */
 	__REQ_NR_BITS,		/* stops here */
 };
 
@@ -248,5 +254,6 @@ enum rq_flag_bits {
 #define REQ_HASHED		(1ULL << __REQ_HASHED)
 #define REQ_MQ_INFLIGHT		(1ULL << __REQ_MQ_INFLIGHT)
 #define REQ_NO_TIMEOUT		(1ULL << __REQ_NO_TIMEOUT)
+#define REQ_WB_TRACKED		(1ULL << __REQ_WB_TRACKED)
 
 #endif /* __LINUX_BLK_TYPES_H */
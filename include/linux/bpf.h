@@ -10,6 +10,8 @@
 #include <uapi/linux/bpf.h>
 #include <linux/workqueue.h>
 #include <linux/file.h>
+#include <linux/err.h>
+#include <linux/percpu.h>
 
 struct bpf_map;
 
@@ -24,6 +26,10 @@ struct bpf_map_ops {
 	void *(*map_lookup_elem)(struct bpf_map *map, void *key);
 	int (*map_update_elem)(struct bpf_map *map, void *key, void *value, u64 flags);
 	int (*map_delete_elem)(struct bpf_map *map, void *key);
+
+	/* funcs callable from userspace only, for maps holding fds */
+	void *(*map_fd_get_ptr)(struct bpf_map *map, int fd);
+	void (*map_fd_put_ptr)(void *ptr);
 };
 
 struct bpf_map {
@@ -46,6 +52,14 @@ void bpf_register_map_type(struct bpf_map_type_list *tl);
 void bpf_map_put(struct bpf_map *map);
 struct bpf_map *bpf_map_get(struct fd f);
 
+/* syscall side of per-cpu maps, value holds one slot per possible cpu */
+int bpf_percpu_hash_copy(struct bpf_map *map, void *key, void *value);
+int bpf_percpu_array_copy(struct bpf_map *map, void *key, void *value);
+int bpf_percpu_hash_update(struct bpf_map *map, void *key, void *value,
+			   u64 flags);
+int bpf_percpu_array_update(struct bpf_map *map, void *key, void *value,
+			    u64 flags);
+
 /* function argument constraints */
 enum bpf_arg_type {
 	ARG_ANYTHING = 0,	/* any argument is ok */
@@ -62,6 +76,8 @@ enum bpf_arg_type {
 	 */
 	ARG_PTR_TO_STACK,	/* any pointer to eBPF program stack */
 	ARG_CONST_STACK_SIZE,	/* number of bytes accessed from stack */
+
+	ARG_PTR_TO_CTX,		/* pointer to context */
 };
 
 /* type of values returned from helper functions */
@@ -105,6 +121,14 @@ struct bpf_verifier_ops {
 	 * with 'type' (read or write) is allowed
 	 */
 	bool (*is_valid_access)(int off, int size, enum bpf_access_type type);
+
+	/* rewrite a 4 byte load from (or store to) bpf_context at ctx_off
+	 * into accesses of the real context; returns the number of insns
+	 * written to insn_buf
+	 */
+	u32 (*convert_ctx_access)(enum bpf_access_type type, int dst_reg,
+				  int src_reg, int ctx_off,
+				  struct bpf_insn *insn_buf);
 };
 
 struct bpf_prog_type_list {
@@ -125,21 +149,69 @@ struct bpf_prog_aux {
 	struct bpf_map **used_maps;
 	u32 used_map_cnt;
 	struct bpf_prog *prog;
-	struct work_struct work;
+	union {
+		struct work_struct work;
+		struct rcu_head rcu;
+	};
+};
+
+struct bpf_array {
+	struct bpf_map map;
+	u32 elem_size;
+	/* BPF_MAP_TYPE_PROG_ARRAY: every program in the array, and every
+	 * program calling into it, must be of the same type and either all
+	 * JITed or all interpreted, as tail calls reuse the caller's frame
+	 */
+	enum bpf_prog_type owner_prog_type;
+	bool owner_jited;
+	union {
+		char value[0] __aligned(8);
+		void *ptrs[0] __aligned(8);
+		/* BPF_MAP_TYPE_PERCPU_ARRAY: one value per possible cpu */
+		void __percpu *pptrs[0] __aligned(8);
+	};
 };
+#define MAX_TAIL_CALL_CNT 32
+
+bool bpf_prog_array_compatible(struct bpf_array *array,
+			       const struct bpf_prog *fp);
+void bpf_fd_array_map_clear(struct bpf_map *map);
+
+#if defined(CONFIG_BPF_SYSCALL) && defined(CONFIG_INET)
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog,
+		  enum bpf_attach_type type);
+void sock_map_clear(struct bpf_map *map);
+#else
+static inline int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog,
+				enum bpf_attach_type type)
+{
+	return -EOPNOTSUPP;
+}
+static inline void sock_map_clear(struct bpf_map *map) {}
+#endif
 
 #ifdef CONFIG_BPF_SYSCALL
+DECLARE_PER_CPU(int, bpf_prog_active);
+
 void bpf_prog_put(struct bpf_prog *prog);
+void bpf_prog_put_rcu(struct bpf_prog *prog);
+struct bpf_prog *bpf_prog_get(u32 ufd);
 #else
 static inline void bpf_prog_put(struct bpf_prog *prog) {}
+static inline void bpf_prog_put_rcu(struct bpf_prog *prog) {}
+static inline struct bpf_prog *bpf_prog_get(u32 ufd)
+{
+	return ERR_PTR(-EOPNOTSUPP);
+}
 #endif
-struct bpf_prog *bpf_prog_get(u32 ufd);
 /* verify correctness of eBPF program */
-int bpf_check(struct bpf_prog *fp, union bpf_attr *attr);
+int bpf_check(struct bpf_prog **fp, union bpf_attr *attr);
 
 /* verifier prototypes for helper functions called from eBPF programs */
 extern struct bpf_func_proto bpf_map_lookup_elem_proto;
 extern struct bpf_func_proto bpf_map_update_elem_proto;
 extern struct bpf_func_proto bpf_map_delete_elem_proto;
+extern const struct bpf_func_proto bpf_tail_call_proto;
+extern const struct bpf_func_proto bpf_sk_redirect_map_proto;
 
 #endif /* _LINUX_BPF_H */
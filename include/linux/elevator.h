@@ -8,6 +8,7 @@
 
 struct io_cq;
 struct elevator_type;
+struct blk_mq_hw_ctx;
 
 typedef int (elevator_merge_fn) (struct request_queue *, struct request **,
 				 struct bio *);
@@ -70,6 +71,19 @@ struct elevator_ops
 	elevator_exit_fn *elevator_exit_fn;
 };
 
+/*
+ * Hooks for elevators that keep their own state in each blk-mq hardware
+ * context, see blk-mq-sched.c.  They are called with the hctx the request
+ * is issued on and without q->queue_lock, so the elevator does its own
+ * (per hctx) locking.
+ */
+struct elevator_mq_ops
+{
+	bool (*bio_merge)(struct blk_mq_hw_ctx *, struct bio *);
+	void (*insert_request)(struct blk_mq_hw_ctx *, struct request *);
+	struct request *(*dispatch_request)(struct blk_mq_hw_ctx *);
+};
+
 #define ELV_NAME_MAX	(16)
 
 struct elv_fs_entry {
@@ -93,6 +107,8 @@ struct elevator_type
 	struct elv_fs_entry *elevator_attrs;
 	char elevator_name[ELV_NAME_MAX];
 	struct module *elevator_owner;
+	bool uses_mq;			/* can run on blk-mq, see blk-mq-sched.c */
+	struct elevator_mq_ops *mq_ops;	/* blk-mq only, per hctx */
 
 	/* managed by elevator core */
 	char icq_cache_name[ELV_NAME_MAX + 5];	/* elvname + "_io_cq" */
@@ -24,6 +24,7 @@
 
 #define NULL_ADDR		((block_t)0)	/* used as block_t addresses */
 #define NEW_ADDR		((block_t)-1)	/* used as block_t addresses */
+#define COMPRESS_ADDR		((block_t)-2)	/* heads a compressed cluster */
 
 /* 0, 1(node nid), 2(meta nid) are reserved node id */
 #define F2FS_RESERVED_NODE_NUM		3
@@ -217,6 +218,25 @@ struct indirect_node {
 	__le32 nid[NIDS_PER_BLOCK];	/* array of data block address */
 } __packed;
 
+/*
+ * A compressed cluster of F2FS_CLUSTER_PAGES data pages keeps COMPRESS_ADDR
+ * in the address slot of its first page, followed by the addresses of the
+ * blocks holding the compressed data and NULL_ADDR in the remaining slots.
+ * The compressed data starts with this header.
+ */
+#define F2FS_LOG_CLUSTER_PAGES	2
+#define F2FS_CLUSTER_PAGES	(1 << F2FS_LOG_CLUSTER_PAGES)
+
+enum {
+	F2FS_COMPRESS_LZO,
+	F2FS_COMPRESS_LZ4,
+};
+
+struct f2fs_compress_header {
+	__le32 clen;		/* bytes of compressed data that follow */
+	__le32 algorithm;	/* F2FS_COMPRESS_LZO or F2FS_COMPRESS_LZ4 */
+} __packed;
+
 enum {
 	COLD_BIT_SHIFT = 0,
 	FSYNC_BIT_SHIFT,
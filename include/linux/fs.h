@@ -50,6 +50,7 @@ struct swap_info_struct;
 struct seq_file;
 struct workqueue_struct;
 struct iov_iter;
+struct cgroup_subsys_state;
 
 extern void __init inode_init(void);
 extern void __init inode_init_early(void);
@@ -611,6 +612,9 @@ struct inode {
 
 	struct hlist_node	i_hash;
 	struct list_head	i_wb_list;	/* backing dev IO list */
+#ifdef CONFIG_CGROUP_WRITEBACK
+	struct cgroup_subsys_state *i_wb_blkcg;	/* blkcg that dirtied it */
+#endif
 	struct list_head	i_lru;		/* inode LRU list */
 	struct list_head	i_sb_list;
 	union {
@@ -1293,6 +1297,12 @@ struct super_block {
 	struct workqueue_struct *s_dio_done_wq;
 	struct hlist_head s_pins;
 
+#ifdef CONFIG_FSNOTIFY
+	__u32			s_fsnotify_mask; /* all events marks on this sb care about */
+	struct hlist_head	s_fsnotify_marks;
+	spinlock_t		s_fsnotify_lock; /* protects s_fsnotify_marks */
+#endif
+
 	/*
 	 * Keep the lru lists last in the structure so they always sit on their
 	 * own individual cachelines.
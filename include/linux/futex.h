@@ -55,6 +55,12 @@ union futex_key {
 #ifdef CONFIG_FUTEX
 extern void exit_robust_list(struct task_struct *curr);
 extern void exit_pi_state_list(struct task_struct *curr);
+extern int futex_hash_prctl(unsigned long arg2, unsigned long arg3);
+#ifdef CONFIG_COMPAT
+extern long compat_futex_wait_multiple(u32 __user *uaddr, int op, u32 count,
+				       union ktime *abs_time);
+#endif
+extern void futex_hash_free(struct mm_struct *mm);
 #ifdef CONFIG_HAVE_FUTEX_CMPXCHG
 #define futex_cmpxchg_enabled 1
 #else
@@ -67,5 +73,12 @@ static inline void exit_robust_list(struct task_struct *curr)
 static inline void exit_pi_state_list(struct task_struct *curr)
 {
 }
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	return -EINVAL;
+}
+static inline void futex_hash_free(struct mm_struct *mm)
+{
+}
 #endif
 #endif
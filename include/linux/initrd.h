@@ -1,3 +1,5 @@
+#ifndef __LINUX_INITRD_H
+#define __LINUX_INITRD_H
 
 #define INITRD_MINOR 250 /* shouldn't collide with /dev/ram* too soon ... */
 
@@ -18,3 +20,13 @@ extern unsigned long initrd_start, initrd_end;
 extern void free_initrd_mem(unsigned long, unsigned long);
 
 extern unsigned int real_root_dev;
+
+#ifdef CONFIG_BLK_DEV_INITRD
+extern void wait_for_initramfs(void);
+#else
+static inline void wait_for_initramfs(void)
+{
+}
+#endif
+
+#endif /* __LINUX_INITRD_H */
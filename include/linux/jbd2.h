@@ -69,6 +69,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -269,7 +270,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -294,6 +297,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
@@ -302,7 +306,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -683,6 +688,9 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/* Recovery passes, also seen by j_fc_replay_callback */
+enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -743,6 +751,12 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbuf: array of buffer_heads for jbd2_journal_commit_transaction
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
+ * @j_fc_first: The block number of the first block of the fast commit area
+ * @j_fc_last: The block number one beyond the last fast commit block
+ * @j_fc_off: Number of fast commit blocks used since the last full commit
+ * @j_fc_start: Value of @j_fc_off when the running fast commit began
+ * @j_fc_wbuf: array of bhs handed out to fast commits
+ * @j_fc_wait: Wait queue for fast and full commits waiting on each other
  * @j_last_sync_writer: most recent pid which did a synchronous write
  * @j_history: Buffer storing the transactions statistics history
  * @j_history_max: Maximum number of transactions in the statistics history
@@ -751,6 +765,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
  * @j_private: An opaque pointer to fs-private information.
+ * @j_fc_replay_callback: called by recovery for each fast commit block
  */
 
 struct journal_s
@@ -948,6 +963,26 @@ struct journal_s
 	struct buffer_head	**j_wbuf;
 	int			j_wbufsize;
 
+	/*
+	 * The fast commit area sits between the end of the log and the end
+	 * of the journal.  Fast commits since the last full commit fill it
+	 * from the start, each one ending with its own commit record.
+	 * [j_state_lock]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	unsigned long		j_fc_start;
+
+	/*
+	 * array of bhs for the fast commit in progress, indexed by their
+	 * offset in the fast commit area
+	 */
+	struct buffer_head	**j_fc_wbuf;
+
+	/* Wait queue for fast and full commits waiting on each other */
+	wait_queue_head_t	j_fc_wait;
+
 	/*
 	 * this is the pid of hte last person to run a synchronous operation
 	 * through the journal
@@ -972,6 +1007,20 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/*
+	 * Called by recovery for each block of the fast commit area, first
+	 * with PASS_SCAN and then with PASS_REPLAY, as long as it returns
+	 * 0.  @off is the offset of @bh in the area and @expected_tid the
+	 * transaction the fast commits have to belong to.  Returning
+	 * JBD2_FC_REPLAY_STOP ends the pass, a negative value fails
+	 * recovery.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							enum passtype pass,
+							int off,
+							tid_t expected_tid);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1007,6 +1056,11 @@ struct journal_s
 #define JBD2_ABORT_ON_SYNCDATA_ERR	0x040	/* Abort the journal on file
 						 * data write error in ordered
 						 * mode */
+#define JBD2_FAST_COMMIT_ONGOING	0x080	/* A fast commit is writing
+						 * to the fast commit area */
+#define JBD2_FULL_COMMIT_ONGOING	0x100	/* A full commit is running */
+
+#define JBD2_FC_REPLAY_STOP	1	/* j_fc_replay_callback: end of pass */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1244,6 +1298,10 @@ int __jbd2_log_start_commit(journal_t *journal, tid_t tid);
 int jbd2_journal_start_commit(journal_t *journal, tid_t *tid);
 int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_complete_transaction(journal_t *journal, tid_t tid);
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+int jbd2_fc_write_bufs(journal_t *journal);
+void jbd2_fc_end_commit(journal_t *journal, int err);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
@@ -0,0 +1,86 @@
+#ifndef KVM_DIRTY_RING_H
+#define KVM_DIRTY_RING_H
+
+#include <linux/kvm.h>
+
+/*
+ * KVM dirty ring
+ *
+ * Each vCPU owns a ring of dirtied guest frames which is shared with
+ * userspace through the vCPU mmap at KVM_DIRTY_LOG_PAGE_OFFSET.
+ *
+ * @dirty_index: free running counter of entries pushed by the vCPU
+ * @reset_index: free running counter of entries handed back by
+ *		 KVM_RESET_DIRTY_RINGS
+ * @size:	 number of entries in the ring, a power of two
+ * @soft_limit:	 the vCPU exits to userspace with KVM_EXIT_DIRTY_RING_FULL
+ *		 once this many entries are in use
+ * @dirty_gfns:	 the ring itself
+ * @index:	 index of the vCPU owning the ring
+ */
+struct kvm_dirty_ring {
+	u32 dirty_index;
+	u32 reset_index;
+	u32 size;
+	u32 soft_limit;
+	struct kvm_dirty_gfn *dirty_gfns;
+	int index;
+};
+
+/*
+ * Entries kept free for the pages a vCPU can dirty between the soft
+ * full check on guest entry and its next exit.
+ */
+#define KVM_DIRTY_RING_RSVD_ENTRIES	64
+
+/* Limits the vmalloc'ed ring of a vCPU to 1MB */
+#define KVM_DIRTY_RING_MAX_ENTRIES	65536
+
+struct kvm;
+
+#ifdef CONFIG_HAVE_KVM_DIRTY_RING
+
+int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring, int index, u32 size);
+void kvm_dirty_ring_free(struct kvm_dirty_ring *ring);
+void kvm_dirty_ring_push(struct kvm_dirty_ring *ring, u32 slot, u64 offset);
+int kvm_dirty_ring_reset(struct kvm *kvm, struct kvm_dirty_ring *ring);
+bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring);
+struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring, u32 offset);
+
+#else
+
+static inline int kvm_dirty_ring_alloc(struct kvm_dirty_ring *ring,
+				       int index, u32 size)
+{
+	return 0;
+}
+
+static inline void kvm_dirty_ring_free(struct kvm_dirty_ring *ring)
+{
+}
+
+static inline void kvm_dirty_ring_push(struct kvm_dirty_ring *ring,
+				       u32 slot, u64 offset)
+{
+}
+
+static inline int kvm_dirty_ring_reset(struct kvm *kvm,
+				       struct kvm_dirty_ring *ring)
+{
+	return 0;
+}
+
+static inline bool kvm_dirty_ring_soft_full(struct kvm_dirty_ring *ring)
+{
+	return false;
+}
+
+static inline struct page *kvm_dirty_ring_get_page(struct kvm_dirty_ring *ring,
+						   u32 offset)
+{
+	return NULL;
+}
+
+#endif /* CONFIG_HAVE_KVM_DIRTY_RING */
+
+#endif /* KVM_DIRTY_RING_H */
@@ -3,6 +3,8 @@
 
   (C) 2001 by Andreas Gruenbacher, <a.gruenbacher@computer.org>
 */
+#include <linux/mm.h>		/* struct shrinker */
+
 struct mb_cache_entry {
 	struct list_head		e_lru_list;
 	struct mb_cache			*e_cache;
@@ -29,6 +31,9 @@ struct mb_cache {
 	struct kmem_cache		*c_entry_cache;
 	struct hlist_bl_head		*c_block_hash;
 	struct hlist_bl_head		*c_index_hash;
+	struct list_head		c_lru_list;
+	spinlock_t			c_lru_lock;
+	struct shrinker			c_shrink;
 };
 
 /* Functions on caches */
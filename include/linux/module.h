@@ -72,6 +72,7 @@ extern void cleanup_module(void);
 
 /* Archs provide a method of finding the correct exception table. */
 struct exception_table_entry;
+struct module_export_hash;
 
 const struct exception_table_entry *
 search_extable(const struct exception_table_entry *first,
@@ -252,11 +253,17 @@ struct module {
 	const unsigned long *unused_gpl_crcs;
 #endif
 
+	/* Entries of the exported symbols in the global export hash. */
+	struct module_export_hash *export_hash;
+
 #ifdef CONFIG_MODULE_SIG
 	/* Signature was verified. */
 	bool sig_ok;
 #endif
 
+	/* Drivers of this module probe asynchronously ("async_probe"). */
+	bool async_probe_requested;
+
 	/* symbols that will be GPL-only in the near future. */
 	const struct kernel_symbol *gpl_future_syms;
 	const unsigned long *gpl_future_crcs;
@@ -502,8 +509,18 @@ int unregister_module_notifier(struct notifier_block *nb);
 
 extern void print_modules(void);
 
+static inline bool module_requested_async_probing(struct module *module)
+{
+	return module && module->async_probe_requested;
+}
+
 #else /* !CONFIG_MODULES... */
 
+static inline bool module_requested_async_probing(struct module *module)
+{
+	return false;
+}
+
 /* Given an address, look for it in the exception tables. */
 static inline const struct exception_table_entry *
 search_module_extables(unsigned long addr)
@@ -41,6 +41,9 @@ struct msi_desc {
 
 	/* Last set MSI message */
 	struct msi_msg msg;
+
+	/* Kernel managed affinity of a spread vector, or NULL */
+	struct cpumask *affinity;
 };
 
 /* Helpers to hide struct msi_desc implementation details */
@@ -17,24 +17,34 @@
 
 #include <linux/wait.h>
 #include <linux/mutex.h>
+#include <linux/blk-mq.h>
+#include <linux/workqueue.h>
 #include <uapi/linux/nbd.h>
 
 struct request;
+struct nbd_device;
+
+struct nbd_sock {
+	struct socket *sock;
+	struct mutex tx_lock;	/* Serializes requests sent on sock	*/
+	struct nbd_device *nbd;
+	bool dead;		/* No more sends once set, under tx_lock */
+};
 
 struct nbd_device {
 	int flags;
 	int harderror;		/* Code of hard error			*/
-	struct socket * sock;	/* If == NULL, device is not ready, yet	*/
+	struct nbd_sock **socks;	/* Connections handed in by nbd-client */
+	int num_connections;
 	int magic;
 
-	spinlock_t queue_lock;
-	struct list_head queue_head;	/* Requests waiting result */
-	struct request *active_req;
-	wait_queue_head_t active_wq;
-	struct list_head waiting_queue;	/* Requests to be sent */
-	wait_queue_head_t waiting_wq;
+	struct blk_mq_tag_set tag_set;
+	unsigned long runtime_flags;
+	atomic_t recv_threads;	/* Receivers still running		*/
+	wait_queue_head_t recv_wq;
+	struct work_struct timeout_work;
 
-	struct mutex tx_lock;
+	struct mutex config_lock;
 	struct gendisk *disk;
 	int blksize;
 	u64 bytesize;
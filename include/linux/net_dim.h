@@ -0,0 +1,118 @@
+/*
+ * net_dim.h	Dynamic interrupt moderation for network drivers
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * net_dim picks interrupt coalescing parameters for one queue from the
+ * traffic it actually sees.  Every NET_DIM_NEVENTS interrupts it turns the
+ * packets, bytes and interrupts seen into per-millisecond rates, compares
+ * them with the previous window and steps through a small table of
+ * (usecs, frames) profiles: towards more coalescing while throughput keeps
+ * improving, back towards low latency when it doesn't.  Once neither way
+ * helps it parks on the current profile until the traffic changes.
+ *
+ * A driver opting in (typically when ethtool sets adaptive-rx):
+ *
+ *  - calls net_dim_init() with a work function that applies
+ *    net_dim_get_rx_moderation(dim->mode, dim->profile_ix) to the queue
+ *    and then sets dim->state back to NET_DIM_START_MEASURE;
+ *  - at the end of each NAPI poll, fills a struct net_dim_sample with
+ *    net_dim_sample() from its free running queue counters and passes it
+ *    to net_dim();
+ *  - cancels dim->work before tearing the queue down.
+ */
+#ifndef _LINUX_NET_DIM_H
+#define _LINUX_NET_DIM_H
+
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+
+/* Interrupts to look at before judging a profile */
+#define NET_DIM_NEVENTS			64
+#define NET_DIM_PARAMS_NUM_PROFILES	5
+#define NET_DIM_DEFAULT_PROFILE_IX	(NET_DIM_PARAMS_NUM_PROFILES - 1)
+
+/* How the hardware starts the coalescing timer */
+enum {
+	NET_DIM_CQ_PERIOD_MODE_START_FROM_EQE,	/* on the interrupt event */
+	NET_DIM_CQ_PERIOD_MODE_START_FROM_CQE,	/* on each completion */
+	NET_DIM_CQ_PERIOD_NUM_MODES,
+};
+
+/* net_dim->state */
+enum {
+	NET_DIM_START_MEASURE,
+	NET_DIM_MEASURE_IN_PROGRESS,
+	NET_DIM_APPLY_NEW_PROFILE,
+};
+
+/* net_dim->tune_state */
+enum {
+	NET_DIM_PARKING_ON_TOP,
+	NET_DIM_PARKING_TIRED,
+	NET_DIM_GOING_RIGHT,
+	NET_DIM_GOING_LEFT,
+};
+
+struct net_dim_cq_moder {
+	u16	usec;
+	u16	pkts;
+	u8	cq_period_mode;
+};
+
+struct net_dim_sample {
+	ktime_t	time;
+	u32	pkt_ctr;
+	u32	byte_ctr;
+	u16	event_ctr;
+};
+
+/* Rates per millisecond over one measurement window */
+struct net_dim_stats {
+	int	ppms;	/* packets */
+	int	bpms;	/* bytes */
+	int	epms;	/* events, i.e. interrupts */
+};
+
+struct net_dim {
+	u8			state;
+	struct net_dim_stats	prev_stats;
+	struct net_dim_sample	start_sample;
+	struct work_struct	work;
+	u8			profile_ix;
+	u8			mode;
+	u8			tune_state;
+	u8			steps_right;
+	u8			steps_left;
+	u8			tired;
+};
+
+static inline void net_dim_init(struct net_dim *dim, u8 mode,
+				work_func_t apply)
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->mode = mode;
+	dim->profile_ix = NET_DIM_DEFAULT_PROFILE_IX;
+	dim->tune_state = NET_DIM_GOING_RIGHT;
+	INIT_WORK(&dim->work, apply);
+}
+
+static inline void net_dim_sample(u16 event_ctr, u64 packets, u64 bytes,
+				  struct net_dim_sample *s)
+{
+	s->time	     = ktime_get();
+	s->pkt_ctr   = packets;
+	s->byte_ctr  = bytes;
+	s->event_ctr = event_ctr;
+}
+
+struct net_dim_cq_moder net_dim_get_rx_moderation(u8 cq_period_mode, int ix);
+struct net_dim_cq_moder net_dim_get_def_rx_moderation(u8 cq_period_mode);
+void net_dim(struct net_dim *dim, const struct net_dim_sample *end_sample);
+
+#endif /* _LINUX_NET_DIM_H */
@@ -764,6 +764,26 @@ struct netdev_phys_item_id {
 	unsigned char id_len;
 };
 
+struct bpf_prog;
+struct packet_zc;
+
+enum xdp_netdev_command {
+	/* install xdp.prog as the rx program (NULL removes it); the
+	 * driver takes over the reference and drops the old program's
+	 */
+	XDP_SETUP_PROG,
+	/* set xdp.prog_attached if a program is installed */
+	XDP_QUERY_PROG,
+};
+
+struct netdev_xdp {
+	enum xdp_netdev_command command;
+	union {
+		struct bpf_prog *prog;		/* XDP_SETUP_PROG */
+		bool prog_attached;		/* XDP_QUERY_PROG */
+	};
+};
+
 typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
 				       struct sk_buff *skb);
 
@@ -1030,6 +1050,17 @@ typedef u16 (*select_queue_fallback_t)(struct net_device *dev,
  * int (*ndo_switch_port_stp_update)(struct net_device *dev, u8 state);
  *	Called to notify switch device port of bridge port STP
  *	state change.
+ *
+ * int (*ndo_xdp)(struct net_device *dev, struct netdev_xdp *xdp);
+ *	Install, remove or query the BPF_PROG_TYPE_XDP program the driver
+ *	runs on received frames before allocating an skb for them.
+ *
+ * int (*ndo_packet_zc)(struct net_device *dev, u32 queue_id,
+ *			struct packet_zc *zc);
+ *	Receive rx queue 'queue_id' straight into the frames of a zero copy
+ *	packet socket, or return it to the stack if 'zc' is NULL.  Called
+ *	under rtnl_lock; once detaching returns the driver must no longer
+ *	touch the socket's frames or rings.
  */
 struct net_device_ops {
 	int			(*ndo_init)(struct net_device *dev);
@@ -1190,6 +1221,11 @@ struct net_device_ops {
 	int			(*ndo_switch_port_stp_update)(struct net_device *dev,
 							      u8 state);
 #endif
+	int			(*ndo_xdp)(struct net_device *dev,
+					   struct netdev_xdp *xdp);
+	int			(*ndo_packet_zc)(struct net_device *dev,
+						 u32 queue_id,
+						 struct packet_zc *zc);
 };
 
 /**
@@ -1943,6 +1979,9 @@ struct napi_gro_cb {
 	/* Used in foo-over-udp, set in udp[46]_gro_receive */
 	u8	is_ipv6:1;
 
+	/* Datagrams merged for a UDP_GRO socket, set in udp4_gro_receive */
+	u8	udp_seg:1;
+
 	/* used to support CHECKSUM_COMPLETE for tunneling protocols */
 	__wsum	csum;
 
@@ -2888,6 +2927,7 @@ int dev_set_mtu(struct net_device *, int);
 void dev_set_group(struct net_device *, int);
 int dev_set_mac_address(struct net_device *, struct sockaddr *);
 int dev_change_carrier(struct net_device *, bool new_carrier);
+int dev_change_xdp_fd(struct net_device *dev, int fd);
 int dev_get_phys_port_id(struct net_device *dev,
 			 struct netdev_phys_item_id *ppid);
 struct sk_buff *validate_xmit_skb_list(struct sk_buff *skb, struct net_device *dev);
@@ -3601,6 +3641,7 @@ static inline bool net_gso_ok(netdev_features_t features, int gso_type)
 	BUILD_BUG_ON(SKB_GSO_UDP_TUNNEL != (NETIF_F_GSO_UDP_TUNNEL >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_UDP_TUNNEL_CSUM != (NETIF_F_GSO_UDP_TUNNEL_CSUM >> NETIF_F_GSO_SHIFT));
 	BUILD_BUG_ON(SKB_GSO_TUNNEL_REMCSUM != (NETIF_F_GSO_TUNNEL_REMCSUM >> NETIF_F_GSO_SHIFT));
+	BUILD_BUG_ON(SKB_GSO_UDP_L4 != (NETIF_F_GSO_UDP_L4 >> NETIF_F_GSO_SHIFT));
 
 	return (features & feature) == feature;
 }
@@ -164,6 +164,33 @@ struct padata_instance {
 #define	PADATA_INVALID	4
 };
 
+/**
+ * struct padata_mt_job - represents one multithreaded job
+ *
+ * @thread_fn: Called for each chunk of work that a padata thread does.
+ * @fn_arg: The thread function argument.
+ * @start: The start of the job (units are job-specific).
+ * @size: Size of the job (units are job-specific).
+ * @align: Ranges passed to the thread function fall on this boundary, with
+ *         the possible exceptions of the beginning and end of the job.
+ * @min_chunk: The minimum chunk size in job-specific units.  This allows
+ *             the client to communicate the minimum amount of work that's
+ *             appropriate for one worker thread to do at once.
+ * @max_threads: Max threads to use for the job, actual number may be less
+ *               depending on job size and minimum chunk size.
+ * @numa_node: NUMA node the helper threads run on, or NUMA_NO_NODE.
+ */
+struct padata_mt_job {
+	void (*thread_fn)(unsigned long start, unsigned long end, void *arg);
+	void			*fn_arg;
+	unsigned long		start;
+	unsigned long		size;
+	unsigned long		align;
+	unsigned long		min_chunk;
+	int			max_threads;
+	int			numa_node;
+};
+
 extern struct padata_instance *padata_alloc_possible(
 					struct workqueue_struct *wq);
 extern struct padata_instance *padata_alloc(struct workqueue_struct *wq,
@@ -186,4 +213,14 @@ extern int padata_register_cpumask_notifier(struct padata_instance *pinst,
 					    struct notifier_block *nblock);
 extern int padata_unregister_cpumask_notifier(struct padata_instance *pinst,
 					      struct notifier_block *nblock);
+
+#ifdef CONFIG_PADATA
+extern void padata_do_multithreaded(struct padata_mt_job *job);
+#else
+static inline void padata_do_multithreaded(struct padata_mt_job *job)
+{
+	if (job->size)
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+}
+#endif
 #endif
@@ -1193,6 +1193,8 @@ enum pci_dma_burst_strategy {
 				   strategy_parameter byte boundaries */
 };
 
+struct irq_affinity;
+
 struct msix_entry {
 	u32	vector;	/* kernel uses to write allocated vector */
 	u16	entry;	/* driver uses to specify entry, OS writes */
@@ -1227,6 +1229,10 @@ static inline int pci_enable_msix_exact(struct pci_dev *dev,
 		return rc;
 	return 0;
 }
+int pci_enable_msix_range_affinity(struct pci_dev *dev,
+				   struct msix_entry *entries, int minvec,
+				   int maxvec, const struct irq_affinity *affd);
+const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev, int nr);
 #else
 static inline int pci_msi_vec_count(struct pci_dev *dev) { return -ENOSYS; }
 static inline void pci_msi_shutdown(struct pci_dev *dev) { }
@@ -1250,6 +1256,13 @@ static inline int pci_enable_msix_range(struct pci_dev *dev,
 static inline int pci_enable_msix_exact(struct pci_dev *dev,
 		      struct msix_entry *entries, int nvec)
 { return -ENOSYS; }
+static inline int pci_enable_msix_range_affinity(struct pci_dev *dev,
+		      struct msix_entry *entries, int minvec, int maxvec,
+		      const struct irq_affinity *affd)
+{ return -ENOSYS; }
+static inline const struct cpumask *pci_irq_get_affinity(struct pci_dev *dev,
+							 int nr)
+{ return NULL; }
 #endif
 
 #ifdef CONFIG_PCIEPORTBUS
@@ -167,6 +167,8 @@ struct perf_event;
  */
 #define PERF_PMU_CAP_NO_INTERRUPT		0x01
 
+struct perf_event_context;
+
 /**
  * struct pmu - generic performance monitoring unit
  */
@@ -258,6 +260,13 @@ struct pmu {
 	 * flush branch stack on context-switches (needed in cpu-wide mode)
 	 */
 	void (*flush_branch_stack)	(void);
+
+	/*
+	 * context-switches callback for events that buffer samples in the
+	 * PMU and need them flushed while the task they belong to is current
+	 */
+	void (*sched_task)		(struct perf_event_context *ctx,
+					bool sched_in);
 };
 
 /**
@@ -293,8 +302,10 @@ struct swevent_hlist {
 #define PERF_ATTACH_CONTEXT	0x01
 #define PERF_ATTACH_GROUP	0x02
 #define PERF_ATTACH_TASK	0x04
+#define PERF_ATTACH_SCHED_CB	0x08
 
 struct perf_cgroup;
+struct perf_cgroup_table;
 struct ring_buffer;
 
 /**
@@ -437,6 +448,7 @@ struct perf_event {
 #ifdef CONFIG_EVENT_TRACING
 	struct ftrace_event_call	*tp_event;
 	struct event_filter		*filter;
+	struct bpf_prog			*prog;	/* attached to tp_event */
 #ifdef CONFIG_FUNCTION_TRACER
 	struct ftrace_ops               ftrace_ops;
 #endif
@@ -445,6 +457,7 @@ struct perf_event {
 #ifdef CONFIG_CGROUP_PERF
 	struct perf_cgroup		*cgrp; /* cgroup event is attach to */
 	int				cgrp_defer_enabled;
+	struct perf_cgroup_table	*cgrp_table; /* PERF_EVENT_IOC_ATTACH_CGROUP */
 #endif
 
 #endif /* CONFIG_PERF_EVENTS */
@@ -644,6 +657,10 @@ extern int perf_event_overflow(struct perf_event *event,
 				 struct perf_sample_data *data,
 				 struct pt_regs *regs);
 
+extern void perf_event_output(struct perf_event *event,
+				struct perf_sample_data *data,
+				struct pt_regs *regs);
+
 static inline bool is_sampling_event(struct perf_event *event)
 {
 	return event->attr.sample_period != 0;
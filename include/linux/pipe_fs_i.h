@@ -37,6 +37,7 @@ struct pipe_buffer {
  *	@writers: number of current writers of this pipe
  *	@files: number of struct file referring this pipe (protected by ->i_lock)
  *	@waiting_writers: number of writers blocked waiting for room
+ *	@poll_usage: the pipe has been polled, wake on every write
  *	@r_counter: reader counter
  *	@w_counter: writer counter
  *	@fasync_readers: reader side fasync
@@ -51,6 +52,7 @@ struct pipe_inode_info {
 	unsigned int writers;
 	unsigned int files;
 	unsigned int waiting_writers;
+	bool poll_usage;
 	unsigned int r_counter;
 	unsigned int w_counter;
 	struct page *tmp_page;
@@ -123,6 +125,7 @@ void pipe_unlock(struct pipe_inode_info *);
 void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size, pipe_min_size;
+extern int pipe_adaptive;
 int pipe_proc_fn(struct ctl_table *, int, void __user *, size_t *, loff_t *);
 
 
@@ -78,6 +78,12 @@ static inline void kfree_call_rcu(struct rcu_head *head,
 	call_rcu(head, func);
 }
 
+static inline void call_rcu_lazy(struct rcu_head *head,
+				 void (*func)(struct rcu_head *rcu))
+{
+	call_rcu(head, func);
+}
+
 static inline void rcu_note_context_switch(void)
 {
 	rcu_sched_qs();
@@ -51,6 +51,7 @@ void synchronize_sched_expedited(void);
 void synchronize_rcu_expedited(void);
 
 void kfree_call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu));
+void call_rcu_lazy(struct rcu_head *head, void (*func)(struct rcu_head *rcu));
 
 /**
  * synchronize_rcu_bh_expedited - Brute-force RCU-bh grace period
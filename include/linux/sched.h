@@ -133,6 +133,7 @@ struct fs_struct;
 struct perf_event_context;
 struct blk_plug;
 struct filename;
+struct rseq;
 
 #define VMACACHE_BITS 2
 #define VMACACHE_SIZE (1U << VMACACHE_BITS)
@@ -592,6 +593,7 @@ struct thread_group_cputimer {
 };
 
 #include <linux/rwsem.h>
+#include <linux/percpu-rwsem.h>
 struct autogroup;
 
 /*
@@ -727,19 +729,6 @@ struct signal_struct {
 	unsigned audit_tty_log_passwd;
 	struct tty_audit_buf *tty_audit_buf;
 #endif
-#ifdef CONFIG_CGROUPS
-	/*
-	 * group_rwsem prevents new tasks from entering the threadgroup and
-	 * member tasks from exiting,a more specifically, setting of
-	 * PF_EXITING.  fork and exit paths are protected with this rwsem
-	 * using threadgroup_change_begin/end().  Users which require
-	 * threadgroup to remain stable should use threadgroup_[un]lock()
-	 * which also takes care of exec path.  Currently, cgroup is the
-	 * only user.
-	 */
-	struct rw_semaphore group_rwsem;
-#endif
-
 	oom_flags_t oom_flags;
 	short oom_score_adj;		/* OOM kill score adjustment */
 	short oom_score_adj_min;	/* OOM kill score adjustment min value.
@@ -1253,6 +1242,45 @@ struct sched_dl_entity {
 	struct hrtimer dl_timer;
 };
 
+/*
+ * Wake-up queues: gather the tasks to wake while holding a lock, then wake
+ * them all once it is dropped, so that they don't run straight into the
+ * lock the waker still holds:
+ *
+ *	WAKE_Q(wake_q);
+ *
+ *	spin_lock(&lock);
+ *	...
+ *	wake_q_add(&wake_q, task);
+ *	...
+ *	spin_unlock(&lock);
+ *	wake_up_q(&wake_q);
+ *
+ * A task is on at most one wake queue at a time: if it already is on one,
+ * wake_q_add() leaves it to that queue's owner to wake it.  The queued task
+ * may therefore see the wakeup condition and go on before it is actually
+ * woken, so wake_up_q() can wake it spuriously later; every sleeper has to
+ * cope with that anyway.  wake_q_add() takes a reference on the task, so
+ * it can't go away before wake_up_q() is done with it.
+ */
+struct wake_q_node {
+	struct wake_q_node *next;
+};
+
+struct wake_q_head {
+	struct wake_q_node *first;
+	struct wake_q_node **lastp;
+};
+
+#define WAKE_Q_TAIL ((struct wake_q_node *) 0x01)
+
+#define WAKE_Q(name)					\
+	struct wake_q_head name = { WAKE_Q_TAIL, &name.first }
+
+extern void wake_q_add(struct wake_q_head *head,
+		       struct task_struct *task);
+extern void wake_up_q(struct wake_q_head *head);
+
 union rcu_special {
 	struct {
 		bool blocked;
@@ -1297,6 +1325,7 @@ struct task_struct {
 	u64 deadline;
 	u64 priodl; /* 8bits prio and 56bits deadline for quick processing */
 	struct list_head run_list;
+	struct rb_node dl_node; /* Deadline index of the runqueue */
 	u64 last_ran;
 	u64 sched_time; /* sched_clock time spent running */
 #ifdef CONFIG_SMT_NICE
@@ -1305,6 +1334,13 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	bool sticky; /* Soft affined flag */
 #endif
+#ifdef CONFIG_BFS_SHARDED_RQ
+	int shard_cpu; /* Runqueue shard the task is queued on */
+#endif
+#ifdef CONFIG_SCHEDSTATS
+	u64 lat_queued; /* niffies when last queued */
+	bool lat_woken; /* Queued by a wakeup */
+#endif
 #ifdef CONFIG_HOTPLUG_CPU
 	bool zerobound; /* Bound to CPU0 for hotplug */
 #endif
@@ -1383,6 +1419,9 @@ struct task_struct {
 	/* Revert to default priority/policy when forking */
 	unsigned sched_reset_on_fork:1;
 	unsigned sched_contributes_to_load:1;
+#ifdef CONFIG_PSI
+	unsigned sched_psi_wake_requeue:1;
+#endif
 
 #ifdef CONFIG_MEMCG_KMEM
 	unsigned memcg_kmem_skip_account:1;
@@ -1514,6 +1553,8 @@ struct task_struct {
 	/* Protection of the PI data structures: */
 	raw_spinlock_t pi_lock;
 
+	struct wake_q_node wake_q;
+
 #ifdef CONFIG_RT_MUTEXES
 	/* PI waiters blocked on a rt_mutex held by this task */
 	struct rb_root pi_waiters;
@@ -1582,6 +1623,10 @@ struct task_struct {
 	int cpuset_mem_spread_rotor;
 	int cpuset_slab_spread_rotor;
 #endif
+#ifdef CONFIG_PSI
+	/* Pressure stall state */
+	unsigned int			psi_flags;
+#endif
 #ifdef CONFIG_CGROUPS
 	/* Control Group info protected by css_set_lock */
 	struct css_set __rcu *cgroups;
@@ -1609,6 +1654,15 @@ struct task_struct {
 	short il_next;
 	short pref_node_fork;
 #endif
+#ifdef CONFIG_RSEQ
+	struct rseq __user *rseq;
+	u32 rseq_sig;
+	/*
+	 * RmW on rseq_event_mask must be performed atomically
+	 * with respect to preemption.
+	 */
+	unsigned long rseq_event_mask;
+#endif
 #ifdef CONFIG_NUMA_BALANCING
 	int numa_scan_seq;
 	unsigned int numa_scan_period;
@@ -2040,6 +2094,7 @@ extern void thread_group_cputime_adjusted(struct task_struct *p, cputime_t *ut,
 #define PF_KTHREAD	0x00200000	/* I am a kernel thread */
 #define PF_RANDOMIZE	0x00400000	/* randomize virtual address space */
 #define PF_SWAPWRITE	0x00800000	/* Allowed to write to swap */
+#define PF_MEMSTALL	0x01000000	/* Stalled due to lack of memory */
 #define PF_NO_SETAFFINITY 0x04000000	/* Userland is not allowed to meddle with cpus_allowed */
 #define PF_MCE_EARLY    0x08000000      /* Early kill for mce process policy */
 #define PF_MUTEX_TESTER	0x20000000	/* Thread belongs to the rt mutex tester */
@@ -2701,51 +2756,46 @@ static inline void unlock_task_sighand(struct task_struct *tsk,
 }
 
 #ifdef CONFIG_CGROUPS
-static inline void threadgroup_change_begin(struct task_struct *tsk)
-{
-	down_read(&tsk->signal->group_rwsem);
-}
-static inline void threadgroup_change_end(struct task_struct *tsk)
-{
-	up_read(&tsk->signal->group_rwsem);
-}
+extern struct percpu_rw_semaphore cgroup_threadgroup_rwsem;
 
 /**
- * threadgroup_lock - lock threadgroup
- * @tsk: member task of the threadgroup to lock
- *
- * Lock the threadgroup @tsk belongs to.  No new task is allowed to enter
- * and member tasks aren't allowed to exit (as indicated by PF_EXITING) or
- * change ->group_leader/pid.  This is useful for cases where the threadgroup
- * needs to stay stable across blockable operations.
+ * threadgroup_change_begin - mark the beginning of changes to a threadgroup
+ * @tsk: task causing the changes
  *
- * fork and exit paths explicitly call threadgroup_change_{begin|end}() for
- * synchronization.  While held, no new task will be added to threadgroup
- * and no existing live task will have its PF_EXITING set.
+ * All operations which modify a threadgroup - a new thread joining the
+ * group, death of a member thread (the assertion of PF_EXITING) and
+ * exec(2) dethreading the process and replacing the leader - are wrapped
+ * by threadgroup_change_{begin|end}().  cgroup write-locks
+ * cgroup_threadgroup_rwsem while migrating tasks, so that the
+ * threadgroups it operates on stay stable.
  *
- * de_thread() does threadgroup_change_{begin|end}() when a non-leader
- * sub-thread becomes a new leader.
+ * This is a single global percpu rwsem rather than a per-process one:
+ * the read side taken on every thread creation and exit only touches a
+ * per-cpu counter, so it doesn't bounce a cacheline between the CPUs
+ * forking threads of the same process.
  */
-static inline void threadgroup_lock(struct task_struct *tsk)
+static inline void threadgroup_change_begin(struct task_struct *tsk)
 {
-	down_write(&tsk->signal->group_rwsem);
+	might_sleep();
+	percpu_down_read(&cgroup_threadgroup_rwsem);
 }
 
 /**
- * threadgroup_unlock - unlock threadgroup
- * @tsk: member task of the threadgroup to unlock
+ * threadgroup_change_end - mark the end of changes to a threadgroup
+ * @tsk: task causing the changes
  *
- * Reverse threadgroup_lock().
+ * See threadgroup_change_begin().
  */
-static inline void threadgroup_unlock(struct task_struct *tsk)
+static inline void threadgroup_change_end(struct task_struct *tsk)
 {
-	up_write(&tsk->signal->group_rwsem);
+	percpu_up_read(&cgroup_threadgroup_rwsem);
 }
 #else
-static inline void threadgroup_change_begin(struct task_struct *tsk) {}
+static inline void threadgroup_change_begin(struct task_struct *tsk)
+{
+	might_sleep();
+}
 static inline void threadgroup_change_end(struct task_struct *tsk) {}
-static inline void threadgroup_lock(struct task_struct *tsk) {}
-static inline void threadgroup_unlock(struct task_struct *tsk) {}
 #endif
 
 #ifndef __HAVE_THREAD_FUNCTIONS
@@ -3159,4 +3209,13 @@ static inline unsigned long rlimit_max(unsigned int limit)
 	return task_rlimit_max(current, limit);
 }
 
+#ifdef CONFIG_CPU_FREQ
+struct update_util_data {
+	void (*func)(struct update_util_data *data,
+		     u64 time, unsigned long util, unsigned long max);
+};
+
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data);
+#endif /* CONFIG_CPU_FREQ */
+
 #endif
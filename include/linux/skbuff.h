@@ -148,8 +148,10 @@
 			 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
 
 struct net_device;
+struct sock;
 struct scatterlist;
 struct pipe_inode_info;
+struct splice_pipe_desc;
 struct iov_iter;
 struct napi_struct;
 
@@ -291,13 +293,42 @@ enum {
  * false on data copy or out of memory error caused by data copy attempt.
  * The ctx field is used to track device context.
  * The desc field is used to track userspace buffer index.
+ *
+ * MSG_ZEROCOPY sends use the second layout instead: one ubuf_info, living in
+ * the cb of the skb that will carry the completion notification, is shared
+ * by all skbs of a send call and reference counted.  id is the send call's
+ * notification number and len the count of calls it covers (0 once aborted).
  */
 struct ubuf_info {
 	void (*callback)(struct ubuf_info *, bool zerocopy_success);
-	void *ctx;
-	unsigned long desc;
+	union {
+		struct {
+			void *ctx;
+			unsigned long desc;
+		};
+		struct {
+			u32 id;
+			u16 len;
+			u16 zerocopy:1;
+			u32 bytelen;
+		};
+	};
+	atomic_t refcnt;
 };
 
+#define skb_uarg(SKB)	((struct ubuf_info *)(skb_shinfo(SKB)->destructor_arg))
+
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk, size_t size);
+void sock_zerocopy_callback(struct ubuf_info *uarg, bool success);
+void sock_zerocopy_put(struct ubuf_info *uarg);
+void sock_zerocopy_put_abort(struct ubuf_info *uarg);
+
+int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+			     const void __user *from, size_t len,
+			     struct ubuf_info *uarg);
+int skb_zerocopy_iter_dgram(struct sk_buff *skb, struct msghdr *msg,
+			    int offset, int len, struct ubuf_info *uarg);
+
 /* This data is invariant across clones and lives at
  * the end of the header data, ie. at skb->end.
  */
@@ -374,6 +405,8 @@ enum {
 	SKB_GSO_UDP_TUNNEL_CSUM = 1 << 11,
 
 	SKB_GSO_TUNNEL_REMCSUM = 1 << 12,
+
+	SKB_GSO_UDP_L4 = 1 << 13,
 };
 
 #if BITS_PER_LONG > 32
@@ -557,8 +590,8 @@ struct sk_buff {
 				fclone:2,
 				peeked:1,
 				head_frag:1,
-				xmit_more:1;
-	/* one bit hole */
+				xmit_more:1,
+				pp_recycle:1;
 	kmemcheck_bitfield_end(flags1);
 
 	/* fields enclosed in headers_start/headers_end are copied
@@ -846,6 +879,9 @@ int skb_append_datato_frags(struct sock *sk, struct sk_buff *skb,
 					int len, int odd, struct sk_buff *skb),
 			    void *from, int length);
 
+int skb_append_pagefrags(struct sk_buff *skb, struct page *page,
+			 int offset, size_t size);
+
 struct skb_seq_state {
 	__u32		lower_offset;
 	__u32		upper_offset;
@@ -971,6 +1007,27 @@ static inline struct skb_shared_hwtstamps *skb_hwtstamps(struct sk_buff *skb)
 	return &skb_shinfo(skb)->hwtstamps;
 }
 
+static inline bool skb_zcopy(struct sk_buff *skb)
+{
+	return skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY;
+}
+
+static inline void sock_zerocopy_get(struct ubuf_info *uarg)
+{
+	atomic_inc(&uarg->refcnt);
+}
+
+/* Make @skb hold a reference to the MSG_ZEROCOPY completion @uarg */
+static inline void skb_zcopy_set(struct sk_buff *skb, struct ubuf_info *uarg)
+{
+	sock_zerocopy_get(uarg);
+	skb_shinfo(skb)->destructor_arg = uarg;
+	skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+}
+
+int skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig,
+		       gfp_t gfp_mask);
+
 /**
  *	skb_queue_empty - check if a queue is empty
  *	@list: queue head
@@ -2087,7 +2144,26 @@ static inline void skb_orphan(struct sk_buff *skb)
  */
 static inline int skb_orphan_frags(struct sk_buff *skb, gfp_t gfp_mask)
 {
-	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
+	if (likely(!skb_zcopy(skb)))
+		return 0;
+	/* MSG_ZEROCOPY frags are refcounted, they may stay with clones */
+	if (skb_uarg(skb)->callback == sock_zerocopy_callback)
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
+/**
+ *	skb_orphan_frags_rx - orphan user frags before the skb is received
+ *	@skb: buffer to orphan frags from
+ *	@gfp_mask: allocation mask for replacement pages
+ *
+ *	Like skb_orphan_frags(), but copies MSG_ZEROCOPY frags as well:
+ *	a packet looped to a local receiver may be held for an unbounded
+ *	time and must not pin the sender's pages.
+ */
+static inline int skb_orphan_frags_rx(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!skb_zcopy(skb)))
 		return 0;
 	return skb_copy_ubufs(skb, gfp_mask);
 }
@@ -2287,9 +2363,35 @@ static inline void __skb_frag_unref(skb_frag_t *frag)
  *
  * Releases a reference on the @f'th paged fragment of @skb.
  */
+#ifdef CONFIG_PAGE_POOL
+bool page_pool_return_skb_page(struct page *page);
+#else
+static inline bool page_pool_return_skb_page(struct page *page)
+{
+	return false;
+}
+#endif
+
+/**
+ * skb_mark_for_recycle - return the pages of an skb to their page_pool
+ * @skb: the buffer
+ *
+ * For drivers that build @skb from page_pool pages: when the skb is
+ * freed, its head and fragment pages go back to their pool instead of
+ * the page allocator.  Pages not from a pool are freed as usual.
+ */
+static inline void skb_mark_for_recycle(struct sk_buff *skb)
+{
+	skb->pp_recycle = 1;
+}
+
 static inline void skb_frag_unref(struct sk_buff *skb, int f)
 {
-	__skb_frag_unref(&skb_shinfo(skb)->frags[f]);
+	skb_frag_t *frag = &skb_shinfo(skb)->frags[f];
+
+	if (skb->pp_recycle && page_pool_return_skb_page(skb_frag_page(frag)))
+		return;
+	__skb_frag_unref(frag);
 }
 
 /**
@@ -2666,6 +2768,8 @@ int skb_copy_and_csum_datagram_msg(struct sk_buff *skb, int hlen,
 				   struct msghdr *msg);
 int skb_copy_datagram_from_iter(struct sk_buff *skb, int offset,
 				 struct iov_iter *from, int len);
+int __zerocopy_sg_from_iter(struct sock *sk, struct sk_buff *skb,
+			    struct iov_iter *from, size_t length);
 int zerocopy_sg_from_iter(struct sk_buff *skb, struct iov_iter *frm);
 void skb_free_datagram(struct sock *sk, struct sk_buff *skb);
 void skb_free_datagram_locked(struct sock *sk, struct sk_buff *skb);
@@ -2674,9 +2778,15 @@ int skb_copy_bits(const struct sk_buff *skb, int offset, void *to, int len);
 int skb_store_bits(struct sk_buff *skb, int offset, const void *from, int len);
 __wsum skb_copy_and_csum_bits(const struct sk_buff *skb, int offset, u8 *to,
 			      int len, __wsum csum);
-int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
+int skb_splice_bits(struct sk_buff *skb, struct sock *sk, unsigned int offset,
 		    struct pipe_inode_info *pipe, unsigned int len,
-		    unsigned int flags);
+		    unsigned int flags,
+		    ssize_t (*splice_cb)(struct sock *,
+					 struct pipe_inode_info *,
+					 struct splice_pipe_desc *));
+ssize_t skb_socket_splice(struct sock *sk,
+			  struct pipe_inode_info *pipe,
+			  struct splice_pipe_desc *spd);
 void skb_copy_and_csum_dev(const struct sk_buff *skb, u8 *to);
 unsigned int skb_zerocopy_headlen(const struct sk_buff *from);
 int skb_zerocopy(struct sk_buff *to, struct sk_buff *from,
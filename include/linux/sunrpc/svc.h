@@ -18,6 +18,7 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/workqueue.h>
 
 /*
  * This is the RPC server thread function prototype
@@ -30,8 +31,20 @@ struct svc_pool_stats {
 	unsigned long	sockets_queued;
 	atomic_long_t	threads_woken;
 	atomic_long_t	threads_timedout;
+	unsigned long	queue_wait;	/* usecs transports waited for a thread */
+	atomic_long_t	threads_started; /* by autoscaling */
+	atomic_long_t	threads_stopped; /* after being idle */
 };
 
+/*
+ * Pools of services that set sv_maxthreads grow by a thread whenever
+ * a transport had to wait longer than SVC_POOL_GROW_WAIT usecs for
+ * one, and threads beyond the configured number exit after
+ * SVC_POOL_IDLE_TIMEOUT without work.
+ */
+#define SVC_POOL_GROW_WAIT	(1000)
+#define SVC_POOL_IDLE_TIMEOUT	(60 * HZ)
+
 /*
  *
  * RPC service thread pool.
@@ -47,10 +60,13 @@ struct svc_pool {
 	spinlock_t		sp_lock;	/* protects all fields */
 	struct list_head	sp_sockets;	/* pending sockets */
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
+	unsigned int		sp_nrthreads_min; /* # of threads configured */
 	struct list_head	sp_all_threads;	/* all server threads */
 	struct svc_pool_stats	sp_stats;	/* statistics on pool operation */
 #define	SP_TASK_PENDING		(0)		/* still work to do even if no
 						 * xprt is queued. */
+#define	SP_NEED_THREAD		(1)		/* autoscaling wants another
+						 * thread here */
 	unsigned long		sp_flags;
 } ____cacheline_aligned_in_smp;
 
@@ -72,6 +88,9 @@ struct svc_serv {
 	unsigned int		sv_maxconn;	/* max connections allowed or
 						 * '0' causing max to be based
 						 * on number of threads. */
+	unsigned int		sv_maxthreads;	/* upper limit for autoscaling
+						 * the pools, or '0' for a
+						 * fixed number of threads */
 
 	unsigned int		sv_max_payload;	/* datagram payload size */
 	unsigned int		sv_max_mesg;	/* max_payload + 1 page for overheads */
@@ -95,6 +114,13 @@ struct svc_serv {
 	struct module *		sv_module;	/* optional module to count when
 						 * adding threads */
 	svc_thread_fn		sv_function;	/* main function for threads */
+	void			(*sv_autoscale)(struct svc_serv *serv);
+						/* Called from sv_grow_work to
+						 * start threads with the
+						 * service's lock held, see
+						 * svc_pools_grow()
+						 */
+	struct work_struct	sv_grow_work;
 #if defined(CONFIG_SUNRPC_BACKCHANNEL)
 	struct list_head	sv_cb_list;	/* queue for callback requests
 						 * that arrive over the same
@@ -263,6 +289,7 @@ struct svc_rqst {
 						 * cache pages */
 #define	RQ_VICTIM	(5)			/* about to be shut down */
 #define	RQ_BUSY		(6)			/* request is busy */
+#define	RQ_IDLE_EXIT	(7)			/* exiting after being idle */
 	unsigned long		rq_flags;	/* flags field */
 
 	void *			rq_argp;	/* decoded arguments */
@@ -437,6 +464,7 @@ struct svc_serv *  svc_create_pooled(struct svc_program *, unsigned int,
 			void (*shutdown)(struct svc_serv *, struct net *net),
 			svc_thread_fn, struct module *);
 int		   svc_set_num_threads(struct svc_serv *, struct svc_pool *, int);
+void		   svc_pools_grow(struct svc_serv *);
 int		   svc_pool_stats_open(struct svc_serv *serv, struct file *file);
 void		   svc_destroy(struct svc_serv *);
 void		   svc_shutdown_net(struct svc_serv *, struct net *);
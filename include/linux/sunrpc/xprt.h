@@ -278,6 +278,18 @@ struct xprt_create {
 	unsigned int		flags;
 };
 
+/*
+ * Additional connections to the same server, shared by an RPC client
+ * and its clones.  Requests are spread round-robin over cl_xprt and
+ * the transports in this set.
+ */
+struct rpc_xprt_set {
+	atomic_t		count;		/* Number of references */
+	atomic_t		next;		/* round-robin cursor */
+	unsigned int		nr;		/* number of entries in xprt[] */
+	struct rpc_xprt *	xprt[0];
+};
+
 struct xprt_class {
 	struct list_head	list;
 	int			ident;		/* XPRT_TRANSPORT identifier */
@@ -309,6 +321,8 @@ struct rpc_xprt *	xprt_alloc(struct net *net, size_t size,
 				unsigned int num_prealloc,
 				unsigned int max_req);
 void			xprt_free(struct rpc_xprt *);
+struct rpc_xprt_set *	xprt_set_alloc(unsigned int nr);
+void			xprt_set_put(struct rpc_xprt_set *set);
 
 /**
  * xprt_get - return a reference to an RPC transport.
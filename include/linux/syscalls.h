@@ -16,12 +16,14 @@ struct iattr;
 struct inode;
 struct iocb;
 struct io_event;
+struct io_uring_params;
 struct iovec;
 struct itimerspec;
 struct itimerval;
 struct kexec_segment;
 struct linux_dirent;
 struct linux_dirent64;
+struct linux_dirent_stat;
 struct list_head;
 struct mmap_arg_struct;
 struct msgbuf;
@@ -35,6 +37,7 @@ struct oldold_utsname;
 struct old_utsname;
 struct pollfd;
 struct rlimit;
+struct rseq;
 struct rlimit64;
 struct rusage;
 struct sched_param;
@@ -503,6 +506,11 @@ asmlinkage long sys_io_submit(aio_context_t, long,
 				struct iocb __user * __user *);
 asmlinkage long sys_io_cancel(aio_context_t ctx_id, struct iocb __user *iocb,
 			      struct io_event __user *result);
+asmlinkage long sys_io_uring_setup(u32 entries,
+				struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				u32 min_complete, u32 flags,
+				const sigset_t __user *sig, size_t sigsz);
 asmlinkage long sys_sendfile(int out_fd, int in_fd,
 			     off_t __user *offset, size_t count);
 asmlinkage long sys_sendfile64(int out_fd, int in_fd,
@@ -587,6 +595,9 @@ asmlinkage long sys_getdents(unsigned int fd,
 asmlinkage long sys_getdents64(unsigned int fd,
 				struct linux_dirent64 __user *dirent,
 				unsigned int count);
+asmlinkage long sys_getdents_stat(unsigned int fd,
+				struct linux_dirent_stat __user *dirent,
+				unsigned int count, unsigned int mask);
 
 asmlinkage long sys_setsockopt(int fd, int level, int optname,
 				char __user *optval, int optlen);
@@ -882,4 +893,7 @@ asmlinkage long sys_execveat(int dfd, const char __user *filename,
 			const char __user *const __user *argv,
 			const char __user *const __user *envp, int flags);
 
+asmlinkage long sys_rseq(struct rseq __user *rseq, u32 rseq_len,
+			 int flags, u32 sig);
+
 #endif
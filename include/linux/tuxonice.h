@@ -8,7 +8,12 @@
 
 #ifndef INCLUDE_LINUX_TUXONICE_H
 #define INCLUDE_LINUX_TUXONICE_H
+struct page;
+
 #ifdef CONFIG_TOI_INCREMENTAL
 extern void toi_set_logbuf_untracked(void);
+extern int toi_page_unchanged(struct page *page);
+#else
+static inline int toi_page_unchanged(struct page *page) { return 0; }
 #endif
 #endif
@@ -50,15 +50,17 @@ struct udp_sock {
 	__u8		 encap_type;	/* Is this an Encapsulation socket? */
 	unsigned char	 no_check6_tx:1,/* Send zero UDP6 checksums on TX? */
 			 no_check6_rx:1,/* Allow zero UDP6 checksums on RX? */
-			 convert_csum:1;/* On receive, convert checksum
+			 convert_csum:1,/* On receive, convert checksum
 					 * unnecessary to checksum complete
 					 * if possible.
 					 */
+			 gro_enabled:1;	/* Accept GRO merged datagrams? */
 	/*
 	 * Following member retains the information to create a UDP header
 	 * when the socket is uncorked.
 	 */
 	__u16		 len;		/* total length of pending frames */
+	__u16		 gso_size;	/* UDP_SEGMENT, 0 if unset */
 	/*
 	 * Fields specific to UDP-Lite.
 	 */
@@ -112,6 +114,9 @@ static inline bool udp_get_convert_csum(struct sock *sk)
 	return udp_sk(sk)->convert_csum;
 }
 
+/* Most datagrams one UDP_SEGMENT send may be cut into */
+#define UDP_MAX_SEGMENTS	(1 << 6UL)
+
 #define udp_portaddr_for_each_entry(__sk, node, list) \
 	hlist_nulls_for_each_entry(__sk, node, list, __sk_common.skc_portaddr_node)
 
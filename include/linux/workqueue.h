@@ -119,18 +119,34 @@ struct delayed_work {
 	int cpu;
 };
 
+/*
+ * Affinity scopes of unbound workqueues.  The CPUs are split into pods
+ * of the given scope and a work item runs within the pod of the CPU it
+ * was queued on.
+ */
+enum wq_affn_scope {
+	WQ_AFFN_DFL,			/* use system default */
+	WQ_AFFN_CPU,			/* one pod per CPU */
+	WQ_AFFN_SMT,			/* one pod per SMT core */
+	WQ_AFFN_CACHE,			/* one pod per last level cache */
+	WQ_AFFN_NUMA,			/* one pod per NUMA node */
+	WQ_AFFN_SYSTEM,			/* one pod across the whole system */
+
+	WQ_AFFN_NR_TYPES,
+};
+
 /*
  * A struct for workqueue attributes.  This can be used to change
  * attributes of an unbound workqueue.
  *
- * Unlike other fields, ->no_numa isn't a property of a worker_pool.  It
- * only modifies how apply_workqueue_attrs() select pools and thus doesn't
- * participate in pool hash calculations or equality comparisons.
+ * Unlike other fields, ->affn_scope isn't a property of a worker_pool.
+ * It only modifies how apply_workqueue_attrs() select pools and thus
+ * doesn't participate in pool hash calculations or equality comparisons.
  */
 struct workqueue_attrs {
 	int			nice;		/* nice level */
 	cpumask_var_t		cpumask;	/* allowed CPUs */
-	bool			no_numa;	/* disable NUMA affinity */
+	enum wq_affn_scope	affn_scope;	/* pods work items stay in */
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
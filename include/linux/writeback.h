@@ -99,6 +99,11 @@ int try_to_writeback_inodes_sb_nr(struct super_block *, unsigned long nr,
 void sync_inodes_sb(struct super_block *);
 void wakeup_flusher_threads(long nr_pages, enum wb_reason reason);
 void inode_wait_for_writeback(struct inode *inode);
+#ifdef CONFIG_CGROUP_WRITEBACK
+void inode_detach_wb_blkcg(struct inode *inode);
+#else
+static inline void inode_detach_wb_blkcg(struct inode *inode) { }
+#endif
 
 /* writeback.h requires fs.h; it, too, is not included from here. */
 static inline void wait_on_inode(struct inode *inode)
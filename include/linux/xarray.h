@@ -0,0 +1,123 @@
+#ifndef _LINUX_XARRAY_H
+#define _LINUX_XARRAY_H
+/*
+ * eXtensible Arrays
+ *
+ * A sparse array of pointers indexed by unsigned long.  Unlike a bare
+ * radix tree or an idr, the xarray carries its own spinlock: lookups are
+ * lockless under RCU, and the modifying calls take the lock themselves,
+ * so callers need neither a lock of their own nor a preload dance around
+ * one.  Entries can carry up to three marks, which searches can filter on.
+ *
+ * Entries must be pointers with the bottom two bits clear; NULL is the
+ * same as no entry.
+ *
+ * Licensed under the GPL v2.
+ */
+
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/radix-tree.h>
+#include <linux/gfp.h>
+
+struct xarray {
+	spinlock_t		xa_lock;
+	unsigned long		xa_free;	/* all indices below are in use */
+	struct radix_tree_root	xa_root;
+};
+
+#define XARRAY_INIT(name) {						\
+	.xa_lock = __SPIN_LOCK_UNLOCKED(name.xa_lock),			\
+	.xa_free = 0,							\
+	.xa_root = RADIX_TREE_INIT(GFP_NOWAIT),				\
+}
+
+#define DEFINE_XARRAY(name) struct xarray name = XARRAY_INIT(name)
+
+typedef unsigned __bitwise__ xa_mark_t;
+#define XA_MARK_0		((__force xa_mark_t)0U)
+#define XA_MARK_1		((__force xa_mark_t)1U)
+#define XA_MARK_2		((__force xa_mark_t)2U)
+#define XA_PRESENT		((__force xa_mark_t)8U)
+#define XA_MARK_MAX		XA_MARK_2
+
+static inline void xa_init(struct xarray *xa)
+{
+	spin_lock_init(&xa->xa_lock);
+	xa->xa_free = 0;
+	INIT_RADIX_TREE(&xa->xa_root, GFP_NOWAIT);
+}
+
+static inline bool xa_empty(const struct xarray *xa)
+{
+	return xa->xa_root.rnode == NULL;
+}
+
+static inline bool xa_marked(const struct xarray *xa, xa_mark_t mark)
+{
+	return radix_tree_tagged((struct radix_tree_root *)&xa->xa_root,
+				 (__force unsigned)mark);
+}
+
+void *xa_load(struct xarray *xa, unsigned long index);
+void *xa_store(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp);
+int xa_insert(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp);
+void *xa_erase(struct xarray *xa, unsigned long index);
+int xa_alloc(struct xarray *xa, u32 *id, void *entry, u32 min, u32 max,
+	     gfp_t gfp);
+void xa_destroy(struct xarray *xa);
+
+bool xa_get_mark(struct xarray *xa, unsigned long index, xa_mark_t mark);
+void xa_set_mark(struct xarray *xa, unsigned long index, xa_mark_t mark);
+void xa_clear_mark(struct xarray *xa, unsigned long index, xa_mark_t mark);
+
+void *xa_find(struct xarray *xa, unsigned long *index, unsigned long max,
+	      xa_mark_t filter);
+void *xa_find_after(struct xarray *xa, unsigned long *index,
+		    unsigned long max, xa_mark_t filter);
+
+/**
+ * xa_for_each - iterate over the present entries of an xarray
+ * @xa: the xarray
+ * @index: unsigned long index of the current entry
+ * @entry: the current entry
+ *
+ * Each step is a separate RCU lookup, so the array may be modified
+ * during the walk; entries added behind @index are not seen.
+ */
+#define xa_for_each(xa, index, entry)					\
+	for (index = 0, entry = xa_find(xa, &index, ULONG_MAX, XA_PRESENT); \
+	     entry;							\
+	     entry = xa_find_after(xa, &index, ULONG_MAX, XA_PRESENT))
+
+/**
+ * xa_for_each_marked - iterate over the entries of an xarray with a mark
+ * @xa: the xarray
+ * @index: unsigned long index of the current entry
+ * @entry: the current entry
+ * @mark: the mark to filter on
+ */
+#define xa_for_each_marked(xa, index, entry, mark)			\
+	for (index = 0, entry = xa_find(xa, &index, ULONG_MAX, mark);	\
+	     entry;							\
+	     entry = xa_find_after(xa, &index, ULONG_MAX, mark))
+
+#define xa_lock(xa)		spin_lock(&(xa)->xa_lock)
+#define xa_unlock(xa)		spin_unlock(&(xa)->xa_lock)
+
+/*
+ * For callers that must store while holding a lock of their own: preload
+ * with a sleeping @gfp outside it, then pass GFP_NOWAIT to the store.
+ * On success preemption is disabled until xa_preload_end().
+ */
+static inline int xa_preload(gfp_t gfp)
+{
+	return radix_tree_preload(gfp);
+}
+
+static inline void xa_preload_end(void)
+{
+	radix_tree_preload_end();
+}
+
+#endif /* _LINUX_XARRAY_H */
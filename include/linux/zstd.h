@@ -0,0 +1,75 @@
+#ifndef __ZSTD_H__
+#define __ZSTD_H__
+/*
+ * Zstandard Kernel Interface
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+
+#define ZSTD_MIN_CLEVEL		1
+#define ZSTD_DEFAULT_CLEVEL	3
+#define ZSTD_MAX_CLEVEL		9
+
+#define ZSTD_DECOMPRESS_WORKMEM	(10 * 1024)
+
+/*
+ * zstd_compressbound()
+ * Provides the maximum size that zstd may output in a "worst case" scenario
+ * (input data not compressible)
+ */
+static inline size_t zstd_compressbound(size_t isize)
+{
+	return isize + 3 * ((isize >> 17) + 1) + 13;
+}
+
+/*
+ * zstd_compress_workmem_size()
+ *	level	: compression level, ZSTD_MIN_CLEVEL to ZSTD_MAX_CLEVEL
+ *	src_len : largest input that will be compressed with this working
+ *		memory, or 0 if that is not known in advance
+ *	return  : size of the working memory zstd_compress() needs
+ */
+size_t zstd_compress_workmem_size(int level, size_t src_len);
+
+/*
+ * zstd_compress()
+ *	src     : source address of the original data
+ *	src_len : size of the original data
+ *	dst	: output buffer address of the compressed data
+ *	dst_len : is the size of the output buffer, which is returned with
+ *		the output size after compress done. A buffer of
+ *		zstd_compressbound(src_len) bytes is always large enough.
+ *	level	: compression level, ZSTD_MIN_CLEVEL to ZSTD_MAX_CLEVEL
+ *	workmem : address of the working memory.
+ *		This requires 'workmem' of size zstd_compress_workmem_size()
+ *		for the same level and src_len, a larger src_len or 0.
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *	note :  The output is a single zstd frame, which the zstd command
+ *		line tool and library can decompress.
+ */
+int zstd_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, int level, void *wrkmem);
+
+/*
+ * zstd_decompress()
+ *	src     : source address of the compressed data
+ *	src_len : is the input size, therefore the compressed size
+ *	dest	: output buffer address of the decompressed data
+ *	dest_len: is the max size of the destination buffer, which is
+ *			returned with actual size of decompressed data after
+ *			decompress done
+ *	workmem : address of the working memory.
+ *		This requires 'workmem' of size ZSTD_DECOMPRESS_WORKMEM.
+ *	return  : Success if return 0
+ *		  Error if return (< 0)
+ *	note :  Destination buffer must be already allocated. Frames
+ *		using a dictionary are not supported, content checksums
+ *		are not verified.
+ */
+int zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len, void *wrkmem);
+#endif
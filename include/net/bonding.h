@@ -25,6 +25,7 @@
 #include <linux/etherdevice.h>
 #include <linux/reciprocal_div.h>
 #include <linux/if_link.h>
+#include <linux/u64_stats_sync.h>
 
 #include <net/bond_3ad.h>
 #include <net/bond_alb.h>
@@ -190,6 +191,12 @@ struct bond_up_slave {
  */
 #define BOND_LINK_NOCHANGE -1
 
+/* Counted by the bond itself, on top of what its slaves report */
+struct bond_pcpu_stats {
+	u64			tx_dropped;
+	struct u64_stats_sync	syncp;
+};
+
 /*
  * Here are the locking policies for the two bonding locks:
  * Get rcu_read_lock when reading or RTNL when writing slave list.
@@ -219,7 +226,8 @@ struct bonding {
 	char     proc_file_name[IFNAMSIZ];
 #endif /* CONFIG_PROC_FS */
 	struct   list_head bond_list;
-	u32      rr_tx_counter;
+	u32 __percpu *rr_tx_counter;	/* each CPU round-robins on its own */
+	struct   bond_pcpu_stats __percpu *pcpu_stats;
 	struct   ad_bond_info ad_info;
 	struct   alb_bond_info alb_info;
 	struct   bond_params params;
@@ -647,7 +655,12 @@ extern struct rtnl_link_ops bond_link_ops;
 
 static inline void bond_tx_drop(struct net_device *dev, struct sk_buff *skb)
 {
-	atomic_long_inc(&dev->tx_dropped);
+	struct bonding *bond = netdev_priv(dev);
+	struct bond_pcpu_stats *stats = this_cpu_ptr(bond->pcpu_stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	stats->tx_dropped++;
+	u64_stats_update_end(&stats->syncp);
 	dev_kfree_skb_any(skb);
 }
 
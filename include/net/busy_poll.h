@@ -73,13 +73,18 @@ static inline bool busy_loop_timeout(unsigned long end_time)
 }
 
 /* when used in sock_poll() nonblock is known at compile time to be true
- * so the loop and end_time will be optimized out
+ * so the loop and end_time will be optimized out.
+ *
+ * Besides the SO_BUSY_POLL time, a blocking caller stops once it has
+ * polled SO_BUSY_POLL_BUDGET packets, if set.
  */
 static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 {
 	unsigned long end_time = !nonblock ? sk_busy_loop_end_time(sk) : 0;
+	unsigned int budget = ACCESS_ONCE(sk->sk_busy_poll_budget);
 	const struct net_device_ops *ops;
 	struct napi_struct *napi;
+	unsigned int done = 0;
 	int rc = false;
 
 	/*
@@ -102,21 +107,71 @@ static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 		if (rc == LL_FLUSH_FAILED)
 			break; /* permanent failure */
 
-		if (rc > 0)
+		if (rc > 0) {
 			/* local bh are disabled so it is ok to use _BH */
 			NET_ADD_STATS_BH(sock_net(sk),
 					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+			done += rc;
+		}
 		cpu_relax();
 
 	} while (!nonblock && skb_queue_empty(&sk->sk_receive_queue) &&
-		 !need_resched() && !busy_loop_timeout(end_time));
+		 !need_resched() && !busy_loop_timeout(end_time) &&
+		 (!budget || done < budget));
 
 	rc = !skb_queue_empty(&sk->sk_receive_queue);
+	atomic_inc(rc ? &sk->sk_busy_poll_hits : &sk->sk_busy_poll_misses);
 out:
 	rcu_read_unlock_bh();
 	return rc;
 }
 
+/*
+ * Busy poll the NAPI context @napi_id for users that aren't tied to a
+ * single socket, like epoll.  Polls until @loop_end(@arg) says there
+ * is work, @end_time passes or, with a non-zero @budget, that many
+ * packets were processed.  A zero @end_time polls just once.
+ */
+static inline void napi_busy_loop(unsigned int napi_id,
+				  unsigned long end_time, unsigned int budget,
+				  bool (*loop_end)(void *arg), void *arg)
+{
+	const struct net_device_ops *ops;
+	struct napi_struct *napi;
+	unsigned int done = 0;
+	int rc;
+
+	/* see sk_busy_loop() */
+	rcu_read_lock_bh();
+
+	napi = napi_by_id(napi_id);
+	if (!napi)
+		goto out;
+
+	ops = napi->dev->netdev_ops;
+	if (!ops->ndo_busy_poll)
+		goto out;
+
+	do {
+		rc = ops->ndo_busy_poll(napi);
+
+		if (rc == LL_FLUSH_FAILED)
+			break; /* permanent failure */
+
+		if (rc > 0) {
+			NET_ADD_STATS_BH(dev_net(napi->dev),
+					 LINUX_MIB_BUSYPOLLRXPACKETS, rc);
+			done += rc;
+		}
+		cpu_relax();
+
+	} while (end_time && !loop_end(arg) && !need_resched() &&
+		 !signal_pending(current) && !busy_loop_timeout(end_time) &&
+		 (!budget || done < budget));
+out:
+	rcu_read_unlock_bh();
+}
+
 /* used in the NIC receive handler to mark the skb */
 static inline void skb_mark_napi_id(struct sk_buff *skb,
 				    struct napi_struct *napi)
@@ -165,5 +220,11 @@ static inline bool sk_busy_loop(struct sock *sk, int nonblock)
 	return false;
 }
 
+static inline void napi_busy_loop(unsigned int napi_id,
+				  unsigned long end_time, unsigned int budget,
+				  bool (*loop_end)(void *arg), void *arg)
+{
+}
+
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 #endif /* _LINUX_NET_BUSY_POLL_H */
@@ -78,6 +78,11 @@ struct inet_request_sock {
 #define ir_v6_loc_addr		req.__req_common.skc_v6_rcv_saddr
 #define ir_iif			req.__req_common.skc_bound_dev_if
 
+#define ireq_net		req.__req_common.skc_net
+#define ireq_state		req.__req_common.skc_state
+#define ireq_refcnt		req.__req_common.skc_refcnt
+#define ireq_family		req.__req_common.skc_family
+
 	kmemcheck_bitfield_begin(flags);
 	u16			snd_wscale : 4,
 				rcv_wscale : 4,
@@ -120,6 +125,7 @@ struct inet_cork {
 	__u8			ttl;
 	__s16			tos;
 	char			priority;
+	__u16			gso_size;
 };
 
 struct inet_cork_full {
@@ -228,14 +234,50 @@ static inline unsigned int __inet_ehashfn(const __be32 laddr,
 			    initval);
 }
 
-static inline struct request_sock *inet_reqsk_alloc(struct request_sock_ops *ops)
+#if IS_ENABLED(CONFIG_IPV6)
+static inline void __sk_v4mapped_set(struct in6_addr *v6, __be32 addr)
+{
+	v6->s6_addr32[0] = 0;
+	v6->s6_addr32[1] = 0;
+	v6->s6_addr32[2] = htonl(0x0000FFFF);
+	v6->s6_addr32[3] = addr;
+}
+#endif
+
+/* Set the IPv4 addresses of a socket (or request socket) and keep the
+ * v4-mapped IPv6 view in sync, so that an IPv6 socket talking to an IPv4
+ * peer hashes exactly like an IPv4 one.
+ */
+static inline void sk_daddr_set(struct sock *sk, __be32 addr)
+{
+	sk->sk_daddr = addr; /* alias of inet_daddr */
+#if IS_ENABLED(CONFIG_IPV6)
+	__sk_v4mapped_set(&sk->sk_v6_daddr, addr);
+#endif
+}
+
+static inline void sk_rcv_saddr_set(struct sock *sk, __be32 addr)
+{
+	sk->sk_rcv_saddr = addr; /* alias of inet_rcv_saddr */
+#if IS_ENABLED(CONFIG_IPV6)
+	__sk_v4mapped_set(&sk->sk_v6_rcv_saddr, addr);
+#endif
+}
+
+static inline struct request_sock *
+inet_reqsk_alloc(const struct request_sock_ops *ops, struct sock *sk_listener,
+		 bool attach_listener)
 {
-	struct request_sock *req = reqsk_alloc(ops);
+	struct request_sock *req = reqsk_alloc(ops, sk_listener,
+					       attach_listener);
 	struct inet_request_sock *ireq = inet_rsk(req);
 
 	if (req != NULL) {
 		kmemcheck_annotate_bitfield(ireq, flags);
 		ireq->opt = NULL;
+		ireq->ireq_state = TCP_NEW_SYN_RECV;
+		write_pnet(&ireq->ireq_net, sock_net(sk_listener));
+		ireq->ireq_family = sk_listener->sk_family;
 	}
 
 	return req;
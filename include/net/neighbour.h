@@ -209,6 +209,9 @@ struct neigh_table {
 	int			gc_thresh3;
 	unsigned long		last_flush;
 	struct delayed_work	gc_work;
+	struct work_struct	grow_work;
+	unsigned int		gc_bucket;
+	unsigned int		forced_gc_bucket;
 	struct timer_list 	proxy_timer;
 	struct sk_buff_head	proxy_queue;
 	atomic_t		entries;
@@ -0,0 +1,111 @@
+#ifndef _NF_FLOW_TABLE_H
+#define _NF_FLOW_TABLE_H
+
+#include <linux/in.h>
+#include <linux/in6.h>
+#include <linux/netdevice.h>
+#include <linux/netfilter.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <net/dst.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+
+struct nf_conn;
+
+/* Established flows that an nf_tables "flow offload" rule has handed
+ * over. Packets matching one of them are forwarded from the prerouting
+ * hook, bypassing conntrack, the routing lookup and the rest of the
+ * hooks.
+ */
+struct nf_flowtable {
+	struct hlist_head	*hash;
+	unsigned int		htable_size;
+	spinlock_t		lock;	/* writers only, lookups use RCU */
+	struct delayed_work	gc_work;
+};
+
+enum flow_offload_tuple_dir {
+	FLOW_OFFLOAD_DIR_ORIGINAL = IP_CT_DIR_ORIGINAL,
+	FLOW_OFFLOAD_DIR_REPLY = IP_CT_DIR_REPLY,
+	FLOW_OFFLOAD_DIR_MAX = IP_CT_DIR_MAX
+};
+
+struct flow_offload_tuple {
+	union {
+		struct in_addr		src_v4;
+		struct in6_addr		src_v6;
+	};
+	union {
+		struct in_addr		dst_v4;
+		struct in6_addr		dst_v6;
+	};
+	__be16				src_port;
+	__be16				dst_port;
+
+	int				iifidx;
+
+	u8				l3proto;
+	u8				l4proto;
+
+	/* everything from here on is not part of the lookup key */
+	u8				dir;
+
+	u16				mtu;
+	u32				dst_cookie;
+	struct dst_entry		*dst_cache;
+};
+
+#define FLOW_OFFLOAD_KEY_LEN	offsetof(struct flow_offload_tuple, dir)
+
+struct flow_offload_tuple_hash {
+	struct hlist_node		node;
+	struct flow_offload_tuple	tuple;
+};
+
+#define FLOW_OFFLOAD_SNAT	0x1
+#define FLOW_OFFLOAD_DNAT	0x2
+#define FLOW_OFFLOAD_TEARDOWN	0x4
+
+struct flow_offload {
+	struct flow_offload_tuple_hash	tuplehash[FLOW_OFFLOAD_DIR_MAX];
+	struct nf_conn			*ct;
+	u32				flags;
+	u32				timeout;	/* jiffies32 */
+	struct rcu_head			rcu_head;
+};
+
+#define NF_FLOW_TIMEOUT (30 * HZ)
+
+struct nf_flow_route {
+	struct {
+		struct dst_entry	*dst;
+		int			ifindex;
+	} tuple[FLOW_OFFLOAD_DIR_MAX];
+};
+
+struct flow_offload *flow_offload_alloc(struct nf_conn *ct,
+					struct nf_flow_route *route);
+void flow_offload_free(struct flow_offload *flow);
+
+int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow);
+void flow_offload_teardown(struct flow_offload *flow);
+
+struct flow_offload_tuple_hash *
+flow_offload_lookup(struct nf_flowtable *flow_table,
+		    const struct flow_offload_tuple *tuple);
+
+struct nf_flowtable *nf_flow_table_net(const struct net *net);
+
+unsigned int nf_flow_offload_ip_hook(const struct nf_hook_ops *ops,
+				     struct sk_buff *skb,
+				     const struct net_device *in,
+				     const struct net_device *out,
+				     int (*okfn)(struct sk_buff *));
+unsigned int nf_flow_offload_ipv6_hook(const struct nf_hook_ops *ops,
+				       struct sk_buff *skb,
+				       const struct net_device *in,
+				       const struct net_device *out,
+				       int (*okfn)(struct sk_buff *));
+
+#endif /* _NF_FLOW_TABLE_H */
@@ -124,6 +124,7 @@ int nft_validate_data_load(const struct nft_ctx *ctx, enum nft_registers reg,
  *
  *	@cookie: implementation specific element cookie
  *	@key: element key
+ *	@key_end: closing element key (concatenated range sets only)
  *	@data: element data (maps only)
  *	@flags: element flags (end of interval)
  *
@@ -133,6 +134,7 @@ int nft_validate_data_load(const struct nft_ctx *ctx, enum nft_registers reg,
 struct nft_set_elem {
 	void			*cookie;
 	struct nft_data		key;
+	struct nft_data		key_end;
 	struct nft_data		data;
 	u32			flags;
 };
@@ -148,17 +150,23 @@ struct nft_set_iter {
 			      const struct nft_set_elem *elem);
 };
 
+#define NFT_SET_MAXFIELDS	8
+
 /**
  *	struct nft_set_desc - description of set elements
  *
  *	@klen: key length
  *	@dlen: data length
  *	@size: number of set elements
+ *	@field_len: length of each field in a concatenated key, in bytes
+ *	@field_count: number of concatenated fields in the key
  */
 struct nft_set_desc {
 	unsigned int		klen;
 	unsigned int		dlen;
 	unsigned int		size;
+	u8			field_len[NFT_SET_MAXFIELDS];
+	u8			field_count;
 };
 
 /**
@@ -246,6 +254,8 @@ void nft_unregister_set(struct nft_set_ops *ops);
  * 	@flags: set flags
  * 	@klen: key length
  * 	@dlen: data length
+ *	@field_len: length of each concatenated field of the key
+ *	@field_count: number of concatenated fields, 0 or 1 for plain keys
  * 	@data: private set data
  */
 struct nft_set {
@@ -262,6 +272,8 @@ struct nft_set {
 	u16				flags;
 	u8				klen;
 	u8				dlen;
+	u8				field_count;
+	u8				field_len[NFT_SET_MAXFIELDS];
 	unsigned char			data[]
 		__attribute__((aligned(__alignof__(u64))));
 };
@@ -271,6 +283,12 @@ static inline void *nft_set_priv(const struct nft_set *set)
 	return (void *)set->data;
 }
 
+/* Elements of concatenated range sets carry both ends of the range. */
+static inline bool nft_set_has_key_end(const struct nft_set *set)
+{
+	return set->field_count > 1 && set->flags & NFT_SET_INTERVAL;
+}
+
 struct nft_set *nf_tables_set_lookup(const struct nft_table *table,
 				     const struct nlattr *nla);
 struct nft_set *nf_tables_set_lookup_byid(const struct net *net,
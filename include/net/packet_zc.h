@@ -0,0 +1,118 @@
+#ifndef _NET_PACKET_ZC_H
+#define _NET_PACKET_ZC_H
+
+/*
+ * Zero copy AF_PACKET rx, the part a driver sees.
+ *
+ * A packet socket with PACKET_ZC set hands a struct packet_zc to the
+ * driver through ndo_packet_zc().  From then on the driver fills the
+ * hardware rx queue with frames taken from the fill ring, maps them for
+ * DMA itself and reports every received frame with packet_zc_rx(); no
+ * skb is built for them.  All helpers are meant for the queue's NAPI
+ * context and need no locking of their own.
+ */
+
+#include <linux/mm.h>
+#include <linux/if_packet.h>
+#include <net/sock.h>
+
+struct packet_zc {
+	struct page		**pages;	/* the pinned umem */
+	unsigned int		npages;
+	unsigned int		frame_size;
+	u64			umem_len;
+	u32			ring_mask;
+
+	void			*ring_mem;	/* mmap()ed by userspace */
+	size_t			ring_len;
+	struct tpacket_zc_ring	*fill;
+	struct tpacket_zc_ring	*rx;
+	struct tpacket_zc_ring	*tx;
+	struct tpacket_zc_ring	*comp;
+
+	u32			rx_prod;	/* not yet published */
+
+	struct sock		*sk;
+	struct net_device	*dev;
+	u32			queue_id;
+};
+
+static inline void *packet_zc_entries(struct tpacket_zc_ring *ring)
+{
+	return ring + 1;
+}
+
+/**
+ * packet_zc_fill_get - take an empty frame from the fill ring
+ * @zc: zero copy context
+ * @addr: umem offset of the frame
+ *
+ * Offsets outside the umem are skipped, others are rounded down to the
+ * start of their frame.  Returns false if the ring is empty.
+ */
+static inline bool packet_zc_fill_get(struct packet_zc *zc, u64 *addr)
+{
+	struct tpacket_zc_ring *fill = zc->fill;
+	u64 *entries = packet_zc_entries(fill);
+	u32 cons = fill->consumer;
+
+	while (cons != ACCESS_ONCE(fill->producer)) {
+		u64 a;
+
+		smp_rmb();
+		a = entries[cons & zc->ring_mask] & ~(u64)(zc->frame_size - 1);
+		cons++;
+		if (a < zc->umem_len) {
+			smp_store_release(&fill->consumer, cons);
+			*addr = a;
+			return true;
+		}
+	}
+	smp_store_release(&fill->consumer, cons);
+	return false;
+}
+
+static inline struct page *packet_zc_page(struct packet_zc *zc, u64 addr)
+{
+	return zc->pages[addr >> PAGE_SHIFT];
+}
+
+static inline unsigned int packet_zc_offset(struct packet_zc *zc, u64 addr)
+{
+	return addr & ~PAGE_MASK;
+}
+
+/**
+ * packet_zc_rx - report a received frame
+ * @zc: zero copy context
+ * @addr: umem offset of the frame
+ * @len: bytes received
+ *
+ * Returns -ENOBUFS if userspace has not kept up with the rx ring, the
+ * frame then still belongs to the driver.  The entry becomes visible
+ * with packet_zc_rx_flush().
+ */
+static inline int packet_zc_rx(struct packet_zc *zc, u64 addr, u32 len)
+{
+	struct tpacket_zc_desc *desc;
+
+	if (zc->rx_prod - ACCESS_ONCE(zc->rx->consumer) > zc->ring_mask)
+		return -ENOBUFS;
+
+	desc = packet_zc_entries(zc->rx);
+	desc += zc->rx_prod & zc->ring_mask;
+	desc->addr = addr;
+	desc->len = len;
+	zc->rx_prod++;
+	return 0;
+}
+
+static inline void packet_zc_rx_flush(struct packet_zc *zc)
+{
+	if (zc->rx_prod == zc->rx->producer)
+		return;
+	smp_store_release(&zc->rx->producer, zc->rx_prod);
+	zc->sk->sk_data_ready(zc->sk);
+}
+
+#endif /* _NET_PACKET_ZC_H */
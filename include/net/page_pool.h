@@ -0,0 +1,109 @@
+/*
+ * page_pool.h	Page recycling for network driver RX buffers
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * A page_pool hands out pages for one RX queue and takes them back, with
+ * their DMA mapping kept, when the driver or the stack is done with them:
+ *
+ *  - the driver allocates and recycles from its NAPI poll routine, which
+ *    is the only context allowed to touch the pool's alloc cache;
+ *  - skbs built from pool pages are marked with skb_mark_for_recycle(),
+ *    and freeing them on any CPU returns the pages through the pool's
+ *    lock-less recycle ring.
+ *
+ * A page only goes back into the pool when the last reference to it is
+ * dropped through the pool.  If someone else still holds it, the page is
+ * unmapped and leaves the pool for good.
+ *
+ * Pool pages are not on any LRU, so struct page is the pool's to use:
+ * ->lru.next holds PP_SIGNATURE, ->lru.prev links the page on the recycle
+ * ring, ->index points to the owning pool and ->private is the DMA
+ * address.  The signature shares its word with the page allocator's free
+ * list link, so it can't survive a page that left the pool behind our back.
+ *
+ * Recycled pages keep their DMA mapping: syncing them for the device
+ * before reuse is up to the driver.
+ */
+#ifndef _NET_PAGE_POOL_H
+#define _NET_PAGE_POOL_H
+
+#include <linux/mm.h>
+#include <linux/llist.h>
+#include <linux/atomic.h>
+#include <linux/poison.h>
+#include <linux/dma-mapping.h>
+
+#define PP_FLAG_DMA_MAP		1	/* keep pages DMA mapped while pooled */
+#define PP_FLAG_ALL		PP_FLAG_DMA_MAP
+
+#define PP_SIGNATURE		(0x40UL + POISON_POINTER_DELTA)
+
+#define PP_ALLOC_CACHE_SIZE	128
+#define PP_RING_SIZE_MAX	32768
+
+struct page_pool_params {
+	unsigned int		flags;
+	unsigned int		order;
+	unsigned int		pool_size;	/* pages kept on the recycle ring */
+	int			nid;		/* NUMA node to allocate from */
+	struct device		*dev;		/* for PP_FLAG_DMA_MAP */
+	enum dma_data_direction	dma_dir;
+};
+
+struct page_pool {
+	struct page_pool_params	p;
+
+	/* Consumer side, only used from the driver's NAPI context */
+	unsigned int		alloc_count;
+	struct page		*alloc_cache[PP_ALLOC_CACHE_SIZE];
+
+	/* Pages given back from any context */
+	struct llist_head	ring;
+	atomic_t		ring_count;
+
+	/* One reference for the driver plus one per page the pool owns */
+	atomic_t		refcnt;
+	bool			destroyed;
+};
+
+struct page_pool *page_pool_create(const struct page_pool_params *params);
+void page_pool_destroy(struct page_pool *pool);
+
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp);
+
+static inline struct page *page_pool_dev_alloc_pages(struct page_pool *pool)
+{
+	return page_pool_alloc_pages(pool, GFP_ATOMIC | __GFP_NOWARN |
+					   __GFP_COLD);
+}
+
+void page_pool_put_page(struct page_pool *pool, struct page *page,
+			bool allow_direct);
+
+/* Give a page back from the pool's own NAPI context, e.g. on RX error */
+static inline void page_pool_recycle_direct(struct page_pool *pool,
+					    struct page *page)
+{
+	page_pool_put_page(pool, page, true);
+}
+
+/* Take a page out of the pool for good, e.g. before handing it to code
+ * that does not know about page pools.  The caller keeps its reference.
+ */
+void page_pool_release_page(struct page_pool *pool, struct page *page);
+
+static inline dma_addr_t page_pool_get_dma_addr(struct page *page)
+{
+	return (dma_addr_t)page_private(page);
+}
+
+static inline bool page_is_pool_page(const struct page *page)
+{
+	return page->lru.next == (struct list_head *)PP_SIGNATURE;
+}
+
+#endif /* _NET_PAGE_POOL_H */
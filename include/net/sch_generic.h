@@ -27,6 +27,7 @@ enum qdisc_state_t {
 	__QDISC_STATE_SCHED,
 	__QDISC_STATE_DEACTIVATED,
 	__QDISC_STATE_THROTTLED,
+	__QDISC_STATE_MISSED,
 };
 
 /*
@@ -61,6 +62,7 @@ struct Qdisc {
 				      */
 #define TCQ_F_WARN_NONWC	(1 << 16)
 #define TCQ_F_CPUSTATS		0x20 /* run using percpu statistics */
+#define TCQ_F_NOLOCK		0x40 /* qdisc does not require locking */
 	u32			limit;
 	const struct Qdisc_ops	*ops;
 	struct qdisc_size_table	__rcu *stab;
@@ -97,15 +99,39 @@ struct Qdisc {
 	atomic_t		refcnt;
 
 	spinlock_t		busylock ____cacheline_aligned_in_smp;
+	spinlock_t		seqlock;	/* TCQ_F_NOLOCK run owner */
 };
 
-static inline bool qdisc_is_running(const struct Qdisc *qdisc)
+static inline bool qdisc_is_running(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK)
+		return spin_is_locked(&qdisc->seqlock);
 	return (qdisc->__state & __QDISC___STATE_RUNNING) ? true : false;
 }
 
+/*
+ * A TCQ_F_NOLOCK qdisc is not protected by its root lock, so the
+ * dequeue side is serialized by seqlock instead of __state.  A CPU
+ * that enqueued a packet but lost the race for seqlock sets
+ * __QDISC_STATE_MISSED, so the owner reschedules the qdisc rather
+ * than leaving that packet behind.
+ */
 static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		if (!spin_trylock(&qdisc->seqlock)) {
+			set_bit(__QDISC_STATE_MISSED, &qdisc->state);
+			/* paired with smp_mb() in qdisc_run_end() */
+			smp_mb__after_atomic();
+			if (!spin_trylock(&qdisc->seqlock))
+				return false;
+		}
+		if (test_bit(__QDISC_STATE_MISSED, &qdisc->state)) {
+			clear_bit(__QDISC_STATE_MISSED, &qdisc->state);
+			smp_mb__after_atomic();
+		}
+		return true;
+	}
 	if (qdisc_is_running(qdisc))
 		return false;
 	qdisc->__state |= __QDISC___STATE_RUNNING;
@@ -114,6 +140,13 @@ static inline bool qdisc_run_begin(struct Qdisc *qdisc)
 
 static inline void qdisc_run_end(struct Qdisc *qdisc)
 {
+	if (qdisc->flags & TCQ_F_NOLOCK) {
+		spin_unlock(&qdisc->seqlock);
+		smp_mb();
+		if (unlikely(test_bit(__QDISC_STATE_MISSED, &qdisc->state)))
+			__netif_schedule(qdisc);
+		return;
+	}
 	qdisc->__state &= ~__QDISC___STATE_RUNNING;
 }
 
@@ -196,6 +229,7 @@ struct Qdisc_ops {
 	int			(*dump)(struct Qdisc *, struct sk_buff *);
 	int			(*dump_stats)(struct Qdisc *, struct gnet_dump *);
 
+	unsigned int		static_flags;	/* TCQ_F_* set at allocation */
 	struct module		*owner;
 };
 
@@ -251,7 +285,7 @@ struct tcf_proto {
 struct qdisc_skb_cb {
 	unsigned int		pkt_len;
 	u16			slave_dev_queue_mapping;
-	u16			_pad;
+	u16			tc_classid;
 #define QDISC_CB_PRIV_LEN 20
 	unsigned char		data[QDISC_CB_PRIV_LEN];
 };
@@ -269,6 +303,20 @@ static inline int qdisc_qlen(const struct Qdisc *q)
 	return q->q.qlen;
 }
 
+/* Queue length including packets accounted in per-cpu counters */
+static inline int qdisc_qlen_sum(const struct Qdisc *q)
+{
+	__u32 qlen = q->q.qlen;
+	int i;
+
+	if (q->flags & TCQ_F_CPUSTATS) {
+		for_each_possible_cpu(i)
+			qlen += per_cpu_ptr(q->cpu_qstats, i)->qlen;
+	}
+
+	return qlen;
+}
+
 static inline struct qdisc_skb_cb *qdisc_skb_cb(const struct sk_buff *skb)
 {
 	return (struct qdisc_skb_cb *)skb->cb;
@@ -410,9 +458,16 @@ static inline void qdisc_reset_all_tx_gt(struct net_device *dev, unsigned int i)
 	for (; i < dev->num_tx_queues; i++) {
 		qdisc = rtnl_dereference(netdev_get_tx_queue(dev, i)->qdisc);
 		if (qdisc) {
+			bool nolock = qdisc->flags & TCQ_F_NOLOCK;
+
+			/* seqlock keeps a lockless qdisc's dequeue side out */
+			if (nolock)
+				spin_lock_bh(&qdisc->seqlock);
 			spin_lock_bh(qdisc_lock(qdisc));
 			qdisc_reset(qdisc);
 			spin_unlock_bh(qdisc_lock(qdisc));
+			if (nolock)
+				spin_unlock_bh(&qdisc->seqlock);
 		}
 	}
 }
@@ -432,7 +487,7 @@ static inline bool qdisc_all_tx_empty(const struct net_device *dev)
 		struct netdev_queue *txq = netdev_get_tx_queue(dev, i);
 		const struct Qdisc *q = rcu_dereference(txq->qdisc);
 
-		if (q->q.qlen) {
+		if (qdisc_qlen_sum(q)) {
 			rcu_read_unlock();
 			return false;
 		}
@@ -565,6 +620,33 @@ static inline void qdisc_qstats_drop_cpu(struct Qdisc *sch)
 	qstats->drops++;
 }
 
+static inline void qdisc_qstats_cpu_backlog_inc(struct Qdisc *sch,
+						unsigned int len)
+{
+	this_cpu_add(sch->cpu_qstats->backlog, len);
+}
+
+static inline void qdisc_qstats_cpu_backlog_dec(struct Qdisc *sch,
+						const struct sk_buff *skb)
+{
+	this_cpu_sub(sch->cpu_qstats->backlog, qdisc_pkt_len(skb));
+}
+
+static inline void qdisc_qstats_cpu_qlen_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_qlen_dec(struct Qdisc *sch)
+{
+	this_cpu_dec(sch->cpu_qstats->qlen);
+}
+
+static inline void qdisc_qstats_cpu_requeues_inc(struct Qdisc *sch)
+{
+	this_cpu_inc(sch->cpu_qstats->requeues);
+}
+
 static inline void qdisc_qstats_overlimit(struct Qdisc *sch)
 {
 	sch->qstats.overlimits++;
@@ -715,6 +797,14 @@ static inline int qdisc_drop(struct sk_buff *skb, struct Qdisc *sch)
 	return NET_XMIT_DROP;
 }
 
+static inline int qdisc_drop_cpu(struct sk_buff *skb, struct Qdisc *sch)
+{
+	kfree_skb(skb);
+	qdisc_qstats_drop_cpu(sch);
+
+	return NET_XMIT_DROP;
+}
+
 static inline int qdisc_reshape_fail(struct sk_buff *skb, struct Qdisc *sch)
 {
 	qdisc_qstats_drop(sch);
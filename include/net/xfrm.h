@@ -521,12 +521,16 @@ struct xfrm_policy_queue {
 	unsigned long		timeout;
 };
 
+struct xfrm_pol_inexact_bin;
+
 struct xfrm_policy {
 #ifdef CONFIG_NET_NS
 	struct net		*xp_net;
 #endif
 	struct hlist_node	bydst;
 	struct hlist_node	byidx;
+	/* Inexact bin whose table holds bydst, if any */
+	struct xfrm_pol_inexact_bin *bin;
 
 	/* This lock only affects elements except for entry. */
 	rwlock_t		lock;
@@ -537,6 +541,8 @@ struct xfrm_policy {
 	atomic_t		genid;
 	u32			priority;
 	u32			index;
+	/* Insertion order, breaks priority ties between inexact bins */
+	u32			pos;
 	struct xfrm_mark	mark;
 	struct xfrm_selector	selector;
 	struct xfrm_lifetime_cfg lft;
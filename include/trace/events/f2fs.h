@@ -916,12 +916,14 @@ TRACE_EVENT(f2fs_writepages,
 		__entry->for_sync)
 );
 
-TRACE_EVENT(f2fs_submit_page_mbio,
+TRACE_EVENT_CONDITION(f2fs_submit_page_mbio,
 
 	TP_PROTO(struct page *page, int rw, int type, block_t blk_addr),
 
 	TP_ARGS(page, rw, type, blk_addr),
 
+	TP_CONDITION(page->mapping),
+
 	TP_STRUCT__entry(
 		__field(dev_t,	dev)
 		__field(ino_t,	ino)
@@ -709,9 +709,17 @@ __SYSCALL(__NR_memfd_create, sys_memfd_create)
 __SYSCALL(__NR_bpf, sys_bpf)
 #define __NR_execveat 281
 __SC_COMP(__NR_execveat, sys_execveat, compat_sys_execveat)
+#define __NR_getdents_stat 282
+__SYSCALL(__NR_getdents_stat, sys_getdents_stat)
+#define __NR_io_uring_setup 283
+__SYSCALL(__NR_io_uring_setup, sys_io_uring_setup)
+#define __NR_io_uring_enter 284
+__SYSCALL(__NR_io_uring_enter, sys_io_uring_enter)
+#define __NR_rseq 285
+__SYSCALL(__NR_rseq, sys_rseq)
 
 #undef __NR_syscalls
-#define __NR_syscalls 282
+#define __NR_syscalls 286
 
 /*
  * All syscalls below here should go away really,
@@ -77,6 +77,8 @@ enum bpf_cmd {
 	 * Using attr->map_fd, attr->key, attr->value
 	 * returns zero and stores found elem into value
 	 * or negative error
+	 * for per-cpu maps value receives one round_up(value_size, 8)
+	 * slot per possible cpu
 	 */
 	BPF_MAP_LOOKUP_ELEM,
 
@@ -84,6 +86,7 @@ enum bpf_cmd {
 	 * err = bpf(BPF_MAP_UPDATE_ELEM, union bpf_attr *attr, u32 size)
 	 * Using attr->map_fd, attr->key, attr->value, attr->flags
 	 * returns zero or negative error
+	 * for per-cpu maps value is laid out as for BPF_MAP_LOOKUP_ELEM
 	 */
 	BPF_MAP_UPDATE_ELEM,
 
@@ -107,17 +110,41 @@ enum bpf_cmd {
 	 * returns fd or negative error
 	 */
 	BPF_PROG_LOAD,
+
+	/* attach a program to an object, or detach the current one
+	 * err = bpf(BPF_PROG_ATTACH, union bpf_attr *attr, u32 size)
+	 * err = bpf(BPF_PROG_DETACH, union bpf_attr *attr, u32 size)
+	 * Using attr->target_fd, attr->attach_bpf_fd, attr->attach_type
+	 * returns zero or negative error
+	 */
+	BPF_PROG_ATTACH,
+	BPF_PROG_DETACH,
 };
 
 enum bpf_map_type {
 	BPF_MAP_TYPE_UNSPEC,
 	BPF_MAP_TYPE_HASH,
 	BPF_MAP_TYPE_ARRAY,
+	BPF_MAP_TYPE_PERCPU_HASH,
+	BPF_MAP_TYPE_PERCPU_ARRAY,
+	BPF_MAP_TYPE_LRU_HASH,
+	BPF_MAP_TYPE_PROG_ARRAY,
+	BPF_MAP_TYPE_SOCKMAP,
 };
 
 enum bpf_prog_type {
 	BPF_PROG_TYPE_UNSPEC,
 	BPF_PROG_TYPE_SOCKET_FILTER,
+	BPF_PROG_TYPE_XDP,
+	BPF_PROG_TYPE_SCHED_CLS,
+	BPF_PROG_TYPE_KPROBE,
+	BPF_PROG_TYPE_TRACEPOINT,
+	BPF_PROG_TYPE_SK_SKB,
+};
+
+enum bpf_attach_type {
+	BPF_SK_SKB_STREAM_VERDICT,	/* target is a BPF_MAP_TYPE_SOCKMAP */
+	__MAX_BPF_ATTACH_TYPE
 };
 
 /* flags for BPF_MAP_UPDATE_ELEM command */
@@ -151,6 +178,13 @@ union bpf_attr {
 		__u32		log_level;	/* verbosity level of verifier */
 		__u32		log_size;	/* size of user buffer */
 		__aligned_u64	log_buf;	/* user supplied buffer */
+		__u32		kern_version;	/* checked when prog_type=kprobe */
+	};
+
+	struct { /* anonymous struct used by BPF_PROG_ATTACH/DETACH commands */
+		__u32		target_fd;	/* container object to attach to */
+		__u32		attach_bpf_fd;	/* eBPF program to attach */
+		__u32		attach_type;	/* one of enum bpf_attach_type */
 	};
 } __attribute__((aligned(8)));
 
@@ -162,7 +196,79 @@ enum bpf_func_id {
 	BPF_FUNC_map_lookup_elem, /* void *map_lookup_elem(&map, &key) */
 	BPF_FUNC_map_update_elem, /* int map_update_elem(&map, &key, &value, flags) */
 	BPF_FUNC_map_delete_elem, /* int map_delete_elem(&map, &key) */
+	BPF_FUNC_xdp_load_bytes,  /* int xdp_load_bytes(ctx, off, &buf, len) */
+	BPF_FUNC_xdp_store_bytes, /* int xdp_store_bytes(ctx, off, &buf, len) */
+	BPF_FUNC_skb_store_bytes, /* int skb_store_bytes(skb, off, &buf, len, flags) */
+	BPF_FUNC_l3_csum_replace, /* int l3_csum_replace(skb, off, from, to, flags) */
+	BPF_FUNC_l4_csum_replace, /* int l4_csum_replace(skb, off, from, to, flags) */
+	BPF_FUNC_clone_redirect,  /* int clone_redirect(skb, ifindex, flags) */
+	BPF_FUNC_tail_call,       /* void tail_call(ctx, &prog_array_map, index), only returns on failure */
+	BPF_FUNC_probe_read,      /* int probe_read(&buf, size, unsafe_ptr) */
+	BPF_FUNC_ktime_get_ns,    /* u64 ktime_get_ns(void), monotonic clock */
+	BPF_FUNC_trace_printk,    /* int trace_printk(&fmt, fmt_size, ...), up to 3 args */
+	BPF_FUNC_get_smp_processor_id, /* u32 get_smp_processor_id(void) */
+	BPF_FUNC_sk_redirect_map, /* int sk_redirect_map(skb, &sockmap, key, flags), returns SK_PASS or SK_DROP */
 	__BPF_FUNC_MAX_ID,
 };
 
+/* skb_store_bytes() flags: fix up skb->csum for the rewritten bytes */
+#define BPF_F_RECOMPUTE_CSUM		(1ULL << 0)
+
+/* l3/l4_csum_replace() flags: size of the changed header field (2 or 4),
+ * and for l4 whether the field is part of the pseudo header
+ */
+#define BPF_F_HDR_FIELD_MASK		0xfULL
+#define BPF_F_PSEUDO_HDR		(1ULL << 4)
+
+/* clone_redirect() flags: receive the copy on the device, not transmit */
+#define BPF_F_INGRESS			(1ULL << 0)
+
+/* user accessible mirror of in-kernel sk_buff.
+ * new fields can only be added to the end of this structure
+ */
+struct __sk_buff {
+	__u32 len;
+	__u32 pkt_type;
+	__u32 mark;
+	__u32 queue_mapping;
+	__u32 protocol;
+	__u32 vlan_present;
+	__u32 vlan_tci;
+	__u32 vlan_proto;
+	__u32 priority;
+	__u32 ingress_ifindex;
+	__u32 ifindex;
+	__u32 tc_index;
+	__u32 cb[5];
+	__u32 hash;
+	__u32 tc_classid;
+};
+
+/* BPF_PROG_TYPE_XDP programs run in the driver on a received frame before
+ * an skb exists for it, and return one of these
+ */
+enum xdp_action {
+	XDP_ABORTED = 0,	/* program error, frame is dropped */
+	XDP_DROP,
+	XDP_PASS,		/* continue with the normal receive path */
+	XDP_TX,			/* send the (possibly rewritten) frame back out */
+};
+
+/* user visible part of the context of BPF_PROG_TYPE_XDP programs, the
+ * frame itself is reached through bpf_xdp_load/store_bytes()
+ */
+struct xdp_md {
+	__u32	len;
+};
+
+/* BPF_PROG_TYPE_SK_SKB programs run on the data of a TCP socket in a
+ * sockmap as it arrives, and return one of these. Data the program does
+ * not redirect with bpf_sk_redirect_map() is dropped, it never reaches
+ * the socket's owner.
+ */
+enum sk_action {
+	SK_DROP = 0,
+	SK_PASS,
+};
+
 #endif /* _UAPI__LINUX_BPF_H__ */
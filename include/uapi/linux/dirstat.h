@@ -0,0 +1,55 @@
+#ifndef _UAPI_LINUX_DIRSTAT_H
+#define _UAPI_LINUX_DIRSTAT_H
+
+#include <linux/types.h>
+
+/*
+ * getdents_stat() returns directory entries together with the
+ * attributes of the inodes they name.  The mask passed in selects
+ * the attributes wanted; ds_mask tells which ones could be filled in
+ * for an entry (none if it disappeared before it could be looked up).
+ */
+#define DIRSTAT_MODE		0x00000001U
+#define DIRSTAT_NLINK		0x00000002U
+#define DIRSTAT_UID		0x00000004U
+#define DIRSTAT_GID		0x00000008U
+#define DIRSTAT_DEV		0x00000010U
+#define DIRSTAT_RDEV		0x00000020U
+#define DIRSTAT_SIZE		0x00000040U
+#define DIRSTAT_BLOCKS		0x00000080U
+#define DIRSTAT_BLKSIZE		0x00000100U
+#define DIRSTAT_ATIME		0x00000200U
+#define DIRSTAT_MTIME		0x00000400U
+#define DIRSTAT_CTIME		0x00000800U
+#define DIRSTAT_ALL		0x00000fffU
+
+struct dirstat_timestamp {
+	__s64	tv_sec;
+	__u32	tv_nsec;
+	__u32	__reserved;
+};
+
+struct linux_dirent_stat {
+	__u64	d_ino;
+	__s64	d_off;
+	__u16	d_reclen;
+	__u8	d_type;
+	__u8	__pad0;
+	__u32	ds_mask;		/* DIRSTAT_* fields filled in */
+	__u32	ds_mode;
+	__u32	ds_nlink;
+	__u32	ds_uid;
+	__u32	ds_gid;
+	__u64	ds_dev;
+	__u64	ds_rdev;
+	__u64	ds_size;
+	__u64	ds_blocks;		/* in 512-byte units */
+	__u32	ds_blksize;
+	__u32	__pad1;
+	struct dirstat_timestamp ds_atime;
+	struct dirstat_timestamp ds_mtime;
+	struct dirstat_timestamp ds_ctime;
+	char	d_name[0];
+};
+
+#endif /* _UAPI_LINUX_DIRSTAT_H */
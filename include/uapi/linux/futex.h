@@ -20,6 +20,7 @@
 #define FUTEX_WAKE_BITSET	10
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
+#define FUTEX_WAIT_MULTIPLE	13
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -39,6 +40,22 @@
 					 FUTEX_PRIVATE_FLAG)
 #define FUTEX_CMP_REQUEUE_PI_PRIVATE	(FUTEX_CMP_REQUEUE_PI | \
 					 FUTEX_PRIVATE_FLAG)
+#define FUTEX_WAIT_MULTIPLE_PRIVATE	(FUTEX_WAIT_MULTIPLE | \
+					 FUTEX_PRIVATE_FLAG)
+
+/*
+ * FUTEX_WAIT_MULTIPLE: uaddr points to an array of val of these, at most
+ * FUTEX_MULTIPLE_MAX_COUNT.  The caller sleeps until any of the futexes is
+ * woken, and the index of that one is returned; as with FUTEX_WAIT, the
+ * timeout is relative.  Wakers use FUTEX_WAKE or FUTEX_WAKE_BITSET as usual.
+ */
+struct futex_wait_block {
+	__u32 __user *uaddr;
+	__u32 val;
+	__u32 bitset;
+};
+
+#define FUTEX_MULTIPLE_MAX_COUNT	128
 
 /*
  * Support for robust futexes: the kernel cleans up held futexes at
@@ -54,6 +54,7 @@ struct sockaddr_ll {
 #define PACKET_FANOUT			18
 #define PACKET_TX_HAS_OFF		19
 #define PACKET_QDISC_BYPASS		20
+#define PACKET_ZC			21
 
 #define PACKET_FANOUT_HASH		0
 #define PACKET_FANOUT_LB		1
@@ -275,6 +276,51 @@ union tpacket_req_u {
 	struct tpacket_req3	req3;
 };
 
+/*
+ * PACKET_ZC: zero copy rx from one hardware queue of the bound device.
+ *
+ * The umem, a page aligned user buffer, is cut into frames of frame_size
+ * bytes that are addressed by their offset in it.  Userspace hands empty
+ * frames to the driver through the fill ring and the driver DMAs received
+ * frames straight into them, reporting each in the rx ring.  Frames to send
+ * are queued in the tx ring and transmitted by sendmsg(); once a frame may
+ * be reused its offset shows up in the completion ring.
+ *
+ * The four rings, each a struct tpacket_zc_ring followed by ring_entries
+ * entries, are mmap()ed from the socket at the offsets getsockopt(PACKET_ZC)
+ * returns.
+ */
+struct tpacket_zc_req {
+	__u64	umem_addr;
+	__u64	umem_len;
+	__u32	frame_size;	/* power of two, 2048 up to the page size */
+	__u32	ring_entries;	/* power of two */
+	__u32	queue_id;
+	__u32	resv;
+};
+
+struct tpacket_zc_ring {
+	__u32	producer;
+	__u32	pad1[15];
+	__u32	consumer;
+	__u32	pad2[15];
+};
+
+/* rx and tx ring entries; fill and completion entries are bare __u64 */
+struct tpacket_zc_desc {
+	__u64	addr;
+	__u32	len;
+	__u32	resv;
+};
+
+struct tpacket_zc_offsets {
+	__u64	fill;
+	__u64	rx;
+	__u64	tx;
+	__u64	completion;
+	__u64	mmap_len;
+};
+
 struct packet_mreq {
 	int		mr_ifindex;
 	unsigned short	mr_type;
@@ -50,6 +50,8 @@
 #define TUNGETFILTER _IOR('T', 219, struct sock_fprog)
 #define TUNSETVNETLE _IOW('T', 220, int)
 #define TUNGETVNETLE _IOR('T', 221, int)
+#define TUNSENDBATCH _IOW('T', 222, struct tun_batch)
+#define TUNRECVBATCH _IOW('T', 223, struct tun_batch)
 
 /* TUNSETIFF ifr flags */
 #define IFF_TUN		0x0001
@@ -83,6 +85,28 @@ struct tun_pi {
 	__be16 proto;
 };
 
+/*
+ * Batched packet I/O (TUNSENDBATCH / TUNRECVBATCH).
+ * Each tun_batch_pkt describes one packet buffer, laid out exactly as for
+ * write() and read().  On TUNRECVBATCH the kernel stores the length of
+ * each packet read in len; a value larger than the buffer means the
+ * packet was truncated.  The ioctl returns the number of packets handled,
+ * or an error if the first one failed.  Only the first packet of a
+ * TUNRECVBATCH may block.
+ */
+#define TUN_BATCH_MAX	1024
+struct tun_batch_pkt {
+	__u64	buf;	/* user pointer to the packet buffer */
+	__u32	len;
+	__u32	reserved;
+};
+
+struct tun_batch {
+	__u64	pkts;	/* user pointer to struct tun_batch_pkt[count] */
+	__u32	count;
+	__u32	flags;	/* must be zero */
+};
+
 /*
  * Filter spec (used for SETXXFILTER ioctls)
  * This stuff is applicable only to the TAP (Ethernet) devices.
@@ -111,9 +111,10 @@ enum {
 	INET_DIAG_SKMEMINFO,
 	INET_DIAG_SHUTDOWN,
 	INET_DIAG_DCTCPINFO,
+	INET_DIAG_BUSYPOLL,	/* u32[SK_BUSY_POLL_VARS], if busy polling */
 };
 
-#define INET_DIAG_MAX INET_DIAG_DCTCPINFO
+#define INET_DIAG_MAX INET_DIAG_BUSYPOLL
 
 /* INET_DIAG_MEM */
 
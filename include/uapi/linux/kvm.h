@@ -172,6 +172,7 @@ struct kvm_pit_config {
 #define KVM_EXIT_S390_TSCH        22
 #define KVM_EXIT_EPR              23
 #define KVM_EXIT_SYSTEM_EVENT     24
+#define KVM_EXIT_DIRTY_RING_FULL  25
 
 /* For KVM_EXIT_INTERNAL_ERROR */
 /* Emulate instruction failed. */
@@ -381,6 +382,22 @@ struct kvm_dirty_log {
 	};
 };
 
+/*
+ * Entry of a vCPU dirty ring, mmap'ed at KVM_DIRTY_LOG_PAGE_OFFSET of
+ * the vCPU fd.  KVM sets KVM_DIRTY_GFN_F_DIRTY once slot and offset are
+ * valid; userspace sets KVM_DIRTY_GFN_F_RESET after collecting the
+ * frame, and KVM_RESET_DIRTY_RINGS hands such entries back to KVM.
+ */
+#define KVM_DIRTY_GFN_F_DIRTY	(1 << 0)
+#define KVM_DIRTY_GFN_F_RESET	(1 << 1)
+#define KVM_DIRTY_GFN_F_MASK	0x3
+
+struct kvm_dirty_gfn {
+	__u32 flags;
+	__u32 slot;	/* memory slot id */
+	__u64 offset;	/* frame offset in the slot */
+};
+
 /* for KVM_SET_SIGNAL_MASK */
 struct kvm_signal_mask {
 	__u32 len;
@@ -753,6 +770,7 @@ struct kvm_ppc_smmu_info {
 #define KVM_CAP_PPC_FIXUP_HCALL 103
 #define KVM_CAP_PPC_ENABLE_HCALL 104
 #define KVM_CAP_CHECK_EXTENSION_VM 105
+#define KVM_CAP_DIRTY_LOG_RING 106
 
 #ifdef KVM_CAP_IRQ_ROUTING
 
@@ -1044,6 +1062,8 @@ struct kvm_s390_ucas_mapping {
 #define KVM_ARM_SET_DEVICE_ADDR	  _IOW(KVMIO,  0xab, struct kvm_arm_device_addr)
 /* Available with KVM_CAP_PPC_RTAS */
 #define KVM_PPC_RTAS_DEFINE_TOKEN _IOW(KVMIO,  0xac, struct kvm_rtas_token_args)
+/* Available with KVM_CAP_DIRTY_LOG_RING */
+#define KVM_RESET_DIRTY_RINGS	  _IO(KVMIO,   0xc7)
 
 /* ioctl for vm fd */
 #define KVM_CREATE_DEVICE	  _IOWR(KVMIO,  0xe0, struct kvm_create_device)
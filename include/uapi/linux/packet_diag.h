@@ -18,6 +18,7 @@ struct packet_diag_req {
 #define PACKET_SHOW_FANOUT	0x00000008
 #define PACKET_SHOW_MEMINFO	0x00000010
 #define PACKET_SHOW_FILTER	0x00000020
+#define PACKET_SHOW_BUSYPOLL	0x00000040
 
 struct packet_diag_msg {
 	__u8	pdiag_family;
@@ -38,6 +39,7 @@ enum {
 	PACKET_DIAG_UID,
 	PACKET_DIAG_MEMINFO,
 	PACKET_DIAG_FILTER,
+	PACKET_DIAG_BUSYPOLL,	/* u32[SK_BUSY_POLL_VARS] */
 
 	__PACKET_DIAG_MAX,
 };
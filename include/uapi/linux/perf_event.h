@@ -349,6 +349,17 @@ struct perf_event_attr {
 
 #define perf_flags(attr)	(*(&(attr)->read_format + 1))
 
+/*
+ * Argument of PERF_EVENT_IOC_READ_CGROUP: the count the event has
+ * accumulated for the cgroup behind @cgroup_fd, which must have been
+ * attached with PERF_EVENT_IOC_ATTACH_CGROUP.
+ */
+struct perf_event_cgroup_count {
+	__u32	cgroup_fd;
+	__u32	__reserved;
+	__u64	count;
+};
+
 /*
  * Ioctls that can be done on a perf event fd:
  */
@@ -360,6 +371,9 @@ struct perf_event_attr {
 #define PERF_EVENT_IOC_SET_OUTPUT	_IO ('$', 5)
 #define PERF_EVENT_IOC_SET_FILTER	_IOW('$', 6, char *)
 #define PERF_EVENT_IOC_ID		_IOR('$', 7, __u64 *)
+#define PERF_EVENT_IOC_SET_BPF		_IOW('$', 8, __u32)
+#define PERF_EVENT_IOC_ATTACH_CGROUP	_IOW('$', 9, __u32)
+#define PERF_EVENT_IOC_READ_CGROUP	_IOWR('$', 10, struct perf_event_cgroup_count)
 
 enum perf_event_ioc_flags {
 	PERF_IOC_FLAG_GROUP		= 1U << 0,
@@ -397,11 +397,17 @@ enum {
 	TCA_BPF_CLASSID,
 	TCA_BPF_OPS_LEN,
 	TCA_BPF_OPS,
+	TCA_BPF_FD,
+	TCA_BPF_NAME,
+	TCA_BPF_FLAGS,
 	__TCA_BPF_MAX,
 };
 
 #define TCA_BPF_MAX (__TCA_BPF_MAX - 1)
 
+/* program return code is the tc action, tc_classid holds the class */
+#define TCA_BPF_FLAG_ACT_DIRECT		(1 << 0)
+
 /* Extended Matches */
 
 struct tcf_ematch_tree_hdr {
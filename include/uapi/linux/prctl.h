@@ -185,4 +185,14 @@ struct prctl_mm_map {
 #define PR_MPX_ENABLE_MANAGEMENT  43
 #define PR_MPX_DISABLE_MANAGEMENT 44
 
+/*
+ * Hash this process's PROCESS_PRIVATE futexes into a table of its own,
+ * allocated on the current NUMA node.  ENABLE takes the number of threads
+ * expected (0 for one per online CPU) and must be called while single
+ * threaded; GET_SLOTS returns the table size, 0 if the global one is used.
+ */
+#define PR_FUTEX_HASH		45
+# define PR_FUTEX_HASH_ENABLE		1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+
 #endif /* _LINUX_PRCTL_H */
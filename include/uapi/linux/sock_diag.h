@@ -23,4 +23,14 @@ enum {
 	SK_MEMINFO_VARS,
 };
 
+/* u32 array, indexed by these */
+enum {
+	SK_BUSY_POLL_USEC,
+	SK_BUSY_POLL_BUDGET,
+	SK_BUSY_POLL_HITS,
+	SK_BUSY_POLL_MISSES,
+
+	SK_BUSY_POLL_VARS,
+};
+
 #endif /* _UAPI__SOCK_DIAG_H__ */
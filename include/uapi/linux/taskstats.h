@@ -200,11 +200,25 @@ enum {
 	TASKSTATS_CMD_ATTR_TGID,
 	TASKSTATS_CMD_ATTR_REGISTER_CPUMASK,
 	TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK,
+	TASKSTATS_CMD_ATTR_PID_LIST,	/* array of u32 pids, for dumps */
+	TASKSTATS_CMD_ATTR_CGROUP_FD,	/* cgroup directory fd, for dumps */
+	TASKSTATS_CMD_ATTR_FIELDS,	/* u32 mask of TASKSTATS_FIELD_* */
 	__TASKSTATS_CMD_ATTR_MAX,
 };
 
 #define TASKSTATS_CMD_ATTR_MAX (__TASKSTATS_CMD_ATTR_MAX - 1)
 
+/*
+ * Groups of struct taskstats fields filled in for a dump.  Fields of
+ * groups that weren't asked for are left zero.
+ */
+#define TASKSTATS_FIELD_BASIC	(1U << 0)	/* ac_* ids, times, faults */
+#define TASKSTATS_FIELD_CSW	(1U << 1)	/* nvcsw, nivcsw */
+#define TASKSTATS_FIELD_DELAY	(1U << 2)	/* delay accounting */
+#define TASKSTATS_FIELD_XACCT	(1U << 3)	/* memory and I/O accounting */
+#define TASKSTATS_FIELD_ALL	(TASKSTATS_FIELD_BASIC | TASKSTATS_FIELD_CSW | \
+				 TASKSTATS_FIELD_DELAY | TASKSTATS_FIELD_XACCT)
+
 /* NETLINK_GENERIC related info */
 
 #define TASKSTATS_GENL_NAME	"TASKSTATS"
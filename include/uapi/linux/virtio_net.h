@@ -55,6 +55,8 @@
 #define VIRTIO_NET_F_MQ	22	/* Device supports Receive Flow
 					 * Steering */
 #define VIRTIO_NET_F_CTRL_MAC_ADDR 23	/* Set MAC address */
+#define VIRTIO_NET_F_RSS	60	/* Guest programs receive side
+					 * scaling */
 
 #define VIRTIO_NET_S_LINK_UP	1	/* Link is up */
 #define VIRTIO_NET_S_ANNOUNCE	2	/* Announcement is needed */
@@ -69,8 +71,29 @@ struct virtio_net_config {
 	 * Legal values are between 1 and 0x8000
 	 */
 	__u16 max_virtqueue_pairs;
+	/* Default maximum transmit unit advice */
+	__u16 mtu;
+	/* Link speed in Mb/s and duplex, if the device reports them */
+	__u32 speed;
+	__u8 duplex;
+	/* Largest hash key and indirection table the device takes, and the
+	 * VIRTIO_NET_RSS_HASH_TYPE_* it can hash on; see VIRTIO_NET_F_RSS.
+	 */
+	__u8 rss_max_key_size;
+	__u16 rss_max_indirection_table_length;
+	__u32 supported_hash_types;
 } __attribute__((packed));
 
+#define VIRTIO_NET_RSS_HASH_TYPE_IPv4		(1 << 0)
+#define VIRTIO_NET_RSS_HASH_TYPE_TCPv4		(1 << 1)
+#define VIRTIO_NET_RSS_HASH_TYPE_UDPv4		(1 << 2)
+#define VIRTIO_NET_RSS_HASH_TYPE_IPv6		(1 << 3)
+#define VIRTIO_NET_RSS_HASH_TYPE_TCPv6		(1 << 4)
+#define VIRTIO_NET_RSS_HASH_TYPE_UDPv6		(1 << 5)
+#define VIRTIO_NET_RSS_HASH_TYPE_IP_EX		(1 << 6)
+#define VIRTIO_NET_RSS_HASH_TYPE_TCP_EX		(1 << 7)
+#define VIRTIO_NET_RSS_HASH_TYPE_UDP_EX		(1 << 8)
+
 /* This header comes first in the scatter-gather list.
  * If VIRTIO_F_ANY_LAYOUT is not negotiated, it must
  * be the first element of the scatter-gather list.  If you don't
@@ -202,4 +225,30 @@ struct virtio_net_ctrl_mq {
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN        1
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MAX        0x8000
 
+/*
+ * Control Receive Side Scaling
+ *
+ * With VIRTIO_NET_F_RSS, the command VIRTIO_NET_CTRL_MQ_RSS_CONFIG replaces
+ * VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET: the device hashes the packet types in
+ * hash_types with the given key (Toeplitz) and looks the receive queue up in
+ * indirection_table, whose size is indirection_table_mask + 1, a power of
+ * two.  Packets it can't hash go to unclassified_queue.  The driver
+ * transmits on the first max_tx_vq transmit queues only.
+ *
+ * indirection_table is followed by max_tx_vq, hash_key_length and the key
+ * itself, so the command is built as one variable sized out sg entry.  The
+ * feature requires VIRTIO_F_VERSION_1, hence little endian fields.
+ */
+struct virtio_net_rss_config {
+	__le32 hash_types;
+	__le16 indirection_table_mask;
+	__le16 unclassified_queue;
+	__le16 indirection_table[1/* + indirection_table_mask */];
+	__le16 max_tx_vq;
+	__u8 hash_key_length;
+	__u8 hash_key_data[/* hash_key_length */];
+};
+
+ #define VIRTIO_NET_CTRL_MQ_RSS_CONFIG          1
+
 #endif /* _LINUX_VIRTIO_NET_H */
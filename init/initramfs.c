@@ -18,6 +18,10 @@
 #include <linux/dirent.h>
 #include <linux/syscalls.h>
 #include <linux/utime.h>
+#include <linux/async.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
 
 static ssize_t __init xwrite(int fd, const char *p, size_t count)
 {
@@ -446,6 +450,144 @@ static unsigned long my_inptr; /* index of next byte to be processed in inbuf */
 
 #include <linux/decompress/generic.h>
 
+/*
+ * With more than one cpu, a compressed segment is decompressed by a
+ * helper thread while the caller extracts the cpio entries already
+ * produced, so decompression and filesystem population overlap. The
+ * decompressor reuses its output window after each flush, hence the
+ * output is copied into a bounded queue of chunks.
+ */
+#define UNPACK_MAX_QUEUED	64
+
+struct unpack_chunk {
+	struct list_head	list;
+	unsigned long		len;	/* 0 marks the end of the segment */
+	char			data[];
+};
+
+struct decompress_job {
+	decompress_fn		decompress;
+	char			*buf;
+	unsigned long		len;
+	int			res;
+};
+
+static __initdata LIST_HEAD(unpack_chunks);
+static __initdata unsigned int unpack_queued;
+static DEFINE_SPINLOCK(unpack_lock);
+static DECLARE_WAIT_QUEUE_HEAD(unpack_wait);
+
+static void __init queue_chunk(struct unpack_chunk *chunk)
+{
+	spin_lock(&unpack_lock);
+	list_add_tail(&chunk->list, &unpack_chunks);
+	unpack_queued++;
+	spin_unlock(&unpack_lock);
+	wake_up(&unpack_wait);
+}
+
+static bool __init unpack_queue_has_room(void)
+{
+	bool ret;
+
+	spin_lock(&unpack_lock);
+	ret = unpack_queued < UNPACK_MAX_QUEUED;
+	spin_unlock(&unpack_lock);
+	return ret;
+}
+
+static struct unpack_chunk __init *dequeue_chunk(void)
+{
+	struct unpack_chunk *chunk = NULL;
+
+	spin_lock(&unpack_lock);
+	if (!list_empty(&unpack_chunks)) {
+		chunk = list_first_entry(&unpack_chunks, struct unpack_chunk,
+					 list);
+		list_del(&chunk->list);
+		unpack_queued--;
+	}
+	spin_unlock(&unpack_lock);
+	if (chunk)
+		wake_up(&unpack_wait);
+	return chunk;
+}
+
+static long __init queue_buffer(void *bufv, unsigned long len)
+{
+	struct unpack_chunk *chunk;
+
+	if (message)
+		return -1;
+
+	chunk = kmalloc(sizeof(*chunk) + len, GFP_KERNEL);
+	if (!chunk) {
+		error("can't allocate buffers");
+		return -1;
+	}
+	memcpy(chunk->data, bufv, len);
+	chunk->len = len;
+
+	wait_event(unpack_wait, unpack_queue_has_room());
+	queue_chunk(chunk);
+	return len;
+}
+
+static int __init decompress_thread(void *data)
+{
+	struct decompress_job *job = data;
+	struct unpack_chunk *end;
+
+	job->res = job->decompress(job->buf, job->len, NULL, queue_buffer,
+				   NULL, &my_inptr, error);
+
+	/* The end marker must not fail, the unpacker waits for it */
+	end = kzalloc(sizeof(*end), GFP_KERNEL | __GFP_NOFAIL);
+	queue_chunk(end);
+	return 0;
+}
+
+static int __init decompress_segment(decompress_fn decompress, char *buf,
+				     unsigned long len)
+{
+	struct decompress_job job = {
+		.decompress	= decompress,
+		.buf		= buf,
+		.len		= len,
+	};
+	struct unpack_chunk *chunk;
+	struct task_struct *tsk;
+
+	if (num_online_cpus() < 2)
+		goto direct;
+
+	tsk = kthread_run(decompress_thread, &job, "initramfs-unz");
+	if (IS_ERR(tsk))
+		goto direct;
+	get_task_struct(tsk);
+
+	for (;;) {
+		wait_event(unpack_wait, (chunk = dequeue_chunk()) != NULL);
+		if (!chunk->len) {
+			kfree(chunk);
+			break;
+		}
+		flush_buffer(chunk->data, chunk->len);
+		kfree(chunk);
+	}
+	/*
+	 * The end marker orders job.res and my_inptr before us. Reap the
+	 * helper so it is off this __init code before initmem is freed.
+	 */
+	kthread_stop(tsk);
+	put_task_struct(tsk);
+	return job.res;
+
+direct:
+	return decompress(buf, len, NULL, flush_buffer, NULL, &my_inptr,
+			  error);
+}
+
 static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 {
 	long written;
@@ -482,8 +624,7 @@ static char * __init unpack_to_rootfs(char *buf, unsigned long len)
 		decompress = decompress_method(buf, len, &compress_name);
 		pr_debug("Detected %s compressed data\n", compress_name);
 		if (decompress) {
-			int res = decompress(buf, len, NULL, flush_buffer, NULL,
-				   &my_inptr, error);
+			int res = decompress_segment(decompress, buf, len);
 			if (res)
 				error("decompressor failed");
 		} else if (compress_name) {
@@ -605,8 +746,46 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+/*
+ * The initramfs is unpacked asynchronously to the remaining initcalls,
+ * everything that looks for files in rootfs has to wait_for_initramfs()
+ * first. "initramfs_async=0" unpacks it synchronously again.
+ */
+static bool initramfs_async = true;
+static bool initramfs_started;
+static DECLARE_COMPLETION(initramfs_done);
+
+static int __init initramfs_async_setup(char *str)
+{
+	strtobool(str, &initramfs_async);
+	return 1;
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+/**
+ * wait_for_initramfs - wait until the initramfs has been unpacked
+ *
+ * Must be called before looking up files that may come from the
+ * initramfs: the init program, usermode helpers, firmware etc.
+ */
+void wait_for_initramfs(void)
+{
+	if (!initramfs_started) {
+		/*
+		 * Something before rootfs_initcall wants to access the
+		 * filesystem. Don't deadlock the machine, let the access
+		 * fail as it always did.
+		 */
+		pr_warn_once("wait_for_initramfs() called before rootfs_initcalls\n");
+		return;
+	}
+	wait_for_completion(&initramfs_done);
+}
+EXPORT_SYMBOL_GPL(wait_for_initramfs);
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
 {
+	bool have_initrd = initrd_start;
 	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
 	if (err)
 		panic("%s", err); /* Failed to decompress INTERNAL initramfs */
@@ -647,12 +826,26 @@ static int __init populate_rootfs(void)
 			printk(KERN_EMERG "Initramfs unpacking failed: %s\n", err);
 		free_initrd();
 #endif
-		/*
-		 * Try loading default modules from initramfs.  This gives
-		 * us a chance to load before device_initcalls.
-		 */
-		load_default_modules();
 	}
+
+	/* usermode helpers wait for us, so complete before loading modules */
+	complete_all(&initramfs_done);
+
+	/*
+	 * Try loading default modules from initramfs.  This gives
+	 * us a chance to load before device_initcalls.
+	 */
+	if (have_initrd)
+		load_default_modules();
+}
+
+static int __init populate_rootfs(void)
+{
+	initramfs_started = true;
+	if (initramfs_async)
+		async_schedule(do_populate_rootfs, NULL);
+	else
+		do_populate_rootfs(NULL, 0);
 	return 0;
 }
 rootfs_initcall(populate_rootfs);
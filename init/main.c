@@ -1017,6 +1017,9 @@ static noinline void __init kernel_init_freeable(void)
 
 	do_basic_setup();
 
+	/* /dev/console and the early userspace init may come from initramfs */
+	wait_for_initramfs();
+
 	/* Open the /dev/console on the rootfs, this should never fail */
 	if (sys_open((const char __user *) "/dev/console", O_RDWR, 0) < 0)
 		pr_err("Warning: unable to open an initial console.\n");
@@ -103,7 +103,7 @@ void ipc_init_ids(struct ipc_ids *ids)
 	ids->seq = 0;
 	ids->next_id = -1;
 	init_rwsem(&ids->rwsem);
-	idr_init(&ids->ipcs_idr);
+	xa_init(&ids->ipcs_xa);
 }
 
 #ifdef CONFIG_PROC_FS
@@ -152,20 +152,12 @@ void __init ipc_init_proc_interface(const char *path, const char *header,
 static struct kern_ipc_perm *ipc_findkey(struct ipc_ids *ids, key_t key)
 {
 	struct kern_ipc_perm *ipc;
-	int next_id;
-	int total;
+	unsigned long index;
 
-	for (total = 0, next_id = 0; total < ids->in_use; next_id++) {
-		ipc = idr_find(&ids->ipcs_idr, next_id);
-
-		if (ipc == NULL)
+	xa_for_each(&ids->ipcs_xa, index, ipc) {
+		if (ipc->key != key)
 			continue;
 
-		if (ipc->key != key) {
-			total++;
-			continue;
-		}
-
 		rcu_read_lock();
 		ipc_lock_object(ipc);
 		return ipc;
@@ -183,8 +175,8 @@ static struct kern_ipc_perm *ipc_findkey(struct ipc_ids *ids, key_t key)
 int ipc_get_maxid(struct ipc_ids *ids)
 {
 	struct kern_ipc_perm *ipc;
+	unsigned long index;
 	int max_id = -1;
-	int total, id;
 
 	if (ids->in_use == 0)
 		return -1;
@@ -193,14 +185,9 @@ int ipc_get_maxid(struct ipc_ids *ids)
 		return IPCMNI - 1;
 
 	/* Look for the last assigned id */
-	total = 0;
-	for (id = 0; id < IPCMNI && total < ids->in_use; id++) {
-		ipc = idr_find(&ids->ipcs_idr, id);
-		if (ipc != NULL) {
-			max_id = id;
-			total++;
-		}
-	}
+	xa_for_each(&ids->ipcs_xa, index, ipc)
+		max_id = index;
+
 	return max_id;
 }
 
@@ -221,7 +208,8 @@ int ipc_addid(struct ipc_ids *ids, struct kern_ipc_perm *new, int size)
 {
 	kuid_t euid;
 	kgid_t egid;
-	int id;
+	u32 id;
+	int err;
 	int next_id = ids->next_id;
 
 	if (size > IPCMNI)
@@ -230,21 +218,23 @@ int ipc_addid(struct ipc_ids *ids, struct kern_ipc_perm *new, int size)
 	if (ids->in_use >= size)
 		return -ENOSPC;
 
-	idr_preload(GFP_KERNEL);
+	err = xa_preload(GFP_KERNEL);
+	if (err)
+		return err;
 
 	spin_lock_init(&new->lock);
 	new->deleted = false;
 	rcu_read_lock();
 	spin_lock(&new->lock);
 
-	id = idr_alloc(&ids->ipcs_idr, new,
-		       (next_id < 0) ? 0 : ipcid_to_idx(next_id), 0,
+	err = xa_alloc(&ids->ipcs_xa, &id, new,
+		       (next_id < 0) ? 0 : ipcid_to_idx(next_id), INT_MAX,
 		       GFP_NOWAIT);
-	idr_preload_end();
-	if (id < 0) {
+	xa_preload_end();
+	if (err) {
 		spin_unlock(&new->lock);
 		rcu_read_unlock();
-		return id;
+		return err;
 	}
 
 	ids->in_use++;
@@ -389,7 +379,7 @@ void ipc_rmid(struct ipc_ids *ids, struct kern_ipc_perm *ipcp)
 {
 	int lid = ipcid_to_idx(ipcp->id);
 
-	idr_remove(&ids->ipcs_idr, lid);
+	xa_erase(&ids->ipcs_xa, lid);
 	ids->in_use--;
 	ipcp->deleted = true;
 }
@@ -563,7 +553,7 @@ struct kern_ipc_perm *ipc_obtain_object(struct ipc_ids *ids, int id)
 	struct kern_ipc_perm *out;
 	int lid = ipcid_to_idx(id);
 
-	out = idr_find(&ids->ipcs_idr, lid);
+	out = xa_load(&ids->ipcs_xa, lid);
 	if (!out)
 		return ERR_PTR(-EINVAL);
 
@@ -747,30 +737,20 @@ static struct kern_ipc_perm *sysvipc_find_ipc(struct ipc_ids *ids, loff_t pos,
 					      loff_t *new_pos)
 {
 	struct kern_ipc_perm *ipc;
-	int total, id;
+	unsigned long index = pos;
 
-	total = 0;
-	for (id = 0; id < pos && total < ids->in_use; id++) {
-		ipc = idr_find(&ids->ipcs_idr, id);
-		if (ipc != NULL)
-			total++;
-	}
-
-	if (total >= ids->in_use)
+	/* Out of range - return NULL to terminate iteration */
+	if (pos >= IPCMNI)
 		return NULL;
 
-	for (; pos < IPCMNI; pos++) {
-		ipc = idr_find(&ids->ipcs_idr, pos);
-		if (ipc != NULL) {
-			*new_pos = pos + 1;
-			rcu_read_lock();
-			ipc_lock_object(ipc);
-			return ipc;
-		}
-	}
+	ipc = xa_find(&ids->ipcs_xa, &index, IPCMNI - 1, XA_PRESENT);
+	if (!ipc)
+		return NULL;
 
-	/* Out of range - return NULL to terminate iteration */
-	return NULL;
+	*new_pos = index + 1;
+	rcu_read_lock();
+	ipc_lock_object(ipc);
+	return ipc;
 }
 
 static void *sysvipc_proc_next(struct seq_file *s, void *it, loff_t *pos)
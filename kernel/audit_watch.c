@@ -470,6 +470,7 @@ static int audit_watch_handle_event(struct fsnotify_group *group,
 				    struct inode *to_tell,
 				    struct fsnotify_mark *inode_mark,
 				    struct fsnotify_mark *vfsmount_mark,
+				    struct fsnotify_mark *sb_mark,
 				    u32 mask, void *data, int data_type,
 				    const unsigned char *dname, u32 cookie)
 {
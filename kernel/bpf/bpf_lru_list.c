@@ -0,0 +1,165 @@
+/* LRU lists backing BPF_MAP_TYPE_LRU_HASH
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * All elements of the map are allocated up front and handed out to the
+ * possible cpus in equal shares. A cpu only ever takes free nodes from,
+ * and evicts from, its own lists, so inserts on different cpus do not
+ * share a lock or a cache line. Lookups merely set the node's ref bit.
+ *
+ * Freed nodes are reused right away rather than after an RCU grace
+ * period: a program still holding a value may see it rewritten, and a
+ * lookup racing with the reuse may miss its key. Nothing is ever handed
+ * back to the allocator before the map itself goes away.
+ *
+ * Lock order is lru list lock -> hash table lock: eviction calls back
+ * into the hash table with its list lock held, so the hash table must
+ * drop its own lock before handing a node back through
+ * bpf_lru_push_free().
+ */
+#include <linux/cpumask.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+
+#include "bpf_lru_list.h"
+
+/* how many nodes at the tail get a second chance before the oldest
+ * one is evicted regardless of its ref bit
+ */
+#define PERCPU_NR_SCANS		16
+
+static void __bpf_lru_node_move_to_free(struct bpf_lru_list *l,
+					struct bpf_lru_node *node)
+{
+	node->type = BPF_LRU_LIST_T_FREE;
+	node->ref = 0;
+	list_move(&node->list, &l->free);
+}
+
+/* Called with l->lock held. Frees at most one node. */
+static void __bpf_lru_list_shrink(struct bpf_lru *lru,
+				  struct bpf_lru_list *l)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	unsigned int i = 0;
+
+	list_for_each_entry_safe_reverse(node, tmp_node, &l->lru, list) {
+		if (i++ >= lru->nr_scans)
+			break;
+
+		if (node->ref) {
+			node->ref = 0;
+			list_move(&node->list, &l->lru);
+			continue;
+		}
+
+		/* fails if the node is not (or no longer) in the table */
+		if (lru->del_from_htab(lru->del_arg, node)) {
+			__bpf_lru_node_move_to_free(l, node);
+			return;
+		}
+	}
+
+	/* every scanned node was recently used, take the oldest anyway */
+	list_for_each_entry_reverse(node, &l->lru, list) {
+		if (lru->del_from_htab(lru->del_arg, node)) {
+			__bpf_lru_node_move_to_free(l, node);
+			return;
+		}
+	}
+}
+
+struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru)
+{
+	struct bpf_lru_node *node = NULL;
+	struct bpf_lru_list *l;
+	unsigned long flags;
+
+	l = raw_cpu_ptr(lru->lists);
+
+	raw_spin_lock_irqsave(&l->lock, flags);
+
+	if (list_empty(&l->free))
+		__bpf_lru_list_shrink(lru, l);
+
+	if (!list_empty(&l->free)) {
+		node = list_first_entry(&l->free, struct bpf_lru_node, list);
+		/* on the lru list before it is in the table; eviction
+		 * skips it until then since del_from_htab() fails
+		 */
+		node->type = BPF_LRU_LIST_T_LRU;
+		node->ref = 0;
+		list_move(&node->list, &l->lru);
+	}
+
+	raw_spin_unlock_irqrestore(&l->lock, flags);
+
+	return node;
+}
+
+/* The node must already be unlinked from the hash table. */
+void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
+{
+	struct bpf_lru_list *l = per_cpu_ptr(lru->lists, node->cpu);
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&l->lock, flags);
+	if (node->type != BPF_LRU_LIST_T_FREE)
+		__bpf_lru_node_move_to_free(l, node);
+	raw_spin_unlock_irqrestore(&l->lock, flags);
+}
+
+void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
+		      u32 elem_size, u32 nr_elems)
+{
+	u32 i = 0, pcpu_entries;
+	int cpu;
+
+	pcpu_entries = nr_elems / num_possible_cpus();
+
+	for_each_possible_cpu(cpu) {
+		struct bpf_lru_list *l = per_cpu_ptr(lru->lists, cpu);
+		u32 j;
+
+		for (j = 0; j < pcpu_entries && i < nr_elems; j++, i++) {
+			struct bpf_lru_node *node;
+
+			node = buf + node_offset + (size_t)i * elem_size;
+			node->cpu = cpu;
+			node->type = BPF_LRU_LIST_T_FREE;
+			node->ref = 0;
+			list_add(&node->list, &l->free);
+		}
+	}
+}
+
+int bpf_lru_init(struct bpf_lru *lru, del_from_htab_func del_from_htab,
+		 void *del_arg)
+{
+	int cpu;
+
+	lru->lists = alloc_percpu(struct bpf_lru_list);
+	if (!lru->lists)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct bpf_lru_list *l = per_cpu_ptr(lru->lists, cpu);
+
+		INIT_LIST_HEAD(&l->free);
+		INIT_LIST_HEAD(&l->lru);
+		raw_spin_lock_init(&l->lock);
+	}
+
+	lru->del_from_htab = del_from_htab;
+	lru->del_arg = del_arg;
+	lru->nr_scans = PERCPU_NR_SCANS;
+
+	return 0;
+}
+
+void bpf_lru_destroy(struct bpf_lru *lru)
+{
+	free_percpu(lru->lists);
+}
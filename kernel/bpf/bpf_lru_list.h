@@ -0,0 +1,58 @@
+/* LRU lists backing BPF_MAP_TYPE_LRU_HASH
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ */
+#ifndef __BPF_LRU_LIST_H_
+#define __BPF_LRU_LIST_H_
+
+#include <linux/list.h>
+#include <linux/spinlock_types.h>
+
+enum bpf_lru_list_type {
+	BPF_LRU_LIST_T_FREE,
+	BPF_LRU_LIST_T_LRU,
+};
+
+struct bpf_lru_node {
+	struct list_head list;
+	u16 cpu;	/* owning cpu, the node never leaves its lists */
+	u8 type;
+	u8 ref;		/* set on lookup, gives the node a second chance */
+};
+
+/* each possible cpu owns an equal share of the preallocated nodes */
+struct bpf_lru_list {
+	struct list_head free;
+	struct list_head lru;	/* most recently inserted at the head */
+	raw_spinlock_t lock ____cacheline_aligned_in_smp;
+};
+
+typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
+
+struct bpf_lru {
+	struct bpf_lru_list __percpu *lists;
+	del_from_htab_func del_from_htab;
+	void *del_arg;
+	unsigned int nr_scans;
+};
+
+static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
+{
+	/* ref is an approximation on access frequency. It does not
+	 * have to be very accurate. Hence, no protection is used.
+	 */
+	if (!node->ref)
+		node->ref = 1;
+}
+
+int bpf_lru_init(struct bpf_lru *lru, del_from_htab_func del_from_htab,
+		 void *del_arg);
+void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
+		      u32 elem_size, u32 nr_elems);
+void bpf_lru_destroy(struct bpf_lru *lru);
+struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru);
+void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node);
+
+#endif
@@ -13,10 +13,14 @@
 #include <linux/jhash.h>
 #include <linux/filter.h>
 #include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include "bpf_lru_list.h"
 
 struct bpf_htab {
 	struct bpf_map map;
 	struct hlist_head *buckets;
+	void *elems;		/* BPF_MAP_TYPE_LRU_HASH: all elements */
+	struct bpf_lru lru;
 	spinlock_t lock;
 	u32 count;	/* number of elements in this hashtable */
 	u32 n_buckets;	/* number of hash buckets */
@@ -28,12 +32,47 @@ struct htab_elem {
 	struct hlist_node hash_node;
 	struct rcu_head rcu;
 	u32 hash;
+	void __percpu *pptr;	/* value of BPF_MAP_TYPE_PERCPU_HASH elems */
+	struct bpf_lru_node lru_node;
 	char key[0] __aligned(8);
 };
 
+static bool htab_is_lru(const struct bpf_htab *htab)
+{
+	return htab->map.map_type == BPF_MAP_TYPE_LRU_HASH;
+}
+
+static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
+
+static int prealloc_lru_elems(struct bpf_htab *htab)
+{
+	u64 size = (u64) htab->elem_size * htab->map.max_entries;
+	int err;
+
+	if (size >= U32_MAX - PAGE_SIZE)
+		return -E2BIG;
+
+	htab->elems = vzalloc(size);
+	if (!htab->elems)
+		return -ENOMEM;
+
+	err = bpf_lru_init(&htab->lru, htab_lru_map_delete_node, htab);
+	if (err) {
+		vfree(htab->elems);
+		return err;
+	}
+
+	bpf_lru_populate(&htab->lru, htab->elems,
+			 offsetof(struct htab_elem, lru_node),
+			 htab->elem_size, htab->map.max_entries);
+	return 0;
+}
+
 /* Called from syscall */
 static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 {
+	bool percpu = attr->map_type == BPF_MAP_TYPE_PERCPU_HASH;
+	bool lru = attr->map_type == BPF_MAP_TYPE_LRU_HASH;
 	struct bpf_htab *htab;
 	int err, i;
 
@@ -54,6 +93,17 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	    htab->map.value_size == 0)
 		goto free_htab;
 
+	if (lru) {
+		/* every cpu gets the same number of elements for its own
+		 * free and lru lists
+		 */
+		htab->map.max_entries = roundup(attr->max_entries,
+						num_possible_cpus());
+		if (htab->map.max_entries < attr->max_entries)
+			htab->map.max_entries = rounddown(attr->max_entries,
+							  num_possible_cpus());
+	}
+
 	/* hash table size must be power of 2 */
 	htab->n_buckets = roundup_pow_of_two(htab->map.max_entries);
 
@@ -64,6 +114,10 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		 */
 		goto free_htab;
 
+	if (percpu && round_up(htab->map.value_size, 8) > PCPU_MIN_UNIT_SIZE)
+		/* make sure the size for pcpu_alloc() is reasonable */
+		goto free_htab;
+
 	err = -ENOMEM;
 	/* prevent zero size kmalloc and check for u32 overflow */
 	if (htab->n_buckets == 0 ||
@@ -86,10 +140,23 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	htab->count = 0;
 
 	htab->elem_size = sizeof(struct htab_elem) +
-			  round_up(htab->map.key_size, 8) +
-			  htab->map.value_size;
+			  round_up(htab->map.key_size, 8);
+	if (lru)
+		/* elements sit back to back in one array */
+		htab->elem_size += round_up(htab->map.value_size, 8);
+	else if (!percpu)
+		htab->elem_size += htab->map.value_size;
+
+	if (lru) {
+		err = prealloc_lru_elems(htab);
+		if (err)
+			goto free_buckets;
+	}
+
 	return &htab->map;
 
+free_buckets:
+	kvfree(htab->buckets);
 free_htab:
 	kfree(htab);
 	return ERR_PTR(err);
@@ -117,12 +184,10 @@ static struct htab_elem *lookup_elem_raw(struct hlist_head *head, u32 hash,
 	return NULL;
 }
 
-/* Called from syscall or from eBPF program */
-static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
+static struct htab_elem *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_head *head;
-	struct htab_elem *l;
 	u32 hash, key_size;
 
 	/* Must be called with rcu_read_lock. */
@@ -134,7 +199,13 @@ static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	head = select_bucket(htab, hash);
 
-	l = lookup_elem_raw(head, hash, key, key_size);
+	return lookup_elem_raw(head, hash, key, key_size);
+}
+
+/* Called from syscall or from eBPF program */
+static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
 
 	if (l)
 		return l->key + round_up(map->key_size, 8);
@@ -142,6 +213,57 @@ static void *htab_map_lookup_elem(struct bpf_map *map, void *key)
 	return NULL;
 }
 
+/* Called from syscall or from eBPF program */
+static void *htab_lru_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
+
+	if (l) {
+		bpf_lru_node_set_ref(&l->lru_node);
+		return l->key + round_up(map->key_size, 8);
+	}
+
+	return NULL;
+}
+
+/* Called from eBPF program, sees only the local cpu's value */
+static void *htab_percpu_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct htab_elem *l = __htab_map_lookup_elem(map, key);
+
+	if (l)
+		return this_cpu_ptr(l->pptr);
+
+	return NULL;
+}
+
+/* Called from syscall, gathers the values of all possible cpus */
+int bpf_percpu_hash_copy(struct bpf_map *map, void *key, void *value)
+{
+	struct htab_elem *l;
+	int ret = -ENOENT;
+	int cpu, off = 0;
+	u32 size;
+
+	/* per_cpu areas are zero-filled and bpf programs can only
+	 * access 'value_size' of them, so copying rounded areas
+	 * will not leak any kernel data
+	 */
+	size = round_up(map->value_size, 8);
+	rcu_read_lock();
+	l = __htab_map_lookup_elem(map, key);
+	if (!l)
+		goto out;
+	for_each_possible_cpu(cpu) {
+		memcpy(value + off, per_cpu_ptr(l->pptr, cpu), size);
+		off += size;
+	}
+	ret = 0;
+out:
+	rcu_read_unlock();
+	return ret;
+}
+
 /* Called from syscall */
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
@@ -200,6 +322,60 @@ find_first_elem:
 	return -ENOENT;
 }
 
+static void htab_elem_free(struct htab_elem *l)
+{
+	free_percpu(l->pptr);
+	kfree(l);
+}
+
+static void htab_elem_free_rcu(struct rcu_head *head)
+{
+	struct htab_elem *l = container_of(head, struct htab_elem, rcu);
+
+	htab_elem_free(l);
+}
+
+static int check_flags(struct bpf_htab *htab, struct htab_elem *l_old,
+		       u64 map_flags)
+{
+	/* an lru map is bounded by its preallocated elements */
+	if (!l_old && !htab_is_lru(htab) &&
+	    unlikely(htab->count >= htab->map.max_entries))
+		/* if elem with this 'key' doesn't exist and we've reached
+		 * max_entries limit, fail insertion of new elem
+		 */
+		return -E2BIG;
+
+	if (l_old && map_flags == BPF_NOEXIST)
+		/* elem already exists */
+		return -EEXIST;
+
+	if (!l_old && map_flags == BPF_EXIST)
+		/* elem doesn't exist, cannot update it */
+		return -ENOENT;
+
+	return 0;
+}
+
+/* copy a value into a per-cpu area: user space supplies one rounded
+ * slot per possible cpu, a program only the value for its own cpu
+ */
+static void pcpu_copy_value(struct bpf_htab *htab, void __percpu *pptr,
+			    void *value, bool onallcpus)
+{
+	if (!onallcpus) {
+		memcpy(this_cpu_ptr(pptr), value, htab->map.value_size);
+	} else {
+		u32 size = round_up(htab->map.value_size, 8);
+		int off = 0, cpu;
+
+		for_each_possible_cpu(cpu) {
+			memcpy(per_cpu_ptr(pptr, cpu), value + off, size);
+			off += size;
+		}
+	}
+}
+
 /* Called from syscall or from eBPF program */
 static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 				u64 map_flags)
@@ -224,6 +400,7 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	key_size = map->key_size;
 
+	l_new->pptr = NULL;
 	memcpy(l_new->key, key, key_size);
 	memcpy(l_new->key + round_up(key_size, 8), value, map->value_size);
 
@@ -236,25 +413,9 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	l_old = lookup_elem_raw(head, l_new->hash, key, key_size);
 
-	if (!l_old && unlikely(htab->count >= map->max_entries)) {
-		/* if elem with this 'key' doesn't exist and we've reached
-		 * max_entries limit, fail insertion of new elem
-		 */
-		ret = -E2BIG;
-		goto err;
-	}
-
-	if (l_old && map_flags == BPF_NOEXIST) {
-		/* elem already exists */
-		ret = -EEXIST;
-		goto err;
-	}
-
-	if (!l_old && map_flags == BPF_EXIST) {
-		/* elem doesn't exist, cannot update it */
-		ret = -ENOENT;
+	ret = check_flags(htab, l_old, map_flags);
+	if (ret)
 		goto err;
-	}
 
 	/* add new element to the head of the list, so that concurrent
 	 * search will find it before old elem
@@ -262,7 +423,7 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 	hlist_add_head_rcu(&l_new->hash_node, head);
 	if (l_old) {
 		hlist_del_rcu(&l_old->hash_node);
-		kfree_rcu(l_old, rcu);
+		call_rcu(&l_old->rcu, htab_elem_free_rcu);
 	} else {
 		htab->count++;
 	}
@@ -275,6 +436,155 @@ err:
 	return ret;
 }
 
+/* Called from syscall or from eBPF program. A full map makes room by
+ * evicting the least recently used element of the local cpu.
+ */
+static int htab_lru_map_update_elem(struct bpf_map *map, void *key,
+				    void *value, u64 map_flags)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_elem *l_new, *l_old;
+	struct bpf_lru_node *node;
+	struct hlist_head *head;
+	unsigned long flags;
+	u32 hash, key_size;
+	int ret;
+
+	if (map_flags > BPF_EXIST)
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	/* the lru lists are taken before, never under, htab->lock */
+	node = bpf_lru_pop_free(&htab->lru);
+	if (!node)
+		return -ENOMEM;
+
+	l_new = container_of(node, struct htab_elem, lru_node);
+	l_new->hash = hash;
+	memcpy(l_new->key, key, key_size);
+	memcpy(l_new->key + round_up(key_size, 8), value, map->value_size);
+
+	/* bpf_map_update_elem() can be called in_irq() */
+	spin_lock_irqsave(&htab->lock, flags);
+
+	head = select_bucket(htab, hash);
+
+	l_old = lookup_elem_raw(head, hash, key, key_size);
+
+	ret = check_flags(htab, l_old, map_flags);
+	if (ret)
+		goto err;
+
+	/* add new element to the head of the list, so that concurrent
+	 * search will find it before old elem
+	 */
+	hlist_add_head_rcu(&l_new->hash_node, head);
+	if (l_old)
+		hlist_del_rcu(&l_old->hash_node);
+	else
+		htab->count++;
+
+err:
+	spin_unlock_irqrestore(&htab->lock, flags);
+
+	if (ret)
+		bpf_lru_push_free(&htab->lru, &l_new->lru_node);
+	else if (l_old)
+		bpf_lru_push_free(&htab->lru, &l_old->lru_node);
+
+	return ret;
+}
+
+/* An existing element is updated in place, so concurrent programs keep
+ * counting into the very per-cpu area they looked up; only inserts
+ * allocate.
+ */
+static int __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
+					 void *value, u64 map_flags,
+					 bool onallcpus)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_elem *l_new = NULL, *l_old;
+	struct hlist_head *head;
+	unsigned long flags;
+	u32 hash, key_size;
+	int ret;
+
+	if (map_flags > BPF_EXIST)
+		/* unknown flags */
+		return -EINVAL;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	/* bpf_map_update_elem() can be called in_irq() */
+	spin_lock_irqsave(&htab->lock, flags);
+
+	head = select_bucket(htab, hash);
+
+	l_old = lookup_elem_raw(head, hash, key, key_size);
+
+	ret = check_flags(htab, l_old, map_flags);
+	if (ret)
+		goto err;
+
+	if (l_old) {
+		pcpu_copy_value(htab, l_old->pptr, value, onallcpus);
+	} else {
+		ret = -ENOMEM;
+		l_new = kmalloc(htab->elem_size, GFP_ATOMIC | __GFP_NOWARN);
+		if (!l_new)
+			goto err;
+
+		l_new->pptr = __alloc_percpu_gfp(round_up(map->value_size, 8),
+						 8, GFP_ATOMIC | __GFP_NOWARN);
+		if (!l_new->pptr) {
+			kfree(l_new);
+			goto err;
+		}
+
+		memcpy(l_new->key, key, key_size);
+		l_new->hash = hash;
+		pcpu_copy_value(htab, l_new->pptr, value, onallcpus);
+
+		hlist_add_head_rcu(&l_new->hash_node, head);
+		htab->count++;
+	}
+	ret = 0;
+err:
+	spin_unlock_irqrestore(&htab->lock, flags);
+	return ret;
+}
+
+/* Called from eBPF program, writes the local cpu's value only */
+static int htab_percpu_map_update_elem(struct bpf_map *map, void *key,
+				       void *value, u64 map_flags)
+{
+	return __htab_percpu_map_update_elem(map, key, value, map_flags, false);
+}
+
+/* Called from syscall, value holds one rounded slot per possible cpu */
+int bpf_percpu_hash_update(struct bpf_map *map, void *key, void *value,
+			   u64 map_flags)
+{
+	int ret;
+
+	rcu_read_lock();
+	ret = __htab_percpu_map_update_elem(map, key, value, map_flags, true);
+	rcu_read_unlock();
+
+	return ret;
+}
+
 /* Called from syscall or from eBPF program */
 static int htab_map_delete_elem(struct bpf_map *map, void *key)
 {
@@ -300,14 +610,78 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 	if (l) {
 		hlist_del_rcu(&l->hash_node);
 		htab->count--;
-		kfree_rcu(l, rcu);
+		call_rcu(&l->rcu, htab_elem_free_rcu);
+		ret = 0;
+	}
+
+	spin_unlock_irqrestore(&htab->lock, flags);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int htab_lru_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct hlist_head *head;
+	struct htab_elem *l;
+	unsigned long flags;
+	u32 hash, key_size;
+	int ret = -ENOENT;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	key_size = map->key_size;
+
+	hash = htab_map_hash(key, key_size);
+
+	spin_lock_irqsave(&htab->lock, flags);
+
+	head = select_bucket(htab, hash);
+
+	l = lookup_elem_raw(head, hash, key, key_size);
+
+	if (l) {
+		hlist_del_rcu(&l->hash_node);
+		htab->count--;
 		ret = 0;
 	}
 
 	spin_unlock_irqrestore(&htab->lock, flags);
+
+	if (l)
+		bpf_lru_push_free(&htab->lru, &l->lru_node);
 	return ret;
 }
 
+/* Called by the lru lists with their lock held to evict an element.
+ * Fails if the element is not linked into the table, either because
+ * it has not been inserted yet or because it is already being deleted.
+ */
+static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
+{
+	struct bpf_htab *htab = (struct bpf_htab *)arg;
+	struct htab_elem *l, *tgt_l;
+	struct hlist_head *head;
+	unsigned long flags;
+
+	tgt_l = container_of(node, struct htab_elem, lru_node);
+
+	spin_lock_irqsave(&htab->lock, flags);
+
+	head = select_bucket(htab, tgt_l->hash);
+
+	hlist_for_each_entry(l, head, hash_node)
+		if (l == tgt_l) {
+			hlist_del_rcu(&l->hash_node);
+			htab->count--;
+			break;
+		}
+
+	spin_unlock_irqrestore(&htab->lock, flags);
+
+	return l == tgt_l;
+}
+
 static void delete_all_elements(struct bpf_htab *htab)
 {
 	int i;
@@ -320,7 +694,7 @@ static void delete_all_elements(struct bpf_htab *htab)
 		hlist_for_each_entry_safe(l, n, head, hash_node) {
 			hlist_del_rcu(&l->hash_node);
 			htab->count--;
-			kfree(l);
+			htab_elem_free(l);
 		}
 	}
 }
@@ -337,7 +711,16 @@ static void htab_map_free(struct bpf_map *map)
 	 */
 	synchronize_rcu();
 
-	/* some of kfree_rcu() callbacks for elements of this map may not have
+	/* lru elements are not allocated one by one and go with the array */
+	if (htab_is_lru(htab)) {
+		bpf_lru_destroy(&htab->lru);
+		vfree(htab->elems);
+		kvfree(htab->buckets);
+		kfree(htab);
+		return;
+	}
+
+	/* some of the rcu callbacks for elements of this map may not have
 	 * executed. It's ok. Proceed to free residual elements and map itself
 	 */
 	delete_all_elements(htab);
@@ -359,9 +742,39 @@ static struct bpf_map_type_list tl = {
 	.type = BPF_MAP_TYPE_HASH,
 };
 
+static struct bpf_map_ops htab_percpu_ops = {
+	.map_alloc = htab_map_alloc,
+	.map_free = htab_map_free,
+	.map_get_next_key = htab_map_get_next_key,
+	.map_lookup_elem = htab_percpu_map_lookup_elem,
+	.map_update_elem = htab_percpu_map_update_elem,
+	.map_delete_elem = htab_map_delete_elem,
+};
+
+static struct bpf_map_type_list percpu_tl = {
+	.ops = &htab_percpu_ops,
+	.type = BPF_MAP_TYPE_PERCPU_HASH,
+};
+
+static struct bpf_map_ops htab_lru_ops = {
+	.map_alloc = htab_map_alloc,
+	.map_free = htab_map_free,
+	.map_get_next_key = htab_map_get_next_key,
+	.map_lookup_elem = htab_lru_map_lookup_elem,
+	.map_update_elem = htab_lru_map_update_elem,
+	.map_delete_elem = htab_lru_map_delete_elem,
+};
+
+static struct bpf_map_type_list lru_tl = {
+	.ops = &htab_lru_ops,
+	.type = BPF_MAP_TYPE_LRU_HASH,
+};
+
 static int __init register_htab_map(void)
 {
 	bpf_register_map_type(&tl);
+	bpf_register_map_type(&percpu_tl);
+	bpf_register_map_type(&lru_tl);
 	return 0;
 }
 late_initcall(register_htab_map);
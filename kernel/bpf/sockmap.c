@@ -0,0 +1,598 @@
+/* This program is free software; you can redistribute it and/or
+ * modify it under the terms of version 2 of the GNU General Public
+ * License as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ */
+
+/* A BPF_MAP_TYPE_SOCKMAP is an array of established TCP sockets. Once a
+ * BPF_SK_SKB_STREAM_VERDICT program is attached to the map, every chunk
+ * of data arriving on a socket in the map is taken off its receive queue
+ * from sk_data_ready() and handed to the program, which can redirect it
+ * with bpf_sk_redirect_map() to the transmit side of another socket in
+ * the map. The data then never reaches user space.
+ *
+ * Per socket state lives in a struct smap_psock hung off sk_user_data,
+ * the socket callbacks are restored when the socket leaves the map.
+ */
+#include <linux/bpf.h>
+#include <linux/filter.h>
+#include <linux/errno.h>
+#include <linux/file.h>
+#include <linux/net.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/highmem.h>
+#include <linux/uio.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+struct bpf_stab {
+	struct bpf_map map;
+	struct bpf_prog *bpf_verdict;
+	struct sock *sock_map[0];
+};
+
+struct smap_psock {
+	struct rcu_head rcu;
+	struct sock *sock;
+	struct bpf_stab *stab;
+	u32 key;
+
+	/* data redirected to this socket, sent from tx_work */
+	struct sk_buff_head txqueue;
+	struct sk_buff *save_skb;
+	int save_off;
+	struct work_struct tx_work;
+	struct work_struct gc_work;
+
+	void (*save_data_ready)(struct sock *sk);
+	void (*save_write_space)(struct sock *sk);
+	void (*save_state_change)(struct sock *sk);
+};
+
+/* cb[] of the skbs a verdict program sees, bpf_sk_redirect_map() leaves
+ * its target here
+ */
+struct smap_skb_cb {
+	struct sock *sk_redir;
+};
+
+#define SMAP_SKB_CB(skb) ((struct smap_skb_cb *)(skb)->cb)
+
+static struct smap_psock *smap_psock_sk(const struct sock *sk)
+{
+	return rcu_dereference_sk_user_data(sk);
+}
+
+static struct sock *__sock_map_lookup_elem(struct bpf_map *map, u32 key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+
+	if (key >= map->max_entries)
+		return NULL;
+
+	return READ_ONCE(stab->sock_map[key]);
+}
+
+static u64 bpf_sk_redirect_map(u64 r1, u64 r2, u64 r3, u64 flags, u64 r5)
+{
+	struct sk_buff *skb = (struct sk_buff *) (long) r1;
+	struct bpf_map *map = (struct bpf_map *) (long) r2;
+	struct sock *sk;
+
+	if (unlikely(flags))
+		return SK_DROP;
+
+	sk = __sock_map_lookup_elem(map, (u32) r3);
+	SMAP_SKB_CB(skb)->sk_redir = sk;
+
+	return sk ? SK_PASS : SK_DROP;
+}
+
+const struct bpf_func_proto bpf_sk_redirect_map_proto = {
+	.func = bpf_sk_redirect_map,
+	.gpl_only = false,
+	.ret_type = RET_INTEGER,
+	.arg1_type = ARG_PTR_TO_CTX,
+	.arg2_type = ARG_CONST_MAP_PTR,
+	.arg3_type = ARG_ANYTHING,
+	.arg4_type = ARG_ANYTHING,
+};
+
+/* called under rcu_read_lock(), consumes skb */
+static void smap_do_verdict(struct smap_psock *psock, struct sk_buff *skb)
+{
+	struct bpf_prog *prog = READ_ONCE(psock->stab->bpf_verdict);
+	struct smap_psock *peer;
+	struct sock *sk = NULL;
+	int rc;
+
+	if (likely(prog)) {
+		SMAP_SKB_CB(skb)->sk_redir = NULL;
+		preempt_disable();
+		rc = BPF_PROG_RUN(prog, skb);
+		preempt_enable();
+		if (rc == SK_PASS)
+			sk = SMAP_SKB_CB(skb)->sk_redir;
+	}
+
+	peer = sk ? smap_psock_sk(sk) : NULL;
+	if (!peer) {
+		kfree_skb(skb);
+		return;
+	}
+
+	skb_queue_tail(&peer->txqueue, skb);
+	schedule_work(&peer->tx_work);
+}
+
+static int smap_read_sock_actor(read_descriptor_t *desc, struct sk_buff *orig,
+				unsigned int offset, size_t len)
+{
+	struct smap_psock *psock = desc->arg.data;
+	struct sk_buff *skb;
+
+	skb = skb_clone(orig, GFP_ATOMIC);
+	if (!skb)
+		goto nomem;
+
+	if (offset && !pskb_pull(skb, offset))
+		goto nomem_free;
+	if (pskb_trim(skb, len))
+		goto nomem_free;
+	/* the sender walks head and page frags only */
+	if (skb_has_frag_list(skb) && skb_linearize(skb))
+		goto nomem_free;
+
+	smap_do_verdict(psock, skb);
+	return len;
+
+nomem_free:
+	kfree_skb(skb);
+nomem:
+	/* leave the data queued, the next sk_data_ready() retries */
+	desc->error = -ENOMEM;
+	return 0;
+}
+
+static void smap_data_ready(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		if (READ_ONCE(psock->stab->bpf_verdict)) {
+			read_descriptor_t desc = {
+				.arg.data = psock,
+				.count = 1,
+			};
+
+			tcp_read_sock(sk, &desc, smap_read_sock_actor);
+		} else {
+			psock->save_data_ready(sk);
+		}
+	}
+	rcu_read_unlock();
+}
+
+static void smap_write_space(struct sock *sk)
+{
+	void (*write_space)(struct sock *sk);
+	struct smap_psock *psock;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		schedule_work(&psock->tx_work);
+		write_space = psock->save_write_space;
+	} else {
+		write_space = sk->sk_write_space;
+	}
+	rcu_read_unlock();
+	write_space(sk);
+}
+
+static void smap_release_sock(struct sock *sk);
+
+static void smap_state_change(struct sock *sk)
+{
+	void (*state_change)(struct sock *sk);
+	struct smap_psock *psock;
+	bool release = false;
+
+	rcu_read_lock();
+	psock = smap_psock_sk(sk);
+	if (likely(psock)) {
+		/* only established sockets stay in the map */
+		if (sk->sk_state != TCP_ESTABLISHED &&
+		    cmpxchg(&psock->stab->sock_map[psock->key], sk, NULL) == sk)
+			release = true;
+		state_change = psock->save_state_change;
+	} else {
+		state_change = sk->sk_state_change;
+	}
+	rcu_read_unlock();
+
+	if (release)
+		smap_release_sock(sk);
+	state_change(sk);
+}
+
+static int smap_sendmsg(struct sock *sk, void *data, size_t len)
+{
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL };
+	struct kvec iov = { .iov_base = data, .iov_len = len };
+	mm_segment_t oldfs = get_fs();
+	int ret;
+
+	set_fs(KERNEL_DS);
+	iov_iter_init(&msg.msg_iter, WRITE, (struct iovec *)&iov, 1, len);
+	ret = tcp_sendmsg(NULL, sk, &msg, len);
+	set_fs(oldfs);
+	return ret;
+}
+
+static int smap_sendpage(struct sock *sk, struct page *page, int offset,
+			 size_t len)
+{
+	int ret;
+
+	/* tcp_sendpage() falls back to the socket, which may be gone */
+	if ((sk->sk_route_caps & NETIF_F_SG) &&
+	    (sk->sk_route_caps & NETIF_F_ALL_CSUM))
+		return tcp_sendpage(sk, page, offset, len,
+				    MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	ret = smap_sendmsg(sk, kmap(page) + offset, len);
+	kunmap(page);
+	return ret;
+}
+
+/* send skb from byte *off on, returns 0 once all of it is queued */
+static int smap_send_skb(struct sock *sk, struct sk_buff *skb, int *off)
+{
+	int headlen = skb_headlen(skb);
+	int i, pos, ret;
+
+	while (*off < headlen) {
+		ret = smap_sendmsg(sk, skb->data + *off, headlen - *off);
+		if (ret <= 0)
+			return ret ? : -EAGAIN;
+		*off += ret;
+	}
+
+	pos = headlen;
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+		int size = skb_frag_size(frag);
+
+		while (*off < pos + size) {
+			int foff = *off - pos;
+
+			ret = smap_sendpage(sk, skb_frag_page(frag),
+					    frag->page_offset + foff,
+					    size - foff);
+			if (ret <= 0)
+				return ret ? : -EAGAIN;
+			*off += ret;
+		}
+		pos += size;
+	}
+
+	return 0;
+}
+
+static void smap_tx_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock, tx_work);
+	struct sock *sk = psock->sock;
+	struct sk_buff *skb;
+	int off, err;
+
+	if (psock->save_skb) {
+		skb = psock->save_skb;
+		off = psock->save_off;
+		psock->save_skb = NULL;
+	} else {
+		skb = skb_dequeue(&psock->txqueue);
+		off = 0;
+	}
+
+	while (skb) {
+		err = smap_send_skb(sk, skb, &off);
+		if (err == -EAGAIN) {
+			/* sk_write_space() schedules us again */
+			psock->save_skb = skb;
+			psock->save_off = off;
+			return;
+		}
+		kfree_skb(skb);
+		if (err) {
+			/* the stream is broken, so is everything behind it */
+			skb_queue_purge(&psock->txqueue);
+			return;
+		}
+		skb = skb_dequeue(&psock->txqueue);
+		off = 0;
+	}
+}
+
+static void smap_gc_work(struct work_struct *w)
+{
+	struct smap_psock *psock = container_of(w, struct smap_psock, gc_work);
+
+	cancel_work_sync(&psock->tx_work);
+	kfree_skb(psock->save_skb);
+	skb_queue_purge(&psock->txqueue);
+	sock_put(psock->sock);
+	kfree(psock);
+}
+
+static void smap_destroy_psock(struct rcu_head *rcu)
+{
+	struct smap_psock *psock = container_of(rcu, struct smap_psock, rcu);
+
+	/* tx_work may sleep in the socket lock, wait for it elsewhere */
+	schedule_work(&psock->gc_work);
+}
+
+/* sk has already been taken out of its map slot */
+static void smap_release_sock(struct sock *sk)
+{
+	struct smap_psock *psock;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	psock = rcu_dereference_protected(__sk_user_data(sk),
+				lockdep_is_held(&sk->sk_callback_lock));
+	if (psock) {
+		sk->sk_data_ready = psock->save_data_ready;
+		sk->sk_write_space = psock->save_write_space;
+		sk->sk_state_change = psock->save_state_change;
+		rcu_assign_sk_user_data(sk, NULL);
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (psock)
+		call_rcu(&psock->rcu, smap_destroy_psock);
+}
+
+static int smap_attach_sock(struct bpf_stab *stab, struct sock *sk, u32 key)
+{
+	struct smap_psock *psock;
+	int err = 0;
+
+	psock = kzalloc(sizeof(*psock), GFP_ATOMIC | __GFP_NOWARN);
+	if (!psock)
+		return -ENOMEM;
+
+	psock->sock = sk;
+	psock->stab = stab;
+	psock->key = key;
+	skb_queue_head_init(&psock->txqueue);
+	INIT_WORK(&psock->tx_work, smap_tx_work);
+	INIT_WORK(&psock->gc_work, smap_gc_work);
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (sk->sk_user_data) {
+		/* in another slot already, or owned by someone else */
+		err = -EBUSY;
+	} else if (sk->sk_state != TCP_ESTABLISHED) {
+		err = -ENOTCONN;
+	} else {
+		psock->save_data_ready = sk->sk_data_ready;
+		psock->save_write_space = sk->sk_write_space;
+		psock->save_state_change = sk->sk_state_change;
+		sock_hold(sk);
+		rcu_assign_sk_user_data(sk, psock);
+		sk->sk_data_ready = smap_data_ready;
+		sk->sk_write_space = smap_write_space;
+		sk->sk_state_change = smap_state_change;
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
+
+	if (err)
+		kfree(psock);
+	return err;
+}
+
+/* Called from syscall */
+static struct bpf_map *sock_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_stab *stab;
+	u32 size;
+
+	/* user space passes socket fds, the map keeps the sockets */
+	if (attr->max_entries == 0 || attr->key_size != 4 ||
+	    attr->value_size != sizeof(u32))
+		return ERR_PTR(-EINVAL);
+
+	if (attr->max_entries > (U32_MAX - sizeof(*stab)) / sizeof(void *))
+		return ERR_PTR(-ENOMEM);
+
+	size = sizeof(*stab) + attr->max_entries * sizeof(void *);
+	stab = kzalloc(size, GFP_USER | __GFP_NOWARN);
+	if (!stab) {
+		stab = vzalloc(size);
+		if (!stab)
+			return ERR_PTR(-ENOMEM);
+	}
+
+	stab->map.key_size = attr->key_size;
+	stab->map.value_size = attr->value_size;
+	stab->map.max_entries = attr->max_entries;
+
+	return &stab->map;
+}
+
+/* Called from syscall or from map_free */
+void sock_map_clear(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *prog;
+	struct sock *sk;
+	int i;
+
+	prog = xchg(&stab->bpf_verdict, NULL);
+	if (prog)
+		bpf_prog_put_rcu(prog);
+
+	for (i = 0; i < map->max_entries; i++) {
+		sk = xchg(&stab->sock_map[i], NULL);
+		if (sk)
+			smap_release_sock(sk);
+	}
+}
+
+static void sock_map_free(struct bpf_map *map)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+
+	sock_map_clear(map);
+
+	/* sockets found in the map before it was cleared may still be
+	 * running callbacks that look at it
+	 */
+	synchronize_rcu();
+
+	kvfree(stab);
+}
+
+/* Called from syscall */
+static int sock_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
+{
+	u32 index = *(u32 *)key;
+	u32 *next = (u32 *)next_key;
+
+	if (index >= map->max_entries) {
+		*next = 0;
+		return 0;
+	}
+
+	if (index == map->max_entries - 1)
+		return -ENOENT;
+
+	*next = index + 1;
+	return 0;
+}
+
+/* Called from syscall, programs only reach the map through
+ * bpf_sk_redirect_map()
+ */
+static void *sock_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	return NULL;
+}
+
+/* Called from syscall */
+static int sock_map_update_elem(struct bpf_map *map, void *key, void *value,
+				u64 map_flags)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 index = *(u32 *)key;
+	struct socket *sock;
+	struct sock *sk, *old;
+	int err;
+
+	if (map_flags > BPF_EXIST)
+		return -EINVAL;
+
+	if (index >= map->max_entries)
+		return -E2BIG;
+
+	sock = sockfd_lookup(*(u32 *)value, &err);
+	if (!sock)
+		return err;
+
+	sk = sock->sk;
+	err = -EOPNOTSUPP;
+	if (sk->sk_type != SOCK_STREAM || sk->sk_protocol != IPPROTO_TCP)
+		goto out;
+
+	err = -EEXIST;
+	if (map_flags == BPF_NOEXIST && READ_ONCE(stab->sock_map[index]))
+		goto out;
+	err = -ENOENT;
+	if (map_flags == BPF_EXIST && !READ_ONCE(stab->sock_map[index]))
+		goto out;
+
+	err = smap_attach_sock(stab, sk, index);
+	if (err)
+		goto out;
+
+	old = xchg(&stab->sock_map[index], sk);
+	if (old)
+		smap_release_sock(old);
+
+	/* sk_state_change() could not find the slot before it was set */
+	if (sk->sk_state != TCP_ESTABLISHED &&
+	    cmpxchg(&stab->sock_map[index], sk, NULL) == sk)
+		smap_release_sock(sk);
+out:
+	fput(sock->file);
+	return err;
+}
+
+/* Called from syscall */
+static int sock_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	u32 index = *(u32 *)key;
+	struct sock *sk;
+
+	if (index >= map->max_entries)
+		return -E2BIG;
+
+	sk = xchg(&stab->sock_map[index], NULL);
+	if (!sk)
+		return -ENOENT;
+
+	smap_release_sock(sk);
+	return 0;
+}
+
+/* Called from syscall, prog is NULL to detach */
+int sock_map_prog(struct bpf_map *map, struct bpf_prog *prog,
+		  enum bpf_attach_type type)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct bpf_prog *orig;
+
+	if (type != BPF_SK_SKB_STREAM_VERDICT)
+		return -EINVAL;
+
+	orig = xchg(&stab->bpf_verdict, prog);
+	if (orig)
+		/* sk_data_ready() may still be running it */
+		bpf_prog_put_rcu(orig);
+
+	return 0;
+}
+
+static struct bpf_map_ops sock_map_ops = {
+	.map_alloc = sock_map_alloc,
+	.map_free = sock_map_free,
+	.map_get_next_key = sock_map_get_next_key,
+	.map_lookup_elem = sock_map_lookup_elem,
+	.map_update_elem = sock_map_update_elem,
+	.map_delete_elem = sock_map_delete_elem,
+};
+
+static struct bpf_map_type_list sock_map_tl = {
+	.ops = &sock_map_ops,
+	.type = BPF_MAP_TYPE_SOCKMAP,
+};
+
+static int __init register_sock_map(void)
+{
+	BUILD_BUG_ON(sizeof(struct smap_skb_cb) >
+		     FIELD_SIZEOF(struct sk_buff, cb));
+	bpf_register_map_type(&sock_map_tl);
+	return 0;
+}
+late_initcall(register_sock_map);
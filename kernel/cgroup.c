@@ -57,6 +57,7 @@
 #include <linux/vmalloc.h> /* TODO: replace with more sophisticated array */
 #include <linux/kthread.h>
 #include <linux/delay.h>
+#include <linux/psi.h>
 
 #include <linux/atomic.h>
 
@@ -91,6 +92,12 @@ static DEFINE_MUTEX(cgroup_mutex);
 static DECLARE_RWSEM(css_set_rwsem);
 #endif
 
+/*
+ * Protects threadgroups against changes while tasks are being migrated.
+ * See threadgroup_change_begin().
+ */
+struct percpu_rw_semaphore cgroup_threadgroup_rwsem;
+
 /*
  * Protects cgroup_idr and css_idr so that IDs can be released without
  * grabbing cgroup_mutex.
@@ -226,15 +233,6 @@ static void cgroup_idr_remove(struct idr *idr, int id)
 	spin_unlock_bh(&cgroup_idr_lock);
 }
 
-static struct cgroup *cgroup_parent(struct cgroup *cgrp)
-{
-	struct cgroup_subsys_state *parent_css = cgrp->self.parent;
-
-	if (parent_css)
-		return container_of(parent_css, struct cgroup, self);
-	return NULL;
-}
-
 /**
  * cgroup_css - obtain a cgroup's css for the specified subsystem
  * @cgrp: the cgroup of interest
@@ -2052,7 +2050,7 @@ static void cgroup_task_migrate(struct cgroup *old_cgrp,
 	lockdep_assert_held(&css_set_rwsem);
 
 	/*
-	 * We are synchronized through threadgroup_lock() against PF_EXITING
+	 * We are synchronized through cgroup_threadgroup_rwsem against PF_EXITING
 	 * setting such that we can't race against cgroup_exit() changing the
 	 * css_set to init_css_set and dropping the old one.
 	 */
@@ -2060,7 +2058,7 @@ static void cgroup_task_migrate(struct cgroup *old_cgrp,
 	old_cset = task_css_set(tsk);
 
 	get_css_set(new_cset);
-	rcu_assign_pointer(tsk->cgroups, new_cset);
+	cgroup_move_task(tsk, new_cset);
 
 	/*
 	 * Use move_tail so that cgroup_taskset_first() still returns the
@@ -2111,10 +2109,11 @@ static void cgroup_migrate_finish(struct list_head *preloaded_csets)
  * @src_cset and add it to @preloaded_csets, which should later be cleaned
  * up by cgroup_migrate_finish().
  *
- * This function may be called without holding threadgroup_lock even if the
- * target is a process.  Threads may be created and destroyed but as long
- * as cgroup_mutex is not dropped, no new css_set can be put into play and
- * the preloaded css_sets are guaranteed to cover all migrations.
+ * This function may be called without holding cgroup_threadgroup_rwsem
+ * even if the target is a process.  Threads may be created and destroyed
+ * but as long as cgroup_mutex is not dropped, no new css_set can be put
+ * into play and the preloaded css_sets are guaranteed to cover all
+ * migrations.
  */
 static void cgroup_migrate_add_src(struct css_set *src_cset,
 				   struct cgroup *dst_cgrp,
@@ -2217,7 +2216,7 @@ err:
  * @threadgroup: whether @leader points to the whole process or a single task
  *
  * Migrate a process or task denoted by @leader to @cgrp.  If migrating a
- * process, the caller must be holding threadgroup_lock of @leader.  The
+ * process, the caller must be holding cgroup_threadgroup_rwsem.  The
  * caller is also responsible for invoking cgroup_migrate_add_src() and
  * cgroup_migrate_prepare_dst() on the targets before invoking this
  * function and following up with cgroup_migrate_finish().
@@ -2345,7 +2344,7 @@ out_release_tset:
  * @leader: the task or the leader of the threadgroup to be attached
  * @threadgroup: attach the whole threadgroup?
  *
- * Call holding cgroup_mutex and threadgroup_lock of @leader.
+ * Call holding cgroup_mutex and cgroup_threadgroup_rwsem.
  */
 static int cgroup_attach_task(struct cgroup *dst_cgrp,
 			      struct task_struct *leader, bool threadgroup)
@@ -2397,14 +2396,18 @@ static ssize_t __cgroup_procs_write(struct kernfs_open_file *of, char *buf,
 	if (!cgrp)
 		return -ENODEV;
 
-retry_find_task:
+	/*
+	 * Holding cgroup_threadgroup_rwsem for writing keeps every
+	 * threadgroup stable, including ->group_leader across de_thread(),
+	 * so the leader looked up below can't change under us.
+	 */
+	percpu_down_write(&cgroup_threadgroup_rwsem);
 	rcu_read_lock();
 	if (pid) {
 		tsk = find_task_by_vpid(pid);
 		if (!tsk) {
-			rcu_read_unlock();
 			ret = -ESRCH;
-			goto out_unlock_cgroup;
+			goto out_unlock_rcu;
 		}
 		/*
 		 * even if we're attaching all tasks in the thread group, we
@@ -2414,9 +2417,8 @@ retry_find_task:
 		if (!uid_eq(cred->euid, GLOBAL_ROOT_UID) &&
 		    !uid_eq(cred->euid, tcred->uid) &&
 		    !uid_eq(cred->euid, tcred->suid)) {
-			rcu_read_unlock();
 			ret = -EACCES;
-			goto out_unlock_cgroup;
+			goto out_unlock_rcu;
 		}
 	} else
 		tsk = current;
@@ -2431,35 +2433,21 @@ retry_find_task:
 	 */
 	if (tsk == kthreadd_task || (tsk->flags & PF_NO_SETAFFINITY)) {
 		ret = -EINVAL;
-		rcu_read_unlock();
-		goto out_unlock_cgroup;
+		goto out_unlock_rcu;
 	}
 
 	get_task_struct(tsk);
 	rcu_read_unlock();
 
-	threadgroup_lock(tsk);
-	if (threadgroup) {
-		if (!thread_group_leader(tsk)) {
-			/*
-			 * a race with de_thread from another thread's exec()
-			 * may strip us of our leadership, if this happens,
-			 * there is no choice but to throw this task away and
-			 * try again; this is
-			 * "double-double-toil-and-trouble-check locking".
-			 */
-			threadgroup_unlock(tsk);
-			put_task_struct(tsk);
-			goto retry_find_task;
-		}
-	}
-
 	ret = cgroup_attach_task(cgrp, tsk, threadgroup);
 
-	threadgroup_unlock(tsk);
-
 	put_task_struct(tsk);
-out_unlock_cgroup:
+	goto out_unlock_threadgroup;
+
+out_unlock_rcu:
+	rcu_read_unlock();
+out_unlock_threadgroup:
+	percpu_up_write(&cgroup_threadgroup_rwsem);
 	cgroup_kn_unlock(of->kn);
 	return ret ?: nbytes;
 }
@@ -2626,6 +2614,11 @@ static int cgroup_update_dfl_csses(struct cgroup *cgrp)
 	if (ret)
 		goto out_finish;
 
+	/*
+	 * Migrate the whole batch under one write hold of
+	 * cgroup_threadgroup_rwsem instead of locking each process.
+	 */
+	percpu_down_write(&cgroup_threadgroup_rwsem);
 	list_for_each_entry(src_cset, &preloaded_csets, mg_preload_node) {
 		struct task_struct *last_task = NULL, *task;
 
@@ -2658,27 +2651,20 @@ static int cgroup_update_dfl_csses(struct cgroup *cgrp)
 			/* guard against possible infinite loop */
 			if (WARN(last_task == task,
 				 "cgroup: update_dfl_csses failed to make progress, aborting in inconsistent state\n"))
-				goto out_finish;
+				goto out_unlock;
 			last_task = task;
 
-			threadgroup_lock(task);
-			/* raced against de_thread() from another thread? */
-			if (!thread_group_leader(task)) {
-				threadgroup_unlock(task);
-				put_task_struct(task);
-				continue;
-			}
-
 			ret = cgroup_migrate(src_cset->dfl_cgrp, task, true);
 
-			threadgroup_unlock(task);
 			put_task_struct(task);
 
 			if (WARN(ret, "cgroup: failed to update controllers for the default hierarchy (%d), further operations may crash or hang\n", ret))
-				goto out_finish;
+				goto out_unlock;
 		}
 	}
 
+out_unlock:
+	percpu_up_write(&cgroup_threadgroup_rwsem);
 out_finish:
 	cgroup_migrate_finish(&preloaded_csets);
 	return ret;
@@ -2926,6 +2912,29 @@ static int cgroup_populated_show(struct seq_file *seq, void *v)
 	return 0;
 }
 
+#ifdef CONFIG_PSI
+/* the root cgroup reports the system-wide pressure */
+static struct psi_group *cgroup_psi(struct cgroup *cgrp)
+{
+	return cgroup_parent(cgrp) ? &cgrp->psi : &psi_system;
+}
+
+static int cgroup_io_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, cgroup_psi(seq_css(seq)->cgroup), PSI_IO);
+}
+
+static int cgroup_memory_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, cgroup_psi(seq_css(seq)->cgroup), PSI_MEM);
+}
+
+static int cgroup_cpu_pressure_show(struct seq_file *seq, void *v)
+{
+	return psi_show(seq, cgroup_psi(seq_css(seq)->cgroup), PSI_CPU);
+}
+#endif /* CONFIG_PSI */
+
 static ssize_t cgroup_file_write(struct kernfs_open_file *of, char *buf,
 				 size_t nbytes, loff_t off)
 {
@@ -4099,6 +4108,63 @@ int cgroupstats_build(struct cgroupstats *stats, struct dentry *dentry)
 	return 0;
 }
 
+/**
+ * cgroup_task_pids - get the pids of the tasks in a cgroup
+ * @dentry: A dentry entry belonging to the cgroup of interest
+ * @nrp: the number of pids is returned here
+ *
+ * Returns an array with the pids, in the caller's pid namespace, of the
+ * tasks in the cgroup, or an ERR_PTR().  Tasks that aren't visible in
+ * the caller's namespace are left out.  The array must be released with
+ * kvfree().
+ */
+pid_t *cgroup_task_pids(struct dentry *dentry, int *nrp)
+{
+	struct kernfs_node *kn = kernfs_node_from_dentry(dentry);
+	struct cgroup *cgrp;
+	struct css_task_iter it;
+	struct task_struct *tsk;
+	pid_t *pids, pid;
+	int length, n = 0;
+
+	/* it should be kernfs_node belonging to cgroupfs and is a directory */
+	if (dentry->d_sb->s_type != &cgroup_fs_type || !kn ||
+	    kernfs_type(kn) != KERNFS_DIR)
+		return ERR_PTR(-EINVAL);
+
+	mutex_lock(&cgroup_mutex);
+
+	/* see cgroupstats_build() */
+	rcu_read_lock();
+	cgrp = rcu_dereference(kn->priv);
+	if (!cgrp || cgroup_is_dead(cgrp)) {
+		rcu_read_unlock();
+		mutex_unlock(&cgroup_mutex);
+		return ERR_PTR(-ENOENT);
+	}
+	rcu_read_unlock();
+
+	/* tasks forked after the count was taken are left out */
+	length = cgroup_task_count(cgrp);
+	pids = pidlist_allocate(length ?: 1);
+	if (!pids) {
+		mutex_unlock(&cgroup_mutex);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	css_task_iter_start(&cgrp->self, &it);
+	while (n < length && (tsk = css_task_iter_next(&it))) {
+		pid = task_pid_vnr(tsk);
+		if (pid > 0)
+			pids[n++] = pid;
+	}
+	css_task_iter_end(&it);
+
+	mutex_unlock(&cgroup_mutex);
+	*nrp = n;
+	return pids;
+}
+
 
 /*
  * seq_file methods for the tasks/procs files. The seq_file position is the
@@ -4266,6 +4332,20 @@ static struct cftype cgroup_dfl_base_files[] = {
 		.flags = CFTYPE_NOT_ON_ROOT,
 		.seq_show = cgroup_populated_show,
 	},
+#ifdef CONFIG_PSI
+	{
+		.name = "io.pressure",
+		.seq_show = cgroup_io_pressure_show,
+	},
+	{
+		.name = "memory.pressure",
+		.seq_show = cgroup_memory_pressure_show,
+	},
+	{
+		.name = "cpu.pressure",
+		.seq_show = cgroup_cpu_pressure_show,
+	},
+#endif
 	{ }	/* terminate */
 };
 
@@ -4399,6 +4479,7 @@ static void css_free_work_fn(struct work_struct *work)
 			 */
 			cgroup_put(cgroup_parent(cgrp));
 			kernfs_put(cgrp->kn);
+			psi_cgroup_free(cgrp);
 			kfree(cgrp);
 		} else {
 			/*
@@ -4642,6 +4723,12 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	cgrp->self.parent = &parent->self;
 	cgrp->root = root;
 
+	if (cgroup_on_dfl(cgrp)) {
+		ret = psi_cgroup_alloc(cgrp);
+		if (ret)
+			goto out_free_id;
+	}
+
 	if (notify_on_release(parent))
 		set_bit(CGRP_NOTIFY_ON_RELEASE, &cgrp->flags);
 
@@ -4713,6 +4800,7 @@ static int cgroup_mkdir(struct kernfs_node *parent_kn, const char *name,
 	goto out_unlock;
 
 out_free_id:
+	psi_cgroup_free(cgrp);
 	cgroup_idr_remove(&root->cgroup_idr, cgrp->id);
 out_cancel_ref:
 	percpu_ref_exit(&cgrp->self.refcnt);
@@ -4986,6 +5074,7 @@ int __init cgroup_init(void)
 	unsigned long key;
 	int ssid, err;
 
+	BUG_ON(percpu_init_rwsem(&cgroup_threadgroup_rwsem));
 	BUG_ON(cgroup_init_cftypes(NULL, cgroup_dfl_base_files));
 	BUG_ON(cgroup_init_cftypes(NULL, cgroup_legacy_base_files));
 
@@ -5281,7 +5370,7 @@ void cgroup_exit(struct task_struct *tsk)
 
 	/* Reassign the task to the init_css_set. */
 	cset = task_css_set(tsk);
-	RCU_INIT_POINTER(tsk->cgroups, &init_css_set);
+	cgroup_move_task(tsk, &init_css_set);
 
 	if (need_forkexit_callback) {
 		/* see cgroup_post_fork() for details */
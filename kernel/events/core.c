@@ -18,6 +18,7 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/hash.h>
+#include <linux/hashtable.h>
 #include <linux/tick.h>
 #include <linux/sysfs.h>
 #include <linux/dcache.h>
@@ -42,6 +43,8 @@
 #include <linux/module.h>
 #include <linux/mman.h>
 #include <linux/compat.h>
+#include <linux/filter.h>
+#include <linux/bpf.h>
 
 #include "internal.h"
 
@@ -150,10 +153,15 @@ enum event_type_t {
 /*
  * perf_sched_events : >0 events exist
  * perf_cgroup_events: >0 per-cpu cgroup events exist on this cpu
+ * perf_cgroup_tables: cpu events counting into a per-cgroup table
  */
 struct static_key_deferred perf_sched_events __read_mostly;
 static DEFINE_PER_CPU(atomic_t, perf_cgroup_events);
+#ifdef CONFIG_CGROUP_PERF
+static DEFINE_PER_CPU(struct list_head, perf_cgroup_tables);
+#endif
 static DEFINE_PER_CPU(atomic_t, perf_branch_stack_events);
+static DEFINE_PER_CPU(atomic_t, perf_sched_cb_events);
 
 static atomic_t nr_mmap_events __read_mostly;
 static atomic_t nr_comm_events __read_mostly;
@@ -679,6 +687,329 @@ perf_cgroup_mark_enabled(struct perf_event *event,
 		}
 	}
 }
+
+/*
+ * Per-cgroup counting tables.
+ *
+ * A pinned cpu event with cgroups attached through
+ * PERF_EVENT_IOC_ATTACH_CGROUP keeps counting for everything that runs
+ * on its cpu; at each context switch between cgroups the delta since
+ * the previous switch is charged to the outgoing task's cgroup and to
+ * each of its ancestors present in the table.  One event per cpu thus
+ * replaces one cgroup event per cgroup per cpu, and nothing has to be
+ * rescheduled on the PMU when the cgroup changes.
+ *
+ * The table is only ever touched on event->cpu with interrupts
+ * disabled: from the context switch path, or by IPI from the ioctls.
+ * table->mutex serializes the ioctls against each other for the case
+ * where the cpu is offline and they run the IPI function directly.
+ */
+#define PERF_CGROUP_TABLE_BITS	6
+
+struct perf_cgroup_node {
+	struct hlist_node		node;
+	struct perf_cgroup		*cgrp;
+	u64				count;
+};
+
+struct perf_cgroup_table {
+	struct perf_event		*event;
+	struct list_head		entry;	/* on perf_cgroup_tables */
+	struct mutex			mutex;
+	u64				last;	/* event count at last switch */
+	DECLARE_HASHTABLE(nodes, PERF_CGROUP_TABLE_BITS);
+};
+
+struct perf_cgroup_table_op {
+	struct perf_event		*event;
+	struct perf_cgroup		*cgrp;
+	struct perf_cgroup_node		*node;
+	u64				count;
+};
+
+static struct perf_cgroup *perf_cgroup_get(int fd)
+{
+	struct cgroup_subsys_state *css;
+	struct fd f = fdget(fd);
+
+	if (!f.file)
+		return ERR_PTR(-EBADF);
+
+	css = css_tryget_online_from_dir(f.file->f_path.dentry,
+					 &perf_event_cgrp_subsys);
+	fdput(f);
+	if (IS_ERR(css))
+		return ERR_CAST(css);
+
+	return container_of(css, struct perf_cgroup, css);
+}
+
+static struct perf_cgroup_node *
+perf_cgroup_table_find(struct perf_cgroup_table *table, struct perf_cgroup *cgrp)
+{
+	struct perf_cgroup_node *node;
+
+	hash_for_each_possible(table->nodes, node, node, (unsigned long)cgrp) {
+		if (node->cgrp == cgrp)
+			return node;
+	}
+
+	return NULL;
+}
+
+static u64 perf_cgroup_table_count(struct perf_event *event)
+{
+	if (event->state == PERF_EVENT_STATE_ACTIVE &&
+	    event->oncpu == smp_processor_id())
+		event->pmu->read(event);
+
+	return local64_read(&event->count);
+}
+
+/*
+ * Charge what the event counted since the last switch to @cgrp and its
+ * ancestors.  Called on event->cpu with ctx->lock held.
+ */
+static void perf_cgroup_table_account(struct perf_event *event,
+				      struct perf_cgroup *cgrp)
+{
+	struct perf_cgroup_table *table = event->cgrp_table;
+	struct cgroup_subsys_state *css;
+	struct perf_cgroup_node *node;
+	u64 now, delta;
+
+	now = perf_cgroup_table_count(event);
+	/* PERF_EVENT_IOC_RESET can move the count backwards */
+	delta = now >= table->last ? now - table->last : now;
+	table->last = now;
+	if (!delta)
+		return;
+
+	for (css = &cgrp->css; css; css = css->parent) {
+		node = perf_cgroup_table_find(table,
+				container_of(css, struct perf_cgroup, css));
+		if (node)
+			node->count += delta;
+	}
+}
+
+static inline void perf_cgroup_table_sched_out(struct task_struct *task,
+					       struct task_struct *next)
+{
+	struct list_head *tables = this_cpu_ptr(&perf_cgroup_tables);
+	struct perf_cgroup_table *table;
+	struct perf_cgroup *cgrp;
+
+	if (list_empty(tables))
+		return;
+
+	rcu_read_lock();
+	cgrp = perf_cgroup_from_task(task);
+	if (cgrp != perf_cgroup_from_task(next)) {
+		list_for_each_entry(table, tables, entry) {
+			raw_spin_lock(&table->event->ctx->lock);
+			perf_cgroup_table_account(table->event, cgrp);
+			raw_spin_unlock(&table->event->ctx->lock);
+		}
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Run @func on event->cpu, or right here if that cpu is offline, in
+ * which case nothing else can be looking at the table.
+ */
+static int perf_cgroup_table_call(struct perf_event *event,
+				  int (*func)(void *), void *info)
+{
+	int ret;
+
+	get_online_cpus();
+	ret = cpu_function_call(event->cpu, func, info);
+	if (ret == -ENXIO) {
+		local_irq_disable();
+		ret = func(info);
+		local_irq_enable();
+	}
+	put_online_cpus();
+
+	return ret;
+}
+
+static int __perf_cgroup_table_attach(void *info)
+{
+	struct perf_cgroup_table_op *op = info;
+	struct perf_event *event = op->event;
+	struct perf_cgroup_table *table = event->cgrp_table;
+
+	if (perf_cgroup_table_find(table, op->node->cgrp))
+		return -EEXIST;
+
+	if (list_empty(&table->entry)) {
+		raw_spin_lock(&event->ctx->lock);
+		table->last = perf_cgroup_table_count(event);
+		raw_spin_unlock(&event->ctx->lock);
+		list_add(&table->entry, per_cpu_ptr(&perf_cgroup_tables, event->cpu));
+	}
+	hash_add(table->nodes, &op->node->node, (unsigned long)op->node->cgrp);
+
+	return 0;
+}
+
+static int __perf_cgroup_table_read(void *info)
+{
+	struct perf_cgroup_table_op *op = info;
+	struct perf_event *event = op->event;
+	struct perf_cgroup_node *node;
+
+	raw_spin_lock(&event->ctx->lock);
+	/* bring the cgroup running right now up to date as well */
+	if (!list_empty(&event->cgrp_table->entry) &&
+	    event->cpu == smp_processor_id()) {
+		rcu_read_lock();
+		perf_cgroup_table_account(event, perf_cgroup_from_task(current));
+		rcu_read_unlock();
+	}
+	node = perf_cgroup_table_find(event->cgrp_table, op->cgrp);
+	if (node)
+		op->count = node->count;
+	raw_spin_unlock(&event->ctx->lock);
+
+	return node ? 0 : -ENOENT;
+}
+
+static int __perf_cgroup_table_del(void *info)
+{
+	struct perf_cgroup_table *table = info;
+
+	list_del_init(&table->entry);
+
+	return 0;
+}
+
+static struct perf_cgroup_table *perf_cgroup_table_get(struct perf_event *event)
+{
+	struct perf_cgroup_table *table = ACCESS_ONCE(event->cgrp_table);
+
+	if (table)
+		return table;
+
+	table = kzalloc(sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	table->event = event;
+	INIT_LIST_HEAD(&table->entry);
+	mutex_init(&table->mutex);
+	hash_init(table->nodes);
+
+	if (cmpxchg(&event->cgrp_table, NULL, table)) {
+		kfree(table);
+		return event->cgrp_table;
+	}
+
+	/* the context switch hook hangs off perf_sched_events */
+	static_key_slow_inc(&perf_sched_events.key);
+
+	return table;
+}
+
+static int perf_cgroup_table_attach(struct perf_event *event, int fd)
+{
+	struct perf_cgroup_table_op op = { .event = event };
+	struct perf_cgroup_table *table;
+	struct perf_cgroup *cgrp;
+	int ret;
+
+	/*
+	 * Only a pinned cpu event sees everything that runs on its cpu,
+	 * which is what makes the per-switch deltas add up.
+	 */
+	if (event->cpu == -1 || (event->attach_state & PERF_ATTACH_TASK) ||
+	    is_cgroup_event(event) || !event->attr.pinned ||
+	    event->group_leader != event)
+		return -EINVAL;
+
+	table = perf_cgroup_table_get(event);
+	if (!table)
+		return -ENOMEM;
+
+	cgrp = perf_cgroup_get(fd);
+	if (IS_ERR(cgrp))
+		return PTR_ERR(cgrp);
+
+	op.node = kzalloc(sizeof(*op.node), GFP_KERNEL);
+	if (!op.node) {
+		css_put(&cgrp->css);
+		return -ENOMEM;
+	}
+	op.node->cgrp = cgrp;
+
+	mutex_lock(&table->mutex);
+	ret = perf_cgroup_table_call(event, __perf_cgroup_table_attach, &op);
+	mutex_unlock(&table->mutex);
+
+	if (ret) {
+		css_put(&cgrp->css);
+		kfree(op.node);
+	}
+
+	return ret;
+}
+
+static int perf_cgroup_table_read(struct perf_event *event, void __user *arg)
+{
+	struct perf_cgroup_table *table = ACCESS_ONCE(event->cgrp_table);
+	struct perf_cgroup_table_op op = { .event = event };
+	struct perf_event_cgroup_count cc;
+	int ret;
+
+	if (copy_from_user(&cc, arg, sizeof(cc)))
+		return -EFAULT;
+
+	if (!table)
+		return -ENOENT;
+
+	op.cgrp = perf_cgroup_get(cc.cgroup_fd);
+	if (IS_ERR(op.cgrp))
+		return PTR_ERR(op.cgrp);
+
+	mutex_lock(&table->mutex);
+	ret = perf_cgroup_table_call(event, __perf_cgroup_table_read, &op);
+	mutex_unlock(&table->mutex);
+
+	css_put(&op.cgrp->css);
+	if (ret)
+		return ret;
+
+	cc.count = op.count;
+	if (copy_to_user(arg, &cc, sizeof(cc)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static void perf_cgroup_table_free(struct perf_event *event)
+{
+	struct perf_cgroup_table *table = event->cgrp_table;
+	struct perf_cgroup_node *node;
+	struct hlist_node *tmp;
+	int bkt;
+
+	if (!table)
+		return;
+
+	perf_cgroup_table_call(event, __perf_cgroup_table_del, table);
+
+	hash_for_each_safe(table->nodes, bkt, tmp, node, node) {
+		css_put(&node->cgrp->css);
+		kfree(node);
+	}
+	kfree(table);
+	event->cgrp_table = NULL;
+
+	static_key_slow_dec_deferred(&perf_sched_events);
+}
 #else /* !CONFIG_CGROUP_PERF */
 
 static inline bool
@@ -718,6 +1049,26 @@ static inline void perf_cgroup_sched_in(struct task_struct *prev,
 {
 }
 
+static inline void perf_cgroup_table_sched_out(struct task_struct *task,
+					       struct task_struct *next)
+{
+}
+
+static inline int perf_cgroup_table_attach(struct perf_event *event, int fd)
+{
+	return -EINVAL;
+}
+
+static inline int perf_cgroup_table_read(struct perf_event *event,
+					 void __user *arg)
+{
+	return -EINVAL;
+}
+
+static inline void perf_cgroup_table_free(struct perf_event *event)
+{
+}
+
 static inline int perf_cgroup_connect(pid_t pid, struct perf_event *event,
 				      struct perf_event_attr *attr,
 				      struct perf_event *group_leader)
@@ -2451,11 +2802,19 @@ unlock:
  * accessing the event control register. If a NMI hits, then it will
  * not restart the event.
  */
+static void perf_pmu_sched_task(struct task_struct *prev,
+				struct task_struct *next,
+				bool sched_in);
+
 void __perf_event_task_sched_out(struct task_struct *task,
 				 struct task_struct *next)
 {
 	int ctxn;
 
+	/* let system-wide events flush what they buffered for @task */
+	if (atomic_read(this_cpu_ptr(&perf_sched_cb_events)))
+		perf_pmu_sched_task(task, next, false);
+
 	for_each_task_context_nr(ctxn)
 		perf_event_context_sched_out(task, ctxn, next);
 
@@ -2466,6 +2825,8 @@ void __perf_event_task_sched_out(struct task_struct *task,
 	 */
 	if (atomic_read(this_cpu_ptr(&perf_cgroup_events)))
 		perf_cgroup_sched_out(task, next);
+
+	perf_cgroup_table_sched_out(task, next);
 }
 
 static void task_ctx_sched_out(struct perf_event_context *ctx)
@@ -2678,6 +3039,52 @@ static void perf_branch_stack_sched_in(struct task_struct *prev,
 	local_irq_restore(flags);
 }
 
+/*
+ * Some PMUs keep samples in a hardware buffer and only hand them to
+ * perf when it fills up.  For system-wide events the samples carry the
+ * pid/tid of whatever task is current at that time, so the buffer has
+ * to be flushed on every context switch.
+ *
+ * Like perf_branch_stack_sched_in() this is only invoked when there is
+ * at least one system-wide event asking for it (PERF_ATTACH_SCHED_CB).
+ */
+static void perf_pmu_sched_task(struct task_struct *prev,
+				struct task_struct *next,
+				bool sched_in)
+{
+	struct perf_cpu_context *cpuctx;
+	struct pmu *pmu;
+	unsigned long flags;
+
+	if (prev == next)
+		return;
+
+	local_irq_save(flags);
+
+	rcu_read_lock();
+
+	list_for_each_entry_rcu(pmu, &pmus, entry) {
+		if (!pmu->sched_task)
+			continue;
+
+		cpuctx = this_cpu_ptr(pmu->pmu_cpu_context);
+
+		perf_ctx_lock(cpuctx, cpuctx->task_ctx);
+
+		perf_pmu_disable(pmu);
+
+		pmu->sched_task(cpuctx->task_ctx, sched_in);
+
+		perf_pmu_enable(pmu);
+
+		perf_ctx_unlock(cpuctx, cpuctx->task_ctx);
+	}
+
+	rcu_read_unlock();
+
+	local_irq_restore(flags);
+}
+
 /*
  * Called from scheduler to add the events of the current task
  * with interrupts disabled.
@@ -2713,6 +3120,9 @@ void __perf_event_task_sched_in(struct task_struct *prev,
 	/* check for system-wide branch_stack events */
 	if (atomic_read(this_cpu_ptr(&perf_branch_stack_events)))
 		perf_branch_stack_sched_in(prev, task);
+
+	if (atomic_read(this_cpu_ptr(&perf_sched_cb_events)))
+		perf_pmu_sched_task(prev, task, true);
 }
 
 static u64 perf_calculate_period(struct perf_event *event, u64 nsec, u64 count)
@@ -3283,6 +3693,7 @@ errout:
 }
 
 static void perf_event_free_filter(struct perf_event *event);
+static void perf_event_free_bpf_prog(struct perf_event *event);
 
 static void free_event_rcu(struct rcu_head *head)
 {
@@ -3308,6 +3719,8 @@ static void unaccount_event_cpu(struct perf_event *event, int cpu)
 		if (!(event->attach_state & PERF_ATTACH_TASK))
 			atomic_dec(&per_cpu(perf_branch_stack_events, cpu));
 	}
+	if (event->attach_state & PERF_ATTACH_SCHED_CB)
+		atomic_dec(&per_cpu(perf_sched_cb_events, cpu));
 	if (is_cgroup_event(event))
 		atomic_dec(&per_cpu(perf_cgroup_events, cpu));
 }
@@ -3331,6 +3744,8 @@ static void unaccount_event(struct perf_event *event)
 		static_key_slow_dec_deferred(&perf_sched_events);
 	if (has_branch_stack(event))
 		static_key_slow_dec_deferred(&perf_sched_events);
+	if (event->attach_state & PERF_ATTACH_SCHED_CB)
+		static_key_slow_dec_deferred(&perf_sched_events);
 
 	unaccount_event_cpu(event, event->cpu);
 }
@@ -3375,6 +3790,9 @@ static void _free_event(struct perf_event *event)
 	if (is_cgroup_event(event))
 		perf_detach_cgroup(event);
 
+	perf_cgroup_table_free(event);
+	perf_event_free_bpf_prog(event);
+
 	__free_event(event);
 }
 
@@ -3795,6 +4213,7 @@ static inline int perf_fget_light(int fd, struct fd *p)
 static int perf_event_set_output(struct perf_event *event,
 				 struct perf_event *output_event);
 static int perf_event_set_filter(struct perf_event *event, void __user *arg);
+static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd);
 
 static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
@@ -3849,6 +4268,15 @@ static long perf_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case PERF_EVENT_IOC_SET_FILTER:
 		return perf_event_set_filter(event, (void __user *)arg);
 
+	case PERF_EVENT_IOC_SET_BPF:
+		return perf_event_set_bpf_prog(event, arg);
+
+	case PERF_EVENT_IOC_ATTACH_CGROUP:
+		return perf_cgroup_table_attach(event, arg);
+
+	case PERF_EVENT_IOC_READ_CGROUP:
+		return perf_cgroup_table_read(event, (void __user *)arg);
+
 	default:
 		return -ENOTTY;
 	}
@@ -5013,9 +5441,9 @@ void perf_prepare_sample(struct perf_event_header *header,
 	}
 }
 
-static void perf_event_output(struct perf_event *event,
-				struct perf_sample_data *data,
-				struct pt_regs *regs)
+void perf_event_output(struct perf_event *event,
+			struct perf_sample_data *data,
+			struct pt_regs *regs)
 {
 	struct perf_output_handle handle;
 	struct perf_event_header header;
@@ -5907,12 +6335,13 @@ int perf_swevent_get_recursion_context(void)
 }
 EXPORT_SYMBOL_GPL(perf_swevent_get_recursion_context);
 
-inline void perf_swevent_put_recursion_context(int rctx)
+void perf_swevent_put_recursion_context(int rctx)
 {
 	struct swevent_htable *swhash = this_cpu_ptr(&swevent_htable);
 
 	put_recursion_context(swhash->recursion, rctx);
 }
+EXPORT_SYMBOL_GPL(perf_swevent_put_recursion_context);
 
 void __perf_sw_event(u32 event_id, u64 nr, struct pt_regs *regs, u64 addr)
 {
@@ -6276,6 +6705,51 @@ static void perf_event_free_filter(struct perf_event *event)
 	ftrace_profile_free_filter(event);
 }
 
+static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
+{
+	struct bpf_prog *prog;
+	bool is_probe;
+
+	if (event->attr.type != PERF_TYPE_TRACEPOINT)
+		return -EINVAL;
+
+	is_probe = event->tp_event->flags &
+		   (TRACE_EVENT_FL_KPROBE | TRACE_EVENT_FL_UPROBE);
+
+	prog = bpf_prog_get(prog_fd);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	if ((is_probe && prog->aux->prog_type != BPF_PROG_TYPE_KPROBE) ||
+	    (!is_probe && prog->aux->prog_type != BPF_PROG_TYPE_TRACEPOINT)) {
+		/* valid fd, but invalid bpf program type */
+		bpf_prog_put(prog);
+		return -EINVAL;
+	}
+
+	/* one program per event, whichever perf event attached it owns it */
+	if (cmpxchg(&event->tp_event->prog, NULL, prog)) {
+		bpf_prog_put(prog);
+		return -EEXIST;
+	}
+	event->prog = prog;
+
+	return 0;
+}
+
+static void perf_event_free_bpf_prog(struct perf_event *event)
+{
+	struct bpf_prog *prog = event->prog;
+
+	if (!prog)
+		return;
+
+	event->tp_event->prog = NULL;
+	event->prog = NULL;
+	/* the probe handler may still be running it */
+	bpf_prog_put_rcu(prog);
+}
+
 #else
 
 static inline void perf_tp_register(void)
@@ -6291,6 +6765,15 @@ static void perf_event_free_filter(struct perf_event *event)
 {
 }
 
+static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd)
+{
+	return -ENOENT;
+}
+
+static void perf_event_free_bpf_prog(struct perf_event *event)
+{
+}
+
 #endif /* CONFIG_EVENT_TRACING */
 
 #ifdef CONFIG_HAVE_HW_BREAKPOINT
@@ -6917,6 +7400,8 @@ static void account_event_cpu(struct perf_event *event, int cpu)
 		if (!(event->attach_state & PERF_ATTACH_TASK))
 			atomic_inc(&per_cpu(perf_branch_stack_events, cpu));
 	}
+	if (event->attach_state & PERF_ATTACH_SCHED_CB)
+		atomic_inc(&per_cpu(perf_sched_cb_events, cpu));
 	if (is_cgroup_event(event))
 		atomic_inc(&per_cpu(perf_cgroup_events, cpu));
 }
@@ -6940,6 +7425,8 @@ static void account_event(struct perf_event *event)
 	}
 	if (has_branch_stack(event))
 		static_key_slow_inc(&perf_sched_events.key);
+	if (event->attach_state & PERF_ATTACH_SCHED_CB)
+		static_key_slow_inc(&perf_sched_events.key);
 	if (is_cgroup_event(event))
 		static_key_slow_inc(&perf_sched_events.key);
 
@@ -8148,6 +8635,9 @@ static void __init perf_event_init_all_cpus(void)
 		swhash = &per_cpu(swevent_htable, cpu);
 		mutex_init(&swhash->hlist_mutex);
 		INIT_LIST_HEAD(&per_cpu(rotation_list, cpu));
+#ifdef CONFIG_CGROUP_PERF
+		INIT_LIST_HEAD(&per_cpu(perf_cgroup_tables, cpu));
+#endif
 	}
 }
 
@@ -74,6 +74,7 @@
 #include <linux/uprobes.h>
 #include <linux/aio.h>
 #include <linux/compiler.h>
+#include <linux/rseq.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -147,19 +148,87 @@ void __weak arch_release_thread_info(struct thread_info *ti)
  * kmemcache based allocator.
  */
 # if THREAD_SIZE >= PAGE_SIZE
+
+/*
+ * Stacks are higher order allocations on most configurations. Keep the
+ * last couple of stacks freed on each CPU around so that fork/exit heavy
+ * workloads recycle cache hot stacks instead of going back to the page
+ * allocator, which also spares them order-2 failures under fragmentation.
+ * The cache is bypassed with kmem accounting enabled, as a cached stack
+ * would stay charged to the cgroup that first allocated it.
+ */
+#define NR_CACHED_STACKS 2
+static DEFINE_PER_CPU(struct thread_info *, cached_stacks[NR_CACHED_STACKS]);
+
 static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
 						  int node)
 {
-	struct page *page = alloc_kmem_pages_node(node, THREADINFO_GFP,
-						  THREAD_SIZE_ORDER);
+	struct page *page;
+	int i;
+
+	if (!memcg_kmem_enabled()) {
+		for (i = 0; i < NR_CACHED_STACKS; i++) {
+			struct thread_info *ti;
+
+			ti = this_cpu_xchg(cached_stacks[i], NULL);
+			if (!ti)
+				continue;
+			if (node == NUMA_NO_NODE ||
+			    page_to_nid(virt_to_page(ti)) == node) {
+#ifdef CONFIG_DEBUG_STACK_USAGE
+				memset(ti, 0, THREAD_SIZE);
+#endif
+				return ti;
+			}
+			free_kmem_pages((unsigned long)ti, THREAD_SIZE_ORDER);
+		}
+	}
+
+	page = alloc_kmem_pages_node(node, THREADINFO_GFP, THREAD_SIZE_ORDER);
 
 	return page ? page_address(page) : NULL;
 }
 
 static inline void free_thread_info(struct thread_info *ti)
 {
+	int i;
+
+	if (!memcg_kmem_enabled()) {
+		for (i = 0; i < NR_CACHED_STACKS; i++) {
+			if (this_cpu_cmpxchg(cached_stacks[i], NULL, ti) == NULL)
+				return;
+		}
+	}
+
 	free_kmem_pages((unsigned long)ti, THREAD_SIZE_ORDER);
 }
+
+static int stack_cache_cpu_notify(struct notifier_block *self,
+				  unsigned long action, void *hcpu)
+{
+	long cpu = (long)hcpu;
+	int i;
+
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_DEAD:
+		for (i = 0; i < NR_CACHED_STACKS; i++) {
+			struct thread_info *ti;
+
+			ti = per_cpu(cached_stacks[i], cpu);
+			if (!ti)
+				continue;
+			per_cpu(cached_stacks[i], cpu) = NULL;
+			free_kmem_pages((unsigned long)ti, THREAD_SIZE_ORDER);
+		}
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static void __init stack_cache_init(void)
+{
+	hotcpu_notifier(stack_cache_cpu_notify, 0);
+}
 # else
 static struct kmem_cache *thread_info_cache;
 
@@ -180,7 +249,11 @@ void thread_info_cache_init(void)
 					      THREAD_SIZE, 0, NULL);
 	BUG_ON(thread_info_cache == NULL);
 }
+
+static inline void stack_cache_init(void) { }
 # endif
+#else
+static inline void stack_cache_init(void) { }
 #endif
 
 /* SLAB cache for signal_struct structures (tsk->signal) */
@@ -268,6 +341,8 @@ void __init fork_init(unsigned long mempages)
 	/* do the arch specific task caches init */
 	arch_task_cache_init();
 
+	stack_cache_init();
+
 	/*
 	 * The default maximum number of threads is set to a safe
 	 * value: the thread structures can take up at most half
@@ -351,6 +426,7 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 #endif
 	tsk->splice_pipe = NULL;
 	tsk->task_frag.page = NULL;
+	tsk->wake_q.next = NULL;
 
 	account_kernel_stack(ti, 1);
 
@@ -572,6 +648,9 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p)
 #if defined(CONFIG_TRANSPARENT_HUGEPAGE) && !USE_SPLIT_PMD_PTLOCKS
 	mm->pmd_huge_pte = NULL;
 #endif
+#ifdef CONFIG_FUTEX
+	mm->futex_phash = NULL;
+#endif
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -656,6 +735,7 @@ void mmput(struct mm_struct *mm)
 		ksm_exit(mm);
 		khugepaged_exit(mm); /* must run before exit_mmap */
 		exit_mmap(mm);
+		futex_hash_free(mm);
 		set_mm_exe_file(mm, NULL);
 		if (!list_empty(&mm->mmlist)) {
 			spin_lock(&mmlist_lock);
@@ -1090,10 +1170,6 @@ static int copy_signal(unsigned long clone_flags, struct task_struct *tsk)
 	tty_audit_fork(sig);
 	sched_autogroup_fork(sig);
 
-#ifdef CONFIG_CGROUPS
-	init_rwsem(&sig->group_rwsem);
-#endif
-
 	sig->oom_score_adj = current->signal->oom_score_adj;
 	sig->oom_score_adj_min = current->signal->oom_score_adj_min;
 
@@ -1278,8 +1354,12 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 		goto bad_fork_cleanup_count;
 
 	delayacct_tsk_init(p);	/* Must remain after dup_task_struct() */
-	p->flags &= ~(PF_SUPERPRIV | PF_WQ_WORKER);
+	p->flags &= ~(PF_SUPERPRIV | PF_WQ_WORKER | PF_MEMSTALL);
 	p->flags |= PF_FORKNOEXEC;
+#ifdef CONFIG_PSI
+	p->psi_flags = 0;
+	p->sched_psi_wake_requeue = 0;
+#endif
 	INIT_LIST_HEAD(&p->children);
 	INIT_LIST_HEAD(&p->sibling);
 	rcu_copy_process(p);
@@ -1400,6 +1480,8 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	if (retval)
 		goto bad_fork_cleanup_io;
 
+	rseq_fork(p, clone_flags);
+
 	if (pid != &init_struct_pid) {
 		retval = -ENOMEM;
 		pid = alloc_pid(p->nsproxy->pid_ns_for_children);
@@ -64,6 +64,9 @@
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
+#include <linux/vmalloc.h>
+#include <linux/prctl.h>
+#include <linux/compat.h>
 
 #include <asm/futex.h>
 
@@ -258,6 +261,22 @@ static unsigned long __read_mostly futex_hashsize;
 
 static struct futex_hash_bucket *futex_queues;
 
+/*
+ * A process can ask for its PROCESS_PRIVATE futexes to be hashed into a
+ * table of its own (PR_FUTEX_HASH), so that they don't share buckets with
+ * anybody else's.  The table is allocated on the node the process runs on
+ * when it asks, which has to be while it is still single threaded: with no
+ * other user of the mm, no private futex of it can be queued anywhere yet
+ * and nothing needs to move.  It stays until the mm goes away.
+ */
+#define FUTEX_PRIVATE_HASH_MIN		16
+#define FUTEX_PRIVATE_HASH_MAX		65536
+
+struct futex_private_hash {
+	unsigned long			hashmask;
+	struct futex_hash_bucket	queues[];
+};
+
 static inline void futex_get_mm(union futex_key *key)
 {
 	atomic_inc(&key->private.mm->mm_count);
@@ -311,6 +330,13 @@ static struct futex_hash_bucket *hash_futex(union futex_key *key)
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
+	struct futex_private_hash *fph = NULL;
+
+	if (!(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED)))
+		fph = ACCESS_ONCE(key->private.mm->futex_phash);
+	if (fph)
+		return &fph->queues[hash & fph->hashmask];
+
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
@@ -1090,9 +1116,10 @@ static void __unqueue_futex(struct futex_q *q)
 
 /*
  * The hash bucket lock must be held when this is called.
- * Afterwards, the futex_q must not be accessed.
+ * Afterwards, the futex_q must not be accessed. Callers must ensure
+ * to later call wake_up_q() for the actual wakeups to occur.
  */
-static void wake_futex(struct futex_q *q)
+static void mark_wake_futex(struct wake_q_head *wake_q, struct futex_q *q)
 {
 	struct task_struct *p = q->task;
 
@@ -1100,14 +1127,12 @@ static void wake_futex(struct futex_q *q)
 		return;
 
 	/*
-	 * We set q->lock_ptr = NULL _before_ we wake up the task. If
-	 * a non-futex wake up happens on another CPU then the task
-	 * might exit and p would dereference a non-existing task
-	 * struct. Prevent this by holding a reference on p across the
-	 * wake up.
+	 * Queue the task for later wakeup for after we've released
+	 * the hb->lock. wake_q_add() grabs reference to p, so the task
+	 * can't go away before wake_up_q() even if it sees q->lock_ptr
+	 * cleared and leaves on its own.
 	 */
-	get_task_struct(p);
-
+	wake_q_add(wake_q, p);
 	__unqueue_futex(q);
 	/*
 	 * The waiting task can free the futex_q as soon as
@@ -1117,9 +1142,6 @@ static void wake_futex(struct futex_q *q)
 	 */
 	smp_wmb();
 	q->lock_ptr = NULL;
-
-	wake_up_state(p, TASK_NORMAL);
-	put_task_struct(p);
 }
 
 static int wake_futex_pi(u32 __user *uaddr, u32 uval, struct futex_q *this)
@@ -1217,6 +1239,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	struct futex_q *this, *next;
 	union futex_key key = FUTEX_KEY_INIT;
 	int ret;
+	WAKE_Q(wake_q);
 
 	if (!bitset)
 		return -EINVAL;
@@ -1244,13 +1267,14 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 			if (!(this->bitset & bitset))
 				continue;
 
-			wake_futex(this);
+			mark_wake_futex(&wake_q, this);
 			if (++ret >= nr_wake)
 				break;
 		}
 	}
 
 	spin_unlock(&hb->lock);
+	wake_up_q(&wake_q);
 out_put_key:
 	put_futex_key(&key);
 out:
@@ -1269,6 +1293,7 @@ futex_wake_op(u32 __user *uaddr1, unsigned int flags, u32 __user *uaddr2,
 	struct futex_hash_bucket *hb1, *hb2;
 	struct futex_q *this, *next;
 	int ret, op_ret;
+	WAKE_Q(wake_q);
 
 retry:
 	ret = get_futex_key(uaddr1, flags & FLAGS_SHARED, &key1, VERIFY_READ);
@@ -1320,7 +1345,7 @@ retry_private:
 				ret = -EINVAL;
 				goto out_unlock;
 			}
-			wake_futex(this);
+			mark_wake_futex(&wake_q, this);
 			if (++ret >= nr_wake)
 				break;
 		}
@@ -1334,7 +1359,7 @@ retry_private:
 					ret = -EINVAL;
 					goto out_unlock;
 				}
-				wake_futex(this);
+				mark_wake_futex(&wake_q, this);
 				if (++op_ret >= nr_wake2)
 					break;
 			}
@@ -1344,6 +1369,7 @@ retry_private:
 
 out_unlock:
 	double_unlock_hb(hb1, hb2);
+	wake_up_q(&wake_q);
 out_put_keys:
 	put_futex_key(&key2);
 out_put_key1:
@@ -1503,6 +1529,7 @@ static int futex_requeue(u32 __user *uaddr1, unsigned int flags,
 	struct futex_pi_state *pi_state = NULL;
 	struct futex_hash_bucket *hb1, *hb2;
 	struct futex_q *this, *next;
+	WAKE_Q(wake_q);
 
 	if (requeue_pi) {
 		/*
@@ -1679,7 +1706,7 @@ retry_private:
 		 * woken by futex_unlock_pi().
 		 */
 		if (++task_count <= nr_wake && !requeue_pi) {
-			wake_futex(this);
+			mark_wake_futex(&wake_q, this);
 			continue;
 		}
 
@@ -1719,6 +1746,7 @@ retry_private:
 out_unlock:
 	free_pi_state(pi_state);
 	double_unlock_hb(hb1, hb2);
+	wake_up_q(&wake_q);
 	hb_waiters_dec(hb2);
 
 	/*
@@ -2161,6 +2189,241 @@ out:
 	return ret;
 }
 
+/*
+ * Unqueue the first @count of @qs, dropping their key references.
+ * Returns the index of the first one that had already been woken, -1 if
+ * none had.
+ */
+static int futex_unqueue_multiple(struct futex_q *qs, int count)
+{
+	int i, woken = -1;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&qs[i]) && woken < 0)
+			woken = i;
+	}
+	return woken;
+}
+
+/**
+ * futex_wait_multiple_setup() - Prepare to wait on several futexes
+ * @wb:		the futexes and their expected values
+ * @qs:		one futex_q per futex
+ * @count:	the number of futexes
+ * @flags:	futex flags (FLAGS_SHARED, etc.)
+ * @woken:	set to the index of a futex found woken while setting up
+ *
+ * The futex_wait_setup() of several futexes at once: each futex is queued
+ * as soon as its value has been checked under the hash bucket lock, with
+ * the task already in TASK_INTERRUPTIBLE so that a wakeup on one that is
+ * queued while the others are still being looked at is not lost.  If any
+ * value doesn't match, everything queued so far is taken back.
+ *
+ * Return:
+ *  0 - all queued and *@woken is -1, or nothing queued and *@woken is the
+ *      index of a futex that was woken before we could take it back;
+ * <0 - -EFAULT or -EWOULDBLOCK, nothing queued and no key references held
+ */
+static int futex_wait_multiple_setup(struct futex_wait_block *wb,
+				     struct futex_q *qs, int count,
+				     unsigned int flags, int *woken)
+{
+	struct futex_hash_bucket *hb;
+	u32 uval;
+	int i, j, ret;
+
+retry:
+	for (i = 0; i < count; i++) {
+		ret = get_futex_key(wb[i].uaddr, flags & FLAGS_SHARED,
+				    &qs[i].key, VERIFY_READ);
+		if (unlikely(ret)) {
+			while (--i >= 0)
+				put_futex_key(&qs[i].key);
+			return ret;
+		}
+	}
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	for (i = 0; i < count; i++) {
+		hb = queue_lock(&qs[i]);
+		ret = get_futex_value_locked(&uval, wb[i].uaddr);
+		if (!ret && uval == wb[i].val) {
+			queue_me(&qs[i], hb);
+			continue;
+		}
+
+		queue_unlock(hb);
+		__set_current_state(TASK_RUNNING);
+
+		*woken = futex_unqueue_multiple(qs, i);
+		for (j = i; j < count; j++)
+			put_futex_key(&qs[j].key);
+		/* A wakeup we can't give back: report it instead */
+		if (*woken >= 0)
+			return 0;
+
+		if (!ret)
+			return -EWOULDBLOCK;
+
+		if (get_user(uval, wb[i].uaddr))
+			return -EFAULT;
+		goto retry;
+	}
+
+	*woken = -1;
+	return 0;
+}
+
+static int futex_wait_multiple(struct futex_wait_block *wb, int count,
+			       unsigned int flags, ktime_t *abs_time)
+{
+	struct hrtimer_sleeper timeout, *to = NULL;
+	struct futex_q *qs;
+	int i, ret, woken;
+
+	qs = kmalloc_array(count, sizeof(*qs), GFP_KERNEL);
+	if (!qs)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		if (!wb[i].bitset) {
+			kfree(qs);
+			return -EINVAL;
+		}
+		qs[i] = futex_q_init;
+		qs[i].bitset = wb[i].bitset;
+	}
+
+	if (abs_time) {
+		to = &timeout;
+
+		hrtimer_init_on_stack(&to->timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_ABS);
+		hrtimer_init_sleeper(to, current);
+		hrtimer_set_expires_range_ns(&to->timer, *abs_time,
+					     current->timer_slack_ns);
+	}
+
+retry:
+	ret = futex_wait_multiple_setup(wb, qs, count, flags, &woken);
+	if (ret)
+		goto out;
+	if (woken >= 0) {
+		ret = woken;
+		goto out;
+	}
+
+	if (to) {
+		hrtimer_start_expires(&to->timer, HRTIMER_MODE_ABS);
+		if (!hrtimer_active(&to->timer))
+			to->task = NULL;
+	}
+
+	/* As in futex_wait_queue_me(), don't sleep if already woken */
+	for (i = 0; i < count; i++) {
+		if (plist_node_empty(&qs[i].list))
+			break;
+	}
+	if (i == count && (!to || to->task))
+		freezable_schedule();
+	__set_current_state(TASK_RUNNING);
+
+	ret = futex_unqueue_multiple(qs, count);
+	if (ret >= 0)
+		goto out;
+
+	ret = -ETIMEDOUT;
+	if (to && !to->task)
+		goto out;
+
+	if (!signal_pending(current))
+		goto retry;
+
+	/*
+	 * The futex array doesn't fit in a restart block, so with a timeout
+	 * we can't restart without stretching it.
+	 */
+	ret = abs_time ? -EINTR : -ERESTARTSYS;
+
+out:
+	if (to) {
+		hrtimer_cancel(&to->timer);
+		destroy_hrtimer_on_stack(&to->timer);
+	}
+	kfree(qs);
+	return ret;
+}
+
+static int futex_wait_multiple_user(struct futex_wait_block __user *uwb,
+				    u32 count, unsigned int flags,
+				    ktime_t *abs_time)
+{
+	struct futex_wait_block *wb;
+	int ret;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	wb = kmalloc_array(count, sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	if (copy_from_user(wb, uwb, count * sizeof(*wb)))
+		ret = -EFAULT;
+	else
+		ret = futex_wait_multiple(wb, count, flags, abs_time);
+
+	kfree(wb);
+	return ret;
+}
+
+#ifdef CONFIG_COMPAT
+struct compat_futex_wait_block {
+	compat_uptr_t	uaddr;
+	u32		val;
+	u32		bitset;
+};
+
+long compat_futex_wait_multiple(u32 __user *uaddr, int op, u32 count,
+				ktime_t *abs_time)
+{
+	struct compat_futex_wait_block __user *ucwb = (void __user *)uaddr;
+	struct compat_futex_wait_block cwb;
+	struct futex_wait_block *wb;
+	unsigned int flags = 0;
+	int i, ret = 0;
+
+	if (!(op & FUTEX_PRIVATE_FLAG))
+		flags |= FLAGS_SHARED;
+	if (op & FUTEX_CLOCK_REALTIME)
+		return -ENOSYS;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	wb = kmalloc_array(count, sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		if (copy_from_user(&cwb, &ucwb[i], sizeof(cwb))) {
+			ret = -EFAULT;
+			break;
+		}
+		wb[i].uaddr = compat_ptr(cwb.uaddr);
+		wb[i].val = cwb.val;
+		wb[i].bitset = cwb.bitset;
+	}
+
+	if (!ret)
+		ret = futex_wait_multiple(wb, count, flags, abs_time);
+
+	kfree(wb);
+	return ret;
+}
+#endif
+
 static int futex_wait(u32 __user *uaddr, unsigned int flags, u32 val,
 		      ktime_t *abs_time, u32 bitset)
 {
@@ -2964,6 +3227,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
 		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+	case FUTEX_WAIT_MULTIPLE:
+		return futex_wait_multiple_user((void __user *)uaddr, val,
+						flags, timeout);
 	}
 	return -ENOSYS;
 }
@@ -2980,14 +3246,15 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
 		      cmd == FUTEX_WAIT_BITSET ||
-		      cmd == FUTEX_WAIT_REQUEUE_PI)) {
+		      cmd == FUTEX_WAIT_REQUEUE_PI ||
+		      cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
 			return -EINVAL;
 
 		t = timespec_to_ktime(ts);
-		if (cmd == FUTEX_WAIT)
+		if (cmd == FUTEX_WAIT || cmd == FUTEX_WAIT_MULTIPLE)
 			t = ktime_add_safe(ktime_get(), t);
 		tp = &t;
 	}
@@ -3022,6 +3289,73 @@ static void __init futex_detect_cmpxchg(void)
 #endif
 }
 
+static int futex_private_hash_alloc(unsigned long nr_threads)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_private_hash *fph;
+	unsigned long i, slots;
+	size_t size;
+	int node;
+
+	if (!nr_threads)
+		nr_threads = num_online_cpus();
+	slots = clamp_t(unsigned long, nr_threads,
+			FUTEX_PRIVATE_HASH_MIN / 4, FUTEX_PRIVATE_HASH_MAX / 4);
+	slots = roundup_pow_of_two(4 * slots);
+
+	if (atomic_read(&mm->mm_users) != 1 || mm->futex_phash)
+		return -EBUSY;
+
+	size = sizeof(*fph) + slots * sizeof(struct futex_hash_bucket);
+	node = numa_node_id();
+	fph = NULL;
+	if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER))
+		fph = kzalloc_node(size, GFP_KERNEL | __GFP_NOWARN, node);
+	if (!fph)
+		fph = vzalloc_node(size, node);
+	if (!fph)
+		return -ENOMEM;
+
+	fph->hashmask = slots - 1;
+	for (i = 0; i < slots; i++) {
+		atomic_set(&fph->queues[i].waiters, 0);
+		plist_head_init(&fph->queues[i].chain);
+		spin_lock_init(&fph->queues[i].lock);
+	}
+
+	/* Threads created from here on see it through clone() */
+	if (cmpxchg(&mm->futex_phash, NULL, fph)) {
+		kvfree(fph);
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	struct futex_private_hash *fph;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_ENABLE:
+		return futex_private_hash_alloc(arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		fph = ACCESS_ONCE(current->mm->futex_phash);
+		return fph ? fph->hashmask + 1 : 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Called once the last user of @mm is gone, so no futex can be queued. */
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(mm->futex_phash);
+	mm->futex_phash = NULL;
+}
+
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
@@ -125,6 +125,21 @@ int irq_can_set_affinity(unsigned int irq)
 	return 1;
 }
 
+/**
+ *	irq_can_set_affinity_usr - Check if affinity of a irq can be set from user space
+ *	@irq:		Interrupt to check
+ *
+ *	Like irq_can_set_affinity() above, but additionally checks for the
+ *	AFFINITY_MANAGED flag.
+ */
+int irq_can_set_affinity_usr(unsigned int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	return irq_can_set_affinity(irq) &&
+		!irqd_affinity_is_managed(&desc->irq_data);
+}
+
 /**
  *	irq_set_thread_affinity - Notify irq threads to adjust affinity
  *	@desc:		irq descriptor which has affitnity changed
@@ -247,6 +262,30 @@ int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 }
 EXPORT_SYMBOL_GPL(irq_set_affinity_hint);
 
+/**
+ *	irq_set_managed_affinity - Pin an interrupt to a kernel chosen cpumask
+ *	@irq:		Interrupt to pin
+ *	@m:		cpumask the interrupt is spread to
+ *
+ *	Used for multiqueue device vectors which were spread by
+ *	irq_create_affinity_masks(). The mask is recorded before the
+ *	interrupt is requested and applied by setup_affinity() on startup.
+ *	Managed interrupts can not be moved from user space afterwards.
+ */
+int irq_set_managed_affinity(unsigned int irq, const struct cpumask *m)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags, IRQ_GET_DESC_CHECK_GLOBAL);
+
+	if (!desc)
+		return -EINVAL;
+	cpumask_copy(desc->irq_data.affinity, m);
+	irqd_set(&desc->irq_data, IRQD_AFFINITY_MANAGED | IRQD_AFFINITY_SET);
+	irq_put_desc_unlock(desc, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_set_managed_affinity);
+
 static void irq_affinity_notify(struct work_struct *work)
 {
 	struct irq_affinity_notify *notify =
@@ -331,13 +370,15 @@ setup_affinity(unsigned int irq, struct irq_desc *desc, struct cpumask *mask)
 
 	/*
 	 * Preserve an userspace affinity setup, but make sure that
-	 * one of the targets is online.
+	 * one of the targets is online. A managed affinity is kept even
+	 * if all of its cpus are offline right now, so it is picked up
+	 * again once they come back.
 	 */
 	if (irqd_has_set(&desc->irq_data, IRQD_AFFINITY_SET)) {
 		if (cpumask_intersects(desc->irq_data.affinity,
 				       cpu_online_mask))
 			set = desc->irq_data.affinity;
-		else
+		else if (!irqd_affinity_is_managed(&desc->irq_data))
 			irqd_clear(&desc->irq_data, IRQD_AFFINITY_SET);
 	}
 
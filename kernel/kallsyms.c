@@ -24,6 +24,9 @@
 #include <linux/ctype.h>
 #include <linux/slab.h>
 #include <linux/compiler.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 
 #include <asm/sections.h>
 
@@ -176,13 +179,92 @@ static unsigned int get_symbol_offset(unsigned long pos)
 	return name - kallsyms_names;
 }
 
+/*
+ * Name -> index hash of the kernel symbols, so kallsyms_lookup_name() does
+ * not have to expand every symbol.  Buckets and chains hold symbol index + 1,
+ * 0 ends a chain.  Chains are kept in symbol order so the first of several
+ * symbols with the same name is still the one found.
+ */
+static u32 *kallsyms_hash_heads;
+static u32 *kallsyms_hash_next;
+static u32 kallsyms_hash_mask;
+
+static u32 kallsyms_hash_name(const char *name)
+{
+	return jhash(name, strlen(name), 0) & kallsyms_hash_mask;
+}
+
+static int __init kallsyms_hash_init(void)
+{
+	char namebuf[KSYM_NAME_LEN];
+	unsigned long i, nbuckets;
+	unsigned int off;
+	u32 *heads, *next, *tails, b;
+
+	if (!kallsyms_num_syms)
+		return 0;
+
+	nbuckets = roundup_pow_of_two(kallsyms_num_syms);
+	heads = vzalloc(nbuckets * sizeof(*heads));
+	next = vzalloc(kallsyms_num_syms * sizeof(*next));
+	tails = vmalloc(nbuckets * sizeof(*tails));
+	if (!heads || !next || !tails) {
+		vfree(heads);
+		vfree(next);
+		vfree(tails);
+		return -ENOMEM;
+	}
+
+	kallsyms_hash_mask = nbuckets - 1;
+	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
+		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
+		b = kallsyms_hash_name(namebuf);
+		if (heads[b])
+			next[tails[b] - 1] = i + 1;
+		else
+			heads[b] = i + 1;
+		tails[b] = i + 1;
+	}
+	vfree(tails);
+
+	kallsyms_hash_next = next;
+	/* Lookups test the heads, publish them last. */
+	smp_store_release(&kallsyms_hash_heads, heads);
+	return 0;
+}
+core_initcall(kallsyms_hash_init);
+
+/* Returns the symbol index + 1, or 0 if name is not a kernel symbol. */
+static u32 kallsyms_hash_lookup(const u32 *heads, const char *name)
+{
+	char namebuf[KSYM_NAME_LEN];
+	u32 i;
+
+	i = heads[kallsyms_hash_name(name)];
+	for (; i; i = kallsyms_hash_next[i - 1]) {
+		kallsyms_expand_symbol(get_symbol_offset(i - 1),
+				       namebuf, ARRAY_SIZE(namebuf));
+		if (strcmp(namebuf, name) == 0)
+			break;
+	}
+	return i;
+}
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
 	char namebuf[KSYM_NAME_LEN];
+	u32 *heads = smp_load_acquire(&kallsyms_hash_heads);
 	unsigned long i;
 	unsigned int off;
 
+	if (heads) {
+		i = kallsyms_hash_lookup(heads, name);
+		if (i)
+			return kallsyms_addresses[i - 1];
+		return module_kallsyms_lookup_name(name);
+	}
+
 	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
 		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
 
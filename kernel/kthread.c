@@ -18,6 +18,7 @@
 #include <linux/freezer.h>
 #include <linux/ptrace.h>
 #include <linux/uaccess.h>
+#include <linux/cgroup.h>
 #include <trace/events/sched.h>
 
 static DEFINE_SPINLOCK(kthread_create_lock);
@@ -44,6 +45,9 @@ struct kthread {
 	void *data;
 	struct completion parked;
 	struct completion exited;
+#ifdef CONFIG_BLK_CGROUP
+	struct cgroup_subsys_state *blkcg_css;
+#endif
 };
 
 enum KTHREAD_BITS {
@@ -184,6 +188,9 @@ static int kthread(void *_create)
 
 	self.flags = 0;
 	self.data = data;
+#ifdef CONFIG_BLK_CGROUP
+	self.blkcg_css = NULL;
+#endif
 	init_completion(&self.exited);
 	init_completion(&self.parked);
 	current->vfork_done = &self.exited;
@@ -206,6 +213,7 @@ static int kthread(void *_create)
 		__kthread_parkme(&self);
 		ret = threadfn(data);
 	}
+	kthread_associate_blkcg(NULL);
 	/* we can't just return, we must preserve "self" on stack */
 	do_exit(ret);
 }
@@ -690,3 +698,51 @@ void flush_kthread_worker(struct kthread_worker *worker)
 	wait_for_completion(&fwork.done);
 }
 EXPORT_SYMBOL_GPL(flush_kthread_worker);
+
+#ifdef CONFIG_BLK_CGROUP
+/**
+ * kthread_associate_blkcg - associate blkcg to current kthread
+ * @css: the cgroup info
+ *
+ * Current thread must be a kthread.  The thread is running jobs on behalf
+ * of other threads, the I/O it issues from now on is charged to @css
+ * instead of the kthread's own blkcg.  Pass %NULL to drop the association.
+ */
+void kthread_associate_blkcg(struct cgroup_subsys_state *css)
+{
+	struct kthread *kthread;
+
+	if (!(current->flags & PF_KTHREAD))
+		return;
+	kthread = to_live_kthread(current);
+	if (!kthread)
+		return;
+
+	if (kthread->blkcg_css == css)
+		return;
+	if (kthread->blkcg_css)
+		css_put(kthread->blkcg_css);
+	if (css)
+		css_get(css);
+	kthread->blkcg_css = css;
+}
+EXPORT_SYMBOL(kthread_associate_blkcg);
+
+/**
+ * kthread_blkcg - get associated blkcg css of current kthread
+ *
+ * Current thread must be a kthread.
+ */
+struct cgroup_subsys_state *kthread_blkcg(void)
+{
+	struct kthread *kthread;
+
+	if (current->flags & PF_KTHREAD) {
+		kthread = to_live_kthread(current);
+		if (kthread)
+			return kthread->blkcg_css;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(kthread_blkcg);
+#endif
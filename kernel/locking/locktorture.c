@@ -35,6 +35,9 @@
 #include <linux/delay.h>
 #include <linux/slab.h>
 #include <linux/torture.h>
+#include <linux/ktime.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Paul E. McKenney <paulmck@us.ibm.com>");
@@ -54,6 +57,14 @@ torture_param(int, stat_interval, 60,
 torture_param(int, stutter, 5, "Number of jiffies to run/halt test, 0=disable");
 torture_param(bool, verbose, true,
 	     "Enable verbose debugging printk()s");
+torture_param(bool, bench, false,
+	     "Benchmark mode: fixed critical sections, report throughput");
+torture_param(int, bench_cs_ns, 0,
+	     "Benchmark: busy time inside the lock (ns)");
+torture_param(int, bench_ncs_ns, 0,
+	     "Benchmark: busy time between acquisitions (ns)");
+torture_param(int, bench_pin, 0,
+	     "Benchmark: pin threads, 0=no, 1=fill nodes in turn, 2=spread over nodes");
 
 static char *torture_type = "spin_lock";
 module_param(torture_type, charp, 0444);
@@ -67,11 +78,19 @@ static struct task_struct **reader_tasks;
 static bool lock_is_write_held;
 static bool lock_is_read_held;
 
+/* Wait time histogram buckets: [2^(i-1), 2^i) ns, the last one open */
+#define LOCK_BENCH_HIST	32
+
 struct lock_stress_stats {
 	long n_lock_fail;
 	long n_lock_acquired;
+	int cpu;		/* benchmark: CPU to run on, or -1 */
+	u64 wait_ns;		/* benchmark: total time spent acquiring */
+	long wait_hist[LOCK_BENCH_HIST];
 };
 
+static u64 bench_start_ns;
+
 #if defined(MODULE)
 #define LOCKTORTURE_RUNNABLE_INIT 1
 #else
@@ -426,6 +445,25 @@ static struct lock_torture_ops rwsem_lock_ops = {
 	.name		= "rwsem_lock"
 };
 
+/*
+ * Benchmark mode helpers.  Instead of random delays meant to provoke
+ * bugs, the threads spin for a fixed time inside and outside the lock,
+ * so that runs are comparable, and time every acquisition.
+ */
+static void lock_bench_start(struct lock_stress_stats *statp)
+{
+	if (statp->cpu >= 0)
+		set_cpus_allowed_ptr(current, cpumask_of(statp->cpu));
+}
+
+static void lock_bench_account(struct lock_stress_stats *statp, u64 start)
+{
+	u64 delta = local_clock() - start;
+
+	statp->wait_ns += delta;
+	statp->wait_hist[min(fls64(delta), LOCK_BENCH_HIST - 1)]++;
+}
+
 /*
  * Lock torture writer kthread.  Repeatedly acquires and releases
  * the lock, checking for duplicate acquisitions.
@@ -434,15 +472,23 @@ static int lock_torture_writer(void *arg)
 {
 	struct lock_stress_stats *lwsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start = 0;
 
 	VERBOSE_TOROUT_STRING("lock_torture_writer task started");
 	set_user_nice(current, MAX_NICE);
+	if (bench)
+		lock_bench_start(lwsp);
 
 	do {
-		if ((torture_random(&rand) & 0xfffff) == 0)
+		if (bench) {
+			ndelay(bench_ncs_ns);
+			start = local_clock();
+		} else if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
 		cxt.cur_ops->writelock();
+		if (bench)
+			lock_bench_account(lwsp, start);
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lwsp->n_lock_fail++;
 		lock_is_write_held = 1;
@@ -450,7 +496,10 @@ static int lock_torture_writer(void *arg)
 			lwsp->n_lock_fail++; /* rare, but... */
 
 		lwsp->n_lock_acquired++;
-		cxt.cur_ops->write_delay(&rand);
+		if (bench)
+			ndelay(bench_cs_ns);
+		else
+			cxt.cur_ops->write_delay(&rand);
 		lock_is_write_held = 0;
 		cxt.cur_ops->writeunlock();
 
@@ -468,21 +517,32 @@ static int lock_torture_reader(void *arg)
 {
 	struct lock_stress_stats *lrsp = arg;
 	static DEFINE_TORTURE_RANDOM(rand);
+	u64 start = 0;
 
 	VERBOSE_TOROUT_STRING("lock_torture_reader task started");
 	set_user_nice(current, MAX_NICE);
+	if (bench)
+		lock_bench_start(lrsp);
 
 	do {
-		if ((torture_random(&rand) & 0xfffff) == 0)
+		if (bench) {
+			ndelay(bench_ncs_ns);
+			start = local_clock();
+		} else if ((torture_random(&rand) & 0xfffff) == 0)
 			schedule_timeout_uninterruptible(1);
 
 		cxt.cur_ops->readlock();
+		if (bench)
+			lock_bench_account(lrsp, start);
 		lock_is_read_held = 1;
 		if (WARN_ON_ONCE(lock_is_write_held))
 			lrsp->n_lock_fail++; /* rare, but... */
 
 		lrsp->n_lock_acquired++;
-		cxt.cur_ops->read_delay(&rand);
+		if (bench)
+			ndelay(bench_cs_ns);
+		else
+			cxt.cur_ops->read_delay(&rand);
 		lock_is_read_held = 0;
 		cxt.cur_ops->readunlock();
 
@@ -492,6 +552,40 @@ static int lock_torture_reader(void *arg)
 	return 0;
 }
 
+/*
+ * Append acquisitions per second and the wait time histogram, summed
+ * over all threads of one kind, to the statistics message.
+ */
+static void __lock_bench_print_stats(char *page,
+				     struct lock_stress_stats *statp,
+				     int n_stress, long long sum)
+{
+	u64 elapsed_ns = ktime_get_ns() - bench_start_ns;
+	u64 wait_ns = 0;
+	long hist[LOCK_BENCH_HIST] = { 0 };
+	int i, j;
+
+	for (i = 0; i < n_stress; i++) {
+		wait_ns += statp[i].wait_ns;
+		for (j = 0; j < LOCK_BENCH_HIST; j++)
+			hist[j] += statp[i].wait_hist[j];
+	}
+
+	page += sprintf(page, "  Acquisitions/s: %llu  Mean wait: %llu ns\n",
+			div64_u64((u64)sum * NSEC_PER_SEC, elapsed_ns ?: 1),
+			div64_u64(wait_ns, sum ?: 1));
+	page += sprintf(page, "  Wait histogram (ns <):");
+	for (j = 0; j < LOCK_BENCH_HIST; j++) {
+		if (!hist[j])
+			continue;
+		if (j == LOCK_BENCH_HIST - 1)
+			page += sprintf(page, " inf:%ld", hist[j]);
+		else
+			page += sprintf(page, " %llu:%ld", 1ULL << j, hist[j]);
+	}
+	sprintf(page, "\n");
+}
+
 /*
  * Create an lock-torture-statistics message in the specified buffer.
  */
@@ -521,6 +615,8 @@ static void __torture_print_stats(char *page,
 			fail, fail ? "!!!" : "");
 	if (fail)
 		atomic_inc(&cxt.n_lock_torture_errors);
+	if (bench)
+		__lock_bench_print_stats(page, statp, n_stress, sum);
 }
 
 /*
@@ -533,11 +629,13 @@ static void __torture_print_stats(char *page,
  */
 static void lock_torture_stats_print(void)
 {
-	int size = cxt.nrealwriters_stress * 200 + 8192;
+	int size = cxt.nrealwriters_stress * 200 + 8192 +
+		   LOCK_BENCH_HIST * 32;
 	char *buf;
 
 	if (cxt.cur_ops->readlock)
-		size += cxt.nrealreaders_stress * 200 + 8192;
+		size += cxt.nrealreaders_stress * 200 + 8192 +
+			LOCK_BENCH_HIST * 32;
 
 	buf = kmalloc(size, GFP_KERNEL);
 	if (!buf) {
@@ -588,11 +686,51 @@ lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
 				const char *tag)
 {
 	pr_alert("%s" TORTURE_FLAG
-		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d\n",
+		 "--- %s%s: nwriters_stress=%d nreaders_stress=%d stat_interval=%d verbose=%d shuffle_interval=%d stutter=%d shutdown_secs=%d onoff_interval=%d onoff_holdoff=%d bench=%d bench_cs_ns=%d bench_ncs_ns=%d bench_pin=%d\n",
 		 torture_type, tag, cxt.debug_lock ? " [debug]": "",
 		 cxt.nrealwriters_stress, cxt.nrealreaders_stress, stat_interval,
 		 verbose, shuffle_interval, stutter, shutdown_secs,
-		 onoff_interval, onoff_holdoff);
+		 onoff_interval, onoff_holdoff, bench, bench_cs_ns,
+		 bench_ncs_ns, bench_pin);
+}
+
+/*
+ * CPU for the @n-th benchmark thread: bench_pin=1 fills up one node
+ * before moving on to the next, bench_pin=2 takes one CPU from each
+ * node in turn.  Returns -1 for no pinning.
+ */
+static int lock_bench_cpu(int n)
+{
+	int nr = num_online_cpus();
+	int node, cpu, round, k, i = 0;
+
+	if (!bench || !bench_pin)
+		return -1;
+
+	n %= nr;
+	if (bench_pin == 1) {
+		for_each_online_node(node)
+			for_each_cpu_and(cpu, cpumask_of_node(node),
+					 cpu_online_mask)
+				if (i++ == n)
+					return cpu;
+		return -1;
+	}
+
+	for (round = 0; round < nr; round++) {
+		for_each_online_node(node) {
+			k = 0;
+			for_each_cpu_and(cpu, cpumask_of_node(node),
+					 cpu_online_mask) {
+				if (k++ < round)
+					continue;
+				if (i++ == n)
+					return cpu;
+				break;
+			}
+		}
+	}
+	return -1;
 }
 
 static void lock_torture_cleanup(void)
@@ -682,19 +820,26 @@ static int __init lock_torture_init(void)
 		cxt.debug_lock = true;
 #endif
 
+	/*
+	 * Shuffling would undo the pinning and stuttering would count
+	 * against the throughput.
+	 */
+	if (bench) {
+		shuffle_interval = 0;
+		stutter = 0;
+	}
+
 	/* Initialize the statistics so that each run gets its own numbers. */
 
 	lock_is_write_held = 0;
-	cxt.lwsa = kmalloc(sizeof(*cxt.lwsa) * cxt.nrealwriters_stress, GFP_KERNEL);
+	cxt.lwsa = kzalloc(sizeof(*cxt.lwsa) * cxt.nrealwriters_stress, GFP_KERNEL);
 	if (cxt.lwsa == NULL) {
 		VERBOSE_TOROUT_STRING("cxt.lwsa: Out of memory");
 		firsterr = -ENOMEM;
 		goto unwind;
 	}
-	for (i = 0; i < cxt.nrealwriters_stress; i++) {
-		cxt.lwsa[i].n_lock_fail = 0;
-		cxt.lwsa[i].n_lock_acquired = 0;
-	}
+	for (i = 0; i < cxt.nrealwriters_stress; i++)
+		cxt.lwsa[i].cpu = lock_bench_cpu(i);
 
 	if (cxt.cur_ops->readlock) {
 		if (nreaders_stress >= 0)
@@ -711,7 +856,7 @@ static int __init lock_torture_init(void)
 		}
 
 		lock_is_read_held = 0;
-		cxt.lrsa = kmalloc(sizeof(*cxt.lrsa) * cxt.nrealreaders_stress, GFP_KERNEL);
+		cxt.lrsa = kzalloc(sizeof(*cxt.lrsa) * cxt.nrealreaders_stress, GFP_KERNEL);
 		if (cxt.lrsa == NULL) {
 			VERBOSE_TOROUT_STRING("cxt.lrsa: Out of memory");
 			firsterr = -ENOMEM;
@@ -719,10 +864,9 @@ static int __init lock_torture_init(void)
 			goto unwind;
 		}
 
-		for (i = 0; i < cxt.nrealreaders_stress; i++) {
-			cxt.lrsa[i].n_lock_fail = 0;
-			cxt.lrsa[i].n_lock_acquired = 0;
-		}
+		for (i = 0; i < cxt.nrealreaders_stress; i++)
+			cxt.lrsa[i].cpu =
+				lock_bench_cpu(cxt.nrealwriters_stress + i);
 	}
 	lock_torture_print_module_parms(cxt.cur_ops, "Start of test");
 
@@ -776,6 +920,7 @@ static int __init lock_torture_init(void)
 	 * for very specific needs, or even let the user choose the policy, if
 	 * ever wanted.
 	 */
+	bench_start_ns = ktime_get_ns();
 	for (i = 0, j = 0; i < cxt.nrealwriters_stress ||
 		    j < cxt.nrealreaders_stress; i++, j++) {
 		if (i >= cxt.nrealwriters_stress)
@@ -16,6 +16,7 @@
 #include <linux/sched/rt.h>
 
 #include "mcs_spinlock.h"
+#include "rwsem.h"
 
 /*
  * Guide to the rw_semaphore's count field for common values.
@@ -107,6 +108,12 @@ enum rwsem_wake_type {
 	RWSEM_WAKE_READ_OWNED	/* Waker thread holds the read lock */
 };
 
+/*
+ * Maximum number of readers granted the lock in one go by __rwsem_do_wake().
+ * This bounds the time spent with the wait_lock held.
+ */
+#define RWSEM_WAKE_READERS_MAX	0x100
+
 /*
  * handle the lock release when processes blocked on it that can now run
  * - if we come here from up_xxxx(), then:
@@ -114,16 +121,19 @@ enum rwsem_wake_type {
  *   - the 'waiting part' of count (&0xffff0000) is -ve (and will still be so)
  * - there must be someone on the queue
  * - the spinlock must be held by the caller
+ * - tasks are marked for being woken up on @wake_q, the caller must call
+ *   wake_up_q() once the spinlock has been released
  * - woken process blocks are discarded from the list after having task zeroed
  * - writers are only woken if downgrading is false
  */
 static struct rw_semaphore *
-__rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
+__rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type,
+		struct wake_q_head *wake_q)
 {
-	struct rwsem_waiter *waiter;
+	struct rwsem_waiter *waiter, *tmp;
 	struct task_struct *tsk;
-	struct list_head *next;
-	long oldcount, woken, loop, adjustment;
+	long oldcount, woken, adjustment;
+	LIST_HEAD(wlist);
 
 	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
 	if (waiter->type == RWSEM_WAITING_FOR_WRITE) {
@@ -133,7 +143,7 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 			 * to be able to steal it.  Readers, on the other hand,
 			 * will block as they will notice the queued writer.
 			 */
-			wake_up_process(waiter->task);
+			wake_q_add(wake_q, waiter->task);
 		goto out;
 	}
 
@@ -156,44 +166,42 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 		}
 	}
 
-	/* Grant an infinite number of read locks to the readers at the front
-	 * of the queue.  Note we increment the 'active part' of the count by
-	 * the number of readers before waking any processes up.
+	/* Grant read locks to all the readers in the queue, not just those
+	 * ahead of the first writer, so that they all enter together instead
+	 * of trickling in one batch per writer.  Writers keep their order.
+	 * Note we increment the 'active part' of the count by the number of
+	 * readers before waking any processes up.
 	 */
 	woken = 0;
-	do {
-		woken++;
+	list_for_each_entry_safe(waiter, tmp, &sem->wait_list, list) {
+		if (waiter->type == RWSEM_WAITING_FOR_WRITE)
+			continue;
 
-		if (waiter->list.next == &sem->wait_list)
+		list_move_tail(&waiter->list, &wlist);
+		if (++woken >= RWSEM_WAKE_READERS_MAX)
 			break;
-
-		waiter = list_entry(waiter->list.next,
-					struct rwsem_waiter, list);
-
-	} while (waiter->type != RWSEM_WAITING_FOR_WRITE);
+	}
 
 	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
-	if (waiter->type != RWSEM_WAITING_FOR_WRITE)
-		/* hit end of list above */
+	if (list_empty(&sem->wait_list))
+		/* took everybody off the queue */
 		adjustment -= RWSEM_WAITING_BIAS;
 
 	if (adjustment)
 		rwsem_atomic_add(adjustment, sem);
+	rwsem_set_reader_owned(sem);
 
-	next = sem->wait_list.next;
-	loop = woken;
-	do {
-		waiter = list_entry(next, struct rwsem_waiter, list);
-		next = waiter->list.next;
+	list_for_each_entry_safe(waiter, tmp, &wlist, list) {
 		tsk = waiter->task;
-		smp_mb();
-		waiter->task = NULL;
-		wake_up_process(tsk);
-		put_task_struct(tsk);
-	} while (--loop);
-
-	sem->wait_list.next = next;
-	next->prev = &sem->wait_list;
+		wake_q_add(wake_q, tsk);
+		/*
+		 * Ensure that the last operation is setting the reader
+		 * waiter to nil such that rwsem_down_read_failed() cannot
+		 * race with do_exit() by always holding a reference count
+		 * to the task to wakeup.
+		 */
+		smp_store_release(&waiter->task, NULL);
+	}
 
  out:
 	return sem;
@@ -205,22 +213,36 @@ __rwsem_do_wake(struct rw_semaphore *sem, enum rwsem_wake_type wake_type)
 __visible
 struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 {
-	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	long count;
+	bool first = false;
 	struct rwsem_waiter waiter;
 	struct task_struct *tsk = current;
+	WAKE_Q(wake_q);
+
+	/* undo read bias from down_read operation, stop active locking */
+	count = rwsem_atomic_update(-RWSEM_ACTIVE_READ_BIAS, sem);
+
+	/*
+	 * Spin for the lock unless we just left waiters with nobody active
+	 * to wake them up: that is our job now, done below.
+	 */
+	if (count != RWSEM_WAITING_BIAS && rwsem_optimistic_spin(sem, false))
+		return sem;
 
 	/* set up my own style of waitqueue */
 	waiter.task = tsk;
 	waiter.type = RWSEM_WAITING_FOR_READ;
-	get_task_struct(tsk);
 
 	raw_spin_lock_irq(&sem->wait_lock);
 	if (list_empty(&sem->wait_list))
-		adjustment += RWSEM_WAITING_BIAS;
+		first = true;
 	list_add_tail(&waiter.list, &sem->wait_list);
 
-	/* we're now waiting on the lock, but no longer actively locking */
-	count = rwsem_atomic_update(adjustment, sem);
+	/* we're now waiting on the lock */
+	if (first)
+		count = rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
+	else
+		count = ACCESS_ONCE(sem->count);
 
 	/* If there are no active locks, wake the front queued process(es).
 	 *
@@ -228,11 +250,11 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 	 * wake our own waiter to join the existing active readers !
 	 */
 	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-	     adjustment != -RWSEM_ACTIVE_READ_BIAS))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+	    (count > RWSEM_WAITING_BIAS && first))
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
+	wake_up_q(&wake_q);
 
 	/* wait to be given the lock */
 	while (true) {
@@ -278,33 +300,58 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 			return false;
 
 		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count) {
+			rwsem_set_owner(sem);
+			return true;
+		}
+
+		count = old;
+	}
+}
+
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * A spinning reader never jumps ahead of queued waiters: that is only
+ * possible while the count is non-negative, i.e. no writer and nobody
+ * waiting.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count >= 0) {
+		old = cmpxchg(&sem->count, count, count + RWSEM_ACTIVE_READ_BIAS);
 		if (old == count)
 			return true;
 
 		count = old;
 	}
+	return false;
 }
 
 static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
 {
 	struct task_struct *owner;
-	bool on_cpu = false;
+	bool ret = false;
 
 	if (need_resched())
 		return false;
 
 	rcu_read_lock();
 	owner = ACCESS_ONCE(sem->owner);
-	if (owner)
-		on_cpu = owner->on_cpu;
+	if (rwsem_owner_is_reader(owner))
+		ret = true;	/* bounded, see rwsem_rspin_deadline() */
+	else if (owner)
+		ret = owner->on_cpu;
 	rcu_read_unlock();
 
 	/*
 	 * If sem->owner is not set, yet we have just recently entered the
-	 * slowpath, then there is a possibility reader(s) may have the lock.
-	 * To be safe, avoid spinning in these situations.
+	 * slowpath, then there is a possibility reader(s) may have the lock
+	 * that haven't marked it reader owned yet.  To be safe, avoid
+	 * spinning in these situations.
 	 */
-	return on_cpu;
+	return ret;
 }
 
 static inline bool owner_running(struct rw_semaphore *sem,
@@ -336,17 +383,48 @@ bool rwsem_spin_on_owner(struct rw_semaphore *sem, struct task_struct *owner)
 	}
 	rcu_read_unlock();
 
+	if (need_resched())
+		return false;
+
 	/*
 	 * We break out the loop above on need_resched() or when the
-	 * owner changed, which is a sign for heavy contention. Return
-	 * success only when sem->owner is NULL.
+	 * owner changed, which is a sign for heavy contention, or went
+	 * to sleep.  Carry on spinning only when the writer let go of the
+	 * lock or handed it to readers.
 	 */
-	return sem->owner == NULL;
+	owner = ACCESS_ONCE(sem->owner);
+	return !rwsem_owner_is_writer(owner);
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+/*
+ * Readers don't record who they are, so there is no on_cpu to watch while
+ * the lock is read owned.  Spin for a limited time instead: long enough
+ * to cover a typical read side critical section, a little longer the more
+ * readers there are.
+ */
+#define RWSEM_RSPIN_BASE_NS	(10 * NSEC_PER_USEC)
+#define RWSEM_RSPIN_READER_NS	(NSEC_PER_USEC / 2)
+#define RWSEM_RSPIN_MAX_READERS	30
+
+static inline u64 rwsem_rspin_deadline(struct rw_semaphore *sem)
+{
+	long readers = ACCESS_ONCE(sem->count) & RWSEM_ACTIVE_MASK;
+
+	if (readers > RWSEM_RSPIN_MAX_READERS)
+		readers = RWSEM_RSPIN_MAX_READERS;
+
+	return local_clock() + RWSEM_RSPIN_BASE_NS +
+	       readers * RWSEM_RSPIN_READER_NS;
+}
+
+/*
+ * Spin for the lock, as a writer if @wlock, else as a reader.  Return true
+ * if the lock was taken.
+ */
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	struct task_struct *owner;
+	u64 rspin_deadline = 0;
 	bool taken = false;
 
 	preempt_disable();
@@ -360,22 +438,40 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 
 	while (true) {
 		owner = ACCESS_ONCE(sem->owner);
-		if (owner && !rwsem_spin_on_owner(sem, owner))
-			break;
+		if (rwsem_owner_is_writer(owner)) {
+			if (!rwsem_spin_on_owner(sem, owner))
+				break;
+			rspin_deadline = 0;
+		} else if (wlock && rwsem_owner_is_reader(owner)) {
+			/* no owner to watch, bound the spinning by time */
+			if (!rspin_deadline)
+				rspin_deadline = rwsem_rspin_deadline(sem);
+			else if (local_clock() > rspin_deadline)
+				break;
+		}
 
 		/* wait_lock will be acquired if write_lock is obtained */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (wlock ? rwsem_try_write_lock_unqueued(sem) :
+			    rwsem_try_read_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		/*
+		 * A reader that could not get the lock without a writer to
+		 * wait for finds waiters queued: go and queue behind them.
+		 */
+		if (!wlock && !rwsem_owner_is_writer(owner))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
 		 * we're an RT task that will live-lock because we won't let
 		 * the owner complete.
 		 */
-		if (!owner && (need_resched() || rt_task(current)))
+		if (!rwsem_owner_is_writer(owner) &&
+		    (need_resched() || rt_task(current)))
 			break;
 
 		/*
@@ -393,7 +489,7 @@ done:
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem, bool wlock)
 {
 	return false;
 }
@@ -413,7 +509,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	count = rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, true))
 		return sem;
 
 	/*
@@ -440,8 +536,17 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 		 * no active writers, the lock must be read owned; so we try to
 		 * wake any read locks that were queued ahead of us.
 		 */
-		if (count > RWSEM_WAITING_BIAS)
-			sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS);
+		if (count > RWSEM_WAITING_BIAS) {
+			WAKE_Q(wake_q);
+
+			sem = __rwsem_do_wake(sem, RWSEM_WAKE_READERS, &wake_q);
+			/*
+			 * The wakeups are normally issued after the wait_lock
+			 * is released, but we are proactively waking readers
+			 * here and will soon drop the lock anyway to sleep.
+			 */
+			wake_up_q(&wake_q);
+		}
 
 	} else
 		count = rwsem_atomic_update(RWSEM_WAITING_BIAS, sem);
@@ -478,14 +583,16 @@ __visible
 struct rw_semaphore *rwsem_wake(struct rw_semaphore *sem)
 {
 	unsigned long flags;
+	WAKE_Q(wake_q);
 
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_ANY, &wake_q);
 
 	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
+	wake_up_q(&wake_q);
 
 	return sem;
 }
@@ -494,20 +601,22 @@ EXPORT_SYMBOL(rwsem_wake);
 /*
  * downgrade a write lock into a read lock
  * - caller incremented waiting part of count and discovered it still negative
- * - just wake up any readers at the front of the queue
+ * - just wake up the queued readers
  */
 __visible
 struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem)
 {
 	unsigned long flags;
+	WAKE_Q(wake_q);
 
 	raw_spin_lock_irqsave(&sem->wait_lock, flags);
 
 	/* do nothing if list empty */
 	if (!list_empty(&sem->wait_list))
-		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
+		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED, &wake_q);
 
 	raw_spin_unlock_irqrestore(&sem->wait_lock, flags);
+	wake_up_q(&wake_q);
 
 	return sem;
 }
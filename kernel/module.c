@@ -59,6 +59,8 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
 #include <uapi/linux/module.h>
 #include "module-internal.h"
 
@@ -292,62 +294,76 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
-/* Returns true as soon as fn returns true, otherwise false. */
-bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
-				    struct module *owner,
-				    void *data),
-			 void *data)
+static const struct symsearch kernel_symsearch[] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
+#define NR_SYMSEARCH	ARRAY_SIZE(kernel_symsearch)
+
+/* Fill in the NR_SYMSEARCH export tables of a module. */
+static void module_symsearch(const struct module *mod, struct symsearch *arr)
 {
-	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	const struct symsearch tmp[] = {
+		{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
 		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
+		{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
+		  mod->gpl_crcs,
 		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
+		{ mod->gpl_future_syms,
+		  mod->gpl_future_syms + mod->num_gpl_future_syms,
+		  mod->gpl_future_crcs,
 		  WILL_BE_GPL_ONLY, false },
 #ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
+		{ mod->unused_syms,
+		  mod->unused_syms + mod->num_unused_syms,
+		  mod->unused_crcs,
 		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
+		{ mod->unused_gpl_syms,
+		  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
+		  mod->unused_gpl_crcs,
 		  GPL_ONLY, true },
 #endif
 	};
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	BUILD_BUG_ON(ARRAY_SIZE(tmp) != NR_SYMSEARCH);
+	memcpy(arr, tmp, sizeof(tmp));
+}
+
+/* Returns true as soon as fn returns true, otherwise false. */
+bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
+				    struct module *owner,
+				    void *data),
+			 void *data)
+{
+	struct module *mod;
+
+	if (each_symbol_in_section(kernel_symsearch, NR_SYMSEARCH,
+				   NULL, fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY, false },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY, false },
-			{ mod->gpl_future_syms,
-			  mod->gpl_future_syms + mod->num_gpl_future_syms,
-			  mod->gpl_future_crcs,
-			  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-			{ mod->unused_syms,
-			  mod->unused_syms + mod->num_unused_syms,
-			  mod->unused_crcs,
-			  NOT_GPL_ONLY, true },
-			{ mod->unused_gpl_syms,
-			  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
-			  mod->unused_gpl_crcs,
-			  GPL_ONLY, true },
-#endif
-		};
+		struct symsearch arr[NR_SYMSEARCH];
 
 		if (mod->state == MODULE_STATE_UNFORMED)
 			continue;
 
-		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
+		module_symsearch(mod, arr);
+		if (each_symbol_in_section(arr, NR_SYMSEARCH, mod, fn, data))
 			return true;
 	}
 	return false;
@@ -424,6 +440,141 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * Hash index over the exported symbols of the kernel and of every formed
+ * module, so resolving a symbol does not bsearch each export table in
+ * turn.  Entries are added and removed under module_mutex and walked
+ * under preempt disabled or module_mutex, just like the module list.
+ * Until the kernel's own exports are hashed find_symbol() falls back to
+ * searching the tables.
+ */
+#define EXPORT_HASH_BITS	13
+static DEFINE_HASHTABLE(export_hash, EXPORT_HASH_BITS);
+static bool export_hash_ready;
+
+struct export_hash_entry {
+	struct hlist_node node;
+	const struct symsearch *syms;
+	struct module *owner;
+	unsigned int symnum;
+};
+
+struct module_export_hash {
+	struct symsearch arr[NR_SYMSEARCH];
+	struct export_hash_entry entries[];
+};
+
+static u32 export_hash_name(const char *name)
+{
+	return jhash(name, strlen(name), 0);
+}
+
+static unsigned int symsearch_count(const struct symsearch *arr)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < NR_SYMSEARCH; i++)
+		n += arr[i].stop - arr[i].start;
+	return n;
+}
+
+/* Hash all symbols of the tables in arr into entries.  Needs module_mutex. */
+static void export_hash_add(const struct symsearch *arr, struct module *owner,
+			    struct export_hash_entry *entries)
+{
+	struct export_hash_entry *e = entries;
+	unsigned int i, j;
+
+	for (i = 0; i < NR_SYMSEARCH; i++) {
+		for (j = 0; j < arr[i].stop - arr[i].start; j++, e++) {
+			e->syms = &arr[i];
+			e->owner = owner;
+			e->symnum = j;
+			hash_add_rcu(export_hash, &e->node,
+				     export_hash_name(arr[i].start[j].name));
+		}
+	}
+}
+
+/* Must hold module_mutex. */
+static int module_export_hash_add(struct module *mod)
+{
+	struct module_export_hash *eh;
+	struct symsearch arr[NR_SYMSEARCH];
+	unsigned int n;
+
+	module_symsearch(mod, arr);
+	n = symsearch_count(arr);
+	if (!n)
+		return 0;
+
+	eh = kmalloc(sizeof(*eh) + n * sizeof(eh->entries[0]), GFP_KERNEL);
+	if (!eh)
+		return -ENOMEM;
+
+	memcpy(eh->arr, arr, sizeof(arr));
+	export_hash_add(eh->arr, mod, eh->entries);
+	mod->export_hash = eh;
+	return 0;
+}
+
+/*
+ * Must hold module_mutex.  The entries are freed by the caller with
+ * module_export_hash_free() once an RCU grace period has passed.
+ */
+static void module_export_hash_del(struct module *mod)
+{
+	struct module_export_hash *eh = mod->export_hash;
+	unsigned int i, n;
+
+	if (!eh)
+		return;
+
+	n = symsearch_count(eh->arr);
+	for (i = 0; i < n; i++)
+		hash_del_rcu(&eh->entries[i].node);
+}
+
+static void module_export_hash_free(struct module *mod)
+{
+	kfree(mod->export_hash);
+	mod->export_hash = NULL;
+}
+
+static int __init export_hash_init(void)
+{
+	struct export_hash_entry *entries;
+	unsigned int n = symsearch_count(kernel_symsearch);
+
+	entries = vmalloc(n * sizeof(*entries));
+	if (!entries) {
+		pr_warn("no memory for the export symbol hash\n");
+		return -ENOMEM;
+	}
+
+	/* Modules formed before this point have hashed their own exports. */
+	mutex_lock(&module_mutex);
+	export_hash_add(kernel_symsearch, NULL, entries);
+	smp_store_release(&export_hash_ready, true);
+	mutex_unlock(&module_mutex);
+	return 0;
+}
+early_initcall(export_hash_init);
+
+static bool find_symbol_hashed(struct find_symbol_arg *fsa)
+{
+	struct export_hash_entry *e;
+
+	hash_for_each_possible_rcu(export_hash, e, node,
+				   export_hash_name(fsa->name)) {
+		if (strcmp(e->syms->start[e->symnum].name, fsa->name))
+			continue;
+		/* Exports are unique, see verify_export_symbols(). */
+		return check_symbol(e->syms, e->owner, e->symnum, fsa);
+	}
+	return false;
+}
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -438,7 +589,9 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	if (smp_load_acquire(&export_hash_ready) ?
+	    find_symbol_hashed(&fsa) :
+	    each_symbol_section(find_symbol_in_section, &fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1223,11 +1376,32 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 	struct module *owner;
 	const struct kernel_symbol *sym;
 	const unsigned long *crc;
+	bool gplok = !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE));
 	int err;
 
+	/*
+	 * Most symbols are exported by the kernel itself, which needs no
+	 * usage tracking and cannot go away: resolve those without
+	 * module_mutex, so modules loading in parallel do not serialize
+	 * on it once per undefined symbol.
+	 */
+	preempt_disable();
+	sym = find_symbol(name, &owner, &crc, gplok, true);
+	preempt_enable();
+	if (!sym)
+		return NULL;
+	if (!owner) {
+		if (!check_version(info->sechdrs, info->index.vers, name, mod,
+				   crc, NULL)) {
+			strncpy(ownername, module_name(owner), MODULE_NAME_LEN);
+			return ERR_PTR(-EINVAL);
+		}
+		return sym;
+	}
+
+	/* Exported by a module: look again with the owner held stable. */
 	mutex_lock(&module_mutex);
-	sym = find_symbol(name, &owner, &crc,
-			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
+	sym = find_symbol(name, &owner, &crc, gplok, false);
 	if (!sym)
 		goto unlock;
 
@@ -1828,6 +2002,7 @@ static void free_module(struct module *mod)
 	 * that noone uses it while it's being deconstructed. */
 	mutex_lock(&module_mutex);
 	mod->state = MODULE_STATE_UNFORMED;
+	module_export_hash_del(mod);
 	mutex_unlock(&module_mutex);
 
 	/* Remove dynamic debug info */
@@ -1852,6 +2027,8 @@ static void free_module(struct module *mod)
 	synchronize_rcu();
 	mutex_unlock(&module_mutex);
 
+	module_export_hash_free(mod);
+
 	/* This may be NULL, but that's OK */
 	unset_module_init_ro_nx(mod);
 	module_arch_freeing_init(mod);
@@ -3066,8 +3243,11 @@ static int do_init_module(struct module *mod)
 	 * Please refer to the following thread for details.
 	 *
 	 * http://thread.gmane.org/gmane.linux.kernel/1420814
+	 *
+	 * A module which asked for asynchronous probing is not waited for
+	 * either, its probes are exactly what would be waited on.
 	 */
-	if (current->flags & PF_USED_ASYNC)
+	if (!mod->async_probe_requested && (current->flags & PF_USED_ASYNC))
 		async_synchronize_full();
 
 	mutex_lock(&module_mutex);
@@ -3194,6 +3374,10 @@ static int complete_formation(struct module *mod, struct load_info *info)
 	if (err < 0)
 		goto out;
 
+	err = module_export_hash_add(mod);
+	if (err < 0)
+		goto out;
+
 	/* This relies on module_mutex for list integrity. */
 	module_bug_finalize(info->hdr, info->sechdrs, mod);
 
@@ -3225,8 +3409,21 @@ out:
 
 static int unknown_module_param_cb(char *param, char *val, const char *modname)
 {
+	struct module *mod;
+	int ret;
+
+	/* Check for magic 'async_probe' arg, the module is formed by now */
+	if (strcmp(param, "async_probe") == 0) {
+		mutex_lock(&module_mutex);
+		mod = find_module(modname);
+		if (mod)
+			mod->async_probe_requested = true;
+		mutex_unlock(&module_mutex);
+		return 0;
+	}
+
 	/* Check for magic 'dyndbg' arg */
-	int ret = ddebug_dyndbg_module_param_cb(param, val, modname);
+	ret = ddebug_dyndbg_module_param_cb(param, val, modname);
 	if (ret != 0)
 		pr_warn("%s: unknown parameter '%s' ignored\n", modname, param);
 	return 0;
@@ -3353,6 +3550,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
  bug_cleanup:
 	/* module_bug_cleanup needs module_mutex protection */
 	mutex_lock(&module_mutex);
+	module_export_hash_del(mod);
 	module_bug_cleanup(mod);
 	mutex_unlock(&module_mutex);
 
@@ -3378,6 +3576,7 @@ static int load_module(struct load_info *info, const char __user *uargs,
 	/* Wait for RCU synchronizing before releasing mod->list. */
 	synchronize_rcu();
 	mutex_unlock(&module_mutex);
+	module_export_hash_free(mod);
  free_module:
 	module_deallocate(mod, info);
  free_copy:
@@ -30,6 +30,9 @@
 #include <linux/slab.h>
 #include <linux/sysfs.h>
 #include <linux/rcupdate.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/topology.h>
 
 #define MAX_OBJ_NUM 1000
 
@@ -347,6 +350,148 @@ void padata_do_serial(struct padata_priv *padata)
 }
 EXPORT_SYMBOL(padata_do_serial);
 
+struct padata_mt_job_state {
+	spinlock_t		lock;
+	struct completion	completion;
+	struct padata_mt_job	*job;
+	int			nworks;
+	int			nworks_fini;
+	unsigned long		chunk_size;
+};
+
+struct padata_mt_work {
+	struct work_struct		work;
+	struct padata_mt_job_state	*ps;
+};
+
+static void padata_mt_helper(struct work_struct *w)
+{
+	struct padata_mt_work *pw = container_of(w, struct padata_mt_work, work);
+	struct padata_mt_job_state *ps = pw->ps;
+	struct padata_mt_job *job = ps->job;
+	bool done;
+
+	spin_lock(&ps->lock);
+
+	while (job->size > 0) {
+		unsigned long start, size, end;
+
+		start = job->start;
+		/* So end is chunk size aligned if enough work remains. */
+		size = roundup(start + 1, ps->chunk_size) - start;
+		size = min(size, job->size);
+		end = start + size;
+
+		job->start = end;
+		job->size -= size;
+
+		spin_unlock(&ps->lock);
+		job->thread_fn(start, end, job->fn_arg);
+		spin_lock(&ps->lock);
+	}
+
+	++ps->nworks_fini;
+	done = (ps->nworks_fini == ps->nworks);
+	spin_unlock(&ps->lock);
+
+	if (done)
+		complete(&ps->completion);
+}
+
+/*
+ * Pick the cpu whose unbound worker pool serves @nid. Queueing an unbound
+ * work on a cpu only selects the pool of that cpu's node, the work is
+ * still free to run on any cpu of the node.
+ */
+static int padata_mt_node_cpu(int nid)
+{
+	int cpu;
+
+	if (nid == NUMA_NO_NODE)
+		return WORK_CPU_UNBOUND;
+
+	cpu = cpumask_any_and(cpumask_of_node(nid), cpu_online_mask);
+	return cpu < nr_cpu_ids ? cpu : WORK_CPU_UNBOUND;
+}
+
+/**
+ * padata_do_multithreaded - run a multithreaded job
+ *
+ * @job: Description of the job.
+ *
+ * The job range is cut into chunks which the calling thread and up to
+ * @job->max_threads - 1 unbound workqueue helpers on @job->numa_node
+ * consume until the range is exhausted.  Returns once all of them are
+ * done.  @job->thread_fn must be safe to call concurrently on disjoint
+ * ranges and may sleep.  If the helpers can't be allocated the caller
+ * does the whole job by itself.
+ *
+ * @job->start and @job->size are consumed by the call.
+ */
+void padata_do_multithreaded(struct padata_mt_job *job)
+{
+	/* In case threads finish at different times. */
+	static const unsigned long load_balance_factor = 4;
+	struct padata_mt_work my_work, *works;
+	struct padata_mt_job_state ps;
+	unsigned long nworks;
+	int i, cpu;
+
+	if (job->size == 0)
+		return;
+
+	/* Ensure at least one thread when size < min_chunk. */
+	nworks = max(job->size / max(job->min_chunk, 1ul), 1ul);
+	nworks = min(nworks, (unsigned long)max(job->max_threads, 1));
+
+	works = NULL;
+	if (nworks > 1)
+		works = kcalloc(nworks - 1, sizeof(*works), GFP_KERNEL);
+
+	if (!works) {
+		/* Single thread, no coordination needed, cut to the chase. */
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+		return;
+	}
+
+	spin_lock_init(&ps.lock);
+	init_completion(&ps.completion);
+	ps.job = job;
+	ps.nworks = nworks;
+	ps.nworks_fini = 0;
+
+	/*
+	 * Chunk size is the amount of work a helper does per call to the
+	 * thread function.  Load balance large jobs between threads by
+	 * increasing the number of chunks, guarantee at least the minimum
+	 * chunk size from the caller, and honor the caller's alignment.
+	 */
+	ps.chunk_size = job->size / (ps.nworks * load_balance_factor);
+	ps.chunk_size = max(ps.chunk_size, job->min_chunk);
+	ps.chunk_size = max(ps.chunk_size, 1ul);
+	if (job->align > 1)
+		ps.chunk_size = roundup(ps.chunk_size, job->align);
+
+	cpu = padata_mt_node_cpu(job->numa_node);
+	for (i = 0; i < nworks - 1; i++) {
+		works[i].ps = &ps;
+		INIT_WORK(&works[i].work, padata_mt_helper);
+		queue_work_on(cpu, system_unbound_wq, &works[i].work);
+	}
+
+	/* Use the current thread, which saves starting a workqueue worker. */
+	my_work.ps = &ps;
+	INIT_WORK_ONSTACK(&my_work.work, padata_mt_helper);
+	padata_mt_helper(&my_work.work);
+
+	/* Wait for all the helpers to finish. */
+	wait_for_completion(&ps.completion);
+
+	destroy_work_on_stack(&my_work.work);
+	kfree(works);
+}
+EXPORT_SYMBOL_GPL(padata_do_multithreaded);
+
 static int padata_setup_cpumasks(struct parallel_data *pd,
 				 const struct cpumask *pcpumask,
 				 const struct cpumask *cbcpumask)
@@ -23,7 +23,15 @@
 
 #define TOI_CORE_VERSION "3.3"
 #define	TOI_HEADER_VERSION 3
-#define MY_BOOT_KERNEL_DATA_VERSION 4
+#define MY_BOOT_KERNEL_DATA_VERSION 5
+
+/* Stages of reading an image, for the timing breakdown in debug_info */
+enum {
+	TOI_READ_STAGE_IO_WAIT,
+	TOI_READ_STAGE_DECOMPRESS,
+	TOI_READ_STAGE_PLACE,
+	TOI_NUM_READ_STAGES
+};
 
 struct toi_boot_kernel_data {
 	int version;
@@ -39,6 +47,7 @@ struct toi_boot_kernel_data {
 	unsigned long compress_bytes_in;
 	unsigned long compress_bytes_out;
 	unsigned long pruned_pages;
+	u64 read_stage_ns[TOI_NUM_READ_STAGES];
 };
 
 extern struct toi_boot_kernel_data toi_bkd;
@@ -31,6 +31,10 @@ struct toi_bdev_info {
 	struct hibernate_extent_chain allocations;
 	char name[266]; /* "swap on " or "file " + up to 256 chars */
 
+	/* Runtime I/O accounting, not saved */
+	atomic_t io_in_progress;
+	int max_io_in_progress;
+
 	/* Saved in header */
 	char uuid[17];
 	dev_t dev_t;
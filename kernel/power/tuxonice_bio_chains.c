@@ -797,6 +797,28 @@ int devices_of_same_priority(struct toi_bdev_info *this)
 	return i;
 }
 
+/**
+ * toi_bdev_chain - find the chain that accounts for I/O to a block device
+ * @bdev: The block device being used.
+ *
+ * Chains that share a block device (a swap partition and a swapfile on the
+ * same disk, say) share the first matching chain's in-flight count, so the
+ * per device throttle really is per device. Called from bio completion, so
+ * it must not sleep; the list of chains doesn't change while I/O is running.
+ **/
+struct toi_bdev_info *toi_bdev_chain(struct block_device *bdev)
+{
+	struct toi_bdev_info *check = prio_chain_head;
+
+	while (check) {
+		if (check->bdev == bdev)
+			return check;
+		check = check->next;
+	}
+
+	return NULL;
+}
+
 /**
  * toi_bio_rw_page - do i/o on the next disk page in the image
  * @writing: Whether reading or writing.
@@ -1039,8 +1061,9 @@ int toi_bio_chains_debug_info(char *buffer, int size)
 
 	while (cur_chain) {
 		len += scnprintf(buffer + len, size - len, "  Used %lu pages "
-				"from %s.\n", cur_chain->pages_used,
-				cur_chain->name);
+				"from %s (max %d in flight).\n",
+				cur_chain->pages_used, cur_chain->name,
+				cur_chain->max_io_in_progress);
 		cur_chain = cur_chain->next;
 	}
 
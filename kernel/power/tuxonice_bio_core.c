@@ -55,6 +55,7 @@ unsigned long mutex_times[2][2][NR_CPUS];
 static int page_idx, reset_idx;
 
 static int target_outstanding_io = 1024;
+static int per_device_outstanding_io;
 static int max_outstanding_writes, max_outstanding_reads;
 
 static struct page *bio_queue_head, *bio_queue_tail;
@@ -104,7 +105,7 @@ static void set_free_mem_throttle(void)
 		free_mem_throttle = new_throttle;
 }
 
-#define NUM_REASONS 7
+#define NUM_REASONS 8
 static atomic_t reasons[NUM_REASONS];
 static char *reason_name[NUM_REASONS] = {
 	"readahead not ready",
@@ -114,6 +115,7 @@ static char *reason_name[NUM_REASONS] = {
 	"memory low",
 	"readahead buffer allocation",
 	"throughput_throttle",
+	"device throttle",
 };
 
 /* User Specified Parameters. */
@@ -262,6 +264,43 @@ static int throttle_if_needed(int flags)
 	return 0;
 }
 
+/**
+ * device_io_limit - how many bios may be in flight to one device
+ * @chain: The chain accounting for the device.
+ *
+ * Image pages are striped page by page across all chains of the same
+ * priority, so each device gets its share of target_outstanding_io unless
+ * the user has set an explicit per device limit. This stops one slow
+ * device from soaking up the whole budget while its peers sit idle.
+ **/
+static int device_io_limit(struct toi_bdev_info *chain)
+{
+	if (per_device_outstanding_io)
+		return per_device_outstanding_io;
+
+	return max(target_outstanding_io / devices_of_same_priority(chain), 1);
+}
+
+/**
+ * throttle_device - wait for a device's in flight I/O to drop below its limit
+ * @chain: The chain accounting for the device.
+ *
+ * Unlike the memory throttle, this is safe when reading too: we only wait
+ * for bios already submitted to complete, not for pages to be consumed.
+ **/
+static void throttle_device(struct toi_bdev_info *chain)
+{
+	int limit = device_io_limit(chain);
+
+	if (likely(atomic_read(&chain->io_in_progress) < limit))
+		return;
+
+	atomic_inc(&reasons[7]);
+	wait_event(num_in_progress_wait,
+		atomic_read(&chain->io_in_progress) < limit ||
+		test_result_state(TOI_ABORTED));
+}
+
 /**
  * update_throughput_throttle - update the raw throughput throttle
  * @jif_index: The number of times this function has been called.
@@ -311,6 +350,7 @@ static int toi_finish_all_io(void)
 static void toi_end_bio(struct bio *bio, int err)
 {
 	struct page *page = bio->bi_io_vec[0].bv_page;
+	struct toi_bdev_info *chain = toi_bdev_chain(bio->bi_bdev);
 
 	BUG_ON(!test_bit(BIO_UPTODATE, &bio->bi_flags));
 
@@ -327,6 +367,8 @@ static void toi_end_bio(struct bio *bio, int err)
 
 	bio_put(bio);
 
+	if (chain)
+		atomic_dec(&chain->io_in_progress);
 	atomic_dec(&toi_io_in_progress);
 	atomic_inc(&toi_io_done);
 
@@ -353,6 +395,7 @@ static void toi_end_bio(struct bio *bio, int err)
 static int submit(int writing, struct block_device *dev, sector_t first_block,
 		struct page *page, int free_group)
 {
+	struct toi_bdev_info *chain = toi_bdev_chain(dev);
 	struct bio *bio = NULL;
 	int cur_outstanding_io, result;
 
@@ -390,6 +433,14 @@ static int submit(int writing, struct block_device *dev, sector_t first_block,
 
 	bio_get(bio);
 
+	if (chain) {
+		throttle_device(chain);
+		cur_outstanding_io = atomic_add_return(1,
+				&chain->io_in_progress);
+		if (cur_outstanding_io > chain->max_io_in_progress)
+			chain->max_io_in_progress = cur_outstanding_io;
+	}
+
 	cur_outstanding_io = atomic_add_return(1, &toi_io_in_progress);
 	if (writing) {
 		if (cur_outstanding_io > max_outstanding_writes)
@@ -843,8 +894,11 @@ static int toi_bio_get_next_page_read(int no_readahead)
 	}
 
 	if (PageLocked(readahead_list_head)) {
+		u64 start = local_clock();
+
 		waiting_on = readahead_list_head;
 		do_bio_wait(0);
+		toi_read_stage_done(TOI_READ_STAGE_IO_WAIT, start);
 	}
 
 	virt = page_address(readahead_list_head);
@@ -1776,6 +1830,8 @@ EXPORT_SYMBOL_GPL(toi_bio_ops);
 static struct toi_sysfs_data sysfs_params[] = {
 	SYSFS_INT("target_outstanding_io", SYSFS_RW, &target_outstanding_io,
 			0, 16384, 0, NULL),
+	SYSFS_INT("per_device_outstanding_io", SYSFS_RW,
+			&per_device_outstanding_io, 0, 16384, 0, NULL),
 };
 
 struct toi_module_ops toi_blockwriter_ops = {
@@ -16,6 +16,7 @@ int go_next_page(int writing, int section_barrier);
 void toi_extent_state_restore(int slot);
 void free_all_bdev_info(void);
 int devices_of_same_priority(struct toi_bdev_info *this);
+struct toi_bdev_info *toi_bdev_chain(struct block_device *bdev);
 int toi_register_storage_chain(struct toi_bdev_info *new);
 int toi_serialise_extent_chains(void);
 int toi_load_extent_chains(void);
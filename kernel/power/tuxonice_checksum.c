@@ -15,6 +15,7 @@
 #include <linux/vmalloc.h>
 #include <linux/crypto.h>
 #include <linux/scatterlist.h>
+#include <linux/tuxonice.h>
 
 #include "tuxonice.h"
 #include "tuxonice_modules.h"
@@ -46,7 +47,7 @@ static DEFINE_PER_CPU(struct cpu_context, contexts);
 static int pages_allocated;
 static unsigned long page_list;
 
-static int toi_num_resaved;
+static int toi_num_resaved, toi_num_unchanged;
 
 static unsigned long this_checksum, next_page;
 static int checksum_count;
@@ -149,6 +150,9 @@ static int toi_checksum_print_debug_stats(char *buffer, int size)
 			toi_checksum_name);
 	len += scnprintf(buffer + len, size - len,
 		"  %d pages resaved in atomic copy.\n", toi_num_resaved);
+	len += scnprintf(buffer + len, size - len,
+		"  %d pages known unchanged by dirty tracking.\n",
+		toi_num_unchanged);
 	return len;
 }
 
@@ -271,6 +275,17 @@ int tuxonice_calc_checksum(struct page *page, char *checksum_locn)
 	if (!toi_checksum_ops.enabled)
 		return 0;
 
+	/*
+	 * Write protected pages can't change before the atomic copy without
+	 * faulting and losing their protection, so check_checksums can tell
+	 * from the page flags alone. Leave the slot zeroed to say we skipped
+	 * it.
+	 */
+	if (toi_page_unchanged(page)) {
+		memset(checksum_locn, 0, CHECKSUM_SIZE);
+		return 0;
+	}
+
 	pa = kmap(page);
 	memcpy(ctx->buf, pa, PAGE_SIZE);
 	kunmap(page);
@@ -300,6 +315,7 @@ void check_checksums(void)
 	next_page = (unsigned long) page_list;
 
 	toi_num_resaved = 0;
+	toi_num_unchanged = 0;
 	this_checksum = 0;
 
         toi_trace_index++;
@@ -320,20 +336,28 @@ void check_checksums(void)
                         next_page = *((unsigned long *) next_page);
                     }
 
-                    /* Done when IRQs disabled so must be atomic */
-                    pa = kmap_atomic(page);
-                    memcpy(ctx->buf, pa, PAGE_SIZE);
-                    kunmap_atomic(pa);
-                    ret = crypto_hash_digest(&ctx->desc, ctx->sg, PAGE_SIZE,
-                            current_checksum);
-
-                    if (ret) {
-                        printk(KERN_INFO "Digest failed. Returned %d.\n", ret);
-                        return;
+                    if (toi_page_unchanged(page)) {
+                        toi_num_unchanged++;
+                    } else if (!memchr_inv((char *) this_checksum, 0,
+                                CHECKSUM_SIZE)) {
+                        /* Skipped when saved, but written to since */
+                        resave_needed = true;
+                    } else {
+                        /* Done when IRQs disabled so must be atomic */
+                        pa = kmap_atomic(page);
+                        memcpy(ctx->buf, pa, PAGE_SIZE);
+                        kunmap_atomic(pa);
+                        ret = crypto_hash_digest(&ctx->desc, ctx->sg,
+                                PAGE_SIZE, current_checksum);
+
+                        if (ret) {
+                            printk(KERN_INFO "Digest failed. Returned %d.\n", ret);
+                            return;
+                        }
+
+                        resave_needed = memcmp(current_checksum,
+                                (char *) this_checksum, CHECKSUM_SIZE);
                     }
-
-                    resave_needed = memcmp(current_checksum, (char *) this_checksum,
-                            CHECKSUM_SIZE);
                 } else {
                     resave_needed = true;
                 }
@@ -27,7 +27,7 @@ static int toi_expected_compression;
 static struct toi_module_ops toi_compression_ops;
 static struct toi_module_ops *next_driver;
 
-static char toi_compressor_name[32] = "lzo";
+static char toi_compressor_name[32] = CONFIG_TOI_DEFAULT_COMPRESSOR;
 
 static DEFINE_MUTEX(stats_lock);
 
@@ -232,6 +232,7 @@ static int toi_compress_read_page(unsigned long *index, int buf_type,
 	unsigned int outlen = PAGE_SIZE;
 	char *buffer_start;
 	struct cpu_context *ctx = &per_cpu(contexts, cpu);
+	u64 start;
 
 	if (!ctx->transform)
 		return next_driver->read_page(index, TOI_PAGE, buffer_page,
@@ -252,10 +253,12 @@ static int toi_compress_read_page(unsigned long *index, int buf_type,
 		goto out;
 	}
 
+	start = local_clock();
 	ret = crypto_comp_decompress(
 			ctx->transform,
 			ctx->page_buffer,
 			len, buffer_start, &outlen);
+	toi_read_stage_done(TOI_READ_STAGE_DECOMPRESS, start);
 
 	toi_message(TOI_COMPRESS, TOI_VERBOSE, 0,
 			"CPU %d, index %lu: %d=>%d (%d).",
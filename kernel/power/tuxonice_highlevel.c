@@ -369,6 +369,15 @@ static int get_toi_debug_info(const char *buffer, int count)
 		SNPRINTF(".\n");
 	} else
 		SNPRINTF("- No I/O speed stats available.\n");
+	if (toi_bkd.toi_io_time[1][1])
+		SNPRINTF("- Read stages    : I/O wait %llu ms, decompress %llu "
+			"ms, placement %llu ms.\n",
+			div_u64(toi_bkd.read_stage_ns[TOI_READ_STAGE_IO_WAIT],
+				NSEC_PER_MSEC),
+			div_u64(toi_bkd.read_stage_ns[TOI_READ_STAGE_DECOMPRESS],
+				NSEC_PER_MSEC),
+			div_u64(toi_bkd.read_stage_ns[TOI_READ_STAGE_PLACE],
+				NSEC_PER_MSEC));
 	SNPRINTF("- Extra pages    : %lu used/%lu.\n",
 			extra_pd1_pages_used, extra_pd1_pages_allowance);
 
@@ -523,6 +532,9 @@ static int toi_init(int restarting)
 		for (j = 0; j < 2; j++)
 			toi_bkd.toi_io_time[i][j] = 0;
 
+	for (i = 0; i < TOI_NUM_READ_STAGES; i++)
+		toi_bkd.read_stage_ns[i] = 0;
+
 	if (!test_toi_state(TOI_CAN_HIBERNATE) ||
 	    allocate_bitmaps())
 		return 1;
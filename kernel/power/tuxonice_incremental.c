@@ -327,6 +327,25 @@ static __init int toi_reset_dirtiness(void)
         return 0;
 }
 
+/**
+ * toi_page_unchanged - has a page been left untouched since it was protected?
+ * @page: The page to check.
+ *
+ * A page that still carries PageTOI_RO has not taken a write fault since
+ * toi_reset_dirtiness protected it, so its contents are known to be the
+ * same without reading them. That only holds if the protection was really
+ * applied, so pages beyond toi_max= or with toi_no_ro in effect never count
+ * as unchanged.
+ **/
+int toi_page_unchanged(struct page *page)
+{
+	if (toi_disable_memory_ro ||
+	    (toi_search && page_to_pfn(page) >= toi_search))
+		return 0;
+
+	return PageTOI_RO(page) && !PageTOI_Dirty(page);
+}
+
 #if 0
 /* toi_generate_untracked_map
  *
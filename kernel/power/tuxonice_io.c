@@ -72,6 +72,9 @@ EXPORT_SYMBOL_GPL(toi_bio_queue_flusher_should_finish);
 
 int toi_max_workers;
 
+/* Time spent in each stage of reading a pageset, summed over I/O threads */
+static atomic64_t toi_read_stage_ns[TOI_NUM_READ_STAGES];
+
 static char *image_version_error = "The image header version is newer than " \
 	"this kernel supports.";
 
@@ -514,6 +517,21 @@ static int read_next_page(int *my_io_index, unsigned long *write_pfn,
 	return first_filter->read_page(write_pfn, TOI_PAGE, buffer, &buf_size);
 }
 
+/**
+ * toi_read_stage_done - account time spent in one stage of reading the image
+ * @stage: TOI_READ_STAGE_* index.
+ * @start: local_clock() value when the stage was entered.
+ *
+ * Reading is done by toi_max_workers threads at once, each getting a page
+ * from the readahead queue, decompressing it on its own cpu and copying it
+ * into place. The totals show which of those stages is holding resume up.
+ **/
+void toi_read_stage_done(int stage, u64 start)
+{
+	atomic64_add(local_clock() - start, &toi_read_stage_ns[stage]);
+}
+EXPORT_SYMBOL_GPL(toi_read_stage_done);
+
 static void use_read_page(unsigned long write_pfn, struct page *buffer)
 {
 	struct page *final_page = pfn_to_page(write_pfn),
@@ -521,6 +539,7 @@ static void use_read_page(unsigned long write_pfn, struct page *buffer)
 	char *virt, *buffer_virt;
 	int was_present, cpu = smp_processor_id();
 	unsigned long idx = 0;
+	u64 start = local_clock();
 
 	if (io_pageset == 1 && (!pageset1_copy_map ||
 			!memory_bm_test_bit(pageset1_copy_map, cpu, write_pfn))) {
@@ -549,6 +568,7 @@ static void use_read_page(unsigned long write_pfn, struct page *buffer)
 	kunmap(buffer);
 	memory_bm_clear_bit(io_map, cpu, write_pfn);
 	TOI_TRACE_DEBUG(write_pfn, "_PS%d_read", io_pageset);
+	toi_read_stage_done(TOI_READ_STAGE_PLACE, start);
 }
 
 static unsigned long status_update(int writing, unsigned long done,
@@ -984,7 +1004,7 @@ int write_pageset(struct pagedir *pagedir)
  **/
 static int read_pageset(struct pagedir *pagedir, int overwrittenpagesonly)
 {
-	int result = 0, base = 0;
+	int result = 0, base = 0, i;
 	int finish_at = pagedir->size;
 	int barmax = pagedir1.size + pagedir2.size;
 	struct memory_bitmap *pageflags;
@@ -1004,6 +1024,9 @@ static int read_pageset(struct pagedir *pagedir, int overwrittenpagesonly)
 		pageflags = pageset2_map;
 	}
 
+	for (i = 0; i < TOI_NUM_READ_STAGES; i++)
+		atomic64_set(&toi_read_stage_ns[i], 0);
+
 	start_time = jiffies;
 
 	if (rw_init_modules(READ, pagedir->id)) {
@@ -1025,6 +1048,9 @@ static int read_pageset(struct pagedir *pagedir, int overwrittenpagesonly)
 	if ((end_time - start_time) && (!test_result_state(TOI_ABORTED))) {
 		toi_bkd.toi_io_time[1][0] += finish_at,
 		toi_bkd.toi_io_time[1][1] += (end_time - start_time);
+		for (i = 0; i < TOI_NUM_READ_STAGES; i++)
+			toi_bkd.read_stage_ns[i] +=
+				atomic64_read(&toi_read_stage_ns[i]);
 	}
 
 	return result;
@@ -56,6 +56,7 @@ int image_exists_read(const char *page, int count);
 int image_exists_write(const char *buffer, int count);
 extern void save_restore_alt_param(int replace, int quiet);
 extern atomic_t toi_io_workers;
+extern void toi_read_stage_done(int stage, u64 start);
 
 /* Args to save_restore_alt_param */
 #define RESTORE 0
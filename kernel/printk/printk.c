@@ -45,6 +45,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 
@@ -1626,6 +1627,29 @@ static size_t cont_print_text(char *text, size_t size)
 	return textlen;
 }
 
+/*
+ * Printing to the consoles is handed off to the printk kthread once it is
+ * running, so that a message storm on a slow (e.g. serial) console does
+ * not keep the CPUs calling printk() spinning in console_unlock() for
+ * hundreds of milliseconds. Emergency messages, oopses and panics, and
+ * everything printed while booting or shutting down is still printed
+ * synchronously. "printk.synchronous=1" restores the old behaviour.
+ */
+static bool __read_mostly printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO);
+MODULE_PARM_DESC(synchronous, "make printing to console synchronous");
+
+static struct task_struct *printk_kthread;
+static bool printk_kthread_need_flush;
+
+static void queue_console_output(void);
+
+static bool printk_offload(int level)
+{
+	return !printk_sync && printk_kthread && !oops_in_progress &&
+	       level > LOGLEVEL_EMERG && system_state == SYSTEM_RUNNING;
+}
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1776,7 +1800,9 @@ asmlinkage int vprintk_emit(int facility, int level,
 	local_irq_restore(flags);
 
 	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	if (!in_sched && printk_offload(level)) {
+		queue_console_output();
+	} else if (!in_sched) {
 		lockdep_off();
 		/*
 		 * Disable preemption to avoid being preempted while holding
@@ -2641,14 +2667,50 @@ late_initcall(printk_late_init);
 
 static DEFINE_PER_CPU(int, printk_pending);
 
+static int printk_kthread_func(void *data)
+{
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_kthread_need_flush)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/* Anything stored after this will set the flag again */
+		printk_kthread_need_flush = false;
+
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+static int __init init_printk_kthread(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(task)) {
+		pr_err("printk: unable to create printing thread\n");
+		return PTR_ERR(task);
+	}
+	printk_kthread = task;
+	return 0;
+}
+late_initcall(init_printk_kthread);
+
 static void wake_up_klogd_work_func(struct irq_work *irq_work)
 {
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
-		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		if (printk_offload(LOGLEVEL_DEFAULT)) {
+			printk_kthread_need_flush = true;
+			wake_up_process(printk_kthread);
+		} else if (console_trylock()) {
+			/* If trylock fails, someone else is doing the printing */
 			console_unlock();
+		}
 	}
 
 	if (pending & PRINTK_PENDING_WAKEUP)
@@ -2660,6 +2722,18 @@ static DEFINE_PER_CPU(struct irq_work, wake_up_klogd_work) = {
 	.flags = IRQ_WORK_LAZY,
 };
 
+/*
+ * Have the pending output printed from irq_work context, where it is safe
+ * to wake up the printk kthread whatever locks the printk() caller holds.
+ */
+static void queue_console_output(void)
+{
+	preempt_disable();
+	__this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+	irq_work_queue(this_cpu_ptr(&wake_up_klogd_work));
+	preempt_enable();
+}
+
 void wake_up_klogd(void)
 {
 	preempt_disable();
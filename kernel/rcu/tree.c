@@ -298,6 +298,16 @@ static ulong jiffies_till_next_fqs = ULONG_MAX;
 module_param(jiffies_till_first_fqs, ulong, 0644);
 module_param(jiffies_till_next_fqs, ulong, 0644);
 
+/*
+ * A lazy callback batch is queued for a grace period once it holds
+ * lazy_batch callbacks, or jiffies_till_lazy_flush after its first one.
+ */
+static long lazy_batch = 128;
+static ulong jiffies_till_lazy_flush = HZ;
+
+module_param(lazy_batch, long, 0644);
+module_param(jiffies_till_lazy_flush, ulong, 0644);
+
 /*
  * How long the grace period must be before we start recruiting
  * quiescent-state help from rcu_note_context_switch().
@@ -2713,6 +2723,119 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_restore(flags);
 }
 
+/*
+ * Queue the lazy batch of lrdp, which is either this CPU's or that of a
+ * dead CPU, as ordinary callbacks of this CPU.  They have waited long
+ * enough already, so from here on they are not treated as lazy.
+ * Called with interrupts disabled, flags are the caller's saved ones.
+ */
+static void rcu_lazy_flush(struct rcu_data *lrdp, unsigned long *counter,
+			   unsigned long flags)
+{
+	struct rcu_head *head = lrdp->lazy_head;
+	struct rcu_head **tail = lrdp->lazy_tail;
+	long n = lrdp->lazy_len;
+	struct rcu_data *rdp;
+
+	del_timer(&lrdp->lazy_timer);
+	if (!n)
+		return;
+	lrdp->lazy_head = NULL;
+	lrdp->lazy_tail = &lrdp->lazy_head;
+	lrdp->lazy_len = 0;
+	(*counter)++;
+	lrdp->n_lazy_cbs += n;
+	if (n > lrdp->lazy_max_batch)
+		lrdp->lazy_max_batch = n;
+
+	rdp = this_cpu_ptr(rcu_state_p->rda);
+	if (unlikely(rdp->nxttail[RCU_NEXT_TAIL] == NULL)) {
+		/* _call_rcu() is illegal on offline CPU; leak the callbacks. */
+		WARN_ON_ONCE(!__call_rcu_nocb_list(rdp, head, tail, n, flags));
+		return;
+	}
+	ACCESS_ONCE(rdp->qlen) = rdp->qlen + n;
+	rcu_idle_count_callbacks_posted();
+	smp_mb();  /* Count before adding callbacks for rcu_barrier(). */
+	*rdp->nxttail[RCU_NEXT_TAIL] = head;
+	rdp->nxttail[RCU_NEXT_TAIL] = tail;
+	__call_rcu_core(rcu_state_p, rdp, head, flags);
+}
+
+static void rcu_lazy_timer(unsigned long unused)
+{
+	struct rcu_data *rdp;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	rdp = this_cpu_ptr(rcu_state_p->rda);
+	rcu_lazy_flush(rdp, &rdp->n_lazy_flush_timer, flags);
+	local_irq_restore(flags);
+}
+
+static void rcu_lazy_flush_func(void *unused)
+{
+	struct rcu_data *rdp;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	rdp = this_cpu_ptr(rcu_state_p->rda);
+	rcu_lazy_flush(rdp, &rdp->n_lazy_flush_other, flags);
+	local_irq_restore(flags);
+}
+
+/* Queue the lazy batch left behind by a CPU that went offline. */
+static void rcu_lazy_flush_dead_cpu(int cpu)
+{
+	struct rcu_data *rdp = per_cpu_ptr(rcu_state_p->rda, cpu);
+	unsigned long flags;
+
+	del_timer_sync(&rdp->lazy_timer);
+	local_irq_save(flags);
+	rcu_lazy_flush(rdp, &rdp->n_lazy_flush_other, flags);
+	local_irq_restore(flags);
+}
+
+/**
+ * call_rcu_lazy() - Queue an RCU callback that is in no hurry.
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * Same guarantees as call_rcu(), but the callback is first collected
+ * into a per-CPU batch, which asks for a grace period only once it is
+ * large enough or old enough.  Meant for callbacks that just free
+ * memory and are posted in storms, like file and dentry freeing, so
+ * that they do not each push for grace periods and softirq work.  The
+ * batch timer is deferrable, so an idle CPU is not woken up for it.
+ */
+void call_rcu_lazy(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
+{
+	struct rcu_data *rdp;
+	unsigned long flags;
+
+	WARN_ON_ONCE((unsigned long)head & 0x1); /* Misaligned rcu_head! */
+	if (debug_rcu_head_queue(head)) {
+		/* Probable double call_rcu(), so leak the callback. */
+		ACCESS_ONCE(head->func) = rcu_leak_callback;
+		WARN_ONCE(1, "call_rcu_lazy(): Leaked duplicate callback\n");
+		return;
+	}
+	head->func = func;
+	head->next = NULL;
+
+	local_irq_save(flags);
+	rdp = this_cpu_ptr(rcu_state_p->rda);
+	*rdp->lazy_tail = head;
+	rdp->lazy_tail = &head->next;
+	if (++rdp->lazy_len >= ACCESS_ONCE(lazy_batch))
+		rcu_lazy_flush(rdp, &rdp->n_lazy_flush_size, flags);
+	else if (rdp->lazy_len == 1)
+		mod_timer_pinned(&rdp->lazy_timer,
+				 jiffies + ACCESS_ONCE(jiffies_till_lazy_flush));
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+
 /*
  * Queue an RCU-sched callback for invocation after a grace period.
  */
@@ -3302,6 +3425,10 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	atomic_set(&rsp->barrier_cpu_count, 1);
 	get_online_cpus();
 
+	/* Lazy batches must be queued before the barrier callbacks. */
+	if (rsp == rcu_state_p)
+		on_each_cpu(rcu_lazy_flush_func, NULL, 1);
+
 	/*
 	 * Force each CPU with callbacks to register a new callback.
 	 * When that callback is invoked, we will know that all of the
@@ -3393,6 +3520,8 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rdp->lazy_tail = &rdp->lazy_head;
+	__setup_timer(&rdp->lazy_timer, rcu_lazy_timer, 0, TIMER_DEFERRABLE);
 	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
@@ -3502,6 +3631,7 @@ static int rcu_cpu_notify(struct notifier_block *self,
 			rcu_cleanup_dead_cpu(cpu, rsp);
 			do_nocb_deferred_wakeup(per_cpu_ptr(rsp->rda, cpu));
 		}
+		rcu_lazy_flush_dead_cpu(cpu);
 		break;
 	default:
 		break;
@@ -372,6 +372,17 @@ struct rcu_data {
 	unsigned int softirq_snap;	/* Snapshot of softirq activity. */
 #endif /* #ifdef CONFIG_RCU_CPU_STALL_INFO */
 
+	/* 9) Lazy callbacks, batched before they are queued. */
+	struct rcu_head *lazy_head;	/* CBs from call_rcu_lazy(). */
+	struct rcu_head **lazy_tail;
+	long lazy_len;			/* # CBs in the lazy batch. */
+	struct timer_list lazy_timer;	/* Flushes batches that stay small. */
+	unsigned long n_lazy_flush_size; /* Batches flushed when full. */
+	unsigned long n_lazy_flush_timer; /* Batches flushed by the timer. */
+	unsigned long n_lazy_flush_other; /* Flushed by barrier or hotplug. */
+	unsigned long n_lazy_cbs;	/* CBs flushed from lazy batches. */
+	long lazy_max_batch;		/* Largest lazy batch flushed. */
+
 	int cpu;
 	struct rcu_state *rsp;
 };
@@ -593,6 +604,9 @@ static void rcu_nocb_gp_cleanup(struct rcu_state *rsp, struct rcu_node *rnp);
 static void rcu_init_one_nocb(struct rcu_node *rnp);
 static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
 			    bool lazy, unsigned long flags);
+static bool __call_rcu_nocb_list(struct rcu_data *rdp, struct rcu_head *head,
+				 struct rcu_head **tail, long n,
+				 unsigned long flags);
 static bool rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
 				      struct rcu_data *rdp,
 				      unsigned long flags);
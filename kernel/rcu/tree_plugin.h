@@ -2178,6 +2178,20 @@ static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
 	return true;
 }
 
+/*
+ * Like __call_rcu_nocb(), but for the list of n callbacks from head to
+ * tail that a flushed lazy batch hands over at once.
+ */
+static bool __call_rcu_nocb_list(struct rcu_data *rdp, struct rcu_head *head,
+				 struct rcu_head **tail, long n,
+				 unsigned long flags)
+{
+	if (!rcu_is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, head, tail, n, 0, flags);
+	return true;
+}
+
 /*
  * Adopt orphaned callbacks on a no-CBs CPU, or return 0 if this is
  * not a no-CBs CPU.
@@ -2697,6 +2711,13 @@ static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
 	return false;
 }
 
+static bool __call_rcu_nocb_list(struct rcu_data *rdp, struct rcu_head *head,
+				 struct rcu_head **tail, long n,
+				 unsigned long flags)
+{
+	return false;
+}
+
 static bool __maybe_unused rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
 						     struct rcu_data *rdp,
 						     unsigned long flags)
@@ -72,6 +72,7 @@
 #include <linux/binfmts.h>
 #include <linux/context_tracking.h>
 #include <linux/sched/prio.h>
+#include <linux/rseq.h>
 
 #include <asm/irq_regs.h>
 #include <asm/switch_to.h>
@@ -165,6 +166,21 @@ static inline int timeslice(void)
 	return MS_TO_US(rr_interval);
 }
 
+/*
+ * The queued but not running tasks, one list per priority level with a
+ * bitmap of the non-empty lists. Without CONFIG_BFS_SHARDED_RQ there is a
+ * single shard embedded in grq. With it, each last level cache domain has
+ * its own shard, stored in the per-cpu area of the first CPU of the domain.
+ * Shards are protected by grq.lock.
+ */
+struct bfs_shard {
+	struct list_head queue[PRIO_LIMIT];
+	/* Deadline ordered index of the ISO, NORMAL and IDLEPRIO queues */
+	struct rb_root dl_tree[PRIO_LIMIT - MAX_RT_PRIO];
+	DECLARE_BITMAP(prio_bitmap, PRIO_LIMIT + 1);
+	unsigned long nr_queued;
+};
+
 /*
  * The global runqueue data that all CPUs work off. Data is protected either
  * by the global grq lock, or the discrete lock that precedes the data in this
@@ -175,8 +191,11 @@ struct global_rq {
 	unsigned long nr_running;
 	unsigned long nr_uninterruptible;
 	unsigned long long nr_switches;
-	struct list_head queue[PRIO_LIMIT];
-	DECLARE_BITMAP(prio_bitmap, PRIO_LIMIT + 1);
+#ifdef CONFIG_BFS_SHARDED_RQ
+	cpumask_t shard_map; /* The first CPU of each shard */
+#else
+	struct bfs_shard shard;
+#endif
 #ifdef CONFIG_SMP
 	unsigned long qnr; /* queued not running */
 	cpumask_t cpu_idle_map;
@@ -535,14 +554,115 @@ static inline bool task_queued(struct task_struct *p)
 	return (!list_empty(&p->run_list));
 }
 
+#ifdef CONFIG_BFS_SHARDED_RQ
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct bfs_shard, bfs_shards);
+
+static inline struct bfs_shard *rq_shard(struct rq *rq)
+{
+	return &per_cpu(bfs_shards, rq->shard_cpu);
+}
+
+/*
+ * A task stays on the shard it was queued on even if its task_cpu changes
+ * while it is queued, so it records the shard it was added to.
+ */
+static inline struct bfs_shard *task_shard(struct task_struct *p)
+{
+	return &per_cpu(bfs_shards, p->shard_cpu);
+}
+
+static inline void set_task_shard(struct task_struct *p, struct rq *rq)
+{
+	p->shard_cpu = rq->shard_cpu;
+}
+#else
+static inline struct bfs_shard *rq_shard(struct rq *rq)
+{
+	return &grq.shard;
+}
+
+static inline struct bfs_shard *task_shard(struct task_struct *p)
+{
+	return &grq.shard;
+}
+
+static inline void set_task_shard(struct task_struct *p, struct rq *rq)
+{
+}
+#endif /* CONFIG_BFS_SHARDED_RQ */
+
+static void init_shard(struct bfs_shard *shard)
+{
+	int i;
+
+	for (i = 0; i < PRIO_LIMIT; i++)
+		INIT_LIST_HEAD(shard->queue + i);
+	for (i = 0; i < PRIO_LIMIT - MAX_RT_PRIO; i++)
+		shard->dl_tree[i] = RB_ROOT;
+	bitmap_zero(shard->prio_bitmap, PRIO_LIMIT);
+	/* delimiter for bitsearch */
+	__set_bit(PRIO_LIMIT, shard->prio_bitmap);
+	shard->nr_queued = 0;
+}
+
+static inline struct rb_root *shard_dl_tree(struct bfs_shard *shard, int prio)
+{
+	return shard->dl_tree + prio - MAX_RT_PRIO;
+}
+
+/*
+ * Non realtime tasks are also kept in a tree sorted by deadline so the
+ * earliest deadline can be found without walking the whole queue. Tasks with
+ * equal deadlines are kept in the order they were queued.
+ */
+static void dl_tree_insert(struct task_struct *p, struct rb_root *root)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+
+	while (*link) {
+		struct task_struct *entry;
+
+		parent = *link;
+		entry = rb_entry(parent, struct task_struct, dl_node);
+		if (deadline_before(p->deadline, entry->deadline))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&p->dl_node, parent, link);
+	rb_insert_color(&p->dl_node, root);
+}
+
+static inline void shard_add(struct task_struct *p, struct rq *rq)
+{
+	struct bfs_shard *shard = rq_shard(rq);
+
+	set_task_shard(p, rq);
+	__set_bit(p->prio, shard->prio_bitmap);
+	list_add_tail(&p->run_list, shard->queue + p->prio);
+	if (!rt_task(p))
+		dl_tree_insert(p, shard_dl_tree(shard, p->prio));
+	shard->nr_queued++;
+}
+
+static inline void shard_del(struct task_struct *p)
+{
+	struct bfs_shard *shard = task_shard(p);
+
+	list_del_init(&p->run_list);
+	if (!rt_task(p))
+		rb_erase(&p->dl_node, shard_dl_tree(shard, p->prio));
+	if (list_empty(shard->queue + p->prio))
+		__clear_bit(p->prio, shard->prio_bitmap);
+	shard->nr_queued--;
+}
+
 /*
  * Removing from the global runqueue. Enter with grq locked.
  */
 static void dequeue_task(struct task_struct *p)
 {
-	list_del_init(&p->run_list);
-	if (list_empty(grq.queue + p->prio))
-		__clear_bit(p->prio, grq.prio_bitmap);
+	shard_del(p);
 	sched_info_dequeued(task_rq(p), p);
 }
 
@@ -579,8 +699,8 @@ static void enqueue_task(struct task_struct *p, struct rq *rq)
 			p->prio = NORMAL_PRIO;
 		update_task_priodl(p);
 	}
-	__set_bit(p->prio, grq.prio_bitmap);
-	list_add_tail(&p->run_list, grq.queue + p->prio);
+	shard_add(p, rq);
+	sched_lat_queued(p);
 	sched_info_queued(rq, p);
 }
 
@@ -1049,6 +1169,38 @@ static int effective_prio(struct task_struct *p)
 	return p->prio;
 }
 
+/*
+ * The number of tasks affined to a rq, running or queued, is averaged in
+ * units of SCHED_CAPACITY_SCALE over a window of about 65ms, and
+ * handed to the cpufreq governor as that CPU's utilization. Only the local
+ * CPU updates its own average.
+ */
+#define LOAD_AVG_SHIFT	16
+#define LOAD_AVG_US	(1 << LOAD_AVG_SHIFT)
+
+static void update_load_avg(struct rq *rq)
+{
+	unsigned long max = SCHED_CAPACITY_SCALE;
+
+	if (likely(rq->clock > rq->load_update)) {
+		u64 us_interval = NS_TO_US(rq->clock - rq->load_update);
+		u64 load = (u64)rq->soft_affined * max;
+
+		if (us_interval < LOAD_AVG_US) {
+			load = load * us_interval +
+			       (u64)rq->load_avg * (LOAD_AVG_US - us_interval);
+			load >>= LOAD_AVG_SHIFT;
+		}
+		rq->load_avg = load;
+	}
+	rq->load_update = rq->clock;
+
+	if (rt_queue(rq))
+		cpufreq_update_util(rq->clock, ULONG_MAX, 0);
+	else
+		cpufreq_update_util(rq->clock, min(rq->load_avg, max), max);
+}
+
 /*
  * activate_task - move a task to the runqueue. Enter with grq locked.
  */
@@ -1070,11 +1222,14 @@ static void activate_task(struct task_struct *p, struct rq *rq)
 	p->prio = effective_prio(p);
 	if (task_contributes_to_load(p))
 		grq.nr_uninterruptible--;
+	psi_enqueue(p, true);
 	enqueue_task(p, rq);
 	rq->soft_affined++;
 	p->on_rq = 1;
 	grq.nr_running++;
 	inc_qnr();
+	if (rq == this_rq())
+		update_load_avg(rq);
 }
 
 static inline void clear_sticky(struct task_struct *p);
@@ -1087,6 +1242,7 @@ static inline void deactivate_task(struct task_struct *p, struct rq *rq)
 {
 	if (task_contributes_to_load(p))
 		grq.nr_uninterruptible++;
+	psi_dequeue(p, true);
 	rq->soft_affined--;
 	p->on_rq = 0;
 	grq.nr_running--;
@@ -1112,6 +1268,29 @@ static inline void check_task_changed(struct rq *rq, struct task_struct *p,
 }
 
 #ifdef CONFIG_SMP
+#ifdef CONFIG_PSI
+/*
+ * The psi state of a task is accounted to the CPU it is on. Unlike CFS,
+ * BFS changes the CPU of queued and sleeping tasks without a dequeue and
+ * enqueue, so carry the state over here. grq lock covers both CPUs.
+ */
+static inline void psi_set_task_cpu(struct task_struct *p, unsigned int cpu)
+{
+	unsigned int psi_flags = p->psi_flags;
+
+	if (psi_flags)
+		psi_task_change(p, psi_flags, 0);
+	task_thread_info(p)->cpu = cpu;
+	if (psi_flags)
+		psi_task_change(p, 0, psi_flags);
+}
+#else
+static inline void psi_set_task_cpu(struct task_struct *p, unsigned int cpu)
+{
+	task_thread_info(p)->cpu = cpu;
+}
+#endif
+
 void set_task_cpu(struct task_struct *p, unsigned int cpu)
 {
 #ifdef CONFIG_LOCKDEP
@@ -1123,6 +1302,7 @@ void set_task_cpu(struct task_struct *p, unsigned int cpu)
 	if (task_cpu(p) == cpu)
 		return;
 	trace_sched_migrate_task(p, cpu);
+	rseq_migrate(p);
 	perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, NULL, 0);
 
 	/*
@@ -1135,7 +1315,7 @@ void set_task_cpu(struct task_struct *p, unsigned int cpu)
 		task_rq(p)->soft_affined--;
 		cpu_rq(cpu)->soft_affined++;
 	}
-	task_thread_info(p)->cpu = cpu;
+	psi_set_task_cpu(p, cpu);
 }
 
 static inline void clear_sticky(struct task_struct *p)
@@ -1202,12 +1382,61 @@ static inline void unstick_task(struct rq *rq, struct task_struct *p)
 }
 #endif
 
+#ifdef CONFIG_SCHEDSTATS
+static inline void sched_lat_queued(struct task_struct *p)
+{
+	p->lat_queued = grq.niffies;
+}
+
+static inline void sched_lat_woken(struct task_struct *p)
+{
+	p->lat_woken = true;
+}
+
+static inline void lat_hist_add(unsigned long *hist, u64 delta)
+{
+	int bucket = fls64(NS_TO_US(delta));
+
+	if (bucket >= SCHED_LAT_BUCKETS)
+		bucket = SCHED_LAT_BUCKETS - 1;
+	hist[bucket]++;
+}
+
+/*
+ * Time spent queued is measured in niffies as they are global and
+ * monotonic, unlike the clocks of the queueing and the picking rq.
+ */
+static inline void sched_lat_picked(struct rq *rq, struct task_struct *p)
+{
+	u64 delta = grq.niffies - p->lat_queued;
+
+	if (p->lat_woken) {
+		lat_hist_add(rq->wakeup_lat, delta);
+		p->lat_woken = false;
+	} else
+		lat_hist_add(rq->runq_wait, delta);
+}
+#else
+static inline void sched_lat_queued(struct task_struct *p)
+{
+}
+
+static inline void sched_lat_woken(struct task_struct *p)
+{
+}
+
+static inline void sched_lat_picked(struct rq *rq, struct task_struct *p)
+{
+}
+#endif /* CONFIG_SCHEDSTATS */
+
 /*
  * Move a task off the global queue and take it to a cpu for it will
  * become the running task.
  */
 static inline void take_task(int cpu, struct task_struct *p)
 {
+	sched_lat_picked(cpu_rq(cpu), p);
 	set_task_cpu(p, cpu);
 	dequeue_task(p);
 	clear_sticky(p);
@@ -1471,8 +1700,13 @@ static void try_preempt(struct task_struct *p, struct rq *this_rq)
 	if (!smt_should_schedule(p, target_cpu))
 		return;
 #endif
-	if (can_preempt(p, highest_priodl))
-		resched_curr(cpu_rq(target_cpu));
+	if (can_preempt(p, highest_priodl)) {
+		struct rq *rq = cpu_rq(target_cpu);
+
+		if (!rt_task(p) && !rq_idle(rq))
+			schedstat_inc(rq, preempt_deadline);
+		resched_curr(rq);
+	}
 }
 #else /* CONFIG_SMP */
 static inline bool needs_other_cpu(struct task_struct *p, int cpu)
@@ -1484,8 +1718,11 @@ static void try_preempt(struct task_struct *p, struct rq *this_rq)
 {
 	if (p->policy == SCHED_IDLEPRIO)
 		return;
-	if (can_preempt(p, grq.rq_priodls[0]))
+	if (can_preempt(p, grq.rq_priodls[0])) {
+		if (!rt_task(p) && !rq_idle(uprq))
+			schedstat_inc(uprq, preempt_deadline);
 		resched_curr(uprq);
+	}
 }
 #endif /* CONFIG_SMP */
 
@@ -1555,6 +1792,7 @@ static inline void ttwu_activate(struct task_struct *p, struct rq *rq,
 				 bool is_sync)
 {
 	activate_task(p, rq);
+	sched_lat_woken(p);
 
 	/*
 	 * if a worker is waking up, notify workqueue. Note that on BFS, we
@@ -1908,6 +2146,7 @@ prepare_task_switch(struct rq *rq, struct task_struct *prev,
 {
 	sched_info_switch(rq, prev, next);
 	perf_event_task_sched_out(prev, next);
+	rseq_preempt(prev);
 	fire_sched_out_preempt_notifiers(prev, next);
 	prepare_lock_switch(rq, next);
 	prepare_arch_switch(next);
@@ -2971,6 +3210,7 @@ void scheduler_tick(void)
 		task_running_tick(rq);
 	else
 		no_iso_tick();
+	update_load_avg(rq);
 	rq->last_tick = rq->clock;
 	perf_event_task_tick();
 }
@@ -3164,11 +3404,10 @@ found_middle:
 }
 
 /*
- * O(n) lookup of all tasks in the global runqueue. The real brainfuck
- * of lock contention and O(n). It's not really O(n) as only the queued,
- * but not running tasks are scanned, and is O(n) queued in the worst case
- * scenario only because the right task can be found before scanning all of
- * them.
+ * Lookup of the best task in a runqueue shard. Realtime queues are scanned
+ * in order, the others are searched through their deadline index, so in the
+ * common case where the earliest deadline task can run here this is
+ * O(log n) in the number of queued tasks.
  * Tasks are selected in this order:
  * Real time tasks are selected purely by their static priority and in the
  * order they were queued, so the lowest value idx, and the first queued task
@@ -3181,8 +3420,9 @@ found_middle:
  * Finally if no SCHED_NORMAL tasks are found, SCHED_IDLEPRIO tasks are
  * selected by the earliest deadline.
  */
-static inline struct
-task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *idle)
+static struct task_struct *
+shard_earliest_task(struct bfs_shard *shard, struct rq *rq, int cpu,
+		    unsigned long *edt_idx, u64 *edt_dl)
 {
 	struct task_struct *edt = NULL;
 	unsigned long idx = -1;
@@ -3190,12 +3430,13 @@ task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *
 	do {
 		struct list_head *queue;
 		struct task_struct *p;
+		struct rb_node *node;
 		u64 earliest_deadline;
 
-		idx = next_sched_bit(grq.prio_bitmap, ++idx);
+		idx = next_sched_bit(shard->prio_bitmap, ++idx);
 		if (idx >= PRIO_LIMIT)
-			return idle;
-		queue = grq.queue + idx;
+			return NULL;
+		queue = shard->queue + idx;
 
 		if (idx < MAX_RT_PRIO) {
 			/* We found an rt task */
@@ -3204,7 +3445,8 @@ task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *
 				if (needs_other_cpu(p, cpu))
 					continue;
 				edt = p;
-				goto out_take;
+				*edt_dl = 0;
+				goto out;
 			}
 			/*
 			 * None of the RT tasks at this priority can run on
@@ -3214,13 +3456,20 @@ task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *
 		}
 
 		/*
-		 * No rt tasks. Find the earliest deadline task. Now we're in
-		 * O(n) territory.
+		 * No rt tasks. Walk the deadline index from the earliest
+		 * deadline. Soft affinity can only make a task's effective
+		 * deadline later, so once a task's deadline is no earlier
+		 * than the best found so far, nothing after it can win.
 		 */
 		earliest_deadline = ~0ULL;
-		list_for_each_entry(p, queue, run_list) {
+		for (node = rb_first(shard_dl_tree(shard, idx)); node;
+		     node = rb_next(node)) {
 			u64 dl;
 
+			p = rb_entry(node, struct task_struct, dl_node);
+			if (!deadline_before(p->deadline, earliest_deadline))
+				break;
+
 			/* Make sure cpu affinity is ok */
 			if (needs_other_cpu(p, cpu))
 				continue;
@@ -3248,12 +3497,86 @@ task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *
 				edt = p;
 			}
 		}
+		*edt_dl = earliest_deadline;
 	} while (!edt);
 
-out_take:
+out:
+	*edt_idx = idx;
+	return edt;
+}
+
+#ifdef CONFIG_BFS_SHARDED_RQ
+/*
+ * Tasks queued on another shard are only taken in preference to the best
+ * local task if they have a better static priority, or if their deadline is
+ * earlier by more than this window. It is one rr_interval so global
+ * deadline ordering is never off by more than one timeslice.
+ */
+static inline u64 shard_window(void)
+{
+	return MS_TO_NS(rr_interval);
+}
+
+/*
+ * The local shard is searched first, then every other shard that could hold
+ * a better task. Shards with nothing queued, or whose highest queued
+ * priority is worse than the best local candidate, are skipped without
+ * scanning their lists.
+ */
+static inline struct
+task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *idle)
+{
+	struct bfs_shard *local = rq_shard(rq);
+	unsigned long edt_idx = PRIO_LIMIT;
+	struct task_struct *edt;
+	u64 edt_dl = ~0ULL;
+	int other;
+
+	edt = shard_earliest_task(local, rq, cpu, &edt_idx, &edt_dl);
+
+	for_each_cpu(other, &grq.shard_map) {
+		struct bfs_shard *shard = &per_cpu(bfs_shards, other);
+		struct task_struct *p;
+		unsigned long idx;
+		u64 dl;
+
+		if (shard == local || !shard->nr_queued)
+			continue;
+		if (find_first_bit(shard->prio_bitmap, PRIO_LIMIT) > edt_idx)
+			continue;
+		p = shard_earliest_task(shard, rq, cpu, &idx, &dl);
+		if (!p || idx > edt_idx)
+			continue;
+		if (idx == edt_idx &&
+		    (idx < MAX_RT_PRIO ||
+		     !deadline_before(dl + shard_window(), edt_dl)))
+			continue;
+		edt = p;
+		edt_idx = idx;
+		edt_dl = dl;
+	}
+
+	if (!edt)
+		return idle;
+	take_task(cpu, edt);
+	return edt;
+}
+#else
+/* Without sharding, the single shard is the whole global runqueue. */
+static inline struct
+task_struct *earliest_deadline_task(struct rq *rq, int cpu, struct task_struct *idle)
+{
+	struct task_struct *edt;
+	unsigned long idx;
+	u64 dl;
+
+	edt = shard_earliest_task(&grq.shard, rq, cpu, &idx, &dl);
+	if (!edt)
+		return idle;
 	take_task(cpu, edt);
 	return edt;
 }
+#endif /* CONFIG_BFS_SHARDED_RQ */
 
 
 /*
@@ -4924,8 +5247,15 @@ int __sched yield_to(struct task_struct *p, bool preempt)
 	p_rq = task_rq(p);
 	yielded = 1;
 	if (p->deadline > rq->rq_deadline) {
+		bool queued = task_queued(p);
+
+		/* The deadline index must be resorted */
+		if (queued)
+			shard_del(p);
 		p->deadline = rq->rq_deadline;
 		update_task_priodl(p);
+		if (queued)
+			shard_add(p, task_rq(p));
 	}
 	p->time_slice += rq->rq_time_slice;
 	rq->rq_time_slice = 0;
@@ -4980,6 +5310,87 @@ long __sched io_schedule_timeout(long timeout)
 	return ret;
 }
 
+#ifdef CONFIG_PSI
+/**
+ * psi_memstall_enter - mark the beginning of a memory stall section
+ * @flags: flags to handle nested sections
+ *
+ * Marks the calling task as being stalled due to a lack of memory,
+ * such as waiting for a refault or performing reclaim.
+ */
+void psi_memstall_enter(unsigned long *flags)
+{
+	if (static_key_false(&psi_disabled))
+		return;
+
+	*flags = current->flags & PF_MEMSTALL;
+	if (*flags)
+		return;
+	/*
+	 * PF_MEMSTALL setting & accounting needs to be atomic wrt
+	 * changes to the task's scheduling state.
+	 */
+	grq_lock_irq();
+	current->flags |= PF_MEMSTALL;
+	psi_task_change(current, 0, TSK_MEMSTALL);
+	grq_unlock_irq();
+}
+
+/**
+ * psi_memstall_leave - mark the end of an memory stall section
+ * @flags: flags to handle nested memdelay sections
+ *
+ * Marks the calling task as no longer stalled due to lack of memory.
+ */
+void psi_memstall_leave(unsigned long *flags)
+{
+	if (static_key_false(&psi_disabled))
+		return;
+
+	if (*flags)
+		return;
+
+	grq_lock_irq();
+	current->flags &= ~PF_MEMSTALL;
+	psi_task_change(current, TSK_MEMSTALL, 0);
+	grq_unlock_irq();
+}
+
+#ifdef CONFIG_CGROUPS
+/**
+ * cgroup_move_task - move task to a different cgroup
+ * @task: the task
+ * @to: the target css_set
+ *
+ * Move task to a new cgroup and safely migrate its associated stall
+ * state between the different groups, under grq lock.
+ */
+void cgroup_move_task(struct task_struct *task, struct css_set *to)
+{
+	unsigned int task_flags;
+	unsigned long flags;
+
+	if (static_key_false(&psi_disabled)) {
+		rcu_assign_pointer(task->cgroups, to);
+		return;
+	}
+
+	task_grq_lock(task, &flags);
+
+	task_flags = task->psi_flags;
+	if (task_flags)
+		psi_task_change(task, task_flags, 0);
+
+	rcu_assign_pointer(task->cgroups, to);
+
+	if (task_flags)
+		psi_task_change(task, 0, task_flags);
+
+	task_grq_unlock(&flags);
+}
+#endif /* CONFIG_CGROUPS */
+#endif /* CONFIG_PSI */
+
 /**
  * sys_sched_get_priority_max - return maximum RT priority.
  * @policy: scheduling class.
@@ -6986,6 +7397,62 @@ enum sched_domain_level {
 	SD_LV_MAX
 };
 
+#ifdef CONFIG_BFS_SHARDED_RQ
+/*
+ * CPUs share a runqueue shard with the other CPUs of their last level cache,
+ * or of their NUMA node if there is no multi-core topology information.
+ */
+static int __init shard_leader(int cpu)
+{
+	int leader;
+
+#ifdef CONFIG_SCHED_MC
+	leader = cpumask_first(cpu_coregroup_mask(cpu));
+#else
+	leader = cpumask_first(cpumask_of_node(cpu_to_node(cpu)));
+#endif
+	/* Topology of CPUs that have never been online may be unknown */
+	if (leader >= nr_cpu_ids)
+		leader = cpu;
+	return leader;
+}
+
+/*
+ * Assign each CPU to its shard and move everything queued on the boot shard
+ * to the shard of the CPU it is queued for. Enter with grq locked.
+ */
+static void __init init_shards(void)
+{
+	struct bfs_shard *boot = &per_cpu(bfs_shards, 0);
+	int cpu, idx;
+
+	cpumask_clear(&grq.shard_map);
+	for_each_possible_cpu(cpu) {
+		int leader = shard_leader(cpu);
+
+		cpu_rq(cpu)->shard_cpu = leader;
+		cpumask_set_cpu(leader, &grq.shard_map);
+	}
+
+	for (idx = 0; idx < PRIO_LIMIT; idx++) {
+		struct task_struct *p, *n;
+		LIST_HEAD(queue);
+
+		list_splice_init(boot->queue + idx, &queue);
+		__clear_bit(idx, boot->prio_bitmap);
+		list_for_each_entry_safe(p, n, &queue, run_list) {
+			list_del_init(&p->run_list);
+			boot->nr_queued--;
+			shard_add(p, task_rq(p));
+		}
+	}
+}
+#else
+static inline void init_shards(void)
+{
+}
+#endif /* CONFIG_BFS_SHARDED_RQ */
+
 void __init sched_init_smp(void)
 {
 	struct sched_domain *sd;
@@ -7055,6 +7522,7 @@ void __init sched_init_smp(void)
 				rq->cpu_locality[other_cpu] = 1;
 #endif
 	}
+	init_shards();
 	grq_unlock_irq();
 
 	for_each_online_cpu(cpu) {
@@ -7147,10 +7615,20 @@ void __init sched_init(void)
 	}
 #endif
 
-	for (i = 0; i < PRIO_LIMIT; i++)
-		INIT_LIST_HEAD(grq.queue + i);
-	/* delimiter for bitsearch */
-	__set_bit(PRIO_LIMIT, grq.prio_bitmap);
+#ifdef CONFIG_BFS_SHARDED_RQ
+	/*
+	 * Everything is queued on the boot CPU's shard until the topology is
+	 * known in sched_init_smp().
+	 */
+	cpumask_clear(&grq.shard_map);
+	cpumask_set_cpu(0, &grq.shard_map);
+	for_each_possible_cpu(i) {
+		cpu_rq(i)->shard_cpu = 0;
+		init_shard(&per_cpu(bfs_shards, i));
+	}
+#else
+	init_shard(&grq.shard);
+#endif
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&init_task.preempt_notifiers);
@@ -7177,6 +7655,8 @@ void __init sched_init(void)
 		zalloc_cpumask_var(&cpu_isolated_map, GFP_NOWAIT);
 	idle_thread_set_boot_cpu();
 #endif /* SMP */
+
+	psi_init();
 }
 
 #ifdef CONFIG_DEBUG_ATOMIC_SLEEP
@@ -4,6 +4,11 @@
 #ifndef BFS_SCHED_H
 #define BFS_SCHED_H
 
+#ifdef CONFIG_SCHEDSTATS
+/* Bucket n counts latencies of [2^(n-1), 2^n) usecs, the last one the rest */
+#define SCHED_LAT_BUCKETS	24
+#endif
+
 /*
  * This is the main, per-CPU runqueue data structure.
  * This data should only be modified by the local cpu.
@@ -39,6 +44,9 @@ struct rq {
 	struct sched_domain *sd;
 	int *cpu_locality; /* CPU relative cache distance */
 	u64 last_niffy; /* Last time this RQ updated grq.niffies */
+#ifdef CONFIG_BFS_SHARDED_RQ
+	int shard_cpu; /* First CPU of the runqueue shard this CPU uses */
+#endif
 #endif /* CONFIG_SMP */
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
 	u64 prev_irq_time;
@@ -54,6 +62,10 @@ struct rq {
 	u64 clock_task;
 	bool dither;
 
+	/* Decaying average of soft_affined for cpufreq, see update_load_avg */
+	unsigned long load_avg;
+	u64 load_update;
+
 #ifdef CONFIG_SCHEDSTATS
 
 	/* latency stats */
@@ -72,6 +84,12 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* latency histograms of tasks picked by this cpu, log2 usecs */
+	unsigned long wakeup_lat[SCHED_LAT_BUCKETS];
+	unsigned long runq_wait[SCHED_LAT_BUCKETS];
+	/* woken tasks that preempted this cpu on an earlier deadline */
+	unsigned int preempt_deadline;
 #endif /* CONFIG_SCHEDSTATS */
 #ifdef CONFIG_CPU_IDLE
 	/* Must be inspected within a rcu lock section */
@@ -130,6 +148,34 @@ static inline int task_on_rq_queued(struct task_struct *p)
 	return p->on_rq;
 }
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_update_util - Take a note about CPU utilization changes.
+ * @time: Current time.
+ * @util: Current utilization, or ULONG_MAX to ask for the highest frequency.
+ * @max: Utilization ceiling.
+ *
+ * Called by the scheduler with the rq lock held and interrupts disabled, on
+ * the CPU whose utilization changed, when a task is enqueued and on ticks.
+ */
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(*this_cpu_ptr(&cpufreq_update_util_data));
+	if (data)
+		data->func(data, time, util, max);
+}
+#else
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max)
+{
+}
+#endif /* CONFIG_CPU_FREQ */
+
 #ifdef CONFIG_CPU_IDLE
 static inline void idle_set_state(struct rq *rq,
 				  struct cpuidle_state *idle_state)
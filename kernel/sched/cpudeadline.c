@@ -14,6 +14,7 @@
 #include <linux/gfp.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/topology.h>
 #include "cpudeadline.h"
 
 static inline int parent(int i)
@@ -36,17 +37,17 @@ static inline int dl_time_before(u64 a, u64 b)
 	return (s64)(a - b) < 0;
 }
 
-static void cpudl_exchange(struct cpudl *cp, int a, int b)
+static void cpudl_exchange(struct cpudl *cp, struct cpudl_heap *h,
+			   int a, int b)
 {
-	int cpu_a = cp->elements[a].cpu, cpu_b = cp->elements[b].cpu;
+	int cpu_a = h->elements[a].cpu, cpu_b = h->elements[b].cpu;
 
-	swap(cp->elements[a].cpu, cp->elements[b].cpu);
-	swap(cp->elements[a].dl , cp->elements[b].dl );
+	swap(h->elements[a], h->elements[b]);
 
-	swap(cp->elements[cpu_a].idx, cp->elements[cpu_b].idx);
+	swap(cp->idx[cpu_a], cp->idx[cpu_b]);
 }
 
-static void cpudl_heapify(struct cpudl *cp, int idx)
+static void cpudl_heapify(struct cpudl *cp, struct cpudl_heap *h, int idx)
 {
 	int l, r, largest;
 
@@ -56,67 +57,86 @@ static void cpudl_heapify(struct cpudl *cp, int idx)
 		r = right_child(idx);
 		largest = idx;
 
-		if ((l < cp->size) && dl_time_before(cp->elements[idx].dl,
-							cp->elements[l].dl))
+		if ((l < h->size) && dl_time_before(h->elements[idx].dl,
+							h->elements[l].dl))
 			largest = l;
-		if ((r < cp->size) && dl_time_before(cp->elements[largest].dl,
-							cp->elements[r].dl))
+		if ((r < h->size) && dl_time_before(h->elements[largest].dl,
+							h->elements[r].dl))
 			largest = r;
 		if (largest == idx)
 			break;
 
 		/* Push idx down the heap one level and bump one up */
-		cpudl_exchange(cp, largest, idx);
+		cpudl_exchange(cp, h, largest, idx);
 		idx = largest;
 	}
 }
 
-static void cpudl_change_key(struct cpudl *cp, int idx, u64 new_dl)
+static void cpudl_change_key(struct cpudl *cp, struct cpudl_heap *h,
+			     int idx, u64 new_dl)
 {
-	WARN_ON(idx == IDX_INVALID || !cpu_present(idx));
+	WARN_ON(idx == IDX_INVALID || idx >= h->size);
 
-	if (dl_time_before(new_dl, cp->elements[idx].dl)) {
-		cp->elements[idx].dl = new_dl;
-		cpudl_heapify(cp, idx);
+	if (dl_time_before(new_dl, h->elements[idx].dl)) {
+		h->elements[idx].dl = new_dl;
+		cpudl_heapify(cp, h, idx);
 	} else {
-		cp->elements[idx].dl = new_dl;
-		while (idx > 0 && dl_time_before(cp->elements[parent(idx)].dl,
-					cp->elements[idx].dl)) {
-			cpudl_exchange(cp, idx, parent(idx));
+		h->elements[idx].dl = new_dl;
+		while (idx > 0 && dl_time_before(h->elements[parent(idx)].dl,
+					h->elements[idx].dl)) {
+			cpudl_exchange(cp, h, idx, parent(idx));
 			idx = parent(idx);
 		}
 	}
 }
 
-static inline int cpudl_maximum(struct cpudl *cp)
-{
-	return cp->elements[0].cpu;
-}
-
 /*
  * cpudl_find - find the best (later-dl) CPU in the system
  * @cp: the cpudl max-heap context
  * @p: the task
  * @later_mask: a mask to fill in with the selected CPUs (or NULL)
  *
+ * Lockless: only looks at the maximum each heap publishes, and picks
+ * the latest deadline among those the task may run on.
+ *
  * Returns: int - best CPU (heap maximum if suitable)
  */
 int cpudl_find(struct cpudl *cp, struct task_struct *p,
 	       struct cpumask *later_mask)
 {
-	int best_cpu = -1;
+	int best_cpu = -1, cpu, i;
 	const struct sched_dl_entity *dl_se = &p->dl;
+	struct cpudl_heap *h;
+	u64 best_dl = 0, dl;
+	unsigned int seq;
 
 	if (later_mask && cpumask_and(later_mask, later_mask, cp->free_cpus)) {
 		best_cpu = cpumask_any(later_mask);
 		goto out;
-	} else if (cpumask_test_cpu(cpudl_maximum(cp), &p->cpus_allowed) &&
-			dl_time_before(dl_se->deadline, cp->elements[0].dl)) {
-		best_cpu = cpudl_maximum(cp);
-		if (later_mask)
-			cpumask_set_cpu(best_cpu, later_mask);
 	}
 
+	for (i = 0; i < cp->nr_heaps; i++) {
+		h = &cp->heaps[i];
+
+		do {
+			seq = read_seqcount_begin(&h->seq);
+			cpu = h->max_cpu;
+			dl = h->max_dl;
+		} while (read_seqcount_retry(&h->seq, seq));
+
+		if (cpu < 0 || !cpumask_test_cpu(cpu, &p->cpus_allowed) ||
+		    !dl_time_before(dl_se->deadline, dl))
+			continue;
+
+		if (best_cpu == -1 || dl_time_before(best_dl, dl)) {
+			best_cpu = cpu;
+			best_dl = dl;
+		}
+	}
+
+	if (best_cpu != -1 && later_mask)
+		cpumask_set_cpu(best_cpu, later_mask);
+
 out:
 	WARN_ON(best_cpu != -1 && !cpu_present(best_cpu));
 
@@ -129,19 +149,21 @@ out:
  * @cpu: the target cpu
  * @dl: the new earliest deadline for this cpu
  *
- * Notes: assumes cpu_rq(cpu)->lock is locked
+ * Notes: assumes cpu_rq(cpu)->lock is locked; only the heap of @cpu's
+ * package is locked.
  *
  * Returns: (void)
  */
 void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
 {
+	struct cpudl_heap *h = &cp->heaps[cp->heap_of[cpu]];
 	int old_idx, new_cpu;
 	unsigned long flags;
 
 	WARN_ON(!cpu_present(cpu));
 
-	raw_spin_lock_irqsave(&cp->lock, flags);
-	old_idx = cp->elements[cpu].idx;
+	raw_spin_lock_irqsave(&h->lock, flags);
+	old_idx = cp->idx[cpu];
 	if (!is_valid) {
 		/* remove item */
 		if (old_idx == IDX_INVALID) {
@@ -152,68 +174,107 @@ void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
 			 */
 			goto out;
 		}
-		new_cpu = cp->elements[cp->size - 1].cpu;
-		cp->elements[old_idx].dl = cp->elements[cp->size - 1].dl;
-		cp->elements[old_idx].cpu = new_cpu;
-		cp->size--;
-		cp->elements[new_cpu].idx = old_idx;
-		cp->elements[cpu].idx = IDX_INVALID;
-		while (old_idx > 0 && dl_time_before(
-				cp->elements[parent(old_idx)].dl,
-				cp->elements[old_idx].dl)) {
-			cpudl_exchange(cp, old_idx, parent(old_idx));
-			old_idx = parent(old_idx);
+		new_cpu = h->elements[h->size - 1].cpu;
+		h->elements[old_idx] = h->elements[h->size - 1];
+		h->size--;
+		cp->idx[new_cpu] = old_idx;
+		cp->idx[cpu] = IDX_INVALID;
+		/* the moved item has to go up or down, unless it was @cpu */
+		if (old_idx < h->size) {
+			while (old_idx > 0 && dl_time_before(
+					h->elements[parent(old_idx)].dl,
+					h->elements[old_idx].dl)) {
+				cpudl_exchange(cp, h, old_idx, parent(old_idx));
+				old_idx = parent(old_idx);
+			}
+			cpudl_heapify(cp, h, old_idx);
 		}
 		cpumask_set_cpu(cpu, cp->free_cpus);
-                cpudl_heapify(cp, old_idx);
-
-		goto out;
-	}
-
-	if (old_idx == IDX_INVALID) {
-		cp->size++;
-		cp->elements[cp->size - 1].dl = 0;
-		cp->elements[cp->size - 1].cpu = cpu;
-		cp->elements[cpu].idx = cp->size - 1;
-		cpudl_change_key(cp, cp->size - 1, dl);
+	} else if (old_idx == IDX_INVALID) {
+		h->size++;
+		h->elements[h->size - 1].dl = 0;
+		h->elements[h->size - 1].cpu = cpu;
+		cp->idx[cpu] = h->size - 1;
+		cpudl_change_key(cp, h, h->size - 1, dl);
 		cpumask_clear_cpu(cpu, cp->free_cpus);
 	} else {
-		cpudl_change_key(cp, old_idx, dl);
+		cpudl_change_key(cp, h, old_idx, dl);
 	}
 
+	write_seqcount_begin(&h->seq);
+	h->max_cpu = h->size ? h->elements[0].cpu : -1;
+	h->max_dl = h->size ? h->elements[0].dl : 0;
+	write_seqcount_end(&h->seq);
+
 out:
-	raw_spin_unlock_irqrestore(&cp->lock, flags);
+	raw_spin_unlock_irqrestore(&h->lock, flags);
 }
 
 /*
  * cpudl_init - initialize the cpudl structure
  * @cp: the cpudl max-heap context
+ *
+ * CPUs are grouped by package, which is the last level cache on most
+ * machines; without topology information they all share one heap.
  */
 int cpudl_init(struct cpudl *cp)
 {
-	int i;
+	int i, cpu, id, size, *ids;
 
 	memset(cp, 0, sizeof(*cp));
-	raw_spin_lock_init(&cp->lock);
-	cp->size = 0;
-
-	cp->elements = kcalloc(nr_cpu_ids,
-			       sizeof(struct cpudl_item),
-			       GFP_KERNEL);
-	if (!cp->elements)
-		return -ENOMEM;
-
-	if (!alloc_cpumask_var(&cp->free_cpus, GFP_KERNEL)) {
-		kfree(cp->elements);
-		return -ENOMEM;
+
+	cp->heap_of = kcalloc(nr_cpu_ids, sizeof(int), GFP_KERNEL);
+	cp->idx = kcalloc(nr_cpu_ids, sizeof(int), GFP_KERNEL);
+	ids = kcalloc(nr_cpu_ids, sizeof(int), GFP_KERNEL);
+	if (!cp->heap_of || !cp->idx || !ids)
+		goto err;
+
+	for_each_possible_cpu(cpu) {
+		id = topology_physical_package_id(cpu);
+		for (i = 0; i < cp->nr_heaps; i++) {
+			if (ids[i] == id)
+				break;
+		}
+		if (i == cp->nr_heaps)
+			ids[cp->nr_heaps++] = id;
+
+		cp->heap_of[cpu] = i;
+		cp->idx[cpu] = IDX_INVALID;
 	}
 
-	for_each_possible_cpu(i)
-		cp->elements[i].idx = IDX_INVALID;
+	cp->heaps = kcalloc(cp->nr_heaps, sizeof(struct cpudl_heap),
+			    GFP_KERNEL);
+	if (!cp->heaps)
+		goto err;
+
+	for (i = 0; i < cp->nr_heaps; i++) {
+		struct cpudl_heap *h = &cp->heaps[i];
+
+		size = 0;
+		for_each_possible_cpu(cpu)
+			size += cp->heap_of[cpu] == i;
+
+		raw_spin_lock_init(&h->lock);
+		seqcount_init(&h->seq);
+		h->max_cpu = -1;
+		h->elements = kcalloc(size, sizeof(struct cpudl_item),
+				      GFP_KERNEL);
+		if (!h->elements)
+			goto err;
+	}
+
+	if (!alloc_cpumask_var(&cp->free_cpus, GFP_KERNEL))
+		goto err;
 
 	cpumask_setall(cp->free_cpus);
+	kfree(ids);
 
 	return 0;
+
+err:
+	kfree(ids);
+	cpudl_cleanup(cp);
+	return -ENOMEM;
 }
 
 /*
@@ -222,6 +283,14 @@ int cpudl_init(struct cpudl *cp)
  */
 void cpudl_cleanup(struct cpudl *cp)
 {
+	int i;
+
 	free_cpumask_var(cp->free_cpus);
-	kfree(cp->elements);
+	if (cp->heaps) {
+		for (i = 0; i < cp->nr_heaps; i++)
+			kfree(cp->heaps[i].elements);
+		kfree(cp->heaps);
+	}
+	kfree(cp->idx);
+	kfree(cp->heap_of);
 }
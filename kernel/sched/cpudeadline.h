@@ -2,20 +2,34 @@
 #define _LINUX_CPUDL_H
 
 #include <linux/sched.h>
+#include <linux/seqlock.h>
 
 #define IDX_INVALID     -1
 
 struct cpudl_item {
 	u64 dl;
 	int cpu;
-	int idx;
 };
 
-struct cpudl {
+/*
+ * One max-heap per package, so that updates from different packages do
+ * not contend; the heap maximum is published under @seq for cpudl_find().
+ */
+struct cpudl_heap {
 	raw_spinlock_t lock;
 	int size;
-	cpumask_var_t free_cpus;
 	struct cpudl_item *elements;
+	seqcount_t seq;
+	u64 max_dl;
+	int max_cpu;
+} ____cacheline_aligned_in_smp;
+
+struct cpudl {
+	int nr_heaps;
+	struct cpudl_heap *heaps;
+	int *heap_of;		/* cpu -> heap */
+	int *idx;		/* cpu -> position in its heap */
+	cpumask_var_t free_cpus;
 };
 
 
@@ -2864,8 +2864,31 @@ void idle_exit_fair(struct rq *this_rq)
 
 static int idle_balance(struct rq *this_rq);
 
+/*
+ * Tell a scheduler driven cpufreq governor about the utilization of the
+ * local rq, which is its tracked runnable load relative to a single always
+ * running nice 0 task.
+ */
+static inline void cfs_rq_util_change(struct rq *rq)
+{
+	unsigned long max = SCHED_CAPACITY_SCALE;
+
+	if (cpu_of(rq) != smp_processor_id())
+		return;
+
+	cpufreq_update_util(rq_clock(rq), min(rq->cfs.runnable_load_avg, max),
+			    max);
+}
+
 #else /* CONFIG_SMP */
 
+static inline void cfs_rq_util_change(struct rq *rq)
+{
+	unsigned long max = SCHED_CAPACITY_SCALE;
+
+	cpufreq_update_util(rq_clock(rq), rq->cfs.h_nr_running ? max : 0, max);
+}
+
 static inline void update_entity_load_avg(struct sched_entity *se,
 					  int update_cfs_rq) {}
 static inline void update_rq_runnable_avg(struct rq *rq, int runnable) {}
@@ -3363,6 +3386,9 @@ static inline u64 sched_cfs_bandwidth_slice(void)
 
 /*
  * Replenish runtime according to assigned quota and update expiration time.
+ * Runtime left unused in the previous period is carried over, up to the
+ * burst allowance on top of the quota. Runtime consumed beyond the quota
+ * since the last refill is accounted as burst.
  * We use sched_clock_cpu directly instead of rq->clock to avoid adding
  * additional synchronization around rq->lock.
  *
@@ -3371,12 +3397,21 @@ static inline u64 sched_cfs_bandwidth_slice(void)
 void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b)
 {
 	u64 now;
+	s64 runtime;
 
 	if (cfs_b->quota == RUNTIME_INF)
 		return;
 
 	now = sched_clock_cpu(smp_processor_id());
-	cfs_b->runtime = cfs_b->quota;
+	cfs_b->runtime += cfs_b->quota;
+	runtime = cfs_b->runtime_snap - cfs_b->runtime;
+	if (runtime > 0) {
+		cfs_b->burst_time += runtime;
+		cfs_b->nr_burst++;
+	}
+
+	cfs_b->runtime = min(cfs_b->runtime, cfs_b->quota + cfs_b->burst);
+	cfs_b->runtime_snap = cfs_b->runtime;
 	cfs_b->runtime_expires = now + ktime_to_ns(cfs_b->period);
 }
 
@@ -3964,6 +3999,7 @@ void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
 	raw_spin_lock_init(&cfs_b->lock);
 	cfs_b->runtime = 0;
 	cfs_b->quota = RUNTIME_INF;
+	cfs_b->burst = 0;
 	cfs_b->period = ns_to_ktime(default_cfs_period());
 
 	INIT_LIST_HEAD(&cfs_b->throttled_cfs_rq);
@@ -4190,6 +4226,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_rq_runnable_avg(rq, rq->nr_running);
 		add_nr_running(rq, 1);
 	}
+	cfs_rq_util_change(rq);
 	hrtick_update(rq);
 }
 
@@ -7718,6 +7755,7 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		task_tick_numa(rq, curr);
 
 	update_rq_runnable_avg(rq, 1);
+	cfs_rq_util_change(rq);
 }
 
 /*
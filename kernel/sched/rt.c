@@ -2056,6 +2056,9 @@ static void task_tick_rt(struct rq *rq, struct task_struct *p, int queued)
 
 	watchdog(rq, p);
 
+	/* Realtime tasks always ask for the highest frequency */
+	cpufreq_update_util(rq_clock(rq), ULONG_MAX, 0);
+
 	/*
 	 * RR tasks need a special form of timeslice management.
 	 * FIFO tasks have no timeslices.
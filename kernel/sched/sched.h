@@ -211,6 +211,7 @@ struct cfs_bandwidth {
 	raw_spinlock_t lock;
 	ktime_t period;
 	u64 quota, runtime;
+	u64 burst, runtime_snap;
 	s64 hierarchical_quota;
 	u64 runtime_expires;
 
@@ -219,8 +220,8 @@ struct cfs_bandwidth {
 	struct list_head throttled_cfs_rq;
 
 	/* statistics */
-	int nr_periods, nr_throttled;
-	u64 throttled_time;
+	int nr_periods, nr_throttled, nr_burst;
+	u64 throttled_time, burst_time;
 #endif
 };
 
@@ -1216,6 +1217,34 @@ static inline void idle_exit_fair(struct rq *rq) { }
 
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+DECLARE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_update_util - Take a note about CPU utilization changes.
+ * @time: Current time.
+ * @util: Current utilization, or ULONG_MAX to ask for the highest frequency.
+ * @max: Utilization ceiling.
+ *
+ * Called by the scheduler with the rq lock held and interrupts disabled, on
+ * the CPU whose utilization changed, when a task is enqueued and on ticks.
+ */
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(*this_cpu_ptr(&cpufreq_update_util_data));
+	if (data)
+		data->func(data, time, util, max);
+}
+#else
+static inline void cpufreq_update_util(u64 time, unsigned long util,
+				       unsigned long max)
+{
+}
+#endif /* CONFIG_CPU_FREQ */
+
 #ifdef CONFIG_CPU_IDLE
 static inline void idle_set_state(struct rq *rq,
 				  struct cpuidle_state *idle_state)
@@ -141,9 +141,73 @@ static const struct file_operations proc_schedstat_operations = {
 	.release = seq_release,
 };
 
+#ifdef CONFIG_SCHED_BFS
+/*
+ * Per cpu latency histograms of the tasks each cpu picked to run. Each line
+ * holds SCHED_LAT_BUCKETS counts, bucket n counting latencies between
+ * 2^(n-1) and 2^n usecs, for the time from wakeup to running and for the
+ * time spent waiting after being preempted or descheduled. The last field
+ * is the number of times a woken task preempted the running one by having
+ * an earlier deadline.
+ */
+#define SCHEDLAT_VERSION 1
+
+static void show_lat_hist(struct seq_file *seq, unsigned long *hist)
+{
+	int i;
+
+	for (i = 0; i < SCHED_LAT_BUCKETS; i++)
+		seq_printf(seq, " %lu", hist[i]);
+}
+
+static int show_schedlat(struct seq_file *seq, void *v)
+{
+	struct rq *rq;
+	int cpu;
+
+	if (v == (void *)1) {
+		seq_printf(seq, "version %d\n", SCHEDLAT_VERSION);
+		seq_printf(seq, "buckets %d\n", SCHED_LAT_BUCKETS);
+		return 0;
+	}
+
+	cpu = (unsigned long)(v - 2);
+	rq = cpu_rq(cpu);
+
+	seq_printf(seq, "cpu%d wakeup", cpu);
+	show_lat_hist(seq, rq->wakeup_lat);
+	seq_printf(seq, " runqueue");
+	show_lat_hist(seq, rq->runq_wait);
+	seq_printf(seq, " preempt %u\n", rq->preempt_deadline);
+	return 0;
+}
+
+static const struct seq_operations schedlat_sops = {
+	.start = schedstat_start,
+	.next  = schedstat_next,
+	.stop  = schedstat_stop,
+	.show  = show_schedlat,
+};
+
+static int schedlat_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &schedlat_sops);
+}
+
+static const struct file_operations proc_schedlat_operations = {
+	.open    = schedlat_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = seq_release,
+};
+#endif /* CONFIG_SCHED_BFS */
+
 static int __init proc_schedstat_init(void)
 {
 	proc_create("schedstat", 0, NULL, &proc_schedstat_operations);
+#ifdef CONFIG_SCHED_BFS
+	proc_create("schedlat", 0, NULL, &proc_schedlat_operations);
+#endif
 	return 0;
 }
 subsys_initcall(proc_schedstat_init);
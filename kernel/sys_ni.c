@@ -148,6 +148,8 @@ cond_syscall(sys_io_setup);
 cond_syscall(sys_io_destroy);
 cond_syscall(sys_io_submit);
 cond_syscall(sys_io_cancel);
+cond_syscall(sys_io_uring_setup);
+cond_syscall(sys_io_uring_enter);
 cond_syscall(sys_io_getevents);
 cond_syscall(sys_sysfs);
 cond_syscall(sys_syslog);
@@ -229,3 +231,6 @@ cond_syscall(sys_bpf);
 
 /* execveat */
 cond_syscall(sys_execveat);
+
+/* restartable sequences */
+cond_syscall(sys_rseq);
@@ -28,6 +28,7 @@
 #include <linux/fs.h>
 #include <linux/file.h>
 #include <linux/pid_namespace.h>
+#include <linux/vmalloc.h>
 #include <net/genetlink.h>
 #include <linux/atomic.h>
 
@@ -52,7 +53,10 @@ static const struct nla_policy taskstats_cmd_get_policy[TASKSTATS_CMD_ATTR_MAX+1
 	[TASKSTATS_CMD_ATTR_PID]  = { .type = NLA_U32 },
 	[TASKSTATS_CMD_ATTR_TGID] = { .type = NLA_U32 },
 	[TASKSTATS_CMD_ATTR_REGISTER_CPUMASK] = { .type = NLA_STRING },
-	[TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK] = { .type = NLA_STRING },};
+	[TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK] = { .type = NLA_STRING },
+	[TASKSTATS_CMD_ATTR_PID_LIST] = { .type = NLA_BINARY },
+	[TASKSTATS_CMD_ATTR_CGROUP_FD] = { .type = NLA_U32 },
+	[TASKSTATS_CMD_ATTR_FIELDS] = { .type = NLA_U32 },};
 
 static const struct nla_policy cgroupstats_cmd_get_policy[CGROUPSTATS_CMD_ATTR_MAX+1] = {
 	[CGROUPSTATS_CMD_ATTR_FD] = { .type = NLA_U32 },
@@ -177,7 +181,8 @@ static void send_cpu_listeners(struct sk_buff *skb,
 
 static void fill_stats(struct user_namespace *user_ns,
 		       struct pid_namespace *pid_ns,
-		       struct task_struct *tsk, struct taskstats *stats)
+		       struct task_struct *tsk, struct taskstats *stats,
+		       u32 fields)
 {
 	memset(stats, 0, sizeof(*stats));
 	/*
@@ -187,16 +192,21 @@ static void fill_stats(struct user_namespace *user_ns,
 	 *	per-task-foo(stats, tsk);
 	 */
 
-	delayacct_add_tsk(stats, tsk);
+	if (fields & TASKSTATS_FIELD_DELAY)
+		delayacct_add_tsk(stats, tsk);
 
 	/* fill in basic acct fields */
 	stats->version = TASKSTATS_VERSION;
-	stats->nvcsw = tsk->nvcsw;
-	stats->nivcsw = tsk->nivcsw;
-	bacct_add_tsk(user_ns, pid_ns, stats, tsk);
+	if (fields & TASKSTATS_FIELD_CSW) {
+		stats->nvcsw = tsk->nvcsw;
+		stats->nivcsw = tsk->nivcsw;
+	}
+	if (fields & TASKSTATS_FIELD_BASIC)
+		bacct_add_tsk(user_ns, pid_ns, stats, tsk);
 
 	/* fill in extended acct fields */
-	xacct_add_tsk(stats, tsk);
+	if (fields & TASKSTATS_FIELD_XACCT)
+		xacct_add_tsk(stats, tsk);
 }
 
 static int fill_stats_for_pid(pid_t pid, struct taskstats *stats)
@@ -210,7 +220,8 @@ static int fill_stats_for_pid(pid_t pid, struct taskstats *stats)
 	rcu_read_unlock();
 	if (!tsk)
 		return -ESRCH;
-	fill_stats(current_user_ns(), task_active_pid_ns(current), tsk, stats);
+	fill_stats(current_user_ns(), task_active_pid_ns(current), tsk, stats,
+		   TASKSTATS_FIELD_ALL);
 	put_task_struct(tsk);
 	return 0;
 }
@@ -588,6 +599,142 @@ static int taskstats_user_cmd(struct sk_buff *skb, struct genl_info *info)
 		return -EINVAL;
 }
 
+/*
+ * State of a TASKSTATS_CMD_GET dump: the pids to report on, taken from
+ * TASKSTATS_CMD_ATTR_PID_LIST or from the cgroup that
+ * TASKSTATS_CMD_ATTR_CGROUP_FD refers to when the dump starts.
+ */
+struct taskstats_dump {
+	u32 fields;
+	int pos;
+	int nr;
+	pid_t *pids;
+};
+
+static struct taskstats_dump *taskstats_dump_start(struct netlink_callback *cb)
+{
+	struct nlattr *attrs[TASKSTATS_CMD_ATTR_MAX + 1];
+	struct taskstats_dump *dump;
+	struct nlattr *na;
+	struct fd f;
+	int rc;
+
+	rc = nlmsg_parse(cb->nlh, GENL_HDRLEN, attrs, TASKSTATS_CMD_ATTR_MAX,
+			 taskstats_cmd_get_policy);
+	if (rc < 0)
+		return ERR_PTR(rc);
+
+	dump = kzalloc(sizeof(*dump), GFP_KERNEL);
+	if (!dump)
+		return ERR_PTR(-ENOMEM);
+
+	dump->fields = TASKSTATS_FIELD_ALL;
+	if (attrs[TASKSTATS_CMD_ATTR_FIELDS])
+		dump->fields = nla_get_u32(attrs[TASKSTATS_CMD_ATTR_FIELDS]);
+
+	rc = -EINVAL;
+	if (attrs[TASKSTATS_CMD_ATTR_PID_LIST]) {
+		na = attrs[TASKSTATS_CMD_ATTR_PID_LIST];
+		if (!nla_len(na) || nla_len(na) % sizeof(u32))
+			goto err;
+
+		dump->nr = nla_len(na) / sizeof(u32);
+		if (nla_len(na) > PAGE_SIZE)
+			dump->pids = vmalloc(nla_len(na));
+		else
+			dump->pids = kmalloc(nla_len(na), GFP_KERNEL);
+		rc = -ENOMEM;
+		if (!dump->pids)
+			goto err;
+		memcpy(dump->pids, nla_data(na), nla_len(na));
+	} else if (attrs[TASKSTATS_CMD_ATTR_CGROUP_FD]) {
+		f = fdget(nla_get_u32(attrs[TASKSTATS_CMD_ATTR_CGROUP_FD]));
+		rc = -EBADF;
+		if (!f.file)
+			goto err;
+		dump->pids = cgroup_task_pids(f.file->f_path.dentry, &dump->nr);
+		fdput(f);
+		if (IS_ERR(dump->pids)) {
+			rc = PTR_ERR(dump->pids);
+			goto err;
+		}
+	} else {
+		goto err;
+	}
+
+	return dump;
+err:
+	kfree(dump);
+	return ERR_PTR(rc);
+}
+
+/*
+ * Report on a batch of tasks with one dump.  Each task gets a
+ * TASKSTATS_CMD_NEW message laid out as the reply to a
+ * TASKSTATS_CMD_ATTR_PID request.  Tasks that have exited by the time
+ * they are reached are skipped.
+ */
+static int taskstats_user_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	struct taskstats_dump *dump = (struct taskstats_dump *) cb->args[0];
+	struct task_struct *tsk;
+	struct taskstats *stats;
+	void *hdr;
+	pid_t pid;
+
+	if (!dump) {
+		dump = taskstats_dump_start(cb);
+		if (IS_ERR(dump))
+			return PTR_ERR(dump);
+		cb->args[0] = (long) dump;
+	}
+
+	for (; dump->pos < dump->nr; dump->pos++) {
+		pid = dump->pids[dump->pos];
+
+		rcu_read_lock();
+		tsk = find_task_by_vpid(pid);
+		if (tsk)
+			get_task_struct(tsk);
+		rcu_read_unlock();
+		if (!tsk)
+			continue;
+
+		hdr = genlmsg_put(skb, NETLINK_CB(cb->skb).portid,
+				  cb->nlh->nlmsg_seq, &family, NLM_F_MULTI,
+				  TASKSTATS_CMD_NEW);
+		if (!hdr) {
+			put_task_struct(tsk);
+			break;
+		}
+
+		stats = mk_reply(skb, TASKSTATS_TYPE_PID, pid);
+		if (!stats) {
+			genlmsg_cancel(skb, hdr);
+			put_task_struct(tsk);
+			break;
+		}
+
+		fill_stats(current_user_ns(), task_active_pid_ns(current), tsk,
+			   stats, dump->fields);
+		put_task_struct(tsk);
+		genlmsg_end(skb, hdr);
+	}
+
+	return skb->len;
+}
+
+static int taskstats_user_dump_done(struct netlink_callback *cb)
+{
+	struct taskstats_dump *dump = (struct taskstats_dump *) cb->args[0];
+
+	if (dump) {
+		kvfree(dump->pids);
+		kfree(dump);
+	}
+	return 0;
+}
+
 static struct taskstats *taskstats_tgid_alloc(struct task_struct *tsk)
 {
 	struct signal_struct *sig = tsk->signal;
@@ -651,7 +798,7 @@ void taskstats_exit(struct task_struct *tsk, int group_dead)
 	if (!stats)
 		goto err;
 
-	fill_stats(&init_user_ns, &init_pid_ns, tsk, stats);
+	fill_stats(&init_user_ns, &init_pid_ns, tsk, stats, TASKSTATS_FIELD_ALL);
 
 	/*
 	 * Doesn't matter if tsk is the leader or the last group member leaving
@@ -677,6 +824,8 @@ static const struct genl_ops taskstats_ops[] = {
 	{
 		.cmd		= TASKSTATS_CMD_GET,
 		.doit		= taskstats_user_cmd,
+		.dumpit		= taskstats_user_dump,
+		.done		= taskstats_user_dump_done,
 		.policy		= taskstats_cmd_get_policy,
 		.flags		= GENL_ADMIN_PERM,
 	},
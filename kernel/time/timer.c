@@ -57,23 +57,55 @@ __visible u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * per-CPU timer wheel definitions:
+ *
+ * The wheel has LVL_DEPTH levels of LVL_SIZE buckets each. Level 0 has a
+ * granularity of one jiffy, every further level is LVL_CLK_DIV times
+ * coarser. A timer is queued once, into the level whose range covers its
+ * timeout, rounded up to that level's granularity, and expires straight
+ * from there. Timers are never cascaded down to finer levels, so adding
+ * and removing a timer stays O(1) and the timer softirq never has to
+ * rehash long lists. The price is a bounded slack: a timer may fire up to
+ * one granule of its level (about 12.5% of its timeout) late, but never
+ * early. With HZ=1000:
+ *
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~4s - ~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~32s - ~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~4m - ~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~34m - ~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~4h - ~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1040187391 ms (~1d - ~12d)
+ *
+ * Timeouts beyond the last level are clamped to WHEEL_TIMEOUT_MAX and
+ * requeued when that bucket expires.
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* The first timeout which no longer fits into level n - 1 */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+#define WHEEL_SIZE		(LVL_SIZE * LVL_DEPTH)
 
 struct tvec_base {
 	spinlock_t lock;
@@ -83,11 +115,8 @@ struct tvec_base {
 	unsigned long active_timers;
 	unsigned long all_timers;
 	int cpu;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -353,61 +382,74 @@ static bool catchup_timer_jiffies(struct tvec_base *base)
 	return false;
 }
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+/*
+ * Return the wheel bucket for a timer expiring at @expires and store the
+ * jiffy at which that bucket will be run in @bucket_expiry.
+ */
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
 {
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long)delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
-		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
+	}
+
+	/*
+	 * Timeouts beyond the wheel are queued at its end, __run_timers()
+	 * requeues them from there.
+	 */
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		delta = WHEEL_TIMEOUT_MAX;
+		expires = clk + delta;
 	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++) {
+		if (delta < LVL_START(lvl + 1))
+			break;
+	}
+
+	/* Round up so the timer never fires before its expiry time */
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned long
+__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
+{
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
 	/*
 	 * Timers are FIFO:
 	 */
-	list_add_tail(&timer->entry, vec);
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+	return bucket_expiry;
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
+	unsigned long bucket_expiry;
+
 	(void)catchup_timer_jiffies(base);
-	__internal_add_timer(base, timer);
+	bucket_expiry = __internal_add_timer(base, timer);
 	/*
 	 * Update base->active_timers and base->next_timer
 	 */
 	if (!tbase_get_deferrable(timer->base)) {
 		if (!base->active_timers++ ||
-		    time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
+		    time_before(bucket_expiry, base->next_timer))
+			base->next_timer = bucket_expiry;
 	}
 	base->all_timers++;
 
@@ -712,13 +754,24 @@ detach_expired_timer(struct timer_list *timer, struct tvec_base *base)
 static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 			     bool clear_pending)
 {
+	struct list_head *prev = timer->entry.prev;
+
 	if (!timer_pending(timer))
 		return 0;
 
 	detach_timer(timer, clear_pending);
+	/*
+	 * If the timer was the last one in its wheel bucket, its only
+	 * neighbour was the bucket head. Timers which __run_timers() has
+	 * already collected sit on a list outside of the wheel.
+	 */
+	if (prev >= base->vectors && prev < base->vectors + WHEEL_SIZE &&
+	    list_empty(prev))
+		__clear_bit(prev - base->vectors, base->pending_map);
 	if (!tbase_get_deferrable(timer->base)) {
 		base->active_timers--;
-		if (timer->expires == base->next_timer)
+		/* base->next_timer is the expiry of the timer's bucket */
+		if (time_after_eq(base->next_timer, timer->expires))
 			base->next_timer = base->timer_jiffies;
 	}
 	base->all_timers--;
@@ -732,7 +785,7 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found in the wheel buckets.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -1092,27 +1145,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1156,18 +1188,81 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Move the buckets which expire at base->timer_jiffies onto @heads and
+ * return how many there were. A level only needs looking at when the
+ * clock has just completed a full granule of it.
+ */
+static int collect_expired_timers(struct tvec_base *base,
+				  struct list_head *heads)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int idx;
+	int lvl, levels = 0;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++) {
+		idx = LVL_OFFS(lvl) + (clk & LVL_MASK);
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_replace_init(base->vectors + idx, heads + levels++);
+		if (clk & LVL_CLK_MASK)
+			break;
+		clk >>= LVL_CLK_SHIFT;
+	}
+	return levels;
+}
+
+static void expire_timers(struct tvec_base *base, struct list_head *head,
+			  unsigned long clk)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+		bool irqsafe;
+
+		timer = list_first_entry(head, struct timer_list, entry);
+
+		/* Clamped to the end of the wheel, not due yet */
+		if (unlikely(time_after(timer->expires, clk))) {
+			__list_del_entry(&timer->entry);
+			__internal_add_timer(base, timer);
+			continue;
+		}
+
+		fn = timer->function;
+		data = timer->data;
+		irqsafe = tbase_get_irqsafe(timer->base);
+
+		timer_stats_account_timer(timer);
+
+		base->running_timer = timer;
+		detach_expired_timer(timer, base);
+
+		if (irqsafe) {
+			spin_unlock(&base->lock);
+			call_timer_fn(timer, fn, data);
+			spin_lock(&base->lock);
+		} else {
+			spin_unlock_irq(&base->lock);
+			call_timer_fn(timer, fn, data);
+			spin_lock_irq(&base->lock);
+		}
+	}
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function executes all expired timer buckets. Timers are never
+ * moved between levels, each bucket is run straight from its level.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head heads[LVL_DEPTH];
+	unsigned long clk;
+	int levels;
 
 	spin_lock_irq(&base->lock);
 	if (catchup_timer_jiffies(base)) {
@@ -1175,45 +1270,11 @@ static inline void __run_timers(struct tvec_base *base)
 		return;
 	}
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
-
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		clk = base->timer_jiffies;
+		levels = collect_expired_timers(base, heads);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, head);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-			bool irqsafe;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-			irqsafe = tbase_get_irqsafe(timer->base);
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_expired_timer(timer, base);
-
-			if (irqsafe) {
-				spin_unlock(&base->lock);
-				call_timer_fn(timer, fn, data);
-				spin_lock(&base->lock);
-			} else {
-				spin_unlock_irq(&base->lock);
-				call_timer_fn(timer, fn, data);
-				spin_lock_irq(&base->lock);
-			}
-		}
+		while (levels--)
+			expire_timers(base, heads + levels, clk);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
@@ -1225,72 +1286,68 @@ static inline void __run_timers(struct tvec_base *base)
  * is used on S/390 to stop all activity when a CPU is idle.
  * This function needs to be called with interrupts disabled.
  */
+static bool bucket_has_active_timers(struct list_head *head)
+{
+	struct timer_list *timer;
+
+	list_for_each_entry(timer, head, entry) {
+		if (!tbase_get_deferrable(timer->base))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Search the level starting at @offset for the first bucket, beginning at
+ * @clk and wrapping around, that holds a non-deferrable timer. Return its
+ * distance from @clk or -1 if there is none.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk)
+{
+	unsigned int pos, start = offset + clk;
+	unsigned int end = offset + LVL_SIZE;
+
+	for (pos = find_next_bit(base->pending_map, end, start); pos < end;
+	     pos = find_next_bit(base->pending_map, end, pos + 1)) {
+		if (bucket_has_active_timers(base->vectors + pos))
+			return pos - start;
+	}
+	for (pos = find_next_bit(base->pending_map, start, offset); pos < start;
+	     pos = find_next_bit(base->pending_map, start, pos + 1)) {
+		if (bucket_has_active_timers(base->vectors + pos))
+			return pos + LVL_SIZE - start;
+	}
+	return -1;
+}
+
+/*
+ * Find the jiffy at which the first bucket holding a non-deferrable timer
+ * is run. Each level is searched from its current position; the earliest
+ * hit across all levels wins.
+ */
 static unsigned long __next_timer_interrupt(struct tvec_base *base)
 {
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
-				continue;
-
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
+	unsigned long clk = base->timer_jiffies;
+	unsigned long expires = clk + NEXT_TIMER_MAX_DELTA;
+	unsigned long tmp, adj;
+	unsigned int lvl, offset = 0;
+	int pos;
+
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		pos = next_pending_bucket(base, offset, clk & LVL_MASK);
+		if (pos >= 0) {
+			tmp = (clk + (unsigned long)pos) << LVL_SHIFT(lvl);
+			if (time_before(tmp, expires))
+				expires = tmp;
 		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
-
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+		/*
+		 * The current bucket of the next level has already been run
+		 * unless the clock is at the start of that level's granule.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
 	}
 	return expires;
 }
@@ -1574,14 +1631,9 @@ static int init_timers_cpu(int cpu)
 	}
 
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1622,14 +1674,9 @@ static void migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
+	bitmap_zero(old_base->pending_map, WHEEL_SIZE);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -982,6 +982,7 @@ struct event_filter {
 	int			a_preds;	/* allocated */
 	struct filter_pred	*preds;
 	struct filter_pred	*root;
+	struct bpf_prog		*prog;		/* compiled preds, if any */
 	char			*filter_string;
 };
 
@@ -1090,6 +1091,13 @@ extern const struct file_operations event_trigger_fops;
 extern int register_trigger_cmds(void);
 extern void clear_event_triggers(struct trace_array *tr);
 
+#ifdef CONFIG_HIST_TRIGGERS
+extern const struct file_operations event_hist_fops;
+extern int register_trigger_hist_cmd(void);
+#else
+static inline int register_trigger_hist_cmd(void) { return 0; }
+#endif
+
 struct event_trigger_data {
 	unsigned long			count;
 	int				ref;
@@ -1113,7 +1121,9 @@ struct event_trigger_data {
  * @func: The trigger 'probe' function called when the triggering
  *	event occurs.  The data passed into this callback is the data
  *	that was supplied to the event_command @reg() function that
- *	registered the trigger (see struct event_command).
+ *	registered the trigger (see struct event_command).  @rec is the
+ *	event's record, or NULL if the trigger is invoked
+ *	unconditionally or after the record has been committed.
  *
  * @init: An optional initialization function called for the trigger
  *	when the trigger is registered (via the event_command reg()
@@ -1138,7 +1148,8 @@ struct event_trigger_data {
  *	(see trace_event_triggers.c).
  */
 struct event_trigger_ops {
-	void			(*func)(struct event_trigger_data *data);
+	void			(*func)(struct event_trigger_data *data,
+					void *rec);
 	int			(*init)(struct event_trigger_ops *ops,
 					struct event_trigger_data *data);
 	void			(*free)(struct event_trigger_ops *ops,
@@ -1201,6 +1212,12 @@ struct event_trigger_ops {
  *	itself logs to the trace buffer, this flag should be set,
  *	otherwise it can be left unspecified.
  *
+ * @needs_rec: A flag that says whether or not this command needs
+ *	the event's record passed to its @func() probe, e.g. to look at
+ *	the event's fields.  Without it, a trigger that has no filter
+ *	may be invoked before the record has been written, with a NULL
+ *	@rec.  Commands with @post_trigger set never get a record.
+ *
  * All the methods below, except for @set_filter(), must be
  * implemented.
  *
@@ -1241,6 +1258,7 @@ struct event_command {
 	char			*name;
 	enum event_trigger_type	trigger_type;
 	bool			post_trigger;
+	bool			needs_rec;
 	int			(*func)(struct event_command *cmd_ops,
 					struct ftrace_event_file *file,
 					char *glob, char *cmd, char *params);
@@ -1258,6 +1276,20 @@ struct event_command {
 	struct event_trigger_ops *(*get_trigger_ops)(char *cmd, char *param);
 };
 
+extern int register_event_command(struct event_command *cmd);
+extern void trigger_data_free(struct event_trigger_data *data);
+extern int event_trigger_init(struct event_trigger_ops *ops,
+			      struct event_trigger_data *data);
+extern int register_trigger(char *glob, struct event_trigger_ops *ops,
+			    struct event_trigger_data *data,
+			    struct ftrace_event_file *file);
+extern void unregister_trigger(char *glob, struct event_trigger_ops *ops,
+			       struct event_trigger_data *test,
+			       struct ftrace_event_file *file);
+extern int set_trigger_filter(char *filter_str,
+			      struct event_trigger_data *trigger_data,
+			      struct ftrace_event_file *file);
+
 extern int trace_event_enable_disable(struct ftrace_event_file *file,
 				      int enable, int soft_disable);
 extern int tracing_alloc_snapshot(void);
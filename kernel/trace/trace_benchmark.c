@@ -20,6 +20,10 @@ static u64 bm_cnt;
 static u64 bm_stddev;
 static unsigned int bm_avg;
 static unsigned int bm_std;
+static u64 bm_call_total;
+
+/* Calls of trace_benchmark_call() timed per iteration */
+#define BM_CALLS	64
 
 /*
  * This gets called in a loop recording the time it took to write
@@ -56,6 +60,24 @@ static void trace_do_benchmark(void)
 
 	delta = stop - start;
 
+	/*
+	 * Also time calls to an empty function that is compiled with
+	 * -pg. Its cost is that of the function (graph) tracer per
+	 * traced call, so running this with function_graph and with or
+	 * without tracing_thresh compares the cost of the two modes.
+	 */
+	if (bm_cnt <= UINT_MAX) {
+		u64 call_start;
+		int i;
+
+		local_irq_disable();
+		call_start = trace_clock_local();
+		for (i = 0; i < BM_CALLS; i++)
+			trace_benchmark_call();
+		bm_call_total += trace_clock_local() - call_start;
+		local_irq_enable();
+	}
+
 	/*
 	 * The first read is cold cached, keep it separate from the
 	 * other calculations.
@@ -81,8 +103,9 @@ static void trace_do_benchmark(void)
 	 */
 	if (bm_cnt > UINT_MAX) {
 		scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
-		    "last=%llu first=%llu max=%llu min=%llu ** avg=%u std=%d std^2=%lld",
-			  bm_last, bm_first, bm_max, bm_min, bm_avg, bm_std, bm_stddev);
+		    "last=%llu first=%llu max=%llu min=%llu ** avg=%u std=%d std^2=%lld call=%llu",
+			  bm_last, bm_first, bm_max, bm_min, bm_avg, bm_std, bm_stddev,
+			  div64_u64(bm_call_total, (u64)UINT_MAX * BM_CALLS));
 		return;
 	}
 
@@ -133,8 +156,9 @@ static void trace_do_benchmark(void)
 	}
 
 	scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
-		  "last=%llu first=%llu max=%llu min=%llu avg=%u std=%d std^2=%lld",
-		  bm_last, bm_first, bm_max, bm_min, avg, std, stddev);
+		  "last=%llu first=%llu max=%llu min=%llu avg=%u std=%d std^2=%lld call=%llu",
+		  bm_last, bm_first, bm_max, bm_min, avg, std, stddev,
+		  div64_u64(bm_call_total, bm_cnt * BM_CALLS));
 
 	bm_std = std;
 	bm_avg = avg;
@@ -190,6 +214,7 @@ void trace_benchmark_unreg(void)
 	bm_max = 0;
 	bm_min = 0;
 	bm_cnt = 0;
+	bm_call_total = 0;
 	/* These don't need to be reset but reset them anyway */
 	bm_first = 0;
 	bm_std = 0;
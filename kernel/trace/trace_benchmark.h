@@ -8,6 +8,7 @@
 
 extern void trace_benchmark_reg(void);
 extern void trace_benchmark_unreg(void);
+extern void trace_benchmark_call(void);
 
 #define BENCHMARK_EVENT_STRLEN		128
 
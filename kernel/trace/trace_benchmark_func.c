@@ -0,0 +1,12 @@
+#include "trace_benchmark.h"
+
+/*
+ * Called in a loop by the benchmark thread. Unlike the rest of
+ * kernel/trace this file is built with -pg, so the function and
+ * function_graph tracers can hook it and the loop measures their
+ * cost per call.
+ */
+void trace_benchmark_call(void)
+{
+	barrier();
+}
@@ -23,6 +23,7 @@
 #include <linux/mutex.h>
 #include <linux/perf_event.h>
 #include <linux/slab.h>
+#include <linux/filter.h>
 
 #include "trace.h"
 #include "trace_output.h"
@@ -546,6 +547,7 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 {
 	struct filter_pred *preds;
 	struct filter_pred *root;
+	struct bpf_prog *prog;
 	struct filter_match_preds_data data = {
 		/* match is currently meaningless */
 		.match = -1,
@@ -568,6 +570,10 @@ int filter_match_preds(struct event_filter *filter, void *rec)
 	if (!root)
 		return 1;
 
+	prog = filter->prog;
+	if (prog)
+		return BPF_PROG_RUN(prog, rec);
+
 	data.preds = preds = rcu_dereference_sched(filter->preds);
 	ret = walk_pred_tree(preds, root, filter_match_preds_cb, &data);
 	WARN_ON(ret);
@@ -770,6 +776,10 @@ static void __free_preds(struct event_filter *filter)
 {
 	int i;
 
+	if (filter->prog) {
+		bpf_prog_free(filter->prog);
+		filter->prog = NULL;
+	}
 	if (filter->preds) {
 		for (i = 0; i < filter->n_preds; i++)
 			kfree(filter->preds[i].ops);
@@ -1549,6 +1559,222 @@ static int fold_pred_tree(struct event_filter *filter,
 			      filter->preds);
 }
 
+/*
+ * Once the predicate tree is built and folded, it is also compiled
+ * into an internal BPF program. The program is run instead of walking
+ * the tree, and is JITed when the architecture supports it. Numeric
+ * compares are emitted inline; everything else (strings, function
+ * fields) calls back into the predicate's own fn.
+ *
+ * Registers: R6 holds the record, R0 the result of the last
+ * predicate, R2/R3 are scratch for the compares.
+ */
+
+/* Worst case number of instructions emitted per predicate */
+#define FILTER_PROG_INSNS_PER_PRED	11
+
+struct filter_prog_data {
+	struct filter_pred	*preds;
+	struct bpf_insn		*insns;
+	int			len;
+	unsigned short		*fixups;
+	int			n_fixups;
+};
+
+static u64 filter_pred_call(u64 r1, u64 r2, u64 r3, u64 r4, u64 r5)
+{
+	struct filter_pred *pred = (struct filter_pred *)(unsigned long)r1;
+
+	return pred->fn(pred, (void *)(unsigned long)r2);
+}
+
+static void filter_prog_emit(struct filter_prog_data *d, struct bpf_insn insn)
+{
+	d->insns[d->len++] = insn;
+}
+
+static void filter_prog_emit_ld_imm64(struct filter_prog_data *d,
+				      int reg, u64 imm)
+{
+	struct bpf_insn ld[] = { BPF_LD_IMM64(reg, imm) };
+
+	filter_prog_emit(d, ld[0]);
+	filter_prog_emit(d, ld[1]);
+}
+
+/* Emit a short circuit jump on R0 whose target is patched later */
+static void filter_prog_emit_fixup(struct filter_prog_data *d, int op)
+{
+	int code = op == OP_OR ? BPF_JNE : BPF_JEQ;
+
+	d->fixups[d->n_fixups++] = d->len;
+	filter_prog_emit(d, BPF_JMP_IMM(code, BPF_REG_0, 0, 0));
+}
+
+/* Point all jumps recorded since @start at the current instruction */
+static void filter_prog_apply_fixups(struct filter_prog_data *d, int start)
+{
+	while (d->n_fixups > start) {
+		int i = d->fixups[--d->n_fixups];
+
+		d->insns[i].off = d->len - i - 1;
+	}
+}
+
+static void filter_prog_emit_not(struct filter_prog_data *d, int not)
+{
+	if (not)
+		filter_prog_emit(d, BPF_ALU64_IMM(BPF_XOR, BPF_REG_0, 1));
+}
+
+static void filter_prog_emit_leaf(struct filter_prog_data *d,
+				  struct filter_pred *pred)
+{
+	struct ftrace_event_field *field = pred->field;
+	int size, shift, code;
+	bool is_signed;
+	u64 val;
+
+	if (!field || is_string_field(field) || is_function_field(field) ||
+	    pred->fn != select_comparison_fn(pred->op, field->size,
+					     field->is_signed)) {
+		filter_prog_emit_ld_imm64(d, BPF_REG_1, (unsigned long)pred);
+		filter_prog_emit(d, BPF_MOV64_REG(BPF_REG_2, BPF_REG_6));
+		filter_prog_emit(d, BPF_EMIT_CALL(filter_pred_call));
+		return;
+	}
+
+	size = field->size;
+	shift = 64 - size * 8;
+	is_signed = field->is_signed && pred->op != OP_EQ &&
+		    pred->op != OP_NE;
+
+	/* Truncate the constant the same way the C predicates cast it */
+	val = pred->val;
+	if (shift) {
+		if (is_signed)
+			val = (u64)((s64)(val << shift) >> shift);
+		else
+			val &= (1ULL << (size * 8)) - 1;
+	}
+
+	filter_prog_emit(d, BPF_LDX_MEM(bytes_to_bpf_size(size), BPF_REG_2,
+					BPF_REG_6, pred->offset));
+	if (is_signed && shift) {
+		filter_prog_emit(d, BPF_ALU64_IMM(BPF_LSH, BPF_REG_2, shift));
+		filter_prog_emit(d, BPF_ALU64_IMM(BPF_ARSH, BPF_REG_2, shift));
+	}
+	filter_prog_emit_ld_imm64(d, BPF_REG_3, val);
+	filter_prog_emit(d, BPF_MOV64_IMM(BPF_REG_0, 1));
+
+	/* There is no "less than" jump, so swap the operands for those */
+	switch (pred->op) {
+	case OP_LT:
+		code = is_signed ? BPF_JSGT : BPF_JGT;
+		filter_prog_emit(d, BPF_JMP_REG(code, BPF_REG_3, BPF_REG_2, 1));
+		break;
+	case OP_LE:
+		code = is_signed ? BPF_JSGE : BPF_JGE;
+		filter_prog_emit(d, BPF_JMP_REG(code, BPF_REG_3, BPF_REG_2, 1));
+		break;
+	case OP_GT:
+		code = is_signed ? BPF_JSGT : BPF_JGT;
+		filter_prog_emit(d, BPF_JMP_REG(code, BPF_REG_2, BPF_REG_3, 1));
+		break;
+	case OP_GE:
+		code = is_signed ? BPF_JSGE : BPF_JGE;
+		filter_prog_emit(d, BPF_JMP_REG(code, BPF_REG_2, BPF_REG_3, 1));
+		break;
+	case OP_BAND:
+		filter_prog_emit(d, BPF_JMP_REG(BPF_JSET, BPF_REG_2, BPF_REG_3, 1));
+		break;
+	default:
+		/* OP_NE was turned into OP_EQ with pred->not set */
+		filter_prog_emit(d, BPF_JMP_REG(BPF_JEQ, BPF_REG_2, BPF_REG_3, 1));
+		break;
+	}
+	filter_prog_emit(d, BPF_MOV64_IMM(BPF_REG_0, 0));
+	filter_prog_emit_not(d, pred->not);
+}
+
+static int filter_prog_cb(enum move_type move, struct filter_pred *pred,
+			  int *err, void *data)
+{
+	struct filter_prog_data *d = data;
+	int i, start;
+
+	switch (move) {
+	case MOVE_DOWN:
+		if (pred->left == FILTER_PRED_INVALID) {
+			filter_prog_emit_leaf(d, pred);
+			return WALK_PRED_PARENT;
+		}
+		if (!pred->ops)
+			return WALK_PRED_DEFAULT;
+
+		/* Folded ops are a flat chain of leafs */
+		start = d->n_fixups;
+		for (i = 0; i < pred->val; i++) {
+			filter_prog_emit_leaf(d, &d->preds[pred->ops[i]]);
+			if (i < pred->val - 1)
+				filter_prog_emit_fixup(d, pred->op);
+		}
+		filter_prog_apply_fixups(d, start);
+		filter_prog_emit_not(d, pred->not);
+		return WALK_PRED_PARENT;
+	case MOVE_UP_FROM_LEFT:
+		filter_prog_emit_fixup(d, pred->op);
+		break;
+	case MOVE_UP_FROM_RIGHT:
+		filter_prog_apply_fixups(d, d->n_fixups - 1);
+		filter_prog_emit_not(d, pred->not);
+		break;
+	}
+
+	return WALK_PRED_DEFAULT;
+}
+
+/*
+ * Failing to compile is not an error, filter_match_preds() just falls
+ * back to walking the tree.
+ */
+static void filter_compile_prog(struct event_filter *filter,
+				struct filter_pred *root)
+{
+	struct filter_prog_data data = {
+		.preds = filter->preds,
+	};
+	struct bpf_prog *prog;
+	int max_insns;
+
+	max_insns = filter->n_preds * FILTER_PROG_INSNS_PER_PRED + 2;
+	if (max_insns > BPF_MAXINSNS)
+		return;
+
+	data.insns = kcalloc(max_insns, sizeof(*data.insns), GFP_KERNEL);
+	data.fixups = kcalloc(filter->n_preds, sizeof(*data.fixups),
+			      GFP_KERNEL);
+	if (!data.insns || !data.fixups)
+		goto out;
+
+	filter_prog_emit(&data, BPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+	if (walk_pred_tree(filter->preds, root, filter_prog_cb, &data))
+		goto out;
+	filter_prog_emit(&data, BPF_EXIT_INSN());
+
+	prog = bpf_prog_alloc(bpf_prog_size(data.len), 0);
+	if (!prog)
+		goto out;
+
+	memcpy(prog->insnsi, data.insns, data.len * sizeof(*data.insns));
+	prog->len = data.len;
+	bpf_prog_select_runtime(prog);
+	filter->prog = prog;
+ out:
+	kfree(data.fixups);
+	kfree(data.insns);
+}
+
 static int replace_preds(struct ftrace_event_call *call,
 			 struct event_filter *filter,
 			 struct filter_parse_state *ps,
@@ -1651,6 +1877,8 @@ static int replace_preds(struct ftrace_event_call *call,
 		if (err)
 			goto fail;
 
+		filter_compile_prog(filter, root);
+
 		/* We don't set root until we know it works */
 		barrier();
 		filter->root = root;
@@ -2388,6 +2616,21 @@ static __init int ftrace_test_event_filter(void)
 		 * tests, but the rcu dereference will complain without it.
 		 */
 		preempt_disable();
+		if (filter->prog) {
+			err = BPF_PROG_RUN(filter->prog, &d->rec);
+			if (err != d->match) {
+				preempt_enable();
+				printk(KERN_INFO
+				       "Failed to match compiled filter '%s', expected %d\n",
+				       d->filter, d->match);
+				__free_filter(filter);
+				break;
+			}
+			/* The visited check below only works on the tree walk */
+			bpf_prog_free(filter->prog);
+			filter->prog = NULL;
+		}
+
 		if (*d->not_visited)
 			walk_pred_tree(filter->preds, filter->root,
 				       test_walk_pred_cb,
@@ -0,0 +1,900 @@
+/*
+ * trace_events_hist - trace event hist triggers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A hist trigger aggregates the events it is attached to into a hash
+ * table kept inside the kernel, keyed by one or more event fields (or
+ * the kernel stack) and summing any number of numeric fields, so that
+ * only the summary, read from the event's 'hist' file, ever has to be
+ * copied to user space:
+ *
+ *   hist:keys=<field>[.hex|.sym][,...][:vals=<field>[,...]]
+ *	 [:sort=<field>[.descending]][:size=<entries>][:pause][:cont][:clear]
+ *	 [if <filter>]
+ *
+ * The table is preallocated when the trigger is set and updated with
+ * cmpxchg and atomic64 operations only, so it can be fed from any
+ * context including NMI.  Events that don't fit into a full table are
+ * counted as dropped.
+ */
+
+#include <linux/module.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/stacktrace.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/sort.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		3
+#define HIST_VALS_MAX		4
+
+#define HIST_MAP_BITS_DEFAULT	11
+#define HIST_MAP_BITS_MIN	7
+#define HIST_MAP_BITS_MAX	17
+
+/*
+ * Skip 4:
+ *   event_hist_trigger()
+ *   event_triggers_call()
+ *   event_trigger_unlock_commit()
+ *   ftrace_raw_event_xxx()
+ */
+#define HIST_STACKTRACE_SKIP	4
+#define HIST_STACKTRACE_DEPTH	16
+#define HIST_STACKTRACE_SIZE	(HIST_STACKTRACE_DEPTH * sizeof(unsigned long))
+
+#define HIST_KEY_SIZE_MAX	(MAX_FILTER_STR_VAL + HIST_STACKTRACE_SIZE)
+
+enum hist_field_flags {
+	HIST_FIELD_HEX		= 1,
+	HIST_FIELD_SYM		= 2,
+	HIST_FIELD_STRING	= 4,
+	HIST_FIELD_STACKTRACE	= 8,
+};
+
+struct hist_field {
+	struct ftrace_event_field	*field;	/* NULL for stacktrace */
+	unsigned int			flags;
+	unsigned int			size;	/* bytes taken in the key */
+	unsigned int			offset;	/* offset in the key */
+};
+
+struct hist_elt {
+	void				*key;
+	atomic64_t			hitcount;
+	atomic64_t			sums[HIST_VALS_MAX];
+};
+
+struct hist_map_entry {
+	u32				key_hash;
+	struct hist_elt			*elt;
+};
+
+struct hist_trigger_attrs {
+	char				*keys_str;
+	char				*vals_str;
+	char				*sort_key_str;
+	bool				pause;
+	bool				cont;
+	bool				clear;
+	unsigned int			map_bits;
+};
+
+struct hist_trigger_data {
+	struct hist_trigger_attrs	*attrs;
+	struct hist_field		keys[HIST_KEYS_MAX];
+	unsigned int			n_keys;
+	unsigned int			key_size;
+	struct hist_field		vals[HIST_VALS_MAX];
+	unsigned int			n_vals;
+	int				sort_val;	/* -1: hitcount */
+	bool				sort_descending;
+	bool				paused;
+
+	unsigned int			map_bits;
+	struct hist_map_entry		*map;		/* 2 << map_bits */
+	struct hist_elt			*elts;		/* 1 << map_bits */
+	char				*keys_buf;
+	atomic_t			next_elt;
+	atomic64_t			drops;
+};
+
+static u64 hist_read_num(void *addr, struct ftrace_event_field *field)
+{
+	switch (field->size) {
+	case 8:
+		return *(u64 *)addr;
+	case 4:
+		if (field->is_signed)
+			return (u64)(s64)*(s32 *)addr;
+		return *(u32 *)addr;
+	case 2:
+		if (field->is_signed)
+			return (u64)(s64)*(s16 *)addr;
+		return *(u16 *)addr;
+	case 1:
+		if (field->is_signed)
+			return (u64)(s64)*(s8 *)addr;
+		return *(u8 *)addr;
+	}
+	return 0;
+}
+
+static void hist_field_key(struct hist_field *key, void *rec, char *buf)
+{
+	struct ftrace_event_field *field = key->field;
+	char *dst = buf + key->offset;
+	const char *str;
+	unsigned int len;
+
+	if (key->flags & HIST_FIELD_STACKTRACE) {
+		struct stack_trace stacktrace = {
+			.max_entries	= HIST_STACKTRACE_DEPTH,
+			.entries	= (unsigned long *)dst,
+			.skip		= HIST_STACKTRACE_SKIP,
+		};
+
+		save_stack_trace(&stacktrace);
+		return;
+	}
+
+	if (!(key->flags & HIST_FIELD_STRING)) {
+		memcpy(dst, rec + field->offset, field->size);
+		return;
+	}
+
+	switch (field->filter_type) {
+	case FILTER_DYN_STRING:
+		len = *(u32 *)(rec + field->offset);
+		str = rec + (len & 0xffff);
+		len >>= 16;
+		break;
+	case FILTER_PTR_STRING:
+		str = *(char **)(rec + field->offset);
+		len = str ? key->size : 0;
+		break;
+	default:
+		str = rec + field->offset;
+		len = field->size;
+		break;
+	}
+	/* The key was zeroed, leave room for the terminating NUL */
+	strncpy(dst, str, min(len, key->size - 1));
+}
+
+static struct hist_elt *hist_map_insert(struct hist_trigger_data *hist_data,
+					void *key)
+{
+	unsigned int mask = (2U << hist_data->map_bits) - 1;
+	unsigned int nr_elts = 1U << hist_data->map_bits;
+	struct hist_map_entry *entry;
+	struct hist_elt *elt;
+	u32 key_hash, test_key, idx, i;
+	int n;
+
+	key_hash = jhash(key, hist_data->key_size, 0);
+	if (!key_hash)
+		key_hash = 1;
+
+	idx = key_hash & mask;
+	for (i = 0; i <= mask; i++, idx = (idx + 1) & mask) {
+		entry = hist_data->map + idx;
+		test_key = ACCESS_ONCE(entry->key_hash);
+
+		if (test_key == key_hash) {
+			elt = smp_load_acquire(&entry->elt);
+			if (elt && !memcmp(elt->key, key, hist_data->key_size))
+				return elt;
+			continue;
+		}
+		if (test_key || cmpxchg(&entry->key_hash, 0, key_hash))
+			continue;
+
+		n = atomic_inc_return(&hist_data->next_elt) - 1;
+		if (n >= nr_elts)
+			return NULL;
+		elt = hist_data->elts + n;
+		memcpy(elt->key, key, hist_data->key_size);
+		smp_store_release(&entry->elt, elt);
+		return elt;
+	}
+	return NULL;
+}
+
+static void event_hist_trigger(struct event_trigger_data *data, void *rec)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	u64 compound_key[HIST_KEY_SIZE_MAX / sizeof(u64)];
+	struct hist_elt *elt;
+	unsigned int i;
+
+	if (!rec || ACCESS_ONCE(hist_data->paused))
+		return;
+
+	memset(compound_key, 0, hist_data->key_size);
+	for (i = 0; i < hist_data->n_keys; i++)
+		hist_field_key(&hist_data->keys[i], rec, (char *)compound_key);
+
+	elt = hist_map_insert(hist_data, compound_key);
+	if (!elt) {
+		atomic64_inc(&hist_data->drops);
+		return;
+	}
+
+	atomic64_inc(&elt->hitcount);
+	for (i = 0; i < hist_data->n_vals; i++) {
+		struct ftrace_event_field *field = hist_data->vals[i].field;
+
+		atomic64_add(hist_read_num(rec + field->offset, field),
+			     &elt->sums[i]);
+	}
+}
+
+static void hist_map_clear(struct hist_trigger_data *hist_data)
+{
+	unsigned int nr_elts = 1U << hist_data->map_bits;
+	unsigned int i, j;
+
+	memset(hist_data->map, 0, sizeof(*hist_data->map) << 1
+	       << hist_data->map_bits);
+	memset(hist_data->keys_buf, 0, hist_data->key_size * nr_elts);
+	for (i = 0; i < nr_elts; i++) {
+		struct hist_elt *elt = hist_data->elts + i;
+
+		elt->key = hist_data->keys_buf + i * hist_data->key_size;
+		atomic64_set(&elt->hitcount, 0);
+		for (j = 0; j < HIST_VALS_MAX; j++)
+			atomic64_set(&elt->sums[j], 0);
+	}
+	atomic_set(&hist_data->next_elt, 0);
+	atomic64_set(&hist_data->drops, 0);
+}
+
+static void destroy_hist_trigger_attrs(struct hist_trigger_attrs *attrs)
+{
+	if (!attrs)
+		return;
+
+	kfree(attrs->keys_str);
+	kfree(attrs->vals_str);
+	kfree(attrs->sort_key_str);
+	kfree(attrs);
+}
+
+static struct hist_trigger_attrs *parse_hist_trigger_attrs(char *trigger_str)
+{
+	struct hist_trigger_attrs *attrs;
+	char *str, **dst;
+	int ret = 0;
+
+	attrs = kzalloc(sizeof(*attrs), GFP_KERNEL);
+	if (!attrs)
+		return ERR_PTR(-ENOMEM);
+
+	attrs->map_bits = HIST_MAP_BITS_DEFAULT;
+
+	while (trigger_str) {
+		str = strsep(&trigger_str, ":");
+		dst = NULL;
+
+		if (!strncmp(str, "keys=", strlen("keys=")) ||
+		    !strncmp(str, "key=", strlen("key=")))
+			dst = &attrs->keys_str;
+		else if (!strncmp(str, "vals=", strlen("vals=")) ||
+			 !strncmp(str, "values=", strlen("values=")))
+			dst = &attrs->vals_str;
+		else if (!strncmp(str, "sort=", strlen("sort=")))
+			dst = &attrs->sort_key_str;
+		else if (!strncmp(str, "size=", strlen("size="))) {
+			unsigned long size;
+
+			ret = kstrtoul(str + strlen("size="), 0, &size);
+			if (ret)
+				goto free;
+			ret = -EINVAL;
+			if (!size || !is_power_of_2(size))
+				goto free;
+			attrs->map_bits = ilog2(size);
+			if (attrs->map_bits < HIST_MAP_BITS_MIN ||
+			    attrs->map_bits > HIST_MAP_BITS_MAX)
+				goto free;
+		} else if (!strcmp(str, "pause"))
+			attrs->pause = true;
+		else if (!strcmp(str, "cont") || !strcmp(str, "continue"))
+			attrs->cont = true;
+		else if (!strcmp(str, "clear"))
+			attrs->clear = true;
+		else {
+			ret = -EINVAL;
+			goto free;
+		}
+
+		if (dst) {
+			ret = -ENOMEM;
+			*dst = kstrdup(strchr(str, '=') + 1, GFP_KERNEL);
+			if (!*dst)
+				goto free;
+		}
+	}
+
+	ret = -EINVAL;
+	if (!attrs->keys_str)
+		goto free;
+
+	return attrs;
+ free:
+	destroy_hist_trigger_attrs(attrs);
+	return ERR_PTR(ret);
+}
+
+static struct ftrace_event_field *
+hist_find_field(struct ftrace_event_file *file, char *name,
+		unsigned int *flags)
+{
+	char *modifier = strchr(name, '.');
+
+	*flags = 0;
+	if (modifier) {
+		*modifier++ = '\0';
+		if (!strcmp(modifier, "hex"))
+			*flags |= HIST_FIELD_HEX;
+		else if (!strcmp(modifier, "sym"))
+			*flags |= HIST_FIELD_SYM;
+		else
+			return NULL;
+	}
+
+	return trace_find_event_field(file->event_call, name);
+}
+
+static int create_key_fields(struct hist_trigger_data *hist_data,
+			     struct ftrace_event_file *file)
+{
+	char *keys = kstrdup(hist_data->attrs->keys_str, GFP_KERNEL);
+	char *fields = keys, *name;
+	struct hist_field *key;
+	int ret = -EINVAL;
+
+	if (!keys)
+		return -ENOMEM;
+
+	while ((name = strsep(&fields, ",")) != NULL) {
+		if (hist_data->n_keys == HIST_KEYS_MAX)
+			goto out;
+		key = &hist_data->keys[hist_data->n_keys];
+
+		if (!strcmp(name, "stacktrace")) {
+			key->flags = HIST_FIELD_STACKTRACE;
+			key->size = HIST_STACKTRACE_SIZE;
+		} else {
+			key->field = hist_find_field(file, name, &key->flags);
+			if (!key->field)
+				goto out;
+
+			if (key->field->filter_type == FILTER_OTHER) {
+				key->size = key->field->size;
+			} else {
+				if (key->flags)
+					goto out;
+				key->flags = HIST_FIELD_STRING;
+				if (key->field->filter_type ==
+				    FILTER_STATIC_STRING)
+					key->size = key->field->size + 1;
+				else
+					key->size = MAX_FILTER_STR_VAL;
+			}
+		}
+
+		key->offset = hist_data->key_size;
+		hist_data->key_size += ALIGN(key->size, sizeof(u64));
+		if (hist_data->key_size > HIST_KEY_SIZE_MAX)
+			goto out;
+		hist_data->n_keys++;
+	}
+	ret = hist_data->n_keys ? 0 : -EINVAL;
+ out:
+	kfree(keys);
+	return ret;
+}
+
+static int create_val_fields(struct hist_trigger_data *hist_data,
+			     struct ftrace_event_file *file)
+{
+	char *vals, *fields, *name;
+	struct hist_field *val;
+	int ret = -EINVAL;
+
+	if (!hist_data->attrs->vals_str)
+		return 0;
+
+	vals = kstrdup(hist_data->attrs->vals_str, GFP_KERNEL);
+	if (!vals)
+		return -ENOMEM;
+
+	fields = vals;
+	while ((name = strsep(&fields, ",")) != NULL) {
+		/* hitcount is always there */
+		if (!strcmp(name, "hitcount"))
+			continue;
+		if (hist_data->n_vals == HIST_VALS_MAX)
+			goto out;
+		val = &hist_data->vals[hist_data->n_vals];
+		val->field = hist_find_field(file, name, &val->flags);
+		if (!val->field || val->flags ||
+		    val->field->filter_type != FILTER_OTHER ||
+		    !is_power_of_2(val->field->size) ||
+		    val->field->size > sizeof(u64))
+			goto out;
+		hist_data->n_vals++;
+	}
+	ret = 0;
+ out:
+	kfree(vals);
+	return ret;
+}
+
+static int create_sort_key(struct hist_trigger_data *hist_data)
+{
+	char *sort_str = hist_data->attrs->sort_key_str;
+	char *modifier;
+	unsigned int i, len;
+
+	hist_data->sort_val = -1;
+	if (!sort_str)
+		return 0;
+
+	len = strlen(sort_str);
+	modifier = strchr(sort_str, '.');
+	if (modifier) {
+		len = modifier - sort_str;
+		if (!strcmp(modifier, ".descending"))
+			hist_data->sort_descending = true;
+		else if (strcmp(modifier, ".ascending"))
+			return -EINVAL;
+	}
+
+	if (len == strlen("hitcount") && !strncmp(sort_str, "hitcount", len))
+		return 0;
+
+	for (i = 0; i < hist_data->n_vals; i++) {
+		const char *name = hist_data->vals[i].field->name;
+
+		if (strlen(name) == len && !strncmp(sort_str, name, len)) {
+			hist_data->sort_val = i;
+			return 0;
+		}
+	}
+	return -EINVAL;
+}
+
+static void destroy_hist_data(struct hist_trigger_data *hist_data)
+{
+	destroy_hist_trigger_attrs(hist_data->attrs);
+	vfree(hist_data->map);
+	vfree(hist_data->elts);
+	vfree(hist_data->keys_buf);
+	kfree(hist_data);
+}
+
+static struct hist_trigger_data *
+create_hist_data(struct hist_trigger_attrs *attrs,
+		 struct ftrace_event_file *file)
+{
+	struct hist_trigger_data *hist_data;
+	unsigned int nr_elts = 1U << attrs->map_bits;
+	int ret;
+
+	hist_data = kzalloc(sizeof(*hist_data), GFP_KERNEL);
+	if (!hist_data)
+		return ERR_PTR(-ENOMEM);
+
+	hist_data->attrs = attrs;
+	hist_data->map_bits = attrs->map_bits;
+	hist_data->paused = attrs->pause;
+
+	ret = create_key_fields(hist_data, file);
+	if (ret)
+		goto free;
+	ret = create_val_fields(hist_data, file);
+	if (ret)
+		goto free;
+	ret = create_sort_key(hist_data);
+	if (ret)
+		goto free;
+
+	ret = -ENOMEM;
+	hist_data->map = vmalloc(sizeof(*hist_data->map) * 2 * nr_elts);
+	hist_data->elts = vmalloc(sizeof(*hist_data->elts) * nr_elts);
+	hist_data->keys_buf = vmalloc(hist_data->key_size * nr_elts);
+	if (!hist_data->map || !hist_data->elts || !hist_data->keys_buf)
+		goto free;
+
+	hist_map_clear(hist_data);
+
+	return hist_data;
+ free:
+	hist_data->attrs = NULL;
+	destroy_hist_data(hist_data);
+	return ERR_PTR(ret);
+}
+
+static void hist_print_key(struct seq_file *m, struct hist_field *key,
+			   void *buf)
+{
+	void *addr = buf + key->offset;
+	unsigned long *stacktrace;
+	unsigned int i;
+	u64 uval;
+
+	if (key->flags & HIST_FIELD_STACKTRACE) {
+		seq_puts(m, "stacktrace:\n");
+		stacktrace = addr;
+		for (i = 0; i < HIST_STACKTRACE_DEPTH; i++) {
+			if (!stacktrace[i] || stacktrace[i] == ULONG_MAX)
+				break;
+			seq_printf(m, "%*c%pS\n", 9, ' ',
+				   (void *)stacktrace[i]);
+		}
+		return;
+	}
+
+	seq_printf(m, "%s: ", key->field->name);
+	if (key->flags & HIST_FIELD_STRING) {
+		seq_printf(m, "%-50s", (char *)addr);
+		return;
+	}
+
+	uval = hist_read_num(addr, key->field);
+	if (key->flags & HIST_FIELD_SYM)
+		seq_printf(m, "[%016llx] %-45pS", uval,
+			   (void *)(unsigned long)uval);
+	else if (key->flags & HIST_FIELD_HEX)
+		seq_printf(m, "%16llx", uval);
+	else if (key->field->is_signed)
+		seq_printf(m, "%16lld", (s64)uval);
+	else
+		seq_printf(m, "%16llu", uval);
+}
+
+static void hist_print_elt(struct seq_file *m,
+			   struct hist_trigger_data *hist_data,
+			   struct hist_elt *elt)
+{
+	unsigned int i;
+
+	seq_puts(m, "{ ");
+	for (i = 0; i < hist_data->n_keys; i++) {
+		if (i)
+			seq_puts(m, ", ");
+		hist_print_key(m, &hist_data->keys[i], elt->key);
+	}
+	seq_puts(m, " }");
+
+	seq_printf(m, " hitcount: %10llu",
+		   (u64)atomic64_read(&elt->hitcount));
+	for (i = 0; i < hist_data->n_vals; i++)
+		seq_printf(m, "  %s: %10llu", hist_data->vals[i].field->name,
+			   (u64)atomic64_read(&elt->sums[i]));
+	seq_putc(m, '\n');
+}
+
+struct hist_sort_entry {
+	u64			val;
+	struct hist_elt		*elt;
+};
+
+static int cmp_hist_sort_entries(const void *a, const void *b)
+{
+	const struct hist_sort_entry *ea = a, *eb = b;
+
+	if (ea->val == eb->val)
+		return 0;
+	return ea->val < eb->val ? -1 : 1;
+}
+
+static void event_hist_trigger_print_attrs(struct seq_file *m,
+					   struct event_trigger_data *data);
+
+static void hist_trigger_show(struct seq_file *m,
+			      struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	unsigned int nr_elts = 1U << hist_data->map_bits;
+	struct hist_sort_entry *entries;
+	unsigned int i, n;
+	u64 hits = 0;
+
+	seq_puts(m, "# event histogram\n#\n# trigger info: ");
+	event_hist_trigger_print_attrs(m, data);
+	seq_puts(m, "#\n\n");
+
+	n = min_t(unsigned int, atomic_read(&hist_data->next_elt), nr_elts);
+	entries = vmalloc(sizeof(*entries) * (n ? n : 1));
+	if (!entries) {
+		seq_puts(m, "# out of memory\n");
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct hist_elt *elt = hist_data->elts + i;
+
+		entries[i].elt = elt;
+		if (hist_data->sort_val < 0)
+			entries[i].val = atomic64_read(&elt->hitcount);
+		else
+			entries[i].val =
+				atomic64_read(&elt->sums[hist_data->sort_val]);
+		hits += atomic64_read(&elt->hitcount);
+	}
+	sort(entries, n, sizeof(*entries), cmp_hist_sort_entries, NULL);
+
+	for (i = 0; i < n; i++) {
+		unsigned int idx = hist_data->sort_descending ? n - 1 - i : i;
+
+		hist_print_elt(m, hist_data, entries[idx].elt);
+	}
+	vfree(entries);
+
+	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n    Dropped: %llu\n",
+		   hits, n, (u64)atomic64_read(&hist_data->drops));
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	struct ftrace_event_file *event_file;
+	struct event_trigger_data *data;
+	int ret = 0;
+
+	mutex_lock(&event_mutex);
+
+	event_file = event_file_data(m->private);
+	if (unlikely(!event_file)) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	list_for_each_entry_rcu(data, &event_file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST)
+			hist_trigger_show(m, data);
+	}
+
+ out_unlock:
+	mutex_unlock(&event_mutex);
+
+	return ret;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, file);
+}
+
+const struct file_operations event_hist_fops = {
+	.open = event_hist_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void event_hist_trigger_print_attrs(struct seq_file *m,
+					   struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+	unsigned int i;
+
+	seq_printf(m, "hist:keys=%s:vals=hitcount",
+		   hist_data->attrs->keys_str);
+	for (i = 0; i < hist_data->n_vals; i++)
+		seq_printf(m, ",%s", hist_data->vals[i].field->name);
+
+	seq_puts(m, ":sort=");
+	if (hist_data->sort_val < 0)
+		seq_puts(m, "hitcount");
+	else
+		seq_puts(m, hist_data->vals[hist_data->sort_val].field->name);
+	if (hist_data->sort_descending)
+		seq_puts(m, ".descending");
+
+	seq_printf(m, ":size=%u", 1U << hist_data->map_bits);
+
+	if (data->filter_str)
+		seq_printf(m, " if %s", data->filter_str);
+
+	seq_printf(m, " [%s]\n", hist_data->paused ? "paused" : "active");
+}
+
+static int event_hist_trigger_print(struct seq_file *m,
+				    struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	event_hist_trigger_print_attrs(m, data);
+	return 0;
+}
+
+static void event_hist_trigger_free(struct event_trigger_ops *ops,
+				    struct event_trigger_data *data)
+{
+	struct hist_trigger_data *hist_data = data->private_data;
+
+	if (WARN_ON_ONCE(data->ref <= 0))
+		return;
+
+	data->ref--;
+	if (!data->ref) {
+		/* Waits for the trigger to be done with hist_data */
+		trigger_data_free(data);
+		destroy_hist_data(hist_data);
+	}
+}
+
+static struct event_trigger_ops event_hist_trigger_ops = {
+	.func			= event_hist_trigger,
+	.print			= event_hist_trigger_print,
+	.init			= event_trigger_init,
+	.free			= event_hist_trigger_free,
+};
+
+static struct event_trigger_ops *event_hist_get_trigger_ops(char *cmd,
+							    char *param)
+{
+	return &event_hist_trigger_ops;
+}
+
+static struct event_trigger_data *
+find_hist_trigger(struct ftrace_event_file *file)
+{
+	struct event_trigger_data *data;
+
+	list_for_each_entry_rcu(data, &file->triggers, list) {
+		if (data->cmd_ops->trigger_type == ETT_EVENT_HIST)
+			return data;
+	}
+	return NULL;
+}
+
+/* pause, cont and clear act on the hist trigger already set */
+static int hist_trigger_control(struct event_trigger_data *data,
+				struct hist_trigger_attrs *attrs)
+{
+	struct hist_trigger_data *hist_data;
+	bool paused;
+
+	if (!data)
+		return -ENOENT;
+
+	hist_data = data->private_data;
+	paused = hist_data->paused;
+	if (attrs->pause)
+		paused = true;
+	else if (attrs->cont)
+		paused = false;
+
+	if (attrs->clear) {
+		ACCESS_ONCE(hist_data->paused) = true;
+		/* Make sure no trigger is updating the table */
+		synchronize_sched();
+		hist_map_clear(hist_data);
+	}
+
+	ACCESS_ONCE(hist_data->paused) = paused;
+	return 0;
+}
+
+static int event_hist_trigger_func(struct event_command *cmd_ops,
+				   struct ftrace_event_file *file,
+				   char *glob, char *cmd, char *param)
+{
+	struct event_trigger_data *trigger_data;
+	struct event_trigger_ops *trigger_ops;
+	struct hist_trigger_attrs *attrs;
+	struct hist_trigger_data *hist_data;
+	char *trigger;
+	int ret;
+
+	if (!param)
+		return -EINVAL;
+
+	/* separate the trigger from the filter (k:v [if filter]) */
+	trigger = strsep(&param, " \t");
+	if (!trigger)
+		return -EINVAL;
+
+	attrs = parse_hist_trigger_attrs(trigger);
+	if (IS_ERR(attrs))
+		return PTR_ERR(attrs);
+
+	trigger_ops = cmd_ops->get_trigger_ops(cmd, trigger);
+
+	if (glob[0] == '!') {
+		struct event_trigger_data test = { .cmd_ops = cmd_ops };
+
+		cmd_ops->unreg(glob + 1, trigger_ops, &test, file);
+		destroy_hist_trigger_attrs(attrs);
+		return 0;
+	}
+
+	trigger_data = find_hist_trigger(file);
+	if (attrs->cont || attrs->clear || (trigger_data && attrs->pause)) {
+		ret = hist_trigger_control(trigger_data, attrs);
+		destroy_hist_trigger_attrs(attrs);
+		return ret;
+	}
+
+	hist_data = create_hist_data(attrs, file);
+	if (IS_ERR(hist_data)) {
+		destroy_hist_trigger_attrs(attrs);
+		return PTR_ERR(hist_data);
+	}
+
+	ret = -ENOMEM;
+	trigger_data = kzalloc(sizeof(*trigger_data), GFP_KERNEL);
+	if (!trigger_data)
+		goto out_free;
+
+	trigger_data->count = -1;
+	trigger_data->ops = trigger_ops;
+	trigger_data->cmd_ops = cmd_ops;
+	trigger_data->private_data = hist_data;
+	INIT_LIST_HEAD(&trigger_data->list);
+
+	if (param) {
+		ret = cmd_ops->set_filter(param, trigger_data, file);
+		if (ret < 0)
+			goto out_free;
+	}
+
+	ret = cmd_ops->reg(glob, trigger_ops, trigger_data, file);
+	/*
+	 * The above returns on success the # of triggers registered,
+	 * but if it didn't register any it returns zero.  Consider no
+	 * triggers registered a failure too.
+	 */
+	if (!ret) {
+		ret = -ENOENT;
+		goto out_free;
+	} else if (ret < 0)
+		goto out_free;
+
+	return 0;
+ out_free:
+	if (trigger_data)
+		cmd_ops->set_filter(NULL, trigger_data, NULL);
+	kfree(trigger_data);
+	destroy_hist_data(hist_data);
+	return ret;
+}
+
+static struct event_command trigger_hist_cmd = {
+	.name			= "hist",
+	.trigger_type		= ETT_EVENT_HIST,
+	.needs_rec		= true,
+	.func			= event_hist_trigger_func,
+	.reg			= register_trigger,
+	.unreg			= unregister_trigger,
+	.get_trigger_ops	= event_hist_get_trigger_ops,
+	.set_filter		= set_trigger_filter,
+};
+
+__init int register_trigger_hist_cmd(void)
+{
+	int ret;
+
+	ret = register_event_command(&trigger_hist_cmd);
+	WARN_ON(ret < 0);
+
+	return ret;
+}
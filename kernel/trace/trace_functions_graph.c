@@ -307,6 +307,18 @@ static inline int ftrace_graph_ignore_irqs(void)
 	return in_irq();
 }
 
+/* Whether the task, set_graph_function and depth filters reject @trace */
+static inline int ftrace_graph_entry_filtered(struct ftrace_graph_ent *trace)
+{
+	if (!ftrace_trace_task(current))
+		return 1;
+
+	/* trace it when it is-nested-in or is a function enabled. */
+	return (!(trace->depth || ftrace_graph_addr(trace->func)) ||
+		ftrace_graph_ignore_irqs()) || (trace->depth < 0) ||
+	       (max_depth && trace->depth >= max_depth);
+}
+
 int trace_graph_entry(struct ftrace_graph_ent *trace)
 {
 	struct trace_array *tr = graph_array;
@@ -317,13 +329,7 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	int cpu;
 	int pc;
 
-	if (!ftrace_trace_task(current))
-		return 0;
-
-	/* trace it when it is-nested-in or is a function enabled. */
-	if ((!(trace->depth || ftrace_graph_addr(trace->func)) ||
-	     ftrace_graph_ignore_irqs()) || (trace->depth < 0) ||
-	    (max_depth && trace->depth >= max_depth))
+	if (ftrace_graph_entry_filtered(trace))
 		return 0;
 
 	/*
@@ -353,12 +359,22 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	return ret;
 }
 
+/*
+ * With tracing_thresh set nothing is written at entry: the call time
+ * stays on the task's return stack and trace_graph_thresh_return()
+ * emits a single return event, only for calls that took at least
+ * tracing_thresh.  The filters still apply here, so that functions
+ * which would not be traced do not cost a return stack entry either.
+ */
 static int trace_graph_thresh_entry(struct ftrace_graph_ent *trace)
 {
-	if (tracing_thresh)
-		return 1;
-	else
+	if (!tracing_thresh)
 		return trace_graph_entry(trace);
+
+	if (ftrace_graph_entry_filtered(trace))
+		return 0;
+
+	return 1;
 }
 
 static void
@@ -46,6 +46,7 @@
 #include <linux/hashtable.h>
 #include <linux/rculist.h>
 #include <linux/nodemask.h>
+#include <linux/topology.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
 
@@ -260,13 +261,45 @@ struct workqueue_struct {
 	/* hot fields used during command issue, aligned to cacheline */
 	unsigned int		flags ____cacheline_aligned; /* WQ: WQ_* flags */
 	struct pool_workqueue __percpu *cpu_pwqs; /* I: per-cpu pwqs */
-	struct pool_workqueue __rcu *numa_pwq_tbl[]; /* FR: unbound pwqs indexed by node */
+	struct pool_workqueue __rcu *unbound_pwq_tbl[]; /* FR: unbound pwqs indexed by cpu */
 };
 
 static struct kmem_cache *pwq_cache;
 
-static cpumask_var_t *wq_numa_possible_cpumask;
-					/* possible CPUs of each node */
+/*
+ * Each affinity scope splits the possible CPUs into pods.  An unbound
+ * workqueue runs a work item on the pwq of the pod of the CPU it was
+ * queued on, so that e.g. with WQ_AFFN_CACHE it stays within the last
+ * level cache of the submitter.
+ */
+struct wq_pod_type {
+	int			nr_pods;	/* number of pods */
+	cpumask_var_t		*pod_cpus;	/* pod -> possible cpus */
+	int			*cpu_pod;	/* cpu -> pod */
+};
+
+static struct wq_pod_type wq_pod_types[WQ_AFFN_NR_TYPES];
+static enum wq_affn_scope wq_affn_dfl = WQ_AFFN_CACHE;	/* PL: default scope */
+
+static const char *wq_affn_names[WQ_AFFN_NR_TYPES] = {
+	[WQ_AFFN_DFL]		= "default",
+	[WQ_AFFN_CPU]		= "cpu",
+	[WQ_AFFN_SMT]		= "smt",
+	[WQ_AFFN_CACHE]		= "cache",
+	[WQ_AFFN_NUMA]		= "numa",
+	[WQ_AFFN_SYSTEM]	= "system",
+};
+
+static int parse_affn_scope(const char *val)
+{
+	int i;
+
+	for (i = 0; i < WQ_AFFN_NR_TYPES; i++) {
+		if (sysfs_streq(val, wq_affn_names[i]))
+			return i;
+	}
+	return -EINVAL;
+}
 
 static bool wq_disable_numa;
 module_param_named(disable_numa, wq_disable_numa, bool, 0444);
@@ -281,9 +314,10 @@ static bool wq_power_efficient;
 module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
+static bool wq_pods_initialized;	/* wq_pod_types[] are set up */
 
-/* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
-static struct workqueue_attrs *wq_update_unbound_numa_attrs_buf;
+/* buf for wq_update_unbound_pod(), protected by CPU hotplug exclusion */
+static struct workqueue_attrs *wq_update_pod_attrs_buf;
 
 static DEFINE_MUTEX(wq_pool_mutex);	/* protects pools and workqueues list */
 static DEFINE_SPINLOCK(wq_mayday_lock);	/* protects wq->maydays list */
@@ -538,21 +572,38 @@ static int worker_pool_assign_id(struct worker_pool *pool)
 }
 
 /**
- * unbound_pwq_by_node - return the unbound pool_workqueue for the given node
+ * unbound_pwq_by_cpu - return the unbound pool_workqueue for the given cpu
  * @wq: the target workqueue
- * @node: the node ID
+ * @cpu: the CPU the work item is queued on
  *
  * This must be called either with pwq_lock held or sched RCU read locked.
  * If the pwq needs to be used beyond the locking in effect, the caller is
  * responsible for guaranteeing that the pwq stays online.
  *
- * Return: The unbound pool_workqueue for @node.
+ * Return: The unbound pool_workqueue of the pod @cpu belongs to.
  */
-static struct pool_workqueue *unbound_pwq_by_node(struct workqueue_struct *wq,
-						  int node)
+static struct pool_workqueue *unbound_pwq_by_cpu(struct workqueue_struct *wq,
+						 int cpu)
 {
 	assert_rcu_or_wq_mutex(wq);
-	return rcu_dereference_raw(wq->numa_pwq_tbl[node]);
+	return rcu_dereference_raw(wq->unbound_pwq_tbl[cpu]);
+}
+
+/*
+ * The pod type @attrs uses.  Until the CPU topology is known, the SMT and
+ * cache scopes fall back to NUMA nodes.  Called with wq_pool_mutex held.
+ */
+static const struct wq_pod_type *wq_pod_type(const struct workqueue_attrs *attrs)
+{
+	enum wq_affn_scope scope = attrs->affn_scope;
+	const struct wq_pod_type *pt;
+
+	if (scope == WQ_AFFN_DFL)
+		scope = wq_affn_dfl;
+	pt = &wq_pod_types[scope];
+	if (!pt->nr_pods)
+		pt = &wq_pod_types[WQ_AFFN_NUMA];
+	return pt;
 }
 
 static unsigned int work_color_to_flags(int color)
@@ -1309,7 +1360,7 @@ retry:
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_cpu(wq, cpu);
 
 	/*
 	 * If @work was previously on a different pool, it might still be
@@ -1339,7 +1390,7 @@ retry:
 	 * pwq is determined and locked.  For unbound pools, we could have
 	 * raced with pwq release and it could already be dead.  If its
 	 * refcnt is zero, repeat pwq selection.  Note that pwqs never die
-	 * without another pwq replacing it in the numa_pwq_tbl or while
+	 * without another pwq replacing it in the unbound_pwq_tbl or while
 	 * work items are executing on it, so the retrying is guaranteed to
 	 * make forward-progress.
 	 */
@@ -3060,13 +3111,13 @@ static ssize_t wq_pool_ids_show(struct device *dev,
 {
 	struct workqueue_struct *wq = dev_to_wq(dev);
 	const char *delim = "";
-	int node, written = 0;
+	int cpu, written = 0;
 
 	rcu_read_lock_sched();
-	for_each_node(node) {
+	for_each_possible_cpu(cpu) {
 		written += scnprintf(buf + written, PAGE_SIZE - written,
-				     "%s%d:%d", delim, node,
-				     unbound_pwq_by_node(wq, node)->pool->id);
+				     "%s%d:%d", delim, cpu,
+				     unbound_pwq_by_cpu(wq, cpu)->pool->id);
 		delim = " ";
 	}
 	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
@@ -3166,7 +3217,7 @@ static ssize_t wq_numa_show(struct device *dev, struct device_attribute *attr,
 
 	mutex_lock(&wq->mutex);
 	written = scnprintf(buf, PAGE_SIZE, "%d\n",
-			    !wq->unbound_attrs->no_numa);
+			    wq->unbound_attrs->affn_scope != WQ_AFFN_SYSTEM);
 	mutex_unlock(&wq->mutex);
 
 	return written;
@@ -3185,7 +3236,7 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 
 	ret = -EINVAL;
 	if (sscanf(buf, "%d", &v) == 1) {
-		attrs->no_numa = !v;
+		attrs->affn_scope = v ? WQ_AFFN_NUMA : WQ_AFFN_SYSTEM;
 		ret = apply_workqueue_attrs(wq, attrs);
 	}
 
@@ -3193,11 +3244,54 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 	return ret ?: count;
 }
 
+static ssize_t wq_affn_scope_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	if (wq->unbound_attrs->affn_scope == WQ_AFFN_DFL)
+		written = scnprintf(buf, PAGE_SIZE, "%s (%s)\n",
+				    wq_affn_names[WQ_AFFN_DFL],
+				    wq_affn_names[wq_affn_dfl]);
+	else
+		written = scnprintf(buf, PAGE_SIZE, "%s\n",
+				    wq_affn_names[wq->unbound_attrs->affn_scope]);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_affn_scope_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int affn, ret;
+
+	affn = parse_affn_scope(buf);
+	if (affn < 0)
+		return affn;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	attrs->affn_scope = affn;
+	ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
+	__ATTR(affinity_scope, 0644, wq_affn_scope_show, wq_affn_scope_store),
 	__ATTR_NULL,
 };
 
@@ -3354,10 +3448,10 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 	cpumask_copy(to->cpumask, from->cpumask);
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
-	 * ->no_numa as it is used for both pool and wq attrs.  Instead,
-	 * get_unbound_pool() explicitly clears ->no_numa after copying.
+	 * ->affn_scope as it is used for both pool and wq attrs.  Instead,
+	 * get_unbound_pool() explicitly clears ->affn_scope after copying.
 	 */
-	to->no_numa = from->no_numa;
+	to->affn_scope = from->affn_scope;
 }
 
 /* hash value of the content of @attr */
@@ -3513,8 +3607,9 @@ static void put_unbound_pool(struct worker_pool *pool)
 static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 {
 	u32 hash = wqattrs_hash(attrs);
+	const struct wq_pod_type *pt = &wq_pod_types[WQ_AFFN_NUMA];
 	struct worker_pool *pool;
-	int node;
+	int pod;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
@@ -3535,17 +3630,17 @@ static struct worker_pool *get_unbound_pool(const struct workqueue_attrs *attrs)
 	copy_workqueue_attrs(pool->attrs, attrs);
 
 	/*
-	 * no_numa isn't a worker_pool attribute, always clear it.  See
+	 * affn_scope isn't a worker_pool attribute, always clear it.  See
 	 * 'struct workqueue_attrs' comments for detail.
 	 */
-	pool->attrs->no_numa = false;
+	pool->attrs->affn_scope = WQ_AFFN_DFL;
 
 	/* if cpumask is contained inside a NUMA node, we belong to that node */
 	if (wq_numa_enabled) {
-		for_each_node(node) {
+		for (pod = 0; pod < pt->nr_pods; pod++) {
 			if (cpumask_subset(pool->attrs->cpumask,
-					   wq_numa_possible_cpumask[node])) {
-				pool->node = node;
+					   pt->pod_cpus[pod])) {
+				pool->node = cpu_to_node(cpumask_first(pt->pod_cpus[pod]));
 				break;
 			}
 		}
@@ -3730,43 +3825,42 @@ static void free_unbound_pwq(struct pool_workqueue *pwq)
 }
 
 /**
- * wq_calc_node_mask - calculate a wq_attrs' cpumask for the specified node
+ * wq_calc_pod_cpumask - calculate a wq_attrs' cpumask for the specified pod
  * @attrs: the wq_attrs of interest
- * @node: the target NUMA node
+ * @pod: the target pod of the pod type of @attrs
  * @cpu_going_down: if >= 0, the CPU to consider as offline
  * @cpumask: outarg, the resulting cpumask
  *
- * Calculate the cpumask a workqueue with @attrs should use on @node.  If
+ * Calculate the cpumask a workqueue with @attrs should use on @pod.  If
  * @cpu_going_down is >= 0, that cpu is considered offline during
  * calculation.  The result is stored in @cpumask.
  *
- * If NUMA affinity is not enabled, @attrs->cpumask is always used.  If
- * enabled and @node has online CPUs requested by @attrs, the returned
- * cpumask is the intersection of the possible CPUs of @node and
- * @attrs->cpumask.
+ * If @pod has online CPUs requested by @attrs, the returned cpumask is
+ * the intersection of the possible CPUs of @pod and @attrs->cpumask.
+ * Otherwise, and always for the system scope, @attrs->cpumask is used.
  *
- * The caller is responsible for ensuring that the cpumask of @node stays
+ * The caller is responsible for ensuring that the cpumask of @pod stays
  * stable.
  *
  * Return: %true if the resulting @cpumask is different from @attrs->cpumask,
  * %false if equal.
  */
-static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs, int node,
-				 int cpu_going_down, cpumask_t *cpumask)
+static bool wq_calc_pod_cpumask(const struct workqueue_attrs *attrs, int pod,
+				int cpu_going_down, cpumask_t *cpumask)
 {
-	if (!wq_numa_enabled || attrs->no_numa)
-		goto use_dfl;
+	const struct wq_pod_type *pt = wq_pod_type(attrs);
 
-	/* does @node have any online CPUs @attrs wants? */
-	cpumask_and(cpumask, cpumask_of_node(node), attrs->cpumask);
+	/* does @pod have any online CPUs @attrs wants? */
+	cpumask_and(cpumask, pt->pod_cpus[pod], attrs->cpumask);
+	cpumask_and(cpumask, cpumask, cpu_online_mask);
 	if (cpu_going_down >= 0)
 		cpumask_clear_cpu(cpu_going_down, cpumask);
 
 	if (cpumask_empty(cpumask))
 		goto use_dfl;
 
-	/* yeap, return possible CPUs in @node that @attrs wants */
-	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
+	/* yeap, return possible CPUs in @pod that @attrs wants */
+	cpumask_and(cpumask, attrs->cpumask, pt->pod_cpus[pod]);
 	return !cpumask_equal(cpumask, attrs->cpumask);
 
 use_dfl:
@@ -3774,10 +3868,10 @@ use_dfl:
 	return false;
 }
 
-/* install @pwq into @wq's numa_pwq_tbl[] for @node and return the old pwq */
-static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
-						   int node,
-						   struct pool_workqueue *pwq)
+/* install @pwq into @wq's unbound_pwq_tbl[] for @cpu and return the old pwq */
+static struct pool_workqueue *unbound_pwq_tbl_install(struct workqueue_struct *wq,
+						      int cpu,
+						      struct pool_workqueue *pwq)
 {
 	struct pool_workqueue *old_pwq;
 
@@ -3786,8 +3880,8 @@ static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
 	/* link_pwq() can handle duplicate calls */
 	link_pwq(pwq);
 
-	old_pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-	rcu_assign_pointer(wq->numa_pwq_tbl[node], pwq);
+	old_pwq = rcu_access_pointer(wq->unbound_pwq_tbl[cpu]);
+	rcu_assign_pointer(wq->unbound_pwq_tbl[cpu], pwq);
 	return old_pwq;
 }
 
@@ -3796,12 +3890,12 @@ static struct pool_workqueue *numa_pwq_tbl_install(struct workqueue_struct *wq,
  * @wq: the target workqueue
  * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
  *
- * Apply @attrs to an unbound workqueue @wq.  Unless disabled, on NUMA
- * machines, this function maps a separate pwq to each NUMA node with
- * possibles CPUs in @attrs->cpumask so that work items are affine to the
- * NUMA node it was issued on.  Older pwqs are released as in-flight work
- * items finish.  Note that a work item which repeatedly requeues itself
- * back-to-back will stay on its current pwq.
+ * Apply @attrs to an unbound workqueue @wq.  This function maps a separate
+ * pwq to each pod of @attrs->affn_scope with possible CPUs in
+ * @attrs->cpumask so that work items are affine to the pod they were
+ * issued on; all CPUs of a pod share its pwq.  Older pwqs are released as
+ * in-flight work items finish.  Note that a work item which repeatedly
+ * requeues itself back-to-back will stay on its current pwq.
  *
  * Performs GFP_KERNEL allocations.
  *
@@ -3812,7 +3906,8 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 {
 	struct workqueue_attrs *new_attrs, *tmp_attrs;
 	struct pool_workqueue **pwq_tbl, *dfl_pwq;
-	int node, ret;
+	const struct wq_pod_type *pt;
+	int cpu, ret;
 
 	/* only unbound workqueues can change attributes */
 	if (WARN_ON(!(wq->flags & WQ_UNBOUND)))
@@ -3822,7 +3917,7 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 	if (WARN_ON((wq->flags & __WQ_ORDERED) && !list_empty(&wq->pwqs)))
 		return -EINVAL;
 
-	pwq_tbl = kzalloc(nr_node_ids * sizeof(pwq_tbl[0]), GFP_KERNEL);
+	pwq_tbl = kzalloc(nr_cpu_ids * sizeof(pwq_tbl[0]), GFP_KERNEL);
 	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
 	tmp_attrs = alloc_workqueue_attrs(GFP_KERNEL);
 	if (!pwq_tbl || !new_attrs || !tmp_attrs)
@@ -3841,12 +3936,13 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 
 	/*
 	 * CPUs should stay stable across pwq creations and installations.
-	 * Pin CPUs, determine the target cpumask for each node and create
+	 * Pin CPUs, determine the target cpumask for each pod and create
 	 * pwqs accordingly.
 	 */
 	get_online_cpus();
 
 	mutex_lock(&wq_pool_mutex);
+	pt = wq_pod_type(new_attrs);
 
 	/*
 	 * If something goes wrong during CPU up/down, we'll fall back to
@@ -3857,14 +3953,25 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 	if (!dfl_pwq)
 		goto enomem_pwq;
 
-	for_each_node(node) {
-		if (wq_calc_node_cpumask(attrs, node, -1, tmp_attrs->cpumask)) {
-			pwq_tbl[node] = alloc_unbound_pwq(wq, tmp_attrs);
-			if (!pwq_tbl[node])
+	/*
+	 * One pwq per pod, created for the first CPU of the pod and shared
+	 * by the others.  Every table slot holds a reference.
+	 */
+	for_each_possible_cpu(cpu) {
+		int pod = pt->cpu_pod[cpu];
+		int first = cpumask_first(pt->pod_cpus[pod]);
+
+		if (cpu != first) {
+			pwq_tbl[cpu] = pwq_tbl[first];
+			pwq_tbl[cpu]->refcnt++;
+		} else if (wq_calc_pod_cpumask(new_attrs, pod, -1,
+					       tmp_attrs->cpumask)) {
+			pwq_tbl[cpu] = alloc_unbound_pwq(wq, tmp_attrs);
+			if (!pwq_tbl[cpu])
 				goto enomem_pwq;
 		} else {
 			dfl_pwq->refcnt++;
-			pwq_tbl[node] = dfl_pwq;
+			pwq_tbl[cpu] = dfl_pwq;
 		}
 	}
 
@@ -3876,8 +3983,8 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 	copy_workqueue_attrs(wq->unbound_attrs, new_attrs);
 
 	/* save the previous pwq and install the new one */
-	for_each_node(node)
-		pwq_tbl[node] = numa_pwq_tbl_install(wq, node, pwq_tbl[node]);
+	for_each_possible_cpu(cpu)
+		pwq_tbl[cpu] = unbound_pwq_tbl_install(wq, cpu, pwq_tbl[cpu]);
 
 	/* @dfl_pwq might not have been used, ensure it's linked */
 	link_pwq(dfl_pwq);
@@ -3886,8 +3993,8 @@ int apply_workqueue_attrs(struct workqueue_struct *wq,
 	mutex_unlock(&wq->mutex);
 
 	/* put the old pwqs */
-	for_each_node(node)
-		put_pwq_unlocked(pwq_tbl[node]);
+	for_each_possible_cpu(cpu)
+		put_pwq_unlocked(pwq_tbl[cpu]);
 	put_pwq_unlocked(dfl_pwq);
 
 	put_online_cpus();
@@ -3901,9 +4008,12 @@ out_free:
 
 enomem_pwq:
 	free_unbound_pwq(dfl_pwq);
-	for_each_node(node)
-		if (pwq_tbl && pwq_tbl[node] != dfl_pwq)
-			free_unbound_pwq(pwq_tbl[node]);
+	for_each_possible_cpu(cpu) {
+		/* shared pwqs are freed through the first CPU of their pod */
+		if (pwq_tbl && pwq_tbl[cpu] != dfl_pwq &&
+		    cpu == cpumask_first(pt->pod_cpus[pt->cpu_pod[cpu]]))
+			free_unbound_pwq(pwq_tbl[cpu]);
+	}
 	mutex_unlock(&wq_pool_mutex);
 	put_online_cpus();
 enomem:
@@ -3912,39 +4022,41 @@ enomem:
 }
 
 /**
- * wq_update_unbound_numa - update NUMA affinity of a wq for CPU hot[un]plug
+ * wq_update_unbound_pod - update the pwq of a CPU of an unbound wq
  * @wq: the target workqueue
- * @cpu: the CPU coming up or going down
- * @online: whether @cpu is coming up or going down
+ * @cpu: the CPU whose pwq to update
+ * @cpu_going_down: if >= 0, the CPU to consider as offline
  *
- * This function is to be called from %CPU_DOWN_PREPARE, %CPU_ONLINE and
- * %CPU_DOWN_FAILED.  @cpu is being hot[un]plugged, update NUMA affinity of
- * @wq accordingly.
+ * Recalculate the cpumask of the pod @cpu belongs to in @wq's affinity
+ * scope and install a matching pwq for @cpu, reusing the one of another
+ * CPU of the pod if there is one.  Called on CPU hot[un]plug for all
+ * CPUs of the pod of the CPU coming up or going down, and for all CPUs
+ * when the pods or the default scope change.  Must be called with CPU
+ * hotplug excluded and wq_pool_mutex held.
  *
- * If NUMA affinity can't be adjusted due to memory allocation failure, it
- * falls back to @wq->dfl_pwq which may not be optimal but is always
- * correct.
+ * If the pod's pwq can't be allocated, it falls back to @wq->dfl_pwq
+ * which may not be optimal but is always correct.
  *
- * Note that when the last allowed CPU of a NUMA node goes offline for a
- * workqueue with a cpumask spanning multiple nodes, the workers which were
+ * Note that when the last allowed CPU of a pod goes offline for a
+ * workqueue with a cpumask spanning multiple pods, the workers which were
  * already executing the work items for the workqueue will lose their CPU
  * affinity and may execute on any CPU.  This is similar to how per-cpu
  * workqueues behave on CPU_DOWN.  If a workqueue user wants strict
  * affinity, it's the user's responsibility to flush the work item from
  * CPU_DOWN_PREPARE.
  */
-static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
-				   bool online)
+static void wq_update_unbound_pod(struct workqueue_struct *wq, int cpu,
+				  int cpu_going_down)
 {
-	int node = cpu_to_node(cpu);
-	int cpu_off = online ? -1 : cpu;
+	const struct wq_pod_type *pt;
 	struct pool_workqueue *old_pwq = NULL, *pwq;
 	struct workqueue_attrs *target_attrs;
 	cpumask_t *cpumask;
+	int pod, tcpu;
 
 	lockdep_assert_held(&wq_pool_mutex);
 
-	if (!wq_numa_enabled || !(wq->flags & WQ_UNBOUND))
+	if (!(wq->flags & WQ_UNBOUND))
 		return;
 
 	/*
@@ -3952,15 +4064,14 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	 * Let's use a preallocated one.  The following buf is protected by
 	 * CPU hotplug exclusion.
 	 */
-	target_attrs = wq_update_unbound_numa_attrs_buf;
+	target_attrs = wq_update_pod_attrs_buf;
 	cpumask = target_attrs->cpumask;
 
 	mutex_lock(&wq->mutex);
-	if (wq->unbound_attrs->no_numa)
-		goto out_unlock;
-
 	copy_workqueue_attrs(target_attrs, wq->unbound_attrs);
-	pwq = unbound_pwq_by_node(wq, node);
+	pt = wq_pod_type(wq->unbound_attrs);
+	pod = pt->cpu_pod[cpu];
+	pwq = unbound_pwq_by_cpu(wq, cpu);
 
 	/*
 	 * Let's determine what needs to be done.  If the target cpumask is
@@ -3968,44 +4079,88 @@ static void wq_update_unbound_numa(struct workqueue_struct *wq, int cpu,
 	 * a new one if they don't match.  If the target cpumask equals
 	 * wq's, the default pwq should be used.
 	 */
-	if (wq_calc_node_cpumask(wq->unbound_attrs, node, cpu_off, cpumask)) {
+	if (wq_calc_pod_cpumask(wq->unbound_attrs, pod, cpu_going_down,
+				cpumask)) {
 		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask))
 			goto out_unlock;
 	} else {
+		if (pwq == wq->dfl_pwq)
+			goto out_unlock;
 		goto use_dfl_pwq;
 	}
 
+	/* another CPU of the pod may already have been switched over */
+	for_each_cpu(tcpu, pt->pod_cpus[pod]) {
+		pwq = unbound_pwq_by_cpu(wq, tcpu);
+		if (cpumask_equal(cpumask, pwq->pool->attrs->cpumask)) {
+			spin_lock_irq(&pwq->pool->lock);
+			get_pwq(pwq);
+			spin_unlock_irq(&pwq->pool->lock);
+			goto install;
+		}
+	}
+
 	mutex_unlock(&wq->mutex);
 
 	/* create a new pwq */
 	pwq = alloc_unbound_pwq(wq, target_attrs);
 	if (!pwq) {
-		pr_warn("workqueue: allocation failed while updating NUMA affinity of \"%s\"\n",
+		pr_warn("workqueue: allocation failed while updating affinity of \"%s\"\n",
 			wq->name);
 		mutex_lock(&wq->mutex);
 		goto use_dfl_pwq;
 	}
 
 	/*
-	 * Install the new pwq.  As this function is called only from CPU
-	 * hotplug callbacks and applying a new attrs is wrapped with
+	 * Install the new pwq.  As this function is called only with CPU
+	 * hotplug excluded and applying a new attrs is wrapped with
 	 * get/put_online_cpus(), @wq->unbound_attrs couldn't have changed
 	 * inbetween.
 	 */
 	mutex_lock(&wq->mutex);
-	old_pwq = numa_pwq_tbl_install(wq, node, pwq);
+install:
+	old_pwq = unbound_pwq_tbl_install(wq, cpu, pwq);
 	goto out_unlock;
 
 use_dfl_pwq:
 	spin_lock_irq(&wq->dfl_pwq->pool->lock);
 	get_pwq(wq->dfl_pwq);
 	spin_unlock_irq(&wq->dfl_pwq->pool->lock);
-	old_pwq = numa_pwq_tbl_install(wq, node, wq->dfl_pwq);
+	old_pwq = unbound_pwq_tbl_install(wq, cpu, wq->dfl_pwq);
 out_unlock:
 	mutex_unlock(&wq->mutex);
 	put_pwq_unlocked(old_pwq);
 }
 
+/* @cpu is coming up or going down, update the pwqs of its pod in @wq */
+static void wq_update_unbound_pods(struct workqueue_struct *wq, int cpu,
+				   bool online)
+{
+	const struct wq_pod_type *pt;
+	int tcpu;
+
+	if (!(wq->flags & WQ_UNBOUND))
+		return;
+
+	/* ->unbound_attrs is stable, see wq_update_unbound_pod() */
+	pt = wq_pod_type(wq->unbound_attrs);
+	for_each_cpu(tcpu, pt->pod_cpus[pt->cpu_pod[cpu]])
+		wq_update_unbound_pod(wq, tcpu, online ? -1 : cpu);
+}
+
+/* Repick the pwqs of all unbound wqs after their pods changed. */
+static void wq_update_all_unbound_pods(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	list_for_each_entry(wq, &workqueues, list)
+		for_each_possible_cpu(cpu)
+			wq_update_unbound_pod(wq, cpu, -1);
+}
+
 static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 {
 	bool highpri = wq->flags & WQ_HIGHPRI;
@@ -4070,7 +4225,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
-		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
+		tbl_size = nr_cpu_ids * sizeof(wq->unbound_pwq_tbl[0]);
 
 	wq = kzalloc(sizeof(*wq) + tbl_size, GFP_KERNEL);
 	if (!wq)
@@ -4169,7 +4324,7 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
 void destroy_workqueue(struct workqueue_struct *wq)
 {
 	struct pool_workqueue *pwq;
-	int node;
+	int cpu;
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
@@ -4221,12 +4376,12 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	} else {
 		/*
 		 * We're the sole accessor of @wq at this point.  Directly
-		 * access numa_pwq_tbl[] and dfl_pwq to put the base refs.
+		 * access unbound_pwq_tbl[] and dfl_pwq to put the base refs.
 		 * @wq will be freed when the last pwq is released.
 		 */
-		for_each_node(node) {
-			pwq = rcu_access_pointer(wq->numa_pwq_tbl[node]);
-			RCU_INIT_POINTER(wq->numa_pwq_tbl[node], NULL);
+		for_each_possible_cpu(cpu) {
+			pwq = rcu_access_pointer(wq->unbound_pwq_tbl[cpu]);
+			RCU_INIT_POINTER(wq->unbound_pwq_tbl[cpu], NULL);
 			put_pwq_unlocked(pwq);
 		}
 
@@ -4318,7 +4473,7 @@ bool workqueue_congested(int cpu, struct workqueue_struct *wq)
 	if (!(wq->flags & WQ_UNBOUND))
 		pwq = per_cpu_ptr(wq->cpu_pwqs, cpu);
 	else
-		pwq = unbound_pwq_by_node(wq, cpu_to_node(cpu));
+		pwq = unbound_pwq_by_cpu(wq, cpu);
 
 	ret = !list_empty(&pwq->delayed_works);
 	rcu_read_unlock_sched();
@@ -4641,9 +4796,9 @@ static int workqueue_cpu_up_callback(struct notifier_block *nfb,
 			mutex_unlock(&pool->attach_mutex);
 		}
 
-		/* update NUMA affinity of unbound workqueues */
+		/* update pod affinity of unbound workqueues */
 		list_for_each_entry(wq, &workqueues, list)
-			wq_update_unbound_numa(wq, cpu, true);
+			wq_update_unbound_pods(wq, cpu, true);
 
 		mutex_unlock(&wq_pool_mutex);
 		break;
@@ -4669,10 +4824,10 @@ static int workqueue_cpu_down_callback(struct notifier_block *nfb,
 		INIT_WORK_ONSTACK(&unbind_work, wq_unbind_fn);
 		queue_work_on(cpu, system_highpri_wq, &unbind_work);
 
-		/* update NUMA affinity of unbound workqueues */
+		/* update pod affinity of unbound workqueues */
 		mutex_lock(&wq_pool_mutex);
 		list_for_each_entry(wq, &workqueues, list)
-			wq_update_unbound_numa(wq, cpu, false);
+			wq_update_unbound_pods(wq, cpu, false);
 		mutex_unlock(&wq_pool_mutex);
 
 		/* wait for per-cpu unbinding to finish */
@@ -4835,48 +4990,148 @@ out_unlock:
 }
 #endif /* CONFIG_FREEZER */
 
-static void __init wq_numa_init(void)
+static bool __init cpus_dont_share(int cpu0, int cpu1)
 {
-	cpumask_var_t *tbl;
-	int node, cpu;
+	return false;
+}
 
-	if (num_possible_nodes() <= 1)
-		return;
+static bool __init cpus_share_smt(int cpu0, int cpu1)
+{
+	return cpumask_test_cpu(cpu1, topology_thread_cpumask(cpu0));
+}
 
-	if (wq_disable_numa) {
-		pr_info("workqueue: NUMA affinity support disabled\n");
-		return;
+static bool __init cpus_share_cache(int cpu0, int cpu1)
+{
+#ifdef CONFIG_SCHED_MC
+	return cpumask_test_cpu(cpu1, cpu_coregroup_mask(cpu0));
+#else
+	return cpu_to_node(cpu0) == cpu_to_node(cpu1);
+#endif
+}
+
+static bool __init cpus_share_numa(int cpu0, int cpu1)
+{
+	return cpu_to_node(cpu0) == cpu_to_node(cpu1);
+}
+
+static bool __init cpus_share_system(int cpu0, int cpu1)
+{
+	return true;
+}
+
+/*
+ * Split the possible CPUs into pods: a CPU joins the first pod whose
+ * first CPU it shares with according to @cpus_share_pod.
+ */
+static void __init init_pod_type(struct wq_pod_type *pt,
+				 bool (*cpus_share_pod)(int, int))
+{
+	int cpu, pod;
+
+	pt->cpu_pod = kcalloc(nr_cpu_ids, sizeof(pt->cpu_pod[0]), GFP_KERNEL);
+	pt->pod_cpus = kcalloc(nr_cpu_ids, sizeof(pt->pod_cpus[0]), GFP_KERNEL);
+	BUG_ON(!pt->cpu_pod || !pt->pod_cpus);
+
+	for_each_possible_cpu(cpu) {
+		for (pod = 0; pod < pt->nr_pods; pod++)
+			if (cpus_share_pod(cpumask_first(pt->pod_cpus[pod]), cpu))
+				break;
+		if (pod == pt->nr_pods) {
+			BUG_ON(!zalloc_cpumask_var(&pt->pod_cpus[pod], GFP_KERNEL));
+			pt->nr_pods++;
+		}
+		cpumask_set_cpu(cpu, pt->pod_cpus[pod]);
+		pt->cpu_pod[cpu] = pod;
 	}
+}
 
-	wq_update_unbound_numa_attrs_buf = alloc_workqueue_attrs(GFP_KERNEL);
-	BUG_ON(!wq_update_unbound_numa_attrs_buf);
+/*
+ * The CPU, NUMA and system pods are known this early.  SMT and cache
+ * pods need the CPU topology, see wq_pod_topology_init().
+ */
+static void __init wq_pod_init(void)
+{
+	int cpu;
 
-	/*
-	 * We want masks of possible CPUs of each node which isn't readily
-	 * available.  Build one from cpu_to_node() which should have been
-	 * fully initialized by now.
-	 */
-	tbl = kzalloc(nr_node_ids * sizeof(tbl[0]), GFP_KERNEL);
-	BUG_ON(!tbl);
+	wq_update_pod_attrs_buf = alloc_workqueue_attrs(GFP_KERNEL);
+	BUG_ON(!wq_update_pod_attrs_buf);
 
-	for_each_node(node)
-		BUG_ON(!zalloc_cpumask_var_node(&tbl[node], GFP_KERNEL,
-				node_online(node) ? node : NUMA_NO_NODE));
+	wq_numa_enabled = num_possible_nodes() > 1;
+	if (wq_numa_enabled && wq_disable_numa) {
+		pr_info("workqueue: NUMA affinity support disabled\n");
+		wq_numa_enabled = false;
+	}
 
 	for_each_possible_cpu(cpu) {
-		node = cpu_to_node(cpu);
-		if (WARN_ON(node == NUMA_NO_NODE)) {
+		if (wq_numa_enabled && WARN_ON(cpu_to_node(cpu) == NUMA_NO_NODE)) {
 			pr_warn("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n", cpu);
 			/* happens iff arch is bonkers, let's just proceed */
-			return;
+			wq_numa_enabled = false;
 		}
-		cpumask_set_cpu(cpu, tbl[node]);
 	}
 
-	wq_numa_possible_cpumask = tbl;
-	wq_numa_enabled = true;
+	init_pod_type(&wq_pod_types[WQ_AFFN_CPU], cpus_dont_share);
+	init_pod_type(&wq_pod_types[WQ_AFFN_NUMA], wq_numa_enabled ?
+		      cpus_share_numa : cpus_share_system);
+	init_pod_type(&wq_pod_types[WQ_AFFN_SYSTEM], cpus_share_system);
+	wq_pods_initialized = true;
+}
+
+/*
+ * Once the secondary CPUs are up their topology is known.  Build the
+ * SMT and cache pods and move the unbound workqueues created so far
+ * over to them.  CPUs which come up for the first time later on form
+ * pods of their own in those scopes.
+ */
+static int __init wq_pod_topology_init(void)
+{
+	get_online_cpus();
+	mutex_lock(&wq_pool_mutex);
+	init_pod_type(&wq_pod_types[WQ_AFFN_SMT], cpus_share_smt);
+	init_pod_type(&wq_pod_types[WQ_AFFN_CACHE], cpus_share_cache);
+	wq_update_all_unbound_pods();
+	mutex_unlock(&wq_pool_mutex);
+	put_online_cpus();
+	return 0;
+}
+core_initcall(wq_pod_topology_init);
+
+static int wq_affn_dfl_set(const char *val, const struct kernel_param *kp)
+{
+	int affn;
+
+	affn = parse_affn_scope(val);
+	if (affn < 0)
+		return affn;
+	if (affn == WQ_AFFN_DFL)
+		return -EINVAL;
+
+	if (!wq_pods_initialized) {
+		wq_affn_dfl = affn;
+		return 0;
+	}
+
+	get_online_cpus();
+	mutex_lock(&wq_pool_mutex);
+	wq_affn_dfl = affn;
+	wq_update_all_unbound_pods();
+	mutex_unlock(&wq_pool_mutex);
+	put_online_cpus();
+	return 0;
+}
+
+static int wq_affn_dfl_get(char *buffer, const struct kernel_param *kp)
+{
+	return scnprintf(buffer, PAGE_SIZE, "%s", wq_affn_names[wq_affn_dfl]);
 }
 
+static struct kernel_param_ops wq_affn_dfl_ops = {
+	.set	= wq_affn_dfl_set,
+	.get	= wq_affn_dfl_get,
+};
+
+module_param_cb(default_affinity_scope, &wq_affn_dfl_ops, NULL, 0644);
+
 static int __init init_workqueues(void)
 {
 	int std_nice[NR_STD_WORKER_POOLS] = { 0, HIGHPRI_NICE_LEVEL };
@@ -4889,7 +5144,7 @@ static int __init init_workqueues(void)
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	hotcpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
-	wq_numa_init();
+	wq_pod_init();
 
 	/* initialize CPU pools */
 	for_each_possible_cpu(cpu) {
@@ -4931,11 +5186,11 @@ static int __init init_workqueues(void)
 		/*
 		 * An ordered wq should have only one pwq as ordering is
 		 * guaranteed by max_active which is enforced by pwqs.
-		 * Turn off NUMA so that dfl_pwq is used for all nodes.
+		 * Use the system scope so that dfl_pwq is used for all CPUs.
 		 */
 		BUG_ON(!(attrs = alloc_workqueue_attrs(GFP_KERNEL)));
 		attrs->nice = std_nice[i];
-		attrs->no_numa = true;
+		attrs->affn_scope = WQ_AFFN_SYSTEM;
 		ordered_wq_attrs[i] = attrs;
 	}
 
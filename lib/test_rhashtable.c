@@ -0,0 +1,403 @@
+/*
+ * Resizable, Scalable, Concurrent Hash Table
+ *
+ * Copyright (c) 2014 Thomas Graf <tgraf@suug.ch>
+ * Copyright (c) 2008-2014 Patrick McHardy <kaber@trash.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/**************************************************************************
+ * Self Test
+ **************************************************************************/
+
+#include <linux/init.h>
+#include <linux/jhash.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/rcupdate.h>
+#include <linux/rhashtable.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#define TEST_HT_SIZE	8
+#define TEST_ENTRIES	2048
+#define TEST_PTR	((void *) 0xdeadbeef)
+#define TEST_NEXPANDS	4
+
+static int tcount = 10;
+module_param(tcount, int, 0);
+MODULE_PARM_DESC(tcount, "Number of concurrent inserting threads (default: 10)");
+
+static int entries = 50000;
+module_param(entries, int, 0);
+MODULE_PARM_DESC(entries, "Number of entries inserted per thread (default: 50000)");
+
+struct test_obj {
+	void			*ptr;
+	int			value;
+	struct rhash_head	node;
+};
+
+struct thread_data {
+	int			id;
+	struct task_struct	*task;
+	struct test_obj		*objs;
+	u64			insert_ns;
+};
+
+static struct rhashtable ht;
+
+static atomic_t startup_count;
+static DECLARE_WAIT_QUEUE_HEAD(startup_wait);
+
+static struct rhashtable_params test_rht_params = {
+	.nelem_hint = TEST_HT_SIZE,
+	.head_offset = offsetof(struct test_obj, node),
+	.key_offset = offsetof(struct test_obj, value),
+	.key_len = sizeof(int),
+	.hashfn = jhash,
+	.grow_decision = rht_grow_above_75,
+	.shrink_decision = rht_shrink_below_30,
+};
+
+static int __init test_rht_lookup(struct rhashtable *ht)
+{
+	unsigned int i;
+
+	for (i = 0; i < TEST_ENTRIES * 2; i++) {
+		struct test_obj *obj;
+		bool expected = !(i % 2);
+		u32 key = i;
+
+		obj = rhashtable_lookup(ht, &key);
+
+		if (expected && !obj) {
+			pr_warn("Test failed: Could not find key %u\n", key);
+			return -ENOENT;
+		} else if (!expected && obj) {
+			pr_warn("Test failed: Unexpected entry found for key %u\n",
+				key);
+			return -EEXIST;
+		} else if (expected && obj) {
+			if (obj->ptr != TEST_PTR || obj->value != i) {
+				pr_warn("Test failed: Lookup value mismatch %p!=%p, %u!=%u\n",
+					obj->ptr, TEST_PTR, obj->value, i);
+				return -EINVAL;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void test_bucket_stats(struct rhashtable *ht, bool quiet)
+{
+	unsigned int cnt, rcu_cnt, i, total = 0;
+	struct test_obj *obj;
+	struct bucket_table *tbl;
+
+	tbl = rht_dereference_rcu(ht->tbl, ht);
+	for (i = 0; i < tbl->size; i++) {
+		rcu_cnt = cnt = 0;
+
+		if (!quiet)
+			pr_info(" [%#4x/%zu]", i, tbl->size);
+
+		rht_for_each_entry_rcu(obj, tbl->buckets[i], node) {
+			cnt++;
+			total++;
+			if (!quiet)
+				pr_cont(" [%p],", obj);
+		}
+
+		rht_for_each_entry_rcu(obj, tbl->buckets[i], node)
+			rcu_cnt++;
+
+		if (rcu_cnt != cnt)
+			pr_warn("Test failed: Chain count mismach %d != %d",
+				cnt, rcu_cnt);
+
+		if (!quiet)
+			pr_cont("\n  [%#x] first element: %p, chain length: %u\n",
+				i, tbl->buckets[i], cnt);
+	}
+
+	pr_info("  Traversal complete: counted=%u, nelems=%u, entries=%d\n",
+		total, atomic_read(&ht->nelems), TEST_ENTRIES);
+
+	if (total != atomic_read(&ht->nelems) || total != TEST_ENTRIES)
+		pr_warn("Test failed: Total count mismatch ^^^");
+}
+
+static int __init test_rhashtable(struct rhashtable *ht)
+{
+	struct bucket_table *tbl;
+	struct test_obj *obj, *next;
+	int err;
+	unsigned int i;
+
+	/*
+	 * Insertion Test:
+	 * Insert TEST_ENTRIES into table with all keys even numbers
+	 */
+	pr_info("  Adding %d keys\n", TEST_ENTRIES);
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		struct test_obj *obj;
+
+		obj = kzalloc(sizeof(*obj), GFP_KERNEL);
+		if (!obj) {
+			err = -ENOMEM;
+			goto error;
+		}
+
+		obj->ptr = TEST_PTR;
+		obj->value = i * 2;
+
+		rhashtable_insert(ht, &obj->node);
+	}
+
+	/* Keep the deferred resize from moving entries while counting */
+	mutex_lock(&ht->mutex);
+	rcu_read_lock();
+	test_bucket_stats(ht, true);
+	test_rht_lookup(ht);
+	rcu_read_unlock();
+	mutex_unlock(&ht->mutex);
+
+	for (i = 0; i < TEST_NEXPANDS; i++) {
+		pr_info("  Table expansion iteration %u...\n", i);
+		mutex_lock(&ht->mutex);
+		rhashtable_expand(ht);
+		mutex_unlock(&ht->mutex);
+
+		rcu_read_lock();
+		pr_info("  Verifying lookups...\n");
+		test_rht_lookup(ht);
+		rcu_read_unlock();
+	}
+
+	for (i = 0; i < TEST_NEXPANDS; i++) {
+		pr_info("  Table shrinkage iteration %u...\n", i);
+		mutex_lock(&ht->mutex);
+		rhashtable_shrink(ht);
+		mutex_unlock(&ht->mutex);
+
+		rcu_read_lock();
+		pr_info("  Verifying lookups...\n");
+		test_rht_lookup(ht);
+		rcu_read_unlock();
+	}
+
+	mutex_lock(&ht->mutex);
+	rcu_read_lock();
+	test_bucket_stats(ht, true);
+	rcu_read_unlock();
+	mutex_unlock(&ht->mutex);
+
+	pr_info("  Deleting %d keys\n", TEST_ENTRIES);
+	for (i = 0; i < TEST_ENTRIES; i++) {
+		u32 key = i * 2;
+
+		obj = rhashtable_lookup(ht, &key);
+		BUG_ON(!obj);
+
+		rhashtable_remove(ht, &obj->node);
+		kfree(obj);
+	}
+
+	return 0;
+
+error:
+	mutex_lock(&ht->mutex);
+	tbl = rht_dereference(ht->tbl, ht);
+	for (i = 0; i < tbl->size; i++)
+		rht_for_each_entry_safe(obj, next, tbl->buckets[i], ht, node)
+			kfree(obj);
+	mutex_unlock(&ht->mutex);
+
+	return err;
+}
+
+static int thread_lookup_test(struct thread_data *tdata)
+{
+	int i, err = 0;
+
+	for (i = 0; i < entries; i++) {
+		struct test_obj *obj;
+		int key = tdata->objs[i].value;
+
+		obj = rhashtable_lookup(&ht, &key);
+		if (obj != &tdata->objs[i]) {
+			pr_err("  thread[%d]: rhashtable_lookup(%d) returned %p, expected %p\n",
+			       tdata->id, key, obj, &tdata->objs[i]);
+			err++;
+		}
+	}
+
+	return err;
+}
+
+static int threadfunc(void *data)
+{
+	struct thread_data *tdata = data;
+	ktime_t start;
+	int i, err;
+
+	if (atomic_dec_and_test(&startup_count))
+		wake_up(&startup_wait);
+	wait_event(startup_wait, atomic_read(&startup_count) == -1);
+
+	start = ktime_get();
+	for (i = 0; i < entries; i++) {
+		tdata->objs[i].value = tdata->id * entries + i;
+		rhashtable_insert(&ht, &tdata->objs[i].node);
+	}
+	tdata->insert_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	err = thread_lookup_test(tdata);
+	if (err) {
+		pr_err("  thread[%d]: lookup test failed\n", tdata->id);
+		goto out;
+	}
+
+	for (i = 0; i < entries; i++) {
+		if (!rhashtable_remove(&ht, &tdata->objs[i].node)) {
+			pr_err("  thread[%d]: rhashtable_remove(%d) failed\n",
+			       tdata->id, tdata->objs[i].value);
+			err = -ENOENT;
+			goto out;
+		}
+	}
+
+out:
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return err;
+}
+
+static int __init test_rht_concurrent(void)
+{
+	struct thread_data *tdata;
+	struct test_obj *objs;
+	u64 max_ns = 0;
+	int i, started = 0, err;
+
+	pr_info("Testing concurrent insertion from %d threads, %d entries each\n",
+		tcount, entries);
+
+	tdata = vzalloc(tcount * sizeof(struct thread_data));
+	if (!tdata)
+		return -ENOMEM;
+	objs = vzalloc((size_t)tcount * entries * sizeof(struct test_obj));
+	if (!objs) {
+		vfree(tdata);
+		return -ENOMEM;
+	}
+
+	err = rhashtable_init(&ht, &test_rht_params);
+	if (err < 0) {
+		pr_warn("Test failed: Unable to initialize hashtable: %d\n",
+			err);
+		goto out_free;
+	}
+
+	atomic_set(&startup_count, tcount);
+	for (i = 0; i < tcount; i++) {
+		tdata[i].id = i;
+		tdata[i].objs = objs + i * entries;
+		tdata[i].task = kthread_run(threadfunc, &tdata[i],
+					    "rhashtable_thread[%d]", i);
+		if (IS_ERR(tdata[i].task)) {
+			pr_err("  kthread_run failed for thread %d\n", i);
+			tdata[i].task = NULL;
+			atomic_dec(&startup_count);
+		} else {
+			started++;
+		}
+	}
+
+	/* Release all threads at the same time once each of them is ready */
+	wait_event(startup_wait, atomic_read(&startup_count) == 0);
+	atomic_dec(&startup_count);
+	wake_up_all(&startup_wait);
+
+	err = 0;
+	for (i = 0; i < tcount; i++) {
+		int ret;
+
+		if (!tdata[i].task)
+			continue;
+
+		ret = kthread_stop(tdata[i].task);
+		if (ret) {
+			pr_warn("Test failed: thread %d returned: %d\n",
+				i, ret);
+			err = ret;
+		}
+		max_ns = max(max_ns, tdata[i].insert_ns);
+	}
+
+	if (atomic_read(&ht.nelems)) {
+		pr_warn("Test failed: %d entries left in the table\n",
+			atomic_read(&ht.nelems));
+		err = -EINVAL;
+	}
+
+	pr_info("  %d threads inserted %llu entries in %llu ns (%llu inserts/sec)\n",
+		started, (u64)started * entries, max_ns,
+		max_ns ? div64_u64((u64)started * entries * NSEC_PER_SEC,
+				   max_ns) : 0);
+
+	rhashtable_destroy(&ht);
+out_free:
+	vfree(objs);
+	vfree(tdata);
+	return err;
+}
+
+static int __init test_rht_init(void)
+{
+	int err;
+
+	pr_info("Running resizable hashtable tests...\n");
+
+	err = rhashtable_init(&ht, &test_rht_params);
+	if (err < 0) {
+		pr_warn("Test failed: Unable to initialize hashtable: %d\n",
+			err);
+		return err;
+	}
+
+	err = test_rhashtable(&ht);
+
+	rhashtable_destroy(&ht);
+
+	if (err)
+		return err;
+
+	if (tcount <= 0 || entries <= 0 || tcount > INT_MAX / entries)
+		return -EINVAL;
+
+	return test_rht_concurrent();
+}
+
+static void __exit test_rht_exit(void)
+{
+}
+
+module_init(test_rht_init);
+module_exit(test_rht_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,372 @@
+/*
+ * eXtensible Arrays
+ *
+ * A self-locking sparse array on top of the radix tree.  Readers walk
+ * the tree under RCU only; writers serialize on the spinlock embedded in
+ * the array and preload radix tree nodes themselves before taking it.
+ *
+ * ID allocation hands out the lowest free index in the requested range.
+ * The radix tree keeps no record of holes, so the array remembers the
+ * index below which every slot is known to be in use; allocation scans
+ * from there, which keeps the common append case O(1) while a freed low
+ * index is still found first.
+ *
+ * Licensed under the GPL v2.
+ */
+
+#include <linux/err.h>
+#include <linux/export.h>
+#include <linux/xarray.h>
+
+static void xa_mark_check(xa_mark_t mark)
+{
+	WARN_ON_ONCE((__force unsigned)mark > (__force unsigned)XA_MARK_MAX);
+}
+
+/**
+ * xa_load - load an entry from an xarray
+ * @xa: the xarray
+ * @index: index into the array
+ *
+ * Safe to call from any context; takes the RCU read lock itself.  The
+ * entry is only guaranteed to stay around as long as the caller keeps
+ * it alive by other means, e.g. RCU freeing.
+ *
+ * Returns the entry at @index, or NULL.
+ */
+void *xa_load(struct xarray *xa, unsigned long index)
+{
+	void *entry;
+
+	rcu_read_lock();
+	entry = radix_tree_lookup(&xa->xa_root, index);
+	rcu_read_unlock();
+
+	return entry;
+}
+EXPORT_SYMBOL(xa_load);
+
+/* Called with xa_lock held */
+static void *__xa_erase(struct xarray *xa, unsigned long index)
+{
+	void *entry = radix_tree_delete(&xa->xa_root, index);
+
+	if (entry && index < xa->xa_free)
+		xa->xa_free = index;
+
+	return entry;
+}
+
+/**
+ * xa_erase - remove an entry from an xarray
+ * @xa: the xarray
+ * @index: index of the entry
+ *
+ * Marks of the entry are cleared with it.
+ *
+ * Returns the entry that was at @index, or NULL.
+ */
+void *xa_erase(struct xarray *xa, unsigned long index)
+{
+	void *entry;
+
+	xa_lock(xa);
+	entry = __xa_erase(xa, index);
+	xa_unlock(xa);
+
+	return entry;
+}
+EXPORT_SYMBOL(xa_erase);
+
+/**
+ * xa_store - store an entry in an xarray
+ * @xa: the xarray
+ * @index: index into the array
+ * @entry: new entry, NULL to erase
+ * @gfp: allocation flags for new radix tree nodes
+ *
+ * Replacing an entry keeps its marks.  With @gfp allowing to sleep, the
+ * nodes are preallocated before the lock is taken.
+ *
+ * Returns the old entry at @index, or ERR_PTR(-ENOMEM).
+ */
+void *xa_store(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp)
+{
+	void **slot;
+	void *old = NULL;
+	int err;
+
+	if (!entry)
+		return xa_erase(xa, index);
+
+	if (WARN_ON_ONCE(radix_tree_is_indirect_ptr(entry) ||
+			 radix_tree_exceptional_entry(entry)))
+		return ERR_PTR(-EINVAL);
+
+	err = radix_tree_maybe_preload(gfp);
+	if (err)
+		return ERR_PTR(err);
+
+	xa_lock(xa);
+	slot = radix_tree_lookup_slot(&xa->xa_root, index);
+	if (slot) {
+		old = radix_tree_deref_slot_protected(slot, &xa->xa_lock);
+		radix_tree_replace_slot(slot, entry);
+	} else {
+		err = radix_tree_insert(&xa->xa_root, index, entry);
+	}
+	xa_unlock(xa);
+	radix_tree_preload_end();
+
+	return err ? ERR_PTR(err) : old;
+}
+EXPORT_SYMBOL(xa_store);
+
+/**
+ * xa_insert - store an entry in an xarray if the index is free
+ * @xa: the xarray
+ * @index: index into the array
+ * @entry: new entry
+ * @gfp: allocation flags for new radix tree nodes
+ *
+ * Returns 0 on success, -EBUSY if @index is in use or -ENOMEM.
+ */
+int xa_insert(struct xarray *xa, unsigned long index, void *entry, gfp_t gfp)
+{
+	int err;
+
+	if (WARN_ON_ONCE(!entry || radix_tree_is_indirect_ptr(entry) ||
+			 radix_tree_exceptional_entry(entry)))
+		return -EINVAL;
+
+	err = radix_tree_maybe_preload(gfp);
+	if (err)
+		return err;
+
+	xa_lock(xa);
+	err = radix_tree_insert(&xa->xa_root, index, entry);
+	xa_unlock(xa);
+	radix_tree_preload_end();
+
+	return err == -EEXIST ? -EBUSY : err;
+}
+EXPORT_SYMBOL(xa_insert);
+
+/*
+ * Find the first free index at or above @start.  Only present entries
+ * are visited and only as long as they are contiguous, so the cost is
+ * the length of the run of used indices starting at @start.
+ *
+ * Called with xa_lock held.
+ */
+static unsigned long xa_find_free(struct xarray *xa, unsigned long start)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned long next = start;
+
+	radix_tree_for_each_contig(slot, &xa->xa_root, &iter, start) {
+		if (iter.index != next)
+			break;
+		next++;
+		if (!next)
+			break;
+	}
+
+	return next;
+}
+
+/**
+ * xa_alloc - allocate an index in an xarray
+ * @xa: the xarray
+ * @id: where to return the index
+ * @entry: new entry
+ * @min: lowest index to allocate
+ * @max: highest index to allocate
+ * @gfp: allocation flags for new radix tree nodes
+ *
+ * Stores @entry at the lowest free index in [@min, @max].  The index is
+ * written to @id before the entry becomes visible to lookups.
+ *
+ * Returns 0 on success, -ENOSPC if the range is full or -ENOMEM.
+ */
+int xa_alloc(struct xarray *xa, u32 *id, void *entry, u32 min, u32 max,
+	     gfp_t gfp)
+{
+	unsigned long index;
+	int err;
+
+	if (WARN_ON_ONCE(!entry || radix_tree_is_indirect_ptr(entry) ||
+			 radix_tree_exceptional_entry(entry)))
+		return -EINVAL;
+
+	err = radix_tree_maybe_preload(gfp);
+	if (err)
+		return err;
+
+	xa_lock(xa);
+	index = xa_find_free(xa, max_t(unsigned long, min, xa->xa_free));
+	if (min <= xa->xa_free)
+		xa->xa_free = index;
+
+	if (index > max || index < min) {
+		err = -ENOSPC;
+	} else {
+		*id = index;
+		err = radix_tree_insert(&xa->xa_root, index, entry);
+		if (!err && index == xa->xa_free)
+			xa->xa_free = index + 1;
+	}
+	xa_unlock(xa);
+	radix_tree_preload_end();
+
+	return err;
+}
+EXPORT_SYMBOL(xa_alloc);
+
+/**
+ * xa_destroy - free the internal structures of an xarray
+ * @xa: the xarray
+ *
+ * The entries themselves are not freed; the array must not be used
+ * concurrently.
+ */
+void xa_destroy(struct xarray *xa)
+{
+	unsigned long index = 0;
+
+	xa_lock(xa);
+	while (xa_find(xa, &index, ULONG_MAX, XA_PRESENT))
+		radix_tree_delete(&xa->xa_root, index);
+	xa->xa_free = 0;
+	xa_unlock(xa);
+}
+EXPORT_SYMBOL(xa_destroy);
+
+/**
+ * xa_get_mark - test a mark on an xarray entry
+ * @xa: the xarray
+ * @index: index of the entry
+ * @mark: the mark
+ *
+ * Returns true if the entry at @index has @mark set.
+ */
+bool xa_get_mark(struct xarray *xa, unsigned long index, xa_mark_t mark)
+{
+	bool ret;
+
+	xa_mark_check(mark);
+	rcu_read_lock();
+	ret = radix_tree_tag_get(&xa->xa_root, index, (__force unsigned)mark);
+	rcu_read_unlock();
+
+	return ret;
+}
+EXPORT_SYMBOL(xa_get_mark);
+
+/**
+ * xa_set_mark - set a mark on an xarray entry
+ * @xa: the xarray
+ * @index: index of the entry
+ * @mark: the mark
+ *
+ * Does nothing if there is no entry at @index.
+ */
+void xa_set_mark(struct xarray *xa, unsigned long index, xa_mark_t mark)
+{
+	xa_mark_check(mark);
+	xa_lock(xa);
+	if (radix_tree_lookup(&xa->xa_root, index))
+		radix_tree_tag_set(&xa->xa_root, index,
+				   (__force unsigned)mark);
+	xa_unlock(xa);
+}
+EXPORT_SYMBOL(xa_set_mark);
+
+/**
+ * xa_clear_mark - clear a mark on an xarray entry
+ * @xa: the xarray
+ * @index: index of the entry
+ * @mark: the mark
+ */
+void xa_clear_mark(struct xarray *xa, unsigned long index, xa_mark_t mark)
+{
+	xa_mark_check(mark);
+	xa_lock(xa);
+	radix_tree_tag_clear(&xa->xa_root, index, (__force unsigned)mark);
+	xa_unlock(xa);
+}
+EXPORT_SYMBOL(xa_clear_mark);
+
+/**
+ * xa_find - find the next entry in an xarray
+ * @xa: the xarray
+ * @index: first index to look at, updated to the index of the entry
+ * @max: last index to look at
+ * @filter: XA_PRESENT for any entry, or a mark the entry must have
+ *
+ * Walks the array under RCU, skipping empty subtrees (or, with a mark,
+ * subtrees without it) a node at a time.
+ *
+ * Returns the entry found, or NULL with @index unchanged.
+ */
+void *xa_find(struct xarray *xa, unsigned long *index, unsigned long max,
+	      xa_mark_t filter)
+{
+	struct radix_tree_iter iter;
+	unsigned flags = 0;
+	void **slot;
+	void *entry = NULL;
+
+	if (filter != XA_PRESENT) {
+		xa_mark_check(filter);
+		flags = RADIX_TREE_ITER_TAGGED | (__force unsigned)filter;
+	}
+
+	rcu_read_lock();
+restart:
+	entry = NULL;
+	for (slot = radix_tree_iter_init(&iter, *index);
+	     slot || (slot = radix_tree_next_chunk(&xa->xa_root, &iter, flags));
+	     slot = radix_tree_next_slot(slot, &iter, flags)) {
+		if (iter.index > max)
+			break;
+		entry = radix_tree_deref_slot(slot);
+		if (unlikely(radix_tree_deref_retry(entry)))
+			goto restart;
+		if (entry) {
+			*index = iter.index;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return entry;
+}
+EXPORT_SYMBOL(xa_find);
+
+/**
+ * xa_find_after - find the next entry after the one at @index
+ * @xa: the xarray
+ * @index: index of the previous entry, updated to the index of the entry
+ * @max: last index to look at
+ * @filter: XA_PRESENT for any entry, or a mark the entry must have
+ *
+ * Returns the entry found, or NULL.
+ */
+void *xa_find_after(struct xarray *xa, unsigned long *index,
+		    unsigned long max, xa_mark_t filter)
+{
+	unsigned long next = *index + 1;
+	void *entry;
+
+	if (!next || next > max)
+		return NULL;
+
+	entry = xa_find(xa, &next, max, filter);
+	if (entry)
+		*index = next;
+
+	return entry;
+}
+EXPORT_SYMBOL(xa_find_after);
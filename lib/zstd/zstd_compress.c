@@ -0,0 +1,1287 @@
+/*
+ * Zstandard compressor for Linux kernel
+ *
+ * Produces a single frame with the content size recorded and no checksum.
+ * Matches are found with a hash chain over the whole input, levels trade
+ * search depth and lazy evaluation for speed. Literals are Huffman coded,
+ * sequences use the predefined or a freshly built FSE table for each
+ * field, whichever comes out smaller.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/sort.h>
+#include <linux/string.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+#include "zstddefs.h"
+
+#define ZSTD_HASH_EMPTY		0xffffffffU
+#define ZSTD_MIN_LITS_COMPRESS	64
+#define ZSTD_MIN_LITS_4STREAMS	256
+
+struct zstd_params {
+	u8 hash_log;
+	u8 chain_log;
+	u8 lazy;
+	u16 depth;
+	u16 nice_len;
+};
+
+static const struct zstd_params zstd_levels[ZSTD_MAX_CLEVEL + 1] = {
+	/* hash  chain  lazy  depth  nice */
+	{ 0 },
+	{ 16,	0,	0,	1,	0 },
+	{ 16,	16,	0,	4,	16 },
+	{ 17,	16,	1,	6,	24 },
+	{ 17,	17,	1,	8,	32 },
+	{ 18,	17,	2,	16,	32 },
+	{ 18,	18,	2,	32,	64 },
+	{ 19,	19,	2,	64,	96 },
+	{ 20,	20,	2,	128,	128 },
+	{ 20,	20,	2,	256,	256 },
+};
+
+struct zstd_seq {
+	u32 lit_len;
+	u32 match_len;
+	u32 offset_value;
+};
+
+struct zstd_fse_ctable {
+	u16 states[1 << ZSTD_LL_MAX_LOG];
+	struct {
+		s32 delta_find;
+		u32 delta_nbits;
+	} tt[ZSTD_FSE_MAX_SYMBOL + 1];
+	unsigned int log;
+	bool rle;
+};
+
+struct zstd_huf_leaf {
+	u32 count;
+	u16 symbol;
+	u16 parent;
+};
+
+struct zstd_huf_node {
+	u32 count;
+	u16 parent;
+	u16 depth;
+};
+
+struct zstd_cctx {
+	const struct zstd_params *params;
+	unsigned int hash_log;
+	u32 chain_mask;
+	u32 *head;
+	u32 *chain;
+	struct zstd_seq *seqs;
+	unsigned int nb_seq;
+	u8 *lits;
+	u8 *lit_end;
+	u32 next_to_update;
+	u32 rep[ZSTD_REP_NUM];
+
+	/* Entropy coding scratch space */
+	u32 counts[ZSTD_HUF_MAX_SYMBOL + 1];
+	struct zstd_fse_ctable ll, of, ml;
+	struct zstd_huf_leaf leaves[ZSTD_HUF_MAX_SYMBOL + 1];
+	struct zstd_huf_node nodes[ZSTD_HUF_MAX_SYMBOL];
+	u16 bl_count[ZSTD_HUF_MAX_SYMBOL + 1];
+	u16 huf_code[ZSTD_HUF_MAX_SYMBOL + 1];
+	u8 huf_nbits[ZSTD_HUF_MAX_SYMBOL + 1];
+};
+
+static void zstd_get_params(int level, size_t src_len, unsigned int *hash_log,
+			    unsigned int *chain_log, size_t *block_size)
+{
+	const struct zstd_params *p = &zstd_levels[level];
+
+	*hash_log = p->hash_log;
+	*chain_log = p->chain_log;
+	*block_size = ZSTD_BLOCK_SIZE_MAX;
+
+	/* Small inputs do not need tables covering a large window */
+	if (src_len) {
+		unsigned int src_log = max_t(unsigned int, 6,
+			src_len > 1 ? zstd_highbit(src_len - 1) + 1 : 1);
+
+		*hash_log = min(*hash_log, src_log + 1);
+		if (*chain_log)
+			*chain_log = min(*chain_log, src_log);
+		*block_size = min_t(size_t, *block_size, src_len);
+	}
+}
+
+size_t zstd_compress_workmem_size(int level, size_t src_len)
+{
+	unsigned int hash_log, chain_log;
+	size_t block_size;
+
+	if (level < ZSTD_MIN_CLEVEL || level > ZSTD_MAX_CLEVEL)
+		return 0;
+
+	zstd_get_params(level, src_len, &hash_log, &chain_log, &block_size);
+	return ALIGN(sizeof(struct zstd_cctx), 8) + (4 << hash_log) +
+		(chain_log ? 4 << chain_log : 0) +
+		ALIGN(sizeof(struct zstd_seq) * (block_size / 4 + 1), 8) +
+		block_size;
+}
+EXPORT_SYMBOL(zstd_compress_workmem_size);
+
+/*
+ * Match finding
+ */
+
+static inline u32 zstd_hash(const u8 *p, unsigned int hash_log)
+{
+	return (get_unaligned_le32(p) * 2654435761U) >> (32 - hash_log);
+}
+
+static size_t zstd_count(const u8 *ip, const u8 *match, const u8 *iend)
+{
+	const u8 *start = ip;
+
+	while (iend - ip >= 8) {
+		u64 diff = get_unaligned_le64(ip) ^ get_unaligned_le64(match);
+
+		if (diff)
+			return ip - start + (__ffs64(diff) >> 3);
+		ip += 8;
+		match += 8;
+	}
+	while (ip < iend && *ip == *match) {
+		ip++;
+		match++;
+	}
+	return ip - start;
+}
+
+static inline bool zstd_rep_match(const u8 *src, const u8 *ip, u32 rep)
+{
+	return rep <= ip - src &&
+		get_unaligned_le32(ip) == get_unaligned_le32(ip - rep);
+}
+
+/* Approximate number of bits needed to code the offset of a match */
+static inline int zstd_offset_cost(u32 dist, u32 rep0)
+{
+	return dist == rep0 ? 0 : zstd_highbit(dist + ZSTD_REP_NUM);
+}
+
+static void zstd_hc_insert(struct zstd_cctx *cctx, const u8 *src, u32 target)
+{
+	u32 idx;
+
+	for (idx = cctx->next_to_update; idx < target; idx++) {
+		u32 h = zstd_hash(src + idx, cctx->hash_log);
+
+		if (cctx->chain)
+			cctx->chain[idx & cctx->chain_mask] = cctx->head[h];
+		cctx->head[h] = idx;
+	}
+	if (target > cctx->next_to_update)
+		cctx->next_to_update = target;
+}
+
+static size_t zstd_hc_find(struct zstd_cctx *cctx, const u8 *src,
+			   const u8 *ip, const u8 *iend, u32 *dist)
+{
+	const struct zstd_params *p = cctx->params;
+	u32 cur = ip - src;
+	u32 min_chain = cur > cctx->chain_mask ? cur - cctx->chain_mask : 0;
+	unsigned int depth = p->depth;
+	size_t best = 0;
+	u32 m;
+
+	zstd_hc_insert(cctx, src, cur);
+	m = cctx->head[zstd_hash(ip, cctx->hash_log)];
+
+	/* Candidates are all older than ip, empty slots are never below */
+	while (m < cur && depth--) {
+		const u8 *match = src + m;
+
+		if (match[best] == ip[best]) {
+			size_t len = zstd_count(ip, match, iend);
+
+			if (len > best) {
+				best = len;
+				*dist = cur - m;
+				if (ip + len == iend || len >= p->nice_len)
+					break;
+			}
+		}
+
+		/* Chain slots of positions this old have been reused */
+		if (!cctx->chain || m <= min_chain)
+			break;
+		m = cctx->chain[m & cctx->chain_mask];
+	}
+
+	return best;
+}
+
+static void zstd_store_seq(struct zstd_cctx *cctx, const u8 *anchor,
+			   size_t lit_len, u32 dist, size_t match_len)
+{
+	struct zstd_seq *seq = &cctx->seqs[cctx->nb_seq++];
+	u32 *rep = cctx->rep;
+	u32 offset_value;
+
+	if (lit_len && dist == rep[0])
+		offset_value = 1;
+	else if (dist == rep[1])
+		offset_value = lit_len ? 2 : 1;
+	else if (dist == rep[2])
+		offset_value = lit_len ? 3 : 2;
+	else if (!lit_len && dist == rep[0] - 1)
+		offset_value = 3;
+	else
+		offset_value = dist + ZSTD_REP_NUM;
+	zstd_apply_offset(rep, offset_value, lit_len);
+
+	memcpy(cctx->lit_end, anchor, lit_len);
+	cctx->lit_end += lit_len;
+	seq->lit_len = lit_len;
+	seq->match_len = match_len;
+	seq->offset_value = offset_value;
+}
+
+struct zstd_match {
+	const u8 *start;
+	size_t len;
+	u32 dist;
+};
+
+/*
+ * Try the repeat offset and the hash chain at ip, replacing @m if either
+ * gives a better match. Returns true if the chain search won, in which
+ * case evaluating the following position is worth it as well.
+ */
+static bool zstd_lazy_step(struct zstd_cctx *cctx, const u8 *src,
+			   const u8 *ip, const u8 *iend, struct zstd_match *m,
+			   int bias)
+{
+	u32 rep0 = cctx->rep[0];
+	size_t len;
+	u32 dist;
+
+	if (m->dist != rep0 && zstd_rep_match(src, ip, rep0)) {
+		len = zstd_count(ip + 4, ip + 4 - rep0, iend) + 4;
+		if ((int)len * 3 >
+		    (int)m->len * 3 - zstd_offset_cost(m->dist, rep0) + 1) {
+			m->start = ip;
+			m->len = len;
+			m->dist = rep0;
+		}
+	}
+
+	len = zstd_hc_find(cctx, src, ip, iend, &dist);
+	if (len >= 4 &&
+	    (int)len * 4 - zstd_offset_cost(dist, rep0) >
+	    (int)m->len * 4 - zstd_offset_cost(m->dist, rep0) + bias) {
+		m->start = ip;
+		m->len = len;
+		m->dist = dist;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Turn the block into sequences and literals. Returns where the last
+ * literals, those not followed by a match, begin.
+ */
+static const u8 *zstd_find_sequences(struct zstd_cctx *cctx, const u8 *src,
+				     const u8 *bstart, const u8 *bend)
+{
+	const struct zstd_params *p = cctx->params;
+	const u8 *ip = bstart, *anchor = bstart;
+	const u8 *ilimit;
+	u32 *rep = cctx->rep;
+
+	if (bend - bstart <= 8)
+		return anchor;
+	ilimit = bend - 8;
+
+	while (ip < ilimit) {
+		struct zstd_match m = { .start = ip + 1, .len = 0, .dist = 0 };
+		size_t len;
+		u32 dist;
+
+		if (zstd_rep_match(src, ip + 1, rep[0])) {
+			m.len = zstd_count(ip + 5, ip + 5 - rep[0], bend) + 4;
+			m.dist = rep[0];
+			if (!p->lazy)
+				goto store;
+		}
+
+		len = zstd_hc_find(cctx, src, ip, bend, &dist);
+		if (len > m.len) {
+			m.start = ip;
+			m.len = len;
+			m.dist = dist;
+		}
+
+		if (m.len < 4) {
+			ip += ((ip - anchor) >> 8) + 1;
+			continue;
+		}
+
+		while (p->lazy && ip < ilimit) {
+			ip++;
+			if (zstd_lazy_step(cctx, src, ip, bend, &m, 4))
+				continue;
+			if (p->lazy == 2 && ip < ilimit) {
+				ip++;
+				if (zstd_lazy_step(cctx, src, ip, bend, &m, 7))
+					continue;
+			}
+			break;
+		}
+
+		/* Extend the match backwards over the pending literals */
+		if (m.dist != rep[0]) {
+			while (m.start > anchor && m.start - src > m.dist &&
+			       m.start[-1] == m.start[-1 - (long)m.dist]) {
+				m.start--;
+				m.len++;
+			}
+		}
+
+store:
+		zstd_store_seq(cctx, anchor, m.start - anchor, m.dist, m.len);
+		anchor = ip = m.start + m.len;
+
+		/* The second repeat offset often matches right away */
+		while (ip <= ilimit && zstd_rep_match(src, ip, rep[1])) {
+			len = zstd_count(ip + 4, ip + 4 - rep[1], bend) + 4;
+			zstd_store_seq(cctx, anchor, 0, rep[1], len);
+			anchor = ip = ip + len;
+		}
+	}
+
+	return anchor;
+}
+
+/*
+ * Entropy coding
+ */
+
+struct zstd_bitwriter {
+	u64 acc;
+	unsigned int nbits;
+	u8 *start;
+	u8 *ptr;
+	u8 *end;
+	bool overflow;
+};
+
+static void zstd_bw_init(struct zstd_bitwriter *bw, u8 *dst, u8 *end)
+{
+	bw->acc = 0;
+	bw->nbits = 0;
+	bw->start = dst;
+	bw->ptr = dst;
+	bw->end = end;
+	bw->overflow = false;
+}
+
+/* @val must fit in @nbits, which must not exceed 31 */
+static inline void zstd_bw_add(struct zstd_bitwriter *bw, u32 val,
+			       unsigned int nbits)
+{
+	bw->acc |= (u64)val << bw->nbits;
+	bw->nbits += nbits;
+	if (bw->nbits >= 32) {
+		if (bw->end - bw->ptr >= 4) {
+			put_unaligned_le32(bw->acc, bw->ptr);
+			bw->ptr += 4;
+		} else {
+			bw->overflow = true;
+		}
+		bw->acc >>= 32;
+		bw->nbits -= 32;
+	}
+}
+
+static int zstd_bw_flush(struct zstd_bitwriter *bw)
+{
+	unsigned int nbytes = (bw->nbits + 7) / 8;
+
+	if (bw->overflow || bw->end - bw->ptr < nbytes)
+		return -ENOSPC;
+	while (nbytes--) {
+		*bw->ptr++ = bw->acc;
+		bw->acc >>= 8;
+	}
+	return bw->ptr - bw->start;
+}
+
+/* Backward streams end with a marker bit so the reader can find the end */
+static int zstd_bw_close(struct zstd_bitwriter *bw)
+{
+	zstd_bw_add(bw, 1, 1);
+	return zstd_bw_flush(bw);
+}
+
+static unsigned int zstd_count_symbols(u32 *counts, unsigned int *max_count,
+				       const u8 *src, size_t len)
+{
+	unsigned int max_symbol = 0, s;
+	size_t i;
+
+	memset(counts, 0, (ZSTD_HUF_MAX_SYMBOL + 1) * sizeof(*counts));
+	for (i = 0; i < len; i++)
+		counts[src[i]]++;
+
+	*max_count = 0;
+	for (s = 0; s <= ZSTD_HUF_MAX_SYMBOL; s++) {
+		if (!counts[s])
+			continue;
+		max_symbol = s;
+		*max_count = max(*max_count, counts[s]);
+	}
+	return max_symbol;
+}
+
+static unsigned int zstd_fse_optimal_log(unsigned int max_log, u32 total,
+					 unsigned int max_symbol)
+{
+	int src_log = zstd_highbit(total - 1);
+	int min_log = min(src_log + 1, (int)zstd_highbit(max_symbol) + 2);
+	int log = min((int)max_log, src_log - 2);
+
+	log = max(log, min_log);
+	return clamp_t(int, log, ZSTD_FSE_MIN_LOG, max_log);
+}
+
+/*
+ * Scale the symbol counts to a distribution over 1 << log states. Rare
+ * symbols get a "less than 1" probability, whatever is left over after
+ * rounding down goes to the most frequent symbol. The table is never
+ * smaller than the number of symbols, so the distribution always fits.
+ */
+static void zstd_fse_normalize(s16 *norm, const u32 *counts,
+			       unsigned int max_symbol, u32 total,
+			       unsigned int log)
+{
+	int remaining = 1 << log;
+	unsigned int s, largest = 0;
+
+	for (s = 0; s <= max_symbol; s++) {
+		u32 p;
+
+		if (!counts[s]) {
+			norm[s] = 0;
+			continue;
+		}
+		p = (counts[s] << log) / total;
+		norm[s] = p ? p : -1;
+		remaining -= p ? p : 1;
+		if (counts[s] > counts[largest])
+			largest = s;
+	}
+
+	while (remaining < 0) {
+		unsigned int top = largest;
+
+		for (s = 0; s <= max_symbol; s++)
+			if (norm[s] > norm[top])
+				top = s;
+		norm[top]--;
+		remaining++;
+	}
+	norm[largest] += remaining;
+}
+
+static int zstd_write_ncount(u8 *dst, size_t cap, const s16 *norm,
+			     unsigned int max_symbol, unsigned int log)
+{
+	struct zstd_bitwriter bw;
+	unsigned int nbits = log + 1, symbol = 0;
+	int remaining = (1 << log) + 1;
+	int threshold = 1 << log;
+	bool previous0 = false;
+
+	zstd_bw_init(&bw, dst, dst + cap);
+	zstd_bw_add(&bw, log - ZSTD_FSE_MIN_LOG, 4);
+
+	while (symbol <= max_symbol && remaining > 1) {
+		int count, max;
+
+		if (previous0) {
+			unsigned int start = symbol;
+
+			while (!norm[symbol])
+				symbol++;
+			while (symbol >= start + 24) {
+				start += 24;
+				zstd_bw_add(&bw, 0xffff, 16);
+			}
+			while (symbol >= start + 3) {
+				start += 3;
+				zstd_bw_add(&bw, 3, 2);
+			}
+			zstd_bw_add(&bw, symbol - start, 2);
+		}
+
+		count = norm[symbol++];
+		max = (2 * threshold - 1) - remaining;
+		remaining -= count < 0 ? -count : count;
+		count++;
+		if (count >= threshold)
+			count += max;
+		zstd_bw_add(&bw, count, count < max ? nbits - 1 : nbits);
+		previous0 = count == 1;
+		while (remaining < threshold) {
+			nbits--;
+			threshold >>= 1;
+		}
+	}
+
+	return zstd_bw_flush(&bw);
+}
+
+static void zstd_build_fse_ctable(struct zstd_fse_ctable *ct, const s16 *norm,
+				  unsigned int max_symbol, unsigned int log)
+{
+	u8 symbols[1 << ZSTD_LL_MAX_LOG];
+	u16 cumul[ZSTD_FSE_MAX_SYMBOL + 2];
+	unsigned int size = 1 << log;
+	unsigned int high = size - 1;
+	unsigned int s, u;
+	int total = 0;
+
+	cumul[0] = 0;
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			cumul[s + 1] = cumul[s] + 1;
+			symbols[high--] = s;
+		} else {
+			cumul[s + 1] = cumul[s] + norm[s];
+		}
+	}
+
+	zstd_fse_spread(symbols, norm, max_symbol, log, high);
+
+	for (u = 0; u < size; u++)
+		ct->states[cumul[symbols[u]]++] = size + u;
+
+	for (s = 0; s <= max_symbol; s++) {
+		unsigned int max_out;
+
+		switch (norm[s]) {
+		case 0:
+			break;
+		case -1:
+		case 1:
+			ct->tt[s].delta_nbits = (log << 16) - size;
+			ct->tt[s].delta_find = total - 1;
+			total++;
+			break;
+		default:
+			max_out = log - zstd_highbit(norm[s] - 1);
+			ct->tt[s].delta_nbits = (max_out << 16) -
+						(norm[s] << max_out);
+			ct->tt[s].delta_find = total - norm[s];
+			total += norm[s];
+			break;
+		}
+	}
+
+	ct->log = log;
+	ct->rle = false;
+}
+
+/*
+ * Start in the state the decoder ends in for @symbol, chosen such that
+ * reading the state after the last symbol always takes at least one bit.
+ */
+static inline void zstd_fse_init_state(const struct zstd_fse_ctable *ct,
+				       u32 *state, unsigned int symbol)
+{
+	u32 nbits = (ct->tt[symbol].delta_nbits + (1 << 15)) >> 16;
+	u32 value = (nbits << 16) - ct->tt[symbol].delta_nbits;
+
+	*state = ct->states[(value >> nbits) + ct->tt[symbol].delta_find];
+}
+
+static inline void zstd_fse_encode(struct zstd_bitwriter *bw,
+				   const struct zstd_fse_ctable *ct,
+				   u32 *state, unsigned int symbol)
+{
+	u32 nbits = (*state + ct->tt[symbol].delta_nbits) >> 16;
+
+	zstd_bw_add(bw, *state & ((1 << nbits) - 1), nbits);
+	*state = ct->states[(*state >> nbits) + ct->tt[symbol].delta_find];
+}
+
+static inline void zstd_fse_flush(struct zstd_bitwriter *bw,
+				  const struct zstd_fse_ctable *ct, u32 state)
+{
+	zstd_bw_add(bw, state & ((1 << ct->log) - 1), ct->log);
+}
+
+static int zstd_huf_leaf_cmp(const void *a, const void *b)
+{
+	const struct zstd_huf_leaf *la = a, *lb = b;
+
+	if (la->count != lb->count)
+		return la->count < lb->count ? -1 : 1;
+	return la->symbol - lb->symbol;
+}
+
+/*
+ * Build Huffman code lengths no longer than ZSTD_HUF_MAX_LOG bits for the
+ * literal counts, and the canonical codes the decoder derives from them.
+ * Returns the length of the longest code.
+ */
+static unsigned int zstd_huf_build(struct zstd_cctx *cctx,
+				   unsigned int max_symbol)
+{
+	struct zstd_huf_leaf *leaves = cctx->leaves;
+	struct zstd_huf_node *nodes = cctx->nodes;
+	u16 *bl_count = cctx->bl_count;
+	u32 rank_start[ZSTD_HUF_MAX_LOG + 2];
+	unsigned int n = 0, i, j, k, len, max_len, s;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (!cctx->counts[s])
+			continue;
+		leaves[n].count = cctx->counts[s];
+		leaves[n].symbol = s;
+		n++;
+	}
+	sort(leaves, n, sizeof(*leaves), zstd_huf_leaf_cmp, NULL);
+
+	/* Both leaves and internal nodes come in order of increasing count */
+	for (i = j = k = 0; k < n - 1; k++) {
+		u32 count = 0;
+		int pick;
+
+		for (pick = 0; pick < 2; pick++) {
+			if (i < n && (j >= k || leaves[i].count <= nodes[j].count)) {
+				count += leaves[i].count;
+				leaves[i++].parent = k;
+			} else {
+				count += nodes[j].count;
+				nodes[j++].parent = k;
+			}
+		}
+		nodes[k].count = count;
+	}
+
+	memset(bl_count, 0, (ZSTD_HUF_MAX_SYMBOL + 1) * sizeof(*bl_count));
+	nodes[n - 2].depth = 0;
+	for (k = n - 2; k-- > 0; )
+		nodes[k].depth = nodes[nodes[k].parent].depth + 1;
+	max_len = 0;
+	for (i = 0; i < n; i++) {
+		len = nodes[leaves[i].parent].depth + 1;
+		bl_count[len]++;
+		max_len = max(max_len, len);
+	}
+
+	/* Move overlong codes up the tree, keeping it complete */
+	for (len = max_len; len > ZSTD_HUF_MAX_LOG; len--) {
+		while (bl_count[len]) {
+			j = len - 2;
+			while (!bl_count[j])
+				j--;
+			bl_count[len] -= 2;
+			bl_count[len - 1]++;
+			bl_count[j + 1] += 2;
+			bl_count[j]--;
+		}
+	}
+	max_len = min_t(unsigned int, max_len, ZSTD_HUF_MAX_LOG);
+
+	/* The rarest symbols get the longest codes */
+	memset(cctx->huf_nbits, 0, sizeof(cctx->huf_nbits));
+	for (i = 0, len = max_len; len > 0; len--)
+		for (k = 0; k < bl_count[len]; k++)
+			cctx->huf_nbits[leaves[i++].symbol] = len;
+
+	/* Codes as the decoder's table lays them out, by weight then symbol */
+	memset(rank_start, 0, sizeof(rank_start));
+	for (s = 0; s <= max_symbol; s++)
+		if (cctx->huf_nbits[s])
+			rank_start[max_len + 1 - cctx->huf_nbits[s]]++;
+	for (k = 0, len = 1; len <= max_len; len++) {
+		u32 count = rank_start[len];
+
+		rank_start[len] = k;
+		k += count << (len - 1);
+	}
+	for (s = 0; s <= max_symbol; s++) {
+		unsigned int w;
+
+		if (!cctx->huf_nbits[s])
+			continue;
+		w = max_len + 1 - cctx->huf_nbits[s];
+		cctx->huf_code[s] = rank_start[w] >> (w - 1);
+		rank_start[w] += 1 << (w - 1);
+	}
+
+	return max_len;
+}
+
+/*
+ * Describe the Huffman tree by the weights of all symbols but the last,
+ * FSE compressed if that pays off. Returns the size of the description.
+ */
+static int zstd_write_huf_tree(struct zstd_cctx *cctx, u8 *dst, size_t cap,
+			       unsigned int max_symbol, unsigned int log)
+{
+	struct zstd_fse_ctable *ct = &cctx->ll;
+	u8 weights[ZSTD_HUF_MAX_SYMBOL + 1];
+	u32 counts[ZSTD_HUF_MAX_LOG + 1];
+	unsigned int n = max_symbol, max_weight = 0, max_count = 0, i;
+
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < n; i++) {
+		u8 nbits = cctx->huf_nbits[i];
+
+		weights[i] = nbits ? log + 1 - nbits : 0;
+		counts[weights[i]]++;
+		max_weight = max_t(unsigned int, max_weight, weights[i]);
+	}
+	for (i = 0; i <= max_weight; i++)
+		max_count = max(max_count, counts[i]);
+
+	if (n > 1 && max_count > 1 && max_count < n && cap > 1) {
+		s16 norm[ZSTD_HUF_MAX_LOG + 1];
+		struct zstd_bitwriter bw;
+		unsigned int wlog;
+		u32 state1, state2;
+		int hsize, ssize;
+
+		wlog = zstd_fse_optimal_log(ZSTD_HUF_WEIGHT_LOG, n, max_weight);
+		zstd_fse_normalize(norm, counts, max_weight, n, wlog);
+		hsize = zstd_write_ncount(dst + 1, cap - 1, norm, max_weight,
+					  wlog);
+		if (hsize < 0)
+			goto direct;
+		zstd_build_fse_ctable(ct, norm, max_weight, wlog);
+
+		/* Two interleaved states, the decoder starts with the first */
+		zstd_bw_init(&bw, dst + 1 + hsize, dst + cap);
+		if (n & 1) {
+			zstd_fse_init_state(ct, &state1, weights[n - 1]);
+			zstd_fse_init_state(ct, &state2, weights[n - 2]);
+			zstd_fse_encode(&bw, ct, &state1, weights[n - 3]);
+			i = n - 3;
+		} else {
+			zstd_fse_init_state(ct, &state2, weights[n - 1]);
+			zstd_fse_init_state(ct, &state1, weights[n - 2]);
+			i = n - 2;
+		}
+		while (i) {
+			zstd_fse_encode(&bw, ct, &state2, weights[--i]);
+			zstd_fse_encode(&bw, ct, &state1, weights[--i]);
+		}
+		zstd_fse_flush(&bw, ct, state2);
+		zstd_fse_flush(&bw, ct, state1);
+		ssize = zstd_bw_close(&bw);
+
+		if (ssize > 0 && hsize + ssize > 1 && hsize + ssize < n / 2) {
+			dst[0] = hsize + ssize;
+			return 1 + hsize + ssize;
+		}
+	}
+
+direct:
+	if (n > 128 || cap < 1 + (n + 1) / 2)
+		return -ENOSPC;
+	dst[0] = 127 + n;
+	for (i = 0; i < n; i += 2)
+		dst[1 + i / 2] = (weights[i] << 4) |
+				 (i + 1 < n ? weights[i + 1] : 0);
+	return 1 + (n + 1) / 2;
+}
+
+static int zstd_huf_stream(struct zstd_cctx *cctx, u8 *dst, u8 *end,
+			   const u8 *src, size_t len)
+{
+	struct zstd_bitwriter bw;
+	size_t i = len;
+
+	zstd_bw_init(&bw, dst, end);
+	while (i--)
+		zstd_bw_add(&bw, cctx->huf_code[src[i]],
+			    cctx->huf_nbits[src[i]]);
+	return zstd_bw_close(&bw);
+}
+
+static int zstd_raw_literals(u8 *dst, size_t cap, const u8 *lits, size_t n,
+			     unsigned int type)
+{
+	size_t hsize = n < 32 ? 1 : n < 4096 ? 2 : 3;
+	size_t size = type == ZSTD_LITS_RLE ? 1 : n;
+
+	if (hsize + size > cap)
+		return -ENOSPC;
+
+	if (hsize == 1) {
+		dst[0] = type | (n << 3);
+	} else if (hsize == 2) {
+		dst[0] = type | (1 << 2) | (n << 4);
+		dst[1] = n >> 4;
+	} else {
+		dst[0] = type | (3 << 2) | (n << 4);
+		dst[1] = n >> 4;
+		dst[2] = n >> 12;
+	}
+	memcpy(dst + hsize, lits, size);
+	return hsize + size;
+}
+
+static int zstd_encode_literals(struct zstd_cctx *cctx, u8 *dst, size_t cap)
+{
+	const u8 *lits = cctx->lits;
+	size_t n = cctx->lit_end - cctx->lits;
+	size_t hsize = n < 1024 ? 3 : n < 16384 ? 4 : 5;
+	size_t max_csize, csize, i;
+	unsigned int max_symbol, max_count, log, format, bits;
+	bool single = n < ZSTD_MIN_LITS_4STREAMS;
+	u64 header;
+	int ret;
+
+	if (!n)
+		return zstd_raw_literals(dst, cap, lits, n, ZSTD_LITS_RAW);
+
+	max_symbol = zstd_count_symbols(cctx->counts, &max_count, lits, n);
+	if (max_count == n)
+		return zstd_raw_literals(dst, cap, lits, n, ZSTD_LITS_RLE);
+	if (n < ZSTD_MIN_LITS_COMPRESS)
+		goto raw;
+
+	/* Not worth it unless it saves a little more than the header */
+	max_csize = min(cap - min(cap, hsize), n - (n >> 6) - 3);
+	log = zstd_huf_build(cctx, max_symbol);
+
+	ret = zstd_write_huf_tree(cctx, dst + hsize, max_csize, max_symbol,
+				  log);
+	if (ret < 0)
+		goto raw;
+	csize = ret;
+
+	if (single) {
+		ret = zstd_huf_stream(cctx, dst + hsize + csize,
+				      dst + hsize + max_csize, lits, n);
+		if (ret < 0)
+			goto raw;
+		csize += ret;
+		format = 0;
+	} else {
+		size_t seg = (n + 3) / 4;
+		u8 *jump = dst + hsize + csize;
+
+		csize += 6;
+		if (csize > max_csize)
+			goto raw;
+		for (i = 0; i < 4; i++) {
+			size_t len = i < 3 ? seg : n - 3 * seg;
+
+			ret = zstd_huf_stream(cctx, dst + hsize + csize,
+					      dst + hsize + max_csize,
+					      lits + i * seg, len);
+			if (ret < 0)
+				goto raw;
+			if (i < 3)
+				put_unaligned_le16(ret, jump + 2 * i);
+			csize += ret;
+		}
+		format = hsize - 2;
+	}
+
+	bits = hsize == 3 ? 10 : hsize == 4 ? 14 : 18;
+	header = ZSTD_LITS_COMPRESSED | (format << 2) | ((u64)n << 4) |
+		 ((u64)csize << (4 + bits));
+	for (i = 0; i < hsize; i++)
+		dst[i] = header >> (8 * i);
+	return hsize + csize;
+
+raw:
+	return zstd_raw_literals(dst, cap, lits, n, ZSTD_LITS_RAW);
+}
+
+static inline unsigned int zstd_ll_code(u32 lit_len)
+{
+	static const u8 ll_code[64] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 16, 17, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+		22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+		24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24
+	};
+
+	return lit_len > 63 ? zstd_highbit(lit_len) + 19 : ll_code[lit_len];
+}
+
+static inline unsigned int zstd_ml_code(u32 match_len)
+{
+	static const u8 ml_code[128] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+		32, 32, 33, 33, 34, 34, 35, 35, 36, 36, 36, 36, 37, 37, 37, 37,
+		38, 38, 38, 38, 38, 38, 38, 38, 39, 39, 39, 39, 39, 39, 39, 39,
+		40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40, 40,
+		41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41, 41,
+		42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42,
+		42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42
+	};
+	u32 ml = match_len - ZSTD_MIN_MATCH;
+
+	return ml > 127 ? zstd_highbit(ml) + 36 : ml_code[ml];
+}
+
+enum zstd_field { ZSTD_FIELD_LL, ZSTD_FIELD_OF, ZSTD_FIELD_ML };
+
+static inline unsigned int zstd_seq_code(const struct zstd_seq *seq,
+					 enum zstd_field field)
+{
+	switch (field) {
+	case ZSTD_FIELD_LL:
+		return zstd_ll_code(seq->lit_len);
+	case ZSTD_FIELD_OF:
+		return zstd_highbit(seq->offset_value);
+	default:
+		return zstd_ml_code(seq->match_len);
+	}
+}
+
+/* log2 in fixed point with 8 fractional bits, linear in between */
+static inline u32 zstd_log2_fp(u32 x)
+{
+	unsigned int h = zstd_highbit(x);
+
+	return (h << 8) + (((x << 8) >> h) & 0xff);
+}
+
+static u32 zstd_table_cost(const u32 *counts, unsigned int max_symbol,
+			   const s16 *norm, unsigned int log)
+{
+	u32 cost = 0;
+	unsigned int s;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (!counts[s])
+			continue;
+		cost += counts[s] * ((log << 8) -
+			zstd_log2_fp(norm[s] < 0 ? 1 : norm[s]));
+	}
+	return cost;
+}
+
+/*
+ * Pick the coding of one sequence field: a single repeated code, the
+ * predefined distribution, or a new one described right here, whichever
+ * is estimated to be cheapest. Returns the size of the description.
+ */
+static int zstd_select_table(struct zstd_cctx *cctx, struct zstd_fse_ctable *ct,
+			     enum zstd_field field, u8 *dst, size_t cap,
+			     unsigned int *mode)
+{
+	static const struct {
+		unsigned int max_log;
+		unsigned int default_max;
+		unsigned int default_log;
+		const s16 *default_norm;
+	} fields[] = {
+		[ZSTD_FIELD_LL] = { ZSTD_LL_MAX_LOG, ZSTD_LL_MAX_SYMBOL,
+				    ZSTD_LL_DEFAULT_LOG, zstd_ll_default_norm },
+		[ZSTD_FIELD_OF] = { ZSTD_OF_MAX_LOG, ZSTD_OF_DEFAULT_MAX,
+				    ZSTD_OF_DEFAULT_LOG, zstd_of_default_norm },
+		[ZSTD_FIELD_ML] = { ZSTD_ML_MAX_LOG, ZSTD_ML_MAX_SYMBOL,
+				    ZSTD_ML_DEFAULT_LOG, zstd_ml_default_norm },
+	};
+	u32 *counts = cctx->counts;
+	unsigned int nb_seq = cctx->nb_seq;
+	unsigned int max_symbol = 0, log, i;
+	u32 default_cost = ~0U, cost;
+	s16 norm[ZSTD_FSE_MAX_SYMBOL + 1];
+	int hsize;
+
+	memset(counts, 0, (ZSTD_FSE_MAX_SYMBOL + 1) * sizeof(*counts));
+	for (i = 0; i < nb_seq; i++) {
+		unsigned int code = zstd_seq_code(&cctx->seqs[i], field);
+
+		counts[code]++;
+		max_symbol = max(max_symbol, code);
+	}
+
+	if (counts[max_symbol] == nb_seq) {
+		if (!cap)
+			return -ENOSPC;
+		dst[0] = max_symbol;
+		ct->log = 0;
+		ct->rle = true;
+		*mode = ZSTD_MODE_RLE;
+		return 1;
+	}
+
+	if (max_symbol <= fields[field].default_max)
+		default_cost = zstd_table_cost(counts, max_symbol,
+					       fields[field].default_norm,
+					       fields[field].default_log);
+
+	log = zstd_fse_optimal_log(fields[field].max_log, nb_seq, max_symbol);
+	zstd_fse_normalize(norm, counts, max_symbol, nb_seq, log);
+	hsize = zstd_write_ncount(dst, cap, norm, max_symbol, log);
+	cost = zstd_table_cost(counts, max_symbol, norm, log) +
+		(hsize > 0 ? hsize * 8 * 256 : ~0U / 2);
+
+	if (default_cost <= cost) {
+		zstd_build_fse_ctable(ct, fields[field].default_norm,
+				      fields[field].default_max,
+				      fields[field].default_log);
+		*mode = ZSTD_MODE_PREDEFINED;
+		return 0;
+	}
+
+	if (hsize < 0)
+		return hsize;
+	zstd_build_fse_ctable(ct, norm, max_symbol, log);
+	*mode = ZSTD_MODE_FSE;
+	return hsize;
+}
+
+static inline void zstd_seq_encode_state(struct zstd_bitwriter *bw,
+					 const struct zstd_fse_ctable *ct,
+					 u32 *state, unsigned int code)
+{
+	if (!ct->rle)
+		zstd_fse_encode(bw, ct, state, code);
+}
+
+static inline void zstd_seq_add_bits(struct zstd_bitwriter *bw,
+				     const struct zstd_seq *seq,
+				     unsigned int ll, unsigned int ml,
+				     unsigned int of)
+{
+	zstd_bw_add(bw, seq->lit_len - zstd_ll_base[ll], zstd_ll_bits[ll]);
+	zstd_bw_add(bw, seq->match_len - zstd_ml_base[ml], zstd_ml_bits[ml]);
+	zstd_bw_add(bw, seq->offset_value - (1U << of), of);
+}
+
+static int zstd_encode_sequences(struct zstd_cctx *cctx, u8 *dst, size_t cap)
+{
+	const struct zstd_seq *seqs = cctx->seqs;
+	unsigned int nb_seq = cctx->nb_seq;
+	unsigned int ll_mode, of_mode, ml_mode, ll, of, ml;
+	struct zstd_bitwriter bw;
+	u32 ll_state = 0, of_state = 0, ml_state = 0;
+	u8 *op = dst, *oend = dst + cap, *modes;
+	int ret, i;
+
+	if (cap < 4)
+		return -ENOSPC;
+	if (nb_seq < 128) {
+		*op++ = nb_seq;
+	} else if (nb_seq < 0x7F00) {
+		*op++ = (nb_seq >> 8) + 0x80;
+		*op++ = nb_seq;
+	} else {
+		*op++ = 0xFF;
+		put_unaligned_le16(nb_seq - 0x7F00, op);
+		op += 2;
+	}
+	if (!nb_seq)
+		return op - dst;
+	modes = op++;
+
+	ret = zstd_select_table(cctx, &cctx->ll, ZSTD_FIELD_LL, op, oend - op,
+				&ll_mode);
+	if (ret < 0)
+		return ret;
+	op += ret;
+	ret = zstd_select_table(cctx, &cctx->of, ZSTD_FIELD_OF, op, oend - op,
+				&of_mode);
+	if (ret < 0)
+		return ret;
+	op += ret;
+	ret = zstd_select_table(cctx, &cctx->ml, ZSTD_FIELD_ML, op, oend - op,
+				&ml_mode);
+	if (ret < 0)
+		return ret;
+	op += ret;
+	*modes = (ll_mode << 6) | (of_mode << 4) | (ml_mode << 2);
+
+	/* Sequences are coded last to first, so they decode in order */
+	zstd_bw_init(&bw, op, oend);
+	i = nb_seq - 1;
+	ll = zstd_ll_code(seqs[i].lit_len);
+	of = zstd_highbit(seqs[i].offset_value);
+	ml = zstd_ml_code(seqs[i].match_len);
+	if (!cctx->ml.rle)
+		zstd_fse_init_state(&cctx->ml, &ml_state, ml);
+	if (!cctx->of.rle)
+		zstd_fse_init_state(&cctx->of, &of_state, of);
+	if (!cctx->ll.rle)
+		zstd_fse_init_state(&cctx->ll, &ll_state, ll);
+	zstd_seq_add_bits(&bw, &seqs[i], ll, ml, of);
+
+	while (i-- > 0) {
+		ll = zstd_ll_code(seqs[i].lit_len);
+		of = zstd_highbit(seqs[i].offset_value);
+		ml = zstd_ml_code(seqs[i].match_len);
+		zstd_seq_encode_state(&bw, &cctx->of, &of_state, of);
+		zstd_seq_encode_state(&bw, &cctx->ml, &ml_state, ml);
+		zstd_seq_encode_state(&bw, &cctx->ll, &ll_state, ll);
+		zstd_seq_add_bits(&bw, &seqs[i], ll, ml, of);
+	}
+
+	zstd_fse_flush(&bw, &cctx->ml, ml_state);
+	zstd_fse_flush(&bw, &cctx->of, of_state);
+	zstd_fse_flush(&bw, &cctx->ll, ll_state);
+	ret = zstd_bw_close(&bw);
+	if (ret < 0)
+		return ret;
+
+	return op + ret - dst;
+}
+
+/*
+ * Compress one block into @dst. Returns the size of the compressed
+ * block, or 0 if it should rather be stored as it is.
+ */
+static size_t zstd_compress_block(struct zstd_cctx *cctx, const u8 *src,
+				  const u8 *bstart, const u8 *bend,
+				  u8 *dst, size_t cap)
+{
+	const u8 *anchor;
+	int lsize, ssize;
+
+	cctx->nb_seq = 0;
+	cctx->lit_end = cctx->lits;
+	anchor = zstd_find_sequences(cctx, src, bstart, bend);
+	memcpy(cctx->lit_end, anchor, bend - anchor);
+	cctx->lit_end += bend - anchor;
+
+	lsize = zstd_encode_literals(cctx, dst, cap);
+	if (lsize < 0)
+		return 0;
+	ssize = zstd_encode_sequences(cctx, dst + lsize, cap - lsize);
+	if (ssize < 0)
+		return 0;
+
+	return lsize + ssize;
+}
+
+static void zstd_write_block_header(u8 *dst, size_t size, unsigned int type,
+				    bool last)
+{
+	u32 bh = last | (type << 1) | (size << 3);
+
+	dst[0] = bh;
+	dst[1] = bh >> 8;
+	dst[2] = bh >> 16;
+}
+
+int zstd_compress(const unsigned char *src, size_t src_len,
+		unsigned char *dst, size_t *dst_len, int level, void *wrkmem)
+{
+	struct zstd_cctx *cctx = wrkmem;
+	const u8 *ip = src, *iend = src + src_len;
+	u8 *op = dst, *oend = dst + *dst_len;
+	unsigned int hash_log, chain_log;
+	size_t block_size;
+	u8 *p;
+
+	if (level < ZSTD_MIN_CLEVEL || level > ZSTD_MAX_CLEVEL ||
+	    src_len >= ZSTD_HASH_EMPTY)
+		return -EINVAL;
+
+	zstd_get_params(level, src_len, &hash_log, &chain_log, &block_size);
+	cctx->params = &zstd_levels[level];
+	cctx->hash_log = hash_log;
+	p = (u8 *)wrkmem + ALIGN(sizeof(*cctx), 8);
+	cctx->head = (u32 *)p;
+	p += 4 << hash_log;
+	if (chain_log) {
+		cctx->chain = (u32 *)p;
+		cctx->chain_mask = (1 << chain_log) - 1;
+		p += 4 << chain_log;
+	} else {
+		cctx->chain = NULL;
+		cctx->chain_mask = 0;
+	}
+	cctx->seqs = (struct zstd_seq *)p;
+	p += ALIGN(sizeof(struct zstd_seq) * (block_size / 4 + 1), 8);
+	cctx->lits = p;
+	cctx->next_to_update = 0;
+	zstd_reset_offsets(cctx->rep);
+	memset(cctx->head, 0xff, 4 << hash_log);
+
+	/* Frame header: single segment, content size, no checksum */
+	if (oend - op < 13)
+		return -ENOSPC;
+	put_unaligned_le32(ZSTD_MAGIC, op);
+	op += 4;
+	if (src_len < 256) {
+		*op++ = 0x20;
+		*op++ = src_len;
+	} else if (src_len < 65536 + 256) {
+		*op++ = 0x60;
+		put_unaligned_le16(src_len - 256, op);
+		op += 2;
+	} else {
+		*op++ = 0xa0;
+		put_unaligned_le32(src_len, op);
+		op += 4;
+	}
+
+	do {
+		size_t len = min_t(size_t, iend - ip, block_size);
+		bool last = ip + len == iend;
+		u32 rep[ZSTD_REP_NUM];
+		size_t size;
+
+		if (oend - op < ZSTD_BLOCK_HEADER_SIZE + 1)
+			return -ENOSPC;
+
+		if (len > 1 && !memchr_inv(ip, ip[0], len)) {
+			zstd_write_block_header(op, len, ZSTD_BLOCK_RLE, last);
+			op[ZSTD_BLOCK_HEADER_SIZE] = ip[0];
+			op += ZSTD_BLOCK_HEADER_SIZE + 1;
+			ip += len;
+			continue;
+		}
+
+		/* Only worth it if smaller than the block stored as it is */
+		memcpy(rep, cctx->rep, sizeof(rep));
+		size = len ? zstd_compress_block(cctx, src, ip, ip + len,
+				op + ZSTD_BLOCK_HEADER_SIZE,
+				min_t(size_t, len - 1,
+				      oend - op - ZSTD_BLOCK_HEADER_SIZE)) : 0;
+
+		if (size) {
+			zstd_write_block_header(op, size, ZSTD_BLOCK_COMPRESSED,
+						last);
+		} else {
+			/* The decoder never sees these sequences */
+			memcpy(cctx->rep, rep, sizeof(rep));
+			if (oend - op - ZSTD_BLOCK_HEADER_SIZE < len)
+				return -ENOSPC;
+			zstd_write_block_header(op, len, ZSTD_BLOCK_RAW, last);
+			memcpy(op + ZSTD_BLOCK_HEADER_SIZE, ip, len);
+			size = len;
+		}
+		op += ZSTD_BLOCK_HEADER_SIZE + size;
+		ip += len;
+	} while (ip < iend);
+
+	*dst_len = op - dst;
+	return 0;
+}
+EXPORT_SYMBOL(zstd_compress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Compressor");
@@ -0,0 +1,918 @@
+/*
+ * Zstandard decompressor for Linux kernel
+ *
+ * Decodes complete frames from one buffer into another. Literals that
+ * have to be regenerated are decoded into the unused tail of the output
+ * buffer, so apart from the entropy tables in the working memory no
+ * buffering is needed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+#include <linux/bitops.h>
+#include <linux/bug.h>
+#include <linux/string.h>
+#include <linux/zstd.h>
+#include <asm/unaligned.h>
+#include "zstddefs.h"
+
+struct zstd_huf_entry {
+	u8 symbol;
+	u8 nbits;
+};
+
+struct zstd_fse_entry {
+	u16 base;
+	u8 symbol;
+	u8 nbits;
+};
+
+struct zstd_fse_table {
+	struct zstd_fse_entry *entries;
+	unsigned int log;
+	unsigned int max_symbol;
+	unsigned int max_log;
+	const s16 *default_norm;
+	unsigned int default_max;
+	unsigned int default_log;
+	bool valid;
+};
+
+struct zstd_dctx {
+	struct zstd_huf_entry huf[1 << ZSTD_HUF_MAX_LOG];
+	struct zstd_fse_entry ll[1 << ZSTD_LL_MAX_LOG];
+	struct zstd_fse_entry of[1 << ZSTD_OF_MAX_LOG];
+	struct zstd_fse_entry ml[1 << ZSTD_ML_MAX_LOG];
+	struct zstd_fse_table ll_table;
+	struct zstd_fse_table of_table;
+	struct zstd_fse_table ml_table;
+	unsigned int huf_log;
+	bool huf_valid;
+	u32 rep[ZSTD_REP_NUM];
+};
+
+/*
+ * Reader for the backward bitstreams. The stream is read from its end
+ * towards its start, and its last byte holds a marker bit above the
+ * first bit to read. @pos counts the bits left; reading past the start
+ * of the stream yields zeroes and makes @pos negative.
+ */
+struct zstd_bitreader {
+	const u8 *start;
+	size_t len;
+	long pos;
+};
+
+static int zstd_bitreader_init(struct zstd_bitreader *br, const u8 *src,
+			       size_t len)
+{
+	if (!len || !src[len - 1])
+		return -EINVAL;
+
+	br->start = src;
+	br->len = len;
+	br->pos = (len - 1) * 8 + zstd_highbit(src[len - 1]);
+	return 0;
+}
+
+static u64 zstd_load_le64(const u8 *src, size_t len, size_t byte)
+{
+	u64 val = 0;
+	int i;
+
+	if (byte + 8 <= len)
+		return get_unaligned_le64(src + byte);
+
+	for (i = 0; byte + i < len; i++)
+		val |= (u64)src[byte + i] << (8 * i);
+	return val;
+}
+
+static u32 zstd_bitreader_peek(const struct zstd_bitreader *br,
+			       unsigned int nbits)
+{
+	long pos = br->pos - nbits;
+	u64 val;
+
+	if (!nbits)
+		return 0;
+
+	if (pos >= 0) {
+		val = zstd_load_le64(br->start, br->len, pos >> 3);
+		return (val >> (pos & 7)) & ((1ULL << nbits) - 1);
+	}
+
+	if (br->pos <= 0)
+		return 0;
+
+	val = zstd_load_le64(br->start, br->len, 0);
+	return (val & ((1ULL << br->pos) - 1)) << -pos;
+}
+
+static u32 zstd_bitreader_read(struct zstd_bitreader *br, unsigned int nbits)
+{
+	u32 val = zstd_bitreader_peek(br, nbits);
+
+	br->pos -= nbits;
+	return val;
+}
+
+/* Forward read of 32 bits at @bitpos, for FSE table headers */
+static u32 zstd_peek_forward(const u8 *src, size_t len, size_t bitpos)
+{
+	return zstd_load_le64(src, len, bitpos >> 3) >> (bitpos & 7);
+}
+
+/*
+ * Read the normalized distribution in the header of an FSE table.
+ * Returns the number of bytes used, or a negative error.
+ */
+static int zstd_read_ncount(s16 *norm, unsigned int *max_symbol,
+			    unsigned int *log, unsigned int max_log,
+			    const u8 *src, size_t len)
+{
+	unsigned int symbol = 0, nbits, threshold;
+	size_t bitpos = 4;
+	bool previous0 = false;
+	int remaining;
+
+	if (!len)
+		return -EINVAL;
+
+	*log = (src[0] & 0xf) + ZSTD_FSE_MIN_LOG;
+	if (*log > max_log)
+		return -EINVAL;
+
+	remaining = (1 << *log) + 1;
+	threshold = 1 << *log;
+	nbits = *log + 1;
+
+	while (remaining > 1) {
+		int count, max;
+		u32 bits;
+
+		if (previous0) {
+			unsigned int zeroes = symbol, repeat;
+
+			do {
+				repeat = zstd_peek_forward(src, len, bitpos) & 3;
+				bitpos += 2;
+				zeroes += repeat;
+			} while (repeat == 3 && bitpos <= len * 8);
+
+			if (zeroes > *max_symbol)
+				return -EINVAL;
+			while (symbol < zeroes)
+				norm[symbol++] = 0;
+		}
+
+		if (symbol > *max_symbol || bitpos > len * 8)
+			return -EINVAL;
+
+		bits = zstd_peek_forward(src, len, bitpos);
+		max = (2 * threshold - 1) - remaining;
+		if ((bits & (threshold - 1)) < max) {
+			count = bits & (threshold - 1);
+			bitpos += nbits - 1;
+		} else {
+			count = bits & (2 * threshold - 1);
+			if (count >= threshold)
+				count -= max;
+			bitpos += nbits;
+		}
+		count--;
+		remaining -= count < 0 ? -count : count;
+		norm[symbol++] = count;
+		previous0 = !count;
+		while (remaining < threshold) {
+			nbits--;
+			threshold >>= 1;
+		}
+	}
+
+	if (remaining != 1 || bitpos > len * 8)
+		return -EINVAL;
+
+	*max_symbol = symbol - 1;
+	return (bitpos + 7) >> 3;
+}
+
+static void zstd_build_fse_table(struct zstd_fse_entry *entries,
+				 const s16 *norm, unsigned int max_symbol,
+				 unsigned int log)
+{
+	u8 symbols[1 << ZSTD_LL_MAX_LOG];
+	u16 next[ZSTD_FSE_MAX_SYMBOL + 1];
+	unsigned int size = 1 << log;
+	unsigned int high = size - 1;
+	unsigned int s, u;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			symbols[high--] = s;
+			next[s] = 1;
+		} else {
+			next[s] = norm[s];
+		}
+	}
+
+	zstd_fse_spread(symbols, norm, max_symbol, log, high);
+
+	for (u = 0; u < size; u++) {
+		unsigned int state = next[symbols[u]]++;
+		unsigned int nbits = log - zstd_highbit(state);
+
+		entries[u].symbol = symbols[u];
+		entries[u].nbits = nbits;
+		entries[u].base = (state << nbits) - size;
+	}
+}
+
+static void zstd_build_rle_table(struct zstd_fse_entry *entries, u8 symbol)
+{
+	entries[0].symbol = symbol;
+	entries[0].nbits = 0;
+	entries[0].base = 0;
+}
+
+/*
+ * Set up one of the sequence decoding tables according to its mode.
+ * Returns the number of bytes of table description used.
+ */
+static int zstd_read_fse_table(struct zstd_fse_table *table,
+			       unsigned int mode, const u8 *src, size_t len)
+{
+	s16 norm[ZSTD_FSE_MAX_SYMBOL + 1];
+	unsigned int max_symbol = table->max_symbol;
+	unsigned int log;
+	int ret;
+
+	switch (mode) {
+	case ZSTD_MODE_PREDEFINED:
+		zstd_build_fse_table(table->entries, table->default_norm,
+				     table->default_max, table->default_log);
+		table->log = table->default_log;
+		ret = 0;
+		break;
+	case ZSTD_MODE_RLE:
+		if (!len || src[0] > table->max_symbol)
+			return -EINVAL;
+		zstd_build_rle_table(table->entries, src[0]);
+		table->log = 0;
+		ret = 1;
+		break;
+	case ZSTD_MODE_FSE:
+		ret = zstd_read_ncount(norm, &max_symbol, &log,
+				       table->max_log, src, len);
+		if (ret < 0)
+			return ret;
+		zstd_build_fse_table(table->entries, norm, max_symbol, log);
+		table->log = log;
+		break;
+	default:
+		if (!table->valid)
+			return -EINVAL;
+		return 0;
+	}
+
+	table->valid = true;
+	return ret;
+}
+
+static int zstd_build_huf_table(struct zstd_dctx *dctx, u8 *weights,
+				unsigned int count)
+{
+	u32 rank_start[ZSTD_HUF_MAX_LOG + 2];
+	u32 rank_count[ZSTD_HUF_MAX_LOG + 2];
+	u32 total = 0, rest, pos;
+	unsigned int log, s, w;
+
+	memset(rank_count, 0, sizeof(rank_count));
+	for (s = 0; s < count; s++) {
+		if (weights[s] > ZSTD_HUF_MAX_LOG)
+			return -EINVAL;
+		rank_count[weights[s]]++;
+		if (weights[s])
+			total += 1 << (weights[s] - 1);
+	}
+	if (!total)
+		return -EINVAL;
+
+	/* The weight of the last symbol completes the tree */
+	log = zstd_highbit(total) + 1;
+	if (log > ZSTD_HUF_MAX_LOG)
+		return -EINVAL;
+	rest = (1 << log) - total;
+	if (rest & (rest - 1))
+		return -EINVAL;
+	weights[count] = zstd_highbit(rest) + 1;
+	rank_count[weights[count]]++;
+	count++;
+
+	/* Shortest codes have the highest weights and the last entries */
+	pos = 0;
+	for (w = 1; w <= log; w++) {
+		rank_start[w] = pos;
+		pos += rank_count[w] << (w - 1);
+	}
+
+	for (s = 0; s < count; s++) {
+		unsigned int len, i;
+
+		w = weights[s];
+		if (!w)
+			continue;
+		len = 1 << (w - 1);
+		for (i = 0; i < len; i++) {
+			dctx->huf[rank_start[w] + i].symbol = s;
+			dctx->huf[rank_start[w] + i].nbits = log + 1 - w;
+		}
+		rank_start[w] += len;
+	}
+
+	dctx->huf_log = log;
+	dctx->huf_valid = true;
+	return 0;
+}
+
+/*
+ * Read the Huffman tree description at the start of compressed literals.
+ * Returns the number of bytes used.
+ */
+static int zstd_read_huf_table(struct zstd_dctx *dctx, const u8 *src,
+			       size_t len)
+{
+	u8 weights[ZSTD_HUF_MAX_SYMBOL + 1];
+	unsigned int count = 0, header, i;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+	header = src[0];
+
+	if (header >= 128) {
+		/* Weights stored directly, four bits each */
+		count = header - 127;
+		if (1 + (count + 1) / 2 > len)
+			return -EINVAL;
+		for (i = 0; i < count; i++)
+			weights[i] = (src[1 + i / 2] >> (i & 1 ? 0 : 4)) & 0xf;
+		ret = zstd_build_huf_table(dctx, weights, count);
+		return ret < 0 ? ret : 1 + (count + 1) / 2;
+	} else {
+		struct zstd_fse_entry table[1 << ZSTD_HUF_WEIGHT_LOG];
+		s16 norm[ZSTD_HUF_MAX_LOG + 1];
+		unsigned int max_symbol = ZSTD_HUF_MAX_LOG, log;
+		struct zstd_bitreader br;
+		u32 state1, state2;
+
+		/* Weights compressed with FSE, using two interleaved states */
+		if (!header || header + 1 > len)
+			return -EINVAL;
+		src++;
+
+		ret = zstd_read_ncount(norm, &max_symbol, &log,
+				       ZSTD_HUF_WEIGHT_LOG, src, header);
+		if (ret < 0)
+			return ret;
+		zstd_build_fse_table(table, norm, max_symbol, log);
+
+		if (zstd_bitreader_init(&br, src + ret, header - ret))
+			return -EINVAL;
+		state1 = zstd_bitreader_read(&br, log);
+		state2 = zstd_bitreader_read(&br, log);
+		if (br.pos < 0)
+			return -EINVAL;
+
+		for (;;) {
+			if (count >= ZSTD_HUF_MAX_SYMBOL - 1)
+				return -EINVAL;
+			weights[count++] = table[state1].symbol;
+			state1 = table[state1].base +
+				 zstd_bitreader_read(&br, table[state1].nbits);
+			if (br.pos < 0) {
+				weights[count++] = table[state2].symbol;
+				break;
+			}
+
+			weights[count++] = table[state2].symbol;
+			state2 = table[state2].base +
+				 zstd_bitreader_read(&br, table[state2].nbits);
+			if (br.pos < 0) {
+				if (count >= ZSTD_HUF_MAX_SYMBOL)
+					return -EINVAL;
+				weights[count++] = table[state1].symbol;
+				break;
+			}
+		}
+
+		ret = zstd_build_huf_table(dctx, weights, count);
+		return ret < 0 ? ret : 1 + header;
+	}
+}
+
+static int zstd_decode_huf_stream(const struct zstd_dctx *dctx, u8 *dst,
+				  size_t count, const u8 *src, size_t len)
+{
+	const struct zstd_huf_entry *huf = dctx->huf;
+	unsigned int log = dctx->huf_log;
+	struct zstd_bitreader br;
+	size_t i;
+
+	if (zstd_bitreader_init(&br, src, len))
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		const struct zstd_huf_entry *e =
+			&huf[zstd_bitreader_peek(&br, log)];
+
+		dst[i] = e->symbol;
+		br.pos -= e->nbits;
+	}
+
+	return br.pos ? -EINVAL : 0;
+}
+
+/*
+ * Decode the literals section of a compressed block. Raw literals are
+ * used in place, everything else is regenerated at the end of the output
+ * buffer. Returns the size of the section.
+ */
+static int zstd_decode_literals(struct zstd_dctx *dctx, const u8 *src,
+				size_t len, u8 *op, u8 *oend,
+				const u8 **lits, size_t *lit_len)
+{
+	unsigned int type, format;
+	size_t hsize, regen, csize, size;
+	u8 *buf;
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+	type = src[0] & 3;
+	format = (src[0] >> 2) & 3;
+
+	if (type == ZSTD_LITS_RAW || type == ZSTD_LITS_RLE) {
+		switch (format) {
+		case 1:
+			hsize = 2;
+			break;
+		case 3:
+			hsize = 3;
+			break;
+		default:
+			hsize = 1;
+			break;
+		}
+		if (hsize > len)
+			return -EINVAL;
+
+		if (hsize == 1)
+			regen = src[0] >> 3;
+		else if (hsize == 2)
+			regen = (src[0] >> 4) | (src[1] << 4);
+		else
+			regen = (src[0] >> 4) | (src[1] << 4) | (src[2] << 12);
+		if (regen > ZSTD_BLOCK_SIZE_MAX)
+			return -EINVAL;
+
+		if (type == ZSTD_LITS_RAW) {
+			if (hsize + regen > len)
+				return -EINVAL;
+			*lits = src + hsize;
+			*lit_len = regen;
+			return hsize + regen;
+		}
+
+		if (hsize + 1 > len)
+			return -EINVAL;
+		if (regen > oend - op)
+			return -ENOSPC;
+		buf = oend - regen;
+		memset(buf, src[hsize], regen);
+		*lits = buf;
+		*lit_len = regen;
+		return hsize + 1;
+	} else {
+		unsigned int bits = format < 2 ? 10 : format == 2 ? 14 : 18;
+		bool single = format == 0;
+		u64 header = 0;
+		size_t i;
+
+		hsize = format < 2 ? 3 : format == 2 ? 4 : 5;
+		if (hsize > len)
+			return -EINVAL;
+		for (i = 0; i < hsize; i++)
+			header |= (u64)src[i] << (8 * i);
+		regen = (header >> 4) & ((1 << bits) - 1);
+		csize = (header >> (4 + bits)) & ((1 << bits) - 1);
+		if (regen > ZSTD_BLOCK_SIZE_MAX || hsize + csize > len)
+			return -EINVAL;
+		size = hsize + csize;
+		if (regen > oend - op)
+			return -ENOSPC;
+		src += hsize;
+
+		if (type == ZSTD_LITS_COMPRESSED) {
+			ret = zstd_read_huf_table(dctx, src, csize);
+			if (ret < 0)
+				return ret;
+			src += ret;
+			csize -= ret;
+		} else if (!dctx->huf_valid) {
+			return -EINVAL;
+		}
+
+		buf = oend - regen;
+		if (single) {
+			ret = zstd_decode_huf_stream(dctx, buf, regen,
+						     src, csize);
+		} else {
+			size_t seg = (regen + 3) / 4;
+			size_t s1, s2, s3;
+
+			if (csize < 6 || 3 * seg > regen)
+				return -EINVAL;
+			s1 = get_unaligned_le16(src);
+			s2 = get_unaligned_le16(src + 2);
+			s3 = get_unaligned_le16(src + 4);
+			if (s1 + s2 + s3 + 6 >= csize)
+				return -EINVAL;
+			src += 6;
+
+			ret = zstd_decode_huf_stream(dctx, buf, seg, src, s1);
+			if (!ret)
+				ret = zstd_decode_huf_stream(dctx, buf + seg,
+						seg, src + s1, s2);
+			if (!ret)
+				ret = zstd_decode_huf_stream(dctx,
+						buf + 2 * seg, seg,
+						src + s1 + s2, s3);
+			if (!ret)
+				ret = zstd_decode_huf_stream(dctx,
+						buf + 3 * seg, regen - 3 * seg,
+						src + s1 + s2 + s3,
+						csize - 6 - s1 - s2 - s3);
+		}
+		if (ret)
+			return ret;
+
+		*lits = buf;
+		*lit_len = regen;
+		return size;
+	}
+}
+
+static void zstd_copy_match(u8 *op, size_t offset, size_t len)
+{
+	const u8 *match = op - offset;
+
+	if (offset >= len) {
+		memcpy(op, match, len);
+	} else if (offset == 1) {
+		memset(op, *match, len);
+	} else {
+		/* The copied pattern doubles in length with every round */
+		while (len) {
+			size_t n = min_t(size_t, len, op - match);
+
+			memcpy(op, match, n);
+			op += n;
+			len -= n;
+		}
+	}
+}
+
+static int zstd_decompress_block(struct zstd_dctx *dctx, const u8 *src,
+				 size_t len, u8 *fstart, u8 **opp, u8 *oend)
+{
+	const u8 *iend = src + len;
+	const u8 *lits, *lit_end;
+	struct zstd_bitreader br;
+	u32 ll_state, of_state, ml_state;
+	size_t lit_len;
+	u8 *op = *opp;
+	u8 *olimit;
+	unsigned int nb_seq, modes, i;
+	int ret;
+
+	ret = zstd_decode_literals(dctx, src, len, op, oend, &lits, &lit_len);
+	if (ret < 0)
+		return ret;
+	src += ret;
+	lit_end = lits + lit_len;
+
+	/* Matches must not overwrite literals that are still to be copied */
+	olimit = lits >= op && lits < oend ? (u8 *)lits : oend;
+
+	if (src >= iend)
+		return -EINVAL;
+	nb_seq = *src++;
+	if (nb_seq >= 128) {
+		if (nb_seq == 255) {
+			if (iend - src < 2)
+				return -EINVAL;
+			nb_seq = get_unaligned_le16(src) + 0x7F00;
+			src += 2;
+		} else {
+			if (src >= iend)
+				return -EINVAL;
+			nb_seq = ((nb_seq - 128) << 8) + *src++;
+		}
+	}
+
+	if (!nb_seq) {
+		if (src != iend)
+			return -EINVAL;
+		goto last_literals;
+	}
+
+	if (src >= iend)
+		return -EINVAL;
+	modes = *src++;
+	if (modes & 3)
+		return -EINVAL;
+
+	ret = zstd_read_fse_table(&dctx->ll_table, modes >> 6, src, iend - src);
+	if (ret < 0)
+		return ret;
+	src += ret;
+	ret = zstd_read_fse_table(&dctx->of_table, (modes >> 4) & 3, src,
+				  iend - src);
+	if (ret < 0)
+		return ret;
+	src += ret;
+	ret = zstd_read_fse_table(&dctx->ml_table, (modes >> 2) & 3, src,
+				  iend - src);
+	if (ret < 0)
+		return ret;
+	src += ret;
+
+	if (zstd_bitreader_init(&br, src, iend - src))
+		return -EINVAL;
+	ll_state = zstd_bitreader_read(&br, dctx->ll_table.log);
+	of_state = zstd_bitreader_read(&br, dctx->of_table.log);
+	ml_state = zstd_bitreader_read(&br, dctx->ml_table.log);
+
+	for (i = 0; i < nb_seq; i++) {
+		const struct zstd_fse_entry *ll = &dctx->ll[ll_state];
+		const struct zstd_fse_entry *of = &dctx->of[of_state];
+		const struct zstd_fse_entry *ml = &dctx->ml[ml_state];
+		u32 offset_value, offset;
+		size_t lit, match;
+
+		offset_value = (1U << of->symbol) +
+			       zstd_bitreader_read(&br, of->symbol);
+		match = zstd_ml_base[ml->symbol] +
+			zstd_bitreader_read(&br, zstd_ml_bits[ml->symbol]);
+		lit = zstd_ll_base[ll->symbol] +
+		      zstd_bitreader_read(&br, zstd_ll_bits[ll->symbol]);
+
+		if (i != nb_seq - 1) {
+			ll_state = ll->base + zstd_bitreader_read(&br, ll->nbits);
+			ml_state = ml->base + zstd_bitreader_read(&br, ml->nbits);
+			of_state = of->base + zstd_bitreader_read(&br, of->nbits);
+		}
+		if (br.pos < 0)
+			return -EINVAL;
+
+		offset = zstd_apply_offset(dctx->rep, offset_value, lit);
+
+		if (lit > lit_end - lits)
+			return -EINVAL;
+		if (lit > oend - op)
+			return -ENOSPC;
+		memmove(op, lits, lit);
+		op += lit;
+		lits += lit;
+		if (olimit != oend)
+			olimit = (u8 *)lits;
+
+		if (!offset || offset > op - fstart)
+			return -EINVAL;
+		if (match > olimit - op)
+			return -ENOSPC;
+		zstd_copy_match(op, offset, match);
+		op += match;
+	}
+
+	if (br.pos)
+		return -EINVAL;
+
+last_literals:
+	lit_len = lit_end - lits;
+	if (lit_len > oend - op)
+		return -ENOSPC;
+	memmove(op, lits, lit_len);
+	*opp = op + lit_len;
+	return 0;
+}
+
+static void zstd_reset_dctx(struct zstd_dctx *dctx)
+{
+	struct zstd_fse_table *t;
+
+	t = &dctx->ll_table;
+	t->entries = dctx->ll;
+	t->max_symbol = ZSTD_LL_MAX_SYMBOL;
+	t->max_log = ZSTD_LL_MAX_LOG;
+	t->default_norm = zstd_ll_default_norm;
+	t->default_max = ZSTD_LL_MAX_SYMBOL;
+	t->default_log = ZSTD_LL_DEFAULT_LOG;
+	t->valid = false;
+
+	t = &dctx->of_table;
+	t->entries = dctx->of;
+	t->max_symbol = ZSTD_OF_MAX_SYMBOL;
+	t->max_log = ZSTD_OF_MAX_LOG;
+	t->default_norm = zstd_of_default_norm;
+	t->default_max = ZSTD_OF_DEFAULT_MAX;
+	t->default_log = ZSTD_OF_DEFAULT_LOG;
+	t->valid = false;
+
+	t = &dctx->ml_table;
+	t->entries = dctx->ml;
+	t->max_symbol = ZSTD_ML_MAX_SYMBOL;
+	t->max_log = ZSTD_ML_MAX_LOG;
+	t->default_norm = zstd_ml_default_norm;
+	t->default_max = ZSTD_ML_MAX_SYMBOL;
+	t->default_log = ZSTD_ML_DEFAULT_LOG;
+	t->valid = false;
+
+	dctx->huf_valid = false;
+	zstd_reset_offsets(dctx->rep);
+}
+
+static int zstd_decompress_frame(struct zstd_dctx *dctx, const u8 **ipp,
+				 const u8 *iend, u8 **opp, u8 *oend)
+{
+	static const u8 fcs_size[4] = { 0, 2, 4, 8 };
+	static const u8 did_size[4] = { 0, 1, 2, 4 };
+	const u8 *ip = *ipp;
+	u8 *fstart = *opp, *op = *opp;
+	unsigned int fhd;
+	u64 fcs = 0;
+	bool has_fcs, last;
+	size_t hsize, i;
+	int ret;
+
+	if (iend - ip < 5)
+		return -EINVAL;
+	fhd = ip[4];
+	ip += 5;
+
+	/* Reserved bit */
+	if (fhd & 0x08)
+		return -EINVAL;
+
+	hsize = (fhd & 0x20 ? 0 : 1) + did_size[fhd & 3] +
+		fcs_size[fhd >> 6] + ((fhd & 0x20) && !(fhd >> 6));
+	if (iend - ip < hsize)
+		return -EINVAL;
+
+	if (!(fhd & 0x20))
+		ip++;		/* Window descriptor, the whole frame is ours */
+
+	for (i = 0; i < did_size[fhd & 3]; i++)
+		if (*ip++)
+			return -EINVAL;	/* No dictionaries */
+
+	has_fcs = (fhd >> 6) || (fhd & 0x20);
+	switch (fhd >> 6) {
+	case 0:
+		if (has_fcs)
+			fcs = *ip++;
+		break;
+	case 1:
+		fcs = get_unaligned_le16(ip) + 256;
+		ip += 2;
+		break;
+	case 2:
+		fcs = get_unaligned_le32(ip);
+		ip += 4;
+		break;
+	case 3:
+		fcs = get_unaligned_le64(ip);
+		ip += 8;
+		break;
+	}
+	if (has_fcs && fcs > oend - op)
+		return -ENOSPC;
+
+	zstd_reset_dctx(dctx);
+
+	do {
+		u32 bh;
+		size_t size;
+
+		if (iend - ip < ZSTD_BLOCK_HEADER_SIZE)
+			return -EINVAL;
+		bh = ip[0] | (ip[1] << 8) | (ip[2] << 16);
+		ip += ZSTD_BLOCK_HEADER_SIZE;
+		last = bh & 1;
+		size = bh >> 3;
+		if (size > ZSTD_BLOCK_SIZE_MAX)
+			return -EINVAL;
+
+		switch ((bh >> 1) & 3) {
+		case ZSTD_BLOCK_RAW:
+			if (size > iend - ip)
+				return -EINVAL;
+			if (size > oend - op)
+				return -ENOSPC;
+			memcpy(op, ip, size);
+			op += size;
+			ip += size;
+			break;
+		case ZSTD_BLOCK_RLE:
+			if (ip >= iend)
+				return -EINVAL;
+			if (size > oend - op)
+				return -ENOSPC;
+			memset(op, *ip, size);
+			op += size;
+			ip++;
+			break;
+		case ZSTD_BLOCK_COMPRESSED:
+			if (size > iend - ip)
+				return -EINVAL;
+			ret = zstd_decompress_block(dctx, ip, size, fstart,
+						    &op, oend);
+			if (ret)
+				return ret;
+			ip += size;
+			break;
+		default:
+			return -EINVAL;
+		}
+	} while (!last);
+
+	/* The content checksum is not verified */
+	if (fhd & 0x04) {
+		if (iend - ip < 4)
+			return -EINVAL;
+		ip += 4;
+	}
+
+	if (has_fcs && op - fstart != fcs)
+		return -EINVAL;
+
+	*ipp = ip;
+	*opp = op;
+	return 0;
+}
+
+int zstd_decompress(const unsigned char *src, size_t src_len,
+		unsigned char *dest, size_t *dest_len, void *wrkmem)
+{
+	const u8 *ip = src, *iend = src + src_len;
+	u8 *op = dest, *oend = dest + *dest_len;
+	int ret;
+
+	BUILD_BUG_ON(sizeof(struct zstd_dctx) > ZSTD_DECOMPRESS_WORKMEM);
+
+	if (!src_len)
+		return -EINVAL;
+
+	while (ip < iend) {
+		u32 magic;
+
+		if (iend - ip < 4)
+			return -EINVAL;
+		magic = get_unaligned_le32(ip);
+
+		if ((magic & ZSTD_MAGIC_SKIP_MASK) == ZSTD_MAGIC_SKIPPABLE) {
+			size_t skip;
+
+			if (iend - ip < 8)
+				return -EINVAL;
+			skip = get_unaligned_le32(ip + 4);
+			if (skip > iend - ip - 8)
+				return -EINVAL;
+			ip += 8 + skip;
+			continue;
+		}
+
+		if (magic != ZSTD_MAGIC)
+			return -EINVAL;
+
+		ret = zstd_decompress_frame(wrkmem, &ip, iend, &op, oend);
+		if (ret)
+			return ret;
+	}
+
+	*dest_len = op - dest;
+	return 0;
+}
+#ifndef STATIC
+EXPORT_SYMBOL(zstd_decompress);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Zstandard Decompressor");
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Zstandard definitions shared by the compressor and the decompressor
+ *
+ * The format is described in RFC 8878. Both sides only deal with single
+ * frames held entirely in memory, so history is simply everything that
+ * precedes the current position in the frame.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define ZSTD_MAGIC		0xFD2FB528U
+#define ZSTD_MAGIC_SKIPPABLE	0x184D2A50U
+#define ZSTD_MAGIC_SKIP_MASK	0xFFFFFFF0U
+
+#define ZSTD_BLOCK_SIZE_MAX	(128 * 1024)
+#define ZSTD_BLOCK_HEADER_SIZE	3
+
+#define ZSTD_BLOCK_RAW		0
+#define ZSTD_BLOCK_RLE		1
+#define ZSTD_BLOCK_COMPRESSED	2
+
+#define ZSTD_LITS_RAW		0
+#define ZSTD_LITS_RLE		1
+#define ZSTD_LITS_COMPRESSED	2
+#define ZSTD_LITS_TREELESS	3
+
+#define ZSTD_MODE_PREDEFINED	0
+#define ZSTD_MODE_RLE		1
+#define ZSTD_MODE_FSE		2
+#define ZSTD_MODE_REPEAT	3
+
+#define ZSTD_MIN_MATCH		3
+#define ZSTD_REP_NUM		3
+
+#define ZSTD_HUF_MAX_LOG	11
+#define ZSTD_HUF_MAX_SYMBOL	255
+#define ZSTD_HUF_WEIGHT_LOG	6
+
+#define ZSTD_FSE_MIN_LOG	5
+#define ZSTD_LL_MAX_LOG		9
+#define ZSTD_ML_MAX_LOG		9
+#define ZSTD_OF_MAX_LOG		8
+#define ZSTD_LL_MAX_SYMBOL	35
+#define ZSTD_ML_MAX_SYMBOL	52
+#define ZSTD_OF_MAX_SYMBOL	31
+#define ZSTD_FSE_MAX_SYMBOL	ZSTD_ML_MAX_SYMBOL
+
+#define ZSTD_LL_DEFAULT_LOG	6
+#define ZSTD_ML_DEFAULT_LOG	6
+#define ZSTD_OF_DEFAULT_LOG	5
+#define ZSTD_OF_DEFAULT_MAX	28
+
+static const u32 zstd_ll_base[ZSTD_LL_MAX_SYMBOL + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048,
+	4096, 8192, 16384, 32768, 65536
+};
+
+static const u8 zstd_ll_bits[ZSTD_LL_MAX_SYMBOL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16
+};
+
+static const u32 zstd_ml_base[ZSTD_ML_MAX_SYMBOL + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027,
+	2051, 4099, 8195, 16387, 32771, 65539
+};
+
+static const u8 zstd_ml_bits[ZSTD_ML_MAX_SYMBOL + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10,
+	11, 12, 13, 14, 15, 16
+};
+
+/* Predefined distributions, -1 stands for a "less than 1" probability */
+static const s16 zstd_ll_default_norm[ZSTD_LL_MAX_SYMBOL + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1
+};
+
+static const s16 zstd_ml_default_norm[ZSTD_ML_MAX_SYMBOL + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1
+};
+
+static const s16 zstd_of_default_norm[ZSTD_OF_DEFAULT_MAX + 1] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1
+};
+
+static inline unsigned int zstd_highbit(u32 val)
+{
+	return __fls(val);
+}
+
+/*
+ * Distribute the symbols of a normalized distribution over an FSE table
+ * of 1 << log entries, as both the encoder and the decoder must. Symbols
+ * with a "less than 1" probability have already been placed at the top
+ * of the table, below @high is what is left.
+ */
+static inline void zstd_fse_spread(u8 *symbols, const s16 *norm,
+				   unsigned int max_symbol, unsigned int log,
+				   unsigned int high)
+{
+	unsigned int size = 1 << log;
+	unsigned int step = (size >> 1) + (size >> 3) + 3;
+	unsigned int mask = size - 1;
+	unsigned int pos = 0;
+	unsigned int s;
+	int i;
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (i = 0; i < norm[s]; i++) {
+			symbols[pos] = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+}
+
+/*
+ * Resolve an offset value as found in a sequence into a match distance,
+ * updating the repeat offset history. Values 1 to 3 select a repeat
+ * offset, shifted by one if the sequence has no literals.
+ */
+static inline u32 zstd_apply_offset(u32 *rep, u32 offset_value, u32 lit_len)
+{
+	u32 offset, idx;
+
+	if (offset_value > ZSTD_REP_NUM) {
+		offset = offset_value - ZSTD_REP_NUM;
+		rep[2] = rep[1];
+		rep[1] = rep[0];
+		rep[0] = offset;
+		return offset;
+	}
+
+	idx = offset_value - 1 + (lit_len == 0);
+	if (idx == 0)
+		return rep[0];
+
+	offset = idx == 3 ? rep[0] - 1 : rep[idx];
+	if (idx != 1)
+		rep[2] = rep[1];
+	rep[1] = rep[0];
+	rep[0] = offset;
+	return offset;
+}
+
+static inline void zstd_reset_offsets(u32 *rep)
+{
+	rep[0] = 1;
+	rep[1] = 4;
+	rep[2] = 8;
+}
@@ -51,6 +51,13 @@ do {						\
 
 #define PNEIGH_HASHMASK		0xF
 
+/* The periodic gc covers the hash table in NEIGH_GC_SLICES runs, and
+ * forced gc looks at no more than NEIGH_FORCED_GC_BUDGET entries per
+ * call, so that neither holds tbl->lock for long on large tables.
+ */
+#define NEIGH_GC_SLICES		16
+#define NEIGH_FORCED_GC_BUDGET	1024
+
 static void neigh_timer_handler(unsigned long arg);
 static void __neigh_notify(struct neighbour *n, int type, int flags);
 static void neigh_update_notify(struct neighbour *neigh);
@@ -116,24 +123,40 @@ unsigned long neigh_rand_reach_time(unsigned long base)
 EXPORT_SYMBOL(neigh_rand_reach_time);
 
 
+/* Called from neigh_alloc(), possibly in softirq context: resume at the
+ * bucket where the previous call stopped and give up once enough entries
+ * are gone to get back under gc_thresh2, or the budget is spent.
+ */
 static int neigh_forced_gc(struct neigh_table *tbl)
 {
-	int shrunk = 0;
-	int i;
+	int max_clean = atomic_read(&tbl->entries) - tbl->gc_thresh2;
+	unsigned int budget = NEIGH_FORCED_GC_BUDGET;
+	unsigned int i, mask, scanned;
 	struct neigh_hash_table *nht;
+	int shrunk = 0;
 
 	NEIGH_CACHE_STAT_INC(tbl, forced_gc_runs);
 
+	if (max_clean <= 0)
+		max_clean = 1;
+
 	write_lock_bh(&tbl->lock);
 	nht = rcu_dereference_protected(tbl->nht,
 					lockdep_is_held(&tbl->lock));
-	for (i = 0; i < (1 << nht->hash_shift); i++) {
+	mask = (1 << nht->hash_shift) - 1;
+	i = tbl->forced_gc_bucket & mask;
+	for (scanned = 0; scanned <= mask; scanned++, i = (i + 1) & mask) {
 		struct neighbour *n;
 		struct neighbour __rcu **np;
 
+		if (shrunk >= max_clean || !budget)
+			break;
+
 		np = &nht->hash_buckets[i];
 		while ((n = rcu_dereference_protected(*np,
 					lockdep_is_held(&tbl->lock))) != NULL) {
+			if (budget)
+				budget--;
 			/* Neighbour record may be discarded if:
 			 * - nobody refers to it.
 			 * - it is not permanent
@@ -145,7 +168,7 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 					rcu_dereference_protected(n->next,
 						  lockdep_is_held(&tbl->lock)));
 				n->dead = 1;
-				shrunk	= 1;
+				shrunk++;
 				write_unlock(&n->lock);
 				neigh_cleanup_and_release(n);
 				continue;
@@ -154,6 +177,7 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 			np = &n->next;
 		}
 	}
+	tbl->forced_gc_bucket = i;
 
 	tbl->last_flush = jiffies;
 
@@ -310,21 +334,21 @@ static void neigh_get_hash_rnd(u32 *x)
 	*x |= 1;
 }
 
-static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift)
+static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift, gfp_t gfp)
 {
 	size_t size = (1 << shift) * sizeof(struct neighbour *);
 	struct neigh_hash_table *ret;
 	struct neighbour __rcu **buckets;
 	int i;
 
-	ret = kmalloc(sizeof(*ret), GFP_ATOMIC);
+	ret = kmalloc(sizeof(*ret), gfp);
 	if (!ret)
 		return NULL;
 	if (size <= PAGE_SIZE)
-		buckets = kzalloc(size, GFP_ATOMIC);
+		buckets = kzalloc(size, gfp);
 	else
 		buckets = (struct neighbour __rcu **)
-			  __get_free_pages(GFP_ATOMIC | __GFP_ZERO,
+			  __get_free_pages(gfp | __GFP_ZERO,
 					   get_order(size));
 	if (!buckets) {
 		kfree(ret);
@@ -352,19 +376,52 @@ static void neigh_hash_free_rcu(struct rcu_head *head)
 	kfree(nht);
 }
 
-static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
-						unsigned long new_shift)
+static void neigh_hash_free(struct neigh_hash_table *nht)
 {
-	unsigned int i, hash;
+	neigh_hash_free_rcu(&nht->rcu);
+}
+
+static bool neigh_hash_needs_grow(const struct neigh_table *tbl,
+				  const struct neigh_hash_table *nht)
+{
+	return atomic_read(&tbl->entries) > (1 << nht->hash_shift);
+}
+
+/* Growing is deferred to process context: the new bucket array is
+ * allocated with GFP_KERNEL outside tbl->lock, and neither neighbour
+ * creation nor the packet path ever waits for it.  Only relinking the
+ * entries happens under the lock; lookups keep running under RCU.
+ */
+static void neigh_hash_grow_work(struct work_struct *work)
+{
+	struct neigh_table *tbl = container_of(work, struct neigh_table,
+					       grow_work);
 	struct neigh_hash_table *new_nht, *old_nht;
+	unsigned int i, hash, new_shift;
 
-	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
+	rcu_read_lock_bh();
+	old_nht = rcu_dereference_bh(tbl->nht);
+	new_shift = old_nht->hash_shift + 1;
+	if (!neigh_hash_needs_grow(tbl, old_nht)) {
+		rcu_read_unlock_bh();
+		return;
+	}
+	rcu_read_unlock_bh();
 
+	new_nht = neigh_hash_alloc(new_shift, GFP_KERNEL);
+	if (!new_nht)
+		return;
+
+	write_lock_bh(&tbl->lock);
 	old_nht = rcu_dereference_protected(tbl->nht,
 					    lockdep_is_held(&tbl->lock));
-	new_nht = neigh_hash_alloc(new_shift);
-	if (!new_nht)
-		return old_nht;
+	if (old_nht->hash_shift + 1 != new_shift) {
+		write_unlock_bh(&tbl->lock);
+		neigh_hash_free(new_nht);
+		return;
+	}
+
+	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
 
 	for (i = 0; i < (1 << old_nht->hash_shift); i++) {
 		struct neighbour *n, *next;
@@ -389,8 +446,12 @@ static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
 	}
 
 	rcu_assign_pointer(tbl->nht, new_nht);
+	/* the gc cursors index the old table; the new one has twice the
+	 * buckets, so they stay in range and at worst revisit some entries
+	 */
+	write_unlock_bh(&tbl->lock);
+
 	call_rcu(&old_nht->rcu, neigh_hash_free_rcu);
-	return new_nht;
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
@@ -499,8 +560,8 @@ struct neighbour *__neigh_create(struct neigh_table *tbl, const void *pkey,
 	nht = rcu_dereference_protected(tbl->nht,
 					lockdep_is_held(&tbl->lock));
 
-	if (atomic_read(&tbl->entries) > (1 << nht->hash_shift))
-		nht = neigh_hash_grow(tbl, nht->hash_shift + 1);
+	if (neigh_hash_needs_grow(tbl, nht))
+		schedule_work(&tbl->grow_work);
 
 	hash_val = tbl->hash(pkey, dev, nht->hash_rnd) >> (32 - nht->hash_shift);
 
@@ -749,9 +810,10 @@ static void neigh_connect(struct neighbour *neigh)
 static void neigh_periodic_work(struct work_struct *work)
 {
 	struct neigh_table *tbl = container_of(work, struct neigh_table, gc_work.work);
+	unsigned long interval;
 	struct neighbour *n;
 	struct neighbour __rcu **np;
-	unsigned int i;
+	unsigned int i, mask, todo;
 	struct neigh_hash_table *nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
@@ -775,7 +837,13 @@ static void neigh_periodic_work(struct work_struct *work)
 	if (atomic_read(&tbl->entries) < tbl->gc_thresh1)
 		goto out;
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
+	/* Only look at one slice of the table per run; tbl->gc_bucket
+	 * remembers where to carry on next time.
+	 */
+	mask = (1 << nht->hash_shift) - 1;
+	todo = DIV_ROUND_UP(mask + 1, NEIGH_GC_SLICES);
+	i = tbl->gc_bucket & mask;
+	for (; todo; todo--, i = (i + 1) & mask) {
 		np = &nht->hash_buckets[i];
 
 		while ((n = rcu_dereference_protected(*np,
@@ -816,14 +884,17 @@ next_elt:
 		write_lock_bh(&tbl->lock);
 		nht = rcu_dereference_protected(tbl->nht,
 						lockdep_is_held(&tbl->lock));
+		mask = (1 << nht->hash_shift) - 1;
 	}
+	tbl->gc_bucket = i;
 out:
-	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
-	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
-	 * BASE_REACHABLE_TIME.
+	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks,
+	 * one slice per run.  ARP entry timeouts range from 1/2
+	 * BASE_REACHABLE_TIME to 3/2 BASE_REACHABLE_TIME.
 	 */
+	interval = NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1;
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
-			      NEIGH_VAR(&tbl->parms, BASE_REACHABLE_TIME) >> 1);
+			   max(interval / NEIGH_GC_SLICES, 1UL));
 	write_unlock_bh(&tbl->lock);
 }
 
@@ -1538,7 +1609,7 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 		panic("cannot create neighbour proc dir entry");
 #endif
 
-	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3));
+	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3, GFP_KERNEL));
 
 	phsize = (PNEIGH_HASHMASK + 1) * sizeof(struct pneigh_entry *);
 	tbl->phash_buckets = kzalloc(phsize, GFP_KERNEL);
@@ -1554,6 +1625,7 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 
 	rwlock_init(&tbl->lock);
 	INIT_DEFERRABLE_WORK(&tbl->gc_work, neigh_periodic_work);
+	INIT_WORK(&tbl->grow_work, neigh_hash_grow_work);
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
 			tbl->parms.reachable_time);
 	setup_timer(&tbl->proxy_timer, neigh_proxy_process, (unsigned long)tbl);
@@ -1572,6 +1644,7 @@ int neigh_table_clear(int index, struct neigh_table *tbl)
 	neigh_tables[index] = NULL;
 	/* It is not clean... Fix it to unload IPv6 module safely */
 	cancel_delayed_work_sync(&tbl->gc_work);
+	cancel_work_sync(&tbl->grow_work);
 	del_timer_sync(&tbl->proxy_timer);
 	pneigh_queue_purge(&tbl->proxy_queue);
 	neigh_ifdown(tbl, NULL);
@@ -0,0 +1,255 @@
+/*
+ * net/core/page_pool.c	Page recycling for network driver RX buffers
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * See include/net/page_pool.h for how pages and pools fit together.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/err.h>
+#include <linux/rcupdate.h>
+#include <linux/skbuff.h>
+#include <net/page_pool.h>
+
+static inline struct llist_node *page_pool_node(struct page *page)
+{
+	return (struct llist_node *)&page->lru.prev;
+}
+
+static inline struct page *page_pool_node_page(struct llist_node *node)
+{
+	return container_of((struct list_head **)node, struct page, lru.prev);
+}
+
+static inline struct page_pool *page_pool_owner(struct page *page)
+{
+	return (struct page_pool *)page->index;
+}
+
+struct page_pool *page_pool_create(const struct page_pool_params *params)
+{
+	struct page_pool *pool;
+
+	if (params->flags & ~PP_FLAG_ALL)
+		return ERR_PTR(-EINVAL);
+
+	if (params->flags & PP_FLAG_DMA_MAP) {
+		/* the DMA address is kept in page->private */
+		if (sizeof(dma_addr_t) > sizeof(unsigned long))
+			return ERR_PTR(-EOPNOTSUPP);
+		if (!params->dev ||
+		    (params->dma_dir != DMA_FROM_DEVICE &&
+		     params->dma_dir != DMA_BIDIRECTIONAL))
+			return ERR_PTR(-EINVAL);
+	}
+
+	if (params->pool_size > PP_RING_SIZE_MAX)
+		return ERR_PTR(-E2BIG);
+
+	pool = kzalloc_node(sizeof(*pool), GFP_KERNEL, params->nid);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	pool->p = *params;
+	init_llist_head(&pool->ring);
+	atomic_set(&pool->ring_count, 0);
+	atomic_set(&pool->refcnt, 1);
+
+	return pool;
+}
+EXPORT_SYMBOL(page_pool_create);
+
+static void page_pool_put_ref(struct page_pool *pool)
+{
+	if (atomic_dec_and_test(&pool->refcnt))
+		kfree(pool);
+}
+
+static struct page *page_pool_alloc_pages_slow(struct page_pool *pool,
+					       gfp_t gfp)
+{
+	unsigned int size = PAGE_SIZE << pool->p.order;
+	dma_addr_t dma = 0;
+	struct page *page;
+
+	if (pool->p.order)
+		gfp |= __GFP_COMP;
+
+	page = alloc_pages_node(pool->p.nid, gfp, pool->p.order);
+	if (!page)
+		return NULL;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP) {
+		dma = dma_map_page(pool->p.dev, page, 0, size, pool->p.dma_dir);
+		if (dma_mapping_error(pool->p.dev, dma)) {
+			put_page(page);
+			return NULL;
+		}
+	}
+
+	set_page_private(page, dma);
+	page->index = (unsigned long)pool;
+	page->lru.next = (struct list_head *)PP_SIGNATURE;
+	atomic_inc(&pool->refcnt);
+
+	return page;
+}
+
+/* Move pages given back through the ring into the alloc cache. */
+static struct page *page_pool_refill_alloc_cache(struct page_pool *pool)
+{
+	struct llist_node *node, *next, *last;
+
+	if (llist_empty(&pool->ring))
+		return NULL;
+
+	node = llist_del_all(&pool->ring);
+	while (node && pool->alloc_count < PP_ALLOC_CACHE_SIZE) {
+		next = node->next;
+		pool->alloc_cache[pool->alloc_count++] =
+			page_pool_node_page(node);
+		atomic_dec(&pool->ring_count);
+		node = next;
+	}
+
+	/* more than fits: put the rest back for next time */
+	if (node) {
+		for (last = node; last->next; last = last->next)
+			;
+		llist_add_batch(node, last, &pool->ring);
+	}
+
+	if (!pool->alloc_count)
+		return NULL;
+	return pool->alloc_cache[--pool->alloc_count];
+}
+
+struct page *page_pool_alloc_pages(struct page_pool *pool, gfp_t gfp)
+{
+	struct page *page;
+
+	if (likely(pool->alloc_count))
+		return pool->alloc_cache[--pool->alloc_count];
+
+	page = page_pool_refill_alloc_cache(pool);
+	if (page)
+		return page;
+
+	return page_pool_alloc_pages_slow(pool, gfp);
+}
+EXPORT_SYMBOL(page_pool_alloc_pages);
+
+void page_pool_release_page(struct page_pool *pool, struct page *page)
+{
+	/* Whoever clears the signature owns the pool's side of the page */
+	if (cmpxchg(&page->lru.next, (struct list_head *)PP_SIGNATURE,
+		    NULL) != (struct list_head *)PP_SIGNATURE)
+		return;
+
+	if (pool->p.flags & PP_FLAG_DMA_MAP)
+		dma_unmap_page(pool->p.dev, page_pool_get_dma_addr(page),
+			       PAGE_SIZE << pool->p.order, pool->p.dma_dir);
+	set_page_private(page, 0);
+	page->index = 0;
+
+	page_pool_put_ref(pool);
+}
+EXPORT_SYMBOL(page_pool_release_page);
+
+static bool page_pool_recycle(struct page_pool *pool, struct page *page,
+			      bool allow_direct)
+{
+	bool ret = false;
+
+	if (allow_direct && pool->alloc_count < PP_ALLOC_CACHE_SIZE) {
+		pool->alloc_cache[pool->alloc_count++] = page;
+		return true;
+	}
+
+	/* page_pool_destroy() waits for us before draining the ring */
+	rcu_read_lock();
+	if (likely(!ACCESS_ONCE(pool->destroyed))) {
+		if (atomic_inc_return(&pool->ring_count) <= pool->p.pool_size) {
+			llist_add(page_pool_node(page), &pool->ring);
+			ret = true;
+		} else {
+			atomic_dec(&pool->ring_count);
+		}
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+void page_pool_put_page(struct page_pool *pool, struct page *page,
+			bool allow_direct)
+{
+	if (likely(page_count(page) == 1)) {
+		/* We hold the only reference, so the page can't leave the
+		 * pool under us any more; check it hasn't already.
+		 */
+		smp_rmb();
+		if (unlikely(!page_is_pool_page(page))) {
+			put_page(page);
+			return;
+		}
+		if (page_pool_recycle(pool, page, allow_direct))
+			return;
+	}
+
+	page_pool_release_page(pool, page);
+	put_page(page);
+}
+EXPORT_SYMBOL(page_pool_put_page);
+
+/* Called for each page of an skb marked for recycling.  Returns false if
+ * @page isn't a pool page, and the caller has to drop its reference.
+ */
+bool page_pool_return_skb_page(struct page *page)
+{
+	page = compound_head(page);
+	if (!page_is_pool_page(page))
+		return false;
+
+	page_pool_put_page(page_pool_owner(page), page, false);
+	return true;
+}
+EXPORT_SYMBOL(page_pool_return_skb_page);
+
+static void page_pool_free_page(struct page_pool *pool, struct page *page)
+{
+	page_pool_release_page(pool, page);
+	put_page(page);
+}
+
+/* The driver must have stopped using the pool, NAPI included.  Pages still
+ * in flight keep the pool around and are released as they come back.
+ */
+void page_pool_destroy(struct page_pool *pool)
+{
+	struct llist_node *node, *next;
+
+	pool->destroyed = true;
+	synchronize_rcu();
+
+	node = llist_del_all(&pool->ring);
+	while (node) {
+		next = node->next;
+		page_pool_free_page(pool, page_pool_node_page(node));
+		node = next;
+	}
+
+	while (pool->alloc_count)
+		page_pool_free_page(pool,
+				    pool->alloc_cache[--pool->alloc_count]);
+
+	page_pool_put_ref(pool);
+}
+EXPORT_SYMBOL(page_pool_destroy);
@@ -177,7 +177,7 @@
 #include <asm/dma.h>
 #include <asm/div64.h>		/* do_div */
 
-#define VERSION	"2.74"
+#define VERSION	"2.75"
 #define IP_NAME_SZ 32
 #define MAX_MPLS_LABELS 16 /* This is the max label stack depth */
 #define MPLS_STACK_BOTTOM htonl(0x00000100)
@@ -218,6 +218,7 @@
 #define PKTGEN_MAGIC 0xbe9be955
 #define PG_PROC_DIR "pktgen"
 #define PGCTRL	    "pgctrl"
+#define PGRX	    "pgrx"
 
 #define MAX_CFLOWS  65536
 
@@ -410,11 +411,40 @@ struct pktgen_hdr {
 
 static int pg_net_id __read_mostly;
 
+/* Latency histogram buckets, by log2 of the latency in usecs */
+#define PG_RX_LAT_BUCKETS 24
+
+/* What one CPU saw of the pktgen packets it received */
+struct pktgen_rx_stats {
+	u64 packets;
+	u64 bytes;
+	u64 lost;		/* estimated from sequence number gaps */
+	u64 reordered;		/* sequence number went backwards */
+	u32 last_seq;
+	u32 copies;		/* packets received carrying last_seq */
+
+	u64 lat_count;		/* timestamped packets */
+	u64 lat_sum;		/* usecs */
+	u32 lat_min;
+	u32 lat_max;
+	u64 lat_hist[PG_RX_LAT_BUCKETS];
+
+	ktime_t first_rx;
+	ktime_t last_rx;
+};
+
 struct pktgen_net {
 	struct net		*net;
 	struct proc_dir_entry	*proc_dir;
 	struct list_head	pktgen_threads;
 	bool			pktgen_exiting;
+
+	/* Receive side, see pktgen_rcv() */
+	struct pktgen_rx_stats __percpu *rx_stats;
+	struct packet_type	rx_pt_ipv4;
+	struct packet_type	rx_pt_ipv6;
+	int			rx_ifindex;	/* 0: any device */
+	bool			rx_enabled;	/* under pktgen_thread_lock */
 };
 
 struct pktgen_thread {
@@ -3412,6 +3442,319 @@ unlock:
 	}
 }
 
+/*
+ * Receive side
+ *
+ * "rx <ifname>" written to /proc/net/pktgen/pgrx starts counting the
+ * pktgen packets that arrive on ifname ("rx any" for every device of the
+ * namespace), next to their normal processing by the stack.  Each CPU
+ * keeps its own counters, so with RSS spreading one pktgen device per RX
+ * queue the sequence accounting follows a single sender per CPU.
+ *
+ * Loss is estimated from gaps in the sequence numbers.  Copies sent with
+ * clone_skb or burst carry the sequence number of the first one and the
+ * sender skips ahead by the number of copies, which the receiver accounts
+ * for.  Latency needs the sender's timestamps and a clock shared with the
+ * sender, i.e. both ends on one host or synchronized clocks.
+ */
+
+static void pktgen_rx_seq(struct pktgen_rx_stats *st, u32 seq)
+{
+	u32 gap;
+
+	if (!st->packets) {
+		st->last_seq = seq;
+		st->copies = 1;
+		return;
+	}
+
+	if (seq == st->last_seq) {
+		st->copies++;
+	} else if ((s32)(seq - st->last_seq) > 0) {
+		gap = seq - st->last_seq;
+		if (gap > st->copies)
+			st->lost += gap - st->copies;
+		st->last_seq = seq;
+		st->copies = 1;
+	} else {
+		/* counted as lost when we skipped over it */
+		st->reordered++;
+		if (st->lost)
+			st->lost--;
+	}
+}
+
+static void pktgen_rx_latency(struct pktgen_rx_stats *st, ktime_t now,
+			      const struct pktgen_hdr *pgh)
+{
+	ktime_t sent;
+	s64 lat;
+	u32 us;
+
+	if (!pgh->tv_sec && !pgh->tv_usec)
+		return;		/* sender runs with NO_TIMESTAMP */
+
+	sent = ktime_set(ntohl(pgh->tv_sec),
+			 ntohl(pgh->tv_usec) * NSEC_PER_USEC);
+	lat = ktime_us_delta(now, sent);
+	us = clamp_t(s64, lat, 0, U32_MAX);	/* clock skew */
+
+	if (!st->lat_count || us < st->lat_min)
+		st->lat_min = us;
+	if (us > st->lat_max)
+		st->lat_max = us;
+	st->lat_count++;
+	st->lat_sum += us;
+	st->lat_hist[min_t(int, fls(us), PG_RX_LAT_BUCKETS - 1)]++;
+}
+
+/* Offset of the pktgen header past the IP and UDP headers, or 0 */
+static unsigned int pktgen_rx_hdr_offset(struct sk_buff *skb)
+{
+	if (skb->protocol == htons(ETH_P_IP)) {
+		const struct iphdr *iph;
+		struct iphdr _iph;
+
+		iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+		if (!iph || iph->ihl < 5 || iph->protocol != IPPROTO_UDP ||
+		    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+			return 0;
+		return iph->ihl * 4 + sizeof(struct udphdr);
+	} else {
+		const struct ipv6hdr *ip6h;
+		struct ipv6hdr _ip6h;
+
+		ip6h = skb_header_pointer(skb, 0, sizeof(_ip6h), &_ip6h);
+		if (!ip6h || ip6h->nexthdr != IPPROTO_UDP)
+			return 0;
+		return sizeof(struct ipv6hdr) + sizeof(struct udphdr);
+	}
+}
+
+static int pktgen_rcv(struct sk_buff *skb, struct net_device *dev,
+		      struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct pktgen_net *pn = pt->af_packet_priv;
+	int ifindex = ACCESS_ONCE(pn->rx_ifindex);
+	const struct pktgen_hdr *pgh;
+	struct pktgen_rx_stats *st;
+	struct pktgen_hdr _pgh;
+	unsigned int off;
+	ktime_t now;
+
+	if (skb->pkt_type == PACKET_OTHERHOST ||
+	    !net_eq(dev_net(dev), pn->net) ||
+	    (ifindex && orig_dev->ifindex != ifindex))
+		goto out;
+
+	off = pktgen_rx_hdr_offset(skb);
+	if (!off)
+		goto out;
+	pgh = skb_header_pointer(skb, off, sizeof(_pgh), &_pgh);
+	if (!pgh || pgh->pgh_magic != htonl(PKTGEN_MAGIC))
+		goto out;
+
+	now = ktime_get_real();
+	st = this_cpu_ptr(pn->rx_stats);
+
+	pktgen_rx_seq(st, ntohl(pgh->seq_num));
+	pktgen_rx_latency(st, now, pgh);
+
+	if (!st->packets)
+		st->first_rx = now;
+	st->last_rx = now;
+	st->packets++;
+	st->bytes += skb->len;
+out:
+	consume_skb(skb);
+	return NET_RX_SUCCESS;
+}
+
+static void pktgen_rx_disable(struct pktgen_net *pn)
+{
+	if (!pn->rx_enabled)
+		return;
+	dev_remove_pack(&pn->rx_pt_ipv4);
+	dev_remove_pack(&pn->rx_pt_ipv6);
+	pn->rx_enabled = false;
+}
+
+/* Counters are only touched from pktgen_rcv(), so reset them with the
+ * handlers unhooked.
+ */
+static void pktgen_rx_reset(struct pktgen_net *pn)
+{
+	bool enabled = pn->rx_enabled;
+	int cpu;
+
+	pktgen_rx_disable(pn);
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(pn->rx_stats, cpu), 0,
+		       sizeof(struct pktgen_rx_stats));
+	if (enabled) {
+		dev_add_pack(&pn->rx_pt_ipv4);
+		dev_add_pack(&pn->rx_pt_ipv6);
+		pn->rx_enabled = true;
+	}
+}
+
+static int pktgen_rx_enable(struct pktgen_net *pn, const char *ifname)
+{
+	struct net_device *dev;
+	int ifindex = 0;
+
+	if (strcmp(ifname, "any")) {
+		dev = dev_get_by_name(pn->net, ifname);
+		if (!dev)
+			return -ENODEV;
+		ifindex = dev->ifindex;
+		dev_put(dev);
+	}
+
+	pktgen_rx_disable(pn);
+	pn->rx_ifindex = ifindex;
+	pktgen_rx_reset(pn);
+	dev_add_pack(&pn->rx_pt_ipv4);
+	dev_add_pack(&pn->rx_pt_ipv6);
+	pn->rx_enabled = true;
+	return 0;
+}
+
+static void pktgen_rx_init(struct pktgen_net *pn)
+{
+	pn->rx_pt_ipv4.type = htons(ETH_P_IP);
+	pn->rx_pt_ipv4.func = pktgen_rcv;
+	pn->rx_pt_ipv4.af_packet_priv = pn;
+	pn->rx_pt_ipv6.type = htons(ETH_P_IPV6);
+	pn->rx_pt_ipv6.func = pktgen_rcv;
+	pn->rx_pt_ipv6.af_packet_priv = pn;
+}
+
+static int pgrx_show(struct seq_file *seq, void *v)
+{
+	struct pktgen_net *pn = seq->private;
+	struct pktgen_rx_stats sum = {};
+	ktime_t first = ktime_set(0, 0), last = ktime_set(0, 0);
+	u64 elapsed, pps = 0, bps = 0;
+	int cpu, i;
+
+	seq_printf(seq, "Receive: %s ifindex: %d\n",
+		   pn->rx_enabled ? "enabled" : "disabled", pn->rx_ifindex);
+
+	for_each_possible_cpu(cpu) {
+		const struct pktgen_rx_stats *st = per_cpu_ptr(pn->rx_stats, cpu);
+
+		if (!st->packets)
+			continue;
+
+		seq_printf(seq, "  CPU %d: packets: %llu  lost: %llu  reordered: %llu\n",
+			   cpu, st->packets, st->lost, st->reordered);
+
+		if (!sum.packets || ktime_before(st->first_rx, first))
+			first = st->first_rx;
+		if (ktime_after(st->last_rx, last))
+			last = st->last_rx;
+		if (st->lat_count &&
+		    (!sum.lat_count || st->lat_min < sum.lat_min))
+			sum.lat_min = st->lat_min;
+		sum.lat_max = max(sum.lat_max, st->lat_max);
+
+		sum.packets += st->packets;
+		sum.bytes += st->bytes;
+		sum.lost += st->lost;
+		sum.reordered += st->reordered;
+		sum.lat_count += st->lat_count;
+		sum.lat_sum += st->lat_sum;
+		for (i = 0; i < PG_RX_LAT_BUCKETS; i++)
+			sum.lat_hist[i] += st->lat_hist[i];
+	}
+
+	elapsed = ktime_to_ns(ktime_sub(last, first));
+	if (elapsed) {
+		pps = div64_u64(sum.packets * NSEC_PER_SEC, elapsed);
+		bps = div64_u64(sum.bytes * 8 * NSEC_PER_SEC, elapsed);
+	}
+
+	seq_printf(seq, "Result: packets: %llu  bytes: %llu  lost: %llu  reordered: %llu\n",
+		   sum.packets, sum.bytes, sum.lost, sum.reordered);
+	seq_printf(seq, "  %lluus %llupps %lluMb/sec (%llubps)\n",
+		   div64_u64(elapsed, NSEC_PER_USEC), pps, bps / 1000000, bps);
+
+	if (!sum.lat_count)
+		return 0;
+
+	seq_printf(seq, "Latency: min: %uus  avg: %lluus  max: %uus\n",
+		   sum.lat_min, div64_u64(sum.lat_sum, sum.lat_count),
+		   sum.lat_max);
+	for (i = 0; i < PG_RX_LAT_BUCKETS; i++) {
+		if (!sum.lat_hist[i])
+			continue;
+		if (i == PG_RX_LAT_BUCKETS - 1)
+			seq_printf(seq, "  >= %luus: %llu\n",
+				   1UL << (i - 1), sum.lat_hist[i]);
+		else
+			seq_printf(seq, "  < %luus: %llu\n",
+				   1UL << i, sum.lat_hist[i]);
+	}
+
+	return 0;
+}
+
+static ssize_t pgrx_write(struct file *file, const char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	struct seq_file *seq = file->private_data;
+	struct pktgen_net *pn = seq->private;
+	char data[128];
+	int err = 0;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (count == 0)
+		return -EINVAL;
+
+	if (count > sizeof(data))
+		count = sizeof(data);
+
+	if (copy_from_user(data, buf, count))
+		return -EFAULT;
+
+	data[count - 1] = 0;	/* Strip trailing '\n' and terminate string */
+
+	mutex_lock(&pktgen_thread_lock);
+
+	if (!strncmp(data, "rx ", 3))
+		err = pktgen_rx_enable(pn, strstrip(data + 3));
+
+	else if (!strcmp(data, "rx_reset"))
+		pktgen_rx_reset(pn);
+
+	else if (!strcmp(data, "rx_disable"))
+		pktgen_rx_disable(pn);
+
+	else
+		pr_warn("Unknown command: %s\n", data);
+
+	mutex_unlock(&pktgen_thread_lock);
+
+	return err ? err : count;
+}
+
+static int pgrx_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pgrx_show, PDE_DATA(inode));
+}
+
+static const struct file_operations pktgen_rx_fops = {
+	.owner   = THIS_MODULE,
+	.open    = pgrx_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.write   = pgrx_write,
+	.release = single_release,
+};
+
 /*
  * Main loop of the thread goes here
  */
@@ -3767,6 +4110,19 @@ static int __net_init pg_net_init(struct net *net)
 		goto remove;
 	}
 
+	pn->rx_stats = alloc_percpu(struct pktgen_rx_stats);
+	if (!pn->rx_stats) {
+		ret = -ENOMEM;
+		goto remove_entry;
+	}
+	pktgen_rx_init(pn);
+	pe = proc_create_data(PGRX, 0600, pn->proc_dir, &pktgen_rx_fops, pn);
+	if (pe == NULL) {
+		pr_err("cannot create %s procfs entry\n", PGRX);
+		ret = -EINVAL;
+		goto free_rx;
+	}
+
 	for_each_online_cpu(cpu) {
 		int err;
 
@@ -3779,11 +4135,15 @@ static int __net_init pg_net_init(struct net *net)
 	if (list_empty(&pn->pktgen_threads)) {
 		pr_err("Initialization failed for all threads\n");
 		ret = -ENODEV;
-		goto remove_entry;
+		goto remove_rx_entry;
 	}
 
 	return 0;
 
+remove_rx_entry:
+	remove_proc_entry(PGRX, pn->proc_dir);
+free_rx:
+	free_percpu(pn->rx_stats);
 remove_entry:
 	remove_proc_entry(PGCTRL, pn->proc_dir);
 remove:
@@ -3812,6 +4172,12 @@ static void __net_exit pg_net_exit(struct net *net)
 		kfree(t);
 	}
 
+	mutex_lock(&pktgen_thread_lock);
+	pktgen_rx_disable(pn);
+	mutex_unlock(&pktgen_thread_lock);
+	remove_proc_entry(PGRX, pn->proc_dir);
+	free_percpu(pn->rx_stats);
+
 	remove_proc_entry(PGCTRL, pn->proc_dir);
 	remove_proc_entry(PG_PROC_DIR, pn->net->proc_net);
 }
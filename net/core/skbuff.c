@@ -591,10 +591,15 @@ static void skb_clone_fraglist(struct sk_buff *skb)
 
 static void skb_free_head(struct sk_buff *skb)
 {
-	if (skb->head_frag)
-		put_page(virt_to_head_page(skb->head));
-	else
+	if (skb->head_frag) {
+		struct page *page = virt_to_head_page(skb->head);
+
+		if (skb->pp_recycle && page_pool_return_skb_page(page))
+			return;
+		put_page(page);
+	} else {
 		kfree(skb->head);
+	}
 }
 
 static void skb_release_data(struct sk_buff *skb)
@@ -608,7 +613,7 @@ static void skb_release_data(struct sk_buff *skb)
 		return;
 
 	for (i = 0; i < shinfo->nr_frags; i++)
-		__skb_frag_unref(&shinfo->frags[i]);
+		skb_frag_unref(skb, i);
 
 	/*
 	 * If skb buf is from userspace, we need to notify the caller
@@ -862,6 +867,7 @@ static struct sk_buff *__skb_clone(struct sk_buff *n, struct sk_buff *skb)
 	C(end);
 	C(head);
 	C(head_frag);
+	C(pp_recycle);
 	C(data);
 	C(truesize);
 	atomic_set(&n->users, 1);
@@ -890,6 +896,208 @@ struct sk_buff *skb_morph(struct sk_buff *dst, struct sk_buff *src)
 }
 EXPORT_SYMBOL_GPL(skb_morph);
 
+/* MSG_ZEROCOPY completion state lives in the cb of the notification skb
+ * that is queued on the error queue once the last reference is dropped.
+ */
+struct ubuf_info *sock_zerocopy_alloc(struct sock *sk, size_t size)
+{
+	struct ubuf_info *uarg;
+	struct sk_buff *skb;
+
+	BUILD_BUG_ON(sizeof(*uarg) > sizeof(skb->cb));
+
+	skb = sock_omalloc(sk, 0, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	uarg = (void *)skb->cb;
+
+	uarg->callback = sock_zerocopy_callback;
+	uarg->id = ((u32)atomic_inc_return(&sk->sk_zckey)) - 1;
+	uarg->len = 1;
+	uarg->bytelen = size;
+	uarg->zerocopy = 1;
+	atomic_set(&uarg->refcnt, 1);
+	sock_hold(sk);
+
+	return uarg;
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_alloc);
+
+static inline struct sk_buff *skb_from_uarg(struct ubuf_info *uarg)
+{
+	return container_of((void *)uarg, struct sk_buff, cb);
+}
+
+static void __sock_zerocopy_callback(struct ubuf_info *uarg)
+{
+	struct sk_buff *tail, *skb = skb_from_uarg(uarg);
+	struct sock_exterr_skb *serr;
+	struct sock *sk = skb->sk;
+	struct sk_buff_head *q;
+	unsigned long flags;
+	u32 lo, hi;
+	u16 len;
+
+	/* if !len, there was only 1 call, and it was aborted
+	 * so do not queue a completion notification
+	 */
+	if (!uarg->len || sock_flag(sk, SOCK_DEAD))
+		goto release;
+
+	len = uarg->len;
+	lo = uarg->id;
+	hi = uarg->id + len - 1;
+
+	serr = SKB_EXT_ERR(skb);
+	memset(serr, 0, sizeof(*serr));
+	serr->ee.ee_errno = 0;
+	serr->ee.ee_origin = SO_EE_ORIGIN_ZEROCOPY;
+	serr->ee.ee_data = hi;
+	serr->ee.ee_info = lo;
+	if (!uarg->zerocopy)
+		serr->ee.ee_code |= SO_EE_CODE_ZEROCOPY_COPIED;
+
+	q = &sk->sk_error_queue;
+	spin_lock_irqsave(&q->lock, flags);
+	tail = skb_peek_tail(q);
+	if (!tail || SKB_EXT_ERR(tail)->ee.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+	    SKB_EXT_ERR(tail)->ee.ee_code != serr->ee.ee_code ||
+	    SKB_EXT_ERR(tail)->ee.ee_data + 1 != lo ||
+	    (u64)SKB_EXT_ERR(tail)->ee.ee_data + len >
+	    (u64)SKB_EXT_ERR(tail)->ee.ee_info + U32_MAX) {
+		__skb_queue_tail(q, skb);
+		skb = NULL;
+	} else {
+		/* coalesce with the contiguous notification already queued */
+		SKB_EXT_ERR(tail)->ee.ee_data = hi;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	sk->sk_error_report(sk);
+
+release:
+	consume_skb(skb);
+	sock_put(sk);
+}
+
+void sock_zerocopy_put(struct ubuf_info *uarg)
+{
+	if (uarg && atomic_dec_and_test(&uarg->refcnt))
+		__sock_zerocopy_callback(uarg);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put);
+
+/* Called for every skb that drops its frags.  Pages that had to be copied
+ * (skb_copy_ubufs) taint the whole notification as a copy.
+ */
+void sock_zerocopy_callback(struct ubuf_info *uarg, bool success)
+{
+	if (!success)
+		uarg->zerocopy = 0;
+
+	sock_zerocopy_put(uarg);
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_callback);
+
+/* Drop the reference of a send call that failed before queueing any data */
+void sock_zerocopy_put_abort(struct ubuf_info *uarg)
+{
+	if (uarg) {
+		struct sock *sk = skb_from_uarg(uarg)->sk;
+
+		atomic_dec(&sk->sk_zckey);
+		uarg->len--;
+
+		sock_zerocopy_put(uarg);
+	}
+}
+EXPORT_SYMBOL_GPL(sock_zerocopy_put_abort);
+
+/* Let @nskb share the MSG_ZEROCOPY frags of @orig.  Frags pinned by another
+ * mechanism cannot be shared and are copied instead.
+ */
+int skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig,
+		       gfp_t gfp_mask)
+{
+	if (skb_zcopy(orig) &&
+	    skb_uarg(orig)->callback == sock_zerocopy_callback) {
+		if (skb_zcopy(nskb)) {
+			if (skb_uarg(nskb) == skb_uarg(orig))
+				return 0;
+			if (skb_copy_ubufs(nskb, gfp_mask))
+				return -EIO;
+		}
+		skb_zcopy_set(nskb, skb_uarg(orig));
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_clone);
+
+/**
+ *	skb_zerocopy_iter_stream - pin user pages into a stream skb
+ *	@sk: socket the data is sent on
+ *	@skb: buffer to append frags to
+ *	@from: user address to send from
+ *	@len: bytes to send
+ *	@uarg: completion state of the current send call
+ *
+ *	Returns the number of bytes added, which may be short of @len when
+ *	the skb runs out of frags, or a negative error if nothing was added.
+ *	-EEXIST means @skb already holds frags of another send call.
+ */
+int skb_zerocopy_iter_stream(struct sock *sk, struct sk_buff *skb,
+			     const void __user *from, size_t len,
+			     struct ubuf_info *uarg)
+{
+	struct iovec iov = { .iov_base = (void __user *)from, .iov_len = len };
+	struct iov_iter it;
+	int err, orig_len = skb->len;
+
+	/* An skb can only point to one uarg. This edge case happens when
+	 * TCP appends to an skb, but zerocopy_realloc triggered a new alloc.
+	 */
+	if (skb_zcopy(skb) && skb_uarg(skb) != uarg)
+		return -EEXIST;
+
+	iov_iter_init(&it, WRITE, &iov, 1, len);
+	err = __zerocopy_sg_from_iter(sk, skb, &it, len);
+	if (skb->len == orig_len)
+		return err ? : -EFAULT;
+
+	if (!skb_zcopy(skb))
+		skb_zcopy_set(skb, uarg);
+
+	return skb->len - orig_len;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iter_stream);
+
+/**
+ *	skb_zerocopy_iter_dgram - pin user pages into a datagram skb
+ *	@skb: buffer to append frags to
+ *	@msg: message being sent
+ *	@offset: offset into the message payload
+ *	@len: bytes to pin
+ *	@uarg: completion state of the current send call
+ *
+ *	Returns 0 or a negative error.
+ */
+int skb_zerocopy_iter_dgram(struct sk_buff *skb, struct msghdr *msg,
+			    int offset, int len, struct ubuf_info *uarg)
+{
+	struct iov_iter it = msg->msg_iter;
+	int err;
+
+	iov_iter_advance(&it, offset);
+	err = __zerocopy_sg_from_iter(skb->sk, skb, &it, len);
+
+	if (skb->data_len && !skb_zcopy(skb))
+		skb_zcopy_set(skb, uarg);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(skb_zerocopy_iter_dgram);
+
 /**
  *	skb_copy_ubufs	-	copy userspace skb frags buffers to kernel
  *	@skb: the skb to modify
@@ -1107,7 +1315,8 @@ struct sk_buff *__pskb_copy_fclone(struct sk_buff *skb, int headroom,
 	if (skb_shinfo(skb)->nr_frags) {
 		int i;
 
-		if (skb_orphan_frags(skb, gfp_mask)) {
+		if (skb_orphan_frags(skb, gfp_mask) ||
+		    skb_zerocopy_clone(n, skb, gfp_mask)) {
 			kfree_skb(n);
 			n = NULL;
 			goto out;
@@ -1117,6 +1326,7 @@ struct sk_buff *__pskb_copy_fclone(struct sk_buff *skb, int headroom,
 			skb_frag_ref(skb, i);
 		}
 		skb_shinfo(n)->nr_frags = i;
+		n->pp_recycle = skb->pp_recycle;
 	}
 
 	if (skb_has_frag_list(skb)) {
@@ -1187,6 +1397,8 @@ int pskb_expand_head(struct sk_buff *skb, int nhead, int ntail,
 		/* copy this zero copy skb frags */
 		if (skb_orphan_frags(skb, gfp_mask))
 			goto nofrags;
+		if (skb_zcopy(skb))
+			sock_zerocopy_get(skb_uarg(skb));
 		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
 			skb_frag_ref(skb, i);
 
@@ -1902,15 +2114,43 @@ static bool __skb_splice_bits(struct sk_buff *skb, struct pipe_inode_info *pipe,
 	return false;
 }
 
+ssize_t skb_socket_splice(struct sock *sk,
+			  struct pipe_inode_info *pipe,
+			  struct splice_pipe_desc *spd)
+{
+	int ret;
+
+	/* Drop the socket lock, otherwise we have reverse
+	 * locking dependencies between sk_lock and i_mutex
+	 * here as compared to sendfile(). We enter here
+	 * with the socket lock held, and splice_to_pipe() will
+	 * grab the pipe inode lock. For sendfile() emulation,
+	 * we call into ->sendpage() with the i_mutex lock held
+	 * and networking will grab the socket lock.
+	 */
+	release_sock(sk);
+	ret = splice_to_pipe(pipe, spd);
+	lock_sock(sk);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(skb_socket_splice);
+
 /*
  * Map data from the skb to a pipe. Should handle both the linear part,
  * the fragments, and the frag list. It does NOT handle frag lists within
  * the frag list, if such a thing exists. We'd probably need to recurse to
  * handle that cleanly.
+ *
+ * @sk is the receiving socket, whose locking @splice_cb knows how to drop
+ * around splice_to_pipe().
  */
-int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
+int skb_splice_bits(struct sk_buff *skb, struct sock *sk, unsigned int offset,
 		    struct pipe_inode_info *pipe, unsigned int tlen,
-		    unsigned int flags)
+		    unsigned int flags,
+		    ssize_t (*splice_cb)(struct sock *,
+					 struct pipe_inode_info *,
+					 struct splice_pipe_desc *))
 {
 	struct partial_page partial[MAX_SKB_FRAGS];
 	struct page *pages[MAX_SKB_FRAGS];
@@ -1923,7 +2163,6 @@ int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
 		.spd_release = sock_spd_release,
 	};
 	struct sk_buff *frag_iter;
-	struct sock *sk = skb->sk;
 	int ret = 0;
 
 	/*
@@ -1946,20 +2185,8 @@ int skb_splice_bits(struct sk_buff *skb, unsigned int offset,
 	}
 
 done:
-	if (spd.nr_pages) {
-		/*
-		 * Drop the socket lock, otherwise we have reverse
-		 * locking dependencies between sk_lock and i_mutex
-		 * here as compared to sendfile(). We enter here
-		 * with the socket lock held, and splice_to_pipe() will
-		 * grab the pipe inode lock. For sendfile() emulation,
-		 * we call into ->sendpage() with the i_mutex lock held
-		 * and networking will grab the socket lock.
-		 */
-		release_sock(sk);
-		ret = splice_to_pipe(pipe, &spd);
-		lock_sock(sk);
-	}
+	if (spd.nr_pages)
+		ret = splice_cb(sk, pipe, &spd);
 
 	return ret;
 }
@@ -2289,7 +2516,7 @@ skb_zerocopy(struct sk_buff *to, struct sk_buff *from, int len, int hlen)
 	to->len += len + plen;
 	to->data_len += len + plen;
 
-	if (unlikely(skb_orphan_frags(from, GFP_ATOMIC))) {
+	if (unlikely(skb_orphan_frags_rx(from, GFP_ATOMIC))) {
 		skb_tx_error(from);
 		return -ENOMEM;
 	}
@@ -2304,6 +2531,7 @@ skb_zerocopy(struct sk_buff *to, struct sk_buff *from, int len, int hlen)
 		j++;
 	}
 	skb_shinfo(to)->nr_frags = j;
+	to->pp_recycle |= from->pp_recycle;
 
 	return 0;
 }
@@ -2570,6 +2798,8 @@ void skb_split(struct sk_buff *skb, struct sk_buff *skb1, const u32 len)
 	int pos = skb_headlen(skb);
 
 	skb_shinfo(skb1)->tx_flags = skb_shinfo(skb)->tx_flags & SKBTX_SHARED_FRAG;
+	skb_zerocopy_clone(skb1, skb, 0);
+	skb1->pp_recycle = skb->pp_recycle;
 	if (len < pos)	/* Split line is inside header. */
 		skb_split_inside_header(skb, skb1, len, pos);
 	else		/* Second chunk has no header, nothing to copy. */
@@ -2612,6 +2842,13 @@ int skb_shift(struct sk_buff *tgt, struct sk_buff *skb, int shiftlen)
 	BUG_ON(shiftlen > skb->len);
 	BUG_ON(skb_headlen(skb));	/* Would corrupt stream */
 
+	/* Frags of different send calls cannot share one completion */
+	if (skb_zcopy(tgt) || skb_zcopy(skb))
+		return 0;
+
+	/* pool pages of @skb must still find their way home from @tgt */
+	tgt->pp_recycle |= skb->pp_recycle;
+
 	todo = shiftlen;
 	from = 0;
 	to = skb_shinfo(tgt)->nr_frags;
@@ -2948,6 +3185,35 @@ int skb_append_datato_frags(struct sock *sk, struct sk_buff *skb,
 }
 EXPORT_SYMBOL(skb_append_datato_frags);
 
+/**
+ * skb_append_pagefrags - append a page range to the frags of a skb
+ * @skb: skb to append to
+ * @page: page holding the data
+ * @offset: offset of the data in @page
+ * @size: length of the data
+ *
+ * Extends the last frag when @page continues it, otherwise takes a
+ * reference on @page for a new frag.  The caller updates the skb length
+ * and truesize.  Returns -EMSGSIZE when all frags are in use.
+ */
+int skb_append_pagefrags(struct sk_buff *skb, struct page *page,
+			 int offset, size_t size)
+{
+	int i = skb_shinfo(skb)->nr_frags;
+
+	if (skb_can_coalesce(skb, i, page, offset)) {
+		skb_frag_size_add(&skb_shinfo(skb)->frags[i - 1], size);
+	} else if (i < MAX_SKB_FRAGS) {
+		get_page(page);
+		skb_fill_page_desc(skb, i, page, offset, size);
+	} else {
+		return -EMSGSIZE;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(skb_append_pagefrags);
+
 /**
  *	skb_pull_rcsum - pull skb and update receive checksum
  *	@skb: buffer to update
@@ -3089,6 +3355,7 @@ struct sk_buff *skb_segment(struct sk_buff *head_skb,
 		tail = nskb;
 
 		__copy_skb_header(nskb, head_skb);
+		nskb->pp_recycle = head_skb->pp_recycle;
 
 		skb_headers_offset_update(nskb, skb_headroom(nskb) - headroom);
 		skb_reset_mac_len(nskb);
@@ -3140,7 +3407,9 @@ struct sk_buff *skb_segment(struct sk_buff *head_skb,
 				goto err;
 			}
 
-			if (unlikely(skb_orphan_frags(frag_skb, GFP_ATOMIC)))
+			if (unlikely(skb_orphan_frags(frag_skb, GFP_ATOMIC) ||
+				     skb_zerocopy_clone(nskb, frag_skb,
+							GFP_ATOMIC)))
 				goto err;
 
 			*nskb_frag = *frag;
@@ -3232,6 +3501,7 @@ int skb_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 		offset -= headlen;
 		pinfo->nr_frags = nr_frags;
 		skbinfo->nr_frags = 0;
+		lp->pp_recycle |= skb->pp_recycle;
 
 		frag = pinfo->frags + nr_frags;
 		frag2 = skbinfo->frags + i;
@@ -3267,6 +3537,7 @@ int skb_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 			       offset;
 
 		pinfo->nr_frags = nr_frags + 1 + skbinfo->nr_frags;
+		lp->pp_recycle |= skb->pp_recycle;
 
 		frag->page.p	  = page;
 		frag->page_offset = first_offset;
@@ -4107,6 +4378,7 @@ bool skb_try_coalesce(struct sk_buff *to, struct sk_buff *from,
 	       skb_shinfo(from)->frags,
 	       skb_shinfo(from)->nr_frags * sizeof(skb_frag_t));
 	skb_shinfo(to)->nr_frags += skb_shinfo(from)->nr_frags;
+	to->pp_recycle |= from->pp_recycle;
 
 	if (!skb_cloned(from))
 		skb_shinfo(from)->nr_frags = 0;
@@ -4179,6 +4451,8 @@ unsigned int skb_gso_transport_seglen(const struct sk_buff *skb)
 			thlen += inner_tcp_hdrlen(skb);
 	} else if (likely(shinfo->gso_type & (SKB_GSO_TCPV4 | SKB_GSO_TCPV6))) {
 		thlen = tcp_hdrlen(skb);
+	} else if (shinfo->gso_type & SKB_GSO_UDP_L4) {
+		thlen = sizeof(struct udphdr);
 	}
 	/* UFO sets gso_size to the size of the fragmentation
 	 * payload, i.e. the size of the L4 (UDP) header is already
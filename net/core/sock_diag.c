@@ -49,6 +49,27 @@ int sock_diag_put_meminfo(struct sock *sk, struct sk_buff *skb, int attrtype)
 }
 EXPORT_SYMBOL_GPL(sock_diag_put_meminfo);
 
+/* Nothing is put for sockets that don't busy poll */
+int sock_diag_put_busypoll(struct sock *sk, struct sk_buff *skb, int attrtype)
+{
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	u32 bp[SK_BUSY_POLL_VARS];
+
+	if (!sk->sk_ll_usec)
+		return 0;
+
+	bp[SK_BUSY_POLL_USEC] = sk->sk_ll_usec;
+	bp[SK_BUSY_POLL_BUDGET] = sk->sk_busy_poll_budget;
+	bp[SK_BUSY_POLL_HITS] = atomic_read(&sk->sk_busy_poll_hits);
+	bp[SK_BUSY_POLL_MISSES] = atomic_read(&sk->sk_busy_poll_misses);
+
+	return nla_put(skb, attrtype, sizeof(bp), &bp);
+#else
+	return 0;
+#endif
+}
+EXPORT_SYMBOL_GPL(sock_diag_put_busypoll);
+
 int sock_diag_put_filterinfo(bool may_report_filterinfo, struct sock *sk,
 			     struct sk_buff *skb, int attrtype)
 {
@@ -1223,6 +1223,7 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 		       SKB_GSO_UDP_TUNNEL |
 		       SKB_GSO_UDP_TUNNEL_CSUM |
 		       SKB_GSO_TUNNEL_REMCSUM |
+		       SKB_GSO_UDP_L4 |
 		       0)))
 		goto out;
 
@@ -1259,6 +1260,10 @@ static struct sk_buff *inet_gso_segment(struct sk_buff *skb,
 	else
 		udpfrag = proto == IPPROTO_UDP && !skb->encapsulation;
 
+	/* UDP_SEGMENT datagrams are cut into datagrams, not fragments */
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		udpfrag = false;
+
 	ops = rcu_dereference(inet_offloads[proto]);
 	if (likely(ops && ops->callbacks.gso_segment))
 		segs = ops->callbacks.gso_segment(skb, features);
@@ -71,6 +71,7 @@
 #include <linux/init.h>
 #include <linux/list.h>
 #include <linux/slab.h>
+#include <linux/percpu.h>
 #include <linux/export.h>
 #include <net/net_namespace.h>
 #include <net/ip.h>
@@ -95,16 +96,17 @@ typedef unsigned int t_key;
 #define IS_TNODE(n) (!(n->parent & T_LEAF))
 #define IS_LEAF(n) (n->parent & T_LEAF)
 
+/*
+ * slen is the longest suffix (KEYLENGTH minus the shortest prefix
+ * length) held by a leaf or anywhere below a tnode. It is an upper
+ * bound: it is raised as soon as a prefix is added and lowered again
+ * when prefixes go away. Lookups use it to stop backtracking into
+ * subtrees that have no prefix short enough to match.
+ */
 struct rt_trie_node {
 	unsigned long parent;
 	t_key key;
-};
-
-struct leaf {
-	unsigned long parent;
-	t_key key;
-	struct hlist_head list;
-	struct rcu_head rcu;
+	unsigned char slen;
 };
 
 struct leaf_info {
@@ -112,12 +114,26 @@ struct leaf_info {
 	int plen;
 	u32 mask_plen; /* ntohl(inet_make_mask(plen)) */
 	struct list_head falh;
+	unsigned char in_leaf;	/* embedded in its leaf, not allocated */
 	struct rcu_head rcu;
 };
 
+struct leaf {
+	unsigned long parent;
+	t_key key;
+	unsigned char slen;
+	struct hlist_head list;
+	struct rcu_head rcu;
+	/* the prefix the leaf was created for, saving a cache miss for
+	 * the common single prefix leaf
+	 */
+	struct leaf_info li;
+};
+
 struct tnode {
 	unsigned long parent;
 	t_key key;
+	unsigned char slen;
 	unsigned char pos;		/* 2log(KEYLENGTH) bits needed */
 	unsigned char bits;		/* 2log(KEYLENGTH) bits needed */
 	unsigned int full_children;	/* KEYLENGTH bits needed */
@@ -153,7 +169,7 @@ struct trie_stat {
 struct trie {
 	struct rt_trie_node __rcu *trie;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-	struct trie_use_stats stats;
+	struct trie_use_stats __percpu *stats;
 #endif
 };
 
@@ -370,7 +386,9 @@ static inline void free_leaf(struct leaf *l)
 
 static inline void free_leaf_info(struct leaf_info *leaf)
 {
-	kfree_rcu(leaf, rcu);
+	/* an embedded leaf_info goes away with its leaf */
+	if (!leaf->in_leaf)
+		kfree_rcu(leaf, rcu);
 }
 
 static struct tnode *tnode_alloc(size_t size)
@@ -431,19 +449,25 @@ static struct leaf *leaf_new(void)
 	struct leaf *l = kmem_cache_alloc(trie_leaf_kmem, GFP_KERNEL);
 	if (l) {
 		l->parent = T_LEAF;
+		l->slen = 0;
 		INIT_HLIST_HEAD(&l->list);
 	}
 	return l;
 }
 
+static void leaf_info_init(struct leaf_info *li, int plen)
+{
+	li->plen = plen;
+	li->mask_plen = ntohl(inet_make_mask(plen));
+	li->in_leaf = 0;
+	INIT_LIST_HEAD(&li->falh);
+}
+
 static struct leaf_info *leaf_info_new(int plen)
 {
 	struct leaf_info *li = kmalloc(sizeof(struct leaf_info),  GFP_KERNEL);
-	if (li) {
-		li->plen = plen;
-		li->mask_plen = ntohl(inet_make_mask(plen));
-		INIT_LIST_HEAD(&li->falh);
-	}
+	if (li)
+		leaf_info_init(li, plen);
 	return li;
 }
 
@@ -454,6 +478,7 @@ static struct tnode *tnode_new(t_key key, int pos, int bits)
 
 	if (tn) {
 		tn->parent = T_TNODE;
+		tn->slen = 0;
 		tn->pos = pos;
 		tn->bits = bits;
 		tn->key = key;
@@ -514,12 +539,62 @@ static void tnode_put_child_reorg(struct tnode *tn, int i, struct rt_trie_node *
 	else if (!wasfull && isfull)
 		tn->full_children++;
 
-	if (n)
+	if (n) {
 		node_set_parent(n, tn);
+		if (n->slen > tn->slen)
+			tn->slen = n->slen;
+	}
 
 	rcu_assign_pointer(tn->child[i], n);
 }
 
+/* Recompute the suffix length of a leaf from its prefixes. */
+static void leaf_update_slen(struct leaf *l)
+{
+	struct leaf_info *li;
+	unsigned char slen = 0;
+
+	/* the list is sorted by decreasing prefix length */
+	hlist_for_each_entry(li, &l->list, hlist)
+		slen = KEYLENGTH - li->plen;
+
+	l->slen = slen;
+}
+
+/* Raise the suffix length of the ancestors of n up to its own. */
+static void node_push_suffix(struct rt_trie_node *n)
+{
+	struct tnode *tp = node_parent(n);
+
+	while (tp && tp->slen < n->slen) {
+		tp->slen = n->slen;
+		tp = node_parent((struct rt_trie_node *)tp);
+	}
+}
+
+/* Lower the suffix length of tn and its ancestors after a removal. */
+static void node_pull_suffix(struct tnode *tn)
+{
+	struct rt_trie_node *n;
+	unsigned char slen;
+	int i;
+
+	while (tn) {
+		slen = 0;
+		for (i = 0; i < tnode_child_length(tn); i++) {
+			n = rtnl_dereference(tn->child[i]);
+			if (n && n->slen > slen)
+				slen = n->slen;
+		}
+
+		if (slen == tn->slen)
+			break;
+
+		tn->slen = slen;
+		tn = node_parent((struct rt_trie_node *)tn);
+	}
+}
+
 #define MAX_WORK 10
 static struct rt_trie_node *resize(struct trie *t, struct tnode *tn)
 {
@@ -631,7 +706,7 @@ static struct rt_trie_node *resize(struct trie *t, struct tnode *tn)
 		if (IS_ERR(tn)) {
 			tn = old_tn;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.resize_node_skipped++;
+			this_cpu_inc(t->stats->resize_node_skipped);
 #endif
 			break;
 		}
@@ -658,7 +733,7 @@ static struct rt_trie_node *resize(struct trie *t, struct tnode *tn)
 		if (IS_ERR(tn)) {
 			tn = old_tn;
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.resize_node_skipped++;
+			this_cpu_inc(t->stats->resize_node_skipped);
 #endif
 			break;
 		}
@@ -1085,6 +1160,8 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 
 		fa_head = &li->falh;
 		insert_leaf_info(&l->list, li);
+		leaf_update_slen(l);
+		node_push_suffix((struct rt_trie_node *)l);
 		goto done;
 	}
 	l = leaf_new();
@@ -1093,15 +1170,13 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 		return NULL;
 
 	l->key = key;
-	li = leaf_info_new(plen);
-
-	if (!li) {
-		free_leaf(l);
-		return NULL;
-	}
+	li = &l->li;
+	leaf_info_init(li, plen);
+	li->in_leaf = 1;
 
 	fa_head = &li->falh;
 	insert_leaf_info(&l->list, li);
+	leaf_update_slen(l);
 
 	if (t->trie && n == NULL) {
 		/* Case 2: n is NULL, and will just insert a new leaf */
@@ -1155,6 +1230,7 @@ static struct list_head *fib_insert_node(struct trie *t, u32 key, int plen)
 	/* Rebalance the trie */
 
 	trie_rebalance(t, tp);
+	node_push_suffix((struct rt_trie_node *)l);
 done:
 	return fa_head;
 }
@@ -1357,7 +1433,7 @@ static int check_leaf(struct fib_table *tb, struct trie *t, struct leaf *l,
 			err = fib_props[fa->fa_type].error;
 			if (err) {
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-				t->stats.semantic_match_passed++;
+				this_cpu_inc(t->stats->semantic_match_passed);
 #endif
 				return err;
 			}
@@ -1372,7 +1448,7 @@ static int check_leaf(struct fib_table *tb, struct trie *t, struct leaf *l,
 					continue;
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-				t->stats.semantic_match_passed++;
+				this_cpu_inc(t->stats->semantic_match_passed);
 #endif
 				res->prefixlen = li->plen;
 				res->nh_sel = nhsel;
@@ -1388,7 +1464,7 @@ static int check_leaf(struct fib_table *tb, struct trie *t, struct leaf *l,
 		}
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-		t->stats.semantic_match_miss++;
+		this_cpu_inc(t->stats->semantic_match_miss);
 #endif
 	}
 
@@ -1417,7 +1493,7 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 		goto failed;
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-	t->stats.gets++;
+	this_cpu_inc(t->stats->gets);
 #endif
 
 	/* Just a leaf? */
@@ -1441,7 +1517,7 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 
 		if (n == NULL) {
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.null_node_hit++;
+			this_cpu_inc(t->stats->null_node_hit);
 #endif
 			goto backtrace;
 		}
@@ -1558,6 +1634,13 @@ backtrace:
 			current_prefix_length = pn->pos + pn->bits
 				- chopped_off;
 
+		/* Whatever is left to try in this tnode has a prefix length
+		 * of at most current_prefix_length. If even the shortest
+		 * prefix below is longer, go straight to the parent.
+		 */
+		if (KEYLENGTH - pn->slen > current_prefix_length)
+			chopped_off = pn->bits + 1;
+
 		/*
 		 * Either we do the actual chop off according or if we have
 		 * chopped off all bits in this tnode walk up to our parent.
@@ -1576,7 +1659,7 @@ backtrace:
 			chopped_off = 0;
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			t->stats.backtrack++;
+			this_cpu_inc(t->stats->backtrack);
 #endif
 			goto backtrace;
 		}
@@ -1601,6 +1684,7 @@ static void trie_leaf_remove(struct trie *t, struct leaf *l)
 	if (tp) {
 		t_key cindex = tkey_extract_bits(l->key, tp->pos, tp->bits);
 		put_child(tp, cindex, NULL);
+		node_pull_suffix(tp);
 		trie_rebalance(t, tp);
 	} else
 		RCU_INIT_POINTER(t->trie, NULL);
@@ -1688,8 +1772,12 @@ int fib_table_delete(struct fib_table *tb, struct fib_config *cfg)
 		free_leaf_info(li);
 	}
 
-	if (hlist_empty(&l->list))
+	if (hlist_empty(&l->list)) {
 		trie_leaf_remove(t, l);
+	} else {
+		leaf_update_slen(l);
+		node_pull_suffix(node_parent((struct rt_trie_node *)l));
+	}
 
 	if (fa->fa_state & FA_S_ACCESSED)
 		rt_cache_flush(cfg->fc_nlinfo.nl_net);
@@ -1814,7 +1902,13 @@ int fib_table_flush(struct fib_table *tb)
 	int found = 0;
 
 	for (l = trie_firstleaf(t); l; l = trie_nextleaf(l)) {
-		found += trie_flush_leaf(l);
+		int flushed = trie_flush_leaf(l);
+
+		if (flushed && !hlist_empty(&l->list)) {
+			leaf_update_slen(l);
+			node_pull_suffix(node_parent((struct rt_trie_node *)l));
+		}
+		found += flushed;
 
 		if (ll && hlist_empty(&ll->list))
 			trie_leaf_remove(t, ll);
@@ -1830,6 +1924,11 @@ int fib_table_flush(struct fib_table *tb)
 
 void fib_free_table(struct fib_table *tb)
 {
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+	struct trie *t = (struct trie *)tb->tb_data;
+
+	free_percpu(t->stats);
+#endif
 	kfree(tb);
 }
 
@@ -1975,6 +2074,14 @@ struct fib_table *fib_trie_table(u32 id)
 	t = (struct trie *) tb->tb_data;
 	memset(t, 0, sizeof(*t));
 
+#ifdef CONFIG_IP_FIB_TRIE_STATS
+	t->stats = alloc_percpu(struct trie_use_stats);
+	if (!t->stats) {
+		kfree(tb);
+		return NULL;
+	}
+#endif
+
 	return tb;
 }
 
@@ -2114,7 +2221,8 @@ static void trie_show_stats(struct seq_file *seq, struct trie_stat *stat)
 	bytes = sizeof(struct leaf) * stat->leaves;
 
 	seq_printf(seq, "\tPrefixes:       %u\n", stat->prefixes);
-	bytes += sizeof(struct leaf_info) * stat->prefixes;
+	/* the first prefix of each leaf is embedded in it */
+	bytes += sizeof(struct leaf_info) * (stat->prefixes - stat->leaves);
 
 	seq_printf(seq, "\tInternal nodes: %u\n\t", stat->tnodes);
 	bytes += sizeof(struct tnode) * stat->tnodes;
@@ -2139,18 +2247,33 @@ static void trie_show_stats(struct seq_file *seq, struct trie_stat *stat)
 
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 static void trie_show_usage(struct seq_file *seq,
-			    const struct trie_use_stats *stats)
+			    const struct trie_use_stats __percpu *stats)
 {
+	struct trie_use_stats s = { 0 };
+	int cpu;
+
+	/* loop through all of the CPUs and gather up the stats */
+	for_each_possible_cpu(cpu) {
+		const struct trie_use_stats *pcpu = per_cpu_ptr(stats, cpu);
+
+		s.gets += pcpu->gets;
+		s.backtrack += pcpu->backtrack;
+		s.semantic_match_passed += pcpu->semantic_match_passed;
+		s.semantic_match_miss += pcpu->semantic_match_miss;
+		s.null_node_hit += pcpu->null_node_hit;
+		s.resize_node_skipped += pcpu->resize_node_skipped;
+	}
+
 	seq_printf(seq, "\nCounters:\n---------\n");
-	seq_printf(seq, "gets = %u\n", stats->gets);
-	seq_printf(seq, "backtracks = %u\n", stats->backtrack);
+	seq_printf(seq, "gets = %u\n", s.gets);
+	seq_printf(seq, "backtracks = %u\n", s.backtrack);
 	seq_printf(seq, "semantic match passed = %u\n",
-		   stats->semantic_match_passed);
+		   s.semantic_match_passed);
 	seq_printf(seq, "semantic match miss = %u\n",
-		   stats->semantic_match_miss);
-	seq_printf(seq, "null node hit= %u\n", stats->null_node_hit);
+		   s.semantic_match_miss);
+	seq_printf(seq, "null node hit= %u\n", s.null_node_hit);
 	seq_printf(seq, "skipped node resize = %u\n\n",
-		   stats->resize_node_skipped);
+		   s.resize_node_skipped);
 }
 #endif /*  CONFIG_IP_FIB_TRIE_STATS */
 
@@ -2191,7 +2314,7 @@ static int fib_triestat_seq_show(struct seq_file *seq, void *v)
 			trie_collect_stats(t, &stat);
 			trie_show_stats(seq, &stat);
 #ifdef CONFIG_IP_FIB_TRIE_STATS
-			trie_show_usage(seq, &t->stats);
+			trie_show_usage(seq, t->stats);
 #endif
 		}
 	}
@@ -21,8 +21,11 @@
 
 #include <net/inet_connection_sock.h>
 #include <net/inet_hashtables.h>
+#include <net/inet6_hashtables.h>
 #include <net/secure_seq.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/sock_reuseport.h>
 
 static unsigned int inet_ehashfn(struct net *net, const __be32 laddr,
 				 const __u16 lport, const __be32 faddr,
@@ -49,6 +52,24 @@ static unsigned int inet_sk_ehashfn(const struct sock *sk)
 	return inet_ehashfn(net, laddr, lport, faddr, fport);
 }
 
+/* Request sockets have no inet_sock, hash them from sock_common alone.
+ * IPv6 sockets talking to an IPv4 peer carry v4-mapped addresses and
+ * live in the same chains as plain IPv4 sockets.
+ */
+static u32 sk_ehashfn(const struct sock *sk)
+{
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6 &&
+	    !ipv6_addr_v4mapped(&sk->sk_v6_daddr))
+		return inet6_ehashfn(sock_net(sk),
+				     &sk->sk_v6_rcv_saddr, sk->sk_num,
+				     &sk->sk_v6_daddr, sk->sk_dport);
+#endif
+	return inet_ehashfn(sock_net(sk),
+			    sk->sk_rcv_saddr, sk->sk_num,
+			    sk->sk_daddr, sk->sk_dport);
+}
+
 /*
  * Allocate and initialize a new local port bind bucket.
  * The bindhash mutex for snum's hash chain must be held here.
@@ -201,6 +222,7 @@ static inline int compute_score(struct sock *sk, struct net *net,
 
 struct sock *__inet_lookup_listener(struct net *net,
 				    struct inet_hashinfo *hashinfo,
+				    struct sk_buff *skb, int doff,
 				    const __be32 saddr, __be16 sport,
 				    const __be32 daddr, const unsigned short hnum,
 				    const int dif)
@@ -210,6 +232,7 @@ struct sock *__inet_lookup_listener(struct net *net,
 	unsigned int hash = inet_lhashfn(net, hnum);
 	struct inet_listen_hashbucket *ilb = &hashinfo->listening_hash[hash];
 	int score, hiscore, matches = 0, reuseport = 0;
+	bool select_ok = true;
 	u32 phash = 0;
 
 	rcu_read_lock();
@@ -225,6 +248,17 @@ begin:
 			if (reuseport) {
 				phash = inet_ehashfn(net, daddr, hnum,
 						     saddr, sport);
+				if (select_ok) {
+					struct sock *sk2;
+
+					sk2 = reuseport_select_sock(sk, phash,
+								    skb, doff);
+					if (sk2) {
+						result = sk2;
+						select_ok = false;
+						goto found;
+					}
+				}
 				matches = 1;
 			}
 		} else if (score == hiscore && reuseport) {
@@ -241,6 +275,7 @@ begin:
 	 */
 	if (get_nulls_value(node) != hash + LISTENING_NULLS_BASE)
 		goto begin;
+found:
 	if (result) {
 		if (unlikely(!atomic_inc_not_zero(&result->sk_refcnt)))
 			result = NULL;
@@ -263,6 +298,8 @@ void sock_gen_put(struct sock *sk)
 
 	if (sk->sk_state == TCP_TIME_WAIT)
 		inet_twsk_free(inet_twsk(sk));
+	else if (sk->sk_state == TCP_NEW_SYN_RECV)
+		reqsk_free(inet_reqsk(sk));
 	else
 		sk_free(sk);
 }
@@ -423,6 +460,96 @@ int __inet_hash_nolisten(struct sock *sk, struct inet_timewait_sock *tw)
 }
 EXPORT_SYMBOL_GPL(__inet_hash_nolisten);
 
+/* Insert a socket into the established hash, replacing @osk (the request
+ * socket a child is being created from) in the same critical section.
+ * Returns false, without inserting @sk, if @osk was already unhashed:
+ * another CPU won the race to turn the request into a child.
+ */
+bool inet_ehash_insert(struct sock *sk, struct sock *osk)
+{
+	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
+	struct hlist_nulls_head *list;
+	struct inet_ehash_bucket *head;
+	spinlock_t *lock;
+	bool ret = true;
+
+	WARN_ON_ONCE(!sk_unhashed(sk));
+
+	sk->sk_hash = sk_ehashfn(sk);
+	head = inet_ehash_bucket(hashinfo, sk->sk_hash);
+	list = &head->chain;
+	lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
+
+	spin_lock(lock);
+	if (osk) {
+		WARN_ON_ONCE(sk->sk_hash != osk->sk_hash);
+		ret = sk_nulls_del_node_init_rcu(osk);
+	}
+	if (ret)
+		__sk_nulls_add_node_rcu(sk, list);
+	spin_unlock(lock);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_insert);
+
+/* Hash a freshly created child in place of its request @osk.  If the
+ * request was already gone the child is left unhashed, and the caller
+ * disposes of it through inet_csk_complete_hashdance().
+ */
+bool inet_ehash_nolisten(struct sock *sk, struct sock *osk)
+{
+	bool ok = inet_ehash_insert(sk, osk);
+
+	if (ok)
+		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
+	return ok;
+}
+EXPORT_SYMBOL_GPL(inet_ehash_nolisten);
+
+/* Sockets that may share a reuseport group: bound by the same user to
+ * exactly the same local address and device.  The caller compares ports.
+ */
+bool inet_reuseport_same_group(struct sock *sk, struct sock *sk2)
+{
+	if (sk2 == sk || !sk2->sk_reuseport ||
+	    !net_eq(sock_net(sk2), sock_net(sk)) ||
+	    sk2->sk_family != sk->sk_family ||
+	    ipv6_only_sock(sk2) != ipv6_only_sock(sk) ||
+	    sk2->sk_bound_dev_if != sk->sk_bound_dev_if ||
+	    !uid_eq(sock_i_uid(sk2), sock_i_uid(sk)))
+		return false;
+
+#if IS_ENABLED(CONFIG_IPV6)
+	if (sk->sk_family == AF_INET6)
+		return ipv6_addr_equal(&sk2->sk_v6_rcv_saddr,
+				       &sk->sk_v6_rcv_saddr);
+#endif
+	return sk2->sk_rcv_saddr == sk->sk_rcv_saddr;
+}
+EXPORT_SYMBOL_GPL(inet_reuseport_same_group);
+
+/* Called with the listening bucket locked.  Should the group allocation
+ * fail, sk is still hashed and lookups fall back to walking the bucket.
+ */
+void inet_reuseport_add_sock(struct sock *sk,
+			     struct inet_listen_hashbucket *ilb)
+{
+	struct hlist_nulls_node *node;
+	struct sock *sk2;
+
+	sk_nulls_for_each(sk2, node, &ilb->head) {
+		if (inet_sk(sk2)->inet_num == inet_sk(sk)->inet_num &&
+		    inet_reuseport_same_group(sk, sk2)) {
+			reuseport_add_sock(sk, sk2);
+			return;
+		}
+	}
+
+	/* Initial allocation may have already happened via setsockopt */
+	reuseport_alloc(sk);
+}
+EXPORT_SYMBOL_GPL(inet_reuseport_add_sock);
+
 static void __inet_hash(struct sock *sk)
 {
 	struct inet_hashinfo *hashinfo = sk->sk_prot->h.hashinfo;
@@ -437,6 +564,8 @@ static void __inet_hash(struct sock *sk)
 	ilb = &hashinfo->listening_hash[inet_sk_listen_hashfn(sk)];
 
 	spin_lock(&ilb->lock);
+	if (sk->sk_reuseport)
+		inet_reuseport_add_sock(sk, ilb);
 	__sk_nulls_add_node_rcu(sk, &ilb->head);
 	sock_prot_inuse_add(sock_net(sk), sk->sk_prot, 1);
 	spin_unlock(&ilb->lock);
@@ -467,6 +596,8 @@ void inet_unhash(struct sock *sk)
 		lock = inet_ehash_lockp(hashinfo, sk->sk_hash);
 
 	spin_lock_bh(lock);
+	if (rcu_access_pointer(sk->sk_reuseport_cb))
+		reuseport_detach_sock(sk);
 	done = __sk_nulls_del_node_init_rcu(sk);
 	if (done)
 		sock_prot_inuse_add(sock_net(sk), sk->sk_prot, -1);
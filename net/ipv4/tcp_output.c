@@ -910,6 +910,7 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 
 	if (clone_it) {
 		skb_mstamp_get(&skb->skb_mstamp);
+		tcp_rate_skb_sent(sk, skb);
 
 		if (unlikely(skb_cloned(skb)))
 			skb = pskb_copy(skb, gfp_mask);
@@ -1192,6 +1193,7 @@ int tcp_fragment(struct sock *sk, struct sk_buff *skb, u32 len,
 
 	buff->tstamp = skb->tstamp;
 	tcp_fragment_tstamp(skb, buff);
+	TCP_SKB_CB(buff)->tx = TCP_SKB_CB(skb)->tx;
 
 	old_factor = tcp_skb_pcount(skb);
 
@@ -175,6 +175,69 @@ out_unlock:
 	return segs;
 }
 
+/*
+ * Cut a UDP_SEGMENT datagram into gso_size ones.  All but the last have
+ * the same length, so the checksum only needs adjusting twice.
+ */
+static struct sk_buff *__udp_gso_segment(struct sk_buff *gso_skb,
+					 netdev_features_t features)
+{
+	struct sk_buff *segs, *seg;
+	struct udphdr *uh;
+	unsigned int mss;
+	__sum16 check;
+	__be16 newlen;
+
+	if (!pskb_may_pull(gso_skb, sizeof(*uh)))
+		return ERR_PTR(-EINVAL);
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (gso_skb->len <= sizeof(*uh) + mss)
+		return ERR_PTR(-EINVAL);
+
+	if (skb_gso_ok(gso_skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		skb_shinfo(gso_skb)->gso_segs =
+			DIV_ROUND_UP(gso_skb->len - sizeof(*uh), mss);
+		return NULL;
+	}
+
+	__skb_pull(gso_skb, sizeof(*uh));
+
+	segs = skb_segment(gso_skb, features);
+	if (IS_ERR_OR_NULL(segs))
+		return segs;
+
+	seg = segs;
+	uh = udp_hdr(seg);
+
+	/* uh->check holds the pseudo header sum for the whole datagram */
+	newlen = htons(sizeof(*uh) + mss);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	while (seg->next) {
+		uh->len = newlen;
+		uh->check = check;
+		if (seg->ip_summed != CHECKSUM_PARTIAL)
+			uh->check = gso_make_checksum(seg, ~check) ? :
+				    CSUM_MANGLED_0;
+
+		seg = seg->next;
+		uh = udp_hdr(seg);
+	}
+
+	newlen = htons(skb_tail_pointer(seg) - skb_transport_header(seg) +
+		       seg->data_len);
+	check = csum16_add(csum16_sub(uh->check, uh->len), newlen);
+
+	uh->len = newlen;
+	uh->check = check;
+	if (seg->ip_summed != CHECKSUM_PARTIAL)
+		uh->check = gso_make_checksum(seg, ~check) ? : CSUM_MANGLED_0;
+
+	return segs;
+}
+
 static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 					 netdev_features_t features)
 {
@@ -191,6 +254,11 @@ static struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb,
 		goto out;
 	}
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4) {
+		segs = __udp_gso_segment(skb, features);
+		goto out;
+	}
+
 	if (!pskb_may_pull(skb, sizeof(struct udphdr)))
 		goto out;
 
@@ -299,10 +367,14 @@ struct sk_buff **udp_gro_receive(struct sk_buff **head, struct sk_buff *skb,
 	unsigned int off = skb_gro_offset(skb);
 	int flush = 1;
 
+	/* A zero UDP checksum leaves nothing to validate at this layer;
+	 * the inner protocol checks its own checksum in software if the
+	 * device could not.
+	 */
 	if (NAPI_GRO_CB(skb)->udp_mark ||
 	    (skb->ip_summed != CHECKSUM_PARTIAL &&
 	     NAPI_GRO_CB(skb)->csum_cnt == 0 &&
-	     !NAPI_GRO_CB(skb)->csum_valid))
+	     !NAPI_GRO_CB(skb)->csum_valid && uh->check))
 		goto out;
 
 	/* mark that this skb passed once through the udp gro layer */
@@ -348,6 +420,69 @@ out:
 	return pp;
 }
 
+/*
+ * Merge consecutive datagrams of one flow for a socket that set UDP_GRO.
+ * The train is cut at the first datagram that is shorter than the ones
+ * before it (which still joins it) and at anything longer.
+ */
+static struct sk_buff **udp_gro_receive_segment(struct sk_buff **head,
+						struct sk_buff *skb,
+						struct udphdr *uh)
+{
+	struct sk_buff *p, **pp = NULL;
+	unsigned int off = skb_gro_offset(skb);
+	unsigned int ulen = ntohs(uh->len);
+	int flush = NAPI_GRO_CB(skb)->flush;
+	struct udphdr *uh2;
+
+	/* a zero checksum would not survive being cut apart again */
+	if (!uh->check || ulen != skb_gro_len(skb))
+		flush = 1;
+
+	NAPI_GRO_CB(skb)->udp_seg = 1;
+	skb_gro_pull(skb, sizeof(struct udphdr));
+	skb_gro_postpull_rcsum(skb, uh, sizeof(struct udphdr));
+
+	for (; (p = *head); head = &p->next) {
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		uh2 = (struct udphdr *)(p->data + off);
+		if (*(u32 *)&uh->source != *(u32 *)&uh2->source) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+
+		if (flush || NAPI_GRO_CB(p)->flush ||
+		    !NAPI_GRO_CB(p)->udp_seg ||
+		    ulen > ntohs(uh2->len) ||
+		    skb_gro_receive(head, skb) ||
+		    ulen != ntohs(uh2->len) ||
+		    NAPI_GRO_CB(p)->count >= UDP_MAX_SEGMENTS)
+			pp = head;
+		goto out;
+	}
+
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+	return pp;
+}
+
+static bool udp4_gro_sk_enabled(struct sk_buff *skb, struct udphdr *uh)
+{
+	const struct iphdr *iph = skb_gro_network_header(skb);
+	struct sock *sk;
+	bool ret;
+
+	sk = udp4_lib_lookup(dev_net(skb->dev), iph->saddr, uh->source,
+			     iph->daddr, uh->dest, skb->dev->ifindex);
+	if (!sk)
+		return false;
+	ret = udp_sk(sk)->gro_enabled;
+	sock_put(sk);
+	return ret;
+}
+
 static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					 struct sk_buff *skb)
 {
@@ -368,6 +503,10 @@ static struct sk_buff **udp4_gro_receive(struct sk_buff **head,
 					     inet_gro_compute_pseudo);
 skip:
 	NAPI_GRO_CB(skb)->is_ipv6 = 0;
+	/* tunnel payloads never go to a UDP_GRO socket */
+	if (static_key_false(&udp_gro_needed) &&
+	    !NAPI_GRO_CB(skb)->udp_mark && udp4_gro_sk_enabled(skb, uh))
+		return udp_gro_receive_segment(head, skb, uh);
 	return udp_gro_receive(head, skb, uh);
 
 flush:
@@ -411,6 +550,17 @@ static int udp4_gro_complete(struct sk_buff *skb, int nhoff)
 		uh->check = ~udp_v4_check(skb->len - nhoff, iph->saddr,
 					  iph->daddr, 0);
 
+	if (NAPI_GRO_CB(skb)->udp_seg) {
+		/* checksums were verified on the way in */
+		uh->len = htons(skb->len - nhoff);
+		skb->csum_start = (unsigned char *)uh - skb->head;
+		skb->csum_offset = offsetof(struct udphdr, check);
+		skb->ip_summed = CHECKSUM_PARTIAL;
+		skb_shinfo(skb)->gso_segs = NAPI_GRO_CB(skb)->count;
+		skb_shinfo(skb)->gso_type |= SKB_GSO_UDP_L4;
+		return 0;
+	}
+
 	return udp_gro_complete(skb, nhoff);
 }
 
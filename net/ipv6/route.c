@@ -301,10 +301,10 @@ static const struct rt6_info ip6_blk_hole_entry_template = {
 #endif
 
 /* allocate dst with ip6_dst_ops */
-static inline struct rt6_info *ip6_dst_alloc(struct net *net,
-					     struct net_device *dev,
-					     int flags,
-					     struct fib6_table *table)
+static struct rt6_info *__ip6_dst_alloc(struct net *net,
+					struct net_device *dev,
+					int flags,
+					struct fib6_table *table)
 {
 	struct rt6_info *rt = dst_alloc(&net->ipv6.ip6_dst_ops, dev,
 					0, DST_OBSOLETE_FORCE_CHK, flags);
@@ -319,6 +319,24 @@ static inline struct rt6_info *ip6_dst_alloc(struct net *net,
 	return rt;
 }
 
+/* allocate a route for the fib6 tree, with room for its per-cpu copies */
+static struct rt6_info *ip6_dst_alloc(struct net *net,
+				      struct net_device *dev,
+				      int flags,
+				      struct fib6_table *table)
+{
+	struct rt6_info *rt = __ip6_dst_alloc(net, dev, flags, table);
+
+	if (rt) {
+		rt->rt6i_pcpu = alloc_percpu_gfp(struct rt6_info *, GFP_ATOMIC);
+		if (!rt->rt6i_pcpu) {
+			dst_destroy(&rt->dst);
+			return NULL;
+		}
+	}
+	return rt;
+}
+
 static void ip6_dst_destroy(struct dst_entry *dst)
 {
 	struct rt6_info *rt = (struct rt6_info *)dst;
@@ -327,6 +345,7 @@ static void ip6_dst_destroy(struct dst_entry *dst)
 
 	if (!(rt->dst.flags & DST_HOST))
 		dst_destroy_metrics_generic(dst);
+	free_percpu(rt->rt6i_pcpu);
 
 	if (idev) {
 		rt->rt6i_idev = NULL;
@@ -914,6 +933,76 @@ static struct rt6_info *rt6_alloc_clone(struct rt6_info *ort,
 	return rt;
 }
 
+static struct rt6_info *rt6_alloc_host_clone(struct rt6_info *ort,
+					     const struct in6_addr *daddr,
+					     const struct in6_addr *saddr)
+{
+	if (!(ort->rt6i_flags & (RTF_NONEXTHOP | RTF_GATEWAY)))
+		return rt6_alloc_cow(ort, daddr, saddr);
+	return rt6_alloc_clone(ort, daddr);
+}
+
+static struct rt6_info *ip6_rt_pcpu_alloc(struct rt6_info *ort)
+{
+	struct net *net = dev_net(ort->dst.dev);
+	struct rt6_info *rt;
+
+	rt = __ip6_dst_alloc(net, ort->dst.dev, ort->dst.flags,
+			     ort->rt6i_table);
+	if (!rt)
+		return NULL;
+
+	rt->dst.input = ort->dst.input;
+	rt->dst.output = ort->dst.output;
+	rt->dst.error = ort->dst.error;
+	rt->dst.lastuse = jiffies;
+	dst_init_metrics(&rt->dst, dst_metrics_ptr(&ort->dst), true);
+	rt->rt6i_idev = ort->rt6i_idev;
+	if (rt->rt6i_idev)
+		in6_dev_hold(rt->rt6i_idev);
+
+	rt->rt6i_gateway = ort->rt6i_gateway;
+	rt->rt6i_dst = ort->rt6i_dst;
+#ifdef CONFIG_IPV6_SUBTREES
+	rt->rt6i_src = ort->rt6i_src;
+#endif
+	rt->rt6i_prefsrc = ort->rt6i_prefsrc;
+	rt->rt6i_flags = ort->rt6i_flags | RTF_PCPU;
+	rt->rt6i_protocol = ort->rt6i_protocol;
+	rt->rt6i_metric = ort->rt6i_metric;
+	rt->rt6i_table = ort->rt6i_table;
+	/* expiry, validity and PMTU all follow the route in the tree */
+	rt6_set_from(rt, ort);
+
+	return rt;
+}
+
+/*
+ * Return this cpu's copy of @rt, creating it on first use.  Called with
+ * table->tb6_lock held for reading, which keeps us on this cpu and keeps
+ * rt6_free_pcpu() away.
+ */
+static struct rt6_info *rt6_get_pcpu_route(struct rt6_info *rt)
+{
+	struct rt6_info **p = this_cpu_ptr(rt->rt6i_pcpu);
+	struct rt6_info *pcpu_rt = *p;
+
+	if (!pcpu_rt) {
+		pcpu_rt = ip6_rt_pcpu_alloc(rt);
+		if (!pcpu_rt)
+			pcpu_rt = dev_net(rt->dst.dev)->ipv6.ip6_null_entry;
+		else
+			*p = pcpu_rt;
+	} else if (dst_metrics_ptr(&pcpu_rt->dst) !=
+		   dst_metrics_ptr(&rt->dst)) {
+		/* the route's metrics were replaced since the copy was made */
+		dst_init_metrics(&pcpu_rt->dst, dst_metrics_ptr(&rt->dst), true);
+	}
+
+	dst_hold(&pcpu_rt->dst);
+	return pcpu_rt;
+}
+
 static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
 				      struct flowi6 *fl6, int flags)
 {
@@ -953,18 +1042,33 @@ redo_rt6_select:
 		}
 	}
 
-	dst_hold(&rt->dst);
-	read_unlock_bh(&table->tb6_lock);
-
-	if (rt->rt6i_flags & RTF_CACHE)
+	if ((rt->rt6i_flags & RTF_CACHE) || !rt->rt6i_pcpu) {
+		dst_hold(&rt->dst);
+		read_unlock_bh(&table->tb6_lock);
 		goto out2;
+	}
 
-	if (!(rt->rt6i_flags & (RTF_NONEXTHOP | RTF_GATEWAY)))
-		nrt = rt6_alloc_cow(rt, &fl6->daddr, &fl6->saddr);
-	else if (!(rt->dst.flags & DST_HOST))
-		nrt = rt6_alloc_clone(rt, &fl6->daddr);
-	else
+	if (likely(!(fl6->flowi6_flags & FLOWI_FLAG_KNOWN_NH) ||
+		   (rt->rt6i_flags & (RTF_NONEXTHOP | RTF_GATEWAY)))) {
+		/*
+		 * Hand out this cpu's copy of the route rather than cloning
+		 * a host route into the tree for every destination.  The
+		 * neighbour of a directly connected destination is found
+		 * from the packet's address by rt6_nexthop().
+		 */
+		rt = rt6_get_pcpu_route(rt);
+		read_unlock_bh(&table->tb6_lock);
 		goto out2;
+	}
+
+	/*
+	 * The caller sends packets for another address through the
+	 * neighbour of fl6->daddr, which only a host clone can record.
+	 */
+	dst_hold(&rt->dst);
+	read_unlock_bh(&table->tb6_lock);
+
+	nrt = rt6_alloc_cow(rt, &fl6->daddr, &fl6->saddr);
 
 	ip6_rt_put(rt);
 	rt = nrt ? : net->ipv6.ip6_null_entry;
@@ -1105,6 +1209,13 @@ static struct dst_entry *ip6_dst_check(struct dst_entry *dst, u32 cookie)
 	 * DST_OBSOLETE_FORCE_CHK which forces validation calls down
 	 * into this function always.
 	 */
+	if (rt->rt6i_flags & RTF_PCPU) {
+		/* freed along with its route in the tree? */
+		if (dst->obsolete != DST_OBSOLETE_FORCE_CHK)
+			return NULL;
+		rt = (struct rt6_info *)dst->from;
+	}
+
 	if (!rt->rt6i_node || (rt->rt6i_node->fn_sernum != cookie))
 		return NULL;
 
@@ -1139,6 +1250,8 @@ static void ip6_link_failure(struct sk_buff *skb)
 	icmpv6_send(skb, ICMPV6_DEST_UNREACH, ICMPV6_ADDR_UNREACH, 0);
 
 	rt = (struct rt6_info *) skb_dst(skb);
+	if (rt && (rt->rt6i_flags & RTF_PCPU))
+		rt = (struct rt6_info *)rt->dst.from;
 	if (rt) {
 		if (rt->rt6i_flags & RTF_CACHE) {
 			dst_hold(&rt->dst);
@@ -1150,24 +1263,63 @@ static void ip6_link_failure(struct sk_buff *skb)
 	}
 }
 
-static void ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
-			       struct sk_buff *skb, u32 mtu)
+static void rt6_do_update_pmtu(struct rt6_info *rt, u32 mtu)
+{
+	struct net *net = dev_net(rt->dst.dev);
+
+	rt->rt6i_flags |= RTF_MODIFIED;
+	dst_metric_set(&rt->dst, RTAX_MTU, mtu);
+	rt6_update_expires(rt, net->ipv6.sysctl.ip6_rt_mtu_expires);
+}
+
+static void __ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
+				 const struct ipv6hdr *iph, u32 mtu)
 {
 	struct rt6_info *rt6 = (struct rt6_info *)dst;
+	const struct in6_addr *daddr, *saddr;
+	struct rt6_info *nrt6;
 
 	dst_confirm(dst);
-	if (mtu < dst_mtu(dst) && rt6->rt6i_dst.plen == 128) {
-		struct net *net = dev_net(dst->dev);
+	if (mtu >= dst_mtu(dst))
+		return;
+	if (mtu < IPV6_MIN_MTU)
+		mtu = IPV6_MIN_MTU;
+
+	if (!(rt6->rt6i_flags & RTF_PCPU)) {
+		if (rt6->rt6i_dst.plen == 128)
+			rt6_do_update_pmtu(rt6, mtu);
+		return;
+	}
 
-		rt6->rt6i_flags |= RTF_MODIFIED;
-		if (mtu < IPV6_MIN_MTU)
-			mtu = IPV6_MIN_MTU;
+	/*
+	 * A per-cpu copy serves every destination of its route, so the
+	 * PMTU goes into a host clone in the tree.  Inserting it changes
+	 * the sernum of the route's node, which makes sockets caching the
+	 * copy look the destination up again and find the clone.
+	 */
+	if (iph) {
+		daddr = &iph->daddr;
+		saddr = &iph->saddr;
+	} else if (sk) {
+		daddr = &sk->sk_v6_daddr;
+		saddr = &inet6_sk(sk)->saddr;
+	} else {
+		return;
+	}
 
-		dst_metric_set(dst, RTAX_MTU, mtu);
-		rt6_update_expires(rt6, net->ipv6.sysctl.ip6_rt_mtu_expires);
+	nrt6 = rt6_alloc_host_clone(rt6, daddr, saddr);
+	if (nrt6) {
+		rt6_do_update_pmtu(nrt6, mtu);
+		ip6_ins_rt(nrt6);
 	}
 }
 
+static void ip6_rt_update_pmtu(struct dst_entry *dst, struct sock *sk,
+			       struct sk_buff *skb, u32 mtu)
+{
+	__ip6_rt_update_pmtu(dst, sk, skb ? ipv6_hdr(skb) : NULL, mtu);
+}
+
 void ip6_update_pmtu(struct sk_buff *skb, struct net *net, __be32 mtu,
 		     int oif, u32 mark)
 {
@@ -1184,7 +1336,7 @@ void ip6_update_pmtu(struct sk_buff *skb, struct net *net, __be32 mtu,
 
 	dst = ip6_route_output(net, NULL, &fl6);
 	if (!dst->error)
-		ip6_rt_update_pmtu(dst, NULL, skb, ntohl(mtu));
+		__ip6_rt_update_pmtu(dst, NULL, iph, ntohl(mtu));
 	dst_release(dst);
 }
 EXPORT_SYMBOL_GPL(ip6_update_pmtu);
@@ -1375,7 +1527,7 @@ struct dst_entry *icmp6_dst_alloc(struct net_device *dev,
 	if (unlikely(!idev))
 		return ERR_PTR(-ENODEV);
 
-	rt = ip6_dst_alloc(net, dev, 0, NULL);
+	rt = __ip6_dst_alloc(net, dev, 0, NULL);
 	if (unlikely(!rt)) {
 		in6_dev_put(idev);
 		dst = ERR_PTR(-ENOMEM);
@@ -1487,6 +1639,8 @@ int ip6_route_add(struct fib6_config *cfg)
 
 	if (cfg->fc_dst_len > 128 || cfg->fc_src_len > 128)
 		return -EINVAL;
+	if (cfg->fc_flags & RTF_PCPU)
+		return -EINVAL;
 #ifndef CONFIG_IPV6_SUBTREES
 	if (cfg->fc_src_len)
 		return -EINVAL;
@@ -1883,8 +2037,13 @@ static struct rt6_info *ip6_rt_copy(struct rt6_info *ort,
 				    const struct in6_addr *dest)
 {
 	struct net *net = dev_net(ort->dst.dev);
-	struct rt6_info *rt = ip6_dst_alloc(net, ort->dst.dev, 0,
-					    ort->rt6i_table);
+	struct rt6_info *rt;
+
+	/* clone the route in the tree, not this cpu's copy of it */
+	if (ort->rt6i_flags & RTF_PCPU)
+		ort = (struct rt6_info *)ort->dst.from;
+
+	rt = __ip6_dst_alloc(net, ort->dst.dev, 0, ort->rt6i_table);
 
 	if (rt) {
 		rt->dst.input = ort->dst.input;
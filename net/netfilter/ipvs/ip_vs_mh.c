@@ -0,0 +1,486 @@
+/*
+ * IPVS:        Maglev Hashing scheduling module
+ *
+ *              This program is free software; you can redistribute it and/or
+ *              modify it under the terms of the GNU General Public License
+ *              as published by the Free Software Foundation; either version
+ *              2 of the License, or (at your option) any later version.
+ *
+ */
+
+/*
+ * The mh algorithm is to assign a preference list of all the lookup
+ * table positions to each destination and populate the table with
+ * the most-preferred position of destinations. Then it is to select
+ * destination with the hash key of source IP address through looking
+ * up the lookup table.
+ *
+ * Each destination derives an offset and a skip from its address and
+ * port, and prefers the positions offset, offset + skip,
+ * offset + 2 * skip, ... modulo the table size M. M is prime, so every
+ * such sequence visits all positions. Destinations take turns, in
+ * proportion to their weights, claiming the next still free position
+ * of their own sequence until the table is full.
+ *
+ * Since a destination's sequence does not depend on the other
+ * destinations, adding or removing one leaves most positions with
+ * the destination they had, unlike the sh table which is tiled anew.
+ *
+ * The maglev hashing is described in:
+ *   Eisenbud et al., "Maglev: A Fast and Reliable Software Network
+ *   Load Balancer", NSDI 2016.
+ *
+ */
+
+#define KMSG_COMPONENT "IPVS"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/ip.h>
+#include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/bitops.h>
+#include <linux/gcd.h>
+
+#include <net/ip_vs.h>
+
+#include <net/tcp.h>
+#include <linux/udp.h>
+#include <linux/sctp.h>
+
+
+/*
+ *      IPVS MH lookup table entry
+ */
+struct ip_vs_mh_lookup {
+	struct ip_vs_dest __rcu	*dest;	/* real server */
+};
+
+/* preference list state of a destination while populating */
+struct ip_vs_mh_dest_setup {
+	unsigned int	offset;	/* starting position */
+	unsigned int	skip;	/* stride through the table */
+	unsigned int	perm;	/* next position to try */
+	int		turns;	/* positions claimed per round */
+};
+
+/*
+ *     for IPVS MH lookup table, sized by the largest prime below 2^N
+ */
+#ifndef CONFIG_IP_VS_MH_TAB_INDEX
+#define CONFIG_IP_VS_MH_TAB_INDEX	12
+#endif
+
+static const unsigned int ip_vs_mh_primes[] = {
+	251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521
+};
+
+#define IP_VS_MH_TAB_INDEX		(CONFIG_IP_VS_MH_TAB_INDEX - 8)
+#define IP_VS_MH_TAB_SIZE		ip_vs_mh_primes[IP_VS_MH_TAB_INDEX]
+
+struct ip_vs_mh_state {
+	struct rcu_head			rcu_head;
+	u32				hash1;	/* seed of the source hash */
+	u32				hash2;	/* seeds of the permutations */
+	u32				hash3;
+	struct ip_vs_mh_lookup		*lookup;
+};
+
+/* Helper function to determine if server is unavailable */
+static inline bool is_unavailable(struct ip_vs_dest *dest)
+{
+	return atomic_read(&dest->weight) <= 0 ||
+	       dest->flags & IP_VS_DEST_F_OVERLOAD;
+}
+
+/*
+ *	Returns hash value for IPVS MH entry
+ */
+static inline unsigned int
+ip_vs_mh_hashkey(int af, const union nf_inet_addr *addr,
+		 __be16 port, u32 seed, unsigned int offset)
+{
+	__be32 addr_fold = addr->ip;
+
+#ifdef CONFIG_IP_VS_IPV6
+	if (af == AF_INET6)
+		addr_fold = addr->ip6[0]^addr->ip6[1]^
+			    addr->ip6[2]^addr->ip6[3];
+#endif
+	return jhash_2words((__force u32)addr_fold, (__force u32)port,
+			    seed + offset) % IP_VS_MH_TAB_SIZE;
+}
+
+
+/*
+ *      Get ip_vs_dest associated with supplied parameters.
+ */
+static inline struct ip_vs_dest *
+ip_vs_mh_get(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
+	     const union nf_inet_addr *addr, __be16 port)
+{
+	unsigned int hash = ip_vs_mh_hashkey(svc->af, addr, port, s->hash1, 0);
+	struct ip_vs_dest *dest = rcu_dereference(s->lookup[hash].dest);
+
+	return (!dest || is_unavailable(dest)) ? NULL : dest;
+}
+
+
+/* As ip_vs_mh_get, but with fallback if selected server is unavailable
+ *
+ * The fallback strategy rehashes the source with an increasing offset,
+ * starting from the original hash value to make the algorithm
+ * deterministic, until an available server turns up.
+ */
+static inline struct ip_vs_dest *
+ip_vs_mh_get_fallback(struct ip_vs_service *svc, struct ip_vs_mh_state *s,
+		      const union nf_inet_addr *addr, __be16 port)
+{
+	unsigned int offset, roffset;
+	unsigned int hash, ihash;
+	struct ip_vs_dest *dest;
+
+	/* first try the dest it's supposed to go to */
+	ihash = ip_vs_mh_hashkey(svc->af, addr, port, s->hash1, 0);
+	dest = rcu_dereference(s->lookup[ihash].dest);
+	if (!dest)
+		return NULL;
+	if (!is_unavailable(dest))
+		return dest;
+
+	IP_VS_DBG_BUF(6, "MH: selected unavailable server %s:%d, reselecting",
+		      IP_VS_DBG_ADDR(dest->af, &dest->addr), ntohs(dest->port));
+
+	/* if the original dest is unavailable, loop around the table
+	 * starting from ihash to find a new dest
+	 */
+	for (offset = 0; offset < IP_VS_MH_TAB_SIZE; offset++) {
+		roffset = (offset + ihash) % IP_VS_MH_TAB_SIZE;
+		hash = ip_vs_mh_hashkey(svc->af, addr, port, s->hash1,
+					roffset);
+		dest = rcu_dereference(s->lookup[hash].dest);
+		if (!dest)
+			break;
+		if (!is_unavailable(dest))
+			return dest;
+		IP_VS_DBG_BUF(6, "MH: selected unavailable "
+			      "server %s:%d (offset %d), reselecting",
+			      IP_VS_DBG_ADDR(dest->af, &dest->addr),
+			      ntohs(dest->port), roffset);
+	}
+
+	return NULL;
+}
+
+
+/*
+ *      Compute the preference list of every destination and the number
+ *      of positions it claims per round, weights reduced by their gcd.
+ *      Returns the number of destinations taking part.
+ */
+static int
+ip_vs_mh_permutate(struct ip_vs_mh_state *s, struct ip_vs_service *svc,
+		   struct ip_vs_mh_dest_setup *ds)
+{
+	struct ip_vs_dest *dest;
+	int weight, g = 0, n = 0;
+
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		weight = atomic_read(&dest->weight);
+		if (weight > 0)
+			g = g ? gcd(g, weight) : weight;
+	}
+
+	list_for_each_entry(dest, &svc->destinations, n_list) {
+		weight = atomic_read(&dest->weight);
+		ds->turns = weight > 0 ? weight / g : 0;
+		if (ds->turns) {
+			u32 key = jhash2((const u32 *)&dest->addr,
+					 sizeof(dest->addr) / sizeof(u32),
+					 (__force u32)dest->port);
+
+			ds->offset = jhash_1word(key, s->hash2) %
+				     IP_VS_MH_TAB_SIZE;
+			ds->skip = jhash_1word(key, s->hash3) %
+				   (IP_VS_MH_TAB_SIZE - 1) + 1;
+			ds->perm = ds->offset;
+			n++;
+		}
+		ds++;
+	}
+
+	return n;
+}
+
+
+/*
+ *      Fill the lookup table from the destinations' preference lists.
+ */
+static int
+ip_vs_mh_populate(struct ip_vs_mh_state *s, struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_dest_setup *dest_setup, *ds;
+	struct ip_vs_dest **table, *dest, *old;
+	unsigned long *used;
+	unsigned int i, c, n = 0;
+	int t;
+
+	dest_setup = kcalloc(max_t(u32, svc->num_dests, 1),
+			     sizeof(*dest_setup), GFP_KERNEL);
+	table = kcalloc(IP_VS_MH_TAB_SIZE, sizeof(*table), GFP_KERNEL);
+	used = kcalloc(BITS_TO_LONGS(IP_VS_MH_TAB_SIZE), sizeof(long),
+		       GFP_KERNEL);
+	if (!dest_setup || !table || !used) {
+		kfree(dest_setup);
+		kfree(table);
+		kfree(used);
+		return -ENOMEM;
+	}
+
+	if (!ip_vs_mh_permutate(s, svc, dest_setup))
+		goto assign;
+
+	while (n < IP_VS_MH_TAB_SIZE) {
+		ds = dest_setup;
+		list_for_each_entry(dest, &svc->destinations, n_list) {
+			for (t = 0; t < ds->turns && n < IP_VS_MH_TAB_SIZE;
+			     t++) {
+				/* next free position of the preference list */
+				c = ds->perm;
+				while (test_bit(c, used))
+					c = (c + ds->skip) % IP_VS_MH_TAB_SIZE;
+				ds->perm = (c + ds->skip) % IP_VS_MH_TAB_SIZE;
+
+				__set_bit(c, used);
+				table[c] = dest;
+				n++;
+			}
+			ds++;
+		}
+	}
+
+assign:
+	for (i = 0; i < IP_VS_MH_TAB_SIZE; i++) {
+		old = rcu_dereference_protected(s->lookup[i].dest, 1);
+		dest = table[i];
+		if (old == dest)
+			continue;
+		if (dest)
+			ip_vs_dest_hold(dest);
+		RCU_INIT_POINTER(s->lookup[i].dest, dest);
+		if (old)
+			ip_vs_dest_put(old);
+	}
+
+	kfree(dest_setup);
+	kfree(table);
+	kfree(used);
+	return 0;
+}
+
+
+/*
+ *      Flush all the entries of the specified table.
+ */
+static void ip_vs_mh_flush(struct ip_vs_mh_state *s)
+{
+	struct ip_vs_mh_lookup *l;
+	struct ip_vs_dest *dest;
+	int i;
+
+	l = &s->lookup[0];
+	for (i = 0; i < IP_VS_MH_TAB_SIZE; i++) {
+		dest = rcu_dereference_protected(l->dest, 1);
+		if (dest) {
+			ip_vs_dest_put(dest);
+			RCU_INIT_POINTER(l->dest, NULL);
+		}
+		l++;
+	}
+}
+
+
+static void ip_vs_mh_state_free(struct rcu_head *head)
+{
+	struct ip_vs_mh_state *s;
+
+	s = container_of(head, struct ip_vs_mh_state, rcu_head);
+	kfree(s->lookup);
+	kfree(s);
+}
+
+
+static int ip_vs_mh_init_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_state *s;
+	int ret;
+
+	/* allocate the MH table for this service */
+	s = kzalloc(sizeof(struct ip_vs_mh_state), GFP_KERNEL);
+	if (s == NULL)
+		return -ENOMEM;
+
+	s->lookup = kcalloc(IP_VS_MH_TAB_SIZE, sizeof(struct ip_vs_mh_lookup),
+			    GFP_KERNEL);
+	if (s->lookup == NULL) {
+		kfree(s);
+		return -ENOMEM;
+	}
+
+	get_random_bytes(&s->hash1, sizeof(s->hash1));
+	get_random_bytes(&s->hash2, sizeof(s->hash2));
+	get_random_bytes(&s->hash3, sizeof(s->hash3));
+
+	IP_VS_DBG(6, "MH lookup table (memory=%Zdbytes) allocated for "
+		  "current service\n",
+		  sizeof(struct ip_vs_mh_lookup) * IP_VS_MH_TAB_SIZE);
+
+	/* fill the lookup table with current dests */
+	ret = ip_vs_mh_populate(s, svc);
+	if (ret < 0) {
+		ip_vs_mh_flush(s);
+		kfree(s->lookup);
+		kfree(s);
+		return ret;
+	}
+
+	svc->sched_data = s;
+	return 0;
+}
+
+
+static void ip_vs_mh_done_svc(struct ip_vs_service *svc)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+
+	/* got to clean up lookup entries here */
+	ip_vs_mh_flush(s);
+
+	/* release the table itself */
+	call_rcu(&s->rcu_head, ip_vs_mh_state_free);
+	IP_VS_DBG(6, "MH lookup table (memory=%Zdbytes) released\n",
+		  sizeof(struct ip_vs_mh_lookup) * IP_VS_MH_TAB_SIZE);
+}
+
+
+static int ip_vs_mh_dest_changed(struct ip_vs_service *svc,
+				 struct ip_vs_dest *dest)
+{
+	struct ip_vs_mh_state *s = svc->sched_data;
+
+	/* refill the lookup table with the updated service */
+	return ip_vs_mh_populate(s, svc);
+}
+
+
+/* Helper function to get port number */
+static inline __be16
+ip_vs_mh_get_port(const struct sk_buff *skb, struct ip_vs_iphdr *iph)
+{
+	__be16 port;
+	struct tcphdr _tcph, *th;
+	struct udphdr _udph, *uh;
+	sctp_sctphdr_t _sctph, *sh;
+
+	switch (iph->protocol) {
+	case IPPROTO_TCP:
+		th = skb_header_pointer(skb, iph->len, sizeof(_tcph), &_tcph);
+		if (unlikely(th == NULL))
+			return 0;
+		port = th->source;
+		break;
+	case IPPROTO_UDP:
+		uh = skb_header_pointer(skb, iph->len, sizeof(_udph), &_udph);
+		if (unlikely(uh == NULL))
+			return 0;
+		port = uh->source;
+		break;
+	case IPPROTO_SCTP:
+		sh = skb_header_pointer(skb, iph->len, sizeof(_sctph), &_sctph);
+		if (unlikely(sh == NULL))
+			return 0;
+		port = sh->source;
+		break;
+	default:
+		port = 0;
+	}
+
+	return port;
+}
+
+
+/*
+ *      Maglev Hashing scheduling
+ */
+static struct ip_vs_dest *
+ip_vs_mh_schedule(struct ip_vs_service *svc, const struct sk_buff *skb,
+		  struct ip_vs_iphdr *iph)
+{
+	struct ip_vs_dest *dest;
+	struct ip_vs_mh_state *s;
+	__be16 port = 0;
+
+	IP_VS_DBG(6, "ip_vs_mh_schedule(): Scheduling...\n");
+
+	if (svc->flags & IP_VS_SVC_F_SCHED_MH_PORT)
+		port = ip_vs_mh_get_port(skb, iph);
+
+	s = (struct ip_vs_mh_state *) svc->sched_data;
+
+	if (svc->flags & IP_VS_SVC_F_SCHED_MH_FALLBACK)
+		dest = ip_vs_mh_get_fallback(svc, s, &iph->saddr, port);
+	else
+		dest = ip_vs_mh_get(svc, s, &iph->saddr, port);
+
+	if (!dest) {
+		ip_vs_scheduler_err(svc, "no destination available");
+		return NULL;
+	}
+
+	IP_VS_DBG_BUF(6, "MH: source IP address %s --> server %s:%d\n",
+		      IP_VS_DBG_ADDR(svc->af, &iph->saddr),
+		      IP_VS_DBG_ADDR(dest->af, &dest->addr),
+		      ntohs(dest->port));
+
+	return dest;
+}
+
+
+/*
+ *      IPVS MH Scheduler structure
+ */
+static struct ip_vs_scheduler ip_vs_mh_scheduler =
+{
+	.name =			"mh",
+	.refcnt =		ATOMIC_INIT(0),
+	.module =		THIS_MODULE,
+	.n_list	 =		LIST_HEAD_INIT(ip_vs_mh_scheduler.n_list),
+	.init_service =		ip_vs_mh_init_svc,
+	.done_service =		ip_vs_mh_done_svc,
+	.add_dest =		ip_vs_mh_dest_changed,
+	.del_dest =		ip_vs_mh_dest_changed,
+	.upd_dest =		ip_vs_mh_dest_changed,
+	.schedule =		ip_vs_mh_schedule,
+};
+
+
+static int __init ip_vs_mh_init(void)
+{
+	return register_ip_vs_scheduler(&ip_vs_mh_scheduler);
+}
+
+
+static void __exit ip_vs_mh_cleanup(void)
+{
+	unregister_ip_vs_scheduler(&ip_vs_mh_scheduler);
+	rcu_barrier();
+}
+
+
+module_init(ip_vs_mh_init);
+module_exit(ip_vs_mh_cleanup);
+MODULE_DESCRIPTION("Maglev hashing ipvs scheduler");
+MODULE_LICENSE("GPL");
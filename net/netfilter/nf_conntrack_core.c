@@ -296,7 +296,6 @@ destroy_conntrack(struct nf_conntrack *nfct)
 
 	pr_debug("destroy_conntrack(%p)\n", ct);
 	NF_CT_ASSERT(atomic_read(&nfct->use) == 0);
-	NF_CT_ASSERT(!timer_pending(&ct->timeout));
 
 	rcu_read_lock();
 	l4proto = __nf_ct_l4proto_find(nf_ct_l3num(ct), nf_ct_protonum(ct));
@@ -352,37 +351,49 @@ static void nf_ct_delete_from_lists(struct nf_conn *ct)
 	local_bh_enable();
 }
 
+/* Drops the reference held by the hash table. Whoever sets the DYING
+ * bit first gets to do this; everybody else gets false back.
+ */
 bool nf_ct_delete(struct nf_conn *ct, u32 portid, int report)
 {
 	struct nf_conn_tstamp *tstamp;
 
+	if (test_and_set_bit(IPS_DYING_BIT, &ct->status))
+		return false;
+
 	tstamp = nf_conn_tstamp_find(ct);
 	if (tstamp && tstamp->stop == 0)
 		tstamp->stop = ktime_get_real_ns();
 
-	if (nf_ct_is_dying(ct))
-		goto delete;
-
 	if (nf_conntrack_event_report(IPCT_DESTROY, ct,
 				    portid, report) < 0) {
-		/* destroy event was not delivered */
+		/* destroy event was not delivered. nf_ct_put will
+		 * be done by event cache worker on redelivery.
+		 */
 		nf_ct_delete_from_lists(ct);
 		nf_conntrack_ecache_delayed_work(nf_ct_net(ct));
 		return false;
 	}
 
 	nf_conntrack_ecache_work(nf_ct_net(ct));
-	set_bit(IPS_DYING_BIT, &ct->status);
- delete:
 	nf_ct_delete_from_lists(ct);
 	nf_ct_put(ct);
 	return true;
 }
 EXPORT_SYMBOL_GPL(nf_ct_delete);
 
-static void death_by_timeout(unsigned long ul_conntrack)
+/* Reap a conntrack that a lookup found past its timeout. Called under
+ * rcu_read_lock(); the entry may be going away under us.
+ */
+static void nf_ct_gc_expired(struct nf_conn *ct)
 {
-	nf_ct_delete((struct nf_conn *)ul_conntrack, 0, 0);
+	if (!atomic_inc_not_zero(&ct->ct_general.use))
+		return;
+
+	if (nf_ct_should_gc(ct))
+		nf_ct_kill(ct);
+
+	nf_ct_put(ct);
 }
 
 static inline bool
@@ -419,6 +430,13 @@ ____nf_conntrack_find(struct net *net, u16 zone,
 	local_bh_disable();
 begin:
 	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[bucket], hnnode) {
+		struct nf_conn *ct = nf_ct_tuplehash_to_ctrack(h);
+
+		if (nf_ct_is_expired(ct)) {
+			nf_ct_gc_expired(ct);
+			continue;
+		}
+
 		if (nf_ct_key_equal(h, tuple, zone)) {
 			NF_CT_STAT_INC(net, found);
 			local_bh_enable();
@@ -522,7 +540,6 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 		    zone == nf_ct_zone(nf_ct_tuplehash_to_ctrack(h)))
 			goto out;
 
-	add_timer(&ct->timeout);
 	smp_wmb();
 	/* The caller holds a reference to this object */
 	atomic_set(&ct->ct_general.use, 2);
@@ -635,11 +652,10 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		    zone == nf_ct_zone(nf_ct_tuplehash_to_ctrack(h)))
 			goto out;
 
-	/* Timer relative to confirmation time, not original
+	/* Timeout is relative to confirmation time, not original
 	   setting time, otherwise we'd get timer wrap in
 	   weird delay cases. */
-	ct->timeout.expires += jiffies;
-	add_timer(&ct->timeout);
+	ct->timeout += nfct_time_stamp;
 	atomic_inc(&ct->ct_general.use);
 	ct->status |= IPS_CONFIRMED;
 
@@ -652,7 +668,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 		tstamp->start = ktime_to_ns(skb->tstamp);
 	}
 	/* Since the lookup is lockless, hash insertion must be done after
-	 * starting the timer and setting the CONFIRMED bit. The RCU barriers
+	 * setting the timeout and the CONFIRMED bit. The RCU barriers
 	 * guarantee that no other CPU can find the conntrack before the above
 	 * stores are visible.
 	 */
@@ -697,8 +713,16 @@ nf_conntrack_tuple_taken(const struct nf_conntrack_tuple *tuple,
 	rcu_read_lock_bh();
 	hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash], hnnode) {
 		ct = nf_ct_tuplehash_to_ctrack(h);
-		if (ct != ignored_conntrack &&
-		    nf_ct_tuple_equal(tuple, &h->tuple) &&
+
+		if (ct == ignored_conntrack)
+			continue;
+
+		if (nf_ct_is_expired(ct)) {
+			nf_ct_gc_expired(ct);
+			continue;
+		}
+
+		if (nf_ct_tuple_equal(tuple, &h->tuple) &&
 		    nf_ct_zone(ct) == zone) {
 			NF_CT_STAT_INC(net, found);
 			rcu_read_unlock_bh();
@@ -741,7 +765,8 @@ restart:
 		hlist_nulls_for_each_entry_rcu(h, n, &net->ct.hash[hash],
 					 hnnode) {
 			tmp = nf_ct_tuplehash_to_ctrack(h);
-			if (!test_bit(IPS_ASSURED_BIT, &tmp->status) &&
+			if ((nf_ct_is_expired(tmp) ||
+			     !test_bit(IPS_ASSURED_BIT, &tmp->status)) &&
 			    !nf_ct_is_dying(tmp) &&
 			    atomic_inc_not_zero(&tmp->ct_general.use)) {
 				ct = tmp;
@@ -762,11 +787,9 @@ restart:
 	if (!ct)
 		return dropped;
 
-	if (del_timer(&ct->timeout)) {
-		if (nf_ct_delete(ct, 0, 0)) {
-			dropped = 1;
-			NF_CT_STAT_INC_ATOMIC(net, early_drop);
-		}
+	if (nf_ct_delete(ct, 0, 0)) {
+		dropped = 1;
+		NF_CT_STAT_INC_ATOMIC(net, early_drop);
 	}
 	nf_ct_put(ct);
 	return dropped;
@@ -829,8 +852,7 @@ __nf_conntrack_alloc(struct net *net, u16 zone,
 	/* save hash for reusing when confirming */
 	*(unsigned long *)(&ct->tuplehash[IP_CT_DIR_REPLY].hnnode.pprev) = hash;
 	ct->status = 0;
-	/* Don't set timer yet: wait for confirmation */
-	setup_timer(&ct->timeout, death_by_timeout, (unsigned long)ct);
+	ct->timeout = 0;
 	write_pnet(&ct->ct_net, net);
 	memset(&ct->__nfct_init_offset[0], 0,
 	       offsetof(struct nf_conn, proto) -
@@ -1207,24 +1229,23 @@ void __nf_ct_refresh_acct(struct nf_conn *ct,
 			  unsigned long extra_jiffies,
 			  int do_acct)
 {
-	NF_CT_ASSERT(ct->timeout.data == (unsigned long)ct);
 	NF_CT_ASSERT(skb);
 
 	/* Only update if this is not a fixed timeout */
 	if (test_bit(IPS_FIXED_TIMEOUT_BIT, &ct->status))
 		goto acct;
 
-	/* If not in hash table, timer will not be active yet */
+	/* If not in hash table, timeout is relative to confirmation */
 	if (!nf_ct_is_confirmed(ct)) {
-		ct->timeout.expires = extra_jiffies;
+		ct->timeout = extra_jiffies;
 	} else {
-		unsigned long newtime = jiffies + extra_jiffies;
+		u32 newtime = nfct_time_stamp + extra_jiffies;
 
 		/* Only update the timeout if the new timeout is at least
-		   HZ jiffies from the old timeout. Need del_timer for race
-		   avoidance (may already be dying). */
-		if (newtime - ct->timeout.expires >= HZ)
-			mod_timer_pending(&ct->timeout, newtime);
+		   HZ jiffies from the old timeout, so that a busy flow
+		   does not dirty the cache line on every packet. */
+		if (newtime - ct->timeout >= HZ)
+			WRITE_ONCE(ct->timeout, newtime);
 	}
 
 acct:
@@ -1260,11 +1281,11 @@ bool __nf_ct_kill_acct(struct nf_conn *ct,
 		}
 	}
 
-	if (del_timer(&ct->timeout)) {
-		ct->timeout.function((unsigned long)ct);
-		return true;
-	}
-	return false;
+	/* not in the hash table yet, nothing to kill */
+	if (!nf_ct_is_confirmed(ct))
+		return false;
+
+	return nf_ct_delete(ct, 0, 0);
 }
 EXPORT_SYMBOL_GPL(__nf_ct_kill_acct);
 
@@ -1399,16 +1420,98 @@ void nf_ct_iterate_cleanup(struct net *net,
 
 	while ((ct = get_next_corpse(net, iter, data, &bucket)) != NULL) {
 		/* Time to push up daises... */
-		if (del_timer(&ct->timeout))
-			nf_ct_delete(ct, portid, report);
-
-		/* ... else the timer will get him soon. */
-
+		nf_ct_delete(ct, portid, report);
 		nf_ct_put(ct);
 	}
 }
 EXPORT_SYMBOL_GPL(nf_ct_iterate_cleanup);
 
+/* Conntracks carry no timer; lookups reap expired entries they walk
+ * past and this worker sweeps the rest of the table in small batches,
+ * so that idle buckets get cleaned up without an expiry storm.
+ */
+#define GC_MAX_BUCKETS_DIV	64u
+#define GC_MAX_BUCKETS		8192u
+#define GC_INTERVAL		(5 * HZ)
+#define GC_MAX_EVICTS		256u
+
+static void gc_worker(struct work_struct *work)
+{
+	struct netns_ct *ctnet =
+		container_of(work, struct netns_ct, gc_dwork.work);
+	unsigned int i, goal, buckets = 0, expired_count = 0, scanned = 0;
+	unsigned long next_run = GC_INTERVAL;
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_node *n;
+	spinlock_t *lockp;
+
+	goal = clamp(ctnet->htable_size / GC_MAX_BUCKETS_DIV, 1u,
+		     GC_MAX_BUCKETS);
+	i = ctnet->gc_bucket;
+
+	do {
+		struct nf_conn *refs[16];
+		unsigned int evicted = 0;
+		bool more = false;
+
+		lockp = &nf_conntrack_locks[i % CONNTRACK_LOCKS];
+		local_bh_disable();
+		spin_lock(lockp);
+		/* the table may have been resized since we last looked */
+		if (i >= ctnet->htable_size) {
+			spin_unlock(lockp);
+			local_bh_enable();
+			i = 0;
+			continue;
+		}
+		hlist_nulls_for_each_entry(h, n, &ctnet->hash[i], hnnode) {
+			struct nf_conn *tmp;
+
+			if (NF_CT_DIRECTION(h) != IP_CT_DIR_ORIGINAL)
+				continue;
+
+			scanned++;
+			tmp = nf_ct_tuplehash_to_ctrack(h);
+			if (test_bit(IPS_OFFLOAD_BIT, &tmp->status)) {
+				nf_ct_offload_timeout(tmp);
+				continue;
+			}
+
+			if (!nf_ct_is_expired(tmp) ||
+			    !atomic_inc_not_zero(&tmp->ct_general.use))
+				continue;
+
+			refs[evicted] = tmp;
+			if (++evicted >= ARRAY_SIZE(refs)) {
+				more = true;
+				break;
+			}
+		}
+		spin_unlock(lockp);
+		local_bh_enable();
+
+		/* can't kill or _put while holding lock */
+		while (evicted) {
+			struct nf_conn *tmp = refs[--evicted];
+
+			if (nf_ct_should_gc(tmp) && nf_ct_kill(tmp))
+				expired_count++;
+			nf_ct_put(tmp);
+		}
+
+		if (!more)
+			i++;
+		cond_resched();
+	} while (++buckets < goal && expired_count < GC_MAX_EVICTS);
+
+	/* most of what we saw was dead, keep going right away */
+	if (scanned && expired_count * 100 / scanned >= 90)
+		next_run = 0;
+
+	ctnet->gc_bucket = i;
+	schedule_delayed_work(&ctnet->gc_dwork, next_run);
+}
+
 static int kill_all(struct nf_conn *i, void *data)
 {
 	return 1;
@@ -1489,6 +1592,9 @@ void nf_conntrack_cleanup_net_list(struct list_head *net_exit_list)
 	 *  netfilter framework.  Roll on, two-stage module
 	 *  delete...
 	 */
+	list_for_each_entry(net, net_exit_list, exit_list)
+		cancel_delayed_work_sync(&net->ct.gc_dwork);
+
 	synchronize_net();
 i_see_dead_people:
 	busy = 0;
@@ -1795,6 +1901,10 @@ int nf_conntrack_init_net(struct net *net)
 	ret = nf_conntrack_proto_pernet_init(net);
 	if (ret < 0)
 		goto err_proto;
+
+	INIT_DEFERRABLE_WORK(&net->ct.gc_dwork, gc_worker);
+	net->ct.gc_bucket = 0;
+	schedule_delayed_work(&net->ct.gc_dwork, GC_INTERVAL);
 	return 0;
 
 err_proto:
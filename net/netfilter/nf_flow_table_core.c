@@ -0,0 +1,356 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Flow table of offloaded conntracks: one table per netns, filled by the
+ * nf_tables "flow offload" expression and consulted from the prerouting
+ * hooks in nf_flow_table_ip.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/netfilter_ipv6.h>
+#include <net/ip6_fib.h>
+#include <net/netns/generic.h>
+#include <net/netfilter/nf_flow_table.h>
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_tuple.h>
+
+static int nf_flow_table_net_id __read_mostly;
+static u32 nf_flow_hash_rnd __read_mostly;
+
+struct nf_flowtable *nf_flow_table_net(const struct net *net)
+{
+	return net_generic(net, nf_flow_table_net_id);
+}
+EXPORT_SYMBOL_GPL(nf_flow_table_net);
+
+static void
+flow_offload_fill_dir(struct flow_offload *flow, struct nf_conn *ct,
+		      struct nf_flow_route *route,
+		      enum flow_offload_tuple_dir dir)
+{
+	struct flow_offload_tuple *ft = &flow->tuplehash[dir].tuple;
+	struct nf_conntrack_tuple *ctt = &ct->tuplehash[dir].tuple;
+	struct dst_entry *dst = route->tuple[dir].dst;
+
+	/* unions and padding are part of the lookup key */
+	memset(ft, 0, sizeof(*ft));
+
+	switch (ctt->src.l3num) {
+	case NFPROTO_IPV4:
+		ft->src_v4 = ctt->src.u3.in;
+		ft->dst_v4 = ctt->dst.u3.in;
+		break;
+#if IS_ENABLED(CONFIG_IPV6)
+	case NFPROTO_IPV6:
+		ft->src_v6 = ctt->src.u3.in6;
+		ft->dst_v6 = ctt->dst.u3.in6;
+		ft->dst_cookie = rt6_get_cookie((struct rt6_info *)dst);
+		break;
+#endif
+	}
+
+	ft->l3proto = ctt->src.l3num;
+	ft->l4proto = ctt->dst.protonum;
+	ft->src_port = ctt->src.u.tcp.port;
+	ft->dst_port = ctt->dst.u.tcp.port;
+
+	ft->iifidx = route->tuple[dir].ifindex;
+	ft->dir = dir;
+	ft->mtu = dst_mtu(dst);
+	ft->dst_cache = dst;
+}
+
+/* Takes its own references on the conntrack and on both routes. */
+struct flow_offload *
+flow_offload_alloc(struct nf_conn *ct, struct nf_flow_route *route)
+{
+	struct flow_offload *flow;
+
+	flow = kzalloc(sizeof(*flow), GFP_ATOMIC);
+	if (!flow)
+		return NULL;
+
+	nf_conntrack_get(&ct->ct_general);
+	flow->ct = ct;
+
+	dst_hold(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst);
+	dst_hold(route->tuple[FLOW_OFFLOAD_DIR_REPLY].dst);
+
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_ORIGINAL);
+	flow_offload_fill_dir(flow, ct, route, FLOW_OFFLOAD_DIR_REPLY);
+
+	if (test_bit(IPS_SRC_NAT_BIT, &ct->status))
+		flow->flags |= FLOW_OFFLOAD_SNAT;
+	if (test_bit(IPS_DST_NAT_BIT, &ct->status))
+		flow->flags |= FLOW_OFFLOAD_DNAT;
+
+	return flow;
+}
+EXPORT_SYMBOL_GPL(flow_offload_alloc);
+
+void flow_offload_free(struct flow_offload *flow)
+{
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_cache);
+	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_cache);
+	nf_ct_put(flow->ct);
+	kfree_rcu(flow, rcu_head);
+}
+EXPORT_SYMBOL_GPL(flow_offload_free);
+
+/* Once back on the slow path, conntrack has to pick up the TCP window
+ * again as it did not see the packets in between.
+ */
+#define NF_FLOWTABLE_TCP_PICKUP_TIMEOUT	(120 * HZ)
+#define NF_FLOWTABLE_UDP_PICKUP_TIMEOUT	(30 * HZ)
+
+static void flow_offload_fixup_tcp(struct nf_conn *ct)
+{
+	struct ip_ct_tcp *tcp = &ct->proto.tcp;
+
+	spin_lock_bh(&ct->lock);
+	tcp->state = TCP_CONNTRACK_ESTABLISHED;
+	tcp->seen[0].td_maxwin = 0;
+	tcp->seen[1].td_maxwin = 0;
+	spin_unlock_bh(&ct->lock);
+}
+
+static void flow_offload_fixup_ct_timeout(struct nf_conn *ct)
+{
+	unsigned long timeout;
+
+	if (nf_ct_protonum(ct) == IPPROTO_TCP)
+		timeout = NF_FLOWTABLE_TCP_PICKUP_TIMEOUT;
+	else
+		timeout = NF_FLOWTABLE_UDP_PICKUP_TIMEOUT;
+
+	if (nf_ct_expires(ct) > timeout)
+		ct->timeout = nfct_time_stamp + timeout;
+}
+
+/* Hand the flow back to the slow path; the gc worker unlinks it. */
+void flow_offload_teardown(struct flow_offload *flow)
+{
+	if (flow->flags & FLOW_OFFLOAD_TEARDOWN)
+		return;
+
+	flow->flags |= FLOW_OFFLOAD_TEARDOWN;
+	if (nf_ct_protonum(flow->ct) == IPPROTO_TCP)
+		flow_offload_fixup_tcp(flow->ct);
+	flow_offload_fixup_ct_timeout(flow->ct);
+}
+EXPORT_SYMBOL_GPL(flow_offload_teardown);
+
+static u32 flow_offload_hash(const struct nf_flowtable *flow_table,
+			     const struct flow_offload_tuple *tuple)
+{
+	return jhash(tuple, FLOW_OFFLOAD_KEY_LEN, nf_flow_hash_rnd) %
+	       flow_table->htable_size;
+}
+
+int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
+{
+	unsigned int hash, reply_hash;
+
+	flow->timeout = nfct_time_stamp + NF_FLOW_TIMEOUT;
+
+	hash = flow_offload_hash(flow_table,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple);
+	reply_hash = flow_offload_hash(flow_table,
+			&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple);
+
+	spin_lock_bh(&flow_table->lock);
+	hlist_add_head_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node,
+			   &flow_table->hash[hash]);
+	hlist_add_head_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node,
+			   &flow_table->hash[reply_hash]);
+	spin_unlock_bh(&flow_table->lock);
+
+	/* conntrack no longer sees the packets, keep it from expiring */
+	nf_ct_offload_timeout(flow->ct);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(flow_offload_add);
+
+/* Called with flow_table->lock held. */
+static void flow_offload_del(struct flow_offload *flow)
+{
+	struct nf_conn *ct = flow->ct;
+
+	hlist_del_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].node);
+	hlist_del_rcu(&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].node);
+
+	clear_bit(IPS_OFFLOAD_BIT, &ct->status);
+	if (!(flow->flags & FLOW_OFFLOAD_TEARDOWN) &&
+	    nf_ct_protonum(ct) == IPPROTO_TCP)
+		flow_offload_fixup_tcp(ct);
+	flow_offload_fixup_ct_timeout(ct);
+
+	flow_offload_free(flow);
+}
+
+/* Must be called under rcu_read_lock(). */
+struct flow_offload_tuple_hash *
+flow_offload_lookup(struct nf_flowtable *flow_table,
+		    const struct flow_offload_tuple *tuple)
+{
+	unsigned int hash = flow_offload_hash(flow_table, tuple);
+	struct flow_offload_tuple_hash *th;
+	struct flow_offload *flow;
+	int dir;
+
+	hlist_for_each_entry_rcu(th, &flow_table->hash[hash], node) {
+		if (memcmp(&th->tuple, tuple, FLOW_OFFLOAD_KEY_LEN))
+			continue;
+
+		dir = th->tuple.dir;
+		flow = container_of(th, struct flow_offload, tuplehash[dir]);
+		if (flow->flags & FLOW_OFFLOAD_TEARDOWN ||
+		    nf_ct_is_dying(flow->ct))
+			return NULL;
+
+		return th;
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(flow_offload_lookup);
+
+static inline bool nf_flow_has_expired(const struct flow_offload *flow)
+{
+	return (__s32)(flow->timeout - nfct_time_stamp) <= 0;
+}
+
+static void nf_flow_table_gc_step(struct nf_flowtable *flow_table,
+				  unsigned int bucket, bool flush)
+{
+	struct flow_offload_tuple_hash *th;
+	struct hlist_node *tmp;
+	struct flow_offload *flow;
+
+	spin_lock_bh(&flow_table->lock);
+	/* the reply node may be the next one in this chain; flows are
+	 * freed after a grace period, so following its next pointer
+	 * after unlinking it is fine
+	 */
+	hlist_for_each_entry_safe(th, tmp, &flow_table->hash[bucket], node) {
+		if (th->tuple.dir != FLOW_OFFLOAD_DIR_ORIGINAL)
+			continue;
+
+		flow = container_of(th, struct flow_offload,
+				    tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL]);
+		if (flush || nf_flow_has_expired(flow) ||
+		    flow->flags & FLOW_OFFLOAD_TEARDOWN ||
+		    nf_ct_is_dying(flow->ct))
+			flow_offload_del(flow);
+	}
+	spin_unlock_bh(&flow_table->lock);
+}
+
+static void nf_flow_offload_work_gc(struct work_struct *work)
+{
+	struct nf_flowtable *flow_table;
+	unsigned int i;
+
+	flow_table = container_of(work, struct nf_flowtable, gc_work.work);
+
+	for (i = 0; i < flow_table->htable_size; i++) {
+		nf_flow_table_gc_step(flow_table, i, false);
+		cond_resched();
+	}
+
+	queue_delayed_work(system_power_efficient_wq, &flow_table->gc_work, HZ);
+}
+
+static int __net_init nf_flow_table_net_init(struct net *net)
+{
+	struct nf_flowtable *flow_table = nf_flow_table_net(net);
+
+	net_get_random_once(&nf_flow_hash_rnd, sizeof(nf_flow_hash_rnd));
+
+	flow_table->htable_size = nf_conntrack_htable_size;
+	flow_table->hash = nf_ct_alloc_hashtable(&flow_table->htable_size, 0);
+	if (!flow_table->hash)
+		return -ENOMEM;
+
+	spin_lock_init(&flow_table->lock);
+	INIT_DEFERRABLE_WORK(&flow_table->gc_work, nf_flow_offload_work_gc);
+	queue_delayed_work(system_power_efficient_wq, &flow_table->gc_work, HZ);
+	return 0;
+}
+
+static void __net_exit nf_flow_table_net_exit(struct net *net)
+{
+	struct nf_flowtable *flow_table = nf_flow_table_net(net);
+	unsigned int i;
+
+	cancel_delayed_work_sync(&flow_table->gc_work);
+	for (i = 0; i < flow_table->htable_size; i++)
+		nf_flow_table_gc_step(flow_table, i, true);
+
+	/* flows are freed after a grace period */
+	rcu_barrier();
+	nf_ct_free_hashtable(flow_table->hash, flow_table->htable_size);
+}
+
+static struct pernet_operations nf_flow_table_net_ops = {
+	.init	= nf_flow_table_net_init,
+	.exit	= nf_flow_table_net_exit,
+	.id	= &nf_flow_table_net_id,
+	.size	= sizeof(struct nf_flowtable),
+};
+
+static struct nf_hook_ops nf_flow_offload_hook_ops[] __read_mostly = {
+	{
+		.hook		= nf_flow_offload_ip_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_PRE_ROUTING,
+		.priority	= NF_IP_PRI_FIRST,
+	},
+#if IS_ENABLED(CONFIG_IPV6)
+	{
+		.hook		= nf_flow_offload_ipv6_hook,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV6,
+		.hooknum	= NF_INET_PRE_ROUTING,
+		.priority	= NF_IP6_PRI_FIRST,
+	},
+#endif
+};
+
+static int __init nf_flow_table_module_init(void)
+{
+	int err;
+
+	err = register_pernet_subsys(&nf_flow_table_net_ops);
+	if (err < 0)
+		return err;
+
+	err = nf_register_hooks(nf_flow_offload_hook_ops,
+				ARRAY_SIZE(nf_flow_offload_hook_ops));
+	if (err < 0)
+		unregister_pernet_subsys(&nf_flow_table_net_ops);
+
+	return err;
+}
+
+static void __exit nf_flow_table_module_exit(void)
+{
+	nf_unregister_hooks(nf_flow_offload_hook_ops,
+			    ARRAY_SIZE(nf_flow_offload_hook_ops));
+	unregister_pernet_subsys(&nf_flow_table_net_ops);
+}
+
+module_init(nf_flow_table_module_init);
+module_exit(nf_flow_table_module_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,451 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Forwarding fast path for offloaded flows. A packet that matches a flow
+ * gets its NAT mangling and TTL decrement applied here and is handed to
+ * the neighbour layer on the cached route, so it skips conntrack, the
+ * routing lookup and the forward and postrouting hooks. Anything out of
+ * the ordinary is left to the slow path.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/netfilter.h>
+#include <net/arp.h>
+#include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/ndisc.h>
+#include <net/neighbour.h>
+#include <net/route.h>
+#include <net/ip6_route.h>
+#include <net/checksum.h>
+#include <net/netfilter/nf_flow_table.h>
+#include <net/netfilter/nf_conntrack.h>
+
+/* TCP and UDP keep their ports at the same place */
+struct flow_ports {
+	__be16 source, dest;
+};
+
+static unsigned int nf_flow_l4_hdrsize(u8 l4proto)
+{
+	switch (l4proto) {
+	case IPPROTO_TCP:
+		return sizeof(struct tcphdr);
+	case IPPROTO_UDP:
+		return sizeof(struct udphdr);
+	}
+	return 0;
+}
+
+/* The TCP connection is going away, let conntrack see it. */
+static int nf_flow_tcp_state_check(struct flow_offload *flow,
+				   struct sk_buff *skb, unsigned int thoff)
+{
+	struct tcphdr *tcph;
+
+	if (flow->tuplehash[0].tuple.l4proto != IPPROTO_TCP)
+		return 0;
+
+	tcph = (void *)(skb_network_header(skb) + thoff);
+	if (unlikely(tcph->fin || tcph->rst)) {
+		flow_offload_teardown(flow);
+		return -1;
+	}
+
+	return 0;
+}
+
+static bool nf_flow_exceeds_mtu(const struct sk_buff *skb, unsigned int mtu)
+{
+	if (skb->len <= mtu)
+		return false;
+
+	if (skb_is_gso(skb) && skb_gso_network_seglen(skb) <= mtu)
+		return false;
+
+	return true;
+}
+
+/* Takes a reference on the cached route, unless it is being released. */
+static struct dst_entry *nf_flow_dst_get(struct flow_offload *flow,
+					 enum flow_offload_tuple_dir dir)
+{
+	const struct flow_offload_tuple *tuple = &flow->tuplehash[dir].tuple;
+	struct dst_entry *dst = tuple->dst_cache;
+
+	if (dst->obsolete && !dst_check(dst, tuple->dst_cookie)) {
+		flow_offload_teardown(flow);
+		return NULL;
+	}
+
+	if (!atomic_inc_not_zero(&dst->__refcnt))
+		return NULL;
+
+	return dst;
+}
+
+/* Returns the checksum to fix up, or NULL for UDP without checksum. */
+static __sum16 *nf_flow_l4_check(struct sk_buff *skb, unsigned int thoff,
+				 u8 l4proto)
+{
+	void *l4hdr = skb_network_header(skb) + thoff;
+	struct udphdr *udph;
+
+	switch (l4proto) {
+	case IPPROTO_TCP:
+		return &((struct tcphdr *)l4hdr)->check;
+	case IPPROTO_UDP:
+		udph = l4hdr;
+		if (!udph->check && skb->ip_summed != CHECKSUM_PARTIAL)
+			return NULL;
+		return &udph->check;
+	}
+	return NULL;
+}
+
+static void nf_flow_nat_port(struct sk_buff *skb, __sum16 *check,
+			     __be16 *port, __be16 new_port)
+{
+	if (check)
+		inet_proto_csum_replace2(check, skb, *port, new_port, 0);
+	*port = new_port;
+}
+
+static void nf_flow_l4_check_done(__sum16 *check, u8 l4proto)
+{
+	if (check && l4proto == IPPROTO_UDP && !*check)
+		*check = CSUM_MANGLED_0;
+}
+
+static void nf_flow_nat_ip_addr(struct sk_buff *skb, struct iphdr *iph,
+				__sum16 *check, __be32 *addr, __be32 new_addr)
+{
+	csum_replace4(&iph->check, *addr, new_addr);
+	if (check)
+		inet_proto_csum_replace4(check, skb, *addr, new_addr, 1);
+	*addr = new_addr;
+}
+
+static void nf_flow_nat_ip(const struct flow_offload *flow, struct sk_buff *skb,
+			   unsigned int thoff, enum flow_offload_tuple_dir dir)
+{
+	const struct flow_offload_tuple *orig, *reply;
+	struct iphdr *iph = ip_hdr(skb);
+	struct flow_ports *ports;
+	__sum16 *check;
+
+	orig = &flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple;
+	reply = &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple;
+	ports = (void *)(skb_network_header(skb) + thoff);
+	check = nf_flow_l4_check(skb, thoff, iph->protocol);
+
+	if (flow->flags & FLOW_OFFLOAD_SNAT) {
+		if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+			nf_flow_nat_ip_addr(skb, iph, check, &iph->saddr,
+					    reply->dst_v4.s_addr);
+			nf_flow_nat_port(skb, check, &ports->source,
+					 reply->dst_port);
+		} else {
+			nf_flow_nat_ip_addr(skb, iph, check, &iph->daddr,
+					    orig->src_v4.s_addr);
+			nf_flow_nat_port(skb, check, &ports->dest,
+					 orig->src_port);
+		}
+	}
+
+	if (flow->flags & FLOW_OFFLOAD_DNAT) {
+		if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+			nf_flow_nat_ip_addr(skb, iph, check, &iph->daddr,
+					    reply->src_v4.s_addr);
+			nf_flow_nat_port(skb, check, &ports->dest,
+					 reply->src_port);
+		} else {
+			nf_flow_nat_ip_addr(skb, iph, check, &iph->saddr,
+					    orig->dst_v4.s_addr);
+			nf_flow_nat_port(skb, check, &ports->source,
+					 orig->dst_port);
+		}
+	}
+
+	nf_flow_l4_check_done(check, iph->protocol);
+}
+
+static int nf_flow_tuple_ip(struct sk_buff *skb, const struct net_device *dev,
+			    struct flow_offload_tuple *tuple,
+			    unsigned int *thoff)
+{
+	struct flow_ports *ports;
+	struct iphdr *iph;
+	unsigned int hdrsize;
+
+	if (!pskb_may_pull(skb, sizeof(*iph)))
+		return -1;
+
+	iph = ip_hdr(skb);
+	*thoff = iph->ihl * 4;
+
+	/* no options, no fragments, and a TTL left to forward with */
+	if (*thoff != sizeof(*iph) || ip_is_fragment(iph) || iph->ttl <= 1)
+		return -1;
+
+	hdrsize = nf_flow_l4_hdrsize(iph->protocol);
+	if (!hdrsize || !pskb_may_pull(skb, *thoff + hdrsize))
+		return -1;
+
+	iph = ip_hdr(skb);
+	ports = (void *)(skb_network_header(skb) + *thoff);
+
+	tuple->src_v4.s_addr	= iph->saddr;
+	tuple->dst_v4.s_addr	= iph->daddr;
+	tuple->src_port		= ports->source;
+	tuple->dst_port		= ports->dest;
+	tuple->l3proto		= AF_INET;
+	tuple->l4proto		= iph->protocol;
+	tuple->iifidx		= dev->ifindex;
+
+	return 0;
+}
+
+static void nf_flow_xmit_ip(struct sk_buff *skb, struct dst_entry *dst)
+{
+	struct net_device *dev = dst->dev;
+	struct neighbour *neigh;
+	u32 nexthop;
+
+	skb_dst_drop(skb);
+	skb_dst_set(skb, dst);
+	skb->dev = dev;
+
+	rcu_read_lock_bh();
+	nexthop = (__force u32)rt_nexthop((struct rtable *)dst,
+					  ip_hdr(skb)->daddr);
+	neigh = __ipv4_neigh_lookup_noref(dev, nexthop);
+	if (unlikely(!neigh))
+		neigh = __neigh_create(&arp_tbl, &nexthop, dev, false);
+	if (!IS_ERR(neigh))
+		dst_neigh_output(dst, neigh, skb);
+	else
+		kfree_skb(skb);
+	rcu_read_unlock_bh();
+}
+
+unsigned int nf_flow_offload_ip_hook(const struct nf_hook_ops *ops,
+				     struct sk_buff *skb,
+				     const struct net_device *in,
+				     const struct net_device *out,
+				     int (*okfn)(struct sk_buff *))
+{
+	struct flow_offload_tuple_hash *tuplehash;
+	struct flow_offload_tuple tuple = {};
+	enum flow_offload_tuple_dir dir;
+	struct flow_offload *flow;
+	struct dst_entry *dst;
+	unsigned int thoff;
+
+	if (skb->nfct || nf_flow_tuple_ip(skb, in, &tuple, &thoff) < 0)
+		return NF_ACCEPT;
+
+	tuplehash = flow_offload_lookup(nf_flow_table_net(dev_net(in)), &tuple);
+	if (tuplehash == NULL)
+		return NF_ACCEPT;
+
+	dir = tuplehash->tuple.dir;
+	flow = container_of(tuplehash, struct flow_offload, tuplehash[dir]);
+
+	/* let the slow path fragment or send the ICMP error */
+	if (unlikely(nf_flow_exceeds_mtu(skb, tuplehash->tuple.mtu)))
+		return NF_ACCEPT;
+
+	if (nf_flow_tcp_state_check(flow, skb, thoff))
+		return NF_ACCEPT;
+
+	if (!skb_make_writable(skb, thoff + nf_flow_l4_hdrsize(tuple.l4proto)))
+		return NF_DROP;
+
+	dst = nf_flow_dst_get(flow, dir);
+	if (!dst)
+		return NF_ACCEPT;
+
+	if (flow->flags & (FLOW_OFFLOAD_SNAT | FLOW_OFFLOAD_DNAT))
+		nf_flow_nat_ip(flow, skb, thoff, dir);
+
+	flow->timeout = nfct_time_stamp + NF_FLOW_TIMEOUT;
+
+	ip_decrease_ttl(ip_hdr(skb));
+	skb_forward_csum(skb);
+	nf_flow_xmit_ip(skb, dst);
+
+	return NF_STOLEN;
+}
+EXPORT_SYMBOL_GPL(nf_flow_offload_ip_hook);
+
+#if IS_ENABLED(CONFIG_IPV6)
+static void nf_flow_nat_ipv6_addr(struct sk_buff *skb, __sum16 *check,
+				  struct in6_addr *addr,
+				  const struct in6_addr *new_addr)
+{
+	if (check)
+		inet_proto_csum_replace16(check, skb, addr->s6_addr32,
+					  new_addr->s6_addr32, 1);
+	*addr = *new_addr;
+}
+
+static void nf_flow_nat_ipv6(const struct flow_offload *flow,
+			     struct sk_buff *skb, unsigned int thoff,
+			     enum flow_offload_tuple_dir dir)
+{
+	const struct flow_offload_tuple *orig, *reply;
+	struct ipv6hdr *ip6h = ipv6_hdr(skb);
+	struct flow_ports *ports;
+	__sum16 *check;
+
+	orig = &flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple;
+	reply = &flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple;
+	ports = (void *)(skb_network_header(skb) + thoff);
+	check = nf_flow_l4_check(skb, thoff, ip6h->nexthdr);
+
+	if (flow->flags & FLOW_OFFLOAD_SNAT) {
+		if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+			nf_flow_nat_ipv6_addr(skb, check, &ip6h->saddr,
+					      &reply->dst_v6);
+			nf_flow_nat_port(skb, check, &ports->source,
+					 reply->dst_port);
+		} else {
+			nf_flow_nat_ipv6_addr(skb, check, &ip6h->daddr,
+					      &orig->src_v6);
+			nf_flow_nat_port(skb, check, &ports->dest,
+					 orig->src_port);
+		}
+	}
+
+	if (flow->flags & FLOW_OFFLOAD_DNAT) {
+		if (dir == FLOW_OFFLOAD_DIR_ORIGINAL) {
+			nf_flow_nat_ipv6_addr(skb, check, &ip6h->daddr,
+					      &reply->src_v6);
+			nf_flow_nat_port(skb, check, &ports->dest,
+					 reply->src_port);
+		} else {
+			nf_flow_nat_ipv6_addr(skb, check, &ip6h->saddr,
+					      &orig->dst_v6);
+			nf_flow_nat_port(skb, check, &ports->source,
+					 orig->dst_port);
+		}
+	}
+
+	nf_flow_l4_check_done(check, ip6h->nexthdr);
+}
+
+static int nf_flow_tuple_ipv6(struct sk_buff *skb, const struct net_device *dev,
+			      struct flow_offload_tuple *tuple)
+{
+	struct flow_ports *ports;
+	struct ipv6hdr *ip6h;
+	unsigned int hdrsize;
+
+	if (!pskb_may_pull(skb, sizeof(*ip6h)))
+		return -1;
+
+	ip6h = ipv6_hdr(skb);
+
+	if (ip6h->hop_limit <= 1)
+		return -1;
+
+	/* extension headers are left to the slow path */
+	hdrsize = nf_flow_l4_hdrsize(ip6h->nexthdr);
+	if (!hdrsize || !pskb_may_pull(skb, sizeof(*ip6h) + hdrsize))
+		return -1;
+
+	ip6h = ipv6_hdr(skb);
+	ports = (void *)(skb_network_header(skb) + sizeof(*ip6h));
+
+	tuple->src_v6		= ip6h->saddr;
+	tuple->dst_v6		= ip6h->daddr;
+	tuple->src_port		= ports->source;
+	tuple->dst_port		= ports->dest;
+	tuple->l3proto		= AF_INET6;
+	tuple->l4proto		= ip6h->nexthdr;
+	tuple->iifidx		= dev->ifindex;
+
+	return 0;
+}
+
+static void nf_flow_xmit_ipv6(struct sk_buff *skb, struct dst_entry *dst)
+{
+	struct net_device *dev = dst->dev;
+	struct neighbour *neigh;
+	struct in6_addr *nexthop;
+
+	skb_dst_drop(skb);
+	skb_dst_set(skb, dst);
+	skb->dev = dev;
+
+	rcu_read_lock_bh();
+	nexthop = rt6_nexthop((struct rt6_info *)dst, &ipv6_hdr(skb)->daddr);
+	neigh = __ipv6_neigh_lookup_noref(dev, nexthop);
+	if (unlikely(!neigh))
+		neigh = __neigh_create(&nd_tbl, nexthop, dev, false);
+	if (!IS_ERR(neigh))
+		dst_neigh_output(dst, neigh, skb);
+	else
+		kfree_skb(skb);
+	rcu_read_unlock_bh();
+}
+
+unsigned int nf_flow_offload_ipv6_hook(const struct nf_hook_ops *ops,
+				       struct sk_buff *skb,
+				       const struct net_device *in,
+				       const struct net_device *out,
+				       int (*okfn)(struct sk_buff *))
+{
+	struct flow_offload_tuple_hash *tuplehash;
+	struct flow_offload_tuple tuple = {};
+	enum flow_offload_tuple_dir dir;
+	const unsigned int thoff = sizeof(struct ipv6hdr);
+	struct flow_offload *flow;
+	struct dst_entry *dst;
+
+	if (skb->nfct || nf_flow_tuple_ipv6(skb, in, &tuple) < 0)
+		return NF_ACCEPT;
+
+	tuplehash = flow_offload_lookup(nf_flow_table_net(dev_net(in)), &tuple);
+	if (tuplehash == NULL)
+		return NF_ACCEPT;
+
+	dir = tuplehash->tuple.dir;
+	flow = container_of(tuplehash, struct flow_offload, tuplehash[dir]);
+
+	/* let the slow path send the packet too big error */
+	if (unlikely(nf_flow_exceeds_mtu(skb, tuplehash->tuple.mtu)))
+		return NF_ACCEPT;
+
+	if (nf_flow_tcp_state_check(flow, skb, thoff))
+		return NF_ACCEPT;
+
+	if (!skb_make_writable(skb, thoff + nf_flow_l4_hdrsize(tuple.l4proto)))
+		return NF_DROP;
+
+	dst = nf_flow_dst_get(flow, dir);
+	if (!dst)
+		return NF_ACCEPT;
+
+	if (flow->flags & (FLOW_OFFLOAD_SNAT | FLOW_OFFLOAD_DNAT))
+		nf_flow_nat_ipv6(flow, skb, thoff, dir);
+
+	flow->timeout = nfct_time_stamp + NF_FLOW_TIMEOUT;
+
+	ipv6_hdr(skb)->hop_limit--;
+	skb_forward_csum(skb);
+	nf_flow_xmit_ipv6(skb, dst);
+
+	return NF_STOLEN;
+}
+EXPORT_SYMBOL_GPL(nf_flow_offload_ipv6_hook);
+#endif
@@ -2208,6 +2208,11 @@ static const struct nla_policy nft_set_policy[NFTA_SET_MAX + 1] = {
 
 static const struct nla_policy nft_set_desc_policy[NFTA_SET_DESC_MAX + 1] = {
 	[NFTA_SET_DESC_SIZE]		= { .type = NLA_U32 },
+	[NFTA_SET_DESC_CONCAT]		= { .type = NLA_NESTED },
+};
+
+static const struct nla_policy nft_set_field_policy[NFTA_SET_FIELD_MAX + 1] = {
+	[NFTA_SET_FIELD_LEN]		= { .type = NLA_U32 },
 };
 
 static int nft_ctx_init_from_setattr(struct nft_ctx *ctx,
@@ -2315,6 +2320,30 @@ cont:
 	return 0;
 }
 
+static int nf_tables_fill_set_concat(struct sk_buff *skb,
+				     const struct nft_set *set)
+{
+	struct nlattr *concat, *field;
+	int i;
+
+	concat = nla_nest_start(skb, NFTA_SET_DESC_CONCAT);
+	if (concat == NULL)
+		return -1;
+
+	for (i = 0; i < set->field_count; i++) {
+		field = nla_nest_start(skb, NFTA_LIST_ELEM);
+		if (field == NULL)
+			return -1;
+		if (nla_put_be32(skb, NFTA_SET_FIELD_LEN,
+				 htonl(set->field_len[i])))
+			return -1;
+		nla_nest_end(skb, field);
+	}
+
+	nla_nest_end(skb, concat);
+	return 0;
+}
+
 static int nf_tables_fill_set(struct sk_buff *skb, const struct nft_ctx *ctx,
 			      const struct nft_set *set, u16 event, u16 flags)
 {
@@ -2365,6 +2394,9 @@ static int nf_tables_fill_set(struct sk_buff *skb, const struct nft_ctx *ctx,
 	if (set->size &&
 	    nla_put_be32(skb, NFTA_SET_DESC_SIZE, htonl(set->size)))
 		goto nla_put_failure;
+	if (set->field_count > 1 &&
+	    nf_tables_fill_set_concat(skb, set) < 0)
+		goto nla_put_failure;
 	nla_nest_end(skb, desc);
 
 	return nlmsg_end(skb, nlh);
@@ -2534,6 +2566,58 @@ err:
 	return err;
 }
 
+static int nf_tables_set_desc_parse_field(struct nft_set_desc *desc,
+					  const struct nlattr *attr)
+{
+	struct nlattr *tb[NFTA_SET_FIELD_MAX + 1];
+	u32 len;
+	int err;
+
+	if (desc->field_count >= ARRAY_SIZE(desc->field_len))
+		return -E2BIG;
+
+	err = nla_parse_nested(tb, NFTA_SET_FIELD_MAX, attr,
+			       nft_set_field_policy);
+	if (err < 0)
+		return err;
+
+	if (tb[NFTA_SET_FIELD_LEN] == NULL)
+		return -EINVAL;
+
+	len = ntohl(nla_get_be32(tb[NFTA_SET_FIELD_LEN]));
+	if (len == 0 || len > FIELD_SIZEOF(struct nft_data, data))
+		return -EINVAL;
+
+	desc->field_len[desc->field_count++] = len;
+	return 0;
+}
+
+static int nf_tables_set_desc_parse_concat(struct nft_set_desc *desc,
+					   const struct nlattr *nla)
+{
+	const struct nlattr *attr;
+	unsigned int klen = 0;
+	int rem, err, i;
+
+	nla_for_each_nested(attr, nla, rem) {
+		if (nla_type(attr) != NFTA_LIST_ELEM)
+			return -EINVAL;
+
+		err = nf_tables_set_desc_parse_field(desc, attr);
+		if (err < 0)
+			return err;
+	}
+
+	for (i = 0; i < desc->field_count; i++)
+		klen += desc->field_len[i];
+
+	/* fields are packed back to back and must make up the whole key */
+	if (klen != desc->klen)
+		return -EINVAL;
+
+	return 0;
+}
+
 static int nf_tables_set_desc_parse(const struct nft_ctx *ctx,
 				    struct nft_set_desc *desc,
 				    const struct nlattr *nla)
@@ -2547,6 +2631,12 @@ static int nf_tables_set_desc_parse(const struct nft_ctx *ctx,
 
 	if (da[NFTA_SET_DESC_SIZE] != NULL)
 		desc->size = ntohl(nla_get_be32(da[NFTA_SET_DESC_SIZE]));
+	if (da[NFTA_SET_DESC_CONCAT] != NULL) {
+		err = nf_tables_set_desc_parse_concat(desc,
+						      da[NFTA_SET_DESC_CONCAT]);
+		if (err < 0)
+			return err;
+	}
 
 	return 0;
 }
@@ -2685,6 +2775,8 @@ static int nf_tables_newset(struct sock *nlsk, struct sk_buff *skb,
 	set->flags = flags;
 	set->size  = desc.size;
 	set->policy = policy;
+	set->field_count = desc.field_count;
+	memcpy(set->field_len, desc.field_len, sizeof(set->field_len));
 
 	err = ops->init(set, &desc, nla);
 	if (err < 0)
@@ -2817,6 +2909,7 @@ static const struct nla_policy nft_set_elem_policy[NFTA_SET_ELEM_MAX + 1] = {
 	[NFTA_SET_ELEM_KEY]		= { .type = NLA_NESTED },
 	[NFTA_SET_ELEM_DATA]		= { .type = NLA_NESTED },
 	[NFTA_SET_ELEM_FLAGS]		= { .type = NLA_U32 },
+	[NFTA_SET_ELEM_KEY_END]		= { .type = NLA_NESTED },
 };
 
 static const struct nla_policy nft_set_elem_list_policy[NFTA_SET_ELEM_LIST_MAX + 1] = {
@@ -2866,6 +2959,11 @@ static int nf_tables_fill_setelem(struct sk_buff *skb,
 			  set->klen) < 0)
 		goto nla_put_failure;
 
+	if (nft_set_has_key_end(set) &&
+	    nft_data_dump(skb, NFTA_SET_ELEM_KEY_END, &elem->key_end,
+			  NFT_DATA_VALUE, set->klen) < 0)
+		goto nla_put_failure;
+
 	if (set->flags & NFT_SET_MAP &&
 	    !(elem->flags & NFT_SET_ELEM_INTERVAL_END) &&
 	    nft_data_dump(skb, NFTA_SET_ELEM_DATA, &elem->data,
@@ -3095,6 +3193,33 @@ static struct nft_trans *nft_trans_elem_alloc(struct nft_ctx *ctx,
 	return trans;
 }
 
+static int nft_set_elem_parse_key_end(const struct nft_ctx *ctx,
+				      const struct nft_set *set,
+				      struct nft_set_elem *elem,
+				      struct nlattr *nla[])
+{
+	struct nft_data_desc desc;
+	int err;
+
+	memset(&elem->key_end, 0, sizeof(elem->key_end));
+	if (!nft_set_has_key_end(set))
+		return nla[NFTA_SET_ELEM_KEY_END] != NULL ? -EINVAL : 0;
+
+	if (nla[NFTA_SET_ELEM_KEY_END] == NULL)
+		return -EINVAL;
+
+	err = nft_data_init(ctx, &elem->key_end, &desc,
+			    nla[NFTA_SET_ELEM_KEY_END]);
+	if (err < 0)
+		return err;
+
+	if (desc.type != NFT_DATA_VALUE || desc.len != set->klen) {
+		nft_data_uninit(&elem->key_end, desc.type);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 			    const struct nlattr *attr)
 {
@@ -3143,6 +3268,10 @@ static int nft_add_set_elem(struct nft_ctx *ctx, struct nft_set *set,
 	if (d1.type != NFT_DATA_VALUE || d1.len != set->klen)
 		goto err2;
 
+	err = nft_set_elem_parse_key_end(ctx, set, &elem, nla);
+	if (err < 0)
+		goto err2;
+
 	err = -EEXIST;
 	if (set->ops->get(set, &elem) == 0)
 		goto err2;
@@ -3260,6 +3389,10 @@ static int nft_del_setelem(struct nft_ctx *ctx, struct nft_set *set,
 	if (desc.type != NFT_DATA_VALUE || desc.len != set->klen)
 		goto err2;
 
+	err = nft_set_elem_parse_key_end(ctx, set, &elem, nla);
+	if (err < 0)
+		goto err2;
+
 	err = set->ops->get(set, &elem);
 	if (err < 0)
 		goto err2;
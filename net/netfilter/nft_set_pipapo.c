@@ -0,0 +1,780 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Set backend matching concatenations of ranges, e.g. an address range
+ * followed by a port range, in a single lookup.
+ *
+ * Each range of each field is covered by a minimal set of prefixes, and
+ * every prefix becomes a rule of that field. A field is split into 4-bit
+ * groups, and for every group there is one bitmap per possible group
+ * value (bucket), with bit n set if rule n accepts that value. Matching a
+ * field is the intersection of the buckets selected by the packet's
+ * group values, restricted to the rules that the matching rules of the
+ * previous field map to. The single matching rule left in the last
+ * field points to the element.
+ *
+ * Lookups cost one bitmap AND per group, independent of how many ranges
+ * the elements expand to, up to the width of the bitmaps.
+ *
+ * Insertions append the new rules to each field and publish them from
+ * the last field backwards, so a concurrent lookup never sees a partial
+ * element match. Removals clear the bits of the element's rules in place.
+ * The holes left behind are reclaimed when the tables are rebuilt, which
+ * happens when they run out of room or when more than half of the rules
+ * are dead. Rebuilt tables replace the old ones under RCU.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/bitmap.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables.h>
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+#include <asm/cpufeature.h>
+#include <asm/i387.h>
+#endif
+
+#define NFT_PIPAPO_GROUP_BITS	4
+#define NFT_PIPAPO_BUCKETS	(1 << NFT_PIPAPO_GROUP_BITS)
+#define NFT_PIPAPO_MAX_BYTES	FIELD_SIZEOF(struct nft_data, data)
+
+/* Below this bitmap width (in longs) the FPU save costs more than the
+ * vector AND saves.
+ */
+#define NFT_PIPAPO_AVX2_MIN	8
+
+struct nft_pipapo_elem;
+
+/**
+ *	struct nft_pipapo_map - where a rule leads to
+ *
+ *	@to: first rule of the next field
+ *	@n: number of rules of the next field
+ *	@e: matching element (last field only)
+ */
+struct nft_pipapo_map {
+	u32			to;
+	u32			n;
+	struct nft_pipapo_elem	*e;
+};
+
+/**
+ *	struct nft_pipapo_field - lookup and mapping tables of one field
+ *
+ *	@offset: offset of the field in the key, in bytes
+ *	@len: length of the field, in bytes
+ *	@groups: number of 4-bit groups of the field
+ *	@rules: number of rules in use, including dead ones
+ *	@bsize: size of one bucket bitmap, in longs
+ *	@lt: bucket bitmaps, indexed by group, then group value
+ *	@mt: mapping of each rule
+ */
+struct nft_pipapo_field {
+	unsigned int		offset;
+	unsigned int		len;
+	unsigned int		groups;
+	unsigned int		rules;
+	unsigned int		bsize;
+	unsigned long		*lt;
+	struct nft_pipapo_map	*mt;
+};
+
+/**
+ *	struct nft_pipapo_match - set of tables used by lookups
+ *
+ *	@field_count: number of fields
+ *	@bsize_max: largest bucket bitmap size of all fields, in longs
+ *	@dead: number of rules of removed elements, over all fields
+ *	@scratch: per-cpu result bitmaps for lookups, 2 * @bsize_max longs
+ *	@rcu: used to release the tables after a rebuild
+ *	@f: fields
+ */
+struct nft_pipapo_match {
+	unsigned int		field_count;
+	unsigned int		bsize_max;
+	unsigned int		dead;
+	unsigned long __percpu	*scratch;
+	struct rcu_head		rcu;
+	struct nft_pipapo_field	f[];
+};
+
+struct nft_pipapo_elem {
+	struct list_head	list;
+	struct rcu_head		rcu;
+	u32			first[NFT_SET_MAXFIELDS];
+	u32			nrules[NFT_SET_MAXFIELDS];
+	u16			flags;
+	struct nft_data		key;
+	struct nft_data		key_end;
+	struct nft_data		data[];
+};
+
+struct nft_pipapo {
+	struct nft_pipapo_match __rcu	*match;
+	struct mutex			lock;	/* updates, get and walk */
+	struct list_head		elems;
+};
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+static bool nft_pipapo_avx2 __read_mostly;
+
+static void pipapo_and_avx2(unsigned long *dst, const unsigned long *src,
+			    unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i + 4 <= len; i += 4)
+		asm volatile("vmovdqu %1, %%ymm0\n\t"
+			     "vpand %0, %%ymm0, %%ymm0\n\t"
+			     "vmovdqu %%ymm0, %0\n\t"
+			     : "+m" (*(u8 (*)[32])&dst[i])
+			     : "m" (*(const u8 (*)[32])&src[i])
+			     : "xmm0");
+
+	for (; i < len; i++)
+		dst[i] &= src[i];
+}
+#endif
+
+static void pipapo_and(unsigned long *dst, const unsigned long *src,
+		       unsigned int len, bool simd)
+{
+	unsigned int i;
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+	if (simd) {
+		pipapo_and_avx2(dst, src, len);
+		return;
+	}
+#endif
+	for (i = 0; i < len; i++)
+		dst[i] &= src[i];
+}
+
+static inline unsigned int pipapo_group(const u8 *data, unsigned int group)
+{
+	u8 byte = data[group / 2];
+
+	return group % 2 ? byte & 0x0f : byte >> 4;
+}
+
+static inline unsigned long *pipapo_bucket(const struct nft_pipapo_field *f,
+					   unsigned int group, unsigned int v)
+{
+	return f->lt + (group * NFT_PIPAPO_BUCKETS + v) * f->bsize;
+}
+
+static const struct nft_pipapo_elem *
+pipapo_get_match(const struct nft_pipapo_match *m, const u8 *key,
+		 unsigned long *res, unsigned long *fill, bool simd)
+{
+	const struct nft_pipapo_field *f;
+	unsigned int i, g, b;
+
+	for (i = 0; i < m->field_count; i++) {
+		const u8 *p;
+
+		f = &m->f[i];
+		p = key + f->offset;
+
+		g = 0;
+		if (i == 0) {
+			memcpy(res, pipapo_bucket(f, 0, pipapo_group(p, 0)),
+			       f->bsize * sizeof(unsigned long));
+			g = 1;
+		}
+		for (; g < f->groups; g++)
+			pipapo_and(res, pipapo_bucket(f, g, pipapo_group(p, g)),
+				   f->bsize, simd);
+
+		b = find_first_bit(res, f->bsize * BITS_PER_LONG);
+		if (b >= f->bsize * BITS_PER_LONG)
+			return NULL;
+
+		/* pairs with smp_wmb() in pipapo_insert_rule() */
+		smp_rmb();
+
+		if (i == m->field_count - 1)
+			return f->mt[b].e;
+
+		bitmap_zero(fill, m->f[i + 1].bsize * BITS_PER_LONG);
+		for (; b < f->bsize * BITS_PER_LONG;
+		     b = find_next_bit(res, f->bsize * BITS_PER_LONG, b + 1))
+			bitmap_set(fill, f->mt[b].to, f->mt[b].n);
+
+		swap(res, fill);
+	}
+
+	return NULL;
+}
+
+static bool nft_pipapo_lookup(const struct nft_set *set,
+			      const struct nft_data *key,
+			      struct nft_data *data)
+{
+	const struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_match *m;
+	const struct nft_pipapo_elem *e;
+	unsigned long *res;
+	bool simd = false;
+
+	m = rcu_dereference(priv->match);
+
+	local_bh_disable();
+	res = this_cpu_ptr(m->scratch);
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+	if (nft_pipapo_avx2 && m->bsize_max >= NFT_PIPAPO_AVX2_MIN &&
+	    irq_fpu_usable()) {
+		kernel_fpu_begin();
+		simd = true;
+	}
+#endif
+	e = pipapo_get_match(m, (const u8 *)key->data, res,
+			     res + m->bsize_max, simd);
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+	if (simd)
+		kernel_fpu_end();
+#endif
+	local_bh_enable();
+
+	if (e == NULL)
+		return false;
+
+	if (set->flags & NFT_SET_MAP)
+		nft_data_copy(data, e->data);
+	return true;
+}
+
+/* Bit @n of a big endian number, counting from the least significant */
+static inline bool pipapo_test_bit(const u8 *data, unsigned int len,
+				   unsigned int n)
+{
+	return data[len - 1 - n / BITS_PER_BYTE] & (1 << (n % BITS_PER_BYTE));
+}
+
+/* Copy @src to @dst, setting its @n least significant bits */
+static void pipapo_set_low(u8 *dst, const u8 *src, unsigned int len,
+			   unsigned int n)
+{
+	unsigned int i;
+
+	memcpy(dst, src, len);
+	for (i = len; n >= BITS_PER_BYTE; n -= BITS_PER_BYTE)
+		dst[--i] = 0xff;
+	if (n)
+		dst[i - 1] |= (1 << n) - 1;
+}
+
+static void pipapo_inc(u8 *data, unsigned int len)
+{
+	while (len-- && ++data[len] == 0)
+		;
+}
+
+static void pipapo_insert_rule(struct nft_pipapo_field *f, unsigned int rule,
+			       const struct nft_pipapo_map *map,
+			       const u8 *base, unsigned int plen)
+{
+	unsigned int g, v, lo, hi, wild;
+
+	f->mt[rule] = *map;
+	/* the mapping must be in place before lookups can match the rule */
+	smp_wmb();
+
+	for (g = 0; g < f->groups; g++) {
+		if (plen >= (g + 1) * NFT_PIPAPO_GROUP_BITS)
+			wild = 0;
+		else if (plen <= g * NFT_PIPAPO_GROUP_BITS)
+			wild = NFT_PIPAPO_GROUP_BITS;
+		else
+			wild = (g + 1) * NFT_PIPAPO_GROUP_BITS - plen;
+
+		lo = pipapo_group(base, g) & ~((1 << wild) - 1);
+		hi = lo | ((1 << wild) - 1);
+		for (v = lo; v <= hi; v++)
+			__set_bit(rule, pipapo_bucket(f, g, v));
+	}
+}
+
+/* Cover [start, end] with the fewest prefixes and add a rule for each,
+ * starting at @rule. With no field given, only count them.
+ */
+static unsigned int pipapo_expand(struct nft_pipapo_field *f,
+				  unsigned int rule,
+				  const struct nft_pipapo_map *map,
+				  const u8 *start, const u8 *end,
+				  unsigned int len)
+{
+	unsigned int bits = len * BITS_PER_BYTE;
+	u8 base[NFT_PIPAPO_MAX_BYTES], last[NFT_PIPAPO_MAX_BYTES];
+	unsigned int n = 0, wild;
+
+	memcpy(base, start, len);
+	for (;;) {
+		/* widen while base stays aligned and the block ends in range */
+		for (wild = 0; wild < bits; wild++) {
+			if (pipapo_test_bit(base, len, wild))
+				break;
+			pipapo_set_low(last, base, len, wild + 1);
+			if (memcmp(last, end, len) > 0)
+				break;
+		}
+
+		if (f != NULL)
+			pipapo_insert_rule(f, rule + n, map, base, bits - wild);
+		n++;
+
+		pipapo_set_low(last, base, len, wild);
+		if (memcmp(last, end, len) == 0)
+			break;
+
+		pipapo_inc(last, len);
+		memcpy(base, last, len);
+	}
+
+	return n;
+}
+
+static void pipapo_count_rules(const struct nft_pipapo_match *m,
+			       const struct nft_pipapo_elem *e,
+			       unsigned int *nrules)
+{
+	const u8 *start = (const u8 *)e->key.data;
+	const u8 *end = (const u8 *)e->key_end.data;
+	const struct nft_pipapo_field *f;
+	unsigned int i;
+
+	for (i = 0; i < m->field_count; i++) {
+		f = &m->f[i];
+		nrules[i] = pipapo_expand(NULL, 0, NULL, start + f->offset,
+					  end + f->offset, f->len);
+	}
+}
+
+/* Add the rules of @e, from the last field backwards. */
+static void pipapo_write_elem(struct nft_pipapo_match *m,
+			      struct nft_pipapo_elem *e)
+{
+	const u8 *start = (const u8 *)e->key.data;
+	const u8 *end = (const u8 *)e->key_end.data;
+	struct nft_pipapo_map map;
+	struct nft_pipapo_field *f;
+	int i;
+
+	for (i = m->field_count - 1; i >= 0; i--) {
+		f = &m->f[i];
+
+		memset(&map, 0, sizeof(map));
+		if (i == m->field_count - 1) {
+			map.e = e;
+		} else {
+			map.to = e->first[i + 1];
+			map.n = e->nrules[i + 1];
+		}
+
+		e->first[i] = f->rules;
+		e->nrules[i] = pipapo_expand(f, f->rules, &map,
+					     start + f->offset,
+					     end + f->offset, f->len);
+		f->rules += e->nrules[i];
+	}
+}
+
+/* Make the rules of @e unmatchable, from the first field onwards. */
+static void pipapo_clear_elem(struct nft_pipapo_match *m,
+			      const struct nft_pipapo_elem *e)
+{
+	struct nft_pipapo_field *f;
+	unsigned int i, r, row;
+
+	for (i = 0; i < m->field_count; i++) {
+		f = &m->f[i];
+		for (row = 0; row < f->groups * NFT_PIPAPO_BUCKETS; row++) {
+			for (r = e->first[i]; r < e->first[i] + e->nrules[i];
+			     r++)
+				__clear_bit(r, f->lt + row * f->bsize);
+		}
+		m->dead += e->nrules[i];
+	}
+}
+
+static void *pipapo_zalloc(size_t size)
+{
+	void *p;
+
+	p = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (p == NULL)
+		p = vzalloc(size);
+	return p;
+}
+
+static void pipapo_free(const void *p)
+{
+	if (is_vmalloc_addr(p))
+		vfree(p);
+	else
+		kfree(p);
+}
+
+static void pipapo_match_free(struct nft_pipapo_match *m)
+{
+	unsigned int i;
+
+	for (i = 0; i < m->field_count; i++) {
+		pipapo_free(m->f[i].lt);
+		pipapo_free(m->f[i].mt);
+	}
+	free_percpu(m->scratch);
+	kfree(m);
+}
+
+static void pipapo_match_free_rcu(struct rcu_head *head)
+{
+	pipapo_match_free(container_of(head, struct nft_pipapo_match, rcu));
+}
+
+/* Allocate empty tables with room for @size rules in each field. */
+static struct nft_pipapo_match *pipapo_match_alloc(const struct nft_set *set,
+						   const unsigned int *size)
+{
+	struct nft_pipapo_match *m;
+	struct nft_pipapo_field *f;
+	unsigned int i, offset = 0;
+
+	m = kzalloc(sizeof(*m) + set->field_count * sizeof(m->f[0]),
+		    GFP_KERNEL);
+	if (m == NULL)
+		return NULL;
+
+	m->field_count = set->field_count;
+	for (i = 0; i < m->field_count; i++) {
+		f = &m->f[i];
+		f->offset = offset;
+		f->len = set->field_len[i];
+		f->groups = f->len * BITS_PER_BYTE / NFT_PIPAPO_GROUP_BITS;
+		f->bsize = BITS_TO_LONGS(max(size[i], 1U));
+		offset += f->len;
+
+		f->lt = pipapo_zalloc(f->groups * NFT_PIPAPO_BUCKETS *
+				      f->bsize * sizeof(unsigned long));
+		f->mt = pipapo_zalloc(f->bsize * BITS_PER_LONG *
+				      sizeof(struct nft_pipapo_map));
+		if (f->lt == NULL || f->mt == NULL)
+			goto err;
+
+		m->bsize_max = max(m->bsize_max, f->bsize);
+	}
+
+	m->scratch = __alloc_percpu(2 * m->bsize_max * sizeof(unsigned long),
+				    __alignof__(unsigned long));
+	if (m->scratch == NULL)
+		goto err;
+
+	return m;
+err:
+	pipapo_match_free(m);
+	return NULL;
+}
+
+/* Build compacted tables from the element list, with room to spare for
+ * @extra more rules in each field.
+ */
+static struct nft_pipapo_match *pipapo_rebuild(const struct nft_set *set,
+					       struct nft_pipapo *priv,
+					       const unsigned int *extra)
+{
+	unsigned int size[NFT_SET_MAXFIELDS];
+	struct nft_pipapo_elem *e;
+	struct nft_pipapo_match *m;
+	unsigned int i;
+
+	for (i = 0; i < set->field_count; i++)
+		size[i] = extra[i];
+	list_for_each_entry(e, &priv->elems, list) {
+		for (i = 0; i < set->field_count; i++)
+			size[i] += e->nrules[i];
+	}
+	for (i = 0; i < set->field_count; i++)
+		size[i] *= 2;
+
+	m = pipapo_match_alloc(set, size);
+	if (m == NULL)
+		return NULL;
+
+	list_for_each_entry(e, &priv->elems, list)
+		pipapo_write_elem(m, e);
+
+	return m;
+}
+
+static void pipapo_replace(struct nft_pipapo *priv,
+			   struct nft_pipapo_match *old,
+			   struct nft_pipapo_match *new)
+{
+	rcu_assign_pointer(priv->match, new);
+	call_rcu(&old->rcu, pipapo_match_free_rcu);
+}
+
+static bool pipapo_elem_cmp(const struct nft_set *set,
+			    const struct nft_pipapo_elem *e,
+			    const struct nft_set_elem *elem)
+{
+	return !nft_data_cmp(&e->key, &elem->key, set->klen) &&
+	       !nft_data_cmp(&e->key_end, &elem->key_end, set->klen);
+}
+
+static int nft_pipapo_insert(const struct nft_set *set,
+			     const struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	unsigned int nrules[NFT_SET_MAXFIELDS];
+	struct nft_pipapo_match *m, *new;
+	struct nft_pipapo_elem *e;
+	unsigned int i, size;
+	bool room = true;
+
+	if (elem->flags & NFT_SET_ELEM_INTERVAL_END)
+		return -EINVAL;
+
+	size = sizeof(*e);
+	if (set->flags & NFT_SET_MAP)
+		size += sizeof(e->data[0]);
+
+	e = kzalloc(size, GFP_KERNEL);
+	if (e == NULL)
+		return -ENOMEM;
+
+	e->flags = elem->flags;
+	nft_data_copy(&e->key, &elem->key);
+	nft_data_copy(&e->key_end, &elem->key_end);
+	if (set->flags & NFT_SET_MAP)
+		nft_data_copy(e->data, &elem->data);
+
+	mutex_lock(&priv->lock);
+	m = rcu_dereference_protected(priv->match,
+				      lockdep_is_held(&priv->lock));
+
+	for (i = 0; i < m->field_count; i++) {
+		const struct nft_pipapo_field *f = &m->f[i];
+
+		if (memcmp((const u8 *)e->key.data + f->offset,
+			   (const u8 *)e->key_end.data + f->offset,
+			   f->len) > 0) {
+			mutex_unlock(&priv->lock);
+			kfree(e);
+			return -EINVAL;
+		}
+	}
+
+	pipapo_count_rules(m, e, nrules);
+	for (i = 0; i < m->field_count; i++) {
+		if (m->f[i].rules + nrules[i] > m->f[i].bsize * BITS_PER_LONG)
+			room = false;
+	}
+
+	if (room) {
+		pipapo_write_elem(m, e);
+	} else {
+		new = pipapo_rebuild(set, priv, nrules);
+		if (new == NULL) {
+			mutex_unlock(&priv->lock);
+			kfree(e);
+			return -ENOMEM;
+		}
+		pipapo_write_elem(new, e);
+		pipapo_replace(priv, m, new);
+	}
+
+	list_add_tail(&e->list, &priv->elems);
+	mutex_unlock(&priv->lock);
+	return 0;
+}
+
+static void nft_pipapo_remove(const struct nft_set *set,
+			      const struct nft_set_elem *elem)
+{
+	static const unsigned int none[NFT_SET_MAXFIELDS];
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e = elem->cookie;
+	struct nft_pipapo_match *m, *new;
+	unsigned int i, used = 0;
+
+	mutex_lock(&priv->lock);
+	m = rcu_dereference_protected(priv->match,
+				      lockdep_is_held(&priv->lock));
+
+	pipapo_clear_elem(m, e);
+	list_del(&e->list);
+
+	/* compact once dead rules outnumber live ones, if memory allows */
+	for (i = 0; i < m->field_count; i++)
+		used += m->f[i].rules;
+	if (m->dead > used - m->dead) {
+		new = pipapo_rebuild(set, priv, none);
+		if (new != NULL)
+			pipapo_replace(priv, m, new);
+	}
+	mutex_unlock(&priv->lock);
+
+	kfree_rcu(e, rcu);
+}
+
+static int nft_pipapo_get(const struct nft_set *set, struct nft_set_elem *elem)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e;
+	int err = -ENOENT;
+
+	mutex_lock(&priv->lock);
+	list_for_each_entry(e, &priv->elems, list) {
+		if (!pipapo_elem_cmp(set, e, elem))
+			continue;
+
+		elem->cookie = e;
+		if (set->flags & NFT_SET_MAP)
+			nft_data_copy(&elem->data, e->data);
+		elem->flags = e->flags;
+		err = 0;
+		break;
+	}
+	mutex_unlock(&priv->lock);
+	return err;
+}
+
+static void nft_pipapo_walk(const struct nft_ctx *ctx,
+			    const struct nft_set *set,
+			    struct nft_set_iter *iter)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	const struct nft_pipapo_elem *e;
+	struct nft_set_elem elem;
+
+	mutex_lock(&priv->lock);
+	list_for_each_entry(e, &priv->elems, list) {
+		if (iter->count < iter->skip)
+			goto cont;
+
+		nft_data_copy(&elem.key, &e->key);
+		nft_data_copy(&elem.key_end, &e->key_end);
+		if (set->flags & NFT_SET_MAP)
+			nft_data_copy(&elem.data, e->data);
+		elem.flags = e->flags;
+
+		iter->err = iter->fn(ctx, set, iter, &elem);
+		if (iter->err < 0)
+			break;
+cont:
+		iter->count++;
+	}
+	mutex_unlock(&priv->lock);
+}
+
+static unsigned int nft_pipapo_privsize(const struct nlattr * const nla[])
+{
+	return sizeof(struct nft_pipapo);
+}
+
+static int nft_pipapo_init(const struct nft_set *set,
+			   const struct nft_set_desc *desc,
+			   const struct nlattr * const nla[])
+{
+	static const unsigned int none[NFT_SET_MAXFIELDS];
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_match *m;
+
+	if (set->field_count < 2)
+		return -EINVAL;
+
+	m = pipapo_match_alloc(set, none);
+	if (m == NULL)
+		return -ENOMEM;
+
+	mutex_init(&priv->lock);
+	INIT_LIST_HEAD(&priv->elems);
+	RCU_INIT_POINTER(priv->match, m);
+	return 0;
+}
+
+static void nft_pipapo_destroy(const struct nft_set *set)
+{
+	struct nft_pipapo *priv = nft_set_priv(set);
+	struct nft_pipapo_elem *e, *next;
+
+	list_for_each_entry_safe(e, next, &priv->elems, list) {
+		list_del(&e->list);
+		nft_data_uninit(&e->key, NFT_DATA_VALUE);
+		nft_data_uninit(&e->key_end, NFT_DATA_VALUE);
+		if (set->flags & NFT_SET_MAP)
+			nft_data_uninit(e->data, set->dtype);
+		kfree(e);
+	}
+
+	pipapo_match_free(rcu_dereference_protected(priv->match, 1));
+}
+
+static bool nft_pipapo_estimate(const struct nft_set_desc *desc, u32 features,
+				struct nft_set_estimate *est)
+{
+	unsigned int nsize;
+
+	/* only concatenations of ranges, the other backends do the rest */
+	if (desc->field_count < 2 || !(features & NFT_SET_INTERVAL))
+		return false;
+
+	nsize = sizeof(struct nft_pipapo_elem);
+	if (features & NFT_SET_MAP)
+		nsize += FIELD_SIZEOF(struct nft_pipapo_elem, data[0]);
+
+	if (desc->size)
+		est->size = sizeof(struct nft_pipapo) + desc->size * nsize;
+	else
+		est->size = nsize;
+
+	est->class = NFT_SET_CLASS_O_LOG_N;
+
+	return true;
+}
+
+static struct nft_set_ops nft_pipapo_ops __read_mostly = {
+	.privsize	= nft_pipapo_privsize,
+	.estimate	= nft_pipapo_estimate,
+	.init		= nft_pipapo_init,
+	.destroy	= nft_pipapo_destroy,
+	.insert		= nft_pipapo_insert,
+	.remove		= nft_pipapo_remove,
+	.get		= nft_pipapo_get,
+	.lookup		= nft_pipapo_lookup,
+	.walk		= nft_pipapo_walk,
+	.features	= NFT_SET_INTERVAL | NFT_SET_MAP,
+	.owner		= THIS_MODULE,
+};
+
+static int __init nft_pipapo_module_init(void)
+{
+#if defined(CONFIG_X86_64) && defined(CONFIG_AS_AVX2)
+	nft_pipapo_avx2 = cpu_has_avx && cpu_has_avx2;
+#endif
+	return nft_register_set(&nft_pipapo_ops);
+}
+
+static void __exit nft_pipapo_module_exit(void)
+{
+	nft_unregister_set(&nft_pipapo_ops);
+	rcu_barrier();
+}
+
+module_init(nft_pipapo_module_init);
+module_exit(nft_pipapo_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_ALIAS_NFT_SET();
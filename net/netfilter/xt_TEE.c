@@ -150,6 +150,7 @@ tee_tg_route6(struct sk_buff *skb, const struct xt_tee_tginfo *info)
 		fl6.flowi6_oif = info->priv->oif;
 	}
 	fl6.daddr = info->gw.in6;
+	fl6.flowi6_flags = FLOWI_FLAG_KNOWN_NH;
 	fl6.flowlabel = ((iph->flow_lbl[0] & 0xF) << 16) |
 			   (iph->flow_lbl[1] << 8) | iph->flow_lbl[2];
 	dst = ip6_route_output(net, NULL, &fl6);
@@ -91,6 +91,9 @@
 #include <linux/percpu.h>
 #ifdef CONFIG_INET
 #include <net/inet_common.h>
+#include <net/busy_poll.h>
+#include <net/packet_zc.h>
+#include <linux/rtnetlink.h>
 #endif
 
 #include "internal.h"
@@ -1837,6 +1840,8 @@ static int packet_rcv(struct sk_buff *skb, struct net_device *dev,
 	/* drop conntrack reference */
 	nf_reset(skb);
 
+	sk_mark_napi_id(sk, skb);
+
 	spin_lock(&sk->sk_receive_queue.lock);
 	po->stats.stats1.tp_packets++;
 	skb->dropcount = atomic_read(&sk->sk_drops);
@@ -1953,6 +1958,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 			macoff = GET_PBDQC_FROM_RB(&po->rx_ring)->max_frame_len;
 		}
 	}
+	/* lets poll() on the ring busy poll the right queue */
+	sk_mark_napi_id(sk, skb);
 	spin_lock(&sk->sk_receive_queue.lock);
 	h.raw = packet_current_rx_frame(po, skb,
 					TP_STATUS_KERNEL, (macoff+snaplen));
@@ -2595,12 +2602,288 @@ out:
 	return err;
 }
 
+/*
+ *	PACKET_ZC: one rx queue of the bound device receives straight into
+ *	user memory, see include/net/packet_zc.h for the driver side.
+ *
+ *	po->zc is set and cleared, and zc->dev is dropped, under rtnl_lock.
+ */
+
+static void packet_zc_offsets(u32 entries, struct tpacket_zc_offsets *off)
+{
+	size_t hdr = sizeof(struct tpacket_zc_ring);
+
+	off->fill = 0;
+	off->rx = PAGE_ALIGN(off->fill + hdr + entries * sizeof(__u64));
+	off->tx = PAGE_ALIGN(off->rx + hdr +
+			     entries * sizeof(struct tpacket_zc_desc));
+	off->completion = PAGE_ALIGN(off->tx + hdr +
+				     entries * sizeof(struct tpacket_zc_desc));
+	off->mmap_len = PAGE_ALIGN(off->completion + hdr +
+				   entries * sizeof(__u64));
+}
+
+static void packet_zc_free(struct packet_zc *zc)
+{
+	unsigned int i;
+
+	for (i = 0; i < zc->npages; i++) {
+		set_page_dirty_lock(zc->pages[i]);
+		put_page(zc->pages[i]);
+	}
+	vfree(zc->pages);
+	vfree(zc->ring_mem);
+	kfree(zc);
+}
+
+static int packet_zc_setup(struct sock *sk, const struct tpacket_zc_req *req)
+{
+	struct packet_sock *po = pkt_sk(sk);
+	struct tpacket_zc_offsets off;
+	struct net_device *dev;
+	struct packet_zc *zc;
+	unsigned long npages;
+	int pinned, err;
+
+	if (req->frame_size < 2048 || req->frame_size > PAGE_SIZE ||
+	    !is_power_of_2(req->frame_size))
+		return -EINVAL;
+	if (!req->ring_entries || req->ring_entries > (1 << 20) ||
+	    !is_power_of_2(req->ring_entries))
+		return -EINVAL;
+	if (!req->umem_len || !PAGE_ALIGNED(req->umem_addr) ||
+	    !PAGE_ALIGNED(req->umem_len))
+		return -EINVAL;
+
+	npages = req->umem_len >> PAGE_SHIFT;
+	if (npages > INT_MAX / sizeof(struct page *))
+		return -EINVAL;
+	if (npages > rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT &&
+	    !capable(CAP_IPC_LOCK))
+		return -ENOMEM;
+
+	mutex_lock(&po->pg_vec_lock);
+
+	err = -EBUSY;
+	if (po->zc || po->rx_ring.pg_vec || po->tx_ring.pg_vec ||
+	    atomic_read(&po->mapped))
+		goto out_unlock;
+
+	err = -ENXIO;
+	dev = packet_cached_dev_get(po);
+	if (!dev)
+		goto out_unlock;
+
+	err = -EOPNOTSUPP;
+	if (!dev->netdev_ops->ndo_packet_zc)
+		goto out_put;
+	err = -EINVAL;
+	if (req->queue_id >= dev->real_num_rx_queues)
+		goto out_put;
+
+	err = -ENOMEM;
+	zc = kzalloc(sizeof(*zc), GFP_KERNEL);
+	if (!zc)
+		goto out_put;
+	zc->frame_size = req->frame_size;
+	zc->umem_len = req->umem_len;
+	zc->ring_mask = req->ring_entries - 1;
+	zc->sk = sk;
+	zc->queue_id = req->queue_id;
+
+	zc->pages = vzalloc(npages * sizeof(struct page *));
+	if (!zc->pages)
+		goto out_free;
+	pinned = get_user_pages_fast(req->umem_addr, npages, 1, zc->pages);
+	if (pinned < 0) {
+		err = pinned;
+		goto out_free;
+	}
+	zc->npages = pinned;
+	err = -EFAULT;
+	if (pinned != npages)
+		goto out_free;
+
+	packet_zc_offsets(req->ring_entries, &off);
+	err = -ENOMEM;
+	zc->ring_len = off.mmap_len;
+	zc->ring_mem = vmalloc_user(zc->ring_len);
+	if (!zc->ring_mem)
+		goto out_free;
+	zc->fill = zc->ring_mem + off.fill;
+	zc->rx = zc->ring_mem + off.rx;
+	zc->tx = zc->ring_mem + off.tx;
+	zc->comp = zc->ring_mem + off.completion;
+
+	rtnl_lock();
+	err = -ENXIO;
+	if (dev->reg_state == NETREG_REGISTERED)
+		err = dev->netdev_ops->ndo_packet_zc(dev, zc->queue_id, zc);
+	if (!err) {
+		zc->dev = dev;
+		po->zc = zc;
+	}
+	rtnl_unlock();
+	if (err)
+		goto out_free;
+
+	mutex_unlock(&po->pg_vec_lock);
+	return 0;
+
+out_free:
+	packet_zc_free(zc);
+out_put:
+	dev_put(dev);
+out_unlock:
+	mutex_unlock(&po->pg_vec_lock);
+	return err;
+}
+
+/* give the queue back to the driver, called under rtnl_lock */
+static void __packet_zc_detach(struct packet_zc *zc)
+{
+	ASSERT_RTNL();
+
+	if (!zc->dev)
+		return;
+	zc->dev->netdev_ops->ndo_packet_zc(zc->dev, zc->queue_id, NULL);
+	dev_put(zc->dev);
+	zc->dev = NULL;
+}
+
+static void packet_zc_release(struct packet_sock *po)
+{
+	struct packet_zc *zc = po->zc;
+
+	if (!zc)
+		return;
+
+	rtnl_lock();
+	__packet_zc_detach(zc);
+	po->zc = NULL;
+	rtnl_unlock();
+
+	packet_zc_free(zc);
+}
+
+/* the device is going away, let go of it but keep the umem until close */
+static void packet_zc_dev_unregister(struct net *net, struct net_device *dev)
+{
+	struct sock *sk;
+
+	mutex_lock(&net->packet.sklist_lock);
+	sk_for_each(sk, &net->packet.sklist) {
+		struct packet_zc *zc = pkt_sk(sk)->zc;
+
+		if (zc && zc->dev == dev)
+			__packet_zc_detach(zc);
+	}
+	mutex_unlock(&net->packet.sklist_lock);
+}
+
+/*
+ * Send the frames queued in the tx ring.  They are copied into skbs, so
+ * each frame is completed as soon as it has been handed to the device.
+ */
+static int packet_zc_snd(struct packet_sock *po)
+{
+	struct packet_zc *zc = po->zc;
+	struct tpacket_zc_desc *descs = packet_zc_entries(zc->tx);
+	u64 *comp = packet_zc_entries(zc->comp);
+	struct sock *sk = &po->sk;
+	struct net_device *dev;
+	u32 cons, prod, comp_prod;
+	int err = 0, len_sum = 0;
+
+	mutex_lock(&po->pg_vec_lock);
+
+	dev = packet_cached_dev_get(po);
+	if (unlikely(!dev)) {
+		err = -ENXIO;
+		goto out_unlock;
+	}
+	if (unlikely(!(dev->flags & IFF_UP))) {
+		err = -ENETDOWN;
+		goto out_put;
+	}
+
+	cons = zc->tx->consumer;
+	prod = ACCESS_ONCE(zc->tx->producer);
+	comp_prod = zc->comp->producer;
+	smp_rmb();
+
+	while (cons != prod) {
+		struct tpacket_zc_desc desc = descs[cons & zc->ring_mask];
+		int hlen = LL_RESERVED_SPACE(dev);
+		int tlen = dev->needed_tailroom;
+		struct sk_buff *skb;
+		struct page *page;
+		void *kaddr;
+
+		if (comp_prod - ACCESS_ONCE(zc->comp->consumer) > zc->ring_mask) {
+			err = -ENOBUFS;
+			break;
+		}
+		if (desc.addr >= zc->umem_len ||
+		    (desc.addr & (zc->frame_size - 1)) + desc.len >
+		    zc->frame_size ||
+		    desc.len < dev->hard_header_len ||
+		    desc.len > dev->mtu + dev->hard_header_len) {
+			err = -EINVAL;
+			break;
+		}
+
+		skb = sock_wmalloc(sk, hlen + desc.len + tlen, 0, GFP_KERNEL);
+		if (!skb) {
+			err = -EAGAIN;
+			break;
+		}
+		skb_reserve(skb, hlen);
+		skb_reset_network_header(skb);
+
+		page = packet_zc_page(zc, desc.addr);
+		kaddr = kmap(page);
+		memcpy(skb_put(skb, desc.len),
+		       kaddr + packet_zc_offset(zc, desc.addr), desc.len);
+		kunmap(page);
+
+		skb->protocol = po->num;
+		skb->dev = dev;
+		skb->priority = sk->sk_priority;
+		skb->mark = sk->sk_mark;
+		skb_set_queue_mapping(skb, zc->queue_id % dev->real_num_tx_queues);
+
+		/* the data is in the skb, the frame can be reused */
+		comp[comp_prod & zc->ring_mask] = desc.addr;
+		comp_prod++;
+		cons++;
+
+		err = po->xmit(skb);
+		if (unlikely(err > 0)) {
+			err = net_xmit_errno(err);
+			if (err)
+				break;
+		}
+		len_sum += desc.len;
+	}
+
+	smp_store_release(&zc->tx->consumer, cons);
+	smp_store_release(&zc->comp->producer, comp_prod);
+out_put:
+	dev_put(dev);
+out_unlock:
+	mutex_unlock(&po->pg_vec_lock);
+	return len_sum ? len_sum : err;
+}
+
 static int packet_sendmsg(struct kiocb *iocb, struct socket *sock,
 		struct msghdr *msg, size_t len)
 {
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 
+	if (po->zc)
+		return packet_zc_snd(po);
 	if (po->tx_ring.pg_vec)
 		return tpacket_snd(po, msg);
 	else
@@ -2645,6 +2928,8 @@ static int packet_release(struct socket *sock)
 
 	packet_flush_mclist(sk);
 
+	packet_zc_release(po);
+
 	if (po->rx_ring.pg_vec) {
 		memset(&req_u, 0, sizeof(req_u));
 		packet_set_ring(sk, &req_u, 1, 0);
@@ -3277,6 +3562,8 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 			return -EINVAL;
 		if (pkt_sk(sk)->has_vnet_hdr)
 			return -EINVAL;
+		if (po->zc)
+			return -EBUSY;
 		if (copy_from_user(&req_u.req, optval, len))
 			return -EFAULT;
 		return packet_set_ring(sk, &req_u, 0,
@@ -3428,6 +3715,16 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 		po->xmit = val ? packet_direct_xmit : dev_queue_xmit;
 		return 0;
 	}
+	case PACKET_ZC:
+	{
+		struct tpacket_zc_req req;
+
+		if (optlen < sizeof(req))
+			return -EINVAL;
+		if (copy_from_user(&req, optval, sizeof(req)))
+			return -EFAULT;
+		return packet_zc_setup(sk, &req);
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3442,6 +3739,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	struct packet_sock *po = pkt_sk(sk);
 	void *data = &val;
 	union tpacket_stats_u st;
+	struct tpacket_zc_offsets zc_off;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -3523,6 +3821,13 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	case PACKET_QDISC_BYPASS:
 		val = packet_use_direct_xmit(po);
 		break;
+	case PACKET_ZC:
+		if (!po->zc)
+			return -ENOENT;
+		packet_zc_offsets(po->zc->ring_mask + 1, &zc_off);
+		lv = sizeof(zc_off);
+		data = &zc_off;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3544,6 +3849,9 @@ static int packet_notifier(struct notifier_block *this,
 	struct net_device *dev = netdev_notifier_info_to_dev(ptr);
 	struct net *net = dev_net(dev);
 
+	if (msg == NETDEV_UNREGISTER)
+		packet_zc_dev_unregister(net, dev);
+
 	rcu_read_lock();
 	sk_for_each_rcu(sk, &net->packet.sklist) {
 		struct packet_sock *po = pkt_sk(sk);
@@ -3647,6 +3955,16 @@ static unsigned int packet_poll(struct file *file, struct socket *sock,
 	struct sock *sk = sock->sk;
 	struct packet_sock *po = pkt_sk(sk);
 	unsigned int mask = datagram_poll(file, sock, wait);
+	struct packet_zc *zc = ACCESS_ONCE(po->zc);
+
+	if (zc) {
+		if (ACCESS_ONCE(zc->rx->producer) !=
+		    ACCESS_ONCE(zc->rx->consumer))
+			mask |= POLLIN | POLLRDNORM;
+		if (zc->comp->producer - ACCESS_ONCE(zc->comp->consumer) <=
+		    zc->ring_mask)
+			mask |= POLLOUT | POLLWRNORM;
+	}
 
 	spin_lock_bh(&sk->sk_receive_queue.lock);
 	if (po->rx_ring.pg_vec) {
@@ -3929,6 +4247,15 @@ static int packet_mmap(struct file *file, struct socket *sock,
 
 	mutex_lock(&po->pg_vec_lock);
 
+	if (po->zc) {
+		if (vma->vm_end - vma->vm_start != po->zc->ring_len)
+			goto out;
+		err = remap_vmalloc_range(vma, po->zc->ring_mem, 0);
+		if (err)
+			goto out;
+		goto mapped;
+	}
+
 	expected_size = 0;
 	for (rb = &po->rx_ring; rb <= &po->tx_ring; rb++) {
 		if (rb->pg_vec) {
@@ -3966,6 +4293,7 @@ static int packet_mmap(struct file *file, struct socket *sock,
 		}
 	}
 
+mapped:
 	atomic_inc(&po->mapped);
 	vma->vm_ops = &packet_mmap_ops;
 	err = 0;
@@ -848,6 +848,10 @@ static int qdisc_graft(struct net_device *dev, struct Qdisc *parent,
 		const struct Qdisc_class_ops *cops = parent->ops->cl_ops;
 
 		err = -EOPNOTSUPP;
+		/* see qdisc_create() */
+		if (new && (new->flags & TCQ_F_NOLOCK) &&
+		    !(parent->flags & TCQ_F_MQROOT))
+			return err;
 		if (cops && cops->graft) {
 			unsigned long cl = cops->get(parent, classid);
 			if (cl) {
@@ -866,6 +870,20 @@ static int qdisc_graft(struct net_device *dev, struct Qdisc *parent,
 static struct lock_class_key qdisc_tx_lock;
 static struct lock_class_key qdisc_rx_lock;
 
+/* Turn a TCQ_F_NOLOCK qdisc into a regular one, before it is in use */
+static void qdisc_clear_nolock(struct Qdisc *sch)
+{
+	sch->flags &= ~TCQ_F_NOLOCK;
+	if (!(sch->flags & TCQ_F_CPUSTATS))
+		return;
+
+	free_percpu(sch->cpu_bstats);
+	free_percpu(sch->cpu_qstats);
+	sch->cpu_bstats = NULL;
+	sch->cpu_qstats = NULL;
+	sch->flags &= ~TCQ_F_CPUSTATS;
+}
+
 /*
    Allocate and initialize new qdisc.
 
@@ -924,6 +942,14 @@ qdisc_create(struct net_device *dev, struct netdev_queue *dev_queue,
 
 	sch->parent = parent;
 
+	/* Only the root of a transmit queue runs without its lock.  Below
+	 * a classful qdisc the parent's lock serializes us anyway, and the
+	 * parent expects q.qlen and the plain counters to be maintained.
+	 */
+	if ((sch->flags & TCQ_F_NOLOCK) &&
+	    (handle == TC_H_INGRESS || (p && !(p->flags & TCQ_F_MQROOT))))
+		qdisc_clear_nolock(sch);
+
 	if (handle == TC_H_INGRESS) {
 		sch->flags |= TCQ_F_INGRESS;
 		handle = TC_H_MAKE(TC_H_INGRESS, 0);
@@ -943,17 +969,6 @@ qdisc_create(struct net_device *dev, struct netdev_queue *dev_queue,
 	sch->handle = handle;
 
 	if (!ops->init || (err = ops->init(sch, tca[TCA_OPTIONS])) == 0) {
-		if (qdisc_is_percpu_stats(sch)) {
-			sch->cpu_bstats =
-				netdev_alloc_pcpu_stats(struct gnet_stats_basic_cpu);
-			if (!sch->cpu_bstats)
-				goto err_out4;
-
-			sch->cpu_qstats = alloc_percpu(struct gnet_stats_queue);
-			if (!sch->cpu_qstats)
-				goto err_out4;
-		}
-
 		if (tca[TCA_STAB]) {
 			stab = qdisc_get_stab(tca[TCA_STAB]);
 			if (IS_ERR(stab)) {
@@ -990,6 +1005,8 @@ qdisc_create(struct net_device *dev, struct netdev_queue *dev_queue,
 		return sch;
 	}
 err_out3:
+	free_percpu(sch->cpu_bstats);
+	free_percpu(sch->cpu_qstats);
 	dev_put(dev);
 	kfree((char *) sch - sch->padded);
 err_out2:
@@ -999,8 +1016,6 @@ err_out:
 	return NULL;
 
 err_out4:
-	free_percpu(sch->cpu_bstats);
-	free_percpu(sch->cpu_qstats);
 	/*
 	 * Any broken qdiscs that would require a ops->reset() here?
 	 * The qdisc was never in action so it shouldn't be necessary.
@@ -1343,7 +1358,7 @@ static int tc_fill_qdisc(struct sk_buff *skb, struct Qdisc *q, u32 clid,
 		goto nla_put_failure;
 	if (q->ops->dump && q->ops->dump(q, skb) < 0)
 		goto nla_put_failure;
-	qlen = q->q.qlen;
+	qlen = qdisc_qlen_sum(q);
 
 	stab = rtnl_dereference(q->stab);
 	if (stab && qdisc_dump_stab(skb, stab) < 0)
@@ -471,7 +471,7 @@ begin:
 		goto out;
 
 	rate = q->flow_max_rate;
-	if (skb->sk && skb->sk->sk_state != TCP_TIME_WAIT)
+	if (skb->sk && sk_fullsock(skb->sk))
 		rate = min(skb->sk->sk_pacing_rate, rate);
 
 	if (rate != ~0U) {
@@ -478,6 +478,53 @@ struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
 }
 EXPORT_SYMBOL_GPL(rpc_create_xprt);
 
+/*
+ * Open @nr more connections to the server behind clnt->cl_xprt.  They
+ * are created from the address the primary transport ended up with,
+ * so a port found by the initial rpcbind query is reused rather than
+ * looked up once per connection.  Failing to set up some of them is
+ * not fatal; the client simply has fewer connections.
+ */
+static void rpc_clnt_add_xprts(struct rpc_clnt *clnt,
+			       struct xprt_create *xprtargs, unsigned int nr)
+{
+	struct sockaddr_storage addr;
+	struct rpc_xprt_set *set;
+	struct rpc_xprt *xprt, *primary;
+	struct xprt_create args = *xprtargs;
+	int resvport;
+
+	set = xprt_set_alloc(nr);
+	if (set == NULL)
+		return;
+
+	rcu_read_lock();
+	primary = rcu_dereference(clnt->cl_xprt);
+	args.addrlen = primary->addrlen;
+	memcpy(&addr, &primary->addr, primary->addrlen);
+	resvport = primary->resvport;
+	rcu_read_unlock();
+	args.dstaddr = (struct sockaddr *)&addr;
+
+	while (set->nr < nr) {
+		xprt = xprt_create_transport(&args);
+		if (IS_ERR(xprt)) {
+			dprintk("RPC:       %s: failed to create connection "
+				"%u: %ld\n", __func__, set->nr + 1,
+				PTR_ERR(xprt));
+			break;
+		}
+		xprt->resvport = resvport;
+		set->xprt[set->nr++] = xprt;
+	}
+
+	if (set->nr == 0) {
+		xprt_set_put(set);
+		return;
+	}
+	rcu_assign_pointer(clnt->cl_xprt_set, set);
+}
+
 /**
  * rpc_create - create an RPC client and transport with one call
  * @args: rpc_clnt create argument structure
@@ -490,6 +537,7 @@ EXPORT_SYMBOL_GPL(rpc_create_xprt);
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
+	struct rpc_clnt *clnt;
 	struct rpc_xprt *xprt;
 	struct xprt_create xprtargs = {
 		.net = args->net,
@@ -554,7 +602,10 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (!IS_ERR(clnt) && args->nconnect > 1)
+		rpc_clnt_add_xprts(clnt, &xprtargs, args->nconnect - 1);
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -566,6 +617,7 @@ EXPORT_SYMBOL_GPL(rpc_create);
 static struct rpc_clnt *__rpc_clone_client(struct rpc_create_args *args,
 					   struct rpc_clnt *clnt)
 {
+	struct rpc_xprt_set *set;
 	struct rpc_xprt *xprt;
 	struct rpc_clnt *new;
 	int err;
@@ -585,6 +637,14 @@ static struct rpc_clnt *__rpc_clone_client(struct rpc_create_args *args,
 		goto out_err;
 	}
 
+	/* Clones spread their requests over the same connections */
+	rcu_read_lock();
+	set = rcu_dereference(clnt->cl_xprt_set);
+	if (set != NULL)
+		atomic_inc(&set->count);
+	rcu_read_unlock();
+	rcu_assign_pointer(new->cl_xprt_set, set);
+
 	/* Turn off autobind on clones */
 	new->cl_autobind = 0;
 	new->cl_softrtry = clnt->cl_softrtry;
@@ -659,6 +719,7 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 {
 	const struct rpc_timeout *old_timeo;
 	rpc_authflavor_t pseudoflavor;
+	struct rpc_xprt_set *old_set;
 	struct rpc_xprt *xprt, *old;
 	struct rpc_clnt *parent;
 	int err;
@@ -675,6 +736,13 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 	old_timeo = clnt->cl_timeout;
 	old = rpc_clnt_set_transport(clnt, xprt, timeout);
 
+	/* The extra connections go to the old server, stop using them */
+	spin_lock(&clnt->cl_lock);
+	old_set = rcu_dereference_protected(clnt->cl_xprt_set,
+			lockdep_is_held(&clnt->cl_lock));
+	RCU_INIT_POINTER(clnt->cl_xprt_set, NULL);
+	spin_unlock(&clnt->cl_lock);
+
 	rpc_unregister_client(clnt);
 	__rpc_clnt_remove_pipedir(clnt);
 	rpc_clnt_debugfs_unregister(clnt);
@@ -699,12 +767,14 @@ int rpc_switch_client_transport(struct rpc_clnt *clnt,
 	synchronize_rcu();
 	if (parent != clnt)
 		rpc_release_client(parent);
+	xprt_set_put(old_set);
 	xprt_put(old);
 	dprintk("RPC:       replaced xprt for clnt %p\n", clnt);
 	return 0;
 
 out_revert:
 	rpc_clnt_set_transport(clnt, old, old_timeo);
+	rcu_assign_pointer(clnt->cl_xprt_set, old_set);
 	clnt->cl_parent = parent;
 	rpc_client_register(clnt, pseudoflavor, NULL);
 	xprt_put(xprt);
@@ -784,6 +854,7 @@ rpc_free_client(struct rpc_clnt *clnt)
 	rpc_unregister_client(clnt);
 	rpc_free_iostats(clnt->cl_metrics);
 	clnt->cl_metrics = NULL;
+	xprt_set_put(rcu_dereference_raw(clnt->cl_xprt_set));
 	xprt_put(rcu_dereference_raw(clnt->cl_xprt));
 	rpciod_down();
 	rpc_free_clid(clnt);
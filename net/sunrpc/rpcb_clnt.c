@@ -689,6 +689,13 @@ void rpcb_getport_async(struct rpc_task *task)
 	} while (xprt == NULL);
 	rcu_read_unlock();
 
+	/* A request on one of the client's extra connections binds that one */
+	if (task->tk_rqstp != NULL && task->tk_rqstp->rq_xprt != xprt &&
+	    xprt_get(task->tk_rqstp->rq_xprt) != NULL) {
+		xprt_put(xprt);
+		xprt = task->tk_rqstp->rq_xprt;
+	}
+
 	dprintk("RPC: %5u %s(%s, %u, %u, %d)\n",
 		task->tk_pid, __func__,
 		xprt->servername, clnt->cl_prog, clnt->cl_vers, xprt->prot);
@@ -418,6 +418,21 @@ int svc_bind(struct svc_serv *serv, struct net *net)
 }
 EXPORT_SYMBOL_GPL(svc_bind);
 
+/*
+ * Transports wait for a thread in a pool that could grow.  Threads
+ * can only be started with the service's own lock held, so leave that
+ * to the service.
+ */
+static void
+svc_grow_work(struct work_struct *work)
+{
+	struct svc_serv *serv = container_of(work, struct svc_serv,
+					     sv_grow_work);
+
+	if (serv->sv_autoscale)
+		serv->sv_autoscale(serv);
+}
+
 /*
  * Create an RPC service
  */
@@ -459,6 +474,7 @@ __svc_create(struct svc_program *prog, unsigned int bufsize, int npools,
 	INIT_LIST_HEAD(&serv->sv_permsocks);
 	init_timer(&serv->sv_temptimer);
 	spin_lock_init(&serv->sv_lock);
+	INIT_WORK(&serv->sv_grow_work, svc_grow_work);
 
 	serv->sv_nrpools = npools;
 	serv->sv_pools =
@@ -542,6 +558,7 @@ svc_destroy(struct svc_serv *serv)
 		printk("svc_destroy: no threads for serv=%p!\n", serv);
 
 	del_timer_sync(&serv->sv_temptimer);
+	cancel_work_sync(&serv->sv_grow_work);
 
 	/*
 	 * The last user is gone and thus all sockets have to be destroyed to
@@ -694,6 +711,73 @@ found_pool:
 	return task;
 }
 
+/*
+ * Start one more thread in @pool.
+ */
+static int
+svc_start_kthread(struct svc_serv *serv, struct svc_pool *pool)
+{
+	struct svc_rqst	*rqstp;
+	struct task_struct *task;
+	int node;
+
+	node = svc_pool_map_get_node(pool->sp_id);
+	rqstp = svc_prepare_thread(serv, pool, node);
+	if (IS_ERR(rqstp))
+		return PTR_ERR(rqstp);
+
+	__module_get(serv->sv_module);
+	task = kthread_create_on_node(serv->sv_function, rqstp,
+				      node, "%s", serv->sv_name);
+	if (IS_ERR(task)) {
+		module_put(serv->sv_module);
+		svc_exit_thread(rqstp);
+		return PTR_ERR(task);
+	}
+
+	rqstp->rq_task = task;
+	if (serv->sv_nrpools > 1)
+		svc_pool_map_set_cpumask(task, pool->sp_id);
+
+	svc_sock_update_bufs(serv);
+	wake_up_process(task);
+	return 0;
+}
+
+/*
+ * Start a thread in each pool that asked for one because its
+ * transports had to wait, up to the pool's share of sv_maxthreads.
+ * Called from the service's sv_autoscale callback with the same
+ * mutual exclusion as svc_set_num_threads().
+ */
+void
+svc_pools_grow(struct svc_serv *serv)
+{
+	unsigned int i, nrthreads, max;
+
+	if (!serv->sv_maxthreads)
+		return;
+	max = DIV_ROUND_UP(serv->sv_maxthreads, serv->sv_nrpools);
+
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		if (!test_and_clear_bit(SP_NEED_THREAD, &pool->sp_flags))
+			continue;
+
+		spin_lock_bh(&pool->sp_lock);
+		nrthreads = pool->sp_nrthreads;
+		spin_unlock_bh(&pool->sp_lock);
+
+		/* A pool without threads is being shut down */
+		if (nrthreads == 0 || nrthreads >= max)
+			continue;
+		if (svc_start_kthread(serv, pool) == 0)
+			atomic_long_inc(&pool->sp_stats.threads_started);
+	}
+}
+EXPORT_SYMBOL_GPL(svc_pools_grow);
+
 /*
  * Create or destroy enough new threads to make the number
  * of threads the given number.  If `pool' is non-NULL, applies
@@ -711,17 +795,22 @@ found_pool:
 int
 svc_set_num_threads(struct svc_serv *serv, struct svc_pool *pool, int nrservs)
 {
-	struct svc_rqst	*rqstp;
 	struct task_struct *task;
 	struct svc_pool *chosen_pool;
 	int error = 0;
 	unsigned int state = serv->sv_nrthreads-1;
-	int node;
+	unsigned int i;
 
+	/* Autoscaling never shrinks a pool below what was asked for */
 	if (pool == NULL) {
+		for (i = 0; i < serv->sv_nrpools; i++)
+			serv->sv_pools[i].sp_nrthreads_min =
+				nrservs / serv->sv_nrpools +
+				(i < nrservs % serv->sv_nrpools);
 		/* The -1 assumes caller has done a svc_get() */
 		nrservs -= (serv->sv_nrthreads-1);
 	} else {
+		pool->sp_nrthreads_min = nrservs;
 		spin_lock_bh(&pool->sp_lock);
 		nrservs -= pool->sp_nrthreads;
 		spin_unlock_bh(&pool->sp_lock);
@@ -732,29 +821,9 @@ svc_set_num_threads(struct svc_serv *serv, struct svc_pool *pool, int nrservs)
 		nrservs--;
 		chosen_pool = choose_pool(serv, pool, &state);
 
-		node = svc_pool_map_get_node(chosen_pool->sp_id);
-		rqstp = svc_prepare_thread(serv, chosen_pool, node);
-		if (IS_ERR(rqstp)) {
-			error = PTR_ERR(rqstp);
+		error = svc_start_kthread(serv, chosen_pool);
+		if (error)
 			break;
-		}
-
-		__module_get(serv->sv_module);
-		task = kthread_create_on_node(serv->sv_function, rqstp,
-					      node, "%s", serv->sv_name);
-		if (IS_ERR(task)) {
-			error = PTR_ERR(task);
-			module_put(serv->sv_module);
-			svc_exit_thread(rqstp);
-			break;
-		}
-
-		rqstp->rq_task = task;
-		if (serv->sv_nrpools > 1)
-			svc_pool_map_set_cpumask(task, chosen_pool->sp_id);
-
-		svc_sock_update_bufs(serv);
-		wake_up_process(task);
 	}
 	/* destroy old threads */
 	while (nrservs < 0 &&
@@ -783,7 +852,9 @@ svc_exit_thread(struct svc_rqst *rqstp)
 	kfree(rqstp->rq_auth_data);
 
 	spin_lock_bh(&pool->sp_lock);
-	pool->sp_nrthreads--;
+	/* svc_pool_shrink() already took an idle thread off the pool */
+	if (!test_bit(RQ_IDLE_EXIT, &rqstp->rq_flags))
+		pool->sp_nrthreads--;
 	if (!test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags))
 		list_del_rcu(&rqstp->rq_all);
 	spin_unlock_bh(&pool->sp_lock);
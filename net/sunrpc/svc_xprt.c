@@ -321,6 +321,20 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 	return false;
 }
 
+/*
+ * A transport in @pool has been waiting @wait usecs for a thread.  If
+ * that is too long and the service scales its pools, ask for another
+ * thread.
+ */
+static void svc_pool_note_wait(struct svc_serv *serv, struct svc_pool *pool,
+			       s64 wait)
+{
+	if (!serv->sv_maxthreads || wait < SVC_POOL_GROW_WAIT)
+		return;
+	set_bit(SP_NEED_THREAD, &pool->sp_flags);
+	schedule_work(&serv->sv_grow_work);
+}
+
 static void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 {
 	struct svc_pool *pool;
@@ -390,11 +404,19 @@ redo_search:
 	 * will pick it up once it searches for a xprt to service.
 	 */
 	if (!queued) {
+		struct svc_xprt *oldest;
+		ktime_t now = ktime_get();
+
 		queued = true;
 		dprintk("svc: transport %p put into queue\n", xprt);
 		spin_lock_bh(&pool->sp_lock);
+		xprt->xpt_qtime = now;
 		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
 		pool->sp_stats.sockets_queued++;
+		oldest = list_first_entry(&pool->sp_sockets,
+					  struct svc_xprt, xpt_ready);
+		svc_pool_note_wait(xprt->xpt_server, pool,
+				   ktime_us_delta(now, oldest->xpt_qtime));
 		spin_unlock_bh(&pool->sp_lock);
 		goto redo_search;
 	}
@@ -429,11 +451,17 @@ static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 
 	spin_lock_bh(&pool->sp_lock);
 	if (likely(!list_empty(&pool->sp_sockets))) {
+		s64 wait;
+
 		xprt = list_first_entry(&pool->sp_sockets,
 					struct svc_xprt, xpt_ready);
 		list_del_init(&xprt->xpt_ready);
 		svc_xprt_get(xprt);
 
+		wait = ktime_us_delta(ktime_get(), xprt->xpt_qtime);
+		pool->sp_stats.queue_wait += wait;
+		svc_pool_note_wait(xprt->xpt_server, pool, wait);
+
 		dprintk("svc: transport %p dequeued, inuse=%d\n",
 			xprt, atomic_read(&xprt->xpt_ref.refcount));
 	}
@@ -664,6 +692,34 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 	return true;
 }
 
+/*
+ * An autoscaled pool has more threads than it was configured with and
+ * this one timed out waiting for work.  Take it off the pool so it can
+ * exit; svc_exit_thread() knows it has already been accounted for.
+ */
+static bool svc_pool_shrink(struct svc_rqst *rqstp)
+{
+	struct svc_pool		*pool = rqstp->rq_pool;
+	bool			ret = false;
+
+	if (!rqstp->rq_server->sv_maxthreads)
+		return false;
+
+	spin_lock_bh(&pool->sp_lock);
+	if (pool->sp_nrthreads > pool->sp_nrthreads_min &&
+	    !test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags)) {
+		list_del_rcu(&rqstp->rq_all);
+		pool->sp_nrthreads--;
+		set_bit(RQ_IDLE_EXIT, &rqstp->rq_flags);
+		ret = true;
+	}
+	spin_unlock_bh(&pool->sp_lock);
+
+	if (ret)
+		atomic_long_inc(&pool->sp_stats.threads_stopped);
+	return ret;
+}
+
 static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 {
 	struct svc_xprt *xprt;
@@ -678,6 +734,10 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	 */
 	rqstp->rq_chandle.thread_wait = 5*HZ;
 
+	/* Threads of an autoscaled pool don't sleep for long */
+	if (rqstp->rq_server->sv_maxthreads)
+		timeout = min_t(long, timeout, SVC_POOL_IDLE_TIMEOUT);
+
 	xprt = svc_xprt_dequeue(pool);
 	if (xprt) {
 		rqstp->rq_xprt = xprt;
@@ -714,8 +774,11 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	if (xprt != NULL)
 		return xprt;
 
-	if (!time_left)
+	if (!time_left) {
 		atomic_long_inc(&pool->sp_stats.threads_timedout);
+		if (svc_pool_shrink(rqstp))
+			return ERR_PTR(-ETIMEDOUT);
+	}
 
 	if (signalled() || kthread_should_stop())
 		return ERR_PTR(-EINTR);
@@ -1337,16 +1400,20 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 	struct svc_pool *pool = p;
 
 	if (p == SEQ_START_TOKEN) {
-		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout\n");
+		seq_puts(m, "# pool packets-arrived sockets-enqueued threads-woken threads-timedout queue-wait-usecs threads threads-started threads-stopped\n");
 		return 0;
 	}
 
-	seq_printf(m, "%u %lu %lu %lu %lu\n",
+	seq_printf(m, "%u %lu %lu %lu %lu %lu %u %lu %lu\n",
 		pool->sp_id,
 		(unsigned long)atomic_long_read(&pool->sp_stats.packets),
 		pool->sp_stats.sockets_queued,
 		(unsigned long)atomic_long_read(&pool->sp_stats.threads_woken),
-		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout));
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_timedout),
+		pool->sp_stats.queue_wait,
+		pool->sp_nrthreads,
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_started),
+		(unsigned long)atomic_long_read(&pool->sp_stats.threads_stopped));
 
 	return 0;
 }
@@ -1134,6 +1134,59 @@ void xprt_free(struct rpc_xprt *xprt)
 }
 EXPORT_SYMBOL_GPL(xprt_free);
 
+/**
+ * xprt_set_alloc - allocate a set of additional transports
+ * @nr: number of transports the set will hold
+ *
+ * The caller fills in and owns the references in set->xprt[].
+ */
+struct rpc_xprt_set *xprt_set_alloc(unsigned int nr)
+{
+	struct rpc_xprt_set *set;
+
+	set = kzalloc(sizeof(*set) + nr * sizeof(set->xprt[0]), GFP_KERNEL);
+	if (set == NULL)
+		return NULL;
+	atomic_set(&set->count, 1);
+	return set;
+}
+EXPORT_SYMBOL_GPL(xprt_set_alloc);
+
+/**
+ * xprt_set_put - release a reference to a set of transports
+ * @set: pointer to the set, may be NULL
+ *
+ */
+void xprt_set_put(struct rpc_xprt_set *set)
+{
+	unsigned int i;
+
+	if (set == NULL || !atomic_dec_and_test(&set->count))
+		return;
+	for (i = 0; i < set->nr; i++)
+		xprt_put(set->xprt[i]);
+	kfree(set);
+}
+EXPORT_SYMBOL_GPL(xprt_set_put);
+
+/*
+ * Choose the transport a new request goes out on.  Clients with
+ * several connections to the server rotate through all of them;
+ * everybody else just uses cl_xprt.  Called under rcu_read_lock().
+ */
+static struct rpc_xprt *xprt_pick(struct rpc_clnt *clnt)
+{
+	struct rpc_xprt_set *set = rcu_dereference(clnt->cl_xprt_set);
+	unsigned int i;
+
+	if (set == NULL)
+		return rcu_dereference(clnt->cl_xprt);
+	i = (unsigned int)atomic_inc_return(&set->next) % (set->nr + 1);
+	if (i == set->nr)
+		return rcu_dereference(clnt->cl_xprt);
+	return set->xprt[i];
+}
+
 /**
  * xprt_reserve - allocate an RPC request slot
  * @task: RPC task requesting a slot allocation
@@ -1153,7 +1206,7 @@ void xprt_reserve(struct rpc_task *task)
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
 	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	xprt = xprt_pick(task->tk_client);
 	if (!xprt_throttle_congested(xprt, task))
 		xprt->ops->alloc_slot(xprt, task);
 	rcu_read_unlock();
@@ -1179,7 +1232,7 @@ void xprt_retry_reserve(struct rpc_task *task)
 	task->tk_timeout = 0;
 	task->tk_status = -EAGAIN;
 	rcu_read_lock();
-	xprt = rcu_dereference(task->tk_client->cl_xprt);
+	xprt = xprt_pick(task->tk_client);
 	xprt->ops->alloc_slot(xprt, task);
 	rcu_read_unlock();
 }
@@ -1228,10 +1281,17 @@ void xprt_release(struct rpc_task *task)
 
 	if (req == NULL) {
 		if (task->tk_client) {
+			struct rpc_xprt_set *set;
+			unsigned int i;
+
 			rcu_read_lock();
 			xprt = rcu_dereference(task->tk_client->cl_xprt);
 			if (xprt->snd_task == task)
 				xprt_release_write(xprt, task);
+			set = rcu_dereference(task->tk_client->cl_xprt_set);
+			for (i = 0; set != NULL && i < set->nr; i++)
+				if (set->xprt[i]->snd_task == task)
+					xprt_release_write(set->xprt[i], task);
 			rcu_read_unlock();
 		}
 		return;
@@ -372,21 +372,164 @@ static void __get_hash_thresh(struct net *net,
 	}
 }
 
+/*
+ * Policies whose selector is too wide for policy_bydst are grouped into
+ * bins by family and selector prefix lengths.  All policies of a bin can
+ * be hashed on their addresses masked to those prefix lengths, so a flow
+ * lookup probes one bucket per bin instead of walking every inexact
+ * policy.  policy_inexact only keeps the policies no bin could be
+ * allocated for; a policy is never on it while its bin exists.
+ */
+struct xfrm_pol_inexact_bin {
+	struct list_head	list;
+	struct hlist_head	*table;
+	unsigned int		hmask;
+	unsigned int		count;
+	u16			family;
+	u8			prefixlen_d;
+	u8			prefixlen_s;
+};
+
+#define XFRM_POL_BIN_HMASK_INIT	(8 - 1)
+
+static struct hlist_head *xfrm_pol_bin_chain(const struct xfrm_pol_inexact_bin *bin,
+					     const xfrm_address_t *daddr,
+					     const xfrm_address_t *saddr)
+{
+	return bin->table + __addr_hash(daddr, saddr, bin->family, bin->hmask,
+					bin->prefixlen_d, bin->prefixlen_s);
+}
+
+static bool xfrm_pol_bin_match(const struct xfrm_pol_inexact_bin *bin,
+			       const struct xfrm_selector *sel,
+			       unsigned short family)
+{
+	return bin->family == family &&
+	       bin->prefixlen_d == sel->prefixlen_d &&
+	       bin->prefixlen_s == sel->prefixlen_s;
+}
+
+static struct xfrm_pol_inexact_bin *xfrm_pol_bin_find(struct net *net,
+						      const struct xfrm_selector *sel,
+						      unsigned short family,
+						      int dir)
+{
+	struct xfrm_pol_inexact_bin *bin;
+
+	list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], list) {
+		if (xfrm_pol_bin_match(bin, sel, family))
+			return bin;
+	}
+	return NULL;
+}
+
+/* Insert behind the last policy of no lower priority, keeping the chain
+ * sorted by priority and, within a priority, by age.
+ */
+static void xfrm_policy_chain_add(struct hlist_head *chain,
+				  struct xfrm_policy *policy)
+{
+	struct hlist_node *newpos = NULL;
+	struct xfrm_policy *pol;
+
+	hlist_for_each_entry(pol, chain, bydst) {
+		if (policy->priority >= pol->priority)
+			newpos = &pol->bydst;
+		else
+			break;
+	}
+	if (newpos)
+		hlist_add_behind(&policy->bydst, newpos);
+	else
+		hlist_add_head(&policy->bydst, chain);
+}
+
+static void xfrm_pol_bin_add(struct xfrm_pol_inexact_bin *bin,
+			     struct xfrm_policy *policy)
+{
+	xfrm_policy_chain_add(xfrm_pol_bin_chain(bin, &policy->selector.daddr,
+						 &policy->selector.saddr),
+			      policy);
+	policy->bin = bin;
+	bin->count++;
+}
+
+/* Called with xfrm_policy_lock held for writing. */
+static struct xfrm_pol_inexact_bin *xfrm_pol_bin_create(struct net *net,
+							const struct xfrm_selector *sel,
+							unsigned short family,
+							int dir)
+{
+	struct xfrm_pol_inexact_bin *bin;
+	struct xfrm_policy *pol;
+	struct hlist_node *tmp;
+
+	if (family != AF_INET && family != AF_INET6)
+		return NULL;
+
+	bin = kzalloc(sizeof(*bin), GFP_ATOMIC);
+	if (!bin)
+		return NULL;
+	bin->table = kcalloc(XFRM_POL_BIN_HMASK_INIT + 1,
+			     sizeof(struct hlist_head), GFP_ATOMIC);
+	if (!bin->table) {
+		kfree(bin);
+		return NULL;
+	}
+	bin->hmask = XFRM_POL_BIN_HMASK_INIT;
+	bin->family = family;
+	bin->prefixlen_d = sel->prefixlen_d;
+	bin->prefixlen_s = sel->prefixlen_s;
+
+	/* Pick up what fell back to policy_inexact while the bin was missing */
+	hlist_for_each_entry_safe(pol, tmp, &net->xfrm.policy_inexact[dir], bydst) {
+		if (!xfrm_pol_bin_match(bin, &pol->selector, pol->family))
+			continue;
+		hlist_del(&pol->bydst);
+		xfrm_pol_bin_add(bin, pol);
+	}
+
+	list_add_tail(&bin->list, &net->xfrm.policy_inexact_bins[dir]);
+	return bin;
+}
+
+static void xfrm_pol_bin_free(struct xfrm_pol_inexact_bin *bin)
+{
+	xfrm_hash_free(bin->table, (bin->hmask + 1) * sizeof(struct hlist_head));
+	kfree(bin);
+}
+
+/*
+ * Return the chain a policy with this selector lives on.  For inexact
+ * selectors *binp is set to the bin of the chain, which is created if
+ * @create is set; if there is no bin the chain is policy_inexact.
+ */
 static struct hlist_head *policy_hash_bysel(struct net *net,
 					    const struct xfrm_selector *sel,
-					    unsigned short family, int dir)
+					    unsigned short family, int dir,
+					    struct xfrm_pol_inexact_bin **binp,
+					    bool create)
 {
 	unsigned int hmask = net->xfrm.policy_bydst[dir].hmask;
+	struct xfrm_pol_inexact_bin *bin;
 	unsigned int hash;
 	u8 dbits;
 	u8 sbits;
 
+	*binp = NULL;
 	__get_hash_thresh(net, family, dir, &dbits, &sbits);
 	hash = __sel_hash(sel, family, hmask, dbits, sbits);
+	if (hash != hmask + 1)
+		return net->xfrm.policy_bydst[dir].table + hash;
 
-	return (hash == hmask + 1 ?
-		&net->xfrm.policy_inexact[dir] :
-		net->xfrm.policy_bydst[dir].table + hash);
+	bin = xfrm_pol_bin_find(net, sel, family, dir);
+	if (!bin && create)
+		bin = xfrm_pol_bin_create(net, sel, family, dir);
+	if (!bin)
+		return &net->xfrm.policy_inexact[dir];
+
+	*binp = bin;
+	return xfrm_pol_bin_chain(bin, &sel->daddr, &sel->saddr);
 }
 
 static struct hlist_head *policy_hash_direct(struct net *net,
@@ -512,6 +655,83 @@ static void xfrm_byidx_resize(struct net *net, int total)
 	xfrm_hash_free(oidx, (hmask + 1) * sizeof(struct hlist_head));
 }
 
+static bool xfrm_pol_bin_should_resize(const struct xfrm_pol_inexact_bin *bin)
+{
+	return (bin->hmask + 1) < xfrm_policy_hashmax && bin->count > bin->hmask;
+}
+
+static void xfrm_pol_bin_transfer(struct xfrm_pol_inexact_bin *bin,
+				  struct hlist_head *ntable,
+				  unsigned int nhashmask)
+{
+	struct hlist_head *otable = bin->table;
+	unsigned int ohashmask = bin->hmask;
+	struct xfrm_policy *pol;
+	struct hlist_node *tmp;
+	int i;
+
+	bin->table = ntable;
+	bin->hmask = nhashmask;
+	for (i = ohashmask; i >= 0; i--) {
+		hlist_for_each_entry_safe(pol, tmp, otable + i, bydst) {
+			hlist_del(&pol->bydst);
+			xfrm_policy_chain_add(xfrm_pol_bin_chain(bin,
+						&pol->selector.daddr,
+						&pol->selector.saddr), pol);
+		}
+	}
+}
+
+/*
+ * Grow crowded inexact bins and free the empty ones.  Only called with
+ * hash_resize_mutex held, so no other context frees or resizes a bin.
+ */
+static void xfrm_pol_bins_resize(struct net *net, int dir)
+{
+	struct list_head *bins = &net->xfrm.policy_inexact_bins[dir];
+	struct xfrm_pol_inexact_bin *bin, *tmp;
+	unsigned int hmask, nhashmask;
+	struct hlist_head *otable, *ntable;
+	LIST_HEAD(dead);
+
+	write_lock_bh(&net->xfrm.xfrm_policy_lock);
+	list_for_each_entry_safe(bin, tmp, bins, list) {
+		if (!bin->count)
+			list_move(&bin->list, &dead);
+	}
+	write_unlock_bh(&net->xfrm.xfrm_policy_lock);
+
+	list_for_each_entry_safe(bin, tmp, &dead, list) {
+		list_del(&bin->list);
+		xfrm_pol_bin_free(bin);
+	}
+
+	for (;;) {
+		read_lock_bh(&net->xfrm.xfrm_policy_lock);
+		list_for_each_entry(bin, bins, list) {
+			if (xfrm_pol_bin_should_resize(bin))
+				goto found;
+		}
+		read_unlock_bh(&net->xfrm.xfrm_policy_lock);
+		return;
+found:
+		hmask = bin->hmask;
+		read_unlock_bh(&net->xfrm.xfrm_policy_lock);
+
+		nhashmask = xfrm_new_hash_mask(hmask);
+		ntable = xfrm_hash_alloc((nhashmask + 1) * sizeof(struct hlist_head));
+		if (!ntable)
+			return;
+
+		write_lock_bh(&net->xfrm.xfrm_policy_lock);
+		otable = bin->table;
+		xfrm_pol_bin_transfer(bin, ntable, nhashmask);
+		write_unlock_bh(&net->xfrm.xfrm_policy_lock);
+
+		xfrm_hash_free(otable, (hmask + 1) * sizeof(struct hlist_head));
+	}
+}
+
 static inline int xfrm_bydst_should_resize(struct net *net, int dir, int *total)
 {
 	unsigned int cnt = net->xfrm.policy_count[dir];
@@ -565,6 +785,7 @@ static void xfrm_hash_resize(struct work_struct *work)
 	for (dir = 0; dir < XFRM_POLICY_MAX; dir++) {
 		if (xfrm_bydst_should_resize(net, dir, &total))
 			xfrm_bydst_resize(net, dir);
+		xfrm_pol_bins_resize(net, dir);
 	}
 	if (xfrm_byidx_should_resize(net, total))
 		xfrm_byidx_resize(net, total);
@@ -577,11 +798,10 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 	struct net *net = container_of(work, struct net,
 				       xfrm.policy_hthresh.work);
 	unsigned int hmask;
-	struct xfrm_policy *pol;
 	struct xfrm_policy *policy;
+	struct xfrm_pol_inexact_bin *bin;
 	struct hlist_head *chain;
 	struct hlist_head *odst;
-	struct hlist_node *newpos;
 	int i;
 	int dir;
 	unsigned seq;
@@ -604,6 +824,11 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 	/* reset the bydst and inexact table in all directions */
 	for (dir = 0; dir < XFRM_POLICY_MAX; dir++) {
 		INIT_HLIST_HEAD(&net->xfrm.policy_inexact[dir]);
+		list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], list) {
+			for (i = bin->hmask; i >= 0; i--)
+				INIT_HLIST_HEAD(bin->table + i);
+			bin->count = 0;
+		}
 		hmask = net->xfrm.policy_bydst[dir].hmask;
 		odst = net->xfrm.policy_bydst[dir].table;
 		for (i = hmask; i >= 0; i--)
@@ -625,25 +850,28 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 
 	/* re-insert all policies by order of creation */
 	list_for_each_entry_reverse(policy, &net->xfrm.policy_all, walk.all) {
-		newpos = NULL;
+		/* Socket policies are not hashed. */
+		if (policy->walk.dead ||
+		    xfrm_policy_id2dir(policy->index) >= XFRM_POLICY_MAX)
+			continue;
 		chain = policy_hash_bysel(net, &policy->selector,
 					  policy->family,
-					  xfrm_policy_id2dir(policy->index));
-		hlist_for_each_entry(pol, chain, bydst) {
-			if (policy->priority >= pol->priority)
-				newpos = &pol->bydst;
-			else
-				break;
+					  xfrm_policy_id2dir(policy->index),
+					  &bin, true);
+		if (bin) {
+			xfrm_pol_bin_add(bin, policy);
+		} else {
+			xfrm_policy_chain_add(chain, policy);
+			policy->bin = NULL;
 		}
-		if (newpos)
-			hlist_add_behind(&policy->bydst, newpos);
-		else
-			hlist_add_head(&policy->bydst, chain);
 	}
 
 	write_unlock_bh(&net->xfrm.xfrm_policy_lock);
 
 	mutex_unlock(&hash_resize_mutex);
+
+	/* Bins may have been emptied or overfilled by the new thresholds */
+	schedule_work(&net->xfrm.policy_hash_work);
 }
 
 void xfrm_policy_hash_rebuild(struct net *net)
@@ -749,11 +977,13 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 	struct net *net = xp_net(policy);
 	struct xfrm_policy *pol;
 	struct xfrm_policy *delpol;
+	struct xfrm_pol_inexact_bin *bin;
 	struct hlist_head *chain;
 	struct hlist_node *newpos;
 
 	write_lock_bh(&net->xfrm.xfrm_policy_lock);
-	chain = policy_hash_bysel(net, &policy->selector, policy->family, dir);
+	chain = policy_hash_bysel(net, &policy->selector, policy->family, dir,
+				  &bin, true);
 	delpol = NULL;
 	newpos = NULL;
 	hlist_for_each_entry(pol, chain, bydst) {
@@ -780,6 +1010,14 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 		hlist_add_behind(&policy->bydst, newpos);
 	else
 		hlist_add_head(&policy->bydst, chain);
+	policy->bin = bin;
+	if (bin)
+		bin->count++;
+	/* A replacement at the same priority takes over the old position */
+	if (delpol && delpol->priority == policy->priority)
+		policy->pos = delpol->pos;
+	else
+		policy->pos = ++net->xfrm.policy_pos;
 	__xfrm_policy_link(policy, dir);
 	atomic_inc(&net->xfrm.flow_cache_genid);
 
@@ -803,7 +1041,8 @@ int xfrm_policy_insert(int dir, struct xfrm_policy *policy, int excl)
 
 	if (delpol)
 		xfrm_policy_kill(delpol);
-	else if (xfrm_bydst_should_resize(net, dir, NULL))
+	else if (xfrm_bydst_should_resize(net, dir, NULL) ||
+		 (bin && xfrm_pol_bin_should_resize(bin)))
 		schedule_work(&net->xfrm.policy_hash_work);
 
 	return 0;
@@ -816,11 +1055,12 @@ struct xfrm_policy *xfrm_policy_bysel_ctx(struct net *net, u32 mark, u8 type,
 					  int *err)
 {
 	struct xfrm_policy *pol, *ret;
+	struct xfrm_pol_inexact_bin *bin;
 	struct hlist_head *chain;
 
 	*err = 0;
 	write_lock_bh(&net->xfrm.xfrm_policy_lock);
-	chain = policy_hash_bysel(net, sel, sel->family, dir);
+	chain = policy_hash_bysel(net, sel, sel->family, dir, &bin, false);
 	ret = NULL;
 	hlist_for_each_entry(pol, chain, bydst) {
 		if (pol->type == type &&
@@ -895,6 +1135,7 @@ xfrm_policy_flush_secctx_check(struct net *net, u8 type, bool task_valid)
 	int dir, err = 0;
 
 	for (dir = 0; dir < XFRM_POLICY_MAX; dir++) {
+		struct xfrm_pol_inexact_bin *bin;
 		struct xfrm_policy *pol;
 		int i;
 
@@ -908,6 +1149,23 @@ xfrm_policy_flush_secctx_check(struct net *net, u8 type, bool task_valid)
 				return err;
 			}
 		}
+		list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir],
+				    list) {
+			for (i = bin->hmask; i >= 0; i--) {
+				hlist_for_each_entry(pol, bin->table + i,
+						     bydst) {
+					if (pol->type != type)
+						continue;
+					err = security_xfrm_policy_delete(
+								pol->security);
+					if (err) {
+						xfrm_audit_policy_delete(pol, 0,
+								 task_valid);
+						return err;
+					}
+				}
+			}
+		}
 		for (i = net->xfrm.policy_bydst[dir].hmask; i >= 0; i--) {
 			hlist_for_each_entry(pol,
 					     net->xfrm.policy_bydst[dir].table + i,
@@ -938,6 +1196,8 @@ int xfrm_policy_flush(struct net *net, u8 type, bool task_valid)
 {
 	int dir, err = 0, cnt = 0;
 
+	/* Keep tables and bins in place while the lock is dropped below */
+	mutex_lock(&hash_resize_mutex);
 	write_lock_bh(&net->xfrm.xfrm_policy_lock);
 
 	err = xfrm_policy_flush_secctx_check(net, type, task_valid);
@@ -945,6 +1205,7 @@ int xfrm_policy_flush(struct net *net, u8 type, bool task_valid)
 		goto out;
 
 	for (dir = 0; dir < XFRM_POLICY_MAX; dir++) {
+		struct xfrm_pol_inexact_bin *bin;
 		struct xfrm_policy *pol;
 		int i;
 
@@ -984,11 +1245,33 @@ int xfrm_policy_flush(struct net *net, u8 type, bool task_valid)
 			}
 		}
 
+		list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir],
+				    list) {
+			for (i = bin->hmask; i >= 0; i--) {
+	again3:
+				hlist_for_each_entry(pol, bin->table + i,
+						     bydst) {
+					if (pol->type != type)
+						continue;
+					__xfrm_policy_unlink(pol, dir);
+					write_unlock_bh(&net->xfrm.xfrm_policy_lock);
+					cnt++;
+
+					xfrm_audit_policy_delete(pol, 1,
+								 task_valid);
+					xfrm_policy_kill(pol);
+
+					write_lock_bh(&net->xfrm.xfrm_policy_lock);
+					goto again3;
+				}
+			}
+		}
 	}
 	if (!cnt)
 		err = -ESRCH;
 out:
 	write_unlock_bh(&net->xfrm.xfrm_policy_lock);
+	mutex_unlock(&hash_resize_mutex);
 	return err;
 }
 EXPORT_SYMBOL(xfrm_policy_flush);
@@ -1085,12 +1368,49 @@ static int xfrm_policy_match(const struct xfrm_policy *pol,
 	return ret;
 }
 
+/* Does @a take precedence over @b among inexact policies? */
+static bool xfrm_policy_before(const struct xfrm_policy *a,
+			       const struct xfrm_policy *b)
+{
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+	return (s32)(a->pos - b->pos) < 0;
+}
+
+/*
+ * Walk one inexact chain for a policy matching the flow that takes
+ * precedence over both @best and the exact match of priority @priority.
+ * Chains are sorted, so the walk stops at the first entry that cannot win.
+ */
+static struct xfrm_policy *
+xfrm_policy_eval_inexact(struct hlist_head *chain, struct xfrm_policy *best,
+			 u32 priority, const struct flowi *fl,
+			 u8 type, u16 family, int dir)
+{
+	struct xfrm_policy *pol;
+	int err;
+
+	hlist_for_each_entry(pol, chain, bydst) {
+		if (pol->priority >= priority)
+			break;
+		if (best && !xfrm_policy_before(pol, best))
+			break;
+		err = xfrm_policy_match(pol, fl, type, family, dir);
+		if (!err)
+			return pol;
+		if (err != -ESRCH)
+			return ERR_PTR(err);
+	}
+	return best;
+}
+
 static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 						     const struct flowi *fl,
 						     u16 family, u8 dir)
 {
 	int err;
-	struct xfrm_policy *pol, *ret;
+	struct xfrm_policy *pol, *ret, *inexact;
+	struct xfrm_pol_inexact_bin *bin;
 	const xfrm_address_t *daddr, *saddr;
 	struct hlist_head *chain;
 	u32 priority = ~0U;
@@ -1118,21 +1438,27 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 			break;
 		}
 	}
-	chain = &net->xfrm.policy_inexact[dir];
-	hlist_for_each_entry(pol, chain, bydst) {
-		err = xfrm_policy_match(pol, fl, type, family, dir);
-		if (err) {
-			if (err == -ESRCH)
-				continue;
-			else {
-				ret = ERR_PTR(err);
-				goto fail;
-			}
-		} else if (pol->priority < priority) {
-			ret = pol;
-			break;
+	inexact = NULL;
+	list_for_each_entry(bin, &net->xfrm.policy_inexact_bins[dir], list) {
+		if (bin->family != family)
+			continue;
+		chain = xfrm_pol_bin_chain(bin, daddr, saddr);
+		inexact = xfrm_policy_eval_inexact(chain, inexact, priority,
+						   fl, type, family, dir);
+		if (IS_ERR(inexact)) {
+			ret = inexact;
+			goto fail;
 		}
 	}
+	inexact = xfrm_policy_eval_inexact(&net->xfrm.policy_inexact[dir],
+					   inexact, priority,
+					   fl, type, family, dir);
+	if (IS_ERR(inexact)) {
+		ret = inexact;
+		goto fail;
+	}
+	if (inexact)
+		ret = inexact;
 	if (ret)
 		xfrm_pol_hold(ret);
 fail:
@@ -1265,6 +1591,12 @@ static struct xfrm_policy *__xfrm_policy_unlink(struct xfrm_policy *pol,
 		hlist_del(&pol->bydst);
 		hlist_del(&pol->byidx);
 	}
+	if (pol->bin) {
+		/* Leave freeing the empty bin to the resize work */
+		if (!--pol->bin->count)
+			schedule_work(&net->xfrm.policy_hash_work);
+		pol->bin = NULL;
+	}
 
 	list_del_init(&pol->walk.all);
 	net->xfrm.policy_count[dir]--;
@@ -2977,6 +3309,7 @@ static int __net_init xfrm_policy_init(struct net *net)
 		net->xfrm.policy_count[dir] = 0;
 		net->xfrm.policy_count[XFRM_POLICY_MAX + dir] = 0;
 		INIT_HLIST_HEAD(&net->xfrm.policy_inexact[dir]);
+		INIT_LIST_HEAD(&net->xfrm.policy_inexact_bins[dir]);
 
 		htab = &net->xfrm.policy_bydst[dir];
 		htab->table = xfrm_hash_alloc(sz);
@@ -3027,11 +3360,22 @@ static void xfrm_policy_fini(struct net *net)
 
 	WARN_ON(!list_empty(&net->xfrm.policy_all));
 
+	flush_work(&net->xfrm.policy_hash_work);
+
 	for (dir = 0; dir < XFRM_POLICY_MAX; dir++) {
+		struct xfrm_pol_inexact_bin *bin, *tmp;
 		struct xfrm_policy_hash *htab;
 
 		WARN_ON(!hlist_empty(&net->xfrm.policy_inexact[dir]));
 
+		list_for_each_entry_safe(bin, tmp,
+					 &net->xfrm.policy_inexact_bins[dir],
+					 list) {
+			WARN_ON(bin->count);
+			list_del(&bin->list);
+			xfrm_pol_bin_free(bin);
+		}
+
 		htab = &net->xfrm.policy_bydst[dir];
 		sz = (htab->hmask + 1) * sizeof(struct hlist_head);
 		WARN_ON(!hlist_empty(htab->table));
@@ -3194,6 +3538,7 @@ static struct xfrm_policy *xfrm_migrate_policy_find(const struct xfrm_selector *
 						    u8 dir, u8 type, struct net *net)
 {
 	struct xfrm_policy *pol, *ret = NULL;
+	struct xfrm_pol_inexact_bin *bin;
 	struct hlist_head *chain;
 	u32 priority = ~0U;
 
@@ -3207,7 +3552,14 @@ static struct xfrm_policy *xfrm_migrate_policy_find(const struct xfrm_selector *
 			break;
 		}
 	}
-	chain = &net->xfrm.policy_inexact[dir];
+	/* A matching policy has the prefix lengths of sel, so only its
+	 * bin (or policy_inexact, if there is none) can hold it.
+	 */
+	bin = xfrm_pol_bin_find(net, sel, sel->family, dir);
+	if (bin)
+		chain = xfrm_pol_bin_chain(bin, &sel->daddr, &sel->saddr);
+	else
+		chain = &net->xfrm.policy_inexact[dir];
 	hlist_for_each_entry(pol, chain, bydst) {
 		if (xfrm_migrate_selector_match(sel, &pol->selector) &&
 		    pol->type == type &&
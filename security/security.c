@@ -25,6 +25,7 @@
 #include <linux/mount.h>
 #include <linux/personality.h>
 #include <linux/backing-dev.h>
+#include <linux/jump_label.h>
 #include <net/flow.h>
 
 #define MAX_LSM_EVM_XATTR	2
@@ -38,6 +39,78 @@ static struct security_operations default_security_ops = {
 	.name	= "default",
 };
 
+/*
+ * Hooks on the hottest syscall paths get a static key that is only
+ * enabled while the active module implements them.  Until then the
+ * wrappers skip the indirect call to the capability no-op altogether.
+ */
+enum lsm_hot_hook {
+	LSM_INODE_FOLLOW_LINK,
+	LSM_INODE_PERMISSION,
+	LSM_INODE_GETATTR,
+	LSM_FILE_PERMISSION,
+	LSM_FILE_IOCTL,
+	LSM_FILE_FCNTL,
+	LSM_FILE_OPEN,
+	LSM_SOCKET_SENDMSG,
+	LSM_SOCKET_RECVMSG,
+	LSM_NR_HOT_HOOKS,
+};
+
+struct lsm_hot_hook_key {
+	size_t			offset;	/* in struct security_operations */
+	bool			enabled;
+	struct static_key	key;
+};
+
+#define LSM_HOT_HOOK(idx, hook)						\
+	[idx] = {							\
+		.offset	= offsetof(struct security_operations, hook),	\
+		.key	= STATIC_KEY_INIT_FALSE,			\
+	}
+
+static struct lsm_hot_hook_key lsm_hot_hooks[LSM_NR_HOT_HOOKS] = {
+	LSM_HOT_HOOK(LSM_INODE_FOLLOW_LINK,	inode_follow_link),
+	LSM_HOT_HOOK(LSM_INODE_PERMISSION,	inode_permission),
+	LSM_HOT_HOOK(LSM_INODE_GETATTR,		inode_getattr),
+	LSM_HOT_HOOK(LSM_FILE_PERMISSION,	file_permission),
+	LSM_HOT_HOOK(LSM_FILE_IOCTL,		file_ioctl),
+	LSM_HOT_HOOK(LSM_FILE_FCNTL,		file_fcntl),
+	LSM_HOT_HOOK(LSM_FILE_OPEN,		file_open),
+	LSM_HOT_HOOK(LSM_SOCKET_SENDMSG,	socket_sendmsg),
+	LSM_HOT_HOOK(LSM_SOCKET_RECVMSG,	socket_recvmsg),
+};
+
+#define lsm_hook_active(idx)	static_key_false(&lsm_hot_hooks[idx].key)
+
+/*
+ * After security_fixup_ops() a hook the module left out points to the
+ * same capability default as in default_security_ops.
+ */
+static void lsm_hot_hooks_update(void)
+{
+	struct lsm_hot_hook_key *h;
+	void *hook, *def;
+	bool enable;
+	int i;
+
+	for (i = 0; i < LSM_NR_HOT_HOOKS; i++) {
+		h = &lsm_hot_hooks[i];
+		hook = *(void **)((void *)security_ops + h->offset);
+		def = *(void **)((void *)&default_security_ops + h->offset);
+
+		enable = hook != def;
+		if (enable == h->enabled)
+			continue;
+
+		h->enabled = enable;
+		if (enable)
+			static_key_slow_inc(&h->key);
+		else
+			static_key_slow_dec(&h->key);
+	}
+}
+
 static inline int __init verify(struct security_operations *ops)
 {
 	/* verify the security_operations structure exists */
@@ -76,6 +149,7 @@ int __init security_init(void)
 void reset_security_ops(void)
 {
 	security_ops = &default_security_ops;
+	lsm_hot_hooks_update();
 }
 
 /* Save user chosen LSM */
@@ -129,6 +203,7 @@ int __init register_security(struct security_operations *ops)
 		return -EAGAIN;
 
 	security_ops = ops;
+	lsm_hot_hooks_update();
 
 	return 0;
 }
@@ -562,6 +637,8 @@ int security_inode_follow_link(struct dentry *dentry, struct nameidata *nd)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
 		return 0;
+	if (!lsm_hook_active(LSM_INODE_FOLLOW_LINK))
+		return 0;
 	return security_ops->inode_follow_link(dentry, nd);
 }
 
@@ -569,6 +646,8 @@ int security_inode_permission(struct inode *inode, int mask)
 {
 	if (unlikely(IS_PRIVATE(inode)))
 		return 0;
+	if (!lsm_hook_active(LSM_INODE_PERMISSION))
+		return 0;
 	return security_ops->inode_permission(inode, mask);
 }
 
@@ -589,6 +668,8 @@ int security_inode_getattr(struct vfsmount *mnt, struct dentry *dentry)
 {
 	if (unlikely(IS_PRIVATE(dentry->d_inode)))
 		return 0;
+	if (!lsm_hook_active(LSM_INODE_GETATTR))
+		return 0;
 	return security_ops->inode_getattr(mnt, dentry);
 }
 
@@ -687,9 +768,11 @@ int security_file_permission(struct file *file, int mask)
 {
 	int ret;
 
-	ret = security_ops->file_permission(file, mask);
-	if (ret)
-		return ret;
+	if (lsm_hook_active(LSM_FILE_PERMISSION)) {
+		ret = security_ops->file_permission(file, mask);
+		if (ret)
+			return ret;
+	}
 
 	return fsnotify_perm(file, mask);
 }
@@ -706,6 +789,8 @@ void security_file_free(struct file *file)
 
 int security_file_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
+	if (!lsm_hook_active(LSM_FILE_IOCTL))
+		return 0;
 	return security_ops->file_ioctl(file, cmd, arg);
 }
 
@@ -772,6 +857,8 @@ int security_file_lock(struct file *file, unsigned int cmd)
 
 int security_file_fcntl(struct file *file, unsigned int cmd, unsigned long arg)
 {
+	if (!lsm_hook_active(LSM_FILE_FCNTL))
+		return 0;
 	return security_ops->file_fcntl(file, cmd, arg);
 }
 
@@ -795,9 +882,11 @@ int security_file_open(struct file *file, const struct cred *cred)
 {
 	int ret;
 
-	ret = security_ops->file_open(file, cred);
-	if (ret)
-		return ret;
+	if (lsm_hook_active(LSM_FILE_OPEN)) {
+		ret = security_ops->file_open(file, cred);
+		if (ret)
+			return ret;
+	}
 
 	return fsnotify_perm(file, MAY_OPEN);
 }
@@ -1178,12 +1267,16 @@ int security_socket_accept(struct socket *sock, struct socket *newsock)
 
 int security_socket_sendmsg(struct socket *sock, struct msghdr *msg, int size)
 {
+	if (!lsm_hook_active(LSM_SOCKET_SENDMSG))
+		return 0;
 	return security_ops->socket_sendmsg(sock, msg, size);
 }
 
 int security_socket_recvmsg(struct socket *sock, struct msghdr *msg,
 			    int size, int flags)
 {
+	if (!lsm_hook_active(LSM_SOCKET_RECVMSG))
+		return 0;
 	return security_ops->socket_recvmsg(sock, msg, size, flags);
 }
 
@@ -22,6 +22,10 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/bootmem.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -33,10 +37,16 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_DEF_CACHE_SLOTS		512
+#define AVC_MIN_CACHE_SLOTS		512
+#define AVC_MAX_CACHE_SLOTS		(1UL << 16)
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
 
+/* Per-cpu front cache of recent decisions, must be a power of two */
+#define AVC_PCPU_SHIFT			4
+#define AVC_PCPU_SLOTS			(1 << AVC_PCPU_SHIFT)
+
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
 #else
@@ -56,14 +66,36 @@ struct avc_node {
 	struct rcu_head		rhead;
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
-	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
+	struct avc_slot		*slots;
+	unsigned int		slots_mask;
 	atomic_t		active_nodes;
+	atomic_t		pcpu_gen;	/* validates avc_pcpu_entry copies */
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * A copy of a decision from the shared cache, only valid while @gen
+ * matches avc_cache.pcpu_gen.  Any change to a cached decision bumps
+ * the generation, which invalidates the copies on every CPU at once.
+ */
+struct avc_pcpu_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	unsigned int		gen;
+	struct av_decision	avd;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	entries[AVC_PCPU_SLOTS];
+};
+
 struct avc_callback_node {
 	int (*callback) (u32 event);
 	u32 events;
@@ -81,9 +113,30 @@ static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+/* Per-cpu position of the reclaim scan, so CPUs don't share a hint */
+static DEFINE_PER_CPU(unsigned int, avc_reclaim_hint);
+
+static unsigned long avc_cache_slots __initdata = AVC_DEF_CACHE_SLOTS;
+
+static int __init avc_cache_slots_setup(char *str)
+{
+	unsigned long slots;
+
+	if (!kstrtoul(str, 0, &slots) && slots)
+		avc_cache_slots = slots;
+	return 1;
+}
+__setup("avc_cache_slots=", avc_cache_slots_setup);
+
 static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return jhash_3words(ssid, tsid, tclass, 0) & avc_cache.slots_mask;
+}
+
+static inline unsigned int avc_pcpu_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+	return hash_32(ssid ^ (tsid << 2) ^ (tclass << 4), AVC_PCPU_SHIFT);
 }
 
 /**
@@ -160,14 +213,35 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
-
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
+	unsigned long nslots;
+	unsigned int shift;
+	int i, cpu;
+
+	nslots = roundup_pow_of_two(clamp_t(unsigned long, avc_cache_slots,
+					    AVC_MIN_CACHE_SLOTS,
+					    AVC_MAX_CACHE_SLOTS));
+	avc_cache.slots = alloc_large_system_hash("AVC cache",
+						  sizeof(struct avc_slot),
+						  nslots, 0, 0, &shift, NULL,
+						  nslots, nslots);
+	nslots = 1UL << shift;
+	avc_cache.slots_mask = nslots - 1;
+
+	for (i = 0; i < nslots; i++) {
+		INIT_HLIST_HEAD(&avc_cache.slots[i].head);
+		spin_lock_init(&avc_cache.slots[i].lock);
 	}
 	atomic_set(&avc_cache.active_nodes, 0);
-	atomic_set(&avc_cache.lru_hint, 0);
+	/* Start at 1 so the zeroed per-cpu entries are never valid */
+	atomic_set(&avc_cache.pcpu_gen, 1);
+
+	/* Spread the reclaim scans of the CPUs over the table */
+	for_each_possible_cpu(cpu)
+		per_cpu(avc_reclaim_hint, cpu) = cpu * (nslots / nr_cpu_ids);
+
+	/* Keep about one cached decision per slot unless told otherwise */
+	if (nslots > avc_cache_threshold)
+		avc_cache_threshold = nslots;
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					     0, SLAB_PANIC, NULL);
@@ -185,8 +259,8 @@ int avc_get_hash_stats(char *page)
 
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i <= avc_cache.slots_mask; i++) {
+		head = &avc_cache.slots[i].head;
 		if (!hlist_empty(head)) {
 			slots_used++;
 			chain_len = 0;
@@ -202,7 +276,7 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, avc_cache.slots_mask + 1, max_chain_len);
 }
 
 static void avc_node_free(struct rcu_head *rhead)
@@ -233,6 +307,69 @@ static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 	atomic_dec(&avc_cache.active_nodes);
 }
 
+/*
+ * Invalidate the per-cpu copies of cached decisions.  Called after a
+ * decision in the shared cache has been replaced or removed, so that a
+ * lookup which sees the new generation also sees the new decision.
+ */
+static inline void avc_pcpu_invalidate(void)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&avc_cache.pcpu_gen);
+}
+
+static inline unsigned int avc_pcpu_generation(void)
+{
+	unsigned int gen = atomic_read(&avc_cache.pcpu_gen);
+
+	smp_rmb();
+	return gen;
+}
+
+static inline bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass,
+				   unsigned int gen, struct av_decision *avd)
+{
+	struct avc_pcpu_entry *entry;
+	unsigned long flags;
+	unsigned int idx;
+	bool hit = false;
+
+	/* Softirq permission checks share the entries with process context */
+	local_irq_save(flags);
+	idx = avc_pcpu_hash(ssid, tsid, tclass);
+	entry = this_cpu_ptr(&avc_pcpu_cache.entries[idx]);
+	if (entry->gen == gen && entry->ssid == ssid &&
+	    entry->tsid == tsid && entry->tclass == tclass) {
+		memcpy(avd, &entry->avd, sizeof(*avd));
+		hit = true;
+	}
+	local_irq_restore(flags);
+
+	return hit;
+}
+
+static inline void avc_pcpu_insert(u32 ssid, u32 tsid, u16 tclass,
+				   unsigned int gen, struct av_decision *avd)
+{
+	struct avc_pcpu_entry *entry;
+	unsigned long flags;
+	unsigned int idx;
+
+	local_irq_save(flags);
+	idx = avc_pcpu_hash(ssid, tsid, tclass);
+	entry = this_cpu_ptr(&avc_pcpu_cache.entries[idx]);
+	entry->ssid = ssid;
+	entry->tsid = tsid;
+	entry->tclass = tclass;
+	entry->gen = gen;
+	memcpy(&entry->avd, avd, sizeof(entry->avd));
+	local_irq_restore(flags);
+}
+
+/*
+ * Evicted decisions stay valid, so reclaim leaves the per-cpu copies
+ * alone and each CPU scans from its own position in the table.
+ */
 static inline int avc_reclaim_node(void)
 {
 	struct avc_node *node;
@@ -241,10 +378,10 @@ static inline int avc_reclaim_node(void)
 	struct hlist_head *head;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	for (try = 0, ecx = 0; try <= avc_cache.slots_mask; try++) {
+		hvalue = this_cpu_inc_return(avc_reclaim_hint) & avc_cache.slots_mask;
+		head = &avc_cache.slots[hvalue].head;
+		lock = &avc_cache.slots[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
@@ -300,7 +437,7 @@ static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 	struct hlist_head *head;
 
 	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	head = &avc_cache.slots[hvalue].head;
 	hlist_for_each_entry_rcu(node, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -395,8 +532,8 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 		hvalue = avc_hash(ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		head = &avc_cache.slots[hvalue].head;
+		lock = &avc_cache.slots[hvalue].lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, head, list) {
@@ -404,11 +541,12 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 			    pos->ae.tsid == tsid &&
 			    pos->ae.tclass == tclass) {
 				avc_node_replace(node, pos);
-				goto found;
+				spin_unlock_irqrestore(lock, flag);
+				avc_pcpu_invalidate();
+				goto out;
 			}
 		}
 		hlist_add_head_rcu(&node->list, head);
-found:
 		spin_unlock_irqrestore(lock, flag);
 	}
 out:
@@ -552,8 +690,8 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 	/* Lock the target slot */
 	hvalue = avc_hash(ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &avc_cache.slots[hvalue].head;
+	lock = &avc_cache.slots[hvalue].lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -604,6 +742,11 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
 out:
+	/*
+	 * Even if the entry was already evicted, drop the per-cpu copies
+	 * so that the update is not hidden behind a stale decision.
+	 */
+	avc_pcpu_invalidate();
 	return rc;
 }
 
@@ -618,9 +761,9 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	for (i = 0; i <= avc_cache.slots_mask; i++) {
+		head = &avc_cache.slots[i].head;
+		lock = &avc_cache.slots[i].lock;
 
 		spin_lock_irqsave(lock, flag);
 		/*
@@ -633,6 +776,7 @@ static void avc_flush(void)
 		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	avc_pcpu_invalidate();
 }
 
 /**
@@ -721,6 +865,7 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 			 struct av_decision *avd)
 {
 	struct avc_node *node;
+	unsigned int gen;
 	int rc = 0;
 	u32 denied;
 
@@ -728,12 +873,18 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 
 	rcu_read_lock();
 
-	node = avc_lookup(ssid, tsid, tclass);
-	if (unlikely(!node)) {
-		node = avc_compute_av(ssid, tsid, tclass, avd);
+	gen = avc_pcpu_generation();
+	if (avc_pcpu_lookup(ssid, tsid, tclass, gen, avd)) {
+		avc_cache_stats_incr(lookups);
 	} else {
-		memcpy(avd, &node->ae.avd, sizeof(*avd));
-		avd = &node->ae.avd;
+		node = avc_lookup(ssid, tsid, tclass);
+		if (unlikely(!node))
+			node = avc_compute_av(ssid, tsid, tclass, avd);
+		else
+			memcpy(avd, &node->ae.avd, sizeof(*avd));
+		/* A decision the cache refused (stale seqno) is not kept */
+		if (node)
+			avc_pcpu_insert(ssid, tsid, tclass, gen, avd);
 	}
 
 	denied = requested & ~(avd->allowed);
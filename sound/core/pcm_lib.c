@@ -24,6 +24,7 @@
 #include <linux/time.h>
 #include <linux/math64.h>
 #include <linux/export.h>
+#include <linux/hrtimer.h>
 #include <sound/core.h>
 #include <sound/control.h>
 #include <sound/tlv.h>
@@ -1774,6 +1775,22 @@ EXPORT_SYMBOL(snd_pcm_period_elapsed);
  * The available space is stored on availp.  When err = 0 and avail = 0
  * on the capture stream, it indicates the stream is in DRAINING state.
  */
+/*
+ * Without period interrupts nobody updates the hw pointer while we sleep,
+ * so sleep until the missing frames should have been transferred at the
+ * stream rate and let the caller re-read the pointer.
+ */
+static void wait_for_frames(struct snd_pcm_runtime *runtime,
+			    snd_pcm_uframes_t frames)
+{
+	ktime_t expires;
+
+	expires = ns_to_ktime(div_u64((u64)frames * NSEC_PER_SEC,
+				      runtime->rate));
+	schedule_hrtimeout_range(&expires, current->timer_slack_ns,
+				 HRTIMER_MODE_REL);
+}
+
 static int wait_for_avail(struct snd_pcm_substream *substream,
 			      snd_pcm_uframes_t *availp)
 {
@@ -1820,10 +1837,18 @@ static int wait_for_avail(struct snd_pcm_substream *substream,
 			break;
 		snd_pcm_stream_unlock_irq(substream);
 
-		tout = schedule_timeout(wait_time);
+		if (runtime->no_period_wakeup && runtime->rate &&
+		    runtime->status->state == SNDRV_PCM_STATE_RUNNING) {
+			wait_for_frames(runtime, runtime->twake - avail);
+			tout = wait_time;
+		} else
+			tout = schedule_timeout(wait_time);
 
 		snd_pcm_stream_lock_irq(substream);
 		set_current_state(TASK_INTERRUPTIBLE);
+		if (runtime->no_period_wakeup &&
+		    runtime->status->state == SNDRV_PCM_STATE_RUNNING)
+			snd_pcm_update_hw_ptr(substream);
 		switch (runtime->status->state) {
 		case SNDRV_PCM_STATE_SUSPENDED:
 			err = -ESTRPIPE;
@@ -1640,6 +1640,7 @@ static int snd_pcm_drain(struct snd_pcm_substream *substream,
 	for (;;) {
 		long tout;
 		struct snd_pcm_runtime *to_check;
+		struct snd_pcm_substream *to_check_s = NULL;
 		if (signal_pending(current)) {
 			result = -ERESTARTSYS;
 			break;
@@ -1652,6 +1653,7 @@ static int snd_pcm_drain(struct snd_pcm_substream *substream,
 			runtime = s->runtime;
 			if (runtime->status->state == SNDRV_PCM_STATE_DRAINING) {
 				to_check = runtime;
+				to_check_s = s;
 				break;
 			}
 		}
@@ -1659,12 +1661,19 @@ static int snd_pcm_drain(struct snd_pcm_substream *substream,
 			break; /* all drained */
 		init_waitqueue_entry(&wait, current);
 		add_wait_queue(&to_check->sleep, &wait);
-		snd_pcm_stream_unlock_irq(substream);
-		up_read(&snd_pcm_link_rwsem);
-		snd_power_unlock(card);
-		if (runtime->no_period_wakeup)
+		if (runtime->no_period_wakeup) {
+			/*
+			 * No interrupt will tell us when the queued data has
+			 * been played; wake up when it should have been and
+			 * check the hw pointer.
+			 */
+			snd_pcm_sframes_t left = snd_pcm_playback_hw_avail(runtime);
+
 			tout = MAX_SCHEDULE_TIMEOUT;
-		else {
+			if (runtime->rate)
+				tout = div_u64((u64)max_t(snd_pcm_sframes_t, left, 0) *
+					       HZ, runtime->rate) + 1;
+		} else {
 			tout = 10;
 			if (runtime->rate) {
 				long t = runtime->period_size * 2 / runtime->rate;
@@ -1672,9 +1681,19 @@ static int snd_pcm_drain(struct snd_pcm_substream *substream,
 			}
 			tout = msecs_to_jiffies(tout * 1000);
 		}
+		snd_pcm_stream_unlock_irq(substream);
+		up_read(&snd_pcm_link_rwsem);
+		snd_power_unlock(card);
 		tout = schedule_timeout_interruptible(tout);
 		snd_power_lock(card);
 		down_read(&snd_pcm_link_rwsem);
+		if (tout == 0 && runtime->no_period_wakeup) {
+			snd_pcm_stream_lock_irq(to_check_s);
+			if (runtime->status->state == SNDRV_PCM_STATE_DRAINING)
+				snd_pcm_update_hw_ptr(to_check_s);
+			snd_pcm_stream_unlock_irq(to_check_s);
+			tout = 1;
+		}
 		snd_pcm_stream_lock_irq(substream);
 		remove_wait_queue(&to_check->sleep, &wait);
 		if (card->shutdown) {
@@ -0,0 +1,413 @@
+/*
+ * epoll: Benchmark epoll_wait() and epoll_ctl() scalability.
+ *
+ * epoll wait: nthreads workers block in epoll_wait() on nfds eventfds each
+ * (or on one epoll instance shared by all of them), while a writer thread
+ * keeps making the eventfds readable.  Every epoll_wait() call is timed.
+ *
+ * epoll ctl: nthreads workers add, modify and delete nfds file descriptors
+ * each, on one shared epoll instance by default, timing every call.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "hist.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 8;
+static unsigned int nfds     = 64;
+static bool done = false, silent = false, shared = false, edge = false;
+static bool per_thread = false;
+
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static pthread_cond_t thread_parent, thread_worker;
+static struct timeval start, end, runtime;
+static struct stats throughput_stats;
+
+enum {
+	EPOLL_OP_WAIT,
+	EPOLL_OP_ADD = EPOLL_OP_WAIT,
+	EPOLL_OP_MOD,
+	EPOLL_OP_DEL,
+	EPOLL_NR_OPS,
+};
+
+static const int ctl_ops[EPOLL_NR_OPS] = {
+	EPOLL_CTL_ADD, EPOLL_CTL_MOD, EPOLL_CTL_DEL,
+};
+
+static const char * const ctl_op_names[EPOLL_NR_OPS] = {
+	"EPOLL_CTL_ADD", "EPOLL_CTL_MOD", "EPOLL_CTL_DEL",
+};
+
+struct worker {
+	int		tid;
+	int		epollfd;
+	int		*fds;
+	pthread_t	thread;
+	unsigned long	ops[EPOLL_NR_OPS];
+	struct lat_hist	hist[EPOLL_NR_OPS];
+};
+
+static const struct option wait_options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",    &nfds,     "Specify amount of file descriptors per thread"),
+	OPT_BOOLEAN( 'S', "shared",  &shared,   "Use a single epoll instance for all threads"),
+	OPT_BOOLEAN( 'E', "edge",    &edge,     "Use edge-triggered notifications"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const struct option ctl_options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,   "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,      "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "nfds",    &nfds,       "Specify amount of file descriptors per thread"),
+	OPT_BOOLEAN( 'N', "per-thread", &per_thread, "Use one epoll instance per thread"),
+	OPT_BOOLEAN( 's', "silent",  &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static const char * const bench_epoll_ctl_usage[] = {
+	"perf bench epoll ctl <options>",
+	NULL
+};
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void worker_wait_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void *wait_workerfn(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev[16];
+	u64 val;
+	int i, n;
+
+	worker_wait_start();
+
+	do {
+		u64 t0 = bench__now_ns();
+
+		/* don't block forever once the writer has stopped */
+		n = epoll_wait(w->epollfd, ev, ARRAY_SIZE(ev), 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "epoll_wait");
+		}
+		if (!n)
+			continue;
+
+		lat_hist__add(&w->hist[EPOLL_OP_WAIT], bench__now_ns() - t0);
+
+		for (i = 0; i < n; i++) {
+			/* another thread may have drained it (shared mode) */
+			if (read(ev[i].data.fd, &val, sizeof(val)) == sizeof(val))
+				w->ops[EPOLL_OP_WAIT]++;
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void *writerfn(void *arg)
+{
+	struct worker *worker = arg;
+	u64 val = 1;
+	unsigned int i, j;
+
+	worker_wait_start();
+
+	do {
+		for (i = 0; i < nthreads && !done; i++) {
+			for (j = 0; j < nfds; j++) {
+				if (write(worker[i].fds[j], &val, sizeof(val)) != sizeof(val))
+					err(EXIT_FAILURE, "write");
+			}
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static void *ctl_workerfn(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev;
+	unsigned int i;
+	int op;
+
+	worker_wait_start();
+
+	do {
+		for (op = EPOLL_OP_ADD; op < EPOLL_NR_OPS && !done; op++) {
+			for (i = 0; i < nfds; i++) {
+				u64 t0;
+
+				ev.events = op == EPOLL_OP_MOD ? EPOLLOUT : EPOLLIN;
+				ev.data.fd = w->fds[i];
+
+				t0 = bench__now_ns();
+				if (epoll_ctl(w->epollfd, ctl_ops[op], w->fds[i], &ev))
+					err(EXIT_FAILURE, "epoll_ctl");
+				lat_hist__add(&w->hist[op], bench__now_ns() - t0);
+				w->ops[op]++;
+			}
+		}
+	} while (!done);
+
+	return NULL;
+}
+
+static struct worker *setup_workers(bool wait)
+{
+	struct worker *worker;
+	int shared_fd = -1;
+	unsigned int i, j;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	if ((wait && shared) || (!wait && !per_thread)) {
+		shared_fd = epoll_create1(0);
+		if (shared_fd < 0)
+			err(EXIT_FAILURE, "epoll_create1");
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		struct worker *w = &worker[i];
+
+		w->tid = i;
+		w->epollfd = shared_fd;
+		if (w->epollfd < 0) {
+			w->epollfd = epoll_create1(0);
+			if (w->epollfd < 0)
+				err(EXIT_FAILURE, "epoll_create1");
+		}
+
+		w->fds = calloc(nfds, sizeof(*w->fds));
+		if (!w->fds)
+			err(EXIT_FAILURE, "calloc");
+
+		for (j = 0; j < nfds; j++) {
+			w->fds[j] = eventfd(0, EFD_NONBLOCK);
+			if (w->fds[j] < 0)
+				err(EXIT_FAILURE, "eventfd");
+
+			if (wait) {
+				struct epoll_event ev = {
+					.events	 = EPOLLIN | (edge ? EPOLLET : 0),
+					.data.fd = w->fds[j],
+				};
+
+				if (epoll_ctl(w->epollfd, EPOLL_CTL_ADD,
+					      w->fds[j], &ev))
+					err(EXIT_FAILURE, "epoll_ctl");
+			}
+		}
+
+		for (j = 0; j < EPOLL_NR_OPS; j++)
+			lat_hist__init(&w->hist[j]);
+	}
+
+	return worker;
+}
+
+static void free_workers(struct worker *worker)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < nthreads; i++) {
+		for (j = 0; j < nfds; j++)
+			close(worker[i].fds[j]);
+		free(worker[i].fds);
+		if (!i || worker[i].epollfd != worker[0].epollfd)
+			close(worker[i].epollfd);
+	}
+
+	free(worker);
+}
+
+static void run_workers(struct worker *worker, void *(*fn)(void *),
+		       pthread_t *writer)
+{
+	pthread_attr_t thread_attr;
+	unsigned int i, ncpus;
+	cpu_set_t cpu;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads + !!writer;
+	pthread_attr_init(&thread_attr);
+	for (i = 0; i < nthreads; i++) {
+		CPU_ZERO(&cpu);
+		CPU_SET(i % ncpus, &cpu);
+
+		if (pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpu))
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		if (pthread_create(&worker[i].thread, &thread_attr, fn, &worker[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	if (writer && pthread_create(writer, NULL, writerfn, worker))
+		err(EXIT_FAILURE, "pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	if (writer && pthread_join(*writer, NULL))
+		err(EXIT_FAILURE, "pthread_join");
+
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+}
+
+static void print_summary(struct worker *worker, int op, const char *what)
+{
+	struct lat_hist hist;
+	unsigned long avg;
+	double stddev, secs;
+	unsigned int i;
+
+	secs = runtime.tv_sec + runtime.tv_usec / 1e6;
+
+	init_stats(&throughput_stats);
+	lat_hist__init(&hist);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops[op] / secs;
+
+		update_stats(&throughput_stats, t);
+		lat_hist__merge(&hist, &worker[i].hist[op]);
+		if (!silent)
+			printf("[thread %2d] %s: %ld ops/sec\n",
+			       worker[i].tid, what, t);
+	}
+
+	avg = avg_stats(&throughput_stats);
+	stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld %s ops/sec (+- %.2f%%), total secs = %.2f\n",
+	       !silent ? "\n" : "", avg, what,
+	       rel_stddev_stats(stddev, avg), secs);
+	lat_hist__fprintf(&hist, what, stdout);
+}
+
+static void setup_common(int argc, const char **argv,
+			 const struct option *options,
+			 const char * const *usage)
+{
+	struct sigaction act;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc || !nfds) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	act.sa_flags = 0;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	struct worker *worker;
+	pthread_t writer;
+
+	setup_common(argc, argv, wait_options, bench_epoll_wait_usage);
+
+	printf("Run summary [PID %d]: %d threads waiting on %d %s eventfds each, "
+	       "%s epoll instance%s, for %d secs.\n\n",
+	       getpid(), nthreads, nfds, edge ? "edge-triggered" : "level-triggered",
+	       shared ? "one shared" : "per-thread", shared ? "" : "s", nsecs);
+
+	worker = setup_workers(true);
+	run_workers(worker, wait_workerfn, &writer);
+	print_summary(worker, EPOLL_OP_WAIT, "epoll_wait");
+	free_workers(worker);
+
+	return 0;
+}
+
+int bench_epoll_ctl(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	struct worker *worker;
+	int op;
+
+	setup_common(argc, argv, ctl_options, bench_epoll_ctl_usage);
+
+	printf("Run summary [PID %d]: %d threads doing epoll_ctl() on %d fds each, "
+	       "%s epoll instance%s, for %d secs.\n\n",
+	       getpid(), nthreads, nfds, per_thread ? "per-thread" : "one shared",
+	       per_thread ? "s" : "", nsecs);
+
+	worker = setup_workers(false);
+	run_workers(worker, ctl_workerfn, NULL);
+	for (op = EPOLL_OP_ADD; op < EPOLL_NR_OPS; op++) {
+		print_summary(worker, op, ctl_op_names[op]);
+		printf("\n");
+	}
+	free_workers(worker);
+
+	return 0;
+}
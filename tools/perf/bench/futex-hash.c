@@ -20,12 +20,20 @@
 #include <stdlib.h>
 #include <sys/time.h>
 #include <pthread.h>
+#include <sys/prctl.h>
+
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH		45
+#define PR_FUTEX_HASH_ENABLE	1
+#define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
 
 static unsigned int nthreads = 0;
 static unsigned int nsecs    = 10;
 /* amount of futexes per thread */
 static unsigned int nfutexes = 1024;
 static bool fshared = false, done = false, silent = false;
+static bool private_hash = false;
 static int futex_flag = 0;
 
 struct timeval start, end, runtime;
@@ -47,6 +55,7 @@ static const struct option options[] = {
 	OPT_UINTEGER('f', "futexes", &nfutexes, "Specify amount of futexes per threads"),
 	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &fshared,  "Use shared futexes instead of private ones"),
+	OPT_BOOLEAN( 'P', "private-hash", &private_hash, "Hash private futexes in a per-process table"),
 	OPT_END()
 };
 
@@ -138,8 +147,17 @@ int bench_futex_hash(int argc, const char **argv,
 	if (!fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
-	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
+	/* has to happen before any thread is created */
+	if (private_hash &&
+	    prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_ENABLE, nthreads, 0, 0))
+		err(EXIT_FAILURE, "prctl(PR_FUTEX_HASH)");
+
+	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n",
 	       getpid(), nthreads, nfutexes, fshared ? "shared":"private", nsecs);
+	if (private_hash)
+		printf("Private futex hash: %d buckets.\n",
+		       prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0));
+	printf("\n");
 
 	init_stats(&throughput_stats);
 	pthread_mutex_init(&thread_lock, NULL);
@@ -0,0 +1,118 @@
+/*
+ * Log2 latency histograms for the I/O benchmarks.
+ *
+ * Bucket i counts samples in [2^i, 2^(i+1)) nanoseconds, which is
+ * precise enough to tell a syscall from a context switch from a disk
+ * seek and cheap enough to update from every worker thread.  Each
+ * thread keeps its own histogram and they are merged at the end.
+ */
+
+#ifndef _BENCH_HIST_H
+#define _BENCH_HIST_H
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <linux/types.h>
+
+#define LAT_HIST_BUCKETS	40
+#define LAT_HIST_BAR		40
+
+struct lat_hist {
+	u64	buckets[LAT_HIST_BUCKETS];
+	u64	nr;
+	u64	sum;
+};
+
+static inline u64 bench__now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void lat_hist__init(struct lat_hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+static inline void lat_hist__add(struct lat_hist *h, u64 ns)
+{
+	int i = ns ? 63 - __builtin_clzll(ns) : 0;
+
+	if (i >= LAT_HIST_BUCKETS)
+		i = LAT_HIST_BUCKETS - 1;
+
+	h->buckets[i]++;
+	h->nr++;
+	h->sum += ns;
+}
+
+static inline void lat_hist__merge(struct lat_hist *to, struct lat_hist *from)
+{
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		to->buckets[i] += from->buckets[i];
+	to->nr += from->nr;
+	to->sum += from->sum;
+}
+
+/* Upper bound of the bucket holding the given percentile, in ns */
+static inline u64 lat_hist__percentile(struct lat_hist *h, double pct)
+{
+	u64 want = h->nr * pct / 100.0, seen = 0;
+	int i;
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen > want)
+			break;
+	}
+
+	return 2ULL << (i < LAT_HIST_BUCKETS ? i : LAT_HIST_BUCKETS - 1);
+}
+
+static inline void lat_hist__fprintf(struct lat_hist *h, const char *what,
+				     FILE *fp)
+{
+	u64 max = 0;
+	int i, first = -1, last = -1;
+
+	if (!h->nr) {
+		fprintf(fp, "%s: no samples\n", what);
+		return;
+	}
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		if (first < 0)
+			first = i;
+		last = i;
+		if (h->buckets[i] > max)
+			max = h->buckets[i];
+	}
+
+	fprintf(fp, "%s latency (usecs), %" PRIu64 " samples, avg %.3f:\n",
+		what, h->nr, (double)h->sum / h->nr / 1e3);
+
+	for (i = first; i <= last; i++) {
+		int bar = h->buckets[i] * LAT_HIST_BAR / max;
+
+		fprintf(fp, " %12.3f -> %-12.3f : %10" PRIu64 " |%-*.*s|\n",
+			(double)(1ULL << i) / 1e3, (double)(2ULL << i) / 1e3,
+			h->buckets[i], LAT_HIST_BAR, bar,
+			"########################################");
+	}
+
+	fprintf(fp, " p50 < %.3f  p90 < %.3f  p99 < %.3f  p99.9 < %.3f usecs\n",
+		lat_hist__percentile(h, 50) / 1e3,
+		lat_hist__percentile(h, 90) / 1e3,
+		lat_hist__percentile(h, 99) / 1e3,
+		lat_hist__percentile(h, 99.9) / 1e3);
+}
+
+#endif /* _BENCH_HIST_H */
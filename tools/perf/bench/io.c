@@ -0,0 +1,455 @@
+/*
+ * io: Benchmark direct I/O against a file or block device.
+ *
+ * io direct: nthreads workers issue synchronous O_DIRECT pread()/pwrite()
+ * calls of blksize bytes, timing every call.
+ *
+ * io aio: nthreads workers each keep depth O_DIRECT requests in flight with
+ * native Linux AIO (io_submit()/io_getevents()), timing every request from
+ * submission to completion.
+ *
+ * Without --file a scratch file is created in the current directory and
+ * removed afterwards.  Writes are only done when asked for with --write,
+ * and they overwrite whatever the target holds.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "hist.h"
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/posix_types.h>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+#include <pthread.h>
+
+static const char *filename;
+static unsigned int nthreads = 1;
+static unsigned int nsecs    = 8;
+static unsigned int blksize  = 4096;
+static unsigned int depth    = 32;
+static unsigned int size_mb  = 256;
+static bool done = false, silent = false, do_write = false, sequential = false;
+
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static pthread_cond_t thread_parent, thread_worker;
+static struct timeval start, end, runtime;
+static struct stats throughput_stats;
+static u64 nblocks;
+
+struct worker {
+	int		tid;
+	int		fd;
+	pthread_t	thread;
+	unsigned int	seed;
+	u64		next;
+	unsigned long	ops;
+	struct lat_hist	hist;
+};
+
+static const struct option options[] = {
+	OPT_STRING(  'f', "file",       &filename,   "path", "Specify file or block device (default: scratch file)"),
+	OPT_UINTEGER('z', "size",       &size_mb,    "Specify scratch file size (in MB)"),
+	OPT_UINTEGER('t', "threads",    &nthreads,   "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime",    &nsecs,      "Specify runtime (in seconds)"),
+	OPT_UINTEGER('b', "blksize",    &blksize,    "Specify I/O size (in bytes)"),
+	OPT_UINTEGER('d', "depth",      &depth,      "Specify requests in flight per thread (aio)"),
+	OPT_BOOLEAN( 'w', "write",      &do_write,   "Write instead of read (destroys the target's data)"),
+	OPT_BOOLEAN( 'S', "sequential", &sequential, "Sequential instead of random offsets"),
+	OPT_BOOLEAN( 's', "silent",     &silent,     "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_io_direct_usage[] = {
+	"perf bench io direct <options>",
+	NULL
+};
+
+static const char * const bench_io_aio_usage[] = {
+	"perf bench io aio <options>",
+	NULL
+};
+
+static inline int io_setup(unsigned nr, aio_context_t *ctxp)
+{
+	return syscall(__NR_io_setup, nr, ctxp);
+}
+
+static inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+static inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+static inline int io_getevents(aio_context_t ctx, long min_nr, long max_nr,
+			       struct io_event *events, struct timespec *timeout)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, max_nr, events, timeout);
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void worker_wait_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static u64 next_offset(struct worker *w)
+{
+	u64 blk;
+
+	if (sequential) {
+		blk = w->next++;
+		if (w->next == nblocks)
+			w->next = 0;
+	} else {
+		blk = (((u64)rand_r(&w->seed) << 31) | rand_r(&w->seed)) % nblocks;
+	}
+
+	return blk * blksize;
+}
+
+static void *alloc_buf(size_t size)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, 4096, size))
+		err(EXIT_FAILURE, "posix_memalign");
+
+	memset(buf, 0xa5, size);
+	return buf;
+}
+
+static void *direct_workerfn(void *arg)
+{
+	struct worker *w = arg;
+	void *buf = alloc_buf(blksize);
+
+	worker_wait_start();
+
+	while (!done) {
+		u64 off = next_offset(w), t0 = bench__now_ns();
+		ssize_t ret;
+
+		if (do_write)
+			ret = pwrite(w->fd, buf, blksize, off);
+		else
+			ret = pread(w->fd, buf, blksize, off);
+
+		if (ret != (ssize_t)blksize) {
+			if (ret < 0 && errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, do_write ? "pwrite" : "pread");
+		}
+
+		lat_hist__add(&w->hist, bench__now_ns() - t0);
+		w->ops++;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void aio_prep(struct worker *w, struct iocb *iocb, u64 *stamp)
+{
+	iocb->aio_lio_opcode = do_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	iocb->aio_offset = next_offset(w);
+	*stamp = bench__now_ns();
+}
+
+static void *aio_workerfn(void *arg)
+{
+	struct worker *w = arg;
+	struct timespec timeout = { .tv_sec = 0, .tv_nsec = 100000000, };
+	aio_context_t ctx = 0;
+	struct iocb *iocbs, **iocbpp;
+	struct io_event *events;
+	unsigned int i, inflight;
+	char *bufs;
+	u64 *stamps;
+
+	if (io_setup(depth, &ctx))
+		err(EXIT_FAILURE, "io_setup");
+
+	bufs = alloc_buf((size_t)depth * blksize);
+	iocbs = calloc(depth, sizeof(*iocbs));
+	iocbpp = calloc(depth, sizeof(*iocbpp));
+	events = calloc(depth, sizeof(*events));
+	stamps = calloc(depth, sizeof(*stamps));
+	if (!iocbs || !iocbpp || !events || !stamps)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < depth; i++) {
+		iocbs[i].aio_fildes = w->fd;
+		iocbs[i].aio_buf = (unsigned long)(bufs + (size_t)i * blksize);
+		iocbs[i].aio_nbytes = blksize;
+		iocbs[i].aio_data = i;
+		iocbpp[i] = &iocbs[i];
+	}
+
+	worker_wait_start();
+
+	for (i = 0; i < depth; i++)
+		aio_prep(w, &iocbs[i], &stamps[i]);
+	if (io_submit(ctx, depth, iocbpp) != (int)depth)
+		err(EXIT_FAILURE, "io_submit");
+	inflight = depth;
+
+	while (inflight) {
+		int n, nr = 0;
+
+		n = io_getevents(ctx, 1, depth, events, &timeout);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, "io_getevents");
+		}
+
+		for (i = 0; i < (unsigned int)n; i++) {
+			unsigned int idx = events[i].data;
+
+			if (events[i].res != (__s64)blksize) {
+				errno = events[i].res < 0 ? -events[i].res : EIO;
+				err(EXIT_FAILURE, "aio %s", do_write ? "write" : "read");
+			}
+
+			lat_hist__add(&w->hist, bench__now_ns() - stamps[idx]);
+			w->ops++;
+			inflight--;
+
+			/* once done, just reap what is still in flight */
+			if (!done) {
+				aio_prep(w, &iocbs[idx], &stamps[idx]);
+				iocbpp[nr++] = &iocbs[idx];
+			}
+		}
+
+		if (nr) {
+			if (io_submit(ctx, nr, iocbpp) != nr)
+				err(EXIT_FAILURE, "io_submit");
+			inflight += nr;
+		}
+	}
+
+	io_destroy(ctx);
+	free(stamps);
+	free(events);
+	free(iocbpp);
+	free(iocbs);
+	free(bufs);
+	return NULL;
+}
+
+/* Fill a scratch file so that reads hit allocated blocks */
+static int create_scratch(char *path)
+{
+	size_t chunk = 1024 * 1024;
+	void *buf = alloc_buf(chunk);
+	unsigned int i;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		err(EXIT_FAILURE, "mkstemp");
+
+	printf("Creating %d MB scratch file %s ...\n", size_mb, path);
+
+	for (i = 0; i < size_mb; i++) {
+		if (write(fd, buf, chunk) != (ssize_t)chunk)
+			err(EXIT_FAILURE, "write");
+	}
+
+	if (fsync(fd))
+		err(EXIT_FAILURE, "fsync");
+
+	free(buf);
+	return fd;
+}
+
+static u64 target_size(int fd)
+{
+	struct stat st;
+	u64 size;
+
+	if (fstat(fd, &st))
+		err(EXIT_FAILURE, "fstat");
+
+	if (!S_ISBLK(st.st_mode))
+		return st.st_size;
+
+	if (ioctl(fd, BLKGETSIZE64, &size))
+		err(EXIT_FAILURE, "ioctl(BLKGETSIZE64)");
+
+	return size;
+}
+
+static void print_summary(struct worker *worker)
+{
+	struct lat_hist hist;
+	unsigned long avg;
+	double stddev, secs, iops = 0;
+	unsigned int i;
+
+	secs = runtime.tv_sec + runtime.tv_usec / 1e6;
+
+	init_stats(&throughput_stats);
+	lat_hist__init(&hist);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = worker[i].ops / secs;
+
+		update_stats(&throughput_stats, t);
+		lat_hist__merge(&hist, &worker[i].hist);
+		iops += t;
+
+		if (!silent)
+			printf("[thread %2d] %ld IOPS, %.2f MB/sec\n",
+			       worker[i].tid, t, (double)t * blksize / (1024 * 1024));
+	}
+
+	avg = avg_stats(&throughput_stats);
+	stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld IOPS per thread (+- %.2f%%), total %.0f IOPS, "
+	       "%.2f MB/sec, total secs = %.2f\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       iops, iops * blksize / (1024 * 1024), secs);
+	lat_hist__fprintf(&hist, do_write ? "write" : "read", stdout);
+}
+
+static int bench_io(int argc, const char **argv, bool aio,
+		    const char * const *usage)
+{
+	char scratch[] = "perf-bench-io.XXXXXX";
+	struct sigaction act;
+	struct worker *worker;
+	unsigned int i;
+	int fd;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc || !blksize || blksize % 512 || !depth) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	act.sa_flags = 0;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!filename) {
+		close(create_scratch(scratch));
+		filename = scratch;
+	}
+
+	fd = open(filename, (do_write ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		err(EXIT_FAILURE, "open %s with O_DIRECT", filename);
+
+	nblocks = target_size(fd) / blksize;
+	if (!nblocks)
+		errx(EXIT_FAILURE, "%s is smaller than %d bytes", filename, blksize);
+
+	printf("Run summary [PID %d]: %d threads doing %s %d byte O_DIRECT %ss",
+	       getpid(), nthreads, sequential ? "sequential" : "random",
+	       blksize, do_write ? "write" : "read");
+	if (aio)
+		printf(", %d in flight per thread (aio)", depth);
+	printf(" on %s (%" PRIu64 " MB), for %d secs.\n\n",
+	       filename, nblocks * blksize >> 20, nsecs);
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		err(EXIT_FAILURE, "calloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		struct worker *w = &worker[i];
+
+		w->tid = i;
+		w->fd = fd;
+		w->seed = getpid() ^ i;
+		/* spread sequential streams over the target */
+		w->next = nblocks / nthreads * i;
+		lat_hist__init(&w->hist);
+
+		if (pthread_create(&w->thread, NULL,
+				   aio ? aio_workerfn : direct_workerfn, w))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(worker[i].thread, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	print_summary(worker);
+
+	close(fd);
+	if (filename == scratch)
+		unlink(scratch);
+	free(worker);
+
+	return 0;
+}
+
+int bench_io_direct(int argc, const char **argv,
+		    const char *prefix __maybe_unused)
+{
+	return bench_io(argc, argv, false, bench_io_direct_usage);
+}
+
+int bench_io_aio(int argc, const char **argv,
+		 const char *prefix __maybe_unused)
+{
+	return bench_io(argc, argv, true, bench_io_aio_usage);
+}
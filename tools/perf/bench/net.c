@@ -0,0 +1,428 @@
+/*
+ * net: Benchmark loopback TCP and UDP socket hot paths.
+ *
+ * net rr: nconns client threads each ping-pong a message of msgsize bytes
+ * with their own server thread over a loopback connection, timing every
+ * round trip.
+ *
+ * net stream: nconns client threads each send msgsize byte messages to
+ * their own server thread as fast as possible, timing every send() call
+ * and reporting the rate seen by the receivers.
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/stat.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "hist.h"
+
+#include <err.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+
+static unsigned int nconns  = 0;
+static unsigned int nsecs   = 8;
+static unsigned int msgsize = 0;
+static bool done = false, silent = false, udp = false;
+
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static pthread_cond_t thread_parent, thread_worker;
+static struct timeval start, end, runtime;
+static struct stats throughput_stats;
+
+struct conn {
+	int		id;
+	int		cfd, sfd;
+	pthread_t	client, server;
+	unsigned long	ops;
+	u64		bytes;
+	struct lat_hist	hist;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('c', "connections", &nconns,  "Specify amount of connections"),
+	OPT_UINTEGER('r', "runtime",     &nsecs,   "Specify runtime (in seconds)"),
+	OPT_UINTEGER('m', "msgsize",     &msgsize, "Specify message size (in bytes)"),
+	OPT_BOOLEAN( 'u', "udp",         &udp,     "Use UDP instead of TCP"),
+	OPT_BOOLEAN( 's', "silent",      &silent,  "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_net_rr_usage[] = {
+	"perf bench net rr <options>",
+	NULL
+};
+
+static const char * const bench_net_stream_usage[] = {
+	"perf bench net stream <options>",
+	NULL
+};
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &runtime);
+}
+
+static void worker_wait_start(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+/*
+ * Move size bytes (one datagram for UDP), retrying short transfers.
+ * Sockets have a receive/send timeout so that this notices the end of
+ * the run.  Returns -1 once done.
+ */
+static int xfer(int fd, char *buf, size_t size, bool tx)
+{
+	size_t pos = 0;
+
+	while (pos < size) {
+		ssize_t ret = tx ? send(fd, buf + pos, size - pos, MSG_NOSIGNAL) :
+				   recv(fd, buf + pos, size - pos, 0);
+
+		if (done)
+			return -1;
+
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == EINTR)
+				continue;
+			/* the peer went away at the end of the run */
+			if (errno == ECONNRESET || errno == EPIPE ||
+			    errno == ECONNREFUSED)
+				return -1;
+			err(EXIT_FAILURE, tx ? "send" : "recv");
+		}
+
+		if (!ret && !tx)
+			return -1;
+
+		if (udp)
+			break;
+		pos += ret;
+	}
+
+	return 0;
+}
+
+static void *rr_clientfn(void *arg)
+{
+	struct conn *c = arg;
+	char *buf = malloc(msgsize);
+
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+
+	worker_wait_start();
+
+	while (!done) {
+		u64 t0 = bench__now_ns();
+
+		if (xfer(c->cfd, buf, msgsize, true) ||
+		    xfer(c->cfd, buf, msgsize, false))
+			break;
+
+		lat_hist__add(&c->hist, bench__now_ns() - t0);
+		c->ops++;
+		c->bytes += msgsize;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *rr_serverfn(void *arg)
+{
+	struct conn *c = arg;
+	char *buf = malloc(msgsize);
+
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+
+	worker_wait_start();
+
+	while (!done) {
+		if (xfer(c->sfd, buf, msgsize, false) ||
+		    xfer(c->sfd, buf, msgsize, true))
+			break;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *stream_clientfn(void *arg)
+{
+	struct conn *c = arg;
+	char *buf = calloc(1, msgsize);
+
+	if (!buf)
+		err(EXIT_FAILURE, "calloc");
+
+	worker_wait_start();
+
+	while (!done) {
+		u64 t0 = bench__now_ns();
+
+		if (xfer(c->cfd, buf, msgsize, true))
+			break;
+
+		lat_hist__add(&c->hist, bench__now_ns() - t0);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *stream_serverfn(void *arg)
+{
+	struct conn *c = arg;
+	char *buf = malloc(msgsize);
+
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+
+	worker_wait_start();
+
+	while (!done) {
+		ssize_t ret = recv(c->sfd, buf, msgsize, 0);
+
+		if (ret > 0) {
+			c->ops++;
+			c->bytes += ret;
+		} else if (!ret) {
+			break;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			   errno != EINTR) {
+			err(EXIT_FAILURE, "recv");
+		}
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void set_timeout(int fd)
+{
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000, };
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) ||
+	    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)))
+		err(EXIT_FAILURE, "setsockopt");
+}
+
+static int bound_socket(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if (fd < 0)
+		err(EXIT_FAILURE, "socket");
+
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr->sin_port = 0;
+
+	if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) ||
+	    getsockname(fd, (struct sockaddr *)addr, &len))
+		err(EXIT_FAILURE, "bind");
+
+	return fd;
+}
+
+static void setup_conn(struct conn *c, int lfd, struct sockaddr_in *laddr,
+		       bool rr)
+{
+	struct sockaddr_in caddr;
+	int one = 1;
+
+	if (udp) {
+		c->sfd = bound_socket(laddr);
+		c->cfd = bound_socket(&caddr);
+
+		if (connect(c->cfd, (struct sockaddr *)laddr, sizeof(*laddr)) ||
+		    connect(c->sfd, (struct sockaddr *)&caddr, sizeof(caddr)))
+			err(EXIT_FAILURE, "connect");
+	} else {
+		c->cfd = socket(AF_INET, SOCK_STREAM, 0);
+		if (c->cfd < 0)
+			err(EXIT_FAILURE, "socket");
+
+		if (connect(c->cfd, (struct sockaddr *)laddr, sizeof(*laddr)))
+			err(EXIT_FAILURE, "connect");
+
+		c->sfd = accept(lfd, NULL, NULL);
+		if (c->sfd < 0)
+			err(EXIT_FAILURE, "accept");
+
+		if (rr &&
+		    (setsockopt(c->cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ||
+		     setsockopt(c->sfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one))))
+			err(EXIT_FAILURE, "setsockopt");
+	}
+
+	set_timeout(c->cfd);
+	set_timeout(c->sfd);
+	lat_hist__init(&c->hist);
+}
+
+static void print_summary(struct conn *conns, bool rr)
+{
+	struct lat_hist hist;
+	unsigned long avg;
+	double stddev, secs, mbytes = 0;
+	unsigned int i;
+
+	secs = runtime.tv_sec + runtime.tv_usec / 1e6;
+
+	init_stats(&throughput_stats);
+	lat_hist__init(&hist);
+
+	for (i = 0; i < nconns; i++) {
+		struct conn *c = &conns[i];
+		unsigned long t = c->ops / secs;
+		double mb = c->bytes / secs / (1024 * 1024);
+
+		update_stats(&throughput_stats, t);
+		lat_hist__merge(&hist, &c->hist);
+		mbytes += mb;
+
+		if (!silent)
+			printf("[conn %3d] %ld %s/sec, %.2f MB/sec\n",
+			       c->id, t, rr ? "transactions" : "messages", mb);
+	}
+
+	avg = avg_stats(&throughput_stats);
+	stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld %s/sec per connection (+- %.2f%%), "
+	       "total %.2f MB/sec, total secs = %.2f\n",
+	       !silent ? "\n" : "", avg, rr ? "transactions" : "messages",
+	       rel_stddev_stats(stddev, avg), mbytes, secs);
+	lat_hist__fprintf(&hist, rr ? "round trip" : "send()", stdout);
+}
+
+static int bench_net(int argc, const char **argv, bool rr,
+		     const char * const *usage)
+{
+	struct sockaddr_in laddr;
+	struct sigaction act;
+	struct conn *conns;
+	int lfd = -1;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc) {
+		usage_with_options(usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	act.sa_flags = 0;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nconns) /* default to the number of CPUs */
+		nconns = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!msgsize)
+		msgsize = rr ? 64 : 16384;
+	if (udp && msgsize > 65507)
+		msgsize = 65507;
+
+	printf("Run summary [PID %d]: %d %s connections over loopback, "
+	       "%d byte messages, for %d secs.\n\n",
+	       getpid(), nconns, udp ? "UDP" : "TCP", msgsize, nsecs);
+
+	conns = calloc(nconns, sizeof(*conns));
+	if (!conns)
+		err(EXIT_FAILURE, "calloc");
+
+	if (!udp) {
+		lfd = bound_socket(&laddr);
+		if (listen(lfd, nconns))
+			err(EXIT_FAILURE, "listen");
+	}
+
+	for (i = 0; i < nconns; i++) {
+		conns[i].id = i;
+		setup_conn(&conns[i], lfd, &laddr, rr);
+	}
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = 2 * nconns;
+	for (i = 0; i < nconns; i++) {
+		if (pthread_create(&conns[i].server, NULL,
+				   rr ? rr_serverfn : stream_serverfn, &conns[i]) ||
+		    pthread_create(&conns[i].client, NULL,
+				   rr ? rr_clientfn : stream_clientfn, &conns[i]))
+			err(EXIT_FAILURE, "pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	gettimeofday(&start, NULL);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nconns; i++) {
+		if (pthread_join(conns[i].client, NULL) ||
+		    pthread_join(conns[i].server, NULL))
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	print_summary(conns, rr);
+
+	for (i = 0; i < nconns; i++) {
+		close(conns[i].cfd);
+		close(conns[i].sfd);
+	}
+	if (lfd >= 0)
+		close(lfd);
+	free(conns);
+
+	return 0;
+}
+
+int bench_net_rr(int argc, const char **argv,
+		 const char *prefix __maybe_unused)
+{
+	return bench_net(argc, argv, true, bench_net_rr_usage);
+}
+
+int bench_net_stream(int argc, const char **argv,
+		     const char *prefix __maybe_unused)
+{
+	return bench_net(argc, argv, false, bench_net_stream_usage);
+}
@@ -13,6 +13,9 @@
  *  mem   ... memory access performance
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
+ *  epoll ... epoll performance
+ *  net   ... Loopback networking performance
+ *  io    ... Direct and asynchronous I/O performance
  */
 #include "perf.h"
 #include "util/util.h"
@@ -63,6 +66,27 @@ static struct bench futex_benchmarks[] = {
 	{ NULL,		NULL,						NULL			}
 };
 
+static struct bench epoll_benchmarks[] = {
+	{ "wait",	"Benchmark for epoll_wait() with many fds",	bench_epoll_wait	},
+	{ "ctl",	"Benchmark for epoll_ctl() add/mod/del",	bench_epoll_ctl		},
+	{ "all",	"Test all epoll benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench net_benchmarks[] = {
+	{ "rr",		"Benchmark for request-response over loopback",	bench_net_rr		},
+	{ "stream",	"Benchmark for streaming over loopback",	bench_net_stream	},
+	{ "all",	"Test all network benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench io_benchmarks[] = {
+	{ "direct",	"Benchmark for synchronous O_DIRECT I/O",	bench_io_direct		},
+	{ "aio",	"Benchmark for native AIO with O_DIRECT",	bench_io_aio		},
+	{ "all",	"Test all I/O benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 struct collection {
 	const char	*name;
 	const char	*summary;
@@ -76,6 +100,9 @@ static struct collection collections[] = {
 	{ "numa",	"NUMA scheduling and MM benchmarks",		numa_benchmarks		},
 #endif
 	{"futex",       "Futex stressing benchmarks",                   futex_benchmarks        },
+	{ "epoll",	"epoll stressing benchmarks",			epoll_benchmarks	},
+	{ "net",	"Loopback networking benchmarks",		net_benchmarks		},
+	{ "io",		"Direct and asynchronous I/O benchmarks",	io_benchmarks		},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
 };
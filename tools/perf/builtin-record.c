@@ -30,8 +30,16 @@
 
 #include <unistd.h>
 #include <sched.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
+struct record;
+
+struct record_thread {
+	struct record		*rec;
+	pthread_t		thread;
+	unsigned int		idx;
+};
 
 struct record {
 	struct perf_tool	tool;
@@ -45,6 +53,14 @@ struct record {
 	bool			no_buildid;
 	bool			no_buildid_cache;
 	long			samples;
+	unsigned int		nr_threads;
+	struct record_thread	*threads;
+	pthread_barrier_t	start_barrier;
+	pthread_barrier_t	done_barrier;
+	pthread_mutex_t		write_lock;
+	off_t			write_off;
+	bool			threads_exit;
+	int			threads_err;
 };
 
 static int record__write(struct record *rec, void *bf, size_t size)
@@ -110,6 +126,174 @@ out:
 	return rc;
 }
 
+static int record__pwrite(struct record *rec, void *bf, size_t size, off_t off)
+{
+	while (size) {
+		ssize_t ret = pwrite(rec->file.fd, bf, size, off);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			pr_err("failed to write perf data, error: %m\n");
+			return -1;
+		}
+
+		bf += ret;
+		size -= ret;
+		off += ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Same as record__mmap_read() but safe to be called concurrently for
+ * different mmaps: the file range is reserved under write_lock and
+ * then written with pwrite().  Both parts of a wrapped buffer go into
+ * one contiguous range, as an event may straddle the wrap point.
+ */
+static int record__mmap_read_pwrite(struct record *rec, int idx)
+{
+	struct perf_mmap *md = &rec->evlist->mmap[idx];
+	unsigned int head = perf_mmap__read_head(md);
+	unsigned int old = md->prev;
+	unsigned char *data = md->base + page_size;
+	unsigned long size, total;
+	off_t off;
+	void *buf;
+
+	if (old == head)
+		return 0;
+
+	total = head - old;
+
+	pthread_mutex_lock(&rec->write_lock);
+	off = rec->write_off;
+	rec->write_off += total;
+	rec->bytes_written += total;
+	rec->samples++;
+	pthread_mutex_unlock(&rec->write_lock);
+
+	size = total;
+
+	if ((old & md->mask) + size != (head & md->mask)) {
+		buf = &data[old & md->mask];
+		size = md->mask + 1 - (old & md->mask);
+		old += size;
+
+		if (record__pwrite(rec, buf, size, off) < 0)
+			return -1;
+		off += size;
+	}
+
+	buf = &data[old & md->mask];
+	size = head - old;
+	old += size;
+
+	if (record__pwrite(rec, buf, size, off) < 0)
+		return -1;
+
+	md->prev = old;
+	perf_evlist__mmap_consume(rec->evlist, idx);
+	return 0;
+}
+
+static void record__thread_drain(struct record *rec, unsigned int idx)
+{
+	int i;
+
+	for (i = idx; i < rec->evlist->nr_mmaps; i += rec->nr_threads) {
+		if (rec->evlist->mmap[i].base &&
+		    record__mmap_read_pwrite(rec, i) < 0)
+			rec->threads_err = -1;
+	}
+}
+
+static void *record__thread(void *arg)
+{
+	struct record_thread *th = arg;
+	struct record *rec = th->rec;
+
+	/* wait for record__threads_start() to settle nr_threads */
+	pthread_mutex_lock(&rec->write_lock);
+	pthread_mutex_unlock(&rec->write_lock);
+
+	for (;;) {
+		pthread_barrier_wait(&rec->start_barrier);
+		if (rec->threads_exit)
+			break;
+
+		record__thread_drain(rec, th->idx);
+		pthread_barrier_wait(&rec->done_barrier);
+	}
+
+	return NULL;
+}
+
+/*
+ * With --threads the mmaps are split between the main thread (index 0)
+ * and nr_threads - 1 helpers, each draining every nr_threads-th mmap.
+ * All of them take part in one pass over the buffers, so the
+ * PERF_RECORD_FINISHED_ROUND written after the pass still orders the
+ * events the same way as in the single threaded case.
+ */
+static int record__threads_start(struct record *rec)
+{
+	unsigned int i;
+
+	if (rec->nr_threads > (unsigned int)rec->evlist->nr_mmaps)
+		rec->nr_threads = rec->evlist->nr_mmaps;
+
+	if (rec->nr_threads <= 1 || rec->file.is_pipe) {
+		rec->nr_threads = 0;
+		return 0;
+	}
+
+	rec->threads = calloc(rec->nr_threads, sizeof(*rec->threads));
+	if (rec->threads == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_init(&rec->write_lock, NULL);
+	pthread_mutex_lock(&rec->write_lock);
+
+	for (i = 1; i < rec->nr_threads; i++) {
+		struct record_thread *th = &rec->threads[i];
+
+		th->rec = rec;
+		th->idx = i;
+		if (pthread_create(&th->thread, NULL, record__thread, th)) {
+			pr_warning("failed to create record thread, using %u\n", i);
+			rec->nr_threads = i;
+			break;
+		}
+	}
+
+	pthread_barrier_init(&rec->start_barrier, NULL, rec->nr_threads);
+	pthread_barrier_init(&rec->done_barrier, NULL, rec->nr_threads);
+	pthread_mutex_unlock(&rec->write_lock);
+
+	return 0;
+}
+
+static void record__threads_stop(struct record *rec)
+{
+	unsigned int i;
+
+	if (rec->threads == NULL)
+		return;
+
+	rec->threads_exit = true;
+	pthread_barrier_wait(&rec->start_barrier);
+
+	for (i = 1; i < rec->nr_threads; i++)
+		pthread_join(rec->threads[i].thread, NULL);
+
+	pthread_barrier_destroy(&rec->start_barrier);
+	pthread_barrier_destroy(&rec->done_barrier);
+	pthread_mutex_destroy(&rec->write_lock);
+	zfree(&rec->threads);
+}
+
 static volatile int done = 0;
 static volatile int signr = -1;
 static volatile int child_finished = 0;
@@ -256,11 +440,28 @@ static int record__mmap_read_all(struct record *rec)
 	int i;
 	int rc = 0;
 
-	for (i = 0; i < rec->evlist->nr_mmaps; i++) {
-		if (rec->evlist->mmap[i].base) {
-			if (record__mmap_read(rec, i) != 0) {
-				rc = -1;
-				goto out;
+	if (rec->threads) {
+		int fd = rec->file.fd;
+
+		rec->write_off = lseek(fd, 0, SEEK_CUR);
+		rec->threads_err = 0;
+
+		pthread_barrier_wait(&rec->start_barrier);
+		record__thread_drain(rec, 0);
+		pthread_barrier_wait(&rec->done_barrier);
+
+		lseek(fd, rec->write_off, SEEK_SET);
+		if (rec->threads_err) {
+			rc = -1;
+			goto out;
+		}
+	} else {
+		for (i = 0; i < rec->evlist->nr_mmaps; i++) {
+			if (rec->evlist->mmap[i].base) {
+				if (record__mmap_read(rec, i) != 0) {
+					rc = -1;
+					goto out;
+				}
 			}
 		}
 	}
@@ -461,6 +662,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		perf_evlist__enable(rec->evlist);
 	}
 
+	err = record__threads_start(rec);
+	if (err < 0)
+		goto out_child;
+
 	for (;;) {
 		int hits = rec->samples;
 
@@ -518,6 +723,8 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	}
 
 out_child:
+	record__threads_stop(rec);
+
 	if (forks) {
 		int exit_status;
 
@@ -811,6 +1018,8 @@ struct option __record_options[] = {
 		    "sample transaction flags (special events only)"),
 	OPT_BOOLEAN(0, "per-thread", &record.opts.target.per_thread,
 		    "use per-thread mmaps"),
+	OPT_UINTEGER(0, "threads", &record.nr_threads,
+		     "number of threads used to drain the mmap buffers"),
 	OPT_BOOLEAN('I', "intr-regs", &record.opts.sample_intr_regs,
 		    "Sample machine registers on interrupt"),
 	OPT_END()
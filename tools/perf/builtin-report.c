@@ -37,6 +37,7 @@
 #include "arch/common.h"
 
 #include <dlfcn.h>
+#include <pthread.h>
 #include <linux/bitmap.h>
 
 struct report {
@@ -52,6 +53,7 @@ struct report {
 	bool			header;
 	bool			header_only;
 	int			max_stack;
+	int			nr_jobs;
 	struct perf_read_values	show_threads_values;
 	const char		*pretty_printing_style;
 	const char		*cpu_list;
@@ -470,6 +472,152 @@ static void report__output_resort(struct report *rep)
 	ui_progress__finish();
 }
 
+struct report_preload {
+	pthread_mutex_t		lock;
+	struct dso		**dsos;
+	symbol_filter_t		*filters;
+	int			nr;
+	int			next;
+};
+
+static void *report__preload_worker(void *arg)
+{
+	struct report_preload *pl = arg;
+
+	while (!session_done()) {
+		struct dso *dso;
+		struct map *map;
+		int idx;
+
+		pthread_mutex_lock(&pl->lock);
+		idx = pl->next++;
+		pthread_mutex_unlock(&pl->lock);
+
+		if (idx >= pl->nr)
+			break;
+
+		dso = pl->dsos[idx];
+		map = map__new2(0, dso, MAP__FUNCTION);
+		if (map == NULL)
+			continue;
+
+		/*
+		 * Leave failed loads to map__load() on the main thread, so
+		 * that the usual "continuing without symbols" warnings are
+		 * still printed for the DSOs that samples actually hit.
+		 */
+		if (dso__load(dso, map, pl->filters[idx]) <= 0)
+			dso->loaded &= ~(1 << MAP__FUNCTION);
+
+		map__delete(map);
+	}
+
+	return NULL;
+}
+
+static int report__preload_add(struct report_preload *pl,
+			       struct machine *machine, int *alloc)
+{
+	struct dso *dso;
+
+	list_for_each_entry(dso, &machine->user_dsos.head, node) {
+		if (!dso->has_build_id || dso__loaded(dso, MAP__FUNCTION))
+			continue;
+
+		if (pl->nr == *alloc) {
+			int nr = *alloc ? *alloc * 2 : 64;
+			struct dso **dsos;
+			symbol_filter_t *filters;
+
+			dsos = realloc(pl->dsos, nr * sizeof(*dsos));
+			if (dsos == NULL)
+				return -ENOMEM;
+			pl->dsos = dsos;
+
+			filters = realloc(pl->filters, nr * sizeof(*filters));
+			if (filters == NULL)
+				return -ENOMEM;
+			pl->filters = filters;
+
+			*alloc = nr;
+		}
+
+		pl->dsos[pl->nr] = dso;
+		pl->filters[pl->nr] = machine->symbol_filter;
+		pl->nr++;
+	}
+
+	return 0;
+}
+
+/*
+ * Symbol table loading (ELF parsing and demangling) is what dominates
+ * report time on large profiles, and it is done lazily, one DSO at a
+ * time, from the sample processing loop.  The build-id table in the
+ * header tells us upfront which user space DSOs were hit, so load their
+ * symbols from a pool of threads before processing samples.  Every DSO
+ * is handed to exactly one worker and the main thread does not touch the
+ * DSO lists until all workers are joined, so no extra locking is needed
+ * in the symbol code.  Kernel DSOs are left alone as loading them
+ * modifies the machine's kernel maps.
+ */
+static void report__preload_symbols(struct report *rep)
+{
+	struct machines *machines = &rep->session->machines;
+	struct report_preload pl = { .nr = 0, };
+	pthread_t *threads;
+	struct rb_node *nd;
+	int i, nr_threads, alloc = 0;
+
+	nr_threads = rep->nr_jobs;
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads <= 1)
+		return;
+
+	if (report__preload_add(&pl, &machines->host, &alloc) < 0)
+		goto out_free;
+
+	for (nd = rb_first(&machines->guests); nd; nd = rb_next(nd)) {
+		struct machine *machine = rb_entry(nd, struct machine, rb_node);
+
+		if (report__preload_add(&pl, machine, &alloc) < 0)
+			goto out_free;
+	}
+
+	if (pl.nr < 2)
+		goto out_free;
+
+	if (nr_threads > pl.nr)
+		nr_threads = pl.nr;
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (threads == NULL)
+		goto out_free;
+
+	pthread_mutex_init(&pl.lock, NULL);
+
+	pr_debug("loading symbols of %d DSOs using %d threads\n",
+		 pl.nr, nr_threads);
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL,
+				   report__preload_worker, &pl))
+			break;
+	}
+
+	/* Whatever is left over gets loaded on demand */
+	nr_threads = i;
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&pl.lock);
+	free(threads);
+out_free:
+	free(pl.dsos);
+	free(pl.filters);
+}
+
 static int __cmd_report(struct report *rep)
 {
 	int ret;
@@ -493,6 +641,9 @@ static int __cmd_report(struct report *rep)
 	if (ret)
 		return ret;
 
+	if (!dump_trace)
+		report__preload_symbols(rep);
+
 	ret = perf_session__process_events(session, &rep->tool);
 	if (ret)
 		return ret;
@@ -624,6 +775,8 @@ int cmd_report(int argc, const char **argv, const char *prefix __maybe_unused)
 	const struct option options[] = {
 	OPT_STRING('i', "input", &input_name, "file",
 		    "input file name"),
+	OPT_INTEGER('j', "jobs", &report.nr_jobs,
+		    "number of threads used to load symbols (default: number of online CPUs)"),
 	OPT_INCR('v', "verbose", &verbose,
 		    "be more verbose (show symbol address, etc)"),
 	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
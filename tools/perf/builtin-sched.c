@@ -98,6 +98,27 @@ struct work_atoms {
 
 typedef int (*sort_fn_t)(struct work_atoms *, struct work_atoms *);
 
+/* per-thread state of the timehist command, hung off thread->priv */
+struct thread_runtime {
+	u64			last_time;	/* last sched in or out */
+	u64			ready_to_run;	/* woken up or preempted */
+	u64			dt_wait;
+	u64			dt_delay;
+	bool			running;
+	u64			nr_runs;
+	u64			total_run_time;
+	u64			total_delay_time;
+	u64			max_delay;
+	u64			max_delay_at;
+};
+
+struct timehist_cpu {
+	u64			last_switch;
+	u64			idle_time;
+	u64			busy_time;
+	u64			nr_switches;
+};
+
 struct perf_sched;
 
 struct trace_sched_handler {
@@ -169,6 +190,13 @@ struct perf_sched {
 	u64		 cpu_last_switched[MAX_CPUS];
 	struct rb_root	 atom_root, sorted_atom_root;
 	struct list_head sort_list, cmp_pid;
+	/* timehist */
+	struct timehist_cpu *hcpu;
+	bool		 summary;
+	bool		 summary_only;
+	bool		 show_callchain;
+	bool		 show_wakeups;
+	unsigned int	 max_stack;
 };
 
 static u64 get_nsecs(void)
@@ -1254,6 +1282,310 @@ static void perf_sched__sort_lat(struct perf_sched *sched)
 	}
 }
 
+/*
+ * timehist: print wait time, scheduling delay and run time for every
+ * sched_switch.  Only sched_switch and sched_wakeup{,_new} are used, as
+ * those are the tracepoints both CFS and BFS emit (BFS has no
+ * sched_stat_* events), and BFS picks tasks from a global runqueue so
+ * all state is kept per task rather than per runqueue.
+ */
+
+/* bits below TASK_STATE_MAX, a task switched out with none set is runnable */
+#define TASK_STATE_MASK		0x3ff
+
+static char timehist__state_char(u64 prev_state)
+{
+	const char *str = TASK_STATE_TO_CHAR_STR;
+	u64 state = prev_state & TASK_STATE_MASK;
+	unsigned int bit = state ? ffs(state) : 0;
+
+	return bit < strlen(str) ? str[bit] : '?';
+}
+
+static struct thread_runtime *thread__get_runtime(struct thread *thread)
+{
+	struct thread_runtime *r = thread__priv(thread);
+
+	if (r == NULL) {
+		r = zalloc(sizeof(*r));
+		if (r == NULL) {
+			pr_err("Failed to allocate memory for thread runtime\n");
+			return NULL;
+		}
+		thread__set_priv(thread, r);
+	}
+
+	return r;
+}
+
+static const char *timehist__task_name(struct thread *thread, char *buf,
+				       size_t size)
+{
+	if (!thread->tid)
+		return "<idle>";
+
+	if (thread->pid_ > 0 && thread->pid_ != thread->tid)
+		snprintf(buf, size, "%s[%d/%d]", thread__comm_str(thread),
+			 thread->tid, thread->pid_);
+	else
+		snprintf(buf, size, "%s[%d]", thread__comm_str(thread),
+			 thread->tid);
+
+	return buf;
+}
+
+/* leave the scheduler itself out of the callchains */
+static int timehist__symbol_filter(struct map *map __maybe_unused,
+				   struct symbol *sym)
+{
+	static const char * const sched_syms[] = {
+		"schedule", "__schedule", "preempt_schedule",
+		"preempt_schedule_common", "schedule_preempt_disabled",
+		"schedule_timeout", "io_schedule", "io_schedule_timeout",
+		"schedule_hrtimeout_range", "schedule_hrtimeout_range_clock",
+		"_cond_resched", "__cond_resched",
+	};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sched_syms); i++) {
+		if (!strcmp(sym->name, sched_syms[i])) {
+			sym->ignore = true;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static void timehist__print_header(void)
+{
+	printf("%15s %6s  %-30s  %9s  %9s  %9s  %s\n",
+	       "time", "cpu", "task name", "wait time", "sch delay",
+	       "run time", "state");
+	printf("%15s %6s  %-30s  %9s  %9s  %9s\n",
+	       "", "", "[tid/pid]", "(msec)", "(msec)", "(msec)");
+	printf("--------------- ------  ------------------------------  "
+	       "---------  ---------  ---------  -----\n");
+}
+
+static void timehist__print_sample(struct perf_sched *sched,
+				   struct perf_evsel *evsel,
+				   struct perf_sample *sample,
+				   struct thread *thread,
+				   struct thread_runtime *tr,
+				   u64 run, u64 prev_state)
+{
+	char buf[64];
+
+	printf("%15.6f [%04d]  %-30s  ", sample->time / 1e9, sample->cpu,
+	       timehist__task_name(thread, buf, sizeof(buf)));
+
+	if (thread->tid)
+		printf("%9.3f  %9.3f  %9.3f  %5c", tr->dt_wait / 1e6,
+		       tr->dt_delay / 1e6, run / 1e6,
+		       timehist__state_char(prev_state));
+	else
+		printf("%9s  %9s  %9.3f", "", "", run / 1e6);
+
+	if (sched->show_callchain && sample->callchain) {
+		struct addr_location al = {
+			.thread = thread,
+		};
+
+		printf("  ");
+		perf_evsel__print_ip(evsel, sample, &al,
+				     PRINT_IP_OPT_SYM | PRINT_IP_OPT_ONELINE,
+				     sched->max_stack);
+	}
+
+	printf("\n");
+}
+
+static int timehist_wakeup_event(struct perf_sched *sched,
+				 struct perf_evsel *evsel,
+				 struct perf_sample *sample,
+				 struct machine *machine)
+{
+	const u32 pid = perf_evsel__intval(evsel, sample, "pid");
+	struct thread *thread = machine__findnew_thread(machine, -1, pid);
+	struct thread_runtime *tr;
+
+	if (thread == NULL)
+		return -1;
+
+	tr = thread__get_runtime(thread);
+	if (tr == NULL)
+		return -1;
+
+	/*
+	 * Wakeups of a task that is still on the CPU (it was woken before
+	 * it got to schedule() out) don't start a scheduling delay.
+	 */
+	if (!tr->running && !tr->ready_to_run)
+		tr->ready_to_run = sample->time;
+
+	if (sched->show_wakeups && !sched->summary_only) {
+		struct thread *waker;
+		char buf[64], wbuf[64];
+
+		waker = machine__findnew_thread(machine, sample->pid,
+						sample->tid);
+		printf("%15.6f [%04d]  %-30s  awakened: %s\n",
+		       sample->time / 1e9, sample->cpu,
+		       waker ? timehist__task_name(waker, wbuf, sizeof(wbuf)) : "",
+		       timehist__task_name(thread, buf, sizeof(buf)));
+	}
+
+	return 0;
+}
+
+static int timehist_switch_event(struct perf_sched *sched,
+				 struct perf_evsel *evsel,
+				 struct perf_sample *sample,
+				 struct machine *machine)
+{
+	const u32 prev_pid = perf_evsel__intval(evsel, sample, "prev_pid"),
+		  next_pid = perf_evsel__intval(evsel, sample, "next_pid");
+	const u64 prev_state = perf_evsel__intval(evsel, sample, "prev_state");
+	struct thread_runtime *tr_prev, *tr_next;
+	struct thread *prev, *next;
+	struct timehist_cpu *hcpu;
+	u64 last, run = 0, t = sample->time;
+	int cpu = sample->cpu;
+
+	BUG_ON(cpu >= MAX_CPUS || cpu < 0);
+
+	if (prev_pid == next_pid)
+		return 0;
+
+	hcpu = &sched->hcpu[cpu];
+	last = hcpu->last_switch;
+	hcpu->last_switch = t;
+	hcpu->nr_switches++;
+
+	if (last) {
+		if (t < last) {
+			pr_err("hm, delta: %" PRIu64 " < 0 ?\n", t - last);
+			return -1;
+		}
+
+		run = t - last;
+		if (prev_pid)
+			hcpu->busy_time += run;
+		else
+			hcpu->idle_time += run;
+	}
+
+	prev = machine__findnew_thread(machine, -1, prev_pid);
+	next = machine__findnew_thread(machine, -1, next_pid);
+	if (prev == NULL || next == NULL)
+		return -1;
+
+	tr_prev = thread__get_runtime(prev);
+	tr_next = thread__get_runtime(next);
+	if (tr_prev == NULL || tr_next == NULL)
+		return -1;
+
+	/* the first switch on a CPU doesn't tell how long prev ran */
+	if (last) {
+		if (prev_pid) {
+			tr_prev->nr_runs++;
+			tr_prev->total_run_time += run;
+		}
+
+		if (!sched->summary_only)
+			timehist__print_sample(sched, evsel, sample, prev,
+					       tr_prev, run, prev_state);
+	}
+
+	if (prev_pid) {
+		tr_prev->running = false;
+		tr_prev->last_time = t;
+		tr_prev->ready_to_run = (prev_state & TASK_STATE_MASK) ? 0 : t;
+		tr_prev->dt_wait = tr_prev->dt_delay = 0;
+	}
+
+	if (next_pid) {
+		if (tr_next->ready_to_run) {
+			tr_next->dt_delay = t - tr_next->ready_to_run;
+			if (tr_next->last_time &&
+			    tr_next->ready_to_run > tr_next->last_time)
+				tr_next->dt_wait = tr_next->ready_to_run -
+						   tr_next->last_time;
+
+			tr_next->total_delay_time += tr_next->dt_delay;
+			if (tr_next->dt_delay > tr_next->max_delay) {
+				tr_next->max_delay = tr_next->dt_delay;
+				tr_next->max_delay_at = t;
+			}
+		} else if (tr_next->last_time) {
+			/* wakeup lost or from before the trace started */
+			tr_next->dt_wait = t - tr_next->last_time;
+		}
+
+		tr_next->ready_to_run = 0;
+		tr_next->running = true;
+		tr_next->last_time = t;
+	}
+
+	return 0;
+}
+
+static void timehist__print_task(struct thread *thread)
+{
+	struct thread_runtime *tr = thread__priv(thread);
+	char buf[64];
+
+	if (tr == NULL || !tr->nr_runs || !thread->tid)
+		return;
+
+	printf("  %-30s  %9" PRIu64 "  %12.3f  %12.3f  %12.3f  %15.6f\n",
+	       timehist__task_name(thread, buf, sizeof(buf)), tr->nr_runs,
+	       tr->total_run_time / 1e6,
+	       tr->total_delay_time / 1e6 / tr->nr_runs,
+	       tr->max_delay / 1e6, tr->max_delay_at / 1e9);
+}
+
+static void timehist__print_summary(struct perf_sched *sched,
+				    struct perf_session *session)
+{
+	struct machine *machine = &session->machines.host;
+	struct thread *thread;
+	struct rb_node *nd;
+	int cpu;
+
+	printf("\nRuntime summary\n");
+	printf("  %-30s  %9s  %12s  %12s  %12s  %15s\n",
+	       "comm[tid/pid]", "sched-in", "run (msec)", "avg delay",
+	       "max delay", "max delay at");
+	printf("  ------------------------------  ---------  ------------"
+	       "  ------------  ------------  ---------------\n");
+
+	for (nd = rb_first(&machine->threads); nd; nd = rb_next(nd)) {
+		thread = rb_entry(nd, struct thread, rb_node);
+		timehist__print_task(thread);
+	}
+
+	list_for_each_entry(thread, &machine->dead_threads, node)
+		timehist__print_task(thread);
+
+	printf("\nIdle stats\n");
+	for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+		struct timehist_cpu *hcpu = &sched->hcpu[cpu];
+		u64 total = hcpu->idle_time + hcpu->busy_time;
+
+		if (!hcpu->nr_switches)
+			continue;
+
+		printf("  CPU %4d  idle %12.3f msec (%6.2f%%)  run %12.3f msec"
+		       "  %9" PRIu64 " switches\n", cpu,
+		       hcpu->idle_time / 1e6,
+		       total ? 100.0 * hcpu->idle_time / total : 0.0,
+		       hcpu->busy_time / 1e6, hcpu->nr_switches);
+	}
+	printf("\n");
+}
+
 static int process_sched_wakeup_event(struct perf_tool *tool,
 				      struct perf_evsel *evsel,
 				      struct perf_sample *sample,
@@ -1463,6 +1795,10 @@ static int perf_sched__read_events(struct perf_sched *sched,
 
 	symbol__init(&session->header.env);
 
+	if (sched->show_callchain)
+		machines__set_symbol_filter(&session->machines,
+					    timehist__symbol_filter);
+
 	if (perf_session__set_tracepoints_handlers(session, handlers))
 		goto out_delete;
 
@@ -1598,6 +1934,36 @@ static int perf_sched__replay(struct perf_sched *sched)
 	return 0;
 }
 
+static int perf_sched__timehist(struct perf_sched *sched)
+{
+	struct perf_session *session;
+	int err = -1;
+
+	sched->hcpu = calloc(MAX_CPUS, sizeof(*sched->hcpu));
+	if (sched->hcpu == NULL)
+		return -ENOMEM;
+
+	symbol_conf.use_callchain = sched->show_callchain;
+
+	setup_pager();
+
+	if (!sched->summary_only)
+		timehist__print_header();
+
+	if (perf_sched__read_events(sched, &session))
+		goto out;
+
+	if (sched->summary || sched->summary_only)
+		timehist__print_summary(sched, session);
+
+	print_bad_events(sched);
+	perf_session__delete(session);
+	err = 0;
+out:
+	zfree(&sched->hcpu);
+	return err;
+}
+
 static void setup_sorting(struct perf_sched *sched, const struct option *options,
 			  const char * const usage_msg[])
 {
@@ -1674,6 +2040,7 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.profile_cpu	      = -1,
 		.next_shortname1      = 'A',
 		.next_shortname2      = '0',
+		.max_stack	      = 5,
 	};
 	const struct option latency_options[] = {
 	OPT_STRING('s', "sort", &sched.sort_order, "key[,key2...]",
@@ -1695,6 +2062,27 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		    "dump raw trace in ASCII"),
 	OPT_END()
 	};
+	const struct option timehist_options[] = {
+	OPT_STRING('k', "vmlinux", &symbol_conf.vmlinux_name,
+		   "file", "vmlinux pathname"),
+	OPT_STRING(0, "kallsyms", &symbol_conf.kallsyms_name,
+		   "file", "kallsyms pathname"),
+	OPT_BOOLEAN('g', "call-graph", &sched.show_callchain,
+		    "Display call chains if present"),
+	OPT_UINTEGER(0, "max-stack", &sched.max_stack,
+		     "Maximum number of functions to display in backtrace"),
+	OPT_BOOLEAN('s', "summary", &sched.summary_only,
+		    "Show only the per-task and per-CPU summary"),
+	OPT_BOOLEAN('S', "with-summary", &sched.summary,
+		    "Show the per-task and per-CPU summary after the events"),
+	OPT_BOOLEAN('w', "wakeups", &sched.show_wakeups,
+		    "Show wakeup events"),
+	OPT_INCR('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_END()
+	};
 	const struct option sched_options[] = {
 	OPT_STRING('i', "input", &input_name, "file",
 		    "input file name"),
@@ -1712,8 +2100,13 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		"perf sched replay [<options>]",
 		NULL
 	};
+	const char * const timehist_usage[] = {
+		"perf sched timehist [<options>]",
+		NULL
+	};
 	const char *const sched_subcommands[] = { "record", "latency", "map",
-						  "replay", "script", NULL };
+						  "replay", "script",
+						  "timehist", NULL };
 	const char *sched_usage[] = {
 		NULL,
 		NULL
@@ -1732,6 +2125,10 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 		.switch_event	    = replay_switch_event,
 		.fork_event	    = replay_fork_event,
 	};
+	struct trace_sched_handler timehist_ops  = {
+		.wakeup_event	    = timehist_wakeup_event,
+		.switch_event	    = timehist_switch_event,
+	};
 	unsigned int i;
 
 	for (i = 0; i < ARRAY_SIZE(sched.curr_pid); i++)
@@ -1771,6 +2168,15 @@ int cmd_sched(int argc, const char **argv, const char *prefix __maybe_unused)
 				usage_with_options(replay_usage, replay_options);
 		}
 		return perf_sched__replay(&sched);
+	} else if (!strcmp(argv[0], "timehist")) {
+		sched.tp_handler = &timehist_ops;
+		if (argc) {
+			argc = parse_options(argc, argv, timehist_options,
+					     timehist_usage, 0);
+			if (argc)
+				usage_with_options(timehist_usage, timehist_options);
+		}
+		return perf_sched__timehist(&sched);
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
@@ -143,6 +143,9 @@ static unsigned int		unit_width			= 4; /* strlen("unit") */
 static bool			forever				= false;
 static struct timespec		ref_time;
 static struct cpu_map		*aggr_map;
+static struct cgroup_sel	*table_cgroups;
+static int			nr_table_cgroups;
+static struct stats		*table_stats;
 static int			(*aggr_get_id)(struct cpu_map *m, int cpu);
 
 static volatile int done = 0;
@@ -289,6 +292,10 @@ static void perf_stat__reset_stats(struct perf_evlist *evlist)
 		sizeof(runtime_transaction_stats));
 	memset(runtime_elision_stats, 0, sizeof(runtime_elision_stats));
 	memset(&walltime_nsecs_stats, 0, sizeof(walltime_nsecs_stats));
+
+	if (table_stats)
+		memset(table_stats, 0, evlist->nr_entries * nr_table_cgroups *
+		       sizeof(*table_stats));
 }
 
 static int create_perf_stat_counter(struct perf_evsel *evsel)
@@ -301,6 +308,10 @@ static int create_perf_stat_counter(struct perf_evsel *evsel)
 
 	attr->inherit = !no_inherit;
 
+	/* a table event has to see every context switch on its cpu */
+	if (nr_table_cgroups)
+		attr->pinned = 1;
+
 	if (target__has_cpu(&target))
 		return perf_evsel__open_per_cpu(evsel, perf_evsel__cpus(evsel));
 
@@ -313,6 +324,84 @@ static int create_perf_stat_counter(struct perf_evsel *evsel)
 	return perf_evsel__open_per_thread(evsel, evsel_list->threads);
 }
 
+/*
+ * --for-each-cgroup: rather than one event per cgroup per cpu, open
+ * each event once per cpu and have the kernel split its count between
+ * the cgroups at context switch time.
+ */
+static int parse_cgroup_table(const struct option *opt __maybe_unused,
+			      const char *str, int unset __maybe_unused)
+{
+	char *s, *name, *saveptr = NULL;
+	struct cgroup_sel *cgrp;
+
+	s = strdup(str);
+	if (s == NULL)
+		return -1;
+
+	for (name = strtok_r(s, ",", &saveptr); name;
+	     name = strtok_r(NULL, ",", &saveptr)) {
+		cgrp = realloc(table_cgroups,
+			       (nr_table_cgroups + 1) * sizeof(*cgrp));
+		if (cgrp == NULL)
+			return -1;
+
+		table_cgroups = cgrp;
+		cgrp += nr_table_cgroups;
+		cgrp->name   = name;
+		cgrp->refcnt = 1;
+		cgrp->fd     = open_cgroup(name);
+		if (cgrp->fd < 0)
+			return -1;
+
+		nr_table_cgroups++;
+	}
+
+	return nr_table_cgroups ? 0 : -1;
+}
+
+static struct stats *table_stat(struct perf_evsel *evsel, int cgrp)
+{
+	return &table_stats[evsel->idx * nr_table_cgroups + cgrp];
+}
+
+static int attach_cgroup_table(struct perf_evsel *counter)
+{
+	int cpu, fd, i;
+
+	for (cpu = 0; cpu < perf_evsel__nr_cpus(counter); cpu++) {
+		fd = *(int *)xyarray__entry(counter->fd, cpu, 0);
+
+		for (i = 0; i < nr_table_cgroups; i++) {
+			if (ioctl(fd, PERF_EVENT_IOC_ATTACH_CGROUP,
+				  table_cgroups[i].fd) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void read_cgroup_table(struct perf_evsel *counter)
+{
+	struct perf_event_cgroup_count cc = { .cgroup_fd = 0, };
+	int cpu, fd, i;
+	u64 val;
+
+	for (i = 0; i < nr_table_cgroups; i++) {
+		val = 0;
+		cc.cgroup_fd = table_cgroups[i].fd;
+
+		for (cpu = 0; cpu < perf_evsel__nr_cpus(counter); cpu++) {
+			fd = *(int *)xyarray__entry(counter->fd, cpu, 0);
+			if (ioctl(fd, PERF_EVENT_IOC_READ_CGROUP, &cc) == 0)
+				val += cc.count;
+		}
+
+		update_stats(table_stat(counter, i), val);
+	}
+}
+
 /*
  * Does the counter have nsecs as a unit?
  */
@@ -674,6 +763,17 @@ static int __run_perf_stat(int argc, const char **argv)
 		}
 		counter->supported = true;
 
+		if (nr_table_cgroups && attach_cgroup_table(counter)) {
+			ui__error("failed to attach cgroups to %s: %s\n",
+				  perf_evsel__name(counter),
+				  strerror_r(errno, msg, sizeof(msg)));
+
+			if (child_pid != -1)
+				kill(child_pid, SIGTERM);
+
+			return -1;
+		}
+
 		l = strlen(counter->unit);
 		if (l > unit_width)
 			unit_width = l;
@@ -724,6 +824,13 @@ static int __run_perf_stat(int argc, const char **argv)
 
 	update_stats(&walltime_nsecs_stats, t1 - t0);
 
+	if (nr_table_cgroups) {
+		evlist__for_each(evsel_list, counter) {
+			if (counter->supported)
+				read_cgroup_table(counter);
+		}
+	}
+
 	if (aggr_mode == AGGR_GLOBAL) {
 		evlist__for_each(evsel_list, counter) {
 			read_counter_aggr(counter);
@@ -1389,6 +1496,58 @@ static void print_counter(struct perf_evsel *counter, char *prefix)
 	}
 }
 
+static void print_cgroup_table(void)
+{
+	struct perf_evsel *counter, *cycles = NULL;
+	double avg, total;
+	const char *fmt;
+	int i;
+
+	evlist__for_each(evsel_list, counter) {
+		if (counter->supported &&
+		    perf_evsel__match(counter, HARDWARE, HW_CPU_CYCLES))
+			cycles = counter;
+	}
+
+	if (csv_output)
+		fmt = "%.0f%s";
+	else
+		fmt = big_num ? "%'18.0f%s" : "%18.0f%s";
+
+	for (i = 0; i < nr_table_cgroups; i++) {
+		if (!csv_output)
+			fprintf(output, "\n");
+
+		evlist__for_each(evsel_list, counter) {
+			if (!counter->supported)
+				continue;
+
+			avg = avg_stats(table_stat(counter, i));
+			fprintf(output, fmt, avg * counter->scale, csv_sep);
+			if (counter->unit)
+				fprintf(output, "%-*s%s",
+					csv_output ? 0 : unit_width,
+					counter->unit, csv_sep);
+			fprintf(output, "%-*s%s%s", csv_output ? 0 : 25,
+				perf_evsel__name(counter), csv_sep,
+				table_cgroups[i].name);
+
+			if (run_count > 1)
+				print_noise_pct(stddev_stats(table_stat(counter, i)),
+						avg);
+
+			if (!csv_output && cycles &&
+			    perf_evsel__match(counter, HARDWARE, HW_INSTRUCTIONS)) {
+				total = avg_stats(table_stat(cycles, i));
+				if (total)
+					fprintf(output, " #   %5.2f  insns per cycle",
+						avg / total);
+			}
+			fputc('\n', output);
+		}
+	}
+}
+
 static void print_stat(int argc, const char **argv)
 {
 	struct perf_evsel *counter;
@@ -1435,6 +1594,9 @@ static void print_stat(int argc, const char **argv)
 		break;
 	}
 
+	if (nr_table_cgroups)
+		print_cgroup_table();
+
 	if (!csv_output) {
 		if (!null_run)
 			fprintf(output, "\n");
@@ -1741,6 +1903,9 @@ int cmd_stat(int argc, const char **argv, const char *prefix __maybe_unused)
 		   "print counts with custom separator"),
 	OPT_CALLBACK('G', "cgroup", &evsel_list, "name",
 		     "monitor event in cgroup name only", parse_cgroups),
+	OPT_CALLBACK(0, "for-each-cgroup", NULL, "name,...",
+		     "also split each count between the listed cgroups",
+		     parse_cgroup_table),
 	OPT_STRING('o', "output", &output_name, "file", "output file name"),
 	OPT_BOOLEAN(0, "append", &append_file, "append to the output file"),
 	OPT_INTEGER(0, "log-fd", &output_fd,
@@ -1858,9 +2023,36 @@ int cmd_stat(int argc, const char **argv, const char *prefix __maybe_unused)
 		goto out;
 	}
 
+	if (nr_table_cgroups) {
+		if (!target__has_cpu(&target) || nr_cgroups || interval ||
+		    aggr_mode != AGGR_GLOBAL) {
+			fprintf(stderr, "--for-each-cgroup is only available in "
+				"system-wide mode, without -G, -I or -A\n");
+			parse_options_usage(stat_usage, options, "for-each-cgroup", 0);
+			goto out;
+		}
+	}
+
 	if (add_default_attributes())
 		goto out;
 
+	if (nr_table_cgroups) {
+		struct perf_evsel *counter;
+
+		evlist__for_each(evsel_list, counter) {
+			if (group || !perf_evsel__is_group_leader(counter)) {
+				fprintf(stderr, "--for-each-cgroup can not "
+					"count event groups\n");
+				goto out;
+			}
+		}
+
+		table_stats = calloc(evsel_list->nr_entries * nr_table_cgroups,
+				     sizeof(*table_stats));
+		if (table_stats == NULL)
+			goto out;
+	}
+
 	target__validate(&target);
 
 	if (perf_evlist__create_maps(evsel_list, &target) < 0) {
@@ -11,6 +11,7 @@ struct cgroup_sel {
 
 
 extern int nr_cgroups; /* number of explicit cgroups defined */
+extern int open_cgroup(const char *name);
 extern void close_cgroup(struct cgroup_sel *cgrp);
 extern int parse_cgroups(const struct option *opt, const char *str, int unset);
 
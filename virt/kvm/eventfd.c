@@ -73,13 +73,16 @@ struct _irqfd_resampler {
 };
 
 struct _irqfd {
-	/* Used for MSI fast-path */
+	/* Used for the atomic fast-path */
 	struct kvm *kvm;
 	wait_queue_t wait;
-	/* Update side is protected by irqfds.lock */
+	/*
+	 * Route of the gsi if it has a single destination, type 0 if not.
+	 * Update side is protected by irqfds.lock
+	 */
 	struct kvm_kernel_irq_routing_entry irq_entry;
 	seqcount_t irq_entry_sc;
-	/* Used for level IRQ fast-path */
+	/* Used for the workqueue slow-path */
 	int gsi;
 	struct work_struct inject;
 	/* The resampler used by this irqfd (resampler-only) */
@@ -218,6 +221,22 @@ irqfd_deactivate(struct _irqfd *irqfd)
 	queue_work(irqfd_cleanup_wq, &irqfd->shutdown);
 }
 
+/*
+ * Inject from the eventfd wakeup, which cannot sleep.  Architectures
+ * return -EWOULDBLOCK for anything they cannot inject there, and the
+ * irqfd falls back to its workqueue.  By default only MSIs qualify.
+ */
+int __weak kvm_arch_irqfd_inject_inatomic(struct kvm_kernel_irq_routing_entry *e,
+					  struct kvm *kvm, int irq_source_id,
+					  bool resample)
+{
+	if (e->type == KVM_IRQ_ROUTING_MSI)
+		return kvm_set_msi(e, kvm, KVM_USERSPACE_IRQ_SOURCE_ID, 1,
+				   false);
+
+	return -EWOULDBLOCK;
+}
+
 /*
  * Called with wqh->lock held and interrupts disabled
  */
@@ -229,7 +248,7 @@ irqfd_wakeup(wait_queue_t *wait, unsigned mode, int sync, void *key)
 	struct kvm_kernel_irq_routing_entry irq;
 	struct kvm *kvm = irqfd->kvm;
 	unsigned seq;
-	int idx;
+	int idx, source_id;
 
 	if (flags & POLLIN) {
 		idx = srcu_read_lock(&kvm->irq_srcu);
@@ -237,11 +256,13 @@ irqfd_wakeup(wait_queue_t *wait, unsigned mode, int sync, void *key)
 			seq = read_seqcount_begin(&irqfd->irq_entry_sc);
 			irq = irqfd->irq_entry;
 		} while (read_seqcount_retry(&irqfd->irq_entry_sc, seq));
+		source_id = irqfd->resampler ?
+			KVM_IRQFD_RESAMPLE_IRQ_SOURCE_ID :
+			KVM_USERSPACE_IRQ_SOURCE_ID;
 		/* An event has been signaled, inject an interrupt */
-		if (irq.type == KVM_IRQ_ROUTING_MSI)
-			kvm_set_msi(&irq, kvm, KVM_USERSPACE_IRQ_SOURCE_ID, 1,
-					false);
-		else
+		if (!irq.type ||
+		    kvm_arch_irqfd_inject_inatomic(&irq, kvm, source_id,
+						   irqfd->resampler) == -EWOULDBLOCK)
 			schedule_work(&irqfd->inject);
 		srcu_read_unlock(&kvm->irq_srcu, idx);
 	}
@@ -281,22 +302,21 @@ irqfd_ptable_queue_proc(struct file *file, wait_queue_head_t *wqh,
 /* Must be called under irqfds.lock */
 static void irqfd_update(struct kvm *kvm, struct _irqfd *irqfd)
 {
-	struct kvm_kernel_irq_routing_entry *e;
 	struct kvm_kernel_irq_routing_entry entries[KVM_NR_IRQCHIPS];
-	int i, n_entries;
+	int n_entries;
 
 	n_entries = kvm_irq_map_gsi(kvm, entries, irqfd->gsi);
 
 	write_seqcount_begin(&irqfd->irq_entry_sc);
 
-	irqfd->irq_entry.type = 0;
-
-	e = entries;
-	for (i = 0; i < n_entries; ++i, ++e) {
-		/* Only fast-path MSI. */
-		if (e->type == KVM_IRQ_ROUTING_MSI)
-			irqfd->irq_entry = *e;
-	}
+	/*
+	 * Only fast-path a gsi with a single destination, a partial
+	 * failure could not be retried from the workqueue.
+	 */
+	if (n_entries == 1)
+		irqfd->irq_entry = entries[0];
+	else
+		irqfd->irq_entry.type = 0;
 
 	write_seqcount_end(&irqfd->irq_entry_sc);
 }